@@ -5,7 +5,22 @@ inline uint64_t os::cycles_since_boot() noexcept
 {
   return os::Arch::cpu_cycles();
 }
+namespace os::detail {
+  // nanoseconds per cycle in 32.32 fixed point, set with the CPU frequency
+  extern uint64_t nanos_per_cycle;
+
+  inline uint64_t cycles_to_nanos(uint64_t cycles) noexcept
+  {
+#ifdef __SIZEOF_INT128__
+    // a multiply, not a division, for every timestamp
+    return ((unsigned __int128) cycles * nanos_per_cycle) >> 32;
+#else
+    return cycles / util::GHz(os::cpu_freq()).count();
+#endif
+  }
+}
+
 inline uint64_t os::nanos_since_boot() noexcept
 {
-  return cycles_since_boot() / util::GHz(os::cpu_freq()).count();
+  return detail::cycles_to_nanos(cycles_since_boot());
 }
@@ -0,0 +1,123 @@
+#pragma once
+#ifndef FS_BLOCK_CACHE_HPP
+#define FS_BLOCK_CACHE_HPP
+
+#include <hw/block_device.hpp>
+#include <util/flat_map.hpp>
+#include <memory>
+#include <vector>
+
+namespace fs {
+
+  /**
+   * A cache of recently used blocks in front of any block device,
+   * within a fixed memory budget. Mount it in place of the device:
+   *
+   *   fs::Block_cache cache {device, 4 << 20};
+   *   fs::VFS::mount("/disk", cache, "cached disk");
+   *
+   * Reads of blocks that are all cached are served right away, and the
+   * least recently used blocks are evicted to make room for new ones.
+   * A read that continues where the last one ended reads ahead.
+   *
+   * @note The cache doesn't see writes made to the device directly,
+   *       invalidate() the blocks after writing them
+   */
+  class Block_cache : public hw::Block_device {
+  public:
+    static constexpr size_t DEFAULT_READAHEAD = 32;
+
+    /**
+     * @param dev        The device to cache blocks of, must outlive the cache
+     * @param budget     The most memory to keep blocks in, in bytes
+     * @param readahead  The most blocks to read ahead, on sequential reads
+     */
+    Block_cache(hw::Block_device& dev, size_t budget,
+                size_t readahead = DEFAULT_READAHEAD);
+
+    std::string device_name() const override {
+      return "bcache" + std::to_string(id());
+    }
+
+    const char* driver_name() const noexcept override
+    { return "Block_cache"; }
+
+    block_t size() const noexcept override
+    { return dev_.size(); }
+
+    block_t block_size() const noexcept override
+    { return dev_.block_size(); }
+
+    void read(block_t blk, size_t cnt, on_read_func reader) override;
+
+    buffer_t read_sync(block_t blk, size_t cnt) override;
+
+    const char* mapped(block_t blk, size_t cnt) const noexcept override
+    { return dev_.mapped(blk, cnt); }
+
+    /** Drop the cached copies of blocks, eg. after writing them */
+    void invalidate(block_t blk, size_t cnt);
+
+    /** Drop all cached blocks */
+    void clear();
+
+    void deactivate() override {}
+
+    /** The device blocks are cached from */
+    hw::Block_device& device() noexcept
+    { return dev_; }
+
+    /** The most blocks that can be cached */
+    size_t capacity() const noexcept
+    { return entries_.size(); }
+
+    /** Blocks currently cached */
+    size_t cached() const noexcept
+    { return used_; }
+
+    /** Reads served from the cache, and reads that went to the device */
+    uint64_t hits() const noexcept
+    { return hits_; }
+    uint64_t misses() const noexcept
+    { return misses_; }
+
+  private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    struct Entry {
+      block_t  blk;
+      // the least recently used list, most recent first
+      uint32_t prev = NONE;
+      uint32_t next = NONE;
+    };
+
+    char* data_of(uint32_t idx) noexcept
+    { return &arena_[idx * block_size()]; }
+
+    // copy out the blocks when all of them are cached
+    buffer_t lookup(block_t blk, size_t cnt);
+    // cache blocks read from the device
+    void insert(block_t blk, size_t cnt, const uint8_t* data);
+    // blocks to read ahead of a read from the device
+    size_t readahead_for(block_t blk, size_t cnt) noexcept;
+    void unlink(uint32_t idx) noexcept;
+    void push_front(uint32_t idx) noexcept;
+
+    hw::Block_device&    dev_;
+    const size_t         readahead_;
+    std::unique_ptr<char[]> arena_;
+    std::vector<Entry>   entries_;
+    Flat_map<block_t, uint32_t> index_;
+    uint32_t lru_head_ = NONE;
+    uint32_t lru_tail_ = NONE;
+    uint32_t used_     = 0;
+    // where the last read from the device ended
+    block_t  last_end_ = ~block_t(0);
+
+    uint64_t& hits_;
+    uint64_t& misses_;
+    uint64_t& readaheads_;
+  }; //< class Block_cache
+
+} //< namespace fs
+
+#endif //< FS_BLOCK_CACHE_HPP
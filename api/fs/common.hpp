@@ -10,6 +10,7 @@
 #include "path.hpp"
 #include <common>
 #include <delegate>
+#include <gsl/span>
 #include <hw/block_device.hpp>
 
 namespace fs {
@@ -22,6 +23,9 @@ namespace fs {
    */
   using buffer_t = os::mem::buf_ptr;
 
+  /** Bytes of a file where they are, owned by the device **/
+  using View = gsl::span<const uint8_t>;
+
   /** Construct a shared vector **/
   template <typename... Args>
   buffer_t construct_buffer(Args&&... args) {
@@ -183,6 +187,20 @@ namespace fs {
   using on_ls_func    = delegate<void(error_t, Dirvec_ptr)>;
   using on_read_func  = delegate<void(error_t, buffer_t)>;
   using on_stat_func  = delegate<void(error_t, Dirent)>;
+  // the error, if any, and the bytes read in all
+  using on_readv_func = delegate<void(error_t, size_t)>;
+
+  /**
+   * @brief A part of a file to read straight into memory of the caller.
+   * The length is cut at the end of the file, as for reads.
+   */
+  struct Read_request
+  {
+    const Dirent* ent;  // only used until the read is started
+    uint64_t      pos;
+    uint64_t      len;
+    void*         dest;
+  };
 
   struct List
   {
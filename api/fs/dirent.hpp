@@ -97,6 +97,10 @@ namespace fs {
     /** Read the whole file, sync, to string **/
     inline std::string read();
 
+    /** View the file where it is, without copying, see File_system::view **/
+    inline View view(uint64_t pos, uint64_t n) const;
+    inline View view() const;
+
     /** List contents async **/
     inline void ls(on_ls_func fn) const;
 
@@ -152,6 +156,14 @@ namespace fs {
     return read(0, size_).to_string();
   }
 
+  View Dirent::view(uint64_t pos, uint64_t n) const {
+    return fs_->view(*this, pos, n);
+  }
+
+  View Dirent::view() const {
+    return view(0, size_);
+  }
+
 
   /** List contents async **/
   void Dirent::ls(on_ls_func fn) const {
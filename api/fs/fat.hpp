@@ -6,10 +6,14 @@
 #include <fs/filesystem.hpp>
 #include <fs/dirent.hpp>
 #include <hw/block_device.hpp>
+#include <kernel/mem_pressure.hpp>
 #include <functional>
 #include <cstdint>
+#include <list>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace fs
 {
@@ -33,6 +37,8 @@ namespace fs
     /** Read @n bytes from file pointed by @entry starting at position @pos */
     void   read(const Dirent&, uint64_t pos, uint64_t n, on_read_func) const override;
     Buffer read(const Dirent&, uint64_t pos, uint64_t n) const override;
+    void   readv(std::vector<Read_request>, on_readv_func) const override;
+    const char* map(const Dirent&, uint64_t pos, uint64_t n) const override;
 
     // return information about a filesystem entity
     void   stat(Path_ptr, on_stat_func, const Dirent* const start) const override;
@@ -61,7 +67,7 @@ namespace fs
 
     // constructor
     FAT(hw::Block_device& dev);
-    virtual ~FAT() = default;
+    virtual ~FAT();
 
   private:
     // FAT types
@@ -93,13 +99,38 @@ namespace fs
         return reserved + (cl * 4 / sector_size);
     }
 
+    // a run of contiguous sectors in a cluster chain
+    struct Extent {
+      uint32_t sector;
+      uint32_t count;
+    };
+    using Extents = std::vector<Extent>;
+
     // initialize filesystem by providing base sector
     void init(const void* base_sector);
+    // keep a copy of the FAT, to follow cluster chains without reading it
+    void load_table(const uint8_t* data, size_t len);
+    // the next cluster in a chain, or 0 at the end of it
+    uint32_t next_cluster(uint32_t cl) const noexcept;
+    // the extents of the chain starting at @cluster, cached on first use
+    const Extents& extents(uint32_t cluster) const;
+    // the extents to read for @nsect sectors from @sector into a file
+    Extents file_range(uint32_t cluster, uint32_t sector, uint32_t nsect) const;
+    // cut the sectors read down to the @n bytes asked for
+    static buffer_t trim_read(buffer_t data, uint32_t internal_ofs, uint64_t n);
     // return a list of entries from directory entries at @sector
     typedef delegate<void(error_t, Dirvec_ptr)> on_internal_ls_func;
     void int_ls(uint32_t sector, Dirvec_ptr, on_internal_ls_func) const;
     bool int_dirent(uint32_t sector, const void* data, dirvector&) const;
 
+    // the cached entry @name in the directory at @cluster, or nullptr
+    const Dirent* dentry_find(uint32_t cluster, const std::string& name) const;
+    // cache an entry, an INVALID_ENTITY one for a name that doesn't exist
+    void dentry_insert(uint32_t cluster, const std::string& name, const Dirent&) const;
+    // look up @name in the directory at @cluster, from the cache or the disk
+    void    lookup(uint32_t cluster, const std::string& name, on_stat_func) const;
+    error_t lookup(uint32_t cluster, const std::string& name, Dirent& result) const;
+
     // tree traversal
     typedef delegate<void(error_t, Dirvec_ptr)> cluster_func;
     // async tree traversal
@@ -132,8 +163,28 @@ namespace fs
     uint32_t data_index;    // index of first data sector (relative to partition)
     uint32_t data_sectors;  // number of data sectors
 
-    // simplistic cache for stat results
-    std::map<std::string, Dirent> stat_cache;
+    // recently looked up entries, by the directory they are in and name
+    struct Dentry_key {
+      uint32_t    parent;
+      std::string name;
+      bool operator== (const Dentry_key& other) const noexcept
+      { return parent == other.parent and name == other.name; }
+    };
+    struct Dentry_hash {
+      size_t operator() (const Dentry_key& key) const noexcept
+      { return std::hash<std::string>{}(key.name) ^ (key.parent * 0x9E3779B97F4A7C15ull); }
+    };
+    // most recently used first
+    using Dentry_list = std::list<std::pair<Dentry_key, Dirent>>;
+    mutable Dentry_list dentry_lru;
+    mutable std::unordered_map<Dentry_key, Dentry_list::iterator, Dentry_hash> dentries;
+    // the FAT as on disk, empty when too large to keep
+    std::vector<uint8_t> fat_table;
+    // extents of files read, by their first cluster
+    mutable std::map<uint32_t, Extents> extent_cache;
+    // gives the caches back when memory is low
+    int shrinker_;
+    size_t shrink(os::mem::Pressure);
   };
 
 } // fs
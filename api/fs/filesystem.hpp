@@ -4,6 +4,7 @@
 
 #include "common.hpp"
 #include <string>
+#include <vector>
 #include <cstdint>
 
 namespace fs {
@@ -35,6 +36,30 @@ namespace fs {
     /** Read - sync */
     virtual Buffer read(const Dirent&, uint64_t pos, uint64_t n) const = 0;
 
+    /**
+     * Read many parts of files, each into the memory it points to, then call
+     * on_read once. A file system can merge them into fewer device reads,
+     * the default is one read() each.
+     */
+    virtual void readv(std::vector<Read_request>, on_readv_func) const;
+
+    /**
+     * The @n bytes of direntry from position @pos where they are, without
+     * copying, or nullptr if the file is not on a device kept in memory
+     */
+    virtual const char* map(const Dirent&, uint64_t /*pos*/, uint64_t /*n*/) const
+    { return nullptr; }
+
+    /**
+     * The @n bytes of direntry from position @pos, up to the end of the file,
+     * as a view of them where they are. The view is empty if they are not on
+     * a device kept in memory, and it is only valid while the device is.
+     */
+    View view(const Dirent&, uint64_t pos, uint64_t n) const;
+
+    /** View an entire file without copying it, sync */
+    View view_file(const std::string& path) const;
+
     /** Return information about a file or directory - async */
     virtual void stat(Path_ptr, on_stat_func fn, const Dirent* const = nullptr) const = 0;
 
@@ -36,6 +36,8 @@ namespace fs {
 
     buffer_t read_sync(block_t blk, size_t cnt) override;
 
+    const char* mapped(block_t blk, size_t cnt) const noexcept override;
+
     explicit MemDisk() noexcept;
     explicit MemDisk(const char* start, const char* end) noexcept;
 
@@ -9,6 +9,7 @@
 #include <util/typename.hpp>
 
 #include <set>
+#include <delegate>
 #include <hw/device.hpp>
 
 namespace os::detail {
@@ -34,6 +35,9 @@ namespace os::detail {
                                    std::equal_to<K>,
                                    Allocator<std::pair<const K,V>>>;
 
+    // constructs a part on first use, see add_lazy()
+    using Part_factory = delegate<void*()>;
+
     struct Part {
       enum class Storage : uint8_t {
         machine, heap
@@ -42,6 +46,9 @@ namespace os::detail {
       void* ptr;
       Storage storage;
       std::type_index t_idx;
+      Part_factory factory = nullptr;
+
+      bool active() const noexcept { return ptr != nullptr; }
     };
 
     using Parts_vec   = Vec<Part>;
@@ -83,9 +90,9 @@ namespace os::detail {
     T& get(int i) {
       const std::type_index t_idx = std::type_index(typeid(T));
       auto& vec = get_vector<T>();
-      auto& part = vec.at(i);
-      Expects(part.t_idx == t_idx);
-      T* tptr = (T*)part.ptr;
+      Expects(vec.at(i).t_idx == t_idx);
+      if (UNLIKELY(not vec[i].active())) activate(vec, i);
+      T* tptr = (T*)vec[i].ptr;
       return *tptr;
     }
 
@@ -94,14 +101,40 @@ namespace os::detail {
       auto& vec = get_vector<T>();
 
       // Populate new vector of ref-wrappers
+      os::Machine::Vector<T> new_parts(ptr_alloc_);
+      for (size_t i = 0; i < vec.size(); i++) {
+        if (UNLIKELY(not vec[i].active())) activate(vec, i);
+        auto ref = std::ref(*(reinterpret_cast<T*>(vec[i].ptr)));
+        new_parts.emplace_back(ref);
+      }
+      return new_parts;
+    }
+
+    template <typename T>
+    os::Machine::Vector<T> get_active() {
+      auto& vec = get_vector<T>();
+
       os::Machine::Vector<T> new_parts(ptr_alloc_);
       for (auto& part : vec) {
+        if (not part.active()) continue;
         auto ref = std::ref(*(reinterpret_cast<T*>(part.ptr)));
         new_parts.emplace_back(ref);
       }
       return new_parts;
     }
 
+    template <typename T>
+    bool is_active(int i) {
+      return get_vector<T>().at(i).active();
+    }
+
+    template <typename T>
+    ssize_t next_index() {
+      if (activating_ >= 0 and activating_type_ == std::type_index(typeid(T)))
+        return activating_;
+      return count<T>();
+    }
+
     template <typename T>
     ssize_t add(T* part, Part::Storage storage) {
       const std::type_index t_idx = std::type_index(typeid(T));
@@ -128,6 +161,13 @@ namespace os::detail {
       return vec.size() - 1;
     }
 
+    template <typename T>
+    ssize_t add_lazy(Part_factory factory) {
+      const ssize_t idx = add<T>(nullptr, Part::Storage::heap);
+      if (idx >= 0) get_vector<T>().at(idx).factory = std::move(factory);
+      return idx;
+    }
+
     template <typename T, typename... Args>
     ssize_t add_new(Args&&... args) {
       auto* mem = memory().allocate(sizeof(T));
@@ -167,6 +207,32 @@ namespace os::detail {
     Ptr_alloc ptr_alloc_;
     Parts_map parts_;
     Device_types device_types_;
+    // the lazy part being constructed, for next_index()
+    ssize_t activating_ = -1;
+    std::type_index activating_type_ = std::type_index(typeid(void));
+
+    void activate(Parts_vec& vec, size_t i)
+    {
+      // the factory may add parts of its own, moving this one
+      const auto factory = vec[i].factory;
+      if (factory == nullptr)
+        throw Machine_access_error("Machine part has no factory");
+      activating_ = i;
+      activating_type_ = vec[i].t_idx;
+      void* ptr = nullptr;
+      try {
+        ptr = factory();
+      }
+      catch (...) {
+        activating_ = -1;
+        throw;
+      }
+      activating_ = -1;
+      if (ptr == nullptr)
+        throw Machine_access_error("Machine part failed to activate");
+      vec[i].ptr = ptr;
+      vec[i].factory = nullptr;
+    }
 
     void add_device_type(const std::type_index t_idx)
     {
@@ -197,11 +263,31 @@ namespace os {
     return impl->add_new<T>(args...);
   }
 
+  template <typename T>
+  ssize_t Machine::add_lazy(delegate<void*()> factory) {
+    return impl->add_lazy<T>(std::move(factory));
+  }
+
   template <typename T>
   T& Machine::get(int id) {
     return impl->get<T>(id);
   }
 
+  template <typename T>
+  Machine::Vector<T> Machine::get_active() {
+    return impl->get_active<T>();
+  }
+
+  template <typename T>
+  bool Machine::is_active(int i) {
+    return impl->is_active<T>(i);
+  }
+
+  template <typename T>
+  ssize_t Machine::next_index() {
+    return impl->next_index<T>();
+  }
+
   template <typename T>
   Machine::Vector<T> Machine::get() {
     return impl->get<T>();
@@ -237,6 +323,7 @@ namespace os::detail
     {
       for(auto& part : parts_.at(idx))
       {
+        if (not part.active()) continue;
         auto& dev = *reinterpret_cast<hw::Device*>(part.ptr);
         dev.deactivate();
       }
@@ -252,6 +339,10 @@ namespace os::detail
       INFO2("|");
       for(const auto& part : parts_.at(idx))
       {
+        if (not part.active()) {
+          INFO2("+--+ (activated on first use)");
+          continue;
+        }
         const auto& dev = *reinterpret_cast<const hw::Device*>(part.ptr);
         INFO2("+--+ %s", dev.to_string().c_str());
       }
@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <memory>
+#include <delegate>
 
 #include <arch.hpp>
 #include <util/allocator.hpp>
@@ -51,12 +52,33 @@ namespace os {
     template <typename T, typename... Args>
     ssize_t add_new(Args&&... args);
 
+    /**
+     * Add a part that is constructed by factory the first time it's
+     * gotten, and not at all if it never is. The factory returns a T*
+     * from new, or nullptr on failure.
+     */
+    template <typename T>
+    ssize_t add_lazy(delegate<void*()> factory);
+
+    /** All parts of type T, activating any lazy ones */
     template <typename T>
     Vector<T> get();
 
+    /** Part i of type T, activating it if lazy */
     template <typename T>
     T& get(int i);
 
+    /** The parts of type T that have been activated */
+    template <typename T>
+    Vector<T> get_active();
+
+    template <typename T>
+    bool is_active(int i);
+
+    /** The index the part of type T being added or activated gets */
+    template <typename T>
+    ssize_t next_index();
+
     template <typename T>
     void remove(int i);
 
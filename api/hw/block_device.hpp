@@ -122,6 +122,21 @@ public:
    */
   virtual buffer_t read_sync(block_t blk, size_t count=1) = 0;
 
+  /**
+   * Get direct access to blocks of a device kept in memory
+   *
+   * @param blk
+   *   The starting block
+   *
+   * @param count
+   *   The number of blocks
+   *
+   * @return The blocks where they are, or nullptr if the device
+   *         is not in memory or the blocks are out of range
+   */
+  virtual const char* mapped(block_t /*blk*/, size_t /*count*/) const noexcept
+  { return nullptr; }
+
   /**
    * Method to deactivate the block device
    */
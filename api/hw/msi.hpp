@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <cassert>
 #include <vector>
+#include <delegate>
 
 namespace hw {
 
@@ -26,6 +27,8 @@ namespace hw {
 
   struct msix_t
   {
+    using handler_t = delegate<void()>;
+
     msix_t(PCI_Device&, uint32_t capoff);
 
     // initialize msi-x tables for device
@@ -37,6 +40,13 @@ namespace hw {
     // redirect MSI-X vector to another CPU
     void redirect_vector(uint16_t idx, uint8_t cpu, uint8_t vector);
 
+    // call @handler on @cpu when entry @idx fires
+    void bind_vector(uint16_t idx, int cpu, handler_t handler);
+    // move a bound entry, along with its handler, to @cpu
+    void set_affinity(uint16_t idx, int cpu);
+    // the CPU a bound entry is directed to, or -1 when unbound
+    int affinity(uint16_t idx) const;
+
     size_t vectors() const noexcept {
       return used_vectors.size();
     }
@@ -49,6 +59,16 @@ namespace hw {
     uintptr_t pba_addr   = 0;
     std::vector<bool> used_vectors;
 
+    // entries whose handlers we subscribe to, on the CPU they run on
+    struct binding_t {
+      handler_t handler;
+      int     cpu       = -1; // where it's going
+      int     bound_cpu = -1; // where it's subscribed to
+      uint8_t evt       = 0;
+    };
+    std::vector<binding_t> bindings;
+    void attach_here(uint16_t idx);
+
     inline auto* get_entry(size_t idx)
     {
       assert(idx < vectors());
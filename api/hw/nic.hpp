@@ -5,6 +5,9 @@
 #include "mac_addr.hpp"
 #include <net/inet_common.hpp>
 #include "device.hpp"
+#include <vector>
+
+namespace net { class Capture; }
 
 #define NIC_SENDQ_LIMIT_DEFAULT  4096
 #define NIC_BUFFER_LIMIT_DEFAULT 4096
@@ -67,6 +70,33 @@ namespace hw {
      */
     virtual net::Packet_ptr create_packet(int layer_begin) = 0;
 
+    /** Transmit offloads a NIC can perform, see offloads() */
+    enum Offload : uint32_t {
+      /** Finish TCP and UDP over IPv4 checksums from a partial pseudo-header sum */
+      TX_CSUM_IP4 = 1 << 0,
+      /** Split TCP/IPv4 super-segments into MSS-sized frames */
+      TSO_IP4     = 1 << 1,
+      /** Send a packet with segments as one frame, a descriptor per buffer */
+      TX_SEGMENTS = 1 << 2,
+    };
+
+    /** Bitmask of the transmit offloads supported by this NIC */
+    virtual uint32_t offloads() const noexcept { return 0; }
+
+    bool has_offload(uint32_t flags) const noexcept
+    { return (offloads() & flags) == flags; }
+
+    /** Largest IP datagram the NIC will segment with TSO */
+    virtual uint32_t max_tso_size() const noexcept { return 0; }
+
+    /**
+     * Create a packet with room for a TSO super-segment of max_tso_size()
+     * @param layer_begin : offset in octets from the link-layer header
+     * @return nullptr if the NIC does not support TSO
+     */
+    virtual net::Packet_ptr create_tso_packet(int /*layer_begin*/)
+    { return nullptr; }
+
     /** Subscribe to event for when there is more room in the tx queue */
     virtual void on_transmit_queue_available(net::transmit_avail_delg del)
     { tqa_events_.push_back(del); }
@@ -91,9 +121,122 @@ namespace hw {
     /** Check for completed rx and pass rx packets up the stack */
     virtual void poll() = 0;
 
+    /** Packets an RX queue may receive per event loop round */
+    static constexpr int poll_budget_default = 64;
+
+    /**
+     * Hybrid interrupt / polling mode for one RX queue.
+     *
+     * The RX interrupt handler masks the queue interrupt and calls
+     * schedule(). From then on the event loop of that CPU calls @poll
+     * with a budget once per round, for as long as the whole budget is
+     * used. When the queue has drained @rearm unmasks the interrupt,
+     * and returns true if packets arrived in the meantime, in which
+     * case polling continues.
+     */
+    class Rx_poller {
+    public:
+      /** Receive at most @budget packets, returning the number received */
+      using poll_func  = delegate<int(int budget)>;
+      using rearm_func = delegate<bool()>;
+
+      Rx_poller(poll_func poll, rearm_func rearm,
+                int budget = poll_budget_default);
+      Rx_poller(Rx_poller&&) = delete;
+      ~Rx_poller();
+
+      /** Start polling on the current CPU, unless already polling */
+      void schedule();
+
+      bool scheduled() const noexcept
+      { return cpu_ >= 0; }
+
+      int budget() const noexcept
+      { return budget_; }
+
+    private:
+      static void poll_round();
+
+      poll_func  poll_;
+      rearm_func rearm_;
+      int budget_;
+      int cpu_ = -1;
+    };
+
     /** Overridable MTU detection function per-network **/
     static uint16_t MTU_detection_override(int idx, uint16_t default_MTU);
 
+    /**
+     * Number of RX/TX queue pairs serviced by this device.
+     * With more than one pair, packets are received and the TX queue
+     * is picked on the CPU that owns the pair.
+     */
+    virtual int queue_pairs() const noexcept { return 1; }
+
+    /**
+     * Overridable number of queue pairs per-network, at most @max_pairs.
+     * Defaults to a single pair, as the upper layers must be able to
+     * handle packets arriving on several CPUs before enabling more.
+     */
+    static int queue_pairs_override(int idx, int max_pairs);
+
+    /** Number of RX queues, which can exceed the TX queues with RSS */
+    virtual int rx_queues() const noexcept { return queue_pairs(); }
+
+    /** Receive-side scaling configuration, see configure_rss() */
+    struct RSS_config {
+      /** Packet types to hash, anything else lands in the first RX queue */
+      enum Hash_type : uint16_t {
+        HASH_IPV4     = 1 << 0,
+        HASH_TCP_IPV4 = 1 << 1,
+        HASH_IPV6     = 1 << 2,
+        HASH_TCP_IPV6 = 1 << 3,
+      };
+      uint16_t hash_types = HASH_IPV4 | HASH_TCP_IPV4;
+      /** Toeplitz hash key, leave empty to keep the current key */
+      std::vector<uint8_t> key;
+      /** Hash bucket to RX queue, leave empty to keep the current table */
+      std::vector<uint8_t> indirection;
+    };
+
+    /**
+     * Reconfigure receive-side scaling over the RX queues
+     * @return false if the NIC has no RSS, or the config is invalid
+     */
+    virtual bool configure_rss(const RSS_config&) { return false; }
+
+    /** The current receive-side scaling config, with an empty table without RSS */
+    virtual RSS_config rss_config() const { return {}; }
+
+    /**
+     * Deliver the interrupts, and thereby the packets, of RX queue @queue
+     * to CPU @cpu
+     * @return false if the queue can't be moved
+     */
+    virtual bool set_rx_queue_cpu(int /*queue*/, int /*cpu*/) { return false; }
+
+    /** The CPU the packets of RX queue @queue are delivered to, -1 if unknown */
+    virtual int rx_queue_cpu(int /*queue*/) const { return -1; }
+
+    /**
+     * Receive packet steering, RSS in software for NICs without it: hand
+     * the TCP flows received to @cpus by their hash (see net::RPS).
+     * Call it on the CPU receiving the packets, before sharding TCP ports.
+     * An empty list turns it off.
+     * @return false if the NIC can't steer
+     */
+    virtual bool set_rps_cpus(std::vector<int> /*cpus*/) { return false; }
+
+    /** The CPU of each hash bucket of receive packet steering, empty when off */
+    virtual std::vector<int> rps_cpus() const { return {}; }
+
+    /**
+     * Record the frames received and sent in @capture (see net::Capture),
+     * or stop with nullptr. Costs a branch per burst received when off.
+     * @return false if the NIC can't capture
+     */
+    virtual bool set_capture(net::Capture*) { return false; }
+
     /** Set new buffer limit, where 0 means infinite **/
     void set_buffer_limit(uint32_t new_limit) {
       this->m_buffer_limit = new_limit;
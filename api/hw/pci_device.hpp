@@ -4,6 +4,7 @@
 
 #include <cstdint>
 #include <common>
+#include <delegate>
 #include <vector>
 #include <unordered_map>
 
@@ -210,6 +211,14 @@ struct msix_t;
     int setup_msix_vector(uint8_t cpu, uint8_t irq);
     // redirect MSI-X vector to another CPU
     void rebalance_msix_vector(uint16_t index, uint8_t cpu, uint8_t irq);
+    // call @handler on @cpu when MSI-X vector @index fires,
+    // subscribing to an event there for it
+    void bind_msix_vector(uint16_t index, int cpu, delegate<void()> handler);
+    // move a bound MSI-X vector, along with its handler, to another CPU
+    // the handler may be called once more after the move
+    void set_msix_affinity(uint16_t index, int cpu);
+    // the CPU a bound MSI-X vector is directed to, or -1 when unbound
+    int msix_affinity(uint16_t index) const;
     // true if msix is enabled
     bool has_msix() const noexcept {
       return this->msix != nullptr;
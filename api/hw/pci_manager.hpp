@@ -19,11 +19,25 @@ public:
 
   using BLK_driver = delegate< std::unique_ptr<hw::Block_device> (PCI_Device&) >;
   static void register_blk(uint16_t, uint16_t, BLK_driver);
+  // a driver for any device of a class and subclass, eg. NVMe controllers,
+  // used when no driver is registered for the vendor and product
+  static void register_blk_class(uint8_t classcode, uint8_t subclass, BLK_driver);
 
   static void init();
   static void init_devices(uint8_t classcode);
   static  Device_vector devices();
 
+  /**
+   * Whether the driver of a device is constructed the first time the
+   * device is gotten from the machine, instead of at boot. Unused devices
+   * then cost no memory for queues and buffers, and no boot time.
+   * Activated at boot unless overridden by the service, per device:
+   *
+   *   bool hw::PCI_manager::lazy_activation_override(hw::Device::Type type, int idx)
+   *   { return type == hw::Device::Type::Nic and idx > 0; }
+   */
+  static bool lazy_activation_override(Device::Type type, int idx);
+
 private:
   static void scan_bus(int bus);
 };
@@ -12,7 +12,7 @@ public:
   static constexpr MAC::Addr MAC_ADDRESS = {1, 2, 3, 4, 5, 6};
 
   static UserNet& create(const uint16_t MTU);
-  UserNet(const uint16_t MTU);
+  UserNet(const uint16_t MTU, uint32_t buffers = 256);
 
   const char* driver_name() const override {
     return "UserNet";
@@ -30,6 +30,10 @@ public:
 
   net::Packet_ptr create_packet(int) override;
 
+  /** The buffers packets are created in, for drivers that register them */
+  net::BufferStore& bufstore() noexcept
+  { return buffer_store; }
+
   net::downstream create_physical_downstream() override
   { return {this, &UserNet::transmit}; }
 
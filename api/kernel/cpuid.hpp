@@ -96,7 +96,15 @@ namespace CPUID
     BMI2,              // Bit manipulation 2
     LZCNT,             // Count leading zero bits
 
+    // ------------------------------------------------------------------------
+    // AVX-512
+    // ------------------------------------------------------------------------
+    AVX512F,           // AVX-512 Foundation
+    AVX512BW,          // AVX-512 Byte and Word Instructions
+
     TSC_INV,           // Invariant TSC
+    WAITPKG,           // UMONITOR/UMWAIT/TPAUSE
+    SHA,               // SHA-1 and SHA-256 extensions (SHA-NI)
   };
 
   std::vector<const char*> detect_features_str();
@@ -3,7 +3,9 @@
 #define KERNEL_EVENTS_HPP
 
 #include <delegate>
+#include <arch.hpp>
 #include <array>
+#include <atomic>
 #include <common>
 #include <deque>
 #include <smp>
@@ -11,12 +13,21 @@
 #define IRQ_BASE    32
 //#define DEBUG_ALL_INTERRUPTS
 
+namespace util { class Histogram_percpu; }
+
 class alignas(SMP_ALIGN) Events {
 public:
   typedef void (*intr_func) ();
   using event_callback = delegate<void()>;
 
   static const int  NUM_EVENTS = 128;
+  // calls that can wait for this CPU, posted by others (power of 2)
+  static const int  POST_QUEUE = 256;
+  // posted calls made before looking at events again
+  static const int  POST_BATCH = 32;
+  // longest time spent polling before halting, and the first step up
+  static const int  HALT_POLL_MAX_US   = 200;
+  static const int  HALT_POLL_START_US = 10;
 
   uint8_t subscribe(event_callback);
   void subscribe(uint8_t evt, event_callback);
@@ -28,6 +39,30 @@ public:
   // call event once, at a later time
   void defer(event_callback);
 
+  /**
+   * Call once, at a later time, on the CPU of this instance. Safe to use
+   * from any CPU and from interrupt handlers, as it takes no locks.
+   * A halted CPU is woken up with an IPI.
+   *
+   * Returns false if the queue is full
+   */
+  bool post(event_callback);
+
+  /** whether there are posted calls waiting */
+  bool has_posted() const noexcept
+  { return posted.tail.load() != posted.head; }
+
+  /** whether there are triggered events waiting */
+  bool has_pending() const noexcept
+  { return pending; }
+
+  /**
+   * Halt the CPU until the next interrupt, unless calls were posted.
+   * Polls for a while first, for as long as recent wakeups suggest
+   * one is near, since waking from a halt is slow (in a VM especially).
+   */
+  void halt();
+
   /**
    * Get per-cpu instance
    */
@@ -53,13 +88,57 @@ private:
   std::array<uint64_t, NUM_EVENTS> received_array;
   std::array<uint64_t, NUM_EVENTS> handled_array;
 
+  // the code behind each callback, naming it for the stall watchdog
+  std::array<const void*, NUM_EVENTS> origins {};
   std::array<bool, NUM_EVENTS>  event_subs {};
   std::array<bool, NUM_EVENTS>  event_pend {};
   // using deque because vector resize causes invalidation of ranged for
   // when something subscribes during processing of events
   std::deque<uint8_t> sublist;
+  // set along with event_pend, from interrupt handlers
+  volatile bool pending = false;
+  // when pending was set, for the "events.dispatch_ns" histogram
+  uint64_t pending_since = 0;
+  util::Histogram_percpu* dispatch_delay = nullptr;
+  inline void set_pending() noexcept;
+
+  // the polling window, in cycles, adapted after each halt
+  struct Halt_poll {
+    uint64_t window = 0;
+    uint64_t start  = 0;
+    uint64_t max    = 0;
+    bool     umwait = false;
+  } poll;
+
+  // bounded MPSC queue, where each slot is claimed by moving the tail,
+  // and published by its sequence number (the position + 1)
+  struct Post_slot {
+    std::atomic<uint32_t> seq;
+    event_callback        func;
+  };
+  struct Post_queue {
+    Post_queue();
+    // only for making the per-CPU instances
+    Post_queue(const Post_queue&) : Post_queue() {}
+
+    std::array<Post_slot, POST_QUEUE> slots;
+    alignas(SMP_ALIGN) std::atomic<uint32_t> tail {0};
+    std::atomic<bool> halted {false};
+    uint32_t          head = 0;
+    uint8_t           wake_evt = 0;
+  } posted;
+
+  int process_posted();
+  void run_timed(uint8_t intr);
+  bool poll_until(uint64_t deadline);
 };
 
+inline void Events::set_pending() noexcept
+{
+  if (not pending) pending_since = os::Arch::cpu_cycles();
+  pending = true;
+}
+
 inline void Events::trigger_event(const uint8_t evt)
 {
 #ifdef DEBUG_ALL_INTERRUPTS
@@ -73,6 +152,7 @@ inline void Events::trigger_event(const uint8_t evt)
 #endif
   if (LIKELY(evt < NUM_EVENTS)) {
     event_pend[evt] = true;
+    set_pending();
     // increment events received
     received_array[evt]++;
   }
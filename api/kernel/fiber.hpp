@@ -6,6 +6,7 @@
 #include <delegate>
 #include <smp>
 #include <atomic>
+#include <memory>
 
 class Fiber;
 /** Bottom C++ stack frame for all fibers */
@@ -26,9 +27,26 @@ public:
   using R_t = void*;
   using P_t = void*;
   using init_func = void*(*)(void*);
-  using Stack_ptr = std::unique_ptr<char[]>;
+
+  /** Returns a stack to the pool of the CPU it's released on */
+  struct Stack_release {
+    int size = 0;
+    void operator()(char* stack) const noexcept;
+  };
+  using Stack_ptr = std::unique_ptr<char[], Stack_release>;
 
   static constexpr int default_stack_size = 0x10000;
+  // stacks kept for reuse, per CPU
+  static constexpr size_t stack_pool_size = 32;
+
+  /**
+   * Get a stack of (at least) stack_size bytes, recycled when possible.
+   * On x86_64 the page below the stack is a guard page.
+   */
+  static Stack_ptr alloc_stack(int stack_size);
+
+  /** Number of stacks kept for reuse on this CPU */
+  static size_t pooled_stacks();
 
   //
   // Strongly typed constructors with parameter pointer
@@ -38,7 +56,7 @@ public:
   Fiber(int stack_size, R(*func)(P), void* arg)
     : id_{next_id_++},
       stack_size_{stack_size},
-      stack_{Stack_ptr(new char[16 + stack_size_], std::default_delete<char[]> ())},
+      stack_{alloc_stack(stack_size_)},
       stack_loc_{(void*)(uintptr_t(stack_.get() + stack_size_ ) &  ~ (uintptr_t)0xf)},
       type_return_{typeid(R)},
       type_param_{typeid(P)},
@@ -68,7 +86,7 @@ public:
   Fiber(int stack_size, void(*func)())
     : id_{next_id_++},
       stack_size_{stack_size},
-      stack_{Stack_ptr(new char[16 + stack_size_], std::default_delete<char[]> ())},
+      stack_{alloc_stack(stack_size_)},
       stack_loc_{(void*)(uintptr_t(stack_.get() + stack_size_ ) &  ~ (uintptr_t)0xf)},
       type_return_{typeid(void)},
       type_param_{typeid(void)},
@@ -89,7 +107,7 @@ public:
   Fiber(int stack_size, void(*func)(P), P par)
     : id_{next_id_++},
       stack_size_{stack_size},
-      stack_{Stack_ptr(new char[16 + stack_size_], std::default_delete<char[]> ())},
+      stack_{alloc_stack(stack_size_)},
       stack_loc_{(void*)(uintptr_t(stack_.get() + stack_size_ ) &  ~ (uintptr_t)0xf)},
       type_return_{typeid(void)},
       type_param_{typeid(P)},
@@ -110,7 +128,7 @@ public:
   Fiber(int stack_size, R(*func)())
     : id_{next_id_++},
       stack_size_{stack_size},
-      stack_{Stack_ptr(new char[16 + stack_size_], std::default_delete<char[]> ())},
+      stack_{alloc_stack(stack_size_)},
       stack_loc_{(void*)(uintptr_t(stack_.get() + stack_size_ ) &  ~ (uintptr_t)0xf)},
       type_return_{typeid(R)},
       type_param_{typeid(void)},
@@ -202,7 +220,7 @@ private:
   const int id_ = next_id_++ ;
 
   int stack_size_ = default_stack_size;
-  Stack_ptr stack_ = nullptr;
+  Stack_ptr stack_;
   void* stack_loc_ = nullptr;
 
   const std::type_info& type_return_;
@@ -0,0 +1,80 @@
+// -*-C++-*-
+
+#pragma once
+#ifndef KERNEL_LOG_STAGE_HPP
+#define KERNEL_LOG_STAGE_HPP
+
+#include <os.hpp>
+#include <smp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace kernel {
+
+/**
+ * Log output staged in a ring per CPU, and handed to a slow sink (a disk,
+ * the serial port) in large batches from a deferred event, so that logging
+ * doesn't stall the code doing it.
+ *
+ * Each ring is only touched by its own CPU, so no locks are taken. When a
+ * ring is full, writes that don't fit are dropped whole, and counted in
+ * the <name>.dropped stat. Until the OS has booted, and when panicking,
+ * writes go straight to the sink.
+ */
+class Log_stage
+{
+public:
+  using sink_t     = os::print_func;
+  using interval_t = std::chrono::milliseconds;
+
+  /**
+   * @param name      prefix of the stats
+   * @param sink      where the batches go, on the CPU that staged them
+   * @param ring_size bytes staged per CPU (a power of 2)
+   * @param interval  time between flushes, 0 for when the CPU gets
+   *                  back to its event loop
+   */
+  Log_stage(const std::string& name, sink_t sink,
+            uint32_t ring_size = 16384, interval_t interval = interval_t{0});
+
+  /** Stage @len bytes on this CPU, can be used as a stdout handler */
+  void write(const char*, size_t len);
+
+  /** Hand what is staged on this CPU to the sink */
+  void flush();
+
+  void set_interval(interval_t ival) noexcept
+  { interval_ = ival; }
+
+  interval_t interval() const noexcept
+  { return interval_; }
+
+  /** Bytes dropped because a ring was full */
+  uint64_t dropped() const noexcept
+  { return *dropped_; }
+
+private:
+  struct alignas(SMP_ALIGN) Ring
+  {
+    char*    data  = nullptr;
+    uint32_t head  = 0; // read
+    uint32_t tail  = 0; // write
+    bool     scheduled = false;
+    uint8_t  event = 0;
+  };
+
+  Ring& local_ring();
+  void  schedule(Ring&);
+
+  sink_t     sink_;
+  uint32_t   size_;
+  interval_t interval_;
+  uint64_t*  dropped_;
+  std::array<Ring, SMP_MAX_CORES> rings_;
+};
+
+} // < namespace kernel
+
+#endif
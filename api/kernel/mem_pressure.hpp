@@ -0,0 +1,75 @@
+// -*-C++-*-
+
+#pragma once
+#ifndef KERNEL_MEM_PRESSURE_HPP
+#define KERNEL_MEM_PRESSURE_HPP
+
+#include <delegate>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Memory pressure: what is left of the heap, against two watermarks, and
+ * the shrinkers that caches register to give memory back when it is low.
+ *
+ * Shrinkers run on the CPU that registered them, from its event loop,
+ * cheapest first, until the heap is above the low watermark again. They
+ * are started by the allocator when it finds the heap below the low
+ * watermark, and by a periodic check on each CPU with shrinkers.
+ */
+namespace os::mem {
+
+  enum class Pressure : uint8_t {
+    none,
+    low,      // below the low watermark: drop what is cheap to rebuild
+    critical  // below the critical watermark: drop all that can be
+  };
+
+  /** How costly it is to give the memory back, and get it again later */
+  enum class Shrink_cost : uint8_t {
+    cheap,
+    moderate,
+    expensive
+  };
+
+  /** Give memory back, for the level of pressure, and return the bytes freed (roughly) */
+  using Shrinker = delegate<size_t(Pressure)>;
+
+  /**
+   * Register a shrinker on this CPU. @name is not copied.
+   * Returns an id for remove_shrinker
+   */
+  int  add_shrinker(const char* name, Shrink_cost, Shrinker);
+  void remove_shrinker(int id);
+
+  /**
+   * Set the bytes of heap left below which pressure is low and critical.
+   * 0 for the defaults, 1/16th and 1/64th of the heap
+   */
+  void   set_watermarks(size_t low, size_t critical);
+  size_t low_watermark() noexcept;
+  size_t critical_watermark() noexcept;
+
+  /** The pressure right now */
+  Pressure pressure() noexcept;
+
+  /**
+   * Run the shrinkers on this CPU for @level, until there is no pressure.
+   * Returns the bytes they freed
+   */
+  size_t shrink(Pressure level);
+
+  /**
+   * Called by the allocator after the heap grows. When it is below the low
+   * watermark, shrinking is posted to every CPU with shrinkers, once.
+   * Takes no locks and doesn't allocate.
+   */
+  void pressure_notify() noexcept;
+
+  /** Time between checks of the pressure, on each CPU with shrinkers */
+  void set_pressure_interval(std::chrono::milliseconds);
+
+} // < namespace os::mem
+
+#endif
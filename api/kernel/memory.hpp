@@ -9,6 +9,7 @@
 #include <util/alloc_buddy.hpp>
 #include <util/allocator.hpp>
 #include <sstream>
+#include <vector>
 #include <kernel/memmap.hpp>
 
 namespace os::mem {
@@ -116,6 +117,9 @@ namespace os::mem {
   uintptr_t active_page_size(uintptr_t addr);
   uintptr_t active_page_size(void* addr);
 
+  /** The page sizes mapping [begin, end], as a bitmask of sizes **/
+  size_t page_sizes_in(uintptr_t begin, uintptr_t end);
+
   /**
    * Set and return access flags for a given linear address range.
    * The range must be a subset of a range mapped by a previous call to map.
@@ -156,6 +160,45 @@ namespace os::mem {
 
   bool heap_ready();
 
+  /** A range of physical memory, and the NUMA node it is local to */
+  struct Numa_range {
+    uintptr_t begin;
+    uintptr_t end;
+    int       node;
+  };
+
+  /** Number of NUMA nodes, 1 when the firmware describes none */
+  int numa_nodes() noexcept;
+
+  /** The NUMA node of a CPU */
+  int numa_node_of_cpu(int cpu) noexcept;
+
+  /** The NUMA node of a physical address, -1 if it's in no known range */
+  int numa_node_of(uintptr_t addr) noexcept;
+
+  /** Relative cost of memory access from one node to another, 10 being local */
+  int numa_distance(int from, int to) noexcept;
+
+  /** The memory ranges of all nodes, empty when there's only one node */
+  const std::vector<Numa_range>& numa_ranges() noexcept;
+
+  /**
+   * Allocate page aligned memory local to a node, or from anywhere
+   * when the node has none left. Free it with numa_free.
+   **/
+  void* numa_alloc(size_t size, int node);
+  void  numa_free(void* ptr, size_t size);
+
+  /**
+   * Take a free block of @size (a power of 2, at least a page) out of the
+   * heap, when more than @reserve bytes of heap would still be left, and
+   * the heap has a block that size free already. For handing memory the
+   * heap doesn't need to the hypervisor. nullptr otherwise.
+   **/
+  void* take_free_block(size_t size, size_t reserve) noexcept;
+  /** Give a block from take_free_block back to the heap */
+  void  return_block(void* block, size_t size) noexcept;
+
 } // os::mem
 
 
@@ -35,6 +35,19 @@ inline uint64_t rng_extract_uint64()
   return x;
   }
 
+// Fast random numbers for the packet path (TCP ISNs, ephemeral ports,
+// DNS ids, WebSocket masks), from a ChaCha20 keystream of each CPU.
+// The key is replaced from the keystream at every refill, so earlier
+// output can't be recovered, and reseeded from the system RNG and the
+// hardware source every RNG_FAST_RESEED bytes.
+extern void rng_fast_fill(void* output, size_t bytes);
+
+extern uint32_t rng_fast_uint32();
+extern uint64_t rng_fast_uint64();
+
+// Reseed the fast RNG of this CPU before it is next used
+extern void rng_fast_reseed();
+
 #include <fs/fd_compatible.hpp>
 class RNG : public FD_compatible {
 public:
@@ -1,5 +1,8 @@
 #pragma once
 #include <smp>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <deque>
 #include <membitmap>
@@ -16,6 +19,34 @@ namespace smp
 	  SMP::done_func done;
 	};
 
+	// Chase-Lev work-stealing deque of tasks. The CPU owning it pushes and
+	// pops at the bottom (not from interrupt handlers), and any other CPU
+	// steals from the top.
+	class work_deque
+	{
+	public:
+	  static const int64_t CAPACITY = 1024;
+
+	  work_deque() = default;
+	  // only for making the per-CPU instances
+	  work_deque(const work_deque&) {}
+
+	  // returns false if full
+	  bool  push(task*) noexcept;
+	  task* pop() noexcept;
+	  task* steal() noexcept;
+
+	  int64_t size() const noexcept {
+	    return std::max<int64_t>(0, bottom.load(std::memory_order_relaxed)
+	                              - top.load(std::memory_order_relaxed));
+	  }
+
+	private:
+	  alignas(SMP_ALIGN) std::atomic<int64_t> top {0};
+	  alignas(SMP_ALIGN) std::atomic<int64_t> bottom {0};
+	  std::array<std::atomic<task*>, CAPACITY> buffer {};
+	};
+
 	void task_done_handler();
 	void smp_task_handler();
 
@@ -37,7 +68,10 @@ namespace smp
 	  smp_spinlock flock;
 	  std::deque<smp::task> tasks;
 	  std::vector<SMP::done_func> completed;
-	  bool work_done = false;
+	  // tasks any CPU may run, stolen by idle ones
+	  work_deque work;
+	  // done functions of this round of tasks, delivered together
+	  std::vector<SMP::done_func> finished;
 	  // main thread on this vCPU
 	  long main_thread_id = 0;
 	};
@@ -1,8 +1,6 @@
 #pragma once
 #include <array>
 #include <delegate>
-#include <deque>
-#include <map>
 #include <vector>
 
 //#define THREADS_DEBUG 1
@@ -28,6 +26,15 @@ namespace kernel
     void*   clear_tid = nullptr;
     // children, detached when exited
     std::vector<Thread*> children;
+    // run queue links, while waiting to run
+    Thread* rq_prev = nullptr;
+    Thread* rq_next = nullptr;
+    bool    queued  = false;
+    // wants to wait outside the run queue on yield, and does
+    bool    sleeping = false;
+    bool    parked   = false;
+    // next thread in the same tid table bucket
+    Thread* tid_next = nullptr;
 
     void init(long tid, Thread* parent, void* stack);
     void exit();
@@ -41,10 +48,38 @@ namespace kernel
     void libc_store_this();
   };
 
+  /** FIFO of threads waiting to run, linked through the threads */
+  struct Run_queue
+  {
+	  bool   empty() const noexcept { return head == nullptr; }
+	  size_t size() const noexcept { return count; }
+	  void    push_back(Thread*) noexcept;
+	  Thread* pop_front() noexcept;
+	  void    erase(Thread*) noexcept;
+  private:
+	  Thread* head = nullptr;
+	  Thread* tail = nullptr;
+	  size_t  count = 0;
+  };
+
+  /** Threads by tid, chained through the threads */
+  struct Thread_table
+  {
+	  Thread* find(long tid) const noexcept;
+	  void    insert(Thread*);
+	  bool    erase(Thread*) noexcept;
+	  size_t  size() const noexcept { return count; }
+  private:
+	  std::vector<Thread*> buckets;
+	  size_t count = 0;
+	  size_t bucket(long tid) const noexcept { return tid & (buckets.size() - 1); }
+	  void grow();
+  };
+
   struct ThreadManager
   {
-	  std::map<long, kernel::Thread*> threads;
-	  std::deque<Thread*> suspended;
+	  Thread_table threads;
+	  Run_queue suspended;
 	  Thread* main_thread = nullptr;
 	  Thread* next_thread = nullptr;
 
@@ -56,7 +91,7 @@ namespace kernel
 	  Thread* detach(long tid);
 	  void attach(Thread* thread);
 
-	  bool has_thread(long tid) const noexcept { return threads.find(tid) != threads.end(); }
+	  bool has_thread(long tid) const noexcept { return threads.find(tid) != nullptr; }
 	  void insert_thread(Thread* thread);
 	  void erase_thread_safely(Thread* thread);
 
@@ -99,6 +134,20 @@ namespace kernel
 
   void resume(long tid);
 
+  /** Yield, waiting outside the run queue until unparked. Returns at once
+      if there's nothing else to run, so check what is waited for in a loop */
+  void park();
+  /** Put a parked thread of this CPU back in the run queue */
+  void unpark(Thread*);
+
+  /** Wake up to count threads waiting on the futex at addr */
+  int futex_wake(int* addr, int count);
+
+  /** Move a suspended thread from this CPU to another, where it runs next
+      time that CPU yields. Tasks for CPU 0 go to any CPU, so that's where
+      a thread moved to CPU 0 ends up. */
+  void migrate(long tid, int cpu);
+
   Thread* setup_main_thread(long tid = 0);
   void setup_automatic_thread_multiprocessing();
 }
@@ -27,6 +27,13 @@ public:
   // un-schedule timer, and free it
   static void stop(id_t);
 
+  /// let a timer run up to @slack late, so that timers due close together
+  /// run in one interrupt (no slack by default)
+  static void set_slack(id_t, duration_t slack);
+  /// a deferrable timer never wakes the CPU by itself: it runs with the next
+  /// timer that does, or when a timer is started (not deferrable by default)
+  static void set_deferrable(id_t, bool);
+
   /// returns the number of current, active timers
   static size_t active();
   /// returns the number of existing timers
@@ -34,7 +41,8 @@ public:
   /// returns the number of free timers
   static size_t free();
 
-  /// returns the time to next timer, or zero
+  /// returns the time to the next wakeup, or zero when only deferrable
+  /// timers (or none) are active
   /// implementations may treat 1 nanosecond as "timer activation imminent"
   static duration_t next();
 
@@ -0,0 +1,86 @@
+// -*-C++-*-
+
+#pragma once
+#ifndef KERNEL_TRACE_HPP
+#define KERNEL_TRACE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <delegate>
+#include <common>
+
+/**
+ * Static tracepoints, recorded into per-CPU binary ring buffers with a
+ * TSC timestamp. They're only compiled in with ENABLE_TRACEPOINTS (the
+ * TRACE cmake option), and record nothing until trace::start().
+ *
+ *   TRACEPOINT(timer_fire, id);
+ *
+ * The arguments are not evaluated when tracing is off.
+ */
+#ifdef ENABLE_TRACEPOINTS
+#define TRACEPOINT(evt, ...) \
+  do { if (UNLIKELY(::trace::enabled())) \
+         ::trace::emit(::trace::Event::evt, ##__VA_ARGS__); } while (0)
+#else
+#define TRACEPOINT(evt, ...) do {} while (0)
+#endif
+
+namespace trace {
+
+  /** What happened. Keep in sync with etc/trace_decode.py */
+  enum class Event : uint16_t {
+    nic_rx = 1,     // size, nic
+    nic_tx,         // size, nic
+    tcp_state,      // from << 8 | to, connection, local port
+    timer_fire,     // timer id, lateness (ns)
+    event_dispatch, // event number
+    heap_alloc,     // size, address
+    heap_free,      // size, address
+    user = 0x100    // and up, for services
+  };
+
+  struct Record {
+    uint64_t tsc;
+    uint16_t event;
+    uint16_t reserved;
+    uint32_t arg0;
+    uint64_t arg1;
+    uint64_t arg2;
+  };
+  static_assert(sizeof(Record) == 32, "Records are read by the host decoder");
+
+  /** Start recording, into rings of @entries records (a power of 2) per CPU */
+  void start(uint32_t entries = 4096);
+
+  /** Stop recording, keeping what was recorded */
+  void stop() noexcept;
+
+  /** Whether tracepoints are recording */
+  inline bool enabled() noexcept;
+
+  void emit(Event, uint32_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0) noexcept;
+
+  /**
+   * Write out what was recorded, oldest first for each CPU, in the
+   * format etc/trace_decode.py reads. Stop recording first, as the
+   * records being written over would be torn.
+   * The writer could be e.g. a TCP connection, or a file.
+   */
+  using writer_t = delegate<void(const void*, size_t)>;
+  void dump(writer_t);
+
+  /** dump() to stdout as hex, between marker lines the decoder looks for */
+  void dump_serial();
+
+  namespace detail {
+    extern bool active;
+  }
+
+  inline bool enabled() noexcept {
+    return detail::active;
+  }
+
+} // < namespace trace
+
+#endif
@@ -0,0 +1,111 @@
+
+#pragma once
+#ifndef NET_BOND_HPP
+#define NET_BOND_HPP
+
+#include "link_layer.hpp"
+#include <net/ethernet/ethernet.hpp>
+#include <vector>
+
+namespace net {
+
+/**
+ * @brief      Link aggregation: several NICs as one interface.
+ *
+ * A frame goes out of the link picked by the hash of its flow (the
+ * addresses, and the ports of TCP and UDP, like the layer3+4 transmit
+ * policy of Linux bonding), so a flow stays in order on one link while
+ * the flows spread over all of them. Anything that isn't IP goes out
+ * of the first link. What arrives on any link is handed up as if it
+ * arrived on the bond.
+ *
+ * The bond has the MAC address of its first link and sends from it on
+ * every link, so the other end must aggregate its ports too (a static
+ * LAG, or a bridge in the host). The links must not have stacks of
+ * their own:
+ *
+ *   auto& bond = Bond::create({&Interfaces::get_nic(0), &Interfaces::get_nic(1)});
+ *   auto& inet = Interfaces::create(bond, 0, 0);
+ */
+class Bond : public Link_layer<Ethernet> {
+public:
+  using Linklayer = Link_layer<Ethernet>;
+  static constexpr size_t MAX_LINKS = 8;
+
+  /**
+   * @brief      Aggregate some links, and add the bond to the NICs
+   *             of the machine
+   *
+   * @param[in]  links  The links, the first one giving its MAC address
+   *
+   * @return     The bond
+   */
+  static Bond& create(std::vector<hw::Nic*> links);
+
+  explicit Bond(std::vector<hw::Nic*> links);
+
+  const std::vector<hw::Nic*>& links() const noexcept
+  { return links_; }
+
+  /**
+   * @brief      The hash of the flow of an Ethernet frame, the link it
+   *             goes out of modulo the number of links
+   *
+   * @return     The hash, 0 for frames that aren't IP
+   */
+  static uint32_t xmit_hash(const uint8_t* frame, size_t len) noexcept;
+
+  /** Send a frame, or a chain of them, out of the links of their flows */
+  void transmit(Packet_ptr chain);
+
+  net::downstream create_physical_downstream() override
+  { return {this, &Bond::transmit}; }
+
+  void set_ip4_upstream(upstream_ip handler) override;
+  void set_ip6_upstream(upstream_ip handler) override;
+  void set_arp_upstream(upstream handler) override;
+  void set_vlan_upstream(upstream handler) override;
+
+  const char* driver_name() const override
+  { return "Bond"; }
+
+  const MAC::Addr& mac() const noexcept override
+  { return links_.front()->mac(); }
+
+  /** The smallest MTU of the links */
+  uint16_t MTU() const noexcept override;
+
+  net::Packet_ptr create_packet(int layer_begin) override
+  { return links_.front()->create_packet(layer_begin); }
+
+  /** The offloads all of the links have */
+  uint32_t offloads() const noexcept override;
+
+  uint32_t max_tso_size() const noexcept override;
+
+  net::Packet_ptr create_tso_packet(int layer_begin) override
+  { return links_.front()->create_tso_packet(layer_begin); }
+
+  void on_transmit_queue_available(net::transmit_avail_delg del) override;
+
+  /** Room on the fullest link, as any flow may go out of it */
+  size_t transmit_queue_available() override;
+
+  uint64_t get_packets_rx() override;
+  uint64_t get_packets_dropped() override;
+
+  void add_vlan(const int id) override;
+
+  void deactivate() override;
+  void move_to_this_cpu() override;
+  void flush() override;
+  void poll() override;
+
+private:
+  std::vector<hw::Nic*> links_;
+  std::vector<net::downstream> phys_down_;
+};
+
+} // < namespace net
+
+#endif
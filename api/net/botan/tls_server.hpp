@@ -20,9 +20,20 @@ public:
   Server(net::Stream_ptr remote,
          Botan::RandomNumberGenerator& rng,
          Botan::Credentials_Manager& credman)
+  : Server(std::move(remote), rng, credman, m_no_sessions)
+  {}
+
+  /**
+   * @brief      A TLS server stream resuming sessions from a manager
+   *             shared with other streams
+   */
+  Server(net::Stream_ptr remote,
+         Botan::RandomNumberGenerator& rng,
+         Botan::Credentials_Manager& credman,
+         Botan::TLS::Session_Manager& sessions)
   : m_creds{credman},
-    m_session_manager{},
-    m_tls{*this, m_session_manager, m_creds, m_policy, rng},
+    m_no_sessions{},
+    m_tls{*this, sessions, m_creds, m_policy, rng},
     m_transport{std::move(remote)}
   {
     assert(m_transport->is_connected());
@@ -132,6 +143,14 @@ public:
     return m_transport.get();
   }
 
+  /**
+   * Set the application protocols to choose from with ALPN,
+   * most preferred first. None are chosen if empty.
+  **/
+  void set_app_protocols(std::vector<std::string> protocols) {
+    m_app_protocols = std::move(protocols);
+  }
+
 protected:
   void tls_read(buffer_t buf)
   {
@@ -186,6 +205,14 @@ protected:
     }
   }
 
+  std::string tls_server_choose_app_protocol(const std::vector<std::string>& client_protos) override
+  {
+    for (const auto& proto : m_app_protocols)
+      for (const auto& offered : client_protos)
+        if (proto == offered) return proto;
+    return "";
+  }
+
   void tls_session_activated() override
   {
     if (m_on_connect) m_on_connect(*this);
@@ -198,10 +225,11 @@ private:
   Stream::CloseCallback   m_on_close = nullptr;
   bool m_busy = false;
   bool m_deferred_close = false;
+  std::vector<std::string> m_app_protocols;
 
   Botan::Credentials_Manager&   m_creds;
   Botan::TLS::Strict_Policy     m_policy;
-  Botan::TLS::Session_Manager_Noop m_session_manager;
+  Botan::TLS::Session_Manager_Noop m_no_sessions;
 
   Botan::TLS::Server m_tls;
   net::Stream_ptr    m_transport = nullptr;
@@ -4,8 +4,10 @@
 #define NET_BUFFER_STORE_HPP
 
 #include <common>
+#include <atomic>
 #include <stdexcept>
 #include <vector>
+#include <unordered_map>
 #include <smp>
 
 namespace net
@@ -17,16 +19,43 @@ namespace net
    * a semi-intelligent buffer wrapper, used throughout the IP-stack.
    *
    * There shouldn't be any need for raw buffers in services.
+   *
+   * Every CPU keeps a cache of free buffers. The store belongs to the CPU
+   * of its driver, and buffers another CPU has no room for are handed back
+   * to it through a lock-free list, so packets can be freed on any CPU.
    **/
   class BufferStore {
   public:
+    /** Capacity of each per-CPU buffer cache */
+    static const int CPU_CACHE_SIZE  = 64;
+    /** Buffers moved between a CPU cache and the shared free list at once */
+    static const int CPU_CACHE_BATCH = CPU_CACHE_SIZE / 2;
+
     BufferStore(uint32_t num, uint32_t bufsize);
+
+    /**
+     * A store of the @num buffers at @memory (page aligned), which it
+     * doesn't own, such as memory shared with another VM. It never grows.
+     * With @filled false, it starts out empty, and only has the buffers
+     * released to it.
+     */
+    BufferStore(uint8_t* memory, uint32_t num, uint32_t bufsize, bool filled = true);
     ~BufferStore();
 
     uint8_t* get_buffer();
 
+    /** A free buffer, or nullptr rather than growing (or throwing) */
+    uint8_t* try_get_buffer() noexcept;
+
     inline void release(void*);
 
+    /**
+     * Release a batch of buffers at once. Every buffer is validated
+     * before any of them is returned, and the shared free list is
+     * locked at most once.
+     */
+    void release(uint8_t* const* buffers, size_t count);
+
     /** Get size of a buffer **/
     uint32_t bufsize() const noexcept
     { return bufsize_; }
@@ -34,19 +63,47 @@ namespace net
     uint32_t poolsize() const noexcept
     { return poolsize_; }
 
-    /** Check if an address belongs to this buffer store */
+    /**
+     * Check if an address belongs to this buffer store.
+     * Pools are page aligned, so the page number of an address
+     * identifies its pool in constant time.
+     */
     bool is_valid(uint8_t* addr) const noexcept
     {
-      for (const auto* pool : pools_)
-          if ((addr - pool) % bufsize_ == 0
-            && addr >= pool && addr < pool + poolsize_) return true;
-      return false;
+      const auto it = page_index_.find((uintptr_t) addr >> page_shift_);
+      if (UNLIKELY(it == page_index_.end())) return false;
+      const auto offset = addr - it->second;
+      return offset >= 0 && offset < (ptrdiff_t) poolsize_ && this->buffer_aligned(offset);
+    }
+
+    /** Start of the pool holding @addr, or nullptr if not from this store */
+    uint8_t* pool_of(const uint8_t* addr) const noexcept
+    {
+      const auto it = page_index_.find((uintptr_t) addr >> page_shift_);
+      if (UNLIKELY(it == page_index_.end())) return nullptr;
+      return it->second;
     }
 
+    /** The pools buffers are taken from, poolsize() bytes each.
+        Lets a driver register them with the device up front. */
+    const std::vector<uint8_t*>& pools() const noexcept
+    { return pools_; }
+
+    /** Free buffers, including those parked in per-CPU caches */
     size_t available() const noexcept {
-      return this->available_.size();
+      size_t total = this->available_.size() + this->remote_available();
+      for (const auto& cache : caches_) total += cache.count;
+      return total;
     }
 
+    /** Buffers released on other CPUs, waiting for the owner to take them */
+    size_t remote_available() const noexcept
+    { return remote_count_.load(std::memory_order_relaxed); }
+
+    /** The CPU whose driver gets buffers from this store */
+    int owner_cpu() const noexcept
+    { return owner_cpu_; }
+
     size_t total_buffers() const noexcept {
       return this->pool_buffers() * this->pools_.size();
     }
@@ -55,19 +112,67 @@ namespace net
       return this->total_buffers() - this->available();
     }
 
-    /** move this bufferstore to the current CPU **/
+    /** move this bufferstore to the current CPU, the one of its driver **/
     void move_to_this_cpu() noexcept;
 
   private:
+    /**
+     * Lock-free per-CPU magazine in front of the shared free list.
+     * Only ever touched by its own CPU, so the common get/release
+     * path never takes plock.
+     */
+    struct alignas(SMP_ALIGN) cpu_cache_t {
+      int       count = 0;
+      uint8_t*  buffers[CPU_CACHE_SIZE];
+      uint64_t* hits   = nullptr;
+      uint64_t* misses = nullptr;
+    };
+
+    cpu_cache_t* local_cache() noexcept {
+      const size_t cpu = SMP::cpu_id();
+      if (LIKELY(cpu < caches_.size())) return &caches_[cpu];
+      return nullptr;
+    }
+    uint8_t* get_buffer_slow(cpu_cache_t*, bool grow = true);
+    void     release_slow(cpu_cache_t*, uint8_t*);
+    void     push_remote(uint8_t* const* buffers, size_t count);
+    int      take_remote(cpu_cache_t*);
+    uint8_t* take_remote_all();
+
+    // a free buffer links to the next one on the remote list in its first bytes
+    static uint8_t*& next_of(uint8_t* buffer) noexcept
+    { return *reinterpret_cast<uint8_t**>(buffer); }
+
+    bool buffer_aligned(ptrdiff_t offset) const noexcept {
+      if (LIKELY(bufmask_ != 0)) return (offset & bufmask_) == 0;
+      return offset % bufsize_ == 0;
+    }
+
     uint32_t pool_buffers() const noexcept { return poolsize_ / bufsize_; }
     void create_new_pool();
+    void add_pool(uint8_t* pool, bool filled);
+    void create_cache_stats();
+    uint8_t* alloc_pool() const;
+    void     free_pool(uint8_t*) const;
     bool growth_enabled() const;
 
     uint32_t              poolsize_;
     uint32_t              bufsize_;
+    // bufsize_ - 1 when bufsize_ is a power of two, otherwise 0
+    uint32_t              bufmask_;
+    int                   page_shift_;
     int                   index = -1;
     std::vector<uint8_t*> available_;
     std::vector<uint8_t*> pools_;
+    // page number -> start of the pool covering that page
+    std::unordered_map<uintptr_t, uint8_t*> page_index_;
+    std::vector<cpu_cache_t> caches_;
+    int                   owner_cpu_;
+    // the pools are not ours, and there are no more
+    bool                  external_ = false;
+    // buffers released on CPUs other than the owner, pushed without a lock
+    std::atomic<uint8_t*> remote_free_ {nullptr};
+    std::atomic<size_t>   remote_count_ {0};
     // has strict alignment reqs, so put at end
     smp_spinlock          plock;
     BufferStore(BufferStore&)  = delete;
@@ -79,10 +184,15 @@ namespace net
   inline void BufferStore::release(void* addr)
   {
     auto* buff = (uint8_t*) addr;
-    if (LIKELY(this->is_valid(buff))) {
-      plock.lock();
-      this->available_.push_back(buff);
-      plock.unlock();
+    if (LIKELY(this->is_valid(buff)))
+    {
+      auto* cache = this->local_cache();
+      if (LIKELY(cache != nullptr && cache->count < CPU_CACHE_SIZE)) {
+        cache->buffers[cache->count++] = buff;
+        (*cache->hits)++;
+        return;
+      }
+      this->release_slow(cache, buff);
       return;
     }
     throw std::runtime_error("Buffer did not belong");
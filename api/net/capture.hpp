@@ -0,0 +1,126 @@
+#pragma once
+#ifndef NET_CAPTURE_HPP
+#define NET_CAPTURE_HPP
+
+#include <net/packet.hpp>
+#include <delegate>
+#include <smp>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace net {
+
+class TCP;
+
+/**
+ * @brief      Packet capture into a preallocated ring, for traces taken
+ *             under load.
+ *
+ * A NIC records the frames it receives and sends once it is given a
+ * capture with hw::Nic::set_capture. Each frame that passes the filter
+ * takes the next record of the ring, with a timestamp, its length and
+ * up to snaplen bytes of its head. The ring overwrites its oldest
+ * records, so it holds the last ones, like a flight recorder. Recording
+ * takes no locks and allocates nothing, so any CPU may record at once.
+ *
+ * The ring is exported in the pcap format, oldest record first, as a
+ * buffer or to whoever connects to a TCP port:
+ *
+ * @code
+ *   static net::Capture capture{4096};
+ *   capture.set_filter([] (const uint8_t* frame, size_t len, net::Capture::Direction) {
+ *     return net::Capture::is_port(frame, len, 80);
+ *   });
+ *   inet.nic().set_capture(&capture);
+ *   capture.serve(inet.tcp(), 2002);  // nc <address> 2002 > trace.pcap
+ * @endcode
+ */
+class Capture {
+public:
+  enum Direction : uint8_t { RX = 1, TX = 2 };
+
+  /** Whether to record a frame, from the Ethernet header on */
+  using Filter = delegate<bool(const uint8_t* frame, size_t len, Direction)>;
+
+  static constexpr uint16_t SNAPLEN_DEFAULT = 128;
+
+  /**
+   * @param[in]  records  Frames kept, the size of the ring
+   * @param[in]  snaplen  Bytes kept of each frame
+   */
+  explicit Capture(size_t records, uint16_t snaplen = SNAPLEN_DEFAULT);
+
+  /** Record only frames @filter returns true for, nullptr for all */
+  void set_filter(Filter filter)
+  { filter_ = filter; }
+
+  /** Stop recording, without forgetting what's in the ring */
+  void pause() noexcept
+  { paused_.store(true, std::memory_order_relaxed); }
+
+  void resume() noexcept
+  { paused_.store(false, std::memory_order_relaxed); }
+
+  bool paused() const noexcept
+  { return paused_.load(std::memory_order_relaxed); }
+
+  /** Record a frame, or a chain of them */
+  void record(const Packet* chain, Direction dir) noexcept
+  {
+    if (UNLIKELY(paused())) return;
+    for (; chain != nullptr; chain = chain->tail())
+      record_one(*chain, dir);
+  }
+
+  /** Frames recorded since the start, including those overwritten since */
+  uint64_t recorded() const noexcept
+  { return head_.load(std::memory_order_relaxed); }
+
+  size_t capacity() const noexcept
+  { return records_; }
+
+  uint16_t snaplen() const noexcept
+  { return snaplen_; }
+
+  /** Forget every record */
+  void clear() noexcept;
+
+  /** The ring as a pcap file, oldest record first, skipping records
+      being written */
+  std::vector<uint8_t> to_pcap() const;
+
+  /** Send the ring as a pcap file to whoever connects to @port, and close */
+  void serve(TCP& tcp, uint16_t port);
+
+  /** A filter helper: TCP or UDP over IPv4 or IPv6 from or to @port */
+  static bool is_port(const uint8_t* frame, size_t len, uint16_t port) noexcept;
+
+private:
+  struct Record {
+    // 2 * position + 1 while written, + 2 once written
+    std::atomic<uint64_t> seq {0};
+    uint64_t ns;
+    uint32_t len;
+    uint16_t caplen;
+    uint8_t  dir;
+    uint8_t  data[0];
+  };
+
+  void record_one(const Packet&, Direction) noexcept;
+
+  Record& at(uint64_t pos) const noexcept
+  { return *reinterpret_cast<Record*>(ring_.get() + (pos % records_) * record_size_); }
+
+  const size_t   records_;
+  const uint16_t snaplen_;
+  const size_t   record_size_;
+  std::unique_ptr<uint8_t[]> ring_;
+  alignas(SMP_ALIGN) std::atomic<uint64_t> head_ {0};
+  std::atomic<bool> paused_ {false};
+  Filter filter_ = nullptr;
+};
+
+} // < namespace net
+
+#endif // < NET_CAPTURE_HPP
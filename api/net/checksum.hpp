@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <vector>
 
 namespace net {
 
@@ -16,6 +17,38 @@ namespace net {
     return checksum(0, data, len);
   }
 
+  /**
+   * @brief      Copy @len bytes from @src to @dst, summing them on the way.
+   *
+   * @return     The one's complement sum of the copied data plus @sum, folded
+   *             to 16 bits but not complemented. It can be handed to checksum()
+   *             as the partial sum when the data starts at an even offset of
+   *             what is checksummed, or byte swapped when it starts at an odd one.
+   */
+  uint16_t copy_and_checksum(void* dst, const void* src, size_t len,
+                             uint32_t sum = 0) noexcept;
+
+  /**
+   * @brief      Combine partial sums of consecutive data, where the data of
+   *             @part follows @offset bytes of the data of @sum.
+   */
+  inline uint16_t checksum_combine(uint16_t sum, uint16_t part, size_t offset) noexcept
+  {
+    // after an odd offset the bytes land in the other half of each word
+    if (offset & 1) part = (part << 8) | (part >> 8);
+    const uint32_t total = sum + part;
+    return (total & 0xffff) + (total >> 16);
+  }
+
+  /** Name of the checksum kernel picked for this CPU, e.g. "avx2" */
+  const char* checksum_kernel() noexcept;
+
+  /** Names of the checksum kernels this CPU can run, best first */
+  std::vector<const char*> checksum_kernels();
+
+  /** Use the named kernel instead of the best one. False if unavailable. */
+  bool use_checksum_kernel(const char* name) noexcept;
+
   /**
    * @brief      Adjust the checksum according to the difference between old and new data.
    *
@@ -48,6 +81,54 @@ namespace net {
     checksum_adjust(reinterpret_cast<uint8_t*>(chksum), old_obj, sizeof(T), new_obj, sizeof(T));
   }
 
+  /**
+   * @brief      One's complement difference between old and new values of
+   *             fields covered by a checksum (RFC 1624). Computed once, it
+   *             adjusts any number of checksums covering the same change,
+   *             e.g. the IP and TCP checksums of every packet in a NATed flow.
+   */
+  class Checksum_delta {
+  public:
+    /** Account for @old_obj being replaced with @new_obj */
+    template <typename T>
+    Checksum_delta& add(const T& old_obj, const T& new_obj) noexcept
+    {
+      static_assert(sizeof(T) % 2 == 0, "Checksum delta only supports even lengths");
+      uint16_t o[sizeof(T) / 2], n[sizeof(T) / 2];
+      __builtin_memcpy(o, &old_obj, sizeof(T));
+      __builtin_memcpy(n, &new_obj, sizeof(T));
+      for (size_t i = 0; i < sizeof(T) / 2; i++)
+        sum_ += (uint16_t) ~o[i] + n[i];
+      sum_ = fold(sum_);
+      return *this;
+    }
+
+    /** Combine with the delta of other fields */
+    Checksum_delta& add(const Checksum_delta& other) noexcept
+    {
+      sum_ = fold(sum_ + other.sum_);
+      return *this;
+    }
+
+    /** Adjust a checksum field as-is: HC' = ~(~HC + ~m + m'), RFC 1624 eqn. 3 */
+    uint16_t apply(const uint16_t chksum) const noexcept
+    { return ~fold((uint16_t) ~chksum + sum_); }
+
+    /** Adjust a partial sum that is not complemented, like the
+        pseudo-header sum left in a packet for checksum offload */
+    uint16_t apply_partial(const uint16_t sum) const noexcept
+    { return fold(sum + sum_); }
+
+  private:
+    static uint32_t fold(uint32_t sum) noexcept
+    {
+      sum = (sum & 0xffff) + (sum >> 16);
+      return (sum & 0xffff) + (sum >> 16);
+    }
+
+    uint32_t sum_ = 0;
+  };
+
 } //< namespace net
 
 #endif //< NET_CHECKSUM_HPP
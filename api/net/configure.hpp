@@ -12,6 +12,7 @@
 #endif
 
 #include <rapidjson/document.h>
+#include <util/config_value.hpp>
 
 namespace net {
 
@@ -29,6 +30,14 @@ namespace net {
    */
   void configure(const rapidjson::Value& net);
 
+  /**
+   * @brief      Configure interfaces according to the array "net" of
+   *             the config compiled at build time.
+   *
+   * @param[in]  net   The compiled value of the member "net"
+   */
+  void configure(const Config_value& net);
+
 }
 
 #endif
@@ -6,11 +6,18 @@
 #include <net/socket.hpp>
 #include <net/ip4/packet_ip4.hpp>
 #include <net/ip6/packet_ip6.hpp>
+#include <hw/mac_addr.hpp>
+#include <array>
 #include <vector>
 #include <unordered_map>
 #include <rtc>
 #include <chrono>
 #include <util/timer.hpp>
+#include <util/flat_map.hpp>
+#include <kernel/mem_pressure.hpp>
+#include <memory>
+#include <deque>
+#include <smp>
 
 namespace net {
 
@@ -37,6 +44,8 @@ public:
       : quad(std::move(q)), proto(p)
     {}
 
+    Quintuple() = default;
+
     bool operator==(const Quintuple& other) const noexcept
     { return proto == other.proto and quad == other.quad; }
 
@@ -53,9 +62,12 @@ public:
   {
     std::size_t operator()(const Quintuple& key) const noexcept
     {
-      const auto h1 = std::hash<Quadruple>{}(key.quad);
-      const auto h2 = std::hash<uint8_t>{}(static_cast<uint8_t>(key.proto));
-      return h1 ^ h2;
+      // std::hash<Quadruple> is symmetric, which would put both
+      // directions of a connection in the same bucket
+      const auto h1 = std::hash<Socket>{}(key.quad.src);
+      const auto h2 = std::hash<Socket>{}(key.quad.dst);
+      const auto h3 = static_cast<uint8_t>(key.proto);
+      return (h1 * 0x9e3779b97f4a7c15ull) ^ (h2 + (h3 << 16));
     }
   };
 
@@ -85,6 +97,41 @@ public:
     State             state;
     uint8_t           flags{0x0};
     uint8_t           other{0x0}; // whoever can make whatever here
+
+    /**
+     * Forwarding decision for one destination of the connection, cached
+     * by the router. Only valid while the routing table and link-layer
+     * cache generations match, and not restored on deserialize.
+     */
+    struct Route_cache {
+      Addr        dst;
+      Addr        nexthop;
+      void*       route     = nullptr; // Route<IPV>*, owned by the router
+      uint32_t    route_gen = 0;
+      uint32_t    link_gen  = 0;       // 0 when link_dst is unresolved
+      MAC::Addr   link_dst;
+    };
+    // one for each direction
+    mutable std::array<Route_cache, 2> route_cache{};
+
+    // expiry list of the timing wheel slot this entry is filed in,
+    // maintained by Conntrack and not restored on deserialize
+    Entry*            expiry_next{nullptr};
+    Entry**           expiry_pprev{nullptr};
+    uint8_t           shard{0}; // index of the owning shard
+
+    // filter chains that accepted this connection when established,
+    // valid for one filter_generation(), see Filter_chain::enable_fast_path
+    mutable uint32_t  filter_gen{0};
+    mutable uint32_t  filter_accepted{0};
+
+    // traffic tracked by in(), index 0 the direction of first and 1 of
+    // second. Not restored on deserialize.
+    uint64_t          packets[2]{};
+    uint64_t          bytes[2]{};
+    RTC::timestamp_t  first_seen{0};
+    RTC::timestamp_t  last_seen{0};
+
     Entry_handler     on_close;
 
     Entry(Quadruple quad, Protocol p)
@@ -93,6 +140,8 @@ public:
     {}
 
     Entry() = default;
+    Entry(const Entry&) = delete;
+    Entry& operator=(const Entry&) = delete;
 
     bool is_mirrored() const noexcept
     { return first.src == second.dst and first.dst == second.src; }
@@ -172,7 +221,8 @@ public:
   Entry* get(const Quadruple& quad, const Protocol proto) const;
 
   /**
-   * @brief      Track a packet, updating the state of the entry.
+   * @brief      Track a packet, updating the state of the entry
+   *             and counting the packet in its direction.
    *
    * @param[in]  pkt   The packet
    *
@@ -224,25 +274,53 @@ public:
   Entry* update_entry(const Protocol proto, const Quadruple& oldq, const Quadruple& newq);
 
   /**
-   * @brief      Remove all expired entries, both confirmed and unconfirmed.
+   * @brief      Set the timeout of an entry to now + dur,
+   *             moving it to the matching timing wheel slot.
+   *
+   * @param      ent   The entry
+   * @param[in]  dur   The duration from now
+   */
+  void set_timeout(Entry& ent, Timeout_duration dur);
+
+  /**
+   * @brief      Remove all expired entries, both confirmed and unconfirmed,
+   *             by scanning the whole table. The flush timer only visits the
+   *             timing wheel slots that are due, so this is only needed when
+   *             an entry's timeout was changed directly.
    */
   void remove_expired();
 
+  /**
+   * @brief      Remove the entries whose timing wheel slot is due,
+   *             in time proportional to the number of due entries.
+   *             Sharded, this only expires the shard of this CPU.
+   *
+   * @param[in]  now   The current time
+   */
+  void expire_due(const RTC::timestamp_t now);
+
+  /**
+   * @brief      Visit every entry once, under the lock of its shard.
+   *             The handler must not call into the tracker.
+   *
+   * @param[in]  handler  The handler
+   */
+  void for_each_entry(Entry_handler handler);
+
   /**
    * @brief      Number of entries currently tracked.
    *
    * @return     Number of entries.
    */
-  size_t number_of_entries() const noexcept
-  { return entries.size(); }
+  size_t number_of_entries() const noexcept;
 
   /**
-   * @brief      Call reserve on the underlying unordered_map
+   * @brief      Preallocate table slots and pooled entries for
+   *             count table entries (two for each connection).
    *
    * @param[in]  count  The count
    */
-  void reserve(size_t count)
-  { entries.reserve(count); }
+  void reserve(size_t count);
 
   /**
    * @brief      A very simple and unreliable way for tracking quintuples.
@@ -282,29 +360,142 @@ public:
   Conntrack();
 
   /**
-   * @brief      Construct a Conntrack with a given limit of entries.
+   * @brief      Construct a Conntrack with a given limit of entries,
+   *             preallocating room for all of them.
    *
    * @param[in]  max_entries  The maximum number of entries
    */
   Conntrack(size_t max_entries);
 
+  /**
+   * @brief      Construct a sharded Conntrack, with one shard for each CPU.
+   *             A new connection is owned by the CPU that sees its first packet,
+   *             so a NIC steering flows to CPUs keeps each flow on one shard.
+   *             Packets of a flow arriving on another CPU are handed off:
+   *             the entry is looked up in the other shards, and used under
+   *             the lock of its shard. The entry limit is split between shards.
+   *
+   * @param[in]  max_entries  The maximum number of entries
+   * @param[in]  shards       The number of shards, usually SMP::cpu_count()
+   */
+  Conntrack(size_t max_entries, int shards);
+
+  ~Conntrack();
+  Conntrack(const Conntrack&) = delete;
+  Conntrack& operator=(const Conntrack&) = delete;
+
   /** How often the flush timer should fire */
   std::chrono::seconds flush_interval {10};
 
+  /**
+   * Called with each entry about to be erased as expired, on the CPU of
+   * its shard and under its lock. Unlike Entry::on_close it is not
+   * called for entries freed with the tracker.
+   */
+  Entry_handler   on_expire;
+
   /** Custom TCP handler can (and should) be added here */
   Packet_tracker  tcp_in;
   Packet_tracker6 tcp6_in;
 
+  /** Number of shards, 1 unless sharded */
+  int shards() const noexcept
+  { return shards_.size(); }
+
+  /** Lookups of a flow on another CPU than the one owning it */
+  uint64_t handoffs() const noexcept
+  { return handoffs_; }
+
   int deserialize_from(void*);
   void serialize_to(std::vector<char>&) const;
 
 private:
-  using Entry_table = std::unordered_map<Quintuple, std::shared_ptr<Entry>, Quintuple_hasher>;
-  Entry_table entries;
-  Timer       flush_timer;
+  // Both quintuples of a connection map to the same Entry, owned by the pool
+  using Entry_table = Flat_map<Quintuple, Entry*, Quintuple_hasher>;
+  // Timing wheel, one slot per second. Entries timing out more than a
+  // lap ahead are filed in their slot anyway, and skipped until due.
+  // Every live entry is in the wheel, which is how they are iterated.
+  static constexpr int WHEEL_SLOTS = 1024;
+  // Entries are allocated in chunks and recycled through a free list
+  using Entry_storage = std::aligned_storage_t<sizeof(Entry), alignof(Entry)>;
+  static constexpr size_t POOL_CHUNK = 256;
+
+  /**
+   * The entries owned by one CPU, or all of them when not sharded.
+   * A shard is expired by the flush timer of its own CPU, and its lock
+   * is only contended when another CPU handles a packet of its flows.
+   */
+  struct alignas(SMP_ALIGN) Shard
+  {
+    Shard(Conntrack& ct, int index);
+    Shard(Shard&&) = delete;
+
+    Entry_table         entries;
+    std::vector<Entry*> wheel;
+    RTC::timestamp_t    wheel_tick = 0; // last second expired
+    Timer               flush_timer;
+    std::vector<std::unique_ptr<Entry_storage[]>> pool_chunks;
+    std::vector<Entry*> pool_free;
+    smp_spinlock        lock;
+    const uint8_t       index;
+  };
+  // Shard is neither movable nor copyable, a deque never relocates
+  std::deque<Shard> shards_;
+  bool              sharded_ = false;
+  uint64_t          handoffs_ = 0;
+  // expires early when memory is low, so the pools don't grow
+  int               shrinker_;
+
+  size_t shrink(os::mem::Pressure);
+
+  /** Locks a shard in sharded mode */
+  class Shard_lock {
+  public:
+    Shard_lock(const Conntrack& ct, Shard& shard)
+      : shard_{ct.sharded_ ? &shard : nullptr}
+    { if(shard_) shard_->lock.lock(); }
+    ~Shard_lock()
+    { if(shard_) shard_->lock.unlock(); }
+    Shard_lock(const Shard_lock&) = delete;
+  private:
+    Shard* shard_;
+  };
+
+  Shard& local_shard() noexcept
+  { return shards_[sharded_ ? SMP::cpu_id() % shards_.size() : 0]; }
+
+  Shard& shard_of(const Entry& ent) noexcept
+  { return shards_[ent.shard]; }
+
+  /** Limit of entries in each shard, 0 for unlimited */
+  size_t shard_limit() const noexcept
+  { return maximum_entries / shards_.size(); }
+
+  /** Find an entry in one shard, which must be locked */
+  static Entry* find(Shard&, const Quadruple& quad, const Protocol proto);
+
+  template <typename... Args>
+  Entry* new_entry(Shard&, Args&&... args);
+  void   free_entry(Shard&, Entry* ent) noexcept;
+  void   grow_pool(Shard&, size_t count);
+  void   reserve(Shard&, size_t count);
 
   inline void update_timeout(Entry& ent, const Timeout_settings& timeouts);
 
+  static void count(Entry& ent, const Quadruple& quad, size_t bytes) noexcept
+  {
+    const int dir = (quad == ent.first) ? 0 : 1;
+    ent.packets[dir]++;
+    ent.bytes[dir] += bytes;
+  }
+
+  /** File an entry in the wheel slot of its timeout */
+  static void link_expiry(Shard&, Entry& ent);
+  static void unlink_expiry(Entry& ent) noexcept;
+  /** Erase both table keys of an entry, and free it */
+  void erase(Shard&, Entry& ent);
+  void expire_due(Shard&, const RTC::timestamp_t now);
+
   void on_timeout();
 
 };
@@ -339,7 +530,7 @@ inline Quadruple Conntrack::get_quadruple_icmp(const IP_packet& pkt)
 
 inline void Conntrack::update_timeout(Entry& ent, const Timeout_settings& timeouts)
 {
-  ent.timeout = RTC::now() + timeouts.get(ent.proto).count();
+  set_timeout(ent, timeouts.get(ent.proto));
 }
 
 }
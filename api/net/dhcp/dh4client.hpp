@@ -4,6 +4,7 @@
 #define NET_DHCP_DH4CLIENT_HPP
 
 #include "dhcp4.hpp"
+#include "lease.hpp"
 #include "options.hpp"
 
 #include <util/timer.hpp>
@@ -19,6 +20,7 @@ namespace net {
 
     using Stack = Inet;
     using config_func = delegate<void(bool)>;
+    using Lease = dhcp::Lease;
 
     DHClient() = delete;
     DHClient(DHClient&) = delete;
@@ -27,6 +29,30 @@ namespace net {
     // negotiate with local DHCP server
     void negotiate(std::chrono::seconds timeout = std::chrono::seconds::zero());
 
+    /**
+     * @brief      Configure the stack from a lease obtained before, as one
+     *             carried over LiveUpdate, and renew it in the background.
+     *             Negotiates instead if it has expired, or when the server
+     *             refuses to renew it.
+     *
+     * @param[in]  lease    The lease
+     * @param[in]  timeout  The timeout of a negotiation, if it comes to that
+     */
+    void resume(const Lease& lease, std::chrono::seconds timeout = std::chrono::seconds::zero());
+
+    /** The lease held, invalid if none */
+    const Lease& lease() const noexcept
+    { return lease_; }
+
+    /**
+     * @brief      Ask for Rapid Commit (RFC 4039) in the DISCOVER, so a server
+     *             supporting it leases an address with a single ACK. On by default.
+     *
+     * @param[in]  enabled  Whether to ask for it
+     */
+    void set_rapid_commit(bool enabled) noexcept
+    { rapid_commit_ = enabled; }
+
     // Signal indicating the result of DHCP negotation
     // timeout is true if the negotiation timed out
     void on_config(config_func handler);
@@ -36,10 +62,21 @@ namespace net {
     void offer(const char* data, size_t len);
     void request(const dhcp::option::server_identifier* server_id);   // --> acknowledge
     void acknowledge(const char* data, size_t len);
+    // read the configuration offered in a message, false if not usable
+    bool read_config(const char* data);
+    // configure the stack with the address acknowledged by @server
+    void bind(ip4::Addr server, uint32_t lease_time);
 
     void restart_negotation();
     void end_negotiation(bool);
 
+    // renewing, at T1 and then at half the time left (RFC 2131 4.4.5)
+    void renew();
+    void send_renew();
+    void renew_reply(const char* data, size_t len);
+    void start_renew_timer();
+    void lease_lost();
+
     Stack& stack;
     uint32_t     xid = 0;
     ip4::Addr    ipaddr, netmask, router, dns_server;
@@ -51,6 +88,11 @@ namespace net {
     Timer        timeout_timer_;
     std::chrono::milliseconds timeout;
     udp::Socket* socket = nullptr;
+    bool         rapid_commit_ = true;
+    Lease        lease_;
+    Timer        renew_timer_;
+    uint32_t     renew_xid_ = 0;
+    udp::Socket* renew_socket_ = nullptr;
   };
 
 }
@@ -6,7 +6,10 @@
 #include <net/dhcp/message.hpp>
 #include <net/dhcp/record.hpp>  // Status and Record
 #include <net/udp/udp.hpp>
-#include <map>
+#include <util/membitmap.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace net {
 namespace dhcp {
@@ -32,8 +35,8 @@ namespace dhcp {
     // open on DHCP client port
     void listen();
 
-    void add_record(const Record& record)
-    { records_.push_back(record); }
+    /** Add a record, replacing any with the same client id */
+    void add_record(const Record& record);
 
     bool record_exists(const Record::byte_seq& client_id) const noexcept;
 
@@ -41,6 +44,11 @@ namespace dhcp {
 
     int get_record_idx_from_ip(ip4::Addr ip) const noexcept;
 
+    int get_record_idx_from_mac(const MAC::Addr& mac) const noexcept;
+
+    /** The status of an address in the pool, IN_USE if outside it */
+    Status status(ip4::Addr ip) const noexcept;
+
     ip4::Addr broadcast_address() const noexcept
     { return server_id_ | ( ~ netmask_); }
 
@@ -76,9 +84,17 @@ namespace dhcp {
     ip4::Addr pool_end() const noexcept
     { return pool_end_; }
 
-    const std::map<ip4::Addr, Status>& pool() const noexcept
+    /** The status of each address in the pool, from pool_start() */
+    const std::vector<Status>& pool() const noexcept
     { return pool_; }
 
+    /** Number of addresses available */
+    size_t available() const noexcept
+    { return free_.count_set(); }
+
+    bool rapid_commit() const noexcept
+    { return rapid_commit_; }
+
     const std::vector<Record>& records() const noexcept
     { return records_; }
 
@@ -105,26 +121,60 @@ namespace dhcp {
     void set_pending(uint8_t pending)
     { pending_ = pending; }
 
+    /**
+     * @brief      Answer a DISCOVER asking for Rapid Commit (RFC 4039)
+     *             with an ACK right away, leasing the address without
+     *             waiting for a REQUEST. On by default.
+     *
+     * @param[in]  enabled  Whether to allow it
+     */
+    void set_rapid_commit(bool enabled)
+    { rapid_commit_ = enabled; }
+
   private:
     UDP::Stack& stack_;
     udp::Socket& socket_;
     ip4::Addr pool_start_, pool_end_;
-    std::map<ip4::Addr, Status> pool_;
+    // status of each address, and a bit set for those available
+    std::vector<Status> pool_;
+    std::vector<MemBitmap::word> free_words_;
+    MemBitmap free_;
+    // where to look for the next address, so released ones rest a while
+    MemBitmap::index_t next_free_ = 0;
 
     ip4::Addr server_id_;
     ip4::Addr netmask_, router_, dns_;
     uint32_t lease_, max_lease_;
     uint8_t pending_;               // How long to consider an offered address in the pending state (seconds)
+    bool rapid_commit_ = true;
     std::vector<Record> records_;   // Temp - Instead of persistent storage
+    // indexes into records_
+    std::unordered_map<std::string, size_t> by_client_id_;
+    std::unordered_map<uint64_t, size_t> by_mac_;
+    std::unordered_map<uint32_t, size_t> by_ip_;
 
     bool valid_pool(ip4::Addr start, ip4::Addr end) const;
     void init_pool();
     void update_pool(ip4::Addr ip, Status new_status);
+    // index of @ip in the pool, -1 if outside
+    int pool_index(ip4::Addr ip) const noexcept;
+    // take the next address available, 0 if none
+    ip4::Addr allocate(Status new_status);
+
+    void index_record(size_t idx);
+    void erase_record(size_t idx);
+    // the record of the client sending @msg, by client id or else MAC
+    int find_record(const Message* msg) const;
+    static std::string id_key(const Record::byte_seq& client_id)
+    { return {client_id.begin(), client_id.end()}; }
+    static uint64_t mac_key(const MAC::Addr& mac) noexcept
+    { return (uint64_t(mac.major) << 16) | mac.minor; }
 
     void resolve(const Message* msg);
     void handle_request(const Message* msg);
     void verify_or_extend_lease(const Message* msg);
     void offer(const Message* msg);
+    void send_reply(const Message* msg, const char* buffer, size_t len);
     void inform_ack(const Message* msg);
     void request_ack(const Message* msg);
     void nak(const Message* msg);
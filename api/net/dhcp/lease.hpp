@@ -0,0 +1,38 @@
+#pragma once
+#ifndef NET_DHCP_LEASE_HPP
+#define NET_DHCP_LEASE_HPP
+
+#include <net/ip4/addr.hpp>
+#include <cstdint>
+
+namespace net {
+namespace dhcp {
+
+  /**
+   * @brief      An address leased from a DHCP server, with what came with it.
+   *             Trivially copyable, so it can be carried over LiveUpdate
+   *             (Storage::add) and resumed with DHClient::resume().
+   */
+  struct Lease
+  {
+    static constexpr uint32_t INFINITE = 0xffffffff;
+
+    ip4::Addr addr{0};
+    ip4::Addr netmask{0};
+    ip4::Addr router{0};
+    ip4::Addr dns_server{0};
+    ip4::Addr server{0};      // the server it was leased from
+    uint32_t  lease_time = 0; // seconds
+    int64_t   obtained   = 0; // RTC::now() when acknowledged
+
+    int64_t expires() const noexcept
+    { return obtained + lease_time; }
+
+    bool valid(int64_t now) const noexcept
+    { return addr != 0 and (lease_time == INFINITE or now < expires()); }
+  };
+
+} // < namespace dhcp
+} // < namespace net
+
+#endif
@@ -80,6 +80,7 @@ enum Code : uint8_t
   NWIP_DOMAIN_NAME =             62,
   NWIP_SUBOPTIONS =              63,
   USER_CLASS =                   77,
+  RAPID_COMMIT =                 80,
   FQDN =                         81,
   DHCP_AGENT_OPTIONS =           82,
   SUBNET_SELECTION =             118,
@@ -322,6 +323,16 @@ struct client_identifier : public type<DHCP_CLIENT_IDENTIFIER>, public base
   { return reinterpret_cast<const Addr*>(&val[1]); }
 };
 
+/**
+ * @brief      RAPID_COMMIT (80), RFC 4039
+ */
+struct rapid_commit : public type<RAPID_COMMIT>, public base
+{
+  constexpr rapid_commit() noexcept
+    : base{CODE, 0}
+  {}
+};
+
 } // < namespace option
 } // < namespace dhcp
 } // < namespace net
@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <vector>
 #include <net/ip4/addr.hpp>
+#include <hw/mac_addr.hpp>
 
 namespace net {
 namespace dhcp {
@@ -39,6 +40,9 @@ namespace dhcp {
     const Status& status() const noexcept
     { return status_; }
 
+    const MAC::Addr& hw_addr() const noexcept
+    { return hw_addr_; }
+
     uint32_t lease_start() const noexcept
     { return lease_start_; }
 
@@ -56,6 +60,9 @@ namespace dhcp {
     void set_status(Status status)
     { status_ = status; }
 
+    void set_hw_addr(const MAC::Addr& hw_addr)
+    { hw_addr_ = hw_addr; }
+
     void set_lease_start(int64_t lease_start)
     { lease_start_ = lease_start; }
 
@@ -65,6 +72,7 @@ namespace dhcp {
   private:
     byte_seq client_id_;
     ip4::Addr ip_;
+    MAC::Addr hw_addr_;             // EMPTY if not known
     Status status_;
     int64_t lease_start_;           // For now: RTC::now()
     uint32_t lease_duration_;
@@ -0,0 +1,142 @@
+#pragma once
+#ifndef NET_DNS_CACHE_HPP
+#define NET_DNS_CACHE_HPP
+
+#include <net/addr.hpp>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace net::dns {
+
+  /**
+   * @brief      A bounded cache of resolved hostnames.
+   *
+   *             Each entry lives for the TTL it was given. When full, the
+   *             least recently used entry makes room for a new one.
+   *             A name that does not exist is cached as a negative entry.
+   *
+   *             An entry looked up often is due for a prefetch in the
+   *             last part of its life, so it can be refreshed before it
+   *             expires and lookups never miss.
+   */
+  class Cache
+  {
+  public:
+    using Hostname    = std::string;
+    using Address     = net::Addr;
+    using timestamp_t = int64_t; // seconds
+
+    static constexpr size_t   DEFAULT_CAPACITY = 1024;
+    // lookups of an entry before it is prefetched
+    static constexpr uint32_t PREFETCH_HITS    = 3;
+    // the fraction of its TTL left when an entry is prefetched
+    static constexpr uint32_t PREFETCH_DIVISOR = 10;
+
+    struct Entry
+    {
+      Address     address;
+      timestamp_t expires;
+      uint32_t    ttl;
+      uint32_t    hits        = 0;
+      bool        negative    = false;
+      bool        prefetching = false;
+
+      uint32_t ttl_left(timestamp_t now) const noexcept
+      { return (expires > now) ? expires - now : 0; }
+    };
+
+    explicit Cache(size_t capacity = DEFAULT_CAPACITY) noexcept
+      : capacity_{capacity}
+    {}
+
+    /**
+     * @brief      Look up a hostname, counting it as used.
+     *             An expired entry is removed.
+     *
+     * @param[in]  hostname  The hostname
+     * @param[in]  now       The current time
+     *
+     * @return     The entry, nullptr if none
+     */
+    Entry* lookup(const Hostname& hostname, timestamp_t now);
+
+    /**
+     * @brief      Cache an address for a hostname, replacing any entry.
+     *
+     * @param[in]  hostname  The hostname
+     * @param[in]  addr      The address
+     * @param[in]  ttl       The ttl (s), 0 does not cache
+     * @param[in]  now       The current time
+     */
+    void insert(const Hostname& hostname, Address addr, uint32_t ttl, timestamp_t now);
+
+    /**
+     * @brief      Cache that a hostname does not exist, replacing any entry.
+     *
+     * @param[in]  hostname  The hostname
+     * @param[in]  ttl       The ttl (s), 0 does not cache
+     * @param[in]  now       The current time
+     */
+    void insert_negative(const Hostname& hostname, uint32_t ttl, timestamp_t now);
+
+    /**
+     * @brief      Whether an entry is popular and close enough to expiring
+     *             to be refreshed. True only once for an entry.
+     *
+     * @param      entry  The entry, as returned by lookup()
+     * @param[in]  now    The current time
+     */
+    bool prefetch_due(Entry& entry, timestamp_t now) const noexcept;
+
+    bool erase(const Hostname& hostname);
+
+    /**
+     * @brief      Remove all expired entries.
+     *
+     * @param[in]  now   The current time
+     *
+     * @return     Number of entries removed
+     */
+    size_t expire(timestamp_t now);
+
+    void clear() noexcept
+    {
+      index_.clear();
+      lru_.clear();
+    }
+
+    /** Sets the capacity, evicting the least recently used entries above it */
+    void set_capacity(size_t capacity);
+
+    /**
+     * @brief      Evict the least recently used entries above @keep, for
+     *             when memory is low. The capacity stays as it is.
+     *
+     * @return     Number of entries removed
+     */
+    size_t shrink(size_t keep);
+
+    size_t capacity() const noexcept
+    { return capacity_; }
+
+    size_t size() const noexcept
+    { return index_.size(); }
+
+    bool empty() const noexcept
+    { return index_.empty(); }
+
+  private:
+    // most recently used first
+    using List = std::list<std::pair<Hostname, Entry>>;
+    List lru_;
+    std::unordered_map<Hostname, List::iterator> index_;
+    size_t capacity_;
+
+    void store(const Hostname& hostname, Entry entry);
+  };
+
+} // < namespace net::dns
+
+#endif // < NET_DNS_CACHE_HPP
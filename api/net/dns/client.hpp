@@ -6,8 +6,13 @@
 #include <net/ip4/ip4.hpp>
 #include <net/udp/socket.hpp>
 #include <util/timer.hpp>
+#include <util/alloc_pmr.hpp>
+#include <kernel/mem_pressure.hpp>
 #include <map>
 #include <unordered_map>
+#include <vector>
+#include "cache.hpp"
+#include "nameservers.hpp"
 #include "query.hpp"
 #include "response.hpp"
 
@@ -20,8 +25,15 @@ namespace net::dns {
    * @brief      A simple DNS client which is able to resolve hostnames
    *             and locally cache them.
    *
-   * @note       A entry can stay longer than TTL due to flush timer granularity.
-   *             Max_TTL = TTL + FLUSH_INTERVAL (90s default)
+   *             Answers are cached for their TTL, names that do not exist
+   *             negatively, in a cache bounded by least recently used.
+   *             Popular names are refreshed shortly before they expire.
+   *             Lookups of a name already being resolved wait for the
+   *             same answer rather than sending a query of their own.
+   *
+   *             With several nameservers set, a query goes to the fastest
+   *             and then to the others in turn while no answer has come,
+   *             and the first valid answer wins.
    */
   class Client
   {
@@ -31,24 +43,14 @@ namespace net::dns {
     using Address         = net::Addr;
     using Hostname        = std::string;
     using timestamp_t     = RTC::timestamp_t;
-    /**
-     * @brief      A simple cache entry containing the resolved IP address
-     *             and a timestamp when it expires (based on uptime)
-     */
-    struct Cache_entry
-    {
-      Address     address;
-      timestamp_t expires;
-
-      Cache_entry(Address addr, const timestamp_t exp) noexcept
-        : address{std::move(addr)}, expires{exp}
-      {}
-    };
-    using Cache           = std::unordered_map<Hostname, Cache_entry>;
+    using Cache           = dns::Cache;
+    using Cache_entry     = Cache::Entry;
+    using Servers         = std::vector<Address>;
 
     static Timer::duration_t DEFAULT_RESOLVE_TIMEOUT; // 5s, client.cpp
-    static Timer::duration_t DEFAULT_FLUSH_INTERVAL; // 60s, client.cpp
-    static std::chrono::seconds DEFAULT_CACHE_TTL; // 60s, client.cpp
+    static Timer::duration_t DEFAULT_FLUSH_INTERVAL; // 30s, client.cpp
+    static std::chrono::seconds DEFAULT_CACHE_TTL; // 1h, client.cpp
+    static std::chrono::seconds DEFAULT_NEGATIVE_TTL; // 60s, client.cpp
 
     /**
      * @brief      Construct a DNS client on a given interface (stack),
@@ -58,6 +60,8 @@ namespace net::dns {
      */
     Client(Stack& stack);
 
+    ~Client();
+
     /**
      * @brief      Resolve a hostname for an IP4 address with a timeout duration
      *             and an option whether to force the request, disabling cache lookup.
@@ -89,6 +93,54 @@ namespace net::dns {
       resolve(dns_server, std::move(hostname), std::move(handler), DEFAULT_RESOLVE_TIMEOUT, force);
     }
 
+    /**
+     * @brief      Resolve a hostname through the nameservers set.
+     *             The query is sent to the fastest one, and to the next
+     *             whenever no answer has come within its hedge delay.
+     *             The first valid answer is the one handed over.
+     *
+     * @param[in]  hostname  The hostname to resolve
+     * @param[in]  handler   The resolve handler
+     * @param[in]  timeout   The time before the request times out
+     * @param[in]  force     Wether to force the resolve, ignoring the cache
+     */
+    void resolve(Hostname           hostname,
+                 Resolve_handler    handler,
+                 Timer::duration_t  timeout,
+                 bool               force = false);
+
+    /**
+     * @brief      Resolve a hostname through the nameservers set, with default timeout.
+     */
+    void resolve(Hostname           hostname,
+                 Resolve_handler    handler,
+                 bool               force = false)
+    {
+      resolve(std::move(hostname), std::move(handler), DEFAULT_RESOLVE_TIMEOUT, force);
+    }
+
+    /**
+     * @brief      Sets the nameservers to resolve through, in order of
+     *             preference until their round trip times are known.
+     *             Only those of the family of the first are used.
+     *
+     * @param[in]  servers  The nameservers
+     */
+    void set_nameservers(const Servers& servers)
+    { nameservers_.set(servers); }
+
+    const Nameservers& nameservers() const noexcept
+    { return nameservers_; }
+
+    /**
+     * @brief      Sets the longest time to wait for a nameserver to answer
+     *             before asking the next one as well.
+     *
+     * @param[in]  delay  The delay
+     */
+    void set_hedge_delay(std::chrono::milliseconds delay)
+    { nameservers_.set_max_hedge_delay(delay.count()); }
+
     /**
      * @brief      Flush the cache, removing all entries.
      */
@@ -103,7 +155,7 @@ namespace net::dns {
     { return cache_; }
 
     /**
-     * @brief      Returns the time to live value of an entry in the cache.
+     * @brief      Returns the longest time to live of an entry in the cache.
      *
      * @return     Time to live in seconds
      */
@@ -111,7 +163,8 @@ namespace net::dns {
     { return cache_ttl_; }
 
     /**
-     * @brief      Sets the time to live for a cache entry
+     * @brief      Sets the longest time to live for a cache entry,
+     *             capping the TTL of the records.
      *             A value of zero means caching is disabled.
      *
      * @param[in]  ttl   The ttl in seconds
@@ -119,6 +172,14 @@ namespace net::dns {
     void set_cache_ttl(std::chrono::seconds ttl)
     { cache_ttl_ = ttl; }
 
+    /**
+     * @brief      Sets the number of hostnames cached at most
+     *
+     * @param[in]  entries  The capacity
+     */
+    void set_cache_size(size_t entries)
+    { cache_.set_capacity(entries); }
+
     /**
      * @brief      Disables caching
      */
@@ -141,6 +202,17 @@ namespace net::dns {
     Cache                 cache_;
     std::chrono::seconds  cache_ttl_;
     Timer                 flush_timer_;
+    Nameservers           nameservers_;
+
+    /**
+     * @brief      Resolve a hostname through the given servers,
+     *             answering from the cache where it can.
+     */
+    void lookup(Servers            servers,
+                Hostname           hostname,
+                Resolve_handler    handler,
+                Timer::duration_t  timeout,
+                bool               force);
 
     /**
      * @brief      Receive a UDP message with a (hopefully) DNS response
@@ -154,13 +226,25 @@ namespace net::dns {
     void receive_response(Address, udp::port_t, const char* data, size_t);
 
     /**
-     * @brief      Adds a cache entry.
+     * @brief      Send a query for a hostname, or join the one already
+     *             sent for it.
      *
+     * @param[in]  servers   The dns servers, in the order to ask them
      * @param[in]  hostname  The hostname
-     * @param[in]  addr      The address
-     * @param[in]  ttl       The ttl
+     * @param[in]  handler   The resolve handler, nullptr when prefetching
+     * @param[in]  timeout   The time before the request times out
      */
-    void add_cache_entry(const Hostname& hostname, Address addr, std::chrono::seconds ttl);
+    void query(Servers servers, Hostname hostname,
+               Resolve_handler handler, Timer::duration_t timeout);
+
+    /**
+     * @brief      Cache the answer of a response, or that the name
+     *             does not exist.
+     *
+     * @param[in]  hostname  The hostname
+     * @param[in]  res       The response
+     */
+    void add_cache_entry(const Hostname& hostname, const dns::Response& res);
 
     /**
      * @brief      Flush all expired cache entries.
@@ -191,12 +275,19 @@ namespace net::dns {
 
       udp::Socket&    socket;
 
-      Resolve_handler callback;
+      // everyone waiting for the answer
+      std::vector<Resolve_handler> callbacks;
       Timer           timer;
 
+      // the servers to ask, and when each was asked (ms, 0 once answered)
+      Servers               servers;
+      std::vector<uint64_t> sent;
+      size_t                failed = 0;
+      Timer                 hedge_timer;
+
       Request(Client& cli, udp::Socket& sock, dns::Query q, Resolve_handler cb);
 
-      void resolve(Address server, Timer::duration_t timeout);
+      void resolve(Servers servers, Timer::duration_t timeout);
 
       ~Request();
 
@@ -208,17 +299,28 @@ namespace net::dns {
 
       /**
        * @brief      Finish the request with a no error,
-       *             invoking the resolve handler (callback)
+       *             invoking the resolve handlers (callbacks)
        */
       void finish(const Error& err);
 
       void timeout();
 
+      /** Ask the next server */
+      void send_next();
+
     }; // < struct Request
        //
-    using Requests = std::unordered_map<dns::id_t, Request>;
+    using Requests = std::pmr::unordered_map<dns::id_t, Request>;
+    /** Where requests are allocated, from this CPU's DNS pool */
+    os::mem::Pmr_pool::Resource_ptr mem_;
     /** Pending requests (not yet resolved) */
     Requests requests_;
+    /** The pending request of each hostname */
+    std::unordered_map<Hostname, dns::id_t> pending_;
+    /** Gives the cache back when memory is low */
+    int shrinker_;
+
+    size_t shrink_cache(os::mem::Pressure);
   };
 }
 
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef NET_DNS_NAMESERVERS_HPP
+#define NET_DNS_NAMESERVERS_HPP
+
+#include <net/addr.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace net::dns {
+
+  /**
+   * @brief      The nameservers a client asks, with a smoothed round trip
+   *             time of each to prefer the fastest.
+   *
+   *             A query goes to the fastest first, then to the next if no
+   *             answer has come within the hedge delay of the one before,
+   *             and so on. A server that does not answer before the query
+   *             times out has its round trip time doubled.
+   */
+  class Nameservers
+  {
+  public:
+    using Address = net::Addr;
+
+    static constexpr uint32_t INITIAL_RTT   = 100;  // ms
+    static constexpr uint32_t MAX_RTT       = 5000; // ms
+    static constexpr uint32_t MIN_HEDGE     = 10;   // ms
+    static constexpr uint32_t DEFAULT_HEDGE = 250;  // ms, the longest
+
+    struct Server
+    {
+      Address  addr;
+      uint32_t srtt; // ms
+    };
+
+    /** Sets the servers, in order of preference until measured */
+    void set(const std::vector<Address>& servers);
+
+    const std::vector<Server>& servers() const noexcept
+    { return servers_; }
+
+    bool empty() const noexcept
+    { return servers_.empty(); }
+
+    /**
+     * @brief      The servers to ask, fastest first. Only servers of the
+     *             family of the first one set are included, as a query is
+     *             sent from one socket.
+     *
+     * @return     The addresses
+     */
+    std::vector<Address> ordered() const;
+
+    /**
+     * @brief      Account for an answer from a server
+     *
+     * @param[in]  server  The server
+     * @param[in]  rtt     The time from the query was sent (ms)
+     */
+    void answered(const Address& server, uint32_t rtt);
+
+    /** Account for a server not answering in time */
+    void timed_out(const Address& server);
+
+    /** The time to wait for a server before asking the next (ms) */
+    uint32_t hedge_delay(const Address& server) const;
+
+    void set_max_hedge_delay(uint32_t ms) noexcept
+    { max_hedge_ = ms; }
+
+  private:
+    std::vector<Server> servers_;
+    uint32_t max_hedge_ = DEFAULT_HEDGE;
+
+    Server* find(const Address& addr);
+    const Server* find(const Address& addr) const
+    { return const_cast<Nameservers*>(this)->find(addr); }
+  };
+
+} // < namespace net::dns
+
+#endif // < NET_DNS_NAMESERVERS_HPP
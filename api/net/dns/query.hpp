@@ -2,6 +2,7 @@
 #pragma once
 
 #include "dns.hpp"
+#include <kernel/rng.hpp>
 
 namespace net::dns {
 
@@ -23,12 +24,9 @@ namespace net::dns {
     size_t write(char* buffer) const;
 
   private:
-    // TODO: for now, needs to be randomized
+    // unpredictable, so that replies can't be forged blind
     static unsigned short generate_id()
-    {
-      static unsigned short id = 0;
-      return ++id;
-    }
+    { return rng_fast_uint32(); }
 
     int write_formatted_hostname(char* qname) const
     { return dns::encode_name(this->hostname, qname); }
@@ -17,6 +17,9 @@ namespace net::dns {
 
     Record() = default;
 
+    /** An address record, as when answered from the cache */
+    Record(std::string name, const net::Addr& addr, uint32_t ttl);
+
     int parse(const char* reader, const char* buffer, size_t len);
     void populate(const rr_data& res);
     int parse_name(const char* reader,
@@ -18,6 +18,7 @@ namespace net::dns {
     std::vector<Record> answers;
     std::vector<Record> auth;
     std::vector<Record> addit;
+    Response_code       rcode = Response_code::NO_ERROR;
 
     ip4::Addr get_first_ipv4() const;
     ip6::Addr get_first_ipv6() const;
@@ -25,6 +26,12 @@ namespace net::dns {
 
     bool has_addr() const;
 
+    /** The lowest TTL of the address answers, 0 if none */
+    uint32_t addr_ttl() const;
+
+    /** The TTL of the SOA record in a negative answer (RFC 2308), 0 if none */
+    uint32_t negative_ttl() const;
+
     int parse(const char* buffer, size_t len);
   };
 
@@ -9,6 +9,8 @@
 #include <hw/mac_addr.hpp> // ethernet address
 #include <hw/nic.hpp> // protocol
 #include <net/inet_common.hpp>
+#include <net/features.hpp>
+#include <statman>
 
 namespace net {
 
@@ -33,7 +35,8 @@ namespace net {
       return "eth" + std::to_string(ethernet_idx);
     }
 
-    /** Bottom upstream input, "Bottom up". Handle raw ethernet buffer. */
+    /** Bottom upstream input, "Bottom up". Handle raw ethernet buffer,
+        or a chain of them, see Link_layer::burst_size. */
     void receive(Packet_ptr);
 
 
@@ -67,7 +70,10 @@ namespace net {
      * @param[in]  del   The upstream delegate
      */
     void set_vlan_upstream(upstream del)
-    { vlan_upstream_ = del; }
+    {
+      Expects(Features::vlan or del == nullptr);
+      vlan_upstream_ = del;
+    }
 
     /** Delegate downstream */
     void set_physical_downstream(downstream del)
@@ -87,10 +93,10 @@ namespace net {
 
     /** Stats getters **/
     uint64_t get_packets_rx()
-    { return packets_rx_; }
+    { return packets_rx_.total(); }
 
     uint64_t get_packets_tx()
-    { return packets_tx_; }
+    { return packets_tx_.total(); }
 
     uint64_t get_packets_dropped()
     { return packets_dropped_; }
@@ -99,12 +105,15 @@ namespace net {
     { return trailer_packets_dropped_; }
 
   protected:
+    /** Handle one frame, batching IPv4 for the upstream handler */
+    void receive_one(Packet_ptr, Packet_chain& ip4_unicast, Packet_chain& ip4_bcast);
+
     const addr& mac_;
     int   ethernet_idx;
 
     /** Stats */
-    uint64_t& packets_rx_;
-    uint64_t& packets_tx_;
+    Stat_percpu& packets_rx_;
+    Stat_percpu& packets_tx_;
     uint32_t& packets_dropped_;
     uint32_t& trailer_packets_dropped_;
 
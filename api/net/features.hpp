@@ -0,0 +1,61 @@
+#pragma once
+#ifndef NET_FEATURES_HPP
+#define NET_FEATURES_HPP
+
+namespace net {
+
+  /**
+   * What the network stack is compiled with. The per packet paths of
+   * Ethernet and IP4 test these with if constexpr, so a service that
+   * needs less than all of it doesn't pay for the checks, calls through
+   * delegates and code of what it doesn't use.
+   *
+   * Chosen at build time, for the OS library and the service alike:
+   *   NET_MINIMAL (cmake)  - IPv4 on plain Ethernet only
+   *   NET_NO_IPV6          - IPv6 frames are dropped
+   *   NET_NO_VLAN          - tagged frames are dropped
+   *   NET_NO_NETFILTER     - no filter chains, conntrack or NAT
+   *   NET_NO_FORWARDING    - only packets to and from this stack
+   * Setting up what is compiled out fails an Expects.
+   */
+  template <bool IPv6, bool VLAN, bool Netfilter, bool Forwarding>
+  struct Feature_set {
+    static constexpr bool ipv6       = IPv6;
+    static constexpr bool vlan       = VLAN;
+    static constexpr bool netfilter  = Netfilter;
+    static constexpr bool forwarding = Forwarding;
+  };
+
+#ifdef NET_FEATURES_MINIMAL
+  #define NET_NO_IPV6
+  #define NET_NO_VLAN
+  #define NET_NO_NETFILTER
+  #define NET_NO_FORWARDING
+#endif
+
+  using Features = Feature_set<
+#ifdef NET_NO_IPV6
+    false,
+#else
+    true,
+#endif
+#ifdef NET_NO_VLAN
+    false,
+#else
+    true,
+#endif
+#ifdef NET_NO_NETFILTER
+    false,
+#else
+    true,
+#endif
+#ifdef NET_NO_FORWARDING
+    false
+#else
+    true
+#endif
+  >;
+
+} // < namespace net
+
+#endif
@@ -0,0 +1,304 @@
+#pragma once
+#ifndef NET_FILTER_RULES_HPP
+#define NET_FILTER_RULES_HPP
+
+#include <net/netfilter.hpp>
+#include <net/inet_common.hpp>
+#include <net/lpm.hpp>
+#include <net/ip4/packet_ip4.hpp>
+#include <net/ip6/packet_ip6.hpp>
+#include <array>
+#include <string>
+#include <vector>
+#include <statman>
+
+namespace net {
+
+  /**
+   *  Bitmap intersection classifier over a fixed number of fields.
+   *  Each field is cut into the elementary intervals formed by every
+   *  rule's range boundaries, and each interval holds a bitmap of the
+   *  rules it satisfies. Classifying is a binary search per field and
+   *  an AND of the bitmaps, where the lowest set bit is the first rule.
+   */
+  class Rule_classifier {
+  public:
+    // 128 bit keys, most significant word first
+    using Key = std::array<uint64_t, 2>;
+
+    enum Field {
+      SRC_ADDR,
+      DST_ADDR,
+      PROTO,
+      SRC_PORT,
+      DST_PORT,
+      CT_STATE,
+      FIELDS
+    };
+
+    /** Inclusive range of values for a field */
+    struct Range {
+      Key lo;
+      Key hi;
+    };
+
+    /** Start a new set of @rules rules, matching anything */
+    void reset(size_t rules);
+
+    /** Let @rule match @range on @field. A rule with no ranges on a
+        field matches any value, and several ranges are a union. */
+    void add(int rule, Field field, Range range);
+
+    /** Build the interval bitmaps from the ranges added since reset */
+    void compile();
+
+    /** Index of the first rule matching @keys, or -1 */
+    int classify(const std::array<Key, FIELDS>& keys) const noexcept;
+
+    size_t rules() const noexcept
+    { return rules_; }
+
+  private:
+    struct Dimension {
+      // ranges added per rule, cleared by compile
+      std::vector<std::pair<int, Range>> ranges;
+      // sorted interval starts, and words_ bitmap words per interval
+      std::vector<Key>      starts;
+      std::vector<uint64_t> bitmaps;
+    };
+
+    std::array<Dimension, FIELDS> dims_;
+    size_t rules_ = 0;
+    size_t words_ = 0;
+  };
+
+  /**
+   *  A declarative netfilter rule. Fields left at their defaults
+   *  match anything.
+   */
+  template <typename IPV>
+  struct Filter_rule
+  {
+    using Addr = typename IPV::addr;
+
+    struct Port_range {
+      uint16_t min = 0;
+      uint16_t max = 0xffff;
+      bool any() const noexcept { return min == 0 and max == 0xffff; }
+    };
+
+    // conntrack states, as a mask in ct_states
+    static constexpr uint8_t NEW         = 1 << (int) Conntrack::State::NEW;
+    static constexpr uint8_t ESTABLISHED = 1 << (int) Conntrack::State::ESTABLISHED;
+    static constexpr uint8_t RELATED     = 1 << (int) Conntrack::State::RELATED;
+    static constexpr uint8_t UNCONFIRMED = 1 << (int) Conntrack::State::UNCONFIRMED;
+    static constexpr uint8_t UNTRACKED   = 1 << 4;
+    static constexpr uint8_t ANY_STATE   = 0x1f;
+
+    Addr       src{};
+    uint8_t    src_prefix = 0;
+    Addr       dst{};
+    uint8_t    dst_prefix = 0;
+    // the protocol after IPv6 extension headers
+    bool       any_proto  = true;
+    Protocol   proto{};
+    // ports only match TCP and UDP packets, unless left as any
+    Port_range src_port{};
+    Port_range dst_port{};
+    uint8_t    ct_states  = ANY_STATE;
+
+    Filter_verdict_type verdict = Filter_verdict_type::DROP;
+
+    Filter_rule& from(const Addr& net, uint8_t prefix) noexcept
+    { src = net; src_prefix = prefix; return *this; }
+
+    Filter_rule& to(const Addr& net, uint8_t prefix) noexcept
+    { dst = net; dst_prefix = prefix; return *this; }
+
+    Filter_rule& protocol(Protocol p) noexcept
+    { proto = p; any_proto = false; return *this; }
+
+    Filter_rule& sport(uint16_t min, uint16_t max) noexcept
+    { src_port = {min, max}; return *this; }
+
+    Filter_rule& dport(uint16_t min, uint16_t max) noexcept
+    { dst_port = {min, max}; return *this; }
+
+    Filter_rule& sport(uint16_t port) noexcept
+    { return sport(port, port); }
+
+    Filter_rule& dport(uint16_t port) noexcept
+    { return dport(port, port); }
+
+    Filter_rule& states(uint8_t mask) noexcept
+    { ct_states = mask; return *this; }
+
+    Filter_rule& accept() noexcept
+    { verdict = Filter_verdict_type::ACCEPT; return *this; }
+
+    Filter_rule& drop() noexcept
+    { verdict = Filter_verdict_type::DROP; return *this; }
+  };
+
+  /**
+   *  An ordered list of Filter_rule compiled into a Rule_classifier,
+   *  so each packet is parsed once and matched against every rule at
+   *  the cost of a few lookups. The first matching rule decides the
+   *  verdict, and packets matching no rule get the default verdict.
+   *
+   *  Every rule counts its hits in the Statman stat "<name>.rule<index>".
+   *  Use filter() to insert the rules into a Filter_chain.
+   */
+  template <typename IPV>
+  class Filter_rules
+  {
+  public:
+    using Rule          = Filter_rule<IPV>;
+    using IP_packet     = typename IPV::IP_packet;
+    using IP_packet_ptr = typename IPV::IP_packet_ptr;
+
+    Filter_rules(std::string name,
+                 std::initializer_list<Rule> rules = {},
+                 Filter_verdict_type default_verdict = Filter_verdict_type::ACCEPT)
+      : name_{std::move(name)}, rules_(rules), default_{default_verdict}
+    { compile(); }
+
+    /** Append a rule. Takes effect on the next compile() */
+    Filter_rules& add(Rule rule)
+    {
+      rules_.push_back(std::move(rule));
+      return *this;
+    }
+
+    /** Rebuild the classifier from the rules, creating missing hit counters.
+        Invalidates verdicts cached by chain fast paths. */
+    void compile();
+
+    /** Index of the first rule matching @pkt, or -1 */
+    int classify(const IP_packet& pkt, Conntrack::Entry_ptr ct) const noexcept
+    { return classifier_.classify(keys(pkt, ct)); }
+
+    Filter_verdict<IPV> operator()(IP_packet_ptr pkt, Inet&, Conntrack::Entry_ptr ct)
+    {
+      const int rule = classify(*pkt, ct);
+      if (rule < 0)
+        return {std::move(pkt), default_};
+      ++(*hits_[rule]);
+      return {std::move(pkt), rules_[rule].verdict};
+    }
+
+    Packetfilter<IPV> filter() noexcept
+    { return {this, &Filter_rules::operator()}; }
+
+    /** Number of packets that matched rule @idx */
+    uint64_t hits(size_t idx) const
+    { return *hits_.at(idx); }
+
+    const std::vector<Rule>& rules() const noexcept
+    { return rules_; }
+
+    const std::string& name() const noexcept
+    { return name_; }
+
+  private:
+    // packets without ports get a port value no rule range includes
+    static constexpr uint64_t NO_PORT = 0x10000;
+    static constexpr uint64_t NO_CT   = 4;
+
+    static std::array<Rule_classifier::Key, Rule_classifier::FIELDS>
+    keys(const IP_packet& pkt, Conntrack::Entry_ptr ct) noexcept;
+
+    static Rule_classifier::Key key(const ip4::Addr& addr) noexcept
+    { return {(uint64_t) ntohl(addr.whole) << 32, 0}; }
+
+    static Rule_classifier::Key key(const ip6::Addr& addr) noexcept
+    { return {ntohll(addr.i64[0]), ntohll(addr.i64[1])}; }
+
+    static bool l4_follows_header(const PacketIP4&) noexcept
+    { return true; }
+
+    static bool l4_follows_header(const PacketIP6& pkt) noexcept
+    { return pkt.next_protocol() == pkt.ip_protocol(); }
+
+    static Rule_classifier::Range prefix(const typename Rule::Addr& net, int len)
+    {
+      const auto lo = Prefix_trie::mask(key(net), len);
+      const auto hi = Prefix_trie::mask({~0ull, ~0ull}, len);
+      return {lo, {lo[0] | ~hi[0], lo[1] | ~hi[1]}};
+    }
+
+    static Rule_classifier::Range value(uint64_t lo, uint64_t hi) noexcept
+    { return {{lo, 0}, {hi, 0}}; }
+
+    std::string               name_;
+    std::vector<Rule>         rules_;
+    Filter_verdict_type       default_;
+    std::vector<uint64_t*>    hits_;
+    Rule_classifier           classifier_;
+  };
+
+  template <typename IPV>
+  void Filter_rules<IPV>::compile()
+  {
+    using C = Rule_classifier;
+    const int addr_bits = sizeof(typename Rule::Addr) * 8;
+
+    classifier_.reset(rules_.size());
+    for (size_t i = 0; i < rules_.size(); i++)
+    {
+      const auto& rule = rules_[i];
+      if (rule.src_prefix)
+        classifier_.add(i, C::SRC_ADDR, prefix(rule.src, std::min<int>(rule.src_prefix, addr_bits)));
+      if (rule.dst_prefix)
+        classifier_.add(i, C::DST_ADDR, prefix(rule.dst, std::min<int>(rule.dst_prefix, addr_bits)));
+      if (not rule.any_proto)
+        classifier_.add(i, C::PROTO, value((uint8_t) rule.proto, (uint8_t) rule.proto));
+      if (not rule.src_port.any())
+        classifier_.add(i, C::SRC_PORT, value(rule.src_port.min, rule.src_port.max));
+      if (not rule.dst_port.any())
+        classifier_.add(i, C::DST_PORT, value(rule.dst_port.min, rule.dst_port.max));
+      if (rule.ct_states != Rule::ANY_STATE)
+        for (uint64_t state = 0; state <= NO_CT; state++)
+          if (rule.ct_states & (1 << state))
+            classifier_.add(i, C::CT_STATE, value(state, state));
+    }
+    classifier_.compile();
+    filter_ruleset_changed();
+
+    while (hits_.size() < rules_.size())
+    {
+      auto& stat = Statman::get().create(Stat::UINT64,
+          name_ + ".rule" + std::to_string(hits_.size()));
+      hits_.push_back(&stat.get_uint64());
+    }
+  }
+
+  template <typename IPV>
+  std::array<Rule_classifier::Key, Rule_classifier::FIELDS>
+  Filter_rules<IPV>::keys(const IP_packet& pkt, Conntrack::Entry_ptr ct) noexcept
+  {
+    const auto proto = pkt.ip_protocol();
+    uint64_t sport = NO_PORT;
+    uint64_t dport = NO_PORT;
+    // IPv6 ports are only read when there are no extension headers
+    if ((proto == Protocol::TCP or proto == Protocol::UDP)
+        and l4_follows_header(pkt)
+        and pkt.ip_data_length() >= 4)
+    {
+      const auto* ports = reinterpret_cast<const uint16_t*>(pkt.ip_data().data());
+      sport = ntohs(ports[0]);
+      dport = ntohs(ports[1]);
+    }
+    return {{
+      key(pkt.ip_src()),
+      key(pkt.ip_dst()),
+      {(uint8_t) proto, 0},
+      {sport, 0},
+      {dport, 0},
+      {ct ? (uint64_t) ct->state : NO_CT, 0}
+    }};
+  }
+
+} //< namespace net
+
+#endif
@@ -0,0 +1,128 @@
+#pragma once
+#ifndef NET_FLOW_EXPORT_HPP
+#define NET_FLOW_EXPORT_HPP
+
+#include <net/conntrack.hpp>
+#include <util/timer.hpp>
+#include <delegate>
+#include <smp>
+#include <chrono>
+#include <vector>
+
+namespace net {
+
+/**
+ * @brief      Flow accounting: the connections of a Conntrack exported as
+ *             IPFIX (RFC 7011) records, for a collector over UDP.
+ *
+ * Nothing is done per packet beyond the counters Conntrack::in() keeps in
+ * each entry. A flow is exported when it expires, and every active_timeout
+ * while it lasts, as one record for each direction that saw traffic, with
+ * its addresses, ports, protocol, total packets and bytes and when it was
+ * first and last seen. Records are batched into messages of up to
+ * MAX_MESSAGE bytes, each carrying the templates, so a collector can
+ * decode any message it gets. Messages are sent every flush_interval.
+ *
+ * With a sampling of N, only one flow in N is exported, picked by the
+ * hash of the flow, so a flow is always or never exported. The collector
+ * scales the totals by N.
+ *
+ * @code
+ *   auto& sock = inet.udp().bind();
+ *   static net::Flow_exporter flows{*inet.conntrack(),
+ *     [&sock] (const uint8_t* data, size_t len) {
+ *       sock.sendto({10,0,0,1}, 4739, data, len);
+ *     }, 10};
+ *   flows.start();
+ * @endcode
+ */
+class Flow_exporter {
+public:
+  using Send_func = delegate<void(const uint8_t* data, size_t len)>;
+
+  /** The largest message, to fit in a datagram without fragments */
+  static constexpr size_t   MAX_MESSAGE = 1400;
+  /** Template of the records of IPv4 and IPv6 flows */
+  static constexpr uint16_t TEMPLATE_IP4 = 256;
+  static constexpr uint16_t TEMPLATE_IP6 = 257;
+
+  /** Why a record was exported, the IPFIX flowEndReason */
+  enum End_reason : uint8_t {
+    IDLE   = 1, // the entry expired
+    ACTIVE = 2, // the flow goes on
+    FORCED = 4  // the exporter stopped
+  };
+
+  /**
+   * Export the flows of @ct, replacing its Conntrack::on_expire
+   *
+   * @param[in]  ct        The connection tracker
+   * @param[in]  send      Sends a message to the collector
+   * @param[in]  sampling  Export one flow in @sampling
+   * @param[in]  domain    The IPFIX observation domain
+   */
+  Flow_exporter(Conntrack& ct, Send_func send,
+                uint32_t sampling = 1, uint32_t domain = 0);
+  ~Flow_exporter();
+  Flow_exporter(const Flow_exporter&) = delete;
+  Flow_exporter& operator=(const Flow_exporter&) = delete;
+
+  /** How often the records of active flows are exported */
+  std::chrono::seconds active_timeout {60};
+  /** How often messages are sent */
+  std::chrono::seconds flush_interval {5};
+  /** Messages waiting to be sent, beyond which records are dropped */
+  size_t max_messages = 256;
+
+  /** Send messages on a timer, on this CPU */
+  void start();
+
+  /** Stop the timer, exporting every flow as FORCED, and send it all */
+  void stop();
+
+  /** Export a record of every flow, as @reason */
+  void export_active(End_reason reason = ACTIVE);
+
+  /** Send the records waiting */
+  void flush();
+
+  /** Whether the flow of @ent is sampled */
+  bool sampled(const Conntrack::Entry& ent) const noexcept;
+
+  /** Records exported so far */
+  uint64_t records() const noexcept
+  { return records_; }
+
+  /** Records dropped as too many messages were waiting */
+  uint64_t dropped() const noexcept
+  { return dropped_; }
+
+private:
+  void on_expire(Conntrack::Entry*);
+  void on_timeout();
+  void add_record(const Conntrack::Entry&, int dir, End_reason);
+  void begin_message();
+  void close_set();
+  void finish_message();
+
+  Conntrack& ct_;
+  Send_func  send_;
+  const uint32_t sampling_;
+  const uint32_t domain_;
+  Timer      timer_;
+  RTC::timestamp_t last_active_ = 0;
+
+  smp_spinlock lock_;
+  // complete messages, then the one being filled
+  std::vector<std::vector<uint8_t>> pending_;
+  std::vector<uint8_t> message_;
+  // offset of the data set being filled in message_, and its template
+  size_t   set_begin_ = 0;
+  uint16_t set_id_    = 0;
+  uint64_t records_ = 0;
+  uint64_t dropped_ = 0;
+};
+
+} // < namespace net
+
+#endif // < NET_FLOW_EXPORT_HPP
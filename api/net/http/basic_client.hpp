@@ -8,6 +8,8 @@
 
 #include <net/tcp/tcp.hpp>
 #include <net/inet>
+#include <util/timer.hpp>
+#include <deque>
 #include <vector>
 #include <map>
 
@@ -47,6 +49,18 @@ namespace http {
 
     };
 
+    /* Connection pool, per host */
+    struct Pool_config {
+      // the most connections open to a host, more requests are queued
+      size_t                max_connections{6};
+      // the most connections kept open without a request
+      size_t                max_idle{2};
+      // how long a connection may be kept open without a request
+      std::chrono::seconds  idle_timeout{30};
+
+      Pool_config() noexcept {}
+    };
+
   private:
     using ResolveCallback = net::Inet::resolve_func;
 
@@ -175,6 +189,38 @@ namespace http {
     std::string origin() const
     { return tcp_.stack().ip_addr().to_string(); }
 
+    /**
+     * @brief      Configure the connection pool
+     *
+     * @param[in]  config  The pool configuration
+     */
+    void set_pool(Pool_config config)
+    { pool_ = config; }
+
+    const Pool_config& pool() const noexcept
+    { return pool_; }
+
+    /**
+     * @brief      Whether requests ask for the connection to be kept
+     *             open and returned to the pool (default true)
+     */
+    void keep_alive(bool keep_alive) noexcept
+    { keep_alive_ = keep_alive; }
+
+    bool keep_alive() const noexcept
+    { return keep_alive_; }
+
+    /**
+     * @brief      Returns the number of requests waiting for a connection to a host
+     *
+     * @param[in]  host  The host
+     */
+    size_t queued(const Host host) const
+    {
+      auto it = queued_.find(host);
+      return (it != queued_.end()) ? it->second.size() : 0;
+    }
+
     virtual ~Basic_client() = default;
 
   protected:
@@ -187,9 +233,20 @@ namespace http {
 
   private:
     friend class Client_connection;
+
+    struct Queued {
+      Request_ptr       req;
+      Response_handler  cb;
+      bool              secure;
+      Options           options;
+    };
+
     Request_handler   on_send_;
-    bool              keep_alive_ = false;
+    bool              keep_alive_ = true;
     const bool        supports_https;
+    Pool_config       pool_;
+    std::map<Host, std::deque<Queued>> queued_;
+    Timer             pool_timer_;
 
     void resolve(const std::string& host, ResolveCallback);
 
@@ -207,6 +264,23 @@ namespace http {
 
     Client_connection& get_connection(const Host host);
 
+    /**
+     * @brief      Get an idle connection to the host, or a new one
+     *             if the pool allows it
+     *
+     * @return     The connection, or nullptr if the request must wait
+     */
+    Client_connection* acquire(const Host host, const bool secure);
+
+    /** Send queued requests to the host, while there are connections */
+    void send_queued(const Host host);
+
+    /** A connection has finished a request and was kept alive */
+    void on_idle(Client_connection&);
+
+    /** Close the idle connections that timed out, or were closed by the peer */
+    void reap_idle();
+
     void close(Client_connection&);
 
     void validate_secure(const bool secure) const
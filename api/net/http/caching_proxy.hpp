@@ -0,0 +1,47 @@
+#pragma once
+#ifndef HTTP_CACHING_PROXY_HPP
+#define HTTP_CACHING_PROXY_HPP
+
+// http
+#include "basic_client.hpp"
+#include "response_cache.hpp"
+
+namespace http {
+
+  /**
+   * @brief      Reverse proxy to one upstream server, answering from a
+   *             Response_cache what it may. Misses and revalidations go
+   *             upstream through a Basic_client, and its connection pool.
+   *
+   *             Install handle() as the request handler of a Server.
+   */
+  class Caching_proxy {
+  public:
+    /**
+     * @param      client    The client for the upstream requests
+     * @param[in]  upstream  The upstream server
+     * @param[in]  capacity  The most bytes to keep cached
+     */
+    Caching_proxy(Basic_client& client, net::Socket upstream,
+                  size_t capacity = Response_cache::DEFAULT_CAPACITY);
+
+    /** Respond to a request, from the cache or the upstream server */
+    void handle(Request_ptr req, Response_writer_ptr res);
+
+    Response_cache& cache() noexcept
+    { return cache_; }
+
+    const net::Socket& upstream() const noexcept
+    { return upstream_; }
+
+  private:
+    Basic_client&  client_;
+    net::Socket    upstream_;
+    Response_cache cache_;
+
+    void fetch(const Request& req, const std::string& etag, Response_cache::Done done);
+  };
+
+} // < namespace http
+
+#endif // < HTTP_CACHING_PROXY_HPP
@@ -9,6 +9,7 @@
 #include "error.hpp"
 
 #include <util/timer.hpp>
+#include <rtc>
 
 namespace http {
 
@@ -28,6 +29,20 @@ namespace http {
     bool occupied() const
     { return !available(); }
 
+    /** Whether a request is waiting for its response */
+    bool busy() const
+    { return on_response_ != nullptr; }
+
+    /**
+     * @brief      Whether the underlying stream can still be used,
+     *             checked before an idle connection is reused
+     */
+    bool healthy() const
+    { return not released() and stream_->is_connected() and not stream_->is_closing(); }
+
+    auto idle_since() const noexcept
+    { return idle_since_; }
+
     void send(Request_ptr, Response_handler, int redirects, timeout_duration = timeout_duration::zero());
 
   private:
@@ -38,6 +53,7 @@ namespace http {
     Timer             timer_;
     timeout_duration  timeout_dur_;
     int               redirect_;
+    RTC::timestamp_t  idle_since_{0};
 
     void send_request();
 
@@ -46,7 +62,11 @@ namespace http {
     void end_response(Error err = Error::NONE);
 
     void timeout_request()
-    { end_response(Error::TIMEOUT); }
+    {
+      // a late response would be taken for the next one
+      keep_alive_ = false;
+      end_response(Error::TIMEOUT);
+    }
 
     bool can_redirect(const Response_ptr&) const;
 
@@ -54,6 +74,8 @@ namespace http {
 
     void close() override;
 
+    void on_end() override;
+
   }; // < class Client_connection
 
 } // < namespace http
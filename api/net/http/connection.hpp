@@ -92,6 +92,12 @@ namespace http {
 
     virtual void close() {}
 
+    /**
+     * @brief      Called when a response has ended and the
+     *             connection is kept alive for another
+     */
+    virtual void on_end() {}
+
   }; // < class Connection
 
   inline Connection::Connection(Stream_ptr stream, bool keep_alive)
@@ -138,6 +144,8 @@ namespace http {
       close();
     else if(!keep_alive_)
       shutdown();
+    else
+      on_end();
   }
 
 } // < namespace http
@@ -0,0 +1,160 @@
+#pragma once
+#ifndef HTTP_H2_SESSION_HPP
+#define HTTP_H2_SESSION_HPP
+
+// http
+#include "hpack.hpp"
+#include "request.hpp"
+#include "response_writer.hpp"
+
+#include <map>
+
+namespace http {
+
+  class Server_connection;
+
+  namespace h2 {
+
+    // the client connection preface (RFC 7540 3.5)
+    static constexpr util::csview PREFACE {"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+    // ALPN protocol identifier
+    static constexpr util::csview ALPN_ID {"h2"};
+
+    static constexpr size_t   FRAME_HEADER_SIZE      = 9;
+    static constexpr uint32_t DEFAULT_WINDOW_SIZE    = 65535;
+    static constexpr uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+    static constexpr uint32_t MAX_WINDOW_SIZE        = 0x7fffffff;
+
+    enum Frame_type : uint8_t {
+      DATA = 0, HEADERS, PRIORITY, RST_STREAM, SETTINGS,
+      PUSH_PROMISE, PING, GOAWAY, WINDOW_UPDATE, CONTINUATION
+    };
+
+    enum Flag : uint8_t {
+      END_STREAM  = 0x1,
+      ACK         = 0x1,
+      END_HEADERS = 0x4,
+      PADDED      = 0x8,
+      PRIORITY_F  = 0x20
+    };
+
+    enum Setting : uint16_t {
+      HEADER_TABLE_SIZE = 1, ENABLE_PUSH, MAX_CONCURRENT_STREAMS,
+      INITIAL_WINDOW_SIZE, MAX_FRAME_SIZE, MAX_HEADER_LIST_SIZE
+    };
+
+    enum Error_code : uint32_t {
+      NO_ERROR = 0, PROTOCOL_ERROR, INTERNAL_ERROR, FLOW_CONTROL_ERROR,
+      SETTINGS_TIMEOUT, STREAM_CLOSED, FRAME_SIZE_ERROR, REFUSED_STREAM,
+      CANCEL, COMPRESSION_ERROR, CONNECT_ERROR, ENHANCE_YOUR_CALM,
+      INADEQUATE_SECURITY, HTTP_1_1_REQUIRED
+    };
+
+  } // < namespace h2
+
+  /**
+   * @brief      The server side of an HTTP/2 connection (RFC 7540).
+   *
+   *             Taken over by a Server_connection when a client opens with
+   *             the connection preface, either after choosing "h2" with ALPN
+   *             or with prior knowledge over plain TCP. Each stream becomes a
+   *             Request handed to the server's request handler, with a
+   *             Response_writer that frames the response on that stream.
+   *             Streams are served concurrently, and DATA is sent within the
+   *             flow control windows the client gives.
+   */
+  class H2_session {
+  public:
+    static constexpr uint32_t MAX_CONCURRENT_STREAMS = 100;
+    static constexpr size_t   MAX_HEADER_BLOCK       = 65536;
+
+    explicit H2_session(Server_connection& conn);
+
+    /**
+     * @brief      Process received data, consuming the frames that are
+     *             complete. The first bytes must be the preface.
+     *
+     * @param      buffer  The data received and not yet consumed
+     */
+    void receive(std::string& buffer);
+
+    /** The response side, for H2_response_writer */
+    void send_headers(uint32_t stream, const Response& res);
+    void send_data(uint32_t stream, const char* data, size_t len, bool end_stream);
+    void send_data(uint32_t stream, net::tcp::buffer_t buffer, bool end_stream);
+    void end_stream(uint32_t stream);
+
+    size_t open_streams() const noexcept
+    { return streams_.size(); }
+
+  private:
+    struct Stream {
+      Request_ptr req;
+      int64_t     send_window;
+      std::string pending;          // DATA waiting for window
+      bool        end_pending = false;
+      bool        remote_closed = false;
+      bool        local_closed = false;
+    };
+
+    Server_connection&         conn_;
+    std::map<uint32_t, Stream> streams_;
+    hpack::Decoder             decoder_;
+
+    bool        preface_ = false;
+    bool        goaway_ = false;
+    uint32_t    last_stream_ = 0;
+    int64_t     send_window_ = h2::DEFAULT_WINDOW_SIZE;
+    uint32_t    peer_window_ = h2::DEFAULT_WINDOW_SIZE;  // initial, per stream
+    uint32_t    peer_max_frame_ = h2::DEFAULT_MAX_FRAME_SIZE;
+
+    // a header block continued in CONTINUATION frames
+    uint32_t    continued_ = 0;
+    bool        continued_end_ = false;
+    std::string header_block_;
+
+    bool frame(uint8_t type, uint8_t flags, uint32_t stream, const uint8_t* payload, uint32_t len);
+    bool on_headers(uint8_t flags, uint32_t stream, const uint8_t* payload, uint32_t len);
+    bool on_header_block(uint32_t stream, bool end_stream);
+    bool on_data(uint8_t flags, uint32_t stream, const uint8_t* payload, uint32_t len);
+    bool on_settings(uint8_t flags, uint32_t stream, const uint8_t* payload, uint32_t len);
+    bool on_window_update(uint32_t stream, const uint8_t* payload, uint32_t len);
+
+    void dispatch(uint32_t id, Stream& stream);
+    void flush(uint32_t id, Stream& stream);
+    void close_if_done(uint32_t id);
+
+    void write_frame(uint8_t type, uint8_t flags, uint32_t stream, util::csview payload);
+    void send_settings();
+    void send_window_update(uint32_t stream, uint32_t increment);
+    void reset(uint32_t stream, h2::Error_code code);
+    void go_away(h2::Error_code code);
+  };
+
+  /**
+   * @brief      Writes a Response as HEADERS and DATA frames on a stream.
+   */
+  class H2_response_writer : public Response_writer {
+  public:
+    H2_response_writer(Response_ptr res, Connection& conn, H2_session& session, uint32_t stream)
+      : Response_writer(std::move(res), conn), session_(session), stream_(stream) {}
+
+    void write(std::string data) override;
+    void write(net::tcp::buffer_t buffer) override;
+    void write_header(status_t code) override;
+    void end() override;
+
+    ~H2_response_writer()
+    { end(); }
+
+  private:
+    H2_session& session_;
+    uint32_t    stream_;
+    size_t      written_ = 0;
+
+    bool last(size_t len);
+  };
+
+} // < namespace http
+
+#endif // < HTTP_H2_SESSION_HPP
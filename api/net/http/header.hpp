@@ -3,7 +3,9 @@
 #define HTTP_HEADER_HPP
 
 #include <algorithm>
+#include <array>
 #include <cctype>
+#include <cstdint>
 #include <cstring>
 #include <ostream>
 #include <type_traits>
@@ -12,6 +14,7 @@
 #include "header_fields.hpp"
 
 #include "../../util/detail/string_view"
+#include "../../util/alloc_pmr.hpp"
 
 namespace http {
 
@@ -43,7 +46,11 @@ public:
   /// @param limit Capacity of how many fields can
   /// be added
   ///
-  explicit Header(const std::size_t limit);
+  /// @param mr Where the fields set with {set_field_view}
+  /// are allocated from
+  ///
+  explicit Header(const std::size_t limit,
+                  std::pmr::memory_resource* mr = std::pmr::get_default_resource());
 
   ///
   /// Default destructor
@@ -95,6 +102,44 @@ public:
   ///
   bool set_field(std::string field, std::string value);
 
+  ///
+  /// Set the base of the buffer that fields set with
+  /// {set_field_view} point into, as when it has moved
+  ///
+  /// @param base The start of the buffer
+  ///
+  void set_base(const char* base) noexcept;
+
+  ///
+  /// Change the value of the specified field, without
+  /// copying either
+  ///
+  /// Both must be views into the buffer given to {set_base},
+  /// which must outlive the header (or be rebased)
+  ///
+  /// @param field The field name
+  /// @param value The field value
+  ///
+  /// @return true if successful, false otherwise
+  ///
+  bool set_field_view(util::csview field, util::csview value);
+
+  ///
+  /// Case insensitive hash of a field name
+  ///
+  /// @param field The field name
+  ///
+  /// @return The FNV-1a hash of the lowercase name
+  ///
+  static constexpr uint32_t hash(util::csview field) noexcept {
+    uint32_t h = 2166136261u;
+    for (const char c : field) {
+      const char l = (c >= 'A' and c <= 'Z') ? c + ('a' - 'A') : c;
+      h = (h ^ static_cast<uint8_t>(l)) * 16777619u;
+    }
+    return h;
+  }
+
   ///
   /// Check to see if the specified field is a
   /// member of the set
@@ -166,12 +211,67 @@ public:
   ///
   bool set_content_length(const size_t len);
 
+  ///
+  /// Call a function with the name and value of each
+  /// field in the set
+  ///
+  /// @param fn The function
+  ///
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (const auto& field : fields_) fn(util::csview{field.first}, util::csview{field.second});
+    for (const auto& field : views_)  fn(name_of(field), value_of(field));
+  }
+
 private:
   ///
   /// Class data members
   ///
   Header_set fields_;
 
+  ///
+  /// How many fields can be added
+  ///
+  std::size_t limit_;
+
+  ///
+  /// A field set with {set_field_view}, as offsets from {base_}
+  ///
+  struct View_field {
+    uint32_t hash;
+    uint32_t name;
+    uint32_t name_len;
+    uint32_t value;
+    uint32_t value_len;
+  };
+  std::pmr::vector<View_field> views_;
+  const char* base_ {nullptr};
+
+  ///
+  /// Index + 1 into {views_} of the well-known fields, zero if absent
+  ///
+  static constexpr std::size_t num_known = 16;
+  std::array<uint8_t, num_known> known_ {};
+
+  static int known_slot(const uint32_t hash) noexcept;
+
+  util::sview name_of(const View_field& f) const noexcept
+  { return {base_ + f.name, f.name_len}; }
+
+  util::sview value_of(const View_field& f) const noexcept
+  { return {base_ + f.value, f.value_len}; }
+
+  ///
+  /// Find the location of a view field
+  ///
+  /// @param field The field name to locate
+  ///
+  /// @return Index into {views_}, or -1 if absent
+  ///
+  int find_view(util::csview field) const noexcept;
+
+  void reindex() noexcept;
+
   ///
   /// Find the location of a field within the set
   ///
@@ -200,6 +300,10 @@ std::basic_ostream<Char, Char_traits>& operator<<(std::basic_ostream<Char, Char_
       output_device << field.first  << ": "
                     << field.second << "\r\n";
     }
+    for (const auto& field : header.views_) {
+      output_device << header.name_of(field)  << ": "
+                    << header.value_of(field) << "\r\n";
+    }
     //-----------------------------------
     output_device << "\r\n";
   }
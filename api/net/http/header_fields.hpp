@@ -14,6 +14,7 @@ extern Field Accept_Charset;
 extern Field Accept_Encoding;
 extern Field Accept_Language;
 extern Field Authorization;
+extern Field Cache_Control;
 extern Field Cookie;
 extern Field Connection;
 extern Field Expect;
@@ -60,6 +61,7 @@ extern Field Content_Range;
 extern Field Content_Type;
 extern Field Expires;
 extern Field Last_Modified;
+extern Field Transfer_Encoding;
 //------------------------------------------------
 //------------------------------------------------
 } //< namespace header
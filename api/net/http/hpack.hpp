@@ -0,0 +1,142 @@
+#pragma once
+#ifndef HTTP_HPACK_HPP
+#define HTTP_HPACK_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../util/detail/string_view"
+
+namespace http {
+namespace hpack {
+
+  ///
+  /// Header compression for HTTP/2 (RFC 7541)
+  ///
+  using Field       = std::pair<std::string, std::string>;
+  using Header_list = std::vector<Field>;
+
+  static constexpr size_t DEFAULT_TABLE_SIZE = 4096;
+
+  ///
+  /// The static table followed by a dynamic table of fields,
+  /// the oldest evicted first
+  ///
+  class Table {
+  public:
+    static constexpr size_t STATIC_SIZE = 61;
+
+    explicit Table(size_t max_size = DEFAULT_TABLE_SIZE)
+      : max_size_{max_size} {}
+
+    ///
+    /// Get a field by its index, starting at 1
+    ///
+    /// @return The field, or nullptr if out of range
+    ///
+    const Field* get(size_t index) const noexcept;
+
+    ///
+    /// Insert a field into the dynamic table, evicting to make room
+    ///
+    void insert(Field field);
+
+    ///
+    /// Change the maximum size of the dynamic table
+    ///
+    void set_max_size(size_t max_size);
+
+    size_t size() const noexcept
+    { return size_; }
+
+    size_t max_size() const noexcept
+    { return max_size_; }
+
+    ///
+    /// Find a field in the static table
+    ///
+    /// @param name  The lowercase field name
+    /// @param value The field value
+    ///
+    /// @return The index of the field if the value matches too (exact = true),
+    /// else of the first with the name, or 0 if none
+    ///
+    static size_t find_static(util::csview name, util::csview value, bool& exact) noexcept;
+
+    static size_t entry_size(const Field& field) noexcept
+    { return field.first.size() + field.second.size() + 32; }
+
+  private:
+    std::deque<Field> dynamic_;
+    size_t size_ = 0;
+    size_t max_size_;
+
+    void evict(size_t room);
+  };
+
+  ///
+  /// Decodes header blocks, keeping the dynamic table across them
+  ///
+  class Decoder {
+  public:
+    explicit Decoder(size_t max_table_size = DEFAULT_TABLE_SIZE)
+      : table_{max_table_size}, limit_{max_table_size} {}
+
+    ///
+    /// Decode a complete header block
+    ///
+    /// @param data The block
+    /// @param len  Its length
+    /// @param out  The fields, appended to
+    ///
+    /// @return false on a compression error, which is fatal to the connection
+    ///
+    bool decode(const uint8_t* data, size_t len, Header_list& out);
+
+  private:
+    Table  table_;
+    size_t limit_;
+  };
+
+  ///
+  /// Encodes header blocks with the static table only, so
+  /// that no state needs to be kept in sync with the peer
+  ///
+  class Encoder {
+  public:
+    ///
+    /// Encode a field, appending to a header block
+    ///
+    /// @param name  The lowercase field name
+    /// @param value The field value
+    /// @param out   The header block
+    ///
+    static void encode(util::csview name, util::csview value, std::string& out);
+  };
+
+  ///
+  /// Integer representation (RFC 7541 5.1)
+  ///
+  bool decode_integer(const uint8_t*& p, const uint8_t* end, int prefix_bits, uint32_t& out) noexcept;
+  void encode_integer(std::string& out, uint8_t first, int prefix_bits, uint32_t value);
+
+  ///
+  /// String literal representation (RFC 7541 5.2)
+  ///
+  bool decode_string(const uint8_t*& p, const uint8_t* end, std::string& out);
+  void encode_string(std::string& out, util::csview str);
+
+  ///
+  /// Huffman coding (RFC 7541 Appendix B)
+  ///
+  bool huffman_decode(const uint8_t* data, size_t len, std::string& out);
+  size_t huffman_length(util::csview str) noexcept;
+  void huffman_encode(util::csview str, std::string& out);
+
+} //< namespace hpack
+} //< namespace http
+
+#endif //< HTTP_HPACK_HPP
@@ -32,7 +32,10 @@ public:
   /// @param limit Capacity of how many fields can
   /// be added to the message
   ///
-  explicit Message(const std::size_t limit) noexcept;
+  /// @param mr Where header field views are allocated from
+  ///
+  explicit Message(const std::size_t limit,
+                   std::pmr::memory_resource* mr = std::pmr::get_default_resource()) noexcept;
 
   ///
   /// Default copy constructor
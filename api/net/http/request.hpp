@@ -43,17 +43,39 @@ public:
   ///
   /// @param parse Whether to perform parsing on the the data specified in {request}
   ///
-  explicit Request(std::string request, const std::size_t limit = 25, const bool parse = true);
+  /// @param zero_copy Whether header fields should be views into {request}
+  /// instead of copies of it
+  ///
+  explicit Request(std::string request, const std::size_t limit = 25,
+                   const bool parse = true, const bool zero_copy = false);
+
+  ///
+  /// Constructor to parse a request message from a copy of
+  /// {request} made in memory from {mr}, where the header
+  /// field views are also allocated
+  ///
+  /// @param mr Where to allocate, as a per-connection resource
+  ///
+  /// @param request The character stream of data
+  ///
+  /// @param limit Capacity of how many fields can
+  /// be added
+  ///
+  /// @param zero_copy Whether header fields should be views into
+  /// the copy of {request}
+  ///
+  Request(std::pmr::memory_resource* mr, util::csview request,
+          const std::size_t limit = 25, const bool zero_copy = true);
 
   ///
-  /// Default copy constructor
+  /// Copy constructor
   ///
-  Request(Request&) = default;
+  Request(Request&);
 
   ///
-  /// Default move constructor
+  /// Move constructor
   ///
-  Request(Request&&) = default;
+  Request(Request&&);
 
   ///
   /// Default destructor
@@ -61,14 +83,23 @@ public:
   ~Request() noexcept = default;
 
   ///
-  /// Default copy assignment operator
+  /// Copy assignment operator
   ///
-  Request& operator = (Request&) = default;
+  Request& operator = (Request&);
 
   ///
-  /// Default move assignment operator
+  /// Move assignment operator
   ///
-  Request& operator = (Request&&) = default;
+  Request& operator = (Request&&);
+
+  ///
+  /// Check if header fields are parsed as views into the
+  /// request data, which is retained by the request
+  ///
+  /// @return true if they are, false otherwise
+  ///
+  bool zero_copy() const noexcept
+  { return zero_copy_; }
 
   ///
   /// Parse the information supplied to the Request object
@@ -188,7 +219,8 @@ private:
   ///
   /// Class data members
   ///
-  std::string request_;
+  std::pmr::string request_;
+  bool             zero_copy_{false};
 
   ///
   /// Request-line parts
@@ -204,6 +236,13 @@ private:
   /// @return The object that invoked this method
   ///
   Request& soft_reset() noexcept;
+
+  ///
+  /// Point header field views at the request data,
+  /// after it has been copied, moved or grown
+  ///
+  void rebase() noexcept
+  { header().set_base(request_.data()); }
 }; //< class Request
 
 /**--v----------- Implementation Details -----------v--**/
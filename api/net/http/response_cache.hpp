@@ -0,0 +1,167 @@
+#pragma once
+#ifndef HTTP_RESPONSE_CACHE_HPP
+#define HTTP_RESPONSE_CACHE_HPP
+
+// http
+#include "request.hpp"
+#include "response.hpp"
+#include "response_writer.hpp"
+
+#include <kernel/mem_pressure.hpp>
+#include <ctime>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace http {
+
+  /**
+   * @brief      Responses kept in memory, by URL (with the Host) and the
+   *             request fields they Vary by, for as long as Cache-Control
+   *             max-age / s-maxage or Expires allow. Stale ones with an
+   *             ETag are revalidated instead of fetched again.
+   *
+   *             Only GET responses are kept, and HEAD is answered from them.
+   *             The least recently used go when over capacity, or under
+   *             memory pressure. Hits are written from the cached buffers.
+   *
+   *             Concurrent misses of the same key wait for one fetch.
+   */
+  class Response_cache {
+  public:
+    using buffer_t = net::tcp::buffer_t;
+    /** Called with the response of a fetch, or nullptr if it failed */
+    using Done     = delegate<void(Response_ptr)>;
+    /** Fetch the response to a request, conditional on @etag when not empty */
+    using Fetch    = delegate<void(const Request&, const std::string& etag, Done)>;
+
+    static constexpr size_t DEFAULT_CAPACITY = 16 * 1024 * 1024;
+
+    struct Entry
+    {
+      status_t    status;
+      Header_set  fields;  // as from the origin, less those about the connection
+      buffer_t    body;
+      std::string etag;
+      std::time_t stored;  // when stored, or last revalidated
+      std::time_t expires; // fresh until
+
+      size_t bytes() const noexcept;
+    };
+
+    explicit Response_cache(size_t capacity = DEFAULT_CAPACITY);
+    ~Response_cache();
+
+    Response_cache(const Response_cache&) = delete;
+    Response_cache& operator=(const Response_cache&) = delete;
+
+    /**
+     * @brief      Answer a request from a fresh entry, or with 304 Not
+     *             Modified if the client has it already
+     *
+     * @return     false if there is none, and nothing was written
+     */
+    bool serve(const Request& req, Response_writer& res);
+
+    /**
+     * @brief      Answer a request from the cache, or else with the response
+     *             from @fetch, which is stored if it may be. A fetch already
+     *             under way for the same key is waited for instead. The
+     *             cache must outlive the fetches.
+     *
+     * @param[in]  req    The request
+     * @param[in]  res    Its response writer
+     * @param[in]  fetch  How to get the response from the origin
+     */
+    void handle(Request_ptr req, Response_writer_ptr res, Fetch fetch);
+
+    /**
+     * @brief      Store a response to a request, if it may be cached
+     *
+     * @return     Whether it was stored
+     */
+    bool store(const Request& req, const Response& res);
+
+    /** The entry for a request, fresh or stale, or nullptr */
+    const Entry* find(const Request& req) const;
+
+    /** Drop the entries of a request, with all variants */
+    void erase(const Request& req);
+
+    /** Drop all entries */
+    void clear() noexcept;
+
+    /**
+     * @brief      Seconds a response may be kept, from its Cache-Control,
+     *             or Expires and Date
+     *
+     * @return     -1 if it must not be kept, 0 if only to revalidate
+     */
+    static long lifetime(const Response& res, std::time_t now);
+
+    /** Whether a request may be answered from, and stored in, a cache */
+    static bool cacheable(const Request& req) noexcept;
+
+    size_t entries() const noexcept
+    { return index_.size(); }
+
+    size_t bytes() const noexcept
+    { return bytes_; }
+
+    size_t capacity() const noexcept
+    { return capacity_; }
+
+    uint64_t hits() const noexcept
+    { return hits_; }
+
+    uint64_t misses() const noexcept
+    { return misses_; }
+
+    uint64_t coalesced() const noexcept
+    { return coalesced_; }
+
+  private:
+    struct Node {
+      std::string key;
+      Entry       entry;
+    };
+    using Lru = std::list<Node>;
+
+    struct Waiter {
+      Request_ptr         req;
+      Response_writer_ptr res;
+    };
+    struct Pending {
+      std::string         key;
+      std::string         etag; // revalidating the entry with it
+      Fetch               fetch;
+      std::vector<Waiter> waiters;
+    };
+
+    const size_t capacity_;
+    size_t bytes_ = 0;
+    // most recently used first
+    Lru lru_;
+    std::unordered_map<std::string, Lru::iterator> index_;
+    // the request fields each URL varies by
+    std::unordered_map<std::string, std::vector<std::string>> vary_;
+    std::unordered_map<std::string, Pending> pending_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t coalesced_ = 0;
+    int shrinker_;
+
+    static std::string url_key(const Request& req);
+    std::string key_of(const Request& req) const;
+    Entry* lookup(const std::string& key);
+    void write(const Request& req, const Entry& entry, Response_writer& res);
+    void fetched(Pending& pending, Response_ptr res);
+    void pass(Request_ptr req, Response_writer_ptr res, Fetch& fetch);
+    void evict(size_t target) noexcept;
+    size_t shrink(os::mem::Pressure level);
+  };
+
+} // < namespace http
+
+#endif // < HTTP_RESPONSE_CACHE_HPP
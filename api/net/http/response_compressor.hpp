@@ -0,0 +1,106 @@
+#pragma once
+#ifndef HTTP_RESPONSE_COMPRESSOR_HPP
+#define HTTP_RESPONSE_COMPRESSOR_HPP
+
+// http
+#include "request.hpp"
+#include "response_writer.hpp"
+
+#include <cstdint>
+
+namespace http {
+
+  /**
+   * @brief      Compresses dynamic response bodies with the content coding
+   *             the client accepts (gzip or deflate), on other CPUs than
+   *             the one serving the connection.
+   *
+   *             The body is cut in blocks that are compressed apart, each
+   *             as a task for the least loaded CPU, and written in order as
+   *             they come back: as one response when there is one block,
+   *             else as chunks. Small bodies, and those whose first block
+   *             hardly compresses, are sent as they are.
+   *
+   *             The compressor must outlive the responses it sends.
+   */
+  class Response_compressor {
+  public:
+    using buffer_t = net::tcp::buffer_t;
+
+    enum class Coding : uint8_t {
+      IDENTITY,
+      GZIP,
+      DEFLATE
+    };
+
+    struct Config {
+      // smaller bodies are sent as they are
+      size_t min_size   = 1024;
+      // bytes compressed by one task, the rest go to other tasks
+      size_t block_size = 64 * 1024;
+      // a block must compress to this much of its size, or less (in %)
+      int    max_ratio  = 90;
+
+      Config() noexcept {}
+    };
+
+    explicit Response_compressor(Config config = {}) noexcept
+      : config_{config} {}
+
+    /**
+     * @brief      Write a response with @body, compressed if the request
+     *             accepts it and it pays. The header of @res is kept, with
+     *             Content-Encoding and Vary added. The writer is let go once
+     *             the body has been written, which may be later.
+     *
+     * @param[in]  req   The request
+     * @param[in]  res   Its response writer
+     * @param[in]  body  The body
+     * @param[in]  code  The status code
+     */
+    void send(const Request& req, Response_writer_ptr res, buffer_t body,
+              status_t code = OK);
+
+    /** The coding the client prefers, from an Accept-Encoding field */
+    static Coding negotiate(util::csview accept_encoding) noexcept;
+
+    /** Whether a body of a Content-Type is worth compressing */
+    static bool compressible(util::csview content_type) noexcept;
+
+    /**
+     * @brief      Compress @data whole, to the format of a coding
+     *             (gzip: RFC 1952, deflate: RFC 1950)
+     */
+    static buffer_t compress(Coding coding, const uint8_t* data, size_t len);
+
+    static const char* to_string(Coding coding) noexcept;
+
+    const Config& config() const noexcept
+    { return config_; }
+
+    uint64_t compressed() const noexcept
+    { return compressed_; }
+
+    uint64_t skipped() const noexcept
+    { return skipped_; }
+
+    uint64_t bytes_in() const noexcept
+    { return bytes_in_; }
+
+    uint64_t bytes_out() const noexcept
+    { return bytes_out_; }
+
+  private:
+    struct Job;
+    const Config config_;
+    uint64_t compressed_ = 0;
+    uint64_t skipped_    = 0;
+    uint64_t bytes_in_   = 0;
+    uint64_t bytes_out_  = 0;
+
+    void block_done(Job& job);
+  };
+
+} // < namespace http
+
+#endif // < HTTP_RESPONSE_COMPRESSOR_HPP
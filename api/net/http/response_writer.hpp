@@ -26,6 +26,12 @@ namespace http {
   class Response_writer {
   public:
     using buffer_t  = net::tcp::buffer_t;
+    /** Writes the next part of a streamed body, false when it has none for now */
+    using Producer  = delegate<bool(Response_writer&)>;
+
+    /** Bytes queued on the connection before a stream waits for it to drain */
+    static constexpr size_t STREAM_HIGH_WATERMARK = 256 * 1024;
+    static constexpr size_t STREAM_LOW_WATERMARK  = 64 * 1024;
 
   public:
     Response_writer(Response_ptr res, Connection&);
@@ -44,14 +50,14 @@ namespace http {
      *
      * @param[in]  data  The data
      */
-    void write(std::string data);
+    virtual void write(std::string data);
 
     /**
      * @brief      Same as write(std::string data) except data does not get copied into TCP buffer.
      *
      * @param[in]  chunk  a chunk of shared data
      */
-    void write(net::tcp::buffer_t buffer);
+    virtual void write(net::tcp::buffer_t buffer);
 
     /**
      * @brief      Writes the status line + header to the underlying connection
@@ -60,13 +66,53 @@ namespace http {
      *
      * @param[in]  code  The code
      */
-    void write_header(status_t code);
+    virtual void write_header(status_t code);
 
     /**
      * @brief      Writes the full response or just the body dependent if headers are sent or not.
      */
     void write();
 
+    /**
+     * @brief      Begin a body of unknown length, sent with chunked transfer
+     *             encoding. Each write() after this is a chunk, and end()
+     *             writes the last one. An HTTP/1.0 body is not framed, and
+     *             ends when the connection is closed.
+     *
+     * @throws     Response_writer_error if the header is already sent
+     *
+     * @param[in]  code  The status code
+     */
+    void begin_chunked(status_t code = http::OK);
+
+    bool is_chunked() const noexcept
+    { return chunked_; }
+
+    /**
+     * @brief      Whether the connection takes more without queuing more
+     *             than STREAM_HIGH_WATERMARK bytes.
+     */
+    bool writable() const;
+
+    /**
+     * @brief      Stream the body from @producer, called for as long as the
+     *             connection is writable, and again each time it has drained.
+     *             It writes with write() and finishes with end(). When it has
+     *             nothing to write for now it returns false, and resume()
+     *             calls it again. Begins a chunked body if none is begun.
+     *
+     *             The writer must be kept alive until the body has ended,
+     *             and not be destroyed by the producer.
+     *
+     * @param[in]  producer  The producer
+     */
+    void stream(Producer producer);
+
+    /**
+     * @brief      Call the producer again, for when it has more to write.
+     */
+    void resume();
+
     /**
      * @brief      Sets the response
      *
@@ -87,14 +133,20 @@ namespace http {
     Connection& connection()
     { return connection_; }
 
-    void end();
+    virtual void end();
 
-    ~Response_writer();
+    virtual ~Response_writer();
 
-  private:
+  protected:
     Response_ptr  response_;
     Connection&   connection_;
     bool          header_sent_{false};
+    bool          ended_{false};
+    // a body of unknown length, and whether it goes in chunks
+    bool          streaming_{false};
+    bool          chunked_{false};
+    bool          producing_{false};
+    Producer      producer_;
 
     /**
      * @brief      Preprocessing of a write
@@ -0,0 +1,137 @@
+#ifndef HTTP_SCANNER_HPP
+#define HTTP_SCANNER_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "../../util/detail/string_view"
+
+namespace http {
+namespace scanner {
+
+///
+/// What the head of a request starts with, as views into it
+///
+struct Request_line {
+  util::sview  method;
+  util::sview  target;
+  unsigned     major = 0;
+  unsigned     minor = 0;
+};
+
+///
+/// The first byte from {p} that is a control character other than HT,
+/// or DEL, looking at 16 or 32 bytes at a time where the CPU can
+///
+/// @return The byte, or {end} if there is none
+///
+const char* line_end(const char* p, const char* end) noexcept;
+
+///
+/// The first byte from {p} that is SP, a control character, DEL or
+/// not ASCII, looking at 16 or 32 bytes at a time where the CPU can
+///
+/// @return The byte, or {end} if there is none
+///
+const char* target_end(const char* p, const char* end) noexcept;
+
+///
+/// The vector instructions used: "avx2", "sse2", "neon" or "scalar"
+///
+const char* kernel_name() noexcept;
+
+namespace detail {
+  // tchar, from RFC 7230
+  constexpr std::array<bool, 256> make_token_table()
+  {
+    std::array<bool, 256> table {};
+    for (int c = '0'; c <= '9'; c++) table[c] = true;
+    for (int c = 'A'; c <= 'Z'; c++) table[c] = true;
+    for (int c = 'a'; c <= 'z'; c++) table[c] = true;
+    for (const char c : "!#$%&'*+-.^_`|~") table[(uint8_t) c] = true;
+    table[0] = false;
+    return table;
+  }
+  inline constexpr std::array<bool, 256> token_table = make_token_table();
+}
+
+///
+/// The first byte from {p} that isn't a token character, or {end}.
+/// Tokens (methods and field names) are short, so a table will do.
+///
+inline const char* token_end(const char* p, const char* end) noexcept
+{
+  while (p < end and detail::token_table[(uint8_t) *p]) p++;
+  return p;
+}
+
+///
+/// Scan the head of a HTTP/1.x request in one pass, handing each header
+/// field to {on_field(name, value)} as views into {data}, with the value
+/// trimmed of whitespace. Only heads of the usual kind are taken: lines
+/// ending with CRLF, no folded lines, and no control characters.
+///
+/// @param data The request, from its first byte
+///
+/// @param line Where the request line is put
+///
+/// @param on_field Called for each header field, in order
+///
+/// @return The length of the head, through the empty line, or 0 when it
+/// is incomplete or unusual, for a complete parser to take on (after the
+/// fields already handed over)
+///
+template <typename Fn>
+size_t scan_request(util::csview data, Request_line& line, Fn&& on_field)
+{
+  const char* const begin = data.data();
+  const char* const end   = begin + data.size();
+  const char* p = begin;
+
+  // method SP request-target SP HTTP/d.d CRLF
+  const char* q = token_end(p, end);
+  if (q == p or q == end or *q != ' ') return 0;
+  line.method = {p, size_t(q - p)};
+  p = q + 1;
+
+  q = target_end(p, end);
+  if (q == p or q == end or *q != ' ') return 0;
+  line.target = {p, size_t(q - p)};
+  p = q + 1;
+
+  auto digit = [] (char c) { return c >= '0' and c <= '9'; };
+  if (end - p < 10 or memcmp(p, "HTTP/", 5) != 0 or not digit(p[5])
+      or p[6] != '.' or not digit(p[7]) or p[8] != '\r' or p[9] != '\n')
+    return 0;
+  line.major = p[5] - '0';
+  line.minor = p[7] - '0';
+  p += 10;
+
+  // field-name ":" OWS field-value OWS CRLF, until an empty line
+  while (end - p >= 2)
+  {
+    if (p[0] == '\r')
+      return (p[1] == '\n') ? p + 2 - begin : 0;
+
+    q = token_end(p, end);
+    if (q == p or q == end or *q != ':') return 0;
+    const util::csview name {p, size_t(q - p)};
+
+    p = q + 1;
+    q = line_end(p, end);
+    if (end - q < 2 or q[0] != '\r' or q[1] != '\n') return 0;
+
+    const char* last = q;
+    while (p < last and (*p == ' ' or *p == '\t')) p++;
+    while (last > p and (last[-1] == ' ' or last[-1] == '\t')) last--;
+    on_field(name, util::csview{p, size_t(last - p)});
+    p = q + 2;
+  }
+  return 0;
+}
+
+} //< namespace scanner
+} //< namespace http
+
+#endif //< HTTP_SCANNER_HPP
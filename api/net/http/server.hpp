@@ -78,6 +78,18 @@ namespace http {
      */
     Response_ptr create_response(status_t code = http::OK) const;
 
+    /**
+     * @brief      Allow clients to speak HTTP/2, chosen with ALPN over TLS
+     *             or with prior knowledge (on by default)
+     *
+     * @param[in]  enabled  Whether to
+     */
+    void enable_http2(bool enabled) noexcept
+    { http2_ = enabled; }
+
+    bool http2_enabled() const noexcept
+    { return http2_; }
+
     /**
      * Return CPU server is hosted on
     **/
@@ -120,6 +132,7 @@ namespace http {
     Connection_set  connections_;
     Index_set       free_idx_;
     bool            keep_alive_;
+    bool            http2_ = true;
     Timers::id_t    timer_id_;
 
     const idle_duration idle_timeout_;
@@ -128,6 +141,8 @@ namespace http {
     Stat& stat_req_rx_;
     Stat& stat_req_bad_;
     Stat& stat_timeouts_;
+    // time spent in on_request, per request
+    util::Histogram_percpu& hist_handle_;
 
     /**
      * @brief      Close the given Server_connection
@@ -152,6 +167,14 @@ namespace http {
      */
     void receive(Request_ptr, status_t code, Server_connection&);
 
+    /**
+     * @brief      Receive a request from a HTTP/2 stream, with its writer
+     *
+     * @param[in]  <unnamed>  The HTTP request
+     * @param[in]  <unnamed>  The response writer for the stream
+     */
+    void receive(Request_ptr, Response_writer_ptr);
+
   }; // < class Server
 
   /**
@@ -1,24 +1,31 @@
-
 #pragma once
 #ifndef HTTP_SERVER_CONNECTION_HPP
 #define HTTP_SERVER_CONNECTION_HPP
 
 // http
 #include "connection.hpp"
+#include "response_writer.hpp"
 
 #include <rtc>
+#include <memory>
+#include <util/alloc_pmr.hpp>
 
 namespace http {
 
   class Server;
+  class H2_session;
 
   class Server_connection : public Connection {
   public:
     static constexpr size_t DEFAULT_BUFSIZE = 1460;
+    // the most a request head may take before it's refused
+    static constexpr size_t MAX_HEAD_SIZE   = 8192;
 
   public:
     explicit Server_connection(Server&, Stream_ptr, size_t idx, const size_t bufsize = DEFAULT_BUFSIZE);
 
+    ~Server_connection();
+
     void send(Response_ptr res);
 
     size_t idx() const noexcept
@@ -27,18 +34,53 @@ namespace http {
     auto idle_since() const noexcept
     { return idle_since_; }
 
+    /** Whether the connection has been taken over by HTTP/2 */
+    bool is_http2() const noexcept
+    { return h2_ != nullptr; }
+
   private:
+    friend class H2_session;
+
     Server&           server_;
+    // the heads of requests, from this CPU's HTTP pool
+    os::mem::Pmr_pool::Resource_ptr mem_;
     Request_ptr       req_;
     size_t            idx_;
     RTC::timestamp_t  idle_since_;
 
+    // received data not yet part of a request, kept across reads
+    std::string       buffer_;
+    // how far buffer_ has been searched for the end of a head
+    size_t            scanned_ = 0;
+    // body still to come for req_
+    size_t            body_left_ = 0;
+    // a request is with the handler, pipelined ones wait in buffer_
+    bool              in_flight_ = false;
+    bool              processing_ = false;
+    // nothing has been parsed yet, so it may still turn out to be HTTP/2
+    bool              fresh_ = true;
+    std::unique_ptr<H2_session> h2_;
+
     void recv_request(buffer_t);
 
+    /**
+     * @brief      Parse what has been received into requests, handing
+     *             them to the server one at a time so that responses
+     *             go out in the order requests came in.
+     */
+    void process();
+
+    bool parse_head();
+
     void end_request(status_t code = http::OK);
 
+    /** Hand a request from a HTTP/2 stream to the server */
+    void receive(Request_ptr req, Response_writer_ptr writer);
+
     void close() override;
 
+    void on_end() override;
+
     void update_idle()
     { idle_since_ = RTC::now(); }
 
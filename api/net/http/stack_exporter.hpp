@@ -0,0 +1,50 @@
+#pragma once
+#ifndef HTTP_STACK_EXPORTER_HPP
+#define HTTP_STACK_EXPORTER_HPP
+
+// http
+#include "request.hpp"
+#include "response_writer.hpp"
+
+#include <string>
+
+namespace http {
+
+  /**
+   * @brief      Serves the stacks taken by StackSampler, in the folded
+   *             format that flame graph tools read.
+   *
+   *             Sampling starts with the first request, unless it was
+   *             started already, so a running VM can be profiled by
+   *             fetching the path twice, some time apart:
+   *
+   * @code
+   *   curl http://vm/stacks > /dev/null; sleep 30
+   *   curl http://vm/stacks | flamegraph.pl > vm.svg
+   * @endcode
+   */
+  class Stack_exporter {
+  public:
+    static constexpr const char* DEFAULT_PATH = "/stacks";
+
+    explicit Stack_exporter(std::string path = DEFAULT_PATH)
+      : path_(std::move(path)) {}
+
+    /**
+     * @brief      Respond to a GET request for the path
+     *
+     * @param[in]  req   The request
+     * @param      res   The response writer
+     *
+     * @return     false if the request is for something else, and nothing
+     *             was written
+     */
+    bool serve(const Request& req, Response_writer& res);
+
+  private:
+    const std::string path_;
+  };
+
+} // < namespace http
+
+#endif // < HTTP_STACK_EXPORTER_HPP
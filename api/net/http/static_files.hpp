@@ -0,0 +1,112 @@
+#pragma once
+#ifndef HTTP_STATIC_FILES_HPP
+#define HTTP_STATIC_FILES_HPP
+
+// http
+#include "request.hpp"
+#include "response_writer.hpp"
+
+#include <fs/filesystem.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace http {
+
+  /**
+   * @brief      Serves files from a file system (e.g. memdisk) out of memory.
+   *
+   *             A file is read the first time it is asked for, together with
+   *             a precompressed variant next to it (path + ".gz") if there is
+   *             one. Its ETag and Last-Modified are worked out then, so that
+   *             every later request is answered straight from the cached
+   *             buffers, or with 304 Not Modified.
+   */
+  class Static_files {
+  public:
+    using buffer_t = net::tcp::buffer_t;
+
+    static constexpr size_t DEFAULT_CAPACITY = 8 * 1024 * 1024;
+
+    struct Entry
+    {
+      buffer_t    plain;
+      buffer_t    gzip; // nullptr if there's no precompressed variant
+      std::string etag;
+      std::string last_modified;
+      util::sview mime;
+
+      size_t bytes() const noexcept
+      { return plain->size() + (gzip ? gzip->size() : 0); }
+    };
+
+    /**
+     * @brief      Serve the files under a directory of a file system
+     *
+     * @param      fs        The file system
+     * @param[in]  root      The directory, prepended to request paths
+     * @param[in]  capacity  The most bytes to keep cached
+     */
+    explicit Static_files(fs::File_system& fs, std::string root = "",
+                          size_t capacity = DEFAULT_CAPACITY);
+
+    /**
+     * @brief      Respond to a GET or HEAD request for a file
+     *
+     * @param[in]  req   The request
+     * @param      res   The response writer
+     *
+     * @return     false if there is no such file, and nothing was written
+     */
+    bool serve(const Request& req, Response_writer& res);
+
+    /**
+     * @brief      Get a file, from the cache or else the file system
+     *
+     * @param[in]  path  The path, relative to the root
+     * @param      out   The entry
+     *
+     * @return     false if there is no such file
+     */
+    bool find(const std::string& path, Entry& out);
+
+    /** Drop all cached files, as when the file system has changed */
+    void clear() noexcept
+    { cache_.clear(); bytes_ = 0; }
+
+    size_t cached_files() const noexcept
+    { return cache_.size(); }
+
+    size_t cached_bytes() const noexcept
+    { return bytes_; }
+
+    /**
+     * @brief      Whether an Accept-Encoding value allows gzip
+     *
+     * @param[in]  accept_encoding  The value
+     *
+     * @return     true if gzip (or *) is listed and not with q=0
+     */
+    static bool accepts_gzip(util::csview accept_encoding) noexcept;
+
+    /**
+     * @brief      An HTTP date from a FAT modification time
+     *
+     * @param[in]  fat_time  The date in the upper half, the time in the lower
+     *
+     * @return     The date, or empty if not set
+     */
+    static std::string fat_time_to_http(uint32_t fat_time);
+
+  private:
+    fs::File_system& fs_;
+    const std::string root_;
+    const size_t capacity_;
+    size_t bytes_ = 0;
+    std::unordered_map<std::string, Entry> cache_;
+
+    bool load(const std::string& path, Entry& out) const;
+  };
+
+} // < namespace http
+
+#endif // < HTTP_STATIC_FILES_HPP
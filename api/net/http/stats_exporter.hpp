@@ -0,0 +1,78 @@
+#pragma once
+#ifndef HTTP_STATS_EXPORTER_HPP
+#define HTTP_STATS_EXPORTER_HPP
+
+// http
+#include "request.hpp"
+#include "response_writer.hpp"
+
+#include <statman>
+#include <string>
+
+namespace http {
+
+  /**
+   * @brief      Serves all stats in Statman in the Prometheus text format,
+   *             for scraping.
+   *
+   *             Stat names become metric names with anything but letters,
+   *             digits and underscores replaced by underscores, after an
+   *             optional prefix. Gauges are typed as such, everything else
+   *             as counters. Per-CPU stats are exported as their sums.
+   *
+   * @code
+   *   static http::Stats_exporter metrics;
+   *   server.on_request([] (auto req, auto res) {
+   *     if (not metrics.serve(*req, *res)) res->write_header(http::Not_Found);
+   *   });
+   * @endcode
+   */
+  class Stats_exporter {
+  public:
+    static constexpr const char* DEFAULT_PATH = "/metrics";
+    static constexpr const char* CONTENT_TYPE = "text/plain; version=0.0.4";
+
+    /**
+     * @brief      Export the stats of a Statman
+     *
+     * @param[in]  path     The path to answer on
+     * @param[in]  prefix   Put in front of every metric name
+     * @param      statman  The stats
+     */
+    explicit Stats_exporter(std::string path = DEFAULT_PATH,
+                            std::string prefix = "",
+                            Statman& statman = Statman::get());
+
+    /**
+     * @brief      Respond to a GET or HEAD request for the path
+     *
+     * @param[in]  req   The request
+     * @param      res   The response writer
+     *
+     * @return     false if the request is for something else, and nothing
+     *             was written
+     */
+    bool serve(const Request& req, Response_writer& res);
+
+    /** All stats, in the text format */
+    std::string render() const;
+
+    /**
+     * @brief      A valid metric name from a stat name
+     *
+     * @param[in]  prefix  The prefix
+     * @param[in]  name    The stat name
+     *
+     * @return     The metric name
+     */
+    static std::string metric_name(util::csview prefix, util::csview name);
+
+  private:
+    const std::string path_;
+    const std::string prefix_;
+    Statman& statman_;
+  };
+
+} // < namespace http
+
+#endif // < HTTP_STATS_EXPORTER_HPP
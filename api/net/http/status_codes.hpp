@@ -9,6 +9,14 @@ namespace http {
 
 util::sview code_description(const status_t status_code) noexcept;
 
+///
+/// Get the HTTP/1.1 status line of a status code, ending with CRLF,
+/// formatted once
+///
+/// @return The status line, or an empty view for an unknown status code
+///
+util::sview status_line_1_1(const status_t status_code) noexcept;
+
 template<typename = void>
 inline bool is_informational(const status_t status_code) noexcept {
   return (status_code >= Continue) and (status_code <= Processing);
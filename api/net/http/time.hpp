@@ -44,6 +44,16 @@ std::time_t to_time_t(util::csview time_);
 ///
 std::string now();
 
+///
+/// Get the current time in {Internet Standard Format}, as for
+/// the Date header of a response
+///
+/// The string is formatted at most once per second on each CPU
+///
+/// @return The current time, valid until the next call on this CPU
+///
+util::sview cached_now();
+
 } //< namespace time
 } //< namespace http
 
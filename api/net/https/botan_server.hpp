@@ -6,6 +6,8 @@
 #include <net/http/server.hpp>
 #include <fs/dirent.hpp>
 #include <net/botan/tls_server.hpp>
+#include <net/https/tls_sessions.hpp>
+#include <botan/tls_session_manager.h>
 
 namespace http {
 
@@ -67,9 +69,26 @@ public:
       fs::Dirent& ca_cert,
       fs::Dirent& server_key);
 
+  /**
+   * @brief      Configure TLS session resumption. Sessions are cached in
+   *             a Botan session manager shared by all connections.
+   *             Botan reads tickets made with the current key only, so
+   *             a ticket from before the last rotation means a full handshake.
+   *             The default config is applied on construction.
+   *             Connections refer to the session manager, so only call
+   *             this before the server starts listening.
+   *
+   * @param[in]  config  The session config
+   */
+  void set_session_config(const TLS_session_config& config);
+
 private:
   Botan::RandomNumberGenerator& rng;
   std::unique_ptr<Botan::Credentials_Manager> credman;
+  std::unique_ptr<Botan::TLS::Session_Manager> sessions;
+  std::unique_ptr<TLS_ticket_keys> ticket_keys;
+  // answers for credman, and with the ticket key
+  std::unique_ptr<Botan::Credentials_Manager> ticket_credman;
 
   /**
    * @brief      Binds TCP to pass all new connections to this on_connect.
@@ -106,6 +125,7 @@ inline Botan_server::Botan_server(
     rng(get_rng())
 {
   load_credentials(name, ca_key, ca_cert, server_key);
+  set_session_config(TLS_session_config{});
 }
 
 template <typename... Server_args>
@@ -118,6 +138,7 @@ inline Botan_server::Botan_server(
     rng(in_rng), credman(in_credman)
 {
   assert(credman != nullptr);
+  set_session_config(TLS_session_config{});
 }
 
 } // < namespace http
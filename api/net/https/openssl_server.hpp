@@ -4,6 +4,9 @@
 #define NET_HTTP_OPENSSL_SERVER_HPP
 
 #include <net/http/server.hpp>
+#include <net/https/tls_sessions.hpp>
+#include <memory>
+#include <vector>
 
 namespace http {
 
@@ -32,8 +35,29 @@ public:
 
   virtual ~OpenSSL_server();
 
+  /**
+   * @brief      Configure TLS session resumption. Sessions are cached
+   *             by OpenSSL, ticket keys rotated here.
+   *             The default config is applied on construction.
+   *
+   * @param[in]  config  The session config
+   */
+  void set_session_config(const TLS_session_config& config);
+
+  /**
+   * @brief      Run the TLS handshakes of new connections on other CPUs,
+   *             the least loaded first, so a surge of them does not hold
+   *             up the connections already established.
+   *
+   * @param[in]  cpus  The CPUs (see SMP::active_cpus), none to stop
+   */
+  void offload_handshakes(std::vector<int> cpus)
+  { m_handshake_cpus = std::move(cpus); }
+
 private:
   void* m_ctx = nullptr;
+  std::unique_ptr<TLS_ticket_keys> m_ticket_keys;
+  std::vector<int> m_handshake_cpus;
 
   void openssl_initialize(const std::string&, const std::string&);
   void bind(const uint16_t port) override;
@@ -4,6 +4,9 @@
 #define NET_HTTP_S2N_SERVER_HPP
 
 #include <net/http/server.hpp>
+#include <net/https/tls_sessions.hpp>
+#include <util/timer.hpp>
+#include <memory>
 
 namespace http {
 
@@ -22,8 +25,22 @@ public:
 
   virtual ~S2N_server();
 
+  /**
+   * @brief      Configure TLS session resumption. Sessions are cached
+   *             here, ticket keys handed to s2n as they rotate.
+   *             The default config is applied on construction.
+   *
+   * @param[in]  config  The session config
+   */
+  void set_session_config(const TLS_session_config& config);
+
 private:
   void* m_config = nullptr;
+  std::unique_ptr<TLS_session_cache> m_session_cache;
+  std::unique_ptr<TLS_ticket_keys>   m_ticket_keys;
+  Timer m_ticket_timer{{this, &S2N_server::rotate_ticket_key}};
+
+  void rotate_ticket_key();
 
   void initialize(const std::string&, const std::string&);
   void bind(const uint16_t port) override;
@@ -0,0 +1,135 @@
+
+#pragma once
+#ifndef NET_HTTPS_TLS_SESSIONS_HPP
+#define NET_HTTPS_TLS_SESSIONS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <rtc>
+#include <util/detail/string_view>
+
+namespace http {
+
+/**
+ * @brief      How a HTTPS server lets clients resume their TLS sessions,
+ *             skipping the full handshake.
+ */
+struct TLS_session_config {
+  // sessions kept for resumption by session id, 0 turns the cache off
+  size_t               cache_size = 1024;
+  // how long after the full handshake a session may be resumed
+  std::chrono::seconds lifetime{300};
+  // hand out session tickets (RFC 5077), which need no state on the server
+  bool                 tickets = true;
+  // how often a new ticket key is made; tickets stay readable for another period
+  std::chrono::seconds ticket_key_rotation{3600};
+};
+
+/**
+ * @brief      A bounded cache of TLS sessions by session id, shared by all
+ *             the connections of a server. The least recently used session
+ *             goes first when full, and sessions expire after their lifetime.
+ */
+class TLS_session_cache {
+public:
+  TLS_session_cache(size_t capacity, std::chrono::seconds lifetime)
+    : capacity_{capacity}, lifetime_{lifetime} {}
+
+  /**
+   * @brief      Store a serialized session
+   *
+   * @param[in]  id       The session id
+   * @param[in]  session  The session
+   * @param[in]  ttl      Shorter lifetime than the cache's, if not zero
+   */
+  void store(util::csview id, util::csview session,
+             std::chrono::seconds ttl = std::chrono::seconds{0});
+
+  /**
+   * @brief      Find a session
+   *
+   * @return     The serialized session, or nullptr if not found or expired
+   */
+  const std::string* find(util::csview id);
+
+  void erase(util::csview id);
+
+  void clear() noexcept
+  { map_.clear(); lru_.clear(); }
+
+  size_t size() const noexcept
+  { return map_.size(); }
+
+  size_t capacity() const noexcept
+  { return capacity_; }
+
+  std::chrono::seconds lifetime() const noexcept
+  { return lifetime_; }
+
+private:
+  struct Entry {
+    std::string      session;
+    RTC::timestamp_t expires;
+    std::list<std::string>::iterator lru;
+  };
+  const size_t capacity_;
+  const std::chrono::seconds lifetime_;
+  std::unordered_map<std::string, Entry> map_;
+  // most recently used first
+  std::list<std::string> lru_;
+};
+
+/**
+ * @brief      Keys for encrypting session tickets, rotated.
+ *
+ *             New tickets are made with the newest key. Older keys can
+ *             still read tickets until they are a period past retirement,
+ *             so clients with such tickets resume and get a new ticket.
+ */
+class TLS_ticket_keys {
+public:
+  struct Key {
+    std::array<uint8_t, 16> name;
+    std::array<uint8_t, 32> aes;
+    std::array<uint8_t, 32> hmac;
+    RTC::timestamp_t        created;
+  };
+
+  explicit TLS_ticket_keys(std::chrono::seconds rotation)
+    : rotation_{rotation} {}
+
+  /** The key for new tickets, making a new one when due */
+  const Key& current();
+
+  /**
+   * @brief      Find the key a ticket was made with
+   *
+   * @param[in]  name  The key name in the ticket (16 bytes)
+   *
+   * @return     The key, or nullptr if unknown or expired
+   */
+  const Key* find(const uint8_t* name);
+
+  /** Whether a key is older than the one for new tickets */
+  bool is_retired(const Key& key) const noexcept
+  { return not keys_.empty() and &key != &keys_.back(); }
+
+  std::chrono::seconds rotation() const noexcept
+  { return rotation_; }
+
+private:
+  const std::chrono::seconds rotation_;
+  // oldest first
+  std::deque<Key> keys_;
+
+  void rotate(RTC::timestamp_t now);
+};
+
+} // < namespace http
+
+#endif
@@ -21,6 +21,7 @@
 #include "ip6/slaac.hpp"
 #include "ip6/mld.hpp"
 #include "dns/client.hpp"
+#include "dhcp/lease.hpp"
 #include "tcp/tcp.hpp"
 #include "udp/udp.hpp"
 
@@ -127,6 +128,9 @@ namespace net {
     /** Get the NDP-object belonging to this stack */
     Ndp& ndp() { return ndp_; }
 
+    /** Get the ARP-object belonging to this stack */
+    Arp& arp() { return arp_; }
+
     /** Get the MLD-object belonging to this stack */
     Mld& mld() { return mld_; }
     //Mld2& mld2() { return mld2_; }
@@ -216,6 +220,17 @@ namespace net {
       return ip_packet;
     }
 
+    /** Create an IP packet sized for a TSO super-segment, nullptr without TSO */
+    IP4::IP_packet_ptr create_ip_tso_packet(Protocol proto) {
+      auto raw = nic_.create_tso_packet(nic_.frame_offset_link());
+      if (raw == nullptr) return nullptr;
+      auto ip_packet = static_unique_ptr_cast<IP4::IP_packet>(std::move(raw));
+
+      ip_packet->init(proto);
+
+      return ip_packet;
+    }
+
     IP6::IP_packet_ptr create_ip6_packet(Protocol proto) {
       auto raw = nic_.create_packet(nic_.frame_offset_link());
       auto ip_packet = static_unique_ptr_cast<IP6::IP_packet>(std::move(raw));
@@ -269,6 +284,14 @@ namespace net {
       this->dns_server6_ = server;
     }
 
+    /**
+     * @brief Resolve through several DNS servers, asking the fastest first
+     * and the others as well when it is slow to answer.
+     * Takes precedence over the single DNS server when set.
+     */
+    void set_dns_servers(const std::vector<net::Addr>& servers)
+    { this->dns_.set_nameservers(servers); }
+
     /**
      * @brief Try to negotiate DHCP
      * @details Initialize DHClient if not present and tries to negotitate dhcp.
@@ -279,6 +302,17 @@ namespace net {
      */
     void negotiate_dhcp(double timeout = 10.0, dhcp_timeout_func = nullptr);
 
+    /**
+     * @brief Resume a DHCP lease obtained before, e.g. carried over LiveUpdate
+     * @details Configures the interface right away and renews the lease in the
+     * background, negotiating anew if it has expired or is refused.
+     *
+     * @param lease the lease, as given by dhclient()->lease()
+     * @param timeout number of seconds before a negotiation should timeout
+     * @param dhcp_timeout_func DHCP timeout handler
+     */
+    void resume_dhcp(const dhcp::Lease& lease, double timeout = 10.0, dhcp_timeout_func = nullptr);
+
     /* Automatic configuration of ipv6 address for inet */
     void autoconf_v6(int retries = 1, slaac_timeout_func = nullptr,
       uint64_t token = 0, bool use_token = false);
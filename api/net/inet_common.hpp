@@ -15,6 +15,7 @@
 #include <net/error.hpp>
 #include <net/ip4/icmp_error.hpp>
 #include <net/iana.hpp>
+#include <kernel/rng.hpp>
 
 namespace net {
   // Packet must be forward declared to avoid circular dependency
@@ -51,7 +52,7 @@ namespace net {
   }
 
   inline uint16_t new_ephemeral_port() noexcept
-  { return port_ranges::DYNAMIC_START + rand() % (port_ranges::DYNAMIC_END - port_ranges::DYNAMIC_START); }
+  { return port_ranges::DYNAMIC_START + rng_fast_uint32() % (port_ranges::DYNAMIC_END - port_ranges::DYNAMIC_START); }
 
 } //< namespace net
 
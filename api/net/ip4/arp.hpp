@@ -4,9 +4,10 @@
 #define NET_IP4_ARP_HPP
 
 #include <rtc>
-#include <unordered_map>
 #include <util/timer.hpp>
+#include <util/token_bucket.hpp>
 #include "ip4.hpp"
+#include "arp_cache.hpp"
 
 using namespace std::chrono_literals;
 namespace net {
@@ -31,6 +32,12 @@ namespace net {
     /** Number of resolution retries **/
     static constexpr int arp_retries = 3;
 
+    /** Neighbours cached, resolved or waiting for resolution */
+    static constexpr size_t cache_capacity = 512;
+
+    /** Packets queued per unresolved neighbour, more are dropped */
+    static constexpr int queue_limit = 16;
+
     /** Constructor */
     explicit Arp(Stack&) noexcept;
 
@@ -73,9 +80,31 @@ namespace net {
     /** Cache IP resolution. */
     void cache(ip4::Addr, MAC::Addr);
 
-    /** Flush the ARP cache. RFC-2.3.2.1 */
-    void flush_cache()
-    { cache_.clear(); };
+    /** Flush the resolved entries of the ARP cache. RFC-2.3.2.1 */
+    void flush_cache();
+
+    /**
+     * Get the cached link address for an IP, without resolving it.
+     * The answer holds for as long as generation() is unchanged.
+     */
+    bool lookup(ip4::Addr ip, MAC::Addr& mac) const noexcept
+    {
+#ifdef ARP_PASSTHROUGH
+      return false;
+#else
+      const auto* ent = cache_.find(ip);
+      if (ent == nullptr or not ent->resolved) return false;
+      mac = ent->mac;
+      return true;
+#endif
+    }
+
+    /** Changed whenever a cached resolution changes or is removed */
+    uint32_t generation() const noexcept
+    { return cache_.generation(); }
+
+    const Arp_cache& neighbours() const noexcept
+    { return cache_; }
 
     /** Flush expired cache entries. RFC-2.3.2.1 */
     void flush_expired ();
@@ -84,59 +113,25 @@ namespace net {
       flush_interval_ = m;
     }
 
+    /**
+     * Limit the replies sent to @rate a second with bursts of @burst,
+     * against floods of requests. A rate of 0 lifts the limit.
+     */
+    void set_reply_rate(uint32_t rate, uint32_t burst)
+    { reply_limit_.set(rate, burst); }
+
   private:
 
     /** ARP cache expires after cache_exp_sec_ seconds */
     static constexpr uint16_t cache_exp_sec_ {60 * 5};
 
-    /** Cache entries are just MAC's and timestamps */
-    struct Cache_entry {
-      /** Map needs empty constructor (we have no emplace yet) */
-      Cache_entry() noexcept = default;
-
-      Cache_entry(MAC::Addr mac) noexcept
-      : mac_(mac), timestamp_(RTC::time_since_boot()) {}
-
-      Cache_entry(const Cache_entry& cpy) noexcept
-      : mac_(cpy.mac_), timestamp_(cpy.timestamp_) {}
-
-      void update() noexcept { timestamp_ = RTC::time_since_boot(); }
-
-      bool expired() const noexcept
-      { return RTC::time_since_boot() > timestamp_ + cache_exp_sec_; }
-
-      MAC::Addr mac() const noexcept
-      { return mac_; }
-
-      RTC::timestamp_t timestamp() const noexcept
-      { return timestamp_; }
-
-      RTC::timestamp_t expires() const noexcept
-      { return timestamp_ + cache_exp_sec_; }
-
-    private:
-      MAC::Addr mac_;
-      RTC::timestamp_t timestamp_;
-    }; //< struct Cache_entry
-
-    struct Queue_entry {
-      Packet_ptr pckt;
-      int tries_remaining = arp_retries;
-
-      Queue_entry(Packet_ptr p)
-        : pckt{std::move(p)}
-      {}
-    };
-
-    using Cache       = std::unordered_map<ip4::Addr, Cache_entry>;
-    using PacketQueue = std::unordered_map<ip4::Addr, Queue_entry>;
-
-
     /** Stats */
     uint32_t& requests_rx_;
     uint32_t& requests_tx_;
     uint32_t& replies_rx_;
     uint32_t& replies_tx_;
+    uint32_t& queue_dropped_;
+    uint32_t& replies_limited_;
 
     std::chrono::minutes flush_interval_ = 5min;
 
@@ -152,17 +147,16 @@ namespace net {
     // Outbound data goes through here */
     downstream_link linklayer_out_ = nullptr;
 
-    // The ARP cache
-    Cache cache_ {};
+    // The ARP cache, including the RFC-1122 2.3.2.2 packet queue
+    Arp_cache cache_ {cache_capacity, queue_limit};
 
-    // RFC-1122 2.3.2.2 Packet queue
-    PacketQueue waiting_packets_;
+    util::Token_bucket reply_limit_ {1000, 100};
 
     // Settable resolver - defualts to arp_resolve
     Arp_resolver arp_resolver_ = {this, &Arp::arp_resolve};
 
-    /** Respond to arp request */
-    void arp_respond(header* hdr_in, ip4::Addr ack_ip);
+    /** Respond to arp request, in its buffer */
+    void arp_respond(Packet_ptr req, ip4::Addr ack_ip);
 
     /** Send an arp resolution request */
     void arp_resolve(ip4::Addr next_hop);
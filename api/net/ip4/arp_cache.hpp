@@ -0,0 +1,150 @@
+#pragma once
+#ifndef NET_IP4_ARP_CACHE_HPP
+#define NET_IP4_ARP_CACHE_HPP
+
+#include <net/ip4/addr.hpp>
+#include <net/packet.hpp>
+#include <hw/mac_addr.hpp>
+#include <util/flat_map.hpp>
+#include <rtc>
+#include <vector>
+
+namespace net {
+
+  /**
+   *  Fixed capacity neighbour table for ARP. Entries live in one array,
+   *  indexed by an open addressing map that never rehashes, and hold
+   *  both resolved addresses and the packets waiting for a resolution.
+   *
+   *  When full, inserting evicts an entry that has not been looked up
+   *  since the clock hand last passed it (second chance, approximating
+   *  LRU), dropping any packets it had queued.
+   */
+  class Arp_cache {
+  public:
+    struct Entry {
+      ip4::Addr        ip;
+      MAC::Addr        mac;
+      bool             resolved = false;
+      mutable bool     referenced = false;
+      int8_t           tries_remaining = 0;
+      RTC::timestamp_t timestamp = 0;
+      // packets waiting for resolution, at most queue_limit()
+      Packet_chain     pending;
+    };
+
+    explicit Arp_cache(size_t capacity, int queue_limit)
+      : entries_(capacity), index_(capacity), queue_limit_{queue_limit}
+    {
+      Expects(capacity > 0 and capacity < UINT32_MAX);
+      free_.reserve(capacity);
+      for (size_t i = capacity; i > 0; i--)
+        free_.push_back(i - 1);
+    }
+
+    /** Find the entry of @ip, or nullptr. Counts as a use of the entry. */
+    Entry* find(const ip4::Addr ip) noexcept
+    {
+      const auto* idx = index_.find(ip);
+      if (idx == nullptr) return nullptr;
+      auto& ent = entries_[*idx];
+      ent.referenced = true;
+      return &ent;
+    }
+
+    const Entry* find(const ip4::Addr ip) const noexcept
+    { return const_cast<Arp_cache*>(this)->find(ip); }
+
+    /** Find the entry of @ip, or add an unresolved one, evicting if full */
+    Entry& insert(const ip4::Addr ip)
+    {
+      if (auto* idx = index_.find(ip))
+        return entries_[*idx];
+      if (free_.empty())
+        evict();
+      const uint32_t idx = free_.back();
+      free_.pop_back();
+      index_.emplace(ip, idx);
+      auto& ent = entries_[idx];
+      ent.ip = ip;
+      used_++;
+      return ent;
+    }
+
+    /** Remove @ent, dropping its waiting packets */
+    void erase(Entry& ent)
+    {
+      if (ent.resolved) generation_++;
+      index_.erase(ent.ip);
+      Packet::release_chain(ent.pending.release());
+      free_.push_back(&ent - entries_.data());
+      ent = Entry{};
+      used_--;
+    }
+
+    /** Call @fn for every entry in use. It may erase the entry it is given. */
+    template <typename Fn>
+    void for_each(Fn fn)
+    {
+      for (auto& ent : entries_)
+        if (in_use(ent)) fn(ent);
+    }
+
+    /** Changed whenever a resolved entry changes or is removed */
+    uint32_t generation() const noexcept
+    { return generation_; }
+
+    /** Mark a change in the resolution of an entry */
+    void changed() noexcept
+    { generation_++; }
+
+    size_t size() const noexcept
+    { return used_; }
+
+    size_t capacity() const noexcept
+    { return entries_.size(); }
+
+    int queue_limit() const noexcept
+    { return queue_limit_; }
+
+    /** Entries removed to make room for new ones */
+    uint64_t evictions() const noexcept
+    { return evictions_; }
+
+  private:
+    bool in_use(const Entry& ent) const noexcept
+    {
+      const auto* idx = index_.find(ent.ip);
+      return idx != nullptr and &entries_[*idx] == &ent;
+    }
+
+    void evict()
+    {
+      // two rounds are enough, the first clears every reference
+      for (size_t n = 0; n < 2 * entries_.size(); n++)
+      {
+        auto& ent = entries_[hand_];
+        hand_ = (hand_ + 1) % entries_.size();
+        if (ent.referenced) {
+          ent.referenced = false;
+          continue;
+        }
+        evictions_++;
+        erase(ent);
+        return;
+      }
+    }
+
+    std::vector<Entry>            entries_;
+    Flat_map<ip4::Addr, uint32_t> index_;
+    std::vector<uint32_t>         free_;
+    size_t   used_  = 0;
+    size_t   hand_  = 0;
+    int      queue_limit_;
+    uint32_t generation_ = 1;
+    uint64_t evictions_  = 0;
+  };
+
+} //< namespace net
+
+#endif
@@ -3,6 +3,7 @@
 #define NET_IP4_ICMPv4_HPP
 
 #include "packet_icmp4.hpp"
+#include <util/token_bucket.hpp>
 #include <map>
 #include <timers>
 
@@ -133,6 +134,17 @@ namespace net {
     void ping(const std::string& hostname);
     void ping(const std::string& hostname, icmp_func callback, int sec_wait = SEC_WAIT_FOR_REPLY);
 
+    /**
+     *  Limit the messages sent in response to others, echo replies and errors alike,
+     *  to @rate a second with bursts of @burst. A rate of 0 lifts the limit.
+     */
+    void set_reply_rate(uint32_t rate, uint32_t burst)
+    { reply_limit_.set(rate, burst); }
+
+    /** Responses not sent, over the reply rate */
+    uint64_t replies_limited() const noexcept
+    { return reply_limit_.limited(); }
+
   private:
     static int request_id_; // message identifier for messages originating from IncludeOS
     Stack& inet_;
@@ -167,6 +179,9 @@ namespace net {
 
     std::map<Tuple, ICMP_callback> ping_callbacks_;
 
+    // responses a second and burst, like the defaults of Linux
+    util::Token_bucket reply_limit_ {1000, 50};
+
     void forward_to_transport_layer(icmp4::Packet& req);
 
     /**
@@ -6,10 +6,13 @@
 #include "addr.hpp"
 #include "header.hpp"
 #include "packet_ip4.hpp"
+#include "reassembly.hpp"
 #include <common>
+#include <net/features.hpp>
 #include <net/netfilter.hpp>
 #include <net/port_util.hpp>
 #include <rtc>
+#include <statman>
 #include <util/timer.hpp>
 
 #include <unordered_map>
@@ -86,7 +89,7 @@ namespace net {
      */
     uint16_t default_PMTU() const noexcept;
 
-    /** Upstream: Input from link layer */
+    /** Upstream: Input from link layer, a packet or a chain of them */
     void receive(Packet_ptr, const bool link_bcast);
 
 
@@ -112,12 +115,19 @@ namespace net {
 
     /** Set handler for packets not addressed to this interface (upstream) */
     void set_packet_forwarding(Forward_delg fwd)
-    { forward_packet_ = fwd; }
+    {
+      Expects(Features::forwarding or fwd == nullptr);
+      forward_packet_ = fwd;
+    }
 
     /** Set linklayer out (downstream) */
     void set_linklayer_out(downstream_arp s)
     { linklayer_out_ = s; }
 
+    /** Set link out, for packets shipped with a resolved link destination */
+    void set_link_out(downstream_link s)
+    { link_out_ = s; }
+
     //
     // Delegate getters
     //
@@ -146,9 +156,18 @@ namespace net {
      *   * Protocol
      *
      *  Source IP *can* be set - if it's not, IP4 will set it
+     *
+     *  A chain of packets is handed to the link layer as chains,
+     *  one for each run of packets to the same next hop.
      */
     void transmit(Packet_ptr);
-    void ship(Packet_ptr, ip4::Addr next_hop = 0, Conntrack::Entry_ptr ct = nullptr);
+
+    /**
+     *  Send a packet to the next hop. The link-layer destination can be
+     *  given when the caller already knows it, bypassing ARP.
+     */
+    void ship(Packet_ptr, ip4::Addr next_hop = 0, Conntrack::Entry_ptr ct = nullptr,
+              const MAC::Addr* link_dst = nullptr);
 
 
     /**
@@ -177,28 +196,28 @@ namespace net {
 
     /** Packets pass through prerouting chain before routing decision */
     Filter_chain<IP4>& prerouting_chain()
-    { return prerouting_chain_; }
+    { Expects(Features::netfilter); return prerouting_chain_; }
 
     /** Packets pass through postrouting chain after routing decision */
     Filter_chain<IP4>& postrouting_chain()
-    { return postrouting_chain_; }
+    { Expects(Features::netfilter); return postrouting_chain_; }
 
     /** Packets pass through input chain before hitting protocol handlers */
     Filter_chain<IP4>& input_chain()
-    { return input_chain_; }
+    { Expects(Features::netfilter); return input_chain_; }
 
     /** Packets pass through output chain after exiting protocol handlers */
     Filter_chain<IP4>& output_chain()
-    { return output_chain_; }
+    { Expects(Features::netfilter); return output_chain_; }
 
     /**
      * Stats getters
      **/
     uint64_t get_packets_rx()
-    { return packets_rx_; }
+    { return packets_rx_.total(); }
 
     uint64_t get_packets_tx()
-    { return packets_tx_; }
+    { return packets_tx_.total(); }
 
     uint64_t get_packets_dropped()
     { return packets_dropped_; }
@@ -209,7 +228,11 @@ namespace net {
     /**  Drop outgoing packets invalid according to RFC */
     IP_packet_ptr drop_invalid_out(IP_packet_ptr packet);
 
-    /**  Reassemble fragments into a coherent heap-allocated packet **/
+    /**
+     *  Reassemble fragments, returning the datagram once complete.
+     *  UDP datagrams keep their fragments as segments, see Reassembly,
+     *  other protocols get the datagram copied into one buffer.
+     */
     IP_packet_ptr reassemble(IP_packet_ptr packet);
 
     /**
@@ -317,8 +340,8 @@ namespace net {
     ip4::Addr netmask_;
     ip4::Addr gateway_;
     /** Stats */
-    uint64_t& packets_rx_;
-    uint64_t& packets_tx_;
+    Stat_percpu& packets_rx_;
+    Stat_percpu& packets_tx_;
     uint32_t& packets_dropped_;
 
     /**
@@ -473,6 +496,7 @@ namespace net {
 
     /** Downstream: Linklayer output delegate */
     downstream_arp linklayer_out_ = nullptr;
+    downstream_link link_out_ = nullptr;
 
     /** Upstream delegates */
     upstream icmp_handler_ = nullptr;
@@ -498,6 +522,24 @@ namespace net {
     /** Drop a packet, calling drop handler if set */
     IP_packet_ptr drop(IP_packet_ptr ptr, Direction direction, Drop_reason reason);
 
+    /** Handle one received packet, batching TCP and UDP for their handlers */
+    void receive_one(Packet_ptr, const bool link_bcast,
+                     Packet_chain& tcp_burst, Packet_chain& udp_burst);
+
+    /** Transmit one packet, see transmit() */
+    void transmit_one(Packet_ptr);
+
+    /** Hand the packets shipped during transmit() to the link layer */
+    void flush_tx_batch();
+
+    /** Fragments of datagrams for this stack waiting to be reassembled */
+    Reassembly reassembly_;
+
+    /** Packets shipped while transmitting a chain, all to the same hop */
+    Packet_chain tx_batch_;
+    ip4::Addr    tx_batch_hop_;
+    bool         tx_batching_ = false;
+
   }; //< class IP4
 
 } //< namespace net
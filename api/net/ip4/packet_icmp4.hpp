@@ -69,6 +69,16 @@ namespace icmp4 {
     void set_code(uint8_t c) noexcept
     { header().code = c; }
 
+    /** Set type and code, adjusting the checksum instead of computing it anew */
+    void rewrite_type(Type t, uint8_t c) noexcept
+    {
+      const uint8_t prev[2] {static_cast<uint8_t>(header().type), header().code};
+      const uint8_t next[2] {static_cast<uint8_t>(t), c};
+      header().type = t;
+      header().code = c;
+      checksum_adjust(reinterpret_cast<uint8_t*>(&header().checksum), prev, 2, next, 2);
+    }
+
     void set_id(uint16_t s) noexcept
     { header().identifier = s; }
 
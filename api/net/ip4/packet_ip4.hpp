@@ -151,6 +151,10 @@ namespace net {
       ip_header().frag_off_flags = htons(ip_header().frag_off_flags);
     }
 
+    /** Clear the flags and fragment offset, e.g. after reassembly */
+    void clear_ip_fragmentation() noexcept
+    { ip_header().frag_off_flags = 0; }
+
     /** Set fragment offset header field */
     void set_ip_frag_offs(uint16_t offs)
     {
@@ -256,7 +260,7 @@ namespace net {
      *  Inferred from packet size
      */
     void set_segment_length() noexcept
-    { ip_header().tot_len = htons(size()); }
+    { ip_header().tot_len = htons(total_size()); }
 
     const ip4::Header& ip_header() const noexcept
     { return *reinterpret_cast<const ip4::Header*>(layer_begin()); }
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef NET_IP4_REASSEMBLY_HPP
+#define NET_IP4_REASSEMBLY_HPP
+
+#include "packet_ip4.hpp"
+#include <array>
+#include <rtc>
+#include <util/timer.hpp>
+
+namespace net {
+
+  /**
+   *  IPv4 fragment reassembly for one stack (RFC 791, RFC 815).
+   *
+   *  Fragments are kept in the buffers they arrived in, linked in offset
+   *  order as segments of the first fragment, so a datagram is reassembled
+   *  without copying. The reassembled packet is the first fragment with
+   *  its header rewritten; every following segment has its layer moved to
+   *  the fragment data. Fragments may arrive in any order, exact duplicates
+   *  are ignored, and datagrams with overlapping fragments are dropped.
+   *
+   *  Incomplete datagrams are dropped after TIMEOUT seconds, and the oldest
+   *  ones whenever more than MAX_BYTES of buffers would be held.
+   */
+  class Reassembly {
+  public:
+    using IP_packet_ptr = std::unique_ptr<PacketIP4>;
+
+    static constexpr int    MAX_DATAGRAMS = 64;
+    static constexpr int    TIMEOUT       = 15; // seconds
+    static constexpr size_t MAX_BYTES     = 256 * 1024;
+
+    Reassembly() = default;
+    Reassembly(const Reassembly&) = delete;
+    Reassembly& operator=(const Reassembly&) = delete;
+
+    /** Add a fragment. Returns the datagram once all of it has arrived */
+    IP_packet_ptr process(IP_packet_ptr fragment);
+
+    /** Drop datagrams waiting since before @now - TIMEOUT  */
+    void expire(RTC::timestamp_t now);
+
+    /** Datagrams waiting for more fragments */
+    int datagrams() const noexcept
+    { return datagrams_; }
+
+    /** Bytes of buffers held by waiting fragments */
+    size_t bytes() const noexcept
+    { return bytes_; }
+
+    /** Incomplete datagrams dropped, for any reason */
+    uint32_t dropped() const noexcept
+    { return dropped_; }
+
+  private:
+    struct Datagram {
+      ip4::Addr        src;
+      ip4::Addr        dst;
+      uint16_t         id    = 0;
+      Protocol         proto = Protocol::HOPOPT;
+      RTC::timestamp_t first_seen = 0;
+      uint32_t         received = 0;
+      uint32_t         total    = 0; // known once the last fragment arrived
+      size_t           bytes    = 0;
+      // fragments in offset order, linked as segments
+      IP_packet_ptr    fragments = nullptr;
+
+      bool matches(const PacketIP4&) const noexcept;
+    };
+
+    Datagram* find_or_create(const PacketIP4&, RTC::timestamp_t now);
+    bool insert(Datagram&, IP_packet_ptr);
+    IP_packet_ptr complete(Datagram&);
+    void drop(Datagram&);
+    void make_room(size_t bytes, const Datagram* keep);
+    void on_timeout();
+
+    std::array<Datagram, MAX_DATAGRAMS> slots_ {};
+    int      datagrams_ = 0;
+    size_t   bytes_     = 0;
+    uint32_t dropped_   = 0;
+    Timer    timer_ {{ *this, &Reassembly::on_timeout }};
+  };
+
+} //< namespace net
+
+#endif
@@ -18,9 +18,10 @@ namespace net::ip6 {
     {
       return static_cast<Protocol>(next_header);
     }
-    uint8_t size() const
+    /** Length in 8-octet units, not counting the first 8 octets */
+    uint16_t size() const
     {
-      return sizeof(Extension_header) + hdr_ext_len;
+      return sizeof(Extension_header) * (hdr_ext_len + 1);
     }
     uint8_t extended() const
     {
@@ -28,6 +29,41 @@ namespace net::ip6 {
     }
   } __attribute__((packed));
 
+  /** Whether @proto is an extension header, followed by another header */
+  constexpr bool is_extension_header(Protocol proto) noexcept
+  {
+    switch (proto)
+    {
+      case Protocol::HOPOPT:
+      case Protocol::IPv6_ROUTE:
+      case Protocol::IPv6_FRAG:
+      case Protocol::AH:
+      case Protocol::OPTSV6:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  struct Upper_layer {
+    Protocol proto;
+    /** Bytes of extension headers in front of the upper layer header */
+    uint16_t offset;
+  };
+
+  /**
+   * @brief      Walk the extension headers to the upper layer header.
+   *             If the headers run past @end, IPv6_NONXT is returned,
+   *             with the offset of the header that did.
+   *
+   * @param[in]  start  The start of the extension header
+   * @param[in]  end    The end of the packet
+   * @param[in]  proto  The protocol
+   *
+   * @return     Upper layer protocol, and where its header starts
+   */
+  Upper_layer parse_upper_layer(const uint8_t* start, const uint8_t* end, Protocol proto) noexcept;
+
   /**
    * @brief      Parse the upper layer protocol (TCP/UDP/ICMPv6).
    *             If none, IPv6_NONXT is returned.
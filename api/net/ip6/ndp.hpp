@@ -5,11 +5,11 @@
 
 #include <rtc>
 #include <cmath>
-#include <unordered_map>
 #include <deque>
 #include <util/timer.hpp>
 #include "packet_icmp6.hpp"
 #include "packet_ndp.hpp"
+#include "ndp_cache.hpp"
 #include "stateful_addr.hpp"
 #include "ndp/router_entry.hpp"
 #include "ndp/host_params.hpp"
@@ -51,14 +51,13 @@ namespace net {
     static const uint32_t NEIGH_UPDATE_ISROUTER          = 0x40000000;
     static const uint32_t NEIGH_UPDATE_ADMIN             = 0x80000000;
 
-    enum class NeighbourStates : uint8_t {
-      INCOMPLETE,
-      REACHABLE,
-      STALE,
-      DELAY,
-      PROBE,
-      FAIL
-    };
+    using NeighbourStates = Ndp_cache::State;
+
+    /** Neighbours and destinations cached, resolved or waiting for resolution */
+    static constexpr size_t cache_capacity = 512;
+
+    /** Packets queued per unresolved neighbour, more are dropped */
+    static constexpr int queue_limit = 16;
     using Stack   = IP6::Stack;
     using Route_checker = delegate<bool(ip6::Addr)>;
     using Ndp_resolver = delegate<void(ip6::Addr)>;
@@ -84,7 +83,20 @@ namespace net {
     void send_router_solicitation(Autoconf_handler delg);
     void send_router_advertisement();
 
-    ip6::Addr next_hop(const ip6::Addr&) const;
+    /** The next hop of a destination, or the any address if there is no route */
+    ip6::Addr next_hop(const ip6::Addr&);
+
+    /**
+     * Route a packet to @dst, in one lookup of the cache once it has
+     * been routed before (RFC 4861 5.2).
+     *
+     * @param[in]  dst       The destination
+     * @param[out] next_hop  The next hop
+     * @param[out] mac       The link address of the next hop, if resolved
+     *
+     * @return     Whether there is a route
+     */
+    bool route(const ip6::Addr& dst, ip6::Addr& next_hop, MAC::Addr& mac);
 
     /** Roll your own ndp-resolution system. */
     void set_resolver(Ndp_resolver ar)
@@ -126,9 +138,11 @@ namespace net {
     /* Check for Neighbour Reachabilty periodically */
     void check_neighbour_reachability();
 
-    /** Flush the NDP cache */
-    void flush_cache()
-    { neighbour_cache_.clear(); };
+    /** Flush the resolved neighbours of the NDP cache */
+    void flush_cache();
+
+    const Ndp_cache& neighbours() const noexcept
+    { return cache_; }
 
     /** Flush expired entries */
     void flush_expired_neighbours();
@@ -169,101 +183,6 @@ namespace net {
     /** NDP cache expires after neighbour_cache_exp_sec_ seconds */
     static constexpr uint16_t neighbour_cache_exp_sec_ {60 * 5};
 
-    /** Cache entries are just MAC's and timestamps */
-    struct Neighbour_Cache_entry {
-      /** Map needs empty constructor (we have no emplace yet) */
-      Neighbour_Cache_entry() noexcept = default;
-
-      Neighbour_Cache_entry(MAC::Addr mac, NeighbourStates state, uint32_t flags) noexcept
-      : mac_(mac), timestamp_(RTC::time_since_boot()), flags_(flags) {
-          set_state(state);
-      }
-
-      Neighbour_Cache_entry(const Neighbour_Cache_entry& cpy) noexcept
-      : mac_(cpy.mac_), state_(cpy.state_),
-        timestamp_(cpy.timestamp_), flags_(cpy.flags_) {}
-
-      void update() noexcept { timestamp_ = RTC::time_since_boot(); }
-
-      bool expired() const noexcept
-      { return RTC::time_since_boot() > timestamp_ + neighbour_cache_exp_sec_; }
-
-      MAC::Addr mac() const noexcept
-      { return mac_; }
-
-      RTC::timestamp_t timestamp() const noexcept
-      { return timestamp_; }
-
-      RTC::timestamp_t expires() const noexcept
-      { return timestamp_ + neighbour_cache_exp_sec_; }
-
-      void set_state(NeighbourStates state)
-      {
-         if (state <= NeighbourStates::FAIL) {
-           state_ = state;
-         }
-      }
-
-      void set_flags(uint32_t flags)
-      {
-          flags_ = flags;
-      }
-
-      std::string get_state_name()
-      {
-          switch(state_) {
-          case NeighbourStates::INCOMPLETE:
-              return "incomplete";
-          case NeighbourStates::REACHABLE:
-              return "reachable";
-          case NeighbourStates::STALE:
-              return "stale";
-          case  NeighbourStates::DELAY:
-              return "delay";
-          case NeighbourStates::PROBE:
-              return "probe";
-          case NeighbourStates::FAIL:
-              return "fail";
-          default:
-              return "uknown";
-          }
-      }
-
-    private:
-      MAC::Addr        mac_;
-      NeighbourStates  state_;
-      RTC::timestamp_t timestamp_;
-      uint32_t         flags_;
-    }; //< struct Neighbour_Cache_entry
-
-    struct Destination_Cache_entry {
-      Destination_Cache_entry(ip6::Addr next_hop)
-        : next_hop_{next_hop} {}
-
-    void update(ip6::Addr next_hop)
-    {
-      next_hop_ = next_hop;
-    }
-
-    ip6::Addr next_hop() const
-    { return next_hop_; }
-
-    private:
-      ip6::Addr        next_hop_;
-      // TODO: Add PMTU and Round-trip timers
-    };
-
-    struct Queue_entry {
-      Queue_entry(Packet_ptr p)
-        : pckt{std::move(p)}
-      {}
-      Packet_ptr pckt;
-      int tries_remaining = MAX_MULTICAST_SOLICIT;
-    };
-
-    using Cache       = std::unordered_map<ip6::Addr, Neighbour_Cache_entry>;
-    using DestCache   = std::unordered_map<ip6::Addr, Destination_Cache_entry>;
-    using PacketQueue = std::unordered_map<ip6::Addr, Queue_entry>;
     using PrefixList  = std::deque<ip6::Stateful_addr>;
     using RouterList  = std::deque<ndp::Router_entry>;
 
@@ -272,6 +191,7 @@ namespace net {
     uint32_t& requests_tx_;
     uint32_t& replies_rx_;
     uint32_t& replies_tx_;
+    uint32_t& queue_dropped_;
 
     std::chrono::minutes flush_interval_ = 5min;
 
@@ -302,12 +222,10 @@ namespace net {
     // Outbound data goes through here */
     downstream_link linklayer_out_ = nullptr;
 
-    // The caches
-    Cache     neighbour_cache_ {};
-    DestCache dest_cache_ {};
-
-    // Packet queue
-    PacketQueue waiting_packets_;
+    // Neighbours, destinations and the packets waiting for them
+    Ndp_cache cache_ {cache_capacity, queue_limit};
+    // Changed with the prefix and router lists, invalidating cached routes
+    uint32_t  routes_gen_ = 1;
 
     // Prefix List
     PrefixList prefix_list_;
@@ -330,6 +248,12 @@ namespace net {
     /** Retry ndp-resolution for packets still waiting */
     void resolve_waiting();
 
+    /** The next hop of @dst from the prefix and router lists */
+    ip6::Addr find_next_hop(const ip6::Addr& dst) const;
+
+    void routes_changed() noexcept
+    { routes_gen_++; }
+
     auto& host()
     { return host_params_; }
 
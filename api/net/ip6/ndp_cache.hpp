@@ -0,0 +1,212 @@
+#pragma once
+#ifndef NET_IP6_NDP_CACHE_HPP
+#define NET_IP6_NDP_CACHE_HPP
+
+#include <net/ip6/addr.hpp>
+#include <net/packet.hpp>
+#include <hw/mac_addr.hpp>
+#include <util/flat_map.hpp>
+#include <rtc>
+#include <vector>
+
+namespace net {
+
+  /**
+   *  Fixed capacity next-hop table for NDP, the neighbour cache and the
+   *  destination cache of RFC 4861 in one. Like Arp_cache, entries live
+   *  in one array indexed by an open addressing map that never rehashes,
+   *  and hold the packets waiting for a resolution.
+   *
+   *  An entry is a neighbour once resolved, and a destination once it
+   *  has a route: its next hop, and the index of the entry of that next
+   *  hop (itself when on-link), so sending to a destination takes one
+   *  lookup. A route holds while its generation matches the one of the
+   *  routes it was made from, and its next hop entry is not reused.
+   *
+   *  When full, inserting evicts an entry that has not been looked up
+   *  since the clock hand last passed it (second chance, approximating
+   *  LRU), dropping any packets it had queued.
+   */
+  class Ndp_cache {
+  public:
+    enum class State : uint8_t {
+      INCOMPLETE,
+      REACHABLE,
+      STALE,
+      DELAY,
+      PROBE,
+      FAIL
+    };
+
+    static constexpr uint32_t NO_HOP = UINT32_MAX;
+
+    struct Entry {
+      ip6::Addr        ip;
+      // the neighbour
+      MAC::Addr        mac;
+      bool             resolved = false;
+      State            state = State::INCOMPLETE;
+      mutable bool     referenced = false;
+      int8_t           tries_remaining = 0;
+      uint32_t         flags = 0;
+      RTC::timestamp_t timestamp = 0;
+      // packets waiting for resolution, at most queue_limit()
+      Packet_chain     pending;
+      // the destination
+      ip6::Addr        next_hop;
+      uint32_t         route_gen = 0;
+      uint32_t         hop = NO_HOP;
+      uint32_t         hop_serial = 0;
+      // changed whenever the slot is reused, invalidating links to it
+      uint32_t         serial = 0;
+    };
+
+    explicit Ndp_cache(size_t capacity, int queue_limit)
+      : entries_(capacity), index_(capacity), queue_limit_{queue_limit}
+    {
+      Expects(capacity > 0 and capacity < NO_HOP);
+      free_.reserve(capacity);
+      for (size_t i = capacity; i > 0; i--)
+        free_.push_back(i - 1);
+    }
+
+    /** Find the entry of @ip, or nullptr. Counts as a use of the entry. */
+    Entry* find(const ip6::Addr& ip) noexcept
+    {
+      const auto* idx = index_.find(ip);
+      if (idx == nullptr) return nullptr;
+      auto& ent = entries_[*idx];
+      ent.referenced = true;
+      return &ent;
+    }
+
+    const Entry* find(const ip6::Addr& ip) const noexcept
+    { return const_cast<Ndp_cache*>(this)->find(ip); }
+
+    /** Find the entry of @ip, or add an empty one, evicting if full */
+    Entry& insert(const ip6::Addr& ip)
+    {
+      if (auto* idx = index_.find(ip)) {
+        auto& ent = entries_[*idx];
+        ent.referenced = true;
+        return ent;
+      }
+      if (free_.empty())
+        evict();
+      const uint32_t idx = free_.back();
+      free_.pop_back();
+      index_.emplace(ip, idx);
+      auto& ent = entries_[idx];
+      ent.ip = ip;
+      used_++;
+      return ent;
+    }
+
+    /** Route packets for @dst through @next_hop, as of routes @gen */
+    void set_route(Entry& dst, const ip6::Addr& next_hop, uint32_t gen)
+    {
+      dst.next_hop  = next_hop;
+      dst.route_gen = gen;
+      dst.hop       = NO_HOP;
+      if (auto* hop = (next_hop == dst.ip) ? &dst : find(next_hop))
+        link(dst, *hop);
+    }
+
+    /**
+     * The entry of the next hop of a destination with a route, or nullptr
+     * if there is none yet. Only looked up when the link to it is broken.
+     */
+    Entry* hop_of(Entry& dst) noexcept
+    {
+      if (LIKELY(dst.hop != NO_HOP and entries_[dst.hop].serial == dst.hop_serial))
+        return &entries_[dst.hop];
+      auto* hop = find(dst.next_hop);
+      if (hop != nullptr) link(dst, *hop);
+      return hop;
+    }
+
+    /** Remove @ent, dropping its waiting packets */
+    void erase(Entry& ent)
+    {
+      if (ent.resolved) generation_++;
+      index_.erase(ent.ip);
+      Packet::release_chain(ent.pending.release());
+      free_.push_back(&ent - entries_.data());
+      const auto serial = ent.serial + 1;
+      ent = Entry{};
+      ent.serial = serial;
+      used_--;
+    }
+
+    /** Call @fn for every entry in use. It may erase the entry it is given. */
+    template <typename Fn>
+    void for_each(Fn fn)
+    {
+      for (auto& ent : entries_)
+        if (in_use(ent)) fn(ent);
+    }
+
+    /** Changed whenever a resolved entry changes or is removed */
+    uint32_t generation() const noexcept
+    { return generation_; }
+
+    /** Mark a change in the resolution of an entry */
+    void changed() noexcept
+    { generation_++; }
+
+    size_t size() const noexcept
+    { return used_; }
+
+    size_t capacity() const noexcept
+    { return entries_.size(); }
+
+    int queue_limit() const noexcept
+    { return queue_limit_; }
+
+    /** Entries removed to make room for new ones */
+    uint64_t evictions() const noexcept
+    { return evictions_; }
+
+  private:
+    bool in_use(const Entry& ent) const noexcept
+    {
+      const auto* idx = index_.find(ent.ip);
+      return idx != nullptr and &entries_[*idx] == &ent;
+    }
+
+    void link(Entry& dst, const Entry& hop) noexcept
+    {
+      dst.hop        = &hop - entries_.data();
+      dst.hop_serial = hop.serial;
+    }
+
+    void evict()
+    {
+      // two rounds are enough, the first clears every reference
+      for (size_t n = 0; n < 2 * entries_.size(); n++)
+      {
+        auto& ent = entries_[hand_];
+        hand_ = (hand_ + 1) % entries_.size();
+        if (ent.referenced) {
+          ent.referenced = false;
+          continue;
+        }
+        evictions_++;
+        erase(ent);
+        return;
+      }
+    }
+
+    std::vector<Entry>            entries_;
+    Flat_map<ip6::Addr, uint32_t> index_;
+    std::vector<uint32_t>         free_;
+    size_t   used_  = 0;
+    size_t   hand_  = 0;
+    int      queue_limit_;
+    uint32_t generation_ = 1;
+    uint64_t evictions_  = 0;
+  };
+
+} //< namespace net
+
+#endif
@@ -59,9 +59,13 @@ namespace net
     Protocol next_protocol() const noexcept
     { return static_cast<Protocol>(ip6_header().next_header); }
 
-    /** Protocol after Extension headers */
+    /** Protocol after Extension headers, parsed once on receive */
     Protocol ip_protocol() const noexcept
     {
+      if (LIKELY(upper_protocol() != 0))
+        return static_cast<Protocol>(upper_protocol());
+      if (LIKELY(not ip6::is_extension_header(next_protocol())))
+        return next_protocol();
       return ip6::parse_upper_layer_proto(ext_hdr_start(), data_end(), next_protocol());
     }
 
@@ -123,7 +127,10 @@ namespace net
 
     /** Set next header */
     void set_ip_next_header(uint8_t next_header) noexcept
-    { ip6_header().next_header = next_header; }
+    {
+      ip6_header().next_header = next_header;
+      set_upper_protocol(0);
+    }
 
     /** Set hop limit */
     void set_ip_hop_limit(uint8_t hop_limit) noexcept
@@ -156,9 +163,15 @@ namespace net
       hdr.next_header = static_cast<uint8_t>(proto);
       increment_data_end(sizeof(ip6::Header));
       set_payload_offset(sizeof(ip6::Header));
+      set_upper_protocol(0);
       assert(this->payload_length() == 0);
     }
 
+    /**
+     *  Find the upper layer header after the extension headers, and keep
+     *  it as the payload and upper protocol of the packet, so the layers
+     *  above don't walk the extension headers again.
+     */
     void calculate_payload_offset();
 
     Span ip_data() {
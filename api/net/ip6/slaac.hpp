@@ -33,12 +33,24 @@ namespace net {
     void autoconf_trigger();
     void on_config(config_func handler);
 
+    /**
+     * @brief      Use addresses while DAD is still in progress (Optimistic
+     *             DAD, RFC 4429), and skip the random delay before the first
+     *             solicitation. An address is removed again if DAD fails.
+     *             On by default.
+     *
+     * @param[in]  enabled  Whether to be optimistic
+     */
+    void set_optimistic_dad(bool enabled) noexcept
+    { optimistic_ = enabled; }
+
   private:
     Stack&        stack;
     uint64_t      token_;
     bool          use_token_;
     ip6::Stateful_addr tentative_addr_;
     bool          linklocal_completed;
+    bool          optimistic_ = true;
     // Number of times to attempt DAD
     int           dad_transmits_;
     Timer         timeout_timer_;
@@ -47,6 +59,8 @@ namespace net {
 
     void process_prefix_info(const ndp::option::Prefix_info& pinfo);
     void perform_dad();
+    void add_tentative();
+    void remove_tentative();
     void dad_handler(const ip6::Addr& addr);
   };
 }
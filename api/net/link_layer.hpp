@@ -4,6 +4,9 @@
 #define NET_LINK_LAYER_HPP
 
 #include <hw/nic.hpp>
+#include <net/capture.hpp>
+#include <net/rps.hpp>
+#include <kernel/trace.hpp>
 
 namespace net {
 
@@ -15,6 +18,9 @@ public:
   using Protocol    = T;
   using upstream    = hw::Nic::upstream;
   using downstream_link  = hw::Nic::downstream;
+
+  /** Max number of packets a driver hands up in one receive() call */
+  static constexpr int burst_size = 32;
 public:
   explicit Link_layer(Protocol&& protocol);
 
@@ -63,17 +69,44 @@ public:
   uint64_t get_packets_dropped() override
   { return link_.get_packets_dropped(); }
 
+  bool set_rps_cpus(std::vector<int> cpus) override;
+
+  std::vector<int> rps_cpus() const override
+  { return (rps_ != nullptr) ? rps_->cpus() : std::vector<int>{}; }
+
+  bool set_capture(Capture* capture) override;
 
 protected:
-  /** Called by the underlying physical driver inheriting the Link_layer */
+  /** Called by the underlying physical driver inheriting the Link_layer.
+      The packet may be the head of a chain of up to burst_size packets,
+      see net::Packet_chain. */
   void receive(net::Packet_ptr pkt)
   {
+    TRACEPOINT(nic_rx, pkt->size(), (uintptr_t) this);
     set_last_packet(pkt.get());
+    if (UNLIKELY(capture_ != nullptr))
+      capture_->record(pkt.get(), Capture::RX);
+    if (UNLIKELY(rps_ != nullptr and not rps_->cpus().empty())) {
+      rps_->receive(std::move(pkt));
+      return;
+    }
     link_.receive(std::move(pkt));
   }
 
 private:
+  void transmit_captured(net::Packet_ptr chain)
+  {
+    if (Capture* capture = capture_; capture != nullptr)
+      capture->record(chain.get(), Capture::TX);
+    physical_(std::move(chain));
+  }
+
   Protocol link_;
+  // kept once created, as its CPUs may have drains of it posted
+  std::unique_ptr<RPS> rps_ = nullptr;
+  Capture* capture_ = nullptr;
+  // the NIC's own, while sent frames go through transmit_captured
+  net::downstream physical_ = nullptr;
 };
 
 template <class Protocol>
@@ -83,6 +116,35 @@ Link_layer<Protocol>::Link_layer(Protocol&& protocol)
 {
 }
 
+template <class Protocol>
+bool Link_layer<Protocol>::set_rps_cpus(std::vector<int> cpus)
+{
+  if (rps_ == nullptr)
+  {
+    if (cpus.empty()) return true;
+    rps_ = std::make_unique<RPS>(device_name(),
+        RPS::deliver_func{link_, &Protocol::receive}, std::move(cpus));
+  }
+  else
+    rps_->set_cpus(std::move(cpus));
+  return true;
+}
+
+template <class Protocol>
+bool Link_layer<Protocol>::set_capture(Capture* capture)
+{
+  // nothing is added to the sending of frames unless they are captured
+  if (capture != nullptr and capture_ == nullptr) {
+    physical_ = link_.physical_downstream();
+    link_.set_physical_downstream({this, &Link_layer::transmit_captured});
+  }
+  else if (capture == nullptr and capture_ != nullptr) {
+    link_.set_physical_downstream(physical_);
+  }
+  capture_ = capture;
+  return true;
+}
+
 } // < namespace net
 
 #endif
@@ -0,0 +1,310 @@
+#pragma once
+#ifndef NET_LPM_HPP
+#define NET_LPM_HPP
+
+#include <net/ip4/addr.hpp>
+#include <net/ip6/addr.hpp>
+#include <net/util.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace net {
+
+  /**
+   *  Path compressed binary trie over prefixes of up to 128 bits,
+   *  mapping each prefix to route indices. Keys are host order with
+   *  the most significant bits in the first word.
+   *
+   *  Every node on the path to an address is a matching prefix, so one
+   *  walk finds both the most specific and the cheapest route.
+   */
+  class Prefix_trie {
+  public:
+    using Key = std::array<uint64_t, 2>;
+
+    struct Match {
+      int longest  = -1;
+      int cheapest = -1;
+    };
+
+    void clear() noexcept
+    {
+      nodes_.clear();
+      root_ = -1;
+    }
+
+    /** Insert route @idx costing @cost. Routes with a lower index win ties,
+        so insert them in table order. */
+    void insert(Key key, const int len, const int idx, const int cost)
+    {
+      key = mask(key, len);
+      int parent = -1;
+      int side   = 0;
+      int cur    = root_;
+      while (true)
+      {
+        if (cur < 0) {
+          link(parent, side, new_node(key, len));
+          set_route(nodes_.back(), idx, cost);
+          return;
+        }
+        const int common = std::min({common_bits(nodes_[cur].key, key),
+                                     (int) nodes_[cur].len, len});
+        if (common == nodes_[cur].len)
+        {
+          if (len == common) {
+            set_route(nodes_[cur], idx, cost);
+            return;
+          }
+          parent = cur;
+          side   = bit(key, common);
+          cur    = nodes_[cur].child[side];
+          continue;
+        }
+        // split the edge into cur at the common prefix
+        const int split = new_node(mask(key, common), common);
+        nodes_[split].child[bit(nodes_[cur].key, common)] = cur;
+        link(parent, side, split);
+        if (common == len) {
+          set_route(nodes_[split], idx, cost);
+        }
+        else {
+          const int leaf = new_node(key, len);
+          nodes_[split].child[bit(key, common)] = leaf;
+          set_route(nodes_[leaf], idx, cost);
+        }
+        return;
+      }
+    }
+
+    Match lookup(const Key& key) const noexcept
+    {
+      Match match;
+      int cheapest_cost = 0;
+      for (int i = root_; i >= 0; )
+      {
+        const auto& node = nodes_[i];
+        if (common_bits(node.key, key) < node.len) break;
+        if (node.route >= 0) {
+          match.longest = node.route;
+          if (match.cheapest < 0 || node.cost < cheapest_cost
+              || (node.cost == cheapest_cost && node.cheapest < match.cheapest)) {
+            match.cheapest = node.cheapest;
+            cheapest_cost  = node.cost;
+          }
+        }
+        if (node.len == 128) break;
+        i = node.child[bit(key, node.len)];
+      }
+      return match;
+    }
+
+    static Key mask(const Key& key, const int len) noexcept
+    {
+      Key res{0, 0};
+      if (len > 0)
+        res[0] = key[0] & (~0ull << (64 - std::min(len, 64)));
+      if (len > 64)
+        res[1] = key[1] & (~0ull << (128 - len));
+      return res;
+    }
+
+  private:
+    struct Node {
+      Key     key;
+      uint8_t len;
+      int     child[2] {-1, -1};
+      // first route with exactly this prefix, and the cheapest one
+      int     route    = -1;
+      int     cheapest = -1;
+      int     cost     = 0;
+    };
+
+    int new_node(const Key& key, int len)
+    {
+      nodes_.push_back({key, (uint8_t) len});
+      return nodes_.size() - 1;
+    }
+
+    void link(int parent, int side, int node) noexcept
+    {
+      if (parent < 0) root_ = node;
+      else nodes_[parent].child[side] = node;
+    }
+
+    static void set_route(Node& node, int idx, int cost) noexcept
+    {
+      if (node.route < 0) node.route = idx;
+      if (node.cheapest < 0 || cost < node.cost) {
+        node.cheapest = idx;
+        node.cost     = cost;
+      }
+    }
+
+    static int bit(const Key& key, int pos) noexcept
+    { return (key[pos / 64] >> (63 - pos % 64)) & 1; }
+
+    static int common_bits(const Key& a, const Key& b) noexcept
+    {
+      if (a[0] != b[0]) return __builtin_clzll(a[0] ^ b[0]);
+      if (a[1] != b[1]) return 64 + __builtin_clzll(a[1] ^ b[1]);
+      return 128;
+    }
+
+    std::vector<Node> nodes_;
+    int root_ = -1;
+  };
+
+  /**
+   *  Compiled longest prefix match over a routing table, rebuilt
+   *  whenever the table changes. Lookups return an index into the
+   *  table the structure was built from, or -1 for no match.
+   *
+   *  Routes whose network has bits outside of the netmask never match,
+   *  and are left out, as are IPv4 routes with a non-contiguous netmask.
+   */
+  template <class Addr>
+  class Lpm;
+
+  /**
+   *  IPv4: Stride tables of 16, 8 and 8 bits (DIR-16-8-8), so a lookup
+   *  is at most three dependent loads. The first level is 256 KB, rather
+   *  than the 32 MB first level of DIR-24-8, and the 256 entry tables
+   *  below it are only created for prefixes longer than /16.
+   *  The cheapest route is found with a Prefix_trie.
+   */
+  template <>
+  class Lpm<ip4::Addr> {
+  public:
+    template <class Routing_table>
+    void build(const Routing_table& table)
+    {
+      tbl16_.clear();
+      subtables_.clear();
+      trie_.clear();
+
+      std::vector<int> prefix(table.size(), -1);
+      for (size_t i = 0; i < table.size(); i++)
+      {
+        const uint32_t mask = ntohl(table[i].netmask().whole);
+        const uint32_t net  = ntohl(table[i].net().whole);
+        const int len = __builtin_popcount(mask);
+        if (mask != prefix_mask(len) or (net & ~mask) != 0) continue;
+        prefix[i] = len;
+        trie_.insert({(uint64_t) net << 32, 0}, len, i, table[i].cost());
+      }
+
+      // Shorter prefixes first, so longer ones overwrite the ranges they
+      // cover. For equal prefixes the first route in the table is written last.
+      std::vector<int> order(table.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [&prefix] (int a, int b) {
+          return prefix[a] != prefix[b] ? prefix[a] < prefix[b] : a > b;
+        });
+
+      for (const int i : order)
+      {
+        if (prefix[i] < 0) continue;
+        if (tbl16_.empty()) tbl16_.assign(1 << 16, 0);
+        insert(ntohl(table[i].net().whole), prefix[i], i + 1);
+      }
+    }
+
+    /** Index of the route with the longest matching prefix */
+    int longest_match(const ip4::Addr dest) const noexcept
+    {
+      if (tbl16_.empty()) return -1;
+      const uint32_t addr = ntohl(dest.whole);
+      uint32_t entry = tbl16_[addr >> 16];
+      if (entry & SUBTABLE) {
+        entry = subtables_[entry & ~SUBTABLE][(addr >> 8) & 0xff];
+        if (entry & SUBTABLE)
+          entry = subtables_[entry & ~SUBTABLE][addr & 0xff];
+      }
+      return (int) entry - 1;
+    }
+
+    /** Index of the cheapest matching route */
+    int cheapest_match(const ip4::Addr dest) const noexcept
+    {
+      return trie_.lookup({(uint64_t) ntohl(dest.whole) << 32, 0}).cheapest;
+    }
+
+  private:
+    // entries are a route index + 1, 0 for none, or a subtable
+    static constexpr uint32_t SUBTABLE = 0x80000000;
+    using Subtable = std::array<uint32_t, 256>;
+
+    static uint32_t prefix_mask(const int len) noexcept
+    { return len ? ~0u << (32 - len) : 0; }
+
+    uint32_t& entry(const int table, const uint32_t slot) noexcept
+    { return table < 0 ? tbl16_[slot] : subtables_[table][slot]; }
+
+    /** Subtable below an entry, created from the entry if missing */
+    int descend(const int table, const uint32_t slot)
+    {
+      const uint32_t value = entry(table, slot);
+      if (value & SUBTABLE) return value & ~SUBTABLE;
+      subtables_.emplace_back();
+      subtables_.back().fill(value);
+      entry(table, slot) = SUBTABLE | (subtables_.size() - 1);
+      return subtables_.size() - 1;
+    }
+
+    void insert(const uint32_t net, const int len, const uint32_t value)
+    {
+      if (len <= 16) {
+        std::fill_n(&tbl16_[net >> 16], 1 << (16 - len), value);
+        return;
+      }
+      const int sub2 = descend(-1, net >> 16);
+      if (len <= 24) {
+        std::fill_n(&subtables_[sub2][(net >> 8) & 0xff], 1 << (24 - len), value);
+        return;
+      }
+      const int sub3 = descend(sub2, (net >> 8) & 0xff);
+      std::fill_n(&subtables_[sub3][net & 0xff], 1 << (32 - len), value);
+    }
+
+    std::vector<uint32_t> tbl16_;
+    std::vector<Subtable> subtables_;
+    Prefix_trie           trie_;
+  };
+
+  /** IPv6: a Prefix_trie over the 128 bit address */
+  template <>
+  class Lpm<ip6::Addr> {
+  public:
+    template <class Routing_table>
+    void build(const Routing_table& table)
+    {
+      trie_.clear();
+      for (size_t i = 0; i < table.size(); i++)
+      {
+        const auto net = key(table[i].net());
+        const int  len = std::min<int>(table[i].netmask(), 128);
+        if (Prefix_trie::mask(net, len) != net) continue;
+        trie_.insert(net, len, i, table[i].cost());
+      }
+    }
+
+    int longest_match(const ip6::Addr& dest) const noexcept
+    { return trie_.lookup(key(dest)).longest; }
+
+    int cheapest_match(const ip6::Addr& dest) const noexcept
+    { return trie_.lookup(key(dest)).cheapest; }
+
+  private:
+    static Prefix_trie::Key key(const ip6::Addr& addr) noexcept
+    { return {ntohll(addr.i64[0]), ntohll(addr.i64[1])}; }
+
+    Prefix_trie trie_;
+  };
+
+} //< namespace net
+
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+#ifndef NET_NAT_LOAD_BALANCER_HPP
+#define NET_NAT_LOAD_BALANCER_HPP
+
+#include <net/nat/napt.hpp>
+#include <net/netfilter.hpp>
+#include <atomic>
+#include <vector>
+
+namespace net {
+namespace nat {
+
+/**
+ * @brief      Maglev consistent hashing lookup table [Eisenbud et al.,
+ *             NSDI 2016]. Each backend fills the slots of its own
+ *             permutation of the table in turn, so the table is spread
+ *             evenly and a change of backends moves few flows.
+ */
+class Maglev {
+public:
+  struct Backend {
+    Socket   addr;
+    uint16_t weight = 1;     // share of the table, relative to the others
+    bool     healthy = true; // 0 weight or not healthy: gets no flows
+  };
+
+  // should be prime, and well above 100x the number of backends
+  static constexpr uint32_t DEFAULT_SIZE = 65537;
+
+  Maglev(std::vector<Backend> backends, uint32_t size = DEFAULT_SIZE);
+
+  /** The backend for a flow with @hash, or nullptr when there are none */
+  const Backend* lookup(uint64_t hash) const noexcept
+  {
+    if (UNLIKELY(empty_)) return nullptr;
+    return &backends_[table_[hash % table_.size()]];
+  }
+
+  /** Slots of the table held by backend @idx */
+  uint32_t slots(size_t idx) const noexcept;
+
+  uint32_t size() const noexcept
+  { return table_.size(); }
+
+  const std::vector<Backend>& backends() const noexcept
+  { return backends_; }
+
+private:
+  std::vector<Backend>  backends_;
+  std::vector<uint16_t> table_;
+  bool empty_ = true;
+};
+
+/**
+ * @brief      L4 load balancer for TCP and UDP to a virtual address (VIP).
+ *             New flows get a backend from a Maglev table, and keep it
+ *             through their conntrack entry, so backend changes only
+ *             move new flows.
+ *
+ *             The table is rebuilt on every change, to the side, and
+ *             swapped in without locks; the old one is freed once every
+ *             CPU has been back to its event loop.
+ *
+ *             Install prerouting() in the prerouting chain, and for NAT
+ *             also postrouting() in the postrouting chain. IPv4 only.
+ */
+class Load_balancer {
+public:
+  using Backend = Maglev::Backend;
+
+  enum class Mode : uint8_t {
+    NAT, // DNAT to the backend, replies SNATed back through us
+    DSR  // direct server return: the packet goes unchanged to the
+         // backend, which has the VIP itself and replies directly
+  };
+
+  Load_balancer(std::shared_ptr<Conntrack> ct, Socket vip, Mode mode = Mode::NAT,
+                uint32_t table_size = Maglev::DEFAULT_SIZE);
+  ~Load_balancer();
+
+  /** Replace the backends. Changes are made from one CPU at a time */
+  void set_backends(std::vector<Backend> backends);
+
+  /** Change the weight, or the health, of backend @idx */
+  void set_weight(size_t idx, uint16_t weight);
+  void set_health(size_t idx, bool healthy);
+
+  /** The backend a new flow would get, nullptr when there are none */
+  const Backend* pick(const Quadruple& flow, Protocol proto = Protocol::TCP) const noexcept;
+
+  /** The backends, as of the latest change */
+  std::vector<Backend> backends() const;
+
+  /** Send flows to the VIP to their backends */
+  Filter_verdict<IP4> prerouting(IP4::IP_packet_ptr, Inet&, Conntrack::Entry_ptr);
+
+  /** Restore the VIP as source of the replies from the backends (NAT only) */
+  Filter_verdict<IP4> postrouting(IP4::IP_packet_ptr, Inet&, Conntrack::Entry_ptr);
+
+  /** Hash of a flow, over its source, destination and protocol */
+  static uint64_t flow_hash(const Quadruple& flow, Protocol proto) noexcept;
+
+  const Socket& vip() const noexcept
+  { return vip_; }
+
+  Mode mode() const noexcept
+  { return mode_; }
+
+  uint64_t new_flows() const noexcept
+  { return new_flows_; }
+
+  uint64_t dropped() const noexcept
+  { return dropped_; }
+
+private:
+  std::shared_ptr<Conntrack> conntrack_;
+  NAPT napt_;
+  const Socket vip_;
+  const Mode mode_;
+  const uint32_t table_size_;
+  std::atomic<const Maglev*> table_ {nullptr};
+  uint64_t new_flows_ = 0;
+  uint64_t dropped_ = 0;
+
+  void publish(std::vector<Backend> backends);
+};
+
+} // < namespace nat
+} // < namespace net
+
+#endif
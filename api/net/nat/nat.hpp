@@ -6,9 +6,49 @@
 #include <net/socket.hpp>
 #include <net/ip4/packet_ip4.hpp>
 
+#include <net/checksum.hpp>
+
 namespace net {
 namespace nat {
 
+/**
+ * A translation of the source or destination of one flow, with the
+ * checksum deltas (RFC 1624) computed from its first packet. Every packet
+ * of the flow has the same old address and port, so a burst is rewritten
+ * by storing the new values and applying the same deltas.
+ */
+class Rewrite {
+public:
+  enum class Dir : uint8_t { SRC, DST };
+
+  /** Rewrite address and port (TCP/UDP) of packets like @pkt */
+  Rewrite(const PacketIP4& pkt, Dir dir, const Socket& sock);
+  /** Rewrite only the address */
+  Rewrite(const PacketIP4& pkt, Dir dir, const ip4::Addr addr);
+  /** Rewrite only the port (TCP/UDP) */
+  Rewrite(const PacketIP4& pkt, Dir dir, const uint16_t port);
+
+  /** Translate one packet of the flow */
+  void apply(PacketIP4& pkt) const noexcept;
+
+  /** Translate every packet in a chain of packets of the flow */
+  void apply_chain(PacketIP4& head) const noexcept;
+
+private:
+  Rewrite(const PacketIP4& pkt, Dir dir, bool set_addr, const ip4::Addr addr,
+          bool set_port, const uint16_t port);
+
+  Checksum_delta ip_delta_;  // IP header
+  Checksum_delta l4_delta_;  // TCP/UDP, including the pseudo-header
+  ip4::Addr      addr_;
+  uint16_t       port_;      // network order
+  Protocol       proto_;
+  Dir            dir_;
+  bool           set_addr_;
+  bool           set_port_;
+};
+
+
 /* TCP Source NAT */
 void tcp_snat(PacketIP4& pkt, const Socket& new_sock);
 void tcp_snat(PacketIP4& pkt, const ip4::Addr new_addr);
@@ -50,6 +50,23 @@ struct Filter_verdict
 
 class Inet;
 
+/**
+ * @brief      Generation of the filter ruleset. Verdicts cached by
+ *             chain fast paths are only valid within one generation.
+ */
+inline uint32_t& filter_generation() noexcept
+{
+  static uint32_t generation = 1;
+  return generation;
+}
+
+/**
+ * @brief      Invalidate every verdict cached by chain fast paths.
+ *             Call after changing what a filter decides.
+ */
+inline void filter_ruleset_changed() noexcept
+{ __sync_fetch_and_add(&filter_generation(), 1); }
+
 template <typename IPV>
 using Packetfilter =
   delegate<Filter_verdict<IPV>(typename IPV::IP_packet_ptr, Inet&, Conntrack::Entry_ptr)>;
@@ -72,6 +89,20 @@ struct Filter_chain
    */
   Filter_verdict<IPV> operator()(IP_packet_ptr pckt, Inet& stack, Conntrack::Entry_ptr ct)
   {
+    const bool established = fast_path_bit_ and ct != nullptr
+      and ct->state == Conntrack::State::ESTABLISHED;
+    if (established)
+    {
+      if (chain.size() != fast_path_size_) {
+        fast_path_size_ = chain.size();
+        filter_ruleset_changed();
+      }
+      else if (ct->filter_gen == filter_generation()
+               and (ct->filter_accepted & fast_path_bit_)) {
+        return {std::move(pckt), Filter_verdict_type::ACCEPT};
+      }
+    }
+
     Filter_verdict<IPV> verdict{std::move(pckt), Filter_verdict_type::ACCEPT};
     int i = 0;
     for (auto& filter : chain) {
@@ -79,15 +110,55 @@ struct Filter_chain
       verdict = filter(verdict.release(), stack, ct);
       if(verdict == Filter_verdict_type::DROP) {
         debug("Packet dropped in %s chain, filter %i \n", name, i);
-        break;
+        return verdict;
       }
     }
+
+    if (established)
+    {
+      const uint32_t gen = filter_generation();
+      if (ct->filter_gen != gen) {
+        ct->filter_gen      = gen;
+        ct->filter_accepted = 0;
+      }
+      ct->filter_accepted |= fast_path_bit_;
+    }
     return verdict;
   }
 
+  /**
+   *  Let packets of established connections skip the filters once the
+   *  chain has accepted the connection, until filter_ruleset_changed()
+   *  is called. Adding or removing filters is detected, replacing one
+   *  is not. Only for chains where every filter decides per connection
+   *  and never modifies the packet, e.g. not for NAT.
+   *
+   *  At most 32 chains per IP version can have a fast path. Returns false if there
+   *  is no room for this one.
+   */
+  bool enable_fast_path() noexcept
+  {
+    static uint8_t chains = 0;
+    if (fast_path_bit_ == 0)
+    {
+      if (chains == 32) return false;
+      fast_path_bit_  = 1u << chains++;
+      fast_path_size_ = chain.size();
+    }
+    return true;
+  }
+
+  bool fast_path() const noexcept
+  { return fast_path_bit_ != 0; }
+
   Filter_chain(const char* chain_name, std::initializer_list<Packetfilter<IPV>> filters)
     : chain(filters), name{chain_name}
   {}
+
+private:
+  // bit of this chain in Conntrack::Entry::filter_accepted, 0 when disabled
+  uint32_t fast_path_bit_  = 0;
+  size_t   fast_path_size_ = 0;
 };
 
 }
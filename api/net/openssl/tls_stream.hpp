@@ -3,6 +3,8 @@
 #include <openssl/pem.h>
 #include <openssl/ssl.h>
 #include <net/stream_buffer.hpp>
+#include <chrono>
+#include <memory>
 
 //#define VERBOSE_OPENSSL 1
 #ifdef VERBOSE_OPENSSL
@@ -26,6 +28,28 @@ namespace openssl
     void write(const void* buf, size_t n) override;
     void close() override;
 
+    /**
+     * @brief      Write several buffers at once, encrypted into as few
+     *             full-size records as they fit in.
+     */
+    void writev(const buffer_t* buffers, size_t count) override;
+    using net::Stream::writev;
+
+    /**
+     * @brief      Let small writes wait up to a window for more, so that they
+     *             go out together in full-size records rather than a record
+     *             (and a TCP segment) each. Writes that fill a record, and
+     *             close(), send what is waiting at once.
+     *
+     * @param[in]  window  How long a write may wait, 0 (the default) for none
+     */
+    void set_write_coalescing(std::chrono::microseconds window) noexcept {
+      m_flush_window = window;
+    }
+
+    /** Send the small writes waiting for more */
+    void flush();
+
     net::Socket local() const override {
       return m_transport->local();
     }
@@ -37,7 +61,7 @@ namespace openssl
     }
 
     bool is_connected() const noexcept override {
-      return handshake_completed() && m_transport->is_connected();
+      return m_handshake_job == nullptr && handshake_completed() && m_transport->is_connected();
     }
     bool is_writable() const noexcept override {
       return (not write_congested()) && is_connected() && m_transport->is_writable();
@@ -63,13 +87,33 @@ namespace openssl
     void handle_read_congestion() override;
     void handle_write_congestion() override;
 
+    /**
+     * @brief      Run the handshake computations on another CPU, so they
+     *             don't hold up the network stack on this one. The stream
+     *             resumes on its own CPU when each step is done, and data
+     *             arriving meanwhile waits in the transport.
+     *
+     * @param[in]  cpu   The CPU, or -1 to run them here
+     */
+    void offload_handshake(int cpu) noexcept {
+      m_handshake_cpu = cpu;
+    }
+
   private:
+    struct Handshake_job;
+    void start_handshake_job();
+    static void handshake_job_done(Handshake_job&);
+    int  handshake_step(int num, int error);
     void handle_data();
     int  decrypt(const void *data,int size);
     int  send_decrypted();
     bool tls_read(buffer_t);
     int  tls_perform_stream_write();
     int  tls_perform_handshake();
+    bool gather(const uint8_t* data, size_t len);
+    bool encrypt_waiting();
+    bool encrypt(const void* data, size_t len);
+    void send_records();
     bool handshake_completed() const noexcept;
     void close_callback_once();
 
@@ -79,12 +123,24 @@ namespace openssl
       STATUS_FAIL
     };
     status_t status(int n) const noexcept;
+    static status_t status_of(int error) noexcept;
+    static BIO* new_cipher_bio(buffer_t* out);
+    static constexpr size_t MAX_RECORD = SSL3_RT_MAX_PLAIN_LENGTH;
     Stream_ptr m_transport = nullptr;
     SSL*   m_ssl    = nullptr;
     BIO*   m_bio_rd = nullptr;
+    // writes the records straight into m_cipher
     BIO*   m_bio_wr = nullptr;
+    buffer_t m_cipher = nullptr;
+    // small writes waiting for more
+    buffer_t m_plain  = nullptr;
+    std::chrono::microseconds m_flush_window{0};
+    Timer  m_flush_timer{{this, &TLS_stream::flush}};
     int8_t m_busy = 0;
     bool   m_deferred_close = false;
+    int    m_handshake_cpu = -1;
+    // set while a handshake step runs on another CPU
+    std::shared_ptr<Handshake_job> m_handshake_job = nullptr;
   };
 
 } // openssl
@@ -7,6 +7,7 @@
 #include <gsl/gsl_assert>
 #include <delegate>
 #include <cassert>
+#include <cstring>
 
 namespace net
 {
@@ -79,6 +80,14 @@ namespace net
     int bufsize() const noexcept
     { return buffer_end() - buf(); }
 
+    /** Bytes in front of the current layer, room for lower layer headers */
+    int headroom() const noexcept
+    { return layer_begin_ - buf(); }
+
+    /** Bytes left after the data in this buffer */
+    int tailroom() const noexcept
+    { return buffer_end_ - data_end_; }
+
     /** Increment / decrement layer_begin, resets data_end */
     void increment_layer_begin(int i)
     {
@@ -115,6 +124,52 @@ namespace net
       data_end_ += i;
     }
 
+    /**
+     *  Leave the checksum to the NIC: it sums from @start to the end of
+     *  the packet, and stores the result @offset bytes after @start.
+     *  The checksum field must hold the pseudo-header sum.
+     */
+    void set_checksum_offload(const Byte* start, uint16_t offset) noexcept
+    {
+      Expects(start > buf() and start + offset < buffer_end());
+      csum_start_  = start - buf();
+      csum_offset_ = offset;
+    }
+    bool checksum_offloaded() const noexcept
+    { return csum_start_ != 0; }
+
+    /** Offset from layer_begin() to where the NIC should start summing */
+    int csum_start() const noexcept
+    { return buf() + csum_start_ - layer_begin(); }
+
+    /** Offset from csum_start() to the checksum field */
+    int csum_offset() const noexcept
+    { return csum_offset_; }
+
+    /** Request segmentation offload into segments of @mss bytes of payload */
+    void set_segment_size(uint16_t mss) noexcept
+    { segment_size_ = mss; }
+
+    /** TSO segment size, or 0 when not requested */
+    uint16_t segment_size() const noexcept
+    { return segment_size_; }
+
+    /** Set by a NIC that took the 802.1Q tag off a received frame */
+    void set_vlan_id(uint16_t vid) noexcept
+    { vlan_id_ = vid; }
+
+    /** VLAN ID of a stripped tag, or 0 if the frame is as it arrived */
+    uint16_t vlan_id() const noexcept
+    { return vlan_id_; }
+
+    /** Set by the network layer once it found the protocol of the payload */
+    void set_upper_protocol(uint8_t proto) noexcept
+    { upper_proto_ = proto; }
+
+    /** Protocol number of the payload, or 0 if not known yet */
+    uint8_t upper_protocol() const noexcept
+    { return upper_proto_; }
+
     /* Add a packet to this packet chain */
     inline void chain(Packet_ptr p) noexcept;
 
@@ -129,10 +184,52 @@ namespace net
     Packet* tail() noexcept
     { return chain_.get(); }
 
+    const Packet* tail() const noexcept
+    { return chain_.get(); }
+
     /* Get the tail, and detach it from the head (for FIFO) */
     Packet_ptr detach_tail() noexcept
     { return std::move(chain_); }
 
+    /**
+     *  Segments hold the rest of a packet too large for one buffer, e.g.
+     *  a reassembled datagram. The data of a segment is its layer, from
+     *  layer_begin() to data_end(). Unlike the chain, which links separate
+     *  packets, segments are parts of this packet and go where it goes.
+     */
+    inline void append_segment(Packet_ptr seg) noexcept;
+
+    /* Get the next segment of this packet */
+    Packet* next_segment() noexcept
+    { return segments_.get(); }
+
+    const Packet* next_segment() const noexcept
+    { return segments_.get(); }
+
+    /* Detach the segments following this buffer */
+    Packet_ptr detach_segments() noexcept
+    { return std::move(segments_); }
+
+    /* Size of the current layer, including the data of every segment */
+    inline int total_size() const noexcept;
+
+    /* Number of buffers this packet is made of, 1 without segments */
+    inline int segment_count() const noexcept;
+
+    /**
+     *  Copy a packet spread over segments into a single buffer from the
+     *  heap, with the same headroom, for code that reads it as one array.
+     *  A packet without segments is returned as is.
+     *  Throws std::bad_alloc.
+     */
+    static inline Packet_ptr linearize(Packet_ptr pkt);
+
+    /**
+     *  Release a whole packet chain, returning buffers to their
+     *  buffer stores in batches. Unlike destroying the head, this
+     *  does not recurse through the chain.
+     */
+    static inline void release_chain(Packet_ptr head);
 
     // delete: release data back to buffer store
     // alternatively, free array of bytes if no bufferstore was set
@@ -145,6 +242,8 @@ namespace net
     }
 
   private:
+    friend class Packet_chain;
+
     /** Set layer begin, e.g. view the packet from another layer */
     void set_layer_begin(Byte_ptr loc)
     {
@@ -169,11 +268,66 @@ namespace net
 
     Packet_ptr chain_ = nullptr;
     Packet*    last_  = nullptr;
+    Packet_ptr segments_ = nullptr;
+
+    // transmit offloads, where a zero checksum start means no offload
+    uint16_t   csum_start_   = 0;
+    uint16_t   csum_offset_  = 0;
+    uint16_t   segment_size_ = 0;
+    // receive offloads
+    uint16_t   vlan_id_      = 0;
+    uint8_t    upper_proto_  = 0;
 
     BufferStore*          bufstore_;
     Byte buf_[0];
   }; //< class Packet
 
+  /**
+   *  Builds a packet chain in FIFO order with constant time appends.
+   *  Used to hand a burst of packets from one layer to the next in a
+   *  single call, where the receiver walks the chain with detach_tail().
+   */
+  class Packet_chain
+  {
+  public:
+    /** Append a packet, or a whole chain, to the end */
+    void push_back(Packet_ptr pkt) noexcept
+    {
+      assert(pkt != nullptr);
+      auto* last = pkt.get();
+      size_++;
+      while (last->chain_ != nullptr) {
+        last = last->chain_.get();
+        size_++;
+      }
+      if (head_ == nullptr)
+        head_ = std::move(pkt);
+      else
+        tail_->chain_ = std::move(pkt);
+      tail_ = last;
+    }
+
+    /** Take the chain, leaving this empty */
+    Packet_ptr release() noexcept
+    {
+      tail_ = nullptr;
+      size_ = 0;
+      return std::move(head_);
+    }
+
+    bool empty() const noexcept
+    { return head_ == nullptr; }
+
+    /** Number of packets in the chain */
+    int size() const noexcept
+    { return size_; }
+
+  private:
+    Packet_ptr head_ = nullptr;
+    Packet*    tail_ = nullptr;
+    int        size_ = 0;
+  };
+
   void Packet::chain(Packet_ptr pkt) noexcept
   {
     assert(pkt.get() != nullptr);
@@ -210,6 +364,87 @@ namespace net
     return count;
   }
 
+  void Packet::append_segment(Packet_ptr seg) noexcept
+  {
+    assert(seg.get() != nullptr);
+    auto* p = this;
+    while (p->segments_ != nullptr)
+      p = p->segments_.get();
+    p->segments_ = std::move(seg);
+  }
+
+  int Packet::total_size() const noexcept
+  {
+    int total = size();
+    for (auto* p = segments_.get(); p != nullptr; p = p->segments_.get())
+      total += p->size();
+    return total;
+  }
+
+  int Packet::segment_count() const noexcept
+  {
+    int count = 1;
+    for (auto* p = segments_.get(); p != nullptr; p = p->segments_.get())
+      count++;
+    return count;
+  }
+
+  Packet_ptr Packet::linearize(Packet_ptr pkt)
+  {
+    if (pkt->segments_ == nullptr) return pkt;
+    assert(pkt->chain_ == nullptr);
+
+    const int head  = pkt->headroom();
+    const int total = pkt->total_size();
+    auto* buffer = new uint8_t[sizeof(Packet) + head + total];
+    auto* raw    = new (buffer) Packet(head, 0, head + total, nullptr);
+    Packet_ptr res(raw);
+
+    // the lower layer headers stay where they were
+    std::memcpy(raw->buf(), pkt->buf(), head + pkt->size());
+    int len = pkt->size();
+    for (auto* seg = pkt->next_segment(); seg; seg = seg->next_segment()) {
+      std::memcpy(raw->layer_begin() + len, seg->layer_begin(), seg->size());
+      len += seg->size();
+    }
+    raw->set_data_end(len);
+    if (pkt->payload_off_)
+      raw->payload_off_ = raw->buf() + (pkt->payload_off_ - pkt->buf());
+    raw->vlan_id_ = pkt->vlan_id_;
+    raw->upper_proto_ = pkt->upper_proto_;
+    return res;
+  }
+
+  void Packet::release_chain(Packet_ptr head)
+  {
+    static const int BATCH = 32;
+    uint8_t*     batch[BATCH];
+    int          count = 0;
+    BufferStore* store = nullptr;
+
+    while (head != nullptr)
+    {
+      auto  tail = head->detach_tail();
+      auto* pkt  = head.release();
+      auto* bs   = pkt->bufstore_;
+      pkt->~Packet();
+
+      if (bs == nullptr) {
+        delete[] (uint8_t*) pkt;
+      }
+      else {
+        if (bs != store || count == BATCH) {
+          if (count) store->release(batch, count);
+          store = bs;
+          count = 0;
+        }
+        batch[count++] = (uint8_t*) pkt;
+      }
+      head = std::move(tail);
+    }
+    if (count) store->release(batch, count);
+  }
+
 } //< namespace net
 
 #endif
@@ -4,7 +4,11 @@
 #define NET_PORT_UTIL_HPP
 
 #include "inet_common.hpp"
+#include "socket.hpp"
 #include <util/fixed_bitmap.hpp>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace net {
 
@@ -17,6 +21,10 @@ struct Port_error : public std::runtime_error {
  * @brief      Class for handling a full range of network ports.
  *             Generates ephemeral ports and track what ports are bound or not.
  *             1 means free, 0 means bound (occupied)
+ *
+ *             A port can either be bound exclusively, or be shared by flows
+ *             to different remotes (one flow per remote), as a connection is
+ *             told apart by its whole tuple.
  */
 class Port_util {
 public:
@@ -24,18 +32,7 @@ public:
    * @brief      Construct a port util with a new generated ephemeral port
    *             and a empty port list.
    */
-  Port_util()
-    : ports(),
-      eph_view{ // set the ephemeral view to be between 49152-65535
-        ports.data() + port_ranges::DYNAMIC_START / 8,
-        size() / sizeof(MemBitmap::word)
-      },
-      ephemeral_(net::new_ephemeral_port()),
-      eph_count(0)
-  {
-    // all ports are free
-    ports.set_all();
-  }
+  Port_util();
 
   static constexpr int size() {
     return port_ranges::DYNAMIC_END + 1 - port_ranges::DYNAMIC_START;
@@ -53,6 +50,17 @@ public:
     return ephemeral_;
   }
 
+  /**
+   * @brief      Gets an ephemeral port for a flow to a remote, which may be
+   *             one already shared by flows to other remotes.
+   *             Throws if every ephemeral port is bound or used with the remote.
+   *
+   * @param[in]  remote  The remote
+   *
+   * @return     The ephemeral port.
+   */
+  uint16_t get_next_ephemeral(const Socket& remote);
+
   /**
    * @brief      Bind a port, making it reserved.
    *
@@ -77,6 +85,41 @@ public:
     if(port_ranges::is_dynamic(port)) --eph_count;
   }
 
+  /**
+   * @brief      Bind a port for a flow to a remote, sharing it with flows
+   *             to other remotes. The port must not be bound exclusively.
+   *
+   * @param[in]  port    The port
+   * @param[in]  remote  The remote
+   */
+  void bind(const uint16_t port, const Socket& remote);
+
+  /**
+   * @brief      Unbind a port from a flow to a remote, making it available
+   *             when no other flow shares it.
+   *
+   * @param[in]  port    The port
+   * @param[in]  remote  The remote
+   *
+   * @return     Whether the flow had the port bound
+   */
+  bool unbind(const uint16_t port, const Socket& remote);
+
+  /**
+   * @brief      Determines if the port is bound for a flow to the remote.
+   *
+   * @param[in]  port    The port
+   * @param[in]  remote  The remote
+   *
+   * @return     True if bound, False otherwise.
+   */
+  bool is_bound(const uint16_t port, const Socket& remote) const
+  { return flows_.count({port, remote}) > 0; }
+
+  /** Whether the port is shared by flows, rather than bound exclusively */
+  bool is_shared(const uint16_t port) const
+  { return shared_.count(port) > 0; }
+
   /**
    * @brief      Determines if the port is bound.
    *
@@ -97,14 +140,33 @@ public:
   bool has_free_ephemeral() const noexcept
   { return eph_count < size(); }
 
+  /** Largest random step between sequential ephemeral ports */
+  static constexpr int RANDOM_STEP = 500;
+
 private:
+  using Flow = std::pair<uint16_t, Socket>; // local port, remote
+  struct Flow_hash {
+    size_t operator()(const Flow& flow) const noexcept
+    { return std::hash<Socket>{}(flow.second) ^ flow.first; }
+  };
+
   Fixed_bitmap<65536> ports;
-  MemBitmap           eph_view;
   uint16_t            ephemeral_;
   uint16_t            eph_count;
 
+  // the ports shared by flows, and how many
+  std::unordered_map<uint16_t, uint32_t> shared_;
+  std::unordered_set<Flow, Flow_hash>    flows_;
+  // the per-remote offset key, and how far each bucket of remotes has come
+  std::array<uint64_t, 2>   key_;
+  std::array<uint16_t, 256> perturb_;
+
+  bool usable_for(const uint16_t port, const Socket& remote) const
+  { return ports[port] or (is_shared(port) and not is_bound(port, remote)); }
+
   /**
-   * @brief      Increment the ephemeral port by one.
+   * @brief      Move the ephemeral port a random step ahead, onto the next
+   *             free one (Random-increments, RFC 6056 3.3.5).
    *             Throws if there are no more free ephemeral ports available.
    */
   void increment_ephemeral()
@@ -112,24 +174,21 @@ private:
     if(UNLIKELY( not has_free_ephemeral() ))
       throw Port_error{"All ephemeral ports are taken"};
 
-    ephemeral_++;
+    const int from = (ephemeral_ - port_ranges::DYNAMIC_START + 1 + rng_fast_uint32() % RANDOM_STEP) % size();
+    // the dynamic ports run to the end of the bitmap
+    auto i = ports.next_set(port_ranges::DYNAMIC_START + from);
 
-    // wrap around to dynamic start if end
-    if(UNLIKELY(ephemeral_ == 0))
-      ephemeral_ = port_ranges::DYNAMIC_START;
+    // wrap around to dynamic start if none after
+    if(UNLIKELY(i == -1))
+      i = ports.next_set(port_ranges::DYNAMIC_START);
 
-    if(UNLIKELY( is_bound(ephemeral_) ))
-    {
-      auto i = eph_view.first_set();
-      Ensures(i != -1 && "Did not found a free ephemeral even tho has_free_ephemeral() == true...");
-      ephemeral_ = port_ranges::DYNAMIC_START + i;
-    }
+    Ensures(i != -1 && "Did not found a free ephemeral even tho has_free_ephemeral() == true...");
+    ephemeral_ = i;
 
     Expects(not is_bound(ephemeral_) && "Generated ephemeral port is already bound. Please fix me!");
   }
 }; // < class Port_util
-static_assert((port_ranges::DYNAMIC_START / 8) % sizeof(MemBitmap::word) == 0, "Must be word-sized multiple");
-static_assert(Port_util::size() % sizeof(MemBitmap::word) == 0, "Must be word-sized multiple");
+static_assert(Port_util::size() % MemBitmap::CHUNK_SIZE == 0, "Must be word-sized multiple");
 
 } // < namespace net
 
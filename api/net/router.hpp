@@ -3,6 +3,7 @@
 #define NET_ROUTER_HPP
 
 #include <net/inet.hpp>
+#include <net/lpm.hpp>
 #include <net/netfilter.hpp>
 #include <statman>
 
@@ -149,13 +150,10 @@ namespace net {
 
     /**
      * Get cheapest route for a certain IP
-     * @todo : Optimize!
      **/
     Route<IPV>* get_cheapest_route(typename IPV::addr dest) {
-      Routing_table all = get_all_routes(dest);
-      std::sort(all.begin(), all.end());
-      if (not all.empty()) return &all.front();
-      return nullptr;
+      const int idx = lpm_.cheapest_match(dest);
+      return (idx >= 0) ? &routing_table_[idx] : nullptr;
     };
 
 
@@ -163,22 +161,11 @@ namespace net {
     /**
      * Get most specific route for a certain IP
      * (e.g. the route with the largest netmask)
-     * @todo : Optimize!
      **/
     Route<IPV>* get_most_specific_route(typename IPV::addr dest)
     {
-      Route<IPV>* match = nullptr;
-      for (auto& route : routing_table_)
-        {
-          if (route.match(dest)) {
-            if (match) {
-              match = route.netmask() > match->netmask() ? &route : match;
-            } else {
-              match = &route;
-            }
-          }
-        }
-      return match;
+      const int idx = lpm_.longest_match(dest);
+      return (idx >= 0) ? &routing_table_[idx] : nullptr;
     }
 
 
@@ -192,12 +179,20 @@ namespace net {
       INFO("Router", "Router created with %lu routes", tbl.size());
       for(auto& route : routing_table_)
         INFO2("%s", route.to_string().c_str());
+      lpm_.build(routing_table_);
     }
 
+    /** Replace the routing table, and recompile the route lookup */
     void set_routing_table(Routing_table tbl) {
       routing_table_ = tbl;
+      lpm_.build(routing_table_);
+      generation_ = ++generations_;
     }
 
+    /** Changes with the routing table, invalidating routes cached in conntrack */
+    uint32_t generation() const noexcept
+    { return generation_; }
+
     /** Whether to send ICMP Time Exceeded when TTL is zero */
     bool send_time_exceeded = true;
 
@@ -205,7 +200,41 @@ namespace net {
     Filter_chain<IPV> forward_chain{"Forward", {}};
 
   private:
+    using Route_cache = Conntrack::Entry::Route_cache;
+
+    /** The route cached for @dest in an established connection, if still valid */
+    Route_cache* cached_route(Conntrack::Entry_ptr ct, Addr dest) const noexcept
+    {
+      if (ct == nullptr or ct->state != Conntrack::State::ESTABLISHED)
+        return nullptr;
+      for (auto& cached : ct->route_cache)
+        if (cached.route_gen == generation_ and cached.dst == dest)
+          return &cached;
+      return nullptr;
+    }
+
+    /** Cache a route in an established connection, replacing a stale entry */
+    Route_cache* cache_route(Conntrack::Entry_ptr ct, Addr dest,
+                             Route<IPV>& route, Addr nexthop) const noexcept
+    {
+      if (ct == nullptr or ct->state != Conntrack::State::ESTABLISHED)
+        return nullptr;
+      auto* cached = &ct->route_cache[0];
+      if (cached->route_gen == generation_ and cached->dst != dest)
+        cached = &ct->route_cache[1];
+      *cached = {dest, nexthop, &route, generation_, 0, {}};
+      return cached;
+    }
+
+    /** Ship along a cached route, skipping the link-layer resolution if possible */
+    inline void ship(Route_cache&, Packet_ptr, Conntrack::Entry_ptr ct);
+
     Routing_table routing_table_;
+    // compiled lookup, indices into routing_table_
+    Lpm<Addr> lpm_;
+    // unique across routers, as a connection may pass through several
+    static inline uint32_t generations_ = 0;
+    uint32_t generation_ = ++generations_;
     uint64_t& packets_fwd;
     uint64_t& packets_dropped;
     uint64_t& bytes_fwd;
@@ -251,6 +280,32 @@ namespace net {
       return nexthop_;
   }
 
+  template <>
+  inline void Router<IP4>::ship(Route_cache& cached, Packet_ptr pckt, Conntrack::Entry_ptr ct)
+  {
+    auto& route = *static_cast<Route<IP4>*>(cached.route);
+    auto& arp   = route.interface()->arp();
+    const auto nexthop = cached.nexthop.v4();
+
+    if (cached.link_gen == arp.generation()) {
+      route.interface()->ip_obj().ship(std::move(pckt), nexthop, ct, &cached.link_dst);
+      return;
+    }
+
+    route.ship(std::move(pckt), nexthop, ct);
+    // remember the link destination once ARP has resolved it
+    if (arp.lookup(nexthop, cached.link_dst))
+      cached.link_gen = arp.generation();
+  }
+
+  template <>
+  inline void Router<IP6>::ship(Route_cache& cached, Packet_ptr pckt, Conntrack::Entry_ptr ct)
+  {
+    // NDP keeps its own neighbour cache, only the route is cached
+    auto& route = *static_cast<Route<IP6>*>(cached.route);
+    route.ship(std::move(pckt), cached.nexthop.v6(), ct);
+  }
+
   template <>
   inline void Router<IP4>::forward(Packet_ptr pckt, Stack& stack, Conntrack::Entry_ptr ct)
   {
@@ -284,14 +339,26 @@ namespace net {
     Ensures(res.packet != nullptr);
     pckt = res.release();
 
-    // Look for a route
+    // Established connections remember their route
     const auto dest = pckt->ip_dst();
+    if (auto* cached = cached_route(ct, dest)) {
+      bytes_fwd += pckt->ip_data_length();
+      ship(*cached, std::move(pckt), ct);
+      packets_fwd++;
+      return;
+    }
+
+    // Look for a route
     auto* route = get_most_specific_route(dest);
 
     if(route) {
       PRINT("Found route: %s", route->to_string().c_str());
       bytes_fwd += pckt->ip_data_length();
-      route->ship(std::move(pckt), ct);
+      auto* cached = cache_route(ct, dest, *route, route->nexthop(dest));
+      if (cached)
+        ship(*cached, std::move(pckt), ct);
+      else
+        route->ship(std::move(pckt), ct);
       packets_fwd++;
       return;
     }
@@ -330,13 +397,23 @@ namespace net {
     Ensures(res.packet != nullptr);
     pckt = res.release();
 
-    // Look for a route
+    // Established connections remember their route
     const auto dest = pckt->ip_dst();
+    if (auto* cached = cached_route(ct, dest)) {
+      ship(*cached, std::move(pckt), ct);
+      return;
+    }
+
+    // Look for a route
     auto* route = get_most_specific_route(dest);
 
     if(route) {
       PRINT("Found route: %s", route->to_string().c_str());
-      route->ship(std::move(pckt), ct);
+      auto* cached = cache_route(ct, dest, *route, route->nexthop(dest));
+      if (cached)
+        ship(*cached, std::move(pckt), ct);
+      else
+        route->ship(std::move(pckt), ct);
       return;
     }
     else {
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef NET_RPS_HPP
+#define NET_RPS_HPP
+
+#include <net/packet.hpp>
+#include <util/lockfree_ring.hpp>
+#include <delegate>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class Stat_percpu;
+
+namespace net {
+
+/**
+ * Receive packet steering: RSS in software, for NICs that deliver every
+ * packet to the CPU taking their one interrupt.
+ *
+ * TCP frames are hashed like TCP hashes them for its shards (the Toeplitz
+ * hash of addresses and ports, with the default key) and handed to the
+ * CPU of their hash bucket through a lock-free ring of that CPU. A CPU
+ * is told about new packets in its ring once, however many arrive before
+ * it gets to them, with Events::post, which only sends an IPI to wake it
+ * when it's halted. Everything else, fragments and VLAN frames included,
+ * is handled where it arrived.
+ *
+ * Like a NIC with more queue pairs, this is for stacks whose TCP is
+ * sharded (TCP::listen_sharded), with a shard on every CPU of the table.
+ */
+class RPS {
+public:
+  using deliver_func = delegate<void(Packet_ptr)>;
+
+  /** Packets waiting for a CPU, beyond which they are dropped */
+  static constexpr size_t RING_SIZE = 512;
+  /** Packets handed up at once, as a chain */
+  static constexpr int    BURST = 32;
+
+  /**
+   * @param name     Prefix of the stats, the interface name
+   * @param deliver  The link layer, called on the CPU of each packet
+   * @param cpus     The CPU of each hash bucket
+   */
+  RPS(const std::string& name, deliver_func deliver, std::vector<int> cpus);
+  ~RPS();
+
+  /** Steer a chain of received frames, on the CPU receiving them */
+  void receive(Packet_ptr chain);
+
+  /** Change the CPU of each hash bucket, empty to handle every frame here.
+      Call it on the CPU receiving the frames. */
+  void set_cpus(std::vector<int> cpus);
+
+  const std::vector<int>& cpus() const noexcept
+  { return cpus_; }
+
+  /** This CPU first, then the other active ones */
+  static std::vector<int> default_cpus();
+
+  /**
+   * The hash of the flow of an Ethernet frame, as TCP steers its shards,
+   * or nothing if the frame is not steered (not TCP, a fragment, or tagged).
+   */
+  static std::optional<uint32_t> flow_hash(const uint8_t* frame, size_t len) noexcept;
+
+private:
+  struct Target {
+    util::MPSC_ring<Packet*, RING_SIZE> ring;
+    // set while a drain is posted to the CPU
+    std::atomic<bool> scheduled {false};
+  };
+
+  Target& target(int cpu);
+  void wake(int cpu);
+  void drain(int cpu);
+
+  deliver_func deliver_;
+  std::vector<int> cpus_;
+  // by CPU, only ever added to, as drains may be posted to them
+  std::vector<std::unique_ptr<Target>> targets_;
+  Stat_percpu& steered_;
+  uint32_t&    dropped_;
+};
+
+} // < namespace net
+
+#endif // < NET_RPS_HPP
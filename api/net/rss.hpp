@@ -0,0 +1,96 @@
+#pragma once
+#ifndef NET_RSS_HPP
+#define NET_RSS_HPP
+
+#include <net/socket.hpp>
+#include <array>
+#include <cstring>
+
+namespace net {
+namespace rss {
+
+/** The well-known default Toeplitz key, used by most NICs */
+inline constexpr std::array<uint8_t, 40> default_key {
+  0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+  0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+  0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+  0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+  0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+/**
+ * @brief      The Toeplitz hash of receive-side scaling
+ *
+ * @param[in]  key      The key, at least 4 bytes longer than the input
+ *                      for all of the input to be hashed
+ * @param[in]  key_len  The key length
+ * @param[in]  data     The input
+ * @param[in]  len      The input length
+ *
+ * @return     The hash
+ */
+inline uint32_t toeplitz(const uint8_t* key, size_t key_len,
+                         const uint8_t* data, size_t len) noexcept
+{
+  if (key_len < 4)
+    return 0;
+  // the 32 bits of the key lined up with the current input bit
+  uint32_t window = (key[0] << 24) | (key[1] << 16) | (key[2] << 8) | key[3];
+  uint32_t hash = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    const uint8_t next = (i + 4 < key_len) ? key[i + 4] : 0;
+    for (int b = 7; b >= 0; b--)
+    {
+      if (data[i] & (1 << b))
+        hash ^= window;
+      window = (window << 1) | ((next >> b) & 1);
+    }
+  }
+  return hash;
+}
+
+/**
+ * @brief      The hash a NIC computes for a received packet:
+ *             source and destination address, then source and destination port.
+ *
+ * @param[in]  src    The source of the packet
+ * @param[in]  dst    The destination of the packet
+ * @param[in]  key    The key
+ * @param[in]  key_len  The key length
+ * @param[in]  ports  Whether to hash the ports, or only the addresses
+ *
+ * @return     The hash
+ */
+inline uint32_t hash(const Socket& src, const Socket& dst,
+                     const uint8_t* key, size_t key_len, bool ports = true) noexcept
+{
+  uint8_t in[36];
+  size_t  n = 0;
+  for (const auto* sock : {&src, &dst})
+  {
+    const auto& addr = sock->address();
+    if (addr.is_v4()) {
+      const auto ip4 = addr.v4();
+      std::memcpy(&in[n], &ip4.whole, 4);
+      n += 4;
+    }
+    else {
+      std::memcpy(&in[n], addr.v6().i64.data(), 16);
+      n += 16;
+    }
+  }
+  if (ports)
+  {
+    for (const auto port : {src.port(), dst.port()}) {
+      in[n++] = port >> 8;
+      in[n++] = port & 0xff;
+    }
+  }
+  return toeplitz(key, key_len, in, n);
+}
+
+} // < namespace rss
+} // < namespace net
+
+#endif // < NET_RSS_HPP
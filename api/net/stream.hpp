@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <cstddef>
 #include <delegate>
+#include <initializer_list>
 #include <memory>
 #include <pmr>
 #include <vector>
@@ -56,6 +57,28 @@ namespace net {
      */
     virtual void on_data(DataCallback cb) = 0;
 
+    /** Called with all the buffers received so far, in order. */
+    using ReadvCallback = delegate<void(const buffer_t* buffers, size_t count)>;
+    /**
+     * @brief      Event when data is received. Pushes every buffer available
+     *             at once, so a stream on top can take them over as they are
+     *             (and pass them on with writev) without copying.
+     *             Replaces the on_data callback.
+     *
+     * @param[in]  cb    The callback
+     */
+    virtual void on_readv(ReadvCallback cb)
+    {
+      on_data(DataCallback::make_packed(
+        [this, cb] ()
+        {
+          std::vector<buffer_t> chain;
+          while (this->next_size() > 0)
+            chain.push_back(this->read_next());
+          if (not chain.empty()) cb(chain.data(), chain.size());
+        }));
+    }
+
     /**
      * @return The size of the next available chunk of data if any.
      */
@@ -107,6 +130,60 @@ namespace net {
      */
     virtual void write(const std::string& str) = 0;
 
+    /**
+     * @brief      Async write of several shared buffers, in order.
+     *             The buffers are not copied unless the stream has to
+     *             transform them, and streams that frame or encrypt their
+     *             data put them in as few frames or records as they fit in.
+     *             By default each is written on its own.
+     *
+     * @param[in]  buffers  The shared buffers
+     * @param[in]  count    The number of buffers
+     */
+    virtual void writev(const buffer_t* buffers, size_t count)
+    {
+      for (size_t i = 0; i < count; i++)
+        write(buffers[i]);
+    }
+    void writev(std::initializer_list<buffer_t> buffers)
+    { writev(buffers.begin(), buffers.size()); }
+
+    /**
+     * @brief      Async write of data the stream takes over, rather than
+     *             copying it like write(const void*, size_t) does.
+     *
+     * @param[in]  data  The data, moved into a shared buffer
+     */
+    void write_owned(os::mem::buffer&& data)
+    { write(construct_buffer(std::move(data))); }
+
+    /** Called when a write blocked stream has drained. */
+    using DrainCallback = delegate<void()>;
+
+    /**
+     * @brief      Bound what is queued for writing: at @high bytes the
+     *             stream is write blocked, until it has drained to @low.
+     *             Writes are never refused, so writers should wait for
+     *             on_drain. Streams that can't tell are never blocked.
+     *
+     * @param[in]  high  The high watermark, 0 for no bound
+     * @param[in]  low   The low watermark
+     */
+    virtual void set_write_watermarks(size_t high, size_t low)
+    { (void) high; (void) low; }
+
+    /** Whether writers should wait for on_drain before writing more */
+    virtual bool write_blocked() const noexcept
+    { return false; }
+
+    /**
+     * @brief      Event for when a write blocked stream has drained.
+     *
+     * @param[in]  cb    The drain callback
+     */
+    virtual void on_drain(DrainCallback cb)
+    { (void) cb; }
+
     /**
      * @brief      Closes the stream.
      */
@@ -25,21 +25,40 @@ namespace net {
     // use of SACK
     static constexpr bool     default_sack {true};
     static constexpr size_t   default_sack_entries{32};
+    // use of RACK-TLP loss detection when SACK is permitted
+    static constexpr bool     default_rack {true};
+    // coalesce in-order segments arriving in the same burst
+    static constexpr bool     default_gro {true};
+    // pacing of NewReno connections, CUBIC and BBR are paced by default
+    static constexpr bool     default_pacing {false};
     // maximum size of a TCP segment - later set based on MTU or peer
     static constexpr uint16_t default_mss     {536};
     static constexpr uint16_t default_mss_v6  {1220};
     // the maximum amount of half-open connections per port (listener)
     static constexpr size_t   default_max_syn_backlog {64};
+    // answer SYNs with cookies when the SYN queue is full
+    static constexpr bool     default_syn_cookies {true};
+    // accept data on SYNs with a Fast Open cookie [RFC 7413]
+    static constexpr bool     default_fast_open {false};
+    // connections and their companions from per instance pools
+    static constexpr bool     default_connection_pooling {true};
+    // grow the receive window from the data received per RTT
+    static constexpr bool     default_rcv_autotune {true};
+    // keep only a tombstone of connections in TIME-WAIT
+    static constexpr bool     default_time_wait_compaction {true};
     // clock granularity of the timestamp value clock
     static constexpr float   clock_granularity {0.0001};
 
     static const std::chrono::seconds       default_msl {30};
     static const std::chrono::milliseconds  default_dack_timeout {40};
+    // release the buffers of connections idle this long
+    static const std::chrono::seconds       default_idle_release {30};
 
     using namespace util::literals;
     static constexpr size_t default_min_bufsize   {4_KiB};
     static constexpr size_t default_max_bufsize   {256_KiB};
     static constexpr size_t default_total_bufsize {64_MiB};
+    static constexpr size_t default_max_rcv_window{8_MiB};
 
     using Address = net::Addr;
 
@@ -97,11 +116,36 @@ namespace net {
           + (Proto_TCP << 8)
           + htons(length);
 
-      // Compute sum of header and data
+      // Compute sum of header and data, unless the data was summed already
       const char* buffer = (char*) &packet.tcp_header();
+      if (packet.has_data_sum())
+        return net::checksum(sum + packet.data_sum(), buffer, packet.tcp_header_length());
       return net::checksum(sum, buffer, length);
     }
 
+    /**
+     * Pseudo-header sum of an IPv4 TCP packet, folded but not complemented.
+     * This is what the checksum field must hold when a NIC finishes it.
+     */
+    template <typename View4>
+    uint16_t pseudo_checksum4(const View4& packet)
+    {
+      constexpr uint8_t Proto_TCP = 6; // avoid including inet_common
+      const auto ip_src = packet.ip4_src();
+      const auto ip_dst = packet.ip4_dst();
+      uint32_t sum =
+            (ip_src.whole >> 16)
+          + (ip_src.whole & 0xffff)
+          + (ip_dst.whole >> 16)
+          + (ip_dst.whole & 0xffff)
+          + (Proto_TCP << 8)
+          + htons(packet.tcp_length());
+
+      while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+      return sum;
+    }
+
     template <typename View6>
     uint16_t calculate_checksum6(const View6& packet)
     {
@@ -125,8 +169,10 @@ namespace net {
 
       sum += (Proto_TCP << 8) + htons(length);
 
-      // Compute sum of header and data
+      // Compute sum of header and data, unless the data was summed already
       const char* buffer = (char*) &packet.tcp_header();
+      if (packet.has_data_sum())
+        return net::checksum(sum + packet.data_sum(), buffer, packet.tcp_header_length());
       return net::checksum(sum, buffer, length);
     }
 
@@ -0,0 +1,230 @@
+#pragma once
+#ifndef NET_TCP_CONGESTION_HPP
+#define NET_TCP_CONGESTION_HPP
+
+#include "common.hpp"
+#include <array>
+#include <memory>
+
+namespace net {
+namespace tcp {
+
+/**
+ * The congestion window of a connection as seen by its controller.
+ * cwnd and ssthresh live in the connection's TCB, the rest is a snapshot
+ * taken for each event.
+ */
+struct Congestion_window {
+  uint32_t& cwnd;
+  uint32_t& ssthresh;
+  uint32_t  flight_size; // bytes in flight, not counting limited transmit [RFC 3042]
+  uint32_t  snd_wnd;     // the peer's receive window
+  uint16_t  smss;
+  uint64_t  srtt_us;     // smoothed RTT
+  uint64_t  now_us;      // monotonic clock
+
+  bool slow_start() const noexcept
+  { return cwnd < ssthresh; }
+};
+
+/**
+ * Congestion control algorithm of one connection [RFC 5681].
+ * Loss detection and recovery (fast retransmit, NewReno partial ACKs,
+ * retransmission timeouts) are done by the connection, which tells its
+ * controller about each event and leaves the window to it.
+ */
+class Congestion_control {
+public:
+  enum class Algorithm : uint8_t {
+    NEW_RENO, // [RFC 5681, RFC 6582]
+    CUBIC,    // [RFC 9438]
+    BBR       // draft-cardwell-iccrg-bbr-congestion-control
+  };
+
+  static std::unique_ptr<Congestion_control> create(Algorithm);
+
+  virtual Algorithm   algorithm() const noexcept = 0;
+  virtual const char* name() const noexcept = 0;
+
+  /** Set the initial window */
+  virtual void init(Congestion_window&) = 0;
+
+  /** A segment ending at @end was sent */
+  virtual void on_send(Congestion_window&, seq_t /*end*/) {}
+
+  /** New data acknowledged outside of fast recovery */
+  virtual void on_ack(Congestion_window&, seq_t ack, uint32_t bytes_acked) = 0;
+
+  /** Third duplicate ACK, entering fast recovery */
+  virtual void on_enter_recovery(Congestion_window&) = 0;
+
+  /** Further duplicate ACKs during fast recovery */
+  virtual void on_recovery_dup_ack(Congestion_window&) = 0;
+
+  /** ACK of some, but not all, of the data outstanding at the loss */
+  virtual void on_partial_ack(Congestion_window&, seq_t ack, uint32_t bytes_acked) = 0;
+
+  /** Full ACK, leaving fast recovery */
+  virtual void on_exit_recovery(Congestion_window&) = 0;
+
+  /**
+   * Retransmission timeout. @first is set when the segment had not been
+   * retransmitted by timeout before.
+   */
+  virtual void on_timeout(Congestion_window&, bool first) = 0;
+
+  /**
+   * Rate in bytes per second to pace transmissions at, 0 when not known yet.
+   * The window over the RTT, with some headroom so pacing doesn't hold back
+   * the window's growth: twice that in slow start, 1.2 times after.
+   */
+  virtual uint64_t pacing_rate(const Congestion_window& w) const noexcept
+  {
+    if (w.srtt_us == 0)
+      return 0;
+    const uint64_t gain = w.slow_start() ? 200 : 120; // percent
+    return uint64_t(w.cwnd) * gain * 10'000 / w.srtt_us;
+  }
+
+  virtual ~Congestion_control() = default;
+};
+
+const char* to_string(Congestion_control::Algorithm);
+
+/** NewReno [RFC 5681, RFC 6582], the default */
+class New_reno : public Congestion_control {
+public:
+  /** ssthresh after a loss: max(FlightSize / 2, 2*SMSS) */
+  static uint32_t loss_ssthresh(const Congestion_window& w) noexcept
+  { return std::max(w.flight_size / 2, 2u * w.smss); }
+
+  Algorithm algorithm() const noexcept override
+  { return Algorithm::NEW_RENO; }
+
+  const char* name() const noexcept override
+  { return "newreno"; }
+
+  void init(Congestion_window&) override;
+  void on_ack(Congestion_window&, seq_t ack, uint32_t bytes_acked) override;
+  void on_enter_recovery(Congestion_window&) override;
+  void on_recovery_dup_ack(Congestion_window&) override;
+  void on_partial_ack(Congestion_window&, seq_t ack, uint32_t bytes_acked) override;
+  void on_exit_recovery(Congestion_window&) override;
+  void on_timeout(Congestion_window&, bool first) override;
+
+protected:
+  // window after a retransmission timeout, in segments
+  static constexpr uint32_t loss_window = 3;
+};
+
+/**
+ * CUBIC [RFC 9438]. Grows the window as a cubic function of the time since
+ * the last congestion event, independent of the RTT, which lets it fill
+ * long, fat links that Reno would take minutes to grow into. Recovery
+ * itself is NewReno's.
+ */
+class Cubic : public New_reno {
+public:
+  static constexpr double C    = 0.4;
+  static constexpr double beta = 0.7;
+
+  Algorithm algorithm() const noexcept override
+  { return Algorithm::CUBIC; }
+
+  const char* name() const noexcept override
+  { return "cubic"; }
+
+  void on_ack(Congestion_window&, seq_t ack, uint32_t bytes_acked) override;
+  void on_enter_recovery(Congestion_window&) override;
+  void on_timeout(Congestion_window&, bool first) override;
+
+private:
+  void reduce(Congestion_window&);
+
+  double   w_max_     = 0; // window before the last reduction, in segments
+  double   w_est_     = 0; // Reno friendly estimate, in segments
+  double   k_         = 0; // seconds to grow back to w_max
+  double   origin_    = 0;
+  double   bytes_     = 0; // growth not yet added to cwnd
+  uint64_t epoch_us_  = 0; // start of the current growth period, 0 when none
+};
+
+/**
+ * BBR. Models the path as its bottleneck bandwidth (the max delivery rate
+ * over the last 10 rounds) and its propagation delay (the min RTT over
+ * the last 10 seconds), and keeps about two bandwidth-delay products in
+ * flight instead of reacting to loss. Delivery rate and RTT are sampled
+ * once per round trip, by timing one segment at a time.
+ */
+class Bbr : public Congestion_control {
+public:
+  enum class Mode : uint8_t { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+
+  static constexpr double   high_gain      = 2.885; // 2/ln(2)
+  static constexpr double   cwnd_gain      = 2.0;
+  static constexpr int      bw_rounds      = 10;
+  static constexpr uint64_t min_rtt_window = 10'000'000; // us
+  static constexpr uint64_t probe_rtt_time = 200'000;    // us
+  static constexpr uint32_t min_segments   = 4;
+
+  Algorithm algorithm() const noexcept override
+  { return Algorithm::BBR; }
+
+  const char* name() const noexcept override
+  { return "bbr"; }
+
+  void init(Congestion_window&) override;
+  void on_send(Congestion_window&, seq_t end) override;
+  void on_ack(Congestion_window&, seq_t ack, uint32_t bytes_acked) override;
+  void on_enter_recovery(Congestion_window&) override;
+  void on_recovery_dup_ack(Congestion_window&) override {}
+  void on_partial_ack(Congestion_window&, seq_t ack, uint32_t bytes_acked) override;
+  void on_exit_recovery(Congestion_window&) override;
+  void on_timeout(Congestion_window&, bool first) override;
+  uint64_t pacing_rate(const Congestion_window&) const noexcept override;
+
+  Mode mode() const noexcept
+  { return mode_; }
+
+  /** Bottleneck bandwidth estimate in bytes per second, 0 until sampled */
+  uint64_t bottleneck_bw() const noexcept;
+
+  /** Min RTT estimate in microseconds, 0 until sampled */
+  uint64_t min_rtt() const noexcept
+  { return min_rtt_us_; }
+
+private:
+  bool sample(Congestion_window&, seq_t ack);
+  void update_mode(Congestion_window&, bool new_round);
+  void set_cwnd(Congestion_window&, uint32_t bytes_acked);
+  uint64_t bdp() const noexcept;
+  double pacing_gain() const noexcept;
+
+  Mode     mode_ = Mode::STARTUP;
+  // delivery accounting
+  uint64_t delivered_      = 0;
+  bool     probing_        = false; // a segment is being timed
+  seq_t    probe_end_      = 0;
+  uint64_t probe_sent_us_  = 0;
+  uint64_t probe_delivered_ = 0;
+  // model
+  std::array<uint64_t, bw_rounds> bw_ {}; // max delivery rate per round
+  uint32_t round_          = 0;
+  uint64_t min_rtt_us_     = 0;
+  uint64_t min_rtt_stamp_  = 0;
+  // startup
+  uint64_t full_bw_        = 0;
+  int      full_bw_rounds_ = 0;
+  bool     filled_pipe_    = false;
+  // probe bw gain cycle and probe rtt
+  int      cycle_          = 0;
+  uint64_t cycle_stamp_    = 0;
+  uint64_t probe_rtt_done_ = 0;
+  uint32_t prior_cwnd_     = 0;
+  bool     in_recovery_    = false;
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_CONGESTION_HPP
@@ -4,16 +4,22 @@
 #define NET_TCP_CONNECTION_HPP
 
 #include "common.hpp"
+#include "congestion.hpp"
+#include "fast_open.hpp"
 #include "packet_view.hpp"
+#include "rack.hpp"
 #include "read_request.hpp"
 #include "rttm.hpp"
 #include "tcp_errors.hpp"
 #include "write_queue.hpp"
 #include "sack.hpp"
+#include "slab_pool.hpp"
 
 #include <net/socket.hpp>
 #include <delegate>
 #include <util/timer.hpp>
+#include "timer_wheel.hpp"
+#include "tx_scheduler.hpp"
 
 #include <util/alloc_pmr.hpp>
 
@@ -88,11 +94,17 @@ public:
    *             there is capacity in the read queue.
    *             If an on_read callback is also registered, this event has no effect.
    *
+   *             With zero_copy, the data is left in the packets it arrived in and
+   *             the event is triggered whenever in-order data arrives.
+   *             The user fetches it with read_slices, and the packets go back to
+   *             the BufferStore once their slices are dropped.
+   *
    * @param[in]  callback    The callback
+   * @param[in]  zero_copy   Whether to leave the data in its packets
    *
    * @return     This connection
    */
-  inline Connection&            on_data(DataCallback callback);
+  inline Connection&            on_data(DataCallback callback, bool zero_copy = false);
 
   /**
    * @brief      Read the next fully acked chunk of received data if any.
@@ -106,6 +118,14 @@ public:
    */
   inline size_t   next_size();
 
+  /**
+   * @brief      Take the received data ready to be read, when reading with zero_copy.
+   *             With zero_copy, read_next gathers the same data into one buffer.
+   *
+   * @return     The data, in order, in the packets it arrived in
+   */
+  Slice_chain read_slices();
+
   /** Called with the connection itself and the reason wrapped in a Disconnect struct. */
   using DisconnectCallback      = delegate<void(Connection_ptr self, Disconnect)>;
   /**
@@ -151,6 +171,17 @@ public:
    */
   inline Connection&            on_write(WriteCallback callback);
 
+  using DrainCallback           = Write_queue::DrainCallback;
+  /**
+   * @brief      Event when a send queue that was full (see set_write_watermarks)
+   *             has been acknowledged down to its low watermark.
+   *
+   * @param[in]  callback  The callback
+   *
+   * @return     This connection
+   */
+  inline Connection&            on_drain(DrainCallback callback);
+
   /** Called with the packet that got dropped and the reason why. */
   using PacketDroppedCallback   = delegate<void(const Packet&, Drop_reason)>;
 
@@ -170,9 +201,23 @@ public:
    *             Avoids any copy of the data into the internal buffer.
    *
    * @param[in]  buffer  shared buffer
-   * @param[in]  n       length
+   * @param[in]  more    more data follows, so a partial segment is held
+   *                     back for it (as MSG_MORE), see cork()
    */
-  void write(buffer_t buffer);
+  void write(buffer_t buffer, bool more = false);
+
+  /**
+   * @brief      Async write of memory that is not copied, such as a file
+   *             on a memdisk. It must stay valid until acknowledged, which
+   *             holding on to @owner takes care of (none for static memory).
+   *
+   * @param[in]  buf    data
+   * @param[in]  n      length
+   * @param[in]  owner  kept until the data is acknowledged
+   * @param[in]  more   more data follows, see above
+   */
+  void write(const void* buf, size_t n, std::shared_ptr<const void> owner,
+             bool more = false);
 
   /**
    * @brief      Async write of a data with a length.
@@ -180,16 +225,40 @@ public:
    *
    * @param[in]  buf   data
    * @param[in]  n     length
+   * @param[in]  more  more data follows, see above
    */
-  inline void write(const void* buf, size_t n);
+  inline void write(const void* buf, size_t n, bool more = false);
 
   /**
    * @brief      Async write of a string.
    *             Calls write(const void* buf, size_t n)
    *
    * @param[in]  str   The string
+   * @param[in]  more  more data follows, see above
    */
-  inline void write(const std::string& str);
+  inline void write(const std::string& str, bool more = false);
+
+  /**
+   * @brief      Cork the connection (as TCP_CORK): written data is only sent
+   *             in full segments, until uncork(), or until it has been held
+   *             for CORK_TIMEOUT. Lets a header and a body written apart
+   *             share a segment. There is no Nagle, so uncorked writes are
+   *             sent right away.
+   */
+  void cork() noexcept
+  { corked_ = true; }
+
+  /** Uncork the connection, sending what has been held back */
+  void uncork();
+
+  /** Send what has been held back now, leaving the connection corked if it is */
+  void push();
+
+  bool is_corked() const noexcept
+  { return corked_; }
+
+  /** The longest a partial segment is held back for more data */
+  static constexpr std::chrono::milliseconds CORK_TIMEOUT {200};
 
   /**
    * @brief      Async close of the connection, sending FIN.
@@ -299,14 +368,107 @@ public:
   uint32_t sendq_remaining() const noexcept
   { return writeq.bytes_remaining(); }
 
+  /**
+   * @brief Bound the send queue: at @high bytes it is full, and writers
+   *        should wait for on_drain, called when it is down to @low.
+   *        Writes are never refused. 0 for no bound (the default)
+   */
+  void set_write_watermarks(uint32_t high, uint32_t low) noexcept
+  { writeq.set_watermarks(high, low); }
+
+  /**
+   * @brief Whether the send queue is full, see set_write_watermarks
+   */
+  bool write_blocked() const noexcept
+  { return writeq.full(); }
+
+  /// --- Congestion control --- ///
+
+  /**
+   * @brief      Replace the congestion control algorithm. Best done before
+   *             the connection opens, the current window carries over.
+   *
+   * @param[in]  algo  The algorithm
+   */
+  void set_congestion_control(Congestion_control::Algorithm algo);
+
+  const Congestion_control& congestion_control() const noexcept
+  { return *cc_; }
+
+  /**
+   * @brief      Congestion window [RFC 5681]
+   *
+   * @return     Bytes allowed in flight by congestion control
+   */
+  uint32_t cwnd() const noexcept
+  { return cb.cwnd; }
+
+  /**
+   * @brief      Slow start threshold [RFC 5681]
+   *
+   * @return     The slow start threshold in bytes
+   */
+  uint32_t ssthresh() const noexcept
+  { return cb.ssthresh; }
+
+  /**
+   * @brief      CPU cycles spent on this connection, on the segments
+   *             arriving and the data sent, with the callbacks they made.
+   *             Only counted while the CycleProfiler is enabled.
+   *
+   * @return     The cycles
+   */
+  uint64_t cycles() const noexcept
+  { return cycles_; }
+
+  /** Count @cycles spent on this connection, also by port and peer */
+  void add_cycles(uint64_t cycles) noexcept;
+
+  /**
+   * @brief      Rate the congestion control wants transmissions paced at
+   *
+   * @return     Bytes per second, 0 when not paced
+   */
+  uint64_t pacing_rate() const noexcept;
+
+  /**
+   * @brief      Sets if new data is sent at the pacing rate, instead of as
+   *             fast as the window allows. On by default with CUBIC and BBR,
+   *             and with NewReno when TCP::set_pacing() is on.
+   *
+   * @param[in]  active  Whether transmissions are paced
+   */
+  void set_pacing(bool active) noexcept;
+
+  bool uses_pacing() const noexcept
+  { return pacing_; }
+
+  /**
+   * @brief      Sets the priority class of the connection when waiting for
+   *             the NIC to have room. Interactive connections are served
+   *             before normal ones, and bulk ones after. Takes effect the
+   *             next time the connection is queued.
+   *
+   * @param[in]  prio  The priority class (default NORMAL)
+   */
+  void set_tx_priority(Tx_priority prio) noexcept
+  { tx_priority_ = prio; }
+
+  Tx_priority tx_priority() const noexcept
+  { return tx_priority_; }
+
   /**
    * @brief      Determines ability to send.
-   *             Is the usable window large enough, and is there data to send.
+   *             Is the usable window large enough, is there data to send,
+   *             and isn't pacing, or a cork, holding it back.
    *
    * @return     True if able to send, False otherwise.
    */
   bool can_send() const noexcept
-  { return (usable_window() >= SMSS()) and writeq.has_remaining_requests(); }
+  {
+    return (usable_window() >= SMSS()) and writeq.has_remaining_requests() and not pace_hold_
+      and not (cork_hold_ and writeq.bytes_remaining() < SMSS());
+  }
 
   /**
    * @brief      Return the "tuple" (id) of the connection.
@@ -608,6 +770,7 @@ public:
   // ???
   void deserialize_from(void*);
   int  serialize_to(void*) const;
+  int  serialized_size() const noexcept;
   static const int VERSION = 2;
 
   /**
@@ -643,7 +806,9 @@ private:
   TCB cb;
 
   /** The given read request */
-  std::unique_ptr<Read_request> read_request;
+  Slab_ptr<Read_request> read_request;
+  /** Packet of the segment being handled, once zero-copy data is kept from it */
+  Packet_slice::Packet_ref rx_packet_;
   os::mem::Pmr_pool::Resource_ptr bufalloc{nullptr};
 
   /** Queue for write requests to process */
@@ -658,10 +823,30 @@ private:
   CloseCallback           on_close_;
 
   /** Retransmission timer */
-  Timer rtx_timer;
+  Wheel_timer rtx_timer;
 
   /** Time Wait / DACK timeout timer */
-  Timer timewait_dack_timer;
+  Wheel_timer timewait_dack_timer;
+
+  /** RACK reordering timer and tail loss probe timer */
+  Wheel_timer rack_timer;
+  Wheel_timer tlp_timer;
+
+  /** Pacing - earliest time the next segment is due, and waiting for it */
+  Wheel_timer pacing_timer;
+  uint64_t    next_send_us_ = 0;
+  bool        pacing_       = false;
+  bool        pace_hold_    = false;
+
+  /** Cork - holding back partial segments, since the first was held */
+  Wheel_timer cork_timer;
+  bool        corked_       = false;
+  bool        cork_hold_    = false;
+
+  /** Idle release - where the sequence numbers were when the period began */
+  Wheel_timer idle_timer;
+  seq_t       idle_rcv_ = 0;
+  seq_t       idle_snd_ = 0;
 
   Recv_window_getter recv_wnd_getter;
 
@@ -676,16 +861,41 @@ private:
   /** number of retransmitted SYN packets. */
   int8_t syn_rtx_ = 0;
 
+  /** TCP Fast Open [RFC 7413] */
+  bool     tfo_          = false; // client: data goes on the SYN
+  uint32_t tfo_syn_data_ = 0;     // client: bytes sent on the SYN
+  Fast_open::Cookie tfo_cookie_;  // client: the cookie in the SYN-ACK
+  bool     tfo_cookie_req_ = false; // server: the SYN asked for a cookie
+  bool     tfo_accepted_   = false; // server: the data on the SYN was taken
+
+  /** Replaced by a tombstone in TIME-WAIT, and done with */
+  bool tombstoned_ = false;
+
   /** State if connection is in TCP write queue or not. */
   bool queued_;
+  Tx_priority tx_priority_ = Tx_priority::NORMAL;
 
   using Sack_list = sack::List<sack::Fixed_list<default_sack_entries>>;
-  std::unique_ptr<Sack_list> sack_list;
+  Slab_ptr<Sack_list> sack_list;
   /** If SACK is permitted (option has been seen from peer) */
   bool sack_perm = false;
   size_t bytes_sacked_ = 0;
 
+  /** RACK-TLP loss detection, when SACK is permitted */
+  Slab_ptr<Rack> rack_;
+
+  /** Receive buffer autotuning: the data received per round trip */
+  struct Rcv_space {
+    seq_t    seq     = 0; // RCV.NXT when the round started
+    uint64_t time_us = 0; // when the round started, 0 before the first
+    uint32_t space   = 0; // most data received in a round
+    uint32_t rtt_us  = 0; // RTT seen as a receiver
+    seq_t    rtt_seq = 0; // a window from RCV.NXT when the RTT sample started
+    uint64_t rtt_time_us = 0;
+  } rcv_space_;
+
   /** Congestion control */
+  std::unique_ptr<Congestion_control> cc_;
   // is fast recovery state
   bool fast_recovery_ = false;
   // First partial ack seen
@@ -701,7 +911,12 @@ private:
 
   /** Delayed ACK - number of seg received without ACKing */
   uint8_t  dack_{0};
+  /** Receive coalescing - active, ACK owed and segments coalesced since */
+  bool     gro_active_{false};
+  bool     gro_ack_{false};
+  uint16_t gro_segments_{0};
   seq_t    last_ack_sent_;
+  uint64_t cycles_{0};
 
   /**
    *  The size of the largest segment that the sender can transmit
@@ -731,8 +946,9 @@ private:
    * @brief      Set the on_data handler
    *
    * @param[in]  cb          The callback
+   * @param[in]  zero_copy   Whether to leave the data in its packets
    */
-  void _on_data(DataCallback cb);
+  void _on_data(DataCallback cb, bool zero_copy);
 
 
   // Retrieve the associated shared_ptr for a connection, if it exists
@@ -793,6 +1009,11 @@ private:
   */
   void writeq_push();
 
+  /*
+    Queue a buffer to be written, if the state allows it.
+  */
+  void queue_write(WriteBuffer, bool more);
+
   /*
     Try to write (some of) queue on connected.
   */
@@ -865,7 +1086,7 @@ private:
   */
   uint32_t usable_window() const noexcept
   {
-    const int64_t x = (int64_t)send_window() - (int64_t)flight_size();
+    const int64_t x = (int64_t)send_window() - (int64_t)pipe();
     return (uint32_t) std::max(static_cast<int64_t>(0), x);
   }
 
@@ -875,6 +1096,10 @@ private:
   uint32_t flight_size() const noexcept
   { return cb.SND.NXT - cb.SND.UNA; }
 
+  /** Bytes in the network, SACKed and lost data left out with RACK [RFC 6675] */
+  uint32_t pipe() const noexcept
+  { return (rack_) ? rack_->pipe(cb.SND.UNA, cb.SND.NXT) : flight_size(); }
+
   bool uses_window_scaling() const noexcept;
 
   bool uses_timestamps() const noexcept;
@@ -887,6 +1112,27 @@ private:
   */
   void segment_arrived(Packet_view&);
 
+  /// --- RECEIVE COALESCING (software GRO) --- ///
+  /*
+    Segments of a receive burst following a plain in-order data segment
+    are merged straight into the read buffer, skipping the state machine,
+    and all of them are acknowledged once when the burst ends.
+  */
+
+  /** Whether the segment can start coalescing. Expects segment_arrived to follow. */
+  bool gro_begin(const Packet_view& in);
+
+  /** Merge the next segment of the burst. Returns false if it has to go through the state machine. */
+  bool gro_merge(Packet_view& in);
+
+  /** End of the burst, send the deferred ACK */
+  void gro_end();
+
+  bool gro_eligible(const Packet_view& in) const noexcept;
+
+  /** Hand the packet over to the zero-copy slices taken from it, if any */
+  void release_rx_packet(Packet_view& in);
+
   /*
     Acknowledge a packet
     - TCB update, Congestion control handling, RTT calculation and RT handling.
@@ -914,8 +1160,24 @@ private:
    */
   void recv_data(const Packet_view& in);
 
+  /** The slot the packet being handled goes in, if zero-copy data is kept from it */
+  const Packet_slice::Packet_ref& rx_packet()
+  {
+    if(rx_packet_ == nullptr)
+      rx_packet_ = std::make_shared<net::Packet_ptr>();
+    return rx_packet_;
+  }
+
   void recv_out_of_order(const Packet_view& in);
 
+  /**
+   * @brief      Measure the data received in a round trip, and grow the
+   *             read buffers to hold twice the most seen, so the sender
+   *             is never limited by our window. [DRS]
+   *             Called when data is received in order.
+   */
+  void rcv_space_adjust();
+
   /**
    * @brief      Acknowledge incoming data. This is done by:
    *             - Trying to send data if possible (can send)
@@ -989,16 +1251,38 @@ private:
   { writeq_push(); }
 
   /**
-   * @brief      Fills the packet with data, limited to SMSS
+   * @brief      Fills the packet with queued data, limited to SMSS.
+   *             The data is gathered from as many write buffers as needed,
+   *             so small writes share a segment.
    *
    * @param      packet  The packet
-   * @param[in]  data    The data
+   * @param[in]  offset  Where the data starts, in bytes past SND.UNA
    * @param[in]  n       The number of bytes to fill
    *
    * @return     The amount of data filled into the packet.
    */
-  size_t fill_packet(Packet_view& packet, const uint8_t* data, size_t n)
-  { return packet.fill(data, std::min(n, (size_t)SMSS())); }
+  size_t fill_packet(Packet_view& packet, uint32_t offset, size_t n)
+  {
+    return writeq.gather(offset, std::min(n, (size_t)SMSS()),
+      [&packet] (const uint8_t* data, uint32_t len) -> uint32_t
+      { return packet.fill(data, len); });
+  }
+
+  /**
+   * @brief      Fills the packet with the next unsent data and sends it off
+   *             the write queue, limited to SMSS.
+   *
+   * @param      packet  The packet
+   *
+   * @return     The amount of data filled into the packet.
+   */
+  size_t fill_packet_nxt(Packet_view& packet)
+  {
+    const auto written = fill_packet(packet, writeq.bytes_in_flight(), writeq.bytes_remaining());
+    cb.SND.NXT += written;
+    writeq.advance(written);
+    return written;
+  }
 
   /*
     Transmit the packet and hooks up retransmission.
@@ -1007,8 +1291,14 @@ private:
 
   /*
     Creates a new outgoing packet with the current TCB values and options.
+    With tso, the packet has room for a super-segment if the NIC supports it.
   */
-  Packet_view_ptr create_outgoing_packet();
+  Packet_view_ptr create_outgoing_packet(bool tso = false);
+
+  /*
+    Whether the next packet should be a super-segment for the NIC to split.
+  */
+  bool should_use_tso() const noexcept;
 
   Packet_view_ptr outgoing_packet()
   { return create_outgoing_packet(); }
@@ -1026,8 +1316,42 @@ private:
 
   /// --- Congestion Control [RFC 5681] --- ///
 
-  void setup_congestion_control()
-  { reno_init(); }
+  void setup_congestion_control();
+
+  /**
+   * The window state handed to the congestion control for an event.
+   * The TCB is packed, so cwnd and ssthresh cannot be bound to directly.
+   * The controller works on copies, written back when the window goes away
+   * at the end of the expression it is created in.
+   */
+  class Cc_window {
+  public:
+    Cc_window(TCB& tcb, uint32_t flight_size, uint16_t smss,
+              uint64_t srtt_us, uint64_t now_us) noexcept
+      : tcb_{tcb}, cwnd_{tcb.cwnd}, ssthresh_{tcb.ssthresh},
+        window_{cwnd_, ssthresh_, flight_size, tcb.SND.WND, smss, srtt_us, now_us}
+    {}
+
+    ~Cc_window()
+    {
+      tcb_.cwnd     = cwnd_;
+      tcb_.ssthresh = ssthresh_;
+    }
+
+    Cc_window(const Cc_window&)            = delete;
+    Cc_window& operator=(const Cc_window&) = delete;
+
+    operator Congestion_window&() noexcept
+    { return window_; }
+
+  private:
+    TCB&              tcb_;
+    uint32_t          cwnd_;
+    uint32_t          ssthresh_;
+    Congestion_window window_;
+  };
+
+  Cc_window cc_window() noexcept;
 
   /**
    * @brief      Sender Maximum Segment Size
@@ -1048,25 +1372,7 @@ private:
   uint16_t RMSS() const noexcept
   { return cb.SND.MSS; }
 
-  // Reno specifics //
-
-  void reno_init()
-  {
-    reno_init_cwnd(3);
-    reno_init_sshtresh();
-  }
-
-  void reno_init_cwnd(const size_t segments)
-  { cb.cwnd = segments*SMSS(); }
-
-  void reno_init_sshtresh()
-  { cb.ssthresh = cb.SND.WND; }
-
-  void reno_increase_cwnd(const uint16_t n)
-  { cb.cwnd += std::min(n, SMSS()); }
-
-  void reno_deflate_cwnd(const uint16_t n)
-  { cb.cwnd -= (n >= SMSS()) ? n-SMSS() : n; }
+  // NewReno recovery [RFC 6582], the window is left to the congestion control //
 
   void reduce_ssthresh();
 
@@ -1093,6 +1399,12 @@ private:
   */
   void retransmit();
 
+  /*
+    Retransmit data from the middle of the retransmission queue.
+    Returns the number of bytes sent, which stops at the end of a buffer.
+  */
+  size_t retransmit(seq_t seq, uint32_t len);
+
   /**
    * @brief      Take an RTT measurment from an incoming packet.
    *             Uses timestamp if timestamp options are in use,
@@ -1141,6 +1453,54 @@ private:
   */
   void rtx_timeout();
 
+  /// --- RACK-TLP [RFC 8985] --- ///
+
+  /** Update the scoreboard with the cumulative ACK and SACK blocks */
+  void rack_ack(const Packet_view&);
+
+  /**
+   * @brief      Mark lost segments and retransmit them, entering fast
+   *             recovery if not already recovering.
+   *
+   * @return     Whether fast recovery was entered
+   */
+  bool rack_detect_loss();
+
+  /** Retransmit segments deemed lost as far as the window allows */
+  void rack_retransmit();
+
+  /** When the reordering window of a segment has passed */
+  void rack_timeout()
+  { rack_detect_loss(); }
+
+  /** (Re)start the probe timer, or stop it when no probe is due */
+  void tlp_arm();
+
+  /** Send a probe to expose a loss at the tail */
+  void tlp_timeout();
+
+  /// --- PACING --- ///
+
+  /** How far ahead of its due time data may go, the wheel can't wait any shorter */
+  static constexpr uint64_t pacing_horizon_us = 1000;
+
+  /** Account for @bytes sent, holding back further sends when ahead of the rate */
+  void pace(uint32_t bytes);
+
+  void pacing_timeout();
+
+  /// --- IDLE RELEASE --- ///
+
+  /** Start watching for the connection going idle, unless already watching */
+  void idle_watch();
+
+  /** Release the buffers if nothing moved during the period, else watch on */
+  void idle_timeout();
+
+  /** Give back the memory of the receive buffer, write queue and SACK list.
+      Returns the bytes of receive buffer freed */
+  size_t release_buffers();
+
   /** Start the timewait timeout for 2*MSL */
   void timewait_start();
 
@@ -1199,6 +1559,20 @@ private:
   void add_syn_options(Packet_view& pkt);
   void add_synack_options(Packet_view& pkt);
 
+  /// --- TCP FAST OPEN [RFC 7413] --- ///
+
+  /** Open with @data queued to go on the SYN */
+  void open_fast(buffer_t data);
+
+  /** Put what fits of the queued data on the SYN, when a cookie is cached */
+  void fill_syn_data(Packet_view& syn);
+
+  /** Cache the cookie of the SYN-ACK, and see how much of the SYN data got in */
+  void fast_open_synack(const Packet_view& in);
+
+  /** Take the data of a SYN with a valid cookie, handing the connection to the user */
+  void fast_open_accept(Packet_view& in);
+
 
 }; // < class Connection
 
@@ -0,0 +1,106 @@
+#pragma once
+#ifndef NET_TCP_FAST_OPEN_HPP
+#define NET_TCP_FAST_OPEN_HPP
+
+#include "common.hpp"
+#include <net/addr.hpp>
+#include <array>
+#include <unordered_map>
+
+namespace net {
+namespace tcp {
+
+/**
+ * TCP Fast Open [RFC 7413], letting data ride on the SYN.
+ *
+ * A server hands out a cookie to a client asking for one in its SYN, and
+ * accepts data on later SYNs from the client when they carry the cookie.
+ * The cookie is a keyed SipHash-2-4 of the client address, so nothing is
+ * kept per client on the server.
+ *
+ * The client keeps the cookies it got, along with the MSS of the server
+ * so the data on the SYN fits the first segment.
+ */
+class Fast_open {
+public:
+  using Key = std::array<uint64_t, 2>;
+
+  static constexpr uint8_t MIN_COOKIE = 4;
+  static constexpr uint8_t MAX_COOKIE = 16;
+  /** Length of the cookies made here */
+  static constexpr uint8_t COOKIE_LEN = 8;
+  /** Servers remembered by a client */
+  static constexpr size_t  CACHE_SIZE = 1024;
+
+  struct Cookie {
+    std::array<uint8_t, MAX_COOKIE> data {};
+    uint8_t len = 0;
+
+    bool empty() const noexcept
+    { return len == 0; }
+  };
+
+  struct Cached {
+    Cookie   cookie;
+    uint16_t mss;
+  };
+
+  /**
+   * @brief      Constructs with a secret key
+   *
+   * @param[in]  key   The key, random when not given
+   */
+  explicit Fast_open(Key key);
+  Fast_open();
+
+  /**
+   * @brief      Make the cookie of a client
+   *
+   * @param[in]  client  The client address
+   *
+   * @return     The cookie
+   */
+  Cookie make(const Addr& client) const noexcept;
+
+  /**
+   * @brief      Validate the cookie of a SYN
+   *
+   * @param[in]  client  The client address
+   * @param[in]  cookie  The cookie
+   * @param[in]  len     The length of the cookie
+   *
+   * @return     Whether it's the cookie of the client
+   */
+  bool check(const Addr& client, const uint8_t* cookie, uint8_t len) const noexcept;
+
+  /**
+   * @brief      Remember the cookie given by a server
+   *
+   * @param[in]  server  The server address
+   * @param[in]  cookie  The cookie
+   * @param[in]  mss     The MSS of the server
+   */
+  void cache(const Addr& server, const Cookie& cookie, uint16_t mss);
+
+  /**
+   * @brief      The cookie of a server
+   *
+   * @param[in]  server  The server address
+   *
+   * @return     The cookie and MSS, nullptr if there is none
+   */
+  const Cached* cached(const Addr& server) const;
+
+  /** Forget the cookie of a server, when it stops taking it */
+  void forget(const Addr& server)
+  { cache_.erase(server.v6()); }
+
+private:
+  Key key_;
+  std::unordered_map<ip6::Addr, Cached> cache_;
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_FAST_OPEN_HPP
@@ -87,6 +87,16 @@ private:
 
   void segment_arrived(Packet_view&);
 
+  /** Answer a SYN with a cookie, keeping no state */
+  void send_syn_cookie(const Packet_view& syn);
+
+  /**
+   * @brief      Create the connection for an ACK echoing a valid cookie
+   *
+   * @return     Whether the cookie was valid
+   */
+  bool accept_syn_cookie(Packet_view& ack);
+
   void remove(const Connection*);
 
   void connected(Connection_ptr);
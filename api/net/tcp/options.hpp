@@ -4,6 +4,7 @@
 #define NET_TCP_OPTION_HPP
 
 #include <net/util.hpp> // byte ordering
+#include <cstring>
 
 namespace net {
 namespace tcp {
@@ -21,6 +22,7 @@ struct Option {
     SACK_PERM = 0x04, // Sack-Permitted [RFC 2018]
     SACK      = 0x05, // Selective ACK [RFC 2018]
     TS        = 0x08, // Timestamp [RFC 7323] p. 11
+    TFO       = 0x22, // Fast Open Cookie [RFC 7413] p. 5
   };
 
   const uint8_t kind    {END};
@@ -38,6 +40,7 @@ struct Option {
       case SACK_PERM: return {"SACK Permitted"};
       case SACK: return {"SACK"};
       case TS: return {"Timestamp"};
+      case TFO: return {"Fast Open"};
       case NOP: return {"No-Operation"};
       case END: return {"End of list"};
       default: return {"Unknown Option"};
@@ -121,6 +124,24 @@ struct Option {
 
   } __attribute__((packed));
 
+  /**
+   * @brief      Fast Open Cookie option [RFC 7413] p. 5
+   *             Without a cookie, it's a request for one.
+   */
+  struct opt_tfo {
+    const uint8_t   kind    {TFO};
+    const uint8_t   length;
+    uint8_t         cookie[16];
+
+    opt_tfo()
+      : length{2} {}
+
+    opt_tfo(const uint8_t* data, const uint8_t len)
+      : length(2 + len)
+    { std::memcpy(cookie, data, len); }
+
+  } __attribute__((packed));
+
   /**
    * @brief      SACK Permitted [RFC 2018] p. 11
    */
@@ -25,6 +25,9 @@ public:
   uint16_t compute_tcp_checksum() const noexcept override
   { return calculate_checksum4(*this); }
 
+  uint16_t compute_pseudo_checksum() const noexcept override
+  { return pseudo_checksum4(*this); }
+
   Protocol ipv() const noexcept override
   { return Protocol::IPv4; }
 
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef NET_TCP_PACKET_SLICE_HPP
+#define NET_TCP_PACKET_SLICE_HPP
+
+#include <net/packet.hpp>
+#include <deque>
+#include <memory>
+
+namespace net {
+namespace tcp {
+
+/**
+ * @brief      Received data left in the packet it arrived in.
+ *
+ *             The packet is shared by the slices of it, and its buffer goes
+ *             back to the BufferStore when the last of them is gone.
+ */
+class Packet_slice {
+public:
+  /** Shared slot the packet is moved into once TCP is done with it */
+  using Packet_ref = std::shared_ptr<net::Packet_ptr>;
+
+  Packet_slice(Packet_ref pkt, const uint8_t* data, size_t len) noexcept
+    : pkt_{std::move(pkt)}, data_{data}, len_{static_cast<uint32_t>(len)}
+  {}
+
+  const uint8_t* data() const noexcept
+  { return data_; }
+
+  size_t size() const noexcept
+  { return len_; }
+
+  /**
+   * @brief      Drop bytes from the front of the slice
+   *
+   * @param[in]  n     Number of bytes, at most size()
+   */
+  void consume(size_t n) noexcept
+  {
+    data_ += n;
+    len_  -= n;
+  }
+
+  /**
+   * @brief      Split off bytes from the front of the slice, sharing the packet
+   *
+   * @param[in]  n     Number of bytes, at most size()
+   *
+   * @return     The first @n bytes, which are dropped from this slice
+   */
+  Packet_slice take(size_t n) noexcept
+  {
+    Packet_slice front{pkt_, data_, n};
+    consume(n);
+    return front;
+  }
+
+private:
+  Packet_ref     pkt_;
+  const uint8_t* data_;
+  uint32_t       len_;
+};
+
+using Slice_chain = std::deque<Packet_slice>;
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_PACKET_SLICE_HPP
@@ -123,6 +123,22 @@ public:
     set_tcp_checksum(compute_tcp_checksum());
   }
 
+  /** Pseudo-header sum for checksum offloading, 0 if not supported */
+  virtual uint16_t compute_pseudo_checksum() const noexcept
+  { return 0; }
+
+  /** Leave the rest of the checksum to the NIC, see Packet::set_checksum_offload */
+  void set_tcp_checksum_offload() noexcept
+  {
+    set_tcp_checksum(compute_pseudo_checksum());
+    pkt->set_checksum_offload((const uint8_t*) &tcp_header(),
+                              offsetof(Header, checksum));
+  }
+
+  /** Request TSO, letting the NIC cut the payload into @mss sized segments */
+  void set_segment_size(uint16_t mss) noexcept
+  { pkt->set_segment_size(mss); }
+
   // Options //
 
   uint8_t* tcp_options()
@@ -165,6 +181,9 @@ public:
 
   inline const Option::opt_ts* parse_ts_option() const noexcept;
 
+  /** The SACK option [RFC 2018], blocks in network byte order */
+  inline const Option::opt_sack* parse_sack_option() const noexcept;
+
   void set_ts_option(const Option::opt_ts* opt)
   { this->ts_opt = opt; }
 
@@ -185,6 +204,14 @@ public:
 
   inline size_t fill(const uint8_t* buffer, size_t length);
 
+  /** True when fill() summed all of the data while copying it in */
+  bool has_data_sum() const noexcept
+  { return data_summed_ != 0 and data_summed_ == tcp_data_length(); }
+
+  /** Partial checksum of the data, folded but not complemented */
+  uint16_t data_sum() const noexcept
+  { return data_sum_; }
+
   bool validate_length() const noexcept {
     return ip_data_length() >= tcp_header_length();
   }
@@ -242,6 +269,9 @@ protected:
 
 private:
   const Option::opt_ts*   ts_opt = nullptr;
+  // sum of the data copied in by fill(), and how many bytes it covers
+  uint16_t data_sum_    = 0;
+  uint16_t data_summed_ = 0;
 
   virtual void set_ip_src(const net::Addr& addr) noexcept = 0;
   virtual void set_ip_dst(const net::Addr& addr) noexcept = 0;
@@ -348,16 +378,58 @@ inline const Option::opt_ts* Packet_v<Ptr_type>::parse_ts_option() const noexcep
   return nullptr;
 }
 
+template <typename Ptr_type>
+inline const Option::opt_sack* Packet_v<Ptr_type>::parse_sack_option() const noexcept
+{
+  auto* opt = this->tcp_options();
+  while(opt < (uint8_t*)this->tcp_data())
+  {
+    auto* option = (Option*)opt;
+
+    switch(option->kind)
+    {
+      case Option::NOP: {
+        opt++;
+        break;
+      }
+
+      case Option::SACK: {
+        return reinterpret_cast<const Option::opt_sack*>(option);
+      }
+
+      case Option::END: {
+        return nullptr;
+      }
+
+      default:
+        // zero-length options cause infinite loops (and are invalid)
+        if (option->length == 0) return nullptr;
+        opt += option->length;
+    }
+  }
+
+  return nullptr;
+}
+
 template <typename Ptr_type>
 inline size_t Packet_v<Ptr_type>::fill(const uint8_t* buffer, size_t length)
 {
   size_t rem = ip_capacity() - tcp_length();
   if(rem == 0) return 0;
   size_t total = std::min(length, rem);
-  // copy from buffer to packet buffer
-  memcpy(tcp_data() + tcp_data_length(), buffer, total);
+  const uint16_t offset = tcp_data_length();
+  // copy from buffer to packet buffer, summing it for the checksum
+  // as long as all the data so far came in this way
+  if (offset == data_summed_) {
+    const auto sum = net::copy_and_checksum(tcp_data() + offset, buffer, total);
+    data_sum_    = net::checksum_combine(data_sum_, sum, offset);
+    data_summed_ = offset + total;
+  }
+  else {
+    memcpy(tcp_data() + offset, buffer, total);
+  }
   // set new packet length
-  set_length(tcp_data_length() + total);
+  set_length(offset + total);
   return total;
 }
 
@@ -0,0 +1,189 @@
+#pragma once
+#ifndef NET_TCP_RACK_HPP
+#define NET_TCP_RACK_HPP
+
+#include "common.hpp"
+#include "sack.hpp"
+#include <deque>
+
+namespace net {
+namespace tcp {
+
+/**
+ * RACK-TLP loss detection [RFC 8985].
+ *
+ * Keeps the send time of every segment in flight, in sequence order, and
+ * marks which of them the peer has SACKed. A segment is deemed lost once
+ * a segment sent after it has been delivered and a reordering window has
+ * passed, instead of after three duplicate ACKs. Tail losses, which leave
+ * nothing behind them to be delivered, are exposed by a tail loss probe
+ * (TLP) after about two RTTs instead of waiting for an RTO.
+ *
+ * Only data is tracked, SYN and FIN are left to the RTO.
+ */
+class Rack {
+public:
+  struct Segment {
+    seq_t    start;
+    seq_t    end;
+    uint64_t xmit_us;               // time of the last (re)transmission
+    bool     retransmitted = false;
+    bool     sacked        = false;
+    bool     lost          = false;
+
+    uint32_t size() const noexcept
+    { return end - start; }
+  };
+
+  // worst case delayed ACK the probe waits for with one segment in flight
+  static constexpr uint64_t max_ack_delay_us = 200'000;
+  // number of recoveries a widened reordering window is kept for
+  static constexpr uint8_t  reo_wnd_persist  = 16;
+
+  /**
+   * @brief      Probe timeout [RFC 8985 7.2]
+   *
+   * @param[in]  srtt_us  The smoothed RTT
+   * @param[in]  rto_us   The retransmission timeout
+   * @param[in]  flight   Bytes in flight
+   * @param[in]  smss     The sender MSS
+   *
+   * @return     Microseconds until a probe should be sent
+   */
+  static uint64_t pto(uint64_t srtt_us, uint64_t rto_us,
+                      uint32_t flight, uint16_t smss) noexcept;
+
+  /**
+   * @brief      Record a transmission of [start, end).
+   *             Data past the last segment is new, anything else is
+   *             a retransmission.
+   */
+  void on_transmit(seq_t start, seq_t end, uint64_t now_us);
+
+  /**
+   * @brief      Process an ACK: drop what is cumulatively acknowledged,
+   *             mark what is selectively acknowledged and update the
+   *             RTT and send time of the most recently sent delivered
+   *             segment.
+   *
+   * @param[in]  una     The cumulative ACK
+   * @param[in]  blocks  SACK blocks in host byte order
+   * @param[in]  count   Number of SACK blocks
+   * @param[in]  now_us  The current time
+   */
+  void on_ack(seq_t una, const sack::Block* blocks, size_t count, uint64_t now_us);
+
+  /**
+   * @brief      Mark segments lost [RFC 8985 6.2 step 5].
+   *
+   * @param[in]  now_us       The current time
+   * @param[in]  srtt_us      The smoothed RTT, caps the reordering window
+   * @param[in]  in_recovery  Whether fast recovery is in progress
+   *
+   * @return     Microseconds until another segment may be deemed lost,
+   *             0 when there is nothing to wait for
+   */
+  uint64_t detect_loss(uint64_t now_us, uint64_t srtt_us, bool in_recovery);
+
+  /** Mark everything not SACKed lost after a retransmission timeout */
+  void on_timeout();
+
+  /** Fast recovery is done, narrows a widened reordering window over time */
+  void on_recovery_end() noexcept;
+
+  /** A probe was sent, ending at @end */
+  void on_probe(seq_t end, bool retransmission) noexcept;
+
+  /** The first segment deemed lost and not retransmitted since, or nullptr */
+  const Segment* next_lost() const noexcept;
+
+  /** The highest segment not SACKed, retransmitted as probe, or nullptr */
+  const Segment* last_unsacked() const noexcept;
+
+  bool has_lost() const noexcept
+  { return lost_ > 0; }
+
+  /** A probe is outstanding, one per tail */
+  bool probing() const noexcept
+  { return tlp_active_; }
+
+  /**
+   * @brief      Whether the last ACK showed that a retransmitted probe
+   *             repaired a loss [RFC 8985 7.4.2]. Cleared when read.
+   */
+  bool probe_repaired_loss() noexcept
+  {
+    const bool loss = tlp_loss_;
+    tlp_loss_ = false;
+    return loss;
+  }
+
+  /** Still repairing the losses of a retransmission timeout */
+  bool rto_recovery() const noexcept
+  { return rto_active_; }
+
+  /**
+   * @brief      Bytes estimated to be in the network [RFC 6675]:
+   *             SACKed and lost segments are left out.
+   *
+   * @param[in]  una   SND.UNA
+   * @param[in]  nxt   SND.NXT, data not yet handed to on_transmit counts in full
+   */
+  uint32_t pipe(seq_t una, seq_t nxt) const noexcept
+  { return pipe_ + (nxt - (segs_.empty() ? una : segs_.back().end)); }
+
+  bool reordering_seen() const noexcept
+  { return reordering_seen_; }
+
+  /** RTT of the most recently sent delivered segment */
+  uint64_t rtt() const noexcept
+  { return rtt_us_; }
+
+  uint64_t min_rtt() const noexcept
+  { return min_rtt_us_; }
+
+  size_t size() const noexcept
+  { return segs_.size(); }
+
+  bool empty() const noexcept
+  { return segs_.empty(); }
+
+  void clear() noexcept;
+
+private:
+  using iterator = std::deque<Segment>::iterator;
+
+  /** Split the segment covering @seq, returns the one starting at it */
+  iterator split(seq_t seq);
+  void deliver(const Segment&, uint64_t now_us) noexcept;
+  void mark_lost(Segment&) noexcept;
+
+  std::deque<Segment> segs_;
+  uint32_t pipe_           = 0;
+  uint32_t lost_           = 0; // lost, not retransmitted since
+  uint32_t sacked_         = 0;
+  // the most recently sent delivered segment
+  uint64_t xmit_us_        = 0;
+  seq_t    end_seq_        = 0;
+  uint64_t rtt_us_         = 0;
+  uint64_t min_rtt_us_     = 0;
+  seq_t    fack_           = 0; // highest delivered sequence
+  bool     delivered_      = false;
+  // reordering window
+  bool     reordering_seen_ = false;
+  uint8_t  reo_wnd_mult_   = 1;
+  uint8_t  reo_wnd_persist_ = 0;
+  // tail loss probe
+  seq_t    tlp_end_        = 0;
+  bool     tlp_active_     = false;
+  bool     tlp_rtx_        = false;
+  bool     tlp_loss_       = false;
+  // retransmission timeout
+  seq_t    rto_end_        = 0;
+  bool     rto_active_     = false;
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_RACK_HPP
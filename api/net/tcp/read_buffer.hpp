@@ -143,6 +143,14 @@ public:
    */
   void reset(const seq_t start, const size_t capacity);
 
+  /**
+   * @brief      Give back the memory of an empty buffer. The capacity stays,
+   *             and the memory is allocated again as data arrives.
+   *
+   * @return     Bytes released
+   */
+  size_t release();
+
   /**
    * @brief      Sets the starting sequence number.
    *             Should not be messed with.
@@ -161,6 +169,8 @@ public:
 
   int deserialize_from(void*);
   int serialize_to(void*) const;
+  // exactly what serialize_to() will write
+  int serialized_size() const noexcept;
 
 private:
   buffer_t        buf;
@@ -4,6 +4,7 @@
 #define NET_TCP_READ_REQUEST_HPP
 
 #include "read_buffer.hpp"
+#include "packet_slice.hpp"
 #include <delegate>
 #include <deque>
 
@@ -22,21 +23,89 @@ public:
   ReadCallback on_read_callback = nullptr;
   DataCallback on_data_callback = nullptr;
 
-  Read_request(seq_t start, size_t min, size_t max, Alloc&& alloc = Alloc());
+  /**
+   * @brief      Construct a read request.
+   *
+   * @param[in]  start      The sequence number the data starts on
+   * @param[in]  min        The minimum size of a read buffer
+   * @param[in]  max        The maximum size of a read buffer
+   * @param[in]  alloc      The buffer allocator
+   * @param[in]  zero_copy  Keep the data in the packets it arrives in,
+   *                        instead of copying it into read buffers
+   */
+  Read_request(seq_t start, size_t min, size_t max, Alloc&& alloc = Alloc(),
+               bool zero_copy = false);
 
   size_t insert(seq_t seq, const uint8_t* data, size_t n, bool psh = false);
 
+  /**
+   * @brief      Insert data left in its packet (zero-copy only).
+   *             Segments out of order are held until the gap before them is filled.
+   *
+   * @warning    Duplicate/overlapping sequences are not supported, as with Read_buffer.
+   *
+   * @param[in]  seq   The sequence number the data starts on
+   * @param[in]  pkt   The packet holding the data
+   * @param[in]  data  The data
+   * @param[in]  n     The length of the data
+   * @param[in]  psh   Whether push or not (ready data is signalled anyway)
+   *
+   * @return     Bytes inserted
+   */
+  size_t insert(seq_t seq, const Packet_slice::Packet_ref& pkt,
+                const uint8_t* data, size_t n, bool psh = false);
+
+  bool zero_copy() const noexcept
+  { return zero_copy_; }
+
   size_t fits(const seq_t seq) const;
 
+  /**
+   * @brief      The room from a sequence number to the end of what the
+   *             request can hold, counting buffers not made yet.
+   *
+   * @param[in]  seq   The sequence number
+   *
+   * @return     Bytes
+   */
+  size_t room(const seq_t seq) const;
+
+  /**
+   * @brief      Sets the capacity of the read buffers made (or reused) from
+   *             now on, growing or shrinking the data the request can hold.
+   *             Buffers already holding data keep their capacity.
+   *
+   * @param[in]  size  The capacity of a buffer, a power of 2
+   */
+  void set_buffer_size(size_t size);
+
+  size_t buffer_size() const noexcept
+  { return buf_size; }
+
   size_t size() const;
 
   void set_start(seq_t seq);
 
   void reset(const seq_t seq);
 
+  /**
+   * @brief      Give back the memory of the read buffer, when there is
+   *             nothing in it and nothing waiting to be read.
+   *
+   * @return     Bytes released
+   */
+  size_t release();
+
   size_t next_size();
   buffer_t read_next();
 
+  /**
+   * @brief      Take the data ready to be read (zero-copy only).
+   *
+   * @return     The slices, in order
+   */
+  Slice_chain read_slices();
+
   const Read_buffer& front() const
   { return *buffers.front(); }
 
@@ -53,8 +122,21 @@ private:
   Ready_queue complete_buffers;
   Alloc        alloc;
 
+  // zero-copy: data ready to be read, and data waiting for a gap to be filled
+  using Held_slice = std::pair<seq_t, Packet_slice>;
+  bool         zero_copy_;
+  Slice_chain  ready_slices;
+  size_t       ready_bytes = 0;
+  std::deque<Held_slice> held_slices;
+  size_t       held_bytes  = 0;
+  seq_t        next_seq;
+  size_t       capacity;
+  size_t       buf_size;
+
   Read_buffer* get_buffer(const seq_t seq);
 
+  void release_held();
+
 };
 
 }
@@ -0,0 +1,172 @@
+#pragma once
+#ifndef NET_TCP_SLAB_POOL_HPP
+#define NET_TCP_SLAB_POOL_HPP
+
+#include <common>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace net {
+namespace tcp {
+
+/**
+ * A pool of fixed size blocks, carved out of slabs taken from the heap.
+ * Freed blocks go back on the pool's free list, never to the heap, so once
+ * the pool has grown to what's in use, allocating and freeing are a couple
+ * of pointer moves.
+ *
+ * Not thread safe: each TCP instance, and so each CPU, has its own.
+ */
+class Slab_pool {
+public:
+  static constexpr size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+  /**
+   * @brief      Constructs an empty pool
+   *
+   * @param[in]  block_size   The size of a block
+   * @param[in]  slab_blocks  Blocks in each slab taken when the pool runs dry
+   */
+  explicit Slab_pool(size_t block_size, size_t slab_blocks = 16);
+
+  Slab_pool(const Slab_pool&)            = delete;
+  Slab_pool& operator=(const Slab_pool&) = delete;
+
+  /** A block, taking another slab from the heap if the pool is empty */
+  void* allocate();
+
+  void deallocate(void* ptr) noexcept;
+
+  /** Make sure @n blocks are free, without a trip to the heap */
+  void reserve(size_t n);
+
+  size_t block_size() const noexcept
+  { return block_size_; }
+
+  /** Blocks free in the pool */
+  size_t available() const noexcept
+  { return available_; }
+
+  /** Blocks taken from the heap */
+  size_t capacity() const noexcept
+  { return capacity_; }
+
+private:
+  struct Block { Block* next; };
+
+  const size_t block_size_;
+  const size_t slab_blocks_;
+  Block*       free_      = nullptr;
+  size_t       available_ = 0;
+  size_t       capacity_  = 0;
+  std::vector<std::unique_ptr<uint8_t[]>> slabs_;
+
+  void grow(size_t blocks);
+};
+
+/**
+ * Allocator handing out blocks of a Slab_pool, for std::allocate_shared.
+ * Whatever doesn't fit a block comes from the heap.
+ */
+template <typename T>
+struct Slab_allocator {
+  using value_type = T;
+
+  Slab_pool* pool;
+
+  explicit Slab_allocator(Slab_pool* pool) noexcept
+    : pool{pool} {}
+
+  template <typename U>
+  Slab_allocator(const Slab_allocator<U>& other) noexcept
+    : pool{other.pool} {}
+
+  T* allocate(size_t n)
+  {
+    if (pooled(n))
+      return static_cast<T*>(pool->allocate());
+    return std::allocator<T>{}.allocate(n);
+  }
+
+  void deallocate(T* ptr, size_t n) noexcept
+  {
+    if (pooled(n))
+      pool->deallocate(ptr);
+    else
+      std::allocator<T>{}.deallocate(ptr, n);
+  }
+
+  bool pooled(size_t n) const noexcept
+  {
+    return pool != nullptr and n == 1 and sizeof(T) <= pool->block_size()
+      and alignof(T) <= Slab_pool::alignment;
+  }
+
+  template <typename U>
+  bool operator==(const Slab_allocator<U>& other) const noexcept
+  { return pool == other.pool; }
+
+  template <typename U>
+  bool operator!=(const Slab_allocator<U>& other) const noexcept
+  { return pool != other.pool; }
+};
+
+/** Deleter of objects made with make_slab(), also taking plain heap objects */
+template <typename T>
+struct Slab_deleter {
+  Slab_pool* pool = nullptr; // on the heap when not pooled
+
+  Slab_deleter() noexcept = default;
+
+  explicit Slab_deleter(Slab_pool* pool) noexcept
+    : pool{pool} {}
+
+  Slab_deleter(std::default_delete<T>) noexcept {}
+
+  void operator()(T* ptr) const
+  {
+    if (pool != nullptr) {
+      ptr->~T();
+      pool->deallocate(ptr);
+    }
+    else {
+      delete ptr;
+    }
+  }
+};
+
+template <typename T>
+using Slab_ptr = std::unique_ptr<T, Slab_deleter<T>>;
+
+/**
+ * @brief      Make an object in a block of a pool
+ *
+ * @param      pool  The pool, the heap when nullptr
+ * @param      args  The constructor arguments
+ *
+ * @return     The object
+ */
+template <typename T, typename... Args>
+Slab_ptr<T> make_slab(Slab_pool* pool, Args&&... args)
+{
+  static_assert(alignof(T) <= Slab_pool::alignment);
+  if (pool == nullptr)
+    return Slab_ptr<T>{new T(std::forward<Args>(args)...)};
+
+  Expects(sizeof(T) <= pool->block_size());
+  void* mem = pool->allocate();
+  try {
+    return Slab_ptr<T>{new (mem) T(std::forward<Args>(args)...), Slab_deleter<T>{pool}};
+  }
+  catch (...) {
+    pool->deallocate(mem);
+    throw;
+  }
+}
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_SLAB_POOL_HPP
@@ -102,6 +102,26 @@ namespace net::tcp
     void on_write(WriteCallback cb) override
     { m_tcp->on_write(cb); }
 
+    /**
+     * @brief      Bound the send queue of the connection.
+     *
+     * @param[in]  high  The high watermark, 0 for no bound
+     * @param[in]  low   The low watermark
+     */
+    void set_write_watermarks(size_t high, size_t low) override
+    { m_tcp->set_write_watermarks(high, low); }
+
+    bool write_blocked() const noexcept override
+    { return m_tcp->write_blocked(); }
+
+    /**
+     * @brief      Event for when the send queue has drained.
+     *
+     * @param[in]  cb    The drain callback
+     */
+    void on_drain(DrainCallback cb) override
+    { m_tcp->on_drain(cb); }
+
     /**
      * @brief      Async write of a data with a length.
      *
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef NET_TCP_SYN_COOKIES_HPP
+#define NET_TCP_SYN_COOKIES_HPP
+
+#include "common.hpp"
+#include <net/socket.hpp>
+#include <array>
+
+namespace net {
+namespace tcp {
+
+/**
+ * SYN cookies, for answering a SYN without keeping any state.
+ *
+ * The cookie is sent as the ISS of the SYN-ACK, and comes back in the ACK
+ * completing the handshake (as SEG.ACK - 1). It holds what is needed to
+ * create the connection then:
+ *
+ *   | t (5 bits) | MSS index (3 bits) | hash (24 bits) |
+ *
+ * t is a counter advancing every 64 seconds, and the hash is a keyed
+ * SipHash-2-4 of the connection's sockets, the peer's ISN, t and the MSS index.
+ * A cookie is accepted up to one period after it was made.
+ */
+class Syn_cookies {
+public:
+  using Key = std::array<uint64_t, 2>;
+
+  static constexpr int      PERIOD_BITS = 6;  // 64 s
+  static constexpr uint32_t HASH_MASK   = 0xffffff;
+
+  /** The MSS values a cookie can hold, ascending */
+  static constexpr std::array<uint16_t, 8> mss_table {
+    536, 1024, 1220, 1300, 1360, 1400, 1440, 1460
+  };
+
+  /**
+   * @brief      Constructs a cookie maker with a secret key
+   *
+   * @param[in]  key   The key, random when not given
+   */
+  explicit Syn_cookies(Key key);
+  Syn_cookies();
+
+  /**
+   * @brief      Make the cookie for a SYN
+   *
+   * @param[in]  local     The local socket
+   * @param[in]  remote    The remote socket
+   * @param[in]  peer_isn  The sequence number of the SYN
+   * @param[in]  mss       The MSS of the peer, rounded down to what fits the cookie
+   * @param[in]  now_s     The current time in seconds
+   *
+   * @return     The ISS to send in the SYN-ACK
+   */
+  seq_t make(const Socket& local, const Socket& remote, seq_t peer_isn,
+             uint16_t mss, uint64_t now_s) const noexcept;
+
+  /**
+   * @brief      Validate the cookie echoed by an ACK
+   *
+   * @param[in]  local     The local socket
+   * @param[in]  remote    The remote socket
+   * @param[in]  peer_isn  The sequence number of the SYN (SEG.SEQ - 1)
+   * @param[in]  cookie    The cookie (SEG.ACK - 1)
+   * @param[in]  now_s     The current time in seconds
+   *
+   * @return     The MSS held by the cookie, 0 when invalid or expired
+   */
+  uint16_t check(const Socket& local, const Socket& remote, seq_t peer_isn,
+                 seq_t cookie, uint64_t now_s) const noexcept;
+
+private:
+  Key key_;
+
+  uint32_t hash(const Socket& local, const Socket& remote,
+                seq_t peer_isn, uint64_t t, uint32_t mss_idx) const noexcept;
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_SYN_COOKIES_HPP
@@ -9,13 +9,20 @@
 #include "listener.hpp"
 #include "packet_view.hpp"
 #include "packet.hpp" // remove me, temp for NaCl
-
-#include <map>  // connections, listeners
-#include <deque>  // writeq
+#include "syn_cookies.hpp"
+#include "fast_open.hpp"
+#include "time_wait.hpp"
+#include "slab_pool.hpp"
+#include "timer_wheel.hpp"
+#include "tx_scheduler.hpp"
+
+#include <map>  // ports
 #include <net/socket.hpp>
 #include <net/ip4/ip4.hpp>
 #include <util/bitops.hpp>
 #include <util/alloc_pmr.hpp>
+#include <util/flat_map.hpp>
+#include <kernel/mem_pressure.hpp>
 
 namespace net {
 
@@ -42,8 +49,9 @@ namespace net {
     friend class tcp::Listener;
 
   private:
-    using Listeners       = std::map<Socket, std::shared_ptr<tcp::Listener>>;
-    using Connections     = std::unordered_map<tcp::Connection::Tuple, tcp::Connection_ptr>;
+    // looked up for every segment, so kept in flat tables
+    using Listeners       = Flat_map<Socket, std::shared_ptr<tcp::Listener>>;
+    using Connections     = Flat_map<tcp::Connection::Tuple, tcp::Connection_ptr>;
 
   public:
     /////// TCP Stuff - Relevant to the protocol /////
@@ -80,6 +88,35 @@ namespace net {
      */
     tcp::Listener& listen(const Socket& socket, ConnectCallback cb = nullptr);
 
+    /**
+     * @brief      Bind to a port with one listener per CPU, SO_REUSEPORT style.
+     *             Every CPU the NIC delivers packets to gets a TCP shard of its own,
+     *             with its own listener, connection table and timers.
+     *             A new connection goes to the CPU its flow hashes to, the same way
+     *             the NIC's receive-side scaling steers it, so it stays there for life.
+     *             Packets arriving on another CPU are handed off to the owner.
+     *             Throws if unable to bind
+     *
+     * @param[in]  port       The port
+     * @param[in]  cb         Connect callback of all the listeners, invoked on
+     *                        the CPU owning the new connection
+     * @param[in]  ipv6_only  Whether to only listen on IPv6
+     *
+     * @return     The listener of the CPU owning this instance
+     */
+    tcp::Listener& listen_sharded(const tcp::port_t port, ConnectCallback cb,
+                                  const bool ipv6_only = false);
+
+    /**
+     * @brief      The TCP handling the sharded ports on a CPU
+     *
+     * @param[in]  cpu   The CPU
+     *
+     * @return     The shard of the CPU, this instance for its own CPU,
+     *             nullptr if there is none
+     */
+    TCP* shard(int cpu) noexcept;
+
     /**
      * @brief Close a Listener
      * @details Closes the Listener and removes it from the
@@ -153,6 +190,28 @@ namespace net {
      */
     tcp::Connection_ptr connect(Socket local, Socket remote);
 
+    /**
+     * @brief      Make an outgoing connection to a TCP remote (IP:port),
+     *             with TCP Fast Open [RFC 7413]: the data goes on the SYN
+     *             when a cookie from the remote is cached, and asks for one
+     *             otherwise. May throw if no available ephemeral ports.
+     *
+     * @param[in]  remote  The remote socket
+     * @param[in]  data    The data to send first
+     *
+     * @return     A ptr to an unestablished TCP Connection
+     */
+    tcp::Connection_ptr connect(Socket remote, tcp::buffer_t data);
+
+    /**
+     * @brief      Make an outgoing connection with TCP Fast Open, see above.
+     *
+     * @param[in]  remote    The remote socket
+     * @param[in]  data      The data to send first
+     * @param[in]  callback  The connect callback
+     */
+    void connect(Socket remote, tcp::buffer_t data, ConnectCallback callback);
+
     /**
      * @brief      Insert a connection ptr into the TCP (used for restoring)
      *
@@ -160,10 +219,28 @@ namespace net {
      */
     void insert_connection(tcp::Connection_ptr);
 
+    /**
+     * @brief      Create a connection to restore into, from the pools
+     *             when pooling (used for restoring)
+     *
+     * @param[in]  local   The local socket
+     * @param[in]  remote  The remote socket
+     */
+    tcp::Connection_ptr restore_connection(Socket local, Socket remote)
+    { return new_connection(std::move(local), std::move(remote)); }
+
+    /**
+     * @brief      Make room for @n more connections, and their pooled
+     *             memory when pooling (used for restoring many at once)
+     *
+     * @param[in]  n     The number of connections
+     */
+    void reserve_connections(size_t n);
+
     /**
      * @brief      Receive a Packet from the network layer (IP)
      *
-     * @param[in]  <unnamed>  A network packet
+     * @param[in]  <unnamed>  A network packet, or a chain of them
      */
     void receive4(net::Packet_ptr);
 
@@ -219,6 +296,38 @@ namespace net {
     size_t active_connections() const
     { return connections_.size(); }
 
+    /**
+     * @brief      The connections that used the most CPU, while the
+     *             CycleProfiler was enabled
+     *
+     * @param[in]  N     How many, at most
+     *
+     * @return     The connections, busiest first
+     */
+    std::vector<tcp::Connection_ptr> busiest_connections(size_t N) const;
+
+    /**
+     * @brief      The number of connections in TIME-WAIT kept as tombstones
+     *
+     * @return     The number of tombstones
+     */
+    size_t time_wait_connections() const noexcept
+    { return time_wait_.size(); }
+
+    /**
+     * @brief      Sets if a connection entering TIME-WAIT is replaced by a
+     *             tombstone holding its tuple and sequence numbers, so it can
+     *             be freed right away. Its close callback is called then,
+     *             instead of 2*MSL later.
+     *
+     * @param[in]  active  Whether TIME-WAIT is compacted
+     */
+    void set_time_wait_compaction(bool active) noexcept
+    { time_wait_compaction_ = active; }
+
+    bool uses_time_wait_compaction() const noexcept
+    { return time_wait_compaction_; }
+
     /**
      * @brief      Sets the MSL (Maximum Segment Lifetime)
      *
@@ -323,6 +432,82 @@ namespace net {
     bool uses_SACK() const noexcept
     { return sack_; }
 
+    /**
+     * @brief      Sets if RACK-TLP loss detection [RFC 8985] is used
+     *             on connections where SACK is permitted.
+     *
+     * @param[in]  active  Whether RACK-TLP is in use.
+     */
+    void set_RACK(bool active) noexcept
+    { rack_ = active; }
+
+    /**
+     * @brief      Whether the TCP instance is using RACK-TLP or not.
+     *
+     * @return     Whether the TCP instance is using RACK-TLP or not.
+     */
+    bool uses_RACK() const noexcept
+    { return rack_; }
+
+    /**
+     * @brief      Sets if in-order segments of a connection arriving in the
+     *             same burst are coalesced, and acknowledged once (software GRO).
+     *
+     * @param[in]  active  Whether receive coalescing is in use.
+     */
+    void set_GRO(bool active) noexcept
+    { gro_ = active; }
+
+    /**
+     * @brief      Whether the TCP instance is coalescing received segments or not.
+     *
+     * @return     Whether receive coalescing is in use.
+     */
+    bool uses_GRO() const noexcept
+    { return gro_; }
+
+    /**
+     * @brief      Sets if new NewReno connections pace their transmissions.
+     *             CUBIC and BBR connections are paced regardless,
+     *             see Connection::set_pacing().
+     *
+     * @param[in]  active  Whether NewReno connections are paced.
+     */
+    void set_pacing(bool active) noexcept
+    { pacing_ = active; }
+
+    /**
+     * @brief      Whether new NewReno connections pace their transmissions.
+     *
+     * @return     Whether NewReno connections are paced.
+     */
+    bool uses_pacing() const noexcept
+    { return pacing_; }
+
+    /**
+     * @brief      Sets the congestion control algorithm of new connections.
+     *
+     * @param[in]  algo  The algorithm
+     */
+    void set_congestion_control(tcp::Congestion_control::Algorithm algo) noexcept
+    { congestion_control_ = algo; }
+
+    /**
+     * @brief      The congestion control algorithm of new connections.
+     *
+     * @return     The algorithm
+     */
+    tcp::Congestion_control::Algorithm congestion_control() const noexcept
+    { return congestion_control_; }
+
+    /**
+     * @brief      The timing wheel running the timers of the connections.
+     *
+     * @return     The timer wheel
+     */
+    tcp::Timer_wheel& timer_wheel() noexcept
+    { return timer_wheel_; }
+
     /**
      * @brief      Sets the dack. [RFC 1122] (p.96)
      *
@@ -339,6 +524,19 @@ namespace net {
     auto DACK_timeout() const
     { return dack_timeout_; }
 
+    /**
+     * @brief      Sets how long a connection goes without data either way
+     *             before its receive buffer, empty write queue and SACK list
+     *             are released. They're allocated again when data comes.
+     *
+     * @param[in]  idle  The idle period, 0 to keep them
+     */
+    void set_idle_release(const std::chrono::milliseconds idle) noexcept
+    { idle_release_ = idle; }
+
+    auto idle_release() const noexcept
+    { return idle_release_; }
+
     /**
      * @brief      Sets the maximum amount of allowed concurrent connection attempts.
      *
@@ -355,6 +553,42 @@ namespace net {
     uint16_t max_syn_backlog() const
     { return max_syn_backlog_; }
 
+    /**
+     * @brief      Sets if a listener with a full SYN queue answers new SYNs
+     *             with SYN cookies, instead of dropping its oldest half-open connection.
+     *
+     * @param[in]  active  Whether SYN cookies are in use.
+     */
+    void set_syn_cookies(bool active) noexcept
+    { syn_cookies_enabled_ = active; }
+
+    /**
+     * @brief      Whether the TCP instance is using SYN cookies or not.
+     *
+     * @return     Whether the TCP instance is using SYN cookies or not.
+     */
+    bool uses_syn_cookies() const noexcept
+    { return syn_cookies_enabled_; }
+
+    /**
+     * @brief      Sets if listeners accept data on SYNs carrying a valid
+     *             Fast Open cookie [RFC 7413], and hand out cookies to
+     *             clients asking. The data may be a replay, only turn it on
+     *             for services where that's harmless.
+     *
+     * @param[in]  active  Whether Fast Open is served.
+     */
+    void set_fast_open(bool active) noexcept
+    { fast_open_enabled_ = active; }
+
+    /**
+     * @brief      Whether listeners serve TCP Fast Open or not.
+     *
+     * @return     Whether Fast Open is served.
+     */
+    bool uses_fast_open() const noexcept
+    { return fast_open_enabled_; }
+
     /**
      * @brief      Set the maximum allowed memory
      *             to be used by this TCP.
@@ -401,6 +635,57 @@ namespace net {
     auto max_bufsize() const
     { return max_bufsize_; }
 
+    /**
+     * @brief      Sets if the receive buffers of connections are sized from
+     *             the data received per round trip, so the window can keep up
+     *             with the bandwidth-delay product. Starting out at twice the
+     *             max buffer size, they grow up to the max receive window and
+     *             the connection's share of the total buffer size, and go back
+     *             to the start when memory runs low.
+     *
+     * @param[in]  active  Whether receive buffers are autotuned
+     */
+    void set_rcv_autotune(bool active) noexcept
+    { rcv_autotune_ = active; }
+
+    bool uses_rcv_autotune() const noexcept
+    { return rcv_autotune_; }
+
+    /**
+     * @brief      Sets the most data a connection may have in its receive
+     *             buffers when autotuned.
+     *
+     * @param[in]  size  The size in bytes
+     */
+    void set_max_rcv_window(const size_t size) noexcept
+    { max_rcv_window_ = size; }
+
+    size_t max_rcv_window() const noexcept
+    { return max_rcv_window_; }
+
+    /**
+     * @brief      Sets if connections, and their read request, SACK list
+     *             and RACK state, come from pools kept by this instance
+     *             (and so by its CPU) instead of the heap.
+     *             What is freed goes back to the pools.
+     *
+     * @param[in]  active  Whether connections are pooled.
+     */
+    void set_connection_pooling(bool active) noexcept
+    { pooling_ = active; }
+
+    bool uses_connection_pooling() const noexcept
+    { return pooling_; }
+
+    /**
+     * @brief      Fill the pools with room for @n connections, so accepting
+     *             and closing them doesn't touch the heap in steady state.
+     *             Shards are filled as they're added.
+     *
+     * @param[in]  n     The number of connections
+     */
+    void prewarm_connections(size_t n);
+
     /**
      * @brief      The Maximum Segment Size to be used for this instance.
      *             [RFC 793] [RFC 879] [RFC 6691]
@@ -442,6 +727,21 @@ namespace net {
     size_t writeq_size() const
     { return writeq.size(); }
 
+    /**
+     * @brief      Sets the packets a queued connection of a priority class
+     *             is given per round when the NIC has room again.
+     *             Connections of a class share the packets left over by
+     *             the classes above it fairly, in deficit round robin.
+     *
+     * @param[in]  prio     The priority class
+     * @param[in]  packets  The quantum, at least 1 (default 16)
+     */
+    void set_tx_quantum(tcp::Tx_priority prio, size_t packets) noexcept
+    { writeq.set_quantum(prio, packets); }
+
+    size_t tx_quantum(tcp::Tx_priority prio) const noexcept
+    { return writeq.quantum(prio); }
+
     /**
      * @brief      The IP address for which the TCP instance is "connected".
      *
@@ -488,18 +788,16 @@ namespace net {
     **/
     tcp::Connection_ptr retrieve_shared(tcp::Connection* self)
     {
-      auto i = connections_.find(self->tuple());
-      if (i != connections_.end())
+      if (auto* conn = connections_.find(self->tuple()))
       {
-        //printf("Found connection: %p\n", i->second.get());
-        return i->second;
+        //printf("Found connection: %p\n", conn->get());
+        return *conn;
       }
 
-      auto j = find_listener(self->local());
-      if (j != listeners_.end())
+      if (auto* listener = find_listener(self->local()))
       {
         //printf("Found listener\n");
-        auto& q = j->second->syn_queue_;
+        auto& q = listener->syn_queue_;
         for (auto& conn : q) {
           if (conn.get() == self) {
             //printf("Found connection: %p\n", conn.get());
@@ -520,22 +818,84 @@ namespace net {
 
   private:
     IPStack&      inet_;
+    // before the connections, so it outlives their timers
+    tcp::Timer_wheel timer_wheel_;
+    // before the listeners and connections, so it outlives what they hold
+    struct Pools {
+      // the shared_ptr control block goes with the connection
+      static constexpr size_t shared_overhead = 64;
+      tcp::Slab_pool connections   {sizeof(tcp::Connection) + shared_overhead};
+      tcp::Slab_pool read_requests {sizeof(tcp::Read_request)};
+      tcp::Slab_pool sack_lists    {sizeof(tcp::Connection::Sack_list)};
+      tcp::Slab_pool racks         {sizeof(tcp::Rack)};
+
+      void reserve(size_t n);
+    } pools_;
     Listeners     listeners_;
     Connections   connections_;
+    /** Tombstones of connections in TIME-WAIT, and the timer expiring them */
+    tcp::Time_wait   time_wait_;
+    tcp::Wheel_timer time_wait_timer_;
 
     size_t total_bufsize_;
     os::mem::Pmr_pool mempool_;
 
     size_t min_bufsize_;
     size_t max_bufsize_;
+    size_t max_rcv_window_;
+    bool   rcv_autotune_;
+
+    /** Make a companion of a connection, from its pool when pooling */
+    template <typename T, typename... Args>
+    tcp::Slab_ptr<T> make_pooled(tcp::Slab_pool& pool, Args&&... args)
+    { return tcp::make_slab<T>(pooling_ ? &pool : nullptr, std::forward<Args>(args)...); }
+
+    tcp::Connection_ptr new_connection(Socket local, Socket remote, ConnectCallback cb = nullptr);
+
+    /** Less than an eighth of the total buffer size left */
+    bool memory_pressure()
+    { return mempool_.allocatable() < total_bufsize_ / 8; }
+
+    /**
+     * @brief      The read buffer size for an autotuned connection
+     *             wanting room for @window bytes.
+     *
+     * @param[in]  window  The bytes wanted
+     *
+     * @return     The size of a read buffer
+     */
+    size_t rcv_buffer_size(size_t window);
 
     Port_utils& ports_;
 
     downstream  network_layer_out4_;
     downstream  network_layer_out6_;
 
+    /** IPv4 segments sent while a Tx_batch is alive, handed down as one chain */
+    net::Packet_chain tx_batch4_;
+    bool              tx_batching_ = false;
+
+    struct Tx_batch {
+      Tx_batch(TCP& tcp) noexcept
+        : tcp{tcp}, owner{not tcp.tx_batching_}
+      { tcp.tx_batching_ = true; }
+
+      ~Tx_batch() {
+        if (owner) tcp.flush_tx_batch();
+      }
+
+      TCP& tcp;
+      const bool owner;
+    };
+    void flush_tx_batch();
+
+    /** The connection whose segments of the current receive burst are being coalesced */
+    tcp::Connection_ptr gro_conn_;
+    bool                rx_burst_ = false;
+    void gro_flush();
+
     /** Internal writeq - connections gets queued in the wait for packets and recvs offer */
-    std::deque<tcp::Connection_ptr> writeq;
+    tcp::Tx_scheduler<tcp::Connection_ptr> writeq;
 
     /* Settings */
 
@@ -549,20 +909,60 @@ namespace net {
     bool                      timestamps_;
     /** Selective ACK  [RFC 2018] */
     bool                      sack_;
+    /** RACK-TLP loss detection [RFC 8985] */
+    bool                      rack_;
+    /** Receive coalescing of segment bursts */
+    bool                      gro_;
+    /** Pacing of NewReno connections */
+    bool                      pacing_;
     /** Delayed ACK timeout - how long should we wait with sending an ACK */
     std::chrono::milliseconds dack_timeout_;
+    /** Release the buffers of connections idle this long */
+    std::chrono::milliseconds idle_release_;
     /** Maximum SYN queue backlog */
     uint16_t                  max_syn_backlog_;
+    /** SYN cookies when the SYN queue is full */
+    bool                      syn_cookies_enabled_;
+    tcp::Syn_cookies          syn_cookies_;
+    /** TCP Fast Open, served and the cookies of servers */
+    bool                      fast_open_enabled_;
+    tcp::Fast_open            fast_open_;
+    /** Connections from pools_, and how many to prewarm them with */
+    bool                      pooling_;
+    size_t                    pool_prewarm_ = 0;
+    /** Tombstones instead of connections in TIME-WAIT */
+    bool                      time_wait_compaction_;
+    /** Congestion control of new connections */
+    tcp::Congestion_control::Algorithm congestion_control_ = tcp::Congestion_control::Algorithm::NEW_RENO;
+
+    /**
+     * SO_REUSEPORT style sharding, see listen_sharded().
+     * Set up on the CPU owning this instance, and only read by the shards.
+     */
+    TCP*                              owner_ = nullptr; // of a shard
+    std::vector<std::unique_ptr<TCP>> shards_;          // by CPU
+    std::vector<tcp::port_t>          sharded_ports_;
+    struct Flow_steering {
+      std::vector<uint8_t> key;
+      std::vector<int>     cpus; // CPU of each hash bucket
+      uint16_t             hash_types = 0;
+    } steering_;
 
     /** Stats */
-    uint64_t* bytes_rx_ = nullptr;
-    uint64_t* bytes_tx_ = nullptr;
-    uint64_t* packets_rx_ = nullptr;
-    uint64_t* packets_tx_ = nullptr;
+    Stat_percpu* bytes_rx_ = nullptr;
+    Stat_percpu* bytes_tx_ = nullptr;
+    Stat_percpu* packets_rx_ = nullptr;
+    Stat_percpu* packets_tx_ = nullptr;
     uint64_t* incoming_connections_ = nullptr;
     uint64_t* outgoing_connections_ = nullptr;
     uint64_t* connection_attempts_ = nullptr;
+    uint64_t* syn_cookies_sent_ = nullptr;
+    uint64_t* syn_cookies_validated_ = nullptr;
+    uint64_t* fast_open_accepted_ = nullptr;
     uint32_t* packets_dropped_ = nullptr;
+    uint64_t* shard_handoffs_ = nullptr;
+    uint64_t* gro_merged_ = nullptr;
+    util::Histogram_percpu* rtt_ = nullptr;
 
     bool smp_enabled = false;
     int  cpu_id = 0;
@@ -590,6 +990,20 @@ namespace net {
      */
     tcp::Packet_view_ptr create_outgoing_packet6();
 
+    /**
+     * @brief      Creates an outgoing TCP packet with room for a super-segment,
+     *             to be split into segments by the NIC (TSO).
+     *             Falls back to a regular packet when the NIC can't.
+     *
+     * @return     A tcp packet ptr
+     */
+    tcp::Packet_view_ptr create_outgoing_tso_packet();
+
+    /**
+     * @brief      Whether the NIC can segment TCP over IPv4 for us
+     */
+    bool tso_available() const noexcept;
+
     /**
      * @brief      Sends a TCP reset based on the values of the incoming packet.
      *             Used when packet are addressed to closed ports or already dead connections.
@@ -647,6 +1061,17 @@ namespace net {
      */
     bool unbind(const Socket& socket);
 
+    /**
+     * @brief      Unbinds a socket used by a flow to a remote, falling back
+     *             to unbinding it exclusively when it's not shared.
+     *
+     * @param[in]  local   The local socket
+     * @param[in]  remote  The remote socket
+     *
+     * @return     Returns wether there was a socket that got unbound
+     */
+    bool unbind(const Socket& local, const Socket& remote);
+
     /**
      * @brief      Bind to an socket where the address is given and the
      *             port is an ephemeral port.
@@ -658,6 +1083,18 @@ namespace net {
      */
     Socket bind(const tcp::Address& addr);
 
+    /**
+     * @brief      Bind to an ephemeral port for a connection to a remote.
+     *             The port may be shared with connections to other remotes.
+     *             Throws if there are no more usable ephemeral ports.
+     *
+     * @param[in]  addr    The address
+     * @param[in]  remote  The remote
+     *
+     * @return     The socket that got bound.
+     */
+    Socket bind(const tcp::Address& addr, const Socket& remote);
+
     /**
      * @brief      Determines if the source address is valid.
      *
@@ -673,9 +1110,9 @@ namespace net {
      *
      * @param[in]  socket  The socket the listener is bound to
      *
-     * @return     A listener iterator
+     * @return     The listener, or nullptr
      */
-    Listeners::iterator find_listener(const Socket& socket);
+    tcp::Listener* find_listener(const Socket& socket);
 
     /**
      * @brief      Try to find the listener bound to socket.
@@ -683,9 +1120,9 @@ namespace net {
      *
      * @param[in]  socket  The socket the listener is bound to
      *
-     * @return     A listener const iterator
+     * @return     The listener, or nullptr
      */
-    Listeners::const_iterator cfind_listener(const Socket& socket) const;
+    const tcp::Listener* cfind_listener(const Socket& socket) const;
 
     /**
      * @brief      Adds a connection.
@@ -716,10 +1153,35 @@ namespace net {
      */
     void close_connection(const tcp::Connection* conn)
     {
-      unbind(conn->local());
+      // the ports of shards are bound by their owner,
+      // and a tombstone keeps the port until it expires
+      if (owner_ == nullptr and not conn->tombstoned_)
+        unbind(conn->local(), conn->remote());
       connections_.erase(conn->tuple());
     }
 
+    /**
+     * @brief      Replace a connection entering TIME-WAIT with a tombstone
+     *
+     * @param[in]  conn  The connection
+     */
+    void time_wait(const tcp::Connection& conn);
+
+    /**
+     * @brief      Handle a segment for a connection in TIME-WAIT
+     *
+     * @param[in]  tuple  The tuple of the connection
+     * @param      tw     The tombstone
+     * @param      in     The segment
+     *
+     * @return     False if the tombstone made way for a new connection,
+     *             and the segment is to be handled as such
+     */
+    bool time_wait_arrived(const tcp::Time_wait::Tuple& tuple,
+                           tcp::Time_wait::Entry& tw, tcp::Packet_view& in);
+
+    void time_wait_timeout();
+
     /**
      * @brief      Closes and deletes a listener.
      *
@@ -759,6 +1221,37 @@ namespace net {
      */
     void kick();
 
+
+    // SHARDING
+
+    /** Construct for a CPU, which is the current one but for shards */
+    TCP(IPStack&, bool smp, int cpu);
+
+    /** The shard of a CPU, created with the settings of this instance */
+    TCP& add_shard(int cpu);
+
+    /** Map the hash buckets of the NIC's RSS to CPUs, or spread them over all CPUs */
+    void setup_steering();
+
+    bool is_sharded(const tcp::port_t port) const noexcept;
+
+    /**
+     * @brief      The TCP owning the flow of a packet
+     *
+     * @return     The shard of the flow on a sharded port, otherwise
+     *             the TCP owning the shards
+     */
+    TCP& owner_of(const tcp::Packet_view&);
+
+    /** Hand a packet over to the CPU of another TCP */
+    void handoff(TCP& to, tcp::Packet_view&);
+
+    /** Run a task on the CPU of a TCP */
+    static void run_on(const TCP& tcp, delegate<void()> task);
+
+    /** Give back the buffers connections aren't using, when memory is low */
+    size_t shrink_buffers(os::mem::Pressure);
+
   }; // < class TCP
 
 } // < namespace net
@@ -0,0 +1,95 @@
+#pragma once
+#ifndef NET_TCP_TIME_WAIT_HPP
+#define NET_TCP_TIME_WAIT_HPP
+
+#include "common.hpp"
+#include <net/socket.hpp>
+#include <delegate>
+#include <deque>
+#include <unordered_map>
+
+namespace net {
+namespace tcp {
+
+/**
+ * Tombstones of connections in TIME-WAIT.
+ *
+ * A connection entering TIME-WAIT only needs to answer a retransmitted FIN
+ * until 2*MSL has passed, so what is kept of it is the tuple, the sequence
+ * numbers to ACK with and when it expires. The connection itself is freed.
+ *
+ * All entries live for the same time, so they expire in the order they were
+ * made (or last restarted), kept in a queue.
+ */
+class Time_wait {
+public:
+  using Tuple = std::pair<Socket, Socket>; // local, remote
+
+  struct Entry {
+    seq_t    snd_nxt;
+    seq_t    rcv_nxt;
+    uint32_t ts_recent;
+    uint16_t window;  // as advertised, scaled
+    bool     ts_ok;   // timestamps in use
+    uint64_t expires; // ms
+  };
+
+  using Expired = delegate<void(const Tuple&)>;
+
+  /**
+   * @brief      Add a tombstone, replacing any for the same tuple.
+   *             The expiry must not be before any other.
+   *
+   * @param[in]  tuple  The tuple
+   * @param[in]  entry  The entry, with its expiry
+   */
+  void insert(const Tuple& tuple, const Entry& entry);
+
+  Entry* find(const Tuple& tuple)
+  {
+    auto it = entries_.find(tuple);
+    return (it != entries_.end()) ? &it->second : nullptr;
+  }
+
+  bool erase(const Tuple& tuple)
+  { return entries_.erase(tuple) > 0; }
+
+  /**
+   * @brief      Restart the expiry of a tombstone, as when a FIN is
+   *             retransmitted. The expiry must not be before any other.
+   *
+   * @param[in]  tuple    The tuple
+   * @param[in]  expires  The new expiry (ms)
+   */
+  void restart(const Tuple& tuple, uint64_t expires);
+
+  /**
+   * @brief      Remove the tombstones expired by @now
+   *
+   * @param[in]  now         The current time (ms)
+   * @param[in]  on_expired  Called with each tuple removed
+   *
+   * @return     Number of tombstones removed
+   */
+  size_t expire(uint64_t now, Expired on_expired = nullptr);
+
+  /** The first expiry, 0 when empty */
+  uint64_t next_expiry() const noexcept
+  { return order_.empty() ? 0 : order_.front().first; }
+
+  size_t size() const noexcept
+  { return entries_.size(); }
+
+  bool empty() const noexcept
+  { return entries_.empty(); }
+
+private:
+  std::unordered_map<Tuple, Entry> entries_;
+  // expiry order, with stale records of entries restarted or removed
+  std::deque<std::pair<uint64_t, Tuple>> order_;
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_TIME_WAIT_HPP
@@ -0,0 +1,148 @@
+#pragma once
+#ifndef NET_TCP_TIMER_WHEEL_HPP
+#define NET_TCP_TIMER_WHEEL_HPP
+
+#include <array>
+#include <cstdint>
+#include <delegate>
+#include <util/timer.hpp>
+
+namespace net {
+namespace tcp {
+
+/**
+ * Hierarchical timing wheel for the timers of TCP connections.
+ *
+ * Four levels of 64 slots, 1 ms apart on the first level and 64 times
+ * further apart on each level above, cover about 4.6 hours. Timers further
+ * out wait in the last slot and are refiled when it comes up. Timers on
+ * the higher levels move down a level each time their slot comes up.
+ * A timer is an intrusive list node, so arming, re-arming and cancelling
+ * take constant time and never allocate.
+ *
+ * One kernel timer drives the wheel and is set for the first slot with
+ * timers in it. Re-arming a retransmission timer further out, the common
+ * case, does not touch the kernel's timer queue at all.
+ */
+class Timer_wheel {
+public:
+  class Timer;
+  using tick_t     = uint64_t;
+  using duration_t = Timers::duration_t;
+  using handler_t  = delegate<void()>;
+  using clock_t    = delegate<uint64_t()>; // monotonic nanoseconds
+
+  static constexpr int      SLOT_BITS = 6;
+  static constexpr int      SLOTS     = 1 << SLOT_BITS;
+  static constexpr int      LEVELS    = 4;
+  static constexpr uint64_t TICK_NS   = 1'000'000;
+
+  /**
+   * @brief      Constructs an empty wheel
+   *
+   * @param[in]  clock  Source of time, RTC::nanos_now when not given
+   */
+  explicit Timer_wheel(clock_t clock = nullptr);
+  ~Timer_wheel();
+
+  Timer_wheel(const Timer_wheel&)            = delete;
+  Timer_wheel& operator=(const Timer_wheel&) = delete;
+
+  /**
+   * @brief      Run the timers that are due up to and including @now.
+   *             Stretches of ticks with nothing due are skipped.
+   *
+   * @param[in]  now   The current tick
+   */
+  void advance(tick_t now);
+
+  /** The last tick that has been run */
+  tick_t now() const noexcept
+  { return now_; }
+
+  /** The next tick with timers to run or move down, 0 when empty */
+  tick_t next_event() const noexcept;
+
+  /** Number of timers running */
+  size_t size() const noexcept
+  { return size_; }
+
+  bool empty() const noexcept
+  { return size_ == 0; }
+
+private:
+  std::array<std::array<Timer*, SLOTS>, LEVELS> slots_;
+  std::array<uint64_t, LEVELS> occupied_ {}; // one bit per non-empty slot
+  size_t    size_      = 0;
+  tick_t    now_       = 0;
+  tick_t    wakeup_    = 0; // tick the kernel timer is set for
+  bool      advancing_ = false;
+  clock_t   clock_;
+  ::Timer   kernel_timer_;
+
+  void arm(Timer&, duration_t);
+  /** File a timer in the slot of its expiry, returns the tick it is due or moved down */
+  tick_t link(Timer&) noexcept;
+  void unlink(Timer&) noexcept;
+  /** Move the timers of a slot to a list of their own */
+  void take(int level, int slot, Timer*& list) noexcept;
+  void schedule(tick_t);
+  void on_kernel_timeout();
+};
+
+/**
+ * A timer on a Timer_wheel, used like ::Timer.
+ */
+class Timer_wheel::Timer {
+public:
+  explicit Timer(Timer_wheel& wheel, handler_t on_timeout = nullptr) noexcept
+    : wheel_{wheel}, on_timeout_{on_timeout}
+  {}
+
+  ~Timer()
+  { stop(); }
+
+  Timer(const Timer&)            = delete;
+  Timer& operator=(const Timer&) = delete;
+
+  /** Start the timer, unless it is already running */
+  void start(duration_t when, handler_t on_timeout = nullptr)
+  {
+    if (not is_running())
+      restart(when, on_timeout);
+  }
+
+  void stop() noexcept
+  { wheel_.unlink(*this); }
+
+  /** (Re)start the timer, running or not */
+  void restart(duration_t when, handler_t on_timeout = nullptr)
+  {
+    if (on_timeout)
+      on_timeout_ = on_timeout;
+    wheel_.arm(*this, when);
+  }
+
+  void set_on_timeout(handler_t on_timeout)
+  { on_timeout_ = on_timeout; }
+
+  bool is_running() const noexcept
+  { return pprev_ != nullptr; }
+
+private:
+  friend class Timer_wheel;
+  Timer_wheel& wheel_;
+  Timer*       next_   = nullptr;
+  Timer**      pprev_  = nullptr;
+  tick_t       expiry_ = 0;
+  uint8_t      level_  = 0;
+  uint8_t      slot_   = 0;
+  handler_t    on_timeout_;
+};
+
+using Wheel_timer = Timer_wheel::Timer;
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_TIMER_WHEEL_HPP
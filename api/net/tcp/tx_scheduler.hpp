@@ -0,0 +1,141 @@
+#pragma once
+#ifndef NET_TCP_TX_SCHEDULER_HPP
+#define NET_TCP_TX_SCHEDULER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace net {
+namespace tcp {
+
+/** Priority class of a connection when waiting for transmit capacity */
+enum class Tx_priority : uint8_t {
+  INTERACTIVE,  // served before the others
+  NORMAL,
+  BULK          // served when nothing else is waiting
+};
+
+inline const char* to_string(Tx_priority prio) noexcept
+{
+  switch (prio) {
+    case Tx_priority::INTERACTIVE: return "INTERACTIVE";
+    case Tx_priority::NORMAL:      return "NORMAL";
+    case Tx_priority::BULK:        return "BULK";
+  }
+  return "UNKNOWN";
+}
+
+/**
+ * Deficit round robin of flows waiting for packets from the NIC.
+ *
+ * Each priority class is served before the ones below it. Within a class,
+ * the flow at the front is offered up to its deficit (a quantum of packets
+ * added when it reaches the front), then goes to the back if it has more to
+ * send. A flow cut short by the NIC running out of packets stays at the
+ * front with what is left of its deficit, and goes first next time.
+ *
+ * A packet is the unit, as that's what the NIC hands out.
+ */
+template <typename Flow>
+class Tx_scheduler {
+public:
+  static constexpr size_t CLASSES = 3;
+
+  /**
+   * @brief      Queue a flow. A flow must only be queued once.
+   *
+   * @param[in]  flow  The flow
+   * @param[in]  prio  The priority class
+   */
+  void push(Flow flow, Tx_priority prio = Tx_priority::NORMAL)
+  {
+    queues_[idx(prio)].push_back({std::move(flow), 0});
+    size_++;
+  }
+
+  /**
+   * @brief      Hand out packets to the queued flows.
+   *
+   * @param      packets  Packets available, decreased by what was used
+   * @param[in]  offer    Called as offer(Flow&, size_t& budget), using packets
+   *                      by decreasing budget. Returns whether the flow
+   *                      has more to send, and stays queued.
+   */
+  template <typename Offer>
+  void serve(size_t& packets, Offer&& offer)
+  {
+    for (size_t c = 0; c < CLASSES and packets > 0; c++)
+    {
+      auto& q = queues_[c];
+      while (packets > 0 and not q.empty())
+      {
+        // taken out, as the offer may queue other flows
+        Entry e = std::move(q.front());
+        q.pop_front();
+        if (e.deficit == 0)
+          e.deficit = quantum_[c];
+
+        size_t budget = std::min(e.deficit, packets);
+        const size_t given = budget;
+        const bool backlogged = offer(e.flow, budget);
+        const size_t used = given - budget;
+        packets   -= used;
+        e.deficit -= used;
+
+        if (not backlogged)
+          size_--;
+        else if (e.deficit > 0 and used > 0)
+          q.push_front(std::move(e)); // the NIC ran out, continue next time
+        else
+          q.push_back({std::move(e.flow), 0});
+      }
+    }
+  }
+
+  /** Whether a flow of the class, or one above it, is waiting */
+  bool waiting(Tx_priority prio = Tx_priority::BULK) const noexcept
+  {
+    for (size_t c = 0; c <= idx(prio); c++)
+      if (not queues_[c].empty())
+        return true;
+    return false;
+  }
+
+  /**
+   * @brief      Sets the packets a flow of a class is given per round
+   *
+   * @param[in]  prio     The priority class
+   * @param[in]  packets  The quantum, at least 1
+   */
+  void set_quantum(Tx_priority prio, size_t packets) noexcept
+  { quantum_[idx(prio)] = std::max(packets, (size_t) 1); }
+
+  size_t quantum(Tx_priority prio) const noexcept
+  { return quantum_[idx(prio)]; }
+
+  size_t size() const noexcept
+  { return size_; }
+
+  bool empty() const noexcept
+  { return size_ == 0; }
+
+private:
+  struct Entry {
+    Flow   flow;
+    size_t deficit;
+  };
+  std::array<std::deque<Entry>, CLASSES> queues_;
+  std::array<size_t, CLASSES> quantum_ {16, 16, 16};
+  size_t size_ = 0;
+
+  static constexpr size_t idx(Tx_priority prio) noexcept
+  { return static_cast<size_t>(prio); }
+};
+
+} // < namespace tcp
+} // < namespace net
+
+#endif // < NET_TCP_TX_SCHEDULER_HPP
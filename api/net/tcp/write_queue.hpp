@@ -6,11 +6,48 @@
 #include <debug>
 #include <delegate>
 #include <deque>
+#include <algorithm>
+#include <memory>
+#include <utility>
 #include "common.hpp"
 
 namespace net {
 namespace tcp {
 
+/*
+  A buffer in the write queue. Either a shared buffer, or memory that
+  isn't copied (a file on a memdisk), which the owner (if any) keeps
+  alive until the buffer is acknowledged.
+*/
+class Write_buffer {
+public:
+  Write_buffer(buffer_t buf)
+    : data_{buf->data()}, size_(buf->size()), owner_{std::move(buf)}
+  {}
+
+  Write_buffer(const uint8_t* data, uint32_t len,
+               std::shared_ptr<const void> owner = nullptr)
+    : data_{data}, size_{len}, owner_{std::move(owner)}
+  {}
+
+  const uint8_t* data() const noexcept
+  { return data_; }
+
+  size_t size() const noexcept
+  { return size_; }
+
+  bool operator==(const buffer_t& buf) const noexcept
+  { return owner_ == buf; }
+
+  bool operator==(const Write_buffer& other) const noexcept
+  { return data_ == other.data_ and size_ == other.size_; }
+
+private:
+  const uint8_t*              data_;
+  uint32_t                    size_;
+  std::shared_ptr<const void> owner_;
+};
+
 /*
   Write Queue containig WriteRequests from user.
   Stores requests until they are fully acknowledged;
@@ -25,7 +62,8 @@ namespace tcp {
 class Write_queue {
 public:
   using WriteCallback = delegate<void(size_t)>;
-  using WriteBuffer   = buffer_t;
+  using DrainCallback = delegate<void()>;
+  using WriteBuffer   = Write_buffer;
 
 public:
   explicit Write_queue(WriteCallback cb = nullptr);
@@ -34,15 +72,18 @@ public:
     Add a request to the back of the queue.
     If the queue was empty/finished, point current to the new request.
   */
-  void push_back(buffer_t wr) {
+  void push_back(WriteBuffer wr) {
     debug2("<WriteQueue> Inserted WR: size=%u, current=%u, size=%u\n",
-      (uint32_t) wr->size(), current_, (uint32_t) size());
+      (uint32_t) wr.size(), current_, (uint32_t) size());
+    total_ += wr.size();
     q.push_back(std::move(wr));
+    if(high_ > 0 and total_ >= high_)
+      full_ = true;
   }
 
   /*
-    Advances the queue forward.
-    If current buffer finishes; exec user callback and step to next.
+    Advances the queue forward, possibly over several buffers.
+    For each buffer finished; exec user callback and step to next.
   */
   void advance(size_t bytes);
 
@@ -58,6 +99,15 @@ public:
   */
   void reset();
 
+  /*
+    Give back the memory of an empty queue.
+  */
+  void shrink()
+  {
+    if(q.empty())
+      std::deque<WriteBuffer>{}.swap(q);
+  }
+
   /*
     The current buffer to write from.
     Can be in the middle/back of the queue due to unacknowledged buffers in front.
@@ -74,6 +124,24 @@ public:
   void on_write(WriteCallback cb)
   { on_write_ = std::move(cb); }
 
+  /*
+    Bound the bytes queued: at @high the queue is full, until acknowledged
+    data takes it down to @low, when the drain callback is called.
+    A @high of 0 (the default) doesn't bound it.
+  */
+  void set_watermarks(uint32_t high, uint32_t low)
+  {
+    high_ = high;
+    low_  = std::min(low, high);
+    full_ = high_ > 0 and total_ >= high_;
+  }
+
+  void on_drain(DrainCallback cb)
+  { on_drain_ = std::move(cb); }
+
+  bool full() const noexcept
+  { return full_; }
+
   bool empty() const
   { return q.empty(); }
 
@@ -90,21 +158,34 @@ public:
   { return acked_; }
 
   const uint8_t* nxt_data() const
-  { return &q.at(current_)->at(offset_); }
+  { return q.at(current_).data() + offset_; }
 
   auto nxt_rem() const
-  { return q.at(current_)->size() - offset_; }
+  { return q.at(current_).size() - offset_; }
 
-  auto bytes_total() const {
-    uint32_t n = 0;
-    for(auto& it : q)
-      n += it->size();
-    return n;
-  }
+  /*
+    Visit @n bytes of data @offset bytes past UNA, across buffers, as
+    pieces passed to @fn(const uint8_t* data, uint32_t len). @fn returns
+    how much of a piece it took, and taking less ends the walk.
+    Returns how many bytes were taken.
+  */
+  template <typename Fn>
+  uint32_t gather(uint32_t offset, uint32_t n, Fn&& fn) const;
 
-  uint32_t bytes_remaining() const;
+  auto bytes_total() const
+  { return total_; }
 
-  uint32_t bytes_unacknowledged() const;
+  uint32_t bytes_remaining() const
+  { return total_ - sent_; }
+
+  uint32_t bytes_unacknowledged() const
+  { return total_ - acked_; }
+
+  /*
+    Bytes sent but not yet acknowledged.
+  */
+  uint32_t bytes_in_flight() const
+  { return sent_ - acked_; }
 
   /*
     If the queue has more data to send
@@ -116,6 +197,7 @@ public:
   // ???
   int deserialize_from(void*);
   int serialize_to(void*) const;
+  int serialized_size() const noexcept;
 
 private:
   std::deque<WriteBuffer> q;
@@ -125,12 +207,51 @@ private:
   uint32_t offset_;
   /* Acknowledged of una() */
   uint32_t acked_;
+  /* Bytes in the queue, and how many of them are sent */
+  uint32_t total_;
+  uint32_t sent_;
   /* Write callback - invoked when a buffer is fully sent */
   WriteCallback on_write_;
+  /* Watermarks, and the callback when a full queue is down to low_ */
+  uint32_t high_ = 0;
+  uint32_t low_  = 0;
+  bool     full_ = false;
+  DrainCallback on_drain_;
 
 
 }; // < WriteQueue
 
+template <typename Fn>
+inline uint32_t Write_queue::gather(uint32_t offset, uint32_t n, Fn&& fn) const
+{
+  // start from nxt() when gathering unsent data, saving the walk
+  size_t i = 0;
+  offset += acked_;
+  if(offset >= sent_ - offset_)
+  {
+    i = current_;
+    offset -= sent_ - offset_;
+  }
+
+  uint32_t taken = 0;
+  for(; i < q.size() and taken < n; ++i)
+  {
+    const auto& buf = q[i];
+    if(offset >= buf.size())
+    {
+      offset -= buf.size();
+      continue;
+    }
+    const uint32_t len = std::min<uint32_t>(buf.size() - offset, n - taken);
+    const uint32_t x = fn(buf.data() + offset, len);
+    taken += x;
+    if(x < len)
+      break;
+    offset = 0;
+  }
+  return taken;
+}
+
 } // < namespace tcp
 } // < namespace net
 
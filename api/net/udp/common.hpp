@@ -38,11 +38,33 @@ namespace net::udp
         + (Proto_UDP << 8)
         + htons(length);
 
-    // Compute sum of header and data
+    // Compute sum of header and data, unless the data was summed already
     const char* buffer = (char*) &packet.udp_header();
+    if (packet.has_data_sum())
+      return net::checksum(sum + packet.data_sum(), buffer, packet.udp_header_length());
     return net::checksum(sum, buffer, length);
   }
 
+  /** Pseudo-header sum, folded but not complemented, for checksum offload */
+  template <typename View4>
+  uint16_t pseudo_checksum4(const View4& packet)
+  {
+    constexpr uint8_t Proto_UDP = 17;
+    const auto ip_src = packet.ip4_src();
+    const auto ip_dst = packet.ip4_dst();
+    uint32_t sum =
+          (ip_src.whole >> 16)
+        + (ip_src.whole & 0xffff)
+        + (ip_dst.whole >> 16)
+        + (ip_dst.whole & 0xffff)
+        + (Proto_UDP << 8)
+        + htons(packet.udp_length());
+
+    while (sum >> 16)
+      sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+  }
+
   template <typename View6>
   uint16_t calculate_checksum6(const View6& packet)
   {
@@ -66,8 +88,10 @@ namespace net::udp
 
     sum += (Proto_UDP << 8) + htons(length);
 
-    // Compute sum of header and data
+    // Compute sum of header and data, unless the data was summed already
     const char* buffer = (char*) &packet.udp_header();
+    if (packet.has_data_sum())
+      return net::checksum(sum + packet.data_sum(), buffer, packet.udp_header_length());
     return net::checksum(sum, buffer, length);
   }
 
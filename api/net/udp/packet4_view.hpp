@@ -25,6 +25,9 @@ public:
   Protocol ipv() const noexcept override
   { return Protocol::IPv4; }
 
+  uint16_t compute_pseudo_checksum() const noexcept override
+  { return pseudo_checksum4(*this); }
+
   ip4::Addr ip4_src() const noexcept
   { return packet().ip_src(); }
 
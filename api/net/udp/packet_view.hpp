@@ -78,26 +78,85 @@ public:
   bool validate_length() const noexcept
   { return udp_length() >= sizeof(udp::Header); }
 
+  /**
+   *  Length of the UDP payload including data in further segments, as in
+   *  a datagram reassembled from fragments. The payload is udp_data_length()
+   *  bytes at udp_data(), followed by the data of each packet segment.
+   */
+  uint16_t udp_payload_length() const noexcept
+  {
+    const int real_length = pkt->total_size() - ip_header_length();
+    const int length = std::min<int>(real_length, ntohs(udp_header().length));
+    return std::max<int>(length - sizeof(udp::Header), 0);
+  }
+
+  /** Copy up to @length bytes of the payload, across segments */
+  inline size_t copy_payload(void* buffer, size_t length) const noexcept;
+
   uint16_t udp_checksum() const noexcept
   { return udp_header().checksum; }
 
   virtual uint16_t compute_udp_checksum() const noexcept
   { return 0x0; }
 
+  void set_udp_checksum(uint16_t checksum) noexcept
+  { udp_header().checksum = checksum; }
+
   void set_udp_checksum() noexcept
   {
     udp_header().checksum = 0;
     udp_header().checksum = compute_udp_checksum();
   }
 
+  /** Pseudo-header sum for checksum offloading, 0 if not supported */
+  virtual uint16_t compute_pseudo_checksum() const noexcept
+  { return 0; }
+
+  /** Leave the checksum to the NIC, see Packet::set_checksum_offload */
+  void set_udp_checksum_offload() noexcept
+  {
+    set_udp_checksum(compute_pseudo_checksum());
+    pkt->set_checksum_offload((const uint8_t*) &udp_header(),
+                              offsetof(Header, checksum));
+  }
+
   uint8_t* udp_data()
   { return (uint8_t*)header + udp_header_length(); }
 
   const uint8_t* udp_data() const
   { return (uint8_t*)header + udp_header_length(); }
 
+  /** Room for data at udp_data(), to write the payload in place */
+  uint16_t udp_data_capacity() const noexcept
+  { return ip_capacity() - udp_header_length(); }
+
+  /** Set the length of the data written in place at udp_data() */
+  void set_data_length(uint16_t length)
+  {
+    Expects(length <= udp_data_capacity());
+    data_sum_    = 0;
+    data_summed_ = 0;
+    set_length(length);
+  }
+
   inline size_t fill(const uint8_t* buffer, size_t length);
 
+  /** Add the data of @seg, a buffer of payload only, after what's written */
+  void append_segment(net::Packet_ptr seg)
+  {
+    udp_header().length = htons(ntohs(udp_header().length) + seg->size());
+    data_summed_ = 0;
+    pkt->append_segment(std::move(seg));
+  }
+
+  /** True when fill() summed all of the data while copying it in */
+  bool has_data_sum() const noexcept
+  { return data_summed_ != 0 and data_summed_ == udp_data_length(); }
+
+  /** Partial checksum of the data, folded but not complemented */
+  uint16_t data_sum() const noexcept
+  { return data_sum_; }
+
   // Packet_view specific operations //
 
   Ptr_type release()
@@ -141,6 +200,10 @@ protected:
 
 
 private:
+  // sum of the data copied in by fill(), and how many bytes it covers
+  uint16_t data_sum_    = 0;
+  uint16_t data_summed_ = 0;
+
   // TODO: see if we can get rid of these virtual calls
   virtual uint16_t ip_data_length() const noexcept = 0;
   virtual uint16_t ip_header_length() const noexcept = 0;
@@ -149,16 +212,41 @@ private:
 
 };
 
+template <typename Ptr_type>
+inline size_t Packet_v<Ptr_type>::copy_payload(void* buffer, size_t length) const noexcept
+{
+  auto* dst = (uint8_t*) buffer;
+  length = std::min<size_t>(length, udp_payload_length());
+  size_t copied = std::min<size_t>(length, udp_data_length());
+  memcpy(dst, udp_data(), copied);
+  for (auto* seg = pkt->next_segment(); seg and copied < length; seg = seg->next_segment())
+  {
+    const size_t part = std::min<size_t>(length - copied, seg->size());
+    memcpy(dst + copied, seg->layer_begin(), part);
+    copied += part;
+  }
+  return copied;
+}
+
 template <typename Ptr_type>
 inline size_t Packet_v<Ptr_type>::fill(const uint8_t* buffer, size_t length)
 {
   size_t rem = ip_capacity() - udp_length();
   if(rem == 0) return 0;
   size_t total = std::min(length, rem);
-  // copy from buffer to packet buffer
-  memcpy(udp_data() + udp_data_length(), buffer, total);
+  const uint16_t offset = udp_data_length();
+  // copy from buffer to packet buffer, summing it for the checksum
+  // as long as all the data so far came in this way
+  if (offset == data_summed_) {
+    const auto sum = net::copy_and_checksum(udp_data() + offset, buffer, total);
+    data_sum_    = net::checksum_combine(data_sum_, sum, offset);
+    data_summed_ = offset + total;
+  }
+  else {
+    memcpy(udp_data() + offset, buffer, total);
+  }
   // set new packet length
-  set_length(udp_data_length() + total);
+  set_length(offset + total);
   return total;
 }
 
@@ -16,12 +16,22 @@ namespace net {
 }
 namespace net::udp
 {
+  /** A datagram of a batch, to or from @peer */
+  struct Datagram
+  {
+    net::Socket peer;
+    const void* data;
+    size_t      length;
+  };
+
   class Socket
   {
   public:
     using multicast_group_addr = ip4::Addr;
 
     using recvfrom_handler  = delegate<void(addr_t, port_t, const char*, size_t)>;
+    using recv_packet_handler = delegate<void(const Packet_view&)>;
+    using recv_batch_handler  = delegate<void(const Datagram*, size_t)>;
 
     // constructors
     Socket(UDP&, net::Socket socket);
@@ -35,11 +45,68 @@ namespace net::udp
     void on_read(recvfrom_handler callback)
     { on_read_handler = callback; }
 
+    /**
+     * Receive the packets themselves instead, replacing on_read. Datagrams
+     * reassembled from fragments can then be read from each packet segment
+     * without copying, see Packet_view::udp_payload_length(). For on_read
+     * such datagrams are first copied into one buffer.
+     */
+    void on_read_packet(recv_packet_handler callback)
+    { on_read_packet_handler = callback; }
+
+    /**
+     * Receive the datagrams that arrived together in one call, replacing
+     * on_read. The data is only valid until the handler returns.
+     * Set to nullptr to go back to on_read.
+     */
+    void on_read_batch(recv_batch_handler callback)
+    { on_read_batch_handler = callback; }
+
     void sendto(addr_t destIP, port_t port,
                 const void* buffer, size_t length,
                 sendto_handler cb = nullptr,
                 error_handler ecb = nullptr);
 
+    /**
+     * Send a large buffer as datagrams of @segment_size bytes each, the
+     * last one taking what is left. The datagrams are cut out of the buffer
+     * in one pass as packets become available, like with sendto().
+     * Segments are capped to the largest datagram the stack can send.
+     *
+     * @param segment_size  Payload bytes per datagram, 0 for as large as possible
+     */
+    void send_segmented(addr_t destIP, port_t port,
+                        const void* buffer, size_t length,
+                        uint16_t segment_size,
+                        sendto_handler cb = nullptr,
+                        error_handler ecb = nullptr);
+
+    /**
+     * Send many datagrams in one go. What fits in the transmit queue is
+     * handed down the stack together, the rest is queued as with sendto().
+     * The data is copied before returning.
+     *
+     * @param msgs   The datagrams
+     * @param count  Number of datagrams
+     * @param cb     Called when all of them are sent
+     */
+    void send_batch(const Datagram* msgs, size_t count,
+                    sendto_handler cb = nullptr);
+
+    /**
+     * Get a packet from the stack to @destIP:@port, to write the payload
+     * straight into: up to udp_data_capacity() bytes at udp_data(),
+     * followed by set_data_length(). Hand it back with send().
+     */
+    Packet_view_ptr create_packet(addr_t destIP, port_t port);
+
+    /**
+     * Send a packet made by create_packet(), as it is. The checksum is
+     * left to the NIC where it can. The packet is not queued, so it may
+     * go out ahead of what sendto() has queued.
+     */
+    void send(Packet_view_ptr packet);
+
     void bcast(addr_t srcIP, port_t port,
                const void* buffer, size_t length,
                sendto_handler cb = nullptr,
@@ -67,6 +134,8 @@ namespace net::udp
     net::Socket  socket_;
     recvfrom_handler on_read_handler =
       [] (addr_t, port_t, const char*, size_t) {};
+    recv_packet_handler on_read_packet_handler = nullptr;
+    recv_batch_handler  on_read_batch_handler = nullptr;
 
     const bool is_ipv6_;
     bool reuse_addr;
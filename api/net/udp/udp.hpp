@@ -12,6 +12,7 @@
 #include <map>
 #include <cstring>
 #include <unordered_map>
+#include <vector>
 
 #include <net/packet.hpp>
 #include <net/socket.hpp>
@@ -36,7 +37,8 @@ namespace net {
     using Stack         = Inet;
     using Port_utils    = std::map<Addr, Port_util>;
 
-    using Sockets       = std::map<net::Socket, udp::Socket>;
+    // hashed, and node based as bind() hands out references
+    using Sockets       = std::unordered_map<net::Socket, udp::Socket>;
 
     using sendto_handler = udp::sendto_handler;
     using error_handler  = udp::error_handler;
@@ -45,7 +47,8 @@ namespace net {
     {
       WriteBuffer(UDP& udp, net::Socket src, net::Socket dst,
                   const uint8_t* data, size_t length,
-                  sendto_handler cb, error_handler ecb);
+                  sendto_handler cb, error_handler ecb,
+                  uint16_t segment_size = 0);
 
       int remaining() const
       { return len - offset; }
@@ -54,7 +57,10 @@ namespace net {
       { return offset == len; }
 
       size_t packets_needed() const;
-      void write();
+      // the datagram size the buffer is cut into
+      uint16_t segment_size() const;
+      // write up to @max packets, returning how many were written
+      size_t write(size_t max);
 
       // the UDP stack
       UDP& udp;
@@ -66,6 +72,8 @@ namespace net {
       std::shared_ptr<uint8_t> buf;
       size_t len;
       size_t offset;
+      // datagram size asked for, 0 for as large as possible
+      uint16_t seg_size;
       // the callback for when this buffer is written
       sendto_handler send_callback;
       // the callback for when this receives an error
@@ -77,7 +85,7 @@ namespace net {
 
     addr_t local_ip() const;
 
-    /** Input from network layer */
+    /** Input from network layer, a packet or a chain of them */
     void receive4(net::Packet_ptr);
     void receive6(net::Packet_ptr);
     void receive(udp::Packet_view_ptr, const bool is_bcast);
@@ -131,6 +139,27 @@ namespace net {
     // create and transmit @num packets from sendq
     void process_sendq(size_t num);
 
+    /**
+     * @brief      Send a batch of datagrams from a socket.
+     *             Behind an empty send queue, what fits in the transmit queue
+     *             is handed down in one go, the rest is queued.
+     *
+     * @param[in]  src    The source
+     * @param[in]  msgs   The datagrams
+     * @param[in]  count  Number of datagrams
+     * @param[in]  cb     Called when all of them are sent
+     */
+    void send_batch(const net::Socket& src, const udp::Datagram* msgs,
+                    size_t count, sendto_handler cb = nullptr);
+
+    /**
+     * @brief      Send a packet with its payload written in place,
+     *             leaving the checksum to the NIC where it can.
+     *
+     * @param[in]  packet  The packet, see udp::Socket::create_packet()
+     */
+    void send_packet(udp::Packet_view_ptr packet);
+
     uint16_t max_datagram_size() noexcept;
 
     class Port_in_use_exception : public UDP_error {
@@ -159,17 +188,29 @@ namespace net {
     // the async send queue
     std::deque<WriteBuffer> sendq;
 
+    // datagrams received in a row for the same batch reader, until delivered
+    udp::Socket*                      rx_batch_socket_ = nullptr;
+    std::vector<udp::Packet_view_ptr> rx_batch_;
+    std::vector<udp::Datagram>        rx_msgs_;
+
+    udp::Socket* batch_reader(const net::Socket& dest);
+    void deliver_batch();
+
+    // the socket bound to @socket, else the one bound to any address
     Sockets::iterator find(const Socket& socket)
     {
       Sockets::iterator it = sockets_.find(socket);
+
+      if(it == sockets_.end() and not socket.address().is_any())
+        it = sockets_.find({socket.address().any_addr(), socket.port()});
+
       return it;
     }
 
     Sockets::const_iterator cfind(const Socket& socket) const
-    {
-      Sockets::const_iterator it = sockets_.find(socket);
-      return it;
-    }
+    { return const_cast<UDP*>(this)->find(socket); }
+
+    bool is_valid_source(const addr_t& addr) const noexcept;
 
     /** Error entries are just error callbacks and timestamps */
     class Error_entry {
@@ -198,6 +239,10 @@ namespace net {
 
     udp::Packet_view_ptr create_packet(const net::Socket& src, const net::Socket& dst);
 
+    /** Fill in the payload, going on in packet segments when it doesn't fit
+        in the first buffer and the NIC can send them. Returns bytes written. */
+    size_t fill(udp::Packet_view&, const uint8_t* data, size_t length);
+
     friend class udp::Socket;
 
   }; //< class UDP
@@ -5,6 +5,7 @@
 
 #include "vif.hpp"
 #include <net/ethernet/ethernet_8021q.hpp>
+#include <array>
 
 namespace net {
 
@@ -16,6 +17,7 @@ namespace net {
 class VLAN_manager {
 public:
   using VLAN_interface = Vif<Ethernet_8021Q>;
+  static constexpr int VID_COUNT = 4096;
 
   /**
    * @brief      Returns a VLAN manager with the given index.
@@ -39,7 +41,8 @@ public:
   VLAN_interface& add(hw::Nic& link, const int id);
 
 private:
-  std::map<int, VLAN_interface*> links_;
+  // indexed by VLAN ID, so a frame finds its interface in one load
+  std::array<VLAN_interface*, VID_COUNT> links_ {};
 
   VLAN_manager() = default;
 
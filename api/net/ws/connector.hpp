@@ -54,6 +54,18 @@ public:
   operator Request_handler()
   { return create_request_handler(); }
 
+  /**
+   * @brief      Agree to permessage-deflate when clients offer it.
+   *
+   * @param[in]  params  The most to agree to (window bits, context takeover),
+   *                     and how our side compresses (memory level, min size)
+   */
+  void enable_deflate(WS_deflate_params params = {})
+  { deflate_ = params; }
+
+  void disable_deflate()
+  { deflate_.reset(); }
+
   /**
    * @brief      Handles a HTTP Request by trying to upgrade it to a WebSocket.
    *             Calls "on_connect" with the WS, nullptr if failed.
@@ -74,7 +86,7 @@ public:
         return;
       }
     }
-    auto ws = WebSocket::upgrade(*req, *writer);
+    auto ws = WebSocket::upgrade(*req, *writer, deflate_);
     if (ws == nullptr) return;
 
     assert(ws->get_cpuid() == SMP::cpu_id());
@@ -83,6 +95,7 @@ public:
 
 private:
   AcceptCallback  on_accept_;
+  std::optional<WS_deflate_params> deflate_;
 
 }; // < WS_server_connector
 
@@ -110,19 +123,22 @@ public:
    * @brief      Creates a HTTP Response handler by allocating a client connector
    *             with restricted lifetime to the response handler itself.
    *
-   * @param[in]  cb    A connect callback
-   * @param[in]  key   The WS key
+   * @param[in]  cb       A connect callback
+   * @param[in]  key      The WS key
+   * @param[in]  offered  The permessage-deflate parameters offered, if any
    *
    * @return     Returns a Response handler with a captured client connector.
    */
-  static Response_handler create_response_handler(ConnectCallback cb, std::string key)
+  static Response_handler create_response_handler(ConnectCallback cb, std::string key,
+                          std::optional<WS_deflate_params> offered = std::nullopt)
   {
     // @todo Try replace with unique_ptr
     // create a new instance of a client connector
     //auto ptr = std::unique_ptr<WS_client_connector>{
     //  new WS_client_connector(std::move(cb), std::move(key))
     //};
-    auto ptr = std::make_shared<WS_client_connector>(std::move(cb), std::move(key));
+    auto ptr = std::make_shared<WS_client_connector>(std::move(cb), std::move(key),
+                                                     std::move(offered));
 
     return [ ptr{std::move(ptr)} ]
            (auto err, auto res, auto& conn)
@@ -135,13 +151,15 @@ public:
    * @brief      Creates a response handler with the current connect callback.
    *             See the static variant for more info.
    *
-   * @param[in]  key   The WS key
+   * @param[in]  key      The WS key
+   * @param[in]  offered  The permessage-deflate parameters offered, if any
    *
    * @return     Returns a Response handler with a captured client connector.
    */
-  Response_handler create_response_handler(std::string key)
+  Response_handler create_response_handler(std::string key,
+                   std::optional<WS_deflate_params> offered = std::nullopt)
   {
-    return create_response_handler(on_connect_, std::move(key));
+    return create_response_handler(on_connect_, std::move(key), std::move(offered));
   }
 
   /**
@@ -154,7 +172,7 @@ public:
    */
   void on_response(http::Error err, http::Response_ptr res, http::Connection& conn)
   {
-    auto ws = WebSocket::upgrade(err, *res, conn, key_);
+    auto ws = WebSocket::upgrade(err, *res, conn, key_, offered_);
 
     if(ws == nullptr) {
     } // not ok
@@ -169,10 +187,13 @@ public:
    *
    * @param[in]  on_connect  On connect callback
    * @param[in]  key         The WS key
+   * @param[in]  offered     The permessage-deflate parameters offered, if any
    */
-  WS_client_connector(ConnectCallback on_connect, std::string key)
+  WS_client_connector(ConnectCallback on_connect, std::string key,
+                      std::optional<WS_deflate_params> offered = std::nullopt)
     : WS_connector(std::move(on_connect)),
-      key_(std::move(key))
+      key_(std::move(key)),
+      offered_(std::move(offered))
   {
   }
 
@@ -189,6 +210,7 @@ public:
 
 private:
   std::string key_;
+  std::optional<WS_deflate_params> offered_;
 
 }; // < WS_client_connector
 
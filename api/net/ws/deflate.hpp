@@ -0,0 +1,116 @@
+#pragma once
+#ifndef NET_WS_DEFLATE_HPP
+#define NET_WS_DEFLATE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <util/detail/string_view>
+
+namespace net {
+
+/**
+ * @brief      The parameters of the permessage-deflate extension (RFC 7692).
+ *
+ *             As configuration, the most a server agrees to. As the result
+ *             of negotiation, what both ends have agreed on.
+ */
+struct WS_deflate_params {
+  // LZ77 window of the server's compressor, 8 to 15
+  uint8_t server_max_window_bits = 15;
+  // LZ77 window of the client's compressor, 8 to 15
+  uint8_t client_max_window_bits = 15;
+  // memory for our compressor's hash table, 1 to 9 (as for zlib)
+  uint8_t mem_level = 8;
+  // the server's compressor starts over for every message
+  bool    server_no_context_takeover = false;
+  // the client's compressor starts over for every message
+  bool    client_no_context_takeover = false;
+  // smaller messages are sent as they are
+  size_t  min_size = 32;
+
+  /**
+   * @brief      Server side: pick the first acceptable offer
+   *
+   * @param[in]  offers    The Sec-WebSocket-Extensions field of the request
+   * @param[in]  config    What the server agrees to
+   * @param      agreed    The parameters agreed on
+   * @param      response  The Sec-WebSocket-Extensions field for the response
+   *
+   * @return     false if none was acceptable
+   */
+  static bool negotiate(util::csview offers, const WS_deflate_params& config,
+                        WS_deflate_params& agreed, std::string& response);
+
+  /** Client side: the Sec-WebSocket-Extensions field to offer */
+  std::string offer() const;
+
+  /**
+   * @brief      Client side: read the server's response to offer()
+   *
+   * @param[in]  response  The Sec-WebSocket-Extensions field of the response
+   * @param      agreed    The parameters agreed on, starting from what was offered
+   *
+   * @return     false if the response is not valid for the offer
+   */
+  static bool accept(util::csview response, WS_deflate_params& agreed);
+};
+
+/**
+ * @brief      Raw DEFLATE (RFC 1951) compressor, ending each message with
+ *             a sync flush whose final 4 bytes are left out (RFC 7692 7.2.1).
+ *
+ *             Greedy LZ77 matches over hash chains, coded with the fixed
+ *             Huffman codes. The window is kept from one message to the
+ *             next unless asked to start over.
+ */
+class WS_deflater {
+public:
+  WS_deflater(int window_bits = 15, int mem_level = 8);
+
+  /**
+   * @brief      Compress a message, appending to out
+   *
+   * @param[in]  reset  Start over without the earlier messages (no context takeover)
+   */
+  void compress(const uint8_t* data, size_t len, std::vector<uint8_t>& out, bool reset);
+
+private:
+  const size_t          window_;
+  const int             hash_bits_;
+  std::vector<uint8_t>  buf_;   // the window, then the message
+  uint32_t              base_ = 0;  // absolute position of buf_[0]
+  std::vector<uint32_t> head_;  // absolute position + 1, by hash
+  std::vector<uint32_t> prev_;  // earlier position with the same hash, by position
+
+  uint32_t hash(const uint8_t* p) const noexcept;
+};
+
+/**
+ * @brief      Raw DEFLATE decompressor for messages from a WS_deflater
+ *             (or any permessage-deflate peer).
+ */
+class WS_inflater {
+public:
+  WS_inflater(int window_bits = 15)
+    : window_(size_t(1) << window_bits) {}
+
+  /**
+   * @brief      Decompress a message, appending to out
+   *
+   * @param[in]  reset     Start over without the earlier messages
+   * @param[in]  max_size  The most it may decompress to (0 = no limit)
+   *
+   * @return     false if the data is not valid, or too large
+   */
+  bool decompress(const uint8_t* data, size_t len, std::vector<uint8_t>& out,
+                  bool reset, size_t max_size = 0);
+
+private:
+  const size_t          window_;
+  std::vector<uint8_t>  buf_;   // the window, then the message
+};
+
+} // < namespace net
+
+#endif
@@ -6,6 +6,9 @@
 #include <cstdint>
 #include <cstring>
 #include <cassert>
+#if defined(__SSE2__)
+  #include <immintrin.h>
+#endif
 
 namespace net {
 
@@ -47,6 +50,14 @@ namespace net {
       assert(data_length() == len);
     }
 
+    // RSV1, set on the first frame of a permessage-deflate message
+    bool is_compressed() const noexcept {
+      return bits & 0x40;
+    }
+    void set_compressed() noexcept {
+      bits |= 0x40;
+    }
+
     bool is_ext() const noexcept {
       return payload() == 126;
     }
@@ -116,11 +127,45 @@ namespace net {
     }
     void masking_algorithm(char* ptr)
     {
-      const char* mask = keymask();
-      for (size_t i = 0; i < data_length(); i++)
+      mask(ptr, data_length(), keymask());
+    }
+
+    /**
+     * XOR data with a 4-byte key, repeated (RFC 6455 5.3).
+     * Wide blocks at a time, as the key lines up with every
+     * block that starts at a multiple of 4
+     */
+    static void mask(char* ptr, size_t len, const char* key) noexcept
+    {
+      uint32_t key32;
+      memcpy(&key32, key, sizeof(key32));
+      size_t i = 0;
+#if defined(__AVX2__)
+      const __m256i key256 = _mm256_set1_epi32(key32);
+      for (; i + 32 <= len; i += 32)
+      {
+        auto* p = (__m256i*) &ptr[i];
+        _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), key256));
+      }
+#endif
+#if defined(__SSE2__)
+      const __m128i key128 = _mm_set1_epi32(key32);
+      for (; i + 16 <= len; i += 16)
+      {
+        auto* p = (__m128i*) &ptr[i];
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+      }
+#endif
+      const uint64_t key64 = ((uint64_t) key32 << 32) | key32;
+      for (; i + 8 <= len; i += 8)
       {
-        ptr[i] = ptr[i] xor mask[i & 3];
+        uint64_t v;
+        memcpy(&v, &ptr[i], sizeof(v));
+        v ^= key64;
+        memcpy(&ptr[i], &v, sizeof(v));
       }
+      for (; i < len; i++)
+        ptr[i] ^= key[i & 3];
     }
 
     char vla[0];
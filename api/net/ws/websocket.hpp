@@ -4,10 +4,12 @@
 #define NET_WS_WEBSOCKET_HPP
 
 #include "header.hpp"
+#include "deflate.hpp"
 
 #include <net/http/server.hpp>
 #include <net/http/basic_client.hpp>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <vector>
 
@@ -23,39 +25,54 @@ public:
   class Message {
   public:
     using Data     = std::vector<uint8_t>;
-    using Data_it  = Data::iterator;
-    using Data_cit = Data::const_iterator;
+    using Data_it  = uint8_t*;
+    using Data_cit = const uint8_t*;
 
-    auto extract_vector() noexcept {
+    auto extract_vector() {
+      if (buffer_ != nullptr)
+        return Data(cbegin(), cend());
       return std::move(data_);
     }
     auto extract_shared_vector() {
-      return std::make_shared<std::vector<uint8_t>> (std::move(data_));
+      return std::make_shared<std::vector<uint8_t>> (extract_vector());
     }
 
     std::string to_string() const
     { return std::string(data(), size()); }
 
     size_t size() const noexcept
-    { return data_.size(); }
+    { return (buffer_ != nullptr) ? view_len_ : data_.size(); }
 
     Data_it begin() noexcept
-    { return data_.begin(); }
+    { return bytes(); }
 
     Data_it end() noexcept
-    { return data_.end(); }
+    { return bytes() + size(); }
 
     Data_cit cbegin() const noexcept
-    { return data_.begin(); }
+    { return bytes(); }
 
     Data_cit cend() const noexcept
-    { return data_.end(); }
+    { return bytes() + size(); }
 
     const char* data() const noexcept
-    { return (const char*) data_.data(); }
+    { return (const char*) bytes(); }
 
     char* data() noexcept
-    { return (char*) data_.data(); }
+    { return (char*) bytes(); }
+
+    /** Whether the payload is a view into the buffer it was received in */
+    bool is_view() const noexcept
+    { return buffer_ != nullptr; }
+
+    /** Replace the payload, as when it was decompressed */
+    void set_data(Data data) noexcept
+    {
+      buffer_   = nullptr;
+      view_     = nullptr;
+      view_len_ = 0;
+      data_     = std::move(data);
+    }
 
     Message(const uint8_t* data, size_t len)
     {
@@ -74,10 +91,28 @@ public:
       this->append(data, len);
     }
 
+    /**
+     * A whole frame within a received buffer, used where it is
+     *
+     * @param  buffer  The buffer
+     * @param  offset  Where the frame starts
+     */
+    Message(Stream::buffer_t buffer, size_t offset)
+      : buffer_(std::move(buffer))
+    {
+      auto* frame = buffer_->data() + offset;
+      const auto& wsh = *(ws_header*) frame;
+      this->header_length = wsh.header_length();
+      std::memcpy(header_.data(), frame, this->header_length);
+      view_     = frame + this->header_length;
+      view_len_ = wsh.data_length();
+      Expects(offset + this->header_length + view_len_ <= buffer_->size());
+    }
+
     size_t append(const uint8_t* data, size_t len);
 
     bool is_complete() const noexcept
-    { return header_complete() && data_.size() == header().data_length(); }
+    { return header_complete() && size() == header().data_length(); }
 
     const ws_header& header() const noexcept
     { return *(ws_header*) header_.data(); }
@@ -88,11 +123,15 @@ public:
     void unmask() noexcept
     {
       if (header().is_masked())
-          writable_header().masking_algorithm(this->data());
+          ws_header::mask(this->data(), size(), writable_header().keymask());
     }
 
   private:
     Data data_;
+    // set when the payload is a view
+    Stream::buffer_t buffer_ = nullptr;
+    uint8_t* view_ = nullptr;
+    size_t   view_len_ = 0;
     std::array<uint8_t, 15> header_;
     uint8_t header_length = 0;
 
@@ -100,9 +139,12 @@ public:
       return header_length >= 2 && header_length >= header().header_length();
     }
 
-    ws_header& writable_header()
+    ws_header& writable_header() const
     { return *(ws_header*) header_.data(); }
 
+    uint8_t* bytes() const noexcept
+    { return (buffer_ != nullptr) ? view_ : (uint8_t*) data_.data(); }
+
   }; // < class Message
 
   using Message_ptr     = std::unique_ptr<Message>;
@@ -125,28 +167,64 @@ public:
   // if a ping resulted in a timeout
   typedef delegate<void(WebSocket& ws)> pong_timeout_func;
 
+  /**
+   * @brief      A message to be sent to many WebSockets.
+   *
+   *             Framed once for all server-side WebSockets, and compressed
+   *             once (per window size) for all of them whose compressor
+   *             starts over for every message (server_no_context_takeover).
+   *             The others compress it on their own.
+   */
+  class Broadcast {
+  public:
+    Broadcast(const char* data, size_t len, op_code code = op_code::TEXT);
+
+    const char* data() const noexcept
+    { return (const char*) plain_->data() + offset_; }
+
+    size_t size() const noexcept
+    { return plain_->size() - offset_; }
+
+    op_code code() const noexcept
+    { return code_; }
+
+  private:
+    friend class WebSocket;
+    const op_code    code_;
+    Stream::buffer_t plain_;
+    size_t           offset_;
+    // by window bits, 8 to 15
+    std::array<Stream::buffer_t, 8> compressed_;
+
+    const Stream::buffer_t& compressed(int window_bits, int mem_level);
+  };
+
   /**
    * @brief      Upgrade a HTTP Request to a WebSocket connection.
    *
-   * @param      req     The HTTP request
-   * @param      writer  The HTTP response writer
+   * @param      req      The HTTP request
+   * @param      writer   The HTTP response writer
+   * @param[in]  deflate  Agree to permessage-deflate, if offered, within these
    *
    * @return     A WebSocket_ptr, or nullptr if upgrade fails.
    */
-  static WebSocket_ptr upgrade(http::Request& req, http::Response_writer& writer);
+  static WebSocket_ptr upgrade(http::Request& req, http::Response_writer& writer,
+                               std::optional<WS_deflate_params> deflate = std::nullopt);
 
   /**
    * @brief      Upgrade a HTTP Response to a WebSocket connection.
    *
-   * @param[in]  err   The HTTP error
-   * @param      res   The HTTP response
-   * @param      conn  The HTTP connection
-   * @param      key   The WS key sent in the HTTP request
+   * @param[in]  err      The HTTP error
+   * @param      res      The HTTP response
+   * @param      conn     The HTTP connection
+   * @param      key      The WS key sent in the HTTP request
+   * @param[in]  offered  The permessage-deflate parameters offered, if any
    *
    * @return     A WebSocket_ptr, or nullptr if upgrade fails.
    */
   static WebSocket_ptr upgrade(http::Error err, http::Response& res,
-                               http::Connection& conn, const std::string& key);
+                               http::Connection& conn, const std::string& key,
+                               std::optional<WS_deflate_params> offered = std::nullopt);
 
   /**
    * @brief      Generate a random WebSocket key
@@ -161,33 +239,39 @@ public:
    * @param      client    The HTTP client
    * @param[in]  dest      The destination
    * @param[in]  callback  The connect callback
+   * @param[in]  deflate   Offer permessage-deflate with these (optional)
    */
   static void connect(http::Basic_client&   client,
                       uri::URI        dest,
-                      Connect_handler callback);
+                      Connect_handler callback,
+                      std::optional<WS_deflate_params> deflate = std::nullopt);
 
   /**
    * @brief      Creates a request handler on heap.
    *
    * @param[in]  on_connect  On connect handler
    * @param[in]  on_accept   On accept (optional)
+   * @param[in]  deflate     Agree to permessage-deflate within these (optional)
    *
    * @return     A Request handler for a http::Server
    */
   static http::Server::Request_handler
   create_request_handler(Connect_handler on_connect,
-                         Accept_handler  on_accept = nullptr);
+                         Accept_handler  on_accept = nullptr,
+                         std::optional<WS_deflate_params> deflate = std::nullopt);
 
   /**
    * @brief      Creates a response handler on heap.
    *
    * @param[in]  on_connect  On connect handler
    * @param[in]  key         The WebSocket key sent in outgoing HTTP header
+   * @param[in]  offered     The permessage-deflate parameters offered, if any
    *
    * @return     A Response handler for a http::Client
    */
   static http::Basic_client::Response_handler
-  create_response_handler(Connect_handler on_connect, std::string key);
+  create_response_handler(Connect_handler on_connect, std::string key,
+                          std::optional<WS_deflate_params> offered = std::nullopt);
 
   void write(const char* buffer, size_t len, op_code = op_code::TEXT);
   void write(Stream::buffer_t, op_code = op_code::TEXT);
@@ -202,6 +286,24 @@ public:
     write((char *)data->data(),data->size());
   }
 
+  /** Write a message shared with other WebSockets, see Broadcast */
+  void write(Broadcast&);
+
+  /**
+   * @brief      Write a message to each WebSocket in a range, framing
+   *             and compressing it as few times as possible
+   *
+   * @param[in]  first, last  Range of WebSocket pointers (raw or smart)
+   * @param      msg          The message
+   */
+  template <typename It>
+  static void broadcast(It first, It last, Broadcast& msg)
+  {
+    for (; first != last; ++first)
+      if (*first != nullptr and (*first)->is_alive())
+        (*first)->write(msg);
+  }
+
   bool ping(const char* buffer, size_t len, Timer::duration_t timeout)
   {
     ping_timer.start(timeout);
@@ -231,6 +333,10 @@ public:
   bool is_client() const noexcept {
     return this->clientside;
   }
+  /** The permessage-deflate parameters agreed on, or nullptr if not in use */
+  const WS_deflate_params* deflate_params() const noexcept {
+    return (deflate_ != nullptr) ? &deflate_->params : nullptr;
+  }
   const auto& get_connection() const noexcept {
     return this->stream;
   }
@@ -264,6 +370,18 @@ public:
   }
 
 private:
+  struct Deflate {
+    Deflate(const WS_deflate_params& agreed, bool client);
+
+    WS_deflate_params params;
+    WS_deflater deflater;
+    WS_inflater inflater;
+    // whether our / the peer's compressor starts over for every message
+    bool reset_out;
+    bool reset_in;
+    std::vector<uint8_t> out;
+  };
+
   net::Stream_ptr stream;
   Timer ping_timer{{this, &WebSocket::pong_timeout}};
   Message_ptr message;
@@ -271,6 +389,7 @@ private:
   bool     clientside;
   bool     m_busy = false;
   uint16_t m_deferred_close = 0;
+  std::unique_ptr<Deflate> deflate_ = nullptr;
 
   WebSocket(const WebSocket&) = delete;
   WebSocket(WebSocket&&) = delete;
@@ -280,7 +399,7 @@ private:
   bool write_opcode(op_code code, const char*, size_t);
   void failure(const std::string&);
   void close_callback_once();
-  size_t create_message(const uint8_t*, size_t len);
+  size_t create_message(const Stream::buffer_t&, size_t offset);
   void finalize_message();
 
   bool default_on_ping(const char*, size_t)
@@ -65,6 +65,12 @@ namespace os {
   /** Time spent sleeping (halt) in nanoseconds **/
   uint64_t nanos_asleep() noexcept;
 
+  /**
+   *  Time this CPU was ready to run, but the hypervisor ran something else
+   *  (steal time), in nanoseconds. 0 where the hypervisor doesn't tell.
+   */
+  uint64_t nanos_stolen() noexcept;
+
 
   //
   // Panic
@@ -113,6 +119,13 @@ namespace os {
    */
   void print_timestamps(bool enabled);
 
+  /**
+   *  Print how long each phase of the boot took, up to Service::start.
+   *  Printed by itself at boot when timestamps are enabled. In cycles
+   *  rather than microseconds where the CPU frequency is unknown.
+   */
+  void print_boot_timeline();
+
   /** Print current call stack **/
   void print_backtrace() noexcept;
 
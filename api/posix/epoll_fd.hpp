@@ -0,0 +1,46 @@
+#pragma once
+#ifndef POSIX_EPOLL_FD_HPP
+#define POSIX_EPOLL_FD_HPP
+
+#include "fd.hpp"
+#include <sys/epoll.h>
+#include <deque>
+#include <unordered_map>
+
+/**
+ * An epoll instance. The FDs it watches tell it when they may have become
+ * ready, so waiting only looks at those, and not at every FD.
+ */
+class Epoll_FD : public FD {
+public:
+  explicit Epoll_FD(const int id)
+    : FD(id)
+  {}
+
+  int  ctl(int op, int fd, struct epoll_event*);
+  // wait up to @timeout ms (-1: forever) for events, returns how many
+  int  wait(struct epoll_event*, int maxevents, int timeout);
+
+  int  close() override;
+
+  int  poll_events() override
+  { return ready_.empty() ? 0 : POLLIN; }
+
+  ~Epoll_FD();
+
+private:
+  struct Entry {
+    uint32_t     events;
+    epoll_data_t data;
+    bool         queued = false;
+  };
+  // by FD id, as ids aren't reused
+  std::unordered_map<int, Entry> interest_;
+  // FDs that may be ready
+  std::deque<int> ready_;
+
+  void on_ready(FD&);
+  void queue(int id, Entry&);
+};
+
+#endif
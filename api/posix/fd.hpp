@@ -6,8 +6,12 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <cstdarg>
+#include <delegate>
 #include <errno.h>
+#include <utility>
+#include <vector>
 
 #define DEFAULT_ERR EPERM
 /**
@@ -27,6 +31,7 @@ public:
   virtual ssize_t read(void*, size_t) { return -DEFAULT_ERR; }
   virtual ssize_t readv(const struct iovec*, int) { return -DEFAULT_ERR; }
   virtual int     write(const void*, size_t) { return -DEFAULT_ERR; }
+  virtual ssize_t writev(const struct iovec*, int iovcnt);
   virtual int     close() = 0;
   virtual int     fcntl(int, va_list);
   virtual int     ioctl(int, void*);
@@ -40,8 +45,10 @@ public:
   virtual ssize_t recv(void *, size_t, int) { return 0; }
   virtual ssize_t recvfrom(void *__restrict__, size_t, int, struct sockaddr *__restrict__, socklen_t *__restrict__) { return 0; }
   virtual ssize_t recvmsg(struct msghdr *, int) { return 0; }
+  virtual int     recvmmsg(struct mmsghdr *, unsigned int, int, struct timespec *) { return -ENOTSOCK; }
   virtual ssize_t send(const void *, size_t, int) { return 0; }
   virtual ssize_t sendmsg(const struct msghdr *, int) { return 0; }
+  virtual int     sendmmsg(struct mmsghdr *, unsigned int, int) { return -ENOTSOCK; }
   virtual ssize_t sendto(const void *, size_t, int, const struct sockaddr *, socklen_t) { return 0; }
   virtual int     setsockopt(int, int, const void *, socklen_t);
   virtual int     shutdown(int) { return -1; }
@@ -57,10 +64,21 @@ public:
   virtual int   mkfifoat(const char *, mode_t) { return -1; }
   virtual int   mknodat(const char *, mode_t, dev_t) { return -1; }
   virtual off_t lseek(off_t, int) { return -DEFAULT_ERR; }
+  // read-only mapping of len bytes from offset, or -errno
+  virtual void* mmap(size_t, off_t) { return (void*) -ENODEV; }
 
   // linux specific
   virtual long getdents(struct dirent*, unsigned int) { return -1; }
 
+  /** READINESS, for epoll **/
+  // the POLL* events that can be handled now without blocking
+  virtual int poll_events() { return POLLIN | POLLOUT; }
+
+  using watcher_t = delegate<void(FD&)>;
+  // call @func whenever the readiness may have changed, until unwatched
+  void watch(void* owner, watcher_t func);
+  void unwatch(void* owner);
+
   id_t get_id() const noexcept { return id_; }
 
   virtual bool is_file() { return false; }
@@ -70,20 +88,30 @@ public:
   bool operator!=(const FD& fd) const noexcept { return !(*this == fd); }
 
   bool is_blocking() const noexcept {
-    return this->non_blocking == 0;
+    return (this->fflags & O_NONBLOCK) == 0;
+  }
+  void set_blocking(bool blocking) noexcept {
+    if (blocking) fflags &= ~O_NONBLOCK;
+    else fflags |= O_NONBLOCK;
   }
 
   virtual ~FD() {}
 
+protected:
+  // let the watchers know, when something may have become ready
+  void notify_ready()
+  {
+    if (watchers_.empty()) return;
+    for (size_t i = 0; i < watchers_.size(); i++)
+      watchers_[i].second(*this);
+  }
+
 private:
+  std::vector<std::pair<void*, watcher_t>> watchers_;
   const id_t id_;
   int dflags;
-  union {
-    struct {
-      int   non_blocking : 1;
-    };
-    int fflags;
-  };
+  // file status flags, O_NONBLOCK and such
+  int fflags;
 };
 
 #endif
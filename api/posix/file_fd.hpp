@@ -4,6 +4,7 @@
 
 #include "fd.hpp"
 #include <fs/dirent.hpp>
+#include <memory>
 
 class File_FD : public FD {
 public:
@@ -17,6 +18,21 @@ public:
   int write(const void*, size_t) override;
   int close() override;
   off_t lseek(off_t, int) override;
+  void* mmap(size_t len, off_t offset) override;
+
+  /** Release a mapping made by mmap, false if addr is not one */
+  static bool munmap(void* addr);
+
+  /**
+   * Up to @len bytes from @offset, for sending elsewhere. Files on a memdisk
+   * are referenced where they are, leaving @owner empty, otherwise they are
+   * read into a buffer which @owner keeps alive.
+   * Returns the number of bytes, 0 at the end of the file, or -errno.
+   */
+  ssize_t peek(uint64_t offset, size_t len,
+               const uint8_t*& data, std::shared_ptr<const void>& owner);
+
+  uint64_t offset() const noexcept { return offset_; }
 
   long getdents(struct dirent *dirp, unsigned int count) override;
 
@@ -0,0 +1,17 @@
+#pragma once
+#ifndef POSIX_POLL_HPP
+#define POSIX_POLL_HPP
+
+#include <poll.h>
+#include <chrono>
+
+/**
+ * Fill in the revents of @fds, and when none of them are ready, wait for
+ * up to @timeout (negative: forever) for one to become ready. The FDs are
+ * only looked at again when one of them says its readiness may have changed.
+ *
+ * @return the number of entries with revents set
+ */
+int fd_poll(struct pollfd* fds, nfds_t nfds, std::chrono::nanoseconds timeout);
+
+#endif
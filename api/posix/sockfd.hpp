@@ -16,6 +16,14 @@ public:
   bool is_socket() override { return true; }
 };
 
+/**
+ * IncludeOS recvmsg flag: instead of copying into the buffers of msg_iov,
+ * point them at the received data where it lies in the network buffers.
+ * The data is lent until the next receive on the socket, or until it is
+ * closed. Only stream sockets lend, the others ignore the flag.
+ */
+#define MSG_HANDOFF 0x10000000
+
 struct sockaddr;
 typedef uint32_t socklen_t;
 extern bool validate_sockaddr_in(const struct sockaddr*, socklen_t);
@@ -5,6 +5,7 @@
 
 #include "sockfd.hpp"
 
+class File_FD;
 struct TCP_FD_Conn;
 struct TCP_FD_Listen;
 
@@ -17,7 +18,9 @@ public:
   {}
 
   ssize_t read(void*, size_t) override;
+  ssize_t readv(const struct iovec*, int iovcnt) override;
   int     write(const void*, size_t) override;
+  ssize_t writev(const struct iovec*, int iovcnt) override;
   int     close() override;
 
   /** SOCKET */
@@ -31,9 +34,32 @@ public:
                  const struct sockaddr*, socklen_t) override;
   ssize_t recv(void*, size_t, int fl) override;
   ssize_t recvfrom(void*, size_t, int fl, struct sockaddr*, socklen_t *) override;
+  // with MSG_HANDOFF, lends the received data instead of copying it
+  ssize_t recvmsg(struct msghdr*, int fl) override;
+
+  /**
+   * Receive up to @len bytes without copying, by handing over the buffers
+   * they arrived in. The caller owns them as long as it keeps the slices,
+   * so that the data can be parsed in place.
+   */
+  ssize_t recv_slices(net::tcp::Slice_chain& out, size_t len, int fl);
+
+  /**
+   * Send @count bytes of a file from @offset, or from (and advancing) the
+   * file offset when it is null. Files on a memdisk go into the write queue
+   * without being copied, other files without a copy in between.
+   */
+  ssize_t sendfile(File_FD&, off_t* offset, size_t count);
+  // the most read from a file before it is queued
+  static constexpr size_t SENDFILE_CHUNK = 64 * 1024;
 
   int     shutdown(int) override;
 
+  int     getsockopt(int, int, void *__restrict__, socklen_t *__restrict__) override;
+  int     setsockopt(int, int, const void *, socklen_t) override;
+
+  int     poll_events() override;
+
   bool is_listener() const noexcept {
     return ld != nullptr;
   }
@@ -48,6 +74,12 @@ public:
 private:
   std::unique_ptr<TCP_FD_Conn> cd = nullptr;
   TCP_FD_Listen* ld = nullptr;
+  // SO_REUSEPORT: bind to the listener of this CPU, on a sharded port
+  bool reuse_port = false;
+  // TCP_CORK: set on the connection once there is one
+  bool cork = false;
+
+  void set_connection(std::unique_ptr<TCP_FD_Conn>);
 
   friend struct TCP_FD_Listen;
 };
@@ -56,20 +88,48 @@ struct TCP_FD_Conn
 {
   TCP_FD_Conn(net::tcp::Connection_ptr c);
 
-  void retrieve_buffer();
+  void retrieve_data();
+  void data_ready();
   void set_default_read();
+  void set_default_write();
+  // block until there is data, or nothing more will come (false)
+  bool await_data();
 
   ssize_t send(const void *, size_t, int fl);
+  // one write, so that the buffers leave in the same segments
+  ssize_t send(net::tcp::buffer_t, int fl);
+  // without copying @data, which @owner (if any) keeps alive until acked
+  ssize_t send(const void* data, size_t, std::shared_ptr<const void> owner, int fl);
   ssize_t recv(void*, size_t, int fl);
+  // scatter what has arrived over the buffers
+  ssize_t recv(const struct iovec*, int iovcnt, int fl);
+  // hand over the slices of up to @len bytes
+  ssize_t recv(net::tcp::Slice_chain& out, size_t len, int fl);
+  // point the buffers at the data, which stays lent until the next receive
+  ssize_t lend(struct iovec*, int iovcnt, int fl);
   int     close();
   int     shutdown(int);
 
+  // recv would have to wait for data
+  bool recv_would_block() const {
+    return slices.empty() and not conn->is_closed() and not recv_disc;
+  }
+  // a non-blocking send would find the send buffer full
+  bool send_would_block() const {
+    return conn->sendq_remaining() >= SEND_BUFFER;
+  }
+  // unsent bytes queued before non-blocking sends get EAGAIN
+  static constexpr uint32_t SEND_BUFFER = 256 * 1024;
+
   std::string to_string() const { return conn->to_string(); }
 
   net::tcp::Connection_ptr conn;
-  net::tcp::buffer_t buffer;
-  size_t buf_offset;
+  net::tcp::Slice_chain slices;
+  // the data a MSG_HANDOFF receive pointed at
+  net::tcp::Slice_chain lent;
   bool recv_disc = false;
+  // called when there may be something to read, or the state changed
+  delegate<void()> on_ready = nullptr;
 };
 
 struct TCP_FD_Listen
@@ -87,6 +147,8 @@ struct TCP_FD_Listen
 
   net::tcp::Listener& listener;
   std::deque<std::unique_ptr<TCP_FD_Conn>> connq;
+  // called when a connection is queued
+  delegate<void()> on_ready = nullptr;
 };
 
 inline net::tcp::Connection_ptr TCP_FD::get_connection() noexcept {
@@ -25,7 +25,9 @@ public:
   ~UDP_FD();
 
   ssize_t read(void*, size_t) override;
+  ssize_t readv(const struct iovec*, int iovcnt) override;
   int     write(const void*, size_t) override;
+  ssize_t writev(const struct iovec*, int iovcnt) override;
   int     close() override;
 
   /** SOCKET */
@@ -33,15 +35,20 @@ public:
   long    connect(const struct sockaddr *, socklen_t) override;
 
   ssize_t sendto(const void *, size_t, int, const struct sockaddr *, socklen_t) override;
+  int     sendmmsg(struct mmsghdr *, unsigned int, int) override;
 
   ssize_t recv(void*, size_t, int fl) override;
   ssize_t recvfrom(void *__restrict__, size_t, int, struct sockaddr *__restrict__, socklen_t *__restrict__) override;
+  int     recvmmsg(struct mmsghdr *, unsigned int, int, struct timespec *) override;
 
   int     shutdown(int) override { return 0; }
 
   int     getsockopt(int, int, void *__restrict__, socklen_t *__restrict__) override;
   int     setsockopt(int, int, const void *, socklen_t) override;
 
+  int     poll_events() override
+  { return buffer_.empty() ? POLLOUT : (POLLIN | POLLOUT); }
+
   struct Message {
     Message(const in_addr_t addr, const in_port_t port, net::tcp::buffer_t buf)
       : buffer(std::move(buf))
@@ -64,6 +71,7 @@ private:
   int                 rcvbuf_;
 
   void recv_to_buffer(net::udp::addr_t, net::udp::port_t, const char*, size_t);
+  void recv_batch_to_buffer(const net::udp::Datagram*, size_t);
   void set_default_recv();
   int read_from_buffer(void*, size_t, int, struct sockaddr*, socklen_t*);
 
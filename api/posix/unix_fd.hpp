@@ -20,6 +20,10 @@ public:
   ssize_t sendto(const void* buf, size_t, int fl,
                  const struct sockaddr* addr, socklen_t addrlen) override;
   int     close() override;
+
+  // only for sending, once connected
+  int     poll_events() override
+  { return impl ? POLLOUT : 0; }
 private:
   Impl* impl = nullptr;
   const int type_; // it's probably gonna be necessary
@@ -62,10 +62,24 @@ namespace os::mem::buddy {
       return ((pool_size / min_size) * 2) - 1;
     }
 
+    /**
+     * Words of the free block bitmaps: for each level of the tree,
+     * a bit per node and a summary bit per word of those.
+     **/
+    static constexpr Size_t free_map_words(Size_t pool_size) {
+      Size_t words = 0;
+      for (Size_t nodes = 1; nodes <= pool_size / min_size; nodes *= 2) {
+        const Size_t level = (nodes + 63) / 64;
+        words += level + (level + 63) / 64;
+      }
+      return words;
+    }
+
     static constexpr Size_t overhead(Size_t pool_size) {
       using namespace util;
       auto nodes_size  = node_count(pool_size) * sizeof(Node_t);
-      auto overhead_   = bits::roundto(min_size, sizeof(Alloc) + nodes_size);
+      auto map_size    = sizeof(uint64_t) + free_map_words(pool_size) * sizeof(uint64_t);
+      auto overhead_   = bits::roundto(min_size, sizeof(Alloc) + nodes_size + map_size);
       return overhead_;
     }
 
@@ -220,7 +234,9 @@ namespace os::mem::buddy {
 
     Alloc(void* start, Size_t bufsize, Size_t pool_size)
       : nodes_{(Node_t*)start, node_count(pool_size)},
-        start_addr_{util::bits::roundto(min_size, (Addr_t)start + node_count(pool_size))}, addr_limit_{reinterpret_cast<uintptr_t>(start) + bufsize},
+        start_addr_{util::bits::roundto(min_size, free_map_begin(start, pool_size)
+                                        + free_map_words(pool_size) * sizeof(uint64_t))},
+        addr_limit_{reinterpret_cast<uintptr_t>(start) + bufsize},
         pool_size_{pool_size}
 
     {
@@ -231,6 +247,16 @@ namespace os::mem::buddy {
       Ensures(bufsize >= overhead(pool_size));
       // Initialize nodes
       memset(nodes_.data(), 0, nodes_.size() * sizeof(Node_arr::element_type));
+      // Initialize free block bitmaps, where the root is the only free block
+      auto* map = (uint64_t*) free_map_begin(start, pool_size);
+      memset(map, 0, free_map_words(pool_size) * sizeof(uint64_t));
+      for (int h = 1; h <= tree_height(); h++) {
+        const Size_t words = ((Size_t(1) << (h - 1)) + 63) / 64;
+        free_map_[h] = map;
+        free_sum_[h] = map + words;
+        map += words + (words + 63) / 64;
+      }
+      set_free(0);
     }
 
     /**
@@ -250,6 +276,17 @@ namespace os::mem::buddy {
       return alloc;
     }
 
+    /**
+     * Where the pool of an allocator created on addr would start
+     **/
+    template <Policy P = Policy::overbook>
+    static Addr_t pool_begin(void* addr, Size_t bufsize) {
+      const Size_t pool_size_ = pool_size<P>(bufsize);
+      auto* start = (char*)addr + sizeof(Alloc);
+      return util::bits::roundto(min_size, free_map_begin(start, pool_size_)
+                                 + free_map_words(pool_size_) * sizeof(uint64_t));
+    }
+
 
     Size_t chunksize(Size_t wanted_sz) const noexcept {
       auto sz = util::bits::next_pow2(wanted_sz);
@@ -300,25 +337,103 @@ namespace os::mem::buddy {
 
       Expects(start_addr_);
 
-      auto node = root();
-
       auto sz = chunksize(size);
       if (not sz) return 0;
 
       // Start allocation tracker
       alloc_tracker(Track::start);
 
-      auto res = node.allocate(sz);
+      const int target = level_of_size(sz);
+      while (true)
+      {
+        // The smallest free block that fits, lowest address first
+        int h = target;
+        while (h > 0 and free_count_[h] == 0) h--;
+        if (h == 0) return 0;
+
+        auto i = find_free(h);
+        clear_free(i);
+        // Split it down to the size wanted, the right halves becoming free
+        for (; h < target; h++) {
+          alloc_tracker(Track::inc);
+          set_free(i * 2 + 2);
+          i = i * 2 + 1;
+        }
+        Node_view node(i, this);
+        auto res = node.allocate_self();
+        mark_allocated(i);
+
+        // For overbooking allocator, allow unusable memory to gradually become
+        // marked as allocated, without actually handing it out.
+        if (UNLIKELY(res + size > addr_limit_)) {
+          overbooked_ = true;
+          continue;
+        }
 
-      // For overbooking allocator, allow unusable memory to gradually become
-      // marked as allocated, without actually handing it out.
-      if (UNLIKELY(res + size > addr_limit_)) {
-        overbooked_ = true;
-        return 0;
+        bytes_used_ += sz;
+        return reinterpret_cast<void*>(res);
       }
+    }
+
+    /**
+     * Allocate from within [begin, end) only, e.g. the memory of one NUMA
+     * node. Returns nullptr when nothing there fits.
+     */
+    void* allocate_in(Size_t size, Addr_t begin, Addr_t end) noexcept {
+
+      Expects(start_addr_);
+
+      auto sz = chunksize(size);
+      if (not sz) return 0;
+      begin = std::max<Addr_t>(begin, start_addr_);
+      end   = std::min<Addr_t>(end, start_addr_ + pool_size_);
+      if (begin >= end) return 0;
+
+      const int target = level_of_size(sz);
+      // the chunks of the target size inside the range, by position
+      const Size_t first = (begin - start_addr_ + sz - 1) / sz;
+      const Size_t last  = (end - start_addr_) / sz;
+      if (first >= last) return 0;
+
+      while (true)
+      {
+        // The smallest free block holding one of them, lowest address first
+        Index_t i = -1;
+        int h = target;
+        for (; h > 0; h--) {
+          const int d = target - h;
+          if (free_count_[h] and (i = find_free(h, first >> d, ((last - 1) >> d) + 1)) >= 0)
+            break;
+        }
+        if (h == 0) return 0;
+
+        clear_free(i);
+        // Split it down, keeping the lowest half that reaches the range
+        for (; h < target; h++) {
+          alloc_tracker(Track::inc);
+          const int d = target - h - 1;
+          const Index_t left = i * 2 + 1;
+          const Size_t left_last = ((pos_in_level(left, h + 1) + 1) << d) - 1;
+          if (left_last >= first) {
+            set_free(left + 1);
+            i = left;
+          } else {
+            set_free(left);
+            i = left + 1;
+          }
+        }
+        Node_view node(i, this);
+        auto res = node.allocate_self();
+        mark_allocated(i);
+
+        if (UNLIKELY(res + size > addr_limit_)) {
+          overbooked_ = true;
+          continue;
+        }
 
-      if (res) bytes_used_ += sz;
-      return reinterpret_cast<void*>(res);
+        bytes_used_ += sz;
+        return reinterpret_cast<void*>(res);
+      }
     }
 
     void deallocate(void* addr, Size_t size) {
@@ -327,6 +442,44 @@ namespace os::mem::buddy {
       auto res = root().deallocate((Addr_t)addr, sz);
       Expects(not size or res == sz);
       bytes_used_ -= res;
+      if (res) mark_freed((Addr_t)addr, res);
+    }
+
+    /** Free blocks, where none can merge with its buddy */
+    Size_t free_blocks() const noexcept {
+      Size_t count = 0;
+      for (int h = 1; h <= tree_height(); h++)
+        count += free_count_[h];
+      return count;
+    }
+
+    /** Free blocks of a size (a power of 2, at least min_size) */
+    Size_t free_blocks(Size_t size) const noexcept {
+      const int h = level_of_size(size);
+      return (h > 0 and h <= tree_height()) ? free_count_[h] : 0;
+    }
+
+    /** The largest block that can be allocated */
+    Size_t largest_free() const noexcept {
+      Size_t best = 0;
+      for (int h = 1; h <= tree_height(); h++)
+      {
+        const Size_t size = min_size << (tree_height() - h);
+        if (size <= best) break;
+        if (free_count_[h] == 0) continue;
+        // with overbooking, blocks may reach past the end of memory
+        const Size_t words = ((Size_t(1) << (h - 1)) + 63) / 64;
+        for (Size_t w = 0; w < words; w++) {
+          for (auto bits = free_map_[h][w]; bits; bits &= bits - 1) {
+            const Addr_t addr = start_addr_ + (w * 64 + __builtin_ctzll(bits)) * size;
+            if (addr + size <= addr_limit_)
+              return size;
+            if (addr < addr_limit_)
+              best = std::max<Size_t>(best, util::bits::keeplast(addr_limit_ - addr));
+          }
+        }
+      }
+      return best >= min_size ? best : 0;
     }
 
     void* do_allocate(std::size_t bytes, std::size_t alignment)  override {
@@ -709,12 +862,106 @@ namespace os::mem::buddy {
     //using Tracker = typename std::enable_if<Track_allocs, Track_res>::type;
     Track_res tr {0,0,0,0,0}; // If tracking enabled
 
+    static Addr_t free_map_begin(void* start, Size_t pool_size) noexcept {
+      return util::bits::roundto(sizeof(uint64_t),
+                                 (Addr_t)start + node_count(pool_size));
+    }
+
+    int level_of_size(Size_t sz) const noexcept {
+      return tree_height() - util::bits::ctz(sz / min_size);
+    }
+
+    static Size_t pos_in_level(Index_t i, int h) noexcept {
+      return i + 1 - (Index_t(1) << (h - 1));
+    }
+
+    void set_free(Index_t i) noexcept {
+      const int h = util::bits::fls(i + 1);
+      const Size_t pos = pos_in_level(i, h);
+      free_map_[h][pos / 64] |= uint64_t(1) << (pos % 64);
+      free_sum_[h][pos / 4096] |= uint64_t(1) << ((pos / 64) % 64);
+      free_count_[h]++;
+    }
+
+    void clear_free(Index_t i) noexcept {
+      const int h = util::bits::fls(i + 1);
+      const Size_t pos = pos_in_level(i, h);
+      auto& word = free_map_[h][pos / 64];
+      word &= ~(uint64_t(1) << (pos % 64));
+      if (word == 0)
+        free_sum_[h][pos / 4096] &= ~(uint64_t(1) << ((pos / 64) % 64));
+      free_count_[h]--;
+    }
+
+    /** The free block with the lowest address on a level (there must be one) */
+    Index_t find_free(int h) const noexcept {
+      for (Size_t s = 0; ; s++) {
+        alloc_tracker(Track::inc);
+        if (auto sum = free_sum_[h][s]) {
+          const Size_t w = s * 64 + __builtin_ctzll(sum);
+          const Size_t pos = w * 64 + __builtin_ctzll(free_map_[h][w]);
+          return (Index_t(1) << (h - 1)) - 1 + pos;
+        }
+      }
+    }
+
+    /** The free block with the lowest address on a level, of those at
+        positions [from, to), or -1 */
+    Index_t find_free(int h, Size_t from, Size_t to) const noexcept {
+      to = std::min<Size_t>(to, Size_t(1) << (h - 1));
+      for (Size_t w = from / 64; w * 64 < to; w++) {
+        alloc_tracker(Track::inc);
+        // skip words with nothing free
+        if (free_sum_[h][w / 64] == 0) {
+          w = (w / 64) * 64 + 63;
+          continue;
+        }
+        auto bits = free_map_[h][w];
+        if (w == from / 64)
+          bits &= ~uint64_t(0) << (from % 64);
+        if (to - w * 64 < 64)
+          bits &= (uint64_t(1) << (to - w * 64)) - 1;
+        if (bits)
+          return (Index_t(1) << (h - 1)) - 1 + w * 64 + __builtin_ctzll(bits);
+      }
+      return -1;
+    }
+
+    /** Update the flags of the parents of a node just taken */
+    void mark_allocated(Index_t i) noexcept {
+      while (i > 0) {
+        const Index_t parent = (i - 1) / 2;
+        const bool full = Node_view(i, this).is_full();
+        if (i & 1)
+          nodes_[parent] |= full ? (Flags::left_used | Flags::left_full) : Flags::left_used;
+        else
+          nodes_[parent] |= full ? (Flags::right_used | Flags::right_full) : Flags::right_used;
+        i = parent;
+      }
+    }
+
+    /** Merge a block just freed with its free buddies */
+    void mark_freed(Addr_t addr, Size_t size) noexcept {
+      const int h = level_of_size(size);
+      Index_t i = (Index_t(1) << (h - 1)) - 1 + (addr - start_addr_) / size;
+      while (i > 0 and nodes_[(i - 1) / 2] == 0) {
+        clear_free((i & 1) ? i + 1 : i - 1);
+        i = (i - 1) / 2;
+      }
+      set_free(i);
+    }
+
     Node_arr nodes_;
     const uintptr_t start_addr_ = 0;
     const uintptr_t addr_limit_ = 0;
     const Size_t pool_size_ = min_size;
     Size_t bytes_used_ = 0;
     bool overbooked_ = false;
+    // Free blocks whose parent is not free, as bits by position on each
+    // level (height) of the tree, with a summary bit per word
+    std::array<uint64_t*, 64> free_map_ {};
+    std::array<uint64_t*, 64> free_sum_ {};
+    std::array<Size_t, 64>    free_count_ {};
   };
 
 }
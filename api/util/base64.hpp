@@ -3,8 +3,7 @@
 #ifndef UTIL_BASE64_HPP
 #define UTIL_BASE64_HPP
 
-#include <algorithm>
-#include <array>
+#include <cstddef>
 #include <cstring>
 #include <stdexcept>
 #include <string>
@@ -65,6 +64,77 @@ inline auto base64url_alphabet() noexcept {
     "-_";
 }
 
+/**
+ * Get the length of the Base64 encoding of some data, with padding
+ *
+ * @param length
+ *   The length of the data as number of char's
+ *
+ * @return The number of char's in the encoding
+ */
+constexpr size_t encoded_size(const size_t length) noexcept {
+  return ((length + 2) / 3) * 4;
+}
+
+/**
+ * Get the largest length that some Base64 data can decode to
+ *
+ * @param length
+ *   The length of the Base64 data as number of char's
+ *
+ * @return The largest number of char's in the decoded data
+ */
+constexpr size_t decoded_size(const size_t length) noexcept {
+  return (length / 4) * 3 + ((length % 4) * 3) / 4;
+}
+
+/**
+ * Encode the specified data into Base64 format, into a buffer owned by
+ * the caller. Whole blocks are encoded with SIMD when the CPU has it.
+ *
+ * @param data
+ *   The data to encode into Base64 format
+ *
+ * @param length
+ *   The length of the data as number of char's
+ *
+ * @param out
+ *   Where to write the encoding, with room for encoded_size(length) char's
+ *
+ * @param url_alphabet_switch
+ *   Whether to use the Base64URL alphabet
+ *
+ * @return The number of char's written
+ */
+size_t encode_into(const void* data, size_t length, char* out,
+                   url_alphabet url_alphabet_switch = url_alphabet{false}) noexcept;
+
+/**
+ * Decode the specified Base64 encoded data into a buffer owned by the
+ * caller. The padding is optional.
+ *
+ * @param data
+ *   The data in Base64 format to decode
+ *
+ * @param length
+ *   The length of the data as number of char's
+ *
+ * @param out
+ *   Where to write the decoded data, with room for decoded_size(length) char's
+ *
+ * @param url_alphabet_switch
+ *   Whether to use the Base64URL alphabet
+ *
+ * @param validate
+ *   Whether to check that the data is Base64. Without, invalid data
+ *   decodes to something unspecified.
+ *
+ * @return The number of char's written, or -1 if the data is invalid
+ */
+long decode_into(const char* data, size_t length, void* out,
+                 url_alphabet url_alphabet_switch = url_alphabet{false},
+                 bool validate = true) noexcept;
+
 /**
  * Encode the specified data into Base64 format
  *
@@ -83,35 +153,9 @@ template<typename R = std::string>
 R encode(const char* data, const size_t length, const url_alphabet url_alphabet_switch = url_alphabet{false}) {
   if (data == nullptr) return R{};
 
-  const char* const alphabet = url_alphabet_switch ? base64url_alphabet() : base64_alphabet();
-  auto encode_unit = [alphabet](const int unit) noexcept -> char {
-    return ((unit >= 0) and (unit < 64)) ? alphabet[unit] : unit;
-  };
-
   R buffer;
-  buffer.reserve(((length + 2) / 3) * 4);
-
-  for (size_t i = 0; i < length; i += 3) {
-    buffer.push_back(encode_unit((data[i] & 0xFC) >> 2));
-    int unit = (data[i] & 0x03) << 4;
-    if ((i + 1) < length) {
-      buffer.push_back(encode_unit(unit | ((data[i + 1] & 0xF0) >> 4)));
-      unit = (data[i + 1] & 0x0F) << 2;
-      if ((i + 2) < length) {
-        buffer.push_back(encode_unit(unit | ((data[i + 2] & 0xC0) >> 6)));
-        buffer.push_back(encode_unit(data[i + 2] & 0x3F));
-      } else  {
-        buffer.push_back(encode_unit(unit));
-        buffer.push_back('=');
-        break;
-      }
-    } else {
-      buffer.push_back(encode_unit(unit));
-      buffer.append("==");
-      break;
-    }
-  }
-
+  buffer.resize(encoded_size(length));
+  encode_into(data, length, buffer.data(), url_alphabet_switch);
   return buffer;
 }
 
@@ -175,46 +219,13 @@ R decode(const char* data, size_t length, const url_alphabet url_alphabet_switch
     throw Decode_error{"Invalid Base64 data"};
   }
 
-  const char* const alphabet = url_alphabet_switch ? base64url_alphabet() : base64_alphabet();
-  auto fetch_unit = [data, alphabet](const size_t i) noexcept -> std::array<char, 4> {
-    std::array<char, 4> unit;
-
-    unit[0] = std::distance(alphabet, std::find(alphabet, (alphabet + 64), data[i]));
-    unit[1] = std::distance(alphabet, std::find(alphabet, (alphabet + 64), data[i + 1]));
-    unit[2] = std::distance(alphabet, std::find(alphabet, (alphabet + 64), data[i + 2]));
-    unit[3] = std::distance(alphabet, std::find(alphabet, (alphabet + 64), data[i + 3]));
-
-    return unit;
-  };
-
   R buffer;
-  buffer.reserve((length * 3) / 4);
-
-  bool has_padding {false};
-  if (data[length - 1] == '=') {
-    has_padding = true;
-    length -= 4;
-  }
-
-  size_t i = 0;
-  for (;i < length; i += 4) {
-    auto&& unit = fetch_unit(i);
-
-    for (int j = 0; j < 4; ++j) {
-      if (unit[j] == 64) throw Decode_error{"Invalid Base64 data"};
-    }
-
-    buffer.push_back((unit[0] << 2) | (unit[1] >> 4));
-    buffer.push_back((unit[1] << 4) | (unit[2] >> 2));
-    buffer.push_back((unit[2] << 6) | unit[3]);
-  }
-
-  if (has_padding) {
-    auto&& unit = fetch_unit(i);
-    buffer.push_back((unit[0] << 2) | (unit[1] >> 4));
-    if (unit[2] < 64) buffer.push_back((unit[1] << 4) | (unit[2] >> 2));
-    if (unit[3] < 64) buffer.push_back((unit[2] << 6) | unit[3]);
+  buffer.resize(decoded_size(length));
+  const long written = decode_into(data, length, buffer.data(), url_alphabet_switch);
+  if (written < 0) {
+    throw Decode_error{"Invalid Base64 data"};
   }
+  buffer.resize(written);
 
   return buffer;
 }
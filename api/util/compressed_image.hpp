@@ -0,0 +1,65 @@
+#pragma once
+#ifndef UTIL_COMPRESSED_IMAGE_HPP
+#define UTIL_COMPRESSED_IMAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * A compressed service image: a header, a table of chunks, then the
+ * chunks, each an LZ4 block of up to chunk_size bytes of the image.
+ * The chunks don't depend on each other, so they are decompressed in
+ * parallel, on every CPU, straight into place. Each has the CRC32 of
+ * what it decompresses to. A chunk that wouldn't shrink is stored as is.
+ *
+ * Used for the service booted by the chainloader and for LiveUpdate
+ * blobs, which can be given either compressed or as plain ELF.
+ */
+namespace compressed_image
+{
+  static constexpr uint32_t MAGIC   = 0x5a4c4f49; // "IOLZ"
+  static constexpr uint16_t VERSION = 1;
+  static constexpr size_t   DEFAULT_CHUNK = 1 << 20;
+
+  // followed by a Chunk for each chunk
+  struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;       // none yet
+    uint32_t chunk_size;
+    uint32_t chunks;
+    uint64_t size;        // of the image, decompressed
+  } __attribute__((packed));
+
+  struct Chunk {
+    uint64_t offset;      // from the start of the compressed image
+    uint32_t length;      // compressed, or the chunk size if stored as is
+    uint32_t crc;         // of the decompressed chunk
+  } __attribute__((packed));
+
+  struct Error : public std::runtime_error {
+    using runtime_error::runtime_error;
+  };
+
+  /** Whether @len bytes at @data look like a compressed image */
+  bool is_compressed(const void* data, size_t len) noexcept;
+
+  /** The size of the decompressed image, 0 if @data isn't compressed */
+  uint64_t decompressed_size(const void* data, size_t len) noexcept;
+
+  /** Compress @len bytes at @data, in chunks of @chunk_size bytes */
+  std::vector<uint8_t> compress(const void* data, size_t len,
+                                size_t chunk_size = DEFAULT_CHUNK);
+
+  /**
+   * Decompress the image of @len bytes at @data into @dest, which has
+   * room for @cap bytes, using every free CPU.
+   * Returns the size of the image. Throws Error if it is malformed,
+   * doesn't fit, or a chunk fails its checksum.
+   */
+  size_t decompress(const void* data, size_t len, void* dest, size_t cap);
+}
+
+#endif
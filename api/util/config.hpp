@@ -12,6 +12,7 @@
 #endif
 
 #include <rapidjson/document.h>
+#include <util/config_value.hpp>
 #include <cstddef>
 
 /**
@@ -35,6 +36,14 @@ public:
    */
   static const rapidjson::Document& doc();
 
+  /**
+   * @brief      Retrieve the config as compiled at build time, which is
+   *             read in place, without parsing or allocating.
+   *
+   * @return     The root value, null when the image has none
+   */
+  static Config_value compiled() noexcept;
+
   const char* data() const noexcept
   { return start_; }
 
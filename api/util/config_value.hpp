@@ -0,0 +1,122 @@
+
+#pragma once
+#ifndef UTIL_CONFIG_VALUE_HPP
+#define UTIL_CONFIG_VALUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+/**
+ * @brief      A value in the config as compiled at build time
+ *             (src/config/config2bin.py), read in place.
+ *
+ * @details    Nothing is parsed or allocated, looking up a member walks
+ *             past the members before it. The methods are named like
+ *             those of rapidjson::Value, so that code can be written
+ *             for both. A member that isn't there, or the value of an
+ *             empty config, is null.
+ */
+class Config_value {
+public:
+  enum Type : uint8_t { NULL_T, FALSE_T, TRUE_T, INT_T, DOUBLE_T, STRING_T, ARRAY_T, OBJECT_T };
+
+  class Iterator;
+  struct Array;
+
+  Config_value() = default;
+
+  /** A value at @p, as written by config2bin.py */
+  explicit Config_value(const uint8_t* p) noexcept : p_{p} {}
+
+  Type type() const noexcept
+  { return p_ ? Type(*p_) : NULL_T; }
+
+  bool IsNull()   const noexcept { return type() == NULL_T; }
+  bool IsBool()   const noexcept { return type() == FALSE_T or type() == TRUE_T; }
+  bool IsInt()    const noexcept { return type() == INT_T; }
+  bool IsNumber() const noexcept { return type() == INT_T or type() == DOUBLE_T; }
+  bool IsString() const noexcept { return type() == STRING_T; }
+  bool IsArray()  const noexcept { return type() == ARRAY_T; }
+  bool IsObject() const noexcept { return type() == OBJECT_T; }
+
+  bool GetBool() const noexcept
+  { return type() == TRUE_T; }
+
+  int64_t GetInt64() const noexcept
+  { return IsInt() ? read<int64_t>(1) : int64_t(GetDouble()); }
+
+  int GetInt() const noexcept
+  { return GetInt64(); }
+
+  double GetDouble() const noexcept
+  { return type() == DOUBLE_T ? read<double>(1) : IsInt() ? read<int64_t>(1) : 0.0; }
+
+  /** NUL-terminated, "" when not a string */
+  const char* GetString() const noexcept
+  { return IsString() ? (const char*) p_ + 5 : ""; }
+
+  uint32_t GetStringLength() const noexcept
+  { return IsString() ? read<uint32_t>(1) : 0; }
+
+  /** Elements of an array, or members of an object */
+  uint32_t Size() const noexcept
+  { return (IsArray() or IsObject()) ? read<uint32_t>(1) : 0; }
+
+  /** The elements of an array, none when not an array */
+  Array GetArray() const noexcept;
+
+  /** The value of member @name of an object, null when there is none */
+  Config_value operator[](const char* name) const noexcept;
+
+  bool HasMember(const char* name) const noexcept
+  { return not (*this)[name].IsNull(); }
+
+  /** The bytes this value takes up */
+  size_t encoded_size() const noexcept;
+
+private:
+  const uint8_t* p_ = nullptr;
+
+  template <typename T>
+  T read(size_t off) const noexcept
+  {
+    T val;
+    std::memcpy(&val, p_ + off, sizeof(T));
+    return val;
+  }
+};
+
+class Config_value::Iterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type        = Config_value;
+  using difference_type   = std::ptrdiff_t;
+  using pointer           = const Config_value*;
+  using reference         = const Config_value&;
+
+  explicit Iterator(const uint8_t* p) noexcept : val_{p} {}
+
+  reference operator*()  const noexcept { return val_; }
+  pointer   operator->() const noexcept { return &val_; }
+
+  Iterator& operator++() noexcept
+  { val_ = Config_value{val_.p_ + val_.encoded_size()}; return *this; }
+
+  bool operator==(const Iterator& other) const noexcept
+  { return val_.p_ == other.val_.p_; }
+  bool operator!=(const Iterator& other) const noexcept
+  { return val_.p_ != other.val_.p_; }
+
+private:
+  Config_value val_;
+};
+
+struct Config_value::Array {
+  Iterator first, last;
+  Iterator begin() const noexcept { return first; }
+  Iterator end()   const noexcept { return last; }
+};
+
+#endif
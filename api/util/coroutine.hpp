@@ -0,0 +1,116 @@
+
+#pragma once
+#ifndef UTIL_COROUTINE_HPP
+#define UTIL_COROUTINE_HPP
+
+// Needs C++20 (the OS itself builds as C++17), so it's empty otherwise
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <delegate>
+
+namespace util {
+
+/**
+ * @brief      A coroutine that starts right away and runs on its own,
+ *             resuming whenever what it awaits completes.
+ *
+ *             The coroutine frame is its only allocation, however many
+ *             times it awaits.
+ */
+struct Task {
+  struct promise_type {
+    Task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+/**
+ * @brief      Awaits a delegate-based async call.
+ *
+ *             The call is started with a callback that only holds a pointer
+ *             to the awaiter, which lives in the coroutine frame, so each
+ *             await allocates nothing. Args must be the arguments of the
+ *             callback the call takes. The callback is expected once, and
+ *             on the CPU that awaits. A callback made before the call
+ *             returns carries on without suspending.
+ *
+ * @code
+ *   util::Task echo(net::tcp::Connection_ptr conn) {
+ *     auto buf = co_await util::await<net::tcp::buffer_t>(
+ *         [conn] (auto done) { conn->on_read(1024, done); });
+ *     conn->write(buf);
+ *   }
+ * @endcode
+ */
+template <typename Start, typename... Args>
+class Awaiter {
+public:
+  using callback_t = delegate<void(Args...)>;
+  using result_t   = std::tuple<std::decay_t<Args>...>;
+
+  explicit Awaiter(Start start)
+    : start_{std::move(start)} {}
+
+  bool await_ready() const noexcept
+  { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle)
+  {
+    handle_ = handle;
+    start_(callback_t{[this] (Args... args) {
+      this->complete(std::forward<Args>(args)...);
+    }});
+    if (result_) return false;
+    waiting_ = true;
+    return true;
+  }
+
+  /** The callback's argument, or a tuple of them when there are several */
+  auto await_resume()
+  {
+    if constexpr (sizeof...(Args) == 1)
+      return std::get<0>(std::move(*result_));
+    else if constexpr (sizeof...(Args) > 1)
+      return std::move(*result_);
+  }
+
+private:
+  Start start_;
+  std::coroutine_handle<> handle_;
+  std::optional<result_t> result_;
+  bool waiting_ = false;
+
+  void complete(Args... args)
+  {
+    result_.emplace(std::forward<Args>(args)...);
+    if (waiting_) {
+      waiting_ = false;
+      handle_.resume();
+    }
+  }
+};
+
+/**
+ * @brief      Await an async call, started by start(callback)
+ *
+ * @tparam     Args   The arguments of the callback
+ */
+template <typename... Args, typename Start>
+Awaiter<std::decay_t<Start>, Args...> await(Start&& start)
+{
+  return Awaiter<std::decay_t<Start>, Args...>{std::forward<Start>(start)};
+}
+
+} // < namespace util
+
+#endif // < __cpp_impl_coroutine
+
+#endif
@@ -77,6 +77,17 @@ inline uint32_t crc32(const void* buf, size_t len)
 /** Intel (iSCSI) aka CRC32-C with hardware support **/
 extern uint32_t crc32_fast(const void* buf, size_t len);
 
+/**
+ * Checksum data as it arrives: start from CRC32_BEGIN(), pass each
+ * result on to the next call, and finish with CRC32_VALUE().
+ * They use the CRC instructions of the CPU (SSE 4.2, ARMv8 CRC) and
+ * folding with carry-less multiplication (PCLMULQDQ) when it has them.
+ **/
+/** Ethernet/ZIP **/
+extern uint32_t crc32_update(uint32_t partial, const void* buf, size_t len);
+/** Intel (iSCSI) aka CRC32-C **/
+extern uint32_t crc32c_update(uint32_t partial, const void* buf, size_t len);
+
 /** Software-only CRC32-C **/
 inline uint32_t crc32c(const void* buf, size_t len)
 {
@@ -4,6 +4,7 @@
 #ifndef UTIL_CRC64_HPP
 #define UTIL_CRC64_HPP
 
+#include <util/detail/crc_fold.hpp>
 #include <array>
 #include <cstdint>
 #include <string>
@@ -26,21 +27,49 @@ struct crc64 {
     : crc64(data.data(), data.size())
   {}
 
+  constexpr crc64() noexcept = default;
+
   constexpr explicit crc64(const char* data, size_t data_len) noexcept {
     crc_register_ = checksum(0, data, data_len);
   }
 
 
   static constexpr uint64_t checksum(uint64_t crc_accumulator, const char* data, size_t data_len) noexcept {
-    auto crc64_table = get_table();
+    return ~update_register(~crc_accumulator, data, data_len);
+  }
+
+  /**
+   * Continue the checksum with more data, as it arrives. Large pieces are
+   * folded with carry-less multiplication (PCLMULQDQ) when the CPU has it.
+   */
+  crc64& update(const char* data, size_t data_len) noexcept {
+    uint64_t reg = ~crc_register_;
+    uint8_t  block[16];
+    const size_t n = detail::crc_fold(reg, reinterpret_cast<const uint8_t*>(data),
+                                      data_len, fold_keys, block);
+    if (n) {
+      reg = update_register(0, reinterpret_cast<const char*>(block), sizeof(block));
+      data += n; data_len -= n;
+    }
+    crc_register_ = ~update_register(reg, data, data_len);
+    return *this;
+  }
 
-    crc_accumulator = ~crc_accumulator;
+  constexpr operator uint64_t() const noexcept
+  { return crc_register_; }
+
+private:
+  uint64_t crc_register_ {0};
+
+  // the CRC register, without the inversion before and after
+  static constexpr uint64_t update_register(uint64_t crc_accumulator, const char* data, size_t data_len) noexcept {
+    const auto& crc64_table = table;
 
     while (data_len > 8) {
-      crc_accumulator ^= static_cast<uint64_t>(data[0])       | static_cast<uint64_t>(data[1]) << 8  |
-                         static_cast<uint64_t>(data[2]) << 16 | static_cast<uint64_t>(data[3]) << 24 |
-                         static_cast<uint64_t>(data[4]) << 32 | static_cast<uint64_t>(data[5]) << 40 |
-                         static_cast<uint64_t>(data[6]) << 48 | static_cast<uint64_t>(data[7]) << 56;
+      crc_accumulator ^= static_cast<uint64_t>(static_cast<uint8_t>(data[0]))       | static_cast<uint64_t>(static_cast<uint8_t>(data[1])) << 8  |
+                         static_cast<uint64_t>(static_cast<uint8_t>(data[2])) << 16 | static_cast<uint64_t>(static_cast<uint8_t>(data[3])) << 24 |
+                         static_cast<uint64_t>(static_cast<uint8_t>(data[4])) << 32 | static_cast<uint64_t>(static_cast<uint8_t>(data[5])) << 40 |
+                         static_cast<uint64_t>(static_cast<uint8_t>(data[6])) << 48 | static_cast<uint64_t>(static_cast<uint8_t>(data[7])) << 56;
 
       crc_accumulator = crc64_table[7][crc_accumulator & 0xff]         ^
                         crc64_table[6][(crc_accumulator >> 8)  & 0xff] ^
@@ -51,23 +80,24 @@ struct crc64 {
                         crc64_table[1][(crc_accumulator >> 48) & 0xff] ^
                         crc64_table[0][crc_accumulator  >> 56];
 
+      data += 8;
       data_len -= 8;
     }
 
     for (size_t i = 0; i < data_len; ++i) {
-      crc_accumulator = crc64_table[0][static_cast<uint8_t>(crc_accumulator) ^ data[i]] ^ (crc_accumulator >> 8);
+      crc_accumulator = crc64_table[0][static_cast<uint8_t>(crc_accumulator ^ static_cast<uint8_t>(data[i]))] ^ (crc_accumulator >> 8);
     }
 
-    return ~crc_accumulator;
+    return crc_accumulator;
   }
 
-  constexpr operator uint64_t() const noexcept
-  { return crc_register_; }
+  using CRC64_table_t = std::array<std::array<uint64_t, 256>, 8>;
 
-private:
-  uint64_t crc_register_ {0};
+  // built once, rather than for each checksum
+  static const CRC64_table_t table;
 
-  using CRC64_table_t = std::array<std::array<uint64_t, 256>, 8>;
+  static constexpr detail::Crc_fold_keys fold_keys =
+      detail::crc_fold_keys(detail::crc_reflect64(POLY), 64);
 
   static constexpr const CRC64_table_t get_table() noexcept {
     auto crc64_itable = get_init_table();
@@ -104,6 +134,9 @@ private:
   }
 }; //< struct crc64
 
+template<uint64_t POLY>
+constexpr typename crc64<POLY>::CRC64_table_t crc64<POLY>::table = crc64<POLY>::get_table();
+
 using crc64_iso_checksum  = crc64<0xD800000000000000>; //< Specified in ISO 3309
 using crc64_ecma_checksum = crc64<0xC96C5795D7870F42>; //< Specified in ECMA 182
 
@@ -131,6 +131,11 @@ public:
 		return static_cast<T*>(invoke_ptr_);
 	}
 
+	const void* invoker() const noexcept
+	{
+		return reinterpret_cast<const void*>(invoke_ptr_);
+	}
+
 private:
 	invoke_ptr_t invoke_ptr_;
 };
@@ -200,6 +205,11 @@ public:
 		return reinterpret_cast<T*>(&storage_);
 	}
 
+	const void* invoker() const noexcept
+	{
+		return reinterpret_cast<const void*>(invoke_ptr_);
+	}
+
 private:
 	invoke_ptr_t invoke_ptr_;
 	mutable storage_t storage_;
@@ -321,6 +331,11 @@ public:
 		return reinterpret_cast<T*>(&storage_);
 	}
 
+	const void* invoker() const noexcept
+	{
+		return reinterpret_cast<const void*>(invoke_ptr_);
+	}
+
 private:
 	mutable storage_t storage_ {};
 
@@ -558,6 +573,12 @@ public:
 		return storage_.template target<T>();
 	}
 
+	// the code called, telling which function this is (not the object)
+	const void* invoker() const noexcept
+	{
+		return storage_.invoker();
+	}
+
 	template<
 		typename T,
 		typename D = std::shared_ptr<T>,
@@ -0,0 +1,78 @@
+
+#pragma once
+#ifndef UTIL_DETAIL_CRC_FOLD_HPP
+#define UTIL_DETAIL_CRC_FOLD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace util::detail {
+
+  /**
+   * Folding a bit-reflected CRC with carry-less multiplication (PCLMULQDQ).
+   *
+   * 16-byte blocks of the message are multiplied forward by x^n mod P and
+   * added onto the blocks further on, which leaves the CRC unchanged, until
+   * 16 bytes are left. The CRC of those is then taken the usual way. Any
+   * reflected CRC of up to 64 bits folds the same way, only the constants
+   * differ.
+   */
+  struct Crc_fold_keys {
+    uint64_t k512_lo, k512_hi; // fold 4 blocks forward by 4 blocks
+    uint64_t k128_lo, k128_hi; // fold a block onto the next
+  };
+
+  // x^n mod P, P given without its x^width term
+  constexpr uint64_t crc_xpow_mod(unsigned n, uint64_t poly, unsigned width) noexcept
+  {
+    const uint64_t top = uint64_t(1) << (width - 1);
+    uint64_t r = 1;
+    while (n--) {
+      const bool carry = r & top;
+      r <<= 1;
+      if (width < 64) r &= (top << 1) - 1;
+      if (carry) r ^= poly;
+    }
+    return r;
+  }
+
+  // degree d in bit 63-d, the order of a reflected 64-bit block
+  constexpr uint64_t crc_reflect64(uint64_t v) noexcept
+  {
+    uint64_t r = 0;
+    for (int i = 0; i < 64; i++)
+      if (v & (uint64_t(1) << i)) r |= uint64_t(1) << (63 - i);
+    return r;
+  }
+
+  /**
+   * The keys for a CRC with the normal (not reflected) polynomial @poly,
+   * without its x^width term. Moving a block forward by S bits multiplies
+   * its halves by x^(S+63) and x^(S-1), the 1 being the bit that the
+   * reflected product is short of.
+   */
+  constexpr Crc_fold_keys crc_fold_keys(uint64_t poly, unsigned width) noexcept
+  {
+    return {
+      crc_reflect64(crc_xpow_mod(512 + 63, poly, width)),
+      crc_reflect64(crc_xpow_mod(512 - 1,  poly, width)),
+      crc_reflect64(crc_xpow_mod(128 + 63, poly, width)),
+      crc_reflect64(crc_xpow_mod(128 - 1,  poly, width))
+    };
+  }
+
+  /**
+   * Fold the start of @data, with the CRC register @crc, into the 16 bytes
+   * of @out, which have the same CRC when taken from a register of 0.
+   * Returns the number of bytes folded, a multiple of 16, or 0 when the
+   * CPU can't or @len is too short to be worth it.
+   */
+  size_t crc_fold(uint64_t crc, const uint8_t* data, size_t len,
+                  const Crc_fold_keys&, uint8_t out[16]) noexcept;
+
+  // bytes before folding is worth the setup
+  constexpr size_t CRC_FOLD_MIN = 256;
+
+} // util::detail
+
+#endif
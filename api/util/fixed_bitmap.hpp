@@ -7,27 +7,35 @@
 #include <array>
 
 /**
- * @brief      A membitmap with a fixed amount of bits and storage.
+ * @brief      A membitmap with a fixed amount of bits and storage, and a
+ *             summary of its words so searches skip the full or empty ones.
  *
- * @tparam     N     Number of bits. Needs to be divisable by sizeof(Storage)
+ * @tparam     N     Number of bits. Needs to be divisable by the bits of Storage
  */
 template <size_t N>
 class Fixed_bitmap : public MemBitmap {
 public:
   using Storage = MemBitmap::word;
-  static_assert(N >= sizeof(Storage), "Number of bits need to be atleast sizeof(Storage)");
-  static_assert(N % sizeof(Storage) == 0, "Number of bits need to be divisable by sizeof(Storage)");
+  static constexpr size_t WORDS = N / MemBitmap::CHUNK_SIZE;
+  static_assert(N >= MemBitmap::CHUNK_SIZE, "Number of bits need to be atleast the bits of Storage");
+  static_assert(N % MemBitmap::CHUNK_SIZE == 0, "Number of bits need to be divisable by the bits of Storage");
 
 public:
   Fixed_bitmap() :
     MemBitmap{},
-    storage{}
+    storage{},
+    summary{}
   {
-    set_location(storage.data(), N / sizeof(Storage));
+    set_location(storage.data(), WORDS);
+    set_summary(summary.data());
   }
+  // the bitmap points into its own storage
+  Fixed_bitmap(const Fixed_bitmap&) = delete;
+  Fixed_bitmap& operator=(const Fixed_bitmap&) = delete;
 
 private:
-  std::array<Storage, N / sizeof(Storage)> storage;
+  std::array<Storage, WORDS> storage;
+  std::array<Storage, MemBitmap::summary_chunks(WORDS)> summary;
 
 }; // < class Fixed_bitmap
 
@@ -0,0 +1,225 @@
+#pragma once
+#ifndef UTIL_FLAT_MAP_HPP
+#define UTIL_FLAT_MAP_HPP
+
+/**
+ * Open addressing hash map with keys and values stored inline in one
+ * array, using linear probing and backward shift deletion (no tombstones).
+ * Lookups touch consecutive slots instead of chasing list nodes.
+ *
+ * Each slot keeps the hash of its key, so probing compares hashes
+ * before keys and growing the table never hashes a key again.
+ *
+ * Pointers to values and iterators are invalidated by insertion and
+ * erasure. Key and T must be default constructible and cheap to move.
+ **/
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+template <class Key, class T, class Hash = std::hash<Key>,
+          class Key_equal = std::equal_to<Key>>
+class Flat_map {
+  struct Slot;
+public:
+  using value_type = std::pair<Key, T>;
+
+  /** Walks the occupied slots, in no particular order. The key must not be changed */
+  template <bool Const>
+  class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = Flat_map::value_type;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = std::conditional_t<Const, const value_type*, value_type*>;
+    using reference         = std::conditional_t<Const, const value_type&, value_type&>;
+    using slot_ptr          = std::conditional_t<Const, const Slot*, Slot*>;
+
+    Iterator(slot_ptr slot, slot_ptr end) noexcept
+      : slot_{slot}, end_{end}
+    { skip_free(); }
+
+    reference operator*() const noexcept
+    { return slot_->kv; }
+
+    pointer operator->() const noexcept
+    { return &slot_->kv; }
+
+    Iterator& operator++() noexcept
+    {
+      ++slot_;
+      skip_free();
+      return *this;
+    }
+
+    bool operator==(const Iterator& other) const noexcept
+    { return slot_ == other.slot_; }
+
+    bool operator!=(const Iterator& other) const noexcept
+    { return slot_ != other.slot_; }
+
+  private:
+    slot_ptr slot_;
+    slot_ptr end_;
+
+    void skip_free() noexcept
+    { while (slot_ != end_ and slot_->tag == 0) ++slot_; }
+  };
+  using iterator       = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  explicit Flat_map(size_t count = 0)
+  { reserve(count); }
+
+  /** Find the value of @key, or nullptr */
+  T* find(const Key& key) noexcept
+  {
+    const size_t i = index_of(key);
+    return (i != npos) ? &slots_[i].kv.second : nullptr;
+  }
+
+  const T* find(const Key& key) const noexcept
+  { return const_cast<Flat_map*>(this)->find(key); }
+
+  /** Insert @value unless @key exists. Returns the value, and if inserted */
+  std::pair<T*, bool> emplace(const Key& key, T value)
+  {
+    if (auto* found = find(key))
+      return {found, false};
+    grow_for(size_ + 1);
+    return {&place(make_tag(key), key, std::move(value)), true};
+  }
+
+  /** Insert or replace the value of @key. Returns true if inserted */
+  bool insert_or_assign(const Key& key, T value)
+  {
+    auto res = emplace(key, value);
+    if (not res.second)
+      *res.first = std::move(value);
+    return res.second;
+  }
+
+  /** Erase @key. Returns true if it existed */
+  bool erase(const Key& key) noexcept
+  {
+    size_t hole = index_of(key);
+    if (hole == npos) return false;
+    // up to the next free slot, move back every slot that probed
+    // past the hole from its home slot
+    for (size_t i = (hole + 1) & mask(); slots_[i].tag != 0; i = (i + 1) & mask())
+    {
+      const size_t home = slots_[i].tag & mask();
+      if (((i - home) & mask()) >= ((i - hole) & mask())) {
+        slots_[hole] = std::move(slots_[i]);
+        hole = i;
+      }
+    }
+    slots_[hole] = Slot{};
+    size_--;
+    return true;
+  }
+
+  /** Make room for @count elements without rehashing */
+  void reserve(size_t count)
+  {
+    size_t cap = slots_.empty() ? 16 : slots_.size();
+    while (cap * 3 / 4 < count) cap *= 2;
+    if (count == 0 or cap <= slots_.size()) return;
+    rehash(cap);
+  }
+
+  void clear() noexcept
+  {
+    for (auto& slot : slots_) slot = Slot{};
+    size_ = 0;
+  }
+
+  size_t size() const noexcept
+  { return size_; }
+
+  bool empty() const noexcept
+  { return size_ == 0; }
+
+  /** Number of elements that fit without rehashing */
+  size_t capacity() const noexcept
+  { return slots_.size() * 3 / 4; }
+
+  iterator begin() noexcept
+  { return {slots_.data(), slots_.data() + slots_.size()}; }
+
+  iterator end() noexcept
+  { return {slots_.data() + slots_.size(), slots_.data() + slots_.size()}; }
+
+  const_iterator begin() const noexcept
+  { return {slots_.data(), slots_.data() + slots_.size()}; }
+
+  const_iterator end() const noexcept
+  { return {slots_.data() + slots_.size(), slots_.data() + slots_.size()}; }
+
+private:
+  struct Slot {
+    uint32_t   tag = 0; // hash with the top bit set, 0 when free
+    value_type kv{};
+  };
+
+  static constexpr size_t npos = SIZE_MAX;
+
+  size_t index_of(const Key& key) const noexcept
+  {
+    if (slots_.empty()) return npos;
+    const uint32_t tag = make_tag(key);
+    for (size_t i = tag & mask(); slots_[i].tag != 0; i = (i + 1) & mask())
+    {
+      if (slots_[i].tag == tag and Key_equal{}(slots_[i].kv.first, key))
+        return i;
+    }
+    return npos;
+  }
+
+  static uint32_t make_tag(const Key& key) noexcept
+  {
+    // spread weak hashes over the low bits used for the home slot
+    uint64_t h = Hash{}(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return (uint32_t) h | 0x80000000;
+  }
+
+  size_t mask() const noexcept
+  { return slots_.size() - 1; }
+
+  T& place(const uint32_t tag, const Key& key, T value) noexcept
+  {
+    size_t i = tag & mask();
+    while (slots_[i].tag != 0) i = (i + 1) & mask();
+    slots_[i].tag = tag;
+    slots_[i].kv  = value_type{key, std::move(value)};
+    size_++;
+    return slots_[i].kv.second;
+  }
+
+  void grow_for(const size_t count)
+  {
+    if (count > capacity())
+      reserve(count);
+  }
+
+  void rehash(const size_t cap)
+  {
+    std::vector<Slot> old(cap);
+    old.swap(slots_);
+    size_ = 0;
+    for (auto& slot : old)
+      if (slot.tag != 0)
+        place(slot.tag, slot.kv.first, std::move(slot.kv.second));
+  }
+
+  std::vector<Slot> slots_;
+  size_t            size_ = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+#ifndef UTIL_HISTOGRAM_HPP
+#define UTIL_HISTOGRAM_HPP
+
+/**
+ * Latency histograms, with buckets as wide as a fixed fraction of the
+ * values in them (like HdrHistogram), so the tail is kept as precisely
+ * as the median, from nanoseconds to minutes, in a few KiB.
+ *
+ * Values below 2^SUB_BITS have a bucket each. Above that, every power
+ * of 2 is split into 2^SUB_BITS buckets, so that a value read back is
+ * off by less than 1/2^SUB_BITS (about 3%). Values from 2^MAX_BITS are
+ * counted in the last bucket, but the largest value is kept exactly.
+ *
+ * Recording is a few instructions and takes no locks: a Histogram has
+ * a single writer, and Histogram_percpu has one for every CPU, which
+ * are merged when read.
+ **/
+
+#include <smp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace util
+{
+
+class Histogram {
+public:
+  static constexpr int    SUB_BITS  = 5;
+  static constexpr int    MAX_BITS  = 40;
+  static constexpr size_t SUB_COUNT = size_t(1) << SUB_BITS;
+  static constexpr size_t BUCKETS   = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+  void record(uint64_t value) noexcept
+  {
+    counts_[index_of(value)]++;
+    count_++;
+    sum_ += value;
+    if (value > max_) max_ = value;
+    if (value < min_) min_ = value;
+  }
+
+  uint64_t count() const noexcept { return count_; }
+  uint64_t sum() const noexcept { return sum_; }
+  uint64_t max() const noexcept { return max_; }
+  uint64_t min() const noexcept { return count_ ? min_ : 0; }
+  double   mean() const noexcept
+  { return count_ ? (double) sum_ / count_ : 0.0; }
+
+  /**
+   * The value that @percentile percent (0 to 100) of the values are
+   * at or below, rounded up to the top of its bucket. 0 when empty.
+   */
+  uint64_t percentile(double percentile) const noexcept;
+
+  /** Add the values of @other, as if they were recorded here */
+  void merge(const Histogram& other) noexcept;
+
+  void reset() noexcept;
+
+  /** "count=N p50=V p90=V p99=V p99.9=V max=V" */
+  std::string to_string() const;
+
+  /** The bucket of @value */
+  static size_t index_of(uint64_t value) noexcept
+  {
+    if (value < SUB_COUNT) return value;
+    const int msb = 63 - __builtin_clzll(value);
+    if (msb >= MAX_BITS) return BUCKETS - 1;
+    const int shift = msb - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) | ((value >> shift) & (SUB_COUNT - 1));
+  }
+
+  /** The largest value in bucket @index */
+  static uint64_t highest_in(size_t index) noexcept
+  {
+    if (index < SUB_COUNT) return index;
+    const int shift = (index >> SUB_BITS) - 1;
+    const uint64_t lowest = (SUB_COUNT | (index & (SUB_COUNT - 1))) << shift;
+    return lowest + (uint64_t(1) << shift) - 1;
+  }
+
+private:
+  std::array<uint64_t, BUCKETS> counts_ {};
+  uint64_t count_ = 0;
+  uint64_t sum_   = 0;
+  uint64_t max_   = 0;
+  uint64_t min_   = UINT64_MAX;
+};
+
+/**
+ * A histogram that every CPU records into in its own copy, merged when
+ * it's read (which may miss values being recorded at the time).
+ *
+ * Created through Statman::create_histogram, once the number of CPUs
+ * is known (not from global constructors).
+ */
+class Histogram_percpu {
+public:
+  explicit Histogram_percpu(size_t cpus)
+    : slots_(cpus > 0 ? cpus : 1) {}
+
+  void record(uint64_t value) noexcept { local().record(value); }
+
+  /** This CPU's histogram */
+  Histogram& local() noexcept
+  { return slots_[SMP::cpu_id()].hist; }
+
+  /** The histogram of CPU @cpu */
+  Histogram& at(size_t cpu)
+  { return slots_.at(cpu).hist; }
+  size_t cpus() const noexcept { return slots_.size(); }
+
+  /** The histograms of all CPUs, merged */
+  Histogram merged() const noexcept;
+
+  void reset() noexcept;
+
+private:
+  struct alignas(SMP_ALIGN) Slot {
+    Histogram hist;
+  };
+  std::vector<Slot> slots_;
+};
+
+} // util
+
+#endif
@@ -0,0 +1,196 @@
+
+#pragma once
+#ifndef UTIL_LOCKFREE_RING_HPP
+#define UTIL_LOCKFREE_RING_HPP
+
+/**
+ * Bounded lock-free rings, for handing things from one CPU to another.
+ *
+ * The capacity is a power of 2, so that the indices run freely and are
+ * masked into the slots. The indices written by the producer side and
+ * the consumer side live on cache lines of their own, and each side
+ * keeps a copy of the other side's index, only reading the shared one
+ * again when the copy says the ring is full (or empty).
+ *
+ * Bulk push and pop move as many of N elements as they can, publishing
+ * them with a single store. Elements are moved, and must be default
+ * constructible.
+ **/
+
+#include <smp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+namespace util
+{
+
+/** A ring with a single producer and a single consumer */
+template <typename T, size_t N>
+class SPSC_ring {
+public:
+  static_assert(N > 0 and (N & (N - 1)) == 0, "Capacity must be a power of 2");
+  static_assert(std::is_default_constructible_v<T>);
+
+  static constexpr size_t capacity() noexcept { return N; }
+
+  /** Producer: add one element, false if the ring is full */
+  bool push(T&& elem) noexcept(std::is_nothrow_move_assignable_v<T>)
+  { return push_bulk(&elem, 1) == 1; }
+
+  bool push(const T& elem)
+  {
+    T copy{elem};
+    return push(std::move(copy));
+  }
+
+  /** Producer: add up to @count elements, returns how many were added */
+  size_t push_bulk(T* elems, size_t count) noexcept(std::is_nothrow_move_assignable_v<T>)
+  {
+    const size_t tail = prod_.tail.load(std::memory_order_relaxed);
+    if (tail - prod_.head_copy + count > N)
+      prod_.head_copy = cons_.head.load(std::memory_order_acquire);
+    count = std::min(count, N - (tail - prod_.head_copy));
+
+    for (size_t i = 0; i < count; i++)
+      slots_[(tail + i) & (N - 1)] = std::move(elems[i]);
+    prod_.tail.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  /** Consumer: take one element, false if the ring is empty */
+  bool pop(T& elem) noexcept(std::is_nothrow_move_assignable_v<T>)
+  { return pop_bulk(&elem, 1) == 1; }
+
+  /** Consumer: take up to @count elements, returns how many were taken */
+  size_t pop_bulk(T* elems, size_t count) noexcept(std::is_nothrow_move_assignable_v<T>)
+  {
+    const size_t head = cons_.head.load(std::memory_order_relaxed);
+    if (cons_.tail_copy - head < count)
+      cons_.tail_copy = prod_.tail.load(std::memory_order_acquire);
+    count = std::min(count, cons_.tail_copy - head);
+
+    for (size_t i = 0; i < count; i++)
+      elems[i] = std::move(slots_[(head + i) & (N - 1)]);
+    cons_.head.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  /** Elements in the ring, only exact on a side that is idle */
+  size_t size() const noexcept
+  {
+    return prod_.tail.load(std::memory_order_acquire)
+         - cons_.head.load(std::memory_order_acquire);
+  }
+
+  bool empty() const noexcept { return size() == 0; }
+
+private:
+  struct alignas(SMP_ALIGN) {
+    std::atomic<size_t> tail {0};
+    size_t head_copy = 0;
+  } prod_;
+  struct alignas(SMP_ALIGN) {
+    std::atomic<size_t> head {0};
+    size_t tail_copy = 0;
+  } cons_;
+  alignas(SMP_ALIGN) std::array<T, N> slots_;
+};
+
+/**
+ * A ring with many producers and a single consumer. Producers claim their
+ * slots with a compare-and-swap on the tail, and mark each slot when it
+ * has been written, so that the consumer doesn't take slots that are
+ * claimed but not filled yet.
+ */
+template <typename T, size_t N>
+class MPSC_ring {
+public:
+  static_assert(N > 0 and (N & (N - 1)) == 0, "Capacity must be a power of 2");
+  static_assert(std::is_default_constructible_v<T>);
+
+  static constexpr size_t capacity() noexcept { return N; }
+
+  /** Any CPU: add one element, false if the ring is full */
+  bool push(T&& elem) noexcept(std::is_nothrow_move_assignable_v<T>)
+  { return push_bulk(&elem, 1) == 1; }
+
+  bool push(const T& elem)
+  {
+    T copy{elem};
+    return push(std::move(copy));
+  }
+
+  /** Any CPU: add up to @count elements, returns how many were added.
+      The elements added by one call are taken out in order. */
+  size_t push_bulk(T* elems, size_t count) noexcept(std::is_nothrow_move_assignable_v<T>)
+  {
+    size_t tail = prod_.tail.load(std::memory_order_relaxed);
+    size_t n;
+    do {
+      const size_t head = cons_.head.load(std::memory_order_acquire);
+      n = std::min(count, N - (tail - head));
+      if (n == 0) return 0;
+    } while (not prod_.tail.compare_exchange_weak(tail, tail + n,
+                 std::memory_order_relaxed, std::memory_order_relaxed));
+
+    for (size_t i = 0; i < n; i++)
+    {
+      auto& slot = slots_[(tail + i) & (N - 1)];
+      slot.elem = std::move(elems[i]);
+      slot.seq.store(tail + i + 1, std::memory_order_release);
+    }
+    return n;
+  }
+
+  /** Consumer: take one element, false if none is ready */
+  bool pop(T& elem) noexcept(std::is_nothrow_move_assignable_v<T>)
+  { return pop_bulk(&elem, 1) == 1; }
+
+  /** Consumer: take up to @count elements that are ready, in order,
+      returns how many were taken */
+  size_t pop_bulk(T* elems, size_t count) noexcept(std::is_nothrow_move_assignable_v<T>)
+  {
+    const size_t head = cons_.head.load(std::memory_order_relaxed);
+    size_t n = 0;
+    for (; n < count; n++)
+    {
+      auto& slot = slots_[(head + n) & (N - 1)];
+      if (slot.seq.load(std::memory_order_acquire) != head + n + 1)
+        break;
+      elems[n] = std::move(slot.elem);
+    }
+    if (n > 0)
+      cons_.head.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+  /** Elements in the ring, including those still being written */
+  size_t size() const noexcept
+  {
+    return prod_.tail.load(std::memory_order_acquire)
+         - cons_.head.load(std::memory_order_acquire);
+  }
+
+  bool empty() const noexcept { return size() == 0; }
+
+private:
+  struct Slot {
+    // index + 1 of the element last written here
+    std::atomic<size_t> seq {0};
+    T elem;
+  };
+  struct alignas(SMP_ALIGN) {
+    std::atomic<size_t> tail {0};
+  } prod_;
+  struct alignas(SMP_ALIGN) {
+    std::atomic<size_t> head {0};
+  } cons_;
+  alignas(SMP_ALIGN) std::array<Slot, N> slots_;
+};
+
+} // util
+
+#endif
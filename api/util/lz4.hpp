@@ -0,0 +1,33 @@
+#pragma once
+#ifndef UTIL_LZ4_HPP
+#define UTIL_LZ4_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * LZ4 blocks (the raw block format, without the frame around it).
+ * Decompressing is a loop of copies, fast enough to run at memory speed,
+ * and checks every length and offset against the buffers given.
+ */
+namespace lz4
+{
+  /** The most a block of @len bytes can grow to when compressed */
+  constexpr size_t compress_bound(size_t len) noexcept
+  { return len + len / 255 + 16; }
+
+  /**
+   * Compress @len bytes of @src into @dst, greedily, as one block.
+   * Returns the size of the block, or 0 if it doesn't fit in @cap bytes.
+   */
+  size_t compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap) noexcept;
+
+  /**
+   * Decompress the block of @len bytes at @src into @dst.
+   * Returns the number of bytes written, or -1 if the block is malformed
+   * or would write more than @cap bytes.
+   */
+  long decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap) noexcept;
+}
+
+#endif
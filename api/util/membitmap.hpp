@@ -3,11 +3,20 @@
 #include <cstdint>
 #include <cstring>
 #include <cassert>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /**
  * In-memory bitmap implementation
  *
  * Not assigning memory area causes undefined behavior
+ *
+ * Searches skip whole words, four at a time with SSE2. For large bitmaps
+ * a summary can be kept with set_summary(): a bit per word telling if it
+ * has a clear bit, and one telling if it has a set bit, so a search looks
+ * at one summary word per 32 words. The summary follows every change but
+ * those of the atomic operations, so don't keep one with them.
 **/
 
 class MemBitmap
@@ -38,28 +47,82 @@ public:
   // return the bit-index of the first clear bit
   index_t first_free() const noexcept
   {
-    // each word
-    for (int i = 0; i < _chunks; i++)
-    if (_data[i] != WORD_MAX) {
-      // each bit
-      for (int b = 0; b < CHUNK_SIZE; b++)
-      if (!(_data[i] & (1 << b))) {
-        return i * CHUNK_SIZE + b;
-      }
-    } // chunk
-    return -1;
+    return next_free(0);
+  }
+  // return the bit-index of the first clear bit at or after @from
+  index_t next_free(index_t from) const noexcept
+  {
+    if (from < 0) from = 0;
+    if (from >= _chunks * CHUNK_SIZE) return -1;
+    // the first word, with the bits before @from counted as set
+    const word first = ~_data[windex(from)] & (WORD_MAX << woffset(from));
+    if (first)
+      return windex(from) * CHUNK_SIZE + __builtin_ctz(first);
+    const index_t i = find_word<true>(windex(from) + 1);
+    if (i < 0) return -1;
+    return i * CHUNK_SIZE + __builtin_ctz(~_data[i]);
   }
 
-  index_t first_set() const noexcept
+  /**
+   * Return the bit-index of the first run of @n clear bits, or -1.
+   * Full words are skipped as in first_free(), so a search of a mostly
+   * full bitmap only looks at the words with clear bits.
+   */
+  index_t find_free_run(index_t n) const noexcept
   {
-    for (int i = 0; i < _chunks; i++)
-    if (_data[i])
+    if (n <= 1) return (n == 1) ? first_free() : -1;
+    // the clear bits at the end of the words before
+    index_t run_start = 0;
+    index_t run = 0;
+    for (index_t i = find_word<true>(0); i >= 0 and i < _chunks; )
     {
-      int b = __builtin_ffs(_data[i]) - 1;
-      return i * CHUNK_SIZE + b;
+      const word w = _data[i];
+      if (run == 0) run_start = i * CHUNK_SIZE;
+      if (w == 0) {
+        run += CHUNK_SIZE;
+        if (run >= n) return run_start;
+        i++;
+        continue;
+      }
+      // continued into the clear bits at the start of this word
+      if (run + __builtin_ctz(w) >= n) return run_start;
+      // or a run inside of it
+      if (n < CHUNK_SIZE) {
+        const word inside = free_runs(~w, n);
+        if (inside) return i * CHUNK_SIZE + __builtin_ctz(inside);
+      }
+      // the clear bits at the end of this word start the next run
+      run = __builtin_clz(w);
+      run_start = (i + 1) * CHUNK_SIZE - run;
+      if (run > 0) {
+        i++;
+      }
+      else {
+        i = find_word<true>(i + 1);
+      }
     }
     return -1;
   }
+
+  index_t first_set() const noexcept
+  {
+    const index_t i = find_word<false>(0);
+    if (i < 0) return -1;
+    return i * CHUNK_SIZE + __builtin_ctz(_data[i]);
+  }
+  // return the bit-index of the first set bit at or after @from
+  index_t next_set(index_t from) const noexcept
+  {
+    if (from < 0) from = 0;
+    if (from >= _chunks * CHUNK_SIZE) return -1;
+    // mask off the bits before @from in its own chunk
+    const word first = _data[windex(from)] & (WORD_MAX << woffset(from));
+    if (first)
+      return windex(from) * CHUNK_SIZE + __builtin_ctz(first);
+    const index_t i = find_word<false>(windex(from) + 1);
+    if (i < 0) return -1;
+    return i * CHUNK_SIZE + __builtin_ctz(_data[i]);
+  }
   index_t last_set() const noexcept
   {
     for (int i = _chunks-1; i >= 0; i--)
@@ -85,39 +148,65 @@ public:
   void zero_all() noexcept
   {
     memset(_data, 0, sizeof(word) * _chunks);
+    rebuild_summary();
   }
   void set_all() noexcept
   {
     memset(_data, 0xFF, sizeof(word) * _chunks);
+    rebuild_summary();
   }
 
   void set(index_t b) noexcept
   {
     _data[windex(b)] |= bit(b);
+    update_summary(windex(b));
   }
   void reset(index_t b) noexcept
   {
     _data[windex(b)] &= ~bit(b);
+    update_summary(windex(b));
   }
   void flip(index_t b) noexcept
   {
     _data[windex(b)] ^= bit(b);
+    update_summary(windex(b));
   }
 
   void atomic_set(index_t b) noexcept
   {
+    assert(_summary == nullptr);
     __sync_fetch_and_or(&_data[windex(b)], bit(b));
   }
   void atomic_reset(index_t b) noexcept
   {
+    assert(_summary == nullptr);
     __sync_fetch_and_and(&_data[windex(b)], ~bit(b));
   }
+  // returns the bit as it was before
+  bool atomic_test_and_set(index_t b) noexcept
+  {
+    assert(_summary == nullptr);
+    return __sync_fetch_and_or(&_data[windex(b)], bit(b)) & bit(b);
+  }
 
   void set_location(const void* location, index_t chunks)
   {
     assert(location != nullptr && chunks != 0);
     this->_data = (word*) location;
     this->_chunks = chunks;
+    this->_summary = nullptr;
+  }
+
+  // words of summary storage needed for a bitmap of @chunks words
+  static constexpr size_t summary_chunks(size_t chunks) noexcept
+  {
+    return 2 * ((chunks + CHUNK_SIZE - 1) / CHUNK_SIZE);
+  }
+  // keep a summary in @location, of summary_chunks() words, or none
+  void set_summary(void* location) noexcept
+  {
+    this->_summary = (word*) location;
+    rebuild_summary();
   }
 
   // returns data in bytes
@@ -138,6 +227,7 @@ public:
     assert(bmp._chunks == _chunks);
     for (index_t i = 0; i < _chunks; i++)
       _data[i] &= bmp._data[i];
+    rebuild_summary();
     return *this;
   }
   // unsafe version: must have data sections, and the number of chunks
@@ -146,6 +236,7 @@ public:
   {
     for (index_t i = 0; i < _chunks; i++)
         _data[i] = a._data[i] & b._data[i];
+    rebuild_summary();
   }
 
   // might wanna look at individual chunks for
@@ -161,6 +252,73 @@ private:
   index_t woffset(index_t b) const { return b & (CHUNK_SIZE-1); }
   index_t bit(index_t b) const { return 1 << woffset(b); }
 
+  // the bits of @free starting a run of @n set bits, for @n below 32
+  static word free_runs(word free, index_t n) noexcept
+  {
+    // each step doubles the length of the runs found, up to @n
+    for (index_t len = 1; len < n and free; ) {
+      const index_t step = (len < n - len) ? len : n - len;
+      free &= free >> step;
+      len += step;
+    }
+    return free;
+  }
+
+  // the summary of words with a clear bit, then of words with a set bit
+  word* summary(bool free) const noexcept
+  {
+    return _summary + (free ? 0 : summary_chunks(_chunks) / 2);
+  }
+  void update_summary(index_t i) noexcept
+  {
+    if (_summary == nullptr) return;
+    const word mask = 1u << woffset(i);
+    word& has_free = summary(true)[windex(i)];
+    word& has_set  = summary(false)[windex(i)];
+    has_free = (_data[i] != WORD_MAX) ? (has_free | mask) : (has_free & ~mask);
+    has_set  = (_data[i] != 0)        ? (has_set | mask)  : (has_set & ~mask);
+  }
+  void rebuild_summary() noexcept
+  {
+    if (_summary == nullptr) return;
+    memset(_summary, 0, sizeof(word) * summary_chunks(_chunks));
+    for (index_t i = 0; i < _chunks; i++)
+      update_summary(i);
+  }
+
+  // index of the first word at or after @from with a clear bit (@free)
+  // or with a set bit (not @free), or -1
+  template <bool free>
+  index_t find_word(index_t from) const noexcept
+  {
+    if (from >= _chunks) return -1;
+    const word skip = free ? WORD_MAX : 0;
+    if (_summary != nullptr)
+    {
+      const word* sum = summary(free);
+      const index_t words = (_chunks + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      word w = sum[windex(from)] & (WORD_MAX << woffset(from));
+      for (index_t s = windex(from); ; ) {
+        if (w) return s * CHUNK_SIZE + __builtin_ctz(w);
+        if (++s >= words) return -1;
+        w = sum[s];
+      }
+    }
+    index_t i = from;
+#if defined(__SSE2__)
+    // four words at a time
+    const __m128i skipv = _mm_set1_epi32(skip);
+    for (; i + 4 <= _chunks; i += 4) {
+      const __m128i v = _mm_loadu_si128((const __m128i*) &_data[i]);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, skipv)) != 0xFFFF) break;
+    }
+#endif
+    for (; i < _chunks; i++)
+      if (_data[i] != skip) return i;
+    return -1;
+  }
+
   word*   _data {nullptr};
   index_t _chunks;
+  word*   _summary {nullptr};
 };
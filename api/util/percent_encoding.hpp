@@ -24,6 +24,7 @@
 #define PERCENT_ENCODING_HPP
 
 #include "detail/string_view"
+#include <cstddef>
 #include <string>
 
 namespace uri {
@@ -38,6 +39,20 @@ std::string encode(util::csview input);
 ///
 std::string decode(util::csview input);
 
+///
+/// Encode (percent-encode) @input into @out, which must have room for
+/// 3 * input.size() chars. Returns the number of chars written.
+///
+size_t encode_into(util::csview input, char* out) noexcept;
+
+///
+/// Decode (percent-decode) @input into @out, which must have room for
+/// input.size() chars. Returns the number of chars written, or -1 if
+/// an escape is cut short, or (when validating) the input has chars
+/// that aren't allowed in a uri, or escapes that aren't hex.
+///
+long decode_into(util::csview input, char* out, bool validate = true) noexcept;
+
 
 #ifdef URI_THROW_ON_ERROR
 #include <stdexcept>
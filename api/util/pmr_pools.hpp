@@ -0,0 +1,44 @@
+
+#pragma once
+#ifndef UTIL_PMR_POOLS_HPP
+#define UTIL_PMR_POOLS_HPP
+
+#include <util/alloc_pmr.hpp>
+#include <cstdint>
+
+/**
+ * Memory pools for the objects of hot allocation sites, one pool on each
+ * CPU for each kind. A connection (or client) takes a resource from the
+ * pool of its CPU and allocates its objects from that, so that each kind
+ * is bounded by its quota instead of competing for the general heap.
+ *
+ * Allocations must be freed on the CPU that made them, which is where
+ * the connection lives.
+ **/
+namespace os::mem {
+
+  enum class Pool_id : uint8_t {
+    http,      // HTTP request and response headers
+    dns,       // DNS client requests
+    NUM_POOLS
+  };
+
+  struct Pool_quota {
+    // bytes in the pool of each CPU
+    size_t total;
+    // bytes for each resource taken from it, 0 to share out the total
+    size_t per_resource;
+  };
+
+  /** Set the quota of the pools of a kind, for the CPUs that haven't
+      used them yet */
+  void set_pool_quota(Pool_id, Pool_quota) noexcept;
+
+  Pool_quota pool_quota(Pool_id) noexcept;
+
+  /** The pool of a kind on this CPU */
+  Pmr_pool& cpu_pool(Pool_id);
+
+} // os::mem
+
+#endif
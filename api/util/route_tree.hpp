@@ -0,0 +1,82 @@
+
+#ifndef UTIL_ROUTE_TREE_HPP
+#define UTIL_ROUTE_TREE_HPP
+
+#include <util/path_to_regex.hpp>
+
+#include <memory>
+#include <string_view>
+
+namespace path2regex {
+
+/**
+ *  Matches paths against many Express-style patterns (see path_to_regex) at once.
+ *
+ *  Patterns made of plain text, named parameters (/:id, /:file.:ext) and
+ *  a trailing wildcard ('*') are compiled into a radix tree, walked once per
+ *  path. Patterns using anything else (custom parameter patterns, optional or
+ *  repeated parameters, end = false) are kept as regexes and tried in turn.
+ *
+ *  As with trying each pattern's regex in the order they were added, the
+ *  first added pattern that matches wins. Unlike the regex, a '.' in the
+ *  plain text of a pattern matches only a '.'.
+ */
+class Route_tree {
+public:
+  using Params = std::vector<std::pair<std::string, std::string>>;
+
+  struct Match {
+    size_t route;   // as returned by add()
+    Params params;  // name and value of each parameter matched
+  };
+
+  Route_tree();
+  ~Route_tree();
+
+  /**
+   *  Add a pattern
+   *
+   *  Options are as for path_to_regex
+   *
+   *  Returns the index of the route, counting from 0
+   */
+  size_t add(const std::string& pattern, const Options& options = Options{});
+
+  /**
+   *  Match a path (without the query) against the patterns added
+   *
+   *  Returns false if none matched
+   */
+  bool match(std::string_view path, Match& out) const;
+
+  size_t size() const noexcept
+  { return routes_; }
+
+  /** The number of patterns that could not be put in the tree */
+  size_t regex_routes() const noexcept
+  { return regexes_.size(); }
+
+private:
+  struct Node;
+  struct Regex_route {
+    size_t      route;
+    std::regex  regex;
+    Keys        keys;
+  };
+  struct Candidate;
+
+  std::unique_ptr<Node>     sensitive_;
+  std::unique_ptr<Node>     insensitive_;
+  std::vector<Regex_route>  regexes_;
+  // the parameter names of each route in the tree
+  std::vector<std::vector<std::string>> names_;
+  size_t                    routes_ = 0;
+
+  static Node* insert_text(Node* node, std::string_view text, size_t route);
+  static void walk(const Node& node, std::string_view path, bool sensitive,
+                   std::vector<std::string_view>& values, Candidate& best);
+};
+
+} //< namespace path2regex
+
+#endif //< UTIL_ROUTE_TREE_HPP
@@ -51,7 +51,7 @@ private:
     uint64_t transforms;
     uint32_t digest[5];
     uint32_t buffer_len = 0;
-    char     buffer[BLOCK_BYTES+2];
+    uint8_t  buffer[BLOCK_BYTES];
 };
 
 
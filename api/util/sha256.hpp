@@ -0,0 +1,42 @@
+
+#ifndef UTIL_SHA256_HPP
+#define UTIL_SHA256_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * SHA-256 (FIPS 180-4), with the same interface as SHA1.
+ * Uses the SHA extensions of the CPU (SHA-NI, ARMv8 crypto) when present.
+ */
+class SHA256
+{
+public:
+    static const size_t BLOCK_BYTES = 64;
+
+    SHA256();
+    // update with new data
+    void update(const std::string&);
+    void update(const std::vector<char>&);
+    void update(const void*, size_t);
+    // finalize values
+    std::vector<char> as_raw();  // 32 bytes
+    std::string       as_hex();  // 64 bytes
+
+    // 32 byte SHA256 raw value
+    static std::vector<char> oneshot_raw(const std::vector<char>&);
+    // 64 byte SHA256 hex string
+    static std::string oneshot_hex(const std::string&);
+
+private:
+    void finalize();
+    void reset();
+    uint64_t transforms;
+    uint32_t digest[8];
+    uint32_t buffer_len = 0;
+    uint8_t  buffer[BLOCK_BYTES];
+};
+
+
+#endif /* UTIL_SHA256_HPP */
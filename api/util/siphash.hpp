@@ -0,0 +1,58 @@
+#pragma once
+#ifndef UTIL_SIPHASH_HPP
+#define UTIL_SIPHASH_HPP
+
+#include <cstdint>
+
+namespace util {
+
+/**
+ * SipHash-2-4 over 64-bit words. A keyed hash, for the short MACs of
+ * cookies and such, where the input is picked by whoever is on the other end.
+ */
+class Siphash {
+public:
+  Siphash(uint64_t k0, uint64_t k1) noexcept
+    : v0{k0 ^ 0x736f6d6570736575ull}, v1{k1 ^ 0x646f72616e646f6dull},
+      v2{k0 ^ 0x6c7967656e657261ull}, v3{k1 ^ 0x7465646279746573ull}
+  {}
+
+  Siphash& add(uint64_t m) noexcept
+  {
+    v3 ^= m;
+    round(); round();
+    v0 ^= m;
+    words_++;
+    return *this;
+  }
+
+  uint64_t finish() noexcept
+  {
+    const uint64_t b = words_ * 8 << 56;
+    v3 ^= b;
+    round(); round();
+    v0 ^= b;
+    v2 ^= 0xff;
+    round(); round(); round(); round();
+    return v0 ^ v1 ^ v2 ^ v3;
+  }
+
+private:
+  uint64_t v0, v1, v2, v3;
+  uint64_t words_ = 0;
+
+  static uint64_t rotl(uint64_t x, int b) noexcept
+  { return (x << b) | (x >> (64 - b)); }
+
+  void round() noexcept
+  {
+    v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+    v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+  }
+};
+
+} // < namespace util
+
+#endif // < UTIL_SIPHASH_HPP
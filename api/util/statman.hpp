@@ -6,8 +6,14 @@
 #include <common>
 #include <cstddef>
 #include <deque>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <smp>
 #include <smp_utils>
+#include <util/histogram.hpp>
 
 struct Stats_out_of_memory : public std::out_of_range {
   explicit Stats_out_of_memory()
@@ -23,9 +29,53 @@ namespace liu {
   struct Storage; struct Restore;
 }
 
+/**
+ * @brief      A counter that every CPU increments in its own cache line,
+ *             without atomics, and that is summed up when it's read.
+ *
+ *             Created through Statman::create_percpu, once the number of
+ *             CPUs is known (not from global constructors).
+ */
+class Stat_percpu {
+public:
+  explicit Stat_percpu(size_t cpus)
+    : slots_(cpus > 0 ? cpus : 1) {}
+
+  void operator++() noexcept { local()++; }
+  void operator++(int) noexcept { local()++; }
+  Stat_percpu& operator+=(uint64_t n) noexcept
+  { local() += n; return *this; }
+
+  /** This CPU's share of the count */
+  uint64_t& local() noexcept
+  { return slots_[SMP::cpu_id()].value; }
+
+  /** The count of all CPUs, which may be short of increments in flight */
+  uint64_t total() const noexcept;
+
+  void reset() noexcept;
+
+private:
+  struct alignas(SMP_ALIGN) Slot {
+    uint64_t value = 0;
+  };
+  std::vector<Slot> slots_;
+};
+
+/**
+ * @brief      What a histogram stat reads: a percentile of a histogram,
+ *             or its largest value when the percentile is over 100.
+ */
+struct Stat_histogram {
+  const util::Histogram_percpu* hist;
+  double percentile;
+};
+
 class Stat {
 public:
   static const int MAX_NAME_LEN = 46;
+  static const int HISTO_BIT    = 0x10;
+  static const int PERCPU_BIT   = 0x20;
   static const int GAUGE_BIT    = 0x40;
   static const int PERSIST_BIT  = 0x80;
 
@@ -56,6 +106,17 @@ public:
   void make_counter() noexcept { m_bits &= ~GAUGE_BIT; }
   void make_gauge() noexcept { m_bits |= GAUGE_BIT; }
 
+  // counted per CPU, see Stat_percpu. get_uint64() returns the sum
+  bool is_percpu() const noexcept { return m_bits & PERCPU_BIT; }
+  Stat_percpu* percpu() const noexcept
+  { return is_percpu() ? m_percpu : nullptr; }
+
+  // a gauge reading a histogram, see Statman::create_histogram.
+  // get_uint64() returns the percentile
+  bool is_histogram() const noexcept { return m_bits & HISTO_BIT; }
+  const Stat_histogram* histogram() const noexcept
+  { return is_histogram() ? m_histo : nullptr; }
+
   const char* name() const noexcept { return name_; }
   bool unused() const noexcept { return name_[0] == 0; }
 
@@ -74,9 +135,24 @@ private:
     uint32_t ui32;
     uint64_t ui64;
   };
+  union {
+    Stat_percpu*    m_percpu = nullptr;
+    Stat_histogram* m_histo;
+  };
   uint8_t m_bits;
 
   char name_[MAX_NAME_LEN+1];
+
+  // the sum of a per-CPU stat, kept in ui64 for readers
+  uint64_t& percpu_total() const noexcept;
+  // the percentile of a histogram stat, kept in ui64 for readers
+  uint64_t& histogram_value() const noexcept;
+  // a plain copy of a per-CPU or histogram stat, with its current value
+  Stat flattened() const;
+  // delete what a per-CPU or histogram stat reads
+  void release() noexcept;
+
+  friend class Statman;
 }; //< class Stat
 
 
@@ -97,9 +173,25 @@ public:
     * Create a new stat
    **/
   Stat& create(const Stat::Stat_type type, const std::string& name);
+  /**
+    * Create a new UINT64 stat that is counted per CPU
+   **/
+  Stat_percpu& create_percpu(const std::string& name);
+  /**
+    * Create a latency histogram that is recorded into per CPU, and read
+    * through the gauges <name>.p50, .p90, .p99, .p999 and .max, which
+    * are computed when read. The name can be 41 characters long.
+    * The histogram lives as long as Statman, or until clear().
+   **/
+  util::Histogram_percpu& create_histogram(const std::string& name);
+  /**
+    * Visit every histogram, with the name it was created with
+   **/
+  template <typename Func>
+  void for_each_histogram(Func func) const;
   // retrieve stat based on address from stats counter: &stat.get_xxx()
   Stat& get(const Stat* addr);
-  // if you know the name of a statistic already
+  // if you know the name of a statistic already (hashed lookup)
   Stat& get_by_name(const char* name);
   // retrieve stat or create if it doesnt exists
   Stat& get_or_create(const Stat::Stat_type type, const std::string& name);
@@ -136,10 +228,16 @@ public:
   void restore(liu::Restore&);
 
   Statman();
+  ~Statman();
 private:
   std::deque<Stat> m_stats;
+  // names point into the stats, which never move
+  std::unordered_map<std::string_view, Stat*> m_index;
+  std::vector<std::pair<std::string, std::unique_ptr<util::Histogram_percpu>>> m_histograms;
   mutable smp_spinlock stlock;
   ssize_t find_free_stat() const noexcept;
+  void index(Stat& stat);
+  void unindex(Stat& stat);
   uint32_t& unused_stats();
 
   Statman(const Statman& other) = delete;
@@ -148,6 +246,13 @@ private:
   Statman& operator=(Statman&& other) = delete;
 }; //< class Statman
 
+template <typename Func>
+void Statman::for_each_histogram(Func func) const {
+  stlock.lock();
+  for (const auto& [name, hist] : m_histograms) func(name, *hist);
+  stlock.unlock();
+}
+
 inline uint32_t& Statman::unused_stats() {
   return m_stats.at(0).get_uint32();
 }
@@ -162,6 +267,8 @@ inline uint32_t& Stat::get_uint32() {
 }
 inline uint64_t& Stat::get_uint64() {
   if (UNLIKELY(type() != UINT64)) throw Stats_exception{"Stat type is not an uint64"};
+  if (UNLIKELY(is_percpu())) return percpu_total();
+  if (UNLIKELY(is_histogram())) return histogram_value();
   return ui64;
 }
 
@@ -175,6 +282,8 @@ inline const uint32_t& Stat::get_uint32() const {
 }
 inline const uint64_t& Stat::get_uint64() const {
   if (UNLIKELY(type() != UINT64)) throw Stats_exception{"Stat type is not an uint64"};
+  if (UNLIKELY(is_percpu())) return percpu_total();
+  if (UNLIKELY(is_histogram())) return histogram_value();
   return ui64;
 }
 
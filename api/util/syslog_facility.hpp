@@ -4,6 +4,7 @@
 
 #define LOG_INTERNAL  5   /* Messages generated internally by syslogd */
 
+#include <chrono>
 #include <cstdio>
 #include <string>
 #include <map>
@@ -130,6 +131,12 @@ private:
 
 class Syslog_udp : public Syslog_facility {
 public:
+  // how messages are put in datagrams
+  enum class Framing {
+    DATAGRAM,      // one message per datagram (RFC 5426)
+    OCTET_COUNTED  // "LEN SP MSG", packed several to a datagram (RFC 6587)
+  };
+
   inline void settings(const net::Addr& dest_ip, const uint16_t dest_port) {
     ip_ = dest_ip;
     port_ = dest_port;
@@ -153,16 +160,56 @@ public:
 
   std::string build_message_prefix(const std::string& binary_name);
 
+  // only use octet counting when the receiver supports it
+  void set_framing(Framing framing) noexcept { framing_ = framing; }
+  Framing framing() const noexcept { return framing_; }
+
+  // the largest datagram to pack messages into
+  void set_max_datagram(uint16_t len) noexcept { max_datagram_ = len; }
+
+  // how long packed messages may wait for more to join them
+  void set_flush_interval(std::chrono::milliseconds ival) noexcept
+  { flush_interval_ = ival; }
+
+  // at most @per_sec messages a second, in bursts of up to @burst,
+  // the rest are counted and reported in a summary (0: no limit)
+  void set_rate_limit(uint32_t per_sec, uint32_t burst);
+
+  // messages not sent because of the rate limit
+  uint64_t suppressed() const noexcept { return suppressed_total_; }
+
+  // send the messages that are packed and waiting
+  void flush();
+
   Syslog_udp() : Syslog_facility() {}
   Syslog_udp(const char* ident, int facility) : Syslog_facility(ident, facility) {}
 
   ~Syslog_udp();
 
 private:
+  bool admit();
+  void send(const std::string& message);
+  void send_udp_data(const char* data, size_t len);
+
   net::Addr ip_{};
   uint16_t port_{0};
   net::udp::Socket* sock_ = nullptr;
 
+  Framing  framing_ = Framing::DATAGRAM;
+  uint16_t max_datagram_ = 1400;
+  std::chrono::milliseconds flush_interval_ {10};
+  std::string batch_;
+  bool    flush_scheduled_ = false;
+  int32_t flush_timer_;
+
+  // token bucket, in messages
+  uint32_t rate_  = 1000;
+  uint32_t burst_ = 1000;
+  double   tokens_ = 1000;
+  uint64_t refilled_ = 0; // nanos
+  uint64_t suppressed_ = 0; // since the last summary
+  uint64_t suppressed_total_ = 0;
+
 }; // < Syslog_udp
 
 // Syslog_print
@@ -8,7 +8,10 @@
 #include <util/crc32.hpp>
 #include <info>
 
+#include <gsl/span>
+#include <deque>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <stdexcept>
 #include <memory>
@@ -88,6 +91,12 @@ public:
   const uint8_t* content() const { return content_start_; }
   void set_content_start(const uint8_t* content_start) { content_start_ = content_start; }
 
+  /** The contents, where they are in the archive */
+  gsl::span<const uint8_t> data() const noexcept {
+    if (content_start_ == nullptr) return {};
+    return {content_start_, content_start_ + size()};
+  }
+
   std::string name() const { return std::string{header_.name}; }
   std::string mode() const { return std::string{header_.mode}; }
   std::string uid() const { return std::string{header_.uid}; }
@@ -134,22 +143,39 @@ private:
 class Tar {
 
 public:
-  using Elements = std::vector<Element>;
+  // a deque, so that elements stay where they are as more are parsed
+  using Elements = std::deque<Element>;
   Tar() = default;
-  int num_elements() const noexcept { return elements_.size(); }
-  void add_element(const Element& element) { elements_.push_back(element); }
+  // headers are parsed as they are needed, from the archive in place
+  Tar(const uint8_t* data, size_t size) noexcept
+    : data_{data}, size_{size} {}
+
+  int num_elements() const { return elements().size(); }
+  void add_element(const Element& element);
   const Element& element(const std::string& path) const;
-  const Elements& elements() const noexcept { return elements_; }
+  /** The element at path, or nullptr, parsing only as far as needed */
+  const Element* find(const std::string& path) const;
+  const Elements& elements() const { parse(nullptr); return elements_; }
   std::vector<std::string> element_names() const;
 
-  auto begin() const noexcept
-  { return elements_.begin(); }
+  auto begin() const
+  { return elements().begin(); }
 
-  auto end() const noexcept
-  { return elements_.end(); }
+  auto end() const
+  { return elements().end(); }
 
 private:
-  std::vector<Element> elements_;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  // where the next header is
+  mutable size_t parsed_ = 0;
+  mutable Elements elements_;
+  // the first element with each name
+  mutable std::unordered_map<std::string, uint32_t> index_;
+
+  // parse headers until path is found, or all of them
+  const Element* parse(const std::string* path) const;
+  const Element& append(const Element& element) const;
 
 };  // class Tar
 
@@ -34,7 +34,9 @@ public:
   /** Move constructor, which stops the other timer and takes over **/
   Timer(Timer&& other)
     : id_{other.id_},
-      on_timeout_{std::move(other.on_timeout_)}
+      on_timeout_{std::move(other.on_timeout_)},
+      slack_{other.slack_},
+      deferrable_{other.deferrable_}
   {
     // the other timer is now "stopped"
     other.id_ = Timers::UNUSED_ID;
@@ -78,6 +80,26 @@ public:
   void set_on_timeout(handler_t on_timeout)
   { on_timeout_ = on_timeout; }
 
+  /**
+   * @brief Let the timer run up to @slack late
+   * @details Timers due within each other's slack run together, in one
+   * interrupt. Applies from the next start.
+   *
+   * @param slack how late the timer may run
+   */
+  void set_slack(duration_t slack)
+  { slack_ = slack; }
+
+  /**
+   * @brief Make the timer deferrable
+   * @details A deferrable timer does not wake the CPU by itself, but runs
+   * along with the next timer that does. Applies from the next start.
+   *
+   * @param deferrable whether the timer is deferrable
+   */
+  void set_deferrable(bool deferrable)
+  { deferrable_ = deferrable; }
+
   /**
    * @brief If the timer is running (active)
    *
@@ -104,6 +126,9 @@ private:
   Timers::id_t id_;
   /** Function to execute on timeout */
   handler_t on_timeout_;
+  /** How late it may run, and whether it wakes the CPU */
+  duration_t slack_ {0};
+  bool deferrable_ = false;
 
   /**
    * @brief Sets the timer to inactive before calling the user callback
@@ -124,6 +149,10 @@ inline void Timer::start(duration_t when, handler_t on_timeout) {
       set_on_timeout(on_timeout);
 
     id_ = Timers::oneshot(when, {this, &Timer::_internal_timeout});
+    if (slack_.count() > 0)
+      Timers::set_slack(id_, slack_);
+    if (deferrable_)
+      Timers::set_deferrable(id_, true);
   }
 }
 
@@ -0,0 +1,74 @@
+
+#pragma once
+#ifndef UTIL_TOKEN_BUCKET_HPP
+#define UTIL_TOKEN_BUCKET_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+namespace util {
+
+/**
+ * @brief      A token bucket rate limiter: up to @burst events at once,
+ *             and @rate a second on average. A rate of 0 admits everything.
+ *
+ * Tokens are counted in billionths, so admitting an event is a few
+ * integer operations on the time given, usually os::nanos_since_boot().
+ */
+class Token_bucket {
+public:
+  static constexpr uint64_t TOKEN = 1'000'000'000;
+
+  Token_bucket(uint32_t rate, uint32_t burst) noexcept
+  { set(rate, burst); }
+
+  /** Change the rate and burst, filling the bucket */
+  void set(uint32_t rate, uint32_t burst) noexcept
+  {
+    rate_   = rate;
+    burst_  = std::max<uint32_t>(burst, 1);
+    tokens_ = burst_ * TOKEN;
+    // time to fill an empty bucket, beyond which the bucket is full
+    fill_ns_ = (rate_ > 0) ? burst_ * TOKEN / rate_ : 0;
+  }
+
+  /** Whether an event at @now (in nanoseconds) may go ahead */
+  bool admit(const uint64_t now) noexcept
+  {
+    if (rate_ == 0) return true;
+    const uint64_t elapsed = now - refilled_;
+    refilled_ = now;
+    if (elapsed >= fill_ns_)
+      tokens_ = burst_ * TOKEN;
+    else
+      tokens_ = std::min(burst_ * TOKEN, tokens_ + elapsed * rate_);
+    if (tokens_ < TOKEN) {
+      limited_++;
+      return false;
+    }
+    tokens_ -= TOKEN;
+    return true;
+  }
+
+  uint32_t rate() const noexcept
+  { return rate_; }
+
+  uint32_t burst() const noexcept
+  { return burst_; }
+
+  /** Events turned away so far */
+  uint64_t limited() const noexcept
+  { return limited_; }
+
+private:
+  uint32_t rate_;
+  uint32_t burst_;
+  uint64_t tokens_;
+  uint64_t fill_ns_;
+  uint64_t refilled_ = 0;
+  uint64_t limited_  = 0;
+};
+
+} // < namespace util
+
+#endif // < UTIL_TOKEN_BUCKET_HPP
@@ -3,9 +3,13 @@
 #ifndef UTIL_URI_HPP
 #define UTIL_URI_HPP
 
-#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include "detail/string_view"
 
@@ -289,6 +293,194 @@ private:
   void load_queries();
 }; //< class URI
 
+///
+/// A URI parsed in place. The parts are offsets into the caller's
+/// buffer, which must outlive the view, and nothing is allocated or
+/// copied. Unlike {URI}, the parts are left percent-encoded, so that
+/// only the parts that are used have to be decoded.
+///
+class URI_view {
+public:
+  ///
+  /// A key and a value from the query string, still percent-encoded
+  ///
+  struct Param {
+    util::sview key;
+    util::sview value;
+  };
+
+  ///
+  /// Iterates over the pieces of a string separated by a char,
+  /// finding each one as it goes
+  ///
+  template <char Sep, typename T>
+  class Split_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = T;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const T*;
+    using reference         = const T&;
+
+    Split_iterator() = default;
+    // an empty string has no pieces
+    explicit Split_iterator(util::csview rest) noexcept
+      : rest_{rest}, done_{rest.empty()}
+    { if (not done_) next(); }
+
+    reference operator*()  const noexcept { return cur_; }
+    pointer   operator->() const noexcept { return &cur_; }
+
+    Split_iterator& operator++() noexcept
+    { next(); return *this; }
+
+    Split_iterator operator++(int) noexcept
+    { auto it = *this; next(); return it; }
+
+    bool operator==(const Split_iterator& other) const noexcept
+    { return done_ == other.done_ and (done_ or rest_.data() == other.rest_.data()); }
+
+    bool operator!=(const Split_iterator& other) const noexcept
+    { return not (*this == other); }
+
+  private:
+    util::sview rest_ {};
+    T    cur_ {};
+    bool done_ = true;
+    bool last_ = false;
+
+    void next() noexcept;
+  };
+
+  using Param_iterator   = Split_iterator<'&', Param>;
+  using Segment_iterator = Split_iterator<'/', util::sview>;
+
+  ///
+  /// A range of pieces, for range-based for loops
+  ///
+  template <typename It>
+  struct Range {
+    It first, last;
+    It begin() const noexcept { return first; }
+    It end()   const noexcept { return last; }
+  };
+
+  ///
+  /// Construct an empty (invalid) view
+  ///
+  URI_view() = default;
+
+  ///
+  /// Parse a string representing a uri, in place
+  ///
+  /// @param uri
+  ///   A view of a string representing a uri, which must outlive this
+  ///
+  /// @param is_connect
+  ///   Whether {uri} is the authority form used by CONNECT requests
+  ///
+  explicit URI_view(util::csview uri, bool is_connect = false) noexcept;
+
+  /// The parts, as in {URI}
+  util::sview scheme()   const noexcept { return part(SCHEME); }
+  util::sview userinfo() const noexcept { return part(USERINFO); }
+  util::sview host()     const noexcept { return part(HOST); }
+  util::sview path()     const noexcept { return part(PATH); }
+  util::sview query()    const noexcept { return part(QUERY); }
+  util::sview fragment() const noexcept { return part(FRAGMENT); }
+
+  ///
+  /// Get numeric port number, or the default one for the scheme.
+  /// 65535 when there is neither.
+  ///
+  uint16_t port() const noexcept { return port_; }
+
+  ///
+  /// Check if host portion is an IPv6 address.
+  ///
+  bool host_is_ip6() const noexcept;
+
+  ///
+  /// The parameters of the query string, in order, found as the
+  /// range is iterated. A key without '=' has an empty value.
+  ///
+  Range<Param_iterator> query_params() const noexcept
+  { return {Param_iterator{query()}, Param_iterator{}}; }
+
+  ///
+  /// Get the (still percent-encoded) value of the first parameter in
+  /// the query string with the (percent-encoded) {key}
+  ///
+  /// @return The value, or an empty view with no data if not found
+  ///
+  util::sview query(util::csview key) const noexcept;
+
+  ///
+  /// The segments of the path between the slashes, for matching a
+  /// route piece by piece. "/a/b/" has the segments "a", "b" and "",
+  /// and "/" has none.
+  ///
+  Range<Segment_iterator> path_segments() const noexcept;
+
+  ///
+  /// The whole uri
+  ///
+  util::sview to_view() const noexcept { return {data_, size_}; }
+
+  ///
+  /// Check whether the uri was parsed, and has a host or a path
+  ///
+  bool is_valid() const noexcept
+  { return valid_ and (not host().empty() or not path().empty()); }
+
+  operator bool() const noexcept
+  { return is_valid(); }
+
+private:
+  // in the order of http_parser's fields
+  enum Part : uint8_t { SCHEME, HOST, PORT, PATH, QUERY, FRAGMENT, USERINFO, NUM_PARTS };
+  struct Span {
+    uint16_t off = 0;
+    uint16_t len = 0;
+  };
+
+  const char* data_ = nullptr;
+  uint32_t    size_ = 0;
+  Span        parts_[NUM_PARTS] {};
+  uint16_t    port_  = 0xFFFF;
+  bool        valid_ = false;
+
+  util::sview part(Part p) const noexcept
+  { return {data_ + parts_[p].off, parts_[p].len}; }
+}; //< class URI_view
+
+template <char Sep, typename T>
+inline void URI_view::Split_iterator<Sep, T>::next() noexcept
+{
+  if (last_) {
+    done_ = true;
+    return;
+  }
+  const auto end = rest_.find(Sep);
+  const util::sview piece = rest_.substr(0, end);
+  if (end == util::sview::npos) {
+    last_ = true;
+    rest_.remove_prefix(rest_.size());
+  }
+  else {
+    rest_.remove_prefix(end + 1);
+  }
+
+  if constexpr (std::is_same_v<T, Param>) {
+    const auto eq = piece.find('=');
+    cur_.key   = piece.substr(0, eq);
+    cur_.value = (eq == util::sview::npos) ? piece.substr(piece.size()) : piece.substr(eq + 1);
+  }
+  else {
+    cur_ = piece;
+  }
+}
+
 ///
 /// Less-than operator to compare two {URI} objects
 ///
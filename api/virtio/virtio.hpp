@@ -29,6 +29,8 @@
 #define VIRTIO_F_RING_INDIRECT_DESC 28
 #define VIRTIO_F_RING_EVENT_IDX 29
 #define VIRTIO_F_VERSION_1 32
+// Needs the 64-bit feature word of the Virtio 1.0 transport, legacy has 32
+#define VIRTIO_F_RING_PACKED 34
 
 // From sanos virtio.h
 #define VIRTIO_PCI_HOST_FEATURES        0   // Features supported by the host
@@ -65,6 +67,7 @@ public:
     inline Token(span buf, Direction d) :
       data_{ buf.first }, size_{ buf.second }, dir_{ d }
     {}
+    inline Token() : Token({nullptr, 0}, OUT) {}
 
     inline auto data() { return data_; }
     inline auto size() { return size_; }
@@ -132,7 +135,7 @@ public:
       le16 flags;
       le16 idx;
       le16 ring[/* Queue Size */];
-      /*le16 used_event;  Only if VIRTIO_F_EVENT_IDX */
+      /*le16 used_event;  Only if VIRTIO_F_EVENT_IDX, see used_event() */
     };
 
 
@@ -151,7 +154,7 @@ public:
       le16 flags;
       le16 idx;
       struct virtq_used_elem ring[ /* Queue Size */];
-      /*le16 avail_event; Only if VIRTIO_F_EVENT_IDX */
+      /*le16 avail_event; Only if VIRTIO_F_EVENT_IDX, see avail_event() */
     };
 
 
@@ -192,6 +195,10 @@ public:
         Will notify the host (Qemu/Virtualbox etc.) about pending data  */
     void kick();
 
+    /** Whether the device asked to be notified about the buffers made
+        available since the avail index was @old_idx */
+    bool needs_notify(u16 old_idx) noexcept;
+
     /** Constructor. @param size shuld be fetched from PCI device. */
     Queue() {}
     Queue(const std::string& name,
@@ -215,6 +222,23 @@ public:
     /** Release token. @param head : the token ID to release*/
     void release(uint32_t head);
 
+    /** Describe chains of up to @max_tokens buffers with a single ring
+        descriptor, pointing to a table of descriptors. Virtio std. §2.4.5.3
+        @note Only if VIRTIO_F_RING_INDIRECT_DESC was negotiated */
+    void enable_indirect(int max_tokens);
+
+    bool indirect() const noexcept
+    { return _indirect != nullptr; }
+
+    /** Suppress interrupts and kicks using the used_event / avail_event
+        indexes instead of flags. Virtio std. §2.4.7 and §2.4.8
+        @note Only if VIRTIO_F_RING_EVENT_IDX was negotiated */
+    void enable_event_idx() noexcept
+    { _event_idx = true; }
+
+    bool event_idx() const noexcept
+    { return _event_idx; }
+
     /** Get number of new incoming buffers, i.e. the increase in
         queue_used_->idx since we last checked. An increase means the device
         has inserted tokens into the used ring.*/
@@ -237,6 +261,13 @@ public:
       return size() - _desc_in_flight;
     }
 
+    /** Get number of chains of @tokens tokens that fit in the Queue */
+    uint16_t num_free_chains(int tokens) const noexcept
+    {
+      if (indirect() && tokens <= _indirect_max) return num_free();
+      return num_free() / tokens;
+    }
+
     // access the current index
     virtq_desc& current()
     {
@@ -262,6 +293,15 @@ public:
     /** Initialize the queue buffer */
     void init_queue(int size, char* buf);
 
+    /** Place the head of a descriptor chain in the avail ring */
+    void add_avail(uint16_t head);
+
+    // Trailing fields of the rings, only used with VIRTIO_F_RING_EVENT_IDX
+    le16& used_event() noexcept
+    { return _queue.avail->ring[_size]; }
+    le16& avail_event() noexcept
+    { return *(le16*) &_queue.used->ring[_size]; }
+
     std::string qname;
 
     // The size as read from the PCI device
@@ -276,6 +316,11 @@ public:
     uint16_t _desc_in_flight = 0; // Entries in _queue_desc currently in use
     uint16_t _last_used_idx = 0; // Last known value of _queue.used->idx
     uint16_t _pci_index = 0; // Queue nr.
+
+    // One table of _indirect_max descriptors per ring descriptor
+    virtq_desc* _indirect = nullptr;
+    uint16_t _indirect_max = 0;
+    bool     _event_idx = false;
   };
 
 
@@ -284,6 +329,9 @@ public:
       @note it varies how these are structured, hence a void* buf */
   void get_config(void* buf, int len);
 
+  /** Write @len bytes of the device specific config registers, from @offset */
+  void set_config(int offset, const void* buf, int len);
+
   /** Get the list of subscribed IRQs */
   auto& get_irqs() { return irqs; };
 
@@ -302,6 +350,18 @@ public:
   /** Get locally stored features */
   inline uint32_t features(){ return _features; };
 
+  /** Features both we and the host agreed on */
+  inline uint32_t negotiated_features() const noexcept { return _negotiated; }
+
+  /** Ring features any driver can ask for, see enable_ring_features() */
+  static const uint32_t RING_FEATURES =
+      (1 << VIRTIO_F_RING_INDIRECT_DESC) | (1 << VIRTIO_F_RING_EVENT_IDX);
+
+  /** Use the negotiated ring features on a queue.
+      @param max_tokens : chain length to use indirect descriptors for,
+                          0 to only use event indexes */
+  void enable_ring_features(Queue& q, int max_tokens);
+
   /** Get iobase. Wrapper around PCI_Device::iobase */
   inline uint32_t iobase(){ return _iobase; }
 
@@ -310,6 +370,8 @@ public:
 
   /** Assign a queue descriptor to a PCI queue index */
   bool assign_queue(uint16_t index, const void* queue_desc);
+  /** Assign a queue descriptor, notifying on a specific MSI-X vector */
+  bool assign_queue(uint16_t index, const void* queue_desc, uint16_t msix_vector);
 
   /** Tell Virtio device if we're OK or not. Virtio Std. § 3.1.1,step 8*/
   void setup_complete(bool ok);
@@ -348,6 +410,7 @@ private:
   //We'll get this from PCI_device::iobase(), but that lookup takes longer
   uint32_t _iobase = 0;
   uint32_t _features = 0;
+  uint32_t _negotiated = 0;
   uint16_t _virtio_device_id = 0;
 
   // Indicate if virtio device ID is legacy or standard
@@ -10,6 +10,7 @@ set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${COMMON}")
 option(BUILD_PLUGINS "Build all plugins as libraries" OFF)
 option(DEBUGGING    "Enable debugging" OFF)
 option(PORTABLE     "Enable portable TAP-free userspace" ON)
+option(IO_URING     "Do TAP I/O on io_uring when the kernel has it" ON)
 option(LIBCPP       "Enable libc++" OFF)
 option(PERFORMANCE  "Enable performance mode" OFF)
 option(GPROF        "Enable profiling with gprof" OFF)
@@ -94,6 +95,8 @@ add_definitions(-DSERVICE_NAME=\"\\\"${SERVICE_NAME}\\\"\")
 add_definitions(-DUSERSPACE_KERNEL)
 if (PORTABLE)
 	add_definitions(-DPORTABLE_USERSPACE)
+elseif (IO_URING)
+	add_definitions(-DUSERSPACE_IO_URING)
 endif()
 
 set(IOSPATH $ENV{INCLUDEOS_SRC})
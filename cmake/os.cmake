@@ -394,7 +394,16 @@ function(internal_os_add_config TARGET CONFIG_JSON)
     COMMAND ${CMAKE_OBJCOPY} -I binary -O ${OBJCOPY_TARGET} -B i386 --rename-section .data=.config,CONTENTS,ALLOC,LOAD,READONLY,DATA ${CONFIG_JSON} ${OUTFILE}
     DEPENDS ${CONFIG_JSON}
     )
-  add_library(config_json_${TARGET} STATIC ${OUTFILE})
+  # the config compiled to binary, which autoconf reads without parsing
+  set(BINFILE ${CMAKE_CURRENT_BINARY_DIR}/${FILENAME}.bin)
+  set(BINOUTFILE ${CMAKE_CURRENT_BINARY_DIR}/${FILENAME}.bin.o)
+  add_custom_command(
+    OUTPUT ${BINOUTFILE}
+    COMMAND ${PYTHON3_EXECUTABLE} ${CONAN_RES_DIRS_INCLUDEOS}/tools/config/config2bin.py ${CONFIG_JSON} ${BINFILE}
+    COMMAND ${CMAKE_OBJCOPY} -I binary -O ${OBJCOPY_TARGET} -B i386 --rename-section .data=.config_bin,CONTENTS,ALLOC,LOAD,READONLY,DATA ${BINFILE} ${BINOUTFILE}
+    DEPENDS ${CONFIG_JSON}
+    )
+  add_library(config_json_${TARGET} STATIC ${OUTFILE} ${BINOUTFILE})
   set_target_properties(config_json_${TARGET} PROPERTIES LINKER_LANGUAGE CXX)
   target_link_libraries(${TARGET}${TARGET_POSTFIX} --whole-archive config_json_${TARGET} --no-whole-archive)
 endfunction()
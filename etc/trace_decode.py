@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+Decode a trace dumped by trace::dump() or trace::dump_serial().
+
+  trace_decode.py trace.bin
+  trace_decode.py serial.log    (the hex between the trace markers)
+
+Prints the records of all CPUs merged by time, in microseconds since the
+first one. Event numbers must match trace::Event in api/kernel/trace.hpp.
+"""
+import struct
+import sys
+
+TCP_STATES = ["CLOSED", "LISTEN", "SYN-SENT", "SYN-RECEIVED", "ESTABLISHED",
+              "FIN-WAIT-1", "FIN-WAIT-2", "CLOSE-WAIT", "CLOSING", "LAST-ACK",
+              "TIME-WAIT"]
+
+def tcp_state(n):
+    return TCP_STATES[n] if n < len(TCP_STATES) else "?"
+
+EVENTS = {
+    1: ("nic_rx",         lambda a0, a1, a2: "%u bytes nic=%#x" % (a0, a1)),
+    2: ("nic_tx",         lambda a0, a1, a2: "%u bytes nic=%#x" % (a0, a1)),
+    3: ("tcp_state",      lambda a0, a1, a2: "%s -> %s conn=%#x port=%u" %
+                              (tcp_state(a0 >> 8), tcp_state(a0 & 0xff), a1, a2)),
+    4: ("timer_fire",     lambda a0, a1, a2: "id=%u late=%uns" % (a0, a1)),
+    5: ("event_dispatch", lambda a0, a1, a2: "event=%u" % a0),
+    6: ("heap_alloc",     lambda a0, a1, a2: "%u bytes at %#x" % (a0, a1)),
+    7: ("heap_free",      lambda a0, a1, a2: "%u bytes at %#x" % (a0, a1)),
+}
+
+HEADER = struct.Struct("<8sIIQII")
+CPU    = struct.Struct("<II")
+RECORD = struct.Struct("<QHHIQQ")
+
+def read_input(path):
+    data = open(path, "rb").read()
+    if data.startswith(b"IOSTRACE"):
+        return data
+    # serial output, with the dump as hex between the markers
+    lines = data.decode("utf-8", "replace").splitlines()
+    try:
+        begin = lines.index("--- trace begin ---")
+        end   = lines.index("--- trace end ---", begin)
+    except ValueError:
+        sys.exit("No trace found in %s" % path)
+    return bytes.fromhex("".join(lines[begin + 1:end]))
+
+def decode(data):
+    magic, version, cpus, tsc_khz, entries, _ = HEADER.unpack_from(data, 0)
+    if magic != b"IOSTRACE" or version != 1:
+        sys.exit("Not a trace, or an unknown version")
+    off = HEADER.size
+    records = []
+    for _ in range(cpus):
+        cpu, count = CPU.unpack_from(data, off)
+        off += CPU.size
+        for _ in range(count):
+            records.append((cpu,) + RECORD.unpack_from(data, off))
+            off += RECORD.size
+    records.sort(key=lambda r: r[1])
+    return tsc_khz, records
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    tsc_khz, records = decode(read_input(sys.argv[1]))
+    if not records:
+        return
+    start = records[0][1]
+    for cpu, tsc, event, _, a0, a1, a2 in records:
+        usecs = (tsc - start) * 1000.0 / tsc_khz if tsc_khz else float(tsc - start)
+        name, fmt = EVENTS.get(event, ("user+%u" % (event - 0x100) if event >= 0x100
+                                       else "event %u" % event,
+                                       lambda a0, a1, a2: "%u %#x %#x" % (a0, a1, a2)))
+        print("%14.3f  cpu%-3u %-15s %s" % (usecs, cpu, name, fmt(a0, a1, a2)))
+
+if __name__ == "__main__":
+    main()
@@ -22,6 +22,31 @@ struct Restore;
 using buffer_t = std::vector<uint8_t>;
 using location_t = std::pair<void*, size_t>;
 
+/**
+ * How long each phase of the blackout took, in CPU cycles, from turning
+ * off interrupts in exec() to jumping to the new kernel. The new kernel
+ * gets it with LiveUpdate::blackout(), along with the time since the jump.
+**/
+struct Blackout
+{
+  uint64_t begin      = 0; // TSC when interrupts were turned off
+  uint64_t scan       = 0; // finding the new kernel in the ELF
+  uint64_t store      = 0; // serializing all the partitions
+  uint64_t deactivate = 0; // flushing and deactivating devices
+  uint64_t softreset  = 0; // storing soft-reset data
+  uint64_t jump       = 0; // TSC right before jumping to the new kernel
+  // from the jump until blackout() was called, in the new kernel
+  // NOTE: only meaningful when the TSC kept counting, as on a soft-reset
+  uint64_t resumed    = 0;
+  double   cpu_khz    = 0; // of the old kernel
+
+  uint64_t total() const noexcept { return jump - begin + resumed; }
+  double   to_us(uint64_t cycles) const noexcept {
+    return cpu_khz > 0 ? cycles / (cpu_khz / 1000.0) : 0.0;
+  }
+  void print() const;
+};
+
 /**
  * The beginning and the end of the LiveUpdate process is the exec() and resume() functions.
  * exec() is called with a provided binary blob that is the new executable code to live update to,
@@ -44,6 +69,7 @@ struct LiveUpdate
   // Start a live update process, storing all user-defined data
   // If no storage functions are registered no state will be saved
   // The default storage area is managed by the OS and is recommended
+  // The blob is either an ELF binary, or one compressed with compressed_image
   static void exec(const uint8_t* blob, size_t size, location_t = default_location);
   // Same as above, but including the partition [@key, func]
   static void exec(const uint8_t* blob, size_t size, std::string key, storage_func func, location_t = default_location);
@@ -58,6 +84,21 @@ struct LiveUpdate
   // Throws exception if process or sanity checks fail
   static size_t store(location_t = default_location);
 
+  // Pre-copy a large memory region into its own partition @key ahead of
+  // exec(), while the service keeps running. Writes to the region after
+  // this must be reported with precopy_dirty(), and only the blocks that
+  // changed are copied again during the blackout. On resume the partition
+  // holds the region as consecutive buffer entries, see Restore::data().
+  // NOTE: the region must stay valid until exec(), or precopy_cancel()
+  static void precopy(std::string key, const void* data, size_t len, location_t = default_location);
+  // Copy up to @max_bytes of the changed blocks now, eg. from a timer,
+  // so that less is left for the blackout. Returns the bytes still dirty
+  static size_t precopy_step(size_t max_bytes);
+  // Report a write to a pre-copied region, after making it
+  static void precopy_dirty(const void* addr, size_t len) noexcept;
+  // Forget all pre-copied regions, and what was stored for them
+  static void precopy_cancel() noexcept;
+
   // Returns the location and size of the executable during exec()
   // To be used from inside the store callbacks to optionally save the binary
   static std::pair<const uint8_t*, size_t> binary_blob() noexcept;
@@ -98,6 +139,10 @@ struct LiveUpdate
   // Enable/disable extra checksumming
   // Note that internal headers are always checked
   void enable_extra_checks(bool en) noexcept;
+
+  // Retrieve the blackout timing of the update that started this kernel.
+  // Returns false when there was no update, or it didn't record any
+  static bool blackout(Blackout&, location_t = default_location);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -136,11 +181,17 @@ struct Storage
   void add_string(uid, const std::string&);
   void add_buffer(uid, const buffer_t&);
   void add_buffer(uid, const void*, size_t length);
+  // store a reference to a buffer in memory that survives the update,
+  // such as the storage area itself, without copying it
+  // NOTE: throws when the buffer could be overwritten by the new kernel
+  void add_reference(uid, const void*, size_t length);
   // store vectors of PODs or std::string
   template <typename T>
   inline void add_vector(uid, const std::vector<T>& vector);
   // store a TCP connection
   void add_connection(uid, Connection_ptr);
+  // store many TCP connections, copying their queues on all CPUs
+  void add_connections(uid, const std::vector<Connection_ptr>&);
   // store a Stream, but not its underlying transport
   // NOTE: UID is taken and used to determine its underlying type
   void add_stream(net::Stream&);
@@ -178,11 +229,17 @@ struct Restore
   bool  is_vector() const noexcept; // not for string-vector
   bool  is_string_vector() const noexcept; // for string-vector
   bool  is_stream() const noexcept;
+  bool  is_reference() const noexcept;
 
   int             as_int()    const;
   std::string     as_string() const;
   buffer_t        as_buffer() const;
+  // the buffer stored with add_reference(), where it was left
+  location_t      as_reference() const;
   Connection_ptr  as_tcp_connection(net::TCP&) const;
+  // restore all the TCP connections from here on, eg. those stored
+  // with add_connections(), and go past them
+  std::vector<Connection_ptr> pop_tcp_connections(net::TCP&);
   net::Stream_ptr as_tcp_stream    (net::TCP&) const;
   // TLS streams require: 1. a context to restore
   // 2. select whether or not its an outgoing or incoming connection
@@ -20,6 +20,7 @@ enum storage_type
   TYPE_BUFFER  = 11,
   TYPE_VECTOR  = 12,
   TYPE_STR_VECTOR = 13,
+  TYPE_REFERENCE  = 14,
 
   TYPE_TCP    = 100,
   TYPE_TCP6   = 101,
@@ -45,6 +46,13 @@ struct varseg_entry
   char   vla[0];
 };
 
+// a buffer left where it is, in memory that survives the update
+struct reference_entry
+{
+  uint64_t   addr;
+  uint64_t   length;
+};
+
 struct storage_entry
 {
   storage_entry(int16_t type, uint16_t id, int length);
@@ -98,6 +106,9 @@ struct storage_header
   uint32_t get_entries() const noexcept {
     return this->entries;
   }
+  uint32_t get_partitions() const noexcept {
+    return this->partitions;
+  }
   uint32_t end_bytes() const noexcept {
 	  return max_length - sizeof(storage_entry);
   }
@@ -106,12 +117,17 @@ struct storage_header
   int  create_partition(std::string key);
   int  find_partition(const char*) const;
   void finish_partition(int);
+  // after changing a finished partition in place
+  void rechecksum_partition(int);
   void zero_partition(int);
+  // keep only the first @count partitions, dropping everything after them
+  void truncate(uint32_t count);
 
   void add_marker(uint16_t id);
   void add_int   (uint16_t id, int value);
   void add_string(uint16_t id, const std::string& data);
   void add_buffer(uint16_t id, const void*, int);
+  void add_reference(uint16_t id, const void*, size_t);
   storage_entry& add_struct(int16_t type, uint16_t id, int length);
   storage_entry& add_struct(int16_t type, uint16_t id, construct_func);
   void add_vector(uint16_t, const void*, size_t cnt, size_t esize);
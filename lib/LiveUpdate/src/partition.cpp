@@ -61,13 +61,40 @@ void storage_header::finish_partition(int p)
   }
   else part.crc = 0;
 }
+void storage_header::rechecksum_partition(int p)
+{
+  auto& part = ptable.at(p);
+  if (LIVEUPDATE_EXTRA_CHECKS) {
+    part.crc = part.generate_checksum(this->vla);
+  }
+  // the partition table is part of the header checksum
+  this->crc = generate_checksum();
+}
+void storage_header::truncate(const uint32_t count)
+{
+  if (count > this->partitions)
+      throw std::out_of_range("Cannot truncate to more partitions than there are");
+  this->length  = 0;
+  this->entries = 0;
+  for (uint32_t p = 0; p < count; p++)
+  {
+    auto& part = ptable.at(p);
+    this->length = part.offset + part.length;
+    // count the entries, including the end
+    auto* ent = this->begin(p);
+    for (; ent->type != TYPE_END; ent = ent->next()) this->entries++;
+    this->entries++;
+  }
+  for (uint32_t p = count; p < this->partitions; p++) ptable.at(p) = {};
+  this->partitions = count;
+  this->append_eof();
+}
 void storage_header::zero_partition(int p)
 {
   auto& part = ptable.at(p);
   memset(&this->vla[part.offset], 0, part.length);
   part = {};
-  if (LIVEUPDATE_EXTRA_CHECKS) {
-    // NOTE: generate **NEW** checksum for header
-    this->crc = generate_checksum();
-  }
+  // NOTE: generate **NEW** checksum for header, as the partition
+  // table is covered by it, and the other partitions are still valid
+  this->crc = generate_checksum();
 }
@@ -0,0 +1,180 @@
+/**
+ * Pre-copying of large memory regions, so that only the blocks that
+ * changed since have to be copied during the blackout.
+ *
+ * The pre-copied partitions are always the first ones in the storage area,
+ * and the ones stored during exec() are appended after them.
+**/
+#include "liveupdate.hpp"
+#include "storage.hpp"
+#include <kernel.hpp>
+#include <smp_utils>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace liu;
+
+// the unit of dirty tracking
+static const size_t PRECOPY_BLOCK = 64 * 1024;
+// regions are stored as entries of at most this size
+static const size_t PRECOPY_CHUNK = 1024 * PRECOPY_BLOCK;
+
+struct Precopy_region
+{
+  const char* data;
+  size_t      len;
+  size_t      blocks;
+  // where each chunk of the region is in the storage area
+  std::vector<char*> chunks;
+  // one bit per block, set when it needs to be copied (again)
+  std::unique_ptr<std::atomic<uint64_t>[]> dirty;
+
+  size_t words() const noexcept { return (blocks + 63) / 64; }
+
+  void copy_block(size_t b) const noexcept
+  {
+    const size_t off = b * PRECOPY_BLOCK;
+    const size_t len = std::min(PRECOPY_BLOCK, this->len - off);
+    memcpy(chunks[off / PRECOPY_CHUNK] + off % PRECOPY_CHUNK, &data[off], len);
+  }
+};
+static std::vector<Precopy_region> regions;
+static storage_header* precopy_storage = nullptr;
+// the partitions that hold pre-copied regions
+static uint32_t precopy_parts = 0;
+
+static inline location_t resolve_default(location_t other)
+{
+	if (other.first == nullptr || other.second == 0)
+		return { kernel::liveupdate_storage_area(), kernel::liveupdate_storage_size() };
+	return other;
+}
+
+void LiveUpdate::precopy(std::string key, const void* data, size_t len, location_t provided)
+{
+  const auto location = resolve_default(provided);
+  if (data == nullptr || len == 0)
+      throw std::runtime_error("LiveUpdate pre-copy region is empty");
+
+  auto* storage = (storage_header*) location.first;
+  if (precopy_storage == nullptr) {
+    new (storage) storage_header(location.second);
+    precopy_storage = storage;
+  }
+  else if (precopy_storage != storage) {
+    throw std::runtime_error("LiveUpdate pre-copy already started at another location");
+  }
+  // drop anything stored after the pre-copied partitions
+  storage->truncate(precopy_parts);
+
+  Precopy_region region;
+  region.data   = (const char*) data;
+  region.len    = len;
+  region.blocks = (len + PRECOPY_BLOCK - 1) / PRECOPY_BLOCK;
+
+  const int p = storage->create_partition(std::move(key));
+  uint16_t id = 0;
+  for (size_t off = 0; off < len; off += PRECOPY_CHUNK)
+  {
+    const int chunk = std::min(PRECOPY_CHUNK, len - off);
+    auto& ent = storage->add_struct(TYPE_BUFFER, id++, chunk);
+    region.chunks.push_back(ent.vla);
+  }
+  storage->finish_partition(p);
+  precopy_parts = storage->get_partitions();
+
+  // nothing has been copied yet
+  region.dirty.reset(new std::atomic<uint64_t>[region.words()]);
+  for (size_t w = 0; w < region.words(); w++)
+  {
+    const size_t bits = std::min<size_t>(64, region.blocks - w * 64);
+    region.dirty[w] = (bits == 64) ? ~0ull : (1ull << bits) - 1;
+  }
+  regions.push_back(std::move(region));
+}
+
+size_t LiveUpdate::precopy_step(const size_t max_bytes)
+{
+  size_t copied = 0;
+  size_t left   = 0;
+  for (auto& region : regions)
+  for (size_t w = 0; w < region.words(); w++)
+  {
+    if (copied >= max_bytes) {
+      left += __builtin_popcountll(region.dirty[w].load()) * PRECOPY_BLOCK;
+      continue;
+    }
+    // clear before copying, so that writes made while copying
+    // mark the block dirty again
+    uint64_t bits = region.dirty[w].exchange(0);
+    while (bits)
+    {
+      if (copied >= max_bytes) {
+        // put back what there was no time for
+        region.dirty[w].fetch_or(bits);
+        left += __builtin_popcountll(bits) * PRECOPY_BLOCK;
+        break;
+      }
+      const size_t b = w * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      region.copy_block(b);
+      copied += PRECOPY_BLOCK;
+    }
+  }
+  return left;
+}
+
+void LiveUpdate::precopy_dirty(const void* addr, size_t len) noexcept
+{
+  if (len == 0) return;
+  const char* begin = (const char*) addr;
+  for (auto& region : regions)
+  {
+    if (begin >= region.data + region.len || begin + len <= region.data) continue;
+    const size_t first = std::max(begin, region.data) - region.data;
+    const size_t last  = std::min(begin + len, region.data + region.len) - region.data - 1;
+    for (size_t b = first / PRECOPY_BLOCK; b <= last / PRECOPY_BLOCK; b++)
+      region.dirty[b / 64].fetch_or(1ull << (b % 64), std::memory_order_release);
+  }
+}
+
+void LiveUpdate::precopy_cancel() noexcept
+{
+  regions.clear();
+  if (precopy_storage) {
+    precopy_storage->truncate(0);
+    precopy_storage = nullptr;
+  }
+  precopy_parts = 0;
+}
+
+// called when storing, instead of creating a new storage header
+// returns false when nothing was pre-copied to @storage
+bool precopy_finish(storage_header* storage)
+{
+  if (precopy_storage == nullptr || precopy_storage != storage)
+      return false;
+  // only the delta is left, copied on all CPUs
+  std::vector<std::pair<const Precopy_region*, size_t>> blocks;
+  for (auto& region : regions)
+  for (size_t w = 0; w < region.words(); w++)
+  {
+    uint64_t bits = region.dirty[w].exchange(0);
+    for (; bits; bits &= bits - 1)
+      blocks.emplace_back(&region, w * 64 + __builtin_ctzll(bits));
+  }
+  smp::parallel_for(0, blocks.size(),
+  [&blocks] (size_t i) {
+    blocks[i].first->copy_block(blocks[i].second);
+  });
+  // drop what was stored after the pre-copied partitions
+  storage->truncate(precopy_parts);
+  // their contents changed after they were finished
+  for (uint32_t p = 0; p < precopy_parts; p++)
+    storage->rechecksum_partition(p);
+  return true;
+}
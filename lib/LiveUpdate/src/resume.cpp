@@ -8,6 +8,7 @@
 #include <os.hpp>
 #include <kernel.hpp>
 #include <profile>
+#include <arch.hpp>
 #include "storage.hpp"
 #include "serialize_tcp.hpp"
 #include <cstdio>
@@ -18,6 +19,10 @@
 namespace liu
 {
 static bool resume_begin(storage_header&, std::string, LiveUpdate::resume_func);
+static void capture_blackout(storage_header&);
+// taken out of storage before the first partition is resumed
+static Blackout blackout_timing;
+static bool     blackout_captured = false;
 
 static inline location_t resolve_default(location_t other)
 {
@@ -43,8 +48,10 @@ static bool resume_helper(location_t location, std::string key, LiveUpdate::resu
       return false;
 
   LPRINT("* Restoring data...\n");
+  auto& storage = *(storage_header*) location.first;
+  capture_blackout(storage);
   // restore connections etc.
-  return resume_begin(*(storage_header*) location.first, key.c_str(), func);
+  return resume_begin(storage, key.c_str(), func);
 }
 bool LiveUpdate::resume(std::string key, resume_func func, location_t provided)
 {
@@ -73,6 +80,46 @@ bool LiveUpdate::partition_exists(const std::string& key, const location_t provi
   return (storage.find_partition(key.c_str()) != -1);
 }
 
+void capture_blackout(storage_header& storage)
+{
+  if (blackout_captured) return;
+  const int p = storage.find_partition("liu:blackout");
+  if (p == -1) return;
+  const uint64_t now = os::Arch::cpu_cycles();
+  auto* ent = storage.begin(p);
+  if (ent->type == TYPE_BUFFER && ent->len == sizeof(Blackout)) {
+    memcpy(&blackout_timing, ent->vla, sizeof(Blackout));
+    // the TSC is not reset by a soft-reset, but it is by a reboot
+    if (now > blackout_timing.jump)
+        blackout_timing.resumed = now - blackout_timing.jump;
+    blackout_captured = true;
+  }
+  storage.zero_partition(p);
+  storage.try_zero();
+}
+bool LiveUpdate::blackout(Blackout& timing, location_t provided)
+{
+  if (blackout_captured == false)
+  {
+    const auto location = resolve_default(provided);
+    if (!LiveUpdate::is_resumable(location)) return false;
+    capture_blackout(*(storage_header*) location.first);
+    if (blackout_captured == false) return false;
+  }
+  timing = blackout_timing;
+  return true;
+}
+void Blackout::print() const
+{
+  printf("LiveUpdate blackout: %.0f us\n", to_us(total()));
+  printf("%10.0f us  Scan ELF\n", to_us(scan));
+  printf("%10.0f us  Store user data\n", to_us(store));
+  printf("%10.0f us  Deactivate devices\n", to_us(deactivate));
+  printf("%10.0f us  Soft-reset store\n", to_us(softreset));
+  printf("%10.0f us  Other\n", to_us(jump - begin - scan - store - deactivate - softreset));
+  printf("%10.0f us  New kernel until resumed\n", to_us(resumed));
+}
+
 bool resume_begin(storage_header& storage, std::string key, LiveUpdate::resume_func func)
 {
   PROFILE("LiveUpdate: Resume partition");
@@ -135,6 +182,10 @@ bool Restore::is_stream() const noexcept
 {
   return get_type() == TYPE_STREAM;
 }
+bool Restore::is_reference() const noexcept
+{
+  return get_type() == TYPE_REFERENCE;
+}
 
 int Restore::as_int() const
 {
@@ -158,6 +209,16 @@ buffer_t  Restore::as_buffer() const
   throw std::runtime_error("LiveUpdate: Restore::as_buffer() encountered incorrect type " + std::to_string(ent->type));
 }
 
+location_t Restore::as_reference() const
+{
+  if (ent->type == TYPE_REFERENCE) {
+      auto& ref = *(const reference_entry*) ent->vla;
+      // preserved memory is identity-mapped
+      return {(void*) (uintptr_t) ref.addr, (size_t) ref.length};
+  }
+  throw std::runtime_error("LiveUpdate: Restore::as_reference() encountered incorrect type " + std::to_string(ent->type));
+}
+
 int16_t     Restore::get_type() const noexcept
 {
   return ent->type;
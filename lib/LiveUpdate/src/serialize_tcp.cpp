@@ -9,6 +9,7 @@
 #include "serialize_tcp.hpp"
 #include "liveupdate.hpp"
 #include "storage.hpp"
+#include <smp_utils>
 #include <cstring>
 #include <unordered_set>
 
@@ -97,15 +98,19 @@ int Write_queue::deserialize_from(void* addr)
     // header
     len += sizeof(write_buffer);
 
-    // insert shared buffer into write queue
-    this->q.emplace_back(net::tcp::construct_buffer());
-
-    // copy data
-    auto wbuf = this->q.back();
+    // copy data into a shared buffer, and insert it into write queue
     auto* source = &writeq->vla[len];
-    std::copy(source, source + current->length, std::back_inserter(*wbuf));
+    this->q.emplace_back(net::tcp::construct_buffer(source, source + current->length));
     len += current->length;
   }
+
+  /// restore the byte counters
+  for (size_t i = 0; i < this->q.size(); i++)
+  {
+    this->total_ += this->q[i].size();
+    if (i < this->current_) this->sent_ += this->q[i].size();
+  }
+  this->sent_ += this->offset_;
   return sizeof(serialized_writeq) + len;
 }
 
@@ -182,7 +187,7 @@ Connection_ptr deserialize_connection(void* addr, net::TCP& tcp)
 {
   auto* area = (serialized_tcp*) addr;
 
-  auto conn = std::make_shared<Connection> (tcp, area->local, area->remote);
+  auto conn = tcp.restore_connection(area->local, area->remote);
   conn->deserialize_from(addr);
   // add connection TCP list
   tcp.insert_connection(conn);
@@ -203,28 +208,41 @@ int  Write_queue::serialize_to(void* addr) const
     auto* current = (write_buffer*) &writeq->vla[len];
 
     // header
-    current->length = wbuf->size();
+    current->length = wbuf.size();
     len += sizeof(write_buffer);
 
     // data
-    memcpy(&writeq->vla[len], wbuf->data(), current->length);
+    memcpy(&writeq->vla[len], wbuf.data(), current->length);
     len += current->length;
   }
   return sizeof(serialized_writeq) + len;
 }
+int  Write_queue::serialized_size() const noexcept
+{
+  int len = sizeof(serialized_writeq);
+  for (auto& wbuf : this->q)
+    len += sizeof(write_buffer) + wbuf.size();
+  return len;
+}
 
 int Read_buffer::serialize_to(void* addr) const
 {
   auto& readbuf = *reinterpret_cast<read_buffer*>(addr);
 
   readbuf.seq   = this->start;
+  readbuf.head  = this->size();
   readbuf.hole  = this->hole;
   readbuf.push  = this->push_seen;
+  readbuf.capacity = this->capacity();
 
   std::copy(this->buf->begin(), this->buf->end(), readbuf.vla);
 
   return sizeof(read_buffer) + this->size();
 }
+int Read_buffer::serialized_size() const noexcept
+{
+  return sizeof(read_buffer) + this->size();
+}
 
 int Connection::serialize_to(void* addr) const
 {
@@ -261,13 +279,23 @@ int Connection::serialize_to(void* addr) const
 
   /// serialize read queue
   auto* readq = (read_buffer*) &area->vla[writeq_len];
-  int readq_len = (read_request) ? read_request->front().serialize_to(readq) : sizeof(read_buffer);
+  int readq_len = sizeof(read_buffer);
+  if (read_request)
+    readq_len = read_request->front().serialize_to(readq);
+  else // no capacity means there is nothing to restore
+    memset(readq, 0, sizeof(read_buffer));
 
   //printf("READ: %u  SEND: %u  REMAIN: %u  STATE: %s\n",
   //    readq_size(), sendq_size(), sendq_remaining(), cb.to_string().c_str());
 
   return sizeof(serialized_tcp) + writeq_len + readq_len;
 }
+int Connection::serialized_size() const noexcept
+{
+  const int readq_len = (read_request) ? read_request->front().serialized_size()
+                                       : sizeof(read_buffer);
+  return sizeof(serialized_tcp) + writeq.serialized_size() + readq_len;
+}
 
 void serialized_tcp::wakeup_ip_networks()
 {
@@ -288,10 +316,42 @@ namespace liu
       return conn->serialize_to(location);
     });
   }
+  void Storage::add_connections(uid id, const std::vector<Connection_ptr>& conns)
+  {
+    // the entries are laid out one by one, as their sizes are known,
+    // and then the queues are copied into them in parallel
+    std::vector<char*> areas;
+    areas.reserve(conns.size());
+    for (const auto& conn : conns)
+    {
+      auto& ent = hdr.add_struct(TYPE_TCP, id, conn->serialized_size());
+      areas.push_back(ent.vla);
+    }
+    smp::parallel_for(0, conns.size(),
+    [&conns, &areas] (size_t i) {
+      conns[i]->serialize_to(areas[i]);
+    });
+  }
   Connection_ptr Restore::as_tcp_connection(net::TCP& tcp) const
   {
     return deserialize_connection(ent->vla, tcp);
   }
+  std::vector<Connection_ptr> Restore::pop_tcp_connections(net::TCP& tcp)
+  {
+    // count the run first, so the table and pools only grow once
+    size_t count = 0;
+    for (auto* e = ent; e->type == TYPE_TCP; e = e->next()) count++;
+    tcp.reserve_connections(count);
+
+    std::vector<Connection_ptr> conns;
+    conns.reserve(count);
+    for (; count > 0; count--)
+    {
+      conns.push_back(deserialize_connection(ent->vla, tcp));
+      go_next();
+    }
+    return conns;
+  }
   net::Stream_ptr Restore::as_tcp_stream   (net::TCP& tcp) const
   {
     return std::make_unique<net::tcp::Stream> (as_tcp_connection(tcp));
@@ -54,6 +54,22 @@ void storage_header::add_buffer(uint16_t id, const void* buffer, int length)
   assert(entry.checksum() == csum);
 #endif
 }
+void storage_header::add_reference(uint16_t id, const void* buffer, size_t length)
+{
+#if !defined(PLATFORM_UNITTEST) && !defined(USERSPACE_KERNEL)
+  // the new kernel and its heap can use anything below heap max
+  const uintptr_t addr = (uintptr_t) buffer;
+  if (addr <= kernel::heap_max() or addr + length < addr)
+    throw std::runtime_error("LiveUpdate reference is not in preserved memory");
+  const uint64_t phys = os::mem::virt_to_phys(addr);
+#else
+  const uint64_t phys = (uintptr_t) buffer;
+#endif
+  auto& entry = create_entry(TYPE_REFERENCE, id, sizeof(reference_entry));
+  auto& ref = *(reference_entry*) entry.vla;
+  ref.addr   = phys;
+  ref.length = length;
+}
 storage_entry& storage_header::add_struct(int16_t type, uint16_t id, int length)
 {
   return create_entry(type, id, length);
@@ -16,6 +16,9 @@
 #include <os.hpp>
 #include <hw/nic.hpp> // for flushing
 #include <profile>
+#include <arch.hpp>
+#include <util/compressed_image.hpp>
+#include <memory>
 
 //#define LPRINT(x, ...) printf(x, ##__VA_ARGS__);
 #define LPRINT(x, ...) /** x **/
@@ -25,6 +28,7 @@ static const int ELF_MINIMUM = 164;
 // hotswapping functions
 #include "hotswap.hpp"
 extern "C" void* __os_store_soft_reset(const void*, size_t);
+extern bool precopy_finish(storage_header*);
 // kernel area
 extern uint8_t _ELF_START_;
 extern uint8_t _end;
@@ -36,7 +40,9 @@ bool LIVEUPDATE_ZERO_OLD_MEMORY = false;
 
 using namespace liu;
 
-static size_t update_store_data(location_t location);
+static size_t update_store_data(location_t location, int* blackout_part = nullptr);
+// the blackout timing is handed over in its own partition
+static const char* BLACKOUT_KEY = "liu:blackout";
 
 // serialization callbacks
 static std::unordered_map<std::string, LiveUpdate::storage_func> storage_callbacks;
@@ -93,10 +99,33 @@ void LiveUpdate::exec(const uint8_t* blob_data, size_t blob_size, location_t pro
 {
   auto location = resolve_default(provided_location);
   LPRINT("LiveUpdate::begin(%p:%zu, %p:%zu, ...)\n", location.first, location.second, blob_data, blob_size);
+  // binary_blob() hands out the blob as given, compressed or not
+  const uint8_t* given_data = blob_data;
+  const size_t   given_size = blob_size;
+  // a compressed blob is decompressed on every CPU before the blackout,
+  // into a buffer that is allocated last, and so far into the heap
+  static std::unique_ptr<uint8_t[]> decompressed;
+  if (compressed_image::is_compressed(blob_data, blob_size))
+  {
+    PROFILE("LiveUpdate: Decompress");
+    const size_t size = compressed_image::decompressed_size(blob_data, blob_size);
+    decompressed.reset(new uint8_t[size]);
+    compressed_image::decompress(blob_data, blob_size, decompressed.get(), size);
+    blob_data = decompressed.get();
+    blob_size = size;
+  }
 #if defined(__includeos__) && defined(ARCH_x86)
   // 1. turn off interrupts
   asm volatile("cli");
 #endif
+  Blackout timing;
+  timing.begin = os::Arch::cpu_cycles();
+  uint64_t phase_begin = timing.begin;
+  auto end_phase = [&phase_begin] (uint64_t& phase) {
+    const uint64_t now = os::Arch::cpu_cycles();
+    phase = now - phase_begin;
+    phase_begin = now;
+  };
 
   // use area provided to us directly, which we will assume
   // is far enough into heap to not get overwritten by hotswap.
@@ -206,19 +235,23 @@ void LiveUpdate::exec(const uint8_t* blob_data, size_t blob_size, location_t pro
   // _start() entry point
   LPRINT("* Kernel entry is located at %#x\n", start_offset);
 
-  liveupdate_blob_data = blob_data;
-  liveupdate_blob_size = blob_size;
+  end_phase(timing.scan);
+
+  liveupdate_blob_data = given_data;
+  liveupdate_blob_size = given_size;
+  int blackout_part = -1;
   {
     PROFILE("LiveUpdate: Store user data");
     // save ourselves if function passed
-    update_store_data(location);
+    update_store_data(location, &blackout_part);
   }
+  end_phase(timing.store);
 
 {
   PROFILE("LiveUpdate: Deactivate devices");
 #if !defined(PLATFORM_UNITTEST) && !defined(USERSPACE_KERNEL)
-  // 2. flush all NICs
-  for(auto& nic : os::machine().get<hw::Nic>())
+  // 2. flush all NICs (that were ever used)
+  for(auto& nic : os::machine().get_active<hw::Nic>())
     nic.get().flush();
   // 3. deactivate all devices (eg. mask all MSI-X vectors)
   // NOTE: there are some nasty side effects from calling this
@@ -227,6 +260,7 @@ void LiveUpdate::exec(const uint8_t* blob_data, size_t blob_size, location_t pro
   // turn off devices that affect memory
   __arch_system_deactivate();
 }
+  end_phase(timing.deactivate);
 
   // store soft-resetting stuff
 #if defined(__includeos__)
@@ -242,6 +276,7 @@ void LiveUpdate::exec(const uint8_t* blob_data, size_t blob_size, location_t pro
 #else
   void* sr_data = nullptr;
 #endif
+  end_phase(timing.softreset);
 
 #ifdef ENABLE_PROFILERS
   auto prof = ScopedProfiler::get_statistics(false);
@@ -258,6 +293,13 @@ void LiveUpdate::exec(const uint8_t* blob_data, size_t blob_size, location_t pro
   // replace ourselves and reset by jumping to _start
   LPRINT("* Replacing self with %d bytes and jumping to %#x\n", bin_len, start_offset);
 
+  // the last thing written to the storage area
+  timing.cpu_khz = os::cpu_freq().count();
+  timing.jump    = os::Arch::cpu_cycles();
+  auto* storage = (storage_header*) location.first;
+  memcpy(storage->begin(blackout_part)->vla, &timing, sizeof(Blackout));
+  storage->rechecksum_partition(blackout_part);
+
 #ifdef PLATFORM_x86_solo5
   solo5_exec(blob_data, blob_size);
   throw std::runtime_error("solo5_exec returned");
@@ -326,11 +368,13 @@ void LiveUpdate::enable_extra_checks(bool en) noexcept
   // TODO: also enable destination zeroing?
 }
 
-size_t update_store_data(location_t location)
+size_t update_store_data(location_t location, int* blackout_part)
 {
-  // create storage header in the fixed location
-  new (location.first) storage_header(location.second);
   auto* storage = (storage_header*) location.first;
+  // create storage header in the fixed location,
+  // unless there are pre-copied partitions there already
+  if (precopy_finish(storage) == false)
+      new (location.first) storage_header(location.second);
 
   Storage wrapper(*storage);
   /// callback for storing stuff, if provided
@@ -343,6 +387,14 @@ size_t update_store_data(location_t location)
     // add end for partition
     storage->finish_partition(p);
   }
+  /// room for the blackout timing, filled in right before the jump
+  if (blackout_part != nullptr)
+  {
+    *blackout_part = storage->create_partition(BLACKOUT_KEY);
+    auto& entry = storage->add_struct(TYPE_BUFFER, 0, sizeof(Blackout));
+    memset(entry.vla, 0, sizeof(Blackout));
+    storage->finish_partition(*blackout_part);
+  }
 
   /// finalize
   storage->finalize();
@@ -373,6 +425,10 @@ void Storage::add_buffer(uid id, const void* buf, size_t len)
 {
   hdr.add_buffer(id, buf, len);
 }
+void Storage::add_reference(uid id, const void* buf, size_t len)
+{
+  hdr.add_reference(id, buf, len);
+}
 void Storage::add_vector(uid id, const void* buf, size_t count, size_t esize)
 {
   hdr.add_vector(id, buf, count, esize);
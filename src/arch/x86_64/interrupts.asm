@@ -84,6 +84,7 @@ parasite_interrupt_handler:
   cli
   PUSHAQ
   mov  rdi, QWORD [rsp + 8*9]
+  mov  rsi, rbp
   call profiler_stack_sampler
   call QWORD [current_intr_handler]
   POPAQ
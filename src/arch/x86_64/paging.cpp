@@ -355,6 +355,23 @@ uintptr_t mem::active_page_size(uintptr_t addr){
   return __pml4->active_page_size(addr);
 }
 
+size_t mem::page_sizes_in(uintptr_t begin, uintptr_t end)
+{
+  size_t sizes = 0;
+  uintptr_t addr = begin;
+  while (addr <= end)
+  {
+    const auto psize = __pml4->active_page_size(addr);
+    if (psize == 0) break;
+    if (flags(addr) != Access::none)
+        sizes |= psize;
+    const auto next = (addr & ~(psize - 1)) + psize;
+    if (next <= addr) break; // wrapped around
+    addr = next;
+  }
+  return sizes;
+}
+
 
 
 void allow_executable()
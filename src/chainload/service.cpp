@@ -1,6 +1,7 @@
 
 #include <os.hpp>
 #include <boot/multiboot.h>
+#include <util/compressed_image.hpp>
 #include <util/elf_binary.hpp>
 #include <service>
 #include <cstdint>
@@ -50,10 +51,22 @@ void Service::start()
   }
 
   auto binary = mods[0];
+  char*  image     = (char*) binary.mod_start;
+  size_t image_len = binary.mod_end - binary.mod_start;
+
+  // a compressed service is decompressed on every CPU into the heap,
+  // which is above where it goes, so hotswap can move it down in place
+  if (compressed_image::is_compressed(image, image_len))
+  {
+    const size_t size = compressed_image::decompressed_size(image, image_len);
+    auto* buffer = new char[size];
+    compressed_image::decompress(image, image_len, buffer, size);
+    MYINFO("Decompressed service from %zu to %zu bytes", image_len, size);
+    image     = buffer;
+    image_len = size;
+  }
 
-  Elf_binary<Elf64> elf (
-      {(char*)binary.mod_start,
-        (int)(binary.mod_end - binary.mod_start)});
+  Elf_binary<Elf64> elf ({image, (int) image_len});
 
 
   auto phdrs = elf.program_headers();
@@ -78,8 +91,8 @@ void Service::start()
          (char*)binary.params, __multiboot_magic, __multiboot_addr);
 
   // Prepare to load ELF segment
-  char* base  = (char*)binary.mod_start + init_seg.p_offset;
-  int len = (int)((char*)binary.mod_end - base);
+  char* base  = image + init_seg.p_offset;
+  int len = (int)(image + image_len - base);
   char* dest = (char*) init_seg.p_paddr;
   void* start = (void*) elf.entry();
 
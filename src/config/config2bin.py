@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+
+# Compile a config.json into the binary form read by Config_value
+# (api/util/config_value.hpp), so that the OS doesn't have to parse
+# JSON at boot.
+#
+# Every value starts with a tag byte, and everything is little-endian:
+#   null, false, true    tag
+#   int                  tag, i64
+#   double               tag, f64
+#   string               tag, u32 length, the bytes, NUL
+#   array                tag, u32 count, u32 bytes of elements, elements
+#   object               tag, u32 count, u32 bytes of members, and each
+#                        member is a key (u32 length, bytes, NUL) and a value
+# The whole is preceded by the magic "ICF1" and the u32 size of the root.
+
+import argparse
+import json
+import struct
+import sys
+
+NULL, FALSE, TRUE, INT, DOUBLE, STRING, ARRAY, OBJECT = range(8)
+
+def encode_str(s):
+  b = s.encode("utf-8")
+  return struct.pack("<I", len(b)) + b + b"\0"
+
+def encode(value):
+  if value is None:
+    return bytes([NULL])
+  if value is True:
+    return bytes([TRUE])
+  if value is False:
+    return bytes([FALSE])
+  if isinstance(value, int) and -2**63 <= value < 2**63:
+    return bytes([INT]) + struct.pack("<q", value)
+  if isinstance(value, (int, float)):
+    return bytes([DOUBLE]) + struct.pack("<d", float(value))
+  if isinstance(value, str):
+    return bytes([STRING]) + encode_str(value)
+  if isinstance(value, list):
+    body = b"".join(encode(v) for v in value)
+    return bytes([ARRAY]) + struct.pack("<II", len(value), len(body)) + body
+  if isinstance(value, dict):
+    body = b"".join(encode_str(k) + encode(v) for k, v in value.items())
+    return bytes([OBJECT]) + struct.pack("<II", len(value), len(body)) + body
+  raise TypeError("Can't encode " + repr(value))
+
+def main():
+  parser = argparse.ArgumentParser(description="Compile config.json into binary")
+  parser.add_argument("input", help="the JSON config")
+  parser.add_argument("output", help="the binary config")
+  args = parser.parse_args()
+
+  with open(args.input) as f:
+    try:
+      doc = json.load(f)
+    except ValueError as e:
+      sys.exit(args.input + ": " + str(e))
+
+  root = encode(doc)
+  with open(args.output, "wb") as f:
+    f.write(b"ICF1" + struct.pack("<I", len(root)) + root)
+
+if __name__ == "__main__":
+  main()
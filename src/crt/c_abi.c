@@ -16,9 +16,10 @@ uint32_t _move_symbols(void* sym_loc)
   sym_loc = (void*) ((uintptr_t) sym_loc + align_size);
 
   extern char _ELF_SYM_START_;
-  // read out size of symbols **before** moving them
-  extern int  _get_elf_section_datasize(const void*);
-  int elfsym_size = _get_elf_section_datasize(&_ELF_SYM_START_);
+  // read out size of symbols **before** moving them,
+  // with room for the symbol index built after them
+  extern int  _get_elf_section_movesize(const void*);
+  int elfsym_size = _get_elf_section_movesize(&_ELF_SYM_START_);
 
   // move ELF symbols to safe area
   extern void _move_elf_syms_location(const void*, void*);
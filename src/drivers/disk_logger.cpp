@@ -2,6 +2,7 @@
 #include <os>
 #include <hw/writable_blkdev.hpp>
 #include <fs/common.hpp>
+#include <kernel/log_stage.hpp>
 #include <rtc>
 
 #include "disk_logger.hpp"
@@ -9,20 +10,37 @@
 static log_structure header;
 static fs::buffer_t  logbuffer;
 static uint32_t position = 0;
-static bool write_once_when_booted = false;
 
 extern "C" void __serial_print1(const char*);
 extern "C" void __serial_print(const char*, size_t);
 
+// log output is written out in batches, at most this often
+static const std::chrono::milliseconds FLUSH_INTERVAL {1000};
+static bool write_in_progress = false;
+
 static void write_all()
 {
   try {
     auto& device = (hw::Writable_Block_device&) hw::Devices::drive(DISK_NO);
     const auto sector = disklogger_start_sector(device);
-    const bool error = device.write_sync(sector, logbuffer);
-    if (error) {
-      __serial_print1("IDE::write_sync failed! Missing or wrong driver?\n");
+    // there is no getting back to the event loop when panicking
+    if (OS::is_panicking())
+    {
+      const bool error = device.write_sync(sector, logbuffer);
+      if (error) {
+        __serial_print1("IDE::write_sync failed! Missing or wrong driver?\n");
+      }
+      return;
     }
+    // the next batch gets written when this one is done
+    if (write_in_progress) return;
+    write_in_progress = true;
+    device.write(sector, logbuffer, [] (bool error) {
+      write_in_progress = false;
+      if (error) {
+        __serial_print1("IDE::write failed! Missing or wrong driver?\n");
+      }
+    });
   } catch (std::exception& e) {
     __serial_print1("IDE block device missing! Missing device or driver?\n");
   }
@@ -47,20 +65,21 @@ static void disk_logger_write(const char* data, size_t len)
   }
   __builtin_memcpy(logbuffer->data(), &header, sizeof(log_structure));
 
-  // write to disk when we are able
-  const bool once = OS::is_booted() && write_once_when_booted == false;
-  if (OS::block_drivers_ready() && (once || OS::is_panicking()))
-  {
-    write_once_when_booted = true;
+  // write to disk when we are able, which is once per batch after booting
+  if (OS::block_drivers_ready() && (OS::is_booted() || OS::is_panicking()))
     write_all();
-  }
 }
 
+static kernel::Log_stage log_stage {"disk_logger", disk_logger_write,
+                                    16384, FLUSH_INTERVAL};
+
 __attribute__((constructor))
 static void enable_disk_logger()
 {
   logbuffer = fs::construct_buffer(DISKLOG_SIZE);
   position = sizeof(log_structure);
   header.max_length = logbuffer->capacity();
-  OS::add_stdout(disk_logger_write);
+  OS::add_stdout([] (const char* data, size_t len) {
+    log_stage.write(data, len);
+  });
 }
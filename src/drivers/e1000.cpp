@@ -6,6 +6,7 @@
 #include <os.hpp>
 #include <hw/ioport.hpp>
 #include <info>
+#include <statman>
 #include <cassert>
 //#define E1000_ENABLE_STATS
 //#define E1000_FAKE_EVENT_HANDLER
@@ -30,27 +31,44 @@ static const uint32_t RXTO = 1 << 7; // receive timer interrupt
 static int deferred_event = 0;
 static std::vector<e1000*> deferred_devices;
 
-static inline uint16_t report_size_for_mtu(uint16_t mtu)
-{
-  uint16_t diff = mtu % 1024;
-  mtu = (mtu / 1024) * 1024;
-  if (diff) mtu += 1024;
-  return mtu;
-}
+// Delay timers are in 1.024 usec units, per moderation_t
+static const struct {
+  uint32_t ints_per_sec; // throttle rate
+  uint16_t rdtr, radv;   // RX packet, absolute delay
+  uint16_t tidv, tadv;   // TX packet, absolute delay
+} moderation_table[] = {
+  { 70000,  0,   0,  0,   0 }, // lowest latency: no delays
+  { 20000,  0,   0,  8,  32 }, // low latency
+  {  8000, 16, 128, 64, 256 }, // bulk
+};
+// how often the moderation level is re-evaluated
+static const uint64_t MODERATION_WINDOW = 100'000'000; // nanos
+
+// the NIC writes up to 2048 bytes in a RX buffer, a jumbo frame takes several
+static const uint16_t RX_BUFFER_LEN = 2048;
+
 static inline uint16_t buffer_size_for_mtu(const uint16_t mtu)
 {
   const uint16_t header = sizeof(net::Packet) + e1000::DRIVER_OFFSET;
   const uint16_t total = header + sizeof(net::ethernet::VLAN_header) + mtu;
   if (total <= 2048) return 2048;
-  assert(mtu <= 9000 && "Buffers larger than 9000 are not supported");
-  return total;
+  assert(mtu <= 9000 && "Frames larger than 9000 are not supported");
+  return header + RX_BUFFER_LEN;
 }
 
 #define NUM_PACKET_BUFFERS (NUM_TX_DESC + NUM_RX_DESC + NUM_TX_QUEUE + 8)
 
 e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
     Link(Link_protocol{{this, &e1000::transmit}, mac()}),
-    m_pcidev(d), m_mtu(mtu), bufstore_{NUM_PACKET_BUFFERS, buffer_size_for_mtu(mtu)}
+    m_pcidev(d), m_mtu(mtu),
+    rx_poller({this, &e1000::receive_handler},
+              {[this] () {
+                write_cmd(REG_IMS, rx_intr_mask());
+                return rx_pending();
+              }}),
+    bufstore_{NUM_PACKET_BUFFERS, buffer_size_for_mtu(mtu)},
+    stat_moderation_{Statman::get().create(Stat::UINT32,
+                device_name() + ".moderation").get_uint32()}
 {
   static_assert((NUM_RX_DESC * sizeof(rx_desc)) % 128 == 0, "Ring length must be 128-byte aligned");
   static_assert((NUM_TX_DESC * sizeof(tx_desc)) % 128 == 0, "Ring length must be 128-byte aligned");
@@ -175,7 +193,7 @@ e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
       //| RCTL_UPE // unicast promisc enable
       | RCTL_MPE // multicast promisc enable
       | RCTL_BAM // broadcast accept mode
-      | (report_size_for_mtu(MTU()) << 27) // recv buffers
+      | RCTL_BSIZE_2048 // recv buffers
       | RCTL_SECRC; // strip eth CRC
   // LPE if MTU > 1500
   if (MTU() > 1500) rx_flags |= RCTL_LPE;
@@ -210,13 +228,13 @@ e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
     // CTRL_EXT = MSI-X PBA + **normal** IAME
     write_cmd(REG_CTRL_EXT, (1 << 31) | (1 << 27));
   }
-  else
-  {
-    write_cmd(REG_ITR, 100);
-    //write_cmd(REG_IAM, 0x0);
-    // CTRL_EXT = IAME
-    //write_cmd(REG_CTRL_EXT, (1 << 27));
-  }
+  //write_cmd(REG_IAM, 0x0);
+  // CTRL_EXT = IAME
+  //write_cmd(REG_CTRL_EXT, (1 << 27));
+
+  // interrupt throttling and delays, adapted to the traffic later on
+  this->set_moderation(moderation.level);
+  moderation.since = os::nanos_since_boot();
 
   // remove master disable bit
   write_cmd(REG_CTRL, read_cmd(REG_CTRL) & ~(1 << 2));
@@ -265,7 +283,7 @@ e1000::e1000(hw::PCI_Device& d, uint16_t mtu) :
 #ifdef E1000E_FAKE_EVENT_HANDLER
   Timers::periodic(std::chrono::milliseconds(1),
     [this] (int) {
-      this->receive_handler();
+      this->receive_handler(NUM_RX_DESC);
       this->transmit_handler();
       this->event_handler();
     });
@@ -277,7 +295,7 @@ void e1000::config_msix()
   #define IVAR_INT_ALLOC_VALID 0x8 // 10.2.4.9 p.328
   uint32_t ivar = 0;
   // rx queue 0 2:0
-  uint8_t vec0 = Events::get().subscribe({this, &e1000::receive_handler});
+  uint8_t vec0 = Events::get().subscribe({this, &e1000::msix_recv_handler});
   int m0 = m_pcidev.setup_msix_vector(SMP::cpu_id(), IRQ_BASE + vec0);
   ivar |= (IVAR_INT_ALLOC_VALID | m0);
 
@@ -447,10 +465,13 @@ net::Packet_ptr
 e1000::create_packet(int link_offset)
 {
   auto* ptr = (net::Packet*) bufstore().get_buffer();
+  // a jumbo frame does not fit, the rest of it goes in segments
+  const int frame_end = DRIVER_OFFSET + frame_offset_link() + MTU();
+  const int buf_end   = bufstore().bufsize() - sizeof(net::Packet);
   new (ptr) net::Packet(
         DRIVER_OFFSET + link_offset,
         0,
-        DRIVER_OFFSET + frame_offset_link() + MTU(),
+        std::min(frame_end, buf_end),
         &bufstore());
   return net::Packet_ptr(ptr);
 }
@@ -485,45 +506,63 @@ void e1000::event_handler()
   if (status & RXDMTO)
   {
     PRINT("[e1000] rx descriptor minimum treshold hit!\n");
-    this->receive_handler();
   }
   if (status & RXO)
   {
     fprintf(stderr, "[e1000] rx overrun!\n");
   }
-  // rx timer interrupt
-  if (status & RXTO)
+  // rx timer interrupt, poll until the ring drains
+  if (status & (RXDMTO | RXTO))
   {
-    this->receive_handler();
+    write_cmd(REG_IMC, rx_intr_mask());
+    rx_poller.schedule();
   }
 
   // ready to handle more events
   this->intr_cause_clear();
 }
 
-void e1000::receive_handler()
+uint32_t e1000::rx_intr_mask() const noexcept
+{
+  // RxQ0 with MSI-X
+  return (this->use_msix) ? (1 << 20) : (RXDMTO | RXTO);
+}
+bool e1000::rx_pending() const noexcept
+{
+  return (rx.desc[rx.current].status & 1) != 0;
+}
+void e1000::msix_recv_handler()
+{
+  write_cmd(REG_IMC, rx_intr_mask());
+  rx_poller.schedule();
+}
+
+int e1000::receive_handler(const int budget)
 {
   uint16_t old_idx = 0;
-  uint32_t received = 0;
-  std::array<net::Packet_ptr, NUM_RX_DESC> recv_array;
+  int received = 0;
+  int frames = 0;
+  net::Packet_chain burst;
+  const int max = std::min(budget, NUM_RX_DESC);
 
-  while (true)
+  while (received < max)
   {
     auto& tk = rx.desc[rx.current];
     if ((tk.status & 1) == 0) break;
 
-    // must be complete packet
-    if ((tk.status & 2) == 0) {
-      PRINT("[e1000] dropping incomplete buffer %u bytes\n", tk.length);
-      continue;
-    }
-
     auto* buf = (uint8_t*) tk.addr;
     assert(buf != nullptr);
     PRINT("[e1000] recv %p -> %u bytes\n", buf, tk.length);
 
-    recv_array[received] = recv_packet(buf, tk.length);
+    // a frame larger than a buffer goes on in the next descriptors
+    auto pckt = recv_packet(buf, tk.length);
+    if (rx.partial == nullptr)
+      rx.partial = std::move(pckt);
+    else
+      rx.partial->append_segment(std::move(pckt));
+    const bool eop = tk.status & 2;
     received++;
+    moderation.bytes += tk.length;
 
     // give new buffer
     tk.addr = (uint64_t) this->new_rx_packet();
@@ -531,17 +570,29 @@ void e1000::receive_handler()
     // go to next index
     old_idx = rx.current;
     rx.current = (rx.current + 1) % NUM_RX_DESC;
+
+    if (not eop) continue;
+    burst.push_back(std::move(rx.partial));
+    frames++;
+
+    if (burst.size() == Link::burst_size) {
+      // acknowledge rx packets before processing them
+      write_cmd(REG_RXDESCTAIL, old_idx);
+      Link_layer::receive(burst.release());
+    }
   }
 
   if (received > 0)
   {
+    moderation.packets += frames;
     // acknowledge all rx packets
     write_cmd(REG_RXDESCTAIL, old_idx);
     // process rx packets
-    for (uint32_t i = 0; i < received; i++) {
-      Link_layer::receive(std::move(recv_array[i]));
-    }
+    if (not burst.empty())
+      Link_layer::receive(burst.release());
   }
+  this->update_moderation();
+  return received;
 }
 
 void e1000::transmit_handler()
@@ -558,14 +609,15 @@ void e1000::transmit_handler()
     //printf("free_tokens: %u\n", free_tokens);
     transmit_queue_available_event(free_tokens);
   }
+  this->update_moderation();
 }
-bool e1000::can_transmit() const noexcept
+bool e1000::can_transmit(const int descriptors) const noexcept
 {
-  return this->link_state_up && tx.sent.size() < NUM_TX_DESC;
+  return this->link_state_up && tx.in_use + descriptors <= NUM_TX_DESC;
 }
 uint16_t e1000::free_transmit_descr() const noexcept
 {
-  return NUM_TX_DESC - tx.sent.size();
+  return NUM_TX_DESC - tx.in_use;
 }
 
 void e1000::transmit(net::Packet_ptr pckt)
@@ -578,25 +630,28 @@ void e1000::transmit(net::Packet_ptr pckt)
         sendq->chain(std::move(pckt));
   }
 
-  // send as much as possible from sendq
-  while (sendq != nullptr && can_transmit())
+  // send as much as possible from sendq, a descriptor per buffer
+  while (sendq != nullptr && can_transmit(sendq->segment_count()))
   {
     auto next = sendq->detach_tail();
     // transmit released buffer
     auto* packet = sendq.release();
-    transmit_data(packet->buf() + DRIVER_OFFSET, packet->size());
+    transmit_data(packet->buf() + DRIVER_OFFSET, packet->size(),
+                  packet->next_segment() == nullptr);
+    for (auto* seg = packet->next_segment(); seg; seg = seg->next_segment())
+      transmit_data(seg->layer_begin(), seg->size(), seg->next_segment() == nullptr);
     // add to sent packets
     tx.sent.push_back(packet);
     // decrement send queue size
     assert(sendq_size > 0);
     sendq_size--;
-    // force kick if tx queue is exactly quarter full
-    if (this->free_transmit_descr() == NUM_TX_DESC / 4) {
-      this->xmit_kick();
-    }
     // next is the new sendq
     sendq = std::move(next);
   }
+  // the tail is written once per batch, unless the ring is already full
+  if (sendq != nullptr) {
+    this->xmit_kick();
+  }
 }
 void e1000::do_release_transmitted()
 {
@@ -604,18 +659,23 @@ void e1000::do_release_transmitted()
   //uint32_t total = (NUM_TX_DESC - tx.current + tx_head) % NUM_TX_DESC;
   while (not tx.sent.empty())
   {
-    auto& tk = tx.desc[tx.sent_id];
+    // the packet is sent when the descriptor of its last buffer is done
+    auto* packet = tx.sent.front();
+    const int count = packet->segment_count();
+    auto& tk = tx.desc[(tx.sent_id + count - 1) % NUM_TX_DESC];
     if ((tk.status & 0x1) == 0) break;
 
-    auto* packet = tx.sent.front();
+    moderation.packets++;
+    moderation.bytes += packet->total_size();
     delete packet; // call deleter on Packet to release it
     tx.sent.pop_front();
-    tx.sent_id = (tx.sent_id + 1) % NUM_TX_DESC;
+    tx.sent_id = (tx.sent_id + count) % NUM_TX_DESC;
+    tx.in_use -= count;
   }
   PRINT("[e1000] transmitting %lu - bufferstore %lu\n",
         tx.sent.size(), bufstore().available());
 }
-void e1000::transmit_data(uint8_t* data, uint16_t length)
+void e1000::transmit_data(uint8_t* data, uint16_t length, const bool last)
 {
   auto& tk = tx.desc[tx.current];
   assert(tk.status == 0x1 && "Descriptor must be done");
@@ -624,12 +684,13 @@ void e1000::transmit_data(uint8_t* data, uint16_t length)
   tk.addr   = (uint64_t) data;
   tk.length = length;
   tk.cso    = 0;
-  tk.cmd    = 0x3 | (1 << 3);
+  tk.cmd    = (last) ? tx.cmd : (tx.cmd & ~CMD_EOP);
   tk.status = 0;
   tk.css    = 0;
   tk.vlan_tag = 0;
   // next tx position
   tx.current = (tx.current + 1) % NUM_TX_DESC;
+  tx.in_use++;
 
   if (tx.deferred == false)
   {
@@ -652,13 +713,65 @@ void e1000::do_deferred_xmit()
   deferred_devices.clear();
 }
 
+e1000::moderation_t
+e1000::select_moderation(uint32_t packets, uint32_t bytes, uint64_t nanos) noexcept
+{
+  const uint64_t rate = (nanos) ? packets * 1'000'000'000ull / nanos : 0;
+  // few packets: every interrupt is worth taking
+  if (rate < 2000) return MOD_LOWEST_LATENCY;
+  // full-sized frames or a packet storm: trade latency for throughput
+  if (rate > 50000 || bytes / packets > 1200) return MOD_BULK;
+  return MOD_LOW_LATENCY;
+}
+
+void e1000::update_moderation()
+{
+  const uint64_t now = os::nanos_since_boot();
+  const uint64_t elapsed = now - moderation.since;
+  if (elapsed < MODERATION_WINDOW) return;
+
+  const auto level = select_moderation(moderation.packets, moderation.bytes, elapsed);
+  if (level != moderation.level) {
+    PRINT("[e1000] moderation level %u -> %u (%u packets)\n",
+          moderation.level, level, moderation.packets);
+    this->set_moderation(level);
+  }
+  moderation.since   = now;
+  moderation.packets = 0;
+  moderation.bytes   = 0;
+}
+
+void e1000::set_moderation(moderation_t level)
+{
+  const auto& mod = moderation_table[level];
+  // interval between interrupts, in 256 nanosecond units
+  const uint32_t itr = 1'000'000'000 / (mod.ints_per_sec * 256);
+  if (this->use_msix) {
+    // rx, tx and other causes vectors
+    for (int i = 0; i < 3; i++) write_cmd(REG_EITR(i), itr);
+  }
+  else {
+    write_cmd(REG_ITR, itr);
+  }
+  write_cmd(REG_RDTR, mod.rdtr);
+  write_cmd(REG_RADV, mod.radv);
+  write_cmd(REG_TIDV, mod.tidv);
+  write_cmd(REG_TADV, mod.tadv);
+  // descriptors only wait for the TX timers with IDE set
+  tx.cmd = CMD_EOP | CMD_IFCS | CMD_RS;
+  if (mod.tidv) tx.cmd |= CMD_IDE;
+
+  moderation.level = level;
+  this->stat_moderation_ = mod.ints_per_sec;
+}
+
 void e1000::flush()
 {
   this->transmit(std::move(nullptr));
 }
 void e1000::poll()
 {
-  this->receive_handler();
+  this->receive_handler(NUM_RX_DESC);
 }
 void e1000::deactivate()
 {
@@ -39,6 +39,10 @@ public:
 
   net::Packet_ptr create_packet(int) override;
 
+  /** Jumbo frames are sent a descriptor per buffer */
+  uint32_t offloads() const noexcept override
+  { return TX_SEGMENTS; }
+
   /** Linklayer input. Hooks into IP-stack bottom, w.DOWNSTREAM data.*/
   void transmit(net::Packet_ptr pckt);
 
@@ -61,6 +65,17 @@ public:
 
   void poll() override;
 
+  /** Interrupt moderation levels, chosen from the recent packet rate */
+  enum moderation_t : uint8_t {
+    MOD_LOWEST_LATENCY,
+    MOD_LOW_LATENCY,
+    MOD_BULK
+  };
+
+  /** Pick a moderation level for @packets of @bytes total in @nanos */
+  static moderation_t select_moderation(uint32_t packets, uint32_t bytes,
+                                        uint64_t nanos) noexcept;
+
 private:
   void intr_enable();
   void intr_disable();
@@ -84,14 +99,19 @@ private:
   net::Packet_ptr recv_packet(uint8_t*, uint16_t);
   uintptr_t       new_rx_packet();
   void event_handler();
-  void receive_handler();
+  void msix_recv_handler();
+  int  receive_handler(int budget);
+  bool rx_pending() const noexcept;
+  uint32_t rx_intr_mask() const noexcept;
   void transmit_handler();
   uint16_t free_transmit_descr() const noexcept;
-  bool can_transmit() const noexcept;
-  void transmit_data(uint8_t*, uint16_t);
+  bool can_transmit(int descriptors = 1) const noexcept;
+  void transmit_data(uint8_t*, uint16_t, bool last = true);
   void do_release_transmitted();
   void xmit_kick();
   static void do_deferred_xmit();
+  void update_moderation();
+  void set_moderation(moderation_t);
 
   hw::PCI_Device& m_pcidev;
   std::vector<uint8_t> irqs;
@@ -127,6 +147,8 @@ private:
   struct rx_t {
     rx_desc desc[NUM_RX_DESC];
     uint16_t current = 0;
+    // the buffers of a frame received so far, until its last one
+    net::Packet_ptr partial = nullptr;
   } rx;
 
   struct tx_t {
@@ -134,11 +156,27 @@ private:
     std::deque<net::Packet*> sent;
     uint16_t current = 0;
     uint16_t sent_id = 0;
+    uint16_t in_use  = 0; // descriptors of the sent packets
+    uint8_t  cmd = 0; // command bits of every descriptor
     bool deferred = false;
   } tx;
 
+  // packets seen since the moderation level was last evaluated
+  struct moderation_state {
+    moderation_t level = MOD_LOW_LATENCY;
+    uint64_t since   = 0;
+    uint32_t packets = 0;
+    uint32_t bytes   = 0;
+  } moderation;
+
+  // RX interrupt / polling mode
+  Rx_poller rx_poller;
+
   // sendq as packet chain
   net::Packet_ptr  sendq = nullptr;
   size_t           sendq_size = 0;
   net::BufferStore bufstore_;
+
+  // max. interrupts per second of the current moderation level
+  uint32_t& stat_moderation_;
 };
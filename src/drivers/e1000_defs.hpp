@@ -29,6 +29,8 @@
 #define REG_TXDESCLEN   0x3808
 #define REG_TXDESCHEAD  0x3810
 #define REG_TXDESCTAIL  0x3818
+#define REG_TIDV        0x3820 // TX Interrupt Delay Value
+#define REG_TADV        0x382C // TX Int. Absolute Delay Value
 
 
 #define REG_RDTR         0x2820 // RX Delay Timer Register
@@ -60,6 +62,7 @@
 #define RCTL_CFI                        (1 << 20)   // Canonical Form Indicator Bit Value
 #define RCTL_DPF                        (1 << 22)   // Discard Pause Frames
 #define RCTL_PMCF                       (1 << 23)   // Pass MAC Control Frames
+#define RCTL_BSIZE_2048                 (0 << 16)   // Receive Buffer Size - 2048 bytes
 #define RCTL_SECRC                      (1 << 26)   // Strip Ethernet CRC
 
 // Transmit Command
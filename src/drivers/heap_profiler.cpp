@@ -0,0 +1,54 @@
+// Hooks operator new and delete into the sampling heap profiler.
+// Link this driver, and see HeapProfiler in <profile> for the results.
+//
+// Allocations straight from malloc aren't seen, as the C library
+// allocator can't be hooked.
+
+#include <profile>
+#include <common>
+#include <cstdlib>
+#include <new>
+
+// each operator calls the hook itself, so that all stacks have the same
+// number of frames between the hook and the call site
+__attribute__((always_inline))
+static inline void* profiled_alloc(std::size_t len)
+{
+  void* data = malloc(len);
+  if (UNLIKELY(data == nullptr)) throw std::bad_alloc();
+  return data;
+}
+
+void* operator new (std::size_t len)
+{
+  void* data = profiled_alloc(len);
+  HeapProfiler::allocated(data, len);
+  return data;
+}
+void* operator new[] (std::size_t len)
+{
+  void* data = profiled_alloc(len);
+  HeapProfiler::allocated(data, len);
+  return data;
+}
+
+void operator delete (void* ptr) noexcept
+{
+  HeapProfiler::deallocated(ptr);
+  free(ptr);
+}
+void operator delete[] (void* ptr) noexcept
+{
+  HeapProfiler::deallocated(ptr);
+  free(ptr);
+}
+void operator delete (void* ptr, std::size_t) noexcept
+{
+  HeapProfiler::deallocated(ptr);
+  free(ptr);
+}
+void operator delete[] (void* ptr, std::size_t) noexcept
+{
+  HeapProfiler::deallocated(ptr);
+  free(ptr);
+}
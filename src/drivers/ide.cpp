@@ -11,6 +11,7 @@
 #include <fs/common.hpp>
 #include <arch.hpp>
 #include <inttypes.h>
+#include <malloc.h>
 
 //#define IDE_DEBUG
 #ifdef IDE_DEBUG
@@ -54,8 +55,11 @@
 
 #define IDE_CMD_READ     0x20
 #define IDE_CMD_WRITE    0x30
+#define IDE_CMD_READ_DMA  0xC8
+#define IDE_CMD_WRITE_DMA 0xCA
 #define IDE_CMD_IDENTIFY 0xEC
 
+#define IDE_ERR      (1 << 0)
 #define IDE_DRQ      (1 << 3)
 #define IDE_DRDY     (1 << 6)
 #define IDE_BUSY     (1 << 7)
@@ -68,6 +72,21 @@
 
 #define IDE_TIMEOUT 2048
 
+// bus-master registers of the primary channel, at BAR4
+#define BM_BAR           4
+#define BM_CMD           0x0
+#define BM_STATUS        0x2
+#define BM_PRDT          0x4
+#define BM_CMD_START     (1 << 0)
+#define BM_CMD_READ      (1 << 3) // device to memory
+#define BM_STATUS_ACTIVE (1 << 0)
+#define BM_STATUS_ERROR  (1 << 1)
+#define BM_STATUS_IRQ    (1 << 2)
+
+// sectors per DMA command, and the PRD entries they can need
+#define IDE_DMA_SECTORS  128
+#define IDE_PRD_ENTRIES  4
+
 const int IDE::SECTOR_SIZE;
 const int IDE::SECTOR_ARRAY;
 
@@ -104,9 +123,11 @@ struct workq_item
 
   uint8_t      drive_id;
   bool         read;
+  bool         dma = false;
   block_t      sector;
   uint32_t     position = 0;
   uint32_t     total;
+  uint32_t     chunk = 0; // sectors in the DMA command in flight
   buffer_t     buffer;
   union {
 #ifdef IDE_ENABLE_READ
@@ -119,6 +140,50 @@ struct workq_item
 };
 static std::deque<workq_item> work_queue;
 
+// physical region descriptor, one contiguous piece of a DMA transfer
+struct prd_t
+{
+  uint32_t addr;
+  uint16_t bytes; // 0 means 64k
+  uint16_t flags;
+};
+#define PRD_EOT  0x8000
+
+static uint16_t bm_iobase = 0;
+static prd_t*   prd_table = nullptr;
+
+// the controller only does 32-bit addresses, in pieces not crossing 64k
+static bool dma_possible(const uint8_t* data, size_t len) noexcept
+{
+  const uintptr_t addr = (uintptr_t) data;
+  return bm_iobase != 0 and (addr & 1) == 0
+     and addr + len <= UINT32_MAX;
+}
+
+static void dma_begin(workq_item& item)
+{
+  item.chunk = std::min<uint32_t>(item.total - item.position, IDE_DMA_SECTORS);
+  uintptr_t addr = (uintptr_t) item.current();
+  size_t    left = item.chunk * IDE::SECTOR_SIZE;
+  int n = 0;
+  while (left > 0)
+  {
+    const size_t len = std::min<size_t>(left, 0x10000 - (addr & 0xFFFF));
+    prd_table[n++] = {(uint32_t) addr, (uint16_t) len, 0};
+    addr += len;
+    left -= len;
+  }
+  assert(n <= IDE_PRD_ENTRIES);
+  prd_table[n-1].flags = PRD_EOT;
+
+  hw::outb(bm_iobase + BM_CMD, 0);
+  hw::outl(bm_iobase + BM_PRDT, (uint32_t) (uintptr_t) prd_table);
+  // clear any old interrupt and error
+  hw::outb(bm_iobase + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERROR);
+  const uint8_t dir = item.read ? BM_CMD_READ : 0;
+  hw::outb(bm_iobase + BM_CMD, dir);
+}
+
 IDE::IDE(hw::PCI_Device& pcidev, selector_t sel)
   : drive_id {(uint8_t) sel}
 {
@@ -135,6 +200,15 @@ IDE::IDE(hw::PCI_Device& pcidev, selector_t sel)
   pcidev.probe_resources();
   this->pci_iobase = pcidev.iobase();
 
+  // the bus-master registers, when the controller has them
+  const auto& bm = pcidev.get_bar(BM_BAR);
+  if (bm.start != 0 and bm_iobase == 0)
+  {
+    // one table, as the channel does one transfer at a time
+    prd_table = (prd_t*) memalign(64, IDE_PRD_ENTRIES * sizeof(prd_t));
+    if (prd_table) bm_iobase = bm.start;
+  }
+
   /** IRQ initialization */
   Events::get().subscribe(IDE_IRQN, {&IDE::irq_handler});
   __arch_enable_legacy_irq(IDE_IRQN);
@@ -166,6 +240,9 @@ IDE::IDE(hw::PCI_Device& pcidev, selector_t sel)
   { // 28-bits CHS (MAX_LBA)
     this->num_blocks = (read_array[61] << 16) | read_array[60];
   }
+  // DMA, unless the drive can only do PIO
+  this->dma = bm_iobase != 0 and (read_array[49] & (1 << 8));
+  INFO("IDE", "Transfers with %s", this->dma ? "bus-master DMA" : "PIO");
   INFO("IDE", "%" PRIu64 " sectors (%" PRIu64 " bytes)", num_blocks, num_blocks * IDE::SECTOR_SIZE);
   INFO("IDE", "Initialization complete");
 }
@@ -181,6 +258,8 @@ void IDE::read(block_t blk, size_t count, on_read_func callback)
 
 #ifdef IDE_ENABLE_READ
   work_queue.emplace_back(drive_id, blk, count, callback);
+  auto& item = work_queue.back();
+  item.dma = this->dma and dma_possible(item.current(), item.buffer->size());
   if (work_queue.size() == 1) work_begin_next();
 #else
   (void) blk;
@@ -226,6 +305,8 @@ void IDE::write(block_t blk, buffer_t buffer, on_write_func callback)
   IDBG("IDE: Write called on %lu (%lu bytes)\n", blk, buffer->size());
 
   work_queue.emplace_back(drive_id, blk, buffer, callback);
+  auto& item = work_queue.back();
+  item.dma = this->dma and dma_possible(item.current(), item.buffer->size());
   if (work_queue.size() == 1) work_begin_next();
 #else
   (void) blk;
@@ -331,6 +412,18 @@ void IDE::work_begin_next()
 {
   if (work_queue.empty()) return;
   auto& item = work_queue.front();
+  if (item.dma)
+  {
+    // the controller moves the sectors, and interrupts when done
+    dma_begin(item);
+    set_irq_mode(true);
+    set_drive(0xE0 | item.drive_id | (((item.sector + item.position) >> 24) & 0x0F));
+    set_nbsectors(item.chunk);
+    set_blocknum(item.sector + item.position);
+    set_command(item.read ? IDE_CMD_READ_DMA : IDE_CMD_WRITE_DMA);
+    hw::outb(bm_iobase + BM_CMD, hw::inb(bm_iobase + BM_CMD) | BM_CMD_START);
+    return;
+  }
   assert(item.position == 0);
 
   set_irq_mode(true);
@@ -350,8 +443,50 @@ void IDE::work_begin_next()
   }
 #endif
 }
+void IDE::dma_complete()
+{
+  const uint8_t bm_status = hw::inb(bm_iobase + BM_STATUS);
+  // not from the controller, or the transfer isn't done yet
+  if ((bm_status & BM_STATUS_IRQ) == 0) return;
+  hw::outb(bm_iobase + BM_CMD, 0);
+  hw::outb(bm_iobase + BM_STATUS, BM_STATUS_IRQ | BM_STATUS_ERROR);
+  // reading the status acknowledges the drive interrupt
+  const uint8_t status = hw::inb(IDE_STATUS);
+  const bool error = (bm_status & BM_STATUS_ERROR) or (status & IDE_ERR);
+
+  auto& item = work_queue.front();
+  item.position += item.chunk;
+  if (not error and not item.done()) {
+    work_begin_next();
+    return;
+  }
+  auto buffer = std::move(item.buffer);
+  const bool read = item.read;
+#ifdef IDE_ENABLE_READ
+  on_read_func readcall;
+  if (read) readcall = std::move(item.readcall);
+#endif
+#ifdef IDE_ENABLE_WRITE
+  on_write_func writecall;
+  if (not read) writecall = std::move(item.writecall);
+#endif
+  work_queue.pop_front();
+  // queue next job, if any, before calling back
+  work_begin_next();
+#ifdef IDE_ENABLE_READ
+  if (read) readcall(error ? nullptr : std::move(buffer));
+#endif
+#ifdef IDE_ENABLE_WRITE
+  if (not read) writecall(error);
+#endif
+}
+
 void IDE::irq_handler()
 {
+  if (not work_queue.empty() and work_queue.front().dma) {
+    dma_complete();
+    return;
+  }
   while (not work_queue.empty())
   {
     auto& item = work_queue.front();
@@ -409,10 +544,14 @@ void IDE::irq_handler()
   } // queue
 }
 
-void IDE::deactivate() {}
+void IDE::deactivate()
+{
+  // stop any transfer in progress
+  if (bm_iobase) hw::outb(bm_iobase + BM_CMD, 0);
+}
 
-#include <kernel/pci_manager.hpp>
+#include <hw/pci_manager.hpp>
 __attribute__((constructor))
 static void autoreg() {
-  PCI_manager::register_blk(PCI::VENDOR_INTEL, IDE_PRODUCT_ID, &IDE::new_instance);
+  hw::PCI_manager::register_blk(PCI::VENDOR_INTEL, IDE_PRODUCT_ID, &IDE::new_instance);
 };
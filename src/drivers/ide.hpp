@@ -80,8 +80,11 @@ private:
   uint8_t    drive_id;
   uint32_t   pci_iobase = 0;
   block_t    num_blocks = 0;
+  // transfers with bus-master DMA, instead of PIO
+  bool       dma = false;
 
   static void work_begin_next();
+  static void dma_complete();
   static void irq_handler();
 }; //< class IDE
 
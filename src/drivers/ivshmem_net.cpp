@@ -0,0 +1,617 @@
+#include "ivshmem_net.hpp"
+#include <kernel/events.hpp>
+#include <kernel/memory.hpp>
+#include <net/ethernet/header.hpp>
+#include <os.hpp>
+#include <info>
+#include <statman>
+#include <smp>
+#include <cassert>
+#include <cstring>
+
+//#define VERBOSE_IVSHMEM
+#ifdef VERBOSE_IVSHMEM
+#define PRINT(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PRINT(fmt, ...) /* fmt */
+#endif
+
+// BAR0 registers
+static const int REG_INTR_MASK   = 0x00;
+static const int REG_IV_POSITION = 0x08;
+static const int REG_DOORBELL    = 0x0c;
+
+static const uint32_t SHM_MAGIC      = 0x4e534849; // "IHSN"
+static const uint32_t SHM_FORMATTING = 1;
+static const uint32_t SHM_VERSION    = 1;
+static const uint32_t NO_DOORBELL    = ~0u;
+
+// states of a place among the peers
+static const uint32_t PEER_FREE    = 0;
+static const uint32_t PEER_CLAIMED = 1;
+static const uint32_t PEER_UP      = 2;
+
+// too few buffers, and the peers starve each other
+static const uint32_t MIN_POOL_BUFFERS = 2 * IvshmemNet::RING_SIZE;
+
+// the only polling there is without doorbells, otherwise for the buffers
+// freed late, after the receive burst they came in
+static const std::chrono::microseconds POLL_INTERVAL {500};
+static const std::chrono::milliseconds HOUSEKEEPING_INTERVAL {10};
+
+static const uint8_t MAC_PREFIX[] {0x02, 0x69, 0x76, 0x73, 0x68};
+
+static inline uint32_t buffer_size_for_mtu(const uint16_t mtu)
+{
+  const uint32_t total = sizeof(net::Packet) + IvshmemNet::DRIVER_OFFSET
+                       + sizeof(net::ethernet::VLAN_header) + mtu;
+  uint32_t size = 2048;
+  while (size < total) size *= 2;
+  return size;
+}
+
+static inline uint32_t read_reg(const uintptr_t regs, const int reg)
+{
+  return *(volatile uint32_t*) (regs + reg);
+}
+static inline void write_reg(const uintptr_t regs, const int reg, const uint32_t value)
+{
+  *(volatile uint32_t*) (regs + reg) = value;
+}
+
+MAC::Addr IvshmemNet::peer_mac(const int peer) noexcept
+{
+  return {MAC_PREFIX[0], MAC_PREFIX[1], MAC_PREFIX[2],
+          MAC_PREFIX[3], MAC_PREFIX[4], (uint8_t) peer};
+}
+
+IvshmemNet::IvshmemNet(hw::PCI_Device& d, uint16_t mtu) :
+    Link(Link_protocol{{this, &IvshmemNet::transmit}, mac()}),
+    m_pcidev(d), m_mtu(mtu),
+    rx_poller({this, &IvshmemNet::receive_handler},
+              {this, &IvshmemNet::rearm}),
+    stat_ring_full{Statman::get().create(Stat::UINT32,
+                device_name() + ".ring_full").get_uint32()},
+    stat_no_buffers{Statman::get().create(Stat::UINT32,
+                device_name() + ".no_buffers").get_uint32()},
+    stat_doorbells{Statman::get().create(Stat::UINT32,
+                device_name() + ".doorbells").get_uint32()},
+    stat_bad_frames{Statman::get().create(Stat::UINT32,
+                device_name() + ".bad_frames").get_uint32()}
+{
+  static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "Ring size must be a power of 2");
+  static_assert(MAX_PEERS <= 32, "Peers to ring are kept in a 32-bit mask");
+
+  INFO("ivshmem", "Inter-VM shared memory network (rev=%#x)", d.rev_id());
+  this->deactivated = true;
+  d.parse_capabilities();
+  d.probe_resources();
+  m_regs = d.get_bar(0).start;
+
+  // the memory is a 64-bit BAR, above 4G when it is large
+  const auto& bar = d.get_bar(2);
+  const uint64_t shm_base = bar.start
+      | (uint64_t) d.read32(PCI::CONFIG_BASE_ADDR_0 + (3 << 2)) << 32;
+  const size_t shm_size = bar.len;
+  if (shm_base == 0 or shm_size < sizeof(layout)) {
+    INFO2("|  |- Shared memory of %zu bytes is too small", shm_size);
+    return;
+  }
+  if (os::mem::flags(shm_base) == os::mem::Access::none) {
+    using namespace util::bitops;
+    os::mem::map({(uintptr_t) shm_base, (uintptr_t) shm_base,
+                  os::mem::Access::read | os::mem::Access::write, shm_size},
+                 "ivshmem");
+  }
+  this->m_shm = (uint8_t*) shm_base;
+  this->shm   = (layout*) m_shm;
+  INFO2("|  |- Shared memory @ %p, %zu MiB", m_shm, shm_size >> 20);
+
+  if (not this->format_or_join(shm_size)) return;
+  this->setup_interrupts();
+  this->m_peer = this->claim_peer();
+  if (m_peer < 0) {
+    INFO2("|  |- All %d places are taken", MAX_PEERS);
+    return;
+  }
+  auto& hdr  = shm->hdr;
+  auto& self = hdr.peers[m_peer];
+  this->m_epoch  = ++self.epoch;
+  self.doorbell = (use_msix) ? read_reg(m_regs, REG_IV_POSITION) : NO_DOORBELL;
+  // without doorbells, nobody needs to ring us
+  self.polling.store(use_msix ? 0 : 1, std::memory_order_relaxed);
+  this->hw_addr = peer_mac(m_peer);
+  INFO2("|  |- Peer %d of %d, MAC %s, %u buffers of %u bytes",
+        m_peer, MAX_PEERS, hw_addr.to_string().c_str(),
+        hdr.pool_buffers, hdr.bufsize);
+
+  this->bufstore_ = std::make_unique<net::BufferStore>(
+        pool_of(m_peer), hdr.pool_buffers, hdr.bufsize);
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    if (peer == m_peer) continue;
+    this->peer_bufs[peer] = std::make_unique<net::BufferStore>(
+        pool_of(peer), hdr.pool_buffers, hdr.bufsize, false);
+  }
+  this->recover_rings();
+  this->deactivated = false;
+  self.alive.store(PEER_UP, std::memory_order_release);
+
+  this->poll_timer = Timers::periodic(
+      use_msix ? std::chrono::microseconds(HOUSEKEEPING_INTERVAL) : POLL_INTERVAL,
+      [this] (Timers::id_t) { this->housekeeping(); });
+}
+
+bool IvshmemNet::format_or_join(const size_t shm_size)
+{
+  auto& hdr = shm->hdr;
+  const uint32_t bufsize = buffer_size_for_mtu(m_mtu);
+  uint32_t magic = 0;
+  if (hdr.magic.compare_exchange_strong(magic, SHM_FORMATTING))
+  {
+    // the first one here lays out the memory for everyone
+    const size_t rings = (sizeof(layout) + 4095) & ~size_t(4095);
+    const size_t per_peer = (shm_size > rings)
+        ? ((shm_size - rings) / MAX_PEERS) & ~size_t(4095) : 0;
+    hdr.version      = SHM_VERSION;
+    hdr.bufsize      = bufsize;
+    hdr.pool_buffers = std::min<size_t>(POOL_BUFFERS, per_peer / bufsize);
+    hdr.pool_offset  = rings;
+    hdr.pool_stride  = (hdr.pool_buffers * bufsize + 4095) & ~4095u;
+    for (auto& peer : hdr.peers) {
+      peer.alive.store(PEER_FREE, std::memory_order_relaxed);
+      peer.polling.store(0, std::memory_order_relaxed);
+      peer.doorbell = NO_DOORBELL;
+      peer.epoch = 0;
+    }
+    for (int to = 0; to < MAX_PEERS; to++)
+    for (int from = 0; from < MAX_PEERS; from++)
+    {
+      shm->rx[to][from].head = 0;  shm->rx[to][from].tail = 0;
+      shm->ret[to][from].head = 0; shm->ret[to][from].tail = 0;
+    }
+    hdr.magic.store(SHM_MAGIC, std::memory_order_release);
+  }
+  else
+  {
+    // someone else is laying it out
+    const uint64_t until = os::nanos_since_boot() + 1'000'000'000ull;
+    while (hdr.magic.load(std::memory_order_acquire) == SHM_FORMATTING
+           and os::nanos_since_boot() < until)
+    {
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+      asm volatile("pause");
+#endif
+    }
+  }
+
+  if (hdr.magic.load(std::memory_order_acquire) != SHM_MAGIC
+      or hdr.version != SHM_VERSION) {
+    INFO2("|  |- Shared memory not laid out by a peer of version %u", SHM_VERSION);
+    return false;
+  }
+  if (hdr.bufsize < bufsize) {
+    INFO2("|  |- MTU %u does not fit in the shared buffers of %u bytes",
+          m_mtu, hdr.bufsize);
+    return false;
+  }
+  if (hdr.pool_buffers < MIN_POOL_BUFFERS) {
+    INFO2("|  |- Room for only %u buffers per peer", hdr.pool_buffers);
+    return false;
+  }
+  return true;
+}
+
+int IvshmemNet::claim_peer()
+{
+  auto& hdr = shm->hdr;
+  // with doorbells, the host numbers the VMs, and a VM that comes back
+  // takes over its old place
+  if (use_msix) {
+    const uint32_t position = read_reg(m_regs, REG_IV_POSITION);
+    if (position < (uint32_t) MAX_PEERS) {
+      hdr.peers[position].alive.store(PEER_CLAIMED);
+      return position;
+    }
+  }
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    uint32_t state = PEER_FREE;
+    if (hdr.peers[peer].alive.compare_exchange_strong(state, PEER_CLAIMED))
+      return peer;
+  }
+  return -1;
+}
+
+void IvshmemNet::recover_rings()
+{
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    if (peer == m_peer) continue;
+    // frames sent to an earlier us go back to their owners
+    auto& rx  = shm->rx[m_peer][peer];
+    auto& ret = shm->ret[peer][m_peer];
+    const uint32_t head = rx.head.load(std::memory_order_acquire);
+    uint32_t tail  = rx.tail.load(std::memory_order_relaxed);
+    uint32_t rhead = ret.head.load(std::memory_order_relaxed);
+    for (; tail != head; tail++, rhead++)
+    {
+      if (rhead - ret.tail.load(std::memory_order_acquire) >= RING_SIZE) break;
+      const auto& desc = rx.slots[tail % RING_SIZE];
+      ret.slots[rhead % RING_SIZE] = return_entry(desc.epoch, desc.buffer);
+    }
+    ret.head.store(rhead, std::memory_order_release);
+    rx.tail.store(head, std::memory_order_release);
+    // what was given back to an earlier us is in the new pool already,
+    // and so is what comes back later, from before our epoch
+    auto& own = shm->ret[m_peer][peer];
+    own.tail.store(own.head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+}
+
+void IvshmemNet::setup_interrupts()
+{
+  if (m_pcidev.msix_cap())
+  {
+    m_pcidev.init_msix();
+    this->use_msix = m_pcidev.has_msix();
+  }
+  if (not use_msix) {
+    INFO2("|  |- No MSI-X, polling every %lld us", (long long) POLL_INTERVAL.count());
+    return;
+  }
+  // a doorbell to vector 0 wakes us up
+  this->m_irq = Events::get().subscribe({this, &IvshmemNet::msix_recv_handler});
+  m_pcidev.setup_msix_vector(SMP::cpu_id(), IRQ_BASE + m_irq);
+  write_reg(m_regs, REG_INTR_MASK, 0);
+}
+
+void IvshmemNet::msix_recv_handler()
+{
+  // senders don't ring while we poll
+  shm->hdr.peers[m_peer].polling.store(1, std::memory_order_relaxed);
+  rx_poller.schedule();
+}
+
+bool IvshmemNet::rearm() noexcept
+{
+  if (not use_msix) return rx_pending();
+  auto& polling = shm->hdr.peers[m_peer].polling;
+  polling.store(0, std::memory_order_relaxed);
+  // the flag before the ring heads, against the senders' ring heads
+  // before the flag, or a frame could be left with no doorbell
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (not rx_pending()) return false;
+  polling.store(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool IvshmemNet::rx_pending() const noexcept
+{
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    const auto& rx = shm->rx[m_peer][peer];
+    if (rx.head.load(std::memory_order_acquire) != rx.tail.load(std::memory_order_relaxed))
+      return true;
+  }
+  return false;
+}
+
+bool IvshmemNet::peer_alive(const int peer) const noexcept
+{
+  return shm != nullptr and peer >= 0 and peer < MAX_PEERS
+     and shm->hdr.peers[peer].alive.load(std::memory_order_acquire) == PEER_UP;
+}
+
+int IvshmemNet::peer_of(const MAC::Addr& addr) const noexcept
+{
+  if (memcmp(addr.part, MAC_PREFIX, sizeof(MAC_PREFIX)) != 0) return -1;
+  const int peer = addr.part[5];
+  if (peer == m_peer or not peer_alive(peer)) return -1;
+  return peer;
+}
+
+net::Packet_ptr
+IvshmemNet::recv_packet(const int peer, const descriptor& desc)
+{
+  // a peer can get it wrong, but not make us look outside its pool
+  const uint32_t bufsize = shm->hdr.bufsize;
+  auto* store  = peer_bufs[peer].get();
+  auto* buffer = buffer_at(desc.buffer);
+  if (UNLIKELY(not store->is_valid(buffer))) {
+    stat_bad_frames++;
+    return nullptr;
+  }
+  // the epoch is kept in the headroom, for when the buffer goes back
+  static_assert(DRIVER_OFFSET >= (int) sizeof(descriptor::epoch), "No room for the epoch");
+  const uint32_t min_offset = sizeof(net::Packet) + DRIVER_OFFSET;
+  const bool valid = desc.data >= min_offset and desc.len >= sizeof(net::ethernet::Header)
+                 and desc.data + desc.len <= bufsize;
+  auto* ptr = (net::Packet*) buffer;
+  new (ptr) net::Packet(
+        valid ? desc.data - sizeof(net::Packet) : DRIVER_OFFSET,
+        valid ? desc.len : 0,
+        bufsize - sizeof(net::Packet),
+        store);
+  memcpy(ptr->buf(), &desc.epoch, sizeof(desc.epoch));
+  net::Packet_ptr pckt(ptr);
+  if (UNLIKELY(not valid)) {
+    stat_bad_frames++;
+    return nullptr;
+  }
+  return pckt;
+}
+
+int IvshmemNet::receive_handler(const int budget)
+{
+  int received = 0;
+  net::Packet_chain burst;
+
+  for (int peer = 0; peer < MAX_PEERS and received < budget; peer++)
+  {
+    if (peer == m_peer) continue;
+    auto& rx = shm->rx[m_peer][peer];
+    const uint32_t head = rx.head.load(std::memory_order_acquire);
+    uint32_t tail = rx.tail.load(std::memory_order_relaxed);
+
+    for (; tail != head and received < budget; tail++)
+    {
+      const descriptor desc = rx.slots[tail % RING_SIZE];
+      received++;
+      PRINT("[ivshmem] recv %u bytes from peer %d\n", desc.len, peer);
+      auto pckt = recv_packet(peer, desc);
+      if (UNLIKELY(pckt == nullptr)) continue;
+      burst.push_back(std::move(pckt));
+
+      if (burst.size() == Link::burst_size) {
+        // free the slots before processing them
+        rx.tail.store(tail + 1, std::memory_order_release);
+        Link_layer::receive(burst.release());
+      }
+    }
+    rx.tail.store(tail, std::memory_order_release);
+  }
+  if (not burst.empty())
+    Link_layer::receive(burst.release());
+
+  this->return_buffers();
+  return received;
+}
+
+void IvshmemNet::return_buffers()
+{
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    auto* store = peer_bufs[peer].get();
+    if (store == nullptr) continue;
+    auto& ret = shm->ret[peer][m_peer];
+    const uint32_t tail = ret.tail.load(std::memory_order_acquire);
+    uint32_t head = ret.head.load(std::memory_order_relaxed);
+    // when it is full, they wait in the store for the next time
+    for (; head - tail < RING_SIZE; head++)
+    {
+      auto* buffer = store->try_get_buffer();
+      if (buffer == nullptr) break;
+      uint16_t epoch;
+      memcpy(&epoch, buffer + sizeof(net::Packet), sizeof(epoch));
+      ret.slots[head % RING_SIZE] = return_entry(epoch, offset_of(buffer));
+    }
+    ret.head.store(head, std::memory_order_release);
+  }
+}
+
+void IvshmemNet::reclaim_buffers()
+{
+  uint8_t* buffers[Link::burst_size];
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    if (peer == m_peer) continue;
+    auto& ret = shm->ret[m_peer][peer];
+    const uint32_t head = ret.head.load(std::memory_order_acquire);
+    uint32_t tail = ret.tail.load(std::memory_order_relaxed);
+    size_t count = 0;
+    for (; tail != head; tail++)
+    {
+      const uint64_t entry = ret.slots[tail % RING_SIZE];
+      auto* buffer = buffer_at(entry & 0xffffffff);
+      // from before we came back, and in the pool already
+      if ((uint16_t) (entry >> 32) != (uint16_t) m_epoch) continue;
+      if (UNLIKELY(not bufstore_->is_valid(buffer))) {
+        stat_bad_frames++;
+        continue;
+      }
+      buffers[count++] = buffer;
+      if (count == Link::burst_size) {
+        bufstore_->release(buffers, count);
+        count = 0;
+      }
+    }
+    if (count) bufstore_->release(buffers, count);
+    ret.tail.store(tail, std::memory_order_release);
+  }
+}
+
+uint8_t* IvshmemNet::own_buffer()
+{
+  if (UNLIKELY(bufstore_ == nullptr)) return nullptr;
+  auto* buffer = bufstore_->try_get_buffer();
+  if (buffer != nullptr) return buffer;
+  this->reclaim_buffers();
+  return bufstore_->try_get_buffer();
+}
+
+net::Packet_ptr
+IvshmemNet::create_packet(int link_offset)
+{
+  const uint32_t bufsize = (bufstore_) ? bufstore_->bufsize() : buffer_size_for_mtu(m_mtu);
+  auto* buffer = this->own_buffer();
+  auto* store  = bufstore_.get();
+  if (UNLIKELY(buffer == nullptr)) {
+    // lent out to the peers, it is copied if there is room when sent
+    buffer = new uint8_t[bufsize];
+    store  = nullptr;
+  }
+  auto* ptr = (net::Packet*) buffer;
+  new (ptr) net::Packet(
+        DRIVER_OFFSET + link_offset,
+        0,
+        bufsize - sizeof(net::Packet),
+        store);
+  return net::Packet_ptr(ptr);
+}
+
+bool IvshmemNet::send_to(const int peer, net::Packet* packet, const bool give)
+{
+  auto& rx = shm->rx[peer][m_peer];
+  const uint32_t head = rx.head.load(std::memory_order_relaxed);
+  if (UNLIKELY(head - rx.tail.load(std::memory_order_acquire) >= RING_SIZE)) {
+    stat_ring_full++;
+    if (give) delete packet;
+    return false;
+  }
+
+  // a frame made in the own pool is handed over as it is
+  uint8_t* buffer = (uint8_t*) packet;
+  const bool zero_copy = give and packet->next_segment() == nullptr
+                     and bufstore_->is_valid(buffer);
+  uint32_t data = packet->layer_begin() - buffer;
+  uint32_t len  = packet->size();
+  if (not zero_copy)
+  {
+    buffer = this->own_buffer();
+    if (UNLIKELY(buffer == nullptr)) {
+      stat_no_buffers++;
+      if (give) delete packet;
+      return false;
+    }
+    data = sizeof(net::Packet) + DRIVER_OFFSET;
+    len  = 0;
+    for (auto* seg = packet; seg != nullptr; seg = seg->next_segment())
+    {
+      if (data + len + seg->size() > bufstore_->bufsize()) break;
+      memcpy(buffer + data + len, seg->layer_begin(), seg->size());
+      len += seg->size();
+    }
+    if (give) delete packet;
+  }
+
+  rx.slots[head % RING_SIZE] = {offset_of(buffer), (uint16_t) data,
+                                (uint16_t) len, (uint16_t) m_epoch, 0};
+  rx.head.store(head + 1, std::memory_order_release);
+  this->ring_mask |= 1u << peer;
+  return true;
+}
+
+void IvshmemNet::transmit(net::Packet_ptr pckt)
+{
+  if (UNLIKELY(deactivated)) return;
+  this->reclaim_buffers();
+
+  while (pckt != nullptr)
+  {
+    auto next = pckt->detach_tail();
+    auto* packet = pckt.release();
+    const MAC::Addr dest {packet->layer_begin()[0], packet->layer_begin()[1],
+                          packet->layer_begin()[2], packet->layer_begin()[3],
+                          packet->layer_begin()[4], packet->layer_begin()[5]};
+    if (dest.part[0] & 1)
+    {
+      // broadcast and multicast, a copy to everyone
+      for (int peer = 0; peer < MAX_PEERS; peer++)
+        if (peer != m_peer and peer_alive(peer))
+          this->send_to(peer, packet, false);
+      delete packet;
+    }
+    else if (const int peer = peer_of(dest); peer >= 0)
+      this->send_to(peer, packet, true);
+    else
+      delete packet;
+
+    pckt = std::move(next);
+  }
+  this->ring_doorbells();
+}
+
+void IvshmemNet::ring_doorbells()
+{
+  if (ring_mask == 0) return;
+  // the ring heads before the flags, see rearm()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    if ((ring_mask & (1u << peer)) == 0) continue;
+    const auto& info = shm->hdr.peers[peer];
+    if (info.polling.load(std::memory_order_relaxed)) continue;
+    if (info.doorbell == NO_DOORBELL) continue;
+    write_reg(m_regs, REG_DOORBELL, info.doorbell << 16);
+    stat_doorbells++;
+  }
+  this->ring_mask = 0;
+}
+
+size_t IvshmemNet::transmit_queue_available()
+{
+  if (UNLIKELY(deactivated)) return 0;
+  size_t avail = RING_SIZE;
+  for (int peer = 0; peer < MAX_PEERS; peer++)
+  {
+    if (peer == m_peer or not peer_alive(peer)) continue;
+    const auto& rx = shm->rx[peer][m_peer];
+    const uint32_t used = rx.head.load(std::memory_order_relaxed)
+                        - rx.tail.load(std::memory_order_acquire);
+    avail = std::min<size_t>(avail, RING_SIZE - used);
+  }
+  return avail;
+}
+
+void IvshmemNet::housekeeping()
+{
+  if (rx_pending()) rx_poller.schedule();
+  this->return_buffers();
+  this->reclaim_buffers();
+}
+
+void IvshmemNet::flush()
+{
+  this->ring_doorbells();
+}
+void IvshmemNet::poll()
+{
+  if (UNLIKELY(deactivated)) return;
+  this->receive_handler(RING_SIZE);
+  this->reclaim_buffers();
+}
+void IvshmemNet::deactivate()
+{
+  if (deactivated) return;
+  this->deactivated = true;
+  if (poll_timer != Timers::UNUSED_ID) {
+    Timers::stop(poll_timer);
+    poll_timer = Timers::UNUSED_ID;
+  }
+  // buffers of ours the others still hold are not coming back
+  auto& self = shm->hdr.peers[m_peer];
+  self.polling.store(1, std::memory_order_relaxed);
+  self.alive.store(PEER_FREE, std::memory_order_release);
+}
+void IvshmemNet::move_to_this_cpu()
+{
+  if (bufstore_) bufstore_->move_to_this_cpu();
+  for (auto& store : peer_bufs)
+    if (store) store->move_to_this_cpu();
+
+  if (use_msix)
+  {
+    this->m_irq = Events::get().subscribe({this, &IvshmemNet::msix_recv_handler});
+    m_pcidev.rebalance_msix_vector(0, SMP::cpu_id(), IRQ_BASE + m_irq);
+  }
+}
+
+#include <hw/pci_manager.hpp>
+__attribute__((constructor))
+static void register_func()
+{
+  using namespace hw;
+  // ivshmem-plain and ivshmem-doorbell
+  PCI_manager::register_nic(PCI::VENDOR_VIRTIO, 0x1110, &IvshmemNet::new_instance);
+}
@@ -0,0 +1,176 @@
+#include <hw/pci_device.hpp>
+#include <net/link_layer.hpp>
+#include <net/ethernet/ethernet_8021q.hpp>
+#include <kernel/timers.hpp>
+#include <array>
+#include <atomic>
+#include <memory>
+
+/**
+ *  Ethernet between VMs on the same host, through an ivshmem device they
+ *  all have. Each VM has a pool of buffers in the shared memory, and a
+ *  frame is handed over by putting the offset of its buffer in a ring of
+ *  the receiver, which gives the buffer back in a return ring when done
+ *  with it. Frames are not copied when they were made in the own pool.
+ *
+ *  A receiver is woken by a doorbell (with ivshmem-doorbell and MSI-X),
+ *  but not while it says it is polling. Without doorbells, it polls on a
+ *  timer.
+ */
+class IvshmemNet : public net::Link_layer<net::Ethernet>
+{
+public:
+  using Link          = net::Link_layer<net::Ethernet>;
+  using Link_protocol = Link::Protocol;
+  static const int DRIVER_OFFSET = 2;
+  static const int MAX_PEERS     = 8;
+  // descriptors in each ring, a power of 2
+  static const int RING_SIZE     = 256;
+  // buffers in the pool of each peer, at most
+  static const int POOL_BUFFERS  = 1024;
+
+  static std::unique_ptr<Nic> new_instance(hw::PCI_Device& d, const uint16_t MTU)
+  { return std::make_unique<IvshmemNet>(d, MTU); }
+
+  const char* driver_name() const override {
+    return "ivshmem";
+  }
+
+  const MAC::Addr& mac() const noexcept override {
+    return this->hw_addr;
+  }
+
+  uint16_t MTU() const noexcept override {
+    return m_mtu;
+  }
+
+  net::downstream create_physical_downstream() override
+  { return {this, &IvshmemNet::transmit}; }
+
+  net::Packet_ptr create_packet(int) override;
+
+  /** Linklayer input. Hooks into IP-stack bottom, w.DOWNSTREAM data.*/
+  void transmit(net::Packet_ptr pckt);
+
+  /** Constructor. @param pcidev an initialized PCI device. */
+  IvshmemNet(hw::PCI_Device& pcidev, uint16_t MTU);
+
+  /** Space available in the ring of the fullest peer, in packets */
+  size_t transmit_queue_available() override;
+
+  void flush() override;
+
+  void deactivate() override;
+
+  void move_to_this_cpu() override;
+
+  void poll() override;
+
+  /** This VM's place among the peers sharing the memory */
+  int peer_id() const noexcept
+  { return m_peer; }
+
+  /** Whether @peer is attached to the shared memory */
+  bool peer_alive(int peer) const noexcept;
+
+  /** The MAC address of the peer in place @peer */
+  static MAC::Addr peer_mac(int peer) noexcept;
+
+private:
+  struct descriptor {
+    uint32_t buffer; // offset in the shared memory
+    uint16_t data;   // offset of the frame in the buffer
+    uint16_t len;
+    uint16_t epoch;  // of the owner of the buffer, given back with it
+    uint16_t unused;
+  };
+  // one producer and one consumer, in different VMs
+  template <typename T>
+  struct ring {
+    alignas(64) std::atomic<uint32_t> head; // written by the producer
+    alignas(64) std::atomic<uint32_t> tail; // written by the consumer
+    alignas(64) T slots[RING_SIZE];
+  };
+  struct peer_info {
+    std::atomic<uint32_t> alive;
+    // not to be rung while it is polling
+    std::atomic<uint32_t> polling;
+    // IVPosition, or ~0 without doorbells
+    uint32_t doorbell;
+    // bumped each time the place is claimed, as buffers given back
+    // from before then are already in the new pool
+    uint32_t epoch;
+  };
+  struct header {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t bufsize;
+    uint32_t pool_buffers;
+    uint32_t pool_offset;  // of the pool of peer 0
+    uint32_t pool_stride;  // from one pool to the next
+    peer_info peers[MAX_PEERS];
+  };
+  // the shared memory: a header page, the rings, then the pools
+  struct layout {
+    alignas(4096) header hdr;
+    // frames to [receiver][sender]
+    ring<descriptor> rx[MAX_PEERS][MAX_PEERS];
+    // buffers given back to [owner][receiver]
+    ring<uint64_t>   ret[MAX_PEERS][MAX_PEERS];
+  };
+
+  bool format_or_join(size_t shm_size);
+  int  claim_peer();
+  void recover_rings();
+  void setup_interrupts();
+  void housekeeping();
+  void msix_recv_handler();
+  int  receive_handler(int budget);
+  bool rx_pending() const noexcept;
+  bool rearm() noexcept;
+  net::Packet_ptr recv_packet(int peer, const descriptor&);
+  bool send_to(int peer, net::Packet* pckt, bool give);
+  void ring_doorbells();
+  void return_buffers();
+  void reclaim_buffers();
+  uint8_t* own_buffer();
+  int  peer_of(const MAC::Addr&) const noexcept;
+
+  uint8_t* buffer_at(uint32_t offset) const noexcept
+  { return m_shm + offset; }
+  uint32_t offset_of(const uint8_t* buffer) const noexcept
+  { return buffer - m_shm; }
+  uint8_t* pool_of(int peer) const noexcept
+  { return m_shm + shm->hdr.pool_offset + peer * shm->hdr.pool_stride; }
+
+  static uint64_t return_entry(uint16_t epoch, uint32_t offset) noexcept
+  { return (uint64_t) epoch << 32 | offset; }
+
+  hw::PCI_Device& m_pcidev;
+  MAC::Addr      hw_addr;
+  const uint16_t m_mtu;
+  uintptr_t      m_regs = 0;
+  uint8_t*       m_shm  = nullptr;
+  layout*        shm    = nullptr;
+  int            m_peer = -1;
+  uint32_t       m_epoch = 0;
+  bool           use_msix = false;
+  uint8_t        m_irq = 0;
+  bool           deactivated = false;
+  Timers::id_t   poll_timer = Timers::UNUSED_ID;
+  // peers to ring after this batch of transmits
+  uint32_t       ring_mask = 0;
+
+  // RX interrupt / polling mode
+  Rx_poller rx_poller;
+
+  // the own pool, where frames are made to be handed over
+  std::unique_ptr<net::BufferStore> bufstore_;
+  // the buffers of each peer, between done with and given back
+  std::array<std::unique_ptr<net::BufferStore>, MAX_PEERS> peer_bufs;
+
+  uint32_t& stat_ring_full;
+  uint32_t& stat_no_buffers;
+  uint32_t& stat_doorbells;
+  uint32_t& stat_bad_frames;
+};
@@ -0,0 +1,550 @@
+#include "nvme.hpp"
+
+#include <kernel/events.hpp>
+#include <fs/common.hpp>
+#include <hw/pci.hpp>
+#include <arch.hpp>
+#include <info>
+#include <os.hpp>
+#include <statman>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <malloc.h>
+
+// controller registers
+#define NVME_REG_CAP    0x00
+#define NVME_REG_CC     0x14
+#define NVME_REG_CSTS   0x1C
+#define NVME_REG_AQA    0x24
+#define NVME_REG_ASQ    0x28
+#define NVME_REG_ACQ    0x30
+#define NVME_DOORBELLS  0x1000
+
+#define NVME_CC_EN      (1u << 0)
+#define NVME_CC_SHN     (1u << 14) // normal shutdown
+#define NVME_CC_IOSQES  (6u << 16) // 64 byte commands
+#define NVME_CC_IOCQES  (4u << 20) // 16 byte completions
+#define NVME_CSTS_RDY   (1u << 0)
+#define NVME_CSTS_CFS   (1u << 1)
+
+// admin commands
+#define NVME_ADMIN_CREATE_SQ  0x01
+#define NVME_ADMIN_CREATE_CQ  0x05
+#define NVME_ADMIN_IDENTIFY   0x06
+#define NVME_ADMIN_SET_FEAT   0x09
+#define NVME_FEAT_NUM_QUEUES  0x07
+// I/O commands
+#define NVME_CMD_READ         0x02
+
+#define NVME_QUEUE_CONTIG     (1u << 0)
+#define NVME_QUEUE_IEN        (1u << 1)
+
+static const uint32_t PAGE_SIZE  = 4096;
+static const uint16_t ADMIN_DEPTH = 32;
+// I/O queues don't need to be deeper than this
+static const uint16_t MAX_DEPTH   = 256;
+// the most bytes in one command, unless the device wants fewer
+static const uint32_t MAX_TRANSFER = 128 * 1024;
+// PRP entries for a whole transfer, as it may not start on a page
+static const uint32_t PRP_ENTRIES  = MAX_TRANSFER / PAGE_SIZE;
+
+// the namespace read from
+static const uint32_t NSID = 1;
+
+static inline uint16_t status_code(uint16_t status) noexcept {
+  // without the phase bit
+  return status >> 1;
+}
+
+NVMe::Queue_pair::Queue_pair(NVMe& dev, const uint16_t qid, const uint16_t dep)
+  : depth(dep)
+{
+  sq = (command_t*) memalign(PAGE_SIZE, depth * sizeof(command_t));
+  cq = (completion_t*) memalign(PAGE_SIZE, depth * sizeof(completion_t));
+  assert(sq && cq);
+  memset(sq, 0, depth * sizeof(command_t));
+  memset(cq, 0, depth * sizeof(completion_t));
+  sq_doorbell = dev.doorbell(qid, false);
+  cq_doorbell = dev.doorbell(qid, true);
+}
+NVMe::Queue_pair::~Queue_pair()
+{
+  free(sq);
+  free(cq);
+}
+
+void NVMe::Queue_pair::submit(const command_t& cmd) noexcept
+{
+  sq[sq_tail] = cmd;
+  if (++sq_tail == depth) sq_tail = 0;
+}
+
+void NVMe::Queue_pair::pop() noexcept
+{
+  if (++cq_head == depth) {
+    cq_head = 0;
+    phase ^= 1;
+  }
+}
+
+NVMe::Io_queue::Io_queue(NVMe& dev, const int idx, const int cpu_id)
+  : qp(dev, idx + 1, dev.queue_depth), cpu(cpu_id), index(idx),
+    slots(dev.queue_depth, nullptr)
+{
+  // one command id less than the depth, as a full queue looks empty
+  for (int cid = dev.queue_depth - 2; cid >= 0; cid--)
+    free_ids.push_back(cid);
+  const size_t len = dev.queue_depth * PRP_ENTRIES * sizeof(uint64_t);
+  prp_lists = (uint64_t*) memalign(PAGE_SIZE, len);
+  assert(prp_lists);
+}
+
+uint32_t NVMe::read32(uint32_t reg) const noexcept
+{
+  return *(volatile uint32_t*) (bar + reg);
+}
+uint64_t NVMe::read64(uint32_t reg) const noexcept
+{
+  return read32(reg) | (uint64_t) read32(reg + 4) << 32;
+}
+void NVMe::write32(uint32_t reg, uint32_t val) noexcept
+{
+  *(volatile uint32_t*) (bar + reg) = val;
+}
+void NVMe::write64(uint32_t reg, uint64_t val) noexcept
+{
+  write32(reg, val);
+  write32(reg + 4, val >> 32);
+}
+
+volatile uint32_t* NVMe::doorbell(uint16_t qid, bool completion) const noexcept
+{
+  const uint32_t reg = NVME_DOORBELLS + (2 * qid + completion) * doorbell_stride;
+  return (volatile uint32_t*) (bar + reg);
+}
+
+NVMe::NVMe(hw::PCI_Device& d)
+  : hw::Block_device(), m_pcidev(d)
+{
+  INFO("NVMe", "Initializing");
+  {
+    auto& reqs = Statman::get().create(
+      Stat::UINT32, device_name() + ".requests");
+    this->requests = &reqs.get_uint32();
+    *this->requests = 0;
+
+    auto& err = Statman::get().create(
+      Stat::UINT32, device_name() + ".errors");
+    this->errors = &err.get_uint32();
+    *this->errors = 0;
+
+    auto& mrg = Statman::get().create(
+      Stat::UINT32, device_name() + ".merged");
+    this->merged = &mrg.get_uint32();
+    *this->merged = 0;
+  }
+
+  d.parse_capabilities();
+  d.probe_resources();
+  this->bar = d.get_bar(0).start;
+  CHECKSERT(this->bar, "Registers are mapped");
+
+  const uint64_t cap = read64(NVME_REG_CAP);
+  this->doorbell_stride = 4u << ((cap >> 32) & 0xF);
+  // in 500 ms units
+  this->timeout_ns = std::max<uint64_t>((cap >> 24) & 0xFF, 1) * 500'000'000ull;
+  this->queue_depth = std::min<uint32_t>((cap & 0xFFFF) + 1, MAX_DEPTH);
+  CHECKSERT(((cap >> 48) & 0xF) == 0, "Controller supports 4k pages");
+
+  // a reset controller, with the admin queues set up
+  if (read32(NVME_REG_CC) & NVME_CC_EN) {
+    write32(NVME_REG_CC, 0);
+    CHECKSERT(wait_ready(false), "Controller was disabled");
+  }
+  admin_q.reset(new Queue_pair(*this, 0, ADMIN_DEPTH));
+  write32(NVME_REG_AQA, (ADMIN_DEPTH - 1) << 16 | (ADMIN_DEPTH - 1));
+  write64(NVME_REG_ASQ, (uintptr_t) admin_q->sq);
+  write64(NVME_REG_ACQ, (uintptr_t) admin_q->cq);
+  write32(NVME_REG_CC, NVME_CC_EN | NVME_CC_IOSQES | NVME_CC_IOCQES);
+  CHECKSERT(wait_ready(true), "Controller is ready");
+
+  identify();
+
+  // one I/O queue per CPU, each with its own vector
+  CHECKSERT(d.msix_cap(), "Device has MSI-X");
+  d.init_msix();
+  const int vectors = d.get_msix_vectors();
+  CHECKSERT(vectors >= 1, "Device has MSI-X vectors");
+  const int wanted = std::min<int>(vectors, 1 + SMP::active_cpus().size());
+  const int num_queues = create_queues(wanted);
+  CHECKSERT(num_queues > 0, "I/O queues created");
+  cpu_queue_.resize(SMP::early_cpu_total(), 0);
+
+  INFO("NVMe", "Queues: %d\tQueue depth: %u\tRequest size: %u sectors",
+       num_queues, queue_depth, max_sectors);
+
+  bind_queue(0);
+  // every other queue is serviced by its own CPU
+  for (int i = 1; i < num_queues; i++)
+  {
+    const int cpu = SMP::active_cpus().at(i - 1);
+    SMP::add_task([this, i] { this->bind_queue(i); }, cpu);
+    SMP::signal(cpu);
+  }
+
+  INFO("NVMe", "Block device with %lu sectors of %u bytes",
+       (unsigned long) sectors, sector_size);
+}
+
+bool NVMe::wait_ready(const bool ready) const
+{
+  const uint64_t until = os::nanos_since_boot() + timeout_ns;
+  while (((read32(NVME_REG_CSTS) & NVME_CSTS_RDY) != 0) != ready)
+  {
+    if (read32(NVME_REG_CSTS) & NVME_CSTS_CFS) return false;
+    if (os::nanos_since_boot() > until) return false;
+    __arch_hw_barrier();
+  }
+  return true;
+}
+
+uint16_t NVMe::admin(command_t& cmd, uint32_t* dw0)
+{
+  auto& q = *admin_q;
+  const uint16_t cid = admin_cid++;
+  cmd.cdw0 |= (uint32_t) cid << 16;
+  q.submit(cmd);
+  *q.sq_doorbell = q.sq_tail;
+
+  // the admin queue has no interrupt, and only one command at a time
+  const uint64_t until = os::nanos_since_boot() + timeout_ns;
+  completion_t* cqe;
+  while ((cqe = q.peek()) == nullptr)
+  {
+    if (os::nanos_since_boot() > until) return 0xFFFF;
+    __arch_hw_barrier();
+  }
+  const uint16_t status = status_code(cqe->status);
+  if (dw0) *dw0 = cqe->dw0;
+  q.pop();
+  *q.cq_doorbell = q.cq_head;
+  return status;
+}
+
+void NVMe::identify()
+{
+  auto* data = (uint8_t*) memalign(PAGE_SIZE, PAGE_SIZE);
+  assert(data);
+
+  // the controller, for the largest transfer
+  command_t cmd {};
+  cmd.cdw0  = NVME_ADMIN_IDENTIFY;
+  cmd.prp1  = (uintptr_t) data;
+  cmd.cdw10 = 1;
+  CHECKSERT(admin(cmd) == 0, "Identified controller");
+  const uint8_t mdts = data[77];
+  uint32_t max_transfer = MAX_TRANSFER;
+  if (mdts != 0 and mdts < 32)
+    max_transfer = std::min<uint64_t>(max_transfer, (uint64_t) PAGE_SIZE << mdts);
+
+  // the namespace, for its size and sector size
+  cmd = {};
+  cmd.cdw0  = NVME_ADMIN_IDENTIFY;
+  cmd.nsid  = NSID;
+  cmd.prp1  = (uintptr_t) data;
+  cmd.cdw10 = 0;
+  CHECKSERT(admin(cmd) == 0, "Identified namespace %u", NSID);
+  memcpy(&this->sectors, &data[0], sizeof(uint64_t));
+  const uint8_t format = data[26] & 0xF;
+  uint32_t lbaf;
+  memcpy(&lbaf, &data[128 + 4 * format], sizeof(lbaf));
+  this->sector_size = 1u << ((lbaf >> 16) & 0xFF);
+  free(data);
+
+  this->max_sectors = std::max<uint32_t>(max_transfer / sector_size, 1);
+}
+
+int NVMe::create_queues(const int wanted)
+{
+  // the controller may give us fewer than asked for
+  command_t cmd {};
+  cmd.cdw0  = NVME_ADMIN_SET_FEAT;
+  cmd.cdw10 = NVME_FEAT_NUM_QUEUES;
+  cmd.cdw11 = (wanted - 1) << 16 | (wanted - 1);
+  uint32_t granted = 0;
+  if (admin(cmd, &granted) != 0) return 0;
+  int count = std::min<int>(wanted, (granted & 0xFFFF) + 1);
+  count = std::min<int>(count, (granted >> 16) + 1);
+
+  for (int i = 0; i < count; i++)
+  {
+    queues_.emplace_back(*this, i, SMP::cpu_id());
+    auto& q = queues_.back();
+    const uint16_t qid = i + 1;
+
+    // I/O queue i completes into vector i
+    cmd = {};
+    cmd.cdw0  = NVME_ADMIN_CREATE_CQ;
+    cmd.prp1  = (uintptr_t) q.qp.cq;
+    cmd.cdw10 = (uint32_t) (queue_depth - 1) << 16 | qid;
+    cmd.cdw11 = (uint32_t) i << 16 | NVME_QUEUE_IEN | NVME_QUEUE_CONTIG;
+    if (admin(cmd) != 0) {
+      queues_.pop_back();
+      break;
+    }
+
+    cmd = {};
+    cmd.cdw0  = NVME_ADMIN_CREATE_SQ;
+    cmd.prp1  = (uintptr_t) q.qp.sq;
+    cmd.cdw10 = (uint32_t) (queue_depth - 1) << 16 | qid;
+    cmd.cdw11 = (uint32_t) qid << 16 | NVME_QUEUE_CONTIG;
+    // the completion queue is left unused
+    if (admin(cmd) != 0) {
+      queues_.pop_back();
+      break;
+    }
+  }
+  return queues_.size();
+}
+
+void NVMe::bind_queue(const int index)
+{
+  auto& q = queues_.at(index);
+  q.cpu = SMP::cpu_id();
+  cpu_queue_.at(q.cpu) = index;
+
+  m_pcidev.bind_msix_vector(index, q.cpu, [this, index] () {
+    this->service_queue(queues_[index]);
+  });
+  // reads are merged until the CPU gets to this event
+  q.flush_event = Events::get().subscribe([this, index] () {
+    this->flush(queues_[index]);
+  });
+}
+
+void NVMe::handle(request_t* req)
+{
+  const bool ok = req->status == 0;
+  if (not ok) (*this->errors)++;
+
+  for (auto* job : req->jobs)
+  {
+    if (ok && req->merged != nullptr)
+    {
+      // copy the part of the merged request that belongs to this job
+      const block_t first = std::max(job->blk, req->blk);
+      const block_t last  = std::min(job->blk + job->cnt, req->blk + req->cnt);
+      memcpy(job->buf->data() + (first - job->blk) * sector_size,
+             req->data + (first - req->blk) * sector_size,
+             (last - first) * sector_size);
+    }
+    if (not ok) job->error = true;
+    // call the user-provided callback once all its requests are done
+    if (--job->left == 0)
+    {
+      if (job->error)
+        job->func(nullptr);
+      else
+        job->func(job->buf);
+      delete job;
+    }
+  }
+  delete req;
+}
+
+void NVMe::service_queue(Io_queue& q)
+{
+  std::vector<request_t*> received;
+  completion_t* cqe;
+  while ((cqe = q.qp.peek()) != nullptr)
+  {
+    auto* req = q.slots.at(cqe->cid);
+    q.slots[cqe->cid] = nullptr;
+    q.free_ids.push_back(cqe->cid);
+    req->status = status_code(cqe->status);
+    received.push_back(req);
+    q.qp.pop();
+  }
+  if (not received.empty())
+    *q.qp.cq_doorbell = q.qp.cq_head;
+
+  // if we have free command ids and waiting requests, start shipping
+  bool shipped = false;
+  while (not q.free_ids.empty() && not q.waiting.empty()) {
+    shipit(q, q.waiting.front());
+    q.waiting.pop_front();
+    shipped = true;
+  }
+  if (shipped) *q.qp.sq_doorbell = q.qp.sq_tail;
+
+  for (request_t* req : received)
+    handle(req);
+}
+
+void NVMe::shipit(Io_queue& q, request_t* req)
+{
+  const uint16_t cid = q.free_ids.back();
+  q.free_ids.pop_back();
+  q.slots[cid] = req;
+
+  command_t cmd {};
+  cmd.cdw0  = NVME_CMD_READ | (uint32_t) cid << 16;
+  cmd.nsid  = NSID;
+  cmd.cdw10 = req->blk;
+  cmd.cdw11 = req->blk >> 32;
+  cmd.cdw12 = req->cnt - 1;
+
+  // the first entry may start inside a page, the others are whole pages
+  const uintptr_t addr = (uintptr_t) req->data;
+  const uintptr_t page = addr & ~(uintptr_t) (PAGE_SIZE - 1);
+  const size_t pages = (addr - page + req->cnt * sector_size + PAGE_SIZE - 1) / PAGE_SIZE;
+  cmd.prp1 = addr;
+  if (pages == 2)
+    cmd.prp2 = page + PAGE_SIZE;
+  else if (pages > 2)
+  {
+    uint64_t* list = &q.prp_lists[cid * PRP_ENTRIES];
+    assert(pages - 1 <= PRP_ENTRIES);
+    for (size_t i = 1; i < pages; i++)
+      list[i - 1] = page + i * PAGE_SIZE;
+    cmd.prp2 = (uintptr_t) list;
+  }
+  q.qp.submit(cmd);
+  (*this->requests)++;
+}
+
+void NVMe::flush(Io_queue& q)
+{
+  std::vector<read_job_t*> jobs;
+  q.pending_lock.lock();
+  jobs.swap(q.pending);
+  q.flush_scheduled = false;
+  q.pending_lock.unlock();
+  if (jobs.empty()) return;
+
+  // in disk order, so that neighbours can share a request
+  std::stable_sort(jobs.begin(), jobs.end(),
+  [] (const read_job_t* a, const read_job_t* b) {
+    return a->blk < b->blk;
+  });
+
+  std::vector<request_t*> reqs;
+  request_t* open = nullptr;
+  for (auto* job : jobs)
+  {
+    const block_t end = job->blk + job->cnt;
+    // adjacent (or overlapping) reads are merged, up to the request limit
+    if (open != nullptr && job->cnt <= max_sectors)
+    {
+      const block_t first = open->blk;
+      const block_t last  = std::max<block_t>(first + open->cnt, end);
+      if (job->blk <= first + open->cnt && last - first <= max_sectors)
+      {
+        open->cnt = last - first;
+        open->jobs.push_back(job);
+        job->left++;
+        (*this->merged)++;
+        continue;
+      }
+    }
+    // reads that are too big are split, straight into the job buffer
+    for (block_t blk = job->blk; blk < end; blk += max_sectors)
+    {
+      auto* req = new request_t(blk, std::min<block_t>(max_sectors, end - blk));
+      req->jobs.push_back(job);
+      job->left++;
+      reqs.push_back(req);
+    }
+    open = (job->cnt <= max_sectors) ? reqs.back() : nullptr;
+  }
+
+  bool shipped = false;
+  for (auto* req : reqs)
+  {
+    if (req->jobs.size() > 1) {
+      req->merged.reset(new uint8_t[req->cnt * sector_size]);
+      req->data = req->merged.get();
+    }
+    else {
+      auto* job = req->jobs.front();
+      req->data = job->buf->data() + (req->blk - job->blk) * sector_size;
+    }
+
+    if (q.waiting.empty() && not q.free_ids.empty()) {
+      shipit(q, req);
+      shipped = true;
+    }
+    else
+      q.waiting.push_back(req);
+  }
+  // one doorbell for all of them
+  if (shipped) *q.qp.sq_doorbell = q.qp.sq_tail;
+}
+
+void NVMe::read (block_t blk, size_t cnt, on_read_func func)
+{
+  if (cnt == 0) {
+    func(fs::construct_buffer(0));
+    return;
+  }
+  auto* job = new read_job_t{blk, cnt, fs::construct_buffer(block_size() * cnt),
+                             std::move(func)};
+
+  // reads are queued until the CPU owning the queue gets to them,
+  // so that those made in the meantime can be merged
+  auto& q = local_queue();
+  q.pending_lock.lock();
+  q.pending.push_back(job);
+  const bool schedule = not q.flush_scheduled;
+  q.flush_scheduled = true;
+  q.pending_lock.unlock();
+  if (not schedule) return;
+
+  if (q.cpu == SMP::cpu_id())
+    Events::get().trigger_event(q.flush_event);
+  else {
+    // a CPU without a queue of its own
+    while (not Events::get(q.cpu).post({[this, &q] { this->flush(q); }}))
+      __arch_hw_barrier();
+  }
+}
+
+NVMe::buffer_t NVMe::read_sync(block_t blk, size_t cnt)
+{
+  buffer_t result;
+  std::atomic<bool> done {false};
+  read(blk, cnt, [&result, &done] (buffer_t buf) {
+    result = std::move(buf);
+    done.store(true, std::memory_order_release);
+  });
+
+  // the owning CPU polls its queue, the others wait for it
+  auto& q = local_queue();
+  const bool owner = q.cpu == SMP::cpu_id();
+  if (owner) flush(q);
+  while (not done.load(std::memory_order_acquire))
+  {
+    if (owner) service_queue(q);
+    __arch_hw_barrier();
+  }
+  return result;
+}
+
+void NVMe::deactivate()
+{
+  m_pcidev.deactivate_msix();
+  // let the controller finish what it's doing before power goes away
+  write32(NVME_REG_CC, read32(NVME_REG_CC) | NVME_CC_SHN);
+}
+
+#include <hw/pci_manager.hpp>
+
+/** Global constructor - register NVMe's driver factory at the PCI_manager */
+struct Autoreg_nvme {
+  Autoreg_nvme() {
+    // mass storage, non-volatile memory
+    hw::PCI_manager::register_blk_class(0x01, 0x08, &NVMe::new_instance);
+  }
+} autoreg_nvme;
@@ -0,0 +1,218 @@
+
+#pragma once
+#ifndef NVME_HPP
+#define NVME_HPP
+
+#include <common>
+#include <hw/block_device.hpp>
+#include <hw/pci_device.hpp>
+#include <smp>
+#include <smp_utils>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/** NVMe controller driver, reading from the first namespace.
+
+    Each CPU gets its own submission and completion queue pair with its
+    own MSI-X vector, so that requests are made and completed without
+    sharing anything with the other CPUs. */
+class NVMe : public hw::Block_device
+{
+public:
+
+  static std::unique_ptr<Block_device> new_instance(hw::PCI_Device& d)
+  { return std::make_unique<NVMe>(d); }
+
+  std::string device_name() const override {
+    return "nvme" + std::to_string(id());
+  }
+
+  /** Human readable name. */
+  const char* driver_name() const noexcept override {
+    return "NVMe";
+  }
+
+  block_t block_size() const noexcept override {
+    return sector_size;
+  }
+
+  block_t size() const noexcept override {
+    return sectors;
+  }
+
+  // read @blk + @cnt from disk, call func with buffer when done
+  void read(block_t blk, size_t cnt, on_read_func cb) override;
+
+  // read @blk + @cnt from disk, waiting for the device
+  buffer_t read_sync(block_t blk, size_t cnt) override;
+
+  void deactivate() override;
+
+  /** Constructor. @param pcidev an initialized PCI device. */
+  NVMe(hw::PCI_Device& pcidev);
+
+private:
+  // submission queue entry
+  struct command_t
+  {
+    uint32_t cdw0; // opcode and command id
+    uint32_t nsid;
+    uint64_t reserved;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+  };
+  static_assert(sizeof(command_t) == 64, "NVMe commands are 64 bytes");
+
+  // completion queue entry
+  struct completion_t
+  {
+    uint32_t dw0;
+    uint32_t dw1;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status; // phase in bit 0
+  };
+  static_assert(sizeof(completion_t) == 16, "NVMe completions are 16 bytes");
+
+  /** A submission queue and the completion queue it completes into */
+  struct Queue_pair
+  {
+    Queue_pair(NVMe&, uint16_t qid, uint16_t depth);
+    ~Queue_pair();
+
+    command_t*    sq;
+    completion_t* cq;
+    uint16_t depth;
+    uint16_t sq_tail = 0;
+    uint16_t cq_head = 0;
+    uint16_t phase   = 1;
+    volatile uint32_t* sq_doorbell;
+    volatile uint32_t* cq_doorbell;
+
+    // the next completion, or nullptr if the device hasn't posted it yet
+    completion_t* peek() const noexcept {
+      auto* cqe = &cq[cq_head];
+      return ((cqe->status & 1) == phase) ? cqe : nullptr;
+    }
+    void pop() noexcept;
+    void submit(const command_t&) noexcept;
+  };
+
+  // a read() waiting for the requests that read its sectors
+  struct read_job_t
+  {
+    block_t      blk;
+    size_t       cnt;
+    buffer_t     buf;
+    on_read_func func;
+    uint32_t     left  = 0; // requests not done yet
+    bool         error = false;
+  };
+
+  // one read command, for a range of sectors of one or more jobs
+  struct request_t
+  {
+    block_t  blk;
+    uint32_t cnt;
+    uint16_t status = 0;
+    uint8_t* data = nullptr; // where the device puts the sectors
+    // only when shared by jobs, otherwise the sectors go straight to the job
+    std::unique_ptr<uint8_t[]> merged;
+    std::vector<read_job_t*>   jobs;
+
+    request_t(block_t b, uint32_t c) : blk(b), cnt(c) {}
+  };
+
+  /** One I/O queue pair, owned and serviced by a single CPU */
+  struct alignas(SMP_ALIGN) Io_queue
+  {
+    Io_queue(NVMe&, int index, int cpu);
+    Io_queue(Io_queue&&) = delete;
+
+    Queue_pair qp;
+    int    cpu;
+    int    index;
+    // requests in flight, by command id
+    std::vector<request_t*> slots;
+    std::vector<uint16_t>   free_ids;
+    // a PRP list for each command id
+    uint64_t* prp_lists;
+    // reads to be merged into requests, from any CPU
+    std::vector<read_job_t*> pending;
+    smp_spinlock pending_lock;
+    bool   flush_scheduled = false;
+    uint8_t flush_event = 0;
+    // requests waiting for a free command id
+    std::deque<request_t*> waiting;
+  };
+
+  uint32_t read32(uint32_t reg) const noexcept;
+  uint64_t read64(uint32_t reg) const noexcept;
+  void write32(uint32_t reg, uint32_t val) noexcept;
+  void write64(uint32_t reg, uint64_t val) noexcept;
+
+  volatile uint32_t* doorbell(uint16_t qid, bool completion) const noexcept;
+
+  /** Wait for CSTS.RDY to become @ready, false on timeout */
+  bool wait_ready(bool ready) const;
+
+  /** Run an admin command, polling for its completion.
+      Returns the status code, and the result in @dw0 */
+  uint16_t admin(command_t&, uint32_t* dw0 = nullptr);
+
+  void identify();
+  int  create_queues(int wanted);
+
+  /** Subscribe to the IRQ and flush event of a queue on this CPU */
+  void bind_queue(int index);
+
+  /** Service an I/O queue, completing finished requests */
+  void service_queue(Io_queue&);
+
+  // merge the pending reads into requests, and ship them with one doorbell
+  void flush(Io_queue&);
+
+  // add one request to the submission queue, without ringing the doorbell
+  void shipit(Io_queue&, request_t*);
+
+  void handle(request_t*);
+
+  Io_queue& local_queue() noexcept {
+    const size_t cpu = SMP::cpu_id();
+    return queues_[(cpu < cpu_queue_.size()) ? cpu_queue_[cpu] : 0];
+  }
+
+  hw::PCI_Device& m_pcidev;
+  uintptr_t bar;
+  uint32_t  doorbell_stride;
+  uint64_t  timeout_ns;
+
+  uint32_t  sector_size = 512;
+  block_t   sectors     = 0;
+  // the most sectors read with a single command
+  uint32_t  max_sectors;
+  uint16_t  queue_depth;
+
+  std::unique_ptr<Queue_pair> admin_q;
+  uint16_t admin_cid = 0;
+  // a deque never relocates its elements
+  std::deque<Io_queue> queues_;
+  // CPU id -> index of the queue serviced by that CPU
+  std::vector<uint8_t> cpu_queue_;
+
+  // stat counters
+  uint32_t* errors;
+  uint32_t* requests;
+  uint32_t* merged;
+};
+
+#endif
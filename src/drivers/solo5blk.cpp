@@ -4,9 +4,12 @@
 
 #include <hw/pci.hpp>
 #include <fs/common.hpp>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <stdlib.h>
 
+#include <kernel/events.hpp>
 #include <statman>
 
 extern "C" {
@@ -21,6 +24,7 @@ Solo5Blk::Solo5Blk()
   assert(bi.block_size == SECTOR_SIZE);
   INFO("Solo5Blk", "Block device with %zu sectors",
        bi.capacity / SECTOR_SIZE);
+  flush_event_ = Events::get().subscribe({this, &Solo5Blk::flush});
 }
 
 Solo5Blk::block_t Solo5Blk::size() const noexcept {
@@ -29,21 +33,69 @@ Solo5Blk::block_t Solo5Blk::size() const noexcept {
   return bi.capacity / SECTOR_SIZE;
 }
 
-Solo5Blk::buffer_t Solo5Blk::read_sync(block_t blk, size_t count) {
-  auto buffer = fs::construct_buffer(SECTOR_SIZE * count);
-  solo5_result_t res;
-
-  auto* data = (uint8_t*) buffer->data();
+bool Solo5Blk::read_sectors(block_t blk, size_t count, uint8_t* data)
+{
   for (size_t i = 0; i < count; i++) {
-    res = solo5_block_read((solo5_off_t) (blk + i) * SECTOR_SIZE,
-                           data + (i * SECTOR_SIZE), SECTOR_SIZE);
+    const auto res = solo5_block_read((solo5_off_t) (blk + i) * SECTOR_SIZE,
+                                      data + (i * SECTOR_SIZE), SECTOR_SIZE);
     if (res != SOLO5_R_OK) {
-      return nullptr;
+      return false;
     }
   }
+  return true;
+}
+
+Solo5Blk::buffer_t Solo5Blk::read_sync(block_t blk, size_t count) {
+  auto buffer = fs::construct_buffer(SECTOR_SIZE * count);
+  if (not read_sectors(blk, count, (uint8_t*) buffer->data())) {
+    return nullptr;
+  }
   return buffer;
 }
 
+void Solo5Blk::read(block_t blk, size_t count, on_read_func reader)
+{
+  // the caller carries on, and may queue more before these are read
+  pending_.push_back({blk, count, std::move(reader)});
+  if (pending_.size() == 1) {
+    Events::get().trigger_event(flush_event_);
+  }
+}
+
+void Solo5Blk::flush()
+{
+  std::vector<read_job_t> jobs;
+  jobs.swap(pending_);
+  // in disk order, so that overlapping reads share their sectors
+  std::stable_sort(jobs.begin(), jobs.end(),
+  [] (const read_job_t& a, const read_job_t& b) {
+    return a.blk < b.blk;
+  });
+
+  buffer_t last = nullptr;
+  block_t  last_blk = 0;
+  for (auto& job : jobs)
+  {
+    auto buffer = fs::construct_buffer(SECTOR_SIZE * job.cnt);
+    auto* data = (uint8_t*) buffer->data();
+    size_t done = 0;
+    // the start of this one may have been read for the one before
+    if (last != nullptr && job.blk < last_blk + last->size() / SECTOR_SIZE)
+    {
+      const size_t offset = job.blk - last_blk;
+      done = std::min(job.cnt, last->size() / SECTOR_SIZE - offset);
+      std::memcpy(data, last->data() + offset * SECTOR_SIZE, done * SECTOR_SIZE);
+    }
+    if (not read_sectors(job.blk + done, job.cnt - done, data + done * SECTOR_SIZE)) {
+      job.func(nullptr);
+      continue;
+    }
+    last = buffer;
+    last_blk = job.blk;
+    job.func(std::move(buffer));
+  }
+}
+
 void Solo5Blk::deactivate()
 {
   INFO("Solo5Net", "deactivate");
@@ -8,6 +8,7 @@
 #include <hw/pci_device.hpp>
 #include <virtio/virtio.hpp>
 #include <deque>
+#include <vector>
 
 class Solo5Blk : public hw::Block_device
 {
@@ -34,10 +35,9 @@ public:
     return SECTOR_SIZE; // some multiple of sector size
   }
 
-  void read(block_t blk, size_t cnt, on_read_func reader) override {
-    // solo5 doesn't support async blk IO at the moment
-    reader( read_sync(blk, cnt) );
-  }
+  /** Queued, and read when the CPU gets to an event, with the reads
+      made until then */
+  void read(block_t blk, size_t cnt, on_read_func reader) override;
 
   buffer_t read_sync(block_t, size_t) override;
 
@@ -49,6 +49,18 @@ public:
   Solo5Blk();
 
 private:
+  struct read_job_t {
+    block_t      blk;
+    size_t       cnt;
+    on_read_func func;
+  };
+  std::vector<read_job_t> pending_;
+  uint8_t flush_event_;
+
+  /** Read the pending jobs in disk order, sectors they share only once */
+  void flush();
+  /** A sector per hypercall, which is all the tender takes */
+  bool read_sectors(block_t blk, size_t cnt, uint8_t* data);
 };
 
 #endif
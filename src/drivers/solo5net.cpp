@@ -4,6 +4,7 @@
 #include <hw/pci.hpp>
 #include <cstdio>
 #include <cstring>
+#include <utility>
 
 extern "C" {
 #include <solo5/solo5.h>
@@ -15,6 +16,7 @@ const char* Solo5Net::driver_name() const { return "Solo5Net"; }
 
 Solo5Net::Solo5Net()
   : Link(Link_protocol{{this, &Solo5Net::transmit}, mac()}),
+    rx_poller({this, &Solo5Net::receive}, {[] () { return false; }}),
     packets_rx_{Statman::get().create(Stat::UINT64, device_name() + ".packets_rx").get_uint64()},
     packets_tx_{Statman::get().create(Stat::UINT64, device_name() + ".packets_tx").get_uint64()},
     bufstore_{NUM_BUFFERS, 2048u} // don't change this
@@ -26,26 +28,18 @@ Solo5Net::Solo5Net()
                        ni.mac_address[3], ni.mac_address[4], ni.mac_address[5]);
 }
 
-void Solo5Net::transmit(net::Packet_ptr pckt)
+void Solo5Net::transmit(net::Packet_ptr chain)
 {
-  net::Packet_ptr tail = std::move(pckt);
-
-  // Transmit all we can directly
-  while (tail) {
-    // next in line
-    auto next = tail->detach_tail();
-    // write data to network
-    solo5_net_write(tail->buf(), tail->size());
-    // set tail to next, releasing tail
-    tail = std::move(next);
-    // Stat increase packets transmitted
-    packets_tx_++;
-  }
-
-  // Buffer the rest
-  if (UNLIKELY(tail)) {
-    INFO("solo5net", "Could not send all packets..\n");
+  // a frame per hypercall, which is all the tender takes
+  uint64_t sent = 0;
+  while (chain != nullptr)
+  {
+    auto pckt = std::move(chain);
+    chain = pckt->detach_tail();
+    if (LIKELY(solo5_net_write(pckt->layer_begin(), pckt->size()) == SOLO5_R_OK))
+      sent++;
   }
+  packets_tx_ += sent;
 }
 
 net::Packet_ptr Solo5Net::create_packet(int link_offset)
@@ -57,28 +51,44 @@ net::Packet_ptr Solo5Net::create_packet(int link_offset)
 }
 net::Packet_ptr Solo5Net::recv_packet()
 {
-  auto* pckt = (net::Packet*) bufstore().get_buffer();
-  new (pckt) net::Packet(0, MTU(), packet_len(), &bufstore());
-  // Populate the packet buffer with new packet, if any
-  size_t size = packet_len();
-  if (solo5_net_read(pckt->buf(), size, &size) == 0) {
-    // Adjust packet size to match received data
-    if (size) {
-      pckt->set_data_end(size);
-      return net::Packet_ptr(pckt);
-    }
+  // the buffer of a read that found nothing is kept for the next one
+  auto* buffer = (spare_ != nullptr) ? std::exchange(spare_, nullptr)
+                                     : bufstore().get_buffer();
+  auto* pckt = new (buffer) net::Packet(0, MTU(), packet_len(), &bufstore());
+  size_t size = 0;
+  if (solo5_net_read(pckt->buf(), packet_len(), &size) == SOLO5_R_OK and size > 0) {
+    pckt->set_data_end(size);
+    return net::Packet_ptr(pckt);
   }
-  bufstore().release(&pckt);
+  spare_ = buffer;
   return nullptr;
 }
 
-void Solo5Net::poll()
+int Solo5Net::receive(const int budget)
 {
-  auto pckt_ptr = recv_packet();
+  // read until there is nothing left, or the budget is used
+  int received = 0;
+  net::Packet_chain burst;
+  while (received < budget)
+  {
+    auto pckt_ptr = recv_packet();
+    if (pckt_ptr == nullptr) break;
 
-  if (LIKELY(pckt_ptr != nullptr)) {
-    Link::receive(std::move(pckt_ptr));
+    received++;
+    burst.push_back(std::move(pckt_ptr));
+    if (burst.size() == Link::burst_size)
+      Link::receive(burst.release());
   }
+  if (not burst.empty())
+    Link::receive(burst.release());
+  packets_rx_ += received;
+  return received;
+}
+
+void Solo5Net::poll()
+{
+  // there are no interrupts to mask, just keep polling until drained
+  rx_poller.schedule();
 }
 
 void Solo5Net::deactivate()
@@ -69,6 +69,12 @@ public:
 private:
   MAC::Addr mac_addr;
   std::unique_ptr<net::Packet> recv_packet();
+  /** Hand up to @budget frames up in bursts, as long as reads find any */
+  int receive(int budget);
+  // a buffer kept from a read that found no frame
+  uint8_t* spare_ = nullptr;
+  // woken up by network activity, polled until there is nothing left
+  Rx_poller rx_poller;
   /** Stats */
   uint64_t& packets_rx_;
   uint64_t& packets_tx_;
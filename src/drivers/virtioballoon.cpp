@@ -0,0 +1,321 @@
+#include "virtioballoon.hpp"
+#include <kernel/events.hpp>
+#include <kernel/memory.hpp>
+#include <kernel.hpp>
+#include <hw/pci.hpp>
+#include <hw/pci_manager.hpp>
+#include <statman>
+#include <algorithm>
+#include <cstddef>
+
+#ifdef VBALLOON_DEBUG
+#define VBPRINT(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define VBPRINT(fmt, ...) /* fmt */
+#endif
+
+#define VIRTIO_BALLOON_F_MUST_TELL_HOST    0
+#define VIRTIO_BALLOON_F_STATS_VQ          1
+#define VIRTIO_BALLOON_F_DEFLATE_ON_OOM    2
+#define VIRTIO_BALLOON_F_FREE_PAGE_HINT    3
+#define VIRTIO_BALLOON_F_PAGE_POISON       4
+#define VIRTIO_BALLOON_F_PAGE_REPORTING    5
+
+#define VIRTIO_BALLOON_S_MEMFREE  4
+#define VIRTIO_BALLOON_S_MEMTOT   5
+#define VIRTIO_BALLOON_S_AVAIL    6
+#define FEAT(x)  (1 << x)
+
+// legacy and Virtio 1.0 device IDs
+static const uint16_t BALLOON_LEGACY = 0x1002;
+static const uint16_t BALLOON_MODERN = 0x1045;
+static const std::chrono::seconds DEFAULT_INTERVAL {2};
+
+static std::unique_ptr<VirtioBalloon> balloon;
+static int index_counter = 0;
+
+VirtioBalloon* VirtioBalloon::init()
+{
+  if (balloon != nullptr) return balloon.get();
+  for (const auto* dev : hw::PCI_manager::devices())
+  {
+    if (dev->vendor_id() != PCI::VENDOR_VIRTIO) continue;
+    if (dev->product_id() != BALLOON_LEGACY and dev->product_id() != BALLOON_MODERN)
+        continue;
+    // the manager keeps its devices, only handing them out const
+    balloon = std::make_unique<VirtioBalloon>(const_cast<hw::PCI_Device&>(*dev));
+    return balloon.get();
+  }
+  return nullptr;
+}
+
+VirtioBalloon::VirtioBalloon(hw::PCI_Device& d)
+: Virtio(d),
+  m_reported_stat(Statman::get().create(Stat::UINT64,
+            "virtioballoon" + std::to_string(index_counter) + ".reported_bytes").get_uint64()),
+  m_reports(Statman::get().create(Stat::UINT64,
+            "virtioballoon" + std::to_string(index_counter) + ".reports").get_uint64()),
+  m_index(index_counter)
+{
+  index_counter++;
+  INFO("VirtioBalloon", "Driver initializing");
+
+  new (&inflate_q) Virtio::Queue(device_name() + ".inflate_q", queue_size(0), 0, iobase());
+  new (&deflate_q) Virtio::Queue(device_name() + ".deflate_q", queue_size(1), 1, iobase());
+  new (&stats_q) Virtio::Queue(device_name() + ".stats_q", queue_size(2), 2, iobase());
+
+  // the host may use the balloon pages whenever, so they needn't be told
+  // about before use, and a deflate is only a courtesy
+  const uint32_t wanted_features =
+        FEAT(VIRTIO_BALLOON_F_STATS_VQ)
+      | FEAT(VIRTIO_BALLOON_F_DEFLATE_ON_OOM)
+      | FEAT(VIRTIO_BALLOON_F_PAGE_REPORTING);
+  negotiate_features(wanted_features
+                     | (probe_features() & (1 << VIRTIO_F_RING_INDIRECT_DESC)));
+
+  CHECK(negotiated_features() & FEAT(VIRTIO_BALLOON_F_STATS_VQ),
+        "Memory statistics");
+  CHECK(negotiated_features() & FEAT(VIRTIO_BALLOON_F_DEFLATE_ON_OOM),
+        "Deflate on out of memory");
+  CHECK(negotiated_features() & FEAT(VIRTIO_BALLOON_F_PAGE_REPORTING),
+        "Free page reporting");
+  m_deflate_on_oom = negotiated_features() & FEAT(VIRTIO_BALLOON_F_DEFLATE_ON_OOM);
+  m_reporting_enabled = negotiated_features() & FEAT(VIRTIO_BALLOON_F_PAGE_REPORTING);
+
+  // the queues there are, are numbered in order, and without free page
+  // hinting the reporting queue follows the stats queue
+  const bool has_stats = negotiated_features() & FEAT(VIRTIO_BALLOON_F_STATS_VQ);
+  const int report_idx = has_stats ? 3 : 2;
+  if (m_reporting_enabled) {
+    new (&report_q) Virtio::Queue(device_name() + ".report_q",
+                                  queue_size(report_idx), report_idx, iobase());
+    enable_ring_features(report_q, MAX_REPORT);
+  }
+
+  // one vector for all the queues, as they are all handled together
+  auto success = assign_queue(0, inflate_q.queue_desc(), 0);
+  CHECK(success, "Inflate queue assigned (%p) to device", inflate_q.queue_desc());
+  success = assign_queue(1, deflate_q.queue_desc(), 0);
+  CHECK(success, "Deflate queue assigned (%p) to device", deflate_q.queue_desc());
+  if (has_stats) {
+    success = assign_queue(2, stats_q.queue_desc(), 0);
+    CHECK(success, "Stats queue assigned (%p) to device", stats_q.queue_desc());
+  }
+  if (m_reporting_enabled) {
+    success = assign_queue(report_idx, report_q.queue_desc(), 0);
+    CHECK(success, "Reporting queue assigned (%p) to device", report_q.queue_desc());
+  }
+
+  get_config(&m_config, sizeof(balloon_config));
+  setup_complete(true);
+
+  if (has_msix())
+  {
+    for (auto irq : this->get_irqs())
+      Events::get().subscribe(irq, {this, &VirtioBalloon::msix_handler});
+  }
+  else
+  {
+    auto irq = Virtio::get_legacy_irq();
+    Events::get().subscribe(irq, {this, &VirtioBalloon::event_handler});
+  }
+
+  // the device asks for statistics by giving the buffer back
+  if (has_stats) send_stats();
+
+  m_shrinker = os::mem::add_shrinker("virtioballoon", os::mem::Shrink_cost::cheap,
+                                     {this, &VirtioBalloon::shrink});
+  m_timer = Timers::periodic(DEFAULT_INTERVAL, {this, &VirtioBalloon::tick});
+
+  INFO("VirtioBalloon", "Target %u pages, free page reporting %s",
+       m_config.num_pages, m_reporting_enabled ? "on" : "off");
+  adjust();
+}
+
+VirtioBalloon::~VirtioBalloon()
+{
+  Timers::stop(m_timer);
+  os::mem::remove_shrinker(m_shrinker);
+  this->Virtio::reset();
+  // the device is gone, so all its memory can be used again
+  for (auto* block : m_reporting) os::mem::return_block(block, REPORT_SIZE);
+  release_reported();
+  for (auto* block : m_balloon) os::mem::return_block(block, BALLOON_BLOCK);
+  if (m_inflating) os::mem::return_block(m_inflating, BALLOON_BLOCK);
+  if (m_deflating) os::mem::return_block(m_deflating, BALLOON_BLOCK);
+}
+
+void VirtioBalloon::set_interval(duration_t interval)
+{
+  Timers::stop(m_timer);
+  m_timer = Timers::periodic(interval, {this, &VirtioBalloon::tick});
+}
+
+void VirtioBalloon::event_handler()
+{
+  int isr = hw::inp(iobase() + VIRTIO_PCI_ISR);
+  VBPRINT("<VirtioBalloon> ISR: %#x\n", isr);
+  if (isr & 1) handle_queues();
+  else if (isr & 2) adjust();
+}
+
+void VirtioBalloon::msix_handler()
+{
+  // config changes come on their own vector, and are looked at anyway
+  handle_queues();
+}
+
+void VirtioBalloon::handle_queues()
+{
+  while (inflate_q.new_incoming())
+  {
+    inflate_q.dequeue();
+    if (m_inflating) m_balloon.push_back(m_inflating);
+    m_inflating = nullptr;
+  }
+  while (deflate_q.new_incoming())
+  {
+    deflate_q.dequeue();
+    if (m_deflating) os::mem::return_block(m_deflating, BALLOON_BLOCK);
+    m_deflating = nullptr;
+  }
+  if (negotiated_features() & FEAT(VIRTIO_BALLOON_F_STATS_VQ))
+  {
+    bool asked = false;
+    while (stats_q.new_incoming()) {
+      stats_q.dequeue();
+      asked = true;
+    }
+    if (asked) send_stats();
+  }
+  if (m_reporting_enabled and report_q.new_incoming())
+  {
+    while (report_q.new_incoming())
+      report_q.dequeue();
+    // the host has dropped them, and they stay out of the heap until needed
+    m_reported.insert(m_reported.end(), m_reporting.begin(), m_reporting.end());
+    m_reporting.clear();
+    m_reported_stat = reported_bytes();
+  }
+  // on to the next list of pages, or a new target
+  adjust();
+}
+
+void VirtioBalloon::tick(Timers::id_t)
+{
+  adjust();
+  report();
+}
+
+size_t VirtioBalloon::reserve() const noexcept
+{
+  return 2 * os::mem::low_watermark();
+}
+
+void VirtioBalloon::adjust()
+{
+  get_config(&m_config, sizeof(balloon_config));
+  // one list of pages in flight at a time
+  if (m_inflating or m_deflating) return;
+
+  const size_t target = m_config.num_pages / PFNS;
+  if (m_balloon.size() < target)
+  {
+    // not from the reserve, the host can wait for it
+    m_inflating = os::mem::take_free_block(BALLOON_BLOCK, reserve());
+    if (m_inflating == nullptr) return;
+    const auto first = (uintptr_t) m_inflating / PAGE_SIZE;
+    for (int i = 0; i < PFNS; i++) m_inflate_pfns[i] = first + i;
+
+    const Token token {{(uint8_t*) m_inflate_pfns.data(), sizeof(m_inflate_pfns)}, Token::OUT};
+    std::array<Token, 1> tokens { token };
+    inflate_q.enqueue(tokens);
+    inflate_q.kick();
+  }
+  else if (m_balloon.size() > target)
+  {
+    m_deflating = m_balloon.back();
+    m_balloon.pop_back();
+    const auto first = (uintptr_t) m_deflating / PAGE_SIZE;
+    for (int i = 0; i < PFNS; i++) m_deflate_pfns[i] = first + i;
+
+    const Token token {{(uint8_t*) m_deflate_pfns.data(), sizeof(m_deflate_pfns)}, Token::OUT};
+    std::array<Token, 1> tokens { token };
+    deflate_q.enqueue(tokens);
+    deflate_q.kick();
+  }
+  update_actual();
+}
+
+void VirtioBalloon::update_actual()
+{
+  const uint32_t actual = m_balloon.size() * PFNS;
+  if (actual == m_config.actual) return;
+  m_config.actual = actual;
+  set_config(offsetof(balloon_config, actual), &actual, sizeof(actual));
+}
+
+void VirtioBalloon::report()
+{
+  if (not m_reporting_enabled or not m_reporting.empty()) return;
+  if (os::mem::pressure() != os::mem::Pressure::none) return;
+
+  if (report_q.num_free_chains(MAX_REPORT) == 0) return;
+
+  std::array<Token, MAX_REPORT> tokens;
+  int count = 0;
+  while (count < MAX_REPORT)
+  {
+    auto* block = os::mem::take_free_block(REPORT_SIZE, reserve());
+    if (block == nullptr) break;
+    m_reporting.push_back(block);
+    // written by the device, as far as the spec is concerned
+    tokens[count++] = Token{{(uint8_t*) block, REPORT_SIZE}, Token::IN};
+  }
+  if (count == 0) return;
+
+  VBPRINT("<VirtioBalloon> Reporting %d blocks free\n", count);
+  report_q.enqueue(gsl::span<Token>(tokens.data(), count));
+  report_q.kick();
+  m_reports++;
+}
+
+void VirtioBalloon::release_reported()
+{
+  for (auto* block : m_reported)
+    os::mem::return_block(block, REPORT_SIZE);
+  m_reported.clear();
+  m_reported_stat = 0;
+}
+
+size_t VirtioBalloon::shrink(os::mem::Pressure level)
+{
+  size_t freed = reported_bytes();
+  release_reported();
+
+  // the balloon pages may be used without asking, when the host said so
+  if (level == os::mem::Pressure::critical and m_deflate_on_oom)
+  {
+    freed += balloon_bytes();
+    for (auto* block : m_balloon)
+      os::mem::return_block(block, BALLOON_BLOCK);
+    m_balloon.clear();
+    update_actual();
+  }
+  return freed;
+}
+
+void VirtioBalloon::send_stats()
+{
+  const uint64_t total = kernel::heap_max() - kernel::heap_begin();
+  const uint64_t avail = kernel::heap_avail();
+  m_stats[0] = {VIRTIO_BALLOON_S_MEMFREE, avail};
+  m_stats[1] = {VIRTIO_BALLOON_S_MEMTOT,  total};
+  // the reported blocks are the heap's to take back
+  m_stats[2] = {VIRTIO_BALLOON_S_AVAIL,   avail + reported_bytes()};
+
+  const Token token {{(uint8_t*) m_stats.data(), sizeof(m_stats)}, Token::OUT};
+  std::array<Token, 1> tokens { token };
+  stats_q.enqueue(tokens);
+  stats_q.kick();
+}
@@ -0,0 +1,135 @@
+#pragma once
+#ifndef VIRTIO_BALLOON_HPP
+#define VIRTIO_BALLOON_HPP
+
+#include <common>
+#include <hw/pci_device.hpp>
+#include <kernel/mem_pressure.hpp>
+#include <kernel/timers.hpp>
+#include <virtio/virtio.hpp>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+/**
+ * http://docs.oasis-open.org/virtio/virtio/v1.1/cs01/virtio-v1.1-cs01.html#x1-2790005
+ *
+ * The virtio memory balloon lets the host take memory back from a guest.
+ * The host sets a target size for the balloon, and the driver fills it
+ * with pages it takes from the heap, telling the host their frame numbers.
+ *
+ * With free page reporting, the driver also tells the host about large
+ * blocks the heap has free, which the host can then drop from the guest,
+ * until the guest uses them again. The buddy allocator keeps no record of
+ * which free blocks have been reported, so the blocks reported are held
+ * out of the heap, leaving a reserve of twice the low watermark, and given
+ * back by a (cheap) shrinker as soon as memory runs low. Under critical
+ * pressure, the balloon is emptied too when the host allows it.
+ *
+ * Free memory and the size of the heap are reported in the statistics.
+ **/
+class VirtioBalloon : public Virtio
+{
+public:
+  using duration_t = std::chrono::milliseconds;
+
+  /** Blocks of free memory reported at a time */
+  static constexpr size_t REPORT_SIZE = 2 * 1024 * 1024;
+  /** Blocks the balloon is filled with, a page frame list each */
+  static constexpr size_t BALLOON_BLOCK = 1024 * 1024;
+
+  /**
+   * Start the driver on the first virtio balloon device, if there is one.
+   * Returns the driver, or nullptr
+   */
+  static VirtioBalloon* init();
+
+  std::string device_name() const {
+    return "virtioballoon" + std::to_string(m_index);
+  }
+
+  /** Time between looking for free blocks to report, and at the target */
+  void set_interval(duration_t);
+
+  /** Whether the host takes reports of free memory */
+  bool reporting() const noexcept
+  { return m_reporting_enabled; }
+
+  /** Bytes the host asks the balloon to hold */
+  uint64_t target_bytes() const noexcept
+  { return (uint64_t) m_config.num_pages * PAGE_SIZE; }
+
+  /** Bytes held by the balloon */
+  uint64_t balloon_bytes() const noexcept
+  { return m_balloon.size() * BALLOON_BLOCK; }
+
+  /** Bytes reported free, and held from the heap until it needs them */
+  uint64_t reported_bytes() const noexcept
+  { return m_reported.size() * REPORT_SIZE; }
+
+  /** Give every reported block back to the heap */
+  void release_reported();
+
+  /** Constructor. @param pcidev an initialized PCI device. */
+  VirtioBalloon(hw::PCI_Device& pcidev);
+  ~VirtioBalloon();
+
+private:
+  struct balloon_config
+  {
+    uint32_t num_pages;
+    uint32_t actual;
+  };
+
+  struct [[gnu::packed]] balloon_stat
+  {
+    uint16_t tag;
+    uint64_t val;
+  };
+
+  static const int PFNS = BALLOON_BLOCK / PAGE_SIZE;
+  static const int MAX_REPORT = 16;
+  static const int STATS = 3;
+
+  void event_handler();
+  void msix_handler();
+  void handle_queues();
+  void tick(Timers::id_t);
+  void adjust();
+  void report();
+  void send_stats();
+  void update_actual();
+  size_t shrink(os::mem::Pressure);
+  size_t reserve() const noexcept;
+
+  Virtio::Queue inflate_q; // 0
+  Virtio::Queue deflate_q; // 1
+  Virtio::Queue stats_q;   // 2
+  Virtio::Queue report_q;  // 3
+
+  balloon_config m_config {};
+  bool m_reporting_enabled = false;
+  bool m_deflate_on_oom = false;
+
+  // blocks in the balloon, and the one on its way in or out
+  std::vector<void*> m_balloon;
+  void* m_inflating = nullptr;
+  void* m_deflating = nullptr;
+  std::array<uint32_t, PFNS> m_inflate_pfns;
+  std::array<uint32_t, PFNS> m_deflate_pfns;
+
+  // blocks with the host to report, and those reported
+  std::vector<void*> m_reporting;
+  std::vector<void*> m_reported;
+
+  std::array<balloon_stat, STATS> m_stats;
+
+  Timers::id_t m_timer = Timers::UNUSED_ID;
+  int m_shrinker = -1;
+  uint64_t& m_reported_stat;
+  uint64_t& m_reports;
+  const int m_index = 0;
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <kernel/events.hpp>
 #include <fs/common.hpp>
 #include <hw/pci.hpp>
+#include <algorithm>
 #include <cassert>
 #include <stdlib.h>
 
@@ -14,6 +15,7 @@
 #define VIRTIO_BLK_F_BLK_SIZE  6
 #define VIRTIO_BLK_F_SCSI      7
 #define VIRTIO_BLK_F_FLUSH     9
+#define VIRTIO_BLK_F_MQ        12
 
 #define VIRTIO_BLK_T_IN         0
 #define VIRTIO_BLK_T_OUT        1
@@ -27,13 +29,22 @@
 
 #define FEAT(x)  (1 << x)
 
+// the most sectors in one request, unless the device wants fewer
+static const uint32_t MAX_REQUEST_SECTORS = 256;
+
 // a deleter that does nothing
 void null_deleter(uint8_t*) {};
 
 #include <statman>
 
+VirtioBlk::Blk_queue::Blk_queue(VirtioBlk& dev, const int idx, const int cpu_id)
+  : req(dev.device_name() + ".req" + std::to_string(idx),
+        dev.queue_size(idx), idx, dev.iobase()),
+    cpu(cpu_id), index(idx)
+{}
+
 VirtioBlk::VirtioBlk(hw::PCI_Device& d)
-  : Virtio(d), hw::Block_device(), req(device_name() + ".req0", queue_size(0), 0, iobase()), inflight(0)
+  : Virtio(d), hw::Block_device(), m_pcidev(d)
 {
   INFO("VirtioBlk", "Initializing");
   {
@@ -46,11 +57,19 @@ VirtioBlk::VirtioBlk(hw::PCI_Device& d)
       Stat::UINT32, device_name() + ".errors");
     this->errors = &err.get_uint32();
     *this->errors = 0;
+
+    auto& mrg = Statman::get().create(
+      Stat::UINT32, device_name() + ".merged");
+    this->merged = &mrg.get_uint32();
+    *this->merged = 0;
   }
 
   uint32_t needed_features =
     FEAT(VIRTIO_BLK_F_BLK_SIZE);
-  negotiate_features(needed_features);
+  uint32_t wanted_features = needed_features
+    | (probe_features() & (FEAT(VIRTIO_BLK_F_SIZE_MAX) | FEAT(VIRTIO_BLK_F_MQ)));
+  negotiate_features(wanted_features | (probe_features() & RING_FEATURES));
+  const uint32_t negotiated = features() & wanted_features;
 
   CHECK(features() & FEAT(VIRTIO_BLK_F_BARRIER),
         "Barrier is enabled");
@@ -68,22 +87,37 @@ VirtioBlk::VirtioBlk(hw::PCI_Device& d)
         "SCSI is enabled :(");
   CHECK(features() & FEAT(VIRTIO_BLK_F_FLUSH),
         "Flush enabled");
+  CHECK(features() & FEAT(VIRTIO_BLK_F_MQ),
+        "Multiple queues");
 
   CHECK ((features() & needed_features) == needed_features,
          "Negotiated needed features");
 
-  // Step 1 - Initialize REQ queue
-  auto success = assign_queue(0, req.queue_desc());
-  CHECK(success, "Request queue assigned (%p) to device",
-        req.queue_desc());
+  // Get device configuration, including the number of queues
+  if (negotiated & FEAT(VIRTIO_BLK_F_MQ))
+    config_length = sizeof(virtio_blk_config_t);
+  get_config();
 
-  // Step 3 - Fill receive queue with buffers
-  // DEBUG: Disable
-  INFO("VirtioBlk", "Queue size: %i\tRequest size: %zu\n",
-       req.size(), sizeof(request_t));
+  // a request reads into one buffer, a single segment
+  max_sectors = MAX_REQUEST_SECTORS;
+  if ((negotiated & FEAT(VIRTIO_BLK_F_SIZE_MAX)) && config.size_max >= SECTOR_SIZE)
+    max_sectors = std::min<uint32_t>(max_sectors, config.size_max / SECTOR_SIZE);
 
-  // Get device configuration
-  get_config();
+  // Step 1 - Initialize REQ queues, a request is 3 tokens
+  const int num_queues = wanted_queues(negotiated);
+  for (int i = 0; i < num_queues; i++)
+  {
+    queues_.emplace_back(*this, i, SMP::cpu_id());
+    auto& q = queues_.back();
+    enable_ring_features(q.req, 3);
+    auto success = assign_queue(i, q.req.queue_desc());
+    CHECKSERT(success, "Request queue %d assigned (%p) to device",
+          i, q.req.queue_desc());
+  }
+  cpu_queue_.resize(SMP::early_cpu_total(), 0);
+
+  INFO("VirtioBlk", "Queues: %d\\tQueue size: %i\\tRequest size: %u sectors\\n",
+       num_queues, queues_.front().req.size(), max_sectors);
 
   // Signal setup complete.
   setup_complete((features() & needed_features) == needed_features);
@@ -92,25 +126,63 @@ VirtioBlk::VirtioBlk(hw::PCI_Device& d)
   // Hook up IRQ handler (inherited from Virtio)
   if (has_msix())
   {
-    assert(get_msix_vectors() >= 2);
+    assert(get_msix_vectors() >= num_queues + 1);
     auto& irqs = this->get_irqs();
-    // update IRQ subscriptions
-    Events::get().subscribe(irqs[0], {this, &VirtioBlk::service_RX});
-    Events::get().subscribe(irqs[1], {this, &VirtioBlk::msix_conf_handler});
+    bind_queue(0);
+    Events::get().subscribe(irqs[num_queues], {this, &VirtioBlk::msix_conf_handler});
+
+    // every other queue is serviced by its own CPU
+    for (int i = 1; i < num_queues; i++)
+    {
+      Events::get().unsubscribe(irqs[i]);
+      const int cpu = SMP::active_cpus().at(i - 1);
+      SMP::add_task([this, i] { this->bind_queue(i); }, cpu);
+      SMP::signal(cpu);
+    }
   }
   else
   {
     auto& irqs = this->get_irqs();
     Events::get().subscribe(irqs[0], {this, &VirtioBlk::irq_handler});
+    bind_queue(0);
   }
 
   // Done
   INFO("VirtioBlk", "Block device with %zu sectors capacity", config.capacity);
 }
 
+int VirtioBlk::wanted_queues(const uint32_t negotiated) const
+{
+  if (not (negotiated & FEAT(VIRTIO_BLK_F_MQ)) || not has_msix()) return 1;
+  // one queue per CPU, each with its own vector, and one for config changes
+  int queues = std::min<int>(config.num_queues, 1 + SMP::active_cpus().size());
+  queues = std::min(queues, get_msix_vectors() - 1);
+  return std::max(queues, 1);
+}
+
+void VirtioBlk::bind_queue(const int index)
+{
+  auto& q = queues_.at(index);
+  q.cpu = SMP::cpu_id();
+  cpu_queue_.at(q.cpu) = index;
+
+  if (has_msix())
+  {
+    auto& irqs = this->get_irqs();
+    irqs[index] = Events::get().subscribe([this, index] () {
+      this->service_queue(queues_[index]);
+    });
+    m_pcidev.rebalance_msix_vector(index, q.cpu, IRQ_BASE + irqs[index]);
+  }
+  // reads are merged until the CPU gets to this event
+  q.flush_event = Events::get().subscribe([this, index] () {
+    this->flush(queues_[index]);
+  });
+}
+
 void VirtioBlk::get_config()
 {
-  Virtio::get_config(&config, sizeof(virtio_blk_config_t));
+  Virtio::get_config(&config, config_length);
 }
 
 void VirtioBlk::msix_conf_handler()
@@ -130,8 +202,7 @@ void VirtioBlk::irq_handler() {
 
   // Step 2. A) - one of the queues have changed
   if (isr & 1) {
-    // This now means service RX & TX interchangeably
-    service_RX();
+    service_queue(queues_.front());
   }
 
   // Step 2. B)
@@ -145,143 +216,186 @@ void VirtioBlk::irq_handler() {
   }
 }
 
-void VirtioBlk::handle(request_t* hdr)
+void VirtioBlk::handle(request_t* vbr)
 {
-  // check request response
-  blk_resp_t& resp = hdr->resp;
-  // only call handler with data when the request was fullfilled
-  //printf("response: status %u blk %llu  func %p  buff %p\n",
-  //      resp.status, hdr->hdr.sector, resp.handler.get_ptr(), hdr->io.sector);
-
-  if (resp.status == 0) {
-    // packaged as buffer, but deleted as request
-    resp.handler(hdr->io.sector);
-  }
-  else {
-    // return empty shared ptr
-    resp.handler(nullptr);
-  }
+  const bool ok = vbr->status == VIRTIO_BLK_S_OK;
+  if (not ok) (*this->errors)++;
 
-  // delete request
-  delete hdr;
+  for (auto* job : vbr->jobs)
+  {
+    if (ok && vbr->merged != nullptr)
+    {
+      // copy the part of the merged request that belongs to this job
+      const block_t first = std::max(job->blk, vbr->hdr.sector);
+      const block_t last  = std::min(job->blk + job->cnt, vbr->hdr.sector + vbr->sectors);
+      memcpy(job->buf->data() + (first - job->blk) * SECTOR_SIZE,
+             vbr->data + (first - vbr->hdr.sector) * SECTOR_SIZE,
+             (last - first) * SECTOR_SIZE);
+    }
+    if (not ok) job->error = true;
+    // call the user-provided callback once all its requests are done
+    if (--job->left == 0)
+    {
+      if (job->error)
+        job->func(nullptr);
+      else
+        job->func(job->buf);
+      delete job;
+    }
+  }
+  delete vbr;
 }
 
-void VirtioBlk::service_RX()
+void VirtioBlk::service_queue(Blk_queue& q)
 {
-  req.disable_interrupts();
-  while (req.new_incoming())
+  std::vector<request_t*> received;
+  q.req.disable_interrupts();
+  while (q.req.new_incoming())
   {
-    auto tok = req.dequeue();
+    auto tok = q.req.dequeue();
     if (!tok.size()) break;
 
     // only handle the main header of each request
-    auto* hdr = (request_t*) tok.data();
-    received.emplace_back(hdr);
+    received.push_back((request_t*) tok.data());
   };
 
-  // if we have free space and jobs, start shipping
+  // if we have free space and waiting requests, start shipping
   bool shipped = false;
-  while (free_space() && !jobs.empty()) {
-    shipit(jobs.front());
-    jobs.pop_front();
+  while (free_space(q) && !q.waiting.empty()) {
+    shipit(q, q.waiting.front());
+    q.waiting.pop_front();
     shipped = true;
   }
-  if (shipped) req.kick();
-  req.enable_interrupts();
+  if (shipped) q.req.kick();
+  q.req.enable_interrupts();
 
-  int handled = 0;
-  for (request_t* hdr : received) {
-    handle(hdr);
-    inflight--; handled++;
+  for (request_t* vbr : received) {
+    q.inflight--;
+    handle(vbr);
   }
-  received.clear();
-
-  //printf("inflight: %d  handled: %d  shipped: %d  num_free: %u\n",
-  //    inflight, handled, scnt, req.num_free());
 }
 
-void VirtioBlk::shipit(request_t* vbr) {
-
+void VirtioBlk::shipit(Blk_queue& q, request_t* vbr)
+{
   Token token1 { { (uint8_t*) &vbr->hdr, sizeof(scsi_header_t) }, Token::OUT };
-  Token token2 { { (uint8_t*) &vbr->io, sizeof(blk_io_t) }, Token::IN };
-  Token token3 { { (uint8_t*) &vbr->resp, 1 }, Token::IN }; // 1 status byte
+  Token token2 { { vbr->data, vbr->sectors * SECTOR_SIZE }, Token::IN };
+  Token token3 { { (uint8_t*) &vbr->status, 1 }, Token::IN }; // 1 status byte
 
-  //printf("shipping job: sect %llu  func %p  buff %p\n",
-  //      vbr->hdr.sector, vbr->resp.handler.get_ptr(), vbr->io.sector);
   std::array<Token, 3> tokens {{ token1, token2, token3 }};
-  req.enqueue(tokens);
-  inflight++;
+  q.req.enqueue(tokens);
+  q.inflight++;
   (*this->requests)++;
 }
 
-void VirtioBlk::read (block_t blk, size_t cnt, on_read_func func)
+void VirtioBlk::flush(Blk_queue& q)
 {
-  // create big buffer for collecting all the disk data
-  auto bigbuf = fs::construct_buffer(block_size() * cnt);
-  // number of reads left
-  auto results = std::make_shared<size_t> (cnt);
-  bool shipped = false;
-  //printf("virtioblk: Enqueue blk %llu cnt %u\n", blk, cnt);
+  std::vector<read_job_t*> jobs;
+  q.pending_lock.lock();
+  jobs.swap(q.pending);
+  q.flush_scheduled = false;
+  q.pending_lock.unlock();
+  if (jobs.empty()) return;
+
+  // in disk order, so that neighbours can share a request
+  std::stable_sort(jobs.begin(), jobs.end(),
+  [] (const read_job_t* a, const read_job_t* b) {
+    return a->blk < b->blk;
+  });
+
+  std::vector<request_t*> reqs;
+  request_t* open = nullptr;
+  for (auto* job : jobs)
+  {
+    const block_t end = job->blk + job->cnt;
+    // adjacent (or overlapping) reads are merged, up to the request limit
+    if (open != nullptr && job->cnt <= max_sectors)
+    {
+      const block_t first = open->hdr.sector;
+      const block_t last  = std::max<block_t>(first + open->sectors, end);
+      if (job->blk <= first + open->sectors && last - first <= max_sectors)
+      {
+        open->sectors = last - first;
+        open->jobs.push_back(job);
+        job->left++;
+        (*this->merged)++;
+        continue;
+      }
+    }
+    // reads that are too big are split, straight into the job buffer
+    for (block_t blk = job->blk; blk < end; blk += max_sectors)
+    {
+      auto* vbr = new request_t(blk, std::min<block_t>(max_sectors, end - blk));
+      vbr->jobs.push_back(job);
+      job->left++;
+      reqs.push_back(vbr);
+    }
+    open = (job->cnt <= max_sectors) ? reqs.back() : nullptr;
+  }
 
-  //for (int i = cnt-1; i >= 0; i--)
-  for (size_t i = 0; i < cnt; i++)
+  bool shipped = false;
+  for (auto* vbr : reqs)
   {
-    // create a special request where we collect all the data
-    auto* vbr = new request_t(
-      blk + i,
-      request_handler_t::make_packed(
-      [this, i, func, results, bigbuf] (uint8_t* data) {
-        // if the job was already completed, return early
-        if (*results == 0) {
-          printf("[virtioblk] Job cancelled? results == 0,  blk=%zu\n", i);
-          return;
-        }
-        // validate partial result
-        if (data != nullptr) {
-          *results -= 1;
-          // copy partial block
-          memcpy(bigbuf->data() + i * block_size(), data, block_size());
-          // check if we have all blocks
-          if (*results == 0) {
-            // finally, call user-provided callback
-            func(bigbuf);
-          }
-        }
-        else {
-          (*this->errors)++;
-          // if the partial result failed, cancel all
-          *results = 0;
-          // callback with no data
-          func(nullptr);
-        }
-      })
-    );
-    //printf("virtioblk: Enqueue blk %llu\n", blk + i);
-    //
-    if (free_space()) {
-      shipit(vbr);
+    if (vbr->jobs.size() > 1) {
+      vbr->merged.reset(new uint8_t[vbr->sectors * SECTOR_SIZE]);
+      vbr->data = vbr->merged.get();
+    }
+    else {
+      auto* job = vbr->jobs.front();
+      vbr->data = job->buf->data() + (vbr->hdr.sector - job->blk) * SECTOR_SIZE;
+    }
+
+    if (q.waiting.empty() && free_space(q)) {
+      shipit(q, vbr);
       shipped = true;
     }
     else
-      jobs.push_back(vbr);
+      q.waiting.push_back(vbr);
+  }
+  // kick once for all of them
+  if (shipped) q.req.kick();
+}
+
+void VirtioBlk::read (block_t blk, size_t cnt, on_read_func func)
+{
+  if (cnt == 0) {
+    func(fs::construct_buffer(0));
+    return;
+  }
+  auto* job = new read_job_t{blk, cnt, fs::construct_buffer(block_size() * cnt),
+                             std::move(func)};
+
+  // reads are queued until the CPU owning the queue gets to them,
+  // so that those made in the meantime can be merged
+  auto& q = local_queue();
+  q.pending_lock.lock();
+  q.pending.push_back(job);
+  const bool schedule = not q.flush_scheduled;
+  q.flush_scheduled = true;
+  q.pending_lock.unlock();
+  if (not schedule) return;
+
+  if (q.cpu == SMP::cpu_id())
+    Events::get().trigger_event(q.flush_event);
+  else {
+    // a CPU without a queue of its own
+    while (not Events::get(q.cpu).post({[this, &q] { this->flush(q); }}))
+      __arch_hw_barrier();
   }
-  // kick when we have enqueued stuff
-  if (shipped) req.kick();
 }
 
-VirtioBlk::request_t::request_t(uint64_t blk, request_handler_t cb)
+VirtioBlk::request_t::request_t(uint64_t blk, uint32_t cnt)
+  : status(VIRTIO_BLK_S_IOERR), sectors(cnt), data(nullptr)
 {
   hdr.type   = VIRTIO_BLK_T_IN;
   hdr.ioprio = 0; // reserved
   hdr.sector = blk;
-  resp.status  = VIRTIO_BLK_S_IOERR;
-  resp.handler = cb;
 }
 
 void VirtioBlk::deactivate()
 {
   /// disable interrupts on virtio queues
-  req.disable_interrupts();
+  for (auto& q : queues_)
+    q.req.disable_interrupts();
 
   /// reset device
   this->Virtio::reset();
@@ -7,7 +7,12 @@
 #include <hw/block_device.hpp>
 #include <hw/pci_device.hpp>
 #include <virtio/virtio.hpp>
+#include <smp>
+#include <smp_utils>
+#include <cstddef>
 #include <deque>
+#include <memory>
+#include <vector>
 
 /** Virtio-net device driver.  */
 class VirtioBlk : public Virtio, public hw::Block_device
@@ -69,6 +74,9 @@ private:
     uint8_t alignment_offset;    // Alignment offset in logical blocks
     uint16_t min_io_size;        // Minimum I/O size without performance penalty in logical blocks
     uint32_t opt_io_size;        // Optimal sustained I/O size in logical blocks
+    uint8_t  writeback;
+    uint8_t  unused0;
+    uint16_t num_queues;         // Only with VIRTIO_BLK_F_MQ
   };
 
   struct scsi_header_t
@@ -77,37 +85,62 @@ private:
     uint32_t ioprio;
     uint64_t sector;
   };
-  struct blk_io_t
-  {
-    uint8_t      sector[512];
-  };
-  typedef delegate<void(uint8_t*)> request_handler_t;
-  struct blk_resp_t
+
+  // a read() waiting for the requests that read its sectors
+  struct read_job_t
   {
-    uint8_t           status;
-    request_handler_t handler;
+    block_t      blk;
+    size_t       cnt;
+    buffer_t     buf;
+    on_read_func func;
+    uint32_t     left  = 0; // requests not done yet
+    bool         error = false;
   };
 
+  // one request to the device, for a range of sectors of one or more jobs
   struct request_t
   {
     scsi_header_t hdr;
-    blk_io_t      io;
-    blk_resp_t    resp;
+    uint8_t       status;
+    uint32_t      sectors;
+    uint8_t*      data; // where the device puts the sectors
+    // only when shared by jobs, otherwise the sectors go straight to the job
+    std::unique_ptr<uint8_t[]> merged;
+    std::vector<read_job_t*>   jobs;
+
+    request_t(uint64_t blk, uint32_t cnt);
+  };
 
-    request_t(uint64_t blk, request_handler_t cb);
+  /** One request virtqueue, owned and serviced by a single CPU */
+  struct alignas(SMP_ALIGN) Blk_queue
+  {
+    Blk_queue(VirtioBlk&, int index, int cpu);
+    Blk_queue(Blk_queue&&) = delete;
+
+    Virtio::Queue req;
+    int    cpu;
+    int    index;
+    size_t inflight = 0;
+    // reads to be merged into requests, from any CPU
+    std::vector<read_job_t*> pending;
+    smp_spinlock pending_lock;
+    bool   flush_scheduled = false;
+    uint8_t flush_event = 0;
+    // requests waiting for room in the ring
+    std::deque<request_t*> waiting;
   };
 
   /** Get virtio PCI config. @see Virtio::get_config.*/
   void get_config();
 
-  /** Service the RX Queue.
-      Push incoming data up to linklayer, dequeue RX buffers. */
-  void service_RX();
+  /** Number of request queues to use, one per CPU when possible */
+  int wanted_queues(uint32_t negotiated) const;
 
-  /** Service the TX Queue
-      Dequeue used TX buffers. @note: This function does not take any
-      responsibility for memory management. */
-  void service_TX();
+  /** Subscribe to the IRQ and flush event of a queue on this CPU */
+  void bind_queue(int index);
+
+  /** Service a request queue, completing finished requests */
+  void service_queue(Blk_queue&);
 
   /** Handle device IRQ.
 
@@ -117,33 +150,39 @@ private:
   void msix_conf_handler();
 
   // need at least 3 tokens free to ship a request
-  inline bool free_space() const noexcept
-  { return req.num_free() >= 3; }
+  static bool free_space(const Blk_queue& q) noexcept
+  { return q.req.num_free_chains(3) >= 1; }
 
-  // need many free tokens free to efficiently ship requests
-  inline bool lots_free_space() const noexcept
-  { return req.num_free() >= 32; }
+  // merge the pending reads into requests, and ship them with one kick
+  void flush(Blk_queue&);
 
-  // add one request to queue and kick
-  void shipit(request_t*);
+  // add one request to queue, without kicking
+  void shipit(Blk_queue&, request_t*);
 
   void handle(request_t*);
 
-  Virtio::Queue req;
+  Blk_queue& local_queue() noexcept {
+    const size_t cpu = SMP::cpu_id();
+    return queues_[(cpu < cpu_queue_.size()) ? cpu_queue_[cpu] : 0];
+  }
+
+  hw::PCI_Device& m_pcidev;
 
   // configuration as read from paravirtual PCI device
   virtio_blk_config_t config;
+  uint32_t config_length = offsetof(virtio_blk_config_t, writeback);
+  // the most sectors read with a single request
+  uint32_t max_sectors;
 
-  // queue waiting for space in vring
-  std::deque<request_t*> jobs;
-  size_t    inflight;
-
-  // stack of dequeued requests to be processed
-  std::vector<request_t*> received;
+  // Virtio::Queue is not movable, a deque never relocates its elements
+  std::deque<Blk_queue> queues_;
+  // CPU id -> index of the queue serviced by that CPU
+  std::vector<uint8_t>  cpu_queue_;
 
   // stat counters
   uint32_t* errors;
   uint32_t* requests;
+  uint32_t* merged;
 };
 
 #endif
@@ -1,6 +1,8 @@
 #include "virtiocon.hpp"
 #include <kernel/events.hpp>
 #include <hw/pci.hpp>
+#include <statman>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -26,7 +28,10 @@
 
 static int index_counter = 0;
 VirtioCon::VirtioCon(hw::PCI_Device& d)
-: Virtio(d), m_index(index_counter)
+: Virtio(d),
+  m_dropped(Statman::get().create(Stat::UINT64,
+            "virtiocon" + std::to_string(index_counter) + ".stat_tx_dropped_bytes").get_uint64()),
+  m_index(index_counter)
 {
   index_counter++;
   INFO("VirtioCon", "Driver initializing");
@@ -38,7 +43,8 @@ VirtioCon::VirtioCon(hw::PCI_Device& d)
 
   const uint32_t needed_features =
         FEAT(VIRTIO_CONSOLE_F_MULTIPORT);
-  negotiate_features(needed_features);
+  negotiate_features(needed_features
+                     | (probe_features() & (1 << VIRTIO_F_RING_EVENT_IDX)));
 
   CHECK(features() & FEAT(VIRTIO_CONSOLE_F_SIZE),
         "Valid console dimensions");
@@ -50,7 +56,10 @@ VirtioCon::VirtioCon(hw::PCI_Device& d)
   CHECK ((features() & needed_features) == needed_features,
          "Negotiated needed features");
 
-  // Step 1 - Initialize queues
+  // Step 1 - Initialize queues, console writes are single tokens
+  enable_ring_features(rx, 0);
+  enable_ring_features(tx, 0);
+
   auto success = assign_queue(0, rx.queue_desc());
   CHECK(success, "Receive queue assigned (%p) to device",
         rx.queue_desc());
@@ -142,17 +151,133 @@ void VirtioCon::msix_recv_handler()
 void VirtioCon::msix_xmit_handler()
 {
   tx.disable_interrupts();
+  reclaim();
+  tx.enable_interrupts();
+}
 
+void VirtioCon::reclaim()
+{
   while (tx.new_incoming())
   {
     auto res = tx.dequeue();
-    free(res.data());
+    auto* first = (Page*) res.data();
+    if (m_pages != nullptr && first >= &m_pages[0] && first < &m_pages[m_npages])
+    {
+      // pages may come back out of order, but are reused in order
+      const uint32_t idx = first - &m_pages[0];
+      m_chain[idx] |= 0x8000;
+    }
+    else {
+      delete[] res.data();
+    }
+  }
+  while (m_tail != m_sent and (m_chain[m_tail % m_npages] & 0x8000))
+  {
+    const uint32_t idx = m_tail % m_npages;
+    m_tail += m_chain[idx] & 0x7fff;
+    m_chain[idx] = 0;
+  }
+  // there are descriptors again for what is waiting
+  if (m_sent != m_head) submit();
+}
+
+void VirtioCon::enable_buffering(int pages, std::chrono::milliseconds flush_interval)
+{
+  Expects(pages > 0 and pages < 0x8000);
+  Expects(m_pages == nullptr);
+  m_pages.reset(new Page[pages]);
+  m_len.assign(pages, 0);
+  m_chain.assign(pages, 0);
+  m_npages = pages;
+  m_flush_interval = flush_interval;
+}
+
+void VirtioCon::submit()
+{
+  bool added = false;
+  std::array<Token, MAX_CHAIN> tokens;
+  while (m_sent != m_head)
+  {
+    const int count = std::min<uint32_t>({m_head - m_sent, MAX_CHAIN, tx.num_free()});
+    if (count == 0) break;
+    for (int i = 0; i < count; i++) {
+      const uint32_t idx = (m_sent + i) % m_npages;
+      tokens[i] = Token{{ m_pages[idx].data, m_len[idx] }, Token::OUT};
+    }
+    tx.enqueue({tokens.data(), (size_t) count});
+    m_chain[m_sent % m_npages] = count;
+    m_sent += count;
+    added = true;
+  }
+  if (added) tx.kick();
+}
+
+void VirtioCon::flush()
+{
+  if (m_flush_timer != Timers::UNUSED_ID) {
+    Timers::stop(m_flush_timer);
+    m_flush_timer = Timers::UNUSED_ID;
+  }
+  if (m_pages == nullptr) return;
+  // close the page being filled
+  if (m_head - m_tail < m_npages and m_len[m_head % m_npages] > 0) {
+    m_head++;
+    m_len[m_head % m_npages] = 0;
+  }
+  submit();
+}
+
+void VirtioCon::flush_timeout(Timers::id_t)
+{
+  m_flush_timer = Timers::UNUSED_ID;
+  flush();
+}
+
+void VirtioCon::write_buffered(const uint8_t* data, size_t len)
+{
+  while (len > 0)
+  {
+    if (m_head - m_tail == m_npages)
+    {
+      reclaim();
+      if (m_head - m_tail == m_npages) {
+        // never wait for the host here
+        m_dropped += len;
+        break;
+      }
+    }
+    const uint32_t idx = m_head % m_npages;
+    const size_t count = std::min(len, PAGE - m_len[idx]);
+    memcpy(m_pages[idx].data + m_len[idx], data, count);
+    m_len[idx] += count;
+    data += count;
+    len  -= count;
+
+    if (m_len[idx] == PAGE) {
+      m_head++;
+      m_len[m_head % m_npages] = 0;
+      submit();
+    }
+  }
+  // the new page may be one just reclaimed
+  if (m_head - m_tail < m_npages and m_len[m_head % m_npages] > 0
+      and m_flush_timer == Timers::UNUSED_ID)
+  {
+    m_flush_timer = Timers::oneshot(m_flush_interval, {this, &VirtioCon::flush_timeout});
   }
-  tx.enable_interrupts();
 }
 
 void VirtioCon::write(const void* data, size_t len)
 {
+  if (m_pages != nullptr) {
+    write_buffered((const uint8_t*) data, len);
+    return;
+  }
+  if (tx.num_free() == 0) reclaim();
+  if (tx.num_free() == 0) {
+    m_dropped += len;
+    return;
+  }
   uint8_t* heapdata = new uint8_t[len];
   memcpy(heapdata, data, len);
 
@@ -6,7 +6,11 @@
 #include <common>
 #include <delegate>
 #include <hw/pci_device.hpp>
+#include <kernel/timers.hpp>
 #include <virtio/virtio.hpp>
+#include <chrono>
+#include <memory>
+#include <vector>
 
 /**
  * http://docs.oasis-open.org/virtio/virtio/v1.0/csprd05/virtio-v1.0-csprd05.html#x1-2180003
@@ -46,6 +50,23 @@ public:
 
   void write (const void* data, size_t len);
 
+  /**
+   * Buffered output: writes are copied into a ring of @pages preallocated
+   * pages, and handed to the device as one chain with a single kick when
+   * a page fills up, or @flush_interval after the first unsent write.
+   * When the ring is full the write is dropped (and counted) instead of
+   * waiting for the host.
+   */
+  void enable_buffering(int pages = 16,
+                        std::chrono::milliseconds flush_interval = std::chrono::milliseconds(5));
+
+  /** Hand everything buffered to the device now */
+  void flush();
+
+  /** Bytes dropped since the ring or the queue was full */
+  uint64_t dropped_bytes() const noexcept
+  { return m_dropped; }
+
   /** Constructor. @param pcidev an initialized PCI device. */
   VirtioCon(hw::PCI_Device& pcidev);
 
@@ -78,6 +99,30 @@ private:
   void msix_recv_handler();
   void msix_xmit_handler();
 
+  void write_buffered(const uint8_t* data, size_t len);
+  void submit();
+  void reclaim();
+  void flush_timeout(Timers::id_t);
+
+  static const size_t PAGE = 4096;
+  // pages in one descriptor chain
+  static const int MAX_CHAIN = 16;
+  struct alignas(PAGE) Page {
+    uint8_t data[PAGE];
+  };
+  // pages [tail, sent) are with the device, [sent, head) are full and
+  // waiting for descriptors, and head is being filled, unless the ring is full
+  std::unique_ptr<Page[]> m_pages;
+  std::vector<uint16_t>   m_len;
+  std::vector<uint16_t>   m_chain; // chain length, by first page, when used
+  uint32_t m_npages = 0;
+  uint32_t m_tail = 0;
+  uint32_t m_sent = 0;
+  uint32_t m_head = 0;
+  std::chrono::milliseconds m_flush_interval {5};
+  Timers::id_t m_flush_timer = Timers::UNUSED_ID;
+  uint64_t& m_dropped;
+
   Virtio::Queue rx;     // 0
   Virtio::Queue tx;     // 1
   Virtio::Queue ctl_rx; // 2
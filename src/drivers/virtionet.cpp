@@ -33,10 +33,13 @@ struct alignas(SMP_ALIGN) smp_deferred_kick
 {
   std::vector<VirtioNet*> devs;
   uint8_t irq;
+  bool    initialized = false;
 };
 static std::vector<smp_deferred_kick> deferred_devs;
 SMP_RESIZE_LATE_GCTOR(deferred_devs);
 #endif
+#include <hal/machine.hpp>
+#include <net/checksum.hpp>
 
 using namespace net;
 
@@ -45,10 +48,31 @@ void VirtioNet::get_config() {
 }
 #define VNET_TOT_BUFFERS() (48 + (queue_size(0) + queue_size(1)) / 2)
 
-VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
+static std::string queue_name(const std::string& dev, const char* q, int index)
+{
+  // the first pair keeps the single-queue names
+  return dev + q + ((index > 0) ? std::to_string(index) : "");
+}
+
+// RX queue of pair N is 2N, TX queue is 2N+1 - Virtio Std. §5.1.2
+VirtioNet::Queue_pair::Queue_pair(VirtioNet& dev, const int index, const int cpu)
+  : rx_q(queue_name(dev.device_name(), ".rx_q", index),
+         dev.queue_size(2 * index), 2 * index, dev.iobase()),
+    tx_q(queue_name(dev.device_name(), ".tx_q", index),
+         dev.queue_size(2 * index + 1), 2 * index + 1, dev.iobase()),
+    poller({[&dev, this] (int budget) { return dev.receive(*this, budget); }},
+           {[this] () {
+             rx_q.enable_interrupts();
+             return rx_q.new_incoming() > 0;
+           }}),
+    cpu(cpu)
+{}
+
+VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t mtu)
   : Virtio(d),
     Link(Link_protocol{{this, &VirtioNet::transmit}, mac()}),
     m_pcidev(d),
+    mtu_(mtu),
     bufstore_{VNET_TOT_BUFFERS(), 2048 /* half-page buffers */},
 
     stat_sendq_max_{Statman::get().create(Stat::UINT64,
@@ -75,10 +99,31 @@ VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
   uint32_t needed_features = 0
     | (1 << VIRTIO_NET_F_MAC)
     | (1 << VIRTIO_NET_F_STATUS)
-    ;//| (1 << VIRTIO_NET_F_MRG_RXBUF); //Merge RX Buffers (Everything i 1 buffer)
-  uint32_t wanted_features = needed_features;
+    ;
+  uint32_t wanted_features = needed_features
+    | (1 << VIRTIO_NET_F_CTRL_VQ)
+    | (1 << VIRTIO_NET_F_MQ);
+  // Large receive (host-side LRO/GRO) requires buffers of 64kb, unless
+  // they can be merged, so only ask for it with mergeable RX buffers
+  const uint32_t host_features = probe_features();
+  if (host_features & (1 << VIRTIO_NET_F_MRG_RXBUF))
+  {
+    wanted_features |= (1 << VIRTIO_NET_F_MRG_RXBUF);
+    // guest TSO depends on guest checksum offloading, Virtio Std. §5.1.3.1
+    if (host_features & (1 << VIRTIO_NET_F_GUEST_CSUM))
+      wanted_features |= (1 << VIRTIO_NET_F_GUEST_CSUM)
+                       | (host_features & (1 << VIRTIO_NET_F_GUEST_TSO4))
+                       | (host_features & (1 << VIRTIO_NET_F_GUEST_TSO6));
+  }
+  // one ring slot per packet, and fewer kicks and interrupts
+  wanted_features |= host_features & RING_FEATURES;
+  // TX checksum offloading, which host TSO depends on
+  if (host_features & (1 << VIRTIO_NET_F_CSUM))
+    wanted_features |= (1 << VIRTIO_NET_F_CSUM)
+                     | (host_features & (1 << VIRTIO_NET_F_HOST_TSO4));
   negotiate_features(wanted_features);
-
+  // features() are the host features, this is what we both agreed on
+  const uint32_t negotiated = features() & wanted_features;
 
   CHECK ((features() & needed_features) == needed_features,
          "Negotiated needed features");
@@ -107,56 +152,91 @@ VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
   CHECK(features() & (1 << VIRTIO_NET_F_MQ),
         "There are multiple queue pairs");
 
-  if (features() & (1 << VIRTIO_NET_F_MQ))
-    printf("\t\t* max_virtqueue_pairs: 0x%x \n",_conf.max_virtq_pairs);
-
   CHECK(features() & (1 << VIRTIO_NET_F_MRG_RXBUF),
         "Merge RX buffers");
 
+  CHECK(negotiated & (1 << VIRTIO_NET_F_GUEST_TSO4),
+        "Guest can receive TSOv4");
+
+  CHECK(negotiated & (1 << VIRTIO_NET_F_HOST_TSO4),
+        "Device can segment TSOv4");
+
+  if (negotiated & (1 << VIRTIO_NET_F_CSUM))
+    this->offloads_ |= TX_CSUM_IP4;
+  if (negotiated & (1 << VIRTIO_NET_F_HOST_TSO4))
+    this->offloads_ |= TSO_IP4;
+
+  // the header has room for num_buffers when RX buffers are mergeable,
+  // in both directions, Virtio Std. §5.1.6.1
+  this->mrg_rxbuf_ = negotiated & (1 << VIRTIO_NET_F_MRG_RXBUF);
+  this->hdr_len_   = (mrg_rxbuf_) ? sizeof(virtio_net_hdr_mrg)
+                                  : sizeof(virtio_net_hdr);
+  // without merging, a frame has to fit in one RX buffer
+  if (not mrg_rxbuf_ and mtu_ > 1500) {
+    INFO("VirtioNet", "MTU %u needs mergeable RX buffers, using 1500", mtu_);
+    this->mtu_ = 1500;
+  }
+  // buffers are always half a page, larger frames are sent as segments
+  this->offloads_ |= TX_SEGMENTS;
 
-  /** RX que is 0, TX Queue is 1 - Virtio Std. §5.1.2  */
-  new (&rx_q) Virtio::Queue(device_name() + ".rx_q", queue_size(0),0,iobase());
-  new (&tx_q) Virtio::Queue(device_name() + ".tx_q", queue_size(1),1,iobase());
-  new (&ctrl_q) Virtio::Queue(device_name() + ".ctl_q", queue_size(2),2,iobase());
+  // Set config length, based on whether there are multiple queues
+  if (negotiated & (1 << VIRTIO_NET_F_MQ))
+    _config_length = sizeof(config);
+  else
+    _config_length = sizeof(config) - sizeof(uint16_t);
 
-  // Step 1 - Initialize RX/TX queues
-  auto success = assign_queue(0, rx_q.queue_desc());
-  CHECKSERT(success, "RX queue (%u) assigned (%p) to device",
-        rx_q.size(), rx_q.queue_desc());
+  // Getting the MAC + status (+ max queue pairs)
+  get_config();
+
+  if (negotiated & (1 << VIRTIO_NET_F_MQ))
+    printf("\t\t* max_virtqueue_pairs: 0x%x \n",_conf.max_virtq_pairs);
 
-  success = assign_queue(1, tx_q.queue_desc());
-  CHECKSERT(success, "TX queue (%u) assigned (%p) to device",
-        tx_q.size(), tx_q.queue_desc());
+  // Step 1 - Initialize RX/TX queue pairs, pair 0 always on this CPU
+  const int num_pairs = wanted_queue_pairs(negotiated);
+  for (int i = 0; i < num_pairs; i++)
+  {
+    pairs_.emplace_back(*this, i, SMP::cpu_id());
+    auto& pair = pairs_.back();
+    // TX packets are a header and a token per packet buffer
+    enable_ring_features(pair.rx_q, 0);
+    enable_ring_features(pair.tx_q, TX_MAX_TOKENS);
+
+    auto success = assign_queue(2 * i, pair.rx_q.queue_desc());
+    CHECKSERT(success, "RX queue %d (%u) assigned (%p) to device",
+          i, pair.rx_q.size(), pair.rx_q.queue_desc());
+
+    success = assign_queue(2 * i + 1, pair.tx_q.queue_desc());
+    CHECKSERT(success, "TX queue %d (%u) assigned (%p) to device",
+          i, pair.tx_q.size(), pair.tx_q.queue_desc());
+  }
+  cpu_pair_.resize(SMP::early_cpu_total(), 0);
 
   // Step 2 - Initialize Ctrl-queue if it exists
-  if (features() & (1 << VIRTIO_NET_F_CTRL_VQ)) {
-    success = assign_queue(2, tx_q.queue_desc());
+  // It comes after all the queue pairs the device has, Virtio Std. §5.1.2
+  if (negotiated & (1 << VIRTIO_NET_F_CTRL_VQ))
+  {
+    const int ctrl_index = (negotiated & (1 << VIRTIO_NET_F_MQ))
+                         ? 2 * _conf.max_virtq_pairs : 2;
+    new (&ctrl_q) Virtio::Queue(device_name() + ".ctl_q",
+                                queue_size(ctrl_index), ctrl_index, iobase());
+    // notify on the vector following our queue pairs
+    auto success = assign_queue(ctrl_index, ctrl_q.queue_desc(), 2 * num_pairs);
     CHECKSERT(success, "CTRL queue (%u) assigned (%p) to device",
           ctrl_q.size(), ctrl_q.queue_desc());
+    ctrl_enabled_ = true;
   }
 
-  // Step 3 - Fill receive queue with buffers
-  // DEBUG: Disable
-  INFO("VirtioNet", "Adding %u receive buffers of size %u",
-       rx_q.size() / 2, (uint32_t) bufstore().bufsize());
+  // Step 3 - Fill receive queues with buffers
+  for (auto& pair : pairs_)
+  {
+    INFO("VirtioNet", "Adding %u receive buffers of size %u",
+         pair.rx_q.size() / 2, (uint32_t) bufstore().bufsize());
 
-  for (int i = 0; i < rx_q.size() / 2; i++) {
-      add_receive_buffer(bufstore().get_buffer());
+    for (int i = 0; i < pair.rx_q.size() / 2; i++) {
+        add_receive_buffer(pair, bufstore().get_buffer());
+    }
   }
 
-  // Step 4 - If there are many queues, we should negotiate the number.
-  // Set config length, based on whether there are multiple queues
-  if (features() & (1 << VIRTIO_NET_F_MQ))
-    _config_length = sizeof(config);
-  else
-    _config_length = sizeof(config) - sizeof(uint16_t);
-  // @todo: Specify how many queues we're going to use.
-
-  // Step 5 - get the mac address (we're demanding this feature)
-  // Step 6 - get the status - demanding this as well.
-  // Getting the MAC + status
-  get_config();
-
   CHECK(_conf.mac.major > 0, "Valid Mac address: %s",
         _conf.mac.str().c_str());
 
@@ -167,38 +247,120 @@ VirtioNet::VirtioNet(hw::PCI_Device& d, const uint16_t /*mtu*/)
   setup_complete((features() & needed_features) == needed_features);
   CHECK((features() & needed_features) == needed_features, "Signalled driver OK");
 
+  // Step 4 - If there are many queues, tell the device how many we use
+  if (num_pairs > 1) {
+    const bool mq_ok = ctrl_set_queue_pairs(num_pairs);
+    CHECK(mq_ok, "Using %d RX/TX queue pairs", num_pairs);
+  }
+
   // Hook up interrupts
   if (has_msix())
   {
-    assert(get_msix_vectors() >= 3);
+    assert(get_msix_vectors() >= 2 * num_pairs + 1);
     auto& irqs = this->get_irqs();
     // update BSP IDT
-    Events::get().subscribe(irqs[0], {this, &VirtioNet::msix_recv_handler});
-    Events::get().subscribe(irqs[1], {this, &VirtioNet::msix_xmit_handler});
-    Events::get().subscribe(irqs[2], {this, &VirtioNet::msix_conf_handler});
+    bind_queue_pair(0);
+    Events::get().subscribe(irqs[2 * num_pairs], {this, &VirtioNet::msix_conf_handler});
+
+    // every other pair is serviced by its own CPU
+    for (int i = 1; i < num_pairs; i++)
+    {
+      Events::get().unsubscribe(irqs[2 * i]);
+      Events::get().unsubscribe(irqs[2 * i + 1]);
+      const int cpu = SMP::active_cpus().at(i - 1);
+      SMP::add_task([this, i] { this->bind_queue_pair(i); }, cpu);
+      SMP::signal(cpu);
+    }
   }
   else
   {
     auto irq = Virtio::get_legacy_irq();
     Events::get().subscribe(irq, {this, &VirtioNet::legacy_handler});
-  }
-
 #ifndef NO_DEFERRED_KICK
-  static bool init_deferred = false;
-  if (!init_deferred) {
-    init_deferred = true;
-    auto defirq = Events::get().subscribe(handle_deferred_devices);
-    PER_CPU(deferred_devs).irq = defirq;
-  }
+    bind_queue_pair(0);
 #endif
+  }
 
   CHECK(this->link_up(), "Link up");
   // Done
   if (this->link_up()) {
-    rx_q.kick();
+    for (auto& pair : pairs_) pair.rx_q.kick();
   }
 }
 
+int VirtioNet::wanted_queue_pairs(const uint32_t negotiated) const
+{
+  const uint32_t MQ = (1 << VIRTIO_NET_F_MQ) | (1 << VIRTIO_NET_F_CTRL_VQ);
+  if ((negotiated & MQ) != MQ || not has_msix()) return 1;
+
+  // one pair per CPU, each pair needs an RX and a TX vector,
+  // and the last vector we need is for the control queue
+  int max_pairs = std::min<int>(_conf.max_virtq_pairs, 1 + SMP::active_cpus().size());
+  max_pairs = std::min(max_pairs, (get_msix_vectors() - 1) / 2);
+  if (max_pairs <= 1) return 1;
+
+  const int idx = os::machine().next_index<hw::Nic>();
+  const int pairs = hw::Nic::queue_pairs_override(idx, max_pairs);
+  return std::max(1, std::min(pairs, max_pairs));
+}
+
+bool VirtioNet::ctrl_set_queue_pairs(const uint16_t pairs)
+{
+  struct {
+    uint8_t  cls;
+    uint8_t  cmd;
+    uint16_t virtqueue_pairs;
+  } __attribute__((packed)) command { VIRTIO_NET_CTRL_MQ,
+                                      VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, pairs };
+  volatile uint8_t ack = VIRTIO_NET_ERR;
+
+  Token token1 {{ (uint8_t*) &command, 2 }, Token::OUT };
+  Token token2 {{ (uint8_t*) &command.virtqueue_pairs, 2 }, Token::OUT };
+  Token token3 {{ (uint8_t*) &ack, 1 }, Token::IN };
+  std::array<Token, 3> tokens {{ token1, token2, token3 }};
+
+  ctrl_q.disable_interrupts();
+  ctrl_q.enqueue(tokens);
+  ctrl_q.kick();
+  // the device processes control commands synchronously with the kick,
+  // so this is just a bounded wait for the used ring to catch up
+  for (int i = 0; i < 1000000 && not ctrl_q.new_incoming(); i++)
+    __arch_hw_barrier();
+  if (not ctrl_q.new_incoming()) return false;
+  ctrl_q.dequeue();
+  return ack == VIRTIO_NET_OK;
+}
+
+void VirtioNet::bind_queue_pair(const int index)
+{
+  auto& pair = pairs_.at(index);
+  pair.cpu = SMP::cpu_id();
+  cpu_pair_.at(pair.cpu) = index;
+
+  if (has_msix())
+  {
+    auto& irqs = this->get_irqs();
+    irqs[2 * index]     = Events::get().subscribe([this, index] () {
+      this->msix_recv_handler(pairs_[index]);
+    });
+    irqs[2 * index + 1] = Events::get().subscribe([this, index] () {
+      this->msix_xmit_handler(pairs_[index]);
+    });
+    m_pcidev.rebalance_msix_vector(2 * index, pair.cpu, IRQ_BASE + irqs[2 * index]);
+    m_pcidev.rebalance_msix_vector(2 * index + 1, pair.cpu, IRQ_BASE + irqs[2 * index + 1]);
+  }
+
+#ifndef NO_DEFERRED_KICK
+  auto& deferred = PER_CPU(deferred_devs);
+  if (!deferred.initialized) {
+    deferred.initialized = true;
+    deferred.irq = Events::get().subscribe(handle_deferred_devices);
+  }
+#endif
+  // start receiving on this CPU
+  if (index > 0 && this->link_up()) pair.rx_q.kick();
+}
+
 bool VirtioNet::link_up() const noexcept
 {
   return _conf.status & 1;
@@ -213,37 +375,71 @@ void VirtioNet::msix_conf_handler()
   get_config();
   VDBG("\t    New status: 0x%x \n",_conf.status);
 }
-void VirtioNet::msix_recv_handler()
+void VirtioNet::msix_recv_handler(Queue_pair& pair)
 {
+  // poll until the queue drains, the poller re-enables interrupts
+  pair.rx_q.disable_interrupts();
+  pair.poller.schedule();
+}
+int VirtioNet::receive(Queue_pair& pair, const int budget)
+{
+  auto& rx_q = pair.rx_q;
   auto rx = stat_packets_rx_total_;
-  rx_q.disable_interrupts();
   // handle incoming packets as long as bufstore has available buffers
-  int max = 128;
-  while (rx_q.new_incoming() && max-- > 0)
+  int received = 0;
+  bool refill = true;
+  net::Packet_chain burst;
+  while (rx_q.new_incoming() && received < budget)
   {
+    received++;
     auto res = rx_q.dequeue();
     VDBG_RX("[virtionet] Recv %u bytes\n", (uint32_t) res.size());
-    auto pckt = recv_packet(res.data(), res.size());
+    // copy the header, the packet owns the buffer from here on
+    const auto hdr = *(virtio_net_hdr_mrg*) res.data();
+    int buffers = 1;
+    auto pckt = recv_packet(res.data(), res.size(), hdr_len_);
+    if (mrg_rxbuf_ && hdr.num_buffers > 1)
+    {
+      buffers = hdr.num_buffers;
+      pckt = recv_merged(pair, std::move(pckt), buffers - 1);
+    }
+
+    if (pckt != nullptr)
+    {
+      // the host only summed the pseudo header, finish the job
+      if (hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+          complete_checksum(*pckt, hdr);
 
-    // Stat increase packets received
-    stat_packets_rx_total_++;
-    stat_bytes_rx_total_ += pckt->size();
+      // Stat increase packets received
+      stat_packets_rx_total_++;
+      stat_bytes_rx_total_ += pckt->total_size();
 
-    Link::receive(std::move(pckt));
+      burst.push_back(std::move(pckt));
+      if (burst.size() == Link::burst_size)
+          Link::receive(burst.release());
+    }
 
-    // Requeue a new buffer unless threshold is reached
-    if (not Nic::buffers_still_available(bufstore().buffers_in_use()))
+    // Requeue new buffers unless threshold is reached
+    while (refill && buffers-- > 0)
     {
-      stat_rx_refill_dropped_++;
-      break;
+      if (not Nic::buffers_still_available(bufstore().buffers_in_use()))
+      {
+        stat_rx_refill_dropped_++;
+        refill = false;
+        break;
+      }
+      add_receive_buffer(pair, bufstore().get_buffer());
     }
-    add_receive_buffer(bufstore().get_buffer());
+    if (not refill) break;
   }
-  rx_q.enable_interrupts();
   if (rx != stat_packets_rx_total_) rx_q.kick();
+  if (not burst.empty())
+      Link::receive(burst.release());
+  return received;
 }
-void VirtioNet::msix_xmit_handler()
+void VirtioNet::msix_xmit_handler(Queue_pair& pair)
 {
+  auto& tx_q = pair.tx_q;
   int dequeued_tx = 0;
   tx_q.disable_interrupts();
   // Do one TX-packet
@@ -251,8 +447,9 @@ void VirtioNet::msix_xmit_handler()
   {
     auto res = tx_q.dequeue();
     assert(res.data() != nullptr);
-    // get packet offset, and call placement Packet deleter directly
-    net::Packet::operator delete(res.data() - sizeof(net::Packet));
+    // the header is at the start of the packet buffer, deleting the
+    // packet releases its segments too
+    delete (net::Packet*) (res.data() - sizeof(net::Packet));
     dequeued_tx++;
   }
   tx_q.enable_interrupts();
@@ -264,75 +461,143 @@ void VirtioNet::msix_xmit_handler()
     VDBG_TX("[virtionet] %d transmitted\n", dequeued_tx);
 
     // transmit as much as possible from the buffer
-    if (! sendq.empty()) {
+    if (! pair.sendq.empty()) {
       transmit(nullptr);
     }
 
     // If we now emptied the buffer, offer packets to stack
-    if (sendq.empty() && tx_q.num_free() > 1) {
-      transmit_queue_available_event(tx_q.num_free() / 2);
+    if (pair.sendq.empty() && tx_q.num_free_chains(2) > 0) {
+      transmit_queue_available_event(tx_q.num_free_chains(2));
     }
   }
 }
 
 void VirtioNet::legacy_handler()
 {
-  msix_recv_handler();
-  msix_xmit_handler();
+  // legacy interrupts means a single queue pair
+  msix_recv_handler(pairs_[0]);
+  msix_xmit_handler(pairs_[0]);
 }
 
-void VirtioNet::add_receive_buffer(uint8_t* pkt)
+void VirtioNet::add_receive_buffer(Queue_pair& pair, uint8_t* pkt)
 {
   assert(pkt >= (uint8_t*) 0x1000);
   // offset pointer to virtionet header
   auto* vnet = pkt + sizeof(Packet);
 
+  if (mrg_rxbuf_)
+  {
+    // the header is at the start of the first buffer, the device fills
+    // as many buffers as it needs and records the count in num_buffers
+    Token token {{vnet, bufstore().bufsize() - sizeof(Packet)}, Token::IN };
+    std::array<Token, 1> tokens {{ token }};
+    pair.rx_q.enqueue(tokens);
+    return;
+  }
+
   Token token1 {{vnet, sizeof(virtio_net_hdr)}, Token::IN };
   Token token2 {{vnet + sizeof(virtio_net_hdr), max_packet_len()}, Token::IN };
 
   std::array<Token, 2> tokens {{ token1, token2 }};
-  rx_q.enqueue(tokens);
+  pair.rx_q.enqueue(tokens);
 }
 
 net::Packet_ptr
-VirtioNet::recv_packet(uint8_t* data, uint16_t size)
+VirtioNet::recv_packet(uint8_t* data, uint16_t size, uint16_t offset)
 {
   auto* ptr = (net::Packet*) (data - sizeof(net::Packet));
 
   new (ptr) net::Packet(
-      sizeof(virtio_net_hdr),
-      size - sizeof(virtio_net_hdr),
+      offset,
+      size - offset,
       size,
       &bufstore());
 
   return net::Packet_ptr(ptr);
 }
 
+net::Packet_ptr
+VirtioNet::recv_merged(Queue_pair& pair, net::Packet_ptr head, int count)
+{
+  // the continuation buffers carry no header
+  for (int i = 0; i < count; i++)
+  {
+    if (UNLIKELY(not pair.rx_q.new_incoming())) return nullptr;
+    auto res = pair.rx_q.dequeue();
+    head->append_segment(recv_packet(res.data(), res.size(), 0));
+  }
+  return head;
+}
+
+void VirtioNet::complete_checksum(net::Packet& pckt, const virtio_net_hdr& hdr)
+{
+  // the checksum field holds the pseudo header sum, which is included
+  // when summing from csum_start to the end of the frame
+  if (UNLIKELY(hdr.csum_start + hdr.csum_offset + 2 > pckt.size())) return;
+  auto* start = pckt.layer_begin() + hdr.csum_start;
+  size_t len = pckt.size() - hdr.csum_start;
+  uint16_t sum = ~net::checksum(start, len);
+  // the segments are summed one by one, and added to the sum so far
+  for (auto* seg = pckt.next_segment(); seg; seg = seg->next_segment()) {
+    const uint16_t part = ~net::checksum(seg->layer_begin(), seg->size());
+    sum = net::checksum_combine(sum, part, len);
+    len += seg->size();
+  }
+  const uint16_t csum = ~sum;
+  memcpy(start + hdr.csum_offset, &csum, sizeof(csum));
+}
+
 net::Packet_ptr
 VirtioNet::create_packet(int link_offset)
 {
   auto* ptr = (net::Packet*) bufstore().get_buffer();
+  // a jumbo frame does not fit, the rest of it goes in segments
+  const int frame_end = hdr_len_ + frame_offset_link() + MTU();
+  const int buf_end   = bufstore().bufsize() - sizeof(net::Packet);
 
   new (ptr) net::Packet(
-        sizeof(virtio_net_hdr) + link_offset,
+        hdr_len_ + link_offset,
         0,
-        sizeof(virtio_net_hdr) + frame_offset_link() + MTU(),
+        std::min(frame_end, buf_end),
         &bufstore());
 
   return net::Packet_ptr(ptr);
 }
 
+net::Packet_ptr
+VirtioNet::create_tso_packet(int link_offset)
+{
+  if (not (offloads_ & TSO_IP4)) return nullptr;
+  const int bufsize = hdr_len_ + frame_offset_link() + max_tso_size();
+  auto* buffer = new uint8_t[sizeof(net::Packet) + bufsize];
+  // no bufferstore, so the packet deleter frees the buffer
+  auto* ptr = new (buffer) net::Packet(
+        hdr_len_ + link_offset,
+        0,
+        bufsize,
+        nullptr);
+
+  return net::Packet_ptr(ptr);
+}
+
 void VirtioNet::transmit(net::Packet_ptr pckt)
 {
+  // transmit on the queue pair owned by this CPU
+  auto& pair  = local_pair();
+  auto& sendq = pair.sendq;
   while (pckt != nullptr) {
     if (not Nic::sendq_still_available(sendq.size())) {
       stat_sendq_limit_dropped_ += pckt->chain_length();
+      net::Packet::release_chain(std::move(pckt));
       break;
     }
     VDBG_TX("[virtionet] tx: Transmitting %#zu sized packet \n",
             pckt->size());
     auto tail = pckt->detach_tail();
-    sendq.emplace_back(std::move(pckt));
+    if (LIKELY(pckt->segment_count() < TX_MAX_TOKENS))
+      sendq.emplace_back(std::move(pckt));
+    else
+      stat_sendq_limit_dropped_++;
     pckt = std::move(tail);
   }
 
@@ -347,18 +612,19 @@ void VirtioNet::transmit(net::Packet_ptr pckt)
           sendq.size());
 
   // Transmit all we can directly
-  while (tx_q.num_free() > 1 and !sendq.empty())
+  while (!sendq.empty() and
+         pair.tx_q.num_free_chains(1 + sendq.front()->segment_count()) > 0)
   {
     VDBG_TX("[virtionet] tx: %u tokens left in TX ring \n",
-            tx_q.num_free());
+            pair.tx_q.num_free());
 
     auto* next = sendq.front().release();
     sendq.pop_front();
-    enqueue_tx(next);
+    enqueue_tx(pair, next);
 
     // Increase TX-stats
     stat_packets_tx_total_++;
-    stat_bytes_tx_total_ += next->size();
+    stat_bytes_tx_total_ += next->total_size();
     stat_packets_tx_total_++;
   }
 
@@ -366,10 +632,10 @@ void VirtioNet::transmit(net::Packet_ptr pckt)
 
   if (tx != this->stat_packets_tx_total_) {
 #ifdef NO_DEFERRED_KICK
-    tx_q.kick();
+    pair.tx_q.kick();
 #else
-    if (!deferred_kick) {
-      deferred_kick = true;
+    if (!pair.deferred_kick) {
+      pair.deferred_kick = true;
       PER_CPU(deferred_devs).devs.push_back(this);
       Events::get().trigger_event(PER_CPU(deferred_devs).irq);
     }
@@ -377,31 +643,52 @@ void VirtioNet::transmit(net::Packet_ptr pckt)
   }
 }
 
-void VirtioNet::enqueue_tx(net::Packet* pckt)
+void VirtioNet::enqueue_tx(Queue_pair& pair, net::Packet* pckt)
 {
-  Expects(pckt->layer_begin() == pckt->buf() + sizeof(virtio_net_hdr));
+  Expects(pckt->layer_begin() == pckt->buf() + hdr_len_);
   auto* hdr = pckt->buf();
-  memset(hdr, 0, sizeof(virtio_net_hdr));
+  memset(hdr, 0, hdr_len_);
   VDBG_TX("[virtionet] tx: Transmit %u bytes\n", (uint32_t) pckt->size());
 
-  Token token1 {{ hdr, sizeof(virtio_net_hdr)}, Token::OUT };
-  Token token2 {{ pckt->layer_begin(), pckt->size()}, Token::OUT };
+  auto& vhdr = *(virtio_net_hdr*) hdr;
+  if (pckt->checksum_offloaded())
+  {
+    vhdr.flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    vhdr.csum_start  = pckt->csum_start();
+    vhdr.csum_offset = pckt->csum_offset();
+    if (pckt->segment_size())
+    {
+      // TCP data offset, in 32-bit words
+      const auto* tcp = pckt->layer_begin() + vhdr.csum_start;
+      vhdr.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+      vhdr.gso_size = pckt->segment_size();
+      vhdr.hdr_len  = vhdr.csum_start + (tcp[12] >> 4) * 4;
+    }
+  }
 
-  std::array<Token, 2> tokens {{ token1, token2 }};
+  std::array<Token, TX_MAX_TOKENS> tokens {{
+      {{ hdr, hdr_len_ }, Token::OUT },
+      {{ pckt->layer_begin(), pckt->size() }, Token::OUT } }};
+  int count = 2;
+  for (auto* seg = pckt->next_segment(); seg; seg = seg->next_segment())
+    tokens[count++] = {{ seg->layer_begin(), seg->size() }, Token::OUT };
 
-  // Enqueue scatterlist, 2 pieces readable, 0 writable.
-  tx_q.enqueue(tokens);
+  // Enqueue scatterlist, all pieces readable, 0 writable.
+  pair.tx_q.enqueue(gsl::span<Token>(tokens.data(), count));
 }
 
 void VirtioNet::handle_deferred_devices()
 {
 #ifndef NO_DEFERRED_KICK
   for (auto* dev : PER_CPU(deferred_devs).devs)
-  if (dev->deferred_kick)
   {
-    dev->deferred_kick = false;
-    // kick transmitq
-    dev->tx_q.kick();
+    auto& pair = dev->local_pair();
+    if (pair.deferred_kick)
+    {
+      pair.deferred_kick = false;
+      // kick transmitq
+      pair.tx_q.kick();
+    }
   }
   PER_CPU(deferred_devs).devs.clear();
 #endif
@@ -409,14 +696,15 @@ void VirtioNet::handle_deferred_devices()
 
 void VirtioNet::poll()
 {
-  msix_recv_handler();
-  msix_xmit_handler();
+  auto& pair = local_pair();
+  receive(pair, pair.poller.budget());
+  msix_xmit_handler(pair);
   // flush transmit_q immediately
-  if (this->deferred_kick)
+  if (pair.deferred_kick)
   {
-    this->deferred_kick = false;
-    this->tx_q.enable_interrupts();
-    this->tx_q.kick();
+    pair.deferred_kick = false;
+    pair.tx_q.enable_interrupts();
+    pair.tx_q.kick();
   }
 }
 
@@ -424,9 +712,12 @@ void VirtioNet::deactivate()
 {
   VDBG("[virtionet] Disabling device\n");
   /// disable interrupts on virtio queues
-  rx_q.disable_interrupts();
-  tx_q.disable_interrupts();
-  ctrl_q.disable_interrupts();
+  for (auto& pair : pairs_) {
+    pair.rx_q.disable_interrupts();
+    pair.tx_q.disable_interrupts();
+  }
+  if (ctrl_enabled_)
+    ctrl_q.disable_interrupts();
 
   // reset device
   this->Virtio::reset();
@@ -437,17 +728,28 @@ void VirtioNet::move_to_this_cpu()
   INFO("VirtioNet", "Moving to CPU %d", SMP::cpu_id());
   // update CPU id in bufferstore
   bufstore().move_to_this_cpu();
+  if (pairs_.size() > 1) {
+    // each queue pair is already serviced by its own CPU
+    INFO("VirtioNet", "Multiqueue device, not moving %zu queue pairs",
+         pairs_.size());
+    return;
+  }
+  const int old_cpu = pairs_[0].cpu;
   // virtio IRQ balancing
   this->Virtio::move_to_this_cpu();
   // reset the IRQ handlers on this CPU
   auto& irqs = this->Virtio::get_irqs();
-  Events::get().subscribe(irqs[0], {this, &VirtioNet::msix_recv_handler});
-  Events::get().subscribe(irqs[1], {this, &VirtioNet::msix_xmit_handler});
+  Events::get().subscribe(irqs[0], [this] () { this->msix_recv_handler(pairs_[0]); });
+  Events::get().subscribe(irqs[1], [this] () { this->msix_xmit_handler(pairs_[0]); });
   Events::get().subscribe(irqs[2], {this, &VirtioNet::msix_conf_handler});
+  pairs_[0].cpu = SMP::cpu_id();
+  cpu_pair_.at(old_cpu) = 0;
+  cpu_pair_.at(pairs_[0].cpu) = 0;
 #ifndef NO_DEFERRED_KICK
   // update deferred kick IRQ
-  auto defirq = Events::get().subscribe(handle_deferred_devices);
-  PER_CPU(deferred_devs).irq = defirq;
+  auto& deferred = PER_CPU(deferred_devs);
+  deferred.initialized = true;
+  deferred.irq = Events::get().subscribe(handle_deferred_devices);
 #endif
 }
 
@@ -97,6 +97,22 @@
 #define VIRTIO_NET_S_LINK_UP  1
 #define VIRTIO_NET_S_ANNOUNCE 2
 
+// From Virtio 1.01, 5.1.6
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+#define VIRTIO_NET_HDR_GSO_NONE     0
+#define VIRTIO_NET_HDR_GSO_TCPV4    1
+
+// From Virtio 1.01, 5.1.6.5
+#define VIRTIO_NET_OK     0
+#define VIRTIO_NET_ERR    1
+
+// From Virtio 1.01, 5.1.6.5.5 (automatic receive steering in multiqueue)
+#define VIRTIO_NET_CTRL_MQ    4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MIN 1
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MAX 0x8000
+
 /** Virtio-net device driver.  */
 class VirtioNet : Virtio, public net::Link_layer<net::Ethernet> {
 public:
@@ -116,7 +132,7 @@ public:
   { return _conf.mac; }
 
   uint16_t MTU() const noexcept override
-  { return 1500; }
+  { return mtu_; }
 
   uint16_t max_packet_len() const noexcept {
     return sizeof(net::ethernet::VLAN_header) + MTU();
@@ -124,6 +140,19 @@ public:
 
   net::Packet_ptr create_packet(int) override;
 
+  /** Header and packet buffers of the largest frame we send */
+  static constexpr int TX_MAX_TOKENS = 8;
+
+  /** Offloads negotiated with the device */
+  uint32_t offloads() const noexcept override
+  { return offloads_; }
+
+  /** Largest IP datagram we hand to the device for segmentation */
+  uint32_t max_tso_size() const noexcept override
+  { return (offloads_ & TSO_IP4) ? 0xffff : 0; }
+
+  net::Packet_ptr create_tso_packet(int) override;
+
   net::downstream create_physical_downstream() override
   { return {this, &VirtioNet::transmit}; }
 
@@ -136,9 +165,13 @@ public:
 
   /** Space available in the transmit queue, in packets */
   size_t transmit_queue_available() override {
-    return tx_q.num_free() / 2;
+    return local_pair().tx_q.num_free_chains(2);
   }
 
+  /** Number of RX/TX queue pairs, each serviced by its own CPU */
+  int queue_pairs() const noexcept override
+  { return pairs_.size(); }
+
   bool link_up() const noexcept;
 
   auto& bufstore() noexcept { return bufstore_; }
@@ -146,7 +179,7 @@ public:
   void deactivate() override;
 
   void flush() override {
-    tx_q.kick();
+    local_pair().tx_q.kick();
   };
 
   void move_to_this_cpu() override;
@@ -166,20 +199,45 @@ private:
   }__attribute__((packed));
 
   /** Virtio std. § 5.1.6.1:
-      "The legacy driver only presented num_buffers in the struct virtio_net_hdr when VIRTIO_NET_F_MRG_RXBUF was not negotiated; without that feature the structure was 2 bytes shorter." */
-  struct virtio_net_hdr_nomerge {
-    uint8_t flags;
-    uint8_t gso_type;
-    uint16_t hdr_len;          // Ethernet + IP + TCP/UDP headers
-    uint16_t gso_size;         // Bytes to append to hdr_len per frame
-    uint16_t csum_start;       // Position to start checksumming from
-    uint16_t csum_offset;      // Offset after that to place checksum
-    uint16_t num_buffers;
+      "The legacy driver only presented num_buffers in the struct virtio_net_hdr when VIRTIO_NET_F_MRG_RXBUF was negotiated; without that feature the structure was 2 bytes shorter." */
+  struct virtio_net_hdr_mrg : public virtio_net_hdr {
+    uint16_t num_buffers;      // Buffers used by this frame
   }__attribute__((packed));
 
-  Virtio::Queue rx_q;
-  Virtio::Queue tx_q;
+  // Whether RX buffers are mergeable, and the matching header length
+  bool     mrg_rxbuf_ = false;
+  uint16_t hdr_len_   = sizeof(virtio_net_hdr);
+  uint32_t offloads_  = 0;
+  // frames larger than a buffer are received and sent as segments
+  uint16_t mtu_;
+
+  /** One RX/TX virtqueue pair, owned and serviced by a single CPU */
+  struct alignas(SMP_ALIGN) Queue_pair
+  {
+    Queue_pair(VirtioNet&, int index, int cpu);
+    Queue_pair(Queue_pair&&) = delete;
+
+    Virtio::Queue rx_q;
+    Virtio::Queue tx_q;
+    Rx_poller     poller;
+    int   cpu;
+    bool  deferred_kick = false;
+    std::deque<net::Packet_ptr> sendq{};
+  };
+  // Virtio::Queue is not movable, a deque never relocates its elements
+  std::deque<Queue_pair>  pairs_;
+  // CPU id -> index of the queue pair serviced by that CPU
+  std::vector<uint8_t>    cpu_pair_;
   Virtio::Queue ctrl_q;
+  bool ctrl_enabled_ = false;
+
+  Queue_pair& local_pair() noexcept {
+    const size_t cpu = SMP::cpu_id();
+    return pairs_[(cpu < cpu_pair_.size()) ? cpu_pair_[cpu] : 0];
+  }
+  const Queue_pair& local_pair() const noexcept {
+    return const_cast<VirtioNet*>(this)->local_pair();
+  }
 
   // From Virtio 1.01, 5.1.4
   struct config{
@@ -197,24 +255,39 @@ private:
   void get_config();
 
   /** Add packet to transmit ring */
-  void enqueue_tx(net::Packet* pckt);
+  void enqueue_tx(Queue_pair&, net::Packet* pckt);
+
+  /** Decide how many queue pairs to use, 1 unless multiqueue is possible */
+  int wanted_queue_pairs(uint32_t negotiated) const;
+  /** Tell the device how many queue pairs we use. Virtio 1.01, 5.1.6.5.5 */
+  bool ctrl_set_queue_pairs(uint16_t pairs);
+
+  /** Subscribe IRQs and redirect MSI-X vectors of a pair to its CPU */
+  void bind_queue_pair(int index);
+
+  /** Receive at most @budget buffers from the RX queue of a pair */
+  int receive(Queue_pair&, int budget);
 
   /** Handle device IRQ.
-      Will look for config changes and service RX/TX queues as necessary.*/
-  void msix_recv_handler();
-  void msix_xmit_handler();
+      RX interrupts switch the pair to polling, see Rx_poller. */
+  void msix_recv_handler(Queue_pair&);
+  void msix_xmit_handler(Queue_pair&);
   void msix_conf_handler();
 
   /** Legacy IRQ handler */
   void legacy_handler();
 
   /** Allocate and queue buffer from bufstore_ in RX queue. */
-  void add_receive_buffer(uint8_t*);
+  void add_receive_buffer(Queue_pair&, uint8_t*);
+
+  std::unique_ptr<net::Packet> recv_packet(uint8_t* data, uint16_t sz, uint16_t offset);
+
+  /** Append @count more RX buffers of a frame to it as packet segments */
+  net::Packet_ptr recv_merged(Queue_pair&, net::Packet_ptr head, int count);
 
-  std::unique_ptr<net::Packet> recv_packet(uint8_t* data, uint16_t sz);
+  /** Fill in a partial checksum left for us by the host, across segments */
+  static void complete_checksum(net::Packet&, const virtio_net_hdr&);
 
-  void begin_deferred_kick();
-  bool deferred_kick = false;
   static void handle_deferred_devices();
 
   net::BufferStore bufstore_;
@@ -228,9 +301,6 @@ private:
   uint64_t& stat_bytes_tx_total_;
   uint64_t& stat_packets_rx_total_;
   uint64_t& stat_packets_tx_total_;
-
-  std::deque<net::Packet_ptr> sendq{};
-
 };
 
 #endif
@@ -11,6 +11,8 @@
 #include <atomic>
 #include <cassert>
 #include <malloc.h>
+#include <hal/machine.hpp>
+#include <net/rss.hpp>
 static std::vector<vmxnet3*> deferred_devs;
 
 #define VMXNET3_REV1_MAGIC 0xbabefee1
@@ -21,7 +23,8 @@ static std::vector<vmxnet3*> deferred_devs;
 #define VMXNET3_IMM_ACTIVE 1
 
 #define VMXNET3_NUM_TX_COMP  vmxnet3::NUM_TX_DESC
-#define VMXNET3_NUM_RX_COMP  vmxnet3::NUM_RX_DESC
+// one completion for every descriptor of both RX rings
+#define VMXNET3_NUM_RX_COMP  (2 * vmxnet3::NUM_RX_DESC)
 static const int VMXNET3_TX_FILL = vmxnet3::NUM_TX_DESC-1;
 static const int VMXNET3_RX_FILL = vmxnet3::NUM_RX_DESC;
 
@@ -38,9 +41,12 @@ struct vmxnet3_dma {
   /** RX ring */
   struct vmxnet3_rx {
     struct vmxnet3_rx_desc desc[vmxnet3::NUM_RX_DESC];
+    struct vmxnet3_rx_desc body[vmxnet3::NUM_RX_DESC];
     struct vmxnet3_rx_comp comp[VMXNET3_NUM_RX_COMP];
   };
   struct vmxnet3_rx rx[vmxnet3::NUM_RX_QUEUES];
+  /** RSS configuration */
+  struct vmxnet3_rss_config rss;
   /** Queue descriptors */
   struct vmxnet3_queues queues;
   /** Shared area */
@@ -106,22 +112,29 @@ static inline uint16_t buffer_size_for_mtu(const uint16_t mtu)
   return total;
 }
 
+// data offset in the TCP header, in 32-bit words
+static inline int tcp_header_length(const uint8_t* tcp)
+{
+  return (tcp[12] >> 4) * 4;
+}
+
 vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
     Link(Link_protocol{{this, &vmxnet3::transmit}, mac()}),
-    m_pcidev(d), m_mtu(mtu),
+    m_pcidev(d), m_mtu(std::min<uint16_t>(mtu, 9000)),
     stat_sendq_cur{Statman::get().create(Stat::UINT32, device_name() + ".sendq_now").get_uint32()},
     stat_sendq_max{Statman::get().create(Stat::UINT32, device_name() + ".sendq_max").get_uint32()},
 
     //TODO make some of these stats generic and put them into LINK object so that they can be seen on all networking drivers
-    stat_tx_total_packets{Statman::get().create(Stat::UINT64, device_name() + ".stat_tx_total_packets").get_uint64()},
-    stat_tx_total_bytes{Statman::get().create(Stat::UINT64, device_name() + ".stat_tx_total_bytes").get_uint64()},
-    stat_rx_total_packets{Statman::get().create(Stat::UINT64, device_name() + ".stat_rx_total_packets").get_uint64()},
-    stat_rx_total_bytes{Statman::get().create(Stat::UINT64, device_name() + ".stat_rx_total_bytes").get_uint64()},
+    stat_tx_total_packets{Statman::get().create_percpu(device_name() + ".stat_tx_total_packets")},
+    stat_tx_total_bytes{Statman::get().create_percpu(device_name() + ".stat_tx_total_bytes")},
+    stat_rx_total_packets{Statman::get().create_percpu(device_name() + ".stat_rx_total_packets")},
+    stat_rx_total_bytes{Statman::get().create_percpu(device_name() + ".stat_rx_total_bytes")},
     stat_rx_zero_dropped{Statman::get().create(Stat::UINT64, device_name() + ".stat_rx_zero_dropped").get_uint64()},
 
     stat_rx_refill_dropped{Statman::get().create(Stat::UINT64, device_name() + ".rx_refill_dropped").get_uint64()},
     stat_sendq_dropped{Statman::get().create(Stat::UINT64, device_name() + ".sendq_dropped").get_uint64()},
-    bufstore_{1024, buffer_size_for_mtu(mtu)}
+    // standard frames fit in one buffer, jumbo frames take several
+    bufstore_{1024, buffer_size_for_mtu(1500)}
 {
   INFO("vmxnet3", "Driver initializing (rev=%#x)", d.rev_id());
   assert(d.rev_id() == REVISION_ID);
@@ -139,9 +152,19 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
     uint8_t msix_vectors = d.get_msix_vectors();
     INFO2("[x] Device has %u MSI-X vectors", msix_vectors);
     assert(msix_vectors >= 3);
-    if (msix_vectors > 2 + NUM_RX_QUEUES) msix_vectors = 2 + NUM_RX_QUEUES;
 
-    for (int i = 0; i < msix_vectors; i++)
+    // one RX queue per CPU, RSS wants a power of two
+    int max_queues = std::min<int>(NUM_RX_QUEUES, msix_vectors - 2);
+    max_queues = std::min<int>(max_queues, 1 + SMP::active_cpus().size());
+    const int idx = os::machine().next_index<hw::Nic>();
+    int queues = hw::Nic::queue_pairs_override(idx, max_queues);
+    queues = std::max(1, std::min(queues, max_queues));
+    while (queues & (queues - 1)) queues &= queues - 1;
+    this->m_rx_queues = queues;
+    INFO2("[x] Using %d RX queues", m_rx_queues);
+
+    // events and TX
+    for (int i = 0; i < 2; i++)
     {
       auto irq = Events::get().subscribe(nullptr);
       this->irqs.push_back(irq);
@@ -150,8 +173,21 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
 
     Events::get().subscribe(irqs[0], {this, &vmxnet3::msix_evt_handler});
     Events::get().subscribe(irqs[1], {this, &vmxnet3::msix_xmit_handler});
-    for (int q = 0; q < NUM_RX_QUEUES; q++)
-    Events::get().subscribe(irqs[2 + q], {this, &vmxnet3::msix_recv_handler});
+    for (int q = 0; q < m_rx_queues; q++) {
+      rx_cpu[q] = SMP::cpu_id();
+      rx_pollers.emplace_back(
+        Rx_poller::poll_func{[this, q] (int budget) {
+          return this->receive_handler(q, budget);
+        }},
+        Rx_poller::rearm_func{[this, q] () {
+          this->enable_intr(2 + q);
+          return this->rx_pending(q);
+        }});
+      // each RX queue can be moved to another CPU later on
+      d.bind_msix_vector(2 + q, SMP::cpu_id(), [this, q] () {
+        this->msix_recv_handler(q);
+      });
+    }
   }
   else {
     assert(0 && "This driver does not support legacy IRQs");
@@ -202,20 +238,21 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   memset(tx.buffers, 0, sizeof(tx.buffers));
 
   // setup rx queues
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  for (int q = 0; q < m_rx_queues; q++)
   {
-    memset(rx[q].buffers, 0, sizeof(rx[q].buffers));
-    rx[q].desc0 = &dma->rx[q].desc[0];
-    rx[q].desc1 = nullptr;
+    for (auto& ring : rx[q].rings)
+      memset(ring.buffers, 0, sizeof(ring.buffers));
+    rx[q].rings[0].desc = &dma->rx[q].desc[0];
+    rx[q].rings[1].desc = &dma->rx[q].body[0];
     rx[q].comp  = &dma->rx[q].comp[0];
     rx[q].index = q;
 
     auto& queue = queues.rx[q];
-    queue.cfg.desc_address[0] = (uintptr_t) rx[q].desc0;
-    queue.cfg.desc_address[1] = (uintptr_t) rx[q].desc1;
+    queue.cfg.desc_address[0] = (uintptr_t) rx[q].rings[0].desc;
+    queue.cfg.desc_address[1] = (uintptr_t) rx[q].rings[1].desc;
     queue.cfg.comp_address    = (uintptr_t) rx[q].comp;
     queue.cfg.num_desc[0]  = vmxnet3::NUM_RX_DESC;
-    queue.cfg.num_desc[1]  = 0;
+    queue.cfg.num_desc[1]  = (jumbo_frames()) ? vmxnet3::NUM_RX_DESC : 0;
     queue.cfg.num_comp     = VMXNET3_NUM_RX_COMP;
     queue.cfg.driver_data_len = sizeof(vmxnet3_rx_desc)
                           + 2 * sizeof(vmxnet3_rx_desc);
@@ -231,21 +268,23 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   shared.misc.version         = VMXNET3_VERSION_MAGIC;
   shared.misc.version_support     = 1;
   shared.misc.upt_version_support = 1;
-  shared.misc.upt_features        = 0;
+  shared.misc.upt_features        = (m_rx_queues > 1) ? UPT1_F_RSS : 0;
   shared.misc.driver_data_address = (uintptr_t) &dma;
   shared.misc.queue_desc_address  = (uintptr_t) &dma->queues;
   shared.misc.driver_data_len     = sizeof(vmxnet3_dma);
-  shared.misc.queue_desc_len      = sizeof(vmxnet3_queues);
+  shared.misc.queue_desc_len      = sizeof(vmxnet3_tx_queue)
+                                  + m_rx_queues * sizeof(vmxnet3_rx_queue);
   shared.misc.mtu = max_packet_len(); // 60-9000
   shared.misc.num_tx_queues  = 1;
-  shared.misc.num_rx_queues  = NUM_RX_QUEUES;
+  shared.misc.num_rx_queues  = m_rx_queues;
   shared.interrupt.mask_mode = VMXNET3_IT_AUTO | (VMXNET3_IMM_AUTO << 2);
-  shared.interrupt.num_intrs = 2 + NUM_RX_QUEUES;
+  shared.interrupt.num_intrs = 2 + m_rx_queues;
   shared.interrupt.event_intr_index = 0;
   memset(shared.interrupt.moderation_level, UPT1_IML_ADAPTIVE, VMXNET3_MAX_INTRS);
   shared.interrupt.control   = 0x1; // disable all
   shared.rx_filter.mode =
       VMXNET3_RXM_UCAST | VMXNET3_RXM_BCAST | VMXNET3_RXM_ALL_MULTI;
+  if (m_rx_queues > 1) this->init_rss();
 
   // location of shared area to device
   uintptr_t shabus = (uintptr_t) &shared;
@@ -259,7 +298,7 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   }
 
   // initialize and fill RX queue...
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  for (int q = 0; q < m_rx_queues; q++)
   {
     refill(rx[q]);
   }
@@ -270,8 +309,84 @@ vmxnet3::vmxnet3(hw::PCI_Device& d, const uint16_t mtu) :
   // enable interrupts
   enable_intr(0);
   enable_intr(1);
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  for (int q = 0; q < m_rx_queues; q++)
       enable_intr(2 + q);
+
+  // each additional RX queue is serviced by its own CPU
+  for (int q = 1; q < m_rx_queues; q++)
+      set_rx_queue_cpu(q, SMP::active_cpus().at(q - 1));
+}
+
+void vmxnet3::init_rss()
+{
+  static_assert(net::rss::default_key.size() == UPT1_RSS_MAX_KEY_SIZE);
+  const auto& default_key = net::rss::default_key;
+  auto& rss = dma->rss;
+  rss.hash_type = UPT1_RSS_HASH_TYPE_IPV4 | UPT1_RSS_HASH_TYPE_TCP_IPV4
+                | UPT1_RSS_HASH_TYPE_IPV6 | UPT1_RSS_HASH_TYPE_TCP_IPV6;
+  rss.hash_func = UPT1_RSS_HASH_FUNC_TOEPLITZ;
+  rss.hash_key_size = default_key.size();
+  memcpy(rss.hash_key, default_key.data(), default_key.size());
+  rss.ind_table_size = UPT1_RSS_MAX_IND_TABLE_SIZE;
+  for (int i = 0; i < UPT1_RSS_MAX_IND_TABLE_SIZE; i++)
+      rss.ind_table[i] = i % m_rx_queues;
+
+  auto& shared = dma->shared;
+  shared.rss.version = 1;
+  shared.rss.length  = sizeof(vmxnet3_rss_config);
+  shared.rss.address = (uintptr_t) &rss;
+}
+
+bool vmxnet3::configure_rss(const RSS_config& config)
+{
+  if (m_rx_queues <= 1) return false;
+  if (config.key.size() > UPT1_RSS_MAX_KEY_SIZE
+   || config.indirection.size() > UPT1_RSS_MAX_IND_TABLE_SIZE) return false;
+  for (const auto queue : config.indirection)
+      if (queue >= m_rx_queues) return false;
+
+  auto& rss = dma->rss;
+  rss.hash_type = config.hash_types & (UPT1_RSS_HASH_TYPE_IPV4
+                | UPT1_RSS_HASH_TYPE_TCP_IPV4 | UPT1_RSS_HASH_TYPE_IPV6
+                | UPT1_RSS_HASH_TYPE_TCP_IPV6);
+  if (not config.key.empty()) {
+    rss.hash_key_size = config.key.size();
+    memcpy(rss.hash_key, config.key.data(), config.key.size());
+  }
+  if (not config.indirection.empty()) {
+    rss.ind_table_size = config.indirection.size();
+    memcpy(rss.ind_table, config.indirection.data(), config.indirection.size());
+  }
+  // TODO in smp/mt protect this with IRQ disable / enable for the entire driver
+  command(VMXNET3_CMD_UPDATE_RSSIDT);
+  return true;
+}
+
+hw::Nic::RSS_config vmxnet3::rss_config() const
+{
+  RSS_config config;
+  if (m_rx_queues <= 1) return config;
+  const auto& rss = dma->rss;
+  config.hash_types = rss.hash_type;
+  config.key.assign(rss.hash_key, rss.hash_key + rss.hash_key_size);
+  config.indirection.assign(rss.ind_table, rss.ind_table + rss.ind_table_size);
+  return config;
+}
+
+bool vmxnet3::set_rx_queue_cpu(const int q, const int cpu)
+{
+  if (q < 0 || q >= m_rx_queues) return false;
+  if (cpu < 0 || cpu >= (int) SMP::early_cpu_total()) return false;
+
+  m_pcidev.set_msix_affinity(2 + q, cpu);
+  rx_cpu[q] = cpu;
+  return true;
+}
+
+int vmxnet3::rx_queue_cpu(const int q) const
+{
+  if (q < 0 || q >= m_rx_queues) return -1;
+  return rx_cpu[q];
 }
 
 uint32_t vmxnet3::command(uint32_t cmd)
@@ -346,41 +461,54 @@ void vmxnet3::disable_intr(uint8_t idx) noexcept
 #define VMXNET3_PT_RXPROD2 0xa00
 
 #define VMXNET3_RXF_GEN  0x80000000UL
+#define VMXNET3_RXF_BODY 0x00004000UL
 #define VMXNET3_RXCF_GEN 0x80000000UL
 #define VMXNET3_TXF_GEN  0x00004000UL
 
 void vmxnet3::refill(rxring_state& rxq)
 {
-  bool added_buffers = (rxq.prod_count < VMXNET3_RX_FILL);
-  while (rxq.prod_count < VMXNET3_RX_FILL)
+  refill(rxq, 0);
+  if (jumbo_frames()) refill(rxq, 1);
+}
+
+void vmxnet3::refill(rxring_state& rxq, const int r)
+{
+  auto& ring = rxq.rings[r];
+  // a frame starts in a head buffer, and goes on in body buffers
+  const uint32_t btype = (r == 0) ? 0 : VMXNET3_RXF_BODY;
+  const uint32_t buflen = bufstore().bufsize() - sizeof(net::Packet) - DRIVER_OFFSET;
+
+  bool added_buffers = (ring.prod_count < VMXNET3_RX_FILL);
+  while (ring.prod_count < VMXNET3_RX_FILL)
   {
     // break when not allowed to refill anymore
-    if (rxq.prod_count > 0 /* prevent full stop? */
+    if (ring.prod_count > 0 /* prevent full stop? */
      && not Nic::buffers_still_available(bufstore().buffers_in_use()))
     {
-      stat_rx_refill_dropped += VMXNET3_RX_FILL - rxq.prod_count;
+      stat_rx_refill_dropped += VMXNET3_RX_FILL - ring.prod_count;
       break;
     }
 
-    size_t i = rxq.producers % vmxnet3::NUM_RX_DESC;
+    size_t i = ring.producers % vmxnet3::NUM_RX_DESC;
     const uint32_t generation =
-        (rxq.producers & vmxnet3::NUM_RX_DESC) ? 0 : VMXNET3_RXF_GEN;
+        (ring.producers & vmxnet3::NUM_RX_DESC) ? 0 : VMXNET3_RXF_GEN;
 
     // get a pointer to packet data
     auto* pkt_data = bufstore().get_buffer();
-    rxq.buffers[i] = &pkt_data[sizeof(net::Packet) + DRIVER_OFFSET];
+    ring.buffers[i] = &pkt_data[sizeof(net::Packet) + DRIVER_OFFSET];
 
     // assign rx descriptor
-    auto& desc = rxq.desc0[i];
-    desc.address = (uintptr_t) rxq.buffers[i];
-    desc.flags   = max_packet_len() | generation;
-    rxq.prod_count++;
-    rxq.producers++;
+    auto& desc = ring.desc[i];
+    desc.address = (uintptr_t) ring.buffers[i];
+    desc.flags   = buflen | btype | generation;
+    ring.prod_count++;
+    ring.producers++;
   }
   if (added_buffers) {
     // send count to NIC
-    mmio_write32(this->ptbase + VMXNET3_PT_RXPROD1 + 0x200 * rxq.index,
-                 rxq.producers % vmxnet3::NUM_RX_DESC);
+    const uint32_t reg = (r == 0) ? VMXNET3_PT_RXPROD1 : VMXNET3_PT_RXPROD2;
+    mmio_write32(this->ptbase + reg + 0x200 * rxq.index,
+                 ring.producers % vmxnet3::NUM_RX_DESC);
   }
 }
 
@@ -399,14 +527,31 @@ net::Packet_ptr
 vmxnet3::create_packet(int link_offset)
 {
   auto* ptr = (net::Packet*) bufstore().get_buffer();
+  // a jumbo frame does not fit, the rest of it goes in segments
+  const int frame_end = DRIVER_OFFSET + frame_offset_link() + MTU();
+  const int buf_end   = bufstore().bufsize() - sizeof(net::Packet);
   new (ptr) net::Packet(
         DRIVER_OFFSET + link_offset,
         0,
-        DRIVER_OFFSET + frame_offset_link() + MTU(),
+        std::min(frame_end, buf_end),
         &bufstore());
   return net::Packet_ptr(ptr);
 }
 
+net::Packet_ptr
+vmxnet3::create_tso_packet(int link_offset)
+{
+  const int bufsize = DRIVER_OFFSET + frame_offset_link() + max_tso_size();
+  auto* buffer = new uint8_t[sizeof(net::Packet) + bufsize];
+  // no bufferstore, so the packet deleter frees the buffer
+  auto* ptr = new (buffer) net::Packet(
+        DRIVER_OFFSET + link_offset,
+        0,
+        bufsize,
+        nullptr);
+  return net::Packet_ptr(ptr);
+}
+
 void vmxnet3::msix_evt_handler()
 {
   uint32_t evts = dma->shared.ecr;
@@ -444,12 +589,11 @@ void vmxnet3::msix_xmit_handler()
   this->transmit_handler();
   this->enable_intr(1);
 }
-void vmxnet3::msix_recv_handler()
+void vmxnet3::msix_recv_handler(const int q)
 {
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
-  {
-      this->receive_handler(q);
-  }
+  // poll until the queue drains, the poller unmasks the interrupt
+  this->disable_intr(2 + q);
+  rx_pollers[q].schedule();
 }
 
 bool vmxnet3::transmit_handler()
@@ -457,15 +601,17 @@ bool vmxnet3::transmit_handler()
   bool transmitted = false;
   while (true)
   {
-    uint32_t idx = tx.consumers % VMXNET3_NUM_TX_COMP;
-    uint32_t gen = (tx.consumers & VMXNET3_NUM_TX_COMP) ? 0 : VMXNET3_TXCF_GEN;
+    uint32_t idx = tx.completions % VMXNET3_NUM_TX_COMP;
+    uint32_t gen = (tx.completions & VMXNET3_NUM_TX_COMP) ? 0 : VMXNET3_TXCF_GEN;
 
     auto& comp = dma->tx_comp[idx];
     if (gen != (comp.flags & VMXNET3_TXCF_GEN)) break;
 
-    tx.consumers++;
+    tx.completions++;
 
     int desc = comp.index % vmxnet3::NUM_TX_DESC;
+    // every descriptor of the packet, up to its last, is free again
+    tx.consumers += ((desc - tx.consumers) & (vmxnet3::NUM_TX_DESC - 1)) + 1;
     if (tx.buffers[desc] == nullptr) {
       printf("empty buffer? comp=%d, desc=%d\n", idx, desc);
       continue;
@@ -488,61 +634,89 @@ bool vmxnet3::transmit_handler()
   }
   return transmitted;
 }
-bool vmxnet3::receive_handler(const int Q)
+bool vmxnet3::rx_pending(const int Q) const noexcept
+{
+  uint32_t idx = rx[Q].consumers % VMXNET3_NUM_RX_COMP;
+  uint32_t gen = (rx[Q].consumers & VMXNET3_NUM_RX_COMP) ? 0 : VMXNET3_RXCF_GEN;
+  return gen == (dma->rx[Q].comp[idx].flags & VMXNET3_RXCF_GEN);
+}
+int vmxnet3::receive_handler(const int Q, const int budget)
 {
   std::vector<net::Packet_ptr> recvq;
-  this->disable_intr(2 + Q);
-  while (true)
+  auto& rxq = rx[Q];
+  int received = 0;
+  while (received < budget)
   {
-    uint32_t idx = rx[Q].consumers % VMXNET3_NUM_RX_COMP;
-    uint32_t gen = (rx[Q].consumers & VMXNET3_NUM_RX_COMP) ? 0 : VMXNET3_RXCF_GEN;
-
-    auto& comp = dma->rx[Q].comp[idx];
     // break when exiting this generation
-    if (gen != (comp.flags & VMXNET3_RXCF_GEN)) break;
+    if (not rx_pending(Q)) break;
+    received++;
+
+    auto& comp = dma->rx[Q].comp[rxq.consumers % VMXNET3_NUM_RX_COMP];
 
     /* prevent speculative pre read ahead of comp content*/
     std::atomic_thread_fence(std::memory_order_acquire);
 
-    rx[Q].consumers++;
-    rx[Q].prod_count--;
+    rxq.consumers++;
+    // the queue ID tells which ring the buffer was in
+    const int rqid = (comp.index >> VMXNET3_RXCI_RQID_SHIFT) & 0x3FF;
+    auto& ring = rxq.rings[(rqid >= m_rx_queues) ? 1 : 0];
+    ring.prod_count--;
 
     int desc = comp.index % vmxnet3::NUM_RX_DESC;
-
-    // Handle case of empty packet
-    if (UNLIKELY((comp.len & (VMXNET3_MAX_BUFFER_LEN-1)) == 0)) {
-      //TODO assert / log if eop and sop are not set in empty packet.
-
-      //release unused buffer
-      auto* packet = (net::Packet*) (tx.buffers[desc] - DRIVER_OFFSET - sizeof(net::Packet));
-      delete packet; // call deleter on Packet to release it
-      rx[Q].buffers[desc] = nullptr;
-      stat_rx_zero_dropped++;
-      break;
-    }
+    auto* buffer = ring.buffers[desc];
+    assert(buffer != nullptr);
+    ring.buffers[desc] = nullptr;
 
     // mask out length
     int len = comp.len & (VMXNET3_MAX_BUFFER_LEN-1);
 
-    // get buffer and construct packet
-    assert(rx[Q].buffers[desc] != nullptr);
-    recvq.push_back(recv_packet(rx[Q].buffers[desc], len));
-
-    stat_rx_total_packets++;
-    stat_rx_total_bytes+=len;
+    // Handle case of empty packet, or a body buffer the frame didn't need
+    if (UNLIKELY(len == 0)) {
+      //release unused buffer
+      // no packet was constructed in it, return the raw buffer
+      bufstore().release(buffer - DRIVER_OFFSET - sizeof(net::Packet));
+      if (comp.index & VMXNET3_RXCI_SOP) {
+        stat_rx_zero_dropped++;
+        break;
+      }
+    }
+    else {
+      // get buffer and construct packet
+      auto pckt = recv_packet(buffer, len);
+      if (comp.index & VMXNET3_RXCI_SOP) {
+        // the tag was stripped by the device, see add_vlan()
+        if (comp.len & VMXNET3_RXCL_TS)
+          pckt->set_vlan_id((comp.len >> VMXNET3_RXCL_TCI_SHIFT) & 0xFFF);
+        rxq.partial = std::move(pckt);
+      }
+      else if (rxq.partial != nullptr) {
+        rxq.partial->append_segment(std::move(pckt));
+      }
+    }
 
-    rx[Q].buffers[desc] = nullptr;
+    // the last buffer completes the frame
+    if ((comp.index & VMXNET3_RXCI_EOP) and rxq.partial != nullptr)
+    {
+      stat_rx_total_packets++;
+      stat_rx_total_bytes += rxq.partial->total_size();
+      recvq.push_back(std::move(rxq.partial));
+    }
   }
-  this->enable_intr(2 + Q);
   // refill always
-  if (!recvq.empty()) {
-    this->refill(rx[Q]);
+  if (received > 0) {
+    this->refill(rxq);
   }
-  // handle packets
+  // handle packets, in bursts
+  net::Packet_chain burst;
   for (auto& pckt : recvq) {
-    Link::receive(std::move(pckt));
+    burst.push_back(std::move(pckt));
+    if (burst.size() == Link::burst_size)
+      Link::receive(burst.release());
   }
-  return recvq.empty() == false;
+  if (!burst.empty()) {
+    Link::receive(burst.release());
+  }
+  return received;
 }
 
 void vmxnet3::transmit(net::Packet_ptr pckt_ptr)
@@ -551,19 +725,20 @@ void vmxnet3::transmit(net::Packet_ptr pckt_ptr)
   {
     if (not Nic::sendq_still_available(this->sendq.size())) {
       stat_sendq_dropped += pckt_ptr->chain_length();
+      net::Packet::release_chain(std::move(pckt_ptr));
       break;
     }
     auto tail = pckt_ptr->detach_tail();
     sendq.emplace_back(std::move(pckt_ptr));
     pckt_ptr = std::move(tail);
   }
-  // send as much as possible from sendq
-  while (!sendq.empty() && can_transmit())
+  // send as much as possible from sendq, a descriptor per buffer
+  while (!sendq.empty() && can_transmit(sendq.front()->segment_count()))
   {
     auto* packet = sendq.front().release();
     sendq.pop_front();
     // transmit released buffer
-    transmit_data(packet->buf() + DRIVER_OFFSET, packet->size());
+    transmit_data(packet);
   }
   // update sendq stats
   stat_sendq_cur = sendq.size();
@@ -587,29 +762,63 @@ inline int  vmxnet3::tx_tokens_free() const noexcept
 {
   return VMXNET3_TX_FILL - (tx.producers - tx.consumers);
 }
-inline bool vmxnet3::can_transmit() const noexcept
+inline bool vmxnet3::can_transmit(const int descriptors) const noexcept
 {
-  return tx_tokens_free() > 0 && this->link_state_up;
+  return tx_tokens_free() >= descriptors && this->link_state_up;
 }
 
-void vmxnet3::transmit_data(uint8_t* data, uint16_t data_length)
+void vmxnet3::transmit_data(net::Packet* packet)
 {
 #define VMXNET3_TXF_EOP 0x000001000UL
 #define VMXNET3_TXF_CQ  0x000002000UL
-  auto idx = tx.producers % vmxnet3::NUM_TX_DESC;
-  auto gen = (tx.producers & vmxnet3::NUM_TX_DESC) ? 0 : VMXNET3_TXF_GEN;
-  tx.producers++;
-
-  assert(tx.buffers[idx] == nullptr);
+  auto* data = packet->buf() + DRIVER_OFFSET;
+  const uint16_t data_length = packet->size();
+  assert(data_length <= MAX_TX_LENGTH);
+  // one descriptor for every buffer of the packet, the offloads are
+  // set in the first, and the last one is completed
+  auto& desc = dma->tx_desc[tx.producers % vmxnet3::NUM_TX_DESC];
+  uint32_t idx = 0;
+  for (auto* seg = packet; seg != nullptr; seg = seg->next_segment())
+  {
+    idx = tx.producers % vmxnet3::NUM_TX_DESC;
+    auto gen = (tx.producers & vmxnet3::NUM_TX_DESC) ? 0 : VMXNET3_TXF_GEN;
+    tx.producers++;
+
+    assert(tx.buffers[idx] == nullptr);
+    auto& sdesc = dma->tx_desc[idx];
+    sdesc.address  = (uintptr_t) ((seg == packet) ? data : seg->layer_begin());
+    sdesc.flags[0] = gen | seg->size();
+    sdesc.flags[1] = 0;
+  }
+  // the completion of the last descriptor releases the packet
   tx.buffers[idx] = data;
+  dma->tx_desc[idx].flags[1] = VMXNET3_TXF_CQ | VMXNET3_TXF_EOP;
 
-  auto& desc = dma->tx_desc[idx];
-  desc.address  = (uintptr_t) tx.buffers[idx];
-  desc.flags[0] = gen | data_length;
-  desc.flags[1] = VMXNET3_TXF_CQ | VMXNET3_TXF_EOP;
+  if (packet->segment_size())
+  {
+    // the device wants the TCP pseudo-header sum without the length
+    const int hlen = packet->csum_start() + tcp_header_length(data + packet->csum_start());
+    auto* check = data + packet->csum_start() + packet->csum_offset();
+    uint16_t sum;
+    memcpy(&sum, check, sizeof(sum));
+    const uint16_t tcp_len = net::htons(data_length - packet->csum_start());
+    uint32_t csum = sum + (uint16_t) ~tcp_len;
+    csum = (csum & 0xffff) + (csum >> 16);
+    sum = (csum & 0xffff) + (csum >> 16);
+    memcpy(check, &sum, sizeof(sum));
+
+    desc.flags[0] |= packet->segment_size() << VMXNET3_TXF_MSSCOF_SHIFT;
+    desc.flags[1] |= hlen | VMXNET3_OM_TSO;
+  }
+  else if (packet->checksum_offloaded())
+  {
+    const int start = packet->csum_start();
+    desc.flags[0] |= (start + packet->csum_offset()) << VMXNET3_TXF_MSSCOF_SHIFT;
+    desc.flags[1] |= start | VMXNET3_OM_CSUM;
+  }
 
   stat_tx_total_packets++;
-  stat_tx_total_bytes+=data_length;
+  stat_tx_total_bytes += packet->total_size();
 }
 
 void vmxnet3::flush()
@@ -642,8 +851,10 @@ void vmxnet3::poll()
   bool work;
   do {
     work = false;
-    for (int q = 0; q < NUM_RX_QUEUES; q++)
-        work |= receive_handler(q);
+    // only the RX queues owned by this CPU
+    for (int q = 0; q < m_rx_queues; q++)
+        if (rx_cpu[q] == SMP::cpu_id())
+            work |= receive_handler(q, rx_pollers[q].budget()) > 0;
     // transmit
     work |= transmit_handler();
     // immediately flush when possible
@@ -658,9 +869,18 @@ void vmxnet3::poll()
 
 void vmxnet3::add_vlan(const int id)
 {
-  this->dma->shared.rx_filter.vlan_filter[((id>>3)&0x1FF)] |= (1<<(id&7));
+  auto& shared = this->dma->shared;
+  // filter in hardware, still letting untagged frames (ID 0) through
+  shared.rx_filter.vlan_filter[0] |= 1;
+  shared.rx_filter.vlan_filter[((id>>3)&0x1FF)] |= (1<<(id&7));
   // TODO in smp/mt protect this with IRQ disable / enable for the entire driver
   mmio_write32(this->iobase + VMXNET3_VD_CMD, VMXNET3_CMD_UPDATE_VLAN_FILTERS);
+
+  // strip the tags too, so the stack gets the ID without parsing them
+  if (not (shared.misc.upt_features & UPT1_F_RXVLAN)) {
+    shared.misc.upt_features |= UPT1_F_RXVLAN;
+    mmio_write32(this->iobase + VMXNET3_VD_CMD, VMXNET3_CMD_UPDATE_FEATURE);
+  }
 }
 
 void vmxnet3::deactivate()
@@ -668,7 +888,7 @@ void vmxnet3::deactivate()
   // disable all queues
   this->disable_intr(0);
   this->disable_intr(1);
-  for (int q = 0; q < NUM_RX_QUEUES; q++)
+  for (int q = 0; q < m_rx_queues; q++)
     this->disable_intr(2 + q);
 
   // reset this device
@@ -686,6 +906,9 @@ void vmxnet3::move_to_this_cpu()
       this->irqs[i] = Events::get().subscribe(nullptr);
       m_pcidev.rebalance_msix_vector(i, SMP::cpu_id(), IRQ_BASE + this->irqs[i]);
     }
+    // the other RX queues stay with their CPUs
+    m_pcidev.set_msix_affinity(2, SMP::cpu_id());
+    rx_cpu[0] = SMP::cpu_id();
   }
 }
 
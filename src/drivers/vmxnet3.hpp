@@ -14,9 +14,12 @@ public:
   using Link          = net::Link_layer<net::Ethernet>;
   using Link_protocol = Link::Protocol;
   static const int DRIVER_OFFSET = 2;
-  static const int NUM_RX_QUEUES = 1;
+  // max RX queues, the number in use is decided at init
+  static const int NUM_RX_QUEUES = 8;
   static const int NUM_TX_DESC   = 128;
   static const int NUM_RX_DESC   = 512;
+  // the length field of a TX descriptor is 14 bits
+  static const int MAX_TX_LENGTH = (1 << 14) - 1;
 
   static std::unique_ptr<Nic> new_instance(hw::PCI_Device& d, const uint16_t MTU)
   { return std::make_unique<vmxnet3>(d, MTU); }
@@ -44,6 +47,16 @@ public:
 
   net::Packet_ptr create_packet(int) override;
 
+  /** Checksum offload, TSO and scatter-gather are part of the base device */
+  uint32_t offloads() const noexcept override
+  { return TX_CSUM_IP4 | TSO_IP4 | TX_SEGMENTS; }
+
+  /** A super-segment has to fit in a single TX descriptor */
+  uint32_t max_tso_size() const noexcept override
+  { return MAX_TX_LENGTH - frame_offset_link(); }
+
+  net::Packet_ptr create_tso_packet(int) override;
+
   /** Linklayer input. Hooks into IP-stack bottom, w.DOWNSTREAM data.*/
   void transmit(net::Packet_ptr pckt);
 
@@ -67,20 +80,35 @@ public:
 
   void add_vlan(const int id) override;
 
+  int rx_queues() const noexcept override
+  { return m_rx_queues; }
+
+  bool configure_rss(const RSS_config&) override;
+
+  RSS_config rss_config() const override;
+
+  bool set_rx_queue_cpu(int queue, int cpu) override;
+
+  int rx_queue_cpu(int queue) const override;
+
 private:
   void msix_evt_handler();
   void msix_xmit_handler();
-  void msix_recv_handler();
-  bool receive_handler(int);
+  void msix_recv_handler(int);
+  void init_rss();
+  int  receive_handler(int, int budget);
+  bool rx_pending(int) const noexcept;
   bool transmit_handler();
   void enable_intr(uint8_t idx) noexcept;
   void disable_intr(uint8_t idx) noexcept;
 
   inline int  tx_flush_diff() const noexcept;
   inline int  tx_tokens_free() const noexcept;
-  inline bool can_transmit() const noexcept;
-  void transmit_data(uint8_t* data, uint16_t);
+  inline bool can_transmit(int descriptors = 1) const noexcept;
+  void transmit_data(net::Packet*);
   net::Packet_ptr recv_packet(uint8_t* data, uint16_t);
+  bool jumbo_frames() const noexcept
+  { return MTU() > 1500; }
 
   // tx/rx ring state
   struct ring_stuff {
@@ -88,19 +116,26 @@ private:
     uint32_t producers  = 0;
     uint32_t prod_count = 0;
     uint32_t consumers  = 0;
+    uint32_t completions = 0;
     uint32_t flushvalue = 0;
   };
   struct rxring_state {
-    uint8_t* buffers[NUM_RX_DESC];
-    vmxnet3_rx_desc* desc0 = nullptr;
-    vmxnet3_rx_desc* desc1 = nullptr;
+    // ring 0 takes the first buffer of every frame, ring 1 the rest
+    // of jumbo frames
+    struct ring {
+      uint8_t* buffers[NUM_RX_DESC];
+      vmxnet3_rx_desc* desc = nullptr;
+      uint32_t producers  = 0;
+      uint32_t prod_count = 0;
+    } rings[2];
     vmxnet3_rx_comp* comp  = nullptr;
     int index = 0;
-    uint32_t producers  = 0;
-    uint32_t prod_count = 0;
     uint32_t consumers  = 0;
+    // the buffers of a frame received so far, until its last one
+    net::Packet_ptr partial = nullptr;
   };
   void refill(rxring_state&);
+  void refill(rxring_state&, int ring);
 
   bool     check_version();
   uint16_t check_link();
@@ -119,6 +154,11 @@ private:
 
   ring_stuff tx;
   rxring_state rx[NUM_RX_QUEUES];
+  // CPU servicing each RX queue
+  int rx_cpu[NUM_RX_QUEUES] = {0};
+  int m_rx_queues = 1;
+  // interrupt / polling mode of each RX queue
+  std::deque<Rx_poller> rx_pollers;
   // deferred transmit dma
   uint8_t  deferred_irq  = 0;
   bool     deferred_kick = false;
@@ -129,10 +169,10 @@ private:
   // sendq as double-ended q
   uint32_t& stat_sendq_cur;
   uint32_t& stat_sendq_max;
-  uint64_t& stat_tx_total_packets;
-  uint64_t& stat_tx_total_bytes;
-  uint64_t& stat_rx_total_packets;
-  uint64_t& stat_rx_total_bytes;
+  Stat_percpu& stat_tx_total_packets;
+  Stat_percpu& stat_tx_total_bytes;
+  Stat_percpu& stat_rx_total_packets;
+  Stat_percpu& stat_rx_total_bytes;
   uint64_t& stat_rx_zero_dropped;
   uint64_t& stat_rx_refill_dropped;
   uint64_t& stat_sendq_dropped;
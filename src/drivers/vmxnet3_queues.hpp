@@ -51,6 +51,29 @@ struct vmxnet3_interrupt_config {
   uint32_t reserved0[2];
 } __attribute__ (( packed ));
 
+/** Receive-side scaling feature */
+#define UPT1_F_RSS        0x2
+
+/** RSS hash types and function */
+#define UPT1_RSS_HASH_TYPE_IPV4     0x01
+#define UPT1_RSS_HASH_TYPE_TCP_IPV4 0x02
+#define UPT1_RSS_HASH_TYPE_IPV6     0x04
+#define UPT1_RSS_HASH_TYPE_TCP_IPV6 0x08
+#define UPT1_RSS_HASH_FUNC_TOEPLITZ 0x01
+
+#define UPT1_RSS_MAX_KEY_SIZE       40
+#define UPT1_RSS_MAX_IND_TABLE_SIZE 128
+
+/** RSS configuration, pointed to by the shared area */
+struct vmxnet3_rss_config {
+  uint16_t hash_type;
+  uint16_t hash_func;
+  uint16_t hash_key_size;
+  uint16_t ind_table_size;
+  uint8_t  hash_key[UPT1_RSS_MAX_KEY_SIZE];
+  uint8_t  ind_table[UPT1_RSS_MAX_IND_TABLE_SIZE];
+} __attribute__ (( packed ));
+
 /** Receive filter configuration */
 struct vmxnet3_rx_filter_config {
   /** Receive filter mode */
@@ -127,6 +150,13 @@ struct vmxnet3_tx_desc {
 /** Transmit completion request flag */
 #define VMXNET3_TXF_CQ 0x000002000UL
 
+/** Checksum start + offset (CSUM) or MSS (TSO), upper bits of flags[0] */
+#define VMXNET3_TXF_MSSCOF_SHIFT 18
+
+/** Offload modes, flags[1] bits 10-11, with header length in bits 0-9 */
+#define VMXNET3_OM_CSUM (2 << 10)
+#define VMXNET3_OM_TSO  (3 << 10)
+
 /** Transmit completion descriptor */
 struct vmxnet3_tx_comp {
   /** Index of the end-of-packet descriptor */
@@ -206,6 +236,14 @@ struct vmxnet3_rx_comp {
 
 /** Receive completion generation flag */
 #define VMXNET3_RXCF_GEN 0x80000000UL
+/** Receive completion: first and last buffer of a frame, and the queue
+    ID, which is above the number of RX queues for buffers of ring 1 */
+#define VMXNET3_RXCI_EOP        0x4000
+#define VMXNET3_RXCI_SOP        0x8000
+#define VMXNET3_RXCI_RQID_SHIFT 16
+/** Receive completion: VLAN tag stripped, with the TCI above the length */
+#define VMXNET3_RXCL_TS        0x8000
+#define VMXNET3_RXCL_TCI_SHIFT 16
 
 /** Receive queue control */
 struct vmxnet3_rx_queue_control {
@@ -273,7 +311,7 @@ struct vmxnet3_rx_queue {
 /**
  * Queue descriptor set
  *
- * We use only a single TX and RX queue
+ * We use a single TX queue, and one RX queue per CPU with RSS
  */
 struct vmxnet3_queues {
   /** Transmit queue descriptor(s) */
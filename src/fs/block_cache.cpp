@@ -0,0 +1,178 @@
+#include <fs/block_cache.hpp>
+#include <fs/common.hpp>
+#include <common>
+#include <statman>
+#include <algorithm>
+#include <cstring>
+
+namespace fs {
+
+  Block_cache::Block_cache(hw::Block_device& dev, size_t budget, size_t readahead)
+    : Block_device(),
+      dev_{dev},
+      readahead_{readahead},
+      hits_( Statman::get().create(
+             Stat::UINT64, device_name() + ".hits").get_uint64() ),
+      misses_( Statman::get().create(
+             Stat::UINT64, device_name() + ".misses").get_uint64() ),
+      readaheads_( Statman::get().create(
+             Stat::UINT64, device_name() + ".readahead").get_uint64() )
+  {
+    const size_t blocks = budget / dev.block_size();
+    Expects(blocks > 0 and blocks < NONE);
+    arena_.reset(new char[blocks * dev.block_size()]);
+    entries_.resize(blocks);
+    index_.reserve(blocks);
+    INFO("Block_cache", "Caching %zu blocks of %s", blocks, dev.device_name().c_str());
+  }
+
+  void Block_cache::unlink(uint32_t idx) noexcept
+  {
+    auto& ent = entries_[idx];
+    if (ent.prev != NONE) entries_[ent.prev].next = ent.next;
+    else lru_head_ = ent.next;
+    if (ent.next != NONE) entries_[ent.next].prev = ent.prev;
+    else lru_tail_ = ent.prev;
+    ent.prev = ent.next = NONE;
+  }
+
+  void Block_cache::push_front(uint32_t idx) noexcept
+  {
+    auto& ent = entries_[idx];
+    ent.prev = NONE;
+    ent.next = lru_head_;
+    if (lru_head_ != NONE) entries_[lru_head_].prev = idx;
+    lru_head_ = idx;
+    if (lru_tail_ == NONE) lru_tail_ = idx;
+  }
+
+  Block_cache::buffer_t Block_cache::lookup(block_t blk, size_t cnt)
+  {
+    // most reads are a block or a few, so check them all first
+    for (size_t i = 0; i < cnt; i++)
+      if (index_.find(blk + i) == nullptr) return nullptr;
+
+    const size_t bsize = block_size();
+    auto buffer = fs::construct_buffer(cnt * bsize);
+    for (size_t i = 0; i < cnt; i++)
+    {
+      const uint32_t idx = *index_.find(blk + i);
+      std::memcpy(buffer->data() + i * bsize, data_of(idx), bsize);
+      unlink(idx);
+      push_front(idx);
+    }
+    return buffer;
+  }
+
+  void Block_cache::insert(block_t blk, size_t cnt, const uint8_t* data)
+  {
+    // a read bigger than the cache keeps its last blocks
+    if (cnt > capacity()) {
+      data += (cnt - capacity()) * block_size();
+      blk  += cnt - capacity();
+      cnt   = capacity();
+    }
+    for (size_t i = 0; i < cnt; i++)
+    {
+      uint32_t idx;
+      if (auto* found = index_.find(blk + i)) {
+        idx = *found;
+        unlink(idx);
+      }
+      else if (used_ < capacity()) {
+        idx = used_++;
+      }
+      else {
+        // evict the least recently used
+        idx = lru_tail_;
+        unlink(idx);
+        index_.erase(entries_[idx].blk);
+      }
+      entries_[idx].blk = blk + i;
+      index_.insert_or_assign(blk + i, idx);
+      std::memcpy(data_of(idx), data + i * block_size(), block_size());
+      push_front(idx);
+    }
+  }
+
+  size_t Block_cache::readahead_for(block_t blk, size_t cnt) noexcept
+  {
+    const bool sequential = blk == last_end_;
+    last_end_ = blk + cnt;
+    if (not sequential or readahead_ == 0) return 0;
+    // never more than half the cache, or past the end of the device
+    const block_t end = std::min<block_t>(size(), blk + cnt + readahead_);
+    const size_t ahead = (end > blk + cnt) ? end - (blk + cnt) : 0;
+    return std::min(ahead, capacity() / 2);
+  }
+
+  void Block_cache::read(block_t blk, size_t cnt, on_read_func reader)
+  {
+    if (auto buffer = lookup(blk, cnt)) {
+      hits_++;
+      reader(std::move(buffer));
+      return;
+    }
+    misses_++;
+    const size_t ahead = readahead_for(blk, cnt);
+    if (ahead) readaheads_++;
+    dev_.read(blk, cnt + ahead, on_read_func::make_packed(
+    [this, blk, cnt, ahead, reader] (buffer_t buffer)
+    {
+      if (buffer == nullptr) {
+        reader(nullptr);
+        return;
+      }
+      insert(blk, std::min(cnt + ahead, buffer->size() / block_size()), buffer->data());
+      // the reader only gets what it asked for
+      if (ahead) buffer->resize(cnt * block_size());
+      reader(std::move(buffer));
+    }));
+  }
+
+  Block_cache::buffer_t Block_cache::read_sync(block_t blk, size_t cnt)
+  {
+    if (auto buffer = lookup(blk, cnt)) {
+      hits_++;
+      return buffer;
+    }
+    misses_++;
+    auto buffer = dev_.read_sync(blk, cnt);
+    if (buffer != nullptr)
+      insert(blk, std::min(cnt, buffer->size() / block_size()), buffer->data());
+    return buffer;
+  }
+
+  void Block_cache::invalidate(block_t blk, size_t cnt)
+  {
+    for (size_t i = 0; i < cnt; i++)
+    {
+      auto* found = index_.find(blk + i);
+      if (found == nullptr) continue;
+      const uint32_t idx = *found;
+      index_.erase(blk + i);
+      unlink(idx);
+      // move the last used entry into the hole, keeping them packed
+      const uint32_t last = --used_;
+      if (idx != last)
+      {
+        const block_t moved = entries_[last].blk;
+        unlink(last);
+        entries_[idx].blk = moved;
+        std::memcpy(data_of(idx), data_of(last), block_size());
+        index_.insert_or_assign(moved, idx);
+        push_front(idx);
+      }
+    }
+  }
+
+  void Block_cache::clear()
+  {
+    index_.clear();
+    for (auto& ent : entries_) ent = Entry{};
+    lru_head_ = lru_tail_ = NONE;
+    used_ = 0;
+    last_end_ = ~block_t(0);
+  }
+
+} //< namespace fs
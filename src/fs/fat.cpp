@@ -14,6 +14,13 @@
 //#define FS_PRINT(fmt, ...)  printf(fmt, ##__VA_ARGS__)
 #define FS_PRINT(fmt, ...)  /** **/
 
+// the largest FAT kept in memory, larger ones are assumed contiguous
+#define FAT_TABLE_MAX   (16u << 20)
+// chains of files kept in memory at once
+#define FAT_EXTENTS_MAX  1024
+// directory entries kept in memory at once
+#define FAT_DENTRIES_MAX 1024
+
 inline std::string trim_right_copy(
    const std::string& s,
    const std::string& delimiters = " \f\n\r\t\v" )
@@ -24,14 +31,40 @@ inline std::string trim_right_copy(
 namespace fs
 {
   FAT::FAT(hw::Block_device& dev)
-    : device(dev) {
+    : device(dev),
+      shrinker_{os::mem::add_shrinker("fs.fat", os::mem::Shrink_cost::moderate,
+                                      {this, &FAT::shrink})}
+  {
     //
   }
 
+  FAT::~FAT()
+  {
+    os::mem::remove_shrinker(shrinker_);
+  }
+
+  size_t FAT::shrink(os::mem::Pressure level)
+  {
+    // extents are rebuilt from the FAT in memory, entries need the disk
+    size_t freed = 0;
+    for (const auto& it : extent_cache)
+      freed += sizeof(it) + it.second.capacity() * sizeof(Extent);
+    extent_cache.clear();
+    if (level == os::mem::Pressure::critical)
+    {
+      freed += dentries.size() * (sizeof(Dentry_list::value_type) + 64);
+      dentries = {};
+      dentry_lru.clear();
+    }
+    return freed;
+  }
+
   void FAT::init(const void* base_sector) {
 
     // assume its the master boot record for now
     auto* mbr = (MBR::mbr*) base_sector;
+    this->dentries.clear();
+    this->dentry_lru.clear();
 
     MBR::BPB* bpb = mbr->bpb();
     this->sector_size = bpb->bytes_per_sector;
@@ -166,12 +199,151 @@ namespace fs
         INFO2("[ofs=%u  size=%u (%u bytes)]\n",
               this->lba_base, this->lba_size, this->lba_size * 512);
 
-        // on_init callback
-        on_init(no_error, *this);
+        if ((size_t) this->sectors_per_fat * sector_size > FAT_TABLE_MAX) {
+          on_init(no_error, *this);
+          return;
+        }
+        // read the first FAT in one go
+        device.read(
+          this->lba_base + this->reserved,
+          this->sectors_per_fat,
+          hw::Block_device::on_read_func::make_packed(
+          [this, on_init] (buffer_t table)
+          {
+            // without it files are read as if contiguous
+            if (table != nullptr)
+                load_table(table->data(), table->size());
+            on_init(no_error, *this);
+          })
+        );
       })
     );
   }
 
+  void FAT::load_table(const uint8_t* data, size_t len)
+  {
+    this->fat_table.assign(data, data + len);
+    this->extent_cache.clear();
+  }
+
+  uint32_t FAT::next_cluster(uint32_t cl) const noexcept
+  {
+    uint32_t next, end;
+    switch (this->fat_type) {
+    case T_FAT12: {
+      const size_t ofs = cl + cl / 2;
+      if (ofs + 1 >= fat_table.size()) return 0;
+      next = fat_table[ofs] | (fat_table[ofs+1] << 8);
+      next = (cl & 1) ? next >> 4 : next & 0xFFF;
+      end  = 0xFF8;
+      } break;
+    case T_FAT16:
+      if (cl * 2 + 1 >= fat_table.size()) return 0;
+      next = fat_table[cl*2] | (fat_table[cl*2+1] << 8);
+      end  = 0xFFF8;
+      break;
+    default:
+      if (cl * 4 + 3 >= fat_table.size()) return 0;
+      memcpy(&next, &fat_table[cl*4], 4);
+      next &= 0x0FFFFFFF;
+      end  = 0x0FFFFFF8;
+    }
+    // free, reserved, bad and end-of-chain all end it
+    if (next < 2 or next >= end or next >= this->clusters + 2) return 0;
+    return next;
+  }
+
+  const FAT::Extents& FAT::extents(uint32_t cluster) const
+  {
+    auto it = extent_cache.find(cluster);
+    if (it != extent_cache.end()) return it->second;
+    if (extent_cache.size() >= FAT_EXTENTS_MAX) extent_cache.clear();
+
+    Extents ext;
+    // the root directory, or no FAT to follow
+    if (cluster <= 2 or fat_table.empty()) {
+      ext.push_back({ cl_to_sector(cluster), UINT32_MAX });
+    }
+    else {
+      // at most one cluster each, so that a loop in the chain ends
+      for (uint32_t cl = cluster, n = 0; cl != 0 and n < this->clusters; n++)
+      {
+        const uint32_t sector = cl_to_sector(cl);
+        if (not ext.empty() and ext.back().sector + ext.back().count == sector)
+          ext.back().count += sectors_per_cluster;
+        else
+          ext.push_back({ sector, sectors_per_cluster });
+        cl = next_cluster(cl);
+      }
+      // past the end of the chain the file is assumed contiguous, like
+      // files in images made without a FAT
+      ext.back().count = UINT32_MAX;
+    }
+    return extent_cache.emplace(cluster, std::move(ext)).first->second;
+  }
+
+  FAT::Extents FAT::file_range(uint32_t cluster, uint32_t sector, uint32_t nsect) const
+  {
+    Extents range;
+    for (const auto& ext : extents(cluster))
+    {
+      if (nsect == 0) break;
+      if (sector >= ext.count) {
+        sector -= ext.count;
+        continue;
+      }
+      const uint32_t count = std::min(ext.count - sector, nsect);
+      range.push_back({ ext.sector + sector, count });
+      nsect -= count;
+      sector = 0;
+    }
+    if (nsect != 0) range.clear();
+    return range;
+  }
+
+  // the root directory is both cluster 0 and the root cluster
+  static uint32_t dentry_parent(uint32_t cluster) noexcept
+  {
+    return (cluster <= 2) ? 0 : cluster;
+  }
+
+  const Dirent* FAT::dentry_find(uint32_t cluster, const std::string& name) const
+  {
+    auto it = dentries.find({ dentry_parent(cluster), name });
+    if (it == dentries.end()) return nullptr;
+    // move to the front, as the most recently used
+    dentry_lru.splice(dentry_lru.begin(), dentry_lru, it->second);
+    return &it->second->second;
+  }
+
+  void FAT::dentry_insert(uint32_t cluster, const std::string& name, const Dirent& ent) const
+  {
+    Dentry_key key { dentry_parent(cluster), name };
+    auto it = dentries.find(key);
+    if (it != dentries.end()) {
+      dentry_lru.erase(it->second);
+      dentries.erase(it);
+    }
+    else if (dentries.size() >= FAT_DENTRIES_MAX) {
+      dentries.erase(dentry_lru.back().first);
+      dentry_lru.pop_back();
+    }
+    dentry_lru.emplace_front(key, ent);
+    dentries.emplace(std::move(key), dentry_lru.begin());
+  }
+
+  buffer_t FAT::trim_read(buffer_t data, uint32_t internal_ofs, uint64_t n)
+  {
+    // when the offset is non-zero we aren't on a sector boundary
+    if (internal_ofs != 0) {
+      return construct_buffer(data->begin() + internal_ofs, data->begin() + internal_ofs + n);
+    }
+    // when not offset all we have to do is resize the buffer down from
+    // a sector size multiple to its given length
+    data->resize(n);
+    return data;
+  }
+
   bool FAT::int_dirent(uint32_t sector, const void* data, dirvector& dirents) const
   {
     auto* root = (cl_dir*) data;
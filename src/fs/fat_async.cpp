@@ -3,12 +3,18 @@
 
 #include <cassert>
 #include <fs/path.hpp>
+#include <algorithm>
 #include <cstring>
 #include <memory>
 
 //#define FS_PRINT(fmt, ...)  printf(fmt, ##__VA_ARGS__)
 #define FS_PRINT(fmt, ...)  /** **/
 
+// sectors between parts of a readv() read over to merge them
+#define READV_GAP   8
+// the most sectors in one device read of a readv()
+#define READV_MAX   1024
+
 inline size_t roundup(size_t n, size_t multiple)
 {
   return ((n + multiple - 1) / multiple) * multiple;
@@ -59,6 +65,46 @@ namespace fs
     (*next)(sector);
   }
 
+  void FAT::lookup(uint32_t cluster, const std::string& name, on_stat_func callback) const
+  {
+    if (auto* found = dentry_find(cluster, name)) {
+      const Dirent ent = *found;
+      if (ent.type() == INVALID_ENTITY)
+        callback({ error_t::E_NOENT, name }, ent);
+      else
+        callback(no_error, ent);
+      return;
+    }
+
+    auto dirents = std::make_shared<dirvector> ();
+    int_ls(
+      this->cl_to_sector(cluster),
+      dirents,
+      on_internal_ls_func::make_packed(
+      [this, cluster, name, callback] (error_t err, Dirvec_ptr ents)
+      {
+        if (UNLIKELY(err)) {
+          callback(err, Dirent(this, INVALID_ENTITY, name));
+          return;
+        }
+        // look for name in directory
+        for (auto& e : *ents)
+        {
+          if (UNLIKELY(e.name() == name)) {
+            dentry_insert(cluster, name, e);
+            callback(no_error, e);
+            return;
+          }
+        }
+        FS_PRINT("NO MATCH for %s\n", name.c_str());
+        // names that don't exist are remembered too
+        Dirent missing(this, INVALID_ENTITY, name);
+        dentry_insert(cluster, name, missing);
+        callback({ error_t::E_NOENT, name }, missing);
+      })
+    );
+  }
+
   void FAT::traverse(std::shared_ptr<Path> path, cluster_func callback, const Dirent* const start) const
   {
     // parse this path into a stack of memes
@@ -89,48 +135,25 @@ namespace fs
       // retrieve next name
       std::string name = path->front();
       path->pop_front();
-
-      uint32_t S = this->cl_to_sector(cluster);
-      FS_PRINT("Current target: %s on cluster %u (sector %u)\n", name.c_str(), cluster, S);
-
-      // result allocated on heap
-      auto dirents = std::make_shared<std::vector<Dirent>> ();
+      FS_PRINT("Current target: %s on cluster %u\n", name.c_str(), cluster);
 
       auto next = weak_next.lock();
-      // list directory contents
-      int_ls(
-        S,
-        dirents,
-        on_internal_ls_func::make_packed(
-        [name, dirents, next, callback] (error_t err, Dirvec_ptr ents)
+      // find the name in the directory, or in the cache
+      lookup(
+        cluster,
+        name,
+        on_stat_func::make_packed(
+        [next, callback] (error_t err, Dirent ent)
         {
-          if (UNLIKELY(err))
-          {
-            FS_PRINT("Could not find: %s\n", name.c_str());
-            callback(err, dirents);
+          if (UNLIKELY(err)) {
+            callback(err, std::make_shared<dirvector> ());
             return;
           }
-
-          // look for name in directory
-          for (auto& e : *ents)
-          {
-            if (UNLIKELY(e.name() == name))
-            {
-              // go to this directory, unless its the last name
-              FS_PRINT("Found match for %s", name.c_str());
-              // enter the matching directory
-              FS_PRINT("\t\t cluster: %lu\n", e.block());
-              // only follow directories
-              if (e.type() == DIR)
-                (*next)(e.block());
-              else
-                callback({ error_t::E_NOTDIR, e.name() }, dirents);
-              return;
-            }
-          } // for (ents)
-
-          FS_PRINT("NO MATCH for %s\n", name.c_str());
-          callback({ error_t::E_NOENT, name }, dirents);
+          // only follow directories
+          if (ent.type() == DIR)
+            (*next)(ent.block());
+          else
+            callback({ error_t::E_NOTDIR, ent.name() }, std::make_shared<dirvector> ());
         })
       );
 
@@ -177,33 +200,186 @@ namespace fs
     uint32_t nsect = roundup(endpos, sector_size) / sector_size - sector;
     uint32_t internal_ofs = stapos % device.block_size();
 
-    // cluster -> sector + position
-    device.read(
-      this->cl_to_sector(ent.block()) + sector,
-      nsect,
-      hw::Block_device::on_read_func::make_packed(
-      [n, callback, internal_ofs] (buffer_t data)
+    const auto range = file_range(ent.block(), sector, nsect);
+    if (UNLIKELY(range.empty())) {
+      callback({ error_t::E_IO, "Unable to read file" }, nullptr);
+      return;
+    }
+    if (range.size() == 1)
+    {
+      // cluster -> sector + position
+      device.read(
+        range[0].sector,
+        nsect,
+        hw::Block_device::on_read_func::make_packed(
+        [n, callback, internal_ofs] (buffer_t data)
+        {
+          if (!data) {
+            // general I/O error occurred
+            callback({ error_t::E_IO, "Unable to read file" }, nullptr);
+            return;
+          }
+          callback(no_error, trim_read(std::move(data), internal_ofs, n));
+        })
+      );
+      return;
+    }
+
+    // a fragmented file, one read for each extent, all at once
+    struct gather_t {
+      buffer_t data;
+      size_t   left;
+      bool     failed = false;
+    };
+    auto gather = std::make_shared<gather_t> ();
+    gather->data = construct_buffer(nsect * device.block_size());
+    gather->left = range.size();
+    size_t ofs = 0;
+    for (const auto& ext : range)
+    {
+      device.read(
+        ext.sector,
+        ext.count,
+        hw::Block_device::on_read_func::make_packed(
+        [n, callback, internal_ofs, gather, ofs] (buffer_t data)
+        {
+          if (!data)
+            gather->failed = true;
+          else
+            memcpy(gather->data->data() + ofs, data->data(), data->size());
+          if (--gather->left != 0) return;
+
+          if (gather->failed)
+            callback({ error_t::E_IO, "Unable to read file" }, nullptr);
+          else
+            callback(no_error, trim_read(std::move(gather->data), internal_ofs, n));
+        })
+      );
+      ofs += ext.count * device.block_size();
+    }
+  }
+
+  void FAT::readv(std::vector<Read_request> reqs, on_readv_func callback) const
+  {
+    // the bytes of one request within one extent
+    struct segment_t {
+      uint32_t sector;
+      uint32_t count;
+      uint32_t skip; // into the first sector
+      uint32_t len;
+      uint8_t* dest;
+    };
+    std::vector<segment_t> segments;
+    segments.reserve(reqs.size());
+    size_t total = 0;
+
+    for (const auto& req : reqs)
+    {
+      // bounds check the read position and length
+      const uint64_t stapos = std::min(req.ent->size(), req.pos);
+      const uint64_t endpos = std::min(req.ent->size(), req.pos + req.len);
+      if (stapos == endpos) continue;
+      const uint32_t sector = stapos / this->sector_size;
+      const uint32_t nsect = roundup(endpos, sector_size) / sector_size - sector;
+
+      const auto range = file_range(req.ent->block(), sector, nsect);
+      if (UNLIKELY(range.empty())) {
+        callback({ error_t::E_IO, "Unable to read file" }, 0);
+        return;
+      }
+      auto*    dest = (uint8_t*) req.dest;
+      uint32_t skip = stapos % sector_size;
+      uint64_t left = endpos - stapos;
+      for (const auto& ext : range)
       {
-        if (!data) {
-          // general I/O error occurred
-          callback({ error_t::E_IO, "Unable to read file" }, nullptr);
-          return;
-        }
+        const uint32_t len = std::min<uint64_t>(left, (uint64_t) ext.count * sector_size - skip);
+        segments.push_back({ ext.sector, ext.count, skip, len, dest });
+        dest += len;
+        left -= len;
+        skip  = 0;
+      }
+      total += endpos - stapos;
+    }
+    if (segments.empty()) {
+      callback(no_error, 0);
+      return;
+    }
 
-        // when the offset is non-zero we aren't on a sector boundary
-        if (internal_ofs != 0) {
-          // so, we need to create new buffer with offset data
-          data = construct_buffer(data->begin() + internal_ofs, data->begin() + internal_ofs + n);
-        }
-        else {
-          // when not offset all we have to do is resize the buffer down from
-          // a sector size multiple to its given length
-          data->resize(n);
+    // merge into runs of sectors, reading over small gaps between them
+    std::sort(segments.begin(), segments.end(),
+    [] (const segment_t& a, const segment_t& b) {
+      return a.sector < b.sector;
+    });
+    struct run_t {
+      uint32_t sector;
+      uint32_t count;
+      size_t   first, last; // segments in it
+    };
+    std::vector<run_t> runs;
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+      const auto& seg = segments[i];
+      const uint32_t end = seg.sector + seg.count;
+      if (not runs.empty())
+      {
+        auto& run = runs.back();
+        const uint32_t run_end = run.sector + run.count;
+        if (seg.sector <= run_end + READV_GAP
+            and std::max(end, run_end) - run.sector <= READV_MAX)
+        {
+          run.count = std::max(end, run_end) - run.sector;
+          run.last  = i;
+          continue;
         }
+      }
+      runs.push_back({ seg.sector, seg.count, i, i });
+    }
 
-        callback(no_error, data);
-      })
-    );
+    struct gather_t {
+      std::vector<segment_t> segments;
+      size_t left;
+      bool   failed = false;
+    };
+    auto gather = std::make_shared<gather_t> ();
+    gather->segments = std::move(segments);
+    gather->left = runs.size();
+    const size_t bsize = device.block_size();
+    auto copy_out = [gather, bsize] (const run_t& run, const uint8_t* data)
+    {
+      for (size_t i = run.first; i <= run.last; i++) {
+        const auto& seg = gather->segments[i];
+        memcpy(seg.dest, data + (seg.sector - run.sector) * bsize + seg.skip, seg.len);
+      }
+    };
+
+    for (const auto& run : runs)
+    {
+      // straight from memory when the device is kept there
+      if (const char* data = device.mapped(run.sector, run.count)) {
+        copy_out(run, (const uint8_t*) data);
+        if (--gather->left == 0)
+          callback(no_error, total);
+        continue;
+      }
+      device.read(
+        run.sector,
+        run.count,
+        hw::Block_device::on_read_func::make_packed(
+        [gather, run, copy_out, callback, total] (buffer_t data)
+        {
+          if (data == nullptr)
+            gather->failed = true;
+          else
+            copy_out(run, data->data());
+          if (--gather->left != 0) return;
+
+          if (gather->failed)
+            callback({ error_t::E_IO, "Unable to read file" }, 0);
+          else
+            callback(no_error, total);
+        })
+      );
+    }
   }
 
   void FAT::stat(Path_ptr path, on_stat_func func, const Dirent* const start) const
@@ -214,57 +390,49 @@ namespace fs
       func(no_error, Dirent(this, DIR, "/", 0));
       return;
     }
-
     FS_PRINT("stat: %s\n", path->back().c_str());
-    // extract file we are looking for
-    std::string filename = path->back();
-    path->pop_back();
-
-    traverse(
-      path,
-      cluster_func::make_packed(
-      [this, filename, func] (error_t error, Dirvec_ptr dirents)
-      {
-        if (UNLIKELY(error)) {
-          // no path, no file!
-          func(error, Dirent(this, INVALID_ENTITY, filename));
-          return;
-        }
 
-        // find the matching filename in directory
-        for (auto& e : *dirents) {
-          if (UNLIKELY(e.name() == filename)) {
-            // return this dir entry
-            func(no_error, e);
+    // one lookup for each name, most often in the cache
+    typedef delegate<void(uint32_t)> next_func_t;
+    auto next = std::make_shared<next_func_t> ();
+    auto weak_next = std::weak_ptr<next_func_t>(next);
+    *next = next_func_t::make_packed(
+    [this, path, weak_next, func] (uint32_t cluster)
+    {
+      std::string name = path->front();
+      path->pop_front();
+
+      auto next = weak_next.lock();
+      lookup(
+        cluster,
+        name,
+        on_stat_func::make_packed(
+        [this, path, next, func] (error_t error, Dirent ent)
+        {
+          if (UNLIKELY(error)) {
+            // no path, no file!
+            func(error, ent);
             return;
           }
-        }
-
-        // not found
-        func({ error_t::E_NOENT, filename }, Dirent(this, INVALID_ENTITY, filename));
-      }),
-      start
-    );
+          if (path->empty()) {
+            func(no_error, ent);
+            return;
+          }
+          if (ent.type() != DIR) {
+            func({ error_t::E_NOTDIR, ent.name() }, Dirent(this, INVALID_ENTITY, ent.name()));
+            return;
+          }
+          (*next)(ent.block());
+        })
+      );
+    });
+    // start by reading provided dirent or root
+    (*next)(start ? start->block() : 0);
   }
 
   void FAT::cstat(const std::string& strpath, on_stat_func func)
   {
-    // cache lookup
-    auto it = stat_cache.find(strpath);
-    if (it != stat_cache.end()) {
-      FS_PRINT("used cached stat for %s\n", strpath.c_str());
-      func(no_error, it->second);
-      return;
-    }
-
-    File_system::stat(
-      strpath,
-      fs::on_stat_func::make_packed(
-      [this, strpath, func] (error_t error, const Dirent& ent)
-      {
-        stat_cache.emplace(strpath, ent);
-        func(error, ent);
-      })
-    );
+    // the entries on the path are cached by lookup()
+    File_system::stat(strpath, func);
   }
 }
@@ -28,22 +28,49 @@ namespace fs
     auto sector = stapos / this->sector_size;
     auto nsect = roundup(endpos, sector_size) / sector_size - sector;
 
-    // read @nsect sectors ahead
-    buffer_t data = device.read_sync(this->cl_to_sector(ent.block()) + sector, nsect);
-    // where to start copying from the device result
-    auto internal_ofs = stapos % device.block_size();
-    // when the offset is non-zero we aren't on a sector boundary
-    if (internal_ofs != 0) {
-      data = construct_buffer(data->begin() + internal_ofs, data->begin() + internal_ofs + n);
+    if (UNLIKELY(nsect == 0))
+      return Buffer(no_error, construct_buffer());
+    const auto range = file_range(ent.block(), sector, nsect);
+    if (UNLIKELY(range.empty()))
+      return Buffer({ error_t::E_IO, "Unable to read file" }, nullptr);
+    buffer_t data;
+    if (range.size() == 1) {
+      // read @nsect sectors ahead
+      data = device.read_sync(range[0].sector, nsect);
     }
     else {
-      // when not offset all we have to do is resize the buffer down from
-      // a sector size multiple to its given length
-      data->resize(n);
+      // a fragmented file, one read for each extent
+      data = construct_buffer(nsect * device.block_size());
+      size_t ofs = 0;
+      for (const auto& ext : range)
+      {
+        auto part = device.read_sync(ext.sector, ext.count);
+        if (UNLIKELY(!part)) { data = nullptr; break; }
+        memcpy(data->data() + ofs, part->data(), part->size());
+        ofs += part->size();
+      }
     }
+    if (UNLIKELY(!data))
+      return Buffer({ error_t::E_IO, "Unable to read file" }, nullptr);
+    data = trim_read(std::move(data), stapos % device.block_size(), n);
     return Buffer(no_error, std::move(data));
   }
 
+  const char* FAT::map(const Dirent& ent, uint64_t pos, uint64_t n) const
+  {
+    if (UNLIKELY(n == 0 or pos > ent.size() or n > ent.size() - pos))
+      return nullptr;
+    auto sector = pos / this->sector_size;
+    auto nsect = roundup(pos + n, sector_size) / sector_size - sector;
+    // only ranges within one extent can be mapped
+    const auto range = file_range(ent.block(), sector, nsect);
+    if (range.size() != 1) return nullptr;
+
+    const char* data = device.mapped(range[0].sector, nsect);
+    if (data == nullptr) return nullptr;
+    return data + pos % device.block_size();
+  }
+
   error_t FAT::int_ls(uint32_t sector, dirvector& ents) const
   {
     bool done = false;
@@ -60,45 +87,50 @@ namespace fs
     return no_error;
   }
 
+  error_t FAT::lookup(uint32_t cluster, const std::string& name, Dirent& result) const
+  {
+    if (auto* ent = dentry_find(cluster, name)) {
+      result = *ent;
+    }
+    else {
+      // sync read entire directory
+      dirvector ents;
+      auto err = int_ls(this->cl_to_sector(cluster), ents);
+      if (UNLIKELY(err)) return err;
+
+      result = Dirent(this, INVALID_ENTITY, name);
+      for (auto& e : ents)
+      if (UNLIKELY(e.name() == name)) {
+        result = e;
+        break;
+      }
+      // names that don't exist are remembered too
+      dentry_insert(cluster, name, result);
+    }
+    if (result.type() == INVALID_ENTITY) {
+      FS_PRINT("lookup_sync: NO MATCH for %s\n", name.c_str());
+      return { error_t::E_NOENT, name };
+    }
+    return no_error;
+  }
+
   error_t FAT::traverse(Path path, dirvector& ents, const Dirent* const start) const
   {
     // start with given entry (defaults to root)
     uint32_t cluster = start ? start->block() : 0;
-    Dirent found(this, INVALID_ENTITY);
 
     while (!path.empty()) {
-
-      auto S = this->cl_to_sector(cluster);
-      ents.clear(); // mui importante
-      // sync read entire directory
-      auto err = int_ls(S, ents);
-      if (UNLIKELY(err)) return err;
       // the name we are looking for
       const std::string name = path.front();
       path.pop_front();
 
-      // check for matches in dirents
-      for (auto& e : ents)
-      if (UNLIKELY(e.name() == name)) {
-        // go to this directory, unless its the last name
-        FS_PRINT("traverse_sync: Found match for %s", name.c_str());
-        // enter the matching directory
-        FS_PRINT("\t\t cluster: %lu\n", e.block());
-        // only follow if the name is a directory
-        if (e.type() == DIR) {
-          found = e;
-          break;
-        }
-        else {
-          // not dir = error, for now
-          return { error_t::E_NOTDIR, "Cannot list non-directory" };
-        }
-      } // for (ents)
-
-      // validate result
-      if (found.type() == INVALID_ENTITY) {
-        FS_PRINT("traverse_sync: NO MATCH for %s\n", name.c_str());
-        return { error_t::E_NOENT, name };
+      Dirent found(this, INVALID_ENTITY);
+      auto err = lookup(cluster, name, found);
+      if (UNLIKELY(err)) return err;
+      // only follow if the name is a directory
+      if (found.type() != DIR) {
+        // not dir = error, for now
+        return { error_t::E_NOTDIR, "Cannot list non-directory" };
       }
       // set next cluster
       cluster = found.block();
@@ -137,24 +169,20 @@ namespace fs
     }
 
     FS_PRINT("stat_sync: %s\n", path.back().c_str());
-    // extract file we are looking for
-    const std::string filename = path.back();
-    path.pop_back();
-
-    // result directory entries are put into @dirents
-    dirvector dirents;
-
-    auto err = traverse(path, dirents, start);
-    if (UNLIKELY(err))
-      return Dirent(this, INVALID_ENTITY); // for now
-
-    // find the matching filename in directory
-    for (auto& e : dirents)
-    if (UNLIKELY(e.name() == filename)) {
-      // return this directory entry
-      return e;
+    // one lookup for each name, most often in the cache
+    uint32_t cluster = start ? start->block() : 0;
+    Dirent found(this, INVALID_ENTITY);
+    while (!path.empty()) {
+      const std::string name = path.front();
+      path.pop_front();
+
+      auto err = lookup(cluster, name, found);
+      if (UNLIKELY(err))
+        return Dirent(this, INVALID_ENTITY); // for now
+      if (not path.empty() and found.type() != DIR)
+        return Dirent(this, INVALID_ENTITY);
+      cluster = found.block();
     }
-    // entry not found
-    return Dirent(this, INVALID_ENTITY);
+    return found;
   }
 }
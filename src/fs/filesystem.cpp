@@ -1,6 +1,8 @@
 
 #include <common>
+#include <algorithm>
 #include <array>
+#include <cstring>
 
 #include <fs/dirent.hpp>
 
@@ -52,6 +54,57 @@ namespace fs
       return read(ent, 0, ent.size());
   }
 
+  void File_system::readv(std::vector<Read_request> reqs, on_readv_func callback) const
+  {
+    struct gather_t {
+      size_t  left;
+      size_t  total  = 0;
+      error_t error  = no_error;
+    };
+    auto gather = std::make_shared<gather_t> ();
+    // one more, so that reads completing right away don't finish early
+    gather->left = reqs.size() + 1;
+    auto done = [gather, callback] {
+      if (--gather->left == 0) callback(gather->error, gather->total);
+    };
+
+    for (const auto& req : reqs)
+    {
+      if (req.len == 0) continue;
+      read(*req.ent, req.pos, req.len,
+      on_read_func::make_packed(
+      [gather, dest = req.dest, done] (error_t err, buffer_t data)
+      {
+        if (UNLIKELY(err or data == nullptr)) {
+          if (not gather->error) gather->error = err ? err : error_t{error_t::E_IO, "Unable to read file"};
+        }
+        else {
+          std::memcpy(dest, data->data(), data->size());
+          gather->total += data->size();
+        }
+        done();
+      }));
+    }
+    done();
+  }
+
+  View File_system::view(const Dirent& ent, uint64_t pos, uint64_t n) const
+  {
+    // bounds check the position and length, as for read()
+    if (UNLIKELY(pos >= ent.size())) return {};
+    n = std::min(n, ent.size() - pos);
+    const auto* data = (const uint8_t*) map(ent, pos, n);
+    if (data == nullptr) return {};
+    return View{data, data + n};
+  }
+
+  View File_system::view_file(const std::string& path) const
+  {
+    auto ent = stat(path);
+    if (UNLIKELY(!ent.is_file())) return {};
+    return view(ent, 0, ent.size());
+  }
+
   static error_t print_subtree(Dirvec_ptr entries, int depth)
   {
     int indent = depth * 3;
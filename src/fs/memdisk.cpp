@@ -43,6 +43,14 @@ namespace fs {
     return fs::construct_buffer(start_loc, end_loc);
   }
 
+  const char* MemDisk::mapped(block_t blk, size_t cnt) const noexcept
+  {
+    const auto* start_loc = image_start_ + blk * block_size();
+    if (UNLIKELY(blk >= size() or cnt > size() - blk))
+      return nullptr;
+    return start_loc;
+  }
+
   MemDisk::block_t MemDisk::size() const noexcept {
     // we are NOT going to round up to "support" unevenly sized
     // disks that are not created as multiples of sectors
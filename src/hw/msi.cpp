@@ -1,7 +1,14 @@
 #include <hw/msi.hpp>
 
 #include <hw/pci_device.hpp>
+#include <kernel/events.hpp>
 #include <info>
+#include <smp>
+
+#if defined(ARCH_aarch64)
+// from the GIC of the platform
+extern "C" uint64_t gic_its_map_msi(uint32_t device, uint32_t event, int cpu, uint32_t intr);
+#endif
 
 //#define VERBOSE_MSIX
 #ifdef VERBOSE_MSIX
@@ -43,7 +50,8 @@ namespace hw
   inline uint32_t msix_data_single_vector(uint8_t vector)
   {
     assert(vector >= 32 && vector != 0xff);
-    const uint32_t DM = 0x1; // low-pri
+    // fixed, so that it only goes to the chosen CPU
+    const uint32_t DM = 0x0;
     const uint32_t TM = 0;
 
     return (TM << 15) | (DM << 8) | vector;
@@ -149,6 +157,7 @@ namespace hw
       return;
     }
     used_vectors.resize(vector_cnt);
+    bindings.resize(vector_cnt);
 
     // manually mask all entries
     for (size_t i = 0; i < this->vectors(); i++) {
@@ -183,11 +192,80 @@ namespace hw
     INFO2("MSI-X vector %u pointing to cpu %u intr %u", idx, cpu, intr);
 
     mask_entry(idx);
+#if defined(ARCH_aarch64)
+    // the ITS translates the vector, as event of the device, to an LPI
+    const uint64_t addr = gic_its_map_msi(dev.pci_addr(), idx, cpu, intr);
+    mm_write(get_entry(idx, ENT_MSG_ADDR), (uint32_t) addr);
+    mm_write(get_entry(idx, ENT_MSG_UPPER), addr >> 32);
+    mm_write(get_entry(idx, ENT_MSG_DATA), idx);
+#else
     mm_write(get_entry(idx, ENT_MSG_ADDR), msix_addr_for_cpu(cpu));
     mm_write(get_entry(idx, ENT_MSG_UPPER), 0x0);
     mm_write(get_entry(idx, ENT_MSG_DATA), msix_data_single_vector(intr));
+#endif
     unmask_entry(idx);
     // mark as being used
     this->used_vectors.at(idx) = true;
   }
+
+  void msix_t::bind_vector(uint16_t idx, int cpu, handler_t handler)
+  {
+    assert(handler != nullptr);
+    bindings.at(idx).handler = std::move(handler);
+    set_affinity(idx, cpu);
+  }
+
+  void msix_t::set_affinity(uint16_t idx, int cpu)
+  {
+    auto& b = bindings.at(idx);
+    assert(b.handler != nullptr && "MSI-X vector must be bound first");
+    assert(cpu >= 0 && cpu < (int) SMP::early_cpu_total());
+    b.cpu = cpu;
+
+    // events are subscribed to by the CPU that handles them
+    auto attach = [this, idx] () { this->attach_here(idx); };
+    if (cpu == SMP::cpu_id())
+      attach();
+    else if (cpu == 0)
+      SMP::add_bsp_task(attach);
+    else {
+      SMP::add_task(attach, nullptr, cpu);
+      SMP::signal(cpu);
+    }
+  }
+
+  int msix_t::affinity(uint16_t idx) const
+  {
+    return bindings.at(idx).cpu;
+  }
+
+  void msix_t::attach_here(uint16_t idx)
+  {
+    auto& b = bindings[idx];
+    const int cpu = SMP::cpu_id();
+    if (b.bound_cpu == cpu) {
+      // a new handler for the same CPU
+      Events::get().subscribe(b.evt, b.handler);
+      return;
+    }
+    const int     old_cpu = b.bound_cpu;
+    const uint8_t old_evt = b.evt;
+    b.evt = Events::get().subscribe(b.handler);
+    b.bound_cpu = cpu;
+    redirect_vector(idx, cpu, IRQ_BASE + b.evt);
+    if (old_cpu < 0) return;
+
+    // the old CPU may have an interrupt pending still, so once it has
+    // let go of the handler, it's called here in case that one was lost
+    const uint8_t new_evt = b.evt;
+    auto release = [cpu, old_evt, new_evt] () {
+      Events::get().unsubscribe(old_evt);
+      while (not Events::get(cpu).post([new_evt] () {
+          Events::get().trigger_event(new_evt);
+        }))
+        asm volatile("pause");
+    };
+    while (not Events::get(old_cpu).post(release))
+        asm volatile("pause");
+  }
 }
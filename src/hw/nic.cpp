@@ -1,5 +1,8 @@
 
 #include <hw/nic.hpp>
+#include <kernel/events.hpp>
+#include <smp>
+#include <algorithm>
 
 namespace hw
 {
@@ -9,4 +12,72 @@ namespace hw
     (void) idx;
     return default_MTU;
   }
+
+  __attribute__((weak))
+  int Nic::queue_pairs_override(int idx, const int max_pairs)
+  {
+    (void) idx; (void) max_pairs;
+    return 1;
+  }
+
+  // RX queues being polled by each CPU
+  struct alignas(SMP_ALIGN) smp_rx_pollers
+  {
+    std::vector<Nic::Rx_poller*> list;
+    uint8_t irq;
+    bool    initialized = false;
+  };
+  static std::vector<smp_rx_pollers> rx_pollers;
+  SMP_RESIZE_LATE_GCTOR(rx_pollers);
+
+  Nic::Rx_poller::Rx_poller(poll_func poll, rearm_func rearm, int budget)
+    : poll_{poll}, rearm_{rearm}, budget_{budget}
+  {
+    Expects(budget > 0);
+  }
+
+  Nic::Rx_poller::~Rx_poller()
+  {
+    if (scheduled()) {
+      auto& list = rx_pollers.at(cpu_).list;
+      list.erase(std::remove(list.begin(), list.end(), this), list.end());
+    }
+  }
+
+  void Nic::Rx_poller::schedule()
+  {
+    if (scheduled()) return;
+    auto& pollers = PER_CPU(rx_pollers);
+    if (not pollers.initialized) {
+      pollers.initialized = true;
+      pollers.irq = Events::get().subscribe(poll_round);
+    }
+    this->cpu_ = SMP::cpu_id();
+    pollers.list.push_back(this);
+    Events::get().trigger_event(pollers.irq);
+  }
+
+  void Nic::Rx_poller::poll_round()
+  {
+    auto& pollers = PER_CPU(rx_pollers);
+    // pollers may be added while polling, they wait for the next round
+    const auto round = std::move(pollers.list);
+    pollers.list.clear();
+
+    for (auto* poller : round)
+    {
+      const int received = poller->poll_(poller->budget_);
+      // the whole budget was used, there is probably more
+      if (received >= poller->budget_) {
+        pollers.list.push_back(poller);
+      }
+      else {
+        poller->cpu_ = -1;
+        if (poller->rearm_()) poller->schedule();
+      }
+    }
+    // other events get their turn before the next round
+    if (not pollers.list.empty())
+      Events::get().trigger_event(pollers.irq);
+  }
 }
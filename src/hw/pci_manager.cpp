@@ -26,28 +26,62 @@ static std::vector<hw::PCI_Device> devices_;
 static std::vector<Driver_entry<PCI_manager::NIC_driver>> nic_fact;
 static std::vector<Driver_entry<PCI_manager::BLK_driver>> blk_fact;
 
+template <typename Class, typename Factory>
+static std::unique_ptr<Class> construct_driver(hw::PCI_Device& dev,
+                                               const Factory& factory,
+                                               const ssize_t idx)
+{
+  if constexpr(std::is_same<Class, hw::Nic>::value)
+    return factory(dev, hw::Nic::MTU_detection_override(idx, 1500));
+  else
+    return factory(dev);
+}
+
+// drivers for a whole class have no vendor, and the class as product
+static const uint16_t ANY_VENDOR = 0xFFFF;
+
+inline uint32_t driver_id(uint16_t vendor, uint16_t prod) {
+  return (uint32_t) prod << 16 | vendor;
+}
+
+template <typename Factory>
+static ssize_t find_driver(const hw::PCI_Device& dev,
+                           const fixed_factory_t<Factory>& factory)
+{
+  for (size_t f = 0; f < factory.size(); f++)
+    if (factory[f].first == dev.vendor_product()) return f;
+  const uint32_t class_id =
+      driver_id(ANY_VENDOR, (uint16_t) dev.classcode() << 8 | dev.subclass());
+  for (size_t f = 0; f < factory.size(); f++)
+    if (factory[f].first == class_id) return f;
+  return -1;
+}
+
 template <typename Factory, typename Class>
-static inline bool register_device(hw::PCI_Device& dev,
+static inline bool register_device(const size_t dev_idx,
                                    fixed_factory_t<Factory>& factory) {
+  auto& dev = devices_.at(dev_idx);
   INFO2("|--[ %s ]", dev.to_string().c_str());
-  for (const auto& fact : factory) {
-    if (fact.first == dev.vendor_product())
-    {
+  const ssize_t f = find_driver(dev, factory);
+  if (f >= 0)
+  {
       INFO2("|");
-      auto driver = [&]
+      const ssize_t idx = os::machine().count<Class>();
+      const auto type = std::is_same<Class, hw::Nic>::value
+                      ? hw::Device::Type::Nic : hw::Device::Type::Block;
+      if (PCI_manager::lazy_activation_override(type, idx))
       {
-        if constexpr(std::is_same<Class, hw::Nic>::value)
-        {
-          const ssize_t idx = os::machine().count<hw::Nic>();
-          return fact.second(dev, hw::Nic::MTU_detection_override(idx, 1500));
-        }
-        else {
-          return fact.second(dev);
-        }
-      }();
-      os::machine().add<Class>(std::move(driver));
+        INFO2("|  +-o Activated on first use");
+        // by index, as the tables can grow until then
+        os::machine().add_lazy<Class>(
+        [&factory, f, dev_idx, idx] () -> void* {
+          return construct_driver<Class>(devices_.at(dev_idx),
+                                          factory[f].second, idx).release();
+        });
+        return true;
+      }
+      os::machine().add<Class>(construct_driver<Class>(dev, factory[f].second, idx));
       return true;
-    }
   }
   INFO2("|  +-x Driver not found ");
   return false;
@@ -103,15 +137,16 @@ void PCI_manager::init_devices(const uint8_t classcode)
       continue;
 
     auto& stored_dev = devices_.emplace_back(pci_addr, id, devclass.reg);
+    const size_t dev_idx = devices_.size() - 1;
     // translate classcode to device and register
     switch (devclass.classcode)
     {
       case PCI::STORAGE: {
-        register_device<BLK_driver, hw::Block_device>(stored_dev, blk_fact);
+        register_device<BLK_driver, hw::Block_device>(dev_idx, blk_fact);
         break;
       }
       case PCI::NIC: {
-        register_device<NIC_driver, hw::Nic>(stored_dev, nic_fact);
+        register_device<NIC_driver, hw::Nic>(dev_idx, nic_fact);
         break;
       }
       default:
@@ -131,10 +166,15 @@ void PCI_manager::init()
    * Starting with the first bus
   **/
   scan_bus(0);
+  // drivers keep references to their devices
+  devices_.reserve(devinfos_.size());
 }
 
-inline uint32_t driver_id(uint16_t vendor, uint16_t prod) {
-  return (uint32_t) prod << 16 | vendor;
+__attribute__((weak))
+bool PCI_manager::lazy_activation_override(Device::Type type, int idx)
+{
+  (void) type; (void) idx;
+  return false;
 }
 
 void PCI_manager::register_nic(uint16_t vendor, uint16_t prod, NIC_driver factory)
@@ -145,5 +185,9 @@ void PCI_manager::register_blk(uint16_t vendor, uint16_t prod, BLK_driver factor
 {
   blk_fact.emplace_back(driver_id(vendor, prod), factory);
 }
+void PCI_manager::register_blk_class(uint8_t classcode, uint8_t subclass, BLK_driver factory)
+{
+  blk_fact.emplace_back(driver_id(ANY_VENDOR, (uint16_t) classcode << 8 | subclass), factory);
+}
 
 }
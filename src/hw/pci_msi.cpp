@@ -59,6 +59,19 @@ namespace hw
   {
     msix->redirect_vector(idx, cpu, irq);
   }
+  void PCI_Device::bind_msix_vector(uint16_t idx, int cpu, delegate<void()> handler)
+  {
+    msix->bind_vector(idx, cpu, std::move(handler));
+  }
+  void PCI_Device::set_msix_affinity(uint16_t idx, int cpu)
+  {
+    msix->set_affinity(idx, cpu);
+  }
+  int PCI_Device::msix_affinity(uint16_t idx) const
+  {
+    if (this->msix == nullptr) return -1;
+    return msix->affinity(idx);
+  }
 
   void PCI_Device::deactivate_msix()
   {
@@ -12,9 +12,9 @@ inline static size_t aligned_size_from_mtu(uint16_t mtu) {
   return 65536;
 }
 
-UserNet::UserNet(const uint16_t mtu)
+UserNet::UserNet(const uint16_t mtu, uint32_t buffers)
   : Link(Link::Protocol{{this, &UserNet::transmit}, MAC_ADDRESS}),
-    mtu_value(mtu), buffer_store(256u, aligned_size_from_mtu(mtu)) {}
+    mtu_value(mtu), buffer_store(buffers, aligned_size_from_mtu(mtu)) {}
 
 UserNet& UserNet::create(const uint16_t mtu)
 {
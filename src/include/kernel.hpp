@@ -95,6 +95,9 @@ namespace kernel {
     return state().cpu_khz;
   }
 
+  /** Set the CPU frequency, and the scaling of cycles to nanoseconds **/
+  void set_cpu_freq(util::KHz);
+
   /** First address of the heap **/
   inline uintptr_t heap_begin() noexcept {
     return state().heap_begin;
@@ -105,6 +108,25 @@ namespace kernel {
     return state().heap_max;
   }
 
+  /** NUMA topology, as found by the platform (proximity domains are the
+      firmware's numbers, and are given node numbers in order of appearance) */
+  void numa_add_range(uintptr_t begin, uintptr_t end, uint32_t domain);
+  void numa_add_cpu(int cpu, uint32_t domain);
+  void numa_set_distance(uint32_t from, uint32_t to, uint8_t distance);
+
+  /** Follow the frame pointers up from fp, the frame of the function
+      current is in, while they look sane. Innermost first, returns count */
+  uint32_t walk_stack(uintptr_t* frames, uint32_t max,
+                      uintptr_t current, uintptr_t fp) noexcept;
+
+  /** Mark the beginning of a boot phase, timed in CPU cycles until the
+      next one. Works from right after .bss is cleared, without a heap */
+  void boot_phase(const char* name) noexcept;
+
+  /** End the last boot phase, and export the timeline to Statman as
+      boot.<phase> gauges (boot.<phase>.cycles without a CPU frequency) */
+  void boot_finish();
+
   /** Initialize platform, devices etc. */
   void start(uint32_t boot_magic, uint32_t boot_addr);
   void start(uint64_t fdt);
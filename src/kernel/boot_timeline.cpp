@@ -0,0 +1,83 @@
+#include <kernel.hpp>
+#include <arch.hpp>
+#include <os.hpp>
+#include <statman>
+#include <cstdio>
+#include <string>
+
+// phases of the boot, marked as they begin
+#define BOOT_PHASES  48
+
+struct Boot_mark {
+  const char* name;
+  uint64_t    cycles;
+};
+// in .bss, as marks are set long before there are any constructors
+static Boot_mark boot_marks[BOOT_PHASES];
+static uint32_t  boot_count = 0;
+static bool      boot_finished = false;
+
+void kernel::boot_phase(const char* name) noexcept
+{
+  if (boot_finished or boot_count == BOOT_PHASES) return;
+  boot_marks[boot_count++] = {name, os::Arch::cpu_cycles()};
+}
+
+// solo5 and x86_nano don't calibrate the TSC, so their timeline is in cycles
+static bool in_cycles()
+{
+  return os::cpu_freq().count() <= 0.0;
+}
+
+static double cycles_to_unit(uint64_t cycles)
+{
+  if (in_cycles()) return cycles;
+  return cycles / (os::cpu_freq().count() / 1000.0);
+}
+
+void kernel::boot_finish()
+{
+  if (boot_finished or boot_count == 0) return;
+  // the end of the last phase
+  boot_phase(nullptr);
+  boot_finished = true;
+
+  // each phase as a gauge in microseconds, like boot.ACPI init,
+  // or in cycles, like boot.ACPI init.cycles
+  auto& statman = Statman::get();
+  const std::string suffix = in_cycles() ? ".cycles" : "";
+  for (uint32_t i = 0; i + 1 < boot_count; i++)
+  {
+    const auto value = cycles_to_unit(boot_marks[i+1].cycles - boot_marks[i].cycles);
+    auto& stat = statman.get_or_create(Stat::UINT64,
+        std::string("boot.") + boot_marks[i].name + suffix);
+    stat.get_uint64() = value;
+    stat.make_gauge();
+  }
+  auto& total = statman.get_or_create(Stat::UINT64, "boot.total" + suffix);
+  total.get_uint64() = cycles_to_unit(boot_marks[boot_count-1].cycles - boot_marks[0].cycles);
+  total.make_gauge();
+
+  if (kernel::timestamps()) os::print_boot_timeline();
+}
+
+void os::print_boot_timeline()
+{
+  if (boot_count == 0) return;
+  const uint32_t phases = boot_finished ? boot_count - 1 : boot_count;
+  const uint64_t begin = boot_marks[0].cycles;
+  printf("Boot timeline - %u phases (%s)\n", phases, in_cycles() ? "cycles" : "us");
+  printf("%10s %10s  %s\n", "Start", "Duration", "Phase");
+  for (uint32_t i = 0; i < phases; i++)
+  {
+    // the last phase is still going when not finished
+    const uint64_t end = (i + 1 < boot_count) ? boot_marks[i+1].cycles
+                                              : os::Arch::cpu_cycles();
+    printf("%10.0f %10.0f  %s\n",
+           cycles_to_unit(boot_marks[i].cycles - begin),
+           cycles_to_unit(end - boot_marks[i].cycles),
+           boot_marks[i].name);
+  }
+  if (boot_finished)
+    printf("%10s %10.0f  %s\n", "", cycles_to_unit(boot_marks[phases].cycles - begin), "Total");
+}
@@ -36,6 +36,8 @@ namespace CPUID {
       {Feature::RDTSCP,"RDTSCP"},
       {Feature::FMA, "FMA"},
       {Feature::AVX2, "AVX2"},
+      {Feature::AVX512F, "AVX512F"},
+      {Feature::AVX512BW, "AVX512BW"},
       {Feature::BMI1,"BMI1"},
       {Feature::BMI2,"BMI2"},
       {Feature::LZCNT,"LZCNT"},
@@ -91,7 +93,9 @@ namespace CPUID {
       {Feature::RDTSCP,"RDTSCP"},
       {Feature::LM,"LM"},
       {Feature::SVM,"SVM"},
-      {Feature::TSC_INV,"TSC_INV"}
+      {Feature::TSC_INV,"TSC_INV"},
+      {Feature::WAITPKG,"WAITPKG"},
+      {Feature::SHA,"SHA"}
   };
 }
 
@@ -194,11 +198,15 @@ namespace
       case Feature::SVM:          return FeatureInfo { 0x80000001, 0, Register::ECX, 1u <<  2 }; // Secure Virtual Machine (AMD-V)
       case Feature::SSE4A:        return FeatureInfo { 0x80000001, 0, Register::ECX, 1u <<  6 }; // SSE4a
       // Standard function 7
-      case Feature::AVX2:         return FeatureInfo { 7, 0, Register::ECX, 1u <<  5 }; // AVX2
-      case Feature::BMI1:         return FeatureInfo { 7, 0, Register::ECX, 1u <<  3 }; // BMI1
-      case Feature::BMI2:         return FeatureInfo { 7, 0, Register::ECX, 1u <<  8 }; // BMI2
-      case Feature::LZCNT:        return FeatureInfo { 7, 0, Register::ECX, 1u <<  5 }; // LZCNT
+      case Feature::AVX2:         return FeatureInfo { 7, 0, Register::EBX, 1u <<  5 }; // AVX2
+      case Feature::BMI1:         return FeatureInfo { 7, 0, Register::EBX, 1u <<  3 }; // BMI1
+      case Feature::BMI2:         return FeatureInfo { 7, 0, Register::EBX, 1u <<  8 }; // BMI2
+      case Feature::AVX512F:      return FeatureInfo { 7, 0, Register::EBX, 1u << 16 }; // AVX-512 Foundation
+      case Feature::AVX512BW:     return FeatureInfo { 7, 0, Register::EBX, 1u << 30 }; // AVX-512 Byte and Word
+      case Feature::LZCNT:        return FeatureInfo { 0x80000001, 0, Register::ECX, 1u <<  5 }; // LZCNT
       case Feature::RDSEED:       return FeatureInfo { 7, 0, Register::EBX, 1u << 18 }; // RDSEED
+      case Feature::WAITPKG:      return FeatureInfo { 7, 0, Register::ECX, 1u <<  5 }; // UMONITOR/UMWAIT/TPAUSE
+      case Feature::SHA:          return FeatureInfo { 7, 0, Register::EBX, 1u << 29 }; // SHA extensions
       default: throw std::out_of_range("Unimplemented CPU feature encountered");
     }
   }
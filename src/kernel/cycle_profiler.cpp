@@ -0,0 +1,145 @@
+#include <profile>
+#include <smp>
+#include <smp_utils>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <unordered_map>
+
+// handlers and peers counted per CPU, the rest go into the last one
+#define CYCLE_SITES  256
+
+namespace
+{
+  struct cycle_site
+  {
+    uint64_t key = 0;
+    uint64_t calls = 0;
+    uint64_t cycles = 0;
+    uint64_t max_cycles = 0;
+    Cycle_sample::Kind kind = Cycle_sample::EVENT;
+  };
+  // only written by its own CPU, so no atomics (or locks!) needed
+  struct alignas(SMP_ALIGN) cycle_table
+  {
+    std::array<cycle_site, CYCLE_SITES> sites;
+  };
+  std::array<cycle_table, SMP_MAX_CORES> cycle_tables;
+
+  cycle_site& find_site(cycle_table& table, Cycle_sample::Kind kind, uint64_t key) noexcept
+  {
+    // open addressing, with the last entry for when it's full
+    const size_t buckets = CYCLE_SITES - 1;
+    size_t idx = ((key ^ ((uint64_t) kind << 56)) * 0x9E3779B97F4A7C15ull >> 32) % buckets;
+    for (size_t i = 0; i < buckets; i++)
+    {
+      auto& entry = table.sites[idx];
+      if (entry.calls != 0 and entry.kind == kind and entry.key == key)
+          return entry;
+      if (entry.calls == 0) {
+        entry.kind = kind;
+        entry.key  = key;
+        return entry;
+      }
+      idx = (idx + 1) % buckets;
+    }
+    return table.sites[buckets];
+  }
+
+  std::string name_of(Cycle_sample::Kind kind, uint64_t key)
+  {
+    char buffer[64];
+    int len = 0;
+    switch (kind) {
+    case Cycle_sample::EVENT:
+      len = snprintf(buffer, sizeof(buffer), "event %u", (unsigned) key);
+      break;
+    case Cycle_sample::POSTED:
+      len = snprintf(buffer, sizeof(buffer), "posted");
+      break;
+    case Cycle_sample::TCP_PORT:
+      len = snprintf(buffer, sizeof(buffer), "tcp port %u", (unsigned) key);
+      break;
+    case Cycle_sample::TCP_PEER4: {
+      const auto* b = (const uint8_t*) &key;
+      len = snprintf(buffer, sizeof(buffer), "tcp peer %u.%u.%u.%u",
+                     b[0], b[1], b[2], b[3]);
+      } break;
+    case Cycle_sample::TCP_PEER6: {
+      const auto* b = (const uint8_t*) &key;
+      len = snprintf(buffer, sizeof(buffer), "tcp peer %x:%x:%x:%x::/64",
+                     b[0] << 8 | b[1], b[2] << 8 | b[3],
+                     b[4] << 8 | b[5], b[6] << 8 | b[7]);
+      } break;
+    }
+    return std::string(buffer, len);
+  }
+}
+
+void CycleProfiler::record(Cycle_sample::Kind kind, uint64_t key, uint64_t cycles) noexcept
+{
+  auto& entry = find_site(cycle_tables[SMP::cpu_id()], kind, key);
+  entry.calls++;
+  entry.cycles += cycles;
+  if (cycles > entry.max_cycles) entry.max_cycles = cycles;
+}
+
+std::vector<Cycle_sample> CycleProfiler::results(int N, int kind)
+{
+  // sum up the sites over all CPUs
+  std::unordered_map<uint64_t, Cycle_sample> sites[5];
+  for (const auto& table : cycle_tables)
+  {
+    for (const auto& entry : table.sites)
+    {
+      if (entry.calls == 0) continue;
+      if (kind >= 0 and entry.kind != kind) continue;
+      auto& sa = sites[entry.kind][entry.key];
+      sa.kind = entry.kind;
+      sa.key  = entry.key;
+      sa.calls  += entry.calls;
+      sa.cycles += entry.cycles;
+      sa.max_cycles = std::max(sa.max_cycles, entry.max_cycles);
+    }
+  }
+  std::vector<Cycle_sample> res;
+  for (auto& map : sites)
+    for (auto& it : map) res.push_back(std::move(it.second));
+
+  std::sort(res.begin(), res.end(),
+  [] (const Cycle_sample& a, const Cycle_sample& b) {
+    return a.cycles > b.cycles;
+  });
+  if (N >= 0 and (size_t) N < res.size()) res.resize(N);
+
+  for (auto& sa : res)
+    sa.name = name_of(sa.kind, sa.key);
+  return res;
+}
+
+void CycleProfiler::print(const int N)
+{
+  if (not enabled()) {
+    printf("Cycle profiling - not enabled\n");
+    return;
+  }
+  printf("%12s %14s %12s %12s  %s\n",
+         "Calls", "Cycles", "Avg", "Max", "Name");
+  for (int kind = Cycle_sample::EVENT; kind <= Cycle_sample::TCP_PEER6; kind++)
+  {
+    for (auto& sa : results(N, kind))
+    {
+      printf("%12lu %14lu %12lu %12lu  %s\n",
+             (unsigned long) sa.calls, (unsigned long) sa.cycles,
+             (unsigned long) (sa.cycles / sa.calls),
+             (unsigned long) sa.max_cycles, sa.name.c_str());
+    }
+  }
+}
+
+void CycleProfiler::reset()
+{
+  for (auto& table : cycle_tables)
+    for (auto& entry : table.sites)
+      entry = {};
+}
@@ -2,6 +2,7 @@
 #include <kernel/elf.hpp>
 #include <util/crc32.hpp>
 #include <common>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
@@ -60,6 +61,11 @@ struct StrTab {
   const char* base;
   uint32_t    size;
 };
+// symbols by address, as indices into the symbol table
+struct SymIndex {
+  const uint32_t* base;
+  uint32_t        entries;
+};
 
 class ElfTables
 {
@@ -83,6 +89,30 @@ public:
     this->strtab = {strs, strsize};
     this->checksum_syms = csum_syms;
     this->checksum_strs = csum_strs;
+    this->symindex = {nullptr, 0};
+  }
+
+  // sort the symbols by address into the space given, once at boot
+  void build_index(uint32_t* index)
+  {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < symtab.entries; i++)
+    {
+      const auto& sym = symtab.base[i];
+      const auto type = ELF64_ST_TYPE(sym.st_info);
+      if (sym.st_value == 0 or type == STT_SECTION or type == STT_FILE)
+          continue;
+      index[count++] = i;
+    }
+    // equal addresses in reverse table order, as lookups walk backwards
+    // (and std::sort, as there's no heap yet for a stable sort)
+    std::sort(index, index + count,
+    [this] (uint32_t a, uint32_t b) {
+      const auto va = symtab.base[a].st_value;
+      const auto vb = symtab.base[b].st_value;
+      return va < vb or (va == vb and a > b);
+    });
+    this->symindex = {index, count};
   }
 
   safe_func_offset getsym_safe(ElfAddr addr, char* buffer, size_t length)
@@ -113,6 +143,8 @@ public:
 
   const ElfSym* getaddr(ElfAddr addr)
   {
+    if (LIKELY(symindex.base != nullptr))
+        return getaddr_indexed(addr);
     // find exact match
     for (int i = 0; i < (int) symtab.entries; i++)
     {
@@ -140,6 +172,29 @@ public:
     return guess;
   }
 
+  // binary search, without locks or allocations
+  const ElfSym* getaddr_indexed(ElfAddr addr) const
+  {
+    const uint32_t* begin = symindex.base;
+    const uint32_t* end   = symindex.base + symindex.entries;
+    // the first symbol after addr
+    const auto* it = std::upper_bound(begin, end, addr,
+    [this] (ElfAddr addr, uint32_t idx) {
+      return addr < symtab.base[idx].st_value;
+    });
+    if (it == begin) return nullptr;
+    // closest start first, but a symbol further back can be the one
+    // containing addr, like a function around a label
+    const ElfSym* closest = &symtab.base[*(it - 1)];
+    for (int i = 0; i < 16 and it != begin; i++)
+    {
+      const auto& sym = symtab.base[*--it];
+      if (addr < sym.st_value + sym.st_size) return &sym;
+    }
+    if (addr < closest->st_value + 512) return closest;
+    return nullptr;
+  }
+
   size_t end_of_file() const {
     auto& hdr = elf_header();
     return hdr.e_ehsize + (hdr.e_phnum * hdr.e_phentsize) + (hdr.e_shnum * hdr.e_shentsize);
@@ -187,6 +242,7 @@ private:
 
   SymTab    symtab;
   StrTab    strtab;
+  SymIndex  symindex;
   /* NOTE: DON'T INITIALIZE */
   uint32_t  checksum_syms;
   uint32_t  checksum_strs;
@@ -330,6 +386,11 @@ static struct relocated_header {
   const char* strings() const {
     return (char*) &syms[entries];
   }
+  // room for the symbol index, after the strings
+  uint32_t* index() const {
+    const uintptr_t end = (uintptr_t) strings() + strsize;
+    return (uint32_t*) ((end + alignof(uint32_t)-1) & ~(alignof(uint32_t)-1));
+  }
 } relocs;
 
 struct elfsyms_header {
@@ -350,6 +411,16 @@ int _get_elf_section_datasize(const void* location)
   return hdr.symtab_entries * sizeof(ElfSym) + hdr.strtab_size;
 }
 
+// the moved symbols, and the index built after them
+extern "C"
+int _get_elf_section_movesize(const void* location)
+{
+  auto& hdr = *(elfsyms_header*) location;
+  const int size = _get_elf_section_datasize(location);
+  if (size == 0) return 0;
+  return size + alignof(uint32_t) + hdr.symtab_entries * sizeof(uint32_t);
+}
+
 extern "C"
 void _move_elf_syms_location(const void* location, void* new_location)
 {
@@ -415,6 +486,7 @@ void _init_elf_parser()
     parser.set(relocs.syms,      relocs.entries,
                relocs.strings(), relocs.strsize,
                relocs.check_syms, relocs.check_strs);
+    parser.build_index(relocs.index());
   }
   else {
     // symbols and strings are stripped out
@@ -463,6 +535,8 @@ void elf_protect_symbol_areas()
 {
   char* src = (char*) parser.symtab.base;
   ptrdiff_t size = &parser.strtab.base[parser.strtab.size] - src;
+  if (parser.symindex.base != nullptr)
+      size = (char*) &parser.symindex.base[parser.symindex.entries] - src;
   if (size % os::mem::min_psize()) size += os::mem::min_psize() - (size & (os::mem::min_psize()-1));
 
   INFO2("* Protecting syms %p to %p (size %#zx)\n", src, &src[size], size);
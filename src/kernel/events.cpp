@@ -1,10 +1,17 @@
 
 #include <kernel/events.hpp>
+#include <kernel/trace.hpp>
 #include <arch.hpp>
+#include <os.hpp>
+#include <profile>
 #include <algorithm>
 #include <cassert>
 #include <statman>
 #include <smp>
+#include <util/histogram.hpp>
+#ifdef ARCH_x86_64
+#include <kernel/cpuid.hpp>
+#endif
 //#define DEBUG_SMP
 
 static std::vector<Events> managers;
@@ -27,6 +34,20 @@ void Events::init_local()
     for (int evt = 0; evt < 32; evt++)
         event_subs[evt] = true;
   }
+  // posted calls are made from the event loop, so waking up is enough
+  posted.wake_evt = subscribe([] {});
+  // from an interrupt to its handler, on all CPUs
+  static auto& delay = Statman::get().create_histogram("events.dispatch_ns");
+  this->dispatch_delay = &delay;
+#ifdef ARCH_x86_64
+  poll.umwait = CPUID::has_feature(CPUID::Feature::WAITPKG);
+#endif
+}
+
+Events::Post_queue::Post_queue()
+{
+  for (uint32_t i = 0; i < slots.size(); i++)
+      slots[i].seq.store(i, std::memory_order_relaxed);
 }
 
 uint8_t Events::subscribe(event_callback func)
@@ -45,6 +66,7 @@ void Events::subscribe(uint8_t evt, event_callback func)
   event_subs[evt] = true;
   // Set (new) callback for event
   callbacks[evt] = func;
+  origins[evt] = func.invoker();
   // add to sublist if not there already
   auto it = std::find(sublist.begin(), sublist.end(), evt);
   if (it == sublist.end())
@@ -82,15 +104,161 @@ void Events::defer(event_callback callback)
       // because unsubscribe() deallocates event storage
       this->unsubscribe(ev);
     }));
+  // named after what it calls, not the wrapper
+  origins[ev] = callback.invoker();
   // and trigger it once
   event_pend[ev] = true;
+  set_pending();
+}
+
+bool Events::post(event_callback func)
+{
+  auto& q = this->posted;
+  uint32_t pos = q.tail.load(std::memory_order_relaxed);
+  Post_slot* slot;
+  while (true)
+  {
+    slot = &q.slots[pos & (POST_QUEUE-1)];
+    const uint32_t seq = slot->seq.load(std::memory_order_acquire);
+    const int32_t diff = seq - pos;
+    if (diff == 0) {
+      if (q.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+    }
+    // the slot from the last round has not been consumed yet
+    else if (diff < 0) {
+      return false;
+    }
+    else {
+      pos = q.tail.load(std::memory_order_relaxed);
+    }
+  }
+  slot->func = func;
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  // pairs with set_halted(true) before the CPU checks has_posted()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const int cpu = this - managers.data();
+  if (q.halted.load() and cpu != SMP::cpu_id()) {
+    SMP::unicast(cpu, q.wake_evt);
+  }
+  return true;
+}
+
+int Events::process_posted()
+{
+  auto& q = this->posted;
+  int count = 0;
+  while (count < POST_BATCH)
+  {
+    auto& slot = q.slots[q.head & (POST_QUEUE-1)];
+    // not published yet, or empty
+    if (slot.seq.load(std::memory_order_acquire) != q.head + 1)
+        break;
+    auto func = slot.func;
+    slot.func = nullptr;
+    slot.seq.store(q.head + POST_QUEUE, std::memory_order_release);
+    q.head++;
+    if (UNLIKELY(CycleProfiler::enabled() or StallWatchdog::enabled())) {
+      const uint64_t start = os::Arch::cpu_cycles();
+      func();
+      const uint64_t cycles = os::Arch::cpu_cycles() - start;
+      if (CycleProfiler::enabled())
+          CycleProfiler::record(Cycle_sample::POSTED, 0, cycles);
+      if (StallWatchdog::enabled())
+          StallWatchdog::record(Stall_sample::POSTED, 0, func.invoker(), cycles);
+    }
+    else func();
+    count++;
+  }
+  return count;
+}
+
+bool Events::poll_until(const uint64_t deadline)
+{
+  while (true)
+  {
+    if (pending or has_posted()) return true;
+    if (os::Arch::cpu_cycles() >= deadline) return false;
+#ifdef ARCH_x86_64
+    if (poll.umwait)
+    {
+      // umonitor the posted tail, so a post ends the wait at once
+      asm volatile(".byte 0xf3, 0x0f, 0xae, 0xf0" :: "a"(&posted.tail) : "memory");
+      if (pending or has_posted()) return true;
+      // umwait in C0.1 until the deadline, or an interrupt
+      asm volatile(".byte 0xf2, 0x0f, 0xae, 0xf1"
+                   :: "c"(1), "a"((uint32_t) deadline), "d"((uint32_t) (deadline >> 32))
+                   : "cc", "memory");
+      continue;
+    }
+#endif
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+    asm volatile("pause");
+#elif defined(ARCH_aarch64)
+    asm volatile("yield");
+#endif
+  }
+}
+
+void Events::halt()
+{
+  if (UNLIKELY(poll.max == 0))
+  {
+    // the CPU frequency is only known after calibration
+    const uint64_t khz = os::cpu_freq().count();
+    poll.start = khz * HALT_POLL_START_US / 1000;
+    poll.max   = khz * HALT_POLL_MAX_US / 1000;
+  }
+  const uint64_t begin  = os::Arch::cpu_cycles();
+  const uint64_t stolen = os::nanos_stolen();
+  if (poll.window > 0 and poll_until(begin + poll.window))
+      return;
+
+  // from here on, those posting to us send an IPI
+  posted.halted.store(true);
+  if (LIKELY(not has_posted() and not pending)) {
+    os::halt();
+  }
+  posted.halted.store(false);
+
+  // grow the window when a longer one would have caught this wakeup,
+  // and shrink it when polling only burned cycles
+  uint64_t slept = os::Arch::cpu_cycles() - begin;
+  // time the hypervisor ran others is neither polling nor waiting
+  const uint64_t steal = (os::nanos_stolen() - stolen) * os::cpu_freq().count() / 1e6;
+  slept -= std::min(slept, steal);
+  if (slept <= poll.max)
+      poll.window = std::clamp(poll.window * 2, poll.start, poll.max);
+  else if (poll.window / 2 >= poll.start)
+      poll.window /= 2;
+  else
+      poll.window = 0;
+}
+
+void Events::run_timed(const uint8_t intr)
+{
+  // the callback may unsubscribe, and another take its place
+  const void* origin = origins[intr];
+  const uint64_t start = os::Arch::cpu_cycles();
+  callbacks[intr]();
+  const uint64_t cycles = os::Arch::cpu_cycles() - start;
+  if (CycleProfiler::enabled())
+      CycleProfiler::record(Cycle_sample::EVENT, intr, cycles);
+  if (StallWatchdog::enabled())
+      StallWatchdog::record(Stall_sample::EVENT, intr, origin, cycles);
 }
 
 void Events::process_events()
 {
   bool handled_any;
   do {
-    handled_any = false;
+    if (pending and dispatch_delay != nullptr) {
+      const uint64_t cycles = os::Arch::cpu_cycles() - pending_since;
+      dispatch_delay->record(os::detail::cycles_to_nanos(cycles));
+    }
+    pending = false;
+    handled_any = process_posted() > 0;
 
     for (const uint8_t intr : sublist)
     if (event_pend[intr])
@@ -105,7 +273,10 @@ void Events::process_events()
         SMP::global_unlock();
       }
 #endif
-      callbacks[intr]();
+      TRACEPOINT(event_dispatch, intr);
+      if (UNLIKELY(CycleProfiler::enabled() or StallWatchdog::enabled()))
+        run_timed(intr);
+      else callbacks[intr]();
       // increment events handled
       handled_array[intr]++;
       handled_any = true;
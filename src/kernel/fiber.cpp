@@ -5,12 +5,79 @@
 #include <cstdint>
 #include <memory>
 #include <smp>
+#include <array>
+#include <cstdlib>
+#include <kernel/memory.hpp>
+#include <util/bitops.hpp>
 
 // Default location for previous stack. Asm will always save a pointer.
 std::atomic<int> Fiber::next_id_{0};
 std::vector<Fiber*> Fiber::main_ = {nullptr};
 std::vector<Fiber*> Fiber::current_ = {nullptr};
 
+// Released stacks, by size, most recently released last
+struct Stack_pool {
+  std::vector<std::pair<int, char*>> stacks;
+};
+static std::array<Stack_pool, SMP_MAX_CORES> stack_pools;
+
+static constexpr size_t guard_size = 4096;
+
+// Make the page below a stack inaccessible, or accessible again
+static void stack_guard(char* base, bool guard)
+{
+#if defined(ARCH_x86_64)
+  using namespace os::mem;
+  using namespace util::bitops;
+  // only where paging is set up, and the heap is in the memory map
+  if (vmmap().in_range((uintptr_t) base))
+      protect((uintptr_t) base, guard_size,
+              guard ? Access::none : Access::read | Access::write);
+#else
+  (void) base; (void) guard;
+#endif
+}
+
+Fiber::Stack_ptr Fiber::alloc_stack(int stack_size)
+{
+  auto& stacks = PER_CPU(stack_pools).stacks;
+  for (auto it = stacks.rbegin(); it != stacks.rend(); ++it)
+  {
+    if (it->first == stack_size) {
+      char* stack = it->second;
+      stacks.erase(std::next(it).base());
+      return Stack_ptr{stack, Stack_release{stack_size}};
+    }
+  }
+
+  const size_t size = guard_size + util::bits::roundto(guard_size, stack_size);
+  auto* base = (char*) aligned_alloc(guard_size, size);
+  if (UNLIKELY(base == nullptr))
+    throw Err_bad_fiber("Can't allocate fiber stack");
+  stack_guard(base, true);
+  return Stack_ptr{base + guard_size, Stack_release{stack_size}};
+}
+
+void Fiber::Stack_release::operator()(char* stack) const noexcept
+{
+  auto& stacks = PER_CPU(stack_pools).stacks;
+  if (stacks.size() < stack_pool_size)
+  {
+    if (stacks.capacity() == 0)
+        stacks.reserve(stack_pool_size);
+    stacks.emplace_back(size, stack);
+    return;
+  }
+  char* base = stack - guard_size;
+  stack_guard(base, false);
+  free(base);
+}
+
+size_t Fiber::pooled_stacks()
+{
+  return PER_CPU(stack_pools).stacks.size();
+}
+
 extern "C" {
   void __fiber_jumpstart(volatile void* th_stack, volatile Fiber* f, volatile void* parent_stack);
   void __fiber_yield(volatile void* stack, volatile void* parent_stack);
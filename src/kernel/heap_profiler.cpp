@@ -0,0 +1,212 @@
+#include <profile>
+#include <arch.hpp>
+#include <common>
+#include <kernel.hpp>
+#include <kernel/elf.hpp>
+#include <smp>
+#include <smp_utils>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+// sampled allocations that can be in use at once
+#define LIVE_SAMPLES  2048
+// frames kept of each, from the call site out
+#define HEAP_DEPTH      16
+// frames not kept: HeapProfiler::allocated and operator new
+#define HEAP_SKIP        2
+
+static const uintptr_t EMPTY     = 0;
+static const uintptr_t TOMBSTONE = 1;
+
+struct Heap_sample
+{
+  size_t    len;
+  uint32_t  depth;
+  uintptr_t frames[HEAP_DEPTH];
+};
+
+// the bytes left until the next sample, on each CPU
+struct alignas(SMP_ALIGN) Heap_countdown
+{
+  int64_t  left = -1; // not started
+  uint64_t seed = 0;
+};
+
+static std::atomic<size_t> sample_rate {HeapProfiler::DEFAULT_RATE};
+static std::atomic<uint64_t> sampled_total {0};
+static std::array<Heap_countdown, SMP_MAX_CORES> countdowns;
+
+// open addressing by address, looked up without the lock
+static std::array<std::atomic<uintptr_t>, LIVE_SAMPLES> live_addr;
+static std::array<Heap_sample, LIVE_SAMPLES> live;
+static uint32_t live_count = 0;
+static smp_spinlock live_lock;
+
+static size_t slot_of(uintptr_t addr) noexcept
+{
+  return ((addr >> 4) * 0x9E3779B97F4A7C15ull >> 32) % LIVE_SAMPLES;
+}
+
+// bytes until the next sample, exponentially distributed around the rate,
+// so that every byte allocated is as likely to be sampled
+static int64_t next_countdown(Heap_countdown& cd, size_t rate) noexcept
+{
+  if (cd.seed == 0)
+    cd.seed = os::Arch::cpu_cycles() | 1;
+  // xorshift64*
+  cd.seed ^= cd.seed >> 12;
+  cd.seed ^= cd.seed << 25;
+  cd.seed ^= cd.seed >> 27;
+  const uint64_t r = cd.seed * 0x2545F4914F6CDD1Dull;
+  // uniform in (0, 1]
+  const double u = ((r >> 11) + 1) * (1.0 / 9007199254740992.0);
+  return (int64_t) (-std::log(u) * rate) + 1;
+}
+
+__attribute__((noinline))
+static void record(void* addr, size_t len) noexcept
+{
+  uintptr_t frames[HEAP_SKIP + HEAP_DEPTH];
+  const uint32_t depth = kernel::walk_stack(frames, HEAP_SKIP + HEAP_DEPTH,
+                    (uintptr_t) __builtin_return_address(0),
+                    (uintptr_t) __builtin_frame_address(1));
+  if (depth <= HEAP_SKIP) return;
+  Heap_sample sample;
+  sample.len   = len;
+  sample.depth = depth - HEAP_SKIP;
+  std::copy(frames + HEAP_SKIP, frames + depth, sample.frames);
+  sampled_total.fetch_add(1, std::memory_order_relaxed);
+
+  // when full, samples are dropped until some are freed
+  live_lock.lock();
+  if (live_count < LIVE_SAMPLES / 2)
+  {
+    size_t idx = slot_of((uintptr_t) addr);
+    while (live_addr[idx].load(std::memory_order_relaxed) > TOMBSTONE)
+      idx = (idx + 1) % LIVE_SAMPLES;
+    live[idx] = sample;
+    live_addr[idx].store((uintptr_t) addr, std::memory_order_release);
+    live_count++;
+  }
+  live_lock.unlock();
+}
+
+void HeapProfiler::allocated(void* addr, size_t len) noexcept
+{
+  if (UNLIKELY(addr == nullptr)) return;
+  auto& cd = countdowns[SMP::cpu_id()];
+  cd.left -= len;
+  if (LIKELY(cd.left >= 0)) return;
+
+  const size_t rate = sample_rate.load(std::memory_order_relaxed);
+  if (rate == 0) {
+    cd.left = INT64_MAX;
+    return;
+  }
+  // the very first allocation only starts the countdown
+  const bool started = cd.seed != 0;
+  cd.left = next_countdown(cd, rate);
+  if (started) record(addr, len);
+}
+
+void HeapProfiler::deallocated(void* addr) noexcept
+{
+  if (addr == nullptr) return;
+  const auto key = (uintptr_t) addr;
+  // most frees find an empty slot right away
+  size_t idx = slot_of(key);
+  for (size_t i = 0; i < LIVE_SAMPLES; i++)
+  {
+    const auto found = live_addr[idx].load(std::memory_order_acquire);
+    if (LIKELY(found == EMPTY)) return;
+    if (found == key) break;
+    idx = (idx + 1) % LIVE_SAMPLES;
+  }
+
+  live_lock.lock();
+  if (live_addr[idx].load(std::memory_order_relaxed) == key) {
+    live_addr[idx].store(TOMBSTONE, std::memory_order_release);
+    live_count--;
+  }
+  live_lock.unlock();
+}
+
+void HeapProfiler::set_rate(size_t bytes) noexcept
+{
+  sample_rate.store(bytes, std::memory_order_relaxed);
+  // start over with the new rate on the next allocation
+  for (auto& cd : countdowns) cd.left = 0;
+}
+size_t HeapProfiler::rate() noexcept
+{
+  return sample_rate.load(std::memory_order_relaxed);
+}
+
+uint64_t HeapProfiler::samples_total() noexcept
+{
+  return sampled_total.load(std::memory_order_relaxed);
+}
+uint32_t HeapProfiler::samples_live() noexcept
+{
+  return live_count;
+}
+
+std::vector<Heap_site> HeapProfiler::results(int N)
+{
+  const double rate = std::max<size_t>(sample_rate.load(), 1);
+  // taken with the lock, and resolved without
+  std::unordered_map<uintptr_t, Heap_site> sites;
+  live_lock.lock();
+  for (size_t i = 0; i < LIVE_SAMPLES; i++)
+  {
+    if (live_addr[i].load(std::memory_order_relaxed) <= TOMBSTONE) continue;
+    const auto& sample = live[i];
+    auto& site = sites[sample.frames[0]];
+    site.addr = (void*) sample.frames[0];
+    // a sample of len bytes stands for this many bytes allocated
+    const double len = sample.len;
+    site.bytes += len / (1.0 - std::exp(-len / rate));
+    site.samples++;
+  }
+  live_lock.unlock();
+
+  std::vector<Heap_site> res;
+  res.reserve(sites.size());
+  for (auto& it : sites) res.push_back(std::move(it.second));
+  std::sort(res.begin(), res.end(),
+  [] (const Heap_site& a, const Heap_site& b) {
+    return a.bytes > b.bytes;
+  });
+  if (N >= 0 and (size_t) N < res.size()) res.resize(N);
+
+  char buffer[8192];
+  for (auto& site : res)
+  {
+    // return addresses can be past the end of the calling function
+    auto func = Elf::safe_resolve_symbol((char*) site.addr - 1, buffer, sizeof(buffer));
+    if (func.name)
+      site.name = func.name;
+    else {
+      int len = snprintf(buffer, sizeof(buffer), "%p", site.addr);
+      site.name.assign(buffer, len);
+    }
+  }
+  return res;
+}
+
+void HeapProfiler::print(const int N)
+{
+  auto sites = results(N);
+  printf("Heap profiling - %zu results (%u live of %lu samples, 1 per %zu bytes)\n",
+         sites.size(), samples_live(), (unsigned long) samples_total(), rate());
+  for (auto& site : sites)
+  {
+    printf("%10lu kB %6u  %.*s\n",
+           (unsigned long) (site.bytes / 1024), site.samples,
+           (int) site.name.size(), site.name.c_str());
+  }
+}
@@ -34,6 +34,14 @@ util::KHz os::cpu_freq() {
   return kernel::cpu_freq();
 }
 
+void kernel::set_cpu_freq(util::KHz khz)
+{
+  state().cpu_khz = khz;
+  // 10^6 ns per cycle at 1 KHz
+  if (khz.count() > 0)
+    os::detail::nanos_per_cycle = (1'000'000ull << 32) / (uint64_t) khz.count();
+}
+
 // stdout redirection
 static Fixed_vector<os::print_func, 16> os_print_handlers;
 
@@ -75,6 +83,7 @@ void kernel::post_start()
   // Enable timestamps (if present)
   kernel::state().timestamps_ready = true;
 
+  kernel::boot_phase("LiveUpdate and SystemLog");
   {
 	PROFILE("LiveUpdate and SystemLog");
     // LiveUpdate needs some initialization, although only if present
@@ -90,6 +99,7 @@ void kernel::post_start()
 
   // Custom initialization functions
   MYINFO("Initializing plugins");
+  kernel::boot_phase("Plugin constructors");
   {
 	PROFILE("Plugin constructors");
     kernel::run_ctors(&__plugin_ctors_start, &__plugin_ctors_end);
@@ -103,6 +113,7 @@ void kernel::post_start()
 
   MYINFO("Running service constructors");
   FILLINE('-');
+  kernel::boot_phase("Service constructors");
   {
 	PROFILE("Service constructors");
     // the boot sequence is over when we get to plugins/Service::start
@@ -140,10 +151,12 @@ void kernel::post_start()
   }
 
   // service program start
+  kernel::boot_phase("Service::start");
   {
 	PROFILE("Service::start");
     Service::start();
   }
+  kernel::boot_finish();
 }
 
 void os::add_stdout(os::print_func func)
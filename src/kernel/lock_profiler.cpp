@@ -0,0 +1,157 @@
+#include <profile>
+#include <arch.hpp>
+#include <smp>
+#include <smp_utils>
+#include <kernel/elf.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <unordered_map>
+
+#ifdef ENABLE_LOCK_PROFILER
+// lock sites counted per CPU, the rest go into the last one
+#define LOCK_SITES  64
+
+namespace smp
+{
+  struct lock_site
+  {
+    uintptr_t site = 0;
+    uint64_t  acquired = 0;
+    uint64_t  contended = 0;
+    uint64_t  spins = 0;
+    uint64_t  cycles_held = 0;
+    uint64_t  max_held = 0;
+  };
+  // only written by its own CPU, so no atomics (or locks!) needed
+  struct alignas(SMP_ALIGN) lock_table
+  {
+    std::array<lock_site, LOCK_SITES> sites;
+  };
+  static std::array<lock_table, SMP_MAX_CORES> lock_tables;
+
+  static lock_site& find_site(lock_table& table, uintptr_t site) noexcept
+  {
+    // open addressing, with the last entry for when it's full
+    const size_t buckets = LOCK_SITES - 1;
+    size_t idx = ((site >> 2) * 0x9E3779B97F4A7C15ull >> 32) % buckets;
+    for (size_t i = 0; i < buckets; i++)
+    {
+      auto& entry = table.sites[idx];
+      if (entry.site == site) return entry;
+      if (entry.site == 0) {
+        entry.site = site;
+        return entry;
+      }
+      idx = (idx + 1) % buckets;
+    }
+    return table.sites[buckets];
+  }
+
+  lock_site* lock_acquired(uintptr_t site, uint32_t spins, uint64_t& acquired) noexcept
+  {
+    auto& entry = find_site(lock_tables[SMP::cpu_id()], site);
+    entry.acquired++;
+    if (spins) {
+      entry.contended++;
+      entry.spins += spins;
+    }
+    acquired = os::Arch::cpu_cycles();
+    return &entry;
+  }
+
+  void lock_released(lock_site* entry, uint64_t acquired) noexcept
+  {
+    if (entry == nullptr) return;
+    const uint64_t cycles_held = os::Arch::cpu_cycles() - acquired;
+    entry->cycles_held += cycles_held;
+    if (cycles_held > entry->max_held) entry->max_held = cycles_held;
+  }
+}
+#endif
+
+bool LockProfiler::enabled() noexcept
+{
+#ifdef ENABLE_LOCK_PROFILER
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::vector<Lock_sample> LockProfiler::results(int N)
+{
+  std::vector<Lock_sample> res;
+#ifdef ENABLE_LOCK_PROFILER
+  // sum up the sites over all CPUs
+  std::unordered_map<uintptr_t, Lock_sample> sites;
+  for (const auto& table : smp::lock_tables)
+  {
+    for (const auto& entry : table.sites)
+    {
+      if (entry.acquired == 0) continue;
+      auto& sa = sites[entry.site];
+      sa.site = (void*) entry.site;
+      sa.acquired    += entry.acquired;
+      sa.contended   += entry.contended;
+      sa.spins       += entry.spins;
+      sa.cycles_held += entry.cycles_held;
+      sa.max_held = std::max(sa.max_held, entry.max_held);
+    }
+  }
+  for (auto& it : sites) res.push_back(std::move(it.second));
+
+  // sort by time spent waiting, then by time held
+  std::sort(res.begin(), res.end(),
+  [] (const Lock_sample& a, const Lock_sample& b) {
+    if (a.spins != b.spins) return a.spins > b.spins;
+    return a.cycles_held > b.cycles_held;
+  });
+  if (N >= 0 and (size_t) N < res.size()) res.resize(N);
+
+  char buffer[8192];
+  for (auto& sa : res)
+  {
+    auto func = Elf::safe_resolve_symbol(sa.site, buffer, sizeof(buffer));
+    if (func.name)
+      sa.name = func.name;
+    else {
+      int len = snprintf(buffer, sizeof(buffer), "%p", sa.site);
+      sa.name.assign(buffer, len);
+    }
+  }
+#else
+  (void) N;
+#endif
+  return res;
+}
+
+void LockProfiler::print(const int N)
+{
+  if (not enabled()) {
+    printf("Lock profiling - not enabled (build with LOCK_PROFILE)\n");
+    return;
+  }
+  auto samp = results(N);
+  printf("Lock profiling - %zu results\n", samp.size());
+  printf("%12s %10s %12s %12s %12s  %s\n",
+         "Acquired", "Contended", "Spins", "Avg held", "Max held", "Site");
+  for (auto& sa : samp)
+  {
+    printf("%12lu %10lu %12lu %12lu %12lu  %.*s\n",
+           (unsigned long) sa.acquired, (unsigned long) sa.contended,
+           (unsigned long) sa.spins,
+           (unsigned long) (sa.cycles_held / sa.acquired),
+           (unsigned long) sa.max_held,
+           (int) sa.name.size(), sa.name.c_str());
+  }
+}
+
+void LockProfiler::reset()
+{
+#ifdef ENABLE_LOCK_PROFILER
+  for (auto& table : smp::lock_tables)
+    for (auto& entry : table.sites)
+      entry = {};
+#endif
+}
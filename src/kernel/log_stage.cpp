@@ -0,0 +1,83 @@
+#include <kernel/log_stage.hpp>
+#include <kernel/events.hpp>
+#include <kernel/timers.hpp>
+#include <kernel.hpp>
+#include <statman>
+#include <algorithm>
+#include <cstring>
+
+namespace kernel
+{
+  Log_stage::Log_stage(const std::string& name, sink_t sink,
+                       uint32_t ring_size, interval_t ival)
+    : sink_(std::move(sink)), size_(ring_size), interval_(ival),
+      dropped_(&Statman::get().create(Stat::UINT64, name + ".dropped").get_uint64())
+  {
+    Expects(ring_size > 0 and (ring_size & (ring_size - 1)) == 0);
+  }
+
+  Log_stage::Ring& Log_stage::local_ring()
+  {
+    auto& ring = PER_CPU(rings_);
+    // the first write on each CPU, which flushes from its own event
+    if (UNLIKELY(ring.data == nullptr))
+    {
+      ring.data  = new char[size_];
+      ring.event = Events::get().subscribe({this, &Log_stage::flush});
+    }
+    return ring;
+  }
+
+  void Log_stage::schedule(Ring& ring)
+  {
+    ring.scheduled = true;
+    if (interval_.count() > 0 and Timers::is_ready())
+      Timers::oneshot(interval_, [this] (int) { this->flush(); });
+    else
+      Events::get().trigger_event(ring.event);
+  }
+
+  void Log_stage::write(const char* data, size_t len)
+  {
+    if (UNLIKELY(not is_booted() or is_panicking()))
+    {
+      // keep the order, when there is something staged
+      if (PER_CPU(rings_).data) flush();
+      sink_(data, len);
+      return;
+    }
+    auto& ring = local_ring();
+    const uint32_t used = ring.tail - ring.head;
+    if (UNLIKELY(len > size_ - used)) {
+      *dropped_ += len;
+      return;
+    }
+    // at most two pieces, when wrapping around
+    const uint32_t pos   = ring.tail & (size_ - 1);
+    const uint32_t first = std::min<size_t>(len, size_ - pos);
+    std::memcpy(ring.data + pos, data, first);
+    std::memcpy(ring.data, data + first, len - first);
+    ring.tail += len;
+
+    if (not ring.scheduled)
+      schedule(ring);
+    // don't wait for the timer when filling up
+    else if (used + len > size_ / 2)
+      Events::get().trigger_event(ring.event);
+  }
+
+  void Log_stage::flush()
+  {
+    auto& ring = PER_CPU(rings_);
+    ring.scheduled = false;
+    if (ring.data == nullptr) return;
+    // the sink may stage more, behind what is being flushed
+    while (ring.head != ring.tail)
+    {
+      const uint32_t pos = ring.head & (size_ - 1);
+      const uint32_t len = std::min(ring.tail - ring.head, size_ - pos);
+      sink_(ring.data + pos, len);
+      ring.head += len;
+    }
+  }
+}
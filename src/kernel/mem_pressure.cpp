@@ -0,0 +1,171 @@
+#include <kernel/mem_pressure.hpp>
+#include <kernel/events.hpp>
+#include <kernel/timers.hpp>
+#include <kernel.hpp>
+#include <smp>
+#include <smp_utils>
+#include <statman>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+namespace os::mem
+{
+  struct Entry {
+    int         id;
+    const char* name;
+    Shrink_cost cost;
+    Shrinker    func;
+  };
+
+  struct alignas(SMP_ALIGN) Cpu_shrinkers
+  {
+    smp_spinlock lock;
+    // cheapest first
+    std::vector<Entry> list;
+    int next_id = 0;
+    // read by the allocator on any CPU
+    std::atomic<int>  count {0};
+    std::atomic<bool> scheduled {false};
+    Timers::id_t timer = Timers::UNUSED_ID;
+  };
+  static std::array<Cpu_shrinkers, SMP_MAX_CORES> cpus;
+
+  // the CPU of a shrinker is in the top bits of its id
+  static const int ID_SHIFT = 20;
+
+  static size_t low_  = 0;
+  static size_t critical_ = 0;
+  static std::chrono::milliseconds interval_ {1000};
+
+  static size_t heap_size() noexcept
+  {
+    return kernel::heap_max() - kernel::heap_begin();
+  }
+
+  size_t low_watermark() noexcept
+  {
+    return (low_) ? low_ : heap_size() / 16;
+  }
+
+  size_t critical_watermark() noexcept
+  {
+    return (critical_) ? critical_ : heap_size() / 64;
+  }
+
+  void set_watermarks(size_t low, size_t critical)
+  {
+    Expects(low == 0 or critical <= low);
+    low_ = low;
+    critical_ = critical;
+  }
+
+  Pressure pressure() noexcept
+  {
+    const size_t avail = kernel::heap_avail();
+    if (avail < critical_watermark()) return Pressure::critical;
+    if (avail < low_watermark()) return Pressure::low;
+    return Pressure::none;
+  }
+
+  static void count_pressure(Pressure level, size_t freed)
+  {
+    static auto& low  = Statman::get().create(Stat::UINT64, "mem.pressure.low").get_uint64();
+    static auto& crit = Statman::get().create(Stat::UINT64, "mem.pressure.critical").get_uint64();
+    static auto& sum  = Statman::get().create(Stat::UINT64, "mem.pressure.freed").get_uint64();
+    __atomic_fetch_add((level == Pressure::critical) ? &crit : &low, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sum, freed, __ATOMIC_RELAXED);
+  }
+
+  size_t shrink(Pressure level)
+  {
+    if (level == Pressure::none) return 0;
+    auto& cpu = PER_CPU(cpus);
+    // a shrinker may remove itself, or others
+    cpu.lock.lock();
+    std::vector<Entry> list = cpu.list;
+    cpu.lock.unlock();
+
+    const Pressure started = level;
+    size_t freed = 0;
+    for (auto& entry : list)
+    {
+      freed += entry.func(level);
+      // some memory came back, so go on as gently as the heap lets us
+      level = pressure();
+      if (level == Pressure::none) break;
+    }
+    count_pressure(started, freed);
+    return freed;
+  }
+
+  static void shrink_posted()
+  {
+    PER_CPU(cpus).scheduled.store(false);
+    shrink(pressure());
+  }
+
+  void pressure_notify() noexcept
+  {
+    if (LIKELY(kernel::heap_avail() >= low_watermark())) return;
+    for (int i = 0; i < SMP::cpu_count(); i++)
+    {
+      auto& cpu = cpus[i];
+      if (cpu.count.load(std::memory_order_relaxed) == 0) continue;
+      if (cpu.scheduled.exchange(true)) continue;
+      if (not Events::get(i).post(shrink_posted))
+        cpu.scheduled.store(false);
+    }
+  }
+
+  static void start_timer(Cpu_shrinkers& cpu)
+  {
+    cpu.timer = Timers::periodic(interval_,
+      [] (int) { shrink(pressure()); });
+    // no need to wake an idle CPU for it
+    Timers::set_deferrable(cpu.timer, true);
+  }
+
+  void set_pressure_interval(std::chrono::milliseconds ival)
+  {
+    Expects(ival.count() > 0);
+    interval_ = ival;
+    auto& cpu = PER_CPU(cpus);
+    if (cpu.timer != Timers::UNUSED_ID) {
+      Timers::stop(cpu.timer);
+      start_timer(cpu);
+    }
+  }
+
+  int add_shrinker(const char* name, Shrink_cost cost, Shrinker func)
+  {
+    Expects(func != nullptr);
+    const int cpu_id = SMP::cpu_id();
+    auto& cpu = cpus[cpu_id];
+    cpu.lock.lock();
+    const int id = (cpu_id << ID_SHIFT) | (cpu.next_id++ & ((1 << ID_SHIFT) - 1));
+    auto it = std::upper_bound(cpu.list.begin(), cpu.list.end(), cost,
+        [] (Shrink_cost c, const Entry& e) { return c < e.cost; });
+    cpu.list.insert(it, Entry{id, name, cost, std::move(func)});
+    cpu.count.store(cpu.list.size());
+    cpu.lock.unlock();
+
+    if (cpu.timer == Timers::UNUSED_ID)
+      start_timer(cpu);
+    return id;
+  }
+
+  void remove_shrinker(int id)
+  {
+    auto& cpu = cpus.at(id >> ID_SHIFT);
+    cpu.lock.lock();
+    auto it = std::find_if(cpu.list.begin(), cpu.list.end(),
+        [id] (const Entry& e) { return e.id == id; });
+    if (it != cpu.list.end()) {
+      cpu.list.erase(it);
+      cpu.count.store(cpu.list.size());
+    }
+    cpu.lock.unlock();
+  }
+}
@@ -0,0 +1,66 @@
+#include <kernel/memory.hpp>
+#include <kernel.hpp>
+#include <smp>
+#include <algorithm>
+#include <array>
+
+static const int NUMA_MAX_NODES = 64;
+
+// node numbers by proximity domain, in order of appearance
+static std::vector<uint32_t> domains;
+static std::vector<os::mem::Numa_range> ranges;
+static std::array<uint8_t, SMP_MAX_CORES> cpu_node {};
+// zero when not given by the firmware
+static std::array<std::array<uint8_t, NUMA_MAX_NODES>, NUMA_MAX_NODES> distances {};
+
+static int node_of_domain(uint32_t domain)
+{
+  auto it = std::find(domains.begin(), domains.end(), domain);
+  if (it != domains.end()) return it - domains.begin();
+  // more nodes than we keep track of are counted as the first one
+  if (domains.size() == NUMA_MAX_NODES) return 0;
+  domains.push_back(domain);
+  return domains.size() - 1;
+}
+
+void kernel::numa_add_range(uintptr_t begin, uintptr_t end, uint32_t domain)
+{
+  ranges.push_back({begin, end, node_of_domain(domain)});
+}
+void kernel::numa_add_cpu(int cpu, uint32_t domain)
+{
+  cpu_node.at(cpu) = node_of_domain(domain);
+}
+void kernel::numa_set_distance(uint32_t from, uint32_t to, uint8_t distance)
+{
+  distances[node_of_domain(from)][node_of_domain(to)] = distance;
+}
+
+int os::mem::numa_nodes() noexcept
+{
+  return std::max<int>(1, domains.size());
+}
+int os::mem::numa_node_of_cpu(int cpu) noexcept
+{
+  return cpu_node.at(cpu);
+}
+int os::mem::numa_node_of(uintptr_t addr) noexcept
+{
+  if (domains.size() <= 1) return 0;
+  for (const auto& range : ranges)
+      if (addr >= range.begin and addr < range.end) return range.node;
+  return -1;
+}
+int os::mem::numa_distance(int from, int to) noexcept
+{
+  const int fallback = from == to ? 10 : 20;
+  if (from < 0 or to < 0 or from >= numa_nodes() or to >= numa_nodes())
+      return fallback;
+  const int dist = distances[from][to];
+  return dist ? dist : fallback;
+}
+const std::vector<os::mem::Numa_range>& os::mem::numa_ranges() noexcept
+{
+  static const std::vector<Numa_range> none;
+  return domains.size() > 1 ? ranges : none;
+}
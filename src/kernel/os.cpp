@@ -2,6 +2,8 @@
 #include <os.hpp>
 #include <kernel.hpp>
 
+uint64_t os::detail::nanos_per_cycle = 0;
+
 bool os::is_booted() noexcept {
   return kernel::is_booted();
 }
@@ -4,62 +4,97 @@
 #include <kernel.hpp>
 #include <kernel/cpuid.hpp>
 #include <kernel/elf.hpp>
+#include <kernel/events.hpp>
 #include <os.hpp>
+#include <smp>
 #include <util/fixed_vector.hpp>
 #include <unordered_map>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
 
-#define BUFFER_COUNT    1024
+#define BUFFER_COUNT     128
+// deepest stack taken, innermost frames first
+#define MAX_DEPTH         32
+// frames further apart than this are not on the same stack
+#define MAX_FRAME_SIZE    (1u << 20)
+// other CPUs are sampled with an IPI on this IRQ (below BSP_LAPIC_IPI_IRQ)
+#define SAMPLE_IRQ       125
 
 extern "C" {
   void parasite_interrupt_handler();
-  void profiler_stack_sampler(void*);
+  void profiler_stack_sampler(void*, void*);
   static void gather_stack_sampling();
 }
 extern char _irq_cb_return_location;
 
 typedef uint32_t func_sample;
-struct Sampler
+struct Stack_sample
 {
-  Fixed_vector<uintptr_t, BUFFER_COUNT>* samplerq;
-  Fixed_vector<uintptr_t, BUFFER_COUNT>* transferq;
-  std::unordered_map<uintptr_t, func_sample> dict;
+  uint32_t  depth;
+  uintptr_t frames[MAX_DEPTH];
+};
+using sample_queue = Fixed_vector<Stack_sample, BUFFER_COUNT>;
+
+struct Stack_hash
+{
+  size_t operator() (const std::vector<uintptr_t>& stack) const noexcept
+  {
+    // FNV-1a over the addresses
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto addr : stack)
+      hash = (hash ^ addr) * 1099511628211ull;
+    return hash;
+  }
+};
+
+// samples of one CPU, handed over to the BSP a queue at a time
+struct alignas(SMP_ALIGN) Cpu_sampler
+{
+  sample_queue* samplerq = nullptr;
+  sample_queue* transferq = nullptr;
   uint64_t total  = 0;
   uint64_t asleep = 0;
-  int  lockless = 0;
+  std::atomic<int> lockless {0};
+
+  void add(uintptr_t current, uintptr_t frame, StackSampler::mode_t mode);
+};
+
+struct Sampler
+{
+  std::vector<Cpu_sampler> cpus;
+  // samples by function sampled, and by whole stack
+  std::unordered_map<uintptr_t, func_sample> dict;
+  std::unordered_map<std::vector<uintptr_t>, func_sample, Stack_hash> stacks;
   bool discard = false; // discard results as long as true
+  bool started = false;
   StackSampler::mode_t mode = StackSampler::MODE_CURRENT;
 
-  Sampler() {
+  Sampler() : cpus(std::max<size_t>(SMP::early_cpu_total(), 1))
+  {
     // make room for these only when requested
-    #define blargh(T) std::remove_pointer<decltype(T)>::type;
-    samplerq = new blargh(samplerq);
-    transferq = new blargh(transferq);
+    for (auto& cpu : cpus) {
+      cpu.samplerq  = new sample_queue;
+      cpu.transferq = new sample_queue;
+    }
   }
 
   void begin() {
+    if (started) return;
+    started = true;
     // gather samples repeatedly over single period
     __arch_preempt_forever(gather_stack_sampling);
     // install interrupt handler (NOTE: after "initializing" PIT)
     __arch_install_irq(0, parasite_interrupt_handler);
-  }
-  void add(void* current)
-  {
-    // need free space to take more samples
-    if (samplerq->free_capacity()) {
-      if (mode == StackSampler::MODE_CURRENT)
-          samplerq->push_back((uintptr_t) current);
-      else if (mode == StackSampler::MODE_CALLER)
-          samplerq->push_back((uintptr_t) __builtin_return_address(2));
+    // the BSP samples the others with an IPI on each of its own
+    for (const int cpu : SMP::active_cpus()) {
+      if (cpu == 0) continue;
+      SMP::add_task([] {
+        Events::get().subscribe(SAMPLE_IRQ, [] {});
+        __arch_install_irq(SAMPLE_IRQ, parasite_interrupt_handler);
+      }, cpu);
+      SMP::signal(cpu);
     }
-    // return when its not our turn
-    if (lockless) return;
-
-    // transfer all the built up samples
-    transferq->copy(samplerq->begin(), samplerq->size());
-    samplerq->clear();
-    lockless = 1;
   }
 };
 
@@ -68,6 +103,44 @@ static Sampler& get() {
   return sampler;
 }
 
+uint32_t kernel::walk_stack(uintptr_t* frames, uint32_t max,
+                            uintptr_t current, uintptr_t fp) noexcept
+{
+  if (max == 0) return 0;
+  uint32_t n = 0;
+  frames[n++] = current;
+  const uintptr_t end = kernel::memory_end();
+  while (n < max)
+  {
+    if (fp < 4096 or (fp & (sizeof(uintptr_t)-1)) or fp >= end - 2 * sizeof(uintptr_t))
+        break;
+    const auto* frame = (const uintptr_t*) fp;
+    if (frame[1] == 0) break;
+    frames[n++] = frame[1];
+    const uintptr_t next = frame[0];
+    if (next <= fp or next - fp > MAX_FRAME_SIZE) break;
+    fp = next;
+  }
+  return n;
+}
+
+void Cpu_sampler::add(uintptr_t current, uintptr_t frame, StackSampler::mode_t mode)
+{
+  // need free space to take more samples
+  if (samplerq->free_capacity() and mode != StackSampler::MODE_DUMMY)
+  {
+    auto& sample = samplerq->emplace_back();
+    sample.depth = kernel::walk_stack(sample.frames, MAX_DEPTH, current, frame);
+  }
+  // return when its not our turn
+  if (lockless.load(std::memory_order_acquire)) return;
+
+  // hand over the built up samples
+  std::swap(samplerq, transferq);
+  samplerq->clear();
+  lockless.store(1, std::memory_order_release);
+}
+
 void StackSampler::begin()
 {
   // start taking samples using PIT interrupts
@@ -78,54 +151,84 @@ void StackSampler::set_mode(mode_t md)
   get().mode = md;
 }
 
-void profiler_stack_sampler(void* sample)
+void profiler_stack_sampler(void* sample, void* frame)
 {
   auto& system = get();
   if (UNLIKELY(sample == nullptr)) return;
+  const int cpuid = SMP::cpu_id();
+  // sample the other CPUs at the same rate
+  if (cpuid == 0 and SMP::cpu_count() > 1)
+    SMP::broadcast(SAMPLE_IRQ);
+
+  auto& cpu = system.cpus.at(cpuid);
   // gather sample statistics
-  system.total++;
+  cpu.total++;
   if (sample == &_irq_cb_return_location) {
-    system.asleep++;
+    cpu.asleep++;
     return;
   }
   // if discard enabled, ignore samples
   if (UNLIKELY(system.discard)) return;
-  // add address to sampler queue
-  system.add(sample);
+  // add stack to sampler queue
+  cpu.add((uintptr_t) sample, (uintptr_t) frame, system.mode);
 }
 
 void gather_stack_sampling()
 {
-  // gather results on our turn only
-  if (get().lockless == 1)
+  auto& system = get();
+  std::vector<uintptr_t> stack;
+  stack.reserve(MAX_DEPTH);
+
+  for (auto& cpu : system.cpus)
   {
-    for (auto* addr = get().transferq->begin(); addr < get().transferq->end(); addr++)
+    // gather results on our turn only
+    if (cpu.lockless.load(std::memory_order_acquire) == 0) continue;
+
+    for (const auto& sample : *cpu.transferq)
     {
-      // convert return address to function entry address
-      uintptr_t resolved = Elf::resolve_addr(*addr);
-      // insert into unordered map
-      auto it = get().dict.find(resolved);
-      if (it != get().dict.end()) {
-        it->second++;
-      }
-      else {
-        // add to dictionary
-        get().dict.emplace(
-            std::piecewise_construct,
-            std::forward_as_tuple(resolved),
-            std::forward_as_tuple(1));
+      stack.clear();
+      // the caller mode leaves out the function sampled
+      const uint32_t first = (system.mode == StackSampler::MODE_CALLER) ? 1 : 0;
+      for (uint32_t i = first; i < sample.depth; i++)
+      {
+        // return addresses can be past the end of the calling function
+        const uintptr_t addr = (i == 0) ? sample.frames[i] : sample.frames[i] - 1;
+        // convert to function entry address
+        stack.push_back(Elf::resolve_addr(addr));
       }
+      if (stack.empty()) continue;
+
+      system.dict[stack.front()]++;
+      auto it = system.stacks.find(stack);
+      if (it != system.stacks.end())
+        it->second++;
+      else
+        system.stacks.emplace(stack, 1);
     }
+    cpu.transferq->clear();
     // switch back transferring of samples
-    get().lockless = 0;
+    cpu.lockless.store(0, std::memory_order_release);
   }
 }
 
 uint64_t StackSampler::samples_total() noexcept {
-  return get().total;
+  uint64_t total = 0;
+  for (const auto& cpu : get().cpus) total += cpu.total;
+  return total;
 }
 uint64_t StackSampler::samples_asleep() noexcept {
-  return get().asleep;
+  uint64_t asleep = 0;
+  for (const auto& cpu : get().cpus) asleep += cpu.asleep;
+  return asleep;
+}
+
+static std::string symbol_name(uintptr_t addr)
+{
+  char buffer[8192];
+  auto func = Elf::safe_resolve_symbol((void*) addr, buffer, sizeof(buffer));
+  if (func.name) return func.name;
+  int len = snprintf(buffer, sizeof(buffer), "0x%08zx", func.addr);
+  return std::string(buffer, len);
 }
 
 std::vector<Sample> StackSampler::results(int N)
@@ -140,28 +243,45 @@ std::vector<Sample> StackSampler::results(int N)
   });
 
   std::vector<Sample> res;
-  char buffer[8192];
 
   N = (N > (int)vec.size()) ? vec.size() : N;
   if (N <= 0) return res;
 
   for (auto& sa : vec)
   {
-    // resolve the addr
-    auto func = Elf::safe_resolve_symbol((void*) sa.first, buffer, sizeof(buffer));
-    if (func.name) {
-      res.push_back(Sample {sa.second, (void*) func.addr, func.name});
-    }
-    else {
-      int len = snprintf(buffer, sizeof(buffer), "0x%08zx", func.addr);
-      res.push_back(Sample {sa.second, (void*) func.addr, std::string(buffer, len)});
-    }
-
+    res.push_back(Sample {sa.second, (void*) sa.first, symbol_name(sa.first)});
     if (--N == 0) break;
   }
   return res;
 }
 
+std::string StackSampler::folded()
+{
+  // the same functions turn up in most stacks
+  std::unordered_map<uintptr_t, std::string> names;
+  std::string out;
+  for (const auto& [stack, count] : get().stacks)
+  {
+    // outermost first
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+    {
+      auto name = names.find(*it);
+      if (name == names.end()) {
+        auto sym = symbol_name(*it);
+        // frames are separated by semicolons
+        std::replace(sym.begin(), sym.end(), ';', ':');
+        name = names.emplace(*it, std::move(sym)).first;
+      }
+      if (it != stack.rbegin()) out += ';';
+      out += name->second;
+    }
+    out += ' ';
+    out += std::to_string(count);
+    out += '\n';
+  }
+  return out;
+}
+
 void StackSampler::print(const int N)
 {
   auto samp = results(N);
@@ -178,6 +298,12 @@ void StackSampler::print(const int N)
   }
 }
 
+void StackSampler::print_folded()
+{
+  const auto text = folded();
+  printf("%.*s", (int) text.size(), text.data());
+}
+
 void StackSampler::set_mask(bool mask)
 {
   get().discard = mask;
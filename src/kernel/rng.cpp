@@ -4,8 +4,10 @@
 #include <os.hpp>
 #include <os.hpp>
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <smp>
+#include <branch_prediction>
 #define SHAKE_128_RATE (1600-256)/8
 
 struct alignas(SMP_ALIGN) rng_state
@@ -179,3 +181,152 @@ void rng_reseed_init(delegate<void(uint64_t*)> func, int rounds)
   local_rng().reseed_rounds = rounds;
   reseed_now();
 }
+
+// Per-CPU ChaCha20 DRBG with fast key erasure: each refill makes a
+// buffer of keystream, the start of which is the next key.
+static const size_t   RNG_FAST_BUFFER = 512;
+static const size_t   RNG_FAST_KEY    = 32;
+static const uint64_t RNG_FAST_RESEED = 1024 * 1024;
+
+struct alignas(SMP_ALIGN) fast_rng_state
+{
+  uint32_t key[8];
+  uint64_t counter = 0;
+  // bytes until the next reseed, 0 when never seeded
+  uint64_t left = 0;
+  size_t   pos  = RNG_FAST_BUFFER;
+  uint8_t  buffer[RNG_FAST_BUFFER];
+};
+static std::array<fast_rng_state, SMP_MAX_CORES> fast_rng;
+
+static inline uint32_t rotl32(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+#define CHACHA_QR(a, b, c, d)               \
+  a += b; d ^= a; d = rotl32(d, 16);        \
+  c += d; b ^= c; b = rotl32(b, 12);        \
+  a += b; d ^= a; d = rotl32(d, 8);         \
+  c += d; b ^= c; b = rotl32(b, 7);
+
+// one 64 byte block of keystream, at @counter (the nonce is 0)
+static void chacha20_block(const uint32_t key[8], uint64_t counter, uint8_t* out)
+{
+  uint32_t in[16] = {
+    0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+    key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+    (uint32_t) counter, (uint32_t) (counter >> 32), 0, 0
+  };
+  uint32_t x[16];
+  memcpy(x, in, sizeof(x));
+  for (int i = 0; i < 10; i++)
+  {
+    CHACHA_QR(x[0], x[4], x[ 8], x[12]);
+    CHACHA_QR(x[1], x[5], x[ 9], x[13]);
+    CHACHA_QR(x[2], x[6], x[10], x[14]);
+    CHACHA_QR(x[3], x[7], x[11], x[15]);
+    CHACHA_QR(x[0], x[5], x[10], x[15]);
+    CHACHA_QR(x[1], x[6], x[11], x[12]);
+    CHACHA_QR(x[2], x[7], x[ 8], x[13]);
+    CHACHA_QR(x[3], x[4], x[ 9], x[14]);
+  }
+  for (int i = 0; i < 16; i++)
+    x[i] += in[i];
+  memcpy(out, x, sizeof(x));
+}
+#undef CHACHA_QR
+
+static void fast_refill(fast_rng_state& s)
+{
+  for (size_t i = 0; i < RNG_FAST_BUFFER; i += 64)
+    chacha20_block(s.key, s.counter++, &s.buffer[i]);
+  // the old key is gone with what it made
+  memcpy(s.key, s.buffer, RNG_FAST_KEY);
+  memset(s.buffer, 0, RNG_FAST_KEY);
+  s.pos = RNG_FAST_KEY;
+}
+
+static void fast_reseed(fast_rng_state& s)
+{
+  uint32_t seed[8];
+  rng_extract(seed, sizeof(seed));
+  for (int i = 0; i < 8; i++)
+    s.key[i] ^= seed[i];
+  // fresh from the hardware (RDSEED / RDRAND), besides the pool
+  if (local_rng().reseed_callback != nullptr) {
+    uint64_t value;
+    local_rng().reseed_callback(&value);
+    s.key[0] ^= value;
+    s.key[1] ^= value >> 32;
+  }
+  s.left = RNG_FAST_RESEED;
+  fast_refill(s);
+}
+
+void rng_fast_fill(void* output, size_t bytes)
+{
+  auto& s = PER_CPU(fast_rng);
+  if (UNLIKELY(s.left < bytes))
+    fast_reseed(s);
+  s.left -= std::min(s.left, (uint64_t) bytes);
+
+  auto* out = static_cast<uint8_t*>(output);
+  size_t take = std::min(bytes, RNG_FAST_BUFFER - s.pos);
+  memcpy(out, &s.buffer[s.pos], take);
+  memset(&s.buffer[s.pos], 0, take);
+  s.pos += take;
+  out   += take;
+  bytes -= take;
+  if (LIKELY(bytes == 0))
+    return;
+
+  // bulk: whole blocks straight to the output, then a new key
+  while (bytes >= 64) {
+    chacha20_block(s.key, s.counter++, out);
+    out   += 64;
+    bytes -= 64;
+  }
+  fast_refill(s);
+  memcpy(out, &s.buffer[s.pos], bytes);
+  memset(&s.buffer[s.pos], 0, bytes);
+  s.pos += bytes;
+}
+
+uint32_t rng_fast_uint32()
+{
+  auto& s = PER_CPU(fast_rng);
+  if (LIKELY(s.pos + sizeof(uint32_t) <= RNG_FAST_BUFFER and s.left >= sizeof(uint32_t)))
+  {
+    uint32_t x;
+    memcpy(&x, &s.buffer[s.pos], sizeof(x));
+    memset(&s.buffer[s.pos], 0, sizeof(x));
+    s.pos  += sizeof(x);
+    s.left -= sizeof(x);
+    return x;
+  }
+  uint32_t x;
+  rng_fast_fill(&x, sizeof(x));
+  return x;
+}
+
+uint64_t rng_fast_uint64()
+{
+  auto& s = PER_CPU(fast_rng);
+  if (LIKELY(s.pos + sizeof(uint64_t) <= RNG_FAST_BUFFER and s.left >= sizeof(uint64_t)))
+  {
+    uint64_t x;
+    memcpy(&x, &s.buffer[s.pos], sizeof(x));
+    memset(&s.buffer[s.pos], 0, sizeof(x));
+    s.pos  += sizeof(x);
+    s.left -= sizeof(x);
+    return x;
+  }
+  uint64_t x;
+  rng_fast_fill(&x, sizeof(x));
+  return x;
+}
+
+void rng_fast_reseed()
+{
+  PER_CPU(fast_rng).left = 0;
+}
@@ -5,6 +5,7 @@
 #include <kernel/elf.hpp>
 #include <os.hpp>
 #include <kernel/rtc.hpp>
+#include <statman>
 #include <util/units.hpp>
 #include <unordered_map>
 #include <cassert>
@@ -88,6 +89,7 @@ ScopedProfiler::~ScopedProfiler()
       // Update the entry
       entry.cycles_total += cycles;
       entry.num_samples += 1;
+      entry.histogram->record(cycles);
       return;
     }
   }
@@ -107,6 +109,8 @@ ScopedProfiler::~ScopedProfiler()
 	  entry.num_samples = 1;
       entry.cycles_total = cycles;
 	  entry.ticks_start = this->tick_start;
+      entry.histogram = std::make_unique<util::Histogram>();
+      entry.histogram->record(cycles);
       return;
     }
   }
@@ -121,7 +125,7 @@ std::string ScopedProfiler::get_statistics(bool sorted)
   std::ostringstream ss;
 
   // Add header
-  ss << " First seen   | CPU time (avg) | Samples | Function Name \n";
+  ss << " First seen   | CPU time (avg) | CPU time (p99) | Samples | Function Name \n";
   ss << "--------------------------------------------------------------------------------\n";
 
   // Calculate the number of used entries
@@ -163,6 +167,10 @@ std::string ScopedProfiler::get_statistics(bool sorted)
       ss.width(10);
       ss << micros << " ms | ";
 
+      double tail = (double) entry.histogram->percentile(99) / KHz(os::cpu_freq()).count();
+      ss.width(10);
+      ss << tail << " ms | ";
+
       ss.width(7);
       ss << entry.num_samples << " | ";
 
@@ -183,5 +191,11 @@ std::string ScopedProfiler::get_statistics(bool sorted)
   // Add footer
   ss << "--------------------------------------------------------------------------------\n";
 
+  // and the latency histograms, in their units (ns)
+  Statman::get().for_each_histogram(
+  [&ss] (const std::string& name, const util::Histogram_percpu& hist) {
+    ss << " " << name << ": " << hist.merged().to_string() << "\n";
+  });
+
   return ss.str();
 }
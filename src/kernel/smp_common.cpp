@@ -1,10 +1,63 @@
 #include <kernel/smp_common.hpp>
+#include <branch_prediction>
+#include <profile>
 
 namespace smp
 {
 smp_main_system main_system;
 std::vector<smp_worker_system> systems;
 
+bool work_deque::push(task* t) noexcept
+{
+  const int64_t b = bottom.load(std::memory_order_relaxed);
+  const int64_t t0 = top.load(std::memory_order_acquire);
+  if (b - t0 >= CAPACITY) return false;
+  buffer[b % CAPACITY].store(t, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom.store(b + 1, std::memory_order_relaxed);
+  return true;
+}
+
+task* work_deque::pop() noexcept
+{
+  const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+  bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top.load(std::memory_order_relaxed);
+  if (t > b) {
+    // empty
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  task* result = buffer[b % CAPACITY].load(std::memory_order_relaxed);
+  if (t == b)
+  {
+    // the last one, race against thieves for it
+    if (not top.compare_exchange_strong(t, t + 1,
+              std::memory_order_seq_cst, std::memory_order_relaxed))
+        result = nullptr;
+    bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return result;
+}
+
+task* work_deque::steal() noexcept
+{
+  while (true)
+  {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+
+    task* result = buffer[t % CAPACITY].load(std::memory_order_relaxed);
+    if (top.compare_exchange_strong(t, t + 1,
+              std::memory_order_seq_cst, std::memory_order_relaxed))
+        return result;
+    // another CPU got it, try the next one
+  }
+}
+
 void task_done_handler()
 {
 	int next = smp::main_system.bitmap.first_set();
@@ -27,6 +80,24 @@ void task_done_handler()
     }
 }
 
+static void smp_task_run(smp::task& task)
+{
+  // execute actual task
+  if (UNLIKELY(StallWatchdog::enabled())) {
+    const uint64_t start = os::Arch::cpu_cycles();
+    task.func();
+    StallWatchdog::record(Stall_sample::TASK, 0, task.func.invoker(),
+                          os::Arch::cpu_cycles() - start);
+  }
+  else task.func();
+  // keep done function for later (only if its callable)
+  if (task.done != nullptr)
+  {
+    // NOTE: specifically pushing to this cpu here, and not main system
+    PER_CPU(smp::systems).finished.push_back(std::move(task.done));
+  }
+}
+
 static bool smp_task_doer(smp_worker_system& system)
 {
   // early return check, as there is no point in locking when its empty
@@ -47,36 +118,59 @@ static bool smp_task_doer(smp_worker_system& system)
 
   system.tlock.unlock();
 
-  // execute actual task
-  task.func();
+  smp_task_run(task);
+  return true;
+}
 
-  // add done function to completed list (only if its callable)
-  if (task.done != nullptr)
+static bool smp_work_doer(smp::task* task)
+{
+  if (task == nullptr) return false;
+  smp_task_run(*task);
+  delete task;
+  return true;
+}
+
+static smp::task* smp_task_steal()
+{
+  const int cpu = SMP::cpu_id();
+  const int count = systems.size();
+  // start with the next CPU, so thieves spread out
+  for (int i = 1; i < count; i++)
   {
-    // NOTE: specifically pushing to this cpu here, and not main system
-    auto& system = PER_CPU(smp::systems);
-    system.flock.lock();
-    system.completed.push_back(std::move(task.done));
-    system.flock.unlock();
-    // signal home
-    system.work_done = true;
+    auto* task = systems[(cpu + i) % count].work.steal();
+    if (task != nullptr) return task;
   }
-  return true;
+  return nullptr;
 }
+
 void smp_task_handler()
 {
   auto& system = PER_CPU(smp::systems);
-  system.work_done = false;
   // cpu-specific tasks
   while (smp_task_doer(system));
+  // our own share, newest first
+  while (smp_work_doer(system.work.pop()));
   // global tasks (by taking from index 0)
   while (smp_task_doer(systems[0]));
-  // if we did any work with done functions, signal back
-  if (system.work_done) {
-    // set bit for this CPU
-    smp::main_system.bitmap.atomic_set(SMP::cpu_id());
-    // signal main CPU
-	SMP::signal_bsp();
+  // take from the others, running whatever each task added here
+  while (smp_work_doer(smp_task_steal())) {
+    while (smp_work_doer(system.work.pop()));
+  }
+  // if we did any work with done functions, signal back once
+  if (not system.finished.empty())
+  {
+    system.flock.lock();
+    if (system.completed.empty())
+        system.completed.swap(system.finished);
+    else
+        system.completed.insert(system.completed.end(),
+              std::make_move_iterator(system.finished.begin()),
+              std::make_move_iterator(system.finished.end()));
+    system.flock.unlock();
+    system.finished.clear();
+    // set bit for this CPU, and signal main CPU unless still pending
+    if (not smp::main_system.bitmap.atomic_test_and_set(SMP::cpu_id()))
+	    SMP::signal_bsp();
   }
 }
 
@@ -1,20 +1,76 @@
 #include <smp_utils>
 #include <smp>
+#include <branch_prediction>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
-void smp_spinlock::lock()
+namespace smp {
+  void (*pv_lock_wait)(volatile spinlock_t*) = nullptr;
+  void (*pv_lock_kick)(volatile spinlock_t*) = nullptr;
+}
+
+// spins until the lock is taken, returning how many times it was busy
+static inline uint32_t spin_acquire(volatile spinlock_t& value)
 {
-  while (!__sync_bool_compare_and_swap(&m_value, 0, 1)) {
-	while (m_value) {
+  uint32_t spins = 0;
+  int until_wait = smp_spinlock::PV_SPIN_THRESHOLD;
+  while (true) {
+    // waiters halted on it are kept in the lock word
+    const spinlock_t val = value;
+    if (!(val & smp_spinlock::LOCKED)) {
+      if (__sync_bool_compare_and_swap(&value, val, val | smp_spinlock::LOCKED))
+        return spins;
+      // lost the race for it
+      if (spins == 0) spins = 1;
+      continue;
+    }
 #ifdef ARCH_x86
-        _mm_pause();
+    _mm_pause();
 #endif
+    spins++;
+    // the holder is probably not running, so stop burning its time
+    if (UNLIKELY(--until_wait == 0 and smp::pv_lock_wait != nullptr)) {
+      smp::pv_lock_wait(&value);
+      until_wait = smp_spinlock::PV_SPIN_THRESHOLD;
     }
   }
 }
+
+static inline void release(volatile spinlock_t& value)
+{
+  if (LIKELY(smp::pv_lock_kick == nullptr)) {
+    __sync_lock_release(&value, 0);
+    return;
+  }
+  const spinlock_t old = __atomic_exchange_n(&value, 0, __ATOMIC_RELEASE);
+  if (UNLIKELY(old & smp_spinlock::WAITERS))
+    smp::pv_lock_kick(&value);
+}
+
+#ifndef ENABLE_LOCK_PROFILER
+void smp_spinlock::lock()
+{
+  spin_acquire(m_value);
+}
+void smp_spinlock::unlock()
+{
+  release(m_value);
+}
+#else
+// records who takes the lock, how long they waited and held it
+__attribute__((noinline))
+void smp_spinlock::lock()
+{
+  const uint32_t spins = spin_acquire(m_value);
+  m_site = smp::lock_acquired((uintptr_t) __builtin_return_address(0), spins, m_acquired);
+}
 void smp_spinlock::unlock()
 {
-  __sync_lock_release(&m_value, 0);
+  smp::lock_released(m_site, m_acquired);
+  release(m_value);
 }
+#endif
 
 void smp_barrier::spin_wait(int max) noexcept
 {
@@ -25,3 +81,68 @@ void smp_barrier::spin_wait(int max) noexcept
 #endif
   }
 }
+
+namespace smp
+{
+  size_t parallel_chunk_size(size_t count, size_t grain) noexcept
+  {
+    // a few chunks per CPU, so that CPUs busy with other things
+    // (or getting to it late) don't hold up the rest
+    const size_t chunks = SMP::cpu_count() * 4;
+    return std::max<size_t>({(count + chunks - 1) / chunks, grain, 1});
+  }
+
+  struct parallel_job
+  {
+    parallel_job(size_t cnt, size_t chk, delegate<void(size_t, size_t)> f)
+      : count(cnt), chunk(chk), func(std::move(f)) {}
+
+    const size_t count;
+    const size_t chunk;
+    delegate<void(size_t, size_t)> func;
+    std::atomic<size_t> next {0};
+    // items finished
+    std::atomic<size_t> done {0};
+  };
+
+  static void parallel_work(parallel_job& job)
+  {
+    while (true)
+    {
+      const size_t first = job.next.fetch_add(job.chunk);
+      if (first >= job.count) return;
+      const size_t last = std::min(first + job.chunk, job.count);
+      job.func(first, last);
+      job.done.fetch_add(last - first, std::memory_order_release);
+    }
+  }
+
+  void parallel_run(size_t count, size_t chunk,
+                    delegate<void(size_t, size_t)> func)
+  {
+    if (count == 0) return;
+    chunk = std::max<size_t>(chunk, 1);
+    const size_t chunks = (count + chunk - 1) / chunk;
+    const size_t helpers = std::min<size_t>(SMP::cpu_count() - 1, chunks - 1);
+    if (helpers == 0)
+    {
+      for (size_t first = 0; first < count; first += chunk)
+          func(first, std::min(first + chunk, count));
+      return;
+    }
+    // helpers getting to it after we return find nothing left to do
+    auto job = std::make_shared<parallel_job>(count, chunk, std::move(func));
+    for (size_t i = 0; i < helpers; i++) {
+      SMP::add_task([job] { parallel_work(*job); });
+    }
+    SMP::signal();
+    parallel_work(*job);
+
+    // wait for the chunks others are still working on
+    while (job->done.load(std::memory_order_acquire) < count) {
+#ifdef ARCH_x86
+      _mm_pause();
+#endif
+    }
+  }
+}
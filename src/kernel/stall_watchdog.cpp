@@ -0,0 +1,149 @@
+#include <profile>
+#include <kernel/elf.hpp>
+#include <os.hpp>
+#include <smp>
+#include <statman>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+namespace
+{
+  struct stall
+  {
+    uint64_t    key = 0;
+    const void* func = nullptr;
+    uint64_t    cycles = 0;
+    uint64_t    when = 0;
+    Stall_sample::Kind kind = Stall_sample::EVENT;
+  };
+  // only written by its own CPU, the last ones in a ring
+  struct alignas(SMP_ALIGN) stall_ring
+  {
+    std::array<stall, StallWatchdog::STALLS> stalls;
+    uint64_t count = 0;
+  };
+  std::array<stall_ring, SMP_MAX_CORES> stall_rings;
+
+  uint64_t threshold = 0;
+  bool     log_stalls = false;
+  util::Histogram_percpu* handler_ns = nullptr;
+
+  const char* kind_name(Stall_sample::Kind kind) noexcept
+  {
+    switch (kind) {
+      case Stall_sample::EVENT:  return "event";
+      case Stall_sample::POSTED: return "posted";
+      case Stall_sample::TIMER:  return "timer";
+      default:                   return "task";
+    }
+  }
+
+  // from the symbol index, without using the heap
+  const char* name_of(const void* func, char* buffer, size_t len) noexcept
+  {
+    auto res = Elf::safe_resolve_symbol(func, buffer, len);
+    if (res.name) return res.name;
+    snprintf(buffer, len, "%p", func);
+    return buffer;
+  }
+}
+
+void StallWatchdog::enable(std::chrono::microseconds limit, bool log)
+{
+  if (handler_ns == nullptr)
+      handler_ns = &Statman::get().create_histogram("events.handler_ns");
+  // cpu_freq() is in kHz
+  threshold  = limit.count() * os::cpu_freq().count() / 1000;
+  log_stalls = log;
+  enabled_ = true;
+}
+
+void StallWatchdog::record(Stall_sample::Kind kind, uint64_t key,
+                           const void* func, uint64_t cycles) noexcept
+{
+  handler_ns->record(os::detail::cycles_to_nanos(cycles));
+  if (LIKELY(cycles < threshold)) return;
+
+  auto& ring = stall_rings[SMP::cpu_id()];
+  ring.stalls[ring.count++ % STALLS] = {key, func, cycles, os::Arch::cpu_cycles(), kind};
+  if (log_stalls)
+  {
+    char buffer[1024];
+    printf("[ stall ] CPU %d: %s %lu ran for %lu us in %s\n",
+           SMP::cpu_id(), kind_name(kind), (unsigned long) key,
+           (unsigned long) (os::detail::cycles_to_nanos(cycles) / 1000),
+           name_of(func, buffer, sizeof(buffer)));
+  }
+}
+
+uint64_t StallWatchdog::count() noexcept
+{
+  uint64_t total = 0;
+  for (const auto& ring : stall_rings) total += ring.count;
+  return total;
+}
+
+std::vector<Stall_sample> StallWatchdog::results(int N)
+{
+  std::vector<Stall_sample> res;
+  for (int cpu = 0; cpu < SMP_MAX_CORES; cpu++)
+  {
+    const auto& ring = stall_rings[cpu];
+    const uint64_t kept = std::min<uint64_t>(ring.count, STALLS);
+    for (uint64_t i = ring.count - kept; i < ring.count; i++)
+    {
+      const auto& entry = ring.stalls[i % STALLS];
+      res.push_back({entry.kind, cpu, entry.key, entry.func, {},
+                     entry.cycles, entry.when});
+    }
+  }
+  std::sort(res.begin(), res.end(),
+  [] (const Stall_sample& a, const Stall_sample& b) {
+    return a.when > b.when;
+  });
+  if (N >= 0 and (size_t) N < res.size()) res.resize(N);
+
+  char buffer[8192];
+  for (auto& sa : res)
+    sa.name = name_of(sa.func, buffer, sizeof(buffer));
+  return res;
+}
+
+util::Histogram StallWatchdog::dispatch_delay(const int cpu)
+{
+  util::Histogram result;
+  Statman::get().for_each_histogram(
+    [&result, cpu] (const std::string& name, util::Histogram_percpu& hist) {
+      if (name == "events.dispatch_ns" and (size_t) cpu < hist.cpus())
+          result = hist.at(cpu);
+    });
+  return result;
+}
+
+void StallWatchdog::print(const int N)
+{
+  if (not enabled()) {
+    printf("Stall watchdog - not enabled\n");
+    return;
+  }
+  printf("Stalls: %lu\n", (unsigned long) count());
+  printf("%4s %8s %8s %12s  %s\n", "CPU", "Kind", "Key", "Micros", "Name");
+  for (auto& sa : results(N))
+  {
+    printf("%4d %8s %8lu %12lu  %s\n",
+           sa.cpu, kind_name(sa.kind), (unsigned long) sa.key,
+           (unsigned long) (os::detail::cycles_to_nanos(sa.cycles) / 1000),
+           sa.name.c_str());
+  }
+  for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+  {
+    printf("CPU %d dispatch delay (ns): %s\n",
+           cpu, dispatch_delay(cpu).to_string().c_str());
+  }
+}
+
+void StallWatchdog::reset()
+{
+  for (auto& ring : stall_rings) ring = {};
+}
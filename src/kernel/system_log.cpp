@@ -1,5 +1,6 @@
 #include <system_log>
 #include <kernel.hpp>
+#include <kernel/log_stage.hpp>
 #include <os.hpp>
 #include <kernel/memory.hpp>
 #include <ringbuffer>
@@ -72,8 +73,31 @@ void SystemLog::write(const char* buffer, size_t length)
   syslog_lock.unlock();
 }
 
+// stdout, batched per CPU so that only the flushes take the lock
+static kernel::Log_stage& log_stage()
+{
+  static kernel::Log_stage stage {"system_log", SystemLog::write};
+  return stage;
+}
+
+void SystemLog::set_flush_interval(std::chrono::milliseconds interval)
+{
+  log_stage().set_interval(interval);
+}
+
+void SystemLog::flush()
+{
+  log_stage().flush();
+}
+
+uint64_t SystemLog::dropped_bytes()
+{
+  return log_stage().dropped();
+}
+
 std::vector<char> SystemLog::copy()
 {
+  SystemLog::flush();
   syslog_lock.lock();
   const auto* buffer = get_mrb()->sequentialize();
   std::vector<char> copy {buffer, buffer + get_mrb()->size()};
@@ -137,5 +161,7 @@ void SystemLog::initialize()
 __attribute__((constructor))
 static void system_log_gconstr()
 {
-  os::add_stdout(SystemLog::write);
+  os::add_stdout([] (const char* data, size_t len) {
+    log_stage().write(data, len);
+  });
 }
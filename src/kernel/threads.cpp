@@ -3,6 +3,7 @@
 #include <common>
 #include <pthread.h>
 #include <kprint>
+#include <algorithm>
 #ifdef ARCH_x86_64
 #include <arch/x86/cpu.hpp>
 #endif
@@ -96,9 +97,11 @@ namespace kernel
     if (this->clear_tid) {
         THPRINT("Clearing child value at %p\n", this->clear_tid);
         *(pid_t*) this->clear_tid = 0;
+        futex_wake((int*) this->clear_tid, 1);
     }
     // delete this thread
 	tman.erase_thread_safely(this);
+	tman.erase_suspension(this);
     // free thread resources
     delete this;
     // NOTE: cannot deref this after this
@@ -135,6 +138,7 @@ namespace kernel
 
   void Thread::resume()
   {
+      this->parked = false;
       set_thread_area(this->my_tls);
       THPRINT("CPU %d: Returning to tid=%ld tls=%p stack=%p thread=%p\n",
             SMP::cpu_id(), this->tid, this->my_tls, this->stored_stack, get_thread());
@@ -249,10 +253,7 @@ namespace kernel
   }
 
   Thread* get_thread(long tid) {
-	  auto& threads = ThreadManager::get().threads;
-      auto it = threads.find(tid);
-      if (it != threads.end()) return it->second;
-	  return nullptr;
+	  return ThreadManager::get().threads.find(tid);
   }
 
   void resume(long tid)
@@ -266,6 +267,107 @@ namespace kernel
 	  Expects(thread && "Could not find thread id");
   }
 
+  void park()
+  {
+	  auto* thread = get_thread();
+	  thread->sleeping = true;
+	  __thread_yield();
+	  thread->sleeping = false;
+  }
+  void unpark(Thread* thread)
+  {
+	  if (thread->parked) {
+		  thread->parked = false;
+		  ThreadManager::get().suspend(thread);
+	  }
+  }
+
+  void migrate(long tid, int cpu)
+  {
+	  if (cpu == SMP::cpu_id()) return;
+	  auto* kthread = ThreadManager::get().detach(tid);
+	  SMP::add_task(
+	  [kthread] () {
+		  ThreadManager::get().attach(kthread);
+	  }, nullptr, cpu);
+	  SMP::signal(cpu);
+  }
+
+  void Run_queue::push_back(Thread* t) noexcept
+  {
+	  Expects(not t->queued);
+	  t->rq_prev = tail;
+	  t->rq_next = nullptr;
+	  if (tail) tail->rq_next = t;
+	  else      head = t;
+	  tail = t;
+	  t->queued = true;
+	  count++;
+  }
+  Thread* Run_queue::pop_front() noexcept
+  {
+	  auto* t = head;
+	  if (t != nullptr) this->erase(t);
+	  return t;
+  }
+  void Run_queue::erase(Thread* t) noexcept
+  {
+	  if (not t->queued) return;
+	  if (t->rq_prev) t->rq_prev->rq_next = t->rq_next;
+	  else            head = t->rq_next;
+	  if (t->rq_next) t->rq_next->rq_prev = t->rq_prev;
+	  else            tail = t->rq_prev;
+	  t->rq_prev = t->rq_next = nullptr;
+	  t->queued = false;
+	  count--;
+  }
+
+  Thread* Thread_table::find(long tid) const noexcept
+  {
+	  if (buckets.empty()) return nullptr;
+	  for (auto* t = buckets[bucket(tid)]; t != nullptr; t = t->tid_next) {
+		  if (t->tid == tid) return t;
+	  }
+	  return nullptr;
+  }
+  void Thread_table::insert(Thread* thread)
+  {
+	  if (count >= buckets.size()) this->grow();
+	  auto& head = buckets[bucket(thread->tid)];
+	  thread->tid_next = head;
+	  head = thread;
+	  count++;
+  }
+  bool Thread_table::erase(Thread* thread) noexcept
+  {
+	  if (buckets.empty()) return false;
+	  for (auto** t = &buckets[bucket(thread->tid)]; *t != nullptr; t = &(*t)->tid_next)
+	  {
+		  if (*t == thread) {
+			  *t = thread->tid_next;
+			  thread->tid_next = nullptr;
+			  count--;
+			  return true;
+		  }
+	  }
+	  return false;
+  }
+  void Thread_table::grow()
+  {
+	  // tids are handed out in sequence, so they spread evenly
+	  std::vector<Thread*> old(std::max<size_t>(16, buckets.size() * 2), nullptr);
+	  old.swap(buckets);
+	  for (auto* t : old) {
+		  while (t != nullptr) {
+			  auto* next = t->tid_next;
+			  auto& head = buckets[bucket(t->tid)];
+			  t->tid_next = head;
+			  head = t;
+			  t = next;
+		  }
+	  }
+  }
+
   Thread* ThreadManager::detach(long tid)
   {
 	  auto* thread = get_thread(tid);
@@ -301,37 +403,22 @@ namespace kernel
   }
   void ThreadManager::insert_thread(Thread* thread)
   {
-	  threads.emplace(
-			std::piecewise_construct,
-			std::forward_as_tuple(thread->tid),
-			std::forward_as_tuple(thread));
+	  threads.insert(thread);
   }
   void ThreadManager::erase_thread_safely(Thread* thread)
   {
 	  Expects(thread != nullptr);
-	  auto it = threads.find(thread->tid);
-	  Expects(it != threads.end());
-	  Expects(it->second == thread);
-	  threads.erase(it);
+	  const bool erased = threads.erase(thread);
+	  Expects(erased);
   }
   Thread* ThreadManager::wakeup_next()
   {
 	  Expects(!suspended.empty());
-	  auto* next = suspended.front();
-	  suspended.pop_front();
-	  return next;
+	  return suspended.pop_front();
   }
   void ThreadManager::erase_suspension(Thread* t)
   {
-      for (auto it = suspended.begin(); it != suspended.end();)
-      {
-          if (*it == t) {
-              it = suspended.erase(it);
-          }
-          else {
-              ++it;
-          }
-      }
+	  suspended.erase(t);
   }
   void ThreadManager::yield_to(Thread* thread)
   {
@@ -352,9 +439,18 @@ void __thread_suspend_and_yield(void* stack)
 				SMP::cpu_id(), kernel::get_thread(), stack);
 		return;
 	}
-	// suspend current thread (yielded)
 	auto* thread = kernel::get_thread();
-	thread->suspend(true, stack);
+	if (thread->sleeping)
+	{
+		// wait outside the run queue, until unparked
+		thread->yielded = true;
+		thread->stored_stack = stack;
+		thread->parked = true;
+	}
+	else {
+		// suspend current thread (yielded)
+		thread->suspend(true, stack);
+	}
 
 	if (man.next_thread == nullptr)
 	{
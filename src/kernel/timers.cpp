@@ -6,7 +6,11 @@
 #include <service>
 #include <smp>
 #include <statman>
-#include <map>
+#include <kernel/trace.hpp>
+#include <profile>
+#include <util/histogram.hpp>
+#include <array>
+#include <limits>
 #include <vector>
 
 using namespace std::chrono;
@@ -30,7 +34,10 @@ struct SystemTimer
   SystemTimer(SystemTimer&& other)
     : time(other.time), period(other.period),
       callback(std::move(other.callback)),
-      already_dead(other.already_dead) {}
+      already_dead(other.already_dead),
+      deferrable(other.deferrable), slack(other.slack),
+      next(other.next), prev(other.prev),
+      level(other.level), slot(other.slot) {}
 
   bool is_alive() const noexcept {
     return already_dead == false;
@@ -38,15 +45,28 @@ struct SystemTimer
   bool is_oneshot() const noexcept {
     return period.count() == 0;
   }
+  bool is_scheduled() const noexcept {
+    return level != UNSCHEDULED;
+  }
   void reset() {
     callback.reset();
     already_dead = false;
+    deferrable = false;
+    slack = duration_t::zero();
   }
 
   duration_t time;
   duration_t period;
   handler_t  callback;
   bool already_dead = false;
+  bool deferrable   = false;
+  duration_t slack {0};
+  // place in the timing wheel
+  static constexpr uint8_t UNSCHEDULED = 0xff;
+  Timers::id_t next  = Timers::UNUSED_ID;
+  Timers::id_t prev  = Timers::UNUSED_ID;
+  uint8_t      level = UNSCHEDULED;
+  uint8_t      slot  = 0;
 };
 
 /**
@@ -59,15 +79,44 @@ struct SystemTimer
  *     inflate the schedule container, as well as complicate stopping timers
  * 6. Free timer IDs are retrieved from a stack of free timer IDs (or through
  *     expanding the "fixed" vector)
+ * 7. Scheduled timers are kept in a hierarchical timing wheel: 6 levels of
+ *     64 slots, the slots of the first level one tick (65.5 us) apart and
+ *     those of each level above 64 times further apart. The slots are lists
+ *     linked through the timers themselves, so scheduling and stopping take
+ *     constant time and never allocate. A timer moves down a level when its
+ *     slot comes up. Timers beyond the top level (52 days) wait in its last
+ *     slot. Timers keep their exact time, and run no earlier than it.
+ * 8. The hardware timer is set for the earliest time a timer may run, with
+ *     its slack, and every timer due by then runs in the same interrupt.
+ *     Deferrable timers are left out, so with only those the hardware timer
+ *     is stopped altogether.
 **/
 static bool signal_ready = false;
 
 struct alignas(SMP_ALIGN) timer_system
 {
-  timer_system() = default;
+  using tick_t = uint64_t;
+  static constexpr int    TICK_SHIFT = 16;
+  static constexpr int    SLOT_BITS  = 6;
+  static constexpr int    SLOTS      = 1 << SLOT_BITS;
+  static constexpr int    LEVELS     = 6;
+  static constexpr tick_t NO_TICK    = std::numeric_limits<tick_t>::max();
+
+  timer_system() { for (auto& level : slots) level.fill(Timers::UNUSED_ID); }
   timer_system(timer_system&&) = default;
   void free_timer(Timers::id_t);
   void sched_timer(duration_t when, Timers::id_t);
+  void link(Timers::id_t) noexcept;
+  void unlink(Timers::id_t) noexcept;
+  Timers::id_t& head_of(const SystemTimer&) noexcept;
+  /** The next tick with timers to run (from the current one) or move down */
+  tick_t next_tick(bool cascades) const noexcept;
+  /** The latest time the next timers may run, or timers moved down */
+  duration_t next_wakeup() const noexcept;
+  /** Run the timers due by @now, moving timers down as their slots come up */
+  void expire(duration_t now);
+  /** Run the callback of @id, timed for the stall watchdog */
+  void run_timed(Timers::id_t);
 
   bool     is_running  = false;
   int      interrupt = 0;
@@ -75,14 +124,21 @@ struct alignas(SMP_ALIGN) timer_system
   Timers::stop_func_t  arch_stop_func;
   std::vector<SystemTimer>  timers;
   std::vector<Timers::id_t> free_timers;
-  // timers sorted by timestamp
-  std::multimap<duration_t, Timers::id_t> scheduled;
+  // the timing wheel, and the timers being run (level LEVELS)
+  std::array<std::array<Timers::id_t, SLOTS>, LEVELS> slots;
+  std::array<uint64_t, LEVELS> occupied {}; // one bit per non-empty slot
+  Timers::id_t running  = Timers::UNUSED_ID;
+  size_t       scheduled = 0;
+  size_t       waking    = 0; // scheduled timers that are not deferrable
+  tick_t       current   = 0; // the tick being run
+  duration_t   wakeup {0};    // time the hardware timer is set for
   /** Stats */
   int64_t  stat64 = 0;
   int64_t*  oneshot_started = &stat64;
   int64_t*  oneshot_stopped = &stat64;
   uint32_t* periodic_started = (uint32_t*) &stat64;
   uint32_t* periodic_stopped = (uint32_t*) &stat64;
+  util::Histogram_percpu* lateness = nullptr;
 };
 static std::vector<timer_system> systems;
 SMP_RESIZE_EARLY_GCTOR(systems);
@@ -111,6 +167,9 @@ void Timers::init(const start_func_t& start, const stop_func_t& stop)
   system.oneshot_stopped = (int64_t*) &Statman::get().create(Stat::UINT64, CPU + ".timers.oneshot_stopped").get_uint64();
   system.periodic_started = &Statman::get().create(Stat::UINT32, CPU + ".timers.periodic_started").get_uint32();
   system.periodic_stopped = &Statman::get().create(Stat::UINT32, CPU + ".timers.periodic_stopped").get_uint32();
+  // how late timers run, on all CPUs
+  static auto& lateness = Statman::get().create_histogram("timers.lateness_ns");
+  system.lateness = &lateness;
 
 }
 
@@ -176,17 +235,10 @@ void Timers::stop(Timers::id_t id)
   timer.already_dead = true;
   // free resources immediately
   timer.callback.reset();
-  // search for timer in scheduled
-  auto it = system.scheduled.find(timer.time);
-  for (; it != system.scheduled.end(); ++it) {
-    // found dead timer
-    if (id == it->second) {
-      // erase from schedule
-      system.scheduled.erase(it);
-      // free from system
-      system.free_timer(id);
-      break;
-    }
+  // a timer running its callback is freed when it returns
+  if (timer.is_scheduled()) {
+    system.unlink(id);
+    system.free_timer(id);
   }
   // timer stats
   if (system.timers[id].is_oneshot())
@@ -195,8 +247,26 @@ void Timers::stop(Timers::id_t id)
     (*system.periodic_stopped)++;
 }
 
+void Timers::set_slack(Timers::id_t id, duration_t slack)
+{
+  get().timers.at(id).slack = std::max(slack, duration_t::zero());
+}
+
+void Timers::set_deferrable(Timers::id_t id, bool deferrable)
+{
+  auto& system = get();
+  auto& timer  = system.timers.at(id);
+  if (timer.deferrable == deferrable) return;
+  // the count of waking timers follows scheduled ones
+  if (timer.is_scheduled()) {
+    if (deferrable) system.waking--;
+    else            system.waking++;
+  }
+  timer.deferrable = deferrable;
+}
+
 size_t Timers::active() {
-  return get().scheduled.size();
+  return get().scheduled;
 }
 size_t Timers::existing() {
   return get().timers.size();
@@ -207,67 +277,235 @@ size_t Timers::free() {
 
 /// scheduling ///
 
-duration_t Timers::next()
+static inline uint64_t rotr(uint64_t x, int n) noexcept
 {
-  auto& system = get();
-  if (LIKELY(!system.scheduled.empty()))
+  n &= 63;
+  return (n == 0) ? x : (x >> n) | (x << (64 - n));
+}
+
+Timers::id_t& timer_system::head_of(const SystemTimer& timer) noexcept
+{
+  if (timer.level == LEVELS) return this->running;
+  return this->slots[timer.level][timer.slot];
+}
+
+void timer_system::link(Timers::id_t id) noexcept
+{
+  auto& timer = this->timers[id];
+  // a timer already due goes in the slot being run
+  const tick_t tick = std::max<tick_t>(timer.time.count() >> TICK_SHIFT, current);
+
+  int    level  = 0;
+  tick_t bucket = 0;
+  for (; level < LEVELS; level++)
   {
-    auto it   = system.scheduled.begin();
-    auto when = it->first;
-    auto diff = when - now();
-    // avoid returning zero or negative diff
-    if (diff < nanoseconds(1)) return nanoseconds(1);
-    return diff;
+    const int shift = level * SLOT_BITS;
+    bucket = tick >> shift;
+    if (bucket - (current >> shift) < SLOTS) break;
   }
-  return duration_t::zero();
+  // too far ahead, wait in the last slot of the top level
+  if (level == LEVELS)
+  {
+    level  = LEVELS - 1;
+    bucket = (current >> (level * SLOT_BITS)) + SLOTS - 1;
+  }
+
+  timer.level = level;
+  timer.slot  = bucket & (SLOTS - 1);
+  auto& head  = slots[level][timer.slot];
+  timer.prev  = Timers::UNUSED_ID;
+  timer.next  = head;
+  if (head != Timers::UNUSED_ID) this->timers[head].prev = id;
+  head = id;
+  occupied[level] |= uint64_t(1) << timer.slot;
+  this->scheduled++;
+  if (not timer.deferrable) this->waking++;
 }
 
-void Timers::timers_handler()
+void timer_system::unlink(Timers::id_t id) noexcept
 {
-  auto& system = get();
-  // assume the hardware timer called this function
-  system.is_running = false;
+  auto& timer = this->timers[id];
+  if (timer.prev != Timers::UNUSED_ID)
+    this->timers[timer.prev].next = timer.next;
+  else
+    head_of(timer) = timer.next;
+  if (timer.next != Timers::UNUSED_ID)
+    this->timers[timer.next].prev = timer.prev;
+
+  if (timer.level < LEVELS and slots[timer.level][timer.slot] == Timers::UNUSED_ID)
+    occupied[timer.level] &= ~(uint64_t(1) << timer.slot);
+  timer.level = SystemTimer::UNSCHEDULED;
+  this->scheduled--;
+  if (not timer.deferrable) this->waking--;
+}
 
-  while (LIKELY(!system.scheduled.empty()))
+timer_system::tick_t timer_system::next_tick(bool cascades) const noexcept
+{
+  tick_t next = NO_TICK;
+  // the first level holds the current tick and those after it
+  if (occupied[0]) {
+    next = current + __builtin_ctzll(rotr(occupied[0], current & (SLOTS - 1)));
+  }
+  if (not cascades) return next;
+  // the levels above hold the buckets after the current one
+  for (int level = 1; level < LEVELS; level++)
   {
-    auto it         = system.scheduled.begin();
-    auto when       = it->first;
-    Timers::id_t id = it->second;
+    if (occupied[level] == 0) continue;
+    const int    shift  = level * SLOT_BITS;
+    const tick_t bucket = (current >> shift) + 1;
+    const auto   ahead  = rotr(occupied[level], bucket & (SLOTS - 1));
+    next = std::min(next, (bucket + __builtin_ctzll(ahead)) << shift);
+  }
+  return next;
+}
 
-    auto ts_now = now();
-    if (ts_now >= when) {
-      // erase immediately
-      system.scheduled.erase(it);
+duration_t timer_system::next_wakeup() const noexcept
+{
+  // moving timers down a level
+  int64_t wakeup = std::numeric_limits<int64_t>::max();
+  const tick_t first   = next_tick(false);
+  const tick_t cascade = next_tick(true);
+  if (cascade != first)
+    wakeup = cascade << TICK_SHIFT;
+  // the earliest deadline of the timers in the slots that begin before it
+  auto ahead = rotr(occupied[0], current & (SLOTS - 1));
+  for (; ahead != 0; ahead &= ahead - 1)
+  {
+    const tick_t tick = current + __builtin_ctzll(ahead);
+    if (int64_t(tick << TICK_SHIFT) > wakeup) break;
+    const auto& head = slots[0][tick & (SLOTS - 1)];
+    for (auto id = head; id != Timers::UNUSED_ID; id = this->timers[id].next)
+    {
+      const auto& timer = this->timers[id];
+      if (not timer.deferrable)
+        wakeup = std::min(wakeup, (timer.time + timer.slack).count());
+    }
+  }
+  return duration_t(wakeup);
+}
+
+void timer_system::expire(const duration_t now)
+{
+  // (the clock may be set back in tests)
+  const tick_t target = std::max<tick_t>(now.count() >> TICK_SHIFT, current);
+
+  while (true)
+  {
+    const tick_t next = next_tick(true);
+    if (next == NO_TICK or next > target) {
+      current = target;
+      return;
+    }
+    if (next != current)
+    {
+      current = next;
+      // move timers down from the slots that came up, top level first
+      for (int level = LEVELS - 1; level > 0; level--)
+      {
+        const int shift = level * SLOT_BITS;
+        if (current & ((tick_t(1) << shift) - 1)) continue;
+        auto& head = slots[level][(current >> shift) & (SLOTS - 1)];
+        while (head != Timers::UNUSED_ID)
+        {
+          const auto id = head;
+          unlink(id);
+          link(id);
+        }
+      }
+    }
+
+    // the timers of this slot are run from a list of their own, as
+    // a callback may stop, or start, any timer
+    auto& head = slots[0][current & (SLOTS - 1)];
+    this->running = head;
+    head = Timers::UNUSED_ID;
+    occupied[0] &= ~(uint64_t(1) << (current & (SLOTS - 1)));
+    for (auto id = this->running; id != Timers::UNUSED_ID; id = this->timers[id].next)
+      this->timers[id].level = LEVELS;
+
+    while (this->running != Timers::UNUSED_ID)
+    {
+      const Timers::id_t id = this->running;
+      const auto when = this->timers[id].time;
+      unlink(id);
+      // the rest of the current tick
+      if (when > now) {
+        link(id);
+        continue;
+      }
 
       // call the users callback function
-      system.timers[id].callback(id);
+      TRACEPOINT(timer_fire, id, (now - when).count());
+      if (LIKELY(this->lateness != nullptr))
+        this->lateness->record((now - when).count());
+      if (UNLIKELY(StallWatchdog::enabled()))
+        run_timed(id);
+      else
+        this->timers[id].callback(id);
       // if the timers struct was modified in callback, eg. due to
       // creating a timer, then the timer reference below would have
       // been invalidated, hence why its BELOW, AND MUST STAY THERE
-      auto& timer = system.timers[id];
+      auto& timer = this->timers[id];
 
       // oneshot timers are automatically freed
       if (timer.already_dead || timer.is_oneshot())
       {
-        system.free_timer(id);
+        free_timer(id);
       }
       else
       {
         // if the timer is recurring, we will simply reschedule it
         // NOTE: we are carefully using (when + period) to avoid drift
-        auto new_time = when + timer.period;
-        // update timers self-time
-        timer.time = new_time;
-        // reschedule
-        system.scheduled.
-          emplace(std::piecewise_construct,
-                  std::forward_as_tuple(new_time),
-                  std::forward_as_tuple(id));
+        timer.time = when + timer.period;
+        link(id);
       }
+    }
+    // what is left of the current tick is not due yet
+    if (current == target) return;
+  }
+}
+
+void timer_system::run_timed(const Timers::id_t id)
+{
+  // the callback may create timers, moving this one
+  const void* func = this->timers[id].callback.invoker();
+  const uint64_t start = os::Arch::cpu_cycles();
+  this->timers[id].callback(id);
+  StallWatchdog::record(Stall_sample::TIMER, id, func, os::Arch::cpu_cycles() - start);
+}
+
+duration_t Timers::next()
+{
+  auto& system = get();
+  if (LIKELY(system.waking > 0))
+  {
+    auto diff = system.next_wakeup() - now();
+    // avoid returning zero or negative diff
+    if (diff < nanoseconds(1)) return nanoseconds(1);
+    return diff;
+  }
+  return duration_t::zero();
+}
+
+void Timers::timers_handler()
+{
+  auto& system = get();
+  // assume the hardware timer called this function
+  system.is_running = false;
+
+  while (LIKELY(system.scheduled > 0))
+  {
+    auto ts_now = now();
+    system.expire(ts_now);
+    // deferrable timers wait for another to wake the CPU
+    if (system.waking == 0) break;
 
-    } else {
+    const auto when = system.next_wakeup();
+    ts_now = now();
+    if (when > ts_now) {
       // not yet time, so schedule it for later
       system.is_running = true;
+      system.wakeup = when;
       system.arch_start_func(when - ts_now);
       // exit early, because we have nothing more to do,
       // and there is a deferred handler
@@ -279,10 +517,10 @@ void Timers::timers_handler()
 }
 void timer_system::sched_timer(duration_t when, Timers::id_t id)
 {
-  this->scheduled.
-    emplace(std::piecewise_construct,
-            std::forward_as_tuple(when),
-            std::forward_as_tuple(id));
+  // an empty wheel starts over from the current time
+  if (this->scheduled == 0)
+    this->current = now().count() >> TICK_SHIFT;
+  link(id);
 
   // dont start any hardware until after calibration
   if (UNLIKELY(!signal_ready)) return;
@@ -293,8 +531,8 @@ void timer_system::sched_timer(duration_t when, Timers::id_t id)
     return;
   }
   // if the scheduled timer is the new front, restart timer
-  auto it = this->scheduled.begin();
-  if (it->second == id) {
+  const auto& timer = this->timers[id];
+  if (not timer.deferrable and when + timer.slack < this->wakeup) {
     Events::get().trigger_event(this->interrupt);
   }
 }
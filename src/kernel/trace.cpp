@@ -0,0 +1,131 @@
+#include <kernel/trace.hpp>
+#include <os.hpp>
+#include <smp>
+#include <array>
+#include <cstring>
+
+namespace trace
+{
+  namespace detail {
+    bool active = false;
+  }
+
+  // written only by its own CPU, from any context, as slots are claimed
+  // by incrementing the head
+  struct alignas(SMP_ALIGN) Ring {
+    Record*  records = nullptr;
+    uint32_t mask    = 0;
+    uint64_t head    = 0;
+  };
+  static std::array<Ring, SMP_MAX_CORES> rings;
+  static uint32_t ring_entries = 0;
+
+  struct Dump_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t cpus;
+    uint64_t tsc_khz;
+    uint32_t entries;
+    uint32_t reserved;
+  };
+  struct Dump_cpu {
+    uint32_t cpu;
+    uint32_t count;
+  };
+
+  void start(const uint32_t entries)
+  {
+    Expects(entries > 0 and (entries & (entries - 1)) == 0);
+    stop();
+    const size_t cpus = SMP::early_cpu_total();
+    for (size_t cpu = 0; cpu < cpus; cpu++)
+    {
+      auto& ring = rings.at(cpu);
+      if (ring_entries != entries) {
+        delete[] ring.records;
+        ring.records = new Record[entries];
+        ring.mask = entries - 1;
+      }
+      ring.head = 0;
+    }
+    ring_entries = entries;
+    __atomic_store_n(&detail::active, true, __ATOMIC_RELEASE);
+  }
+
+  void stop() noexcept
+  {
+    __atomic_store_n(&detail::active, false, __ATOMIC_RELEASE);
+  }
+
+  void emit(Event evt, uint32_t arg0, uint64_t arg1, uint64_t arg2) noexcept
+  {
+    auto& ring = PER_CPU(rings);
+    if (UNLIKELY(ring.records == nullptr)) return;
+    const uint64_t pos = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+    auto& rec = ring.records[pos & ring.mask];
+    rec.tsc   = os::Arch::cpu_cycles();
+    rec.event = (uint16_t) evt;
+    rec.reserved = 0;
+    rec.arg0  = arg0;
+    rec.arg1  = arg1;
+    rec.arg2  = arg2;
+  }
+
+  void dump(writer_t write)
+  {
+    const uint32_t cpus = SMP::early_cpu_total();
+    Dump_header hdr;
+    std::memcpy(hdr.magic, "IOSTRACE", sizeof(hdr.magic));
+    hdr.version  = 1;
+    hdr.cpus     = cpus;
+    hdr.tsc_khz  = os::cpu_freq().count();
+    hdr.entries  = ring_entries;
+    hdr.reserved = 0;
+    write(&hdr, sizeof(hdr));
+
+    for (uint32_t cpu = 0; cpu < cpus; cpu++)
+    {
+      const auto& ring = rings.at(cpu);
+      const uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+      const uint32_t count = ring.records ? std::min<uint64_t>(head, ring_entries) : 0;
+      const Dump_cpu part {cpu, count};
+      write(&part, sizeof(part));
+      // oldest first, which may wrap around
+      const uint64_t first = head - count;
+      for (uint64_t i = first; i < head;)
+      {
+        const uint32_t idx = i & ring.mask;
+        const uint32_t run = std::min<uint64_t>(head - i, ring_entries - idx);
+        write(&ring.records[idx], run * sizeof(Record));
+        i += run;
+      }
+    }
+  }
+
+  void dump_serial()
+  {
+    static const char hex[] = "0123456789abcdef";
+    char line[65];
+    int  len = 0;
+    os::print("--- trace begin ---\n", 20);
+    dump([&line, &len] (const void* data, size_t size) {
+      const auto* bytes = (const uint8_t*) data;
+      for (size_t i = 0; i < size; i++)
+      {
+        line[len++] = hex[bytes[i] >> 4];
+        line[len++] = hex[bytes[i] & 0xf];
+        if (len == 64) {
+          line[len++] = '\n';
+          os::print(line, len);
+          len = 0;
+        }
+      }
+    });
+    if (len > 0) {
+      line[len++] = '\n';
+      os::print(line, len);
+    }
+    os::print("--- trace end ---\n", 18);
+  }
+
+} // < namespace trace
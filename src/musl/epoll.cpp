@@ -0,0 +1,71 @@
+#include "common.hpp"
+#include <sys/epoll.h>
+#include <signal.h>
+
+#include <posix/fd_map.hpp>
+#include <posix/epoll_fd.hpp>
+
+static Epoll_FD* get_epoll(int epfd)
+{
+  return dynamic_cast<Epoll_FD*>(FD_map::_get(epfd));
+}
+
+static long sys_epoll_create1(int flags)
+{
+  if (flags & ~EPOLL_CLOEXEC) return -EINVAL;
+  return FD_map::_open<Epoll_FD>().get_id();
+}
+
+static long sys_epoll_create(int size)
+{
+  // the size is only a hint
+  if (size <= 0) return -EINVAL;
+  return sys_epoll_create1(0);
+}
+
+static long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event)
+{
+  if (FD_map::_get(epfd) == nullptr) return -EBADF;
+  if (auto* ep = get_epoll(epfd); ep)
+    return ep->ctl(op, fd, event);
+  return -EINVAL;
+}
+
+static long sys_epoll_pwait(int epfd, struct epoll_event* events, int maxevents,
+                            int timeout, const sigset_t* /*sigmask*/)
+{
+  if (FD_map::_get(epfd) == nullptr) return -EBADF;
+  if (auto* ep = get_epoll(epfd); ep)
+    return ep->wait(events, maxevents, timeout);
+  return -EINVAL;
+}
+
+static long sys_epoll_wait(int epfd, struct epoll_event* events, int maxevents,
+                           int timeout)
+{
+  return sys_epoll_pwait(epfd, events, maxevents, timeout, nullptr);
+}
+
+extern "C" {
+long syscall_SYS_epoll_create(int size) {
+  return strace(sys_epoll_create, "epoll_create", size);
+}
+
+long syscall_SYS_epoll_create1(int flags) {
+  return strace(sys_epoll_create1, "epoll_create1", flags);
+}
+
+long syscall_SYS_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+  return strace(sys_epoll_ctl, "epoll_ctl", epfd, op, fd, event);
+}
+
+long syscall_SYS_epoll_wait(int epfd, struct epoll_event* events,
+                            int maxevents, int timeout) {
+  return strace(sys_epoll_wait, "epoll_wait", epfd, events, maxevents, timeout);
+}
+
+long syscall_SYS_epoll_pwait(int epfd, struct epoll_event* events, int maxevents,
+                             int timeout, const sigset_t* sigmask) {
+  return strace(sys_epoll_pwait, "epoll_pwait", epfd, events, maxevents, timeout, sigmask);
+}
+} // extern "C"
@@ -1,6 +1,14 @@
 #include "stub.hpp"
 #include <errno.h>
+#include <climits>
+#include <array>
+#include <atomic>
+#include <vector>
 #include <kernel/threads.hpp>
+#include <kernel/events.hpp>
+#include <arch.hpp>
+#include <smp>
+#include <timers>
 
 #define FUTEX_WAIT 0
 #define FUTEX_WAKE 1
@@ -12,29 +20,268 @@
 #define FUTEX_UNLOCK_PI 7
 #define FUTEX_TRYLOCK_PI 8
 #define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
 #define FUTEX_PRIVATE 128
 #define FUTEX_CLOCK_REALTIME 256
 
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+// A thread waiting on a futex, on its own stack
+struct Futex_waiter {
+  Futex_waiter* prev = nullptr;
+  Futex_waiter* next = nullptr;
+  const int* addr;
+  uint32_t   bitset;
+  kernel::Thread* thread;
+  long tid;
+  int  cpu;
+  bool queued    = false;
+  bool timed_out = false;
+  std::atomic<bool> woken {false};
+};
+
+// Waiters by address, oldest first
+struct Futex_bucket {
+  smp_spinlock  lock;
+  Futex_waiter* head = nullptr;
+  Futex_waiter* tail = nullptr;
+
+  void push_back(Futex_waiter* w) noexcept
+  {
+    w->prev = tail;
+    w->next = nullptr;
+    if (tail) tail->next = w;
+    else      head = w;
+    tail = w;
+    w->queued = true;
+  }
+  void erase(Futex_waiter* w) noexcept
+  {
+    if (w->prev) w->prev->next = w->next;
+    else         head = w->next;
+    if (w->next) w->next->prev = w->prev;
+    else         tail = w->prev;
+    w->prev = w->next = nullptr;
+    w->queued = false;
+  }
+};
+static std::array<Futex_bucket, 256> futex_buckets;
+
+static Futex_bucket& bucket_of(const int* addr) noexcept
+{
+  const uint64_t hash = ((uintptr_t) addr >> 2) * 0x9E3779B97F4A7C15ull;
+  return futex_buckets[hash >> 56];
+}
+
+// Take a waiter off its queue and make it runnable, with its bucket locked.
+// Waiters on other CPUs are collected in remote and woken by the caller.
+static void wake_locked(Futex_bucket& b, Futex_waiter* w,
+                        std::vector<std::pair<long, int>>& remote)
+{
+  b.erase(w);
+  auto* thread = w->thread;
+  const long tid = w->tid;
+  const int  cpu = w->cpu;
+  // the waiter may be gone as soon as this is set
+  w->woken.store(true, std::memory_order_release);
+  if (cpu == SMP::cpu_id())
+    kernel::unpark(thread);
+  else
+    remote.emplace_back(tid, cpu);
+}
+
+static void wake_remote(const std::vector<std::pair<long, int>>& remote)
+{
+  for (const auto& [tid, cpu] : remote)
+  {
+    const long t = tid;
+    while (not Events::get(cpu).post([t] () {
+        if (auto* thread = kernel::get_thread(t); thread != nullptr)
+            kernel::unpark(thread);
+      }))
+      asm volatile("pause");
+  }
+}
+
+static int futex_wait(int* uaddr, int val, uint64_t deadline, uint32_t bitset)
+{
+  if (UNLIKELY(bitset == 0))
+    return -EINVAL;
+
+  auto& b = bucket_of(uaddr);
+  Futex_waiter w;
+  w.addr   = uaddr;
+  w.bitset = bitset;
+  w.thread = kernel::get_thread();
+  w.tid    = w.thread->tid;
+  w.cpu    = SMP::cpu_id();
+
+  b.lock.lock();
+  if (__atomic_load_n(uaddr, __ATOMIC_SEQ_CST) != val) {
+    b.lock.unlock();
+    return -EAGAIN;
+  }
+  b.push_back(&w);
+  b.lock.unlock();
+
+  auto time_out = [&w] () -> bool {
+    auto& b = bucket_of(w.addr);
+    b.lock.lock();
+    const bool expired = w.queued;
+    if (expired) {
+      b.erase(&w);
+      w.timed_out = true;
+      w.woken.store(true, std::memory_order_release);
+    }
+    b.lock.unlock();
+    return expired;
+  };
+
+  bool timer_fired = false;
+  Timers::id_t timer = Timers::UNUSED_ID;
+  if (deadline != 0 and Timers::is_ready())
+  {
+    const auto now = __arch_system_time();
+    timer = Timers::oneshot(std::chrono::nanoseconds(deadline > now ? deadline - now : 0),
+      [&w, &timer_fired, time_out] (Timers::id_t) {
+        timer_fired = true;
+        if (time_out()) kernel::unpark(w.thread);
+      });
+  }
+
+  while (not w.woken.load(std::memory_order_acquire))
+  {
+    // when there's nothing else to run, park() returns at once
+    if (deadline != 0 and __arch_system_time() >= deadline and time_out())
+        break;
+    kernel::park();
+  }
+
+  if (timer != Timers::UNUSED_ID and not timer_fired)
+      Timers::stop(timer);
+  return w.timed_out ? -ETIMEDOUT : 0;
+}
+
+static int futex_wake(int* uaddr, int count, uint32_t bitset)
+{
+  if (UNLIKELY(bitset == 0))
+    return -EINVAL;
+
+  std::vector<std::pair<long, int>> remote;
+  auto& b = bucket_of(uaddr);
+  int woken = 0;
+  b.lock.lock();
+  for (auto* w = b.head; w != nullptr and woken < count;)
+  {
+    auto* next = w->next;
+    if (w->addr == uaddr and (w->bitset & bitset)) {
+      wake_locked(b, w, remote);
+      woken++;
+    }
+    w = next;
+  }
+  b.lock.unlock();
+  wake_remote(remote);
+  return woken;
+}
+
+static int futex_requeue(int* uaddr, int nr_wake, int nr_requeue, int* uaddr2,
+                         bool compare, int val3)
+{
+  if (UNLIKELY(nr_wake < 0 or nr_requeue < 0))
+    return -EINVAL;
+
+  std::vector<std::pair<long, int>> remote;
+  auto& b1 = bucket_of(uaddr);
+  auto& b2 = bucket_of(uaddr2);
+  // lock in address order, so two requeues can't deadlock
+  auto* first  = &b1 < &b2 ? &b1 : &b2;
+  auto* second = &b1 < &b2 ? &b2 : &b1;
+  first->lock.lock();
+  if (second != first) second->lock.lock();
+
+  int woken = 0, requeued = 0;
+  int result = 0;
+  if (compare and __atomic_load_n(uaddr, __ATOMIC_SEQ_CST) != val3) {
+    result = -EAGAIN;
+  }
+  else {
+    for (auto* w = b1.head; w != nullptr;)
+    {
+      auto* next = w->next;
+      if (w->addr == uaddr)
+      {
+        if (woken < nr_wake) {
+          wake_locked(b1, w, remote);
+          woken++;
+        }
+        else if (requeued < nr_requeue) {
+          b1.erase(w);
+          w->addr = uaddr2;
+          b2.push_back(w);
+          requeued++;
+        }
+        else break;
+      }
+      w = next;
+    }
+    result = compare ? woken + requeued : woken;
+  }
+
+  if (second != first) second->lock.unlock();
+  first->lock.unlock();
+  wake_remote(remote);
+  return result;
+}
+
+// absolute time on the monotonic clock, 0 for no timeout
+static uint64_t futex_deadline(const struct timespec* timeout, bool absolute, bool realtime)
+{
+  if (timeout == nullptr) return 0;
+  const uint64_t ns = timeout->tv_sec * 1000000000ull + timeout->tv_nsec;
+  const uint64_t now = __arch_system_time();
+  if (not absolute) return now + ns;
+  if (realtime) {
+    const auto wall = __arch_wall_clock();
+    const uint64_t wall_ns = wall.tv_sec * 1000000000ull + wall.tv_nsec;
+    return ns > wall_ns ? now + (ns - wall_ns) : now;
+  }
+  return ns > 0 ? ns : 1;
+}
+
+namespace kernel {
+  int futex_wake(int* addr, int count) {
+    return ::futex_wake(addr, count, FUTEX_BITSET_MATCH_ANY);
+  }
+}
+
 static int sys_futex(int *uaddr, int futex_op, int val,
-                      const struct timespec* /* timeout */, int /*val3*/)
+                     const struct timespec* timeout, int* uaddr2, int val3)
 {
-  switch (futex_op & 0xF) {
-	  case FUTEX_WAIT: if (*uaddr != val) return -EAGAIN;
-			    // we have to yield here because of cooperative threads
-			    // TODO: potential for sleeping here
-			    while (*uaddr == val) __thread_yield();
-			    break;
-	  case FUTEX_WAKE: // We can't wake up anything specific yet, so just yield
-			    __thread_yield();
-	  default:
-			    break;
+  const bool realtime = futex_op & FUTEX_CLOCK_REALTIME;
+  switch (futex_op & 0x7F) {
+    case FUTEX_WAIT:
+      return futex_wait(uaddr, val, futex_deadline(timeout, false, false),
+                        FUTEX_BITSET_MATCH_ANY);
+    case FUTEX_WAIT_BITSET:
+      return futex_wait(uaddr, val, futex_deadline(timeout, true, realtime), val3);
+    case FUTEX_WAKE:
+      return futex_wake(uaddr, val, FUTEX_BITSET_MATCH_ANY);
+    case FUTEX_WAKE_BITSET:
+      return futex_wake(uaddr, val, val3);
+    case FUTEX_REQUEUE:
+      // the timeout argument is the number of waiters to requeue
+      return futex_requeue(uaddr, val, (int) (uintptr_t) timeout, uaddr2, false, 0);
+    case FUTEX_CMP_REQUEUE:
+      return futex_requeue(uaddr, val, (int) (uintptr_t) timeout, uaddr2, true, val3);
+    default:
+      return -ENOSYS;
   }
-  return 0;
 }
 
 extern "C"
 int syscall_SYS_futex(int *uaddr, int futex_op, int val,
-                      const struct timespec *timeout, int val3)
+                      const struct timespec *timeout, int* uaddr2, int val3)
 {
-  return stubtrace(sys_futex, "futex", uaddr, futex_op, val, timeout, val3);
+  return stubtrace(sys_futex, "futex", uaddr, futex_op, val, timeout, uaddr2, val3);
 }
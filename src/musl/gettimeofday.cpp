@@ -5,7 +5,7 @@ static long sys_gettimeofday(struct timeval *tv, struct timezone *tz)
 {
   timespec t  = __arch_wall_clock();
   tv->tv_sec  = t.tv_sec;
-  tv->tv_usec = t.tv_nsec * 1000;
+  tv->tv_usec = t.tv_nsec / 1000;
   if (tz != nullptr) {
     tz->tz_minuteswest = 0;
     tz->tz_dsttime     = 0; /* DST_NONE */
@@ -5,8 +5,14 @@
 #include <util/alloc_buddy.hpp>
 #include <os>
 #include <kernel/memory.hpp>
+#include <kernel/mem_pressure.hpp>
 #include <kernel.hpp>
 #include <kernel/mrspinny.hpp>
+#include <kernel/trace.hpp>
+#include <smp>
+#include <posix/fd_map.hpp>
+#include <statman>
+#include <array>
 
 using Alloc = os::mem::Raw_allocator;
 static Alloc* alloc;
@@ -16,28 +22,255 @@ Alloc& os::mem::raw_allocator() {
   return *alloc;
 }
 
+// fragmentation of the free chunks, updated with the lock held
+static struct {
+  uint32_t* free_chunks   = nullptr;
+  uint64_t* largest_free  = nullptr;
+  float*    fragmentation = nullptr;
+} mmap_stats;
+
+static void mmap_update_stats()
+{
+  if (mmap_stats.free_chunks == nullptr) return;
+  *mmap_stats.free_chunks  = alloc->free_blocks();
+  *mmap_stats.largest_free = alloc->largest_free();
+  // how much of the free memory is not in the largest chunk
+  const auto free = alloc->bytes_free();
+  *mmap_stats.fragmentation = free ? 1.0f - float(*mmap_stats.largest_free) / free : 0.0f;
+}
+
+void mmap_init_stats()
+{
+  auto& statman = Statman::get();
+  auto* free_chunks   = &statman.create(Stat::UINT32, "mem.mmap.free_chunks").get_uint32();
+  auto* largest_free  = &statman.create(Stat::UINT64, "mem.mmap.largest_free").get_uint64();
+  auto* fragmentation = &statman.create(Stat::FLOAT, "mem.mmap.fragmentation").get_float();
+  mr_spinny.memory.lock();
+  mmap_stats.free_chunks   = free_chunks;
+  mmap_stats.largest_free  = largest_free;
+  mmap_stats.fragmentation = fragmentation;
+  mmap_update_stats();
+  mr_spinny.memory.unlock();
+}
+
+// Per-CPU caches of the smaller chunks (4 to 64 KB), in front of the
+// buddy allocator, so that most allocations and frees take no lock.
+// A chunk freed on another CPU than the one it was handed out on goes
+// back to that CPU through a lock-free list.
+static const int SLAB_CLASSES = 5;
+static const int SLAB_DEPTH   = 16;
+static const int SLAB_BATCH   = SLAB_DEPTH / 2;
+
+struct alignas(SMP_ALIGN) slab_cpu
+{
+  struct Class {
+    std::array<void*, SLAB_DEPTH> chunks;
+    int   count = 0;
+    // freed on other CPUs, linked through the chunks themselves
+    void* remote = nullptr;
+  };
+  std::array<Class, SLAB_CLASSES> classes;
+};
+static std::vector<slab_cpu> slabs;
+SMP_RESIZE_EARLY_GCTOR(slabs);
+// the CPU that handed out each chunk, by its first page
+static uint8_t*  slab_owner = nullptr;
+static uintptr_t slab_begin = 0;
+
+static inline int slab_class(size_t size) noexcept
+{
+  if (size == 0 or size > (Alloc::min_size << (SLAB_CLASSES-1))) return -1;
+  const size_t sz = std::max<size_t>(util::bits::next_pow2(size), Alloc::min_size);
+  return __builtin_ctzl(sz / Alloc::min_size);
+}
+static inline size_t slab_size(int cls) noexcept
+{
+  return Alloc::min_size << cls;
+}
+static inline uint8_t& slab_owner_of(void* ptr) noexcept
+{
+  return slab_owner[((uintptr_t) ptr - slab_begin) / Alloc::min_size];
+}
+
+// from the memory local to a NUMA node, or anywhere when it has none left
+static void* node_allocate(size_t size, int node)
+{
+  for (const auto& range : os::mem::numa_ranges())
+  {
+    if (range.node != node) continue;
+    if (auto* chunk = alloc->allocate_in(size, range.begin, range.end))
+        return chunk;
+  }
+  return alloc->allocate(size);
+}
+static void* local_allocate(size_t size)
+{
+  if (os::mem::numa_nodes() > 1)
+      return node_allocate(size, os::mem::numa_node_of_cpu(SMP::cpu_id()));
+  return alloc->allocate(size);
+}
+
+static void slab_refill(slab_cpu::Class& c, int cls, int cpu)
+{
+  // first take back what the other CPUs freed
+  auto* list = (void**) __atomic_exchange_n(&c.remote, nullptr, __ATOMIC_ACQUIRE);
+  while (list != nullptr and c.count < SLAB_DEPTH) {
+    c.chunks[c.count++] = list;
+    list = (void**) *list;
+  }
+  if (c.count > 0 and list == nullptr) return;
+
+  mr_spinny.memory.lock();
+  for (; list != nullptr; list = (void**) *list) {
+    alloc->deallocate(list, slab_size(cls));
+  }
+  const int node = os::mem::numa_node_of_cpu(cpu);
+  while (c.count < SLAB_BATCH)
+  {
+    auto* chunk = node_allocate(slab_size(cls), node);
+    if (chunk == nullptr) break;
+    slab_owner_of(chunk) = cpu;
+    c.chunks[c.count++] = chunk;
+  }
+  mmap_update_stats();
+  mr_spinny.memory.unlock();
+}
+
+static void slab_drain(slab_cpu::Class& c, int cls)
+{
+  mr_spinny.memory.lock();
+  while (c.count > SLAB_BATCH) {
+    alloc->deallocate(c.chunks[--c.count], slab_size(cls));
+  }
+  mmap_update_stats();
+  mr_spinny.memory.unlock();
+}
+
 uintptr_t __init_mmap(uintptr_t addr_begin, size_t size)
 {
+  using namespace util::literals;
   auto aligned_begin = (addr_begin + Alloc::align - 1) & ~(Alloc::align - 1);
   int64_t len = size & ~int64_t(Alloc::align - 1);
 
+  // start the pool on a huge page, so that chunks of 2 MiB and up are
+  // whole huge pages and no smaller chunk straddles two of them
+  for (int i = 0; i < 3; i++) {
+    const auto pool  = Alloc::pool_begin((void*)aligned_begin, len);
+    const auto shift = util::bits::roundto(2_MiB, pool) - pool;
+    if (shift == 0 or (int64_t) shift >= len / 4) break;
+    aligned_begin += shift;
+    len -= shift;
+  }
+
   alloc = Alloc::create((void*)aligned_begin, len);
+
+  const size_t pages = len / Alloc::min_size;
+  slab_owner = (uint8_t*) alloc->allocate(pages);
+  if (slab_owner != nullptr) {
+    memset(slab_owner, 0, pages);
+    slab_begin = aligned_begin;
+  }
   return aligned_begin + len;
 }
 
 extern "C" __attribute__((weak))
 void* kalloc(size_t size) {
   Expects(kernel::heap_ready());
+  const int cls = slab_class(size);
+  // the per-CPU caches are there once SMP is set up
+  if (cls >= 0 and not slabs.empty() and slab_owner != nullptr)
+  {
+    const int cpu = SMP::cpu_id();
+    auto& c = slabs[cpu].classes[cls];
+    if (c.count == 0) {
+      slab_refill(c, cls, cpu);
+      os::mem::pressure_notify();
+    }
+    if (UNLIKELY(c.count == 0)) return nullptr;
+    auto* chunk = c.chunks[--c.count];
+    TRACEPOINT(heap_alloc, size, (uintptr_t) chunk);
+    return chunk;
+  }
   mr_spinny.memory.lock();
-  auto* data = alloc->allocate(size);
+  auto* data = local_allocate(size);
+  mmap_update_stats();
   mr_spinny.memory.unlock();
+  // the caches give some back, later, when the heap runs low
+  os::mem::pressure_notify();
+  TRACEPOINT(heap_alloc, size, (uintptr_t) data);
   return data;
 }
 
 extern "C" __attribute__((weak))
 void kfree (void* ptr, size_t size) {
+  TRACEPOINT(heap_free, size, (uintptr_t) ptr);
+  const int cls = slab_class(size);
+  if (cls >= 0 and not slabs.empty() and slab_owner != nullptr)
+  {
+    const int cpu = SMP::cpu_id();
+    const int owner = slab_owner_of(ptr);
+    if (owner == cpu)
+    {
+      auto& c = slabs[cpu].classes[cls];
+      if (c.count == SLAB_DEPTH) slab_drain(c, cls);
+      c.chunks[c.count++] = ptr;
+    }
+    else
+    {
+      auto& c = slabs[owner].classes[cls];
+      void* head = __atomic_load_n(&c.remote, __ATOMIC_RELAXED);
+      do {
+        *(void**) ptr = head;
+      } while (not __atomic_compare_exchange_n(&c.remote, &head, ptr, true,
+                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    return;
+  }
   mr_spinny.memory.lock();
   alloc->deallocate(ptr, size);
+  mmap_update_stats();
+  mr_spinny.memory.unlock();
+}
+
+void* os::mem::numa_alloc(size_t size, int node)
+{
+  Expects(kernel::heap_ready());
+  mr_spinny.memory.lock();
+  auto* data = node_allocate(size, node);
+  mmap_update_stats();
+  mr_spinny.memory.unlock();
+  return data;
+}
+
+void os::mem::numa_free(void* ptr, size_t size)
+{
+  // not through the slab caches, as it didn't come from them
+  mr_spinny.memory.lock();
+  alloc->deallocate(ptr, size);
+  mmap_update_stats();
+  mr_spinny.memory.unlock();
+}
+
+void* os::mem::take_free_block(size_t size, size_t reserve) noexcept
+{
+  Expects(util::bits::is_pow2(size) and size >= Alloc::min_size);
+  void* block = nullptr;
+  mr_spinny.memory.lock();
+  // never by splitting the last of the free memory
+  if (kernel::heap_avail() >= reserve + size and alloc->largest_free() >= size)
+  {
+    block = alloc->allocate(size);
+    mmap_update_stats();
+  }
+  mr_spinny.memory.unlock();
+  return block;
+}
+
+void os::mem::return_block(void* block, size_t size) noexcept
+{
+  mr_spinny.memory.lock();
+  alloc->deallocate(block, size);
+  mmap_update_stats();
   mr_spinny.memory.unlock();
 }
 
@@ -53,12 +286,20 @@ uintptr_t mmap_allocation_end() {
   return alloc->highest_used();
 }
 
-static void* sys_mmap(void *addr, size_t length, int /*prot*/, int flags,
+static void* sys_mmap(void *addr, size_t length, int prot, int flags,
                       int fd, off_t offset)
 {
-  // TODO: Mapping to file descriptor
-  if (fd > 0) {
-    assert(false && "Mapping to file descriptor not yet implemented");
+  // files are mapped read-only
+  if (fd > 0 and not (flags & MAP_ANONYMOUS))
+  {
+    if (UNLIKELY(prot & PROT_WRITE))
+      return (void*) -EACCES;
+    if (UNLIKELY(flags & MAP_FIXED))
+      return (void*) -EINVAL;
+
+    if (auto* fildes = FD_map::_get(fd); fildes)
+      return fildes->mmap(length, offset);
+    return (void*) -EBADF;
   }
 
   // TODO: mapping virtual address
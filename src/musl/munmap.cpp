@@ -1,4 +1,5 @@
 #include "common.hpp"
+#include <posix/file_fd.hpp>
 
 extern "C" void kfree(void* addr, size_t length);
 
@@ -7,6 +8,10 @@ static long sys_munmap(void *addr, size_t length)
   if(UNLIKELY(length == 0))
     return -EINVAL;
 
+  // file mappings are not heap memory
+  if (File_FD::munmap(addr))
+    return 0;
+
   kfree(addr, length);
   return 0;
 }
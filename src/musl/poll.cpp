@@ -1,32 +1,36 @@
-#include "stub.hpp"
+#include "common.hpp"
 #include <poll.h>
 #include <signal.h>
+#include <posix/poll.hpp>
 
+using namespace std::chrono;
 
-static long sys_poll(struct pollfd *fds, nfds_t nfds, int /*timeout*/)
+static long sys_poll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
-  for (nfds_t i = 0; i < nfds; i++)
-  {
-    fds[i].revents = fds[i].events;
-  }
-  return nfds;
+  if (nfds > 0 and fds == nullptr) return -EFAULT;
+  // a negative timeout waits forever
+  return fd_poll(fds, nfds, milliseconds(timeout));
 }
-static long sys_ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec * /*timeout_ts*/, const sigset_t * /*sigmask*/)
+static long sys_ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout_ts, const sigset_t * /*sigmask*/)
 {
-  for (nfds_t i = 0; i < nfds; i++)
+  if (nfds > 0 and fds == nullptr) return -EFAULT;
+  auto timeout = nanoseconds(-1);
+  if (timeout_ts != nullptr)
   {
-    fds[i].revents = fds[i].events;
+    if (timeout_ts->tv_sec < 0 or timeout_ts->tv_nsec < 0
+        or timeout_ts->tv_nsec >= 1'000'000'000) return -EINVAL;
+    timeout = seconds(timeout_ts->tv_sec) + nanoseconds(timeout_ts->tv_nsec);
   }
-  return nfds;
+  return fd_poll(fds, nfds, timeout);
 }
 extern "C"
 long syscall_SYS_poll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
-  return stubtrace(sys_poll, "poll", fds, nfds, timeout);
+  return strace(sys_poll, "poll", fds, nfds, timeout);
 }
 
 extern "C"
 int syscall_SYS_ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *timeout_ts, const sigset_t *sigmask)
 {
-	return stubtrace(sys_ppoll, "ppoll", fds, nfds, timeout_ts,sigmask);
+	return strace(sys_ppoll, "ppoll", fds, nfds, timeout_ts,sigmask);
 }
@@ -1,13 +1,57 @@
 #include "common.hpp"
 #include <sys/select.h>
+#include <posix/poll.hpp>
+#include <vector>
 
-long sys_select(int /*nfds*/,
-                fd_set* /*readfds*/,
-                fd_set* /*writefds*/,
-                fd_set* /*exceptfds*/,
-                struct timeval* /*timeout*/)
+using namespace std::chrono;
+
+long sys_select(int nfds,
+                fd_set* readfds,
+                fd_set* writefds,
+                fd_set* exceptfds,
+                struct timeval* timeout)
 {
-  return -ENOSYS;
+  if (nfds < 0 or nfds > FD_SETSIZE) return -EINVAL;
+  auto wait = nanoseconds(-1);
+  if (timeout != nullptr)
+  {
+    if (timeout->tv_sec < 0 or timeout->tv_usec < 0) return -EINVAL;
+    wait = seconds(timeout->tv_sec) + microseconds(timeout->tv_usec);
+  }
+
+  // the same wait as poll, on the FDs that are in any of the sets
+  std::vector<struct pollfd> fds;
+  for (int fd = 0; fd < nfds; fd++)
+  {
+    short events = 0;
+    if (readfds and FD_ISSET(fd, readfds))     events |= POLLIN;
+    if (writefds and FD_ISSET(fd, writefds))   events |= POLLOUT;
+    if (exceptfds and FD_ISSET(fd, exceptfds)) events |= POLLPRI;
+    if (events) fds.push_back({fd, events, 0});
+  }
+
+  const int ready = fd_poll(fds.data(), fds.size(), wait);
+  if (readfds)   FD_ZERO(readfds);
+  if (writefds)  FD_ZERO(writefds);
+  if (exceptfds) FD_ZERO(exceptfds);
+  if (ready == 0) return 0;
+
+  int count = 0;
+  for (auto& pfd : fds)
+  {
+    if (pfd.revents & POLLNVAL) return -EBADF;
+    // errors and hangups are reported as readable and writable, like Linux
+    if ((pfd.events & POLLIN) and (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+      FD_SET(pfd.fd, readfds); count++;
+    }
+    if ((pfd.events & POLLOUT) and (pfd.revents & (POLLOUT | POLLERR))) {
+      FD_SET(pfd.fd, writefds); count++;
+    }
+    if ((pfd.events & POLLPRI) and (pfd.revents & POLLPRI)) {
+      FD_SET(pfd.fd, exceptfds); count++;
+    }
+  }
+  return count;
 }
 
 extern "C"
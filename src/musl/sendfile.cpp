@@ -0,0 +1,52 @@
+#include "common.hpp"
+#include <sys/sendfile.h>
+
+#include <posix/fd_map.hpp>
+#include <posix/file_fd.hpp>
+#include <posix/tcp_fd.hpp>
+
+static long sys_sendfile(int out_fd, int in_fd, off_t* offset, size_t count)
+{
+  auto* out = FD_map::_get(out_fd);
+  auto* in  = FD_map::_get(in_fd);
+  if (out == nullptr or in == nullptr) return -EBADF;
+  // like Linux, only from files
+  auto* file = dynamic_cast<File_FD*>(in);
+  if (file == nullptr) return -EINVAL;
+  if (offset and *offset < 0) return -EINVAL;
+
+  if (auto* tcp = dynamic_cast<TCP_FD*>(out); tcp)
+    return tcp->sendfile(*file, offset, count);
+
+  // anywhere else, one write per piece of the file
+  uint64_t pos = (offset) ? *offset : file->offset();
+  long total = 0;
+  while (count > 0)
+  {
+    const uint8_t* data;
+    std::shared_ptr<const void> owner;
+    const ssize_t n = file->peek(pos, std::min(count, TCP_FD::SENDFILE_CHUNK), data, owner);
+    if (n <= 0) {
+      if (total == 0) return n;
+      break;
+    }
+    const int res = out->write(data, n);
+    if (res <= 0) {
+      if (total == 0) return res;
+      break;
+    }
+    pos   += res;
+    total += res;
+    count -= res;
+    if (res < n) break;
+  }
+  if (offset) *offset = pos;
+  else file->lseek(total, SEEK_CUR);
+  return total;
+}
+
+extern "C"
+long syscall_SYS_sendfile(int out_fd, int in_fd, off_t* offset, size_t count)
+{
+  return strace(sys_sendfile, "sendfile", out_fd, in_fd, offset, count);
+}
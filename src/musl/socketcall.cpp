@@ -9,29 +9,29 @@
 
 static long sock_socket(int domain, int type, int protocol)
 {
+  // the flags that can be or'ed into the type
+  const bool non_blocking = type & SOCK_NONBLOCK;
+  type &= ~(SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  FD* fd = nullptr;
   if(domain == AF_UNIX)
-    return FD_map::_open<Unix_FD>(type).get_id();
+    fd = &FD_map::_open<Unix_FD>(type);
   // currently only support for AF_INET (IPv4, no local/unix or IP6)
-  if (UNLIKELY(domain != AF_INET))
+  else if (UNLIKELY(domain != AF_INET))
     return -EAFNOSUPPORT;
   // disallow RAW etc
-  if (UNLIKELY(type < 0 || type > SOCK_DGRAM))
+  else if (UNLIKELY(type != SOCK_STREAM and type != SOCK_DGRAM))
     return -EINVAL;
   // we are purposefully ignoring the protocol argument
-  if (UNLIKELY(protocol < 0))
+  else if (UNLIKELY(protocol < 0))
     return -EPROTONOSUPPORT;
+  else if (type == SOCK_STREAM)
+    fd = &FD_map::_open<TCP_FD>();
+  else
+    fd = &FD_map::_open<UDP_FD>();
 
-  return [](const int type)->int{
-    switch(type)
-    {
-      case SOCK_STREAM:
-        return FD_map::_open<TCP_FD>().get_id();
-      case SOCK_DGRAM:
-        return FD_map::_open<UDP_FD>().get_id();
-      default:
-        return -EINVAL;
-    }
-  }(type);
+  fd->set_blocking(not non_blocking);
+  return fd->get_id();
 }
 
 static long sock_connect(int sockfd, const struct sockaddr *addr,
@@ -60,6 +60,15 @@ static long sock_sendmsg(int sockfd, const struct msghdr *msg, int flags)
   return -EBADF;
 }
 
+static long sock_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                          int flags)
+{
+  if(auto* fildes = FD_map::_get(sockfd); fildes)
+    return fildes->sendmmsg(msgvec, vlen, flags);
+
+  return -EBADF;
+}
+
 static ssize_t sock_sendto(int sockfd, const void *buf, size_t len, int flags,
                            const struct sockaddr *dest_addr, socklen_t addrlen)
 {
@@ -78,6 +87,23 @@ static ssize_t sock_recvfrom(int sockfd, void *buf, size_t len, int flags,
   return -EBADF;
 }
 
+static long sock_recvmsg(int sockfd, struct msghdr *msg, int flags)
+{
+  if(auto* fildes = FD_map::_get(sockfd); fildes)
+    return fildes->recvmsg(msg, flags);
+
+  return -EBADF;
+}
+
+static long sock_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                          int flags, struct timespec *timeout)
+{
+  if(auto* fildes = FD_map::_get(sockfd); fildes)
+    return fildes->recvmmsg(msgvec, vlen, flags, timeout);
+
+  return -EBADF;
+}
+
 static long sock_listen(int sockfd, int backlog)
 {
   if(auto* fildes = FD_map::_get(sockfd); fildes)
@@ -94,6 +120,35 @@ static long sock_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
   return -EBADF;
 }
 
+static long sock_accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                         int flags)
+{
+  if (UNLIKELY(flags & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)))
+    return -EINVAL;
+  const long res = sock_accept(sockfd, addr, addrlen);
+  if (res >= 0 and (flags & SOCK_NONBLOCK))
+    FD_map::_get(res)->set_blocking(false);
+  return res;
+}
+
+static long sock_getsockopt(int sockfd, int level, int optname,
+                            void *optval, socklen_t *optlen)
+{
+  if(auto* fildes = FD_map::_get(sockfd); fildes)
+    return fildes->getsockopt(level, optname, optval, optlen);
+
+  return -EBADF;
+}
+
+static long sock_setsockopt(int sockfd, int level, int optname,
+                            const void *optval, socklen_t optlen)
+{
+  if(auto* fildes = FD_map::_get(sockfd); fildes)
+    return fildes->setsockopt(level, optname, optval, optlen);
+
+  return -EBADF;
+}
+
 static long sock_shutdown(int sockfd, int how)
 {
   if(auto* fildes = FD_map::_get(sockfd); fildes)
@@ -111,12 +166,12 @@ long socketcall_socket(int domain, int type, int protocol)
 long socketcall_getsockopt(int sockfd,
     int level, int optname, void *optval, socklen_t *optlen)
 {
-  return -ENOSYS;
+  return strace(sock_getsockopt, "getsockopt", sockfd, level, optname, optval, optlen);
 }
 long socketcall_setsockopt(int sockfd,
     int level, int optname, const void *optval, socklen_t optlen)
 {
-  return -ENOSYS;
+  return strace(sock_setsockopt, "setsockopt", sockfd, level, optname, optval, optlen);
 }
 long socketcall_getsockname(int sockfd,
     struct sockaddr *addr, socklen_t *addrlen)
@@ -148,6 +203,12 @@ long socketcall_sendmsg(int sockfd, const struct msghdr *msg, int flags)
   return strace(sock_sendmsg, "sendmsg", sockfd, msg, flags);
 }
 
+long socketcall_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                         int flags)
+{
+  return strace(sock_sendmmsg, "sendmmsg", sockfd, msgvec, vlen, flags);
+}
+
 ssize_t socketcall_sendto(int sockfd, const void *buf, size_t len, int flags,
                           const struct sockaddr *dest_addr, socklen_t addrlen)
 {
@@ -160,6 +221,17 @@ ssize_t socketcall_recvfrom(int sockfd, void *buf, size_t len, int flags,
   return strace(sock_recvfrom, "recvfrom", sockfd, buf, len, flags, src_addr, addrlen);
 }
 
+long socketcall_recvmsg(int sockfd, struct msghdr *msg, int flags)
+{
+  return strace(sock_recvmsg, "recvmsg", sockfd, msg, flags);
+}
+
+long socketcall_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                         int flags, struct timespec *timeout)
+{
+  return strace(sock_recvmmsg, "recvmmsg", sockfd, msgvec, vlen, flags, timeout);
+}
+
 long socketcall_listen(int sockfd, int backlog)
 {
   return strace(sock_listen, "listen", sockfd, backlog);
@@ -170,6 +242,12 @@ long socketcall_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
   return strace(sock_accept, "accept", sockfd, addr, addrlen);
 }
 
+long socketcall_accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                        int flags)
+{
+  return strace(sock_accept4, "accept4", sockfd, addr, addrlen, flags);
+}
+
 long socketcall_shutdown(int sockfd, int how)
 {
   return strace(sock_shutdown, "shutdown", sockfd, how);
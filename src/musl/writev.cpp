@@ -1,8 +1,14 @@
 #include "common.hpp"
 #include <sys/uio.h>
+#include <limits.h>
+
+#include <posix/fd_map.hpp>
 
 static long sys_writev(int fd, const struct iovec *iov, int iovcnt)
 {
+  if (UNLIKELY(iovcnt < 0 or iovcnt > IOV_MAX))
+    return -EINVAL;
+
   if (fd == 1 || fd == 2)
   {
     long res = 0;
@@ -15,7 +21,12 @@ static long sys_writev(int fd, const struct iovec *iov, int iovcnt)
     }
     return res;
   }
-  return 0;
+
+  // sockets gather the buffers into one segment or datagram
+  if(auto* fildes = FD_map::_get(fd); fildes)
+    return fildes->writev(iov, iovcnt);
+
+  return -EBADF;
 }
 
 extern "C"
@@ -0,0 +1,205 @@
+
+#include <net/bond.hpp>
+#include <net/iana.hpp>
+#include <hal/machine.hpp>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace net {
+
+Bond& Bond::create(std::vector<hw::Nic*> links)
+{
+  auto bond = std::make_unique<Bond>(std::move(links));
+  auto* raw = bond.get();
+
+  os::machine().add<hw::Nic>(std::move(bond));
+
+  INFO("Bond", "Added %s over %zu links", raw->device_name().c_str(),
+       raw->links().size());
+  return *raw;
+}
+
+Bond::Bond(std::vector<hw::Nic*> links)
+  : Linklayer(Ethernet{{this, &Bond::transmit}, links.at(0)->mac()}),
+    links_{std::move(links)}
+{
+  Expects(links_.size() <= MAX_LINKS && "Too many links in a bond");
+  for (auto* link : links_)
+    phys_down_.push_back(link->create_physical_downstream());
+}
+
+uint32_t Bond::xmit_hash(const uint8_t* frame, const size_t len) noexcept
+{
+  size_t l3 = sizeof(ethernet::Header);
+  if (len < l3) return 0;
+  auto type = reinterpret_cast<const ethernet::Header*>(frame)->type();
+  // frames of VLAN interfaces on top of the bond
+  if (type == Ethertype::VLAN)
+  {
+    if (len < l3 + 4) return 0;
+    std::memcpy(&type, frame + l3 + 2, sizeof(type));
+    l3 += 4;
+  }
+
+  const uint8_t* ip = frame + l3;
+  uint32_t hash = 0;
+  uint8_t  proto;
+  size_t   l4;
+  bool     fragment = false;
+  if (type == Ethertype::IP4)
+  {
+    if (len < l3 + 20) return 0;
+    for (const size_t off : {12, 16}) {
+      uint32_t addr;
+      std::memcpy(&addr, ip + off, 4);
+      hash ^= addr;
+    }
+    proto = ip[9];
+    l4 = l3 + (ip[0] & 0xf) * 4;
+    // only the first fragment has the ports, so none of them are used
+    fragment = ((ip[6] & 0x3f) | ip[7]) != 0;
+  }
+  else if (type == Ethertype::IP6)
+  {
+    if (len < l3 + 40) return 0;
+    for (size_t off = 8; off < 40; off += 4) {
+      uint32_t word;
+      std::memcpy(&word, ip + off, 4);
+      hash ^= word;
+    }
+    proto = ip[6];
+    l4 = l3 + 40;
+  }
+  else return 0;
+
+  if ((proto == (uint8_t) net::Protocol::TCP or proto == (uint8_t) net::Protocol::UDP)
+      and not fragment and len >= l4 + 4)
+  {
+    uint32_t ports;
+    std::memcpy(&ports, frame + l4, 4);
+    hash ^= ports;
+  }
+  hash ^= hash >> 16;
+  hash ^= hash >> 8;
+  return hash;
+}
+
+void Bond::transmit(Packet_ptr chain)
+{
+  if (links_.size() == 1) {
+    phys_down_.front()(std::move(chain));
+    return;
+  }
+
+  // each link gets its part of the chain, in order
+  std::array<Packet_chain, MAX_LINKS> out;
+  while (chain != nullptr)
+  {
+    auto pkt = std::move(chain);
+    chain = pkt->detach_tail();
+    const auto link = xmit_hash(pkt->layer_begin(), pkt->size()) % links_.size();
+    out[link].push_back(std::move(pkt));
+  }
+  for (size_t i = 0; i < links_.size(); i++)
+    if (not out[i].empty())
+      phys_down_[i](out[i].release());
+}
+
+void Bond::set_ip4_upstream(upstream_ip handler)
+{
+  Linklayer::set_ip4_upstream(handler);
+  for (auto* link : links_) link->set_ip4_upstream(handler);
+}
+
+void Bond::set_ip6_upstream(upstream_ip handler)
+{
+  Linklayer::set_ip6_upstream(handler);
+  for (auto* link : links_) link->set_ip6_upstream(handler);
+}
+
+void Bond::set_arp_upstream(upstream handler)
+{
+  Linklayer::set_arp_upstream(handler);
+  for (auto* link : links_) link->set_arp_upstream(handler);
+}
+
+void Bond::set_vlan_upstream(upstream handler)
+{
+  Linklayer::set_vlan_upstream(handler);
+  for (auto* link : links_) link->set_vlan_upstream(handler);
+}
+
+uint16_t Bond::MTU() const noexcept
+{
+  uint16_t mtu = links_.front()->MTU();
+  for (const auto* link : links_) mtu = std::min(mtu, link->MTU());
+  return mtu;
+}
+
+uint32_t Bond::offloads() const noexcept
+{
+  uint32_t flags = links_.front()->offloads();
+  for (const auto* link : links_) flags &= link->offloads();
+  return flags;
+}
+
+uint32_t Bond::max_tso_size() const noexcept
+{
+  uint32_t size = links_.front()->max_tso_size();
+  for (const auto* link : links_) size = std::min(size, link->max_tso_size());
+  return size;
+}
+
+void Bond::on_transmit_queue_available(net::transmit_avail_delg del)
+{
+  for (auto* link : links_) link->on_transmit_queue_available(del);
+}
+
+size_t Bond::transmit_queue_available()
+{
+  size_t avail = links_.front()->transmit_queue_available();
+  for (auto* link : links_) avail = std::min(avail, link->transmit_queue_available());
+  return avail;
+}
+
+uint64_t Bond::get_packets_rx()
+{
+  uint64_t packets = 0;
+  for (auto* link : links_) packets += link->get_packets_rx();
+  return packets;
+}
+
+uint64_t Bond::get_packets_dropped()
+{
+  uint64_t packets = Linklayer::get_packets_dropped();
+  for (auto* link : links_) packets += link->get_packets_dropped();
+  return packets;
+}
+
+void Bond::add_vlan(const int id)
+{
+  for (auto* link : links_) link->add_vlan(id);
+}
+
+void Bond::deactivate()
+{
+  for (auto* link : links_) link->deactivate();
+}
+
+void Bond::move_to_this_cpu()
+{
+  for (auto* link : links_) link->move_to_this_cpu();
+}
+
+void Bond::flush()
+{
+  for (auto* link : links_) link->flush();
+}
+
+void Bond::poll()
+{
+  for (auto* link : links_) link->poll();
+}
+
+} // < namespace net
@@ -6,7 +6,9 @@
 #include <common>
 #include <cassert>
 #include <smp>
+#include <statman>
 #include <cstddef>
+#include <algorithm>
 #ifdef __MACH__
 extern void* aligned_alloc(size_t alignment, size_t size);
 #endif
@@ -22,7 +24,10 @@ namespace net {
 
   BufferStore::BufferStore(uint32_t num, uint32_t bufsize) :
     poolsize_  {num * bufsize},
-    bufsize_   {bufsize}
+    bufsize_   {bufsize},
+    bufmask_   {(bufsize & (bufsize - 1)) == 0 ? bufsize - 1 : 0},
+    page_shift_{__builtin_ctzl(os::mem::min_psize())},
+    owner_cpu_ {SMP::cpu_id()}
   {
     assert(num != 0);
     assert(bufsize != 0);
@@ -31,55 +36,265 @@ namespace net {
     this->create_new_pool();
     assert(this->available_.capacity() == num);
     assert(available() == num);
+    this->create_cache_stats();
+  }
 
+  BufferStore::BufferStore(uint8_t* memory, uint32_t num, uint32_t bufsize, bool filled) :
+    poolsize_  {num * bufsize},
+    bufsize_   {bufsize},
+    bufmask_   {(bufsize & (bufsize - 1)) == 0 ? bufsize - 1 : 0},
+    page_shift_{__builtin_ctzl(os::mem::min_psize())},
+    owner_cpu_ {SMP::cpu_id()},
+    external_  {true}
+  {
+    assert(num != 0);
+    assert(bufsize != 0);
+    assert(((uintptr_t) memory & (os::mem::min_psize() - 1)) == 0);
+    available_.reserve(num);
+    this->add_pool(memory, filled);
+    this->create_cache_stats();
+  }
+
+  void BufferStore::create_cache_stats()
+  {
     static int bsidx = 0;
     this->index = ++bsidx;
+
+    // one buffer cache per CPU, with its own hit/miss counters
+    caches_.resize(SMP::early_cpu_total());
+    for (size_t cpu = 0; cpu < caches_.size(); cpu++)
+    {
+      const std::string name = "bufstore" + std::to_string(this->index)
+                             + ".cpu" + std::to_string(cpu);
+      auto& cache = caches_[cpu];
+      cache.hits   = &Statman::get().create(Stat::UINT64, name + ".cache_hits").get_uint64();
+      cache.misses = &Statman::get().create(Stat::UINT64, name + ".cache_misses").get_uint64();
+    }
   }
 
   BufferStore::~BufferStore() {
-    for (auto* pool : this->pools_)
-        free(pool);
+    for (auto& cache : this->caches_) {
+      Statman::get().free(cache.hits);
+      Statman::get().free(cache.misses);
+    }
+    if (not this->external_)
+      for (auto* pool : this->pools_)
+        free_pool(pool);
   }
 
   uint8_t* BufferStore::get_buffer()
   {
+    auto* cache = this->local_cache();
+    if (LIKELY(cache != nullptr && cache->count > 0)) {
+      (*cache->hits)++;
+      return cache->buffers[--cache->count];
+    }
+    return this->get_buffer_slow(cache);
+  }
+
+  uint8_t* BufferStore::try_get_buffer() noexcept
+  {
+    auto* cache = this->local_cache();
+    if (LIKELY(cache != nullptr && cache->count > 0)) {
+      (*cache->hits)++;
+      return cache->buffers[--cache->count];
+    }
+    return this->get_buffer_slow(cache, false);
+  }
+
+  uint8_t* BufferStore::get_buffer_slow(cpu_cache_t* cache, const bool grow)
+  {
+    // the owner refills from what other CPUs gave back before locking
+    if (cache != nullptr and SMP::cpu_id() == owner_cpu_ and take_remote(cache) > 0) {
+      (*cache->misses)++;
+      return cache->buffers[--cache->count];
+    }
+
     plock.lock();
 
     if (UNLIKELY(available_.empty())) {
-      if (this->growth_enabled())
+      // rather than growing, take the buffers waiting for the owner
+      for (auto* buf = take_remote_all(); buf != nullptr; buf = next_of(buf))
+        available_.push_back(buf);
+      remote_count_.fetch_sub(available_.size(), std::memory_order_relaxed);
+    }
+    if (UNLIKELY(available_.empty())) {
+      if (not grow) {
+          plock.unlock();
+          return nullptr;
+      }
+      if (not this->external_ and this->growth_enabled())
           this->create_new_pool();
       else {
           plock.unlock();
           throw std::runtime_error("This BufferStore has run out of buffers");
-	  }
+      }
     }
 
     auto* addr = available_.back();
     available_.pop_back();
+
+    // refill the CPU cache in bulk while we hold the lock
+    if (cache != nullptr)
+    {
+      (*cache->misses)++;
+      const int count = std::min((size_t) CPU_CACHE_BATCH, available_.size());
+      std::copy(available_.end() - count, available_.end(), &cache->buffers[0]);
+      available_.resize(available_.size() - count);
+      cache->count = count;
+    }
     BSD_PRINT("%d: Gave away %p, %zu buffers remain\n",
             this->index, addr, available());
     plock.unlock();
     return addr;
   }
 
+  void BufferStore::release_slow(cpu_cache_t* cache, uint8_t* buff)
+  {
+    // other CPUs hand half their cache back to the owner, lock-free
+    if (cache != nullptr and SMP::cpu_id() != owner_cpu_)
+    {
+      (*cache->misses)++;
+      cache->count -= CPU_CACHE_BATCH;
+      this->push_remote(&cache->buffers[cache->count], CPU_CACHE_BATCH);
+      cache->buffers[cache->count++] = buff;
+      return;
+    }
+    plock.lock();
+    this->available_.push_back(buff);
+    // return half the CPU cache in bulk, so the next releases are local
+    if (cache != nullptr)
+    {
+      (*cache->misses)++;
+      cache->count -= CPU_CACHE_BATCH;
+      this->available_.insert(this->available_.end(),
+                              &cache->buffers[cache->count],
+                              &cache->buffers[cache->count + CPU_CACHE_BATCH]);
+    }
+    plock.unlock();
+  }
+
+  void BufferStore::release(uint8_t* const* buffers, size_t count)
+  {
+    for (size_t i = 0; i < count; i++) {
+      if (UNLIKELY(not this->is_valid(buffers[i])))
+          throw std::runtime_error("Buffer did not belong");
+    }
+
+    auto* cache = this->local_cache();
+    if (cache != nullptr)
+    {
+      const size_t local = std::min(count, size_t(CPU_CACHE_SIZE - cache->count));
+      std::copy(buffers, buffers + local, &cache->buffers[cache->count]);
+      cache->count += local;
+      (*cache->hits) += local;
+      buffers += local;
+      count   -= local;
+      if (count == 0) return;
+      (*cache->misses)++;
+      if (SMP::cpu_id() != owner_cpu_) {
+        this->push_remote(buffers, count);
+        return;
+      }
+    }
+    plock.lock();
+    this->available_.insert(this->available_.end(), buffers, buffers + count);
+    plock.unlock();
+  }
+
+  // large pools come straight from the page allocator, whose chunks are
+  // aligned to their size, so they take up as few huge pages as possible,
+  // and from the NUMA node of the CPU growing the store
+  static constexpr size_t HUGE_POOL = 2 << 20;
+
+  uint8_t* BufferStore::alloc_pool() const
+  {
+    if (poolsize_ >= HUGE_POOL) {
+      const int node = os::mem::numa_node_of_cpu(SMP::cpu_id());
+      return (uint8_t*) os::mem::numa_alloc(poolsize_, node);
+    }
+    return (uint8_t*) aligned_alloc(os::mem::min_psize(), poolsize_);
+  }
+
+  void BufferStore::free_pool(uint8_t* pool) const
+  {
+    if (poolsize_ >= HUGE_POOL)
+        os::mem::numa_free(pool, poolsize_);
+    else
+        free(pool);
+  }
+
   void BufferStore::create_new_pool()
   {
-    auto* pool = (uint8_t*) aligned_alloc(os::mem::min_psize(), poolsize_);
+    auto* pool = this->alloc_pool();
     if (UNLIKELY(pool == nullptr)) {
       throw std::runtime_error("Buffer store failed to allocate memory");
     }
+    this->add_pool(pool, true);
+    BSD_PRINT("%d: Creating new pool, now %zu total buffers\n",
+              this->index, this->total_buffers());
+  }
+
+  void BufferStore::add_pool(uint8_t* pool, const bool filled)
+  {
     this->pools_.push_back(pool);
+    // index every page the pool touches
+    const uintptr_t first = (uintptr_t) pool >> page_shift_;
+    const uintptr_t last  = ((uintptr_t) pool + poolsize_ - 1) >> page_shift_;
+    for (uintptr_t page = first; page <= last; page++)
+        this->page_index_.emplace(page, pool);
 
-    for (uint8_t* b = pool; b < pool + poolsize_; b += bufsize_) {
+    if (filled)
+      for (uint8_t* b = pool; b < pool + poolsize_; b += bufsize_) {
         this->available_.push_back(b);
+      }
+  }
+
+  void BufferStore::push_remote(uint8_t* const* buffers, size_t count)
+  {
+    // link the buffers together, then publish them all with one CAS
+    for (size_t i = 0; i + 1 < count; i++)
+      next_of(buffers[i]) = buffers[i + 1];
+    // counted first, so taking them never makes the count wrap
+    remote_count_.fetch_add(count, std::memory_order_relaxed);
+    auto*& last = next_of(buffers[count - 1]);
+    last = remote_free_.load(std::memory_order_relaxed);
+    while (not remote_free_.compare_exchange_weak(last, buffers[0],
+                  std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  uint8_t* BufferStore::take_remote_all()
+  {
+    // taking the whole list at once can't suffer from ABA
+    return remote_free_.exchange(nullptr, std::memory_order_acquire);
+  }
+
+  int BufferStore::take_remote(cpu_cache_t* cache)
+  {
+    auto* head = take_remote_all();
+    int taken = 0;
+    while (head != nullptr and cache->count < CPU_CACHE_SIZE) {
+      cache->buffers[cache->count++] = head;
+      head = next_of(head);
+      taken++;
     }
-    BSD_PRINT("%d: Creating new pool, now %zu total buffers\n",
-              this->index, this->total_buffers());
+    remote_count_.fetch_sub(taken, std::memory_order_relaxed);
+    if (head != nullptr)
+    {
+      // more than fits in the cache, put the rest back
+      auto* tail = head;
+      while (next_of(tail) != nullptr) tail = next_of(tail);
+      auto*& last = next_of(tail);
+      last = remote_free_.load(std::memory_order_relaxed);
+      while (not remote_free_.compare_exchange_weak(last, head,
+                    std::memory_order_release, std::memory_order_relaxed));
+    }
+    return taken;
   }
 
   void BufferStore::move_to_this_cpu() noexcept
   {
-    // TODO: hmm
+    owner_cpu_ = SMP::cpu_id();
   }
 
   __attribute__((weak))
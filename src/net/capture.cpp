@@ -0,0 +1,140 @@
+
+#include <net/capture.hpp>
+#include <net/ethernet/header.hpp>
+#include <net/iana.hpp>
+#include <net/tcp/tcp.hpp>
+#include <kernel/rtc.hpp>
+#include <os.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace net {
+
+// the pcap file format, with nanosecond timestamps
+static constexpr uint32_t PCAP_MAGIC_NS   = 0xa1b23c4d;
+static constexpr uint32_t LINKTYPE_ETHERNET = 1;
+
+struct pcap_header {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t  thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t network;
+};
+
+struct pcap_record {
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  uint32_t incl_len;
+  uint32_t orig_len;
+};
+
+Capture::Capture(const size_t records, const uint16_t snaplen)
+  : records_{std::max<size_t>(records, 1)},
+    snaplen_{snaplen},
+    // keeping the sequence numbers aligned
+    record_size_{(sizeof(Record) + snaplen + 7) & ~size_t(7)},
+    ring_{new uint8_t[records_ * record_size_]}
+{
+  for (size_t i = 0; i < records_; i++)
+    new (&at(i)) Record();
+}
+
+void Capture::record_one(const Packet& pkt, const Direction dir) noexcept
+{
+  const uint8_t* frame = pkt.layer_begin();
+  const size_t len = pkt.size();
+  if (filter_ and not filter_(frame, len, dir)) return;
+
+  const uint64_t pos = head_.fetch_add(1, std::memory_order_relaxed);
+  auto& rec = at(pos);
+  rec.seq.store(2 * pos + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  rec.ns     = os::nanos_since_boot();
+  rec.len    = pkt.total_size();
+  rec.caplen = std::min<size_t>(len, snaplen_);
+  rec.dir    = dir;
+  std::memcpy(rec.data, frame, rec.caplen);
+  rec.seq.store(2 * pos + 2, std::memory_order_release);
+}
+
+void Capture::clear() noexcept
+{
+  for (size_t i = 0; i < records_; i++)
+    at(i).seq.store(0, std::memory_order_relaxed);
+  head_.store(0, std::memory_order_release);
+}
+
+std::vector<uint8_t> Capture::to_pcap() const
+{
+  const uint64_t head  = head_.load(std::memory_order_acquire);
+  const uint64_t first = (head > records_) ? head - records_ : 0;
+
+  std::vector<uint8_t> out;
+  out.reserve(sizeof(pcap_header) + (head - first) * (sizeof(pcap_record) + snaplen_));
+  const pcap_header hdr {PCAP_MAGIC_NS, 2, 4, 0, 0, snaplen_, LINKTYPE_ETHERNET};
+  out.insert(out.end(), (const uint8_t*) &hdr, (const uint8_t*) &hdr + sizeof(hdr));
+
+  // timestamps are taken since boot, and shown as wall clock time
+  const uint64_t boot_ns = RTC::nanos_now() - os::nanos_since_boot();
+  for (uint64_t pos = first; pos < head; pos++)
+  {
+    const auto& rec = at(pos);
+    const uint64_t seq = rec.seq.load(std::memory_order_acquire);
+    // being written, or overwritten by a later one
+    if (seq != 2 * pos + 2) continue;
+
+    const uint64_t ns = boot_ns + rec.ns;
+    const uint16_t caplen = std::min(rec.caplen, snaplen_);
+    const pcap_record prec {uint32_t(ns / 1000000000), uint32_t(ns % 1000000000),
+                            caplen, rec.len};
+    const size_t size = out.size();
+    out.insert(out.end(), (const uint8_t*) &prec, (const uint8_t*) &prec + sizeof(prec));
+    out.insert(out.end(), rec.data, rec.data + caplen);
+
+    // overwritten while it was copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (rec.seq.load(std::memory_order_relaxed) != seq)
+      out.resize(size);
+  }
+  return out;
+}
+
+void Capture::serve(TCP& tcp, const uint16_t port)
+{
+  tcp.listen(port, [this] (tcp::Connection_ptr conn) {
+    auto pcap = std::make_shared<std::vector<uint8_t>>(to_pcap());
+    conn->write(pcap->data(), pcap->size(), pcap);
+    conn->close();
+  });
+}
+
+bool Capture::is_port(const uint8_t* frame, const size_t len, const uint16_t port) noexcept
+{
+  const size_t l3 = sizeof(ethernet::Header);
+  if (len < l3) return false;
+  const auto type = reinterpret_cast<const ethernet::Header*>(frame)->type();
+  const uint8_t* ip = frame + l3;
+  uint8_t proto;
+  size_t  l4;
+  if (type == Ethertype::IP4 and len >= l3 + 20) {
+    proto = ip[9];
+    l4 = l3 + (ip[0] & 0xf) * 4;
+  }
+  else if (type == Ethertype::IP6 and len >= l3 + 40) {
+    proto = ip[6];
+    l4 = l3 + 40;
+  }
+  else return false;
+
+  if (proto != (uint8_t) Protocol::TCP and proto != (uint8_t) Protocol::UDP)
+    return false;
+  if (len < l4 + 4) return false;
+  const uint16_t src = (frame[l4] << 8) | frame[l4 + 1];
+  const uint16_t dst = (frame[l4 + 2] << 8) | frame[l4 + 3];
+  return src == port or dst == port;
+}
+
+} // < namespace net
@@ -1,160 +1,37 @@
-
 #include <net/checksum.hpp>
 #include <net/util.hpp>
 #if defined(ARCH_x86_64) || defined(ARCH_i686)
   #include <immintrin.h>
   #include <x86intrin.h>
+  #include <kernel/cpuid.hpp>
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+  #include <arm_neon.h>
 #endif
 #include <cassert>
+#include <cstring>
 #include <common>
 
 namespace net {
 
-uint16_t checksum(uint32_t tsum, const void* data, size_t length) noexcept
-{
-  const char* buffer = (const char*) data;
-  int64_t sum = tsum;
-  if (UNLIKELY(length == 0))
-    return 0xffff;
-
-  if (UNLIKELY(buffer == 0))
-    return 0xffff;
-
+/**
+ *  Every kernel sums native 32-bit words into 64 bits, which folds to the
+ *  same one's complement sum as adding 16-bit words. A kernel consumes as
+ *  many whole blocks as it can from the front of the buffer, advancing
+ *  @buf and @len, and leaves the rest to sum_tail() / copy_tail().
+ */
+using sum_kernel_t  = uint64_t (*)(const uint8_t*& buf, size_t& len);
+using copy_kernel_t = uint64_t (*)(uint8_t*& dst, const uint8_t*& src, size_t& len);
 
+struct Checksum_kernel {
+  const char*   name;
+  bool          (*available)();
+  sum_kernel_t  sum;
+  copy_kernel_t copy;
+};
 
-#if defined(__SSSE3__)
-    static __m128i swap16a = _mm_setr_epi16(0x0001, 0xffff, 0x0203, 0xffff,
-                                         0x0405, 0xffff, 0x0607, 0xffff);
-    static __m128i swap16b = _mm_setr_epi16(0x0809, 0xffff, 0x0a0b, 0xffff,
-                      0x0c0d, 0xffff, 0x0e0f, 0xffff);
-    size_t count;
-    __m128i zero = _mm_setzero_si128();
-    __m128i suma=zero;
-    __m128i sumb=zero;
-    __m128i oldsum;
-
-    //according to godbolt its sligtly better to count index than incrementing pointer
-    for(count = 0; (count+64) < length; count+=64)
-    {
-      __m128i dblock1,dblock2;
-      dblock1 = _mm_loadu_si128((__m128i *) (&buffer[count +  0]));
-      dblock2 = _mm_loadu_si128((__m128i *) (&buffer[count + 16]));
-
-      suma = _mm_add_epi32(suma,_mm_shuffle_epi8(dblock1,swap16a));
-      sumb = _mm_add_epi32(sumb,_mm_shuffle_epi8(dblock1,swap16b));
-
-      suma = _mm_add_epi32(suma,_mm_shuffle_epi8(dblock2,swap16a));
-      sumb = _mm_add_epi32(sumb,_mm_shuffle_epi8(dblock2,swap16b));
-
-      dblock1 = _mm_loadu_si128((__m128i *) (&buffer[count + 32]));
-      dblock2 = _mm_loadu_si128((__m128i *) (&buffer[count + 48]));
-
-      suma = _mm_add_epi32(suma,_mm_shuffle_epi8(dblock1,swap16a));
-      sumb = _mm_add_epi32(sumb,_mm_shuffle_epi8(dblock1,swap16b));
-
-      suma = _mm_add_epi32(suma,_mm_shuffle_epi8(dblock2,swap16a));
-      sumb = _mm_add_epi32(sumb,_mm_shuffle_epi8(dblock2,swap16b));
-    }
-    //why are we not doing a 32 ?
-    while ((count+16) <= length)
-    {
-      __m128i dblock;
-      dblock= _mm_loadu_si128((__m128i *) (&buffer[count]));
-      suma = _mm_add_epi32(suma,_mm_shuffle_epi8(dblock,swap16a));
-      sumb = _mm_add_epi32(sumb,_mm_shuffle_epi8(dblock,swap16b));
-      count+=16;
-    }
-
-    /*alignas(16) this can be unaligned as we most likely are accessing it unaligned anyays*/
-    alignas(16) static const uint8_t shift_tab[48]={
-        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
-        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
-    };
-    /* we could extend this to fast convert 4 words to LE from BE */
-    alignas(16) static const uint8_t swap32[16]{
-        0x03,0x02,0x01,0x00,0x80,0x80,0x80,0x80,
-        0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80
-    };
-    int rest=16-(length-count);
-    //this over reads but who cares?!
-    if (LIKELY(rest != 16))
-    {
-       __m128i dblock;
-       dblock = _mm_loadu_si128((__m128i *)(&buffer[count]));
-       //shifting the data up then down gives us leading zeroes clearing out any over read data
-       //the shift up shuffles the data bytewise into place
-       dblock = _mm_shuffle_epi8(dblock, _mm_loadu_si128((__m128i *)(&shift_tab[16 - rest])));
-       dblock = _mm_shuffle_epi8(dblock, _mm_loadu_si128((__m128i *)(&shift_tab[16 + rest])));
-       suma = _mm_add_epi32(suma,_mm_shuffle_epi8(dblock,swap16a));
-       sumb = _mm_add_epi32(sumb,_mm_shuffle_epi8(dblock,swap16b));
-    }
-
-     suma = _mm_add_epi32(suma, sumb);
-     //add 0 and 1 to 0 and 2 and 3 to 1
-     suma = _mm_hadd_epi32(suma, _mm_setzero_si128());
-     //add 0 and 1 to 1 ..
-     suma = _mm_hadd_epi32(suma, _mm_setzero_si128());
-
-     oldsum = _mm_shuffle_epi8(_mm_cvtsi32_si128(tsum), _mm_loadu_si128((__m128i *)&swap32[0]));
-     suma = _mm_add_epi32(suma,oldsum); //adds the old csum to this
-     //fix endianess
-
-     //extract the 32 bit sum from vector
-     uint32_t vsum;
-     vsum=(uint32_t) _mm_cvtsi128_si32(suma);
-
-    //printf("Vsum + swapped(tsum) %08x\n",vsum);
-    //maybe this only works if tsum is byteswapped ?
-    while (vsum >>16)
-    {
-      vsum=(vsum & 0xFFFF)+(vsum>>16);
-    }
-    //allways right in this case as its allways little endian x86
-    return ~ntohs((uint16_t)(vsum));
-#elif defined(__AVX2__)
-  // VEX-align buffer
-  while (((uintptr_t) buffer & 15) && length >= 4) {
-    sum += *(uint32_t*) buffer;
-    length -= 4; buffer += 4;
-  }
-  // run 4 32-bit adds in parallell
-  union vec4 {
-    __m256i  mm;
-    int64_t  epi64[4];
-  };
-  vec4 vsum; vsum.mm = _mm256_set1_epi32(0);
-  while (length >= 64)
-  {
-    __m128i tmp1 = _mm_load_si128((__m128i*) (buffer + 0));
-    __m128i tmp2 = _mm_load_si128((__m128i*) (buffer + 16));
-    __m128i tmp3 = _mm_load_si128((__m128i*) (buffer + 32));
-    __m128i tmp4 = _mm_load_si128((__m128i*) (buffer + 48));
-
-    // unpack 16x 32-bit values
-    __m256i epi64_1 = _mm256_cvtepu32_epi64(tmp1);
-    __m256i epi64_2 = _mm256_cvtepu32_epi64(tmp2);
-    __m256i epi64_3 = _mm256_cvtepu32_epi64(tmp3);
-    __m256i epi64_4 = _mm256_cvtepu32_epi64(tmp4);
-
-    // sum 16x 32-bit values
-    vsum.mm = _mm256_add_epi64(vsum.mm, epi64_1);
-    vsum.mm = _mm256_add_epi64(vsum.mm, epi64_2);
-    vsum.mm = _mm256_add_epi64(vsum.mm, epi64_3);
-    vsum.mm = _mm256_add_epi64(vsum.mm, epi64_4);
-
-    length -= 64; buffer += 64;
-  }
-  // horizontal add
-  sum += vsum.epi64[0];
-  sum += vsum.epi64[1];
-  sum += vsum.epi64[2];
-  sum += vsum.epi64[3];
-#endif
-
+static uint64_t sum_scalar(const uint8_t*& buffer, size_t& length)
+{
+  uint64_t sum = 0;
   // unrolled 8 32-bit adds
   while (length >= 32)
   {
@@ -169,7 +46,29 @@ uint16_t checksum(uint32_t tsum, const void* data, size_t length) noexcept
     sum += v[7];
     length -= 32; buffer += 32;
   }
+  return sum;
+}
 
+static uint64_t copy_scalar(uint8_t*& dst, const uint8_t*& src, size_t& length)
+{
+  uint64_t sum = 0;
+  while (length >= 32)
+  {
+    uint64_t v[4];
+    memcpy(v, src, sizeof(v));
+    memcpy(dst, v, sizeof(v));
+    for (auto w : v)
+      sum += (w & 0xffffffff) + (w >> 32);
+    length -= 32; src += 32; dst += 32;
+  }
+  return sum;
+}
+
+static bool always() { return true; }
+
+static uint64_t sum_tail(const uint8_t* buffer, size_t length)
+{
+  uint64_t sum = 0;
   while (length >= 4)
   {
     auto v = *(uint32_t*) buffer;
@@ -187,6 +86,219 @@ uint16_t checksum(uint32_t tsum, const void* data, size_t length) noexcept
     auto v = *(uint8_t*) buffer;
     sum += v;
   }
+  return sum;
+}
+
+static uint64_t copy_tail(uint8_t* dst, const uint8_t* src, size_t length)
+{
+  memcpy(dst, src, length);
+  return sum_tail(dst, length);
+}
+
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+// CPU support is not enough, the OS must save the register state (XCR0)
+static bool os_saves(uint64_t mask)
+{
+  if (not CPUID::has_feature(CPUID::Feature::OSXSAVE)) return false;
+  uint32_t lo, hi;
+  asm volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((((uint64_t) hi << 32) | lo) & mask) == mask;
+}
+
+static bool has_sse2()
+{ return CPUID::has_feature(CPUID::Feature::SSE2); }
+
+__attribute__((target("sse2")))
+static uint64_t sum_sse2(const uint8_t*& buffer, size_t& length)
+{
+  const __m128i low = _mm_set1_epi64x(0xffffffff);
+  __m128i acc0 = _mm_setzero_si128(), acc1 = acc0;
+  while (length >= 32)
+  {
+    const __m128i a = _mm_loadu_si128((const __m128i*) (buffer +  0));
+    const __m128i b = _mm_loadu_si128((const __m128i*) (buffer + 16));
+    // even words to one accumulator, odd words to the other
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(a, low));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(a, 32));
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(b, low));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(b, 32));
+    length -= 32; buffer += 32;
+  }
+  alignas(16) uint64_t lanes[2];
+  _mm_store_si128((__m128i*) lanes, _mm_add_epi64(acc0, acc1));
+  return lanes[0] + lanes[1];
+}
+
+__attribute__((target("sse2")))
+static uint64_t copy_sse2(uint8_t*& dst, const uint8_t*& src, size_t& length)
+{
+  const __m128i low = _mm_set1_epi64x(0xffffffff);
+  __m128i acc0 = _mm_setzero_si128(), acc1 = acc0;
+  while (length >= 32)
+  {
+    const __m128i a = _mm_loadu_si128((const __m128i*) (src +  0));
+    const __m128i b = _mm_loadu_si128((const __m128i*) (src + 16));
+    _mm_storeu_si128((__m128i*) (dst +  0), a);
+    _mm_storeu_si128((__m128i*) (dst + 16), b);
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(a, low));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(a, 32));
+    acc0 = _mm_add_epi64(acc0, _mm_and_si128(b, low));
+    acc1 = _mm_add_epi64(acc1, _mm_srli_epi64(b, 32));
+    length -= 32; src += 32; dst += 32;
+  }
+  alignas(16) uint64_t lanes[2];
+  _mm_store_si128((__m128i*) lanes, _mm_add_epi64(acc0, acc1));
+  return lanes[0] + lanes[1];
+}
+
+static bool has_avx2()
+{
+  return CPUID::has_feature(CPUID::Feature::AVX2) and os_saves(0x6);
+}
+
+__attribute__((target("avx2")))
+static uint64_t sum_avx2(const uint8_t*& buffer, size_t& length)
+{
+  const __m256i low = _mm256_set1_epi64x(0xffffffff);
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0;
+  while (length >= 64)
+  {
+    const __m256i a = _mm256_loadu_si256((const __m256i*) (buffer +  0));
+    const __m256i b = _mm256_loadu_si256((const __m256i*) (buffer + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(a, low));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(a, 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(b, low));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(b, 32));
+    length -= 64; buffer += 64;
+  }
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256((__m256i*) lanes, _mm256_add_epi64(acc0, acc1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2")))
+static uint64_t copy_avx2(uint8_t*& dst, const uint8_t*& src, size_t& length)
+{
+  const __m256i low = _mm256_set1_epi64x(0xffffffff);
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0;
+  while (length >= 64)
+  {
+    const __m256i a = _mm256_loadu_si256((const __m256i*) (src +  0));
+    const __m256i b = _mm256_loadu_si256((const __m256i*) (src + 32));
+    _mm256_storeu_si256((__m256i*) (dst +  0), a);
+    _mm256_storeu_si256((__m256i*) (dst + 32), b);
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(a, low));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(a, 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_and_si256(b, low));
+    acc1 = _mm256_add_epi64(acc1, _mm256_srli_epi64(b, 32));
+    length -= 64; src += 64; dst += 64;
+  }
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256((__m256i*) lanes, _mm256_add_epi64(acc0, acc1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static bool has_avx512()
+{
+  // opmask and both halves of the ZMM state, on top of AVX
+  return CPUID::has_feature(CPUID::Feature::AVX512F) and os_saves(0xe6);
+}
+
+__attribute__((target("avx512f")))
+static uint64_t sum_avx512(const uint8_t*& buffer, size_t& length)
+{
+  const __m512i low = _mm512_set1_epi64(0xffffffff);
+  __m512i acc0 = _mm512_setzero_si512(), acc1 = acc0;
+  while (length >= 128)
+  {
+    const __m512i a = _mm512_loadu_si512(buffer +  0);
+    const __m512i b = _mm512_loadu_si512(buffer + 64);
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(a, low));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(a, 32));
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(b, low));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(b, 32));
+    length -= 128; buffer += 128;
+  }
+  return _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+static uint64_t copy_avx512(uint8_t*& dst, const uint8_t*& src, size_t& length)
+{
+  const __m512i low = _mm512_set1_epi64(0xffffffff);
+  __m512i acc0 = _mm512_setzero_si512(), acc1 = acc0;
+  while (length >= 128)
+  {
+    const __m512i a = _mm512_loadu_si512(src +  0);
+    const __m512i b = _mm512_loadu_si512(src + 64);
+    _mm512_storeu_si512(dst +  0, a);
+    _mm512_storeu_si512(dst + 64, b);
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(a, low));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(a, 32));
+    acc0 = _mm512_add_epi64(acc0, _mm512_and_si512(b, low));
+    acc1 = _mm512_add_epi64(acc1, _mm512_srli_epi64(b, 32));
+    length -= 128; src += 128; dst += 128;
+  }
+  return _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+}
+
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+static uint64_t sum_neon(const uint8_t*& buffer, size_t& length)
+{
+  uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0);
+  while (length >= 32)
+  {
+    // pairwise add 32-bit words into the 64-bit lanes
+    acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(buffer +  0)));
+    acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(buffer + 16)));
+    length -= 32; buffer += 32;
+  }
+  return vaddvq_u64(vaddq_u64(acc0, acc1));
+}
+
+static uint64_t copy_neon(uint8_t*& dst, const uint8_t*& src, size_t& length)
+{
+  uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0);
+  while (length >= 32)
+  {
+    const uint8x16_t a = vld1q_u8(src +  0);
+    const uint8x16_t b = vld1q_u8(src + 16);
+    vst1q_u8(dst +  0, a);
+    vst1q_u8(dst + 16, b);
+    acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(a));
+    acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(b));
+    length -= 32; src += 32; dst += 32;
+  }
+  return vaddvq_u64(vaddq_u64(acc0, acc1));
+}
+#endif
+
+// best first
+static const Checksum_kernel kernels[] {
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  { "avx512", has_avx512, sum_avx512, copy_avx512 },
+  { "avx2",   has_avx2,   sum_avx2,   copy_avx2   },
+  { "sse2",   has_sse2,   sum_sse2,   copy_sse2   },
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+  { "neon",   always,     sum_neon,   copy_neon   },
+#endif
+  { "scalar", always,     sum_scalar, copy_scalar },
+};
+
+static const Checksum_kernel* active_kernel = nullptr;
+
+// picked on first use, which is early in boot
+static const Checksum_kernel& kernel() noexcept
+{
+  if (UNLIKELY(active_kernel == nullptr)) {
+    for (const auto& k : kernels)
+      if (k.available()) { active_kernel = &k; break; }
+  }
+  return *active_kernel;
+}
+
+static uint16_t fold(uint64_t sum) noexcept
+{
   // fold to 32-bit
   uint32_t a32 = sum & 0xffffffff;
   uint32_t b32 = sum >> 32;
@@ -197,8 +309,57 @@ uint16_t checksum(uint32_t tsum, const void* data, size_t length) noexcept
   uint16_t b16 = a32 >> 16;
   a16 += b16;
   if (a16 < b16) a16++;
+  return a16;
+}
+
+uint16_t checksum(uint32_t tsum, const void* data, size_t length) noexcept
+{
+  const uint8_t* buffer = (const uint8_t*) data;
+  if (UNLIKELY(length == 0))
+    return 0xffff;
+
+  if (UNLIKELY(buffer == 0))
+    return 0xffff;
+
+  uint64_t sum = tsum;
+  sum += kernel().sum(buffer, length);
+  sum += sum_tail(buffer, length);
   // return 2s complement
-  return ~a16;
+  return ~fold(sum);
+}
+
+uint16_t copy_and_checksum(void* dst, const void* src, size_t length,
+                           uint32_t tsum) noexcept
+{
+  auto* to = (uint8_t*) dst;
+  auto* from = (const uint8_t*) src;
+  uint64_t sum = tsum;
+  sum += kernel().copy(to, from, length);
+  sum += copy_tail(to, from, length);
+  return fold(sum);
+}
+
+const char* checksum_kernel() noexcept
+{
+  return kernel().name;
+}
+
+std::vector<const char*> checksum_kernels()
+{
+  std::vector<const char*> names;
+  for (const auto& k : kernels)
+    if (k.available()) names.push_back(k.name);
+  return names;
+}
+
+bool use_checksum_kernel(const char* name) noexcept
+{
+  for (const auto& k : kernels)
+    if (strcmp(k.name, name) == 0 and k.available()) {
+      active_kernel = &k;
+      return true;
+    }
+  return false;
 }
 
 // Taken from https://tools.ietf.org/html/rfc3022#page-9
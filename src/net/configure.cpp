@@ -190,17 +190,18 @@ inline void parse(const Val& val, v4_config& cfg4, v6_config& cfg6, Func func)
   }
 }
 
-void configure(const rapidjson::Value& net)
+// the same for the JSON document and the compiled config
+template <typename Value>
+static void configure_from(const Value& net)
 {
   MYINFO("Configuring network");
 
   Expects(net.IsArray() && "Member net is not an array");
 
-  auto configs = net.GetArray();
-  if(configs.Size() > Interfaces::get().size())
+  if(net.Size() > Interfaces::get().size())
     MYINFO("WARN: Found more configs than there are interfaces");
   // Iterate all interfaces in config
-  for(auto& val : configs)
+  for(auto& val : net.GetArray())
   {
     Expects(val.HasMember("iface")
       && "Missing member iface - don't know which interface to configure");
@@ -303,4 +304,14 @@ void configure(const rapidjson::Value& net)
   MYINFO("Configuration complete");
 }
 
+void configure(const rapidjson::Value& net)
+{
+  configure_from(net);
+}
+
+void configure(const Config_value& net)
+{
+  configure_from(net);
+}
+
 }
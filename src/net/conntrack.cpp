@@ -1,6 +1,7 @@
 
 #include <net/conntrack.hpp>
-#include <set>
+#include <algorithm>
+#include <stdexcept>
 
 //#define CT_DEBUG 1
 #ifdef CT_DEBUG
@@ -52,6 +53,7 @@ Conntrack::Entry::~Entry()
 {
   if(this->on_close)
     on_close(this);
+  Conntrack::unlink_expiry(*this);
 }
 
 Conntrack::Entry* Conntrack::simple_track_in(Quadruple q, const Protocol proto)
@@ -94,11 +96,103 @@ Conntrack::Conntrack()
 {}
 
 Conntrack::Conntrack(size_t max_entries)
+ : Conntrack(max_entries, 1)
+{}
+
+Conntrack::Conntrack(size_t max_entries, int shards)
  : maximum_entries{max_entries},
    tcp_in{&dumb_in},
    tcp6_in{&dumb6_in},
-   flush_timer({this, &Conntrack::on_timeout})
+   sharded_{shards > 1}
 {
+  Expects(shards > 0 and shards <= 256);
+  for(int i = 0; i < shards; i++)
+    shards_.emplace_back(*this, i);
+
+  if(max_entries != 0)
+    reserve(max_entries);
+
+  shrinker_ = os::mem::add_shrinker("conntrack", os::mem::Shrink_cost::moderate,
+                                    {this, &Conntrack::shrink});
+}
+
+Conntrack::Shard::Shard(Conntrack& ct, int idx)
+ : flush_timer({&ct, &Conntrack::on_timeout}),
+   index(idx)
+{}
+
+Conntrack::~Conntrack()
+{
+  os::mem::remove_shrinker(shrinker_);
+  for(auto& shard : shards_)
+  {
+    for(auto* head : shard.wheel)
+    {
+      for(auto* ent = head; ent != nullptr;)
+      {
+        auto* next = ent->expiry_next;
+        free_entry(shard, ent);
+        ent = next;
+      }
+    }
+  }
+}
+
+size_t Conntrack::number_of_entries() const noexcept
+{
+  size_t count = 0;
+  for(const auto& shard : shards_)
+    count += shard.entries.size();
+  return count;
+}
+
+void Conntrack::reserve(size_t count)
+{
+  for(auto& shard : shards_)
+  {
+    Shard_lock lock(*this, shard);
+    reserve(shard, count / shards_.size());
+  }
+}
+
+void Conntrack::reserve(Shard& shard, size_t count)
+{
+  shard.entries.reserve(count);
+  const size_t pooled = shard.pool_chunks.size() * POOL_CHUNK;
+  if(count / 2 > pooled)
+    grow_pool(shard, count / 2 - pooled);
+}
+
+void Conntrack::grow_pool(Shard& shard, size_t count)
+{
+  count = ((count + POOL_CHUNK - 1) / POOL_CHUNK) * POOL_CHUNK;
+  while(count > 0)
+  {
+    shard.pool_chunks.emplace_back(new Entry_storage[POOL_CHUNK]);
+    auto* chunk = shard.pool_chunks.back().get();
+    shard.pool_free.reserve(shard.pool_free.size() + POOL_CHUNK);
+    for(size_t i = POOL_CHUNK; i > 0; i--)
+      shard.pool_free.push_back(reinterpret_cast<Entry*>(&chunk[i-1]));
+    count -= POOL_CHUNK;
+  }
+}
+
+template <typename... Args>
+Conntrack::Entry* Conntrack::new_entry(Shard& shard, Args&&... args)
+{
+  if(UNLIKELY(shard.pool_free.empty()))
+    grow_pool(shard, POOL_CHUNK);
+  auto* storage = shard.pool_free.back();
+  shard.pool_free.pop_back();
+  auto* entry = new (storage) Entry(std::forward<Args>(args)...);
+  entry->shard = shard.index;
+  return entry;
+}
+
+void Conntrack::free_entry(Shard& shard, Entry* ent) noexcept
+{
+  ent->~Entry();
+  shard.pool_free.push_back(ent);
 }
 
 Conntrack::Entry* Conntrack::get(const PacketIP4& pkt) const
@@ -135,52 +229,95 @@ Conntrack::Entry* Conntrack::get(const PacketIP6& pkt) const
   }
 }
 
-Conntrack::Entry* Conntrack::get(const Quadruple& quad, const Protocol proto) const
+Conntrack::Entry* Conntrack::find(Shard& shard, const Quadruple& quad, const Protocol proto)
 {
-  auto it = entries.find({quad, proto});
+  const auto* ent = shard.entries.find({quad, proto});
+  return (ent != nullptr) ? *ent : nullptr;
+}
 
-  if(it != entries.end())
-    return it->second.get();
+Conntrack::Entry* Conntrack::get(const Quadruple& quad, const Protocol proto) const
+{
+  auto& self  = const_cast<Conntrack&>(*this);
+  auto& local = self.local_shard();
+  {
+    Shard_lock lock(*this, local);
+    if(auto* entry = find(local, quad, proto))
+      return entry;
+  }
+  if(LIKELY(not sharded_))
+    return nullptr;
 
+  // handoff: the flow may be owned by another CPU
+  for(auto& shard : self.shards_)
+  {
+    if(&shard == &local) continue;
+    Shard_lock lock(*this, shard);
+    if(auto* entry = find(shard, quad, proto)) {
+      __sync_fetch_and_add(&self.handoffs_, 1);
+      return entry;
+    }
+  }
   return nullptr;
 }
 
 Conntrack::Entry* Conntrack::in(const PacketIP4& pkt)
 {
   const auto proto = pkt.ip_protocol();
+  Quadruple quad;
+  Entry* entry = nullptr;
   switch(proto)
   {
     case Protocol::TCP:
-      return tcp_in(*this, get_quadruple(pkt), pkt);
+      quad  = get_quadruple(pkt);
+      entry = tcp_in(*this, quad, pkt);
+      break;
 
     case Protocol::UDP:
-      return simple_track_in(get_quadruple(pkt), proto);
+      quad  = get_quadruple(pkt);
+      entry = simple_track_in(quad, proto);
+      break;
 
     case Protocol::ICMPv4:
-      return simple_track_in(get_quadruple_icmp(pkt), proto);
+      quad  = get_quadruple_icmp(pkt);
+      entry = simple_track_in(quad, proto);
+      break;
 
     default:
       return nullptr;
   }
+  if(entry != nullptr)
+    count(*entry, quad, pkt.size());
+  return entry;
 }
 
 Conntrack::Entry* Conntrack::in(const PacketIP6& pkt)
 {
   const auto proto = pkt.ip_protocol();
+  Quadruple quad;
+  Entry* entry = nullptr;
   switch(proto)
   {
     case Protocol::TCP:
-      return tcp6_in(*this, get_quadruple(pkt), pkt);
+      quad  = get_quadruple(pkt);
+      entry = tcp6_in(*this, quad, pkt);
+      break;
 
     case Protocol::UDP:
-      return simple_track_in(get_quadruple(pkt), proto);
+      quad  = get_quadruple(pkt);
+      entry = simple_track_in(quad, proto);
+      break;
 
     case Protocol::ICMPv6:
-      return simple_track_in(get_quadruple_icmp(pkt), proto);
+      quad  = get_quadruple_icmp(pkt);
+      entry = simple_track_in(quad, proto);
+      break;
 
     default:
       return nullptr;
   }
+  if(entry != nullptr)
+    count(*entry, quad, pkt.size());
+  return entry;
 }
 
 Conntrack::Entry* Conntrack::confirm(const PacketIP4& pkt)
@@ -253,53 +390,57 @@ Conntrack::Entry* Conntrack::confirm(Quadruple quad, const Protocol proto)
 Conntrack::Entry* Conntrack::add_entry(
   const Quadruple& quad, const Protocol proto)
 {
-  // Return nullptr if conntrack is full
-  if(UNLIKELY(maximum_entries != 0 and
-    entries.size() + 2 > maximum_entries))
+  // new connections belong to the CPU that sees them first
+  auto& shard = local_shard();
+  Entry* entry = nullptr;
   {
-    CTDBG("<Conntrack> Limit reached (limit=%lu sz=%lu)\n",
-      maximum_entries, entries.size());
-    return nullptr;
-  }
-
-  if(not flush_timer.is_running())
-    flush_timer.start(flush_interval);
+    Shard_lock lock(*this, shard);
+    // Return nullptr if conntrack is full
+    if(UNLIKELY(maximum_entries != 0 and
+      shard.entries.size() + 2 > shard_limit()))
+    {
+      CTDBG("<Conntrack> Limit reached (limit=%lu sz=%lu)\n",
+        maximum_entries, shard.entries.size());
+      return nullptr;
+    }
 
-  // we dont check if it's already exists
-  // because it should be called from in()
+    // the timer fires on this CPU, which owns the shard
+    if(not shard.flush_timer.is_running())
+      shard.flush_timer.start(flush_interval);
 
-  // create the entry
-  auto entry = std::make_shared<Entry>(quad, proto);
+    // we dont check if it's already exists
+    // because it should be called from in()
 
-  entries.emplace(std::piecewise_construct,
-    std::forward_as_tuple(entry->first, proto),
-    std::forward_as_tuple(entry));
+    // create the entry
+    entry = new_entry(shard, quad, proto);
 
-  entries.emplace(std::piecewise_construct,
-    std::forward_as_tuple(entry->second, proto),
-    std::forward_as_tuple(entry));
+    shard.entries.emplace({entry->first, proto}, entry);
+    shard.entries.emplace({entry->second, proto}, entry);
+  }
 
   CTDBG("<Conntrack> Entry added: %s\n", entry->to_string().c_str());
 
   update_timeout(*entry, timeout.unconfirmed);
 
-  return entry.get();
+  return entry;
 }
 
 Conntrack::Entry* Conntrack::update_entry(
   const Protocol proto, const Quadruple& oldq, const Quadruple& newq)
 {
   // find the entry that has quintuple containing the old quant
+  // (copied, oldq may refer to the quadruple being updated)
   const auto quint = Quintuple{oldq, proto};
-  auto it = entries.find(quint);
+  auto* entry = get(oldq, proto);
 
-  if(UNLIKELY(it == entries.end())) {
+  if(UNLIKELY(entry == nullptr)) {
     CTDBG("<Conntrack> Cannot find entry when updating: %s\n",
       oldq.to_string().c_str());
     return nullptr;
   }
 
-  auto entry = it->second;
+  auto& shard = shard_of(*entry);
+  Shard_lock lock(*this, shard);
 
   // determine if the old quant hits the first or second quantuple
   auto& quad = (entry->first == oldq)
@@ -310,48 +451,170 @@ Conntrack::Entry* Conntrack::update_entry(
 
   // replace this ...
   // erase the old entry
-  entries.erase(quint);
+  shard.entries.erase(quint);
   // insert the entry with updated quintuple
-  entries.emplace(std::piecewise_construct,
-    std::forward_as_tuple(newq, proto),
-    std::forward_as_tuple(entry));
-
-  // ... with this (when compile on clang)
-  /*
-  // update the key in the map with the new quadruple
-  auto ent = entries.extract(it);
-  ent.key().quad = newq;
-  entries.insert(std::move(ent));
-  */
+  shard.entries.emplace({newq, proto}, entry);
 
   CTDBG("<Conntrack> Entry updated: %s\n", entry->to_string().c_str());
 
-  return entry.get();
+  return entry;
+}
+
+void Conntrack::set_timeout(Entry& ent, Timeout_duration dur)
+{
+  const auto now = RTC::now();
+  const auto timeout = now + dur.count();
+  // timeouts are refreshed by the packets of the entry
+  if(UNLIKELY(ent.first_seen == 0))
+    ent.first_seen = now;
+  ent.last_seen = now;
+  // most packets refresh the timeout within the same second
+  if(ent.timeout == timeout and ent.expiry_pprev != nullptr)
+    return;
+  auto& shard = shard_of(ent);
+  Shard_lock lock(*this, shard);
+  ent.timeout = timeout;
+  unlink_expiry(ent);
+  link_expiry(shard, ent);
+}
+
+void Conntrack::link_expiry(Shard& shard, Entry& ent)
+{
+  if(UNLIKELY(shard.wheel.empty())) {
+    shard.wheel.assign(WHEEL_SLOTS, nullptr);
+    shard.wheel_tick = RTC::now();
+  }
+  // already due entries go in the next slot to be expired
+  const auto tick = std::max(ent.timeout, shard.wheel_tick + 1);
+  auto& head = shard.wheel[tick & (WHEEL_SLOTS - 1)];
+  ent.expiry_next  = head;
+  ent.expiry_pprev = &head;
+  if(head != nullptr)
+    head->expiry_pprev = &ent.expiry_next;
+  head = &ent;
+}
+
+void Conntrack::unlink_expiry(Entry& ent) noexcept
+{
+  if(ent.expiry_pprev == nullptr)
+    return;
+  *ent.expiry_pprev = ent.expiry_next;
+  if(ent.expiry_next != nullptr)
+    ent.expiry_next->expiry_pprev = ent.expiry_pprev;
+  ent.expiry_next  = nullptr;
+  ent.expiry_pprev = nullptr;
+}
+
+void Conntrack::erase(Shard& shard, Entry& ent)
+{
+  // leave keys that were taken over by another entry (deserialize) alone
+  for(const auto* quad : {&ent.first, &ent.second})
+  {
+    const Quintuple key{*quad, ent.proto};
+    const auto* found = shard.entries.find(key);
+    if(found != nullptr and *found == &ent)
+      shard.entries.erase(key);
+  }
+  unlink_expiry(ent);
+  free_entry(shard, &ent);
+}
+
+void Conntrack::for_each_entry(Entry_handler handler)
+{
+  // every entry is once in the timing wheel of its shard
+  for(auto& shard : shards_)
+  {
+    Shard_lock lock(*this, shard);
+    for(auto* head : shard.wheel)
+    {
+      for(auto* ent = head; ent != nullptr;)
+      {
+        auto* next = ent->expiry_next;
+        handler(ent);
+        ent = next;
+      }
+    }
+  }
+}
+
+void Conntrack::expire_due(const RTC::timestamp_t now)
+{
+  auto& shard = local_shard();
+  Shard_lock lock(*this, shard);
+  expire_due(shard, now);
+}
+
+void Conntrack::expire_due(Shard& shard, const RTC::timestamp_t now)
+{
+  if(shard.wheel.empty() or now <= shard.wheel_tick)
+    return;
+  const auto first = shard.wheel_tick + 1;
+  const auto due = std::min<RTC::timestamp_t>(now - shard.wheel_tick, WHEEL_SLOTS);
+  for(RTC::timestamp_t tick = first; tick < first + due; tick++)
+  {
+    const int slot = tick & (WHEEL_SLOTS - 1);
+    for(auto* ent = shard.wheel[slot]; ent != nullptr;)
+    {
+      auto* next = ent->expiry_next;
+      if(ent->timeout <= now) {
+        CTDBG("<Conntrack> Erasing %s\n", ent->to_string().c_str());
+        if(on_expire)
+          on_expire(ent);
+        erase(shard, *ent);
+      }
+      // timeout changed directly, or more than a lap ahead
+      else if(int(ent->timeout & (WHEEL_SLOTS - 1)) != slot) {
+        unlink_expiry(*ent);
+        link_expiry(shard, *ent);
+      }
+      ent = next;
+    }
+  }
+  shard.wheel_tick = now;
 }
 
 void Conntrack::remove_expired()
 {
   CTDBG("<Conntrack> Removing expired entries\n");
   const auto NOW = RTC::now();
-  // entries data structure
-  for(auto it = entries.begin(); it != entries.end();)
+  for(auto& shard : shards_)
   {
-    if(it->second->timeout > NOW) {
-      ++it;
-    }
-    else {
-      CTDBG("<Conntrack> Erasing %s\n", it->second->to_string().c_str());
-      it = entries.erase(it);
+    Shard_lock lock(*this, shard);
+    for(auto* head : shard.wheel)
+    {
+      for(auto* ent = head; ent != nullptr;)
+      {
+        auto* next = ent->expiry_next;
+        if(ent->timeout <= NOW) {
+          CTDBG("<Conntrack> Erasing %s\n", ent->to_string().c_str());
+          if(on_expire)
+            on_expire(ent);
+          erase(shard, *ent);
+        }
+        ent = next;
+      }
     }
   }
 }
 
-void Conntrack::on_timeout()
+size_t Conntrack::shrink(os::mem::Pressure)
 {
+  // the entries go back to the pools, for new connections instead of
+  // more chunks from the heap
+  const size_t before = number_of_entries();
   remove_expired();
+  return (before - number_of_entries()) * sizeof(Entry);
+}
+
+void Conntrack::on_timeout()
+{
+  // each shard has a timer on the CPU owning it
+  auto& shard = local_shard();
+  Shard_lock lock(*this, shard);
+  expire_due(shard, RTC::now());
 
-  if(not entries.empty())
-    flush_timer.restart(flush_interval);
+  if(not shard.entries.empty())
+    shard.flush_timer.restart(flush_interval);
 }
 
 int Conntrack::Entry::deserialize_from(void* addr)
@@ -374,26 +637,74 @@ void Conntrack::Entry::serialize_to(std::vector<char>& buf) const
   buf.insert(buf.end(), ptr, ptr + size);
 }
 
+// The serialized table: a header, and then a fixed size record per entry,
+// without the parts of Entry that aren't restored
+struct Serialized_header
+{
+  static constexpr uint32_t MAGIC = 0x43544231; // CTB1
+  uint32_t magic;
+  uint32_t entry_size;
+  uint64_t count;
+};
+struct Serialized_entry
+{
+  Quadruple         first;
+  Quadruple         second;
+  RTC::timestamp_t  timeout;
+  Protocol          proto;
+  Conntrack::State  state;
+  uint8_t           flags;
+  uint8_t           other;
+};
+
 int Conntrack::deserialize_from(void* addr)
 {
+  // restored entries belong to this CPU
+  auto& shard = local_shard();
+  Shard_lock lock(*this, shard);
+  auto& entries = shard.entries;
   const auto prev_size = entries.size();
   auto* buffer = reinterpret_cast<uint8_t*>(addr);
 
-  const auto size = *reinterpret_cast<size_t*>(buffer);
-  buffer += sizeof(size_t);
+  const auto& hdr = *reinterpret_cast<const Serialized_header*>(buffer);
+  const bool compact = hdr.magic == Serialized_header::MAGIC;
+  if(compact and hdr.entry_size != sizeof(Serialized_entry))
+    throw std::runtime_error("Conntrack serialized entry size mismatch");
+  // the old format was the count, and then each entry as in memory
+  const size_t size = compact ? hdr.count : *reinterpret_cast<size_t*>(buffer);
+  buffer += compact ? sizeof(Serialized_header) : sizeof(size_t);
+
+  // table slots and pooled entries for all of them at once
+  reserve(shard, entries.size() + size * 2);
 
   size_t dupes = 0;
   for(auto i = size; i > 0; i--)
   {
     // create the entry
-    auto entry = std::make_shared<Entry>();
-    buffer += entry->deserialize_from(buffer);
+    auto* entry = new_entry(shard);
+    if(compact)
+    {
+      const auto& ser = *reinterpret_cast<const Serialized_entry*>(buffer);
+      entry->first   = ser.first;
+      entry->second  = ser.second;
+      entry->timeout = ser.timeout;
+      entry->proto   = ser.proto;
+      entry->state   = ser.state;
+      entry->flags   = ser.flags;
+      entry->other   = ser.other;
+      buffer += sizeof(Serialized_entry);
+    }
+    else {
+      buffer += entry->deserialize_from(buffer);
+    }
+    link_expiry(shard, *entry);
 
+    // a replaced entry keeps its other key, and is freed when it expires
     bool insert = false;
-    insert = entries.insert_or_assign({entry->first, entry->proto}, entry).second;
+    insert = entries.insert_or_assign({entry->first, entry->proto}, entry);
     if(not insert)
       dupes++;
-    insert = entries.insert_or_assign({entry->second, entry->proto}, entry).second;
+    insert = entries.insert_or_assign({entry->second, entry->proto}, entry);
     if(not insert)
       dupes++;
   }
@@ -406,36 +717,41 @@ int Conntrack::deserialize_from(void* addr)
 void Conntrack::serialize_to(std::vector<char>& buf) const
 {
   int unserialized = 0;
-
-  // Since each entry is stored twice in the map,
-  // we iterate and put it in a set if not already there
-  std::set<Entry*> to_serialize;
-  for(auto& i : entries)
+  const size_t begin = buf.size();
+  // each entry is stored twice in the table, so this is usually enough
+  size_t keys = 0;
+  for(const auto& shard : shards_)
+    keys += shard.entries.size();
+  buf.resize(begin + sizeof(Serialized_header) + keys * sizeof(Serialized_entry) / 2);
+
+  // one pass over the timing wheel, where every entry is once
+  size_t pos = begin + sizeof(Serialized_header);
+  uint64_t count = 0;
+  for(auto& shard : const_cast<Conntrack*>(this)->shards_)
   {
-    auto* ent = i.second.get();
-
-    // We cannot restore delegates, so just ignore
-    // the ones with close handler set
-    if(ent->on_close != nullptr) {
-      unserialized++;
-      continue;
+    Shard_lock lock(*this, shard);
+    for(const auto* head : shard.wheel)
+    {
+      for(const auto* ent = head; ent != nullptr; ent = ent->expiry_next)
+      {
+        // We cannot restore delegates, so just ignore
+        // the ones with close handler set
+        if(ent->on_close != nullptr) {
+          unserialized++;
+          continue;
+        }
+        if(UNLIKELY(pos + sizeof(Serialized_entry) > buf.size()))
+          buf.resize(buf.size() + (buf.size() - begin) / 2 + sizeof(Serialized_entry));
+        new (&buf[pos]) Serialized_entry{ent->first, ent->second, ent->timeout,
+                                         ent->proto, ent->state, ent->flags, ent->other};
+        pos += sizeof(Serialized_entry);
+        count++;
+      }
     }
-    // If not in set, add
-    if(to_serialize.find(ent) == to_serialize.end())
-      to_serialize.emplace(ent);
   }
-
-  // Serialize number of entries
-  size_t size = to_serialize.size();
-  const auto* size_ptr = reinterpret_cast<const char*>(&size);
-
-  const auto expected_buf_size = sizeof(size) + (size * (sizeof(Entry) - sizeof(Entry_handler)));
-  buf.reserve(expected_buf_size);
-
-  buf.insert(buf.end(), size_ptr, size_ptr + sizeof(size));
-  // Serialize each entry
-  for(auto& ent : to_serialize)
-    ent->serialize_to(buf);
+  buf.resize(pos);
+  new (&buf[begin]) Serialized_header{Serialized_header::MAGIC,
+                                      sizeof(Serialized_entry), count};
 
   if(unserialized > 0)
     INFO("Conntrack", "%i entries not serialized\n", unserialized);
@@ -14,6 +14,7 @@
 #include <net/dhcp/message.hpp>
 #include <cstdlib>
 #include <debug>
+#include <rtc>
 
 namespace net {
 
@@ -22,7 +23,8 @@ namespace net {
   DHClient::DHClient(Stack& inet)
     : stack(inet),
       domain_name{},
-      timeout_timer_{{this, &DHClient::restart_negotation}}
+      timeout_timer_{{this, &DHClient::restart_negotation}},
+      renew_timer_{{this, &DHClient::renew}}
   {
     // default timed out handler spams logs
     this->on_config(
@@ -148,6 +150,11 @@ namespace net {
       option::DOMAIN_NAME_SERVERS,
       option::DOMAIN_NAME
     });
+
+    // An ACK straight away, if the server will
+    if (rapid_commit_)
+      msg.add_option<option::rapid_commit>();
+
     // END
     msg.end();
 
@@ -176,21 +183,43 @@ namespace net {
     // silently ignore transactions not our own
     if (msg.xid() != this->xid) return;
 
-    //const dhcp_option_t* server_id {nullptr};
-
     // check if the BOOTP message is a DHCP OFFER
     const auto* msg_opt = msg.find_option<option::message_type>();
-    if(msg_opt != nullptr)
-    {
-      // ignore when not a DHCP Offer
-      if (UNLIKELY(msg_opt->type() != message_type::OFFER)) return;
+    if(msg_opt == nullptr) return;
 
-      // verify that the type is indeed DHCPOFFER
-      PRINT("Got DHCP message type OFFER (%d)\n",
-            static_cast<uint8_t>(msg_opt->type()));
+    // or an ACK to our asking for Rapid Commit
+    const bool rapid = rapid_commit_
+      and msg_opt->type() == message_type::ACK
+      and msg.find_option<option::rapid_commit>() != nullptr;
+
+    // ignore when not a DHCP Offer
+    if (UNLIKELY(msg_opt->type() != message_type::OFFER and not rapid)) return;
+
+    PRINT("Got DHCP message type %d\n", static_cast<uint8_t>(msg_opt->type()));
+
+    if (not read_config(data)) return;
+
+    // Preserve DHCP server address
+    const auto* server_id = msg.find_option<option::server_identifier>();
+
+    if (rapid)
+    {
+      PRINT("Server committed rapidly\n");
+      bind(server_id ? *(server_id->addr<ip4::Addr>()) : this->router, this->lease_time);
+      return;
     }
-    // ignore message when DHCP message type is missing
-    else return;
+
+    // Remove any existing IP config to be able to receive on broadcast
+    stack.reset_config();
+
+    this->progress++;
+    // we can accept the offer now by requesting the IP!
+    this->request(server_id);
+  }
+
+  bool DHClient::read_config(const char* data)
+  {
+    const Message_reader msg{reinterpret_cast<const uint8_t*>(data)};
 
     // the offered IP address:
     this->ipaddr = msg.yiaddr();
@@ -209,7 +238,6 @@ namespace net {
       this->lease_time = lease_opt->secs();
     }
 
-    // Preserve DHCP server address
     const auto* server_id = msg.find_option<option::server_identifier>();
 
     // now validate the offer, checking for minimum information
@@ -226,7 +254,7 @@ namespace net {
         this->router = *(server_id->addr<ip4::Addr>());
 
       // silently ignore when both ROUTER and SERVER_ID is missing
-      else return;
+      else return false;
     }
 
     // domain name servers
@@ -251,13 +279,7 @@ namespace net {
       }
       //printf("Found Domain name option: %s\n", dn_opt->name().c_str());
     }
-
-    // Remove any existing IP config to be able to receive on broadcast
-    stack.reset_config();
-
-    this->progress++;
-    // we can accept the offer now by requesting the IP!
-    this->request(server_id);
+    return true;
   }
 
   void DHClient::request(const option::server_identifier* server_id)
@@ -343,12 +365,32 @@ namespace net {
     else return;
 
     PRINT("Server acknowledged our request!\n");
+
+    // the lease time may have changed since the offer
+    const auto* lease_opt = msg.find_option<option::lease_time>();
+    if (lease_opt != nullptr)
+      this->lease_time = lease_opt->secs();
+
+    const auto* server_id = msg.find_option<option::server_identifier>();
+    bind(server_id ? *(server_id->addr<ip4::Addr>()) : this->router, this->lease_time);
+  }
+
+  void DHClient::bind(ip4::Addr server, uint32_t lease_secs)
+  {
     PRINT("IP ADDRESS: \t%s\n", this->ipaddr.str().c_str());
     PRINT("SUBNET MASK: \t%s\n", this->netmask.str().c_str());
-    PRINT("LEASE TIME: \t%u mins\n", this->lease_time / 60);
+    PRINT("LEASE TIME: \t%u mins\n", lease_secs / 60);
     PRINT("GATEWAY: \t%s\n", this->router.str().c_str());
     PRINT("DNS SERVER: \t%s\n", this->dns_server.str().c_str());
 
+    lease_.addr       = this->ipaddr;
+    lease_.netmask    = this->netmask;
+    lease_.router     = this->router;
+    lease_.dns_server = this->dns_server;
+    lease_.server     = server;
+    lease_.lease_time = lease_secs;
+    lease_.obtained   = RTC::now();
+
     // configure our network stack
     stack.network_config(this->ipaddr, this->netmask,
                          this->router, this->dns_server);
@@ -357,8 +399,136 @@ namespace net {
       PRINT("DOMAIN NAME: \t%s\n", this->domain_name.c_str());
       stack.set_domain_name(domain_name);
     }
+    start_renew_timer();
     // did not time out!
     end_negotiation(false);
   }
 
+  void DHClient::resume(const Lease& lease, std::chrono::seconds timeout)
+  {
+    this->timeout = timeout;
+    if (not lease.valid(RTC::now()))
+    {
+      negotiate(timeout);
+      return;
+    }
+
+    PRINT("Resuming lease of %s from %s\n",
+          lease.addr.str().c_str(), lease.server.str().c_str());
+    lease_ = lease;
+    stack.network_config(lease.addr, lease.netmask, lease.router, lease.dns_server);
+    for(auto& handler : this->config_handlers_)
+        handler(false);
+
+    // make sure the server still agrees, in the background
+    renew();
+  }
+
+  void DHClient::start_renew_timer()
+  {
+    if (lease_.lease_time == Lease::INFINITE)
+      return;
+
+    const int64_t left = lease_.expires() - RTC::now();
+    if (left <= 0)
+    {
+      lease_lost();
+      return;
+    }
+    // half of what is left, or the rest when it's down to a minute
+    const int64_t wait = (left > 120) ? left / 2 : left;
+    renew_timer_.restart(std::chrono::seconds(wait));
+  }
+
+  void DHClient::renew()
+  {
+    if (not lease_.valid(RTC::now()))
+    {
+      lease_lost();
+      return;
+    }
+    send_renew();
+    // try again later, unless answered before
+    start_renew_timer();
+  }
+
+  void DHClient::send_renew()
+  {
+    // RENEWING: from our address, unicast to the server
+    this->renew_xid_  = (rand() & 0xffff);
+    this->renew_xid_ |= (rand() & 0xffff) << 16;
+
+    uint8_t buffer[Message::size()];
+    Message_writer msg{&buffer[0], op_code::BOOTREQUEST, message_type::REQUEST};
+    msg.set_hw_addr(htype::ETHER, sizeof(MAC::Addr)); // eth dependency
+    msg.set_xid(this->renew_xid_);
+    msg.set_ciaddr(lease_.addr);
+
+    MAC::Addr link_addr = stack.link_addr();
+    msg.set_chaddr(&link_addr);
+
+    // DHCP client identifier
+    msg.add_option<option::client_identifier>(htype::ETHER, &link_addr);
+    // END
+    msg.end();
+
+    if (renew_socket_ == nullptr)
+    {
+      renew_socket_ = &stack.udp().bind(DHCP_CLIENT_PORT);
+      renew_socket_->on_read(
+      [this] (net::Addr, UDP::port_t port, const char* data, size_t len)
+      {
+        if (port == DHCP_SERVER_PORT)
+          this->renew_reply(data, len);
+      });
+    }
+    renew_socket_->sendto(lease_.server, DHCP_SERVER_PORT, buffer, sizeof(buffer));
+  }
+
+  void DHClient::renew_reply(const char* data, size_t)
+  {
+    const Message_reader msg{reinterpret_cast<const uint8_t*>(data)};
+
+    // silently ignore transactions not our own
+    if (msg.xid() != this->renew_xid_) return;
+
+    const auto* msg_opt = msg.find_option<option::message_type>();
+    if (msg_opt == nullptr) return;
+
+    if (msg_opt->type() == message_type::NAK)
+    {
+      MYINFO("Lease refused by server (%s)", this->stack.ifname().c_str());
+      lease_lost();
+      return;
+    }
+    if (msg_opt->type() != message_type::ACK) return;
+
+    PRINT("Lease renewed\n");
+    const auto* lease_opt = msg.find_option<option::lease_time>();
+    if (lease_opt != nullptr)
+      lease_.lease_time = lease_opt->secs();
+    lease_.obtained = RTC::now();
+
+    this->renew_xid_ = 0;
+    renew_socket_->close();
+    renew_socket_ = nullptr;
+    start_renew_timer();
+  }
+
+  void DHClient::lease_lost()
+  {
+    renew_timer_.stop();
+    this->renew_xid_ = 0;
+    if (renew_socket_ != nullptr)
+    {
+      renew_socket_->close();
+      renew_socket_ = nullptr;
+    }
+    lease_ = {};
+
+    // start over
+    stack.reset_config();
+    negotiate(std::chrono::duration_cast<std::chrono::seconds>(this->timeout));
+  }
+
 }
@@ -23,28 +23,75 @@ DHCPD::DHCPD(UDP& udp, ip4::Addr pool_start, ip4::Addr pool_end,
   init_pool();
 }
 
+void DHCPD::add_record(const Record& record) {
+  int ridx = get_record_idx(record.client_id());
+  if (ridx not_eq -1)
+    erase_record(ridx);
+  records_.push_back(record);
+  index_record(records_.size() - 1);
+}
+
 bool DHCPD::record_exists(const Record::byte_seq& client_id) const noexcept {
-  for (auto& rec : records_) {
-    if (rec.client_id() == client_id)
-      return true;
-  }
-  return false;
+  return get_record_idx(client_id) not_eq -1;
 }
 
 int DHCPD::get_record_idx(const Record::byte_seq& client_id) const noexcept {
-  for (size_t i = 0; i < records_.size(); i++) {
-    if (records_.at(i).client_id() == client_id)
-      return i;
-  }
-  return -1;
+  auto it = by_client_id_.find(id_key(client_id));
+  return (it != by_client_id_.end()) ? (int) it->second : -1;
 }
 
 int DHCPD::get_record_idx_from_ip(ip4::Addr ip) const noexcept {
-  for (size_t i = 0; i < records_.size(); i++) {
-    if (records_.at(i).ip() == ip)
-      return i;
+  auto it = by_ip_.find(ip.whole);
+  return (it != by_ip_.end()) ? (int) it->second : -1;
+}
+
+int DHCPD::get_record_idx_from_mac(const MAC::Addr& mac) const noexcept {
+  if (mac == MAC::EMPTY)
+    return -1;
+  auto it = by_mac_.find(mac_key(mac));
+  return (it != by_mac_.end()) ? (int) it->second : -1;
+}
+
+void DHCPD::index_record(size_t idx) {
+  const auto& rec = records_.at(idx);
+  by_client_id_[id_key(rec.client_id())] = idx;
+  if (rec.ip() not_eq ip4::Addr{0})
+    by_ip_[rec.ip().whole] = idx;
+  if (rec.hw_addr() not_eq MAC::EMPTY)
+    by_mac_[mac_key(rec.hw_addr())] = idx;
+}
+
+void DHCPD::erase_record(size_t idx) {
+  const auto& rec = records_.at(idx);
+  // only where the indexes point at this record
+  auto drop = [idx] (auto& index, const auto& key) {
+    auto it = index.find(key);
+    if (it != index.end() and it->second == idx)
+      index.erase(it);
+  };
+  drop(by_client_id_, id_key(rec.client_id()));
+  drop(by_ip_, rec.ip().whole);
+  drop(by_mac_, mac_key(rec.hw_addr()));
+
+  // the last record takes its place
+  const size_t last = records_.size() - 1;
+  if (idx not_eq last) {
+    records_[idx] = std::move(records_[last]);
+    index_record(idx);
   }
-  return -1;
+  records_.pop_back();
+}
+
+int DHCPD::find_record(const Message* msg) const {
+  int ridx = get_record_idx(get_client_id(msg));
+  if (ridx == -1 and msg->hlen == sizeof(MAC::Addr))
+    ridx = get_record_idx_from_mac(*reinterpret_cast<const MAC::Addr*>(&msg->chaddr));
+  return ridx;
+}
+
+Status DHCPD::status(ip4::Addr ip) const noexcept {
+  const int idx = pool_index(ip);
+  return (idx not_eq -1) ? pool_[idx] : Status::IN_USE;
 }
 
 bool DHCPD::valid_pool(ip4::Addr start, ip4::Addr end) const {
@@ -61,19 +108,43 @@ bool DHCPD::valid_pool(ip4::Addr start, ip4::Addr end) const {
 }
 
 void DHCPD::init_pool() {
-  ip4::Addr start = pool_start_;
-  while (start < pool_end_ and network_address(start) == network_address(server_id_)) {
-    pool_.emplace(std::make_pair(start, Status::AVAILABLE));
-    start = inc_addr(start);
-  }
-  // Including pool_end_ IP:
-  pool_.emplace(std::make_pair(pool_end_, Status::AVAILABLE));
+  // valid_pool() has made sure start and end are on the server's network
+  const size_t size = ntohl(pool_end_.whole) - ntohl(pool_start_.whole) + 1;
+  pool_.assign(size, Status::AVAILABLE);
+
+  free_words_.assign((size + MemBitmap::CHUNK_SIZE - 1) / MemBitmap::CHUNK_SIZE, 0);
+  free_.set_location(free_words_.data(), free_words_.size());
+  for (size_t i = 0; i < size; i++)
+    free_.set(i);
+}
+
+int DHCPD::pool_index(ip4::Addr ip) const noexcept {
+  const int64_t idx = int64_t(ntohl(ip.whole)) - int64_t(ntohl(pool_start_.whole));
+  return (idx >= 0 and idx < (int64_t) pool_.size()) ? idx : -1;
 }
 
 void DHCPD::update_pool(ip4::Addr ip, Status new_status) {
-  auto it = pool_.find(ip);
-  if (it not_eq pool_.end())
-    it->second = new_status;
+  const int idx = pool_index(ip);
+  if (idx == -1)
+    return;
+  pool_[idx] = new_status;
+  if (new_status == Status::AVAILABLE)
+    free_.set(idx);
+  else
+    free_.reset(idx);
+}
+
+ip4::Addr DHCPD::allocate(Status new_status) {
+  auto idx = free_.next_set(next_free_);
+  if (idx == -1)
+    idx = free_.next_set(0);
+  if (idx == -1)
+    return ip4::Addr{0};
+
+  next_free_ = idx + 1;
+  pool_[idx] = new_status;
+  free_.reset(idx);
+  return ip4::Addr{htonl(ntohl(pool_start_.whole) + idx)};
 }
 
 void DHCPD::listen() {
@@ -160,10 +231,10 @@ void DHCPD::resolve(const Message* msg) {
       // A client has discovered that the suggested network address is already in use.
       // The server must mark the network address as not available and should notify the network admin
       // of a possible configuration problem - TODO
-      ridx = get_record_idx(cid);
+      ridx = find_record(msg);
       // Erase record if exists because client hasn't got a valid IP
       if (ridx not_eq -1)
-        records_.erase(records_.begin() + ridx);
+        erase_record(ridx);
       update_pool(get_requested_ip_in_opts(msg), Status::IN_USE);    // In use - possible config problem
       return;
     case message_type::RELEASE:
@@ -176,7 +247,7 @@ void DHCPD::resolve(const Message* msg) {
       // in response to subsequent requests from the client
       ridx = get_record_idx_from_ip(msg->ciaddr);
       if (ridx not_eq -1)
-        records_.erase(records_.begin() + ridx);
+        erase_record(ridx);
       update_pool(msg->ciaddr, Status::AVAILABLE);
       break;
 
@@ -221,14 +292,14 @@ void DHCPD::handle_request(const Message* msg) {
 
       debug("Client hasn't chosen this server - returning\n");
 
-      int ridx = get_record_idx(get_client_id(msg));
+      int ridx = find_record(msg);
       if (ridx != -1) {
 
         debug("Freeing up record\n");
 
         // Free up the IP address - the client has declined our offer
         update_pool(records_.at(ridx).ip(), Status::AVAILABLE);
-        records_.erase(records_.begin() + ridx);
+        erase_record(ridx);
       }
       return;
     }
@@ -237,7 +308,7 @@ void DHCPD::handle_request(const Message* msg) {
 
     debug("Client has chosen this server\n");
 
-    int ridx = get_record_idx(get_client_id(msg));
+    int ridx = find_record(msg);
 
     if (ridx not_eq -1) { // A record for this client already exists
       auto& record = records_.at(ridx);
@@ -278,7 +349,7 @@ void DHCPD::handle_request(const Message* msg) {
 }
 
 void DHCPD::verify_or_extend_lease(const Message* msg) {
-  int ridx = get_record_idx(get_client_id(msg));
+  int ridx = find_record(msg);
 
   if (ridx == -1) {
     // If the server has no record of this client, then it MUST remain silent and MAY
@@ -304,7 +375,7 @@ void DHCPD::verify_or_extend_lease(const Message* msg) {
 
       // Updating pool and erasing record
       update_pool(records_.at(ridx).ip(), Status::AVAILABLE);
-      records_.erase(records_.begin() + ridx);
+      erase_record(ridx);
       nak(msg);
       return;
     }
@@ -354,55 +425,68 @@ void DHCPD::verify_or_extend_lease(const Message* msg) {
 }
 
 void DHCPD::offer(const Message* msg) {
-  // It may occur that the client doesn't get our offers and then we don't want to
-  // exhaust our pool
-  auto client_id = get_client_id(msg);
-  int ridx = get_record_idx(client_id);
-  if (ridx not_eq -1)
-    return;
+  const Message_reader reader{msg};
+  // RFC 4039: lease the address right away, answering with an ACK
+  const bool rapid = rapid_commit_
+    and reader.find_option<option::rapid_commit>() != nullptr;
 
-  // Search for available IP in pool
-  auto it = std::find_if(pool_.begin(), pool_.end(), [](const auto& entry)->bool {
-    return entry.second == Status::AVAILABLE;
-  });
+  // It may occur that the client doesn't get our offers and then we don't want to
+  // exhaust our pool: a client with a record is offered the same address again
+  int ridx = find_record(msg);
 
-  if(UNLIKELY(it == pool_.end()))
+  ip4::Addr free_addr;
+  if (ridx not_eq -1)
   {
-    debug("No more available IPs - clearing offered ips and sending nak\n");
+    free_addr = records_.at(ridx).ip();
+    if (rapid) {
+      records_.at(ridx).set_status(Status::IN_USE);
+      records_.at(ridx).set_lease_start(RTC::now());
+      update_pool(free_addr, Status::IN_USE);
+    }
+  }
+  else
+  {
+    // Take the next available IP in the pool
+    free_addr = allocate(rapid ? Status::IN_USE : Status::OFFERED);
 
-    // Clear offered ips that have not been confirmed - Maybe use pending value instead
-    clear_offered_ips();
-    nak(msg);   // Record has not been added to the records_ vector so OK
-    return;
+    if(UNLIKELY(free_addr == ip4::Addr{0}))
+    {
+      debug("No more available IPs - clearing offered ips and sending nak\n");
+
+      // Clear offered ips that have not been confirmed - Maybe use pending value instead
+      clear_offered_ips();
+      nak(msg);   // Record has not been added to the records_ vector so OK
+      return;
+    }
+    debug("Found available IP: %s\n", free_addr.to_string().c_str());
+
+    // If we want to offer this client an IP address: Create a RECORD
+    Record record;
+    // Keep client identifier (index into database)
+    record.set_client_id(get_client_id(msg));
+    if (msg->hlen == sizeof(MAC::Addr))
+      record.set_hw_addr(*reinterpret_cast<const MAC::Addr*>(&msg->chaddr));
+
+    // Servers need not reserve the offered network address, although the protocol will work more efficiently if the server
+    // avoids allocating the offered network address to another client.
+    // When allocating a new address, servers should check that the offered network address is not already in use; e.g.
+    // the server may probe the offered address with an ICMP Echo Request. Servers SHOULD be implemented so that
+    // network admins MAY choose to disable probes of newly allocated addresses.
+
+    // RECORD
+    record.set_ip(free_addr);
+    record.set_status(rapid ? Status::IN_USE : Status::OFFERED);
+    record.set_lease_start(RTC::now());
+    record.set_lease_duration(lease_);
+    add_record(record);
   }
 
-  const auto free_addr = it->first;
-  debug("Found available IP: %s\n", free_addr.to_string().c_str());
-  // mark the IP as offered
-  it->second = Status::OFFERED;
-
-  // If we want to offer this client an IP address: Create a RECORD
-  Record record;
-  // Keep client identifier (index into database)
-  record.set_client_id(client_id);
-
-  // Servers need not reserve the offered network address, although the protocol will work more efficiently if the server
-  // avoids allocating the offered network address to another client.
-  // When allocating a new address, servers should check that the offered network address is not already in use; e.g.
-  // the server may probe the offered address with an ICMP Echo Request. Servers SHOULD be implemented so that
-  // network admins MAY choose to disable probes of newly allocated addresses.
-
-  // RECORD
-  record.set_ip(free_addr);
-  record.set_status(Status::OFFERED);
-  record.set_lease_start(RTC::now());
-  record.set_lease_duration(lease_);
-
-  // OFFER
+  // OFFER, or ACK when committing rapidly
   // NOTE: It may be possible with some changes to use the incoming "msg" as buffer to avoid some extra copy
   // due to some of the fields are sent in return to the client
   char buffer[Message::size()];
-  Message_writer offer{reinterpret_cast<Message*>(buffer), op_code::BOOTREPLY, message_type::OFFER};
+  Message_writer offer{reinterpret_cast<Message*>(buffer), op_code::BOOTREPLY,
+    rapid ? message_type::ACK : message_type::OFFER};
 
   offer.set_hw_addr(htype::ETHER, sizeof(MAC::Addr)); // assume ethernet
   offer.set_xid(ntohl(msg->xid));
@@ -453,37 +537,16 @@ void DHCPD::offer(const Message* msg) {
   auto bcast = broadcast_address();
   offer.add_option<option::broadcast_address>(&bcast);
 
+  // RAPID_COMMIT (MUST in the ACK of a rapid commit)
+  if (rapid)
+    offer.add_option<option::rapid_commit>();
+
   // END
   offer.end();
 
-  // RECORD
-  add_record(record);
-
   debug("Sending offer\n");
 
-  // If the giaddr field in a DHCP message from a client is non-zero, the server sends any return
-  // messages to the DHCP server port on the BOOTP relay agent whose address appears in giaddr
-  if (msg->giaddr != ip4::Addr{0}) {
-    socket_.sendto(msg->giaddr, DHCP_SERVER_PORT, buffer, sizeof(buffer));
-    return;
-  }
-  // If the giaddr field is zero and the ciaddr field is non-zero, then the server unicasts
-  // DHCPOFFER and DHCPACK messages to the address in ciaddr
-  if (msg->ciaddr != ip4::Addr{0}) {
-    socket_.sendto(msg->ciaddr, DHCP_CLIENT_PORT, buffer, sizeof(buffer));
-    return;
-  }
-  // If giaddr is zero and ciaddr is zero, and the broadcast bit (leftmost bit in flags field) is set,
-  // then the server broadcasts DHCPOFFER and DHCPACK messsages to 0xffffffff
-  if (ntohs(msg->flags) & static_cast<uint16_t>(flag::BOOTP_BROADCAST)) {
-    socket_.bcast(server_id_, DHCP_CLIENT_PORT, buffer, sizeof(buffer));
-    return;
-  }
-  // If the broadcast bit is not set and giaddr is zero and ciaddr is zero, then the server unicasts
-  // DHCPOFFER and DHCPACK messages to the client's hardware address and yiaddr address
-  socket_.sendto(msg->yiaddr, DHCP_CLIENT_PORT, buffer, sizeof(buffer));
-  // TODO: Send the message to the client's hardware address:
-  // socket_.sendto(, DHCP_CLIENT_PORT, packet, PACKET_SIZE);
+  send_reply(msg, buffer, sizeof(buffer));
 }
 
 void DHCPD::inform_ack(const Message* msg) {
@@ -538,7 +601,7 @@ void DHCPD::request_ack(const Message* msg) {
   ack.set_hw_addr(htype::ETHER, sizeof(MAC::Addr)); // assume ethernet
   ack.set_xid(ntohl(msg->xid));
 
-  int ridx = get_record_idx(get_client_id(msg));
+  int ridx = find_record(msg);
   ack.set_yiaddr((ridx not_eq -1) ? records_.at(ridx).ip() : 0); // TODO: else what?     // IP address assigned to client
   ack.set_ciaddr(msg->ciaddr); // or 0
   ack.set_giaddr(msg->giaddr);
@@ -567,27 +630,31 @@ void DHCPD::request_ack(const Message* msg) {
 
   debug("Sending request ack\n");
 
+  send_reply(msg, buffer, sizeof(buffer));
+}
+
+void DHCPD::send_reply(const Message* msg, const char* buffer, size_t len) {
   // If the giaddr field in a DHCP message from a client is non-zero, the server sends any return
   // messages to the DHCP server port on the BOOTP relay agent whose address appears in giaddr
   if (msg->giaddr != ip4::Addr{0}) {
-    socket_.sendto(msg->giaddr, DHCP_SERVER_PORT, buffer, sizeof(buffer));
+    socket_.sendto(msg->giaddr, DHCP_SERVER_PORT, buffer, len);
     return;
   }
   // If the giaddr field is zero and the ciaddr field is non-zero, then the server unicasts
   // DHCPOFFER and DHCPACK messages to the address in ciaddr
   if (msg->ciaddr != ip4::Addr{0}) {
-    socket_.sendto(msg->ciaddr, DHCP_CLIENT_PORT, buffer, sizeof(buffer));
+    socket_.sendto(msg->ciaddr, DHCP_CLIENT_PORT, buffer, len);
     return;
   }
   // If giaddr is zero and ciaddr is zero, and the broadcast bit (leftmost bit in flags field) is set,
   // then the server broadcasts DHCPOFFER and DHCPACK messsages to 0xffffffff
   if (ntohs(msg->flags) & static_cast<uint16_t>(flag::BOOTP_BROADCAST)) {
-    socket_.bcast(server_id_, DHCP_CLIENT_PORT, buffer, sizeof(buffer));
+    socket_.bcast(server_id_, DHCP_CLIENT_PORT, buffer, len);
     return;
   }
   // If the broadcast bit is not set and giaddr is zero and ciaddr is zero, then the server unicasts
   // DHCPOFFER and DHCPACK messages to the client's hardware address and yiaddr address
-  socket_.sendto(msg->yiaddr, DHCP_CLIENT_PORT, buffer, sizeof(buffer));
+  socket_.sendto(msg->yiaddr, DHCP_CLIENT_PORT, buffer, len);
   // TODO: Send the message to the client's hardware address:
   // socket_.sendto(, DHCP_CLIENT_PORT, packet, PACKET_SIZE);
 }
@@ -684,25 +751,23 @@ bool DHCPD::on_correct_network(const Message* msg) const {
 void DHCPD::clear_offered_ip(ip4::Addr ip) {
   int ridx = get_record_idx_from_ip(ip);
   if (ridx not_eq -1)
-    records_.erase(records_.begin() + ridx);
+    erase_record(ridx);
   update_pool(ip, Status::AVAILABLE);
 }
 
 void DHCPD::clear_offered_ips() {
   // looping through pool
-  for (auto& entry : pool_) {
-    if (entry.second == Status::OFFERED)
-      entry.second = Status::AVAILABLE;
+  for (size_t i = 0; i < pool_.size(); i++) {
+    if (pool_[i] == Status::OFFERED) {
+      pool_[i] = Status::AVAILABLE;
+      free_.set(i);
+    }
   }
 
-  // and records
-  for (size_t i = 0; i < records_.size(); i++) {
-    if (records_.at(i).status() == Status::OFFERED) {
-      // Update pool
-      // update_pool(records_.at(i).ip(), Status::AVAILABLE);
-      // And erase record
-      records_.erase(records_.begin() + i);
-    }
+  // and records, from the back as the last one fills an erased one's place
+  for (size_t i = records_.size(); i-- > 0;) {
+    if (records_.at(i).status() == Status::OFFERED)
+      erase_record(i);
   }
 }
 
@@ -0,0 +1,121 @@
+#include <net/dns/cache.hpp>
+
+namespace net::dns {
+
+  Cache::Entry* Cache::lookup(const Hostname& hostname, timestamp_t now)
+  {
+    auto it = index_.find(hostname);
+    if (it == index_.end())
+      return nullptr;
+
+    auto node = it->second;
+    if (node->second.expires <= now)
+    {
+      lru_.erase(node);
+      index_.erase(it);
+      return nullptr;
+    }
+
+    lru_.splice(lru_.begin(), lru_, node);
+    node->second.hits++;
+    return &node->second;
+  }
+
+  void Cache::insert(const Hostname& hostname, Address addr, uint32_t ttl, timestamp_t now)
+  {
+    store(hostname, Entry{std::move(addr), now + ttl, ttl});
+  }
+
+  void Cache::insert_negative(const Hostname& hostname, uint32_t ttl, timestamp_t now)
+  {
+    Entry entry{Address{}, now + ttl, ttl};
+    entry.negative = true;
+    store(hostname, std::move(entry));
+  }
+
+  void Cache::store(const Hostname& hostname, Entry entry)
+  {
+    if (entry.ttl == 0 or capacity_ == 0)
+    {
+      erase(hostname);
+      return;
+    }
+
+    auto it = index_.find(hostname);
+    if (it != index_.end())
+    {
+      it->second->second = std::move(entry);
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return;
+    }
+
+    if (index_.size() >= capacity_)
+    {
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+
+    lru_.emplace_front(hostname, std::move(entry));
+    index_.emplace(hostname, lru_.begin());
+  }
+
+  bool Cache::prefetch_due(Entry& entry, timestamp_t now) const noexcept
+  {
+    if (entry.negative or entry.prefetching or entry.hits < PREFETCH_HITS)
+      return false;
+
+    if (entry.ttl_left(now) > entry.ttl / PREFETCH_DIVISOR)
+      return false;
+
+    entry.prefetching = true;
+    return true;
+  }
+
+  bool Cache::erase(const Hostname& hostname)
+  {
+    auto it = index_.find(hostname);
+    if (it == index_.end())
+      return false;
+
+    lru_.erase(it->second);
+    index_.erase(it);
+    return true;
+  }
+
+  size_t Cache::expire(timestamp_t now)
+  {
+    size_t removed = 0;
+    for (auto it = lru_.begin(); it != lru_.end();)
+    {
+      if (it->second.expires > now) {
+        it++;
+        continue;
+      }
+      index_.erase(it->first);
+      it = lru_.erase(it);
+      removed++;
+    }
+    return removed;
+  }
+
+  void Cache::set_capacity(size_t capacity)
+  {
+    capacity_ = capacity;
+    shrink(capacity_);
+  }
+
+  size_t Cache::shrink(size_t keep)
+  {
+    size_t removed = 0;
+    while (index_.size() > keep)
+    {
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+      removed++;
+    }
+    // the buckets aren't given back by erasing
+    if (removed > 0) index_.rehash(0);
+    return removed;
+  }
+
+}
@@ -1,9 +1,14 @@
 
 #include <net/dns/client.hpp>
+#include <util/pmr_pools.hpp>
 #include <net/inet>
+#include <rtc>
 
 namespace net::dns
 {
+  static uint64_t now_ms()
+  { return RTC::nanos_now() / 1'000'000; }
+
 #ifdef LIBFUZZER_ENABLED
   Timer::duration_t Client::DEFAULT_RESOLVE_TIMEOUT{std::chrono::seconds(9999)};
   uint16_t g_last_xid = 0;
@@ -11,52 +16,124 @@ namespace net::dns
   Timer::duration_t Client::DEFAULT_RESOLVE_TIMEOUT{std::chrono::seconds(5)};
 #endif
   Timer::duration_t Client::DEFAULT_FLUSH_INTERVAL{std::chrono::seconds(30)};
-  std::chrono::seconds Client::DEFAULT_CACHE_TTL{std::chrono::seconds(60)};
+  std::chrono::seconds Client::DEFAULT_CACHE_TTL{std::chrono::hours(1)};
+  std::chrono::seconds Client::DEFAULT_NEGATIVE_TTL{std::chrono::seconds(60)};
 
   Client::Client(Stack& stack)
     : stack_{stack},
       cache_ttl_{DEFAULT_CACHE_TTL},
-      flush_timer_{{this, &Client::flush_expired}}
+      flush_timer_{{this, &Client::flush_expired}},
+      mem_{os::mem::cpu_pool(os::mem::Pool_id::dns).get_resource()},
+      requests_{mem_ ? mem_.get() : std::pmr::get_default_resource()},
+      shrinker_{os::mem::add_shrinker("dns.cache", os::mem::Shrink_cost::cheap,
+                                      {this, &Client::shrink_cache})}
   {
   }
 
+  Client::~Client()
+  {
+    os::mem::remove_shrinker(shrinker_);
+  }
+
   void Client::resolve(Address dns_server,
                        Hostname hostname,
                        Resolve_handler func,
                        Timer::duration_t timeout, bool force)
+  {
+    lookup({dns_server}, std::move(hostname), std::move(func), timeout, force);
+  }
+
+  void Client::resolve(Hostname hostname,
+                       Resolve_handler func,
+                       Timer::duration_t timeout, bool force)
+  {
+    Expects(not nameservers_.empty());
+    lookup(nameservers_.ordered(), std::move(hostname), std::move(func), timeout, force);
+  }
+
+  void Client::lookup(Servers servers,
+                      Hostname hostname,
+                      Resolve_handler func,
+                      Timer::duration_t timeout, bool force)
   {
     Expects(not hostname.empty());
+    Expects(not servers.empty());
+    const bool v6 = servers.front().is_v6();
     if(not is_FQDN(hostname) and not stack_.domain_name().empty())
     {
       hostname.append(".").append(stack_.domain_name());
     }
-    if(not force)
+    if(not force and cache_ttl_ > std::chrono::seconds::zero())
     {
-      auto it = cache_.find(hostname);
-      if(it != cache_.end())
+      const auto now = timestamp();
+      auto* entry = cache_.lookup(hostname, now);
+      // the address must be of the kind asked for
+      if(entry != nullptr
+        and (entry->negative or entry->address.is_v6() == v6))
       {
-        Error err;
-        func(nullptr, err); // fix
+        auto res = std::make_unique<dns::Response>();
+        if(entry->negative)
+          res->rcode = Response_code::NAME_ERROR;
+        else
+          res->answers.emplace_back(hostname, entry->address, entry->ttl_left(now));
+
+        // refresh it before it expires, while answering from the cache
+        if(cache_.prefetch_due(*entry, now) and pending_.count(hostname) == 0)
+          query(servers, hostname, nullptr, timeout);
+
+        func(std::move(res), {});
         return;
       }
     }
+    query(std::move(servers), std::move(hostname), std::move(func), timeout);
+  }
+
+  void Client::query(Servers servers, Hostname hostname,
+                     Resolve_handler func, Timer::duration_t timeout)
+  {
+    const bool v6  = servers.front().is_v6();
+    const auto rtype = (v6 ? Record_type::AAAA : Record_type::A);
+
+    // wait for the answer to the query already sent
+    auto pending = pending_.find(hostname);
+    if(pending != pending_.end())
+    {
+      auto& req = requests_.at(pending->second);
+      if(req.query.rtype == rtype)
+      {
+        if(func)
+          req.callbacks.push_back(std::move(func));
+        return;
+      }
+    }
+
     // Make sure we actually can bind to a socket
-    auto& socket = (dns_server.is_v6()) ? stack_.udp().bind6() : stack_.udp().bind();
+    auto& socket = (v6) ? stack_.udp().bind6() : stack_.udp().bind();
 
     // Create our query
-    Query query{std::move(hostname), (dns_server.is_v6() ? Record_type::AAAA : Record_type::A)};
+    Query query{std::move(hostname), rtype};
 #ifdef LIBFUZZER_ENABLED
     g_last_xid = query.id;
 #endif
 
     // store the request for later match
-    auto emp = requests_.emplace(std::piecewise_construct,
-      std::forward_as_tuple(query.id),
-      std::forward_as_tuple(*this, socket, std::move(query), std::move(func)));
+    std::pair<Requests::iterator, bool> emp;
+    try {
+      emp = requests_.emplace(std::piecewise_construct,
+        std::forward_as_tuple(query.id),
+        std::forward_as_tuple(*this, socket, std::move(query), std::move(func)));
+    }
+    catch (const std::bad_alloc&) {
+      // over the quota of the DNS pool
+      socket.close();
+      if (func) func(nullptr, {Error::Type::general_IO, "Too many DNS requests"});
+      return;
+    }
 
     Ensures(emp.second && "Unable to insert");
     auto& req = emp.first->second;
-    req.resolve(dns_server, timeout);
+    pending_.insert_or_assign(req.query.hostname, req.query.id);
+    req.resolve(std::move(servers), timeout);
   }
 
   Client::Request::Request(Client& cli, udp::Socket& sock,
@@ -65,24 +142,47 @@ namespace net::dns
       query{std::move(q)},
       response{nullptr},
       socket{sock},
-      callback{std::move(cb)},
-      timer({this, &Request::timeout})
+      timer({this, &Request::timeout}),
+      hedge_timer({this, &Request::send_next})
   {
+    if(cb)
+      callbacks.push_back(std::move(cb));
     socket.on_read({this, &Client::Request::parse_response});
   }
 
-  void Client::Request::resolve(net::Addr server, Timer::duration_t timeout)
+  void Client::Request::resolve(Servers srvs, Timer::duration_t timeout)
+  {
+    Expects(not srvs.empty());
+    servers = std::move(srvs);
+    sent.reserve(servers.size());
+
+    timer.start(timeout);
+    send_next();
+  }
+
+  void Client::Request::send_next()
   {
+    if(sent.size() >= servers.size())
+      return;
+
+    const auto& server = servers[sent.size()];
+    sent.push_back(now_ms());
+
     std::array<char, 256> buf;
     size_t len = query.write(buf.data());
 
     socket.sendto(server, dns::SERVICE_PORT, buf.data(), len, nullptr,
       {this, &Client::Request::handle_error});
 
-    timer.start(timeout);
+    // ask the next one too if this one is slow
+    if(sent.size() < servers.size())
+    {
+      hedge_timer.restart(std::chrono::milliseconds(
+        client.nameservers_.hedge_delay(server)));
+    }
   }
 
-  void Client::Request::parse_response(Addr, UDP::port_t, const char* data, size_t len)
+  void Client::Request::parse_response(Addr from, UDP::port_t, const char* data, size_t len)
   {
     if(UNLIKELY(len < sizeof(dns::Header)))
       return;
@@ -92,17 +192,38 @@ namespace net::dns
     // this is a response to our query
     if(query.id == ntohs(reply.id))
     {
+      // from one of the servers asked, once
+      size_t idx = 0;
+      while(idx < sent.size() and servers[idx] != from)
+        idx++;
+      if(UNLIKELY(idx == sent.size() or sent[idx] == 0))
+        return;
+
+      client.nameservers_.answered(from, now_ms() - sent[idx]);
+      sent[idx] = 0;
+
       auto res = std::make_unique<dns::Response>();
       // TODO: Validate
       res->parse(data, len);
 
+      // a server failing is no answer, while others may give one
+      if(res->rcode != Response_code::NO_ERROR
+        and res->rcode != Response_code::NAME_ERROR)
+      {
+        failed++;
+        if(sent.size() < servers.size())
+        {
+          send_next();
+          return;
+        }
+        if(failed < sent.size())
+          return;
+      }
+
       this->response = std::move(res);
 
-      // TODO: Cache
-      /*if(client.cache_ttl_ > std::chrono::seconds::zero())
-      {
-        add_cache_entry(...);
-      }*/
+      if(client.cache_ttl_ > std::chrono::seconds::zero())
+        client.add_cache_entry(query.hostname, *response);
 
       finish({});
     }
@@ -115,7 +236,18 @@ namespace net::dns
 
   void Client::Request::finish(const Error& err)
   {
-    callback(std::move(response), err);
+    // lookups from here on send a query of their own
+    auto pending = client.pending_.find(query.hostname);
+    if(pending != client.pending_.end() and pending->second == query.id)
+      client.pending_.erase(pending);
+
+    for(size_t i = 0; i < callbacks.size(); i++)
+    {
+      // each gets a copy of the response, the last one the original
+      auto res = (i + 1 < callbacks.size() and response != nullptr)
+        ? std::make_unique<dns::Response>(*response) : std::move(response);
+      callbacks[i](std::move(res), err);
+    }
 
     auto erased = client.requests_.erase(query.id);
     Ensures(erased == 1);
@@ -123,6 +255,11 @@ namespace net::dns
 
   void Client::Request::timeout()
   {
+    for(size_t i = 0; i < sent.size(); i++)
+    {
+      if(sent[i] != 0)
+        client.nameservers_.timed_out(servers[i]);
+    }
     finish({Error::Type::timeout, "Request timed out"});
   }
 
@@ -144,31 +281,53 @@ namespace net::dns
     flush_timer_.stop();
   }
 
-  void Client::add_cache_entry(const Hostname& hostname, Address addr, std::chrono::seconds ttl)
+  void Client::add_cache_entry(const Hostname& hostname, const dns::Response& res)
   {
-    // cache the address
-    cache_.emplace(std::piecewise_construct,
-      std::forward_as_tuple(hostname),
-      std::forward_as_tuple(addr, timestamp() + ttl.count()));
+    const uint32_t max_ttl = cache_ttl_.count();
 
-    debug("<DNSClient> Cache entry added: [%s] %s (%lld)\n",
-      hostname.c_str(), addr.to_string().c_str(), ttl.count());
+    if(res.rcode == Response_code::NAME_ERROR)
+    {
+      auto ttl = res.negative_ttl();
+      if(ttl == 0)
+        ttl = DEFAULT_NEGATIVE_TTL.count();
+      cache_.insert_negative(hostname, std::min(ttl, max_ttl), timestamp());
+
+      debug("<DNSClient> Negative cache entry added: [%s] (%u)\n",
+        hostname.c_str(), std::min(ttl, max_ttl));
+    }
+    else if(res.rcode == Response_code::NO_ERROR and res.has_addr())
+    {
+      const auto ttl = std::min(res.addr_ttl(), max_ttl);
+      cache_.insert(hostname, res.get_first_addr(), ttl, timestamp());
+
+      debug("<DNSClient> Cache entry added: [%s] %s (%u)\n",
+        hostname.c_str(), res.get_first_addr().to_string().c_str(), ttl);
+    }
+    else
+    {
+      return;
+    }
 
     // start the timer if not already active
     if(not flush_timer_.is_running())
       flush_timer_.start(DEFAULT_FLUSH_INTERVAL);
   }
 
+  size_t Client::shrink_cache(os::mem::Pressure level)
+  {
+    // roughly what an entry costs, with its node and bucket
+    static constexpr size_t ENTRY_SIZE = 128;
+    size_t removed = cache_.expire(timestamp());
+    if (level == os::mem::Pressure::critical)
+      removed += cache_.shrink(0);
+    else
+      removed += cache_.shrink(cache_.size() / 2);
+    return removed * ENTRY_SIZE;
+  }
+
   void Client::flush_expired()
   {
-    const auto now = timestamp();
-    for(auto it = cache_.begin(); it != cache_.end();)
-    {
-      if(it->second.expires > now)
-        it++;
-      else
-        it = cache_.erase(it);
-    }
+    cache_.expire(timestamp());
 
     if(not cache_.empty())
       flush_timer_.start(DEFAULT_FLUSH_INTERVAL);
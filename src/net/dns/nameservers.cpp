@@ -0,0 +1,71 @@
+#include <net/dns/nameservers.hpp>
+#include <algorithm>
+
+namespace net::dns {
+
+  void Nameservers::set(const std::vector<Address>& servers)
+  {
+    servers_.clear();
+    for (const auto& addr : servers)
+    {
+      if (find(addr) == nullptr)
+        servers_.push_back({addr, INITIAL_RTT});
+    }
+  }
+
+  std::vector<Nameservers::Address> Nameservers::ordered() const
+  {
+    std::vector<const Server*> order;
+    if (servers_.empty())
+      return {};
+    for (const auto& srv : servers_)
+    {
+      if (srv.addr.is_v6() == servers_.front().addr.is_v6())
+        order.push_back(&srv);
+    }
+    // ties keep the order they were set in
+    std::stable_sort(order.begin(), order.end(),
+      [] (const Server* a, const Server* b) { return a->srtt < b->srtt; });
+
+    std::vector<Address> addrs;
+    addrs.reserve(order.size());
+    for (const auto* srv : order)
+      addrs.push_back(srv->addr);
+    return addrs;
+  }
+
+  void Nameservers::answered(const Address& server, uint32_t rtt)
+  {
+    auto* srv = find(server);
+    if (srv == nullptr)
+      return;
+    rtt = std::min(rtt, MAX_RTT);
+    // as TCP smooths its RTT (RFC 6298), alpha = 1/8
+    srv->srtt = srv->srtt - srv->srtt / 8 + rtt / 8;
+  }
+
+  void Nameservers::timed_out(const Address& server)
+  {
+    auto* srv = find(server);
+    if (srv != nullptr)
+      srv->srtt = std::min(std::max(srv->srtt, MIN_HEDGE) * 2, MAX_RTT);
+  }
+
+  uint32_t Nameservers::hedge_delay(const Address& server) const
+  {
+    const auto* srv = find(server);
+    const uint32_t srtt = (srv != nullptr) ? srv->srtt : INITIAL_RTT;
+    return std::clamp(srtt * 2, MIN_HEDGE, std::max(max_hedge_, MIN_HEDGE));
+  }
+
+  Nameservers::Server* Nameservers::find(const Address& addr)
+  {
+    for (auto& srv : servers_)
+    {
+      if (srv.addr == addr)
+        return &srv;
+    }
+    return nullptr;
+  }
+
+}
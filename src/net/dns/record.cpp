@@ -3,6 +3,23 @@
 
 namespace net::dns {
 
+  Record::Record(std::string nm, const net::Addr& addr, uint32_t tl)
+    : name{std::move(nm)}, rclass{Class::INET}, ttl{tl}
+  {
+    if(addr.is_v4())
+    {
+      const auto ip4 = addr.v4();
+      rtype = Record_type::A;
+      rdata.assign((const char*) &ip4, sizeof(ip4));
+    }
+    else
+    {
+      rtype = Record_type::AAAA;
+      rdata.assign((const char*) &addr.v6(), sizeof(ip6::Addr));
+    }
+    data_len = rdata.size();
+  }
+
   int Record::parse(const char* reader, const char* buffer, size_t len)
   {
     // don't call parse_name if we are already out of buffer
@@ -43,12 +43,34 @@ namespace net::dns {
     return false;
   }
 
+  uint32_t Response::addr_ttl() const
+  {
+    uint32_t ttl = 0;
+    for(auto& rec : answers)
+    {
+      if(rec.is_addr() and (ttl == 0 or rec.ttl < ttl))
+        ttl = rec.ttl;
+    }
+    return ttl;
+  }
+
+  uint32_t Response::negative_ttl() const
+  {
+    for(auto& rec : auth)
+    {
+      if(rec.rtype == Record_type::SOA)
+        return rec.ttl;
+    }
+    return 0;
+  }
+
   // TODO: Verify
   int Response::parse(const char* buffer, size_t len)
   {
     Expects(len >= sizeof(Header));
 
     const auto& hdr = *(const Header*) buffer;
+    rcode = static_cast<Response_code>(hdr.rcode);
 
     // move ahead of the dns header and the query field
     const char* reader = (char*)buffer + sizeof(Header);
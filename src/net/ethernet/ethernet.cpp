@@ -9,6 +9,7 @@
 #include <net/util.hpp>
 #include <net/ethernet/ethernet.hpp>
 #include <statman>
+#include <kernel/trace.hpp>
 
 #ifdef ntohs
 #undef ntohs
@@ -29,10 +30,10 @@ namespace net {
         const addr& mac) noexcept
   : mac_(mac),
     ethernet_idx(eth_name_idx++),
-    packets_rx_{Statman::get().create(Stat::UINT64,
-                link_name() + ".ethernet.packets_rx").get_uint64()},
-    packets_tx_{Statman::get().create(Stat::UINT64,
-                link_name() + ".ethernet.packets_tx").get_uint64()},
+    packets_rx_{Statman::get().create_percpu(
+                link_name() + ".ethernet.packets_rx")},
+    packets_tx_{Statman::get().create_percpu(
+                link_name() + ".ethernet.packets_tx")},
     packets_dropped_{Statman::get().create(Stat::UINT32,
                 link_name() + ".ethernet.packets_dropped").get_uint32()},
     trailer_packets_dropped_{Statman::get().create(Stat::UINT32,
@@ -87,13 +88,34 @@ namespace net {
 
     } while (next);
 
+    TRACEPOINT(nic_tx, pckt->size(), (uintptr_t) this);
     physical_downstream_(std::move(pckt));
   }
 
 #ifdef ARP_PASSTHROUGH
   MAC::Addr linux_tap_device;
 #endif
-  void Ethernet::receive(Packet_ptr pckt) {
+  void Ethernet::receive(Packet_ptr chain) {
+    // IPv4 is handed up as a burst, in the order it arrived
+    Packet_chain ip4_unicast;
+    Packet_chain ip4_bcast;
+
+    while (chain != nullptr)
+    {
+      auto pckt = std::move(chain);
+      chain = pckt->detach_tail();
+      receive_one(std::move(pckt), ip4_unicast, ip4_bcast);
+    }
+
+    if (not ip4_unicast.empty())
+      ip4_upstream_(ip4_unicast.release(), false);
+    if (not ip4_bcast.empty())
+      ip4_upstream_(ip4_bcast.release(), true);
+  }
+
+  void Ethernet::receive_one(Packet_ptr pckt,
+                             Packet_chain& ip4_unicast, Packet_chain& ip4_bcast)
+  {
     Expects(pckt->size() > 0);
 
     header* eth = reinterpret_cast<header*>(pckt->layer_begin());
@@ -108,15 +130,32 @@ namespace net {
     // Stat increment packets received
     packets_rx_++;
 
+    // the NIC already took the tag off, so it's not parsed here
+    if (pckt->vlan_id() != 0) {
+      PRINT("VLAN frame (stripped)\n");
+      if (not Features::vlan or not vlan_upstream_)
+        packets_dropped_++;
+      else
+        vlan_upstream_(std::move(pckt));
+      return;
+    }
+
     switch(eth->type()) {
     case Ethertype::IP4:
       PRINT("IPv4 packet\n");
       pckt->increment_layer_begin(sizeof(header));
-      ip4_upstream_(std::move(pckt), eth->dest() == MAC::BROADCAST);
+      if (eth->dest() == MAC::BROADCAST)
+        ip4_bcast.push_back(std::move(pckt));
+      else
+        ip4_unicast.push_back(std::move(pckt));
       break;
 
     case Ethertype::IP6:
       PRINT("IPv6 packet\n");
+      if constexpr (not Features::ipv6) {
+        packets_dropped_++;
+        break;
+      }
       pckt->increment_layer_begin(sizeof(header));
       ip6_upstream_(std::move(pckt), eth->dest() == MAC::BROADCAST);
       break;
@@ -134,7 +173,7 @@ namespace net {
 
     case Ethertype::VLAN:
       PRINT("VLAN frame\n");
-      if(not vlan_upstream_)
+      if(not Features::vlan or not vlan_upstream_)
         packets_dropped_++;
       else {
         vlan_upstream_(std::move(pckt));
@@ -19,25 +19,31 @@ Ethernet_8021Q::Ethernet_8021Q(downstream phys_down,
 void Ethernet_8021Q::receive(Packet_ptr pkt)
 {
   auto& vlan = *reinterpret_cast<ethernet::VLAN_header*>(pkt->layer_begin());
+  // a tag stripped by the NIC leaves a plain Ethernet header
+  const bool stripped = pkt->vlan_id() != 0;
+  const auto type = stripped
+    ? reinterpret_cast<ethernet::Header*>(pkt->layer_begin())->type() : vlan.type;
+  const int  hlen = stripped ? sizeof(ethernet::Header) : header_size();
+  const bool bcast = vlan.dest == MAC::BROADCAST;
 
-  PRINT("<802.1Q IN> %#x (id %d) - ", vlan.tpid, vlan.vid());
+  PRINT("<802.1Q IN> %#x (id %d) - ", vlan.tpid, stripped ? pkt->vlan_id() : vlan.vid());
 
-  switch(vlan.type) {
+  switch(type) {
   case Ethertype::IP4:
     PRINT("IPv4 packet\n");
-    pkt->increment_layer_begin(header_size());
-    ip4_upstream_(std::move(pkt), vlan.dest == MAC::BROADCAST);
+    pkt->increment_layer_begin(hlen);
+    ip4_upstream_(std::move(pkt), bcast);
     break;
 
   case Ethertype::IP6:
     PRINT("IPv6 packet\n");
-    pkt->increment_layer_begin(header_size());
-    ip6_upstream_(std::move(pkt), vlan.dest == MAC::BROADCAST);
+    pkt->increment_layer_begin(hlen);
+    ip6_upstream_(std::move(pkt), bcast);
     break;
 
   case Ethertype::ARP:
     PRINT("ARP packet\n");
-    pkt->increment_layer_begin(header_size());
+    pkt->increment_layer_begin(hlen);
     arp_upstream_(std::move(pkt));
     break;
 
@@ -51,21 +57,21 @@ void Ethernet_8021Q::receive(Packet_ptr pkt)
     break;
 
   default:
-    uint16_t type = ntohs(static_cast<uint16_t>(vlan.type));
+    uint16_t etype = ntohs(static_cast<uint16_t>(type));
 
     // Trailer negotiation and encapsulation RFC 893 and 1122
-    if (UNLIKELY(type == ntohs(static_cast<uint16_t>(Ethertype::TRAILER_NEGO)) or
-      (type >= ntohs(static_cast<uint16_t>(Ethertype::TRAILER_FIRST)) and
-        type <= ntohs(static_cast<uint16_t>(Ethertype::TRAILER_LAST))))) {
+    if (UNLIKELY(etype == ntohs(static_cast<uint16_t>(Ethertype::TRAILER_NEGO)) or
+      (etype >= ntohs(static_cast<uint16_t>(Ethertype::TRAILER_FIRST)) and
+        etype <= ntohs(static_cast<uint16_t>(Ethertype::TRAILER_LAST))))) {
       printf("Trailer packet\n");
       break;
     }
 
     // This might be 802.3 LLC traffic
-    if (type > 1500) {
-      PRINT("<802.1Q> UNKNOWN ethertype 0x%hx\n", vlan.type);
+    if (etype > 1500) {
+      PRINT("<802.1Q> UNKNOWN ethertype 0x%hx\n", etype);
     } else {
-      PRINT("IEEE802.3 Length field: 0x%hx\n", vlan.type);
+      PRINT("IEEE802.3 Length field: 0x%hx\n", etype);
     }
     break;
   }
@@ -0,0 +1,101 @@
+
+#include <net/filter_rules.hpp>
+#include <algorithm>
+
+namespace net {
+
+  static Rule_classifier::Key successor(Rule_classifier::Key key) noexcept
+  {
+    if (++key[1] == 0) ++key[0];
+    return key;
+  }
+
+  static bool is_max(const Rule_classifier::Key& key) noexcept
+  { return key[0] == ~0ull and key[1] == ~0ull; }
+
+  void Rule_classifier::reset(size_t rules)
+  {
+    rules_ = rules;
+    words_ = (rules + 63) / 64;
+    for (auto& dim : dims_) {
+      dim.ranges.clear();
+      dim.starts.clear();
+      dim.bitmaps.clear();
+    }
+  }
+
+  void Rule_classifier::add(int rule, Field field, Range range)
+  {
+    Expects(rule >= 0 and (size_t) rule < rules_);
+    Expects(range.lo <= range.hi);
+    dims_[field].ranges.emplace_back(rule, range);
+  }
+
+  void Rule_classifier::compile()
+  {
+    for (auto& dim : dims_)
+    {
+      // every range boundary starts a new interval
+      std::vector<Key> starts {{0, 0}};
+      for (const auto& r : dim.ranges) {
+        starts.push_back(r.second.lo);
+        if (not is_max(r.second.hi))
+          starts.push_back(successor(r.second.hi));
+      }
+      std::sort(starts.begin(), starts.end());
+      starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+      // rules without a range on this field match every interval
+      std::vector<bool> restricted(rules_, false);
+      for (const auto& r : dim.ranges)
+        restricted[r.first] = true;
+
+      std::vector<uint64_t> any(words_, 0);
+      for (size_t rule = 0; rule < rules_; rule++)
+        if (not restricted[rule])
+          any[rule / 64] |= 1ull << (rule % 64);
+
+      std::vector<uint64_t> bitmaps;
+      bitmaps.reserve(starts.size() * words_);
+      for (size_t i = 0; i < starts.size(); i++)
+        bitmaps.insert(bitmaps.end(), any.begin(), any.end());
+
+      for (const auto& r : dim.ranges)
+      {
+        auto first = std::lower_bound(starts.begin(), starts.end(), r.second.lo);
+        auto last  = is_max(r.second.hi) ? starts.end()
+          : std::lower_bound(starts.begin(), starts.end(), successor(r.second.hi));
+        for (auto it = first; it != last; ++it)
+          bitmaps[(it - starts.begin()) * words_ + r.first / 64] |= 1ull << (r.first % 64);
+      }
+
+      dim.starts  = std::move(starts);
+      dim.bitmaps = std::move(bitmaps);
+      dim.ranges.clear();
+      dim.ranges.shrink_to_fit();
+    }
+  }
+
+  int Rule_classifier::classify(const std::array<Key, FIELDS>& keys) const noexcept
+  {
+    const uint64_t* maps[FIELDS];
+    for (int f = 0; f < FIELDS; f++)
+    {
+      const auto& dim = dims_[f];
+      if (dim.starts.empty()) return -1;
+      const auto it = std::upper_bound(dim.starts.begin(), dim.starts.end(), keys[f]);
+      maps[f] = &dim.bitmaps[(it - dim.starts.begin() - 1) * words_];
+    }
+
+    for (size_t w = 0; w < words_; w++)
+    {
+      uint64_t match = maps[0][w];
+      for (int f = 1; f < FIELDS and match; f++)
+        match &= maps[f][w];
+      if (match)
+        return w * 64 + __builtin_ctzll(match);
+    }
+    return -1;
+  }
+
+} //< namespace net
@@ -0,0 +1,223 @@
+
+#include <net/flow_export.hpp>
+#include <net/util.hpp>
+#include <cstring>
+
+namespace net {
+
+// IPFIX information elements of the records, in the order they're written
+struct Field { uint16_t id; uint16_t length; };
+static constexpr Field fields_ip4[] {
+  {8, 4}, {12, 4},    // sourceIPv4Address, destinationIPv4Address
+  {7, 2}, {11, 2},    // sourceTransportPort, destinationTransportPort
+  {4, 1}, {136, 1},   // protocolIdentifier, flowEndReason
+  {86, 8}, {85, 8},   // packetTotalCount, octetTotalCount
+  {150, 4}, {151, 4}  // flowStartSeconds, flowEndSeconds
+};
+static constexpr Field fields_ip6[] {
+  {27, 16}, {28, 16}, // sourceIPv6Address, destinationIPv6Address
+  {7, 2}, {11, 2},
+  {4, 1}, {136, 1},
+  {86, 8}, {85, 8},
+  {150, 4}, {151, 4}
+};
+static constexpr size_t SET_HEADER  = 4;
+static constexpr size_t RECORD_IP4  = 38;
+static constexpr size_t RECORD_IP6  = 62;
+
+template <typename T>
+static void put(std::vector<uint8_t>& buf, const T value)
+{
+  const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+  buf.insert(buf.end(), bytes, bytes + sizeof(T));
+}
+static void put16(std::vector<uint8_t>& buf, const uint16_t v) { put(buf, htons(v)); }
+static void put32(std::vector<uint8_t>& buf, const uint32_t v) { put(buf, htonl(v)); }
+static void put64(std::vector<uint8_t>& buf, const uint64_t v) { put(buf, htonll(v)); }
+
+static void set16(std::vector<uint8_t>& buf, const size_t off, const uint16_t v)
+{
+  const uint16_t net = htons(v);
+  std::memcpy(&buf[off], &net, sizeof(net));
+}
+
+Flow_exporter::Flow_exporter(Conntrack& ct, Send_func send,
+                             uint32_t sampling, uint32_t domain)
+  : ct_{ct}, send_{send},
+    sampling_{sampling > 0 ? sampling : 1}, domain_{domain},
+    timer_{{this, &Flow_exporter::on_timeout}}
+{
+  ct_.on_expire = {this, &Flow_exporter::on_expire};
+}
+
+Flow_exporter::~Flow_exporter()
+{
+  timer_.stop();
+  ct_.on_expire = nullptr;
+}
+
+void Flow_exporter::start()
+{
+  last_active_ = RTC::now();
+  timer_.start(flush_interval);
+}
+
+void Flow_exporter::stop()
+{
+  timer_.stop();
+  export_active(FORCED);
+  flush();
+}
+
+bool Flow_exporter::sampled(const Conntrack::Entry& ent) const noexcept
+{
+  if (sampling_ == 1) return true;
+  auto hash = Conntrack::Quintuple_hasher{}({ent.first, ent.proto});
+  hash ^= hash >> 32;
+  return hash % sampling_ == 0;
+}
+
+void Flow_exporter::on_expire(Conntrack::Entry* ent)
+{
+  if (not sampled(*ent)) return;
+  lock_.lock();
+  for (int dir = 0; dir < 2; dir++)
+    if (ent->packets[dir] > 0)
+      add_record(*ent, dir, IDLE);
+  lock_.unlock();
+}
+
+void Flow_exporter::export_active(const End_reason reason)
+{
+  // the shard lock is held in the handler, then lock_, as in on_expire
+  ct_.for_each_entry([this, reason] (Conntrack::Entry* ent) {
+    if (not sampled(*ent)) return;
+    lock_.lock();
+    for (int dir = 0; dir < 2; dir++)
+      if (ent->packets[dir] > 0)
+        add_record(*ent, dir, reason);
+    lock_.unlock();
+  });
+}
+
+void Flow_exporter::on_timeout()
+{
+  const auto now = RTC::now();
+  if (now >= last_active_ + active_timeout.count()) {
+    last_active_ = now;
+    export_active();
+  }
+  flush();
+  timer_.restart(flush_interval);
+}
+
+void Flow_exporter::flush()
+{
+  // sent outside of the lock, as sending may go through the tracker
+  lock_.lock();
+  if (not message_.empty())
+    finish_message();
+  auto messages = std::move(pending_);
+  pending_.clear();
+  lock_.unlock();
+
+  for (const auto& msg : messages)
+    send_(msg.data(), msg.size());
+}
+
+void Flow_exporter::begin_message()
+{
+  message_.reserve(MAX_MESSAGE);
+  // the header, its length and export time set when finished
+  put16(message_, 10);
+  put16(message_, 0);
+  put32(message_, 0);
+  put32(message_, records_);
+  put32(message_, domain_);
+
+  // both templates, in one template set
+  const size_t set = message_.size();
+  put16(message_, 2);
+  put16(message_, 0);
+  for (const auto tmpl : {TEMPLATE_IP4, TEMPLATE_IP6})
+  {
+    const auto& fields = (tmpl == TEMPLATE_IP4) ? fields_ip4 : fields_ip6;
+    put16(message_, tmpl);
+    put16(message_, std::size(fields));
+    for (const auto& field : fields) {
+      put16(message_, field.id);
+      put16(message_, field.length);
+    }
+  }
+  set16(message_, set + 2, message_.size() - set);
+}
+
+void Flow_exporter::close_set()
+{
+  if (set_id_ != 0)
+    set16(message_, set_begin_ + 2, message_.size() - set_begin_);
+  set_id_ = 0;
+}
+
+void Flow_exporter::finish_message()
+{
+  close_set();
+  set16(message_, 2, message_.size());
+  const uint32_t now = htonl(RTC::now());
+  std::memcpy(&message_[4], &now, sizeof(now));
+  pending_.push_back(std::move(message_));
+  message_ = {};
+}
+
+void Flow_exporter::add_record(const Conntrack::Entry& ent, const int dir,
+                               const End_reason reason)
+{
+  const auto& quad = (dir == 0) ? ent.first : ent.second;
+  const bool ip4   = quad.src.address().is_v4();
+  const auto tmpl  = ip4 ? TEMPLATE_IP4 : TEMPLATE_IP6;
+  const size_t size = ip4 ? RECORD_IP4 : RECORD_IP6;
+  const size_t set_size = (set_id_ == tmpl) ? 0 : SET_HEADER;
+
+  if (not message_.empty() and message_.size() + set_size + size > MAX_MESSAGE)
+    finish_message();
+  if (message_.empty())
+  {
+    if (UNLIKELY(pending_.size() >= max_messages)) {
+      dropped_++;
+      return;
+    }
+    begin_message();
+  }
+  if (set_id_ != tmpl)
+  {
+    close_set();
+    set_begin_ = message_.size();
+    set_id_    = tmpl;
+    put16(message_, tmpl);
+    put16(message_, 0);
+  }
+
+  if (ip4) {
+    put(message_, quad.src.address().v4().whole);
+    put(message_, quad.dst.address().v4().whole);
+  }
+  else {
+    const auto& src = quad.src.address().v6().i8;
+    const auto& dst = quad.dst.address().v6().i8;
+    message_.insert(message_.end(), src.begin(), src.end());
+    message_.insert(message_.end(), dst.begin(), dst.end());
+  }
+  // ICMP has its id in both ports
+  const bool ports = ent.proto == Protocol::TCP or ent.proto == Protocol::UDP;
+  put16(message_, ports ? quad.src.port() : 0);
+  put16(message_, ports ? quad.dst.port() : 0);
+  message_.push_back(static_cast<uint8_t>(ent.proto));
+  message_.push_back(reason);
+  put64(message_, ent.packets[dir]);
+  put64(message_, ent.bytes[dir]);
+  put32(message_, ent.first_seen);
+  put32(message_, ent.last_seen);
+  records_++;
+}
+
+} // < namespace net
@@ -1,6 +1,8 @@
 
 #include <net/http/basic_client.hpp>
 
+#include <algorithm>
+
 namespace http {
 
   const Basic_client::timeout_duration Basic_client::DEFAULT_TIMEOUT{std::chrono::seconds(5)};
@@ -14,7 +16,8 @@ namespace http {
   Basic_client::Basic_client(TCP& tcp, Request_handler on_send, const bool https_supported)
     : tcp_(tcp),
       on_send_{std::move(on_send)},
-      supports_https(https_supported)
+      supports_https(https_supported),
+      pool_timer_({this, &Basic_client::reap_idle})
   {
   }
 
@@ -35,8 +38,6 @@ namespace http {
   {
     Expects(cb != nullptr);
     using namespace std;
-    auto& conn = (not secure) ?
-      get_connection(host) : get_secure_connection(host);
 
     auto&& header = req->header();
 
@@ -53,7 +54,15 @@ namespace http {
     if(on_send_)
       on_send_(*req, options, host);
 
-    conn.send(move(req), move(cb), options.follow_redirect, options.timeout);
+    auto* conn = acquire(host, secure);
+    // wait for a connection to the host to be done
+    if(conn == nullptr)
+    {
+      queued_[host].push_back({move(req), move(cb), secure, move(options)});
+      return;
+    }
+
+    conn->send(move(req), move(cb), options.follow_redirect, options.timeout);
   }
 
   void Basic_client::send(Request_ptr req, URI url, Response_handler cb, Options options)
@@ -342,6 +351,131 @@ namespace http {
     return *cset.back();
   }
 
+  Client_connection* Basic_client::acquire(const Host host, const bool secure)
+  {
+    auto& cset = conns_[host];
+    Client_connection* idle = nullptr;
+    std::vector<Client_connection*> stale;
+    size_t busy = 0;
+
+    for(auto& conn : cset)
+    {
+      if(conn->busy())
+        busy++;
+      else if(conn->available())
+      {
+        // the peer may have closed it while idle
+        if(not conn->healthy())
+        {
+          conn->keep_alive(false);
+          stale.push_back(conn.get());
+        }
+        else if(idle == nullptr)
+          idle = conn.get();
+      }
+    }
+    // closing may close right away, and erase from the set
+    for(auto* conn : stale)
+      conn->shutdown();
+
+    if(idle != nullptr)
+      return idle;
+
+    if(busy >= pool_.max_connections)
+      return nullptr;
+
+    return (not secure) ?
+      &get_connection(host) : &get_secure_connection(host);
+  }
+
+  void Basic_client::send_queued(const Host host)
+  {
+    while(true)
+    {
+      auto it = queued_.find(host);
+      if(it == queued_.end())
+        return;
+      if(it->second.empty())
+      {
+        queued_.erase(it);
+        return;
+      }
+
+      auto* conn = acquire(host, it->second.front().secure);
+      if(conn == nullptr)
+        return;
+
+      // acquiring may have sent some already
+      it = queued_.find(host);
+      if(it == queued_.end() or it->second.empty())
+        return;
+
+      auto next = std::move(it->second.front());
+      it->second.pop_front();
+      conn->send(std::move(next.req), std::move(next.cb),
+                 next.options.follow_redirect, next.options.timeout);
+    }
+  }
+
+  void Basic_client::on_idle(Client_connection& conn)
+  {
+    // the response handler may have sent another request on it
+    if(not conn.available())
+      return;
+
+    const auto host = conn.peer();
+    send_queued(host);
+    if(not conn.available())
+      return;
+
+    size_t idle = 0;
+    for(auto& c : conns_[host])
+      if(c->available()) idle++;
+
+    if(idle > pool_.max_idle)
+    {
+      conn.keep_alive(false);
+      conn.shutdown();
+      return;
+    }
+
+    if(not pool_timer_.is_running())
+      pool_timer_.start(pool_.idle_timeout);
+  }
+
+  void Basic_client::reap_idle()
+  {
+    const auto now = RTC::now();
+    std::vector<Client_connection*> stale;
+
+    for(auto& host : conns_)
+    {
+      for(auto& conn : host.second)
+      {
+        if(not conn->available())
+          continue;
+
+        if(not conn->healthy()
+          or now - conn->idle_since() >= (RTC::timestamp_t) pool_.idle_timeout.count())
+        {
+          conn->keep_alive(false);
+          stale.push_back(conn.get());
+        }
+      }
+    }
+
+    const bool idle_left = std::any_of(conns_.begin(), conns_.end(),
+    [] (const auto& host) {
+      return std::any_of(host.second.begin(), host.second.end(),
+        [] (const auto& conn) { return conn->available(); });
+    });
+    if(idle_left)
+      pool_timer_.start(pool_.idle_timeout);
+
+    for(auto* conn : stale)
+      conn->shutdown();
+  }
+
   Client_connection& Basic_client::get_secure_connection(const Host)
   {
     throw Client_error{"Secured connections not supported (use the HTTPS Client)."};
@@ -350,13 +484,17 @@ namespace http {
   void Basic_client::close(Client_connection& c)
   {
     debug("<http::Basic_client> Closing %u:%s %p\n", c.local_port(), c.peer().to_string().c_str(), &c);
-    auto& cset = conns_.at(c.peer());
+    const auto host = c.peer();
+    auto& cset = conns_.at(host);
 
     cset.erase(std::remove_if(cset.begin(), cset.end(),
     [port = c.local_port()] (const std::unique_ptr<Client_connection>& conn)->bool
     {
       return conn->local_port() == port;
     }));
+
+    // there's room for a waiting request
+    send_queued(host);
   }
 
 }
@@ -0,0 +1,58 @@
+#include <net/http/caching_proxy.hpp>
+#include <strings.h>
+
+namespace http {
+
+  // not passed on: about the connection, or conditions of the client
+  // that the cache answers itself
+  static bool is_forwarded(util::csview field) noexcept
+  {
+    static const char* dropped[] {
+      "Connection", "Keep-Alive", "Transfer-Encoding", "TE", "Trailer", "Upgrade",
+      "Proxy-Connection", "Proxy-Authorization", "Content-Length", "Host",
+      "If-None-Match", "If-Modified-Since"
+    };
+    for (const char* name : dropped)
+      if (field.size() == strlen(name) and strncasecmp(field.data(), name, field.size()) == 0)
+        return false;
+    return true;
+  }
+
+  Caching_proxy::Caching_proxy(Basic_client& client, net::Socket upstream, size_t capacity)
+    : client_{client}, upstream_{upstream}, cache_{capacity}
+  {
+  }
+
+  void Caching_proxy::handle(Request_ptr req, Response_writer_ptr res)
+  {
+    cache_.handle(std::move(req), std::move(res), {this, &Caching_proxy::fetch});
+  }
+
+  void Caching_proxy::fetch(const Request& req, const std::string& etag,
+                            Response_cache::Done done)
+  {
+    Header_set fields;
+    req.header().for_each([&fields] (util::csview name, util::csview value) {
+      if (is_forwarded(name)) fields.emplace_back(std::string(name), std::string(value));
+    });
+    if (not etag.empty())
+      fields.emplace_back(std::string(header::If_None_Match), etag);
+
+    auto path = req.uri().to_string();
+    if (path.empty()) path = "/";
+    // a delegate is too large to go in another
+    auto on_done = std::make_shared<Response_cache::Done>(std::move(done));
+    Response_handler on_response = [on_done] (Error err, Response_ptr res, Connection&) {
+      (*on_done)(err ? nullptr : std::move(res));
+    };
+    // requests that aren't cached go through with their payload
+    const auto body = req.body();
+    if (body.empty())
+      client_.request(req.method(), upstream_, std::move(path), std::move(fields),
+                      std::move(on_response));
+    else
+      client_.request(req.method(), upstream_, std::move(path), std::move(fields),
+                      std::string(body), std::move(on_response));
+  }
+
+} // < namespace http
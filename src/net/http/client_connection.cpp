@@ -212,6 +212,13 @@ namespace http {
     client_.send(std::move(req_), location, std::move(callback), options);
   }
 
+  void Client_connection::on_end()
+  {
+    // kept alive, back to the pool
+    idle_since_ = RTC::now();
+    client_.on_idle(*this);
+  }
+
   void Client_connection::close()
   {
     // if the user havent received a response yet
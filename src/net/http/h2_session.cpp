@@ -0,0 +1,661 @@
+#include <net/http/h2_session.hpp>
+#include <net/http/server_connection.hpp>
+#include <net/http/time.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace http {
+
+  using namespace h2;
+
+  static inline uint32_t read32(const uint8_t* p) noexcept
+  { return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+  static inline void append32(std::string& out, uint32_t v)
+  {
+    out += static_cast<char>(v >> 24);
+    out += static_cast<char>(v >> 16);
+    out += static_cast<char>(v >> 8);
+    out += static_cast<char>(v);
+  }
+
+  static std::string frame_header(uint8_t type, uint8_t flags, uint32_t stream, uint32_t len)
+  {
+    std::string out;
+    out.reserve(FRAME_HEADER_SIZE + len);
+    out += static_cast<char>(len >> 16);
+    out += static_cast<char>(len >> 8);
+    out += static_cast<char>(len);
+    out += static_cast<char>(type);
+    out += static_cast<char>(flags);
+    append32(out, stream & 0x7fffffff);
+    return out;
+  }
+
+  H2_session::H2_session(Server_connection& conn)
+    : conn_(conn)
+  {}
+
+  void H2_session::receive(std::string& buffer)
+  {
+    size_t pos = 0;
+    if (not preface_)
+    {
+      if (buffer.size() < PREFACE.size())
+        return;
+      if (util::csview{buffer}.substr(0, PREFACE.size()) != PREFACE)
+      {
+        buffer.clear();
+        go_away(PROTOCOL_ERROR);
+        return;
+      }
+      preface_ = true;
+      pos = PREFACE.size();
+      send_settings();
+    }
+
+    while (not goaway_ and buffer.size() - pos >= FRAME_HEADER_SIZE)
+    {
+      const auto* hdr = reinterpret_cast<const uint8_t*>(buffer.data()) + pos;
+      const uint32_t len = (hdr[0] << 16) | (hdr[1] << 8) | hdr[2];
+      // we never allow larger than the default
+      if (len > DEFAULT_MAX_FRAME_SIZE)
+      {
+        go_away(FRAME_SIZE_ERROR);
+        break;
+      }
+      if (buffer.size() - pos < FRAME_HEADER_SIZE + len)
+        break;
+
+      pos += FRAME_HEADER_SIZE + len;
+      if (not frame(hdr[3], hdr[4], read32(hdr + 5) & 0x7fffffff,
+                    hdr + FRAME_HEADER_SIZE, len))
+        break;
+    }
+
+    if (goaway_)
+      buffer.clear();
+    else
+      buffer.erase(0, pos);
+  }
+
+  bool H2_session::frame(uint8_t type, uint8_t flags, uint32_t stream,
+                         const uint8_t* payload, uint32_t len)
+  {
+    // a header block must not be interrupted
+    if (continued_ and (type != CONTINUATION or stream != continued_))
+    {
+      go_away(PROTOCOL_ERROR);
+      return false;
+    }
+
+    switch (type)
+    {
+    case DATA:
+      return on_data(flags, stream, payload, len);
+    case HEADERS:
+      return on_headers(flags, stream, payload, len);
+    case PRIORITY:
+      if (stream == 0)
+      {
+        go_away(PROTOCOL_ERROR);
+        return false;
+      }
+      // every stream is served as soon as it can be
+      return true;
+    case RST_STREAM:
+      if (stream == 0 or len != 4)
+      {
+        go_away(stream == 0 ? PROTOCOL_ERROR : FRAME_SIZE_ERROR);
+        return false;
+      }
+      streams_.erase(stream);
+      return true;
+    case SETTINGS:
+      return on_settings(flags, stream, payload, len);
+    case PING:
+      if (stream != 0 or len != 8)
+      {
+        go_away(stream != 0 ? PROTOCOL_ERROR : FRAME_SIZE_ERROR);
+        return false;
+      }
+      if (not (flags & ACK))
+        write_frame(PING, ACK, 0, {reinterpret_cast<const char*>(payload), len});
+      return true;
+    case GOAWAY:
+      // the client is done, answer what it has sent so far
+      goaway_ = true;
+      return false;
+    case WINDOW_UPDATE:
+      return on_window_update(stream, payload, len);
+    case CONTINUATION:
+      if (not continued_)
+      {
+        go_away(PROTOCOL_ERROR);
+        return false;
+      }
+      if (header_block_.size() + len > MAX_HEADER_BLOCK)
+      {
+        go_away(ENHANCE_YOUR_CALM);
+        return false;
+      }
+      header_block_.append(reinterpret_cast<const char*>(payload), len);
+      if (flags & END_HEADERS)
+      {
+        const auto id = continued_;
+        continued_ = 0;
+        return on_header_block(id, continued_end_);
+      }
+      return true;
+    case PUSH_PROMISE: // clients can't push
+      go_away(PROTOCOL_ERROR);
+      return false;
+    default:
+      // unknown frame types are ignored
+      return true;
+    }
+  }
+
+  bool H2_session::on_headers(uint8_t flags, uint32_t stream,
+                              const uint8_t* payload, uint32_t len)
+  {
+    // clients open odd streams only
+    if (stream == 0 or (stream & 1) == 0)
+    {
+      go_away(PROTOCOL_ERROR);
+      return false;
+    }
+
+    const uint8_t* p   = payload;
+    const uint8_t* end = payload + len;
+    uint8_t pad = 0;
+    if (flags & PADDED)
+    {
+      if (p == end)
+      {
+        go_away(FRAME_SIZE_ERROR);
+        return false;
+      }
+      pad = *p++;
+    }
+    if (flags & PRIORITY_F)
+      p += 5;
+    if (p > end or pad > end - p)
+    {
+      go_away(PROTOCOL_ERROR);
+      return false;
+    }
+    end -= pad;
+
+    // a new stream, unless trailers
+    if (streams_.find(stream) == streams_.end())
+    {
+      if (stream <= last_stream_)
+      {
+        go_away(PROTOCOL_ERROR);
+        return false;
+      }
+      last_stream_ = stream;
+    }
+
+    header_block_.assign(reinterpret_cast<const char*>(p), end - p);
+    if (flags & END_HEADERS)
+      return on_header_block(stream, flags & END_STREAM);
+
+    continued_     = stream;
+    continued_end_ = flags & END_STREAM;
+    return true;
+  }
+
+  bool H2_session::on_header_block(uint32_t id, bool end_stream)
+  {
+    hpack::Header_list fields;
+    // a block must be decoded even if the stream is refused,
+    // to keep the table in sync
+    if (not decoder_.decode(reinterpret_cast<const uint8_t*>(header_block_.data()),
+                            header_block_.size(), fields))
+    {
+      go_away(COMPRESSION_ERROR);
+      return false;
+    }
+    header_block_.clear();
+
+    auto it = streams_.find(id);
+    // trailers end the request body; their fields are ignored
+    if (it != streams_.end())
+    {
+      auto& stream = it->second;
+      if (not end_stream or stream.remote_closed)
+      {
+        reset(id, PROTOCOL_ERROR);
+        return true;
+      }
+      stream.remote_closed = true;
+      if (stream.req) dispatch(id, stream);
+      else close_if_done(id);
+      return true;
+    }
+
+    if (streams_.size() >= MAX_CONCURRENT_STREAMS)
+    {
+      reset(id, REFUSED_STREAM);
+      return true;
+    }
+
+    auto req = std::make_unique<Request>();
+    req->set_version(Version{2U, 0U});
+    bool has_method = false, has_path = false;
+    for (auto& field : fields)
+    {
+      const auto& name = field.first;
+      if (not name.empty() and name.front() == ':')
+      {
+        if (name == ":method") {
+          req->set_method(method::code(field.second));
+          has_method = true;
+        }
+        else if (name == ":path") {
+          req->set_uri(URI{field.second});
+          has_path = true;
+        }
+        else if (name == ":authority")
+          req->header().set_field(header::Host, std::move(field.second));
+        else if (name != ":scheme")
+        {
+          reset(id, PROTOCOL_ERROR);
+          return true;
+        }
+      }
+      // cookies may come split up (RFC 7540 8.1.2.5)
+      else if (name == "cookie" and req->header().has_field(header::Cookie))
+      {
+        req->header().set_field(header::Cookie,
+          std::string(req->header().value(header::Cookie)) + "; " + field.second);
+      }
+      else
+        req->header().add_field(std::move(field.first), std::move(field.second));
+    }
+    if (not has_method or not has_path)
+    {
+      reset(id, PROTOCOL_ERROR);
+      return true;
+    }
+
+    auto& stream = streams_[id];
+    stream.req = std::move(req);
+    stream.send_window = peer_window_;
+    if (end_stream)
+    {
+      stream.remote_closed = true;
+      dispatch(id, stream);
+    }
+    return true;
+  }
+
+  bool H2_session::on_data(uint8_t flags, uint32_t id,
+                           const uint8_t* payload, uint32_t len)
+  {
+    if (id == 0)
+    {
+      go_away(PROTOCOL_ERROR);
+      return false;
+    }
+
+    const uint8_t* p   = payload;
+    const uint8_t* end = payload + len;
+    if (flags & PADDED)
+    {
+      if (p == end or *p >= len)
+      {
+        go_away(PROTOCOL_ERROR);
+        return false;
+      }
+      end -= *p++;
+    }
+
+    // give back to the connection what was spent, padding included
+    if (len > 0)
+      send_window_update(0, len);
+
+    auto it = streams_.find(id);
+    if (it == streams_.end() or it->second.remote_closed)
+    {
+      reset(id, STREAM_CLOSED);
+      return true;
+    }
+
+    auto& stream = it->second;
+    if (stream.req and p < end)
+      stream.req->add_chunk(std::string(reinterpret_cast<const char*>(p), end - p));
+
+    if (flags & END_STREAM)
+    {
+      stream.remote_closed = true;
+      if (stream.req) dispatch(id, stream);
+      else close_if_done(id);
+    }
+    else if (len > 0)
+      send_window_update(id, len);
+    return true;
+  }
+
+  bool H2_session::on_settings(uint8_t flags, uint32_t stream,
+                               const uint8_t* payload, uint32_t len)
+  {
+    if (stream != 0)
+    {
+      go_away(PROTOCOL_ERROR);
+      return false;
+    }
+    if (flags & ACK)
+    {
+      if (len != 0)
+      {
+        go_away(FRAME_SIZE_ERROR);
+        return false;
+      }
+      return true;
+    }
+    if (len % 6 != 0)
+    {
+      go_away(FRAME_SIZE_ERROR);
+      return false;
+    }
+
+    for (uint32_t i = 0; i < len; i += 6)
+    {
+      const uint16_t id    = (payload[i] << 8) | payload[i + 1];
+      const uint32_t value = read32(payload + i + 2);
+      switch (id)
+      {
+      case INITIAL_WINDOW_SIZE:
+      {
+        if (value > MAX_WINDOW_SIZE)
+        {
+          go_away(FLOW_CONTROL_ERROR);
+          return false;
+        }
+        // applies to the streams already open too
+        const int64_t delta = int64_t(value) - peer_window_;
+        for (auto& s : streams_)
+          s.second.send_window += delta;
+        peer_window_ = value;
+        break;
+      }
+      case MAX_FRAME_SIZE:
+        if (value < DEFAULT_MAX_FRAME_SIZE or value > 0xffffff)
+        {
+          go_away(PROTOCOL_ERROR);
+          return false;
+        }
+        peer_max_frame_ = value;
+        break;
+      default:
+        // headers are encoded without the dynamic table,
+        // and nothing is pushed, so the rest don't matter
+        break;
+      }
+    }
+    write_frame(SETTINGS, ACK, 0, {});
+
+    std::vector<uint32_t> ids;
+    for (const auto& s : streams_)
+      ids.push_back(s.first);
+    for (const auto id : ids)
+    {
+      auto it = streams_.find(id);
+      if (it == streams_.end()) continue;
+      flush(id, it->second);
+      close_if_done(id);
+    }
+    return true;
+  }
+
+  bool H2_session::on_window_update(uint32_t id, const uint8_t* payload, uint32_t len)
+  {
+    if (len != 4)
+    {
+      go_away(FRAME_SIZE_ERROR);
+      return false;
+    }
+    const uint32_t increment = read32(payload) & 0x7fffffff;
+
+    if (id == 0)
+    {
+      send_window_ += increment;
+      if (increment == 0 or send_window_ > MAX_WINDOW_SIZE)
+      {
+        go_away(increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+        return false;
+      }
+      std::vector<uint32_t> ids;
+      for (const auto& s : streams_)
+        ids.push_back(s.first);
+      for (const auto sid : ids)
+      {
+        auto it = streams_.find(sid);
+        if (it == streams_.end()) continue;
+        flush(sid, it->second);
+        close_if_done(sid);
+      }
+      return true;
+    }
+
+    auto it = streams_.find(id);
+    if (it == streams_.end())
+      return true;
+    auto& stream = it->second;
+    stream.send_window += increment;
+    if (increment == 0 or stream.send_window > MAX_WINDOW_SIZE)
+    {
+      reset(id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+      return true;
+    }
+    flush(id, stream);
+    close_if_done(id);
+    return true;
+  }
+
+  void H2_session::dispatch(uint32_t id, Stream& stream)
+  {
+    // the stream may be gone when the handler returns
+    auto req = std::move(stream.req);
+    auto res = make_response();
+    res->set_status_code(OK);
+    conn_.receive(std::move(req),
+      std::make_unique<H2_response_writer>(std::move(res), conn_, *this, id));
+  }
+
+  void H2_session::send_headers(uint32_t id, const Response& res)
+  {
+    auto it = streams_.find(id);
+    if (it == streams_.end() or it->second.local_closed)
+      return;
+
+    std::string block;
+    hpack::Encoder::encode(":status", std::to_string(res.status_code()), block);
+    if (not res.header().has_field(header::Date))
+      hpack::Encoder::encode("date", time::cached_now(), block);
+    res.header().for_each(
+    [&block] (util::csview name, util::csview value)
+    {
+      std::string lower{name};
+      std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+      // connection specific fields are not allowed (RFC 7540 8.1.2.2)
+      if (lower == "connection" or lower == "keep-alive" or lower == "proxy-connection"
+          or lower == "transfer-encoding" or lower == "upgrade")
+        return;
+      hpack::Encoder::encode(lower, value, block);
+    });
+
+    // split in CONTINUATION frames if need be
+    util::sview rest{block};
+    uint8_t type = HEADERS;
+    do {
+      const auto chunk = rest.substr(0, peer_max_frame_);
+      rest.remove_prefix(chunk.size());
+      write_frame(type, rest.empty() ? END_HEADERS : 0, id, chunk);
+      type = CONTINUATION;
+    } while (not rest.empty());
+  }
+
+  void H2_session::send_data(uint32_t id, const char* data, size_t len, bool end)
+  {
+    auto it = streams_.find(id);
+    if (it == streams_.end() or it->second.local_closed)
+      return;
+    auto& stream = it->second;
+    stream.pending.append(data, len);
+    stream.end_pending |= end;
+    flush(id, stream);
+    close_if_done(id);
+  }
+
+  void H2_session::send_data(uint32_t id, net::tcp::buffer_t buffer, bool end)
+  {
+    auto it = streams_.find(id);
+    if (it == streams_.end() or it->second.local_closed)
+      return;
+    auto& stream = it->second;
+    const int64_t len = buffer->size();
+
+    // the buffer goes out as it is when there's room for all of it
+    if (stream.pending.empty() and len <= peer_max_frame_
+        and len <= send_window_ and len <= stream.send_window)
+    {
+      const auto header = frame_header(DATA, end ? END_STREAM : 0, id, len);
+      conn_.stream()->writev({net::Stream::construct_buffer(header.begin(), header.end()),
+                              std::move(buffer)});
+      send_window_       -= len;
+      stream.send_window -= len;
+      stream.local_closed = end;
+      close_if_done(id);
+      return;
+    }
+    send_data(id, reinterpret_cast<const char*>(buffer->data()), len, end);
+  }
+
+  void H2_session::end_stream(uint32_t id)
+  {
+    auto it = streams_.find(id);
+    if (it == streams_.end() or it->second.local_closed)
+      return;
+    it->second.end_pending = true;
+    flush(id, it->second);
+    close_if_done(id);
+  }
+
+  void H2_session::flush(uint32_t id, Stream& stream)
+  {
+    while (not stream.pending.empty())
+    {
+      const int64_t n = std::min({int64_t(stream.pending.size()), int64_t(peer_max_frame_),
+                                  send_window_, stream.send_window});
+      if (n <= 0)
+        return;
+      const bool last = size_t(n) == stream.pending.size() and stream.end_pending;
+      write_frame(DATA, last ? END_STREAM : 0, id, {stream.pending.data(), size_t(n)});
+      stream.pending.erase(0, n);
+      send_window_       -= n;
+      stream.send_window -= n;
+      stream.local_closed = last;
+    }
+    if (stream.end_pending and not stream.local_closed)
+    {
+      write_frame(DATA, END_STREAM, id, {});
+      stream.local_closed = true;
+    }
+  }
+
+  void H2_session::close_if_done(uint32_t id)
+  {
+    auto it = streams_.find(id);
+    if (it != streams_.end() and it->second.local_closed and it->second.remote_closed)
+      streams_.erase(it);
+  }
+
+  void H2_session::write_frame(uint8_t type, uint8_t flags, uint32_t stream, util::csview payload)
+  {
+    auto frame = frame_header(type, flags, stream, payload.size());
+    frame.append(payload.data(), payload.size());
+    conn_.stream()->write(std::move(frame));
+  }
+
+  void H2_session::send_settings()
+  {
+    std::string payload;
+    auto setting = [&payload] (uint16_t id, uint32_t value) {
+      payload += static_cast<char>(id >> 8);
+      payload += static_cast<char>(id);
+      append32(payload, value);
+    };
+    setting(h2::MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    setting(ENABLE_PUSH, 0);
+    write_frame(SETTINGS, 0, 0, payload);
+  }
+
+  void H2_session::send_window_update(uint32_t stream, uint32_t increment)
+  {
+    std::string payload;
+    append32(payload, increment);
+    write_frame(WINDOW_UPDATE, 0, stream, payload);
+  }
+
+  void H2_session::reset(uint32_t stream, Error_code code)
+  {
+    std::string payload;
+    append32(payload, code);
+    write_frame(RST_STREAM, 0, stream, payload);
+    streams_.erase(stream);
+  }
+
+  void H2_session::go_away(Error_code code)
+  {
+    std::string payload;
+    append32(payload, last_stream_);
+    append32(payload, code);
+    write_frame(GOAWAY, 0, 0, payload);
+    goaway_ = true;
+    conn_.shutdown();
+  }
+
+  bool H2_response_writer::last(size_t len)
+  {
+    written_ += len;
+    return header().has_field(header::Content_Length)
+      and written_ >= response_->content_length();
+  }
+
+  void H2_response_writer::write(std::string data)
+  {
+    pre_write(data.size());
+    session_.send_data(stream_, data.data(), data.size(), last(data.size()));
+  }
+
+  void H2_response_writer::write(net::tcp::buffer_t buffer)
+  {
+    pre_write(buffer->size());
+    const auto len = buffer->size();
+    session_.send_data(stream_, std::move(buffer), last(len));
+  }
+
+  void H2_response_writer::write_header(status_t code)
+  {
+    if (UNLIKELY(header_sent_))
+      throw Response_writer_error{"Headers already sent."};
+    response_->set_status_code(code);
+    session_.send_headers(stream_, *response_);
+    header_sent_ = true;
+  }
+
+  void H2_response_writer::end()
+  {
+    if (ended_) return;
+    ended_ = true;
+    if (not header_sent_)
+      write_header(response_->status_code());
+    session_.end_stream(stream_);
+  }
+
+}
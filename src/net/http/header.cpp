@@ -3,21 +3,48 @@
 
 namespace http {
 
-///////////////////////////////////////////////////////////////////////////////
-Header::Header() {
-  fields_.reserve(25);
+static bool iequals(util::csview a, util::csview b) noexcept {
+  return std::equal(a.cbegin(), a.cend(), b.cbegin(), b.cend(),
+    [](const auto x, const auto y) { return std::tolower(x) == std::tolower(y); });
 }
 
+///
+/// The fields looked up through {Header::known_}, by their hash
+///
+static constexpr std::array<uint32_t, 16> known_fields {
+  Header::hash("host"),
+  Header::hash("content-length"),
+  Header::hash("content-type"),
+  Header::hash("connection"),
+  Header::hash("transfer-encoding"),
+  Header::hash("accept"),
+  Header::hash("accept-encoding"),
+  Header::hash("user-agent"),
+  Header::hash("cookie"),
+  Header::hash("authorization"),
+  Header::hash("upgrade"),
+  Header::hash("expect"),
+  Header::hash("origin"),
+  Header::hash("range"),
+  Header::hash("if-none-match"),
+  Header::hash("if-modified-since")
+};
+
 ///////////////////////////////////////////////////////////////////////////////
-Header::Header(const std::size_t limit) {
-  fields_.reserve(limit);
-}
+Header::Header()
+  : limit_{25}
+{}
+
+///////////////////////////////////////////////////////////////////////////////
+Header::Header(const std::size_t limit, std::pmr::memory_resource* mr)
+  : limit_{limit}, views_{mr}
+{}
 
 ///////////////////////////////////////////////////////////////////////////////
 bool Header::add_field(std::string field, std::string value) {
   if (field.empty()) return false;
   //-----------------------------------
-  if (size() < fields_.capacity()) {
+  if (size() < limit_) {
     fields_.emplace_back(std::move(field), std::move(value));
     return true;
   }
@@ -36,40 +63,90 @@ bool Header::set_field(std::string field, std::string value) {
     return true;
   }
   //-----------------------------------
-  else return add_field(std::move(field), std::move(value));
+  // an owned value replaces a view
+  const auto view = find_view(field);
+  if (view >= 0) {
+    views_.erase(views_.begin() + view);
+    reindex();
+  }
+  //-----------------------------------
+  return add_field(std::move(field), std::move(value));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Header::set_base(const char* base) noexcept {
+  base_ = base;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool Header::set_field_view(util::csview field, util::csview value) {
+  if (field.empty() || value.empty() || base_ == nullptr) return false;
+  //-----------------------------------
+  const uint32_t value_off = value.data() - base_;
+  //-----------------------------------
+  const auto target = find_view(field);
+  if (target >= 0) {
+    views_[target].value     = value_off;
+    views_[target].value_len = value.size();
+    return true;
+  }
+  //-----------------------------------
+  if (size() >= limit_) return false;
+  //-----------------------------------
+  const auto h = hash(field);
+  views_.push_back({h, static_cast<uint32_t>(field.data() - base_),
+                    static_cast<uint32_t>(field.size()),
+                    value_off, static_cast<uint32_t>(value.size())});
+  //-----------------------------------
+  const auto slot = known_slot(h);
+  if (slot >= 0 and known_[slot] == 0 and views_.size() <= UINT8_MAX)
+    known_[slot] = views_.size();
+  return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 bool Header::has_field(util::csview field) const noexcept {
-  return find(field) not_eq fields_.cend();
+  return find_view(field) >= 0 or find(field) not_eq fields_.cend();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 util::sview Header::value(util::csview field) const noexcept {
   if (field.empty()) return field;
+  if (not views_.empty()) {
+    const auto view = find_view(field);
+    if (view >= 0) return value_of(views_[view]);
+  }
   const auto it = find(field);
   return (it not_eq fields_.cend()) ? util::csview{it->second} : util::sview();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 bool Header::is_empty() const noexcept {
-  return fields_.empty();
+  return fields_.empty() and views_.empty();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 std::size_t Header::size() const noexcept {
-  return fields_.size();
+  return fields_.size() + views_.size();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void Header::erase(util::csview field) noexcept {
   Const_iterator target;
   while ((target = find(field)) not_eq fields_.cend()) fields_.erase(target);
+  //-----------------------------------
+  const auto view = find_view(field);
+  if (view >= 0) {
+    views_.erase(views_.begin() + view);
+    reindex();
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void Header::clear() noexcept {
   fields_.clear();
+  views_.clear();
+  known_.fill(0);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -94,9 +171,43 @@ Header::Const_iterator Header::find(util::csview field) const noexcept {
   //-----------------------------------
   return
     std::find_if(fields_.cbegin(), fields_.cend(), [&field](const auto _) {
-      return std::equal(_.first.cbegin(), _.first.cend(), field.cbegin(), field.cend(),
-        [](const auto a, const auto b) { return std::tolower(a) == std::tolower(b); });
+      return iequals(_.first, field);
     });
 }
 
+///////////////////////////////////////////////////////////////////////////////
+int Header::known_slot(const uint32_t hash) noexcept {
+  for (std::size_t i = 0; i < known_fields.size(); ++i) {
+    if (known_fields[i] == hash) return i;
+  }
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int Header::find_view(util::csview field) const noexcept {
+  if (field.empty() or views_.empty()) return -1;
+  //-----------------------------------
+  const auto h    = hash(field);
+  const auto slot = known_slot(h);
+  if (slot >= 0) {
+    const int idx = known_[slot] - 1;
+    if (idx < 0 and views_.size() <= UINT8_MAX) return -1;
+    if (idx >= 0 and iequals(name_of(views_[idx]), field)) return idx;
+  }
+  //-----------------------------------
+  for (std::size_t i = 0; i < views_.size(); ++i) {
+    if (views_[i].hash == h and iequals(name_of(views_[i]), field)) return i;
+  }
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Header::reindex() noexcept {
+  known_.fill(0);
+  for (std::size_t i = 0; i < views_.size(); ++i) {
+    const auto slot = known_slot(views_[i].hash);
+    if (slot >= 0 and known_[slot] == 0 and i < UINT8_MAX) known_[slot] = i + 1;
+  }
+}
+
 } //< namespace http
@@ -11,6 +11,7 @@ Field Accept_Charset      {"Accept-Charset"};
 Field Accept_Encoding     {"Accept-Encoding"};
 Field Accept_Language     {"Accept-Language"};
 Field Authorization       {"Authorization"};
+Field Cache_Control       {"Cache-Control"};
 Field Cookie              {"Cookie"};
 Field Connection          {"Connection"};
 Field Expect              {"Expect"};
@@ -57,6 +58,7 @@ Field Content_Range       {"Content-Range"};
 Field Content_Type        {"Content-Type"};
 Field Expires             {"Expires"};
 Field Last_Modified       {"Last-Modified"};
+Field Transfer_Encoding   {"Transfer-Encoding"};
 //------------------------------------------------
 //------------------------------------------------
 } //< namespace header
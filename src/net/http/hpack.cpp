@@ -0,0 +1,370 @@
+#include <net/http/hpack.hpp>
+
+#include <array>
+
+namespace http {
+namespace hpack {
+
+static const Field static_table[Table::STATIC_SIZE] {
+  {":authority", ""},                             // 1
+  {":method", "GET"},                             // 2
+  {":method", "POST"},                            // 3
+  {":path", "/"},                                 // 4
+  {":path", "/index.html"},                       // 5
+  {":scheme", "http"},                            // 6
+  {":scheme", "https"},                           // 7
+  {":status", "200"},                             // 8
+  {":status", "204"},                             // 9
+  {":status", "206"},                             // 10
+  {":status", "304"},                             // 11
+  {":status", "400"},                             // 12
+  {":status", "404"},                             // 13
+  {":status", "500"},                             // 14
+  {"accept-charset", ""},                         // 15
+  {"accept-encoding", "gzip, deflate"},           // 16
+  {"accept-language", ""},                        // 17
+  {"accept-ranges", ""},                          // 18
+  {"accept", ""},                                 // 19
+  {"access-control-allow-origin", ""},            // 20
+  {"age", ""},                                    // 21
+  {"allow", ""},                                  // 22
+  {"authorization", ""},                          // 23
+  {"cache-control", ""},                          // 24
+  {"content-disposition", ""},                    // 25
+  {"content-encoding", ""},                       // 26
+  {"content-language", ""},                       // 27
+  {"content-length", ""},                         // 28
+  {"content-location", ""},                       // 29
+  {"content-range", ""},                          // 30
+  {"content-type", ""},                           // 31
+  {"cookie", ""},                                 // 32
+  {"date", ""},                                   // 33
+  {"etag", ""},                                   // 34
+  {"expect", ""},                                 // 35
+  {"expires", ""},                                // 36
+  {"from", ""},                                   // 37
+  {"host", ""},                                   // 38
+  {"if-match", ""},                               // 39
+  {"if-modified-since", ""},                      // 40
+  {"if-none-match", ""},                          // 41
+  {"if-range", ""},                               // 42
+  {"if-unmodified-since", ""},                    // 43
+  {"last-modified", ""},                          // 44
+  {"link", ""},                                   // 45
+  {"location", ""},                               // 46
+  {"max-forwards", ""},                           // 47
+  {"proxy-authenticate", ""},                     // 48
+  {"proxy-authorization", ""},                    // 49
+  {"range", ""},                                  // 50
+  {"referer", ""},                                // 51
+  {"refresh", ""},                                // 52
+  {"retry-after", ""},                            // 53
+  {"server", ""},                                 // 54
+  {"set-cookie", ""},                             // 55
+  {"strict-transport-security", ""},              // 56
+  {"transfer-encoding", ""},                      // 57
+  {"user-agent", ""},                             // 58
+  {"vary", ""},                                   // 59
+  {"via", ""},                                    // 60
+  {"www-authenticate", ""},                       // 61
+};
+
+// code lengths of the symbols, the codes being canonical
+static constexpr uint8_t code_lengths[257] {
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+   6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+   5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+  13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+   7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+  15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+   6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30,
+};
+
+static constexpr int MAX_CODE_LENGTH = 30;
+static constexpr uint16_t EOS = 256;
+
+///
+/// The canonical code of each symbol, and what it takes to decode them
+/// one length at a time: the first code of each length, where its
+/// symbols start in the symbols sorted by code, and how many there are
+///
+struct Huffman {
+  std::array<uint32_t, 257> codes;
+  std::array<uint16_t, 257> sorted;
+  std::array<uint32_t, MAX_CODE_LENGTH + 1> first;
+  std::array<uint16_t, MAX_CODE_LENGTH + 1> offset;
+  std::array<uint16_t, MAX_CODE_LENGTH + 1> count;
+
+  Huffman() noexcept : first{}, offset{}, count{}
+  {
+    for (auto len : code_lengths) count[len]++;
+
+    uint32_t code = 0;
+    uint16_t idx  = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; ++len)
+    {
+      first[len]  = code;
+      offset[len] = idx;
+      for (uint16_t sym = 0; sym <= EOS; ++sym)
+      {
+        if (code_lengths[sym] != len) continue;
+        codes[sym]    = code++;
+        sorted[idx++] = sym;
+      }
+      code <<= 1;
+    }
+  }
+};
+
+static const Huffman huffman;
+
+///////////////////////////////////////////////////////////////////////////////
+bool huffman_decode(const uint8_t* data, size_t len, std::string& out)
+{
+  uint32_t code = 0;
+  int bits = 0;
+  for (size_t i = 0; i < len; ++i)
+  {
+    for (int b = 7; b >= 0; --b)
+    {
+      code = (code << 1) | ((data[i] >> b) & 1);
+      ++bits;
+      if (code - huffman.first[bits] < huffman.count[bits])
+      {
+        const auto sym = huffman.sorted[huffman.offset[bits] + code - huffman.first[bits]];
+        if (sym == EOS) return false;
+        out += static_cast<char>(sym);
+        code = 0;
+        bits = 0;
+      }
+      else if (bits == MAX_CODE_LENGTH) return false;
+    }
+  }
+  // padding is at most 7 bits of the EOS prefix, all ones
+  return bits < 8 and code == (1u << bits) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+size_t huffman_length(util::csview str) noexcept
+{
+  size_t bits = 0;
+  for (const auto c : str) bits += code_lengths[static_cast<uint8_t>(c)];
+  return (bits + 7) / 8;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void huffman_encode(util::csview str, std::string& out)
+{
+  uint64_t acc = 0;
+  int bits = 0;
+  for (const auto c : str)
+  {
+    const auto sym = static_cast<uint8_t>(c);
+    acc = (acc << code_lengths[sym]) | huffman.codes[sym];
+    bits += code_lengths[sym];
+    while (bits >= 8)
+    {
+      bits -= 8;
+      out += static_cast<char>(acc >> bits);
+    }
+  }
+  // pad with the most significant bits of EOS
+  if (bits > 0)
+    out += static_cast<char>((acc << (8 - bits)) | (0xff >> bits));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool decode_integer(const uint8_t*& p, const uint8_t* end, int prefix_bits, uint32_t& out) noexcept
+{
+  if (p >= end) return false;
+  const uint32_t max_prefix = (1u << prefix_bits) - 1;
+  out = *p++ & max_prefix;
+  if (out < max_prefix) return true;
+
+  for (int shift = 0; p < end; shift += 7)
+  {
+    // refuse anything that won't fit
+    if (shift > 28) return false;
+    const uint8_t byte = *p++;
+    const uint64_t value = out + (uint64_t(byte & 0x7f) << shift);
+    if (value > UINT32_MAX) return false;
+    out = value;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void encode_integer(std::string& out, uint8_t first, int prefix_bits, uint32_t value)
+{
+  const uint32_t max_prefix = (1u << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out += static_cast<char>(first | value);
+    return;
+  }
+  out += static_cast<char>(first | max_prefix);
+  value -= max_prefix;
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool decode_string(const uint8_t*& p, const uint8_t* end, std::string& out)
+{
+  if (p >= end) return false;
+  const bool huff = *p & 0x80;
+  uint32_t len;
+  if (not decode_integer(p, end, 7, len)) return false;
+  if (len > size_t(end - p)) return false;
+
+  if (huff) {
+    if (not huffman_decode(p, len, out)) return false;
+  }
+  else out.assign(reinterpret_cast<const char*>(p), len);
+  p += len;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void encode_string(std::string& out, util::csview str)
+{
+  const auto hlen = huffman_length(str);
+  if (hlen < str.size()) {
+    encode_integer(out, 0x80, 7, hlen);
+    huffman_encode(str, out);
+  }
+  else {
+    encode_integer(out, 0x00, 7, str.size());
+    out.append(str.data(), str.size());
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+const Field* Table::get(size_t index) const noexcept
+{
+  if (index == 0) return nullptr;
+  if (index <= STATIC_SIZE) return &static_table[index - 1];
+  index -= STATIC_SIZE + 1;
+  return (index < dynamic_.size()) ? &dynamic_[index] : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Table::insert(Field field)
+{
+  const auto size = entry_size(field);
+  // too big empties the table (RFC 7541 4.4)
+  if (size > max_size_) {
+    dynamic_.clear();
+    size_ = 0;
+    return;
+  }
+  evict(size);
+  dynamic_.push_front(std::move(field));
+  size_ += size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Table::set_max_size(size_t max_size)
+{
+  max_size_ = max_size;
+  evict(0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Table::evict(size_t room)
+{
+  while (not dynamic_.empty() and size_ + room > max_size_) {
+    size_ -= entry_size(dynamic_.back());
+    dynamic_.pop_back();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+size_t Table::find_static(util::csview name, util::csview value, bool& exact) noexcept
+{
+  size_t first = 0;
+  exact = false;
+  for (size_t i = 0; i < STATIC_SIZE; ++i) {
+    if (static_table[i].first != name) continue;
+    if (static_table[i].second == value) {
+      exact = true;
+      return i + 1;
+    }
+    if (first == 0) first = i + 1;
+  }
+  return first;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool Decoder::decode(const uint8_t* data, size_t len, Header_list& out)
+{
+  const uint8_t* p   = data;
+  const uint8_t* end = data + len;
+  while (p < end)
+  {
+    const uint8_t byte = *p;
+    uint32_t index;
+    // indexed field
+    if (byte & 0x80) {
+      if (not decode_integer(p, end, 7, index)) return false;
+      const auto* field = table_.get(index);
+      if (field == nullptr) return false;
+      out.push_back(*field);
+      continue;
+    }
+    // dynamic table size update
+    if ((byte & 0xe0) == 0x20) {
+      uint32_t size;
+      if (not decode_integer(p, end, 5, size) or size > limit_) return false;
+      table_.set_max_size(size);
+      continue;
+    }
+    // literal, with incremental indexing or not (or never)
+    const bool indexing = (byte & 0xc0) == 0x40;
+    if (not decode_integer(p, end, indexing ? 6 : 4, index)) return false;
+
+    Field field;
+    if (index) {
+      const auto* named = table_.get(index);
+      if (named == nullptr) return false;
+      field.first = named->first;
+    }
+    else if (not decode_string(p, end, field.first)) return false;
+    if (not decode_string(p, end, field.second)) return false;
+
+    if (indexing) table_.insert(field);
+    out.push_back(std::move(field));
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Encoder::encode(util::csview name, util::csview value, std::string& out)
+{
+  bool exact;
+  const auto index = Table::find_static(name, value, exact);
+  if (exact) {
+    encode_integer(out, 0x80, 7, index);
+    return;
+  }
+  // literal without indexing
+  encode_integer(out, 0x00, 4, index);
+  if (index == 0) encode_string(out, name);
+  encode_string(out, value);
+}
+
+} //< namespace hpack
+} //< namespace http
@@ -4,8 +4,8 @@
 namespace http {
 
 ///////////////////////////////////////////////////////////////////////////////
-Message::Message(const std::size_t limit) noexcept
-  : header_fields_{limit}, headers_complete_{false}
+Message::Message(const std::size_t limit, std::pmr::memory_resource* mr) noexcept
+  : header_fields_{limit, mr}, headers_complete_{false}
 {}
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1,6 +1,7 @@
 
 #include <http-parser/http_parser.h>
 #include <net/http/request.hpp>
+#include <net/http/scanner.hpp>
 
 namespace http {
 
@@ -26,7 +27,10 @@ static void _GFRGRGRgegerjiuo_()
 
   settings.on_header_value = [](http_parser* parser, const char* at, size_t length) {
     auto req = reinterpret_cast<Request*>(parser->data);
-    req->header().set_field(std::string(req->private_field()), {at, length});
+    if (req->zero_copy())
+      req->header().set_field_view(req->private_field(), {at, length});
+    else
+      req->header().set_field(std::string(req->private_field()), {at, length});
     return 0;
   };
 
@@ -50,20 +54,89 @@ static void _GFRGRGRgegerjiuo_()
 ///
 /// Function to parse the request data
 ///
-static size_t parse_request(Request*, const std::string&) noexcept;
+static size_t parse_request(Request*, util::csview) noexcept;
+
+///
+/// Function to parse a request of the usual kind in one pass
+///
+static bool scan_request(Request*, util::csview);
 
 ///////////////////////////////////////////////////////////////////////////////
-Request::Request(std::string request, const std::size_t limit, const bool parse)
+Request::Request(std::string request, const std::size_t limit,
+                 const bool parse, const bool zero_copy)
   : Message{limit}
-  , request_{std::move(request)}
+  , request_{request.data(), request.size()}
+  , zero_copy_{zero_copy}
 {
   if (parse) this->parse();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+Request::Request(std::pmr::memory_resource* mr, util::csview request,
+                 const std::size_t limit, const bool zero_copy)
+  : Message{limit, mr}
+  , request_{request, mr}
+  , zero_copy_{zero_copy}
+{
+  parse();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Request::Request(Request& other)
+  : Message{other}
+  , request_{other.request_}
+  , zero_copy_{other.zero_copy_}
+  , method_{other.method_}
+  , uri_{other.uri_}
+  , version_{other.version_}
+{
+  rebase();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Request::Request(Request&& other)
+  : Message{std::move(other)}
+  , request_{std::move(other.request_)}
+  , zero_copy_{other.zero_copy_}
+  , method_{other.method_}
+  , uri_{std::move(other.uri_)}
+  , version_{other.version_}
+{
+  rebase();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Request& Request::operator = (Request& other) {
+  Message::operator=(other);
+  request_   = other.request_;
+  zero_copy_ = other.zero_copy_;
+  method_    = other.method_;
+  uri_       = other.uri_;
+  version_   = other.version_;
+  rebase();
+  return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+Request& Request::operator = (Request&& other) {
+  Message::operator=(std::move(other));
+  request_   = std::move(other.request_);
+  zero_copy_ = other.zero_copy_;
+  method_    = other.method_;
+  uri_       = std::move(other.uri_);
+  version_   = other.version_;
+  rebase();
+  return *this;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 Request& Request::parse() {
+  rebase();
+  if (scan_request(this, request_)) {
+    return *this;
+  }
   if (parse_request(this, request_) not_eq request_.length()) {
-    throw Request_error{"Invalid request: " + request_};
+    throw Request_error{"Invalid request: " + std::string{request_.data(), request_.size()}};
   }
 
   return *this;
@@ -125,16 +198,65 @@ Request::operator std::string () const {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-static size_t parse_request(Request* req, const std::string& data) noexcept {
+static size_t parse_request(Request* req, util::csview data) noexcept {
   http_parser parser;
   http_parser_init(&parser, HTTP_REQUEST);
   parser.data = req;
   return http_parser_execute(&parser, &settings, data.data(), data.size());
 }
 
+///////////////////////////////////////////////////////////////////////////////
+static bool scan_request(Request* req, util::csview data) {
+  scanner::Request_line line;
+  const auto head = scanner::scan_request(data, line,
+    [req](util::csview name, util::csview value) {
+      if (req->zero_copy())
+        req->header().set_field_view(name, value);
+      else
+        req->header().set_field(std::string(name), std::string(value));
+    });
+  //-----------------------------------
+  const auto method = http::method::code(line.method);
+  const auto body   = data.substr(head);
+  if (head == 0 or line.major != 1 or method == INVALID
+      or req->header().has_field(header::Transfer_Encoding)
+      or (not body.empty() and not req->header().has_field(header::Content_Length)))
+  {
+    // for http_parser to take on
+    req->header().clear();
+    return false;
+  }
+  //-----------------------------------
+  if (not body.empty())
+  {
+    const auto length = req->header().value(header::Content_Length);
+    bool   valid = not length.empty();
+    size_t content_length = 0;
+    for (const char c : length) {
+      if (c < '0' or c > '9') { valid = false; break; }
+      // as far as telling whether there is more than the body
+      if (content_length <= body.size())
+        content_length = content_length * 10 + (c - '0');
+    }
+    // or the start of another request
+    if (not valid or body.size() > content_length) {
+      req->header().clear();
+      return false;
+    }
+    req->add_chunk(std::string(body));
+  }
+  //-----------------------------------
+  req->set_uri(URI{std::string{line.target}});
+  req->set_version(Version{line.major, line.minor});
+  req->set_method(method);
+  req->set_headers_complete(true);
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 Request& Request::operator << (const std::string& chunk) {
   request_.append(chunk);
+  rebase();
   return *this;
 }
 
@@ -91,6 +91,11 @@ Response& Response::set_version(const Version version) noexcept {
 
 ///////////////////////////////////////////////////////////////////////////////
 std::string Response::status_line() const noexcept {
+  if (version_ == Version{1, 1}) {
+    const auto line = status_line_1_1(code_);
+    if (not line.empty())
+      return std::string(line.data(), line.size() - 2);
+  }
   std::ostringstream status_line;
   //-----------------------------------
   status_line << version_ << " " << code_ << " "
@@ -107,6 +112,11 @@ Response& Response::reset() noexcept {
 
 ///////////////////////////////////////////////////////////////////////////////
 std::string Response::to_string() const {
+  if (version_ == Version{1, 1}) {
+    const auto line = status_line_1_1(code_);
+    if (not line.empty())
+      return std::string(line) + Message::to_string();
+  }
   std::ostringstream response;
   //-----------------------------------
   response << version_ << " " << code_ << " "
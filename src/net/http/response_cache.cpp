@@ -0,0 +1,443 @@
+#include <net/http/response_cache.hpp>
+#include <net/http/time.hpp>
+#include <rtc>
+#include <strings.h>
+
+namespace http {
+
+  static bool iequals(util::csview a, util::csview b) noexcept
+  {
+    return a.size() == b.size() and strncasecmp(a.data(), b.data(), a.size()) == 0;
+  }
+
+  static std::string_view trim(std::string_view s) noexcept
+  {
+    while (not s.empty() and (s.front() == ' ' or s.front() == '\t')) s.remove_prefix(1);
+    while (not s.empty() and (s.back() == ' ' or s.back() == '\t')) s.remove_suffix(1);
+    return s;
+  }
+
+  // calls @fn with each item of a comma separated list
+  template <typename Fn>
+  static void for_each_item(std::string_view list, Fn&& fn)
+  {
+    while (not list.empty())
+    {
+      const auto comma = list.find(',');
+      const auto item = trim(list.substr(0, comma));
+      if (not item.empty()) fn(item);
+      if (comma == std::string_view::npos) break;
+      list.remove_prefix(comma + 1);
+    }
+  }
+
+  // the seconds of a "name=N" directive, or -1
+  static long directive_seconds(util::csview item, util::csview name) noexcept
+  {
+    if (item.size() <= name.size() + 1 or item[name.size()] != '='
+        or not iequals(item.substr(0, name.size()), name))
+      return -1;
+    long secs = 0;
+    for (const char c : item.substr(name.size() + 1)) {
+      if (c < '0' or c > '9') return -1;
+      secs = std::min(secs * 10 + (c - '0'), 0x7fffffffL);
+    }
+    return secs;
+  }
+
+  // the client wants the origin asked, not a stored answer
+  static bool wants_revalidation(const Request& req) noexcept
+  {
+    bool revalidate = false;
+    for_each_item(req.header().value(header::Cache_Control), [&] (util::csview item) {
+      if (iequals(item, "no-cache") or directive_seconds(item, "max-age") == 0)
+        revalidate = true;
+    });
+    return revalidate;
+  }
+
+  // fields about the connection, or made again for each response
+  static bool is_kept(util::csview field) noexcept
+  {
+    static const char* dropped[] {
+      "Connection", "Keep-Alive", "Transfer-Encoding", "TE", "Trailer", "Upgrade",
+      "Proxy-Connection", "Proxy-Authenticate", "Content-Length", "Date", "Age"
+    };
+    for (const char* name : dropped)
+      if (iequals(field, name)) return false;
+    return true;
+  }
+
+  // the body of a response written to a client, as it came
+  static void write_response(Response_writer& res, const Response& from, bool head)
+  {
+    auto& header = res.header();
+    from.header().for_each([&header] (util::csview name, util::csview value) {
+      if (is_kept(name)) header.add_field(std::string(name), std::string(value));
+    });
+    const auto status = from.status_code();
+    const auto body = from.body();
+    if (status != Not_Modified and status != No_Content)
+      res.response_ptr()->set_content_length(body.size());
+    res.write_header(status);
+    if (not head and not body.empty())
+      res.write(std::string(body));
+  }
+
+  static void write_error(Response_writer& res, status_t code)
+  {
+    res.response_ptr()->set_content_length(0);
+    res.write_header(code);
+  }
+
+  size_t Response_cache::Entry::bytes() const noexcept
+  {
+    size_t total = sizeof(Entry) + etag.size() + body->size();
+    for (const auto& field : fields)
+      total += field.first.size() + field.second.size();
+    return total;
+  }
+
+  Response_cache::Response_cache(size_t capacity)
+    : capacity_{capacity},
+      shrinker_{os::mem::add_shrinker("http.cache", os::mem::Shrink_cost::moderate,
+                                      {this, &Response_cache::shrink})}
+  {
+  }
+
+  Response_cache::~Response_cache()
+  {
+    os::mem::remove_shrinker(shrinker_);
+  }
+
+  bool Response_cache::cacheable(const Request& req) noexcept
+  {
+    if (req.method() != GET and req.method() != HEAD)
+      return false;
+    // what is behind it differs by who asks
+    if (req.header().has_field(header::Authorization))
+      return false;
+    bool store = true;
+    for_each_item(req.header().value(header::Cache_Control), [&] (util::csview item) {
+      if (iequals(item, "no-store")) store = false;
+    });
+    return store;
+  }
+
+  long Response_cache::lifetime(const Response& res, std::time_t now)
+  {
+    bool keep = true;
+    bool no_cache = false;
+    long max_age = -1;
+    long s_maxage = -1;
+    for_each_item(res.header().value(header::Cache_Control), [&] (util::csview item) {
+      if (iequals(item, "no-store") or iequals(item, "private"))
+        keep = false;
+      else if (iequals(item, "no-cache"))
+        no_cache = true;
+      else if (const long secs = directive_seconds(item, "s-maxage"); secs >= 0)
+        s_maxage = secs;
+      else if (const long secs = directive_seconds(item, "max-age"); secs >= 0)
+        max_age = secs;
+    });
+    if (not keep) return -1;
+    if (no_cache) return 0;
+    if (s_maxage >= 0) return s_maxage;
+    if (max_age >= 0) return max_age;
+
+    const auto expires = res.header().value(header::Expires);
+    if (expires.empty()) return -1;
+    const auto until = time::to_time_t(expires);
+    // an invalid date means it has expired already
+    if (until <= 0) return 0;
+    const auto date = res.header().value(header::Date);
+    const auto from = date.empty() ? now : time::to_time_t(date);
+    return (until > from) ? until - from : 0;
+  }
+
+  std::string Response_cache::url_key(const Request& req)
+  {
+    std::string key{req.header().value(header::Host)};
+    key.append(" ").append(req.uri().to_string());
+    return key;
+  }
+
+  std::string Response_cache::key_of(const Request& req) const
+  {
+    auto key = url_key(req);
+    auto it = vary_.find(key);
+    if (it != vary_.end())
+    {
+      for (const auto& field : it->second)
+      {
+        const auto value = req.header().value(field);
+        key.append("\n").append(value.data(), value.size());
+      }
+    }
+    return key;
+  }
+
+  Response_cache::Entry* Response_cache::lookup(const std::string& key)
+  {
+    auto it = index_.find(key);
+    if (it == index_.end())
+      return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->entry;
+  }
+
+  const Response_cache::Entry* Response_cache::find(const Request& req) const
+  {
+    auto it = index_.find(key_of(req));
+    return (it != index_.end()) ? &it->second->entry : nullptr;
+  }
+
+  bool Response_cache::store(const Request& req, const Response& res)
+  {
+    if (req.method() != GET or not cacheable(req))
+      return false;
+
+    // those that may be cached without being told so, when they are told
+    switch (res.status_code()) {
+      case OK: case Non_Authoritative: case No_Content:
+      case Multiple_Choices: case Moved_Permanently:
+      case Not_Found: case Method_Not_Allowed: case Gone:
+      case URI_Too_Long: case Not_Implemented:
+        break;
+      default:
+        return false;
+    }
+    const auto now = RTC::now();
+    const long ttl = lifetime(res, now);
+    const auto etag = res.header().value(header::ETag);
+    if (ttl < 0 or (ttl == 0 and etag.empty()))
+      return false;
+    if (res.header().has_field(header::Set_Cookie))
+      return false;
+
+    std::vector<std::string> vary;
+    bool any = false;
+    for_each_item(res.header().value(header::Vary), [&] (util::csview item) {
+      if (item == "*") any = true;
+      vary.emplace_back(item);
+    });
+    if (any) return false;
+
+    Entry entry;
+    entry.status = res.status_code();
+    res.header().for_each([&entry] (util::csview name, util::csview value) {
+      if (is_kept(name)) entry.fields.emplace_back(std::string(name), std::string(value));
+    });
+    const auto body = res.body();
+    entry.body    = net::tcp::construct_buffer(body.begin(), body.end());
+    entry.etag    = std::string(etag);
+    entry.stored  = now;
+    entry.expires = now + ttl;
+    const size_t bytes = entry.bytes();
+    // one response may not push out all the others
+    if (bytes > capacity_ / 4)
+      return false;
+
+    const auto url = url_key(req);
+    if (vary.empty()) vary_.erase(url);
+    else vary_[url] = std::move(vary);
+    auto key = key_of(req);
+
+    auto it = index_.find(key);
+    if (it != index_.end())
+    {
+      bytes_ -= it->second->entry.bytes();
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+    lru_.push_front({key, std::move(entry)});
+    index_.emplace(std::move(key), lru_.begin());
+    bytes_ += bytes;
+    evict(capacity_);
+    return true;
+  }
+
+  void Response_cache::erase(const Request& req)
+  {
+    const auto url = url_key(req);
+    for (auto it = lru_.begin(); it != lru_.end(); )
+    {
+      // the key of a variant is the URL and then its fields, by line
+      const auto& key = it->key;
+      if (key.compare(0, url.size(), url) == 0
+          and (key.size() == url.size() or key[url.size()] == '\n'))
+      {
+        bytes_ -= it->entry.bytes();
+        index_.erase(key);
+        it = lru_.erase(it);
+      }
+      else ++it;
+    }
+    vary_.erase(url);
+  }
+
+  void Response_cache::clear() noexcept
+  {
+    index_.clear();
+    lru_.clear();
+    vary_.clear();
+    bytes_ = 0;
+  }
+
+  void Response_cache::evict(size_t target) noexcept
+  {
+    while (bytes_ > target and not lru_.empty())
+    {
+      auto& node = lru_.back();
+      bytes_ -= node.entry.bytes();
+      index_.erase(node.key);
+      lru_.pop_back();
+    }
+  }
+
+  size_t Response_cache::shrink(os::mem::Pressure level)
+  {
+    const size_t before = bytes_;
+    evict(level == os::mem::Pressure::critical ? 0 : bytes_ / 2);
+    return before - bytes_;
+  }
+
+  void Response_cache::write(const Request& req, const Entry& entry, Response_writer& res)
+  {
+    auto& header = res.header();
+    for (const auto& field : entry.fields)
+      header.add_field(field.first, field.second);
+    const auto age = std::max<std::time_t>(0, RTC::now() - entry.stored);
+    header.set_field(header::Age, std::to_string(age));
+
+    // the client has it already
+    const auto inm = req.header().value(header::If_None_Match);
+    if (not inm.empty() and not entry.etag.empty() and (inm == entry.etag or inm == "*"))
+    {
+      res.write_header(Not_Modified);
+      return;
+    }
+    res.response_ptr()->set_content_length(entry.body->size());
+    res.write_header(entry.status);
+    // the cached buffer goes out as it is
+    if (req.method() != HEAD and not entry.body->empty())
+      res.write(entry.body);
+  }
+
+  bool Response_cache::serve(const Request& req, Response_writer& res)
+  {
+    if (not cacheable(req) or wants_revalidation(req))
+      return false;
+    const auto* entry = lookup(key_of(req));
+    if (entry == nullptr or entry->expires <= RTC::now())
+      return false;
+    hits_++;
+    write(req, *entry, res);
+    return true;
+  }
+
+  void Response_cache::pass(Request_ptr req, Response_writer_ptr res, Fetch& fetch)
+  {
+    // only called once, so it can own them
+    auto* waiter = new Waiter{std::move(req), std::move(res)};
+    fetch(*waiter->req, {}, [waiter] (Response_ptr response) {
+      if (response != nullptr)
+        write_response(*waiter->res, *response, waiter->req->method() == HEAD);
+      else
+        write_error(*waiter->res, Bad_Gateway);
+      delete waiter;
+    });
+  }
+
+  void Response_cache::handle(Request_ptr req, Response_writer_ptr res, Fetch fetch)
+  {
+    if (not cacheable(*req))
+    {
+      pass(std::move(req), std::move(res), fetch);
+      return;
+    }
+    if (serve(*req, *res))
+      return;
+    misses_++;
+
+    auto key = key_of(*req);
+    auto it = pending_.find(key);
+    if (it != pending_.end())
+    {
+      coalesced_++;
+      it->second.waiters.push_back({std::move(req), std::move(res)});
+      return;
+    }
+    // nothing of a HEAD response is kept
+    if (req->method() == HEAD)
+    {
+      pass(std::move(req), std::move(res), fetch);
+      return;
+    }
+
+    auto& pending = pending_[key];
+    pending.key   = std::move(key);
+    pending.fetch = fetch;
+    // a stale entry is asked for again, only if it changed
+    if (const auto* entry = lookup(pending.key); entry != nullptr)
+      pending.etag = entry->etag;
+    pending.waiters.push_back({std::move(req), std::move(res)});
+    fetch(*pending.waiters.front().req, pending.etag,
+          [this, p = &pending] (Response_ptr response) {
+            fetched(*p, std::move(response));
+          });
+  }
+
+  void Response_cache::fetched(Pending& pending, Response_ptr response)
+  {
+    auto key     = std::move(pending.key);
+    auto etag    = std::move(pending.etag);
+    auto fetch   = std::move(pending.fetch);
+    auto waiters = std::move(pending.waiters);
+    pending_.erase(key);
+
+    if (response == nullptr)
+    {
+      for (auto& w : waiters)
+        write_error(*w.res, Bad_Gateway);
+      return;
+    }
+
+    bool stored = false;
+    const bool not_modified = response->status_code() == Not_Modified and not etag.empty();
+    if (not_modified)
+    {
+      // still the same, fresh for as long as the origin now says
+      if (auto* entry = lookup(key); entry != nullptr)
+      {
+        const auto now = RTC::now();
+        entry->stored  = now;
+        entry->expires = now + std::max(0L, lifetime(*response, now));
+        stored = true;
+      }
+    }
+    else {
+      stored = store(*waiters.front().req, *response);
+    }
+
+    for (auto& w : waiters)
+    {
+      if (stored)
+      {
+        if (const auto* entry = lookup(key_of(*w.req)); entry != nullptr)
+        {
+          write(*w.req, *entry, *w.res);
+          continue;
+        }
+      }
+      if (&w == &waiters.front() and not not_modified)
+      {
+        write_response(*w.res, *response, false);
+        continue;
+      }
+      // it varies for them, or wasn't stored: each asks on its own
+      pass(std::move(w.req), std::move(w.res), fetch);
+    }
+  }
+
+} // < namespace http
@@ -0,0 +1,336 @@
+#include <net/http/response_compressor.hpp>
+#include <net/ws/deflate.hpp>
+#include <util/crc32.hpp>
+#include <smp>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <strings.h>
+
+namespace http {
+
+  using Coding   = Response_compressor::Coding;
+  using buffer_t = Response_compressor::buffer_t;
+
+  static const uint8_t GZIP_HEADER[] {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+  static const uint8_t ZLIB_HEADER[] {0x78, 0x01};
+  // the sync flush a WS_deflater leaves out, then an empty last block
+  static const uint8_t SYNC_FLUSH[] {0x00, 0x00, 0xff, 0xff};
+  static const uint8_t LAST_BLOCK[] {0x03, 0x00};
+
+  // a compressor for each CPU, kept for its tables
+  static std::array<std::unique_ptr<net::WS_deflater>, SMP_MAX_CORES> deflaters;
+
+  // DEFLATE blocks of @data, not the last, ending on a byte so that
+  // blocks compressed apart can follow each other
+  static void deflate_block(const uint8_t* data, size_t len, std::vector<uint8_t>& out)
+  {
+    auto& deflater = PER_CPU(deflaters);
+    if (deflater == nullptr)
+      deflater = std::make_unique<net::WS_deflater>();
+    deflater->compress(data, len, out, true);
+    out.insert(out.end(), std::begin(SYNC_FLUSH), std::end(SYNC_FLUSH));
+  }
+
+  static uint32_t adler32(const uint8_t* data, size_t len) noexcept
+  {
+    uint32_t a = 1, b = 0;
+    while (len > 0)
+    {
+      // the sums can't overflow over this many bytes
+      const size_t n = std::min<size_t>(len, 5552);
+      for (size_t i = 0; i < n; i++) {
+        a += data[i];
+        b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+      data += n;
+      len  -= n;
+    }
+    return (b << 16) | a;
+  }
+
+  static uint32_t checksum(Coding coding, const uint8_t* data, size_t len) noexcept
+  {
+    return (coding == Coding::GZIP) ? crc32(data, len) : adler32(data, len);
+  }
+
+  static void put_header(Coding coding, std::vector<uint8_t>& out)
+  {
+    if (coding == Coding::GZIP)
+      out.insert(out.end(), std::begin(GZIP_HEADER), std::end(GZIP_HEADER));
+    else
+      out.insert(out.end(), std::begin(ZLIB_HEADER), std::end(ZLIB_HEADER));
+  }
+
+  static void put_trailer(Coding coding, uint32_t check, size_t len, std::vector<uint8_t>& out)
+  {
+    // gzip: CRC-32 and length, little endian. zlib: Adler-32, big endian
+    if (coding == Coding::GZIP) {
+      for (int i = 0; i < 32; i += 8) out.push_back(check >> i);
+      for (int i = 0; i < 32; i += 8) out.push_back(uint32_t(len) >> i);
+    }
+    else {
+      for (int i = 24; i >= 0; i -= 8) out.push_back(check >> i);
+    }
+  }
+
+  // run @fn on @cpu, right away when already there
+  template <typename Fn>
+  static void on_cpu(int cpu, Fn fn)
+  {
+    if (SMP::cpu_id() == cpu)
+      fn();
+    else if (cpu == 0)
+      SMP::add_bsp_task(std::move(fn));
+    else {
+      SMP::add_task(std::move(fn), cpu);
+      SMP::signal(cpu);
+    }
+  }
+
+  static void write_plain(Response_writer& res, buffer_t body, status_t code)
+  {
+    res.response_ptr()->set_content_length(body->size());
+    res.write_header(code);
+    if (not body->empty())
+      res.write(std::move(body));
+  }
+
+  struct Response_compressor::Job
+  {
+    Response_writer_ptr res;
+    buffer_t  body;
+    Coding    coding;
+    status_t  code;
+    int       owner;
+    size_t    count;
+    // compressed by the workers, each only its own
+    std::vector<buffer_t> blocks;
+    // those back on the owner, only touched there
+    std::vector<uint8_t>  ready;
+    size_t    next = 0;
+    uint32_t  check = 0;
+    bool      check_ready = false;
+    // sent as it is, the rest of the work needn't be done
+    std::atomic<bool> given_up {false};
+  };
+
+  const char* Response_compressor::to_string(Coding coding) noexcept
+  {
+    switch (coding) {
+      case Coding::GZIP:    return "gzip";
+      case Coding::DEFLATE: return "deflate";
+      default:              return "identity";
+    }
+  }
+
+  // the quality of "q=N" parameters, in thousandths
+  static int quality(util::sview params) noexcept
+  {
+    const auto q = params.find("q=");
+    if (q == util::sview::npos)
+      return 1000;
+    auto value = params.substr(q + 2);
+    if (value.empty() or value[0] < '0' or value[0] > '1')
+      return 0;
+    int result = (value[0] - '0') * 1000;
+    if (value.size() > 1 and value[1] == '.')
+    {
+      int scale = 100;
+      for (size_t i = 2; i < value.size() and scale > 0; i++, scale /= 10) {
+        if (value[i] < '0' or value[i] > '9') break;
+        result += (value[i] - '0') * scale;
+      }
+    }
+    return std::min(result, 1000);
+  }
+
+  Coding Response_compressor::negotiate(util::csview accept_encoding) noexcept
+  {
+    int gzip = -1, deflate = -1, any = -1;
+    util::sview rest = accept_encoding;
+    while (not rest.empty())
+    {
+      const auto comma = rest.find(',');
+      auto coding = rest.substr(0, comma);
+      rest = (comma == util::sview::npos) ? util::sview{} : rest.substr(comma + 1);
+
+      const auto semi = coding.find(';');
+      const auto params = (semi == util::sview::npos) ? util::sview{} : coding.substr(semi + 1);
+      coding = coding.substr(0, semi);
+      while (not coding.empty() and coding.front() == ' ') coding.remove_prefix(1);
+      while (not coding.empty() and coding.back() == ' ') coding.remove_suffix(1);
+
+      if (coding == "gzip" or coding == "x-gzip") gzip = quality(params);
+      else if (coding == "deflate")              deflate = quality(params);
+      else if (coding == "*")                    any = quality(params);
+    }
+    // those not named are as acceptable as "*"
+    if (gzip < 0) gzip = std::max(any, 0);
+    if (deflate < 0) deflate = std::max(any, 0);
+
+    if (gzip > 0 and gzip >= deflate)
+      return Coding::GZIP;
+    if (deflate > 0)
+      return Coding::DEFLATE;
+    return Coding::IDENTITY;
+  }
+
+  bool Response_compressor::compressible(util::csview content_type) noexcept
+  {
+    const auto type = content_type.substr(0, content_type.find(';'));
+    if (type.size() >= 5 and strncasecmp(type.data(), "text/", 5) == 0)
+      return true;
+    for (const char* kind : {"json", "javascript", "ecmascript", "xml"})
+    {
+      // application/json, application/ld+json, image/svg+xml ...
+      const size_t n = strlen(kind);
+      for (size_t at = 0; at + n <= type.size(); at++)
+        if (strncasecmp(type.data() + at, kind, n) == 0)
+          return true;
+    }
+    return false;
+  }
+
+  buffer_t Response_compressor::compress(Coding coding, const uint8_t* data, size_t len)
+  {
+    Expects(coding != Coding::IDENTITY);
+    std::vector<uint8_t> out;
+    out.reserve(len / 2 + 32);
+    put_header(coding, out);
+    deflate_block(data, len, out);
+    out.insert(out.end(), std::begin(LAST_BLOCK), std::end(LAST_BLOCK));
+    put_trailer(coding, checksum(coding, data, len), len, out);
+    return net::tcp::construct_buffer(out.begin(), out.end());
+  }
+
+  void Response_compressor::send(const Request& req, Response_writer_ptr res,
+                                 buffer_t body, status_t code)
+  {
+    auto& header = res->header();
+    if (body->size() < config_.min_size or code == No_Content or code == Not_Modified
+        or header.has_field(header::Content_Encoding)
+        or not compressible(header.value(header::Content_Type)))
+    {
+      write_plain(*res, std::move(body), code);
+      return;
+    }
+    // the body is as the Accept-Encoding asked for it
+    header.add_field(header::Vary, "Accept-Encoding");
+    const auto coding = negotiate(req.header().value(header::Accept_Encoding));
+    if (coding == Coding::IDENTITY)
+    {
+      write_plain(*res, std::move(body), code);
+      return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->res    = std::move(res);
+    job->body   = std::move(body);
+    job->coding = coding;
+    job->code   = code;
+    job->owner  = SMP::cpu_id();
+    const size_t len   = job->body->size();
+    const size_t block = config_.block_size;
+    job->count = (len + block - 1) / block;
+    job->blocks.resize(job->count);
+    job->ready.resize(job->count);
+
+    // blocks to any CPU that has time, each back to this one when done
+    for (size_t i = 0; i < job->count; i++)
+    {
+      // a small (or incompressible) body may be written already
+      if (job->res == nullptr) return;
+      SMP::add_balanced_task([this, job, i] {
+        if (job->given_up.load(std::memory_order_relaxed)) return;
+        const size_t block = config_.block_size;
+        const auto* data = job->body->data();
+        const size_t len = job->body->size();
+        const size_t from = i * block;
+        const size_t n = std::min(block, len - from);
+        if (job->count == 1) {
+          job->blocks[i] = compress(job->coding, data, len);
+        }
+        else {
+          std::vector<uint8_t> out;
+          out.reserve(n / 2 + 32);
+          if (i == 0) put_header(job->coding, out);
+          deflate_block(data + from, n, out);
+          if (i == job->count - 1)
+            out.insert(out.end(), std::begin(LAST_BLOCK), std::end(LAST_BLOCK));
+          job->blocks[i] = net::tcp::construct_buffer(out.begin(), out.end());
+        }
+        on_cpu(job->owner, [this, job, i] {
+          job->ready[i] = 1;
+          block_done(*job);
+        });
+      });
+    }
+    // the checksum of a body in blocks goes at the end
+    if (job->count > 1 and job->res != nullptr)
+    {
+      SMP::add_balanced_task([this, job] {
+        if (job->given_up.load(std::memory_order_relaxed)) return;
+        const uint32_t check = checksum(job->coding, job->body->data(), job->body->size());
+        on_cpu(job->owner, [this, job, check] {
+          job->check = check;
+          job->check_ready = true;
+          block_done(*job);
+        });
+      });
+    }
+  }
+
+  void Response_compressor::block_done(Job& job)
+  {
+    if (job.res == nullptr)
+      return;
+
+    while (job.next < job.count and job.ready[job.next])
+    {
+      auto& block = job.blocks[job.next];
+      if (job.next == 0)
+      {
+        // not worth it, when the first block hardly got smaller
+        const size_t in = std::min(config_.block_size, job.body->size());
+        if (block->size() * 100 > in * config_.max_ratio)
+        {
+          skipped_++;
+          job.given_up = true;
+          // the workers may still be reading it
+          write_plain(*job.res, job.body, job.code);
+          job.res = nullptr;
+          return;
+        }
+        job.res->header().set_field(header::Content_Encoding, to_string(job.coding));
+        bytes_in_ += job.body->size();
+        if (job.count == 1)
+        {
+          compressed_++;
+          bytes_out_ += block->size();
+          write_plain(*job.res, std::move(block), job.code);
+          job.res = nullptr;
+          return;
+        }
+        job.res->begin_chunked(job.code);
+      }
+      bytes_out_ += block->size();
+      job.res->write(std::move(block));
+      job.next++;
+    }
+
+    if (job.next == job.count and job.check_ready)
+    {
+      std::vector<uint8_t> trailer;
+      put_trailer(job.coding, job.check, job.body->size(), trailer);
+      bytes_out_ += trailer.size();
+      job.res->write(net::tcp::construct_buffer(trailer.begin(), trailer.end()));
+      job.res->end();
+      job.res = nullptr;
+      compressed_++;
+    }
+  }
+
+} // < namespace http
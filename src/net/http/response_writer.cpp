@@ -1,7 +1,6 @@
 
 #include <net/http/response_writer.hpp>
-
-#include <sstream>
+#include <net/http/time.hpp>
 
 namespace http {
 
@@ -12,10 +11,27 @@ namespace http {
     Ensures(not connection_.released());
   }
 
+  // the line before a chunk: its size in hex
+  static std::string chunk_size_line(size_t len)
+  {
+    char line[24];
+    const int n = snprintf(line, sizeof(line), "%zx\r\n", len);
+    return std::string(line, n);
+  }
+
   void Response_writer::write(std::string data)
   {
     pre_write(data.size());
 
+    if(chunked_)
+    {
+      // an empty chunk would end the body
+      if(data.empty()) return;
+      auto chunk = chunk_size_line(data.size());
+      chunk.reserve(chunk.size() + data.size() + 2);
+      chunk.append(data).append("\r\n");
+      data = std::move(chunk);
+    }
     connection_.stream()->write(std::move(data));
   }
 
@@ -23,11 +39,29 @@ namespace http {
   {
     pre_write(buffer->size());
 
+    if(chunked_)
+    {
+      if(buffer->empty()) return;
+      static const uint8_t crlf[] {'\r', '\n'};
+      const auto line = chunk_size_line(buffer->size());
+      auto head = net::Stream::construct_buffer(line.begin(), line.end());
+      auto tail = net::Stream::construct_buffer(std::begin(crlf), std::end(crlf));
+      connection_.stream()->writev({std::move(head), std::move(buffer), std::move(tail)});
+      return;
+    }
     connection_.stream()->write(std::move(buffer));
   }
 
   void Response_writer::pre_write(size_t len)
   {
+    // no length to keep to
+    if(streaming_)
+    {
+      if(UNLIKELY(ended_))
+        throw Response_writer_error{"Trying to write after the end of a streamed body"};
+      return;
+    }
+
     // send headers if not already sent
     if(not header_sent_)
     {
@@ -62,10 +96,28 @@ namespace http {
     {
       response_->set_status_code(code);
 
-      std::ostringstream header;
-      header << response_->status_line() << "\r\n" << response_->header();
+      std::string header;
+      header.reserve(256);
+      const auto line = (response_->version() == Version{1, 1})
+        ? status_line_1_1(code) : util::sview{};
+      if (LIKELY(not line.empty()))
+        header.append(line.data(), line.size());
+      else
+        header.append(response_->status_line()).append("\r\n");
+
+      // an origin server with a clock must send the date (RFC 7231 7.1.1.2)
+      if (not response_->header().has_field(http::header::Date)) {
+        const auto date = time::cached_now();
+        header.append("Date: ").append(date.data(), date.size()).append("\r\n");
+      }
+      response_->header().for_each([&header] (util::csview name, util::csview value) {
+        header.append(name.data(), name.size()).append(": ")
+              .append(value.data(), value.size()).append("\r\n");
+      });
+      header.append("\r\n");
 
-      connection_.stream()->write(header.str());
+      connection_.stream()->write(std::move(header));
+      header_sent_ = true;
 
       // disable keep alive if "Connection: close" is present
       if(response_->header().value(http::header::Connection) == "close")
@@ -83,8 +135,71 @@ namespace http {
       write_header(response_->status_code());
   }
 
+  void Response_writer::begin_chunked(status_t code)
+  {
+    if(header_sent_)
+      throw Response_writer_error{"Headers already sent."};
+    header().erase(header::Content_Length);
+    if(response_->version() == Version{1, 1})
+    {
+      header().set_field(header::Transfer_Encoding, "chunked");
+      chunked_ = true;
+    }
+    // the end of the body is the end of the connection
+    else if(response_->version() < Version{1, 1})
+    {
+      connection_.keep_alive(false);
+    }
+    streaming_ = true;
+    write_header(code);
+    connection_.stream()->set_write_watermarks(STREAM_HIGH_WATERMARK, STREAM_LOW_WATERMARK);
+  }
+
+  bool Response_writer::writable() const
+  {
+    return not connection_.released()
+      and not connection_.stream()->write_blocked();
+  }
+
+  void Response_writer::stream(Producer producer)
+  {
+    Expects(producer != nullptr);
+    producer_ = std::move(producer);
+    if(not streaming_)
+      begin_chunked(response_->status_code());
+    resume();
+  }
+
+  void Response_writer::resume()
+  {
+    // not from within the producer, it is called again when it returns true
+    if(producing_ or ended_ or producer_ == nullptr)
+      return;
+    producing_ = true;
+    while(not ended_ and writable())
+    {
+      if(not producer_(*this))
+        break;
+    }
+    producing_ = false;
+    // called again when the connection has taken what is queued
+    if(not ended_ and not connection_.released() and not writable())
+      connection_.stream()->on_drain({this, &Response_writer::resume});
+  }
+
   void Response_writer::end()
   {
+    // only once, as the connection may have moved on to the next request
+    if(ended_) return;
+    ended_ = true;
+    if(streaming_ and not connection_.released())
+    {
+      if(chunked_)
+        connection_.stream()->write(std::string("0\r\n\r\n"));
+      // the next response on the connection isn't bounded
+      connection_.stream()->on_drain(nullptr);
+      connection_.stream()->set_write_watermarks(0, 0);
+    }
     connection_.end();
   }
 
@@ -0,0 +1,209 @@
+#include <net/http/scanner.hpp>
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  #include <immintrin.h>
+  #include <kernel/cpuid.hpp>
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
+#include <common>
+
+namespace http {
+namespace scanner {
+
+/**
+ *  The kernels look at whole blocks from @p, and return the first byte
+ *  they stop at, or where fewer than a block is left, for the scalar
+ *  code to go on from.
+ */
+using scan_kernel_t = const char* (*)(const char* p, const char* end);
+
+struct Scan_kernel {
+  const char*   name;
+  bool          (*available)();
+  scan_kernel_t line_end;
+  scan_kernel_t target_end;
+};
+
+static inline bool stops_line(const uint8_t c) noexcept
+{ return (c < 0x20 and c != '\t') or c == 0x7f; }
+
+static inline bool stops_target(const uint8_t c) noexcept
+{ return c <= 0x20 or c >= 0x7f; }
+
+static const char* scan_scalar(const char* p, const char*)
+{
+  // all of it is left to the scalar tail
+  return p;
+}
+
+static bool always() { return true; }
+
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+// CPU support is not enough, the OS must save the register state (XCR0)
+static bool os_saves(uint64_t mask)
+{
+  if (not CPUID::has_feature(CPUID::Feature::OSXSAVE)) return false;
+  uint32_t lo, hi;
+  asm volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((((uint64_t) hi << 32) | lo) & mask) == mask;
+}
+
+static bool has_sse2()
+{ return CPUID::has_feature(CPUID::Feature::SSE2); }
+
+/**
+ *  There are no unsigned compares, but v <= N where max(v, N) == N,
+ *  and v >= N where min(v, N) == N.
+ */
+__attribute__((target("sse2")))
+static const char* line_end_sse2(const char* p, const char* end)
+{
+  const __m128i ctl = _mm_set1_epi8(0x1f);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i del = _mm_set1_epi8(0x7f);
+  for (; end - p >= 16; p += 16)
+  {
+    const __m128i v = _mm_loadu_si128((const __m128i*) p);
+    __m128i stop = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl);
+    stop = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), stop);
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, del));
+    const int mask = _mm_movemask_epi8(stop);
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return p;
+}
+
+__attribute__((target("sse2")))
+static const char* target_end_sse2(const char* p, const char* end)
+{
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i del   = _mm_set1_epi8(0x7f);
+  for (; end - p >= 16; p += 16)
+  {
+    const __m128i v = _mm_loadu_si128((const __m128i*) p);
+    const __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, space), space),
+                                      _mm_cmpeq_epi8(_mm_min_epu8(v, del), del));
+    const int mask = _mm_movemask_epi8(stop);
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return p;
+}
+
+static bool has_avx2()
+{
+  return CPUID::has_feature(CPUID::Feature::AVX2) and os_saves(0x6);
+}
+
+__attribute__((target("avx2")))
+static const char* line_end_avx2(const char* p, const char* end)
+{
+  const __m256i ctl = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  for (; end - p >= 32; p += 32)
+  {
+    const __m256i v = _mm256_loadu_si256((const __m256i*) p);
+    __m256i stop = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl), ctl);
+    stop = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), stop);
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, del));
+    const uint32_t mask = _mm256_movemask_epi8(stop);
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return p;
+}
+
+__attribute__((target("avx2")))
+static const char* target_end_avx2(const char* p, const char* end)
+{
+  const __m256i space = _mm256_set1_epi8(0x20);
+  const __m256i del   = _mm256_set1_epi8(0x7f);
+  for (; end - p >= 32; p += 32)
+  {
+    const __m256i v = _mm256_loadu_si256((const __m256i*) p);
+    const __m256i stop = _mm256_or_si256(
+        _mm256_cmpeq_epi8(_mm256_max_epu8(v, space), space),
+        _mm256_cmpeq_epi8(_mm256_min_epu8(v, del), del));
+    const uint32_t mask = _mm256_movemask_epi8(stop);
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+  return p;
+}
+
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+// a nibble for each byte, 0xf where it stopped
+static inline const char* first_stop_neon(const char* p, const uint8x16_t stop)
+{
+  const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+      vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+  return (mask != 0) ? p + __builtin_ctzll(mask) / 4 : nullptr;
+}
+
+static const char* line_end_neon(const char* p, const char* end)
+{
+  for (; end - p >= 16; p += 16)
+  {
+    const uint8x16_t v = vld1q_u8((const uint8_t*) p);
+    uint8x16_t stop = vcltq_u8(v, vdupq_n_u8(0x20));
+    stop = vbicq_u8(stop, vceqq_u8(v, vdupq_n_u8('\t')));
+    stop = vorrq_u8(stop, vceqq_u8(v, vdupq_n_u8(0x7f)));
+    if (const char* at = first_stop_neon(p, stop)) return at;
+  }
+  return p;
+}
+
+static const char* target_end_neon(const char* p, const char* end)
+{
+  for (; end - p >= 16; p += 16)
+  {
+    const uint8x16_t v = vld1q_u8((const uint8_t*) p);
+    const uint8x16_t stop = vorrq_u8(vcleq_u8(v, vdupq_n_u8(0x20)),
+                                     vcgeq_u8(v, vdupq_n_u8(0x7f)));
+    if (const char* at = first_stop_neon(p, stop)) return at;
+  }
+  return p;
+}
+#endif
+
+// best first
+static const Scan_kernel kernels[] {
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  { "avx2",   has_avx2,   line_end_avx2, target_end_avx2 },
+  { "sse2",   has_sse2,   line_end_sse2, target_end_sse2 },
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+  { "neon",   always,     line_end_neon, target_end_neon },
+#endif
+  { "scalar", always,     scan_scalar,   scan_scalar     },
+};
+
+static const Scan_kernel* active_kernel = nullptr;
+
+static const Scan_kernel& kernel() noexcept
+{
+  if (UNLIKELY(active_kernel == nullptr)) {
+    for (const auto& k : kernels)
+      if (k.available()) { active_kernel = &k; break; }
+  }
+  return *active_kernel;
+}
+
+const char* line_end(const char* p, const char* end) noexcept
+{
+  p = kernel().line_end(p, end);
+  while (p < end and not stops_line(*p)) p++;
+  return p;
+}
+
+const char* target_end(const char* p, const char* end) noexcept
+{
+  p = kernel().target_end(p, end);
+  while (p < end and not stops_target(*p)) p++;
+  return p;
+}
+
+const char* kernel_name() noexcept
+{
+  return kernel().name;
+}
+
+} //< namespace scanner
+} //< namespace http
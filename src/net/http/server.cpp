@@ -1,6 +1,7 @@
 
 #include <net/http/server.hpp>
 #include <net/inet>
+#include <os.hpp>
 #include <smp>
 
 namespace http {
@@ -16,7 +17,8 @@ namespace http {
       stat_conns_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.connections")},
       stat_req_rx_{Statman::get().create(Stat::UINT64, tcp.stack().ifname() + ".http_server.requests_rx")},
       stat_req_bad_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.requests_bad")},
-      stat_timeouts_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.timeouts")}
+      stat_timeouts_{Statman::get().create(Stat::UINT32, tcp.stack().ifname() + ".http_server.timeouts")},
+      hist_handle_{Statman::get().create_histogram(tcp.stack().ifname() + ".http_server.handle_ns")}
   {
   }
 
@@ -28,8 +30,13 @@ namespace http {
 
     using namespace std::chrono;
 
+    // one timer for all connections, checking often enough that
+    // none stays more than a quarter of the timeout past it
     if(idle_timeout_ != idle_duration::zero())
-      timer_id_ = Timers::periodic(30s, 1min, {this, &Server::timeout_clients});
+    {
+      const auto period = std::clamp<idle_duration>(idle_timeout_ / 4, 1s, 30s);
+      timer_id_ = Timers::periodic(period, period, {this, &Server::timeout_clients});
+    }
   }
 
   Response_ptr Server::create_response(status_t code) const
@@ -83,8 +90,9 @@ namespace http {
   void Server::timeout_clients(int32_t)
   {
     const auto count = idle_timeout_.count();
+    const auto now   = RTC::now();
     for(auto& conn : connections_) {
-      if(conn != nullptr and RTC::now() > (conn->idle_since() + count))
+      if(conn != nullptr and now > (conn->idle_since() + count))
       {
         conn->timeout();
         ++stat_timeouts_;
@@ -97,7 +105,9 @@ namespace http {
     ++stat_req_rx_;
     if(code == OK)
     {
+      const auto start = os::nanos_since_boot();
       on_request_(std::move(req), std::make_unique<Response_writer>( create_response(code), conn ));
+      hist_handle_.record(os::nanos_since_boot() - start);
     }
     else
     {
@@ -108,4 +118,12 @@ namespace http {
     }
   }
 
+  void Server::receive(Request_ptr req, Response_writer_ptr writer)
+  {
+    ++stat_req_rx_;
+    const auto start = os::nanos_since_boot();
+    on_request_(std::move(req), std::move(writer));
+    hist_handle_.record(os::nanos_since_boot() - start);
+  }
+
 }
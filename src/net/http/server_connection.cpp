@@ -1,21 +1,26 @@
-
 #include <net/http/server_connection.hpp>
 #include <net/http/server.hpp>
+#include <net/http/h2_session.hpp>
+#include <util/pmr_pools.hpp>
 
 namespace http {
 
  Server_connection::Server_connection(Server& server, Stream_ptr stream, size_t idx, const size_t bufsize)
     : Connection(std::move(stream)),
       server_(server),
+      mem_(os::mem::cpu_pool(os::mem::Pool_id::http).get_resource()),
       req_(nullptr),
       idx_(idx),
       idle_since_{0}
   {
+    buffer_.reserve(bufsize);
     stream_->on_read(bufsize, {this, &Server_connection::recv_request});
     // setup close event
     stream_->on_close({this, &Server_connection::close});
   }
 
+  Server_connection::~Server_connection() = default;
+
   void Server_connection::send(Response_ptr res)
   {
     stream_->write(res->to_string());
@@ -28,53 +33,125 @@ namespace http {
       return;
     }
 
-    const std::string data{(char*) buf->data(), buf->size()};
+    buffer_.append((const char*) buf->data(), buf->size());
+    update_idle();
+    process();
+  }
+
+  void Server_connection::process()
+  {
+    // a request handled right away ends in here again
+    if (processing_) return;
+    processing_ = true;
+
+    if (h2_)
+    {
+      h2_->receive(buffer_);
+      processing_ = false;
+      return;
+    }
 
-    // create response if not exist
-    if(req_ == nullptr)
+    while (not in_flight_ and not released())
     {
-      try {
-        req_ = make_request(data); // this also parses
-        update_idle();
+      if (req_ == nullptr)
+      {
+        if (not parse_head())
+          break;
       }
-      catch(...)
+
+      // add what there is of the body
+      const auto len = std::min(body_left_, buffer_.size());
+      if (len > 0)
       {
-        // Invalid request, just return (?)
-        //end_request(http::Bad_Request);
-        return;
+        req_->add_chunk(buffer_.substr(0, len));
+        buffer_.erase(0, len);
+        body_left_ -= len;
       }
-    }
-    // if there already is a request
-    else
-    {
-      // note: need to validate that the method is allowed, etc.
-      // add chunks of body data
-      req_->add_chunk(std::move(data));
-      update_idle();
+      // risk buffering forever if no timeout
+      if (body_left_ > 0)
+        break;
+
+      in_flight_ = true;
+      end_request();
     }
 
-    const auto& header = req_->header();
+    processing_ = false;
+  }
 
-    if(not header.is_empty() && header.has_field(header::Content_Length))
+  bool Server_connection::parse_head()
+  {
+    // a client with prior knowledge (or ALPN) opens with the HTTP/2 preface
+    if (fresh_ and server_.http2_enabled())
     {
-      try
+      const auto len = std::min(buffer_.size(), h2::PREFACE.size());
+      if (util::csview{buffer_}.substr(0, len) == h2::PREFACE.substr(0, len))
       {
-        const unsigned conlen = std::stoul(std::string(header.value(header::Content_Length)));
-        // risk buffering forever if no timeout
-        if(conlen == req_->body().size())
-        {
-          end_request();
-        }
+        if (len < h2::PREFACE.size())
+          return false;
+        h2_ = std::make_unique<H2_session>(*this);
+        h2_->receive(buffer_);
+        return false;
       }
-      catch(...)
+    }
+    fresh_ = false;
+
+    // continue searching where the last read ended
+    const auto from = (scanned_ > 3) ? scanned_ - 3 : 0;
+    const auto end  = buffer_.find("\r\n\r\n", from);
+    if (end == std::string::npos)
+    {
+      scanned_ = buffer_.size();
+      if (UNLIKELY(scanned_ > MAX_HEAD_SIZE))
       {
-        end_request(http::Bad_Request);
+        buffer_.clear();
+        scanned_ = 0;
+        in_flight_ = true;
+        end_request(http::Request_Header_Fields_Too_Large);
+        shutdown();
       }
+      return false;
     }
-    else
+    const auto head_len = end + 4;
+    scanned_ = 0;
+
+    try {
+      // header fields as views into the request's own copy of the head,
+      // both in the connection's memory (which throws when over quota)
+      std::pmr::memory_resource* mr = mem_ ? mem_.get() : std::pmr::get_default_resource();
+      req_ = std::make_unique<Request>(mr, util::csview{buffer_}.substr(0, head_len));
+    }
+    catch(...)
     {
-      end_request();
+      // Invalid request, drop what we have
+      //end_request(http::Bad_Request);
+      buffer_.clear();
+      return false;
     }
+    buffer_.erase(0, head_len);
+
+    const auto& header = req_->header();
+    try
+    {
+      body_left_ = header.has_field(header::Content_Length)
+        ? std::stoul(std::string(header.value(header::Content_Length))) : 0;
+    }
+    catch(...)
+    {
+      buffer_.clear();
+      in_flight_ = true;
+      end_request(http::Bad_Request);
+      shutdown();
+      return false;
+    }
+
+    // HTTP/1.0 closes unless asked not to, HTTP/1.1 when asked to
+    const auto conn = header.value(header::Connection);
+    if (req_->version().minor() == 0)
+      keep_alive(conn == "keep-alive" or conn == "Keep-Alive");
+    else if (conn == "close")
+      keep_alive(false);
+
+    return true;
   }
 
   void Server_connection::end_request(const status_t code)
@@ -82,6 +159,19 @@ namespace http {
     server_.receive(std::move(req_), code, *this);
   }
 
+  void Server_connection::receive(Request_ptr req, Response_writer_ptr writer)
+  {
+    server_.receive(std::move(req), std::move(writer));
+  }
+
+  void Server_connection::on_end()
+  {
+    // the response is out, on to the next pipelined request
+    in_flight_ = false;
+    update_idle();
+    process();
+  }
+
   void Server_connection::close()
   {
     server_.close(*this);
@@ -0,0 +1,19 @@
+#include <net/http/stack_exporter.hpp>
+#include <profile>
+
+namespace http {
+
+  bool Stack_exporter::serve(const Request& req, Response_writer& res)
+  {
+    if (req.method() != GET or req.uri().path() != path_)
+      return false;
+
+    // does nothing when sampling already
+    StackSampler::begin();
+
+    res.header().set_field(header::Content_Type, "text/plain");
+    res.write(StackSampler::folded());
+    return true;
+  }
+
+} // < namespace http
@@ -0,0 +1,172 @@
+#include <net/http/static_files.hpp>
+#include <net/http/mime_types.hpp>
+#include <net/http/time.hpp>
+
+#include <cstdio>
+
+namespace http {
+
+  Static_files::Static_files(fs::File_system& fs, std::string root, size_t capacity)
+    : fs_(fs),
+      root_(std::move(root)),
+      capacity_(capacity)
+  {}
+
+  bool Static_files::serve(const Request& req, Response_writer& res)
+  {
+    const auto method = req.method();
+    if (method != GET and method != HEAD)
+      return false;
+
+    std::string path{req.uri().path()};
+    if (path.empty() or path.back() == '/')
+      path += "index.html";
+
+    Entry entry;
+    if (not find(path, entry))
+      return false;
+
+    auto& header = res.header();
+    if (entry.gzip)
+      header.set_field(header::Vary, "Accept-Encoding");
+
+    const bool gzip = entry.gzip
+      and accepts_gzip(req.header().value(header::Accept_Encoding));
+    const auto etag = gzip ? entry.etag.substr(0, entry.etag.size() - 1) + "-gz\""
+                           : entry.etag;
+    header.set_field(header::ETag, etag);
+    if (not entry.last_modified.empty())
+      header.set_field(header::Last_Modified, entry.last_modified);
+
+    // the client has it already
+    const auto inm = req.header().value(header::If_None_Match);
+    const auto ims = req.header().value(header::If_Modified_Since);
+    if ((not inm.empty() and (inm == etag or inm == "*"))
+        or (inm.empty() and not ims.empty() and ims == entry.last_modified))
+    {
+      res.write_header(Not_Modified);
+      return true;
+    }
+
+    header.set_field(header::Content_Type, std::string(entry.mime));
+    if (gzip)
+      header.set_field(header::Content_Encoding, "gzip");
+
+    const auto& body = gzip ? entry.gzip : entry.plain;
+    if (method == HEAD)
+    {
+      res.response_ptr()->set_content_length(body->size());
+      res.write_header(OK);
+      return true;
+    }
+    // the cached buffer goes out as it is
+    res.write(body);
+    return true;
+  }
+
+  bool Static_files::find(const std::string& path, Entry& out)
+  {
+    // keep to the root
+    if (path.find("..") != std::string::npos)
+      return false;
+
+    auto it = cache_.find(path);
+    if (it != cache_.end())
+    {
+      out = it->second;
+      return true;
+    }
+
+    if (not load(path, out))
+      return false;
+
+    if (bytes_ + out.bytes() <= capacity_)
+    {
+      bytes_ += out.bytes();
+      cache_.emplace(path, out);
+    }
+    return true;
+  }
+
+  bool Static_files::load(const std::string& path, Entry& out) const
+  {
+    const auto full = root_ + path;
+    const auto ent = fs_.stat(full);
+    if (not ent.is_valid() or not ent.is_file())
+      return false;
+
+    auto plain = fs_.read(ent, 0, ent.size());
+    if (not plain)
+      return false;
+    out.plain = plain.get();
+
+    auto gz = fs_.read_file(full + ".gz");
+    out.gzip = gz ? gz.get() : nullptr;
+
+    // FNV-1a over the contents
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto byte : *out.plain)
+      hash = (hash ^ byte) * 1099511628211ull;
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long) hash);
+    out.etag = etag;
+
+    out.last_modified = fat_time_to_http(ent.modified());
+
+    const auto dot = path.find_last_of('.');
+    out.mime = (dot != std::string::npos)
+      ? ext_to_mime_type(util::csview{path}.substr(dot + 1))
+      : ext_to_mime_type("");
+    return true;
+  }
+
+  bool Static_files::accepts_gzip(util::csview accept_encoding) noexcept
+  {
+    util::sview rest = accept_encoding;
+    while (not rest.empty())
+    {
+      const auto comma = rest.find(',');
+      auto coding = rest.substr(0, comma);
+      rest = (comma == util::sview::npos) ? util::sview{} : rest.substr(comma + 1);
+
+      const auto semi = coding.find(';');
+      auto params = (semi == util::sview::npos) ? util::sview{} : coding.substr(semi + 1);
+      coding = coding.substr(0, semi);
+      while (not coding.empty() and coding.front() == ' ') coding.remove_prefix(1);
+      while (not coding.empty() and coding.back() == ' ') coding.remove_suffix(1);
+
+      if (coding != "gzip" and coding != "x-gzip" and coding != "*")
+        continue;
+
+      // "q=0", "q=0.0" etc. refuses it
+      const auto q = params.find("q=");
+      if (q == util::sview::npos)
+        return true;
+      for (const auto c : params.substr(q + 2))
+      {
+        if (c >= '1' and c <= '9') return true;
+        if (c != '0' and c != '.') break;
+      }
+      return false;
+    }
+    return false;
+  }
+
+  std::string Static_files::fat_time_to_http(uint32_t fat_time)
+  {
+    const uint16_t date = fat_time >> 16;
+    const uint16_t clock = fat_time & 0xffff;
+    if (date == 0)
+      return {};
+
+    std::tm tm{};
+    tm.tm_year = 80 + (date >> 9);
+    tm.tm_mon  = ((date >> 5) & 0xf) - 1;
+    tm.tm_mday = date & 0x1f;
+    tm.tm_hour = clock >> 11;
+    tm.tm_min  = (clock >> 5) & 0x3f;
+    tm.tm_sec  = (clock & 0x1f) * 2;
+    return time::from_time_t(timegm(&tm));
+  }
+
+}
@@ -0,0 +1,70 @@
+#include <net/http/stats_exporter.hpp>
+
+namespace http {
+
+  Stats_exporter::Stats_exporter(std::string path, std::string prefix, Statman& statman)
+    : path_(std::move(path)),
+      prefix_(std::move(prefix)),
+      statman_(statman)
+  {}
+
+  bool Stats_exporter::serve(const Request& req, Response_writer& res)
+  {
+    const auto method = req.method();
+    if (method != GET and method != HEAD)
+      return false;
+    if (req.uri().path() != path_)
+      return false;
+
+    auto body = render();
+    auto& header = res.header();
+    header.set_field(header::Content_Type, CONTENT_TYPE);
+    if (method == HEAD)
+    {
+      res.response_ptr()->set_content_length(body.size());
+      res.write_header(OK);
+      return true;
+    }
+    res.write(std::move(body));
+    return true;
+  }
+
+  std::string Stats_exporter::render() const
+  {
+    std::string out;
+    // about what a stat takes, to allocate once for most
+    out.reserve(statman_.size() * (2 * Stat::MAX_NAME_LEN + 32));
+
+    for (const auto& stat : statman_)
+    {
+      if (stat.unused()) continue;
+      const auto name = metric_name(prefix_, stat.name());
+      out += "# TYPE ";
+      out += name;
+      out += stat.is_gauge() ? " gauge\n" : " counter\n";
+      out += name;
+      out += ' ';
+      out += stat.to_string();
+      out += '\n';
+    }
+    return out;
+  }
+
+  std::string Stats_exporter::metric_name(util::csview prefix, util::csview name)
+  {
+    std::string out;
+    out.reserve(prefix.size() + name.size() + 1);
+    out.append(prefix.data(), prefix.size());
+    // names can't start with a digit
+    if (out.empty() and not name.empty() and name[0] >= '0' and name[0] <= '9')
+      out += '_';
+    for (const char c : name)
+    {
+      const bool valid = (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z')
+                      or (c >= '0' and c <= '9') or c == '_';
+      out += valid ? c : '_';
+    }
+    return out;
+  }
+
+} // < namespace http
@@ -1,4 +1,5 @@
 
+#include <string>
 #include <unordered_map>
 
 #include <net/http/status_code_constants.hpp>
@@ -82,4 +83,17 @@ util::sview code_description(const status_t status_code) noexcept {
   return (iter not_eq status_code_table.cend()) ? iter->second : "Internal Server Error";
 }
 
+util::sview status_line_1_1(const status_t status_code) noexcept {
+  static const auto lines = [] {
+    std::unordered_map<int, std::string> table;
+    for (const auto& code : status_code_table) {
+      table.emplace(code.first, "HTTP/1.1 " + std::to_string(code.first) + ' '
+                                + std::string(code.second) + "\r\n");
+    }
+    return table;
+  }();
+  const auto iter = lines.find(status_code);
+  return (iter not_eq lines.cend()) ? util::sview{iter->second} : util::sview{};
+}
+
 } //< namespace http
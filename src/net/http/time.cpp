@@ -1,6 +1,9 @@
 
 #include <net/http/time.hpp>
 
+#include <array>
+#include <smp>
+
 namespace http {
 namespace time {
 
@@ -48,5 +51,27 @@ std::string now() {
   return from_time_t(std::time(nullptr));
 }
 
+///////////////////////////////////////////////////////////////////////////////
+struct alignas(SMP_ALIGN) Date_slot {
+  std::time_t time = -1;
+  size_t      len  = 0;
+  char        text[40];
+};
+static std::array<Date_slot, SMP_MAX_CORES> date_slots;
+
+util::sview cached_now() {
+  auto& slot = per_cpu_help(date_slots);
+  const auto now = std::time(nullptr);
+
+  if (now != slot.time) {
+    std::tm tm;
+    slot.len  = gmtime_r(&now, &tm) ? std::strftime(slot.text, sizeof(slot.text),
+                                                    "%a, %d %b %Y %H:%M:%S GMT", &tm)
+                                    : 0;
+    slot.time = now;
+  }
+  return {slot.text, slot.len};
+}
+
 } //< namespace time
 } //< namespace http
@@ -18,6 +18,72 @@ inline std::unique_ptr<Botan::Private_Key> read_pkey(fs::Dirent& key_file)
 
 namespace http
 {
+  /**
+   * Credentials from the server's credential manager, and the current
+   * session ticket key (which Botan asks for as a PSK)
+   */
+  class Ticket_credman : public Botan::Credentials_Manager
+  {
+  public:
+    Ticket_credman(Botan::Credentials_Manager& creds, TLS_ticket_keys& keys)
+      : m_creds{creds}, m_keys{keys} {}
+
+    std::vector<Botan::Certificate_Store*>
+    trusted_certificate_authorities(const std::string& type,
+                                    const std::string& context) override
+    { return m_creds.trusted_certificate_authorities(type, context); }
+
+    std::vector<Botan::X509_Certificate>
+    find_cert_chain(const std::vector<std::string>& algos,
+                    const std::vector<Botan::X509_DN>& acceptable_CAs,
+                    const std::string& type,
+                    const std::string& context) override
+    { return m_creds.find_cert_chain(algos, acceptable_CAs, type, context); }
+
+    std::vector<Botan::X509_Certificate>
+    cert_chain(const std::vector<std::string>& algos,
+               const std::string& type,
+               const std::string& context) override
+    { return m_creds.cert_chain(algos, type, context); }
+
+    Botan::Private_Key* private_key_for(const Botan::X509_Certificate& cert,
+                                        const std::string& type,
+                                        const std::string& context) override
+    { return m_creds.private_key_for(cert, type, context); }
+
+    Botan::SymmetricKey psk(const std::string& type,
+                            const std::string& context,
+                            const std::string& identity) override
+    {
+      if (type == "tls-server" and context == "session-ticket") {
+        const auto& key = m_keys.current();
+        return Botan::SymmetricKey(key.aes.data(), key.aes.size());
+      }
+      return m_creds.psk(type, context, identity);
+    }
+
+  private:
+    Botan::Credentials_Manager& m_creds;
+    TLS_ticket_keys& m_keys;
+  };
+
+  void Botan_server::set_session_config(const TLS_session_config& config)
+  {
+    Expects(connected_clients() == 0);
+    if (config.cache_size > 0)
+      this->sessions = std::make_unique<Botan::TLS::Session_Manager_In_Memory>(
+          rng, config.cache_size, config.lifetime);
+    else
+      this->sessions = std::make_unique<Botan::TLS::Session_Manager_Noop>();
+
+    this->ticket_credman = nullptr;
+    this->ticket_keys = nullptr;
+    if (config.tickets) {
+      this->ticket_keys = std::make_unique<TLS_ticket_keys>(config.ticket_key_rotation);
+      this->ticket_credman = std::make_unique<Ticket_credman>(*credman, *ticket_keys);
+    }
+  }
+
   Botan::RandomNumberGenerator& Botan_server::get_rng()
   {
     return ::get_rng();
@@ -57,11 +123,16 @@ namespace http
 
   void Botan_server::on_connect(TCP_conn conn)
   {
-    connect(
-      std::make_unique<net::botan::Server> (
+    auto& creds = (ticket_credman != nullptr) ? *ticket_credman : *credman;
+    auto stream = std::make_unique<net::botan::Server> (
         std::make_unique<net::tcp::Stream>(
-          std::move(conn)), rng, *credman)
-    );
+          std::move(conn)), rng, creds, *sessions);
+    // ALPN, most preferred first
+    if (http2_enabled())
+      stream->set_app_protocols({"h2", "http/1.1"});
+    else
+      stream->set_app_protocols({"http/1.1"});
+    connect(std::move(stream));
   }
 
 }
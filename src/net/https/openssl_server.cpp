@@ -2,9 +2,99 @@
 #include <net/openssl/init.hpp>
 #include <net/openssl/tls_stream.hpp>
 #include <memdisk>
+#include <smp>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <cstring>
 
 namespace http
 {
+  // ALPN, choosing HTTP/2 over HTTP/1.1 if enabled
+  static int alpn_select(SSL*, const unsigned char** out, unsigned char* outlen,
+                         const unsigned char* in, unsigned int inlen, void* arg)
+  {
+    static const unsigned char h2_first[] = "\x02h2\x08http/1.1";
+    static const unsigned char http11[]   = "\x08http/1.1";
+    const bool h2 = ((OpenSSL_server*) arg)->http2_enabled();
+    const auto* prefs = h2 ? h2_first : http11;
+    const auto  len   = h2 ? sizeof(h2_first) - 1 : sizeof(http11) - 1;
+
+    unsigned char* selected;
+    if (SSL_select_next_proto(&selected, outlen, prefs, len, in, inlen)
+        != OPENSSL_NPN_NEGOTIATED)
+      return SSL_TLSEXT_ERR_NOACK;
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+  }
+
+  // handshakes may run on other CPUs (see offload_handshakes)
+  static smp_spinlock ticket_lock;
+
+  // Session tickets (RFC 5077), with keys from the server's TLS_ticket_keys
+  static int ticket_key(TLS_ticket_keys* keys, unsigned char* name, unsigned char* iv,
+                        EVP_CIPHER_CTX* ectx, HMAC_CTX* hctx, int enc)
+  {
+    if (enc)
+    {
+      const auto& key = keys->current();
+      if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+        return -1;
+      std::memcpy(name, key.name.data(), key.name.size());
+      EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), nullptr, key.aes.data(), iv);
+      HMAC_Init_ex(hctx, key.hmac.data(), key.hmac.size(), EVP_sha256(), nullptr);
+      return 1;
+    }
+
+    const auto* key = keys->find(name);
+    // unknown or expired, do a full handshake
+    if (key == nullptr) return 0;
+    HMAC_Init_ex(hctx, key->hmac.data(), key->hmac.size(), EVP_sha256(), nullptr);
+    EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), nullptr, key->aes.data(), iv);
+    // made with an older key, so resume and give out a new ticket
+    return keys->is_retired(*key) ? 2 : 1;
+  }
+
+  static int ticket_key_cb(SSL* ssl, unsigned char* name, unsigned char* iv,
+                           EVP_CIPHER_CTX* ectx, HMAC_CTX* hctx, int enc)
+  {
+    auto* keys = (TLS_ticket_keys*) SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    if (keys == nullptr) return 0;
+    ticket_lock.lock();
+    const int res = ticket_key(keys, name, iv, ectx, hctx, enc);
+    ticket_lock.unlock();
+    return res;
+  }
+
+  void OpenSSL_server::set_session_config(const TLS_session_config& config)
+  {
+    auto* ctx = (SSL_CTX*) this->m_ctx;
+    static const unsigned char sid_ctx[] = "IncludeOS HTTPS";
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_timeout(ctx, config.lifetime.count());
+
+    if (config.cache_size > 0) {
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+      SSL_CTX_sess_set_cache_size(ctx, config.cache_size);
+    }
+    else {
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    if (config.tickets) {
+      m_ticket_keys = std::make_unique<TLS_ticket_keys>(config.ticket_key_rotation);
+      SSL_CTX_set_app_data(ctx, m_ticket_keys.get());
+      SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticket_key_cb);
+      SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+    }
+    else {
+      SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+      SSL_CTX_set_tlsext_ticket_key_cb(ctx, nullptr);
+      SSL_CTX_set_app_data(ctx, nullptr);
+      m_ticket_keys = nullptr;
+    }
+  }
+
   void OpenSSL_server::openssl_initialize(const std::string& certif,
                                           const std::string& key)
   {
@@ -21,6 +111,8 @@ namespace http
 
     this->m_ctx = openssl::create_server(certif.c_str(), key.c_str());
     assert(ERR_get_error() == 0);
+    SSL_CTX_set_alpn_select_cb((SSL_CTX*) this->m_ctx, alpn_select, this);
+    set_session_config(TLS_session_config{});
   }
   OpenSSL_server::~OpenSSL_server()
   {
@@ -35,8 +127,11 @@ namespace http
 
   void OpenSSL_server::on_connect(TCP_conn conn)
   {
-    connect(
-      std::make_unique<openssl::TLS_stream> ((SSL_CTX*) m_ctx, std::make_unique<net::tcp::Stream>(std::move(conn)))
-    );
+    auto stream = std::make_unique<openssl::TLS_stream> ((SSL_CTX*) m_ctx, std::make_unique<net::tcp::Stream>(std::move(conn)));
+    if (not m_handshake_cpus.empty())
+    {
+      stream->offload_handshake(SMP::least_loaded_cpu(m_handshake_cpus));
+    }
+    connect(std::move(stream));
   }
 } // http
@@ -1,6 +1,7 @@
 
 #include <net/https/s2n_server.hpp>
 #include <net/s2n/stream.hpp>
+#include <cstring>
 using s2n::print_s2n_error;
 
 // allow all clients
@@ -8,8 +9,84 @@ static uint8_t verify_host_passthrough(const char*, size_t, void* /*data*/) {
     return 1;
 }
 
+// the session cache, shared by the connections of a server
+static int cache_store(struct s2n_connection*, void* data, uint64_t ttl,
+                       const void* key, uint64_t key_size,
+                       const void* value, uint64_t value_size)
+{
+  auto* cache = (http::TLS_session_cache*) data;
+  cache->store({(const char*) key, key_size}, {(const char*) value, value_size},
+               std::chrono::seconds(ttl));
+  return 0;
+}
+static int cache_retrieve(struct s2n_connection*, void* data,
+                          const void* key, uint64_t key_size,
+                          void* value, uint64_t* value_size)
+{
+  auto* cache = (http::TLS_session_cache*) data;
+  const auto* session = cache->find({(const char*) key, key_size});
+  if (session == nullptr or session->size() > *value_size)
+    return -1;
+  memcpy(value, session->data(), session->size());
+  *value_size = session->size();
+  return 0;
+}
+static int cache_delete(struct s2n_connection*, void* data,
+                        const void* key, uint64_t key_size)
+{
+  auto* cache = (http::TLS_session_cache*) data;
+  cache->erase({(const char*) key, key_size});
+  return 0;
+}
+
 namespace http
 {
+  void S2N_server::set_session_config(const TLS_session_config& config)
+  {
+    auto* cfg = (s2n_config*) this->m_config;
+    m_session_cache = nullptr;
+    if (config.cache_size > 0)
+    {
+      m_session_cache = std::make_unique<TLS_session_cache>(config.cache_size, config.lifetime);
+      s2n_config_set_cache_store_callback(cfg, cache_store, m_session_cache.get());
+      s2n_config_set_cache_retrieve_callback(cfg, cache_retrieve, m_session_cache.get());
+      s2n_config_set_cache_delete_callback(cfg, cache_delete, m_session_cache.get());
+    }
+    if (s2n_config_set_session_cache_onoff(cfg, config.cache_size > 0) < 0) {
+      print_s2n_error("Error setting session cache");
+    }
+
+    m_ticket_timer.stop();
+    m_ticket_keys = nullptr;
+    if (config.tickets)
+    {
+      // s2n moves a key from making tickets to reading them by itself
+      const uint64_t period = config.ticket_key_rotation.count();
+      s2n_config_set_ticket_encrypt_decrypt_key_lifetime(cfg, period);
+      s2n_config_set_ticket_decrypt_key_lifetime(cfg, period);
+      m_ticket_keys = std::make_unique<TLS_ticket_keys>(config.ticket_key_rotation);
+      rotate_ticket_key();
+    }
+    if (s2n_config_set_session_tickets_onoff(cfg, config.tickets) < 0) {
+      print_s2n_error("Error setting session tickets");
+    }
+  }
+
+  void S2N_server::rotate_ticket_key()
+  {
+    auto& key = m_ticket_keys->current();
+    // s2n wants 32 bytes of secret, and makes its own keys from it
+    int res =
+    s2n_config_add_ticket_crypto_key((s2n_config*) this->m_config,
+        key.name.data(), key.name.size(),
+        const_cast<uint8_t*>(key.aes.data()), key.aes.size(), 0);
+    if (res < 0) {
+      print_s2n_error("Error adding session ticket key");
+    }
+    // a second late, so the key is due
+    m_ticket_timer.start(m_ticket_keys->rotation() + std::chrono::seconds(1));
+  }
+
   void S2N_server::initialize(
       const std::string& ca_cert,
       const std::string& ca_key)
@@ -39,6 +116,7 @@ namespace http
       print_s2n_error("Error setting verify-host callback");
       exit(1);
     }
+    this->set_session_config(TLS_session_config{});
   }
   
   S2N_server::~S2N_server()
@@ -48,6 +126,16 @@ namespace http
   
   void S2N_server::bind(const uint16_t port)
   {
+    // ALPN, most preferred first
+    static const char* h2_first[] = { "h2", "http/1.1" };
+    static const char* http11[]   = { "http/1.1" };
+    int res = http2_enabled()
+      ? s2n_config_set_protocol_preferences((s2n_config*) this->m_config, h2_first, 2)
+      : s2n_config_set_protocol_preferences((s2n_config*) this->m_config, http11, 1);
+    if (res < 0) {
+      print_s2n_error("Error setting ALPN preferences");
+    }
+
     tcp_.listen(port, {this, &S2N_server::on_connect});
     INFO("HTTPS Server", "Listening on port %u", port);
   }
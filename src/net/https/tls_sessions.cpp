@@ -0,0 +1,94 @@
+#include <net/https/tls_sessions.hpp>
+#include <kernel/rng.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace http
+{
+  void TLS_session_cache::store(util::csview id, util::csview session,
+                                std::chrono::seconds ttl)
+  {
+    if (capacity_ == 0) return;
+    if (ttl.count() <= 0 or ttl > lifetime_) ttl = lifetime_;
+    const auto expires = RTC::now() + ttl.count();
+
+    std::string key{id};
+    auto it = map_.find(key);
+    if (it != map_.end())
+    {
+      it->second.session = std::string{session};
+      it->second.expires = expires;
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      return;
+    }
+
+    if (map_.size() >= capacity_)
+    {
+      map_.erase(lru_.back());
+      lru_.pop_back();
+    }
+    lru_.push_front(key);
+    map_.emplace(std::move(key), Entry{std::string{session}, expires, lru_.begin()});
+  }
+
+  const std::string* TLS_session_cache::find(util::csview id)
+  {
+    auto it = map_.find(std::string{id});
+    if (it == map_.end())
+      return nullptr;
+
+    if (it->second.expires <= RTC::now())
+    {
+      lru_.erase(it->second.lru);
+      map_.erase(it);
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return &it->second.session;
+  }
+
+  void TLS_session_cache::erase(util::csview id)
+  {
+    auto it = map_.find(std::string{id});
+    if (it == map_.end()) return;
+    lru_.erase(it->second.lru);
+    map_.erase(it);
+  }
+
+  const TLS_ticket_keys::Key& TLS_ticket_keys::current()
+  {
+    const auto now = RTC::now();
+    if (keys_.empty() or now - keys_.back().created >= (RTC::timestamp_t) rotation_.count())
+      rotate(now);
+    return keys_.back();
+  }
+
+  const TLS_ticket_keys::Key* TLS_ticket_keys::find(const uint8_t* name)
+  {
+    current();
+    for (const auto& key : keys_)
+      if (std::memcmp(key.name.data(), name, key.name.size()) == 0)
+        return &key;
+    return nullptr;
+  }
+
+  void TLS_ticket_keys::rotate(RTC::timestamp_t now)
+  {
+    Key key;
+    rng_extract(key.name.data(), key.name.size());
+    rng_extract(key.aes.data(),  key.aes.size());
+    rng_extract(key.hmac.data(), key.hmac.size());
+    key.created = now;
+    keys_.push_back(key);
+
+    // a key makes tickets for a period, and reads them for another
+    while (keys_.size() > 1 and now - keys_.front().created >= 2 * (RTC::timestamp_t) rotation_.count())
+    {
+      std::fill(keys_.front().aes.begin(),  keys_.front().aes.end(),  0);
+      std::fill(keys_.front().hmac.begin(), keys_.front().hmac.end(), 0);
+      keys_.pop_front();
+    }
+  }
+
+} // < namespace http
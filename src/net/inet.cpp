@@ -105,6 +105,9 @@ Inet::Inet(hw::Nic& nic)
   // IP4 -> Arp
   ip4_.set_linklayer_out(arp_top);
 
+  // IP4 -> Link, for already resolved destinations
+  ip4_.set_link_out(link_top);
+
   // IP6 -> Ndp
   ip6_.set_linklayer_out(ndp_top);
 
@@ -208,6 +211,16 @@ void Inet::negotiate_dhcp(double timeout, dhcp_timeout_func handler) {
       dhcp_->on_config(handler);
 }
 
+void Inet::resume_dhcp(const dhcp::Lease& lease, double timeout, dhcp_timeout_func handler) {
+  INFO("Inet", "Resuming DHCP lease of %s", lease.addr.str().c_str());
+  if (!dhcp_)
+      dhcp_ = std::make_shared<DHClient>(*this);
+  // configuring may happen right away
+  if (handler)
+      dhcp_->on_config(handler);
+  dhcp_->resume(lease, std::chrono::seconds((uint32_t)timeout));
+}
+
 void Inet::autoconf_v6(int retries, slaac_timeout_func handler,
         uint64_t token, bool use_token)
 {
@@ -289,6 +302,7 @@ void Inet::add_addr_autoconf(const ip6::Addr& addr, uint8_t prefix,
 void Inet::enable_conntrack(std::shared_ptr<Conntrack> ct)
 {
   Expects(conntrack_ == nullptr && "Conntrack is already set");
+  Expects(Features::netfilter);
   conntrack_ = ct;
 }
 
@@ -366,7 +380,9 @@ void Inet::resolve(const std::string& hostname,
      resolve_func       func,
      bool               force)
 {
-  if(is_configured_v6() and dns_server6_ != ip6::Addr::addr_any)
+  if(not dns_.nameservers().empty())
+    dns_.resolve(hostname, func, force);
+  else if(is_configured_v6() and dns_server6_ != ip6::Addr::addr_any)
     resolve(hostname, this->dns_server6_, func, force);
   else
     resolve(hostname, this->dns_server_, func, force);
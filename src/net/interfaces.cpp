@@ -143,7 +143,7 @@ Interfaces::Interfaces()
   if (os::machine().count<hw::Nic>() == 0)
     INFO("Network", "No registered network interfaces found");
 
-  for (size_t i = 0; i < os::machine().get<hw::Nic>().size(); i++) {
+  for (ssize_t i = 0; i < os::machine().count<hw::Nic>(); i++) {
     stacks_.emplace_back();
     stacks_.back()[0] = nullptr;
   }
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include <net/inet>
+#include <os.hpp>
 #include <net/ip4/arp.hpp>
 #include <net/ip4/packet_arp.hpp>
 #include <statman>
@@ -23,6 +24,8 @@ namespace net {
   requests_tx_    {Statman::get().create(Stat::UINT32, inet.ifname() + ".arp.requests_tx").get_uint32()},
   replies_rx_     {Statman::get().create(Stat::UINT32, inet.ifname() + ".arp.replies_rx").get_uint32()},
   replies_tx_     {Statman::get().create(Stat::UINT32, inet.ifname() + ".arp.replies_tx").get_uint32()},
+  queue_dropped_  {Statman::get().create(Stat::UINT32, inet.ifname() + ".arp.queue_dropped").get_uint32()},
+  replies_limited_{Statman::get().create(Stat::UINT32, inet.ifname() + ".arp.replies_limited").get_uint32()},
   inet_           {inet},
   mac_            (inet.link_addr())
   {}
@@ -30,17 +33,20 @@ namespace net {
   void Arp::receive(Packet_ptr pckt) {
     PRINT("<ARP handler> got %i bytes of data\n", pckt->size());
 
+    if (UNLIKELY(pckt->size() < (int) sizeof(header)))
+      return;
     header* hdr = reinterpret_cast<header*>(pckt->layer_begin());
 
-    /// cache entry
-    this->cache(hdr->sipaddr, hdr->shwaddr);
+    /// cache entry, if known or if it's talking to us (RFC 826), so that
+    /// scans and floods of requests for others don't fill the cache
+    if (hdr->dipaddr == inet_.ip_addr() or cache_.find(hdr->sipaddr) != nullptr)
+      this->cache(hdr->sipaddr, hdr->shwaddr);
 
     /// always try to ship waiting packets when someone talks
-    auto waiting = waiting_packets_.find(hdr->sipaddr);
-    if (waiting != waiting_packets_.end()) {
+    auto* waiting = cache_.find(hdr->sipaddr);
+    if (waiting != nullptr and not waiting->pending.empty()) {
       PRINT("<Arp> Had a packet waiting for this IP. Sending\n");
-      transmit(std::move(waiting->second.pckt), hdr->sipaddr);
-      waiting_packets_.erase(waiting);
+      transmit(waiting->pending.release(), hdr->sipaddr);
     }
 
     switch(hdr->opcode) {
@@ -55,12 +61,12 @@ namespace net {
       if (hdr->dipaddr == inet_.ip_addr()) {
 
         // The packet is for us. Respond.
-        arp_respond(hdr, inet_.ip_addr());
+        arp_respond(std::move(pckt), inet_.ip_addr());
 
       } else if (proxy_ and proxy_(hdr->dipaddr)){
 
         // The packet is for an IP to which we know a route
-        arp_respond(hdr, hdr->dipaddr);
+        arp_respond(std::move(pckt), hdr->dipaddr);
 
       } else {
 
@@ -74,7 +80,7 @@ namespace net {
       // Stat increment replies received
       replies_rx_++;
       PRINT("\t ARP REPLY: %s belongs to %s (waiting: %zu)\n",
-             hdr->sipaddr.str().c_str(), hdr->shwaddr.str().c_str(), waiting_packets_.size());
+             hdr->sipaddr.str().c_str(), hdr->shwaddr.str().c_str(), cache_.size());
       break;
     }
     default:
@@ -87,49 +93,60 @@ namespace net {
   void Arp::cache(ip4::Addr ip, MAC::Addr mac) {
     PRINT("<Arp> Caching IP %s for %s\n", ip.str().c_str(), mac.str().c_str());
 
-    auto entry = cache_.find(ip);
+    auto& entry = cache_.insert(ip);
 
-    if (entry != cache_.end()) {
+    if (entry.resolved) {
       PRINT("Cached entry found: %s recorded @ %zu. Updating timestamp\n",
-             entry->second.mac().str().c_str(), entry->second.timestamp());
+             entry.mac.str().c_str(), entry.timestamp);
 
-      if (entry->second.mac() != mac) {
-        cache_.erase(entry);
-        cache_.emplace(ip, mac);
-      } else {
-        entry->second.update();
-      }
+      if (entry.mac != mac)
+        cache_.changed();
+    }
+    entry.mac       = mac;
+    entry.resolved  = true;
+    entry.timestamp = RTC::time_since_boot();
 
-    } else {
-      cache_.emplace(ip, mac); // Insert
-      if (UNLIKELY(not flush_timer_.is_running())) {
-        flush_timer_.start(flush_interval_);
-      }
+    if (UNLIKELY(not flush_timer_.is_running())) {
+      flush_timer_.start(flush_interval_);
     }
   }
 
+  void Arp::flush_cache()
+  {
+    cache_.for_each([this] (Arp_cache::Entry& ent) {
+        if (ent.resolved) cache_.erase(ent);
+      });
+  }
 
-  void Arp::arp_respond(header* hdr_in, ip4::Addr ack_ip) {
+  void Arp::arp_respond(Packet_ptr req, ip4::Addr ack_ip) {
+    if (UNLIKELY(not reply_limit_.admit(os::nanos_since_boot()))) {
+      replies_limited_++;
+      return;
+    }
     PRINT("\t IP Match. Constructing ARP Reply\n");
 
     // Stat increment replies sent
     replies_tx_++;
 
-    // Populate ARP-header
-    auto res = static_unique_ptr_cast<PacketArp>(inet_.create_packet());
-    res->init(mac_, ack_ip, hdr_in->sipaddr);
-
-    res->set_dest_mac(hdr_in->shwaddr);
-    res->set_opcode(H_reply);
+    // The reply is the request turned around, in the same buffer
+    auto* hdr = reinterpret_cast<header*>(req->layer_begin());
+    const MAC::Addr dest = hdr->shwaddr;
+    hdr->opcode  = H_reply;
+    hdr->dhwaddr = hdr->shwaddr;
+    hdr->dipaddr = hdr->sipaddr;
+    hdr->shwaddr = mac_;
+    hdr->sipaddr = ack_ip;
+    // without the padding of the frame it came in
+    req->set_data_end(sizeof(header));
+    req->set_vlan_id(0);
 
     PRINT("\t IP: %s is at My Mac: %s\n",
-           res->source_ip().str().c_str(), res->source_mac().str().c_str());
+           ack_ip.str().c_str(), mac_.str().c_str());
 
-    MAC::Addr dest = hdr_in->shwaddr;
     PRINT("<ARP -> physical> Sending response to %s. Linklayer begin: buf + %li \n",
-          dest.str().c_str(), res->layer_begin() - res->buf() );
+          dest.str().c_str(), req->layer_begin() - req->buf() );
 
-    linklayer_out_(std::move(res), dest, Ethertype::ARP);
+    linklayer_out_(std::move(req), dest, Ethertype::ARP);
   }
 
   void Arp::transmit(Packet_ptr pckt, ip4::Addr next_hop) {
@@ -150,15 +167,15 @@ namespace net {
       dest_mac = linux_tap_device;
 #else
       // If we don't have a cached IP, perform address resolution
-      auto cache_entry = cache_.find(next_hop);
-      if (UNLIKELY(cache_entry == cache_.end())) {
+      const auto* cache_entry = cache_.find(next_hop);
+      if (UNLIKELY(cache_entry == nullptr or not cache_entry->resolved)) {
         PRINT("<ARP> No cache entry for IP %s.  Resolving. \n", next_hop.to_string().c_str());
         await_resolution(std::move(pckt), next_hop);
         return;
       }
 
       // Get MAC from cache
-      dest_mac = cache_[next_hop].mac();
+      dest_mac = cache_entry->mac;
 #endif
 
       PRINT("<ARP> Found cache entry for IP %s -> %s \n",
@@ -175,30 +192,38 @@ namespace net {
 
     PRINT("<Arp> resolve timer doing sweep\n");
 
-    for (auto it =waiting_packets_.begin(); it != waiting_packets_.end();){
-      if (it->second.tries_remaining--) {
-        arp_resolver_(it->first);
-        it++;
-      } else {
-        it = waiting_packets_.erase(it);
-      }
-    }
-
-    if (not waiting_packets_.empty())
+    bool waiting = false;
+    cache_.for_each([this, &waiting] (Arp_cache::Entry& ent) {
+        if (ent.resolved) return;
+        if (ent.tries_remaining-- > 0) {
+          arp_resolver_(ent.ip);
+          waiting = true;
+        } else {
+          cache_.erase(ent);
+        }
+      });
+
+    if (waiting)
       resolve_timer_.start(1s);
 
   }
 
 
   void Arp::await_resolution(Packet_ptr pckt, ip4::Addr next_hop) {
-    auto queue =  waiting_packets_.find(next_hop);
+    auto& entry = cache_.insert(next_hop);
     PRINT("<ARP await> Waiting for resolution of %s\n", next_hop.str().c_str());
-    if (queue != waiting_packets_.end()) {
+    if (not entry.pending.empty()) {
       PRINT("\t * Packets already queueing for this IP\n");
-      queue->second.pckt->chain(std::move(pckt));
+      if (entry.pending.size() >= cache_.queue_limit()) {
+        queue_dropped_++;
+        Packet::release_chain(std::move(pckt));
+        return;
+      }
+      entry.pending.push_back(std::move(pckt));
     } else {
       PRINT("\t *This is the first packet going to that IP\n");
-      waiting_packets_.emplace(std::make_pair(next_hop, Queue_entry{std::move(pckt)}));
+      entry.pending.push_back(std::move(pckt));
+      entry.tries_remaining = arp_retries;
 
       // Try resolution immediately
       arp_resolver_(next_hop);
@@ -227,18 +252,17 @@ namespace net {
   void Arp::flush_expired()
   {
     PRINT("<ARP> Flushing expired entries\n");
-    std::vector<ip4::Addr> expired;
-    for (auto ent : cache_) {
-      if (ent.second.expired()) {
-        expired.push_back(ent.first);
-      }
-    }
-
-    for (auto ip : expired) {
-      cache_.erase(ip);
-    }
-
-    if (not cache_.empty()) {
+    const auto now = RTC::time_since_boot();
+    bool resolved = false;
+    cache_.for_each([this, now, &resolved] (Arp_cache::Entry& ent) {
+        if (not ent.resolved) return;
+        if (now > ent.timestamp + cache_exp_sec_)
+          cache_.erase(ent);
+        else
+          resolved = true;
+      });
+
+    if (resolved) {
       flush_timer_.start(flush_interval_);
     }
   }
@@ -2,6 +2,7 @@
 // #define DEBUG
 #include <net/ip4/icmp4.hpp>
 #include <net/inet>
+#include <os.hpp>
 
 namespace net {
 
@@ -217,6 +218,9 @@ namespace net {
   }
 
   void ICMPv4::send_response(icmp4::Packet& req, ICMP_type type, ICMP_code code, uint8_t error_pointer) {
+    if (UNLIKELY(not reply_limit_.admit(os::nanos_since_boot())))
+      return;
+
     // Provision new IP4-packet
     icmp4::Packet res(inet_.ip_packet_factory());
 
@@ -247,6 +251,29 @@ namespace net {
   }
 
   void ICMPv4::ping_reply(icmp4::Packet& req) {
+    if (UNLIKELY(not reply_limit_.admit(os::nanos_since_boot())))
+      return;
+
+    // Reply in the buffer of a plain request to us. Swapping the addresses
+    // leaves the payload and the ICMP checksum as they are but for the type,
+    // and IP fills in the rest of its header on the way out.
+    auto& ip = req.ip();
+    if (LIKELY(ip.ip_dst() == inet_.ip_addr() and ip.tail() == nullptr
+        and ip.ip_header_length() == (int) sizeof(IP4::header)))
+    {
+      const auto src = ip.ip_src();
+      ip.set_ip_src(ip.ip_dst());
+      ip.set_ip_dst(src);
+      ip.set_ip_ttl(PacketIP4::DEFAULT_TTL);
+      ip.set_vlan_id(0);
+      req.rewrite_type(ICMP_type::ECHO_REPLY, 0);
+
+      debug("<ICMP> Transmitting answer to %s in place\n",
+            ip.ip_dst().str().c_str());
+      network_layer_out_(req.release());
+      return;
+    }
+
     // Provision new IP4-packet
     icmp4::Packet res(inet_.ip_packet_factory());
 
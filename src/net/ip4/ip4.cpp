@@ -15,6 +15,18 @@
 
 namespace net {
 
+  /** One buffer for a frame the NIC received into several, nullptr if out of memory */
+  static IP4::IP_packet_ptr linearize(IP4::IP_packet_ptr packet)
+  {
+    try {
+      return static_unique_ptr_cast<IP4::IP_packet>(
+          Packet::linearize(std::move(packet)));
+    }
+    catch (const std::bad_alloc&) {
+      return nullptr;
+    }
+  }
+
   const ip4::Addr IP4::ADDR_ANY(0);
   const ip4::Addr IP4::ADDR_BCAST(0xff,0xff,0xff,0xff);
 
@@ -22,8 +34,8 @@ namespace net {
   addr_             {IP4::ADDR_ANY},
   netmask_          {IP4::ADDR_ANY},
   gateway_          {IP4::ADDR_ANY},
-  packets_rx_       {Statman::get().create(Stat::UINT64, inet.ifname() + ".ip4.packets_rx").get_uint64()},
-  packets_tx_       {Statman::get().create(Stat::UINT64, inet.ifname() + ".ip4.packets_tx").get_uint64()},
+  packets_rx_       {Statman::get().create_percpu(inet.ifname() + ".ip4.packets_rx")},
+  packets_tx_       {Statman::get().create_percpu(inet.ifname() + ".ip4.packets_tx")},
   packets_dropped_  {Statman::get().create(Stat::UINT32, inet.ifname() + ".ip4.packets_dropped").get_uint32()},
   stack_            {inet},
   prerouting_dropped_   {Statman::get().create(Stat::UINT32, inet.ifname() + ".ip4.prerouting_dropped").get_uint32()},
@@ -101,7 +113,27 @@ namespace net {
       or dst == ADDR_BCAST;
   }
 
-  void IP4::receive(Packet_ptr pckt, [[maybe_unused]]const bool link_bcast)
+  void IP4::receive(Packet_ptr chain, const bool link_bcast)
+  {
+    // TCP and UDP are handed up as a burst, in the order they arrived
+    Packet_chain tcp_burst;
+    Packet_chain udp_burst;
+
+    while (chain != nullptr)
+    {
+      auto pckt = std::move(chain);
+      chain = pckt->detach_tail();
+      receive_one(std::move(pckt), link_bcast, tcp_burst, udp_burst);
+    }
+
+    if (not udp_burst.empty())
+      udp_handler_(udp_burst.release());
+    if (not tcp_burst.empty())
+      tcp_handler_(tcp_burst.release());
+  }
+
+  void IP4::receive_one(Packet_ptr pckt, [[maybe_unused]]const bool link_bcast,
+                        Packet_chain& tcp_burst, Packet_chain& udp_burst)
   {
     // Cast to IP4 Packet
     auto packet = static_unique_ptr_cast<net::PacketIP4>(std::move(pckt));
@@ -124,6 +156,14 @@ namespace net {
     // Stat increment packets received
     packets_rx_++;
 
+    // UDP reads a jumbo frame in place, everyone else gets one buffer
+    if (UNLIKELY(packet->next_segment() != nullptr)
+        and packet->ip_protocol() != Protocol::UDP)
+    {
+      packet = linearize(std::move(packet));
+      if (packet == nullptr) return;
+    }
+
     // Account for possible linklayer padding
     packet->adjust_size_from_header();
 
@@ -131,33 +171,39 @@ namespace net {
     if (UNLIKELY(packet == nullptr)) return;
 
     /* PREROUTING */
-    // Track incoming packet if conntrack is active
-    Conntrack::Entry_ptr ct = (stack_.conntrack())
-      ? stack_.conntrack()->in(*packet) : nullptr;
-    auto res = prerouting_chain_(std::move(packet), stack_, ct);
-    if (UNLIKELY(res == Filter_verdict_type::DROP)) {
-      prerouting_dropped_++;
-      return;
-    }
+    Conntrack::Entry_ptr ct = nullptr;
+    if constexpr (Features::netfilter)
+    {
+      // Track incoming packet if conntrack is active
+      ct = (stack_.conntrack()) ? stack_.conntrack()->in(*packet) : nullptr;
+      auto res = prerouting_chain_(std::move(packet), stack_, ct);
+      if (UNLIKELY(res == Filter_verdict_type::DROP)) {
+        prerouting_dropped_++;
+        return;
+      }
 
-    Ensures(res.packet != nullptr);
-    packet = res.release();
+      Ensures(res.packet != nullptr);
+      packet = res.release();
+    }
 
     // Drop / forward if my ip address doesn't match dest. or broadcast
     if(not is_for_me(packet->ip_dst()))
     {
-      // Forwarding disabled
-      if (not forward_packet_)
-      {
-        PRINT("Dropping packet \n");
-        drop(std::move(packet), Direction::Upstream, Drop_reason::Bad_destination);
-      }
       // Forwarding enabled
-      else
+      if constexpr (Features::forwarding)
       {
-        PRINT("Forwarding packet \n");
-        forward_packet_(std::move(packet), stack_, ct);
+        if (forward_packet_)
+        {
+          PRINT("Forwarding packet \n");
+          // not every NIC sends segments
+          packet = linearize(std::move(packet));
+          if (packet == nullptr) return;
+          forward_packet_(std::move(packet), stack_, ct);
+          return;
+        }
       }
+      PRINT("Dropping packet \n");
+      drop(std::move(packet), Direction::Upstream, Drop_reason::Bad_destination);
       return;
     }
 
@@ -172,22 +218,25 @@ namespace net {
     }
 
     /* INPUT */
-    // Confirm incoming packet if conntrack is active
-    auto& conntrack = stack_.conntrack();
-    if(conntrack) {
-      ct = (ct != nullptr) ?
-        conntrack->confirm(ct->second, ct->proto) : conntrack->confirm(*packet);
-    }
-    if(stack_.conntrack())
-      stack_.conntrack()->confirm(*packet); // No need to set ct again
-    res = input_chain_(std::move(packet), stack_, ct);
-    if (UNLIKELY(res == Filter_verdict_type::DROP)) {
-      input_dropped_++;
-      return;
-    }
+    if constexpr (Features::netfilter)
+    {
+      // Confirm incoming packet if conntrack is active
+      auto& conntrack = stack_.conntrack();
+      if(conntrack) {
+        ct = (ct != nullptr) ?
+          conntrack->confirm(ct->second, ct->proto) : conntrack->confirm(*packet);
+      }
+      if(stack_.conntrack())
+        stack_.conntrack()->confirm(*packet); // No need to set ct again
+      auto res = input_chain_(std::move(packet), stack_, ct);
+      if (UNLIKELY(res == Filter_verdict_type::DROP)) {
+        input_dropped_++;
+        return;
+      }
 
-    Ensures(res.packet != nullptr);
-    packet = res.release();
+      Ensures(res.packet != nullptr);
+      packet = res.release();
+    }
     PRINT("* Done parsing the packet header\n");
 
     // Pass packet to it's respective protocol controller
@@ -196,10 +245,10 @@ namespace net {
       icmp_handler_(std::move(packet));
       break;
     case Protocol::UDP:
-      udp_handler_(std::move(packet));
+      udp_burst.push_back(std::move(packet));
       break;
     case Protocol::TCP:
-      tcp_handler_(std::move(packet));
+      tcp_burst.push_back(std::move(packet));
       break;
 
     default:
@@ -212,7 +261,31 @@ namespace net {
     }
   }
 
-  void IP4::transmit(Packet_ptr pckt) {
+  void IP4::transmit(Packet_ptr chain) {
+    // packets shipped to the same next hop go down as one chain
+    const bool owner = not tx_batching_;
+    tx_batching_ = true;
+
+    while (chain != nullptr)
+    {
+      auto pckt = std::move(chain);
+      chain = pckt->detach_tail();
+      transmit_one(std::move(pckt));
+    }
+
+    if (owner) {
+      flush_tx_batch();
+      tx_batching_ = false;
+    }
+  }
+
+  void IP4::flush_tx_batch()
+  {
+    if (not tx_batch_.empty())
+      linklayer_out_(tx_batch_.release(), tx_batch_hop_);
+  }
+
+  void IP4::transmit_one(Packet_ptr pckt) {
     assert((size_t)pckt->size() > sizeof(header));
 
     auto packet = static_unique_ptr_cast<PacketIP4>(std::move(pckt));
@@ -234,27 +307,33 @@ namespace net {
     packet->make_flight_ready();
 
     /* OUTPUT */
-    Conntrack::Entry_ptr ct =
-      (stack_.conntrack()) ? stack_.conntrack()->in(*packet) : nullptr;
-    auto res = output_chain_(std::move(packet), stack_, ct);
-    if (UNLIKELY(res == Filter_verdict_type::DROP)) {
-      output_dropped_++;
-      return;
-    }
-
-    Ensures(res.packet != nullptr);
-    packet = res.release();
+    Conntrack::Entry_ptr ct = nullptr;
+    if constexpr (Features::netfilter)
+    {
+      ct = (stack_.conntrack()) ? stack_.conntrack()->in(*packet) : nullptr;
+      auto res = output_chain_(std::move(packet), stack_, ct);
+      if (UNLIKELY(res == Filter_verdict_type::DROP)) {
+        output_dropped_++;
+        return;
+      }
 
+      Ensures(res.packet != nullptr);
+      packet = res.release();
+    }
 
-    if (forward_packet_) {
-      forward_packet_(std::move(packet), stack_, ct);
-      return;
+    if constexpr (Features::forwarding)
+    {
+      if (forward_packet_) {
+        forward_packet_(std::move(packet), stack_, ct);
+        return;
+      }
     }
 
     ship(std::move(packet), 0, ct);
   }
 
-  void IP4::ship(Packet_ptr pckt, ip4::Addr next_hop, Conntrack::Entry_ptr ct)
+  void IP4::ship(Packet_ptr pckt, ip4::Addr next_hop, Conntrack::Entry_ptr ct,
+                 const MAC::Addr* link_dst)
   {
     auto packet = static_unique_ptr_cast<PacketIP4>(std::move(pckt));
 
@@ -266,6 +345,12 @@ namespace net {
             );
       // to avoid loops, lets decrement hop count here
       packet->decrement_ttl();
+      // there is no NIC to finish offloaded checksums
+      if (packet->checksum_offloaded()) {
+        auto* start = packet->layer_begin() + packet->csum_start();
+        const uint16_t csum = net::checksum(start, packet->data_end() - start);
+        memcpy(start + packet->csum_offset(), &csum, sizeof(csum));
+      }
       IP4::receive(std::move(packet), false);
       return;
     }
@@ -275,19 +360,22 @@ namespace net {
     if (packet == nullptr) return;
 
     /* POSTROUTING */
-    auto& conntrack = stack_.conntrack();
-    if(conntrack) {
-      ct = (ct != nullptr) ?
-        conntrack->confirm(ct->first, ct->proto) : conntrack->confirm(*packet);
-    }
-    auto res = postrouting_chain_(std::move(packet), stack_, ct);
-    if (UNLIKELY(res == Filter_verdict_type::DROP)) {
-      postrouting_dropped_++;
-      return;
-    }
+    if constexpr (Features::netfilter)
+    {
+      auto& conntrack = stack_.conntrack();
+      if(conntrack) {
+        ct = (ct != nullptr) ?
+          conntrack->confirm(ct->first, ct->proto) : conntrack->confirm(*packet);
+      }
+      auto res = postrouting_chain_(std::move(packet), stack_, ct);
+      if (UNLIKELY(res == Filter_verdict_type::DROP)) {
+        postrouting_dropped_++;
+        return;
+      }
 
-    Ensures(res.packet != nullptr);
-    packet = res.release();
+      Ensures(res.packet != nullptr);
+      packet = res.release();
+    }
 
     if (next_hop == 0) {
       if (UNLIKELY(packet->ip_dst() == IP4::ADDR_BCAST)) {
@@ -323,6 +411,20 @@ namespace net {
     PRINT("<IP4> Transmitting packet, layer begin: buf + %li ip.len=%u pkt.size=%zu\n",
       packet->layer_begin() - packet->buf(), packet->ip_total_length(), packet->size());
 
+    if (link_dst != nullptr and link_out_)
+    {
+      link_out_(std::move(packet), *link_dst, Ethertype::IP4);
+      return;
+    }
+    if (tx_batching_)
+    {
+      if (tx_batch_hop_ != next_hop) {
+        flush_tx_batch();
+        tx_batch_hop_ = next_hop;
+      }
+      tx_batch_.push_back(std::move(packet));
+      return;
+    }
     linklayer_out_(std::move(packet), next_hop);
   }
 
@@ -1,6 +1,6 @@
 #include <net/ip4/ip4.hpp>
+#include <net/ip4/reassembly.hpp>
 #include <cassert>
-#include <rtc>
 
 //#define REASSEMBLY_DEBUG 1
 #ifdef REASSEMBLY_DEBUG
@@ -9,231 +9,222 @@
 #define PRINT(fmt, ...) /* fmt */
 #endif
 
+using namespace std::chrono_literals;
 
 namespace net
 {
-  static const int REASSEMBLY_ENTRIES = 64;
-  static const int TIMEOUT = 15;
-  //static const int TTL_MAX = 163;
-  static const int IP_ALIGN = 2;
+  // largest datagram payload with a minimal header
   static const int MAX_DATAGRAM = 65515;
 
-  inline net::Packet_ptr create_packet(uint16_t length)
-  {
-    size_t buffer_len = sizeof(Packet) + IP_ALIGN + length;
-    auto  buffer = new uint8_t[buffer_len];
-    auto* ptr    = (net::Packet*) buffer;
+  static int frag_offset(const PacketIP4& pkt) noexcept
+  { return pkt.ip_frag_offs() * 8; }
 
-    new (ptr) net::Packet(IP_ALIGN, 0, IP_ALIGN + length, nullptr);
-    return net::Packet_ptr(ptr);
-  }
+  static bool more_fragments(const PacketIP4& pkt) noexcept
+  { return (uint8_t) pkt.ip_flags() & (uint8_t) ip4::Flags::MF; }
 
-  struct Entry
-  {
-    ip4::Addr src = IP4::ADDR_ANY;
-    Protocol proto;
-    uint16_t frag_id;
-    DSCP     dscp;
-    uint32_t received;
-    uint32_t total_length;
-    RTC::timestamp_t last_seen;
-    IP4::IP_packet_ptr buffer = nullptr;
-
-    Entry() = default;
-    inline Entry(RTC::timestamp_t, IP4::IP_packet&);
-
-    bool is_dead(RTC::timestamp_t now) const noexcept {
-      return src == IP4::ADDR_ANY || now - last_seen >= TIMEOUT;
-    }
-    bool matches(RTC::timestamp_t now, IP4::IP_packet& packet) const noexcept {
-      return is_dead(now) == false
-          && this->src == packet.ip_src()
-          && this->proto == packet.ip_protocol()
-          && this->frag_id == packet.ip_id();
-    }
-    void disable() { this->src = IP4::ADDR_ANY; }
-
-    IP4::IP_packet_ptr assemble_from(IP4::IP_packet&);
-
-    auto release() {
-      this->src = IP4::ADDR_ANY;
-      return std::move(buffer);
-    }
-  };
-  IP4::IP_packet_ptr Entry::assemble_from(IP4::IP_packet& packet)
+  IP4::IP_packet_ptr IP4::reassemble(IP4::IP_packet_ptr packet)
   {
-    const int fragoff = packet.ip_frag_offs() * 8;
-    assert(fragoff >= 0);
-    // we don't allow non-initial fragments to start with
-    if (fragoff != 0 && this->buffer == nullptr) {
-      PRINT("-> Non-initial fragment in new buffer, dropping entry\n");
-      this->disable();
-      return nullptr;
-    }
-
-    if (fragoff == 0)
+    assert(packet != nullptr);
+    packet = reassembly_.process(std::move(packet));
+    // UDP reads the segments in place, everyone else gets one buffer
+    if (packet != nullptr and packet->next_segment() != nullptr
+        and packet->ip_protocol() != Protocol::UDP)
     {
-      PRINT("Creating entry buffer\n");
-      // first fragment
       try {
-        // NOTE: we can run out of memory here
-        auto raw = create_packet(MAX_DATAGRAM);
-        this->buffer = static_unique_ptr_cast<IP4::IP_packet> (std::move(raw));
+        packet = static_unique_ptr_cast<IP4::IP_packet>(
+            Packet::linearize(std::move(packet)));
       }
-      catch (std::exception&) {
+      catch (const std::bad_alloc&) {
         return nullptr;
       }
-      // set header and options
-      buffer->set_ip_version(4);
-      buffer->set_ip_header_length(20);
-      buffer->set_ip_dscp(packet.ip_dscp());
-      buffer->set_ip_ecn(packet.ip_ecn());
-      buffer->set_ip_total_length(20);
-
-      buffer->set_ip_ttl(packet.ip_ttl());
-      buffer->set_protocol(packet.ip_protocol());
-      buffer->set_ip_checksum(0);
-
-      buffer->set_ip_src(packet.ip_src());
-      buffer->set_ip_dst(packet.ip_dst());
     }
-    else
+    return packet;
+  }
+
+  bool Reassembly::Datagram::matches(const PacketIP4& pkt) const noexcept
+  {
+    return fragments != nullptr
+        && src == pkt.ip_src() && dst == pkt.ip_dst()
+        && id == pkt.ip_id() && proto == pkt.ip_protocol();
+  }
+
+  IP4::IP_packet_ptr Reassembly::process(IP_packet_ptr packet)
+  {
+    // some basic validation
+    if (UNLIKELY(packet->ip_data_length() == 0)) return nullptr;
+    if (UNLIKELY(packet->ip_src() == IP4::ADDR_ANY)) return nullptr;
+    // non-last fragments ...
+    if (more_fragments(*packet))
     {
-      // verify member fields match
-      if (UNLIKELY(this->dscp != packet.ip_dscp())) {
-        PRINT("-> DSCP mismatch in entry, dropping entry\n");
-        this->disable();
-        return nullptr;
-      }
+      // must have length mult of 8
+      if (UNLIKELY(packet->ip_data_length() % 8 != 0)) return nullptr;
+      // should be at least 400 octets long
+      if (UNLIKELY(packet->ip_data_length() < 400)) return nullptr;
     }
-    // validate length
-    const int len = packet.ip_data_length();
-    if (this->received + len > MAX_DATAGRAM) {
-      PRINT("-> data overflow in entry (%u > %u), dropping entry\n",
-            this->received + len, MAX_DATAGRAM);
-      this->disable();
+    if (UNLIKELY(frag_offset(*packet) + packet->ip_data_length() > MAX_DATAGRAM))
+      return nullptr;
+
+    const auto now = RTC::now();
+    auto* dgram = find_or_create(*packet, now);
+    if (dgram == nullptr) return nullptr;
+    PRINT("Reassembly on %s  id=%u (slot %d)\n",
+          packet->ip_src().to_string().c_str(), packet->ip_id(),
+          (int) (dgram - slots_.data()));
+
+    make_room(packet->bufsize(), dgram);
+    if (bytes_ + packet->bufsize() > MAX_BYTES
+        or not insert(*dgram, std::move(packet))) {
+      drop(*dgram);
       return nullptr;
     }
-    // add data, increase bytes received
-    auto* data = buffer->layer_begin() + buffer->ip_header_length();
-    auto* src_data = packet.layer_begin() + packet.ip_header_length();
-    std::memcpy(&data[fragoff], src_data, len);
-    this->received += len;
-
-    // when last fragment received, record total length
-    if (packet.ip_flags() != ip4::Flags::MF) {
-      this->total_length = fragoff + len;
-      PRINT("-> last fragment received, total length is %u\n",
-            this->total_length);
-    }
-    // if we've received all bytes,
-    if (this->total_length != 0)
-    {
-      // if exact, we're done
-      if (this->received == this->total_length)
-      {
-        buffer->set_ip_total_length(buffer->size());
-        buffer->set_ip_data_length(this->total_length);
-        PRINT("Shipping large packet (%u / %u)\n",
-              buffer->size(), buffer->bufsize());
-        return this->release();
-      }
-      else if (this->received > this->total_length)
-      {
-        // received too many bytes, possibly overlapping
-        PRINT("-> data overflow (%u > %u), dropping entry\n",
-              this->received, this->total_length);
-        this->disable();
-        return nullptr;
-      }
-    }
-    // otherwise, return nothing
+
+    if (dgram->total != 0 and dgram->received == dgram->total)
+      return complete(*dgram);
     return nullptr;
   }
 
-  Entry::Entry(RTC::timestamp_t now, IP4::IP_packet& packet)
-    : frag_id(packet.ip_id()), received(0), total_length(0),
-      last_seen(now), buffer(nullptr)
+  Reassembly::Datagram*
+  Reassembly::find_or_create(const PacketIP4& packet, RTC::timestamp_t now)
   {
-    this->src   = packet.ip_src();
-    this->proto = packet.ip_protocol();
-    this->dscp  = packet.ip_dscp();
+    Datagram* free_slot = nullptr;
+    for (auto& dgram : slots_)
+    {
+      if (dgram.matches(packet)) return &dgram;
+      if (dgram.fragments == nullptr and free_slot == nullptr)
+        free_slot = &dgram;
+    }
+    if (free_slot == nullptr) {
+      PRINT("-> No free reassembly slots\n");
+      return nullptr;
+    }
+    *free_slot = Datagram{};
+    free_slot->src   = packet.ip_src();
+    free_slot->dst   = packet.ip_dst();
+    free_slot->id    = packet.ip_id();
+    free_slot->proto = packet.ip_protocol();
+    free_slot->first_seen = now;
+    if (not timer_.is_running())
+      timer_.start(1s);
+    return free_slot;
   }
 
-  struct Reassembly
+  bool Reassembly::insert(Datagram& dgram, IP_packet_ptr packet)
   {
-    Reassembly() = default;
-    std::array<Entry, REASSEMBLY_ENTRIES> entries {};
-
-    int get_entry(RTC::timestamp_t, IP4::IP_packet&);
+    const int off = frag_offset(*packet);
+    const int len = packet->ip_data_length();
+    const bool last = not more_fragments(*packet);
+
+    if (last) {
+      if (dgram.total != 0 and dgram.total != (uint32_t) (off + len)) {
+        PRINT("-> Conflicting last fragments, dropping datagram\n");
+        return false;
+      }
+      dgram.total = off + len;
+      // fragments that arrived earlier must all end before it
+      for (Packet* frag = dgram.fragments.get(); frag; frag = frag->next_segment()) {
+        auto& ip = *static_cast<PacketIP4*>(frag);
+        if ((uint32_t) (frag_offset(ip) + ip.ip_data_length()) > dgram.total)
+          return false;
+      }
+    }
+    if (dgram.total != 0 and (uint32_t) (off + len) > dgram.total) {
+      PRINT("-> Fragment past the end of the datagram, dropping datagram\n");
+      return false;
+    }
 
-    IP4::IP_packet_ptr process(IP4::IP_packet_ptr packet);
-  };
-  static std::vector<std::pair<IP4&, Reassembly>> assemblies;
+    // find the fragments before and after this one
+    PacketIP4* prev = nullptr;
+    auto* next = static_cast<PacketIP4*>(dgram.fragments.get());
+    while (next != nullptr and frag_offset(*next) < off) {
+      prev = next;
+      next = static_cast<PacketIP4*>(next->next_segment());
+    }
+    if (next != nullptr and frag_offset(*next) == off
+        and next->ip_data_length() == len) {
+      PRINT("-> Duplicate fragment, ignoring\n");
+      return true;
+    }
+    if ((prev != nullptr and frag_offset(*prev) + prev->ip_data_length() > off)
+        or (next != nullptr and off + len > frag_offset(*next))) {
+      PRINT("-> Overlapping fragments, dropping datagram\n");
+      return false;
+    }
+    dgram.received += len;
+    dgram.bytes    += packet->bufsize();
+    bytes_         += packet->bufsize();
+    if (prev == nullptr) {
+      if (dgram.fragments != nullptr)
+        packet->append_segment(std::move(dgram.fragments));
+      else
+        datagrams_++;
+      dgram.fragments = std::move(packet);
+    }
+    else {
+      auto rest = prev->detach_segments();
+      if (rest != nullptr) packet->append_segment(std::move(rest));
+      prev->append_segment(std::move(packet));
+    }
+    return true;
+  }
 
-  static inline auto& get_assembly(IP4& current)
+  Reassembly::IP_packet_ptr Reassembly::complete(Datagram& dgram)
   {
-    for (auto& stk : assemblies) {
-      if (&stk.first == &current) return stk.second;
+    const uint32_t length = dgram.total;
+    auto head = std::move(dgram.fragments);
+    bytes_ -= dgram.bytes;
+    datagrams_--;
+    dgram = Datagram{};
+
+    // the fragments may not add up to more than the total length field
+    if (UNLIKELY(head->ip_header_length() + length > 0xffff)) {
+      dropped_++;
+      return nullptr;
     }
-    // create new
-    assemblies.emplace_back(current, Reassembly{});
-    return assemblies.back().second;
+    for (auto* seg = head->next_segment(); seg; seg = seg->next_segment())
+      seg->increment_layer_begin(static_cast<PacketIP4*>(seg)->ip_header_length());
+
+    head->set_ip_total_length(head->ip_header_length() + length);
+    head->clear_ip_fragmentation();
+    head->set_ip_checksum();
+    PRINT("Reassembled datagram of %u bytes\n", length);
+    return head;
   }
 
-  IP4::IP_packet_ptr IP4::reassemble(IP4::IP_packet_ptr packet)
+  void Reassembly::drop(Datagram& dgram)
   {
-    assert(packet != nullptr);
-    auto& assembly = get_assembly(*this);
-    return assembly.process(std::move(packet));
+    if (dgram.fragments == nullptr) return;
+    bytes_ -= dgram.bytes;
+    datagrams_--;
+    dropped_++;
+    dgram = Datagram{};
   }
 
-  int Reassembly::get_entry(RTC::timestamp_t now, IP4::IP_packet& packet)
+  void Reassembly::make_room(size_t bytes, const Datagram* keep)
   {
-    // first fragment
-    if (packet.ip_frag_offs() == 0)
-    {
-      // assign new entry
-      for (int i = 0; i < (int) entries.size(); i++) {
-        if (entries[i].is_dead(now)) {
-          entries[i] = Entry(now, packet);
-          return i;
-        }
-      }
-      // no free entries
-      return -1;
-    }
-    // find matching entry
-    for (int i = 0; i < (int) entries.size(); i++)
+    while (bytes_ + bytes > MAX_BYTES)
     {
-      if (entries[i].matches(now, packet)) return i;
+      Datagram* oldest = nullptr;
+      for (auto& dgram : slots_)
+        if (dgram.fragments != nullptr and &dgram != keep
+            and (oldest == nullptr or dgram.first_seen < oldest->first_seen))
+          oldest = &dgram;
+      if (oldest == nullptr) return;
+      PRINT("-> Over the memory limit, dropping the oldest datagram\n");
+      drop(*oldest);
     }
-    // no match, and we don't allow initial non-zero offsets
-    return -1;
   }
 
-  IP4::IP_packet_ptr Reassembly::process(IP4::IP_packet_ptr packet)
+  void Reassembly::expire(RTC::timestamp_t now)
   {
-    // some basic validation
-    if (UNLIKELY(packet->ip_data_length() == 0)) return nullptr;
-    if (UNLIKELY(packet->ip_src() == IP4::ADDR_ANY)) return nullptr;
-    // non-last fragments ...
-    if (packet->ip_flags() == ip4::Flags::MF)
-    {
-      // must have length mult of 8
-      if (UNLIKELY(packet->ip_data_length() % 8 != 0)) return nullptr;
-      // should be at least 400 octets long
-      if (UNLIKELY(packet->ip_data_length() < 400)) return nullptr;
-    }
-    // create timestamp used for timeouts
-    RTC::timestamp_t now = RTC::now();
-    // get entry for this fragment
-    int idx = this->get_entry(now, *packet);
-    if (idx < 0) return nullptr;
-    PRINT("Reassembly on %s  id=%u (entry %d)\n",
-          packet->ip_src().to_string().c_str(), packet->ip_id(), idx);
-
-    auto& entry = this->entries.at(idx);
-    return entry.assemble_from(*packet);
+    for (auto& dgram : slots_)
+      if (dgram.fragments != nullptr and now - dgram.first_seen >= TIMEOUT)
+        drop(dgram);
+  }
+
+  void Reassembly::on_timeout()
+  {
+    expire(RTC::now());
+    if (datagrams_ > 0)
+      timer_.start(1s);
   }
 }
@@ -1,39 +1,39 @@
-
 #include <net/ip6/extension_header.hpp>
 #include <net/ip6/packet_ip6.hpp>
 
 namespace net::ip6 {
 
-  Protocol parse_upper_layer_proto(const uint8_t* reader, const uint8_t* end,  Protocol proto)
+  Upper_layer parse_upper_layer(const uint8_t* start, const uint8_t* end, Protocol proto) noexcept
   {
-    while (proto != Protocol::IPv6_NONXT)
+    const auto* reader = start;
+    while (is_extension_header(proto))
     {
-      // bounds check
-      if (reader + sizeof(ip6::Extension_header) >= end)
-      {
-        // the packet is invalid
-        return Protocol::IPv6_NONXT;
-      }
+      // bounds check, both the fixed part and the whole header
+      if (reader + sizeof(Extension_header) > end)
+        break;
 
-      switch (proto)
-      {
-        // One of these should be the last one, and isn't a IP6 option.
-        case Protocol::TCP:
-        case Protocol::UDP:
-        case Protocol::ICMPv6:
-          return proto;
+      auto& ext = *(const Extension_header*)reader;
+      // the AH length is in 4-octet units, less two (RFC 4302)
+      const size_t len = (proto == Protocol::AH)
+        ? (ext.extended() + 2) * 4u : ext.size();
+      if (reader + len > end)
+        break;
 
-        // Currently just ignore and iterate to next one header
-        default:
-        {
-          auto& ext = *(Extension_header*)reader;
-          proto = ext.proto();
-          reader += ext.size();
-        }
-      }
+      proto = ext.proto();
+      reader += len;
     }
 
-    return proto;
+    if (is_extension_header(proto))
+    {
+      // the packet is invalid
+      return {Protocol::IPv6_NONXT, static_cast<uint16_t>(reader - start)};
+    }
+    return {proto, static_cast<uint16_t>(reader - start)};
+  }
+
+  Protocol parse_upper_layer_proto(const uint8_t* reader, const uint8_t* end,  Protocol proto)
+  {
+    return parse_upper_layer(reader, end, proto).proto;
   }
 
   uint16_t parse_extension_headers(const Extension_header* start, Protocol proto,
@@ -70,3 +70,23 @@ namespace net::ip6 {
     return n;
   }
 }
+
+namespace net {
+
+  void PacketIP6::calculate_payload_offset()
+  {
+    auto proto = next_protocol();
+    uint16_t offset = sizeof(ip6::Header);
+
+    // most packets have no extension headers, and skip the walk
+    if (UNLIKELY(ip6::is_extension_header(proto)))
+    {
+      const auto upper = ip6::parse_upper_layer(ext_hdr_start(), data_end(), proto);
+      proto   = upper.proto;
+      offset += upper.offset;
+    }
+    set_upper_protocol(static_cast<uint8_t>(proto));
+    set_payload_offset(offset);
+  }
+
+}
@@ -60,39 +60,17 @@ namespace net
       or local_ip() == ADDR_ANY;
   }
 
-  void PacketIP6::calculate_payload_offset()
-  {
-    const ptrdiff_t size = this->data_end() - this->ext_hdr_start();
-    const auto* reader = this->ext_hdr_start();
-    auto next_proto = this->next_protocol();
-    ssize_t pl_off = sizeof(ip6::Header);
-
-    while (next_proto != Protocol::IPv6_NONXT)
-    {
-        if (next_proto != Protocol::HOPOPT &&
-            next_proto != Protocol::OPTSV6)
-        {
-            PRINT("Done parsing extension header, next proto: %d\n", next_proto);
-            this->set_payload_offset(pl_off);
-            return;
-        }
-        // bounds check
-        if (reader + sizeof(ip6::Extension_header) >= this->data_end())
-        {
-          break;
-        }
-        auto& ext = *(ip6::Extension_header*)reader;
-        next_proto = ext.proto();
-        pl_off += ext.size();
-        reader += ext.size();
-    }
-    // bounds-check final payload offset
-    if (pl_off > size) pl_off = size;
-    this->set_payload_offset(pl_off);
-  }
-
   void IP6::receive(Packet_ptr pckt, const bool link_bcast)
   {
+    // a jumbo frame the NIC received into several buffers
+    if (UNLIKELY(pckt->next_segment() != nullptr)) {
+      try {
+        pckt = Packet::linearize(std::move(pckt));
+      }
+      catch (const std::bad_alloc&) {
+        return;
+      }
+    }
     auto packet = static_unique_ptr_cast<net::PacketIP6>(std::move(pckt));
     // this will calculate exthdr length and set payload correctly
     packet->calculate_payload_offset();
@@ -253,23 +231,25 @@ namespace net
     packet = drop_invalid_out(std::move(packet));
     if (packet == nullptr) return;
 
+    // The next hop and its link address, in one cache lookup when known
+    MAC::Addr mac = MAC::EMPTY;
     if (next_hop == ip6::Addr::addr_any)
     {
       auto dst = packet->ip_dst();
-      next_hop = dst.is_linklocal() ? dst : stack_.ndp().next_hop(dst);
-      PRINT("<IP6> Nexthop for %s: %s\n", dst.to_string().c_str(), next_hop.to_string().c_str());
-
-      if(UNLIKELY(next_hop == ip6::Addr::addr_any)) {
-        PRINT("<IP6> Next_hop calculated to 0, dropping\n");
+      if (dst.is_linklocal())
+        next_hop = dst;
+      else if (UNLIKELY(not stack_.ndp().route(dst, next_hop, mac))) {
+        PRINT("<IP6> No next hop for %s, dropping\n", dst.to_string().c_str());
         drop(std::move(packet), Direction::Downstream, Drop_reason::Bad_destination);
         return;
       }
+      PRINT("<IP6> Nexthop for %s: %s\n", dst.to_string().c_str(), next_hop.to_string().c_str());
     }
 
     // Stat increment packets transmitted
     packets_tx_++;
 
-    ndp_out_(std::move(packet), next_hop, MAC::EMPTY);
+    ndp_out_(std::move(packet), next_hop, mac);
   }
 
   const ip6::Addr IP6::local_ip() const {
@@ -19,6 +19,7 @@ namespace net
   requests_tx_    {Statman::get().create(Stat::UINT32, inet.ifname() + ".ndp.requests_tx").get_uint32()},
   replies_rx_     {Statman::get().create(Stat::UINT32, inet.ifname() + ".ndp.replies_rx").get_uint32()},
   replies_tx_     {Statman::get().create(Stat::UINT32, inet.ifname() + ".ndp.replies_tx").get_uint32()},
+  queue_dropped_  {Statman::get().create(Stat::UINT32, inet.ifname() + ".ndp.queue_dropped").get_uint32()},
   inet_           {inet},
   host_params_    {},
   router_params_  {},
@@ -149,13 +150,6 @@ namespace net
         }
       }
     });
-
-    auto waiting = waiting_packets_.find(target);
-    if (waiting != waiting_packets_.end()) {
-      PRINT("Ndp: Had a packet waiting for this IP. Sending\n");
-      transmit(std::move(waiting->second.pckt), target);
-      waiting_packets_.erase(waiting);
-    }
   }
 
   void Ndp::send_neighbour_solicitation(ip6::Addr target)
@@ -200,7 +194,6 @@ namespace net
         req.ip().ip_src().str().c_str(),
         req.ip().ip_dst().str().c_str(), dest_mac.str().c_str());
 
-    cache(dest, MAC::EMPTY, NeighbourStates::INCOMPLETE, 0);
     transmit(req.release(), dest, dest_mac);
   }
 
@@ -260,17 +253,23 @@ namespace net
 
     bool is_dest_multicast = req.ip().ip_dst().is_multicast();
 
+    // Someone else is probing for our tentative address. With Optimistic
+    // DAD (RFC 4429) it may already be configured, so check this first.
+    if (dad_handler_ && target == tentative_addr_
+        && (any_src || not inet_.is_valid_source6(target)))
+    {
+      PRINT("NDP: NS: DAD failed. We can't use the %s"
+            " address on our interface", target.str().c_str());
+      dad_handler_(target);
+      return;
+    }
+
     // TODO: Change this. Can be targeted to many ip6 address on this inet
     if (not inet_.is_valid_source6(target))
     {
       PRINT("NDP: not for us. target=%s us=%s\n", target.to_string().c_str(),
               inet_.ip6_linklocal().to_string().c_str());
-      if (dad_handler_ && target == tentative_addr_) {
-        PRINT("NDP: NS: DAD failed. We can't use the %s"
-              " address on our interface", target.str().c_str());
-        dad_handler_(target);
-        return;
-      } else if (!proxy_) {
+      if (!proxy_) {
         return;
       } else if (!proxy_(target)) {
          return;
@@ -581,13 +580,37 @@ namespace net
   }
 
   // RFC 4861 5.2.
-  ip6::Addr Ndp::next_hop(const ip6::Addr& dst) const
+  bool Ndp::route(const ip6::Addr& dst, ip6::Addr& next_hop, MAC::Addr& mac)
   {
-    // First check destination cache
-    auto search = dest_cache_.find(dst);
-    if(search != dest_cache_.end())
-      return search->second.next_hop();
+    // The destination cache first, valid while the routes are unchanged
+    auto* ent = cache_.find(dst);
+    if (UNLIKELY(ent == nullptr or ent->route_gen != routes_gen_))
+    {
+      const auto hop = find_next_hop(dst);
+      if (hop == ip6::Addr::addr_any)
+        return false;
+      if (ent == nullptr)
+        ent = &cache_.insert(dst);
+      cache_.set_route(*ent, hop, routes_gen_);
+    }
+    next_hop = ent->next_hop;
+
+    auto* neighbour = cache_.hop_of(*ent);
+    if (neighbour != nullptr and neighbour->resolved)
+      mac = neighbour->mac;
+    return true;
+  }
 
+  ip6::Addr Ndp::next_hop(const ip6::Addr& dst)
+  {
+    ip6::Addr hop = ip6::Addr::addr_any;
+    MAC::Addr mac;
+    route(dst, hop, mac);
+    return hop;
+  }
+
+  ip6::Addr Ndp::find_next_hop(const ip6::Addr& dst) const
+  {
     const ip6::Stateful_addr* match = nullptr;
     // Check prefix list (longest prefix match)
     for(const auto& entry : prefix_list_)
@@ -617,11 +640,8 @@ namespace net
 
   bool Ndp::lookup(ip6::Addr ip)
   {
-    auto entry = neighbour_cache_.find(ip);
-    if (entry != neighbour_cache_.end()) {
-      return true;
-    }
-    return false;
+    const auto* entry = cache_.find(ip);
+    return entry != nullptr and entry->resolved;
   }
 
   void Ndp::cache(ip6::Addr ip, uint8_t *ll_addr, NeighbourStates state, uint32_t flags, bool update)
@@ -634,70 +654,84 @@ namespace net
 
   void Ndp::cache(ip6::Addr ip, MAC::Addr mac, NeighbourStates state, uint32_t flags, bool update)
   {
+    if (UNLIKELY(mac == MAC::EMPTY)) return;
     PRINT("Ndp Caching IP %s for %s\n", ip.str().c_str(), mac.str().c_str());
-    auto entry = neighbour_cache_.find(ip);
-    if (entry != neighbour_cache_.end()) {
+
+    auto& entry = cache_.insert(ip);
+    if (entry.resolved) {
       PRINT("Cached entry found: %s recorded @ %zu. Updating timestamp\n",
-         entry->second.mac().str().c_str(), entry->second.timestamp());
-      if (entry->second.mac() != mac) {
-        neighbour_cache_.erase(entry);
-        neighbour_cache_.emplace(
-           std::make_pair(ip, Neighbour_Cache_entry{mac, state, flags})); // Insert
-      } else if (update) {
-        entry->second.set_state(state);
-        entry->second.set_flags(flags);
-        entry->second.update();
-      }
-    } else {
-      neighbour_cache_.emplace(
-        std::make_pair(ip, Neighbour_Cache_entry{mac, state, flags})); // Insert
-      if (UNLIKELY(not flush_neighbour_timer_.is_running())) {
-        flush_neighbour_timer_.start(flush_interval_);
-      }
+         entry.mac.str().c_str(), entry.timestamp);
+      if (entry.mac == mac and not update)
+        return;
+      if (entry.mac != mac)
+        cache_.changed();
+    }
+    entry.mac       = mac;
+    entry.resolved  = true;
+    entry.state     = state;
+    entry.flags     = flags;
+    entry.timestamp = RTC::time_since_boot();
+
+    if (not entry.pending.empty()) {
+      PRINT("Ndp: Had a packet waiting for this IP. Sending\n");
+      linklayer_out_(entry.pending.release(), mac, Ethertype::IP6);
+    }
+
+    if (UNLIKELY(not flush_neighbour_timer_.is_running())) {
+      flush_neighbour_timer_.start(flush_interval_);
     }
   }
 
+  void Ndp::flush_cache()
+  {
+    cache_.for_each([this] (Ndp_cache::Entry& ent) {
+        if (ent.resolved) cache_.erase(ent);
+      });
+  }
+
   void Ndp::dest_cache(ip6::Addr dest_ip, ip6::Addr next_hop)
   {
-    auto entry = dest_cache_.find(dest_ip);
-    if (entry != dest_cache_.end()) {
-      entry->second.update(next_hop);
-    } else {
-      dest_cache_.emplace(std::make_pair(dest_ip,
-            Destination_Cache_entry{next_hop}));
-    }
+    cache_.set_route(cache_.insert(dest_ip), next_hop, routes_gen_);
   }
 
   void Ndp::resolve_waiting()
   {
     PRINT("<ndp> resolve timer doing sweep\n");
 
-    for (auto it = waiting_packets_.begin(); it != waiting_packets_.end();) {
-      if (it->second.tries_remaining--) {
-        ndp_resolver_(it->first);
-        it++;
-      } else {
-        // TODO: According to RFC,
-        // Send ICMP destination unreachable
-        it = waiting_packets_.erase(it);
-      }
-    }
+    bool waiting = false;
+    cache_.for_each([this, &waiting] (Ndp_cache::Entry& ent) {
+        if (ent.resolved or ent.pending.empty()) return;
+        if (ent.tries_remaining-- > 0) {
+          ndp_resolver_(ent.ip);
+          waiting = true;
+        } else {
+          // TODO: According to RFC,
+          // Send ICMP destination unreachable
+          cache_.erase(ent);
+        }
+      });
 
-    if (not waiting_packets_.empty())
+    if (waiting)
       resolve_timer_.start(1s);
 
   }
 
   void Ndp::await_resolution(Packet_ptr pckt, ip6::Addr next_hop)
   {
-    auto queue =  waiting_packets_.find(next_hop);
+    auto& entry = cache_.insert(next_hop);
     PRINT("<NDP await> Waiting for resolution of %s\n", next_hop.str().c_str());
-    if (queue != waiting_packets_.end()) {
+    if (not entry.pending.empty()) {
       PRINT("\t * Packets already queueing for this IP\n");
-      queue->second.pckt->chain(std::move(pckt));
+      if (entry.pending.size() >= cache_.queue_limit()) {
+        queue_dropped_++;
+        Packet::release_chain(std::move(pckt));
+        return;
+      }
+      entry.pending.push_back(std::move(pckt));
     } else {
       PRINT("\t *This is the first packet going to that IP\n");
-      waiting_packets_.emplace(std::make_pair(next_hop, Queue_entry{std::move(pckt)}));
+      entry.pending.push_back(std::move(pckt));
+      entry.tries_remaining = MAX_MULTICAST_SOLICIT;
 
       // Try resolution immediately
       ndp_resolver_(next_hop);
@@ -713,15 +747,10 @@ namespace net
 
   void Ndp::delete_dest_entry(ip6::Addr ip)
   {
-    //TODO: Better to have a list of destination
-    // list entries inside router entries for faster cleanup
-    for(auto it = dest_cache_.begin(); it != dest_cache_.end(); )
-    {
-      if(it->second.next_hop() == ip)
-        it = dest_cache_.erase(it);
-      else
-        it++;
-    }
+    // Routes are looked up again before they are used next
+    PRINT("NDP: Routes through %s are gone\n", ip.to_string().c_str());
+    (void) ip;
+    routes_changed();
   }
 
   void Ndp::flush_expired_routers()
@@ -730,7 +759,7 @@ namespace net
     // TODO: Check the head of the router list.
     // If that isn't expired. None of them after it is
     for (auto ent = router_list_.begin(); ent != router_list_.end();) {
-      if (!ent->expired()) {
+      if (ent->expired()) {
         delete_dest_entry(ent->router());
         ent = router_list_.erase(ent);
       } else {
@@ -746,18 +775,17 @@ namespace net
   void Ndp::flush_expired_neighbours()
   {
     PRINT("NDP: Flushing expired entries\n");
-    std::vector<IP6::addr> expired;
-    for (auto ent : neighbour_cache_) {
-      if (ent.second.expired()) {
-        expired.push_back(ent.first);
-      }
-    }
-
-    for (auto ip : expired) {
-      neighbour_cache_.erase(ip);
-    }
+    const auto now = RTC::time_since_boot();
+    bool resolved = false;
+    cache_.for_each([this, now, &resolved] (Ndp_cache::Entry& ent) {
+        if (not ent.resolved) return;
+        if (now > ent.timestamp + neighbour_cache_exp_sec_)
+          cache_.erase(ent);
+        else
+          resolved = true;
+      });
 
-    if (not neighbour_cache_.empty()) {
+    if (resolved) {
       flush_neighbour_timer_.start(flush_interval_);
     }
   }
@@ -768,6 +796,7 @@ namespace net
     for (auto ent = prefix_list_.begin(); ent != prefix_list_.end();) {
       if (!ent->valid()) {
         ent = prefix_list_.erase(ent);
+        routes_changed();
       } else {
         ent++;
       }
@@ -796,15 +825,15 @@ namespace net
 
     if (mac == MAC::EMPTY) {
       // If we don't have a cached IP, perform NDP sol
-      auto neighbour_cache_entry = neighbour_cache_.find(next_hop);
-      if (UNLIKELY(neighbour_cache_entry == neighbour_cache_.end())) {
+      const auto* entry = cache_.find(next_hop);
+      if (UNLIKELY(entry == nullptr or not entry->resolved)) {
         PRINT("NDP: No cache entry for IP %s.  Resolving. \n", next_hop.to_string().c_str());
         await_resolution(std::move(pckt), next_hop);
         return;
       }
 
       // Get MAC from cache
-      mac = neighbour_cache_[next_hop].mac();
+      mac = entry->mac;
 
       PRINT("NDP: Found cache entry for IP %s -> %s \n",
           next_hop.to_string().c_str(), mac.to_string().c_str());
@@ -846,6 +875,7 @@ namespace net
 
     if (entry == prefix_list_.end()) {
         prefix_list_.emplace_back(ip, 64, 0, valid_lifetime);
+        routes_changed();
     } else {
         entry->update_valid_lifetime(valid_lifetime);
     }
@@ -859,12 +889,14 @@ namespace net
     if (entry == prefix_list_.end()) {
       if (valid_lifetime) {
         prefix_list_.emplace_back(ip, prefix, 0, valid_lifetime);
+        routes_changed();
       }
     } else {
       if (valid_lifetime) {
         entry->update_valid_lifetime(valid_lifetime);
       } else {
         prefix_list_.erase(entry);
+        routes_changed();
       }
     }
   }
@@ -882,6 +914,7 @@ namespace net
 
     if (entry == prefix_list_.end()) {
       prefix_list_.emplace_back(ip, prefix, preferred_lifetime, valid_lifetime);
+      routes_changed();
     } else if (!entry->always_valid()) {
       entry->update_preferred_lifetime(preferred_lifetime);
       if ((valid_lifetime > two_hours) ||
@@ -905,6 +938,9 @@ namespace net
     if (entry == router_list_.end()) {
       if (router_lifetime) {
         router_list_.emplace_back(ip, router_lifetime);
+        routes_changed();
+        if (not flush_router_timer_.is_running())
+          flush_router_timer_.start(flush_interval_);
       }
     } else if (router_lifetime) {
       entry->update_router_lifetime(router_lifetime);
@@ -63,7 +63,7 @@ namespace net
     if (!linklocal_completed)
     {
       stack.ndp().dad_completed();
-      stack.add_addr(tentative_addr_.addr(), 64, 0, 0);
+      add_tentative();
       PRINT("Auto-configuring ip6-address %s for stack %s\n",
           tentative_addr_.addr().str().c_str(), stack.ifname().c_str());
       linklocal_completed = true;
@@ -75,9 +75,7 @@ namespace net
     else
     {
       stack.ndp().dad_completed();
-      stack.add_addr_autoconf(tentative_addr_.addr(), 64,
-        tentative_addr_.preferred_ts(),
-        tentative_addr_.valid_ts());
+      add_tentative();
       PRINT("Auto-configuring ip6-address %s for stack %s\n",
           tentative_addr_.addr().str().c_str(), stack.ifname().c_str());
 
@@ -111,6 +109,12 @@ namespace net
     using namespace std::chrono;
     this->interval = milliseconds(LINKLOCAL_INTERVAL*1000);
     auto delay = milliseconds(rand() % (LINKLOCAL_INTERVAL * 1000));
+    // the address is usable right away, so solicit right away too
+    if (optimistic_)
+    {
+      add_tentative();
+      delay = milliseconds::zero();
+    }
     PRINT("Auto-configuring tentative ip6-address %s for %s "
         "with interval:%u and delay:%u ms\n",
            tentative_addr_.addr().str().c_str(), stack.ifname().c_str(),
@@ -148,6 +152,28 @@ namespace net
     timeout_timer_.start(interval, {this, &Slaac::autoconf_global});
   }
 
+  void Slaac::add_tentative()
+  {
+    const auto& addr = tentative_addr_.addr();
+    // re-adding a link-local address with no lifetime would remove it
+    if (stack.addr6_config().has(addr))
+      return;
+
+    if (addr.is_linklocal())
+      stack.add_addr(addr, 64, 0, 0);
+    else
+      stack.add_addr_autoconf(addr, 64,
+        tentative_addr_.preferred_ts(),
+        tentative_addr_.valid_ts());
+  }
+
+  void Slaac::remove_tentative()
+  {
+    const auto& addr = tentative_addr_.addr();
+    if (stack.addr6_config().has(addr))
+      stack.add_addr(addr, 64, 0, 0);
+  }
+
   void Slaac::perform_dad()
   {
     dad_transmits_--;
@@ -158,12 +184,17 @@ namespace net
 
   void Slaac::dad_handler([[maybe_unused]]const ip6::Addr& addr)
   {
+    // someone else has it, even if we were optimistic
+    remove_tentative();
+
     if(token_ and tentative_addr_.addr().get_part<uint64_t>(1) != token_)
     {
       tentative_addr_.addr().set_part(1, token_);
       PRINT("<SLAAC> DAD fail, using supplied token: %zu => %s\n",
         token_, tentative_addr_.addr().to_string().c_str());
       dad_transmits_ = 1;
+      if (optimistic_)
+        add_tentative();
     }
     else {
       timeout_timer_.stop();
@@ -224,6 +255,8 @@ namespace net
       tentative_addr_ = {addr, prefix_len, preferred_lifetime, valid_lifetime};
       dad_transmits_ = GLOBAL_RETRIES;
       timeout_timer_.stop();
+      if (optimistic_)
+        add_tentative();
       PRINT("<SLAAC> New prefix info, DAD address %s\n", addr.to_string().c_str());
       autoconf_trigger();
     }
@@ -0,0 +1,216 @@
+#include <net/nat/load_balancer.hpp>
+#include <net/inet>
+#include <kernel/events.hpp>
+#include <smp>
+#include <algorithm>
+
+//#define LB_DEBUG 1
+#ifdef LB_DEBUG
+#define LBDBG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define LBDBG(fmt, ...) /* fmt */
+#endif
+
+namespace net {
+namespace nat {
+
+static uint64_t mix(uint64_t x) noexcept
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+static bool is_prime(uint32_t n) noexcept
+{
+  if (n < 2) return false;
+  for (uint32_t d = 2; (uint64_t) d * d <= n; d++)
+    if (n % d == 0) return false;
+  return true;
+}
+
+Maglev::Maglev(std::vector<Backend> backends, uint32_t size)
+  : backends_(std::move(backends))
+{
+  Expects(is_prime(size));
+  Expects(backends_.size() < size and backends_.size() < UINT16_MAX);
+
+  struct Perm {
+    uint32_t offset;
+    uint32_t skip;
+    uint32_t next = 0;
+  };
+  std::vector<Perm> perms(backends_.size());
+  uint16_t max_weight = 0;
+  for (size_t i = 0; i < backends_.size(); i++)
+  {
+    const auto& b = backends_[i];
+    if (not b.healthy) continue;
+    max_weight = std::max(max_weight, b.weight);
+    const uint64_t key = std::hash<Socket>{}(b.addr);
+    perms[i].offset = mix(key) % size;
+    perms[i].skip   = mix(key ^ 0x9e3779b97f4a7c15ull) % (size - 1) + 1;
+  }
+  if (max_weight == 0) return;
+
+  table_.assign(size, UINT16_MAX);
+  uint32_t filled = 0;
+  for (uint64_t round = 0; ; round++)
+  {
+    for (size_t i = 0; i < backends_.size(); i++)
+    {
+      const auto& b = backends_[i];
+      if (not b.healthy or b.weight == 0) continue;
+      // the heaviest take a slot every round, the others as often as
+      // their weight says
+      if ((round + 1) * b.weight / max_weight == round * b.weight / max_weight)
+        continue;
+
+      auto& p = perms[i];
+      uint32_t slot = (p.offset + (uint64_t) p.next * p.skip) % size;
+      while (table_[slot] != UINT16_MAX) {
+        p.next++;
+        slot = (p.offset + (uint64_t) p.next * p.skip) % size;
+      }
+      table_[slot] = i;
+      p.next++;
+      if (++filled == size) {
+        empty_ = false;
+        return;
+      }
+    }
+  }
+}
+
+uint32_t Maglev::slots(size_t idx) const noexcept
+{
+  return std::count(table_.begin(), table_.end(), idx);
+}
+
+Load_balancer::Load_balancer(std::shared_ptr<Conntrack> ct, Socket vip, Mode mode,
+                             uint32_t table_size)
+  : conntrack_{ct}, napt_{std::move(ct)}, vip_{vip}, mode_{mode},
+    table_size_{table_size}
+{
+  Expects(vip_.address().is_v4());
+  publish({});
+}
+
+Load_balancer::~Load_balancer()
+{
+  // the filters must be removed from the chains by now
+  delete table_.load();
+}
+
+uint64_t Load_balancer::flow_hash(const Quadruple& flow, Protocol proto) noexcept
+{
+  const uint64_t src = std::hash<Socket>{}(flow.src);
+  const uint64_t dst = std::hash<Socket>{}(flow.dst);
+  return mix(mix(src) ^ dst ^ ((uint64_t) proto << 56));
+}
+
+void Load_balancer::publish(std::vector<Backend> backends)
+{
+  const Maglev* old = table_.exchange(new Maglev(std::move(backends), table_size_));
+  if (old == nullptr) return;
+
+  // readers only hold a table while a filter runs, so it can go once
+  // every CPU has been back to its event loop. If one can't be told,
+  // the table is kept, rather than freed too early.
+  auto* left = new std::atomic<int>(SMP::cpu_count());
+  for (int cpu = 0; cpu < SMP::cpu_count(); cpu++)
+  {
+    Events::get(cpu).post([old, left] () {
+      if (left->fetch_sub(1) == 1) {
+        delete old;
+        delete left;
+      }
+    });
+  }
+}
+
+void Load_balancer::set_backends(std::vector<Backend> backends)
+{
+  LBDBG("<LB> %s: %zu backends\n", vip_.to_string().c_str(), backends.size());
+  publish(std::move(backends));
+}
+
+std::vector<Load_balancer::Backend> Load_balancer::backends() const
+{
+  return table_.load()->backends();
+}
+
+void Load_balancer::set_weight(size_t idx, uint16_t weight)
+{
+  auto list = backends();
+  list.at(idx).weight = weight;
+  publish(std::move(list));
+}
+
+void Load_balancer::set_health(size_t idx, bool healthy)
+{
+  auto list = backends();
+  if (list.at(idx).healthy == healthy) return;
+  list[idx].healthy = healthy;
+  publish(std::move(list));
+}
+
+const Load_balancer::Backend* Load_balancer::pick(const Quadruple& flow,
+                                                  Protocol proto) const noexcept
+{
+  const auto* table = table_.load(std::memory_order_acquire);
+  return table->lookup(flow_hash(flow, proto));
+}
+
+Filter_verdict<IP4> Load_balancer::prerouting(IP4::IP_packet_ptr pkt, Inet& inet,
+                                              Conntrack::Entry_ptr entry)
+{
+  if (entry == nullptr or entry->first.dst != vip_)
+    return {std::move(pkt), Filter_verdict_type::ACCEPT};
+
+  const auto proto = pkt->ip_protocol();
+  if (proto != Protocol::TCP and proto != Protocol::UDP)
+    return {std::move(pkt), Filter_verdict_type::ACCEPT};
+
+  // the first packet picks the backend, the rest find it in the entry
+  Socket backend = entry->second.src;
+  if (backend == vip_)
+  {
+    const auto* table = table_.load(std::memory_order_acquire);
+    const auto* chosen = table->lookup(flow_hash(entry->first, proto));
+    if (UNLIKELY(chosen == nullptr)) {
+      __atomic_fetch_add(&dropped_, 1, __ATOMIC_RELAXED);
+      return {nullptr, Filter_verdict_type::DROP};
+    }
+    backend = chosen->addr;
+    __atomic_fetch_add(&new_flows_, 1, __ATOMIC_RELAXED);
+    LBDBG("<LB> New flow %s => %s\n",
+          entry->first.to_string().c_str(), backend.to_string().c_str());
+  }
+
+  if (mode_ == Mode::NAT) {
+    napt_.dnat(*pkt, entry, backend);
+    return {std::move(pkt), Filter_verdict_type::ACCEPT};
+  }
+
+  // DSR: only remember the backend, replies don't come back this way
+  if (entry->second.src != backend)
+    conntrack_->update_entry(entry->proto, entry->second, {backend, entry->second.dst});
+  // taken from the chain, so it counts as dropped there
+  inet.ip_obj().ship(std::move(pkt), backend.address().v4(), entry);
+  return {nullptr, Filter_verdict_type::DROP};
+}
+
+Filter_verdict<IP4> Load_balancer::postrouting(IP4::IP_packet_ptr pkt, Inet&,
+                                               Conntrack::Entry_ptr entry)
+{
+  if (entry != nullptr and entry->first.dst == vip_)
+    napt_.snat(*pkt, entry);
+  return {std::move(pkt), Filter_verdict_type::ACCEPT};
+}
+
+} // < namespace nat
+} // < namespace net
@@ -178,9 +178,10 @@ Socket NAPT::masq(Conntrack::Entry_ptr entry, const ip4::Addr addr, Port_util& p
   // If the entry is mirrored, it's not masked yet
   if(not is_snat(entry))
   {
-    // Generate a new eph port and bind it
-    auto port = ports.get_next_ephemeral();
-    ports.bind(port);
+    // Generate a new eph port and bind it, shared with flows to other remotes
+    const auto remote = entry->second.src;
+    auto port = ports.get_next_ephemeral(remote);
+    ports.bind(port, remote);
 
     // Update the entry to have the new socket as second
     auto masq_sock = Socket{addr, port};
@@ -188,7 +189,7 @@ Socket NAPT::masq(Conntrack::Entry_ptr entry, const ip4::Addr addr, Port_util& p
       entry->proto, entry->second, {entry->second.src, masq_sock});
 
     // Setup to unbind port on entry close
-    auto on_close = [&ports, port](Conntrack::Entry_ptr){ ports.unbind(port); };
+    auto on_close = [&ports, port](Conntrack::Entry_ptr entry){ ports.unbind(port, entry->second.src); };
     updated->on_close = on_close;
   }
 
@@ -1,16 +1,102 @@
 
 #include <net/nat/nat.hpp>
-#include <net/checksum.hpp>
 #include <net/tcp/packet4_view.hpp>
 #include <net/udp/packet4_view.hpp>
 
 namespace net {
 namespace nat {
 
-// Helper functions
-inline void recalc_ip_checksum(PacketIP4& pkt, ip4::Addr old_addr, ip4::Addr new_addr);
-inline void recalc_tcp_addr(tcp::Packet4_view_raw& pkt, ip4::Addr old_addr, ip4::Addr new_addr);
-inline void recalc_tcp_port(tcp::Packet4_view_raw& pkt, uint16_t old_port, uint16_t new_port);
+Rewrite::Rewrite(const PacketIP4& pkt, Dir dir, const Socket& sock)
+  : Rewrite(pkt, dir, true, sock.address().v4(), true, sock.port())
+{}
+
+Rewrite::Rewrite(const PacketIP4& pkt, Dir dir, const ip4::Addr addr)
+  : Rewrite(pkt, dir, true, addr, false, 0)
+{}
+
+Rewrite::Rewrite(const PacketIP4& pkt, Dir dir, const uint16_t port)
+  : Rewrite(pkt, dir, false, 0, true, port)
+{}
+
+Rewrite::Rewrite(const PacketIP4& pkt, Dir dir,
+                 bool set_addr, const ip4::Addr addr,
+                 bool set_port, const uint16_t port)
+  : addr_{addr}, port_{htons(port)},
+    proto_{pkt.ip_protocol()}, dir_{dir},
+    set_addr_{set_addr},
+    set_port_{set_port and
+              (proto_ == Protocol::TCP or proto_ == Protocol::UDP)}
+{
+  if(set_addr_)
+  {
+    const auto& old_addr = (dir == Dir::SRC) ? pkt.ip_src() : pkt.ip_dst();
+    ip_delta_.add(old_addr, addr_);
+    // the TCP/UDP pseudo-header covers the addresses
+    l4_delta_.add(ip_delta_);
+  }
+  if(set_port_)
+  {
+    // TCP and UDP both start with source and destination port
+    const auto* ports = reinterpret_cast<const uint16_t*>(pkt.ip_data().data());
+    const uint16_t old_port = ports[(dir == Dir::SRC) ? 0 : 1];
+    l4_delta_.add(old_port, port_);
+  }
+}
+
+void Rewrite::apply(PacketIP4& pkt) const noexcept
+{
+  if(set_addr_)
+  {
+    pkt.set_ip_checksum(ip_delta_.apply(pkt.ip_checksum()));
+    if(dir_ == Dir::SRC)
+      pkt.set_ip_src(addr_);
+    else
+      pkt.set_ip_dst(addr_);
+  }
+
+  switch(proto_)
+  {
+    case Protocol::TCP:
+    {
+      tcp::Packet4_view_raw tcp{&pkt};
+      // with checksum offload the field holds the pseudo-header sum,
+      // and the NIC sums the ports
+      const auto sum = tcp.tcp_checksum();
+      tcp.set_tcp_checksum(pkt.checksum_offloaded()
+        ? ip_delta_.apply_partial(sum) : l4_delta_.apply(sum));
+      break;
+    }
+    case Protocol::UDP:
+    {
+      udp::Packet4_view_raw udp{&pkt};
+      // as with TCP, an offloaded checksum holds the pseudo-header sum
+      if(pkt.checksum_offloaded()) {
+        udp.set_udp_checksum(ip_delta_.apply_partial(udp.udp_checksum()));
+        break;
+      }
+      // a zero UDP checksum means none, zero is sent as all ones
+      if(const auto sum = udp.udp_checksum(); sum != 0) {
+        const auto adjusted = l4_delta_.apply(sum);
+        udp.set_udp_checksum(adjusted != 0 ? adjusted : 0xffff);
+      }
+      break;
+    }
+    default:
+      return;
+  }
+
+  if(set_port_)
+  {
+    auto* ports = reinterpret_cast<uint16_t*>(pkt.ip_data().data());
+    ports[(dir_ == Dir::SRC) ? 0 : 1] = port_;
+  }
+}
+
+void Rewrite::apply_chain(PacketIP4& head) const noexcept
+{
+  for(Packet* pkt = &head; pkt != nullptr; pkt = pkt->tail())
+    apply(static_cast<PacketIP4&>(*pkt));
+}
 
 void snat(PacketIP4& pkt, const Socket& src_socket)
 {
@@ -123,248 +209,90 @@ void dnat(PacketIP4& pkt, const uint16_t new_port)
 }
 
 // TCP SNAT //
-void tcp_snat(PacketIP4& ip4, const Socket& new_sock)
+void tcp_snat(PacketIP4& pkt, const Socket& new_sock)
 {
-  Expects(ip4.ip_protocol() == Protocol::TCP);
-
-  // IP4 source
-  auto old_addr = ip4.ip_src();
-  auto new_addr = new_sock.address().v4();
-  // recalc IP checksum
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  // TCP
-  tcp::Packet4_view_raw pkt{&ip4};
-  auto tcp_sum = pkt.tcp_checksum();
-  // recalc tcp address part
-  checksum_adjust(&tcp_sum, &old_addr, &new_addr);
-  // recalc tcp port part
-  auto old_port = htons(pkt.src_port());
-  auto new_port = htons(new_sock.port());
-  checksum_adjust<uint16_t>(&tcp_sum, &old_port, &new_port);
-
-  // set the new sum
-  pkt.set_tcp_checksum(tcp_sum);
-
-  // change source address and port
-  ip4.set_ip_src(new_addr);
-  pkt.set_src_port(new_sock.port());
+  Expects(pkt.ip_protocol() == Protocol::TCP);
+  Rewrite{pkt, Rewrite::Dir::SRC, new_sock}.apply(pkt);
 }
 
-void tcp_snat(PacketIP4& ip4, const ip4::Addr new_addr)
+void tcp_snat(PacketIP4& pkt, const ip4::Addr new_addr)
 {
-  Expects(ip4.ip_protocol() == Protocol::TCP);
-
-  // recalc IP checksum
-  auto old_addr = ip4.ip_src();
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  // recalc tcp address csum
-  tcp::Packet4_view_raw pkt{&ip4};
-  recalc_tcp_addr(pkt, old_addr, new_addr);
-
-  // change source address
-  ip4.set_ip_src(new_addr);
+  Expects(pkt.ip_protocol() == Protocol::TCP);
+  Rewrite{pkt, Rewrite::Dir::SRC, new_addr}.apply(pkt);
 }
 
-void tcp_snat(PacketIP4& p, const uint16_t new_port)
+void tcp_snat(PacketIP4& pkt, const uint16_t new_port)
 {
-  Expects(p.ip_protocol() == Protocol::TCP);
-  tcp::Packet4_view_raw pkt{&p};
-  // recalc tcp port
-  recalc_tcp_port(pkt, pkt.src_port(), new_port);
-  // change source port
-  pkt.set_src_port(new_port);
+  Expects(pkt.ip_protocol() == Protocol::TCP);
+  Rewrite{pkt, Rewrite::Dir::SRC, new_port}.apply(pkt);
 }
 
 // TCP DNAT //
-void tcp_dnat(PacketIP4& ip4, const Socket& new_sock)
+void tcp_dnat(PacketIP4& pkt, const Socket& new_sock)
 {
-  Expects(ip4.ip_protocol() == Protocol::TCP);
-
-  // IP4 dest
-  auto old_addr = ip4.ip_dst();
-  auto new_addr = new_sock.address().v4();
-  // recalc IP checksum
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  // TCP
-  tcp::Packet4_view_raw pkt{&ip4};
-  auto tcp_sum = pkt.tcp_checksum();
-  // recalc tcp address part
-  checksum_adjust(&tcp_sum, &old_addr, &new_addr);
-  // recalc tcp port part
-  auto old_port = htons(pkt.dst_port());
-  auto new_port = htons(new_sock.port());
-  checksum_adjust<uint16_t>(&tcp_sum, &old_port, &new_port);
-
-  // set the new sum
-  pkt.set_tcp_checksum(tcp_sum);
-
-  // change source address and port
-  ip4.set_ip_dst(new_addr);
-  pkt.set_dst_port(new_sock.port());
+  Expects(pkt.ip_protocol() == Protocol::TCP);
+  Rewrite{pkt, Rewrite::Dir::DST, new_sock}.apply(pkt);
 }
 
-void tcp_dnat(PacketIP4& ip4, const ip4::Addr new_addr)
+void tcp_dnat(PacketIP4& pkt, const ip4::Addr new_addr)
 {
-  Expects(ip4.ip_protocol() == Protocol::TCP);
-
-  // recalc IP checksum
-  auto old_addr = ip4.ip_dst();
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  // recalc tcp address csum
-  tcp::Packet4_view_raw pkt{&ip4};
-  recalc_tcp_addr(pkt, old_addr, new_addr);
-
-  // change destination address
-  ip4.set_ip_dst(new_addr);
+  Expects(pkt.ip_protocol() == Protocol::TCP);
+  Rewrite{pkt, Rewrite::Dir::DST, new_addr}.apply(pkt);
 }
 
-void tcp_dnat(PacketIP4& ip4, const uint16_t new_port)
+void tcp_dnat(PacketIP4& pkt, const uint16_t new_port)
 {
-  Expects(ip4.ip_protocol() == Protocol::TCP);
-  tcp::Packet4_view_raw pkt{&ip4};
-  // recalc tcp port csum
-  recalc_tcp_port(pkt, pkt.dst_port(), new_port);
-  // change destination port
-  pkt.set_dst_port(new_port);
+  Expects(pkt.ip_protocol() == Protocol::TCP);
+  Rewrite{pkt, Rewrite::Dir::DST, new_port}.apply(pkt);
 }
 
 // UDP SNAT //
-void udp_snat(PacketIP4& ip4, const Socket& new_sock)
+void udp_snat(PacketIP4& pkt, const Socket& new_sock)
 {
-  Expects(ip4.ip_protocol() == Protocol::UDP);
-
-  // IP4 source
-  auto old_addr = ip4.ip_src();
-  auto new_addr = new_sock.address().v4();
-  // recalc IP checksum
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  udp::Packet4_view_raw pkt{&ip4};
-
-  // <Recalc UDP checksum here>
-
-  // change source
-  ip4.set_ip_src(new_addr);
-  pkt.set_src_port(new_sock.port());
+  Expects(pkt.ip_protocol() == Protocol::UDP);
+  Rewrite{pkt, Rewrite::Dir::SRC, new_sock}.apply(pkt);
 }
 
-void udp_snat(PacketIP4& ip4, const ip4::Addr new_addr)
+void udp_snat(PacketIP4& pkt, const ip4::Addr new_addr)
 {
-  Expects(ip4.ip_protocol() == Protocol::UDP);
-
-  // IP4 source
-  auto old_addr = ip4.ip_src();
-  // recalc IP checksum
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  // <Recalc UDP checksum here>
-
-  // change destination address
-  ip4.set_ip_src(new_addr);
+  Expects(pkt.ip_protocol() == Protocol::UDP);
+  Rewrite{pkt, Rewrite::Dir::SRC, new_addr}.apply(pkt);
 }
 
-void udp_snat(PacketIP4& ip4, const uint16_t new_port)
+void udp_snat(PacketIP4& pkt, const uint16_t new_port)
 {
-  Expects(ip4.ip_protocol() == Protocol::UDP);
-
-  udp::Packet4_view_raw pkt{&ip4};
-
-  // <Recalc UDP checksum here>
-
-  // change source port
-  pkt.set_src_port(new_port);
+  Expects(pkt.ip_protocol() == Protocol::UDP);
+  Rewrite{pkt, Rewrite::Dir::SRC, new_port}.apply(pkt);
 }
 
 // UDP DNAT //
-void udp_dnat(PacketIP4& ip4, const Socket& new_sock)
+void udp_dnat(PacketIP4& pkt, const Socket& new_sock)
 {
-  Expects(ip4.ip_protocol() == Protocol::UDP);
-
-  // IP4 dest
-  auto old_addr = ip4.ip_dst();
-  auto new_addr = new_sock.address().v4();
-  // recalc IP checksum
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  udp::Packet4_view_raw pkt{&ip4};
-
-  // <Recalc UDP checksum here>
-
-  // change destination
-  ip4.set_ip_dst(new_addr);
-  pkt.set_dst_port(new_sock.port());
+  Expects(pkt.ip_protocol() == Protocol::UDP);
+  Rewrite{pkt, Rewrite::Dir::DST, new_sock}.apply(pkt);
 }
 
-void udp_dnat(PacketIP4& ip4, const ip4::Addr new_addr)
+void udp_dnat(PacketIP4& pkt, const ip4::Addr new_addr)
 {
-  Expects(ip4.ip_protocol() == Protocol::UDP);
-
-  // IP4 dest
-  auto old_addr = ip4.ip_dst();
-  // recalc IP checksum
-  recalc_ip_checksum(ip4, old_addr, new_addr);
-
-  // <Recalc UDP checksum here>
-
-  // change destination address
-  ip4.set_ip_dst(new_addr);
+  Expects(pkt.ip_protocol() == Protocol::UDP);
+  Rewrite{pkt, Rewrite::Dir::DST, new_addr}.apply(pkt);
 }
 
-void udp_dnat(PacketIP4& ip4, const uint16_t new_port)
+void udp_dnat(PacketIP4& pkt, const uint16_t new_port)
 {
-  Expects(ip4.ip_protocol() == Protocol::UDP);
-
-  udp::Packet4_view_raw pkt{&ip4};
-
-  // <Recalc UDP checksum here>
-
-  // change destination port
-  pkt.set_dst_port(new_port);
+  Expects(pkt.ip_protocol() == Protocol::UDP);
+  Rewrite{pkt, Rewrite::Dir::DST, new_port}.apply(pkt);
 }
 
 // ICMP NAT
 void icmp_snat(PacketIP4& pkt, const ip4::Addr addr)
 {
-  // recalc IP checksum
-  recalc_ip_checksum(pkt, pkt.ip_src(), addr);
-  pkt.set_ip_src(addr);
+  Rewrite{pkt, Rewrite::Dir::SRC, addr}.apply(pkt);
 }
 
 void icmp_dnat(PacketIP4& pkt, const ip4::Addr addr)
 {
-  // recalc IP checksum
-  recalc_ip_checksum(pkt, pkt.ip_dst(), addr);
-  pkt.set_ip_dst(addr);
-}
-
-inline void recalc_ip_checksum(PacketIP4& pkt, ip4::Addr old_addr, ip4::Addr new_addr)
-{
-  auto ip_sum = pkt.ip_checksum();
-  checksum_adjust(&ip_sum, &old_addr, &new_addr);
-  pkt.set_ip_checksum(ip_sum);
-}
-
-inline void recalc_tcp_addr(tcp::Packet4_view_raw& pkt, ip4::Addr old_addr, ip4::Addr new_addr)
-{
-  // recalc tcp address part
-  auto tcp_sum = pkt.tcp_checksum();
-  checksum_adjust(&tcp_sum, &old_addr, &new_addr);
-  pkt.set_tcp_checksum(tcp_sum);
-}
-
-inline void recalc_tcp_port(tcp::Packet4_view_raw& pkt, uint16_t old_port, uint16_t new_port)
-{
-  // swap ports to network order
-  old_port = htons(old_port);
-  new_port = htons(new_port);
-  // update TCP csum
-  auto tcp_sum  = pkt.tcp_checksum();
-  checksum_adjust<uint16_t>(&tcp_sum, &old_port, &new_port);
-  pkt.set_tcp_checksum(tcp_sum);
+  Rewrite{pkt, Rewrite::Dir::DST, addr}.apply(pkt);
 }
 
 }
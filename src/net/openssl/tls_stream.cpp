@@ -1,13 +1,64 @@
 #include <net/openssl/tls_stream.hpp>
+#include <smp>
 
 using namespace openssl;
 
+// A handshake step on another CPU. The SSL is only touched there until
+// the job is back on the stream's CPU.
+struct TLS_stream::Handshake_job {
+  SSL*        ssl;
+  TLS_stream* stream;  // nullptr if the stream went away meanwhile
+  int         owner;
+  int         result = 0;
+  int         error  = SSL_ERROR_NONE;
+  // records written meanwhile
+  net::Stream::buffer_t cipher = nullptr;
+};
+
+// OpenSSL writes the records straight into a buffer for the transport,
+// rather than into a memory BIO to be copied out again
+static int cipher_bio_write(BIO* bio, const char* data, int len)
+{
+  auto& out = *static_cast<net::Stream::buffer_t*>(BIO_get_data(bio));
+  BIO_clear_retry_flags(bio);
+  try {
+    if (out == nullptr)
+      out = std::make_shared<os::mem::buffer>();
+    out->insert(out->end(), data, data + len);
+  }
+  catch (const std::bad_alloc&) {
+    BIO_set_retry_write(bio);
+    return -1;
+  }
+  return len;
+}
+static long cipher_bio_ctrl(BIO*, int cmd, long, void*)
+{
+  // the records are sent by tls_perform_stream_write
+  return (cmd == BIO_CTRL_FLUSH) ? 1 : 0;
+}
+
+BIO* TLS_stream::new_cipher_bio(buffer_t* out)
+{
+  static BIO_METHOD* method = [] {
+    auto* m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "TLS_stream");
+    BIO_meth_set_write(m, cipher_bio_write);
+    BIO_meth_set_ctrl(m, cipher_bio_ctrl);
+    return m;
+  }();
+  BIO* bio = BIO_new(method);
+  assert(bio != nullptr);
+  BIO_set_data(bio, out);
+  BIO_set_init(bio, 1);
+  return bio;
+}
+
 TLS_stream::TLS_stream(SSL_CTX* ctx, Stream_ptr t, bool outgoing)
   : m_transport(std::move(t))
 {
   ERR_clear_error(); // prevent old errors from mucking things up
   this->m_bio_rd = BIO_new(BIO_s_mem());
-  this->m_bio_wr = BIO_new(BIO_s_mem());
+  this->m_bio_wr = new_cipher_bio(&this->m_cipher);
   assert(ERR_get_error() == 0 && "Initializing BIOs");
   this->m_ssl = SSL_new(ctx);
   assert(this->m_ssl != nullptr);
@@ -31,8 +82,18 @@ TLS_stream::TLS_stream(SSL_CTX* ctx, Stream_ptr t, bool outgoing)
   }
 }
 TLS_stream::TLS_stream(Stream_ptr t, SSL* ssl, BIO* rd, BIO* wr)
-  : m_transport(std::move(t)), m_ssl(ssl), m_bio_rd(rd), m_bio_wr(wr)
+  : m_transport(std::move(t)), m_ssl(ssl), m_bio_rd(rd)
 {
+  // records already written go first
+  const int pending = BIO_ctrl_pending(wr);
+  if (pending > 0)
+  {
+    this->m_cipher = construct_write_buffer(pending);
+    if (this->m_cipher != nullptr)
+      BIO_read(wr, this->m_cipher->data(), pending);
+  }
+  this->m_bio_wr = new_cipher_bio(&this->m_cipher);
+  SSL_set0_wbio(ssl, this->m_bio_wr);
   // always-on callbacks
   m_transport->on_data({this, &TLS_stream::handle_data});
   m_transport->on_close({this, &TLS_stream::close_callback_once});
@@ -40,45 +101,128 @@ TLS_stream::TLS_stream(Stream_ptr t, SSL* ssl, BIO* rd, BIO* wr)
 TLS_stream::~TLS_stream()
 {
   assert(m_busy == 0 && "Cannot delete stream while in its call stack");
-  SSL_free(this->m_ssl);
+  // the job frees the SSL when it comes back
+  if (m_handshake_job != nullptr)
+    m_handshake_job->stream = nullptr;
+  else
+    SSL_free(this->m_ssl);
 }
 
 void TLS_stream::write(buffer_t buffer)
+{
+  write(buffer->data(), buffer->size());
+}
+
+void TLS_stream::write(const std::string& str)
+{
+  write(str.data(), str.size());
+}
+
+void TLS_stream::write(const void* data, const size_t len)
 {
   if (UNLIKELY(this->is_connected() == false)) {
     TLS_PRINT("::write() called on closed stream\n");
     return;
   }
-  int n = SSL_write(this->m_ssl, buffer->data(), buffer->size());
-  auto status = this->status(n);
-  if (status == STATUS_FAIL) {
-    TLS_PRINT("::write() Fail status %d\n",n);
-    this->close();
+  auto* buf = static_cast<const uint8_t*> (data);
+  if (m_flush_window.count() > 0 and len < MAX_RECORD)
+  {
+    if (gather(buf, len) == false) return;
+  }
+  else
+  {
+    // what is waiting goes first
+    if (encrypt_waiting() == false) return;
+    if (encrypt(buf, len) == false) return;
+  }
+  send_records();
+}
+
+void TLS_stream::writev(const buffer_t* buffers, const size_t count)
+{
+  if (UNLIKELY(this->is_connected() == false)) {
+    TLS_PRINT("::writev() called on closed stream\n");
     return;
   }
+  for (size_t i = 0; i < count; i++)
+  {
+    const auto& buffer = buffers[i];
+    if (buffer->size() >= MAX_RECORD)
+    {
+      if (encrypt_waiting() == false) return;
+      if (encrypt(buffer->data(), buffer->size()) == false) return;
+    }
+    else if (gather(buffer->data(), buffer->size()) == false) return;
+  }
+  // the last record waits only if asked to
+  if (m_flush_window.count() == 0 and encrypt_waiting() == false) return;
+  send_records();
+}
 
-  do {
-    n = tls_perform_stream_write();
-  } while (n > 0);
+void TLS_stream::flush()
+{
+  if (UNLIKELY(this->is_connected() == false)) return;
+  if (encrypt_waiting()) send_records();
+}
 
-  if (this->m_deferred_close) {
-    TLS_PRINT("::write() close on m_deferred_close after tls_perform_stream_write\n");
-    this->close();
-    return;
+// Adds to the small writes waiting, encrypting each record filled.
+// false if the stream closed.
+bool TLS_stream::gather(const uint8_t* data, size_t len)
+{
+  while (len > 0)
+  {
+    if (m_plain == nullptr)
+    {
+      m_plain = construct_write_buffer();
+      if (UNLIKELY(m_plain == nullptr)) return encrypt(data, len);
+      m_plain->reserve(MAX_RECORD);
+    }
+    const size_t n = std::min(len, MAX_RECORD - m_plain->size());
+    m_plain->insert(m_plain->end(), data, data + n);
+    data += n;
+    len  -= n;
+    if (m_plain->size() == MAX_RECORD)
+    {
+      if (encrypt_waiting() == false) return false;
+    }
   }
+  if (m_plain != nullptr and m_flush_window.count() > 0)
+    m_flush_timer.start(m_flush_window);
+  return true;
 }
 
-void TLS_stream::write(const std::string& str)
+bool TLS_stream::encrypt_waiting()
 {
-  //TODO handle failed alloc
-  write(net::StreamBuffer::construct_write_buffer(str.data(),str.data()+str.size()));
+  m_flush_timer.stop();
+  if (m_plain == nullptr) return true;
+  auto plain = std::move(m_plain);
+  m_plain = nullptr;
+  return encrypt(plain->data(), plain->size());
 }
 
-void TLS_stream::write(const void* data, const size_t len)
+// Encrypts into m_cipher, to be sent with send_records().
+// false if the stream closed.
+bool TLS_stream::encrypt(const void* data, const size_t len)
 {
-  //TODO handle failed alloc
-  auto* buf = static_cast<const uint8_t*> (data);
-  write(net::StreamBuffer::construct_write_buffer(buf, buf + len));
+  if (len == 0) return true;
+  ERR_clear_error();
+  int n = SSL_write(this->m_ssl, data, len);
+  if (this->status(n) == STATUS_FAIL) {
+    TLS_PRINT("::write() Fail status %d\n",n);
+    this->close();
+    return false;
+  }
+  return true;
+}
+
+void TLS_stream::send_records()
+{
+  tls_perform_stream_write();
+
+  if (this->m_deferred_close) {
+    TLS_PRINT("::write() close on m_deferred_close after tls_perform_stream_write\n");
+    this->close();
+  }
 }
 
 int TLS_stream::decrypt(const void *indata, int size)
@@ -94,38 +238,105 @@ int TLS_stream::decrypt(const void *indata, int size)
   // if we aren't finished initializing session
   if (UNLIKELY(!handshake_completed()))
   {
-    int num = SSL_do_handshake(this->m_ssl);
-    auto status = this->status(num);
-    // OpenSSL wants to write
-    if (status == STATUS_WANT_IO)
+    if (m_handshake_cpu >= 0 and m_handshake_cpu != SMP::cpu_id())
     {
-      tls_perform_stream_write();
+      start_handshake_job();
+      return 0;
     }
-    else if (status == STATUS_FAIL)
-    {
-      if (num < 0) {
-        TLS_PRINT("TLS_stream::SSL_do_handshake() returned %d\n", num);
-        #ifdef VERBOSE_OPENSSL
-          ERR_print_errors_fp(stdout);
-        #endif
-      }
-      this->close();
-      return -1;
+    int num = SSL_do_handshake(this->m_ssl);
+    const int res = handshake_step(num, SSL_get_error(this->m_ssl, num));
+    if (res <= 0) return res;
+  }
+  return n;
+}
+
+// -1 if the stream closed, 0 if the handshake goes on, 1 when it is done
+int TLS_stream::handshake_step(int num, int error)
+{
+  auto status = status_of(error);
+  // OpenSSL wants to write
+  if (status == STATUS_WANT_IO)
+  {
+    tls_perform_stream_write();
+  }
+  else if (status == STATUS_FAIL)
+  {
+    if (num < 0) {
+      TLS_PRINT("TLS_stream::SSL_do_handshake() returned %d\n", num);
+      #ifdef VERBOSE_OPENSSL
+        ERR_print_errors_fp(stdout);
+      #endif
     }
-    // nothing more to do if still not finished
-    if (handshake_completed() == false) return 0;
-    // handshake success
-    this->m_busy += 1;
-    connected();
-    this->m_busy -= 1;
+    this->close();
+    return -1;
+  }
+  // nothing more to do if still not finished
+  if (handshake_completed() == false) return 0;
+  // handshake success
+  this->m_busy += 1;
+  connected();
+  this->m_busy -= 1;
 
-    if (this->m_deferred_close) {
-      TLS_PRINT("::read() close on m_deferred_close after tls_perform_stream_write\n");
-      this->close();
-      return -1;
+  if (this->m_deferred_close) {
+    TLS_PRINT("::read() close on m_deferred_close after tls_perform_stream_write\n");
+    this->close();
+    return -1;
+  }
+  return 1;
+}
+
+void TLS_stream::start_handshake_job()
+{
+  auto job = std::make_shared<Handshake_job>();
+  job->ssl    = this->m_ssl;
+  job->stream = this;
+  job->owner  = SMP::cpu_id();
+  this->m_handshake_job = job;
+  // the records of this step are kept with the job
+  BIO_set_data(this->m_bio_wr, &job->cipher);
+
+  SMP::add_task(
+  [job] () {
+    ERR_clear_error();
+    job->result = SSL_do_handshake(job->ssl);
+    job->error  = SSL_get_error(job->ssl, job->result);
+    // back to the stream's CPU
+    if (job->owner == 0)
+      SMP::add_bsp_task([job] () { handshake_job_done(*job); });
+    else {
+      SMP::add_task([job] () { handshake_job_done(*job); }, job->owner);
+      SMP::signal(job->owner);
     }
+  }, m_handshake_cpu);
+  SMP::signal(m_handshake_cpu);
+}
+
+void TLS_stream::handshake_job_done(Handshake_job& job)
+{
+  if (job.stream == nullptr) {
+    SSL_free(job.ssl);
+    return;
   }
-  return n;
+  auto& self = *job.stream;
+  self.m_handshake_job = nullptr;
+  BIO_set_data(self.m_bio_wr, &self.m_cipher);
+  self.m_cipher = std::move(job.cipher);
+  const int res = self.handshake_step(job.result, job.error);
+  if (res < 0) return;
+  // data that came along with the end of the handshake
+  if (res > 0)
+  {
+    self.send_decrypted();
+    self.m_busy += 1;
+    self.signal_data();
+    self.m_busy -= 1;
+    if (self.m_deferred_close) {
+      self.close();
+      return;
+    }
+  }
+  // carry on with what arrived meanwhile
+  self.handle_data();
 }
 
 int TLS_stream::send_decrypted()
@@ -170,7 +381,7 @@ void TLS_stream::handle_data()
 {
   while (m_transport->next_size() > 0)
   {
-    if (UNLIKELY(this->read_congested())) {
+    if (UNLIKELY(this->read_congested() or m_handshake_job != nullptr)) {
       break;
     }
     auto buffer = m_transport->read_next();
@@ -258,41 +469,20 @@ bool TLS_stream::tls_read(buffer_t buffer)
 
 int TLS_stream::tls_perform_stream_write()
 {
-  ERR_clear_error();
-  int pending = BIO_ctrl_pending(this->m_bio_wr);
-  if (pending > 0)
-  {
-    TLS_PRINT("::tls_perform_stream_write() pending=%d bytes\n",pending);
-    auto buffer = net::StreamBuffer::construct_write_buffer(pending);
-    if (buffer == nullptr) {
-      return 0;
-    }
-    int n = BIO_read(this->m_bio_wr, buffer->data(), buffer->size());
-    assert(n == pending);
-    //What if we cant write..
-    if (m_transport->is_writable())
-    {
-      m_transport->write(buffer);
-
-      this->m_busy += 1;
-      stream_on_write(n);
-      this->m_busy -= 1;
-    }
-
-    if (UNLIKELY((pending = BIO_ctrl_pending(this->m_bio_wr)) > 0))
-    {
-      return pending;
-    }
+  if (this->m_cipher == nullptr or this->m_cipher->empty())
     return 0;
-  }
-
-  BIO_read(this->m_bio_wr, nullptr, 0);
-
-  if (!BIO_should_retry(this->m_bio_wr))
+  auto buffer = std::move(this->m_cipher);
+  this->m_cipher = nullptr;
+  const int n = buffer->size();
+  TLS_PRINT("::tls_perform_stream_write() pending=%d bytes\n", n);
+  //What if we cant write..
+  if (m_transport->is_writable())
   {
-    TLS_PRINT("::tls_perform_stream_write() close on !BIO_should_retry\n");
-    this->close();
-    return -1;
+    m_transport->write(std::move(buffer));
+
+    this->m_busy += 1;
+    stream_on_write(n);
+    this->m_busy -= 1;
   }
   return 0;
 }
@@ -329,6 +519,12 @@ void TLS_stream::close()
     TLS_PRINT("::close() deferred\n");
     this->m_deferred_close = true; return;
   }
+  // the small writes waiting are sent before closing
+  if (m_plain != nullptr and this->is_connected())
+  {
+    if (encrypt_waiting()) tls_perform_stream_write();
+  }
+  m_flush_timer.stop();
   CloseCallback func = getCloseCallback();
   this->reset_callbacks();
   if (m_transport->is_connected())
@@ -356,7 +552,10 @@ bool TLS_stream::handshake_completed() const noexcept
 }
 TLS_stream::status_t TLS_stream::status(int n) const noexcept
 {
-  int error = SSL_get_error(this->m_ssl, n);
+  return status_of(SSL_get_error(this->m_ssl, n));
+}
+TLS_stream::status_t TLS_stream::status_of(int error) noexcept
+{
   switch (error)
   {
   case SSL_ERROR_NONE:
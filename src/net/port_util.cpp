@@ -0,0 +1,67 @@
+#include <net/port_util.hpp>
+#include <kernel/rng.hpp>
+#include <util/siphash.hpp>
+
+using namespace net;
+
+Port_util::Port_util()
+  : ports(),
+    ephemeral_(net::new_ephemeral_port()),
+    eph_count(0),
+    key_{rng_extract_uint64(), rng_extract_uint64()},
+    perturb_{}
+{
+  // all ports are free
+  ports.set_all();
+}
+
+uint16_t Port_util::get_next_ephemeral(const Socket& remote)
+{
+  // Double-hash port selection (RFC 6056 3.3.4): the remote decides where
+  // to start, and a counter per bucket of remotes moves it along, so the
+  // ports to one remote are hard to guess without following each other.
+  const auto& addr = remote.address().v6();
+  const uint64_t h = util::Siphash{key_[0], key_[1]}
+    .add(addr.i64[0]).add(addr.i64[1])
+    .add(remote.port())
+    .finish();
+  const uint32_t offset = h >> 32;
+  auto& perturb = perturb_[h & 0xff];
+
+  for (int n = 0; n < size(); n++)
+  {
+    const uint16_t port = port_ranges::DYNAMIC_START + (offset + perturb++) % size();
+    if (usable_for(port, remote))
+      return port;
+  }
+  throw Port_error{"All ephemeral ports are taken for " + remote.to_string()};
+}
+
+void Port_util::bind(const uint16_t port, const Socket& remote)
+{
+  Expects((not is_bound(port) or is_shared(port)) && "Port is bound exclusively");
+
+  if (not flows_.emplace(port, remote).second)
+    return;
+
+  if (shared_[port]++ == 0)
+  {
+    ports.reset(port);
+    if(port_ranges::is_dynamic(port)) ++eph_count;
+  }
+}
+
+bool Port_util::unbind(const uint16_t port, const Socket& remote)
+{
+  if (flows_.erase({port, remote}) == 0)
+    return false;
+
+  auto it = shared_.find(port);
+  if (--it->second == 0)
+  {
+    shared_.erase(it);
+    ports.set(port);
+    if(port_ranges::is_dynamic(port)) --eph_count;
+  }
+  return true;
+}
@@ -0,0 +1,174 @@
+
+#include <net/rps.hpp>
+#include <net/rss.hpp>
+#include <net/ethernet/header.hpp>
+#include <net/iana.hpp>
+#include <kernel/events.hpp>
+#include <statman>
+#include <algorithm>
+#include <cstring>
+
+namespace net {
+
+RPS::RPS(const std::string& name, deliver_func deliver, std::vector<int> cpus)
+  : deliver_{deliver},
+    targets_(SMP::early_cpu_total()),
+    steered_{Statman::get().create_percpu(name + ".rps.steered")},
+    dropped_{Statman::get().create(Stat::UINT32, name + ".rps.dropped").get_uint32()}
+{
+  set_cpus(std::move(cpus));
+}
+
+RPS::~RPS()
+{
+  for (auto& target : targets_)
+  {
+    if (target == nullptr) continue;
+    Packet* pkt;
+    while (target->ring.pop(pkt))
+      delete pkt;
+  }
+}
+
+std::vector<int> RPS::default_cpus()
+{
+  std::vector<int> cpus {SMP::cpu_id()};
+  for (const int cpu : SMP::active_cpus())
+    if (cpu != SMP::cpu_id())
+      cpus.push_back(cpu);
+  return cpus;
+}
+
+void RPS::set_cpus(std::vector<int> cpus)
+{
+  for (const int cpu : cpus)
+    Expects(cpu >= 0 and cpu < (int) targets_.size());
+  for (const int cpu : cpus)
+    target(cpu);
+  cpus_ = std::move(cpus);
+}
+
+RPS::Target& RPS::target(const int cpu)
+{
+  auto& target = targets_.at(cpu);
+  if (target == nullptr)
+    target = std::make_unique<Target>();
+  return *target;
+}
+
+std::optional<uint32_t> RPS::flow_hash(const uint8_t* frame, size_t len) noexcept
+{
+  const size_t l3 = sizeof(ethernet::Header);
+  if (len < l3) return {};
+  const auto type = reinterpret_cast<const ethernet::Header*>(frame)->type();
+
+  // source and destination address, then source and destination port
+  uint8_t in[36];
+  size_t  n;
+  size_t  l4;
+  if (type == Ethertype::IP4)
+  {
+    const uint8_t* ip = frame + l3;
+    if (len < l3 + 20 or (ip[0] >> 4) != 4) return {};
+    const size_t ihl = (ip[0] & 0xf) * 4;
+    // only the first fragment has the ports, so none of them are steered
+    const bool fragment = ((ip[6] & 0x3f) | ip[7]) != 0;
+    if (ip[9] != (uint8_t) Protocol::TCP or fragment or ihl < 20) return {};
+    std::memcpy(in, ip + 12, 8);
+    n  = 8;
+    l4 = l3 + ihl;
+  }
+  else if (type == Ethertype::IP6)
+  {
+    const uint8_t* ip = frame + l3;
+    // TCP right after the fixed header, or it's not worth the parsing
+    if (len < l3 + 40 or ip[6] != (uint8_t) Protocol::TCP) return {};
+    std::memcpy(in, ip + 8, 32);
+    n  = 32;
+    l4 = l3 + 40;
+  }
+  else return {};
+
+  if (len < l4 + 4) return {};
+  std::memcpy(&in[n], frame + l4, 4);
+  n += 4;
+  return rss::toeplitz(rss::default_key.data(), rss::default_key.size(), in, n);
+}
+
+void RPS::receive(Packet_ptr chain)
+{
+  const int this_cpu = SMP::cpu_id();
+  Packet_chain local;
+  // CPUs with new packets in their ring, woken once the burst is steered
+  int woken[BURST];
+  int wake_count = 0;
+
+  while (chain != nullptr)
+  {
+    auto pkt = std::move(chain);
+    chain = pkt->detach_tail();
+
+    // VLAN frames belong to the stack of their VLAN, which isn't steered
+    const auto hash = (pkt->vlan_id() == 0)
+      ? flow_hash(pkt->layer_begin(), pkt->size()) : std::nullopt;
+    const int cpu = (hash and not cpus_.empty())
+                  ? cpus_[*hash % cpus_.size()] : this_cpu;
+    if (cpu == this_cpu) {
+      local.push_back(std::move(pkt));
+      continue;
+    }
+
+    auto* raw = pkt.release();
+    if (UNLIKELY(not targets_[cpu]->ring.push(std::move(raw)))) {
+      dropped_++;
+      delete raw;
+      continue;
+    }
+    steered_++;
+    if (std::find(woken, woken + wake_count, cpu) == woken + wake_count) {
+      if (wake_count < BURST) woken[wake_count++] = cpu;
+      else wake(cpu);
+    }
+  }
+
+  // the others get going before the local packets are handled
+  for (int i = 0; i < wake_count; i++)
+    wake(woken[i]);
+  if (not local.empty())
+    deliver_(local.release());
+}
+
+void RPS::wake(const int cpu)
+{
+  auto& target = *targets_[cpu];
+  if (target.scheduled.exchange(true))
+    return;
+  if (UNLIKELY(not Events::get(cpu).post([this, cpu] { drain(cpu); })))
+    // its queue is full, so it's awake, and the next burst tries again
+    target.scheduled = false;
+}
+
+void RPS::drain(const int cpu)
+{
+  auto& target = *targets_[cpu];
+  // anything pushed from here on posts another drain
+  target.scheduled = false;
+
+  Packet* pkts[BURST];
+  size_t left = RING_SIZE;
+  while (left > 0)
+  {
+    const size_t count = target.ring.pop_bulk(pkts, std::min<size_t>(BURST, left));
+    if (count == 0) return;
+    left -= count;
+    Packet_chain burst;
+    for (size_t i = 0; i < count; i++)
+      burst.push_back(Packet_ptr{pkts[i]});
+    deliver_(burst.release());
+  }
+  // a full ring's worth, and there's more: let the others have a go
+  if (not target.ring.empty())
+    wake(cpu);
+}
+
+} // < namespace net
@@ -0,0 +1,328 @@
+#include <net/tcp/congestion.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace net::tcp;
+
+std::unique_ptr<Congestion_control> Congestion_control::create(Algorithm algo)
+{
+  switch (algo)
+  {
+  case Algorithm::CUBIC:
+    return std::make_unique<Cubic>();
+  case Algorithm::BBR:
+    return std::make_unique<Bbr>();
+  case Algorithm::NEW_RENO:
+  default:
+    return std::make_unique<New_reno>();
+  }
+}
+
+const char* net::tcp::to_string(Congestion_control::Algorithm algo)
+{
+  switch (algo)
+  {
+  case Congestion_control::Algorithm::NEW_RENO: return "newreno";
+  case Congestion_control::Algorithm::CUBIC:    return "cubic";
+  case Congestion_control::Algorithm::BBR:      return "bbr";
+  }
+  return "unknown";
+}
+
+/// NewReno ///
+
+void New_reno::init(Congestion_window& w)
+{
+  w.cwnd     = 3 * w.smss;
+  w.ssthresh = w.snd_wnd;
+}
+
+void New_reno::on_ack(Congestion_window& w, seq_t, uint32_t bytes_acked)
+{
+  // slow start
+  if (w.slow_start())
+    w.cwnd += std::min(bytes_acked, (uint32_t) w.smss);
+  // congestion avoidance, increase cwnd once per RTT
+  else
+    w.cwnd += std::max((uint32_t) w.smss * w.smss / w.cwnd, (uint32_t) 1);
+}
+
+void New_reno::on_enter_recovery(Congestion_window& w)
+{
+  w.ssthresh = loss_ssthresh(w);
+  // inflate congestion window with the 3 packets we got dup ack on.
+  w.cwnd = w.ssthresh + 3 * w.smss;
+}
+
+void New_reno::on_recovery_dup_ack(Congestion_window& w)
+{
+  w.cwnd += w.smss;
+}
+
+void New_reno::on_partial_ack(Congestion_window& w, seq_t, uint32_t bytes_acked)
+{
+  // deflate by the amount acked, then add back one SMSS [RFC 6582]
+  const uint32_t n = (bytes_acked >= w.smss) ? bytes_acked - w.smss : bytes_acked;
+  w.cwnd -= std::min(n, w.cwnd);
+}
+
+void New_reno::on_exit_recovery(Congestion_window& w)
+{
+  w.cwnd = w.ssthresh;
+}
+
+void New_reno::on_timeout(Congestion_window& w, bool first)
+{
+  if (first)
+    w.ssthresh = loss_ssthresh(w);
+  w.cwnd = loss_window * w.smss;
+}
+
+/// CUBIC ///
+
+void Cubic::on_ack(Congestion_window& w, seq_t ack, uint32_t bytes_acked)
+{
+  if (w.slow_start()) {
+    New_reno::on_ack(w, ack, bytes_acked);
+    return;
+  }
+
+  const double cwnd = (double) w.cwnd / w.smss;
+  if (epoch_us_ == 0)
+  {
+    epoch_us_ = w.now_us;
+    if (cwnd < w_max_) {
+      k_      = std::cbrt((w_max_ - cwnd) / C);
+      origin_ = w_max_;
+    }
+    else {
+      k_      = 0;
+      origin_ = cwnd;
+    }
+    w_est_ = cwnd;
+  }
+
+  const double t = (w.now_us - epoch_us_) / 1e6;
+  const double rtt = w.srtt_us / 1e6;
+  const double acked = (double) bytes_acked / w.smss;
+  // the Reno friendly region grows like Reno with beta [RFC 9438 4.3]
+  w_est_ += 3.0 * (1 - beta) / (1 + beta) * acked / cwnd;
+
+  double growth; // in segments
+  const double w_cubic = origin_ + C * std::pow(t - k_, 3);
+  if (w_cubic < w_est_) {
+    growth = w_est_ - cwnd;
+  }
+  else {
+    // aim for where the curve is one RTT from now
+    const double target = std::clamp(origin_ + C * std::pow(t + rtt - k_, 3),
+                                     cwnd, 1.5 * cwnd);
+    growth = (target - cwnd) * acked / cwnd;
+  }
+  bytes_ += std::max(growth, 0.0) * w.smss;
+  if (bytes_ >= 1.0) {
+    const auto inc = (uint32_t) std::min(bytes_, (double) UINT32_MAX - w.cwnd);
+    w.cwnd += inc;
+    bytes_ -= inc;
+  }
+}
+
+void Cubic::reduce(Congestion_window& w)
+{
+  const double cwnd = (double) w.cwnd / w.smss;
+  // fast convergence: leave room for new flows when losing before w_max
+  w_max_    = (cwnd < w_max_) ? cwnd * (1 + beta) / 2 : cwnd;
+  epoch_us_ = 0;
+  bytes_    = 0;
+  w.ssthresh = std::max((uint32_t) (w.flight_size * beta), 2u * w.smss);
+}
+
+void Cubic::on_enter_recovery(Congestion_window& w)
+{
+  reduce(w);
+  w.cwnd = w.ssthresh + 3 * w.smss;
+}
+
+void Cubic::on_timeout(Congestion_window& w, bool first)
+{
+  if (first)
+    reduce(w);
+  epoch_us_ = 0;
+  w.cwnd = loss_window * w.smss;
+}
+
+/// BBR ///
+
+void Bbr::init(Congestion_window& w)
+{
+  w.cwnd     = min_segments * w.smss;
+  w.ssthresh = w.snd_wnd;
+  min_rtt_stamp_ = w.now_us;
+}
+
+void Bbr::on_send(Congestion_window& w, seq_t end)
+{
+  if (probing_) return;
+  probing_         = true;
+  probe_end_       = end;
+  probe_sent_us_   = w.now_us;
+  probe_delivered_ = delivered_;
+}
+
+uint64_t Bbr::bottleneck_bw() const noexcept
+{
+  return *std::max_element(bw_.begin(), bw_.end());
+}
+
+uint64_t Bbr::bdp() const noexcept
+{
+  return bottleneck_bw() * min_rtt_us_ / 1'000'000;
+}
+
+double Bbr::pacing_gain() const noexcept
+{
+  static constexpr double cycle[8] {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+  switch (mode_)
+  {
+  case Mode::STARTUP:  return high_gain;
+  case Mode::DRAIN:    return 1 / high_gain;
+  case Mode::PROBE_BW: return cycle[cycle_];
+  default:             return 1;
+  }
+}
+
+uint64_t Bbr::pacing_rate(const Congestion_window& w) const noexcept
+{
+  if (const auto bw = bottleneck_bw(); bw != 0)
+    return pacing_gain() * bw;
+  // no model yet, spread the window over the RTT
+  if (w.srtt_us != 0)
+    return high_gain * w.cwnd * 1'000'000 / w.srtt_us;
+  return 0;
+}
+
+bool Bbr::sample(Congestion_window& w, seq_t ack)
+{
+  if (not probing_ or static_cast<int32_t>(ack - probe_end_) < 0)
+    return false;
+  probing_ = false;
+  const uint64_t rtt = w.now_us - probe_sent_us_;
+  if (rtt == 0) return false;
+
+  // one sample per round trip, so the per round max is the sample
+  bw_[round_++ % bw_rounds] = (delivered_ - probe_delivered_) * 1'000'000 / rtt;
+  if (min_rtt_us_ == 0 or rtt <= min_rtt_us_
+      or w.now_us - min_rtt_stamp_ > min_rtt_window)
+  {
+    min_rtt_us_    = rtt;
+    min_rtt_stamp_ = w.now_us;
+  }
+  return true;
+}
+
+void Bbr::update_mode(Congestion_window& w, bool new_round)
+{
+  const uint64_t bw = bottleneck_bw();
+  // the pipe is full once the bandwidth stops growing by 25% for 3 rounds
+  if (new_round and not filled_pipe_)
+  {
+    if (bw >= full_bw_ * 5 / 4) {
+      full_bw_ = bw;
+      full_bw_rounds_ = 0;
+    }
+    else if (++full_bw_rounds_ >= 3) {
+      filled_pipe_ = true;
+    }
+  }
+
+  switch (mode_)
+  {
+  case Mode::STARTUP:
+    if (filled_pipe_) mode_ = Mode::DRAIN;
+    [[fallthrough]];
+  case Mode::DRAIN:
+    if (mode_ == Mode::DRAIN and w.flight_size <= bdp()) {
+      mode_ = Mode::PROBE_BW;
+      // start anywhere in the cycle but the draining phase
+      cycle_ = 2 + round_ % 6;
+      cycle_stamp_ = w.now_us;
+    }
+    break;
+  case Mode::PROBE_BW:
+    if (w.now_us - cycle_stamp_ > min_rtt_us_) {
+      cycle_ = (cycle_ + 1) % 8;
+      cycle_stamp_ = w.now_us;
+    }
+    break;
+  case Mode::PROBE_RTT:
+    if (w.now_us >= probe_rtt_done_) {
+      min_rtt_stamp_ = w.now_us;
+      mode_ = filled_pipe_ ? Mode::PROBE_BW : Mode::STARTUP;
+      cycle_stamp_ = w.now_us;
+      w.cwnd = std::max(w.cwnd, prior_cwnd_);
+    }
+    break;
+  }
+
+  // drain the queue now and then to see the real propagation delay
+  if (mode_ != Mode::PROBE_RTT and w.now_us - min_rtt_stamp_ > min_rtt_window)
+  {
+    mode_ = Mode::PROBE_RTT;
+    prior_cwnd_ = w.cwnd;
+    probe_rtt_done_ = w.now_us + probe_rtt_time;
+  }
+}
+
+void Bbr::set_cwnd(Congestion_window& w, uint32_t bytes_acked)
+{
+  const uint32_t min_cwnd = min_segments * w.smss;
+  if (mode_ == Mode::PROBE_RTT) {
+    w.cwnd = min_cwnd;
+    return;
+  }
+  const double gain = (mode_ == Mode::STARTUP) ? high_gain : cwnd_gain;
+  const uint64_t target = std::max<uint64_t>(gain * bdp(), min_cwnd);
+  if (filled_pipe_)
+    w.cwnd = std::min<uint64_t>(w.cwnd + bytes_acked, target);
+  else if (w.cwnd < target or bottleneck_bw() == 0)
+    w.cwnd = std::min<uint64_t>((uint64_t) w.cwnd + bytes_acked, UINT32_MAX);
+  w.cwnd = std::max(w.cwnd, min_cwnd);
+}
+
+void Bbr::on_ack(Congestion_window& w, seq_t ack, uint32_t bytes_acked)
+{
+  delivered_ += bytes_acked;
+  const bool new_round = sample(w, ack);
+  update_mode(w, new_round);
+  if (not in_recovery_)
+    set_cwnd(w, bytes_acked);
+}
+
+void Bbr::on_enter_recovery(Congestion_window& w)
+{
+  // packet conservation: send one for each that leaves the network
+  in_recovery_ = true;
+  prior_cwnd_  = w.cwnd;
+  w.cwnd = std::max(w.flight_size + w.smss, min_segments * w.smss);
+}
+
+void Bbr::on_partial_ack(Congestion_window& w, seq_t ack, uint32_t bytes_acked)
+{
+  delivered_ += bytes_acked;
+  update_mode(w, sample(w, ack));
+}
+
+void Bbr::on_exit_recovery(Congestion_window& w)
+{
+  in_recovery_ = false;
+  w.cwnd = std::max(w.cwnd, prior_cwnd_);
+}
+
+void Bbr::on_timeout(Congestion_window& w, bool first)
+{
+  if (first)
+    prior_cwnd_ = w.cwnd;
+  // the timed segment is being resent, its RTT would be ambiguous
+  probing_ = false;
+  w.cwnd = min_segments * w.smss;
+}
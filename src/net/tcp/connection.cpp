@@ -7,10 +7,21 @@
 #include <net/tcp/connection_states.hpp>
 #include <net/tcp/tcp.hpp>
 #include <net/tcp/tcp_errors.hpp>
+#include <kernel/trace.hpp>
+#include <profile>
+#include <rtc>
+#include <cstring>
 
 using namespace net::tcp;
 using namespace std;
 
+static inline uint64_t now_us() noexcept
+{ return RTC::nanos_now() / 1000; }
+
+template <typename Duration>
+static inline uint64_t to_us(Duration d) noexcept
+{ return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); }
+
 Connection::Connection(TCP& host, Socket local, Socket remote, ConnectCallback callback)
   : host_(host),
     local_{std::move(local)}, remote_{std::move(remote)},
@@ -22,14 +33,21 @@ Connection::Connection(TCP& host, Socket local, Socket remote, ConnectCallback c
     writeq(),
     on_connect_{std::move(callback)},
     on_disconnect_({this, &Connection::default_on_disconnect}),
-    rtx_timer({this, &Connection::rtx_timeout}),
-    timewait_dack_timer({this, &Connection::dack_timeout}),
+    rtx_timer(host.timer_wheel(), {this, &Connection::rtx_timeout}),
+    timewait_dack_timer(host.timer_wheel(), {this, &Connection::dack_timeout}),
+    rack_timer(host.timer_wheel(), {this, &Connection::rack_timeout}),
+    tlp_timer(host.timer_wheel(), {this, &Connection::tlp_timeout}),
+    pacing_timer(host.timer_wheel(), {this, &Connection::pacing_timeout}),
+    cork_timer(host.timer_wheel(), {this, &Connection::push}),
+    idle_timer(host.timer_wheel(), {this, &Connection::idle_timeout}),
     recv_wnd_getter{nullptr},
     queued_(false),
     dack_{0},
     last_ack_sent_{cb.RCV.NXT},
     smss_{MSS()}
 {
+  cc_ = Congestion_control::create(host_.congestion_control());
+  pacing_ = cc_->algorithm() != Congestion_control::Algorithm::NEW_RENO or host_.uses_pacing();
   setup_congestion_control();
   //printf("<Connection> Created %p %s  ACTIVE: %u\n", this,
   //        to_string().c_str(), host_.active_connections());
@@ -49,11 +67,12 @@ void Connection::_on_read(size_t recv_bufsz, ReadCallback cb)
   if(read_request == nullptr)
   {
     Expects(bufalloc != nullptr);
-    read_request.reset(
-      new Read_request(this->cb.RCV.NXT, host_.min_bufsize(), host_.max_bufsize(), bufalloc.get()));
+    read_request = host_.make_pooled<Read_request>(host_.pools_.read_requests,
+      seq_t{this->cb.RCV.NXT}, host_.min_bufsize(), host_.max_bufsize(), bufalloc.get());
     read_request->on_read_callback = cb;
     const size_t avail_thres = host_.max_bufsize() * Read_request::buffer_limit;
     bufalloc->on_avail(avail_thres, {this, &Connection::trigger_window_update});
+    idle_watch();
   }
   // read request is already set, only reset if new size.
   else
@@ -70,15 +89,25 @@ void Connection::_on_read(size_t recv_bufsz, ReadCallback cb)
   }
 }
 
-void Connection::_on_data(DataCallback cb) {
+void Connection::_on_data(DataCallback cb, bool zero_copy) {
+  // switching between zero-copy and buffered reads starts over
+  if(read_request != nullptr and read_request->zero_copy() != zero_copy)
+  {
+    read_request->reset(this->cb.RCV.NXT);
+    read_request = nullptr;
+    if(sack_list)
+      sack_list->clear();
+  }
+
   if(read_request == nullptr)
   {
     Expects(bufalloc != nullptr);
-    read_request.reset(
-      new Read_request(this->cb.RCV.NXT, host_.min_bufsize(), host_.max_bufsize(), bufalloc.get()));
+    read_request = host_.make_pooled<Read_request>(host_.pools_.read_requests,
+      seq_t{this->cb.RCV.NXT}, host_.min_bufsize(), host_.max_bufsize(), bufalloc.get(), zero_copy);
     read_request->on_data_callback = cb;
     const size_t avail_thres = host_.max_bufsize() * Read_request::buffer_limit;
     bufalloc->on_avail(avail_thres, {this, &Connection::trigger_window_update});
+    idle_watch();
   }
   // read request is already set, only reset if new size.
   else
@@ -130,6 +159,8 @@ void Connection::reset_callbacks()
   on_disconnect_ = {this, &Connection::default_on_disconnect};
   on_connect_.reset();
   writeq.on_write(nullptr);
+  writeq.on_drain(nullptr);
+  writeq.set_watermarks(0, 0);
   on_close_.reset();
   recv_wnd_getter.reset();
   if(read_request) {
@@ -165,20 +196,60 @@ size_t Connection::receive(seq_t seq, const uint8_t* data, size_t n, bool PUSH)
 }
 
 
-void Connection::write(buffer_t buffer)
+Slice_chain Connection::read_slices()
+{
+  if(UNLIKELY(read_request == nullptr))
+    return {};
+
+  auto slices = read_request->read_slices();
+  // the data held may have closed the window
+  if(cb.RCV.WND == 0 and not slices.empty())
+    send_window_update();
+  return slices;
+}
+
+void Connection::write(buffer_t buffer, bool more)
+{
+  queue_write(std::move(buffer), more);
+}
+
+void Connection::write(const void* buf, size_t n, std::shared_ptr<const void> owner,
+                       bool more)
+{
+  queue_write({(const uint8_t*) buf, (uint32_t) n, std::move(owner)}, more);
+}
+
+void Connection::queue_write(WriteBuffer buffer, bool more)
 {
-  if (UNLIKELY(buffer->size() == 0)) {
+  if (UNLIKELY(buffer.size() == 0)) {
     throw TCP_error("Can't write zero bytes to TCP stream");
   }
 
-  // Only write if allowed
-  if(state_->is_writable())
+  // Only write if allowed, a Fast Open server may before the handshake is done
+  const bool fast_open = UNLIKELY(tfo_accepted_) and is_state(SynReceived::instance());
+  if(state_->is_writable() or fast_open)
   {
     // add to queue
     writeq.push_back(std::move(buffer));
+    idle_watch();
+
+    // hold back a partial segment for what comes next, but not for long
+    if(corked_ or more)
+    {
+      if(not cork_hold_)
+      {
+        cork_hold_ = true;
+        cork_timer.restart(CORK_TIMEOUT);
+      }
+    }
+    else if(cork_hold_)
+    {
+      cork_hold_ = false;
+      cork_timer.stop();
+    }
 
     // request packets if connected, else let ACK clock do the writing
-    if(state_->is_connected())
+    if(state_->is_connected() or fast_open)
       host_.request_offer(*this);
   }
 }
@@ -193,26 +264,26 @@ void Connection::offer(size_t& packets)
 
   while(can_send() and packets)
   {
-    auto packet = create_outgoing_packet();
+    auto packet = create_outgoing_packet(should_use_tso());
     packets--;
 
     size_t written{0};
     size_t x{0};
-    // fill the packet with data
-    while(can_send() and
-      (x = fill_packet(*packet, writeq.nxt_data(), writeq.nxt_rem()) ))
-    {
+    // fill the packet with data, a segment at a time across write buffers
+    while(can_send() and (x = fill_packet_nxt(*packet)))
       written += x;
-      cb.SND.NXT += x;
-      writeq.advance(x);
-    }
 
     packet->set_flag(ACK);
 
+    // let the NIC cut super-segments, options are repeated in each segment
+    const size_t seg_size = SMSS() - packet->tcp_options_length();
+    if (written > seg_size)
+      packet->set_segment_size(seg_size);
+
     debug2("<Connection::offer> Wrote %u bytes (%u remaining) with [%u] packets left and a usable window of %u.\n",
            written, buf.remaining, packets, usable_window());
 
-    if(!can_send() or !packets or !writeq.nxt_rem())
+    if(!can_send() or !packets or !writeq.bytes_remaining())
       packet->set_flag(PSH);
 
     if(UNLIKELY(not writeq.has_remaining_requests() and is_closing()))
@@ -223,6 +294,9 @@ void Connection::offer(size_t& packets)
     }
 
     transmit(std::move(packet));
+
+    if(pacing_)
+      pace(written);
   }
 
   debug2("<Connection::offer> Finished working offer with [%u] packets left and a queue of (%u) with a usable window of %i\n",
@@ -247,12 +321,9 @@ void Connection::limited_tx() {
 
   debug2("<Connection::limited_tx> UW: %u CW: %u, FS: %u\n", usable_window(), cb.cwnd, flight_size());
 
-  const auto written = fill_packet(*packet, writeq.nxt_data(), writeq.nxt_rem());
-  cb.SND.NXT += written;
+  fill_packet_nxt(*packet);
   packet->set_flag(ACK);
 
-  writeq.advance(written);
-
   if(UNLIKELY(not writeq.has_remaining_requests() and is_closing()))
   {
     debug("<Connection::limited_tx> Setting FIN\n");
@@ -267,6 +338,14 @@ void Connection::writeq_reset() {
   debug2("<Connection::writeq_reset> Reseting.\n");
   writeq.reset();
   rtx_timer.stop();
+  rack_timer.stop();
+  tlp_timer.stop();
+  pacing_timer.stop();
+  pace_hold_ = false;
+  cork_timer.stop();
+  cork_hold_ = false;
+  if(rack_)
+    rack_->clear();
 }
 
 void Connection::open(bool active)
@@ -281,6 +360,11 @@ void Connection::close() {
   if(is_closing())
     return;
 
+  // the FIN goes after everything written
+  corked_ = false;
+  if(cork_hold_)
+    push();
+
   try {
     state_->close(*this);
     if(is_state(Closed::instance()))
@@ -346,7 +430,19 @@ void Connection::segment_arrived(Packet_view& incoming)
   //  printf("predicted\n");
 
   // Let state handle what to do when incoming packet arrives, and modify the outgoing packet.
-  switch(state_->handle(*this, incoming))
+  const auto result = state_->handle(*this, incoming);
+
+  release_rx_packet(incoming);
+
+  // TIME-WAIT was handed over to a tombstone, nothing more to do here
+  if(UNLIKELY(tombstoned_ and result == State::OK))
+  {
+    writeq_reset();
+    signal_close();
+    return;
+  }
+
+  switch(result)
   {
     case State::OK:
       return; // // Do nothing.
@@ -360,6 +456,89 @@ void Connection::segment_arrived(Packet_view& incoming)
   }
 }
 
+void Connection::release_rx_packet(Packet_view& in)
+{
+  // Zero-copy data is sliced from the packet while it's being handled.
+  // Hand the packet over to the slices still around, if any.
+  if(rx_packet_ != nullptr and rx_packet_.use_count() > 1)
+  {
+    *rx_packet_ = in.release();
+    rx_packet_ = nullptr;
+  }
+}
+
+bool Connection::gro_eligible(const Packet_view& in) const noexcept
+{
+  // plain data segment, ACK (+PSH) only, no options other than timestamps
+  static constexpr int TS_LEN = 12;
+  return in.has_tcp_data() and in.isset(ACK)
+    and not (in.isset(SYN) or in.isset(FIN) or in.isset(RST) or in.isset(URG))
+    and in.tcp_options_length() == (cb.SND.TS_OK ? TS_LEN : 0)
+    and (sack_list == nullptr or sack_list->size() == 0)
+    and read_request != nullptr
+    and is_state(Established::instance());
+}
+
+bool Connection::gro_begin(const Packet_view& in)
+{
+  gro_active_ = gro_eligible(in);
+  gro_ack_ = false;
+  gro_segments_ = 0;
+  return gro_active_;
+}
+
+bool Connection::gro_merge(Packet_view& in)
+{
+  if(not gro_active_ or not gro_eligible(in))
+    return false;
+
+  // exactly what the state machine would accept without further ado:
+  // the next data in sequence, fitting the window,
+  // and an ACK neither new, nor duplicate nor changing the window
+  const uint32_t length = in.tcp_data_length();
+  if(in.seq() != cb.RCV.NXT or length > cb.RCV.WND
+    or in.ack() != cb.SND.UNA or cb.SND.UNA != cb.SND.NXT
+    or (uint32_t(in.win()) << cb.SND.wind_shift) != cb.SND.WND)
+    return false;
+
+  if(cb.SND.TS_OK)
+  {
+    const auto* ts = in.parse_ts_option();
+    // leave PAWS to the state machine
+    if(ts == nullptr or ts->get_val() < cb.TS_recent)
+      return false;
+    if(in.seq() <= last_ack_sent_)
+      cb.TS_recent = ts->get_val();
+  }
+  cb.SND.WL1 = in.seq();
+
+  recv_data(in);
+  release_rx_packet(in);
+  return true;
+}
+
+void Connection::gro_end()
+{
+  gro_active_ = false;
+  if(not gro_ack_ or is_closed() or tombstoned_)
+    return;
+  gro_ack_ = false;
+
+  // already ACKed by data sent meanwhile
+  if(last_ack_sent_ == cb.RCV.NXT)
+    return;
+
+  // at least every second full-sized segment is ACKed [RFC 5681],
+  // so a coalesced burst gets its ACK right away
+  if(gro_segments_ > 1 and not can_send())
+  {
+    stop_dack();
+    send_ack();
+    return;
+  }
+  ack_data();
+}
+
 bool Connection::is_listening() const noexcept {
   return is_state(Listen::instance());
 }
@@ -369,11 +548,19 @@ void Connection::deserialize_from(void*) {}
 __attribute__((weak))
 int  Connection::serialize_to(void*) const {  return 0;  }
 
-Packet_view_ptr Connection::create_outgoing_packet()
+bool Connection::should_use_tso() const noexcept
+{
+  // only worth it when more than one segment can go out at once
+  return not is_ipv6_ and host_.tso_available()
+    and usable_window() >= 2u * SMSS()
+    and writeq.bytes_remaining() > SMSS();
+}
+
+Packet_view_ptr Connection::create_outgoing_packet(const bool tso)
 {
   update_rcv_wnd();
-  auto packet = (is_ipv6_) ?
-    host_.create_outgoing_packet6() : host_.create_outgoing_packet();
+  auto packet = (is_ipv6_) ? host_.create_outgoing_packet6()
+    : (tso) ? host_.create_outgoing_tso_packet() : host_.create_outgoing_packet();
   // Set Source (local == the current connection)
   packet->set_source(local_);
   // Set Destination (remote)
@@ -417,6 +604,15 @@ void Connection::transmit(Packet_view_ptr packet) {
   }
   if(packet->isset(ACK))
     last_ack_sent_ = cb.RCV.NXT;
+  if(packet->has_tcp_data()) {
+    cc_->on_send(cc_window(), packet->end());
+    if(rack_)
+    {
+      rack_->on_transmit(packet->seq(), packet->end(), now_us());
+      if(not tlp_timer.is_running())
+        tlp_arm();
+    }
+  }
 
   //printf("<Connection::transmit> TX %s\n%s\n", packet->to_string().c_str(), to_string().c_str());
 
@@ -429,6 +625,10 @@ bool Connection::handle_ack(const Packet_view& in)
 
   // Calculate true window due to WS option
   const uint32_t true_win = in.win() << cb.SND.wind_shift;
+
+  // RACK needs the SACK blocks of every ACK, duplicate or not
+  if(rack_)
+    rack_ack(in);
   /*
     (a) the receiver of the ACK has outstanding data
     (b) the incoming acknowledgment carries no data
@@ -444,6 +644,8 @@ bool Connection::handle_ack(const Packet_view& in)
   {
     dup_acks_++;
     on_dup_ack(in);
+    if(rack_)
+      rack_detect_loss();
     return false;
   } // < dup ack
 
@@ -483,9 +685,16 @@ bool Connection::handle_ack(const Packet_view& in)
 
   take_rtt_measure(in);
 
-  // do either congctrl or fastrecov according to New Reno
-  (not fast_recovery_)
-    ? congestion_control(in) : fast_recovery(in);
+  // RACK may enter recovery on this ACK, which then is no partial ACK
+  if(not (rack_ and rack_detect_loss()))
+  {
+    // do either congctrl or fastrecov according to New Reno
+    (not fast_recovery_)
+      ? congestion_control(in) : fast_recovery(in);
+  }
+
+  if(rack_)
+    tlp_arm();
 
   dup_acks_ = 0;
 
@@ -504,21 +713,9 @@ void Connection::congestion_control(const Packet_view& in)
   // update recover
   cb.recover = cb.SND.NXT;
 
-  // slow start
-  if(cb.slow_start())
-  {
-    reno_increase_cwnd(bytes_acked);
-    debug2("<Connection::handle_ack> Slow start. cwnd=%u uw=%u\n",
-      cb.cwnd, usable_window());
-  }
-  // congestion avoidance
-  else
-  {
-    // increase cwnd once per RTT
-    cb.cwnd += std::max(SMSS()*SMSS()/cb.cwnd, (uint32_t)1);
-    debug2("<Connection::handle_ack> Congestion avoidance. cwnd=%u uw=%u\n",
-      cb.cwnd, usable_window());
-  } // < congestion avoidance
+  cc_->on_ack(cc_window(), in.ack(), bytes_acked);
+  debug2("<Connection::handle_ack> %s cwnd=%u uw=%u\n",
+    cc_->name(), cb.cwnd, usable_window());
 
   // try to write
   if(can_send() and (!in.has_tcp_data() or cb.RCV.WND < in.tcp_data_length()))
@@ -540,7 +737,7 @@ void Connection::fast_recovery(const Packet_view& in)
   {
     const size_t bytes_acked = highest_ack_ - prev_highest_ack_;
     debug2("<Connection::handle_ack> Partial ACK - recover: %u NXT: %u ACK: %u\n", cb.recover, cb.SND.NXT, in.ack());
-    reno_deflate_cwnd(bytes_acked);
+    cc_->on_partial_ack(cc_window(), in.ack(), bytes_acked);
     // RFC 4015
     /*
     If the value of the Timestamp Echo Reply field of the
@@ -581,7 +778,9 @@ void Connection::fast_recovery(const Packet_view& in)
       reno_fpack_seen = true;
     }
 
-    retransmit();
+    // with RACK, what is deemed lost has already been retransmitted
+    if(not rack_)
+      retransmit();
 
     // send one segment if possible
     if(can_send())
@@ -632,6 +831,10 @@ void Connection::on_dup_ack(const Packet_view& in)
   // 3 dup acks
   else if(dup_acks_ == 3)
   {
+    // RACK decides what is lost from the SACK blocks instead
+    if(rack_)
+      return;
+
     //printf("<TCP::Connection::on_dup_ack> Dup ACK == 3 - UNA=%u recover=%u\n", cb.SND.UNA, cb.recover);
 
     if(cb.SND.UNA - 1 > cb.recover)
@@ -667,9 +870,9 @@ void Connection::on_dup_ack(const Packet_view& in)
     }
   }
 
-  // > 3 dup acks
-  else {
-    cb.cwnd += SMSS();
+  // > 3 dup acks, RACK leaves SACKed data out of the pipe instead
+  else if(not rack_) {
+    cc_->on_recovery_dup_ack(cc_window());
     // send one segment if possible
     //if(can_send())
     //  limited_tx();
@@ -727,6 +930,13 @@ uint32_t Connection::calculate_rcv_wnd() const
   if(UNLIKELY(read_request == nullptr))
     return 0xffff;
 
+  // zero-copy data sits in packet buffers, not the read buffer allocator
+  if(read_request->zero_copy())
+  {
+    const auto win = read_request->fits(cb.RCV.NXT);
+    return (win < SMSS()) ? 0 : win;
+  }
+
   const auto& rbuf = read_request->front();
   auto remaining = rbuf.capacity() - rbuf.size();
 
@@ -734,6 +944,10 @@ uint32_t Connection::calculate_rcv_wnd() const
   auto reserve   = (host_.max_bufsize() * Read_request::buffer_limit);
   auto win = buf_avail > reserve ? buf_avail - reserve : 0;
 
+  // autotuned, no more than the read buffers are sized to hold
+  if(host_.uses_rcv_autotune())
+    win = std::min(win, read_request->room(cb.RCV.NXT));
+
   return (win < SMSS()) ? 0 : win; // Avoid small silly windows
 
   // REPORT CHUNKWISE
@@ -801,6 +1015,7 @@ void Connection::recv_data(const Packet_view& in)
   }*/
 
   size_t length = in.tcp_data_length();
+  idle_watch();
 
   if(UNLIKELY(cb.RCV.WND < length))
   {
@@ -842,9 +1057,14 @@ void Connection::recv_data(const Packet_view& in)
     // only actually recv the data if there is a read request (created with on_read)
     if(read_request != nullptr)
     {
-      const auto recv = read_request->insert(in.seq(), in.tcp_data(), length, in.isset(PSH));
+      const auto recv = (read_request->zero_copy())
+        ? read_request->insert(in.seq(), rx_packet(), in.tcp_data(), length, in.isset(PSH))
+        : read_request->insert(in.seq(), in.tcp_data(), length, in.isset(PSH));
       // this ensures that the data we ACK is actually put in our buffer.
       Ensures(recv == length);
+
+      if(host_.uses_rcv_autotune())
+        rcv_space_adjust();
     }
   }
   // Packet out of order
@@ -863,6 +1083,54 @@ void Connection::recv_data(const Packet_view& in)
   // [RFC 5681] ???
 }
 
+void Connection::rcv_space_adjust()
+{
+  const auto now = now_us();
+
+  // a receiver only sending ACKs has no RTT samples of its own. Data a window
+  // ahead takes at least a round trip to arrive, which gives an upper bound.
+  auto& rs = rcv_space_;
+  if(rs.rtt_time_us == 0)
+  {
+    rs.rtt_seq     = cb.RCV.NXT + cb.RCV.WND;
+    rs.rtt_time_us = now;
+  }
+  else if(static_cast<int32_t>(cb.RCV.NXT - rs.rtt_seq) >= 0)
+  {
+    const auto sample = static_cast<uint32_t>(now - rs.rtt_time_us);
+    rs.rtt_us = (rs.rtt_us == 0 or sample < rs.rtt_us)
+      ? sample : rs.rtt_us - rs.rtt_us / 8 + sample / 8;
+    rs.rtt_seq     = cb.RCV.NXT + cb.RCV.WND;
+    rs.rtt_time_us = now;
+  }
+
+  const uint64_t rtt = (rttm.samples > 0) ? to_us(rttm.SRTT) : rs.rtt_us;
+  if(rtt == 0)
+    return;
+
+  if(rs.time_us != 0 and now - rs.time_us < rtt)
+    return;
+
+  if(host_.memory_pressure())
+  {
+    // back to the start, growing again when there's room
+    rs.space = 0;
+    read_request->set_buffer_size(host_.max_bufsize());
+  }
+  else if(rs.time_us != 0)
+  {
+    const uint32_t received = cb.RCV.NXT - rs.seq;
+    if(received > rs.space)
+    {
+      rs.space = received;
+      read_request->set_buffer_size(host_.rcv_buffer_size(2 * (size_t) received));
+    }
+  }
+
+  rs.seq     = cb.RCV.NXT;
+  rs.time_us = now;
+}
+
 // This function need to sync both SACK and the read buffer, meaning:
 // * Data cannot be old segments (already acked)
 // * Data cannot be duplicate (already S-acked)
@@ -881,7 +1149,7 @@ void Connection::recv_out_of_order(const Packet_view& in)
 
   // The SACK list is initated on the first out of order packet
   if(UNLIKELY(not sack_list))
-    sack_list = std::make_unique<Sack_list>();
+    sack_list = host_.make_pooled<Sack_list>(host_.pools_.sack_lists);
 
   size_t length = in.tcp_data_length();
   auto seq = in.seq();
@@ -908,7 +1176,9 @@ void Connection::recv_out_of_order(const Packet_view& in)
     if(UNLIKELY(length == 0))
       return;
 
-    const auto inserted = read_request->insert(seq, in.tcp_data(), length, in.isset(PSH));
+    const auto inserted = (read_request->zero_copy())
+      ? read_request->insert(seq, rx_packet(), in.tcp_data(), length, in.isset(PSH))
+      : read_request->insert(seq, in.tcp_data(), length, in.isset(PSH));
     Ensures(inserted == length && "No partial insertion support");
     bytes_sacked_ += inserted;
   }
@@ -934,6 +1204,14 @@ void Connection::recv_out_of_order(const Packet_view& in)
 
 void Connection::ack_data()
 {
+  // coalescing, ACK once at the end of the burst
+  if(gro_active_)
+  {
+    gro_ack_ = true;
+    gro_segments_++;
+    return;
+  }
+
   const auto snd_nxt = cb.SND.NXT;
   // ACK by trying to send more
   if (can_send())
@@ -975,14 +1253,18 @@ void Connection::take_rtt_measure(const Packet_view& packet)
       ts = packet.parse_ts_option();
     if(ts)
     {
-      rttm.rtt_measurement(RTTM::milliseconds{host_.get_ts_value() - ntohl(ts->ecr)});
+      const RTTM::milliseconds rtt{host_.get_ts_value() - ntohl(ts->ecr)};
+      rttm.rtt_measurement(rtt);
+      host_.rtt_->record(std::chrono::nanoseconds(rtt).count());
       return;
     }
   }
 
   if(rttm.active())
   {
-    rttm.stop(RTTM::milliseconds{host_.get_ts_value()});
+    const RTTM::milliseconds now{host_.get_ts_value()};
+    host_.rtt_->record(std::chrono::nanoseconds(now - rttm.time).count());
+    rttm.stop(now);
   }
 }
 
@@ -1016,13 +1298,11 @@ void Connection::retransmit() {
   // If not, check if there is data and retransmit
   else if(writeq.size())
   {
-    auto& buf = writeq.una();
-
     // TODO: Finish to send window zero probe, but only on rtx timeout
 
-    //printf("<Connection::retransmit> With data (wq.sz=%zu) buf.size=%zu buf.unacked=%zu SND.WND=%u CWND=%u\n",
-    //       writeq.size(), buf->size(), buf->size() - writeq.acked(), cb.SND.WND, cb.cwnd);
-    fill_packet(*packet, buf->data() + writeq.acked(), buf->size() - writeq.acked());
+    //printf("<Connection::retransmit> With data (wq.sz=%zu) unacked=%u SND.WND=%u CWND=%u\n",
+    //       writeq.size(), writeq.bytes_unacknowledged(), cb.SND.WND, cb.cwnd);
+    fill_packet(*packet, 0, writeq.bytes_unacknowledged());
       packet->set_flag(PSH);
   }
   packet->set_seq(cb.SND.UNA);
@@ -1062,8 +1342,31 @@ void Connection::retransmit() {
   if(packet->should_rtx() and !rtx_timer.is_running()) {
     rtx_start();
   }
+  if(rack_ and packet->has_tcp_data())
+    rack_->on_transmit(packet->seq(), packet->end(), now_us());
+  debug("<Connection::retransmit> RTX: %s\n", packet->to_string().c_str());
+  host_.transmit(std::move(packet));
+}
+
+size_t Connection::retransmit(const seq_t seq, const uint32_t len)
+{
+  const uint32_t offset = seq - cb.SND.UNA;
+  if(UNLIKELY(offset >= writeq.bytes_unacknowledged()))
+    return 0;
+
+  auto packet = create_outgoing_packet();
+  packet->set_flag(ACK);
+  const auto written = fill_packet(*packet, offset, len);
+  packet->set_flag(PSH);
+  packet->set_seq(seq);
+
+  if(!rtx_timer.is_running())
+    rtx_start();
+  if(rack_)
+    rack_->on_transmit(seq, seq + written, now_us());
   debug("<Connection::retransmit> RTX: %s\n", packet->to_string().c_str());
   host_.transmit(std::move(packet));
+  return written;
 }
 
 void Connection::rtx_clear() {
@@ -1105,6 +1408,14 @@ void Connection::rtx_timeout() {
     return;
   }
 
+  // everything not SACKed is presumed lost, and resent as the window opens
+  if(rack_)
+  {
+    rack_->on_timeout();
+    rack_timer.stop();
+    tlp_timer.stop();
+  }
+
   // retransmit SND.UNA
   retransmit();
   rtx_attempt_++;
@@ -1125,21 +1436,17 @@ void Connection::rtx_timeout() {
 
       ssthresh = max (FlightSize / 2, 2*SMSS)
   */
-  if(rtx_attempt_ == 1)
-  {
-    // RFC 4015
-    /*
-      Before the variables cwnd and ssthresh get updated when
-      loss recovery is initiated:
-          pipe_prev <- max (FlightSize, ssthresh)
-          SRTT_prev <- SRTT + (2 * G)
-          RTTVAR_prev <- RTTVAR
-    */
-    //pipe_prev   = std::max(flight_size(), cb.ssthresh);
-    //SRTT_prev   = RTTM::seconds{rttm.SRTT.count() + (2 * RTTM::CLOCK_G)};
-    //RTTVAR_prev = rttm.RTTVAR;
-    reduce_ssthresh();
-  }
+  // RFC 4015
+  /*
+    Before the variables cwnd and ssthresh get updated when
+    loss recovery is initiated:
+        pipe_prev <- max (FlightSize, ssthresh)
+        SRTT_prev <- SRTT + (2 * G)
+        RTTVAR_prev <- RTTVAR
+  */
+  //pipe_prev   = std::max(flight_size(), cb.ssthresh);
+  //SRTT_prev   = RTTM::seconds{rttm.SRTT.count() + (2 * RTTM::CLOCK_G)};
+  //RTTVAR_prev = rttm.RTTVAR;
 
   /*
     [RFC 6582] p. 6
@@ -1154,8 +1461,8 @@ void Connection::rtx_timeout() {
   if(fast_recovery_) // not sure if this is correct
     finish_fast_recovery();
 
-  //cb.cwnd = SMSS();
-  reno_init_cwnd(3); // experimental
+  // ssthresh is reduced on the first timeout of a segment only
+  cc_->on_timeout(cc_window(), rtx_attempt_ == 1);
   /*
     NOTE: It's unclear which one comes first, or if finish_fast_recovery includes changing the cwnd.
   */
@@ -1165,14 +1472,40 @@ seq_t Connection::generate_iss() {
   return TCP::generate_iss();
 }
 
+// the state numbered as in RFC 793, for tracing
+[[maybe_unused]]
+static uint32_t state_number(const Connection::State* state)
+{
+  const Connection::State* states[] = {
+    &Connection::Closed::instance(),      &Connection::Listen::instance(),
+    &Connection::SynSent::instance(),     &Connection::SynReceived::instance(),
+    &Connection::Established::instance(), &Connection::FinWait1::instance(),
+    &Connection::FinWait2::instance(),    &Connection::CloseWait::instance(),
+    &Connection::Closing::instance(),     &Connection::LastAck::instance(),
+    &Connection::TimeWait::instance()
+  };
+  for (uint32_t i = 0; i < sizeof(states) / sizeof(states[0]); i++)
+    if (states[i] == state) return i;
+  return 0xff;
+}
+
 void Connection::set_state(State& state) {
   prev_state_ = state_;
   state_ = &state;
+  TRACEPOINT(tcp_state, state_number(prev_state_) << 8 | state_number(state_),
+             (uintptr_t) this, local_port());
   debug("<TCP::Connection::set_state> %s => %s \n",
         prev_state_->to_string().c_str(), state_->to_string().c_str());
 }
 
 void Connection::timewait_start() {
+  // closed once the segment is handled
+  if(host_.uses_time_wait_compaction())
+  {
+    host_.time_wait(*this);
+    tombstoned_ = true;
+    return;
+  }
   const auto timeout = 2 * host().MSL(); // 60 seconds
   timewait_dack_timer.restart(timeout, {this, &Connection::timewait_timeout});
 }
@@ -1213,8 +1546,8 @@ void Connection::signal_connect(const bool success)
   // If no data event was registered we still want to start buffering here,
   // in case the user is not yet ready to subscribe to data.
   if (read_request == nullptr and success) {
-    read_request.reset(
-      new Read_request(this->cb.RCV.NXT, host_.min_bufsize(), host_.max_bufsize(), bufalloc.get()));
+    read_request = host_.make_pooled<Read_request>(host_.pools_.read_requests,
+      seq_t{this->cb.RCV.NXT}, host_.min_bufsize(), host_.max_bufsize(), bufalloc.get());
   }
 }
 
@@ -1236,6 +1569,9 @@ void Connection::signal_close()
 void Connection::clean_up() {
   // clear timers if active
   rtx_clear();
+  rack_timer.stop();
+  tlp_timer.stop();
+  idle_timer.stop();
   if(timewait_dack_timer.is_running())
     timewait_dack_timer.stop();
 
@@ -1364,6 +1700,39 @@ void Connection::parse_options(const Packet_view& packet) {
       if(host_.uses_SACK())
       {
         sack_perm = true;
+        if(host_.uses_RACK() and not rack_)
+          rack_ = host_.make_pooled<Rack>(host_.pools_.racks);
+      }
+
+      opt += option->length;
+      break;
+    }
+
+    case Option::TFO:
+    {
+      if(UNLIKELY(option->length < 2 or option->length > sizeof(Option::opt_tfo)))
+        throw TCPBadOptionException{Option::TFO, "length out of range"};
+
+      if(packet.isset(SYN))
+      {
+        const uint8_t len = option->length - 2;
+        // the cookie of the server
+        if(packet.isset(ACK))
+        {
+          if(tfo_ and len >= Fast_open::MIN_COOKIE)
+          {
+            std::memcpy(tfo_cookie_.data.data(), option->data, len);
+            tfo_cookie_.len = len;
+          }
+        }
+        // a client asking for a cookie, or with one
+        else if(host_.uses_fast_open())
+        {
+          tfo_accepted_ = len > 0
+            and host_.fast_open_.check(remote_.address(), option->data, len);
+          // a bad cookie gets replaced
+          tfo_cookie_req_ = not tfo_accepted_;
+        }
       }
 
       opt += option->length;
@@ -1431,6 +1800,15 @@ void Connection::add_syn_options(Packet_view& packet)
   {
     add_option(Option::SACK_PERM, packet);
   }
+  // Fast Open, a cookie or a request for one. Not on retransmits,
+  // in case the option is what gets the SYN dropped [RFC 7413] p. 12
+  if(tfo_ and syn_rtx_ == 0)
+  {
+    if(const auto* cached = host_.fast_open_.cached(remote_.address()))
+      packet.add_tcp_option<Option::opt_tfo>(cached->cookie.data.data(), cached->cookie.len);
+    else
+      packet.add_tcp_option<Option::opt_tfo>();
+  }
 }
 
 void Connection::add_synack_options(Packet_view& packet)
@@ -1452,9 +1830,81 @@ void Connection::add_synack_options(Packet_view& packet)
     add_option(Option::SACK_PERM, packet);
   }
 
+  // Fast Open cookie asked for
+  if(tfo_cookie_req_)
+  {
+    const auto cookie = host_.fast_open_.make(remote_.address());
+    packet.add_tcp_option<Option::opt_tfo>(cookie.data.data(), cookie.len);
+  }
+
   // NOTE: Timestamp is already handled by create_outgoing_packet
 }
 
+void Connection::open_fast(buffer_t data)
+{
+  Expects(data != nullptr and data->size() > 0);
+  tfo_ = true;
+  writeq.push_back(std::move(data));
+  open(true);
+}
+
+void Connection::fill_syn_data(Packet_view& syn)
+{
+  const auto* cached = host_.fast_open_.cached(remote_.address());
+  if(not tfo_ or cached == nullptr)
+    return;
+
+  // the MSS of the server is known from before, the options come off it
+  const size_t room = std::min(cached->mss, SMSS()) - syn.tcp_options_length();
+  tfo_syn_data_ = fill_packet(syn, 0, std::min(room, (size_t)writeq.bytes_remaining()));
+  cb.SND.NXT += tfo_syn_data_;
+}
+
+void Connection::fast_open_synack(const Packet_view& in)
+{
+  if(not tfo_)
+    return;
+
+  auto& fo = host_.fast_open_;
+  if(not tfo_cookie_.empty())
+    fo.cache(remote_.address(), tfo_cookie_, cb.SND.MSS);
+  else if(tfo_syn_data_ > 0)
+    fo.forget(remote_.address());
+
+  // what the server took of the data on the SYN is sent,
+  // the rest goes again once established
+  const uint32_t taken = in.ack() - (cb.ISS + 1);
+  if(taken > 0)
+  {
+    writeq.advance(taken);
+    writeq.acknowledge(taken);
+  }
+  cb.SND.NXT = in.ack();
+  tfo_syn_data_ = 0;
+}
+
+void Connection::fast_open_accept(Packet_view& in)
+{
+  (*host_.fast_open_accepted_)++;
+  debug("<Connection::fast_open_accept> %s took %u bytes on the SYN\n",
+    to_string().c_str(), in.tcp_data_length());
+
+  // the user can read and write from here on
+  signal_connect();
+
+  const uint32_t length = in.tcp_data_length();
+  const seq_t    seq    = in.seq() + 1;
+  cb.RCV.NXT += length;
+  last_ack_sent_ = cb.RCV.NXT; // by the SYN-ACK
+  if(read_request != nullptr)
+  {
+    const auto recv = (read_request->zero_copy())
+      ? read_request->insert(seq, rx_packet(), in.tcp_data(), length, true)
+      : read_request->insert(seq, in.tcp_data(), length, true);
+    Ensures(recv == length);
+  }
+}
+
 bool Connection::uses_window_scaling() const noexcept
 {
   return host_.uses_wscale();
@@ -1482,34 +1932,253 @@ void Connection::default_on_disconnect(Connection_ptr conn, Disconnect) {
     conn->close();
 }
 
-void Connection::reduce_ssthresh() {
+void Connection::setup_congestion_control()
+{
+  cc_->init(cc_window());
+}
+
+Connection::Cc_window Connection::cc_window() noexcept
+{
   auto fs = flight_size();
 
   const uint32_t two_seg = 2*SMSS();
 
+  // leave out what limited transmit sent [RFC 3042]
   if(limited_tx_)
     fs = (fs >= two_seg) ? fs - two_seg : 0;
 
-  cb.ssthresh = std::max( (fs / 2), two_seg );
+  return Cc_window{cb, fs, SMSS(), to_us(rttm.SRTT), now_us()};
+}
+
+void Connection::set_congestion_control(Congestion_control::Algorithm algo)
+{
+  if (algo != cc_->algorithm())
+  {
+    cc_ = Congestion_control::create(algo);
+    set_pacing(algo != Congestion_control::Algorithm::NEW_RENO or host_.uses_pacing());
+  }
+}
+
+void Connection::set_pacing(bool active) noexcept
+{
+  pacing_ = active;
+  if(not pacing_ and pace_hold_)
+  {
+    pacing_timer.stop();
+    pace_hold_ = false;
+  }
+}
+
+void Connection::pace(uint32_t bytes)
+{
+  const auto rate = pacing_rate();
+  if(rate == 0)
+    return;
+
+  const auto now = now_us();
+  // time spent idle doesn't add up to a burst later
+  next_send_us_ = std::max(next_send_us_, now) + uint64_t(bytes) * 1'000'000 / rate;
+
+  const auto ahead = next_send_us_ - now;
+  if(ahead > pacing_horizon_us)
+  {
+    pace_hold_ = true;
+    pacing_timer.restart(std::chrono::microseconds{ahead - pacing_horizon_us});
+  }
+}
+
+void Connection::pacing_timeout()
+{
+  pace_hold_ = false;
+  writeq_push();
+}
+
+void Connection::uncork()
+{
+  corked_ = false;
+  push();
+}
+
+void Connection::push()
+{
+  cork_timer.stop();
+  cork_hold_ = false;
+  if(state_->is_connected())
+    writeq_push();
+}
+
+uint64_t Connection::pacing_rate() const noexcept
+{
+  return cc_->pacing_rate(const_cast<Connection*>(this)->cc_window());
+}
+
+void Connection::idle_watch()
+{
+  if(idle_timer.is_running() or host_.idle_release().count() == 0)
+    return;
+  idle_rcv_ = cb.RCV.NXT;
+  idle_snd_ = cb.SND.NXT;
+  idle_timer.start(host_.idle_release());
+}
+
+void Connection::idle_timeout()
+{
+  // nothing is done per segment, the sequence numbers tell if data moved
+  if(cb.RCV.NXT != idle_rcv_ or cb.SND.NXT != idle_snd_ or not writeq.empty())
+  {
+    idle_watch();
+    return;
+  }
+  // watched again when data comes or goes
+  release_buffers();
+}
+
+void Connection::add_cycles(uint64_t cycles) noexcept
+{
+  cycles_ += cycles;
+  CycleProfiler::record(Cycle_sample::TCP_PORT, local().port(), cycles);
+  const auto& addr = remote().address();
+  if (addr.is_v4())
+    CycleProfiler::record(Cycle_sample::TCP_PEER4, addr.v4().whole, cycles);
+  else
+    CycleProfiler::record(Cycle_sample::TCP_PEER6, addr.v6().i64[0], cycles);
+}
+
+size_t Connection::release_buffers()
+{
+  size_t freed = 0;
+  if(read_request != nullptr)
+    freed = read_request->release();
+  // back to the pool, made again on the next gap
+  if(sack_list != nullptr and sack_list->size() == 0)
+    sack_list = nullptr;
+  writeq.shrink();
+  return freed;
+}
+
+void Connection::reduce_ssthresh() {
+  const auto ssthresh = New_reno::loss_ssthresh(cc_window());
+  cb.ssthresh = ssthresh;
   //printf("<TCP::Connection::reduce_ssthresh> Slow start threshold reduced: %u\n",
   //  cb.ssthresh);
 }
 
 void Connection::fast_retransmit() {
   //printf("<TCP::Connection::fast_retransmit> Fast retransmit initiated.\n");
-  // reduce sshtresh
-  reduce_ssthresh();
-  // retransmit segment starting SND.UNA
-  retransmit();
-  // inflate congestion window with the 3 packets we got dup ack on.
-  cb.cwnd = cb.ssthresh + 3*SMSS();
+  // reduce sshtresh and inflate the window
+  cc_->on_enter_recovery(cc_window());
+  // retransmit segment starting SND.UNA, or what RACK deemed lost
+  if(rack_)
+    rack_retransmit();
+  else
+    retransmit();
   fast_recovery_ = true;
 }
 
 void Connection::finish_fast_recovery() {
   reno_fpack_seen = false;
   fast_recovery_ = false;
-  //cb.cwnd = std::min(cb.ssthresh, std::max(flight_size(), (uint32_t)SMSS()) + SMSS());
-  cb.cwnd = cb.ssthresh;
+  cc_->on_exit_recovery(cc_window());
+  if(rack_)
+    rack_->on_recovery_end();
   //printf("<TCP::Connection::finish_fast_recovery> Finished Fast Recovery - Cwnd: %u\n", cb.cwnd);
 }
+
+void Connection::rack_ack(const Packet_view& in)
+{
+  sack::Block blocks[4];
+  size_t count = 0;
+  if(const auto* opt = in.parse_sack_option(); opt != nullptr and opt->length > 2)
+  {
+    count = std::min((opt->length - 2u) / sizeof(sack::Block), std::size(blocks));
+    std::memcpy(blocks, opt->val, count * sizeof(sack::Block));
+    for(size_t i = 0; i < count; i++)
+      blocks[i].swap_endian();
+  }
+
+  rack_->on_ack(in.ack(), blocks, count, now_us());
+
+  // the probe repaired a loss, respond as to one found by fast recovery
+  if(UNLIKELY(rack_->probe_repaired_loss()))
+  {
+    cc_->on_enter_recovery(cc_window());
+    cc_->on_exit_recovery(cc_window());
+  }
+}
+
+bool Connection::rack_detect_loss()
+{
+  const auto timeout = rack_->detect_loss(now_us(), to_us(rttm.SRTT), fast_recovery_);
+  if(timeout > 0)
+    rack_timer.restart(std::chrono::microseconds{timeout});
+  else
+    rack_timer.stop();
+
+  if(not rack_->has_lost())
+    return false;
+
+  // losses after a timeout are repaired in slow start
+  if(fast_recovery_ or rack_->rto_recovery())
+  {
+    rack_retransmit();
+    return false;
+  }
+
+  cb.recover = cb.SND.NXT;
+  debug("<TCP::Connection::rack_detect_loss> Enter Recovery %u - Flight Size: %u\n",
+    cb.recover, flight_size());
+  tlp_timer.stop();
+  fast_retransmit();
+  return true;
+}
+
+void Connection::rack_retransmit()
+{
+  // always one segment, then as long as the pipe is below cwnd [RFC 6675]
+  bool first = true;
+  while(const auto* seg = rack_->next_lost())
+  {
+    if(not first and pipe() + SMSS() > cb.cwnd)
+      break;
+    if(retransmit(seg->start, seg->size()) == 0)
+      break;
+    first = false;
+  }
+}
+
+void Connection::tlp_arm()
+{
+  // one probe per tail, and none while recovering
+  if(fast_recovery_ or rack_->empty() or rack_->probing() or rack_->rto_recovery())
+  {
+    tlp_timer.stop();
+    return;
+  }
+  const auto pto = Rack::pto(to_us(rttm.SRTT), to_us(rttm.rto_ms()), flight_size(), SMSS());
+  tlp_timer.restart(std::chrono::microseconds{pto});
+}
+
+void Connection::tlp_timeout()
+{
+  if(fast_recovery_ or rack_->empty())
+    return;
+
+  // new data if the peer's window allows, or else the last segment again
+  if(writeq.has_remaining_requests() and cb.SND.WND >= flight_size() + SMSS())
+  {
+    limited_tx();
+    rack_->on_probe(cb.SND.NXT, false);
+  }
+  else if(const auto* seg = rack_->last_unsacked())
+  {
+    // copy, the retransmission may split the segment
+    const auto start = seg->start, end = seg->end;
+    retransmit(start, end - start);
+    rack_->on_probe(end, true);
+  }
+  debug("<TCP::Connection::tlp_timeout> Probe sent - UNA: %u NXT: %u\n", cb.SND.UNA, cb.SND.NXT);
+
+  // the RTO takes over should the probe go unanswered
+  tlp_timer.stop();
+  rtx_reset();
+}
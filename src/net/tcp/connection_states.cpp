@@ -368,6 +368,9 @@ void Connection::Closed::open(Connection& tcp, bool active) {
 
       tcb.SND.UNA = tcb.ISS;
       tcb.SND.NXT = tcb.ISS+1;
+      // Fast Open [RFC 7413]
+      if(UNLIKELY(tcp.tfo_))
+        tcp.fill_syn_data(*packet);
       tcp.transmit(std::move(packet));
       tcp.set_state(SynSent::instance());
     } else {
@@ -637,8 +640,20 @@ State::Result Connection::Listen::handle(Connection& tcp, Packet_view& in) {
     // Parse options
     tcp.parse_options(in);
 
+    // [RFC 7413] the data on a SYN with a valid Fast Open cookie
+    // is ACKed by the SYN-ACK, and may be answered right away
+    const bool fast_open = tcp.tfo_accepted_ and in.has_tcp_data();
+    tcp.tfo_accepted_ = fast_open;
+    if(UNLIKELY(fast_open))
+    {
+      tcb.SND.WND = in.win();
+      tcb.SND.WL1 = in.seq();
+      tcb.SND.WL2 = tcb.ISS;
+    }
+
     auto packet = tcp.outgoing_packet();
-    packet->set_seq(tcb.ISS).set_ack(tcb.RCV.NXT).set_flags(SYN | ACK);
+    const seq_t ack = tcb.RCV.NXT + (fast_open ? in.tcp_data_length() : 0);
+    packet->set_seq(tcb.ISS).set_ack(ack).set_flags(SYN | ACK);
 
     // Options are now parsed so we should be able to
     // add the negotiated options here
@@ -647,6 +662,9 @@ State::Result Connection::Listen::handle(Connection& tcp, Packet_view& in) {
     tcp.transmit(std::move(packet));
     tcp.set_state(SynReceived::instance());
 
+    if(UNLIKELY(fast_open))
+      tcp.fast_open_accept(in);
+
     return OK;
   }
   return OK;
@@ -743,6 +761,10 @@ State::Result Connection::SynSent::handle(Connection& tcp, Packet_view& in) {
     // (our SYN has been ACKed)
     if(tcb.SND.UNA > tcb.ISS)
     {
+      // Fast Open [RFC 7413]
+      if(UNLIKELY(tcp.tfo_))
+        tcp.fast_open_synack(in);
+
       // Correction: [RFC 1122 p. 94]
       tcb.SND.WND = in.win();
       tcb.SND.WL1 = in.seq();
@@ -865,7 +887,9 @@ State::Result Connection::SynReceived::handle(Connection& tcp, Packet_view& in)
         tcp.rttm.RTO = RTTM::seconds(3.0);
       }
 
-      tcp.signal_connect(); // NOTE: User callback
+      // a Fast Open connection is with the user already
+      if(LIKELY(not tcp.tfo_accepted_))
+        tcp.signal_connect(); // NOTE: User callback
 
       // 7. proccess the segment text
       if(UNLIKELY(in.has_tcp_data())) {
@@ -0,0 +1,51 @@
+#include <net/tcp/fast_open.hpp>
+#include <kernel/rng.hpp>
+#include <util/siphash.hpp>
+#include <cstring>
+
+using namespace net::tcp;
+
+Fast_open::Fast_open(Key key)
+  : key_{key}
+{}
+
+Fast_open::Fast_open()
+  : Fast_open{Key{rng_extract_uint64(), rng_extract_uint64()}}
+{}
+
+Fast_open::Cookie Fast_open::make(const Addr& client) const noexcept
+{
+  // addresses are kept as IPv6, IPv4 mapped
+  const auto& addr = client.v6();
+  const uint64_t mac = util::Siphash{key_[0], key_[1]}
+    .add(addr.i64[0]).add(addr.i64[1]).finish();
+
+  Cookie cookie;
+  std::memcpy(cookie.data.data(), &mac, COOKIE_LEN);
+  cookie.len = COOKIE_LEN;
+  return cookie;
+}
+
+bool Fast_open::check(const Addr& client, const uint8_t* cookie, uint8_t len) const noexcept
+{
+  if (len != COOKIE_LEN)
+    return false;
+  const auto expected = make(client);
+  return std::memcmp(expected.data.data(), cookie, COOKIE_LEN) == 0;
+}
+
+void Fast_open::cache(const Addr& server, const Cookie& cookie, uint16_t mss)
+{
+  if (cookie.len < MIN_COOKIE or cookie.len > MAX_COOKIE)
+    return;
+  // make room, any server will do
+  if (cache_.size() >= CACHE_SIZE and cache_.find(server.v6()) == cache_.end())
+    cache_.erase(cache_.begin());
+  cache_[server.v6()] = Cached{cookie, mss};
+}
+
+const Fast_open::Cached* Fast_open::cached(const Addr& server) const
+{
+  auto it = cache_.find(server.v6());
+  return (it != cache_.end()) ? &it->second : nullptr;
+}
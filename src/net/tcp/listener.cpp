@@ -1,7 +1,9 @@
 
 #include <gsl/gsl_assert>
 #include <net/tcp/listener.hpp>
+#include <net/tcp/connection_states.hpp>
 #include <net/tcp/tcp.hpp>
+#include <rtc>
 
 using namespace net;
 using namespace tcp;
@@ -54,8 +56,18 @@ void Listener::segment_arrived(Packet_view& packet) {
   // if it's a new attempt (SYN)
   else
   {
-    // don't waste time if the packet does not have SYN
-    if(UNLIKELY(not packet.isset(SYN) or packet.has_tcp_data()))
+    // or the ACK completing a handshake answered with a cookie
+    if(UNLIKELY(host_.uses_syn_cookies() and packet.isset(ACK)
+      and not packet.isset(SYN) and not packet.isset(RST)))
+    {
+      if(accept_syn_cookie(packet))
+        return;
+    }
+
+    // don't waste time if the packet does not have SYN,
+    // or has data without a chance of Fast Open
+    if(UNLIKELY(not packet.isset(SYN)
+      or (packet.has_tcp_data() and not host_.uses_fast_open())))
     {
       TCPL_PRINT2("<Listener::segment_arrived> Packet did not have SYN - dropping\n");
       host_.send_reset(packet);
@@ -63,7 +75,7 @@ void Listener::segment_arrived(Packet_view& packet) {
     }
 
     // Stat increment number of connection attempts
-    host_.connection_attempts_++;
+    (*host_.connection_attempts_)++;
 
     // if we don't like this client, do nothing
     if(UNLIKELY(on_accept_(packet.source()) == false)) {
@@ -71,12 +83,16 @@ void Listener::segment_arrived(Packet_view& packet) {
       return;
     }
 
-    // remove oldest connection if queue is full
     TCPL_PRINT2("<Listener::segment_arrived> SynQueue: %u\n", syn_queue_.size());
-    // SYN queue is full
-    if(syn_queue_.size() >= host_.max_syn_backlog())
+    // SYN queue is full, answer with a cookie or remove oldest connection
+    if(syn_queue_full())
     {
       TCPL_PRINT2("<Listener::segment_arrived> Queue is full\n");
+      if(host_.uses_syn_cookies())
+      {
+        send_syn_cookie(packet);
+        return;
+      }
       Expects(not syn_queue_.empty());
       debug("<Listener::segment_arrived> Connection %s dropped to make room for new connection\n",
         syn_queue_.back()->to_string().c_str());
@@ -86,7 +102,7 @@ void Listener::segment_arrived(Packet_view& packet) {
 
     auto& conn = *(syn_queue_.emplace(
       syn_queue_.cbegin(),
-      std::make_shared<Connection>(host_, packet.destination(), packet.source(), ConnectCallback{this, &Listener::connected})
+      host_.new_connection(packet.destination(), packet.source(), ConnectCallback{this, &Listener::connected})
       )
     );
     conn->_on_cleanup({this, &Listener::remove});
@@ -102,6 +118,84 @@ void Listener::segment_arrived(Packet_view& packet) {
   TCPL_PRINT2("<Listener::segment_arrived> No receipent\n");
 }
 
+static uint64_t cookie_clock()
+{ return RTC::nanos_now() / 1'000'000'000ull; }
+
+// the MSS option of a SYN, or the default when there is none
+static uint16_t syn_mss(const Packet_view& syn)
+{
+  const uint8_t* opt = syn.tcp_options();
+  while(opt < syn.tcp_data())
+  {
+    const auto* option = reinterpret_cast<const Option*>(opt);
+    if(option->kind == Option::END)
+      break;
+    if(option->kind == Option::NOP) {
+      opt++;
+      continue;
+    }
+    if(UNLIKELY(option->length < 2))
+      break;
+    if(option->kind == Option::MSS and option->length == sizeof(Option::opt_mss))
+      return ntohs(reinterpret_cast<const Option::opt_mss*>(option)->mss);
+    opt += option->length;
+  }
+  return (syn.ipv() == Protocol::IPv6) ? default_mss_v6 : default_mss;
+}
+
+void Listener::send_syn_cookie(const Packet_view& in)
+{
+  const seq_t cookie = host_.syn_cookies_.make(in.destination(), in.source(),
+    in.seq(), syn_mss(in), cookie_clock());
+
+  auto out = (in.ipv() == Protocol::IPv6)
+    ? host_.create_outgoing_packet6() : host_.create_outgoing_packet();
+  out->set_source(in.destination());
+  out->set_destination(in.source());
+  out->set_seq(cookie).set_ack(in.seq()+1).set_flags(SYN | ACK);
+  // no room in the cookie for window scaling, timestamps or SACK
+  out->set_win(std::min(host_.window_size(), (uint32_t)default_window_size));
+  out->add_tcp_option<Option::opt_mss>(host_.MSS(in.ipv()));
+
+  debug("<Listener::send_syn_cookie> %s answered with cookie %u\n",
+    in.source().to_string().c_str(), cookie);
+  host_.transmit(std::move(out));
+  (*host_.syn_cookies_sent_)++;
+}
+
+bool Listener::accept_syn_cookie(Packet_view& packet)
+{
+  const seq_t irs = packet.seq() - 1;
+  const seq_t iss = packet.ack() - 1;
+  const uint16_t mss = host_.syn_cookies_.check(packet.destination(), packet.source(),
+    irs, iss, cookie_clock());
+  if(mss == 0)
+    return false;
+
+  (*host_.syn_cookies_validated_)++;
+  auto conn = host_.new_connection(packet.destination(), packet.source(),
+    ConnectCallback{this, &Listener::connected});
+  conn->_on_cleanup({this, &Listener::remove});
+  conn->open(false);
+  Ensures(conn->is_listening());
+
+  // the state the SYN would have left it in
+  auto& tcb    = conn->tcb();
+  tcb.IRS      = irs;
+  tcb.RCV.NXT  = packet.seq();
+  tcb.ISS      = iss;
+  tcb.recover  = iss;
+  tcb.SND.UNA  = iss;
+  tcb.SND.NXT  = iss+1;
+  tcb.SND.MSS  = mss;
+  conn->set_state(Connection::SynReceived::instance());
+  debug("<Listener::accept_syn_cookie> Connection %s created from cookie\n",
+    conn->to_string().c_str());
+
+  conn->segment_arrived(packet);
+  return true;
+}
+
 void Listener::remove(const Connection* conn) {
   TCPL_PRINT2("<Listener::remove> Try remove %s\n", conn->to_string().c_str());
   auto it = syn_queue_.begin();
@@ -120,7 +214,8 @@ void Listener::remove(const Connection* conn) {
 void Listener::connected(Connection_ptr conn) {
   debug("<Listener::connected> %s connected\n", conn->to_string().c_str());
   remove(conn.get());
-  Expects(conn->is_connected());
+  // Fast Open hands the connection over before the handshake completes
+  Expects(conn->is_connected() or conn->tfo_accepted_);
   if (UNLIKELY(! host_.add_connection(conn)))
     return;
 
@@ -0,0 +1,265 @@
+#include <net/tcp/rack.hpp>
+#include <algorithm>
+#include <array>
+
+using namespace net::tcp;
+
+static inline bool before(seq_t a, seq_t b) noexcept
+{ return static_cast<int32_t>(a - b) < 0; }
+
+// whether (t1, seq1) was sent after (t2, seq2), ties broken by sequence
+static inline bool sent_after(uint64_t t1, seq_t seq1, uint64_t t2, seq_t seq2) noexcept
+{ return t1 > t2 or (t1 == t2 and before(seq2, seq1)); }
+
+uint64_t Rack::pto(uint64_t srtt_us, uint64_t rto_us,
+                   uint32_t flight, uint16_t smss) noexcept
+{
+  uint64_t pto = 2 * srtt_us;
+  // a lone segment may sit in the peer's delayed ACK
+  if (flight <= smss)
+    pto += max_ack_delay_us;
+  return std::min(pto, rto_us);
+}
+
+Rack::iterator Rack::split(seq_t seq)
+{
+  // first segment ending after seq
+  auto it = std::lower_bound(segs_.begin(), segs_.end(), seq,
+    [](const Segment& seg, seq_t seq) { return not before(seq, seg.end); });
+
+  if (it == segs_.end() or not before(it->start, seq))
+    return it;
+
+  Segment tail = *it;
+  tail.start = seq;
+  it->end = seq;
+  if (tail.lost) ++lost_;
+  if (tail.sacked) ++sacked_;
+  return segs_.insert(it + 1, tail);
+}
+
+void Rack::on_transmit(seq_t start, seq_t end, uint64_t now_us)
+{
+  if (not before(start, end))
+    return;
+
+  // new data
+  if (segs_.empty() or not before(start, segs_.back().end))
+  {
+    segs_.push_back({start, end, now_us});
+    pipe_ += end - start;
+    return;
+  }
+
+  const seq_t tail = segs_.back().end;
+  if (before(tail, end))
+  {
+    segs_.push_back({tail, end, now_us});
+    pipe_ += end - tail;
+    end = tail;
+  }
+
+  // retransmission, split so the timestamp covers exactly what was sent
+  split(end);
+  for (auto it = split(start); it != segs_.end() and before(it->start, end); ++it)
+  {
+    if (it->sacked)
+      continue;
+    it->xmit_us       = now_us;
+    it->retransmitted = true;
+    if (it->lost)
+    {
+      it->lost = false;
+      --lost_;
+      pipe_ += it->size();
+    }
+  }
+}
+
+void Rack::deliver(const Segment& seg, uint64_t now_us) noexcept
+{
+  const uint64_t rtt = std::max<uint64_t>(now_us - seg.xmit_us, 1);
+  // the ACK may be for the original transmission, which would give
+  // a bogus RTT sample
+  if (seg.retransmitted and rtt < min_rtt_us_)
+    return;
+
+  if (min_rtt_us_ == 0 or rtt < min_rtt_us_)
+    min_rtt_us_ = rtt;
+
+  // delivered below a segment that was delivered earlier and sent later
+  if (delivered_ and not seg.retransmitted and before(seg.end, fack_))
+    reordering_seen_ = true;
+  else if (not delivered_ or before(fack_, seg.end))
+    fack_ = seg.end;
+
+  if (not delivered_ or sent_after(seg.xmit_us, seg.end, xmit_us_, end_seq_))
+  {
+    xmit_us_   = seg.xmit_us;
+    end_seq_   = seg.end;
+    rtt_us_    = rtt;
+    delivered_ = true;
+  }
+}
+
+void Rack::on_ack(seq_t una, const sack::Block* blocks, size_t count, uint64_t now_us)
+{
+  // a first block below the cumulative ACK, or inside the second block,
+  // reports data received twice [RFC 2883]
+  const bool dsack = count > 0 and (before(blocks[0].start, una) or
+    (count > 1 and not before(blocks[0].start, blocks[1].start)
+               and not before(blocks[1].end, blocks[0].end)));
+
+  // cumulatively acknowledged
+  while (not segs_.empty() and not before(una, segs_.front().end))
+  {
+    const auto& seg = segs_.front();
+    if (seg.sacked) {
+      --sacked_;
+    }
+    else {
+      deliver(seg, now_us);
+      if (seg.lost) --lost_;
+      else pipe_ -= seg.size();
+    }
+    segs_.pop_front();
+  }
+
+  // partially acknowledged
+  if (not segs_.empty() and before(segs_.front().start, una))
+  {
+    auto& seg = segs_.front();
+    if (not seg.sacked and not seg.lost)
+      pipe_ -= una - seg.start;
+    seg.start = una;
+  }
+
+  // selectively acknowledged, lowest block first, as the blocks come
+  // most recent first and would otherwise look reordered
+  std::array<sack::Block, 4> sorted;
+  size_t n = 0;
+  for (size_t i = dsack ? 1 : 0; i < count and n < sorted.size(); i++)
+    if (before(una, blocks[i].end))
+      sorted[n++] = blocks[i];
+  std::sort(sorted.begin(), sorted.begin() + n,
+    [](const sack::Block& a, const sack::Block& b) { return before(a.start, b.start); });
+
+  for (size_t i = 0; i < n; i++)
+  {
+    const auto& blk = sorted[i];
+    auto it = std::lower_bound(segs_.begin(), segs_.end(), blk.start,
+      [](const Segment& seg, seq_t seq) { return before(seg.start, seq); });
+
+    for (; it != segs_.end() and not before(blk.end, it->end); ++it)
+    {
+      if (it->sacked)
+        continue;
+      it->sacked = true;
+      ++sacked_;
+      if (it->lost) --lost_;
+      else pipe_ -= it->size();
+      deliver(*it, now_us);
+    }
+  }
+
+  // a spurious retransmission, wait longer for reordering [RFC 8985 6.2 step 4]
+  if (dsack and reo_wnd_mult_ < UINT8_MAX)
+  {
+    ++reo_wnd_mult_;
+    reo_wnd_persist_ = reo_wnd_persist;
+  }
+
+  // the probe was acknowledged. Without a DSACK telling that the original
+  // made it, the probe repaired a loss
+  if (tlp_active_ and not before(una, tlp_end_))
+  {
+    tlp_active_ = false;
+    tlp_loss_   = tlp_rtx_ and not dsack;
+  }
+
+  if (rto_active_ and not before(una, rto_end_))
+    rto_active_ = false;
+}
+
+void Rack::mark_lost(Segment& seg) noexcept
+{
+  seg.lost = true;
+  ++lost_;
+  pipe_ -= seg.size();
+}
+
+uint64_t Rack::detect_loss(uint64_t now_us, uint64_t srtt_us, bool in_recovery)
+{
+  if (not delivered_)
+    return 0;
+
+  // without reordering there is no reason to wait once recovering,
+  // or once as many segments are SACKed as would be duplicate ACKs
+  uint64_t reo_wnd = 0;
+  if (reordering_seen_ or not (in_recovery or sacked_ >= 3))
+    reo_wnd = std::min(reo_wnd_mult_ * min_rtt_us_ / 4, srtt_us);
+
+  const uint64_t deadline = rtt_us_ + reo_wnd;
+  uint64_t timeout = 0;
+  for (auto& seg : segs_)
+  {
+    if (seg.sacked or seg.lost)
+      continue;
+    // only what was sent before the most recently sent delivered segment
+    if (not sent_after(xmit_us_, end_seq_, seg.xmit_us, seg.end))
+      continue;
+
+    const uint64_t elapsed = now_us - seg.xmit_us;
+    if (elapsed >= deadline)
+      mark_lost(seg);
+    else
+      timeout = std::max(timeout, deadline - elapsed);
+  }
+  return timeout;
+}
+
+void Rack::on_timeout()
+{
+  for (auto& seg : segs_)
+    if (not seg.sacked and not seg.lost)
+      mark_lost(seg);
+
+  rto_active_ = not segs_.empty();
+  if (rto_active_)
+    rto_end_ = segs_.back().end;
+  tlp_active_ = false;
+}
+
+void Rack::on_recovery_end() noexcept
+{
+  if (reo_wnd_persist_ > 0 and --reo_wnd_persist_ == 0)
+    reo_wnd_mult_ = 1;
+}
+
+void Rack::on_probe(seq_t end, bool retransmission) noexcept
+{
+  tlp_end_    = end;
+  tlp_active_ = true;
+  tlp_rtx_    = retransmission;
+}
+
+const Rack::Segment* Rack::next_lost() const noexcept
+{
+  if (lost_ == 0)
+    return nullptr;
+  auto it = std::find_if(segs_.begin(), segs_.end(),
+    [](const Segment& seg) { return seg.lost; });
+  return (it != segs_.end()) ? &*it : nullptr;
+}
+
+const Rack::Segment* Rack::last_unsacked() const noexcept
+{
+  auto it = std::find_if(segs_.rbegin(), segs_.rend(),
+    [](const Segment& seg) { return not seg.sacked; });
+  return (it != segs_.rend()) ? &*it : nullptr;
+}
+
+void Rack::clear() noexcept
+{
+  *this = Rack{};
+}
@@ -103,6 +103,16 @@ void Read_buffer::reset_buffer_if_needed()
   }
 }
 
+size_t Read_buffer::release()
+{
+  const size_t bytes = buf->capacity();
+  if (size() > 0 or bytes == 0)
+    return 0;
+  // the user may still hold the old one
+  buf = tcp::construct_buffer(buf->get_allocator());
+  return bytes;
+}
+
 __attribute__((weak))
 int Read_buffer::deserialize_from(void*) { return 0; }
 __attribute__((weak))
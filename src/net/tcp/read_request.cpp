@@ -1,11 +1,18 @@
 
 #include <net/tcp/read_request.hpp>
+#include <util/bitops.hpp>
+#include <algorithm>
 
 namespace net {
 namespace tcp {
 
-  Read_request::Read_request(seq_t start, size_t min, size_t max, Alloc&& alloc)
-    : alloc{alloc}
+  static inline bool before(seq_t a, seq_t b) noexcept
+  { return static_cast<int32_t>(a - b) < 0; }
+
+  Read_request::Read_request(seq_t start, size_t min, size_t max, Alloc&& alloc,
+                             bool zero_copy)
+    : alloc{alloc}, zero_copy_{zero_copy},
+      next_seq{start}, capacity{max * buffer_limit}, buf_size{max}
   {
     buffers.push_back(std::make_unique<Read_buffer>(start, min, max, alloc));
   }
@@ -13,6 +20,7 @@ namespace tcp {
   size_t Read_request::insert(seq_t seq, const uint8_t* data, size_t n, bool psh)
   {
     Expects(not buffers.empty());
+    Expects(not zero_copy_ && "Zero-copy data is inserted with its packet");
 
     //printf("insert: seq=%u len=%lu\n", seq, n);
     size_t recv{0};
@@ -55,7 +63,7 @@ namespace tcp {
           // it means the local sequence number is much farther behind
           // the real one
           seq = end_seq - rem;
-          buf->reset(seq);
+          buf->reset(seq, buf_size);
           //printf("size=1, reset rem=%u start=%u end=%u\n",
           //  rem, buf->start_seq(), buf->end_seq());
           break;
@@ -94,6 +102,63 @@ namespace tcp {
     return recv;
   }
 
+  size_t Read_request::insert(seq_t seq, const Packet_slice::Packet_ref& pkt,
+                              const uint8_t* data, size_t n, bool)
+  {
+    Expects(zero_copy_);
+    n = std::min(n, fits(seq));
+    if (UNLIKELY(n == 0))
+      return 0;
+
+    if (seq == next_seq)
+    {
+      ready_slices.emplace_back(pkt, data, n);
+      ready_bytes += n;
+      next_seq += n;
+      release_held();
+    }
+    else
+    {
+      // keep the held segments in sequence order
+      auto it = held_slices.end();
+      while (it != held_slices.begin() and before(seq, std::prev(it)->first))
+        --it;
+      held_slices.emplace(it, seq, Packet_slice{pkt, data, n});
+      held_bytes += n;
+    }
+
+    // there are no buffers to fill, so signal whenever data is ready
+    signal_data();
+    return n;
+  }
+
+  void Read_request::release_held()
+  {
+    while (not held_slices.empty() and not before(next_seq, held_slices.front().first))
+    {
+      auto& [seq, slice] = held_slices.front();
+      held_bytes -= slice.size();
+      // drop what has already been delivered
+      const size_t dup = next_seq - seq;
+      if (dup < slice.size())
+      {
+        slice.consume(dup);
+        ready_bytes += slice.size();
+        next_seq += slice.size();
+        ready_slices.push_back(std::move(slice));
+      }
+      held_slices.pop_front();
+    }
+  }
+
+  Slice_chain Read_request::read_slices()
+  {
+    Slice_chain slices;
+    slices.swap(ready_slices);
+    ready_bytes = 0;
+    return slices;
+  }
+
   Read_buffer* Read_request::get_buffer(const seq_t seq)
   {
     // There is room in a existing one
@@ -116,7 +181,7 @@ namespace tcp {
       // we probably need to create multiple buffers,
       // ... or just decide we only support gaps of 1 buffer size.
       buffers.push_back(
-        std::make_unique<Read_buffer>(cur_back->end_seq(), cur_back->capacity(), cur_back->capacity(), alloc));
+        std::make_unique<Read_buffer>(cur_back->end_seq(), buf_size, buf_size, alloc));
 
       auto& back = buffers.back();
       //printf("new buffer added start=%u end=%u, fits(%lu)=%lu\n",
@@ -132,6 +197,14 @@ namespace tcp {
 
   size_t Read_request::fits(const seq_t seq) const
   {
+    if (zero_copy_)
+    {
+      const size_t held = ready_bytes + held_bytes;
+      const size_t avail = (capacity > held) ? capacity - held : 0;
+      const size_t rel = seq - next_seq;
+      return (rel < avail) ? avail - rel : 0;
+    }
+
     auto len = 0;
     // There is room in a existing one
     for(auto& ptr : buffers)
@@ -146,17 +219,38 @@ namespace tcp {
     {
       auto& back = buffers.back();
       const auto rel = seq - back->end_seq();
-      const auto cap = back->capacity();
 
-      if(rel < cap)
-        len += (cap - rel);
+      if(rel < buf_size)
+        len += (buf_size - rel);
     }
 
     return len;
   }
 
+  size_t Read_request::room(const seq_t seq) const
+  {
+    if (zero_copy_)
+      return fits(seq);
+
+    const seq_t end = buffers.back()->end_seq()
+      + (buffer_limit - buffers.size()) * buf_size;
+    const size_t rel = seq - buffers.front()->start_seq();
+    const size_t total = end - buffers.front()->start_seq();
+    return (rel < total) ? total - rel : 0;
+  }
+
+  void Read_request::set_buffer_size(size_t size)
+  {
+    Expects(util::bits::is_pow2(size));
+    buf_size = size;
+    capacity = size * buffer_limit;
+  }
+
   size_t Read_request::size() const
   {
+    if (zero_copy_)
+      return ready_bytes + held_bytes;
+
     size_t bytes = 0;
 
     for(auto& ptr : buffers)
@@ -167,6 +261,8 @@ namespace tcp {
 
   void Read_request::set_start(seq_t seq)
   {
+    Expects(held_slices.empty() && "Cannot change start sequence when there already is data");
+    next_seq = seq;
     for(auto& ptr : buffers)
     {
       Expects(ptr->size() == 0 && "Cannot change start sequence when there already is data");
@@ -178,6 +274,12 @@ namespace tcp {
 
   void Read_request::signal_data() {
 
+    if (zero_copy_) {
+      if (not ready_slices.empty() and on_data_callback != nullptr)
+        on_data_callback();
+      return;
+    }
+
     if (not complete_buffers.empty()) {
       if (on_data_callback != nullptr){
         on_data_callback();
@@ -196,6 +298,9 @@ namespace tcp {
   }
 
   size_t Read_request::next_size() {
+    if (zero_copy_) {
+      return ready_bytes;
+    }
     if (not complete_buffers.empty()) {
       return complete_buffers.front()->size();
     }
@@ -203,6 +308,16 @@ namespace tcp {
   }
 
   buffer_t Read_request::read_next() {
+    // zero-copy data read this way is gathered into one buffer
+    if (zero_copy_) {
+      if (UNLIKELY(ready_slices.empty()))
+        return nullptr;
+      auto buf = tcp::construct_buffer(alloc);
+      buf->reserve(ready_bytes);
+      for (const auto& slice : read_slices())
+        buf->insert(buf->end(), slice.data(), slice.data() + slice.size());
+      return buf;
+    }
     if (UNLIKELY(complete_buffers.empty()))
         return nullptr;
     auto buf = std::move(complete_buffers.front());
@@ -214,6 +329,15 @@ namespace tcp {
   {
     Expects(not buffers.empty());
 
+    // data ready is already acknowledged and stays, what is held is thrown away
+    if (zero_copy_)
+    {
+      signal_data();
+      held_slices.clear();
+      held_bytes = 0;
+      next_seq = seq;
+    }
+
     auto it = buffers.begin();
 
     // get the first buffer
@@ -242,5 +366,13 @@ namespace tcp {
     Ensures(buffers.size() == 1);
   }
 
+  size_t Read_request::release()
+  {
+    // a second buffer means data is still coming in around a gap
+    if (buffers.size() != 1 or not complete_buffers.empty())
+      return 0;
+    return buffers.front()->release();
+  }
+
 }
 }
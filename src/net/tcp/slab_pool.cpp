@@ -0,0 +1,47 @@
+#include <net/tcp/slab_pool.hpp>
+#include <algorithm>
+
+using namespace net::tcp;
+
+static constexpr size_t round_up(size_t n, size_t align) noexcept
+{ return (n + align - 1) / align * align; }
+
+Slab_pool::Slab_pool(size_t block_size, size_t slab_blocks)
+  : block_size_{round_up(std::max(block_size, sizeof(Block)), alignment)},
+    slab_blocks_{std::max(slab_blocks, (size_t) 1)}
+{}
+
+void* Slab_pool::allocate()
+{
+  if (UNLIKELY(free_ == nullptr))
+    grow(slab_blocks_);
+
+  auto* block = free_;
+  free_ = block->next;
+  available_--;
+  return block;
+}
+
+void Slab_pool::deallocate(void* ptr) noexcept
+{
+  auto* block = static_cast<Block*>(ptr);
+  block->next = free_;
+  free_ = block;
+  available_++;
+}
+
+void Slab_pool::reserve(size_t n)
+{
+  if (available_ < n)
+    grow(n - available_);
+}
+
+void Slab_pool::grow(size_t blocks)
+{
+  // default initialized, the blocks are written before use
+  std::unique_ptr<uint8_t[]> slab{new uint8_t[blocks * block_size_]};
+  for (size_t i = blocks; i-- > 0; )
+    deallocate(slab.get() + i * block_size_);
+  capacity_ += blocks;
+  slabs_.push_back(std::move(slab));
+}
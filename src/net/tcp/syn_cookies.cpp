@@ -0,0 +1,55 @@
+#include <net/tcp/syn_cookies.hpp>
+#include <kernel/rng.hpp>
+#include <util/siphash.hpp>
+
+using namespace net::tcp;
+
+Syn_cookies::Syn_cookies(Key key)
+  : key_{key}
+{}
+
+Syn_cookies::Syn_cookies()
+  : Syn_cookies{Key{rng_extract_uint64(), rng_extract_uint64()}}
+{}
+
+uint32_t Syn_cookies::hash(const Socket& local, const Socket& remote,
+                           seq_t peer_isn, uint64_t t, uint32_t mss_idx) const noexcept
+{
+  // addresses are kept as IPv6, IPv4 mapped
+  const auto& la = local.address().v6();
+  const auto& ra = remote.address().v6();
+  return util::Siphash{key_[0], key_[1]}
+    .add(la.i64[0]).add(la.i64[1])
+    .add(ra.i64[0]).add(ra.i64[1])
+    .add((uint64_t(local.port()) << 48) | (uint64_t(remote.port()) << 32) | peer_isn)
+    .add((t << 3) | mss_idx)
+    .finish() & HASH_MASK;
+}
+
+seq_t Syn_cookies::make(const Socket& local, const Socket& remote, seq_t peer_isn,
+                        uint16_t mss, uint64_t now_s) const noexcept
+{
+  uint32_t idx = 0;
+  while (idx + 1 < mss_table.size() and mss_table[idx + 1] <= mss)
+    idx++;
+
+  const uint64_t t = now_s >> PERIOD_BITS;
+  return (uint32_t(t & 0x1f) << 27) | (idx << 24)
+    | hash(local, remote, peer_isn, t, idx);
+}
+
+uint16_t Syn_cookies::check(const Socket& local, const Socket& remote, seq_t peer_isn,
+                            seq_t cookie, uint64_t now_s) const noexcept
+{
+  const uint64_t now = now_s >> PERIOD_BITS;
+  const uint32_t idx = (cookie >> 24) & 0x7;
+  // made this period or the one before
+  for (uint64_t age = 0; age <= 1 and age <= now; age++)
+  {
+    const uint64_t t = now - age;
+    if ((cookie >> 27) == (t & 0x1f)
+        and (cookie & HASH_MASK) == hash(local, remote, peer_isn, t, idx))
+      return mss_table[idx];
+  }
+  return 0;
+}
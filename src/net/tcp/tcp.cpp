@@ -13,18 +13,33 @@
 #include <rtc> // nanos_now (get_ts_value)
 #include <net/tcp/packet4_view.hpp>
 #include <net/tcp/packet6_view.hpp>
+#include <net/rss.hpp>
+#include <profile>
+#include <smp>
+#include <kernel/rng.hpp>
+#include <algorithm>
 
 using namespace std;
 using namespace net;
 using namespace net::tcp;
 
-TCP::TCP(IPStack& inet, bool smp_enable) :
+TCP::TCP(IPStack& inet, bool smp_enable)
+  : TCP(inet, smp_enable, SMP::cpu_id())
+{
+  os::mem::add_shrinker("tcp.buffers", os::mem::Shrink_cost::cheap,
+                        {this, &TCP::shrink_buffers});
+}
+
+TCP::TCP(IPStack& inet, bool smp_enable, int cpu) :
   inet_{inet},
   listeners_(),
   connections_(),
+  time_wait_(),
+  time_wait_timer_{timer_wheel_, {this, &TCP::time_wait_timeout}},
   total_bufsize_{default_total_bufsize},
   mempool_{total_bufsize_},
   min_bufsize_{default_min_bufsize}, max_bufsize_{default_max_bufsize},
+  max_rcv_window_{default_max_rcv_window}, rcv_autotune_{default_rcv_autotune},
   ports_(inet.tcp_ports()),
   writeq(),
   max_seg_lifetime_{default_msl},       // 30s
@@ -32,13 +47,21 @@ TCP::TCP(IPStack& inet, bool smp_enable) :
   wscale_{default_window_scaling},      // 5
   timestamps_{default_timestamps},      // true
   sack_{default_sack},                  // true
+  rack_{default_rack},                  // true
+  gro_{default_gro},                    // true
+  pacing_{default_pacing},              // false
   dack_timeout_{default_dack_timeout},  // 40ms
-  max_syn_backlog_{default_max_syn_backlog} // 64
+  idle_release_{default_idle_release},  // 30s
+  max_syn_backlog_{default_max_syn_backlog}, // 64
+  syn_cookies_enabled_{default_syn_cookies}, // true
+  fast_open_enabled_{default_fast_open},      // false
+  pooling_{default_connection_pooling},       // true
+  time_wait_compaction_{default_time_wait_compaction} // true
 {
   Expects(wscale_ <= 14 && "WScale factor cannot exceed 14");
   Expects(win_size_ <= 0x40000000 && "Invalid size");
 
-  this->cpu_id = SMP::cpu_id();
+  this->cpu_id = cpu;
   this->smp_enabled = smp_enable;
   std::string stat_prefix;
   if (this->smp_enabled == false)
@@ -53,14 +76,20 @@ TCP::TCP(IPStack& inet, bool smp_enable) :
     SMP::global_unlock();
     stat_prefix = inet.ifname() + ".cpu" + std::to_string(this->cpu_id);
   }
-  bytes_rx_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.rx").get_uint64();
-  bytes_tx_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.tx").get_uint64();
-  packets_rx_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.packets_rx").get_uint64();
-  packets_tx_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.packets_tx").get_uint64();
+  bytes_rx_ = &Statman::get().create_percpu(stat_prefix + ".tcp.rx");
+  bytes_tx_ = &Statman::get().create_percpu(stat_prefix + ".tcp.tx");
+  packets_rx_ = &Statman::get().create_percpu(stat_prefix + ".tcp.packets_rx");
+  packets_tx_ = &Statman::get().create_percpu(stat_prefix + ".tcp.packets_tx");
   incoming_connections_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.conn_incoming").get_uint64();
   outgoing_connections_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.conn_outgoing").get_uint64();
   connection_attempts_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.conn_attempts").get_uint64();
+  syn_cookies_sent_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.syn_cookies_sent").get_uint64();
+  syn_cookies_validated_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.syn_cookies_validated").get_uint64();
+  fast_open_accepted_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.fast_open_accepted").get_uint64();
   packets_dropped_ = &Statman::get().create(Stat::UINT32, stat_prefix + ".tcp.dropped").get_uint32();
+  shard_handoffs_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.shard_handoffs").get_uint64();
+  gro_merged_ = &Statman::get().create(Stat::UINT64, stat_prefix + ".tcp.gro_merged").get_uint64();
+  rtt_ = &Statman::get().create_histogram(stat_prefix + ".tcp.rtt_ns");
 }
 
 void TCP::smp_process_writeq(size_t packets)
@@ -78,9 +107,8 @@ Listener& TCP::listen(const Socket& socket, ConnectCallback cb)
 {
   bind(socket);
 
-  auto& listener = listeners_.emplace(socket,
-    std::make_unique<tcp::Listener>(*this, socket, std::move(cb))
-    ).first->second;
+  auto listener = std::make_shared<tcp::Listener>(*this, socket, std::move(cb));
+  listeners_.emplace(socket, listener);
   debug("<TCP::listen> Bound to socket %s \n", socket.to_string().c_str());
   return *listener;
 }
@@ -91,7 +119,7 @@ Listener& TCP::listen(const tcp::port_t port, ConnectCallback cb, const bool ipv
   bind(socket);
 
   auto ptr = std::make_shared<tcp::Listener>(*this, socket, std::move(cb), ipv6_only);
-  auto& listener = listeners_.emplace(socket, ptr).first->second;
+  listeners_.emplace(socket, ptr);
 
   if(not ipv6_only)
   {
@@ -100,19 +128,245 @@ Listener& TCP::listen(const tcp::port_t port, ConnectCallback cb, const bool ipv
     Ensures(listeners_.emplace(ip4_sock, ptr).second && "Could not insert IPv4 listener");
   }
 
-  return *listener;
+  return *ptr;
+}
+
+Listener& TCP::listen_sharded(const tcp::port_t port, ConnectCallback cb, const bool ipv6_only)
+{
+  Expects(owner_ == nullptr && "A shard can't be sharded");
+  auto& listener = listen(port, cb, ipv6_only);
+
+  if (sharded_ports_.empty())
+    setup_steering();
+
+  // the shards share the port bound here
+  const Socket socket{ip6::Addr::addr_any, port};
+  const Socket ip4_sock{ip4::Addr::addr_any, port};
+  for (const int cpu : steering_.cpus)
+  {
+    if (cpu == cpu_id)
+      continue;
+    auto& shard = add_shard(cpu);
+    if (shard.listeners_.find(socket) != nullptr)
+      continue;
+    auto ptr = std::make_shared<tcp::Listener>(shard, socket, cb, ipv6_only);
+    shard.listeners_.emplace(socket, ptr);
+    if (not ipv6_only)
+      shard.listeners_.emplace(ip4_sock, ptr);
+  }
+  sharded_ports_.push_back(port);
+  debug("<TCP::listen_sharded> Port %u sharded over %zu hash buckets\n",
+        port, steering_.cpus.size());
+  return listener;
+}
+
+TCP* TCP::shard(int cpu) noexcept
+{
+  if (cpu == cpu_id)
+    return this;
+  if (cpu < 0 or cpu >= (int) shards_.size())
+    return nullptr;
+  return shards_[cpu].get();
+}
+
+TCP& TCP::add_shard(int cpu)
+{
+  Expects(cpu >= 0 and cpu < (int) shards_.size());
+  auto& shard = shards_[cpu];
+  if (shard != nullptr)
+    return *shard;
+
+  // CPU 0 runs the writeq itself, as it is the one told of free packets
+  shard.reset(new TCP(inet_, cpu != 0, cpu));
+  shard->owner_              = this;
+  shard->network_layer_out4_ = network_layer_out4_;
+  shard->network_layer_out6_ = network_layer_out6_;
+  shard->max_seg_lifetime_   = max_seg_lifetime_;
+  shard->win_size_           = win_size_;
+  shard->wscale_             = wscale_;
+  shard->timestamps_         = timestamps_;
+  shard->sack_               = sack_;
+  shard->rack_               = rack_;
+  shard->gro_                = gro_;
+  shard->pacing_             = pacing_;
+  shard->dack_timeout_       = dack_timeout_;
+  shard->idle_release_       = idle_release_;
+  shard->max_syn_backlog_    = max_syn_backlog_;
+  shard->syn_cookies_enabled_ = syn_cookies_enabled_;
+  shard->fast_open_enabled_  = fast_open_enabled_;
+  shard->fast_open_          = fast_open_; // same cookies on every CPU
+  shard->congestion_control_ = congestion_control_;
+  shard->min_bufsize_        = min_bufsize_;
+  shard->max_bufsize_        = max_bufsize_;
+  shard->max_rcv_window_     = max_rcv_window_;
+  shard->rcv_autotune_       = rcv_autotune_;
+  shard->time_wait_compaction_ = time_wait_compaction_;
+  shard->pooling_            = pooling_;
+  shard->pool_prewarm_       = pool_prewarm_;
+  for(auto prio : {Tx_priority::INTERACTIVE, Tx_priority::NORMAL, Tx_priority::BULK})
+    shard->writeq.set_quantum(prio, writeq.quantum(prio));
+  // filled on its CPU, with everything else about the shard set up
+  if (pool_prewarm_ > 0)
+    run_on(*shard, [tcp = shard.get()] { tcp->pools_.reserve(tcp->pool_prewarm_); });
+  // its connections are only touched from its CPU
+  run_on(*shard, [tcp = shard.get()] {
+    os::mem::add_shrinker("tcp.buffers", os::mem::Shrink_cost::cheap,
+                          {tcp, &TCP::shrink_buffers});
+  });
+  return *shard;
+}
+
+size_t TCP::shrink_buffers(os::mem::Pressure)
+{
+  // only what holds no data, so it is cheap at any level
+  size_t freed = 0;
+  for (auto& it : connections_)
+    freed += it.second->release_buffers();
+  return freed;
+}
+
+namespace {
+// the cycles from here to the end of the scope go to the connection
+struct Cycle_scope
+{
+  Cycle_scope(Connection& conn) noexcept
+  {
+    if (UNLIKELY(CycleProfiler::enabled())) {
+      conn_  = &conn;
+      start_ = os::Arch::cpu_cycles();
+    }
+  }
+  ~Cycle_scope()
+  {
+    if (conn_ != nullptr)
+      conn_->add_cycles(os::Arch::cpu_cycles() - start_);
+  }
+  Connection* conn_ = nullptr;
+  uint64_t start_ = 0;
+};
+}
+
+std::vector<Connection_ptr> TCP::busiest_connections(size_t N) const
+{
+  std::vector<Connection_ptr> res;
+  for (auto& it : connections_)
+    if (it.second->cycles() > 0) res.push_back(it.second);
+
+  auto by_cycles = [] (const Connection_ptr& a, const Connection_ptr& b) {
+    return a->cycles() > b->cycles();
+  };
+  N = std::min(N, res.size());
+  std::partial_sort(res.begin(), res.begin() + N, res.end(), by_cycles);
+  res.resize(N);
+  return res;
+}
+
+void TCP::setup_steering()
+{
+  using RSS = hw::Nic::RSS_config;
+  auto& nic = inet_.nic();
+  const auto rss = nic.rss_config();
+  steering_.cpus.clear();
+
+  if (auto rps = nic.rps_cpus(); not rps.empty())
+  {
+    // steered to the CPUs in software, by the hash of owner_of()
+    steering_.hash_types = RSS::HASH_IPV4 | RSS::HASH_TCP_IPV4
+                         | RSS::HASH_IPV6 | RSS::HASH_TCP_IPV6;
+    steering_.cpus = std::move(rps);
+  }
+  else if (nic.rx_queues() > 1 and not rss.indirection.empty())
+  {
+    // the same hash buckets as the NIC, so a flow is handled where it arrives
+    steering_.hash_types = rss.hash_types;
+    steering_.key = rss.key;
+    for (const auto queue : rss.indirection)
+    {
+      const int cpu = nic.rx_queue_cpu(queue);
+      steering_.cpus.push_back((cpu >= 0) ? cpu : cpu_id);
+    }
+  }
+  else
+  {
+    // everything arrives here, and is spread over the CPUs in software
+    steering_.hash_types = RSS::HASH_IPV4 | RSS::HASH_TCP_IPV4
+                         | RSS::HASH_IPV6 | RSS::HASH_TCP_IPV6;
+    steering_.cpus.push_back(cpu_id);
+    for (const int cpu : SMP::active_cpus())
+      if (cpu != cpu_id)
+        steering_.cpus.push_back(cpu);
+  }
+  if (steering_.key.empty())
+    steering_.key.assign(rss::default_key.begin(), rss::default_key.end());
+
+  shards_.resize(SMP::early_cpu_total());
+}
+
+bool TCP::is_sharded(const tcp::port_t port) const noexcept
+{
+  return std::find(sharded_ports_.begin(), sharded_ports_.end(), port)
+    != sharded_ports_.end();
+}
+
+TCP& TCP::owner_of(const tcp::Packet_view& packet)
+{
+  auto& root = (owner_ != nullptr) ? *owner_ : *this;
+  if (LIKELY(root.sharded_ports_.empty()))
+    return *this;
+  if (not root.is_sharded(packet.dst_port()))
+    return root;
+
+  using RSS = hw::Nic::RSS_config;
+  const auto& st = root.steering_;
+  const bool ipv6  = packet.ipv() == Protocol::IPv6;
+  const bool ports = st.hash_types & (ipv6 ? RSS::HASH_TCP_IPV6 : RSS::HASH_TCP_IPV4);
+  const bool addrs = st.hash_types & (ipv6 ? RSS::HASH_IPV6 : RSS::HASH_IPV4);
+
+  // what the NIC doesn't hash lands in the first bucket
+  size_t bucket = 0;
+  if (ports or addrs)
+    bucket = rss::hash(packet.source(), packet.destination(),
+                       st.key.data(), st.key.size(), ports) % st.cpus.size();
+
+  auto* owner = root.shard(st.cpus[bucket]);
+  return (owner != nullptr) ? *owner : root;
+}
+
+void TCP::handoff(TCP& to, tcp::Packet_view& packet)
+{
+  (*shard_handoffs_)++;
+  const bool ipv6 = packet.ipv() == Protocol::IPv6;
+  auto* pkt = packet.release().release();
+  TCP* tcp = &to;
+  run_on(to, [tcp, pkt, ipv6] {
+    net::Packet_ptr ptr{pkt};
+    if (ipv6)
+      tcp->receive6(std::move(ptr));
+    else
+      tcp->receive4(std::move(ptr));
+  });
+}
+
+void TCP::run_on(const TCP& tcp, delegate<void()> task)
+{
+  if (tcp.cpu_id == 0)
+    SMP::add_bsp_task(task);
+  else {
+    SMP::add_task(task, tcp.cpu_id);
+    SMP::signal(tcp.cpu_id);
+  }
 }
 
 bool TCP::close(const Socket& socket)
 {
   // TODO: if the socket is ipv6 any addr it will also
   // close the ipv4 any addr due to call to Listener::close()
-  auto it = listeners_.find(socket);
-  if(it != listeners_.end())
+  auto* it = listeners_.find(socket);
+  if(it != nullptr)
   {
-    auto listener = std::move(it->second);
+    auto listener = std::move(*it);
     listener->close();
-    Ensures(listeners_.find(socket) == listeners_.end());
+    Ensures(listeners_.find(socket) == nullptr);
     return true;
   }
 
@@ -133,12 +387,12 @@ void TCP::connect(Socket remote, ConnectCallback callback)
     }
   }();
 
-  create_connection(bind(addr), remote, std::move(callback))->open(true);
+  create_connection(bind(addr, remote), remote, std::move(callback))->open(true);
 }
 
 void TCP::connect(Address source, Socket remote, ConnectCallback callback)
 {
-  connect(bind(source), remote, std::move(callback));
+  connect(bind(source, remote), remote, std::move(callback));
 }
 
 void TCP::connect(Socket local, Socket remote, ConnectCallback callback)
@@ -161,14 +415,14 @@ Connection_ptr TCP::connect(Socket remote)
     }
   }();
 
-  auto conn = create_connection(bind(addr), remote);
+  auto conn = create_connection(bind(addr, remote), remote);
   conn->open(true);
   return conn;
 }
 
 Connection_ptr TCP::connect(Address source, Socket remote)
 {
-  auto conn = create_connection(bind(source), remote);
+  auto conn = create_connection(bind(source, remote), remote);
   conn->open(true);
   return conn;
 }
@@ -181,27 +435,145 @@ Connection_ptr TCP::connect(Socket local, Socket remote)
   return conn;
 }
 
+Connection_ptr TCP::connect(Socket remote, buffer_t data)
+{
+  auto addr = [&]()->auto{
+    if(remote.address().is_v6())
+    {
+      auto dest = remote.address().v6();
+      return Addr{inet_.addr6_config().get_src(dest)};
+    }
+    else
+    {
+      return Addr{inet_.ip_addr()};
+    }
+  }();
+
+  auto conn = create_connection(bind(addr, remote), remote);
+  conn->open_fast(std::move(data));
+  return conn;
+}
+
+void TCP::connect(Socket remote, buffer_t data, ConnectCallback callback)
+{
+  connect(remote, std::move(data))->on_connect(std::move(callback));
+}
+
+Connection_ptr TCP::new_connection(Socket local, Socket remote, ConnectCallback cb)
+{
+  if(pooling_)
+    return std::allocate_shared<Connection>(tcp::Slab_allocator<Connection>{&pools_.connections},
+      *this, std::move(local), std::move(remote), std::move(cb));
+  return std::make_shared<Connection>(*this, std::move(local), std::move(remote), std::move(cb));
+}
+
+void TCP::prewarm_connections(size_t n)
+{
+  pool_prewarm_ = n;
+  pools_.reserve(n);
+  for(auto& ptr : shards_)
+  {
+    auto* shard = ptr.get();
+    if(shard == nullptr)
+      continue;
+    shard->pool_prewarm_ = n;
+    run_on(*shard, [shard] { shard->pools_.reserve(shard->pool_prewarm_); });
+  }
+}
+
+void TCP::Pools::reserve(size_t n)
+{
+  connections.reserve(n);
+  read_requests.reserve(n);
+  // only needed on loss, a fraction will do
+  sack_lists.reserve(n / 4);
+  racks.reserve(n);
+}
+
+size_t TCP::rcv_buffer_size(size_t window)
+{
+  if(memory_pressure())
+    return max_bufsize_;
+
+  // the share of the total buffer size a connection gets
+  const size_t limit = std::min(max_rcv_window_, mempool_.resource_capacity());
+  size_t size = max_bufsize_;
+  while(size * Read_request::buffer_limit < window
+    and size * 2 * Read_request::buffer_limit <= limit)
+  {
+    size *= 2;
+  }
+  return size;
+}
+
 void TCP::insert_connection(Connection_ptr conn)
 {
-  connections_.emplace(
-      std::piecewise_construct,
-      std::forward_as_tuple(conn->local(), conn->remote()),
-      std::forward_as_tuple(conn));
+  connections_.emplace({conn->local(), conn->remote()}, conn);
+}
+
+void TCP::reserve_connections(size_t n)
+{
+  connections_.reserve(connections_.size() + n);
+  if(pooling_)
+  {
+    pools_.connections.reserve(n);
+    pools_.read_requests.reserve(n);
+  }
 }
 
-void TCP::receive4(net::Packet_ptr ptr)
+void TCP::receive4(net::Packet_ptr chain)
 {
-  auto ip4 = static_unique_ptr_cast<PacketIP4>(std::move(ptr));
-  Packet4_view pkt{std::move(ip4)};
+  // the NIC steered these here, to the shard of this CPU
+  if (UNLIKELY(SMP::cpu_id() != cpu_id))
+  {
+    if (auto* shard = this->shard(SMP::cpu_id()); shard != nullptr) {
+      shard->receive4(std::move(chain));
+      return;
+    }
+  }
 
-  PRINT("<TCP::receive> Recv TCP4 packet %s => %s\n",
-    pkt.source().to_string().c_str(), pkt.destination().to_string().c_str());
+  // replies to the whole burst go down together
+  Tx_batch batch{*this};
+  rx_burst_ = gro_;
 
-  receive(pkt);
+  while (chain != nullptr)
+  {
+    auto ptr = std::move(chain);
+    chain = ptr->detach_tail();
+
+    auto ip4 = static_unique_ptr_cast<PacketIP4>(std::move(ptr));
+    Packet4_view pkt{std::move(ip4)};
+
+    PRINT("<TCP::receive> Recv TCP4 packet %s => %s\n",
+      pkt.source().to_string().c_str(), pkt.destination().to_string().c_str());
+
+    receive(pkt);
+  }
+
+  // acknowledge the last coalesced segments before the batch goes out
+  gro_flush();
+  rx_burst_ = false;
+}
+
+void TCP::gro_flush()
+{
+  if (gro_conn_ == nullptr)
+    return;
+  auto conn = std::move(gro_conn_);
+  gro_conn_ = nullptr;
+  conn->gro_end();
 }
 
 void TCP::receive6(net::Packet_ptr ptr)
 {
+  if (UNLIKELY(SMP::cpu_id() != cpu_id))
+  {
+    if (auto* shard = this->shard(SMP::cpu_id()); shard != nullptr) {
+      shard->receive6(std::move(ptr));
+      return;
+    }
+  }
+
   auto ip6 = static_unique_ptr_cast<PacketIP6>(std::move(ptr));
   Packet6_view pkt{std::move(ip6)};
 
@@ -250,22 +622,46 @@ void TCP::receive(Packet_view& packet)
   const Connection::Tuple tuple { dest, packet.source() };
 
   // Try to find the receiver
-  auto conn_it = connections_.find(tuple);
+  auto* conn_it = connections_.find(tuple);
 
   // Connection found
-  if (conn_it != connections_.end()) {
-    PRINT("<TCP::receive> Connection found: %s \n", conn_it->second->to_string().c_str());
-    conn_it->second->segment_arrived(packet);
+  if (conn_it != nullptr) {
+    PRINT("<TCP::receive> Connection found: %s \n", (*conn_it)->to_string().c_str());
+    // the next in-order segment of the burst being coalesced
+    if (gro_conn_ == *conn_it and gro_conn_->gro_merge(packet)) {
+      (*gro_merged_)++;
+      return;
+    }
+    // held, as the table may change under the flush and the segment
+    const auto conn = *conn_it;
+    gro_flush();
+    if (rx_burst_ and conn->gro_begin(packet))
+      gro_conn_ = conn;
+    Cycle_scope scope{*conn};
+    conn->segment_arrived(packet);
+    return;
+  }
+
+  // TIME-WAIT, only a tombstone is left of the connection
+  if (not time_wait_.empty())
+  {
+    if (auto* tw = time_wait_.find(tuple); tw != nullptr
+        and time_wait_arrived(tuple, *tw, packet))
+      return;
+  }
+
+  // New flows of sharded ports belong to the CPU they hash to
+  if (auto& owner = owner_of(packet); UNLIKELY(&owner != this)) {
+    handoff(owner, packet);
     return;
   }
 
   // No open connection found, find listener for destination
   debug("<TCP::receive> No connection found - looking for listener..\n");
-  auto listener_it = find_listener(dest);
+  auto* listener = find_listener(dest);
 
   // Listener found => Create Listener
-  if (listener_it != listeners_.end()) {
-    auto& listener = listener_it->second;
+  if (listener != nullptr) {
     PRINT("<TCP::receive> Listener found: %s\n", listener->to_string().c_str());
     listener->segment_arrived(packet);
     PRINT("<TCP::receive> Listener done with packet\n");
@@ -378,8 +774,12 @@ void TCP::reset_pmtu(Socket dest, IP4::PMTU pmtu) {
 
 void TCP::transmit(tcp::Packet_view_ptr packet)
 {
-  // Generate checksum.
-  packet->set_tcp_checksum();
+  // Generate checksum, or leave the payload part of it to the NIC
+  if (packet->ipv() == Protocol::IPv4
+      and inet_.nic().has_offload(hw::Nic::TX_CSUM_IP4))
+    packet->set_tcp_checksum_offload();
+  else
+    packet->set_tcp_checksum();
 
   // Stat increment bytes transmitted and packets transmitted
   (*bytes_tx_) += packet->tcp_data_length();
@@ -388,11 +788,21 @@ void TCP::transmit(tcp::Packet_view_ptr packet)
   if(packet->ipv() == Protocol::IPv6) {
     network_layer_out6_(packet->release());
   }
+  else if (tx_batching_) {
+    tx_batch4_.push_back(packet->release());
+  }
   else {
     network_layer_out4_(packet->release());
   }
 }
 
+void TCP::flush_tx_batch()
+{
+  tx_batching_ = false;
+  if (not tx_batch4_.empty())
+    network_layer_out4_(tx_batch4_.release());
+}
+
 tcp::Packet_view_ptr TCP::create_outgoing_packet()
 {
   auto packet = std::make_unique<tcp::Packet4_view>(inet_.create_ip_packet(Protocol::TCP));
@@ -407,6 +817,22 @@ tcp::Packet_view_ptr TCP::create_outgoing_packet6()
   return packet;
 }
 
+tcp::Packet_view_ptr TCP::create_outgoing_tso_packet()
+{
+  auto ip_packet = inet_.create_ip_tso_packet(Protocol::TCP);
+  if (ip_packet == nullptr)
+    return create_outgoing_packet();
+  auto packet = std::make_unique<tcp::Packet4_view>(std::move(ip_packet));
+  packet->init();
+  return packet;
+}
+
+bool TCP::tso_available() const noexcept
+{
+  // the NIC finishes the checksum of every segment it cuts
+  return inet_.nic().has_offload(hw::Nic::TSO_IP4 | hw::Nic::TX_CSUM_IP4);
+}
+
 void TCP::send_reset(const tcp::Packet_view& in)
 {
   // TODO: maybe worth to just swap the fields in
@@ -422,9 +848,79 @@ void TCP::send_reset(const tcp::Packet_view& in)
   transmit(std::move(out));
 }
 
+static inline uint64_t now_ms() noexcept
+{ return RTC::nanos_now() / 1'000'000; }
+
+void TCP::time_wait(const Connection& conn)
+{
+  using namespace std::chrono;
+  const auto& cb = conn.cb;
+  const uint64_t twomsl = duration_cast<milliseconds>(2 * MSL()).count();
+  time_wait_.insert(conn.tuple(), {
+    cb.SND.NXT, cb.RCV.NXT, cb.get_ts_recent(),
+    (uint16_t) std::min(cb.RCV.WND >> cb.RCV.wind_shift, (uint32_t) default_window_size),
+    cb.SND.TS_OK, now_ms() + twomsl
+  });
+  time_wait_timer_.start(milliseconds{twomsl});
+}
+
+bool TCP::time_wait_arrived(const tcp::Time_wait::Tuple& tuple,
+                            tcp::Time_wait::Entry& tw, tcp::Packet_view& in)
+{
+  // as with the connection, a reset ends it
+  if (in.isset(RST))
+  {
+    if (time_wait_.erase(tuple) and owner_ == nullptr)
+      unbind(tuple.first, tuple.second);
+    return true;
+  }
+
+  // a new SYN above what was received may start a new incarnation [RFC 1122 4.2.2.13]
+  if (in.isset(SYN) and not in.isset(ACK)
+      and static_cast<int32_t>(in.seq() - tw.rcv_nxt) > 0)
+  {
+    time_wait_.erase(tuple);
+    if (owner_ == nullptr)
+      unbind(tuple.first, tuple.second);
+    return false;
+  }
+
+  // a retransmitted FIN, our ACK of it was lost
+  if (in.isset(FIN))
+  {
+    using namespace std::chrono;
+    time_wait_.restart(tuple, now_ms() + duration_cast<milliseconds>(2 * MSL()).count());
+  }
+
+  // anything but a lone ACK of what we sent is old, and ACKed again
+  if (in.tcp_data_length() > 0 or in.isset(SYN) or in.isset(FIN) or in.seq() != tw.rcv_nxt)
+  {
+    auto out = (in.ipv() == Protocol::IPv6)
+      ? create_outgoing_packet6() : create_outgoing_packet();
+    out->set_seq(tw.snd_nxt).set_ack(tw.rcv_nxt).set_flag(ACK);
+    out->set_win(tw.window);
+    if (tw.ts_ok)
+      out->add_tcp_option_aligned<Option::opt_ts_align>(get_ts_value(), tw.ts_recent);
+    out->set_source(in.destination());
+    out->set_destination(in.source());
+    transmit(std::move(out));
+  }
+  return true;
+}
+
+void TCP::time_wait_timeout()
+{
+  const auto now = now_ms();
+  time_wait_.expire(now, [this] (const tcp::Time_wait::Tuple& tuple) {
+    if (owner_ == nullptr)
+      unbind(tuple.first, tuple.second);
+  });
+  if (not time_wait_.empty())
+    time_wait_timer_.start(std::chrono::milliseconds{time_wait_.next_expiry() - now});
+}
+
 seq_t TCP::generate_iss() {
-  // Do something to get a iss.
-  return rand();
+  return rng_fast_uint32();
 }
 
 uint32_t TCP::get_ts_value() const
@@ -474,6 +970,27 @@ Socket TCP::bind(const Address& addr)
   return {addr, port};
 }
 
+Socket TCP::bind(const Address& addr, const Socket& remote)
+{
+  if(UNLIKELY( is_valid_source(addr) == false ))
+    throw TCP_error{"Cannot bind to address: " + addr.to_string()};
+
+  auto& port_util = ports_[addr];
+  const auto port = port_util.get_next_ephemeral(remote);
+  port_util.bind(port, remote);
+  return {addr, port};
+}
+
+bool TCP::unbind(const Socket& local, const Socket& remote)
+{
+  auto it = ports_.find(local.address());
+
+  if(it != ports_.end() and it->second.unbind(local.port(), remote))
+    return true;
+
+  return unbind(local);
+}
+
 bool TCP::unbind(const Socket& socket)
 {
   auto it = ports_.find(socket.address());
@@ -530,11 +1047,8 @@ Connection_ptr TCP::create_connection(Socket local, Socket remote, ConnectCallba
   // Stat increment number of outgoing connections
   (*outgoing_connections_)++;
 
-  auto& conn = (connections_.emplace(
-      Connection::Tuple{ local, remote },
-      std::make_shared<Connection>(*this, local, remote, std::move(cb))
-      )
-    ).first->second;
+  auto conn = new_connection(local, remote, std::move(cb));
+  connections_.emplace({local, remote}, conn);
   conn->_on_cleanup({this, &TCP::close_connection});
   conn->bufalloc = std::move(resource);
 
@@ -546,19 +1060,31 @@ Connection_ptr TCP::create_connection(Socket local, Socket remote, ConnectCallba
 
 void TCP::process_writeq(size_t packets) {
   debug2("<TCP::process_writeq> size=%u p=%u\n", writeq.size(), packets);
-  // foreach connection who wants to write
-  while(packets and !writeq.empty()) {
-    debug("<TCP::process_writeq> Processing writeq size=%u, p=%u\n", writeq.size(), packets);
-    auto conn = writeq.front();
-    // remove from writeq
-    writeq.pop_front();
+  Tx_batch batch{*this};
+  // shared by the connections who want to write, by priority
+  writeq.serve(packets, [](Connection_ptr& conn, size_t& budget)
+  {
+    debug("<TCP::process_writeq> Offering %s %u packets\n", conn->to_string().c_str(), budget);
+    // still queued, so it doesn't requeue itself at the back
+    {
+      Cycle_scope scope{*conn};
+      conn->offer(budget);
+    }
+    if(conn->can_send())
+      return true;
     conn->set_queued(false);
-    // packets taken in as reference
-    conn->offer(packets);
-  }
+    return false;
+  });
 }
 
 void TCP::request_offer(Connection& conn) {
+  // wait behind the connections of the same priority or above
+  if(writeq.waiting(conn.tx_priority()))
+  {
+    queue_offer(conn);
+    return;
+  }
+
   SMP::global_lock();
   auto packets = inet_.transmit_queue_available();
   SMP::global_unlock();
@@ -568,6 +1094,7 @@ void TCP::request_offer(Connection& conn) {
 
   // Note: Must be called even if packets is 0
   // because the connectoin is responsible for requeuing itself (see Connection::offer)
+  Tx_batch batch{*this};
   conn.offer(packets);
 }
 
@@ -578,7 +1105,7 @@ void TCP::queue_offer(Connection& conn)
   {
     try {
       debug("<TCP::queue_offer> %s queued\n", conn.to_string().c_str());
-      writeq.push_back(conn.retrieve_shared());
+      writeq.push(conn.retrieve_shared(), conn.tx_priority());
       conn.set_queued(true);
     }
     catch (std::exception& e) {
@@ -611,42 +1138,50 @@ void TCP::kick()
 void TCP::close_listener(tcp::Listener& listener)
 {
   const auto& socket = listener.local();
-  unbind(socket);
+  // the ports of shards are bound by their owner
+  if (owner_ == nullptr)
+    unbind(socket);
   listeners_.erase(socket);
 
+  // close the listeners of the shards, each on its own CPU
+  if (owner_ == nullptr and is_sharded(socket.port()))
+  {
+    const auto port = socket.port();
+    sharded_ports_.erase(std::find(sharded_ports_.begin(), sharded_ports_.end(), port));
+    for (auto& ptr : shards_)
+    {
+      if (ptr == nullptr)
+        continue;
+      TCP* shard = ptr.get();
+      run_on(*shard, [shard, port] {
+        shard->close({ip6::Addr::addr_any, port});
+      });
+    }
+  }
+
   // if the listener is "dual-stack", make sure to clean up the
   // ip4 any addr copy as well
   if(socket.address().is_v6() and socket.address().is_any())
   {
     Socket ip4_sock{ip4::Addr::addr_any, socket.port()};
-    unbind(ip4_sock);
+    if (owner_ == nullptr)
+      unbind(ip4_sock);
     listeners_.erase(ip4_sock);
   }
 }
 
-TCP::Listeners::iterator TCP::find_listener(const Socket& socket)
+tcp::Listener* TCP::find_listener(const Socket& socket)
 {
-  Listeners::iterator it = listeners_.find(socket);
-  if(it != listeners_.end())
-    return it;
+  auto* it = listeners_.find(socket);
 
-  if(not socket.address().is_any())
+  if(it == nullptr and not socket.address().is_any())
     it = listeners_.find({socket.address().any_addr(), socket.port()});
 
-  return it;
+  return (it != nullptr) ? it->get() : nullptr;
 }
 
-TCP::Listeners::const_iterator TCP::cfind_listener(const Socket& socket) const
-{
-  Listeners::const_iterator it = listeners_.find(socket);
-  if(it != listeners_.cend())
-    return it;
-
-  if(not socket.address().is_any())
-    it = listeners_.find({socket.address().any_addr(), socket.port()});
-
-  return it;
-}
+const tcp::Listener* TCP::cfind_listener(const Socket& socket) const
+{ return const_cast<TCP*>(this)->find_listener(socket); }
 
 
 
@@ -15,9 +15,9 @@ namespace net::tcp {
   [[maybe_unused]]
   static inline std::string state_str(const uint8_t state);
 
-  static inline void update_timeout(Conntrack::Entry* entry);
-  static inline void set_state(Conntrack::Entry* entry, const Ct_state state);
-  static inline void close(Conntrack::Entry* entry);
+  static inline void update_timeout(Conntrack& ct, Conntrack::Entry* entry);
+  static inline void set_state(Conntrack& ct, Conntrack::Entry* entry, const Ct_state state);
+  static inline void close(Conntrack& ct, Conntrack::Entry* entry);
 
   Conntrack::Entry* tcp4_conntrack(Conntrack& ct, Quadruple q, const PacketIP4& pkt)
   {
@@ -38,7 +38,7 @@ namespace net::tcp {
         // this was a SYN, set internal state SYN_SENT & UNREPLIED
         entry = ct.add_entry(q, proto);
         entry->set_flag(Conntrack::Flag::UNREPLIED);
-        set_state(entry, Ct_state::SYN_SENT);
+        set_state(ct, entry, Ct_state::SYN_SENT);
 
         CTDBG("<CT_TCP4> Entry created: %s State: %s\n",
           entry->to_string().c_str(), state_str(entry->other).c_str());
@@ -53,7 +53,7 @@ namespace net::tcp {
     // On reset we just have to terminate
     if(UNLIKELY(tcp.isset(RST)))
     {
-      close(entry);
+      close(ct, entry);
       return entry;
     }
 
@@ -67,7 +67,7 @@ namespace net::tcp {
         entry->state = State::ESTABLISHED;
 
         // set internal state SYN_RECV & !UNREPLIED
-        set_state(entry, Ct_state::SYN_RECV);
+        set_state(ct, entry, Ct_state::SYN_RECV);
       }
 
       return entry;
@@ -80,7 +80,7 @@ namespace net::tcp {
       {
         // set internal state ESTABLISHED & ASSURED
         entry->set_flag(Conntrack::Flag::ASSURED);
-        set_state(entry, Ct_state::ESTABLISHED);
+        set_state(ct, entry, Ct_state::ESTABLISHED);
       }
 
       return entry;
@@ -92,13 +92,13 @@ namespace net::tcp {
       switch(state(entry))
       {
         case Ct_state::ESTABLISHED:
-          set_state(entry, (q == entry->first) ? Ct_state::FIN_WAIT : Ct_state::CLOSE_WAIT);
+          set_state(ct, entry, (q == entry->first) ? Ct_state::FIN_WAIT : Ct_state::CLOSE_WAIT);
           break;
         case Ct_state::FIN_WAIT:
-          set_state(entry, Ct_state::TIME_WAIT);
+          set_state(ct, entry, Ct_state::TIME_WAIT);
           break;
         case Ct_state::CLOSE_WAIT:
-          set_state(entry, Ct_state::LAST_ACK);
+          set_state(ct, entry, Ct_state::LAST_ACK);
           break;
         default:
           CTDBG("FIN in state: %s\n", state_str(entry->other).c_str());
@@ -113,12 +113,12 @@ namespace net::tcp {
       // For that we need to know about the TCP state... (sequence number SND.NXT etc..)
       if(tcp.isset(ACK))
       {
-        close(entry);
+        close(ct, entry);
         return entry;
       }
     }
 
-    update_timeout(entry);
+    update_timeout(ct, entry);
 
     CTDBG("<CT_TCP4> Entry handled: %s State: %s\n",
       entry->to_string().c_str(), state_str(entry->other).c_str());
@@ -131,21 +131,21 @@ namespace net::tcp {
     return static_cast<Ct_state>(entry->other);
   }
 
-  static inline void set_state(Conntrack::Entry* entry, const Ct_state state)
+  static inline void set_state(Conntrack& ct, Conntrack::Entry* entry, const Ct_state state)
   {
     CTDBG("<CT_TCP4> State change %s => %s on %s\n",
       state_str(entry->other).c_str(), state_str((uint8_t)state).c_str(), entry->to_string().c_str());
     reinterpret_cast<Ct_state&>(entry->other) = state;
-    update_timeout(entry);
+    update_timeout(ct, entry);
   }
 
-  static inline void close(Conntrack::Entry* entry)
+  static inline void close(Conntrack& ct, Conntrack::Entry* entry)
   {
     CTDBG("<CT_TCP4> Closing from state %s\n", state_str(entry->other).c_str());
-    set_state(entry, Ct_state::CLOSE);
+    set_state(ct, entry, Ct_state::CLOSE);
   }
 
-  static inline void update_timeout(Conntrack::Entry* entry)
+  static inline void update_timeout(Conntrack& ct, Conntrack::Entry* entry)
   {
     const auto& dur = [&]()->const auto&
     {
@@ -164,7 +164,7 @@ namespace net::tcp {
       }
     }();
 
-    entry->timeout = RTC::now() + dur.count();
+    ct.set_timeout(*entry, dur);
   }
 
   static inline std::string state_str(const uint8_t state)
@@ -0,0 +1,48 @@
+#include <net/tcp/time_wait.hpp>
+
+using namespace net::tcp;
+
+void Time_wait::insert(const Tuple& tuple, const Entry& entry)
+{
+  entries_.insert_or_assign(tuple, entry);
+  order_.emplace_back(entry.expires, tuple);
+}
+
+void Time_wait::restart(const Tuple& tuple, uint64_t expires)
+{
+  auto* entry = find(tuple);
+  if (entry == nullptr)
+    return;
+  // the record already queued is left to go stale
+  entry->expires = expires;
+  order_.emplace_back(expires, tuple);
+}
+
+size_t Time_wait::expire(uint64_t now, Expired on_expired)
+{
+  size_t removed = 0;
+  while (not order_.empty() and order_.front().first <= now)
+  {
+    const auto [when, tuple] = order_.front();
+    order_.pop_front();
+
+    auto it = entries_.find(tuple);
+    // removed, or restarted with a later record queued
+    if (it == entries_.end() or it->second.expires != when)
+      continue;
+
+    entries_.erase(it);
+    removed++;
+    if (on_expired)
+      on_expired(tuple);
+  }
+  // drop stale records at the front, so next_expiry() is one that counts
+  while (not order_.empty())
+  {
+    auto it = entries_.find(order_.front().second);
+    if (it != entries_.end() and it->second.expires == order_.front().first)
+      break;
+    order_.pop_front();
+  }
+  return removed;
+}
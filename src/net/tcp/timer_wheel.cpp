@@ -0,0 +1,180 @@
+#include <net/tcp/timer_wheel.hpp>
+#include <rtc>
+#include <algorithm>
+
+using namespace net::tcp;
+
+static inline uint64_t rotr(uint64_t x, int n) noexcept
+{
+  n &= 63;
+  return (n == 0) ? x : (x >> n) | (x << (64 - n));
+}
+
+Timer_wheel::Timer_wheel(clock_t clock)
+  : clock_{clock ? clock : clock_t{[] () -> uint64_t { return RTC::nanos_now(); }}},
+    kernel_timer_{{this, &Timer_wheel::on_kernel_timeout}}
+{
+  for (auto& level : slots_)
+    level.fill(nullptr);
+  now_ = clock_() / TICK_NS;
+  // the wheel turns in whole ticks anyway
+  kernel_timer_.set_slack(std::chrono::nanoseconds(TICK_NS));
+}
+
+Timer_wheel::~Timer_wheel()
+{
+  // leave the timers that outlive the wheel stopped
+  for (auto& level : slots_)
+    for (auto* head : level)
+      for (auto* t = head; t != nullptr;)
+      {
+        auto* next = t->next_;
+        t->next_  = nullptr;
+        t->pprev_ = nullptr;
+        t = next;
+      }
+}
+
+void Timer_wheel::arm(Timer& t, duration_t when)
+{
+  unlink(t);
+  // round up, a timer never runs early
+  const uint64_t ns = clock_() + std::max<int64_t>(when.count(), 0);
+  t.expiry_ = std::max<tick_t>((ns + TICK_NS - 1) / TICK_NS, now_ + 1);
+  const tick_t due = link(t);
+
+  if (not advancing_ and (not kernel_timer_.is_running() or due < wakeup_))
+    schedule(due);
+}
+
+Timer_wheel::tick_t Timer_wheel::link(Timer& t) noexcept
+{
+  int    level  = 0;
+  tick_t bucket = 0;
+  for (; level < LEVELS; level++)
+  {
+    const int shift = level * SLOT_BITS;
+    bucket = t.expiry_ >> shift;
+    if (bucket - (now_ >> shift) < SLOTS)
+      break;
+  }
+  // too far ahead, wait in the last slot of the top level
+  if (level == LEVELS)
+  {
+    level  = LEVELS - 1;
+    bucket = (now_ >> (level * SLOT_BITS)) + SLOTS - 1;
+  }
+
+  const int slot = bucket & (SLOTS - 1);
+  auto& head = slots_[level][slot];
+  t.next_  = head;
+  t.pprev_ = &head;
+  if (head != nullptr)
+    head->pprev_ = &t.next_;
+  head = &t;
+  t.level_ = level;
+  t.slot_  = slot;
+  occupied_[level] |= uint64_t(1) << slot;
+  size_++;
+  return bucket << (level * SLOT_BITS);
+}
+
+void Timer_wheel::unlink(Timer& t) noexcept
+{
+  if (t.pprev_ == nullptr)
+    return;
+  *t.pprev_ = t.next_;
+  if (t.next_ != nullptr)
+    t.next_->pprev_ = t.pprev_;
+  // timers taken off their slot are marked with level LEVELS
+  if (t.level_ < LEVELS and slots_[t.level_][t.slot_] == nullptr)
+    occupied_[t.level_] &= ~(uint64_t(1) << t.slot_);
+  t.next_  = nullptr;
+  t.pprev_ = nullptr;
+  size_--;
+}
+
+void Timer_wheel::take(int level, int slot, Timer*& list) noexcept
+{
+  list = slots_[level][slot];
+  slots_[level][slot] = nullptr;
+  occupied_[level] &= ~(uint64_t(1) << slot);
+  if (list != nullptr)
+    list->pprev_ = &list;
+  for (auto* t = list; t != nullptr; t = t->next_)
+    t->level_ = LEVELS;
+}
+
+Timer_wheel::tick_t Timer_wheel::next_event() const noexcept
+{
+  tick_t next = 0;
+  for (int level = 0; level < LEVELS; level++)
+  {
+    if (occupied_[level] == 0)
+      continue;
+    // the slots hold the buckets after the current one, in order
+    const int    shift  = level * SLOT_BITS;
+    const tick_t bucket = now_ >> shift;
+    const auto   ahead  = rotr(occupied_[level], (bucket + 1) & (SLOTS - 1));
+    const tick_t tick   = (bucket + 1 + __builtin_ctzll(ahead)) << shift;
+    if (next == 0 or tick < next)
+      next = tick;
+  }
+  return next;
+}
+
+void Timer_wheel::advance(tick_t target)
+{
+  advancing_ = true;
+  while (now_ < target)
+  {
+    const tick_t next = next_event();
+    if (next == 0 or next > target) {
+      now_ = target;
+      break;
+    }
+    now_ = next;
+
+    // move timers down from the slots that came up, top level first
+    Timer* list;
+    for (int level = LEVELS - 1; level > 0; level--)
+    {
+      const int shift = level * SLOT_BITS;
+      if (now_ & ((tick_t(1) << shift) - 1))
+        continue;
+      take(level, (now_ >> shift) & (SLOTS - 1), list);
+      while (list != nullptr)
+      {
+        auto& t = *list;
+        unlink(t);
+        link(t);
+      }
+    }
+
+    // a handler may stop or restart any timer, including those in the list
+    take(0, now_ & (SLOTS - 1), list);
+    while (list != nullptr)
+    {
+      auto& t = *list;
+      unlink(t);
+      if (t.on_timeout_)
+        t.on_timeout_();
+    }
+  }
+  advancing_ = false;
+}
+
+void Timer_wheel::schedule(tick_t tick)
+{
+  const uint64_t at  = tick * TICK_NS;
+  const uint64_t now = clock_();
+  wakeup_ = tick;
+  kernel_timer_.restart(duration_t((at > now) ? int64_t(at - now) : 0));
+}
+
+void Timer_wheel::on_kernel_timeout()
+{
+  advance(clock_() / TICK_NS);
+  if (const auto next = next_event(); next != 0)
+    schedule(next);
+}
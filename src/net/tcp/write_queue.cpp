@@ -7,29 +7,37 @@ Write_queue::Write_queue(WriteCallback cb)
   : current_(0),
     offset_(0),
     acked_(0),
+    total_(0),
+    sent_(0),
     on_write_(cb)
 {}
 
 void Write_queue::advance(size_t bytes)
 {
-  auto& buf = nxt();
+  sent_ += bytes;
+  assert(sent_ <= total_);
 
-  offset_ += bytes;
-  assert(offset_ <= buf->size());
+  while(bytes)
+  {
+    auto& buf = nxt();
+    const auto n = std::min(bytes, buf.size() - offset_);
+    offset_ += n;
+    bytes   -= n;
 
-  debug2("<WriteQueue> Advance: bytes=%u off=%u rem=%u\n",
-    bytes, offset_, (buf->size() - offset_));
+    debug2("<WriteQueue> Advance: bytes=%u off=%u rem=%u\n",
+      n, offset_, (buf.size() - offset_));
 
-  if(offset_ == buf->size())
-  {
-    current_++;
-    offset_ = 0;
+    if(offset_ == buf.size())
+    {
+      current_++;
+      offset_ = 0;
 
-    if(on_write_)
-      on_write_(buf->size());
+      if(on_write_)
+        on_write_(buf.size());
 
-    debug("<WriteQueue> Advance: Done (%u) current++ [%u] sz=%u\n",
-      buf->size(), current_, q.size());
+      debug("<WriteQueue> Advance: Done (%u) current++ [%u] sz=%u\n",
+        buf.size(), current_, q.size());
+    }
   }
 }
 
@@ -39,9 +47,9 @@ void Write_queue::acknowledge(size_t bytes)
   while(bytes and !q.empty())
   {
     auto& buf = una();
-    assert(buf->size() >= acked_);
+    assert(buf.size() >= acked_);
     // remaining
-    const auto rem = buf->size() - acked_;
+    const auto rem = buf.size() - acked_;
 
     // if everything or more is acked
     if(bytes >= rem)
@@ -50,6 +58,9 @@ void Write_queue::acknowledge(size_t bytes)
       bytes -= rem;
       // reset acked
       acked_ = 0;
+      // the buffer leaves the counters with it
+      total_ -= buf.size();
+      sent_  -= buf.size();
       // pop and subtract index
       q.pop_front();
       current_--;
@@ -63,6 +74,13 @@ void Write_queue::acknowledge(size_t bytes)
       bytes = 0;
     }
   }
+
+  if(full_ and total_ <= low_)
+  {
+    full_ = false;
+    if(on_drain_)
+      on_drain_();
+  }
 }
 
 void Write_queue::reset()
@@ -72,33 +90,14 @@ void Write_queue::reset()
 
   q.clear();
   current_ = 0;
+  offset_  = 0;
+  acked_   = 0;
+  total_   = 0;
+  sent_    = 0;
+  full_    = false;
   debug("<WriteQueue::reset> Reset\n");
 }
 
-uint32_t Write_queue::bytes_remaining() const
-{
-  if(current_ >= q.size()) return 0;
-
-  uint32_t n = nxt()->size() - offset_;
-
-  for(auto i = current_ + 1; i < q.size(); ++i)
-    n += q.at(i)->size();
-
-  return n;
-}
-
-uint32_t Write_queue::bytes_unacknowledged() const
-{
-  if(q.empty()) return 0;
-
-  uint32_t n = una()->size() - acked_;
-
-  for(uint32_t i = 1; i < q.size(); ++i)
-    n += q.at(i)->size();
-
-  return n;
-}
-
 __attribute__((weak))
 int Write_queue::deserialize_from(void*) { return 0; }
 __attribute__((weak))
@@ -13,6 +13,27 @@ namespace net::udp
 
   void Socket::internal_read(const Packet_view& udp)
   {
+    if (on_read_packet_handler) {
+      on_read_packet_handler(udp);
+      return;
+    }
+    if (UNLIKELY(udp.packet_ptr()->next_segment() != nullptr)) {
+      const size_t len = udp.udp_payload_length();
+      auto buffer = std::make_unique<char[]>(len);
+      udp.copy_payload(buffer.get(), len);
+      if (on_read_batch_handler) {
+        const Datagram msg{udp.source(), buffer.get(), len};
+        on_read_batch_handler(&msg, 1);
+        return;
+      }
+      on_read_handler(udp.ip_src(), udp.src_port(), buffer.get(), len);
+      return;
+    }
+    if (on_read_batch_handler) {
+      const Datagram msg{udp.source(), udp.udp_data(), udp.udp_data_length()};
+      on_read_batch_handler(&msg, 1);
+      return;
+    }
     on_read_handler(udp.ip_src(), udp.src_port(),
                    (const char*) udp.udp_data(), udp.udp_data_length());
   }
@@ -35,6 +56,42 @@ namespace net::udp
     udp_.flush();
   }
 
+  void Socket::send_segmented(
+     addr_t destIP,
+     port_t port,
+     const void* buffer,
+     size_t length,
+     uint16_t segment_size,
+     sendto_handler cb,
+     error_handler ecb)
+  {
+    if (UNLIKELY(length == 0)) return;
+    udp_.sendq.emplace_back(this->udp_,
+      socket_, net::Socket{destIP, port},
+      (const uint8_t*) buffer, length,
+      cb, ecb, segment_size);
+
+    udp_.flush();
+  }
+
+  void Socket::send_batch(const Datagram* msgs, size_t count, sendto_handler cb)
+  {
+    udp_.send_batch(socket_, msgs, count, cb);
+  }
+
+  Packet_view_ptr Socket::create_packet(addr_t destIP, port_t port)
+  {
+    return udp_.create_packet(socket_, net::Socket{destIP, port});
+  }
+
+  void Socket::send(Packet_view_ptr packet)
+  {
+    Expects((packet->source() == socket_
+             or (socket_.address().is_any() and packet->src_port() == socket_.port()))
+            && "Packet not made by this socket");
+    udp_.send_packet(std::move(packet));
+  }
+
   void Socket::bcast(
     addr_t srcIP,
     port_t port,
@@ -24,16 +24,74 @@ namespace net {
     inet.on_transmit_queue_available({this, &UDP::process_sendq});
   }
 
-  void UDP::receive4(net::Packet_ptr ptr)
+  void UDP::receive4(net::Packet_ptr chain)
   {
-    auto ip4 = static_unique_ptr_cast<PacketIP4>(std::move(ptr));
-    auto pkt = std::make_unique<udp::Packet4_view>(std::move(ip4));
+    while (chain != nullptr)
+    {
+      auto ptr = std::move(chain);
+      chain = ptr->detach_tail();
 
-    const auto dst_ip = pkt->ip4_dst();
-    const bool is_bcast = (dst_ip == IP4::ADDR_BCAST
-      or dst_ip == stack_.broadcast_addr());
+      auto ip4 = static_unique_ptr_cast<PacketIP4>(std::move(ptr));
+      auto pkt = std::make_unique<udp::Packet4_view>(std::move(ip4));
 
-    receive(std::move(pkt), is_bcast);
+      const auto dst_ip = pkt->ip4_dst();
+      const bool is_bcast = (dst_ip == IP4::ADDR_BCAST
+        or dst_ip == stack_.broadcast_addr());
+
+      // datagrams to a batch reader are held until the run ends
+      if (not is_bcast and pkt->validate_length()
+          and pkt->packet_ptr()->next_segment() == nullptr
+          and batch_reader(pkt->destination()) != nullptr)
+      {
+        rx_batch_.push_back(std::move(pkt));
+        continue;
+      }
+      deliver_batch();
+      receive(std::move(pkt), is_bcast);
+    }
+    deliver_batch();
+  }
+
+  udp::Socket* UDP::batch_reader(const net::Socket& dest)
+  {
+    auto it = find(dest);
+    if (it == sockets_.end() or not it->second.on_read_batch_handler)
+      return nullptr;
+
+    if (rx_batch_socket_ != nullptr and rx_batch_socket_ != &it->second)
+    {
+      // the reader of the run before may close this one
+      deliver_batch();
+      it = find(dest);
+      if (it == sockets_.end() or not it->second.on_read_batch_handler)
+        return nullptr;
+    }
+    rx_batch_socket_ = &it->second;
+    return rx_batch_socket_;
+  }
+
+  void UDP::deliver_batch()
+  {
+    if (rx_batch_.empty())
+      return;
+
+    // taken out, as the reader may send and receive
+    auto* sock = rx_batch_socket_;
+    rx_batch_socket_ = nullptr;
+    std::vector<udp::Packet_view_ptr> batch;
+    std::vector<udp::Datagram> msgs;
+    batch.swap(rx_batch_);
+    msgs.swap(rx_msgs_);
+
+    for (const auto& pkt : batch)
+      msgs.push_back({pkt->source(), pkt->udp_data(), pkt->udp_data_length()});
+    sock->on_read_batch_handler(msgs.data(), msgs.size());
+
+    // keep the storage for the next batch
+    batch.clear();
+    msgs.clear();
+    if (rx_batch_.empty()) rx_batch_.swap(batch);
+    if (rx_msgs_.empty())  rx_msgs_.swap(msgs);
   }
 
   void UDP::receive6(net::Packet_ptr ptr)
@@ -140,14 +198,14 @@ namespace net {
     if(UNLIKELY( port == 0))
       return bind(addr);
 
-    if(UNLIKELY( not stack_.is_valid_source(addr) ))
+    if(UNLIKELY( not is_valid_source(addr) ))
       throw UDP_error{"Cannot bind to address: " + addr.to_string()};
 
-    auto& port_util = ports_[addr];
-
-    if(UNLIKELY( port_util.is_bound(port) ))
+    if(UNLIKELY( is_bound(socket) ))
       throw Port_in_use_exception{port};
 
+    auto& port_util = ports_[addr];
+
     debug("<%s> UDP bind to %s\n", stack_.ifname().c_str(), socket.to_string().c_str());
 
     auto it = sockets_.emplace(
@@ -164,11 +222,14 @@ namespace net {
 
   udp::Socket& UDP::bind(const addr_t& addr)
   {
-    if(UNLIKELY( not stack_.is_valid_source(addr) ))
+    if(UNLIKELY( not is_valid_source(addr) ))
       throw UDP_error{"Cannot bind to address: " + addr.to_string()};
 
     auto& port_util = ports_[addr];
-    const auto port = port_util.get_next_ephemeral();
+    auto port = port_util.get_next_ephemeral();
+    // skip the ones taken on any address
+    while (UNLIKELY( is_bound({addr, port}) ))
+      port = port_util.get_next_ephemeral();
 
     Socket socket{addr, port};
     debug("UDP bind to %s\n", socket.to_string().c_str());
@@ -188,9 +249,21 @@ namespace net {
 
   bool UDP::is_bound(const net::Socket& socket) const
   {
-    return sockets_.find(socket) != sockets_.end();
+    auto it = ports_.find(socket.address());
+    if(it != ports_.cend() and it->second.is_bound(socket.port()))
+      return true;
+
+    // a port bound on any address is taken on all of them
+    if(socket.address().is_any())
+      return false;
+
+    it = ports_.find(socket.address().any_addr());
+    return it != ports_.cend() and it->second.is_bound(socket.port());
   }
 
+  bool UDP::is_valid_source(const addr_t& addr) const noexcept
+  { return addr.is_any() or stack_.is_valid_source(addr); }
+
   bool UDP::is_bound(const port_t port) const
   { return is_bound({stack_.ip_addr(), port}); }
 
@@ -200,7 +273,12 @@ namespace net {
   void UDP::close(const net::Socket& socket)
   {
     PRINT("Closed socket %s\n", socket.to_string().c_str());
-    sockets_.erase(socket);
+    if (sockets_.erase(socket) == 0)
+      return;
+
+    auto it = ports_.find(socket.address());
+    if (it != ports_.end())
+      it->second.unbind(socket.port());
   }
 
   void UDP::transmit(udp::Packet_view_ptr udp)
@@ -254,9 +332,11 @@ namespace net {
       if (UNLIKELY(buffer.remaining() == 0))
         return;
 
-      // create and transmit packet from writebuffer
-      buffer.write();
-      num--;
+      // create and transmit packets from writebuffer
+      const size_t written = buffer.write(num);
+      if (UNLIKELY(written == 0))
+        return;
+      num -= written;
 
       if (buffer.done()) {
         if (buffer.send_callback != nullptr)
@@ -282,22 +362,89 @@ namespace net {
     }
   }
 
+  void UDP::send_batch(const net::Socket& src, const udp::Datagram* msgs,
+                       size_t count, sendto_handler cb)
+  {
+    size_t i = 0;
+    // with nothing queued ahead, what fits goes down the stack as one chain
+    if (sendq.empty())
+    {
+      udp::Packet_view_ptr chain = nullptr;
+      size_t avail = stack_.transmit_queue_available();
+      for (; i < count and avail > 0; i++)
+      {
+        const auto& msg = msgs[i];
+        if (UNLIKELY(msg.length == 0)) continue;
+        // larger ones are split up by the send queue
+        if (msg.length > max_datagram_size()) break;
+
+        auto pkt = create_packet(src, msg.peer);
+        if (UNLIKELY(pkt == nullptr)) break;
+        fill(*pkt, (const uint8_t*) msg.data, msg.length);
+        avail--;
+
+        // IPv6 takes one packet at a time
+        if (pkt->ipv() == Protocol::IPv6)
+          transmit(std::move(pkt));
+        else if (chain == nullptr)
+          chain = std::move(pkt);
+        else
+          chain->packet_ptr()->chain(pkt->release());
+      }
+      if (chain != nullptr)
+        transmit(std::move(chain));
+    }
+
+    // the rest waits its turn, as if sent one by one
+    WriteBuffer* last = nullptr;
+    for (; i < count; i++)
+    {
+      const auto& msg = msgs[i];
+      if (UNLIKELY(msg.length == 0)) continue;
+      last = &sendq.emplace_back(*this, src, msg.peer,
+        (const uint8_t*) msg.data, msg.length, nullptr, nullptr);
+    }
+
+    if (last == nullptr) {
+      if (cb) cb();
+      return;
+    }
+    last->send_callback = cb;
+    flush();
+  }
+
+  void UDP::send_packet(udp::Packet_view_ptr packet)
+  {
+    // IPv6 sums it in transmit(), as it must
+    if (packet->ipv() == Protocol::IPv4
+        and stack_.nic().has_offload(hw::Nic::TX_CSUM_IP4))
+      packet->set_udp_checksum_offload();
+    transmit(std::move(packet));
+  }
+
   size_t UDP::WriteBuffer::packets_needed() const
   {
     int r = remaining();
     // whole packets
-    size_t P = r / udp.max_datagram_size();
+    size_t P = r / segment_size();
     // one packet for remainder
-    if (r % udp.max_datagram_size()) P++;
+    if (r % segment_size()) P++;
     return P;
   }
 
+  uint16_t UDP::WriteBuffer::segment_size() const
+  {
+    const auto max = udp.max_datagram_size();
+    return (seg_size != 0 and seg_size < max) ? seg_size : max;
+  }
+
   UDP::WriteBuffer::WriteBuffer(UDP& stack, net::Socket source, net::Socket dest,
                                 const uint8_t* data, size_t length,
-                                sendto_handler cb, error_handler ecb)
+                                sendto_handler cb, error_handler ecb,
+                                uint16_t segment_size)
     : udp(stack),
       src{std::move(source)}, dst{std::move(dest)},
-      len(length), offset(0),
+      len(length), offset(0), seg_size(segment_size),
       send_callback(cb), error_callback(ecb)
   {
     // create a copy of the data,
@@ -308,37 +455,44 @@ namespace net {
       std::shared_ptr<uint8_t> (copy, std::default_delete<uint8_t[]>());
   }
 
-  void UDP::WriteBuffer::write()
+  size_t UDP::WriteBuffer::write(size_t max)
   {
     udp::Packet_view_ptr chain_head = nullptr;
 
-    PRINT("<%s> UDP: %i bytes to write, need %i packets \n",
-          udp.stack().ifname().c_str(),
-          remaining(),
-          remaining() / udp.max_datagram_size() + (remaining() % udp.max_datagram_size() ? 1 : 0));
+    PRINT("<%s> UDP: %i bytes to write, need %zu packets \n",
+          udp.stack().ifname().c_str(), remaining(), packets_needed());
 
     // Only call write() (above) when there's something remaining
     Expects(remaining());
 
-    while (remaining()) {
+    const size_t seg = segment_size();
+    size_t written = 0;
+    while (remaining() and written < max) {
       // the max bytes we can write in one operation
       size_t total = remaining();
-      total = (total > udp.max_datagram_size()) ? udp.max_datagram_size() : total;
+      total = (total > seg) ? seg : total;
 
       // Create IP packet and convert it to PacketUDP)
       auto pkt = udp.create_packet(src, dst);
       if (!pkt) break;
 
-      pkt->fill(buf.get() + this->offset, total);
+      udp.fill(*pkt, buf.get() + this->offset, total);
+      written++;
+
+      // next position in buffer
+      this->offset += total;
+
+      // IPv6 takes one packet at a time
+      if (pkt->ipv() == Protocol::IPv6) {
+        udp.transmit(std::move(pkt));
+        continue;
+      }
 
       // Attach packet to chain
       if (!chain_head)
         chain_head = std::move(pkt);
       else
         chain_head->packet_ptr()->chain(pkt->release());
-
-      // next position in buffer
-      this->offset += total;
     }
 
     // Only transmit if a chain actually was produced
@@ -346,6 +500,7 @@ namespace net {
       // ship the packet
       udp.transmit(std::move(chain_head));
     }
+    return written;
   }
 
   udp::Packet_view_ptr UDP::create_packet(const net::Socket& src,
@@ -355,14 +510,21 @@ namespace net {
     {
       Expects(dst.address().is_v6());
       auto pkt = std::make_unique<udp::Packet6_view>(stack_.create_ip6_packet(Protocol::UDP));
-      pkt->init(src, dst);
+      // sockets bound to any address send from the stack's
+      if (UNLIKELY(src.address().is_any()))
+        pkt->init({stack_.ip6_addr(), src.port()}, dst);
+      else
+        pkt->init(src, dst);
       return pkt;
     }
     else
     {
       Expects(dst.address().is_v4());
       auto pkt = std::make_unique<udp::Packet4_view>(stack_.create_ip_packet(Protocol::UDP));
-      pkt->init(src, dst);
+      if (UNLIKELY(src.address().is_any()))
+        pkt->init({stack_.ip_addr(), src.port()}, dst);
+      else
+        pkt->init(src, dst);
       return pkt;
     }
   }
@@ -382,6 +544,26 @@ namespace net {
   udp::Socket& UDP::bind6()
   { return bind(stack_.ip6_addr()); }
 
+  size_t UDP::fill(udp::Packet_view& pkt, const uint8_t* data, const size_t length)
+  {
+    size_t filled = pkt.fill(data, length);
+    // the rest of a jumbo datagram, which is sent without a checksum
+    if (filled < length and pkt.ipv() == Protocol::IPv4
+        and stack_.nic().has_offload(hw::Nic::TX_SEGMENTS))
+    {
+      while (filled < length)
+      {
+        auto seg = stack_.nic().create_packet(0);
+        const size_t len = std::min<size_t>(length - filled, seg->capacity());
+        memcpy(seg->layer_begin(), data + filled, len);
+        seg->set_data_end(len);
+        pkt.append_segment(std::move(seg));
+        filled += len;
+      }
+    }
+    return filled;
+  }
+
   uint16_t UDP::max_datagram_size() noexcept
   { return stack().ip_obj().MDDS() - sizeof(udp::Header); }
 
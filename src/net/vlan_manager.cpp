@@ -8,6 +8,7 @@
 
 #include <net/vlan_manager.hpp>
 #include <hal/machine.hpp>
+#include <map>
 
 namespace net {
 
@@ -32,7 +33,8 @@ VLAN_manager& VLAN_manager::get(int N)
 
 VLAN_manager::VLAN_interface& VLAN_manager::add(hw::Nic& link, const int id)
 {
-  Expects(id > 0 and id <= 4096 && "Outside VID range (1-4096)");
+  Expects(id > 0 and id < VID_COUNT && "Outside VID range (1-4095)");
+  Expects(links_[id] == nullptr && "VLAN ID is already taken");
 
   // this is very redudant if it's already been set once,
   // but i'll keep it for now since it's not expensive.
@@ -44,27 +46,30 @@ VLAN_manager::VLAN_interface& VLAN_manager::add(hw::Nic& link, const int id)
   // register as a device (unnecessary?)
   os::machine().add<hw::Nic>(std::move(vif));
 
-  auto it = links_.emplace(id, raw);
-  Ensures(it.second && "Could not insert - ID is most likely already taken");
+  links_[id] = raw;
 
   INFO("VLAN", "Added VLAN %s %s", raw->driver_name(), raw->device_name().c_str());
 
-  return *it.first->second;
+  return *raw;
 }
 
 void VLAN_manager::receive(Packet_ptr pkt)
 {
-  auto& vlan = *reinterpret_cast<ethernet::VLAN_header*>(pkt->layer_begin());
-  Expects(vlan.tpid == static_cast<int>(Ethertype::VLAN));
-
-  auto id = vlan.vid();
+  // the NIC may have stripped the tag already, and kept the ID
+  int id = pkt->vlan_id();
+  if (id == 0)
+  {
+    auto& vlan = *reinterpret_cast<ethernet::VLAN_header*>(pkt->layer_begin());
+    Expects(vlan.tpid == static_cast<int>(Ethertype::VLAN));
+    id = vlan.vid();
+  }
 
-  auto it = links_.find(id);
+  auto* link = links_[id];
   PRINT("<VLAN_manager> Recieved frame tagged with ID %d ", id);
-  if(it != links_.end())
+  if(link != nullptr)
   {
     PRINT("- Found\n");
-    it->second->receive(std::move(pkt));
+    link->receive(std::move(pkt));
     return;
   }
   else
@@ -0,0 +1,561 @@
+#include <net/ws/deflate.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+namespace net {
+
+static const uint16_t LEN_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LEN_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+  8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static constexpr size_t MIN_MATCH = 3;
+static constexpr size_t MAX_MATCH = 258;
+static constexpr int    MAX_CHAIN = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+// Negotiation
+
+// calls fn(name, value) for each parameter of each extension in the field,
+// and done() at the end of each extension
+template <typename Param, typename Done>
+static void parse_extensions(util::sview field, Param param, Done done)
+{
+  auto trim = [] (util::sview s) {
+    while (not s.empty() and (s.front() == ' ' or s.front() == '\t')) s.remove_prefix(1);
+    while (not s.empty() and (s.back() == ' ' or s.back() == '\t')) s.remove_suffix(1);
+    return s;
+  };
+  while (not field.empty())
+  {
+    const auto comma = field.find(',');
+    auto ext = field.substr(0, comma);
+    field = (comma == util::sview::npos) ? util::sview{} : field.substr(comma + 1);
+
+    bool first = true;
+    while (true)
+    {
+      const auto semi = ext.find(';');
+      auto part = trim(ext.substr(0, semi));
+      const auto eq = part.find('=');
+      auto name  = trim(part.substr(0, eq));
+      auto value = (eq == util::sview::npos) ? util::sview{} : trim(part.substr(eq + 1));
+      if (value.size() >= 2 and value.front() == '"' and value.back() == '"')
+        value = value.substr(1, value.size() - 2);
+      param(name, value, first);
+      first = false;
+      if (semi == util::sview::npos) break;
+      ext = ext.substr(semi + 1);
+    }
+    done();
+  }
+}
+
+static int window_bits(util::sview value)
+{
+  if (value.size() == 1 and value[0] >= '8' and value[0] <= '9')
+    return value[0] - '0';
+  if (value.size() == 2 and value[0] == '1' and value[1] >= '0' and value[1] <= '5')
+    return 10 + value[1] - '0';
+  return -1;
+}
+
+bool WS_deflate_params::negotiate(util::csview offers, const WS_deflate_params& config,
+                                  WS_deflate_params& agreed, std::string& response)
+{
+  bool found = false;
+  bool deflate = false, valid = true;
+  WS_deflate_params p = config;
+  bool server_bits_offered = false;
+
+  parse_extensions(offers,
+  [&] (util::sview name, util::sview value, bool first)
+  {
+    if (found) return;
+    if (first) {
+      deflate = (name == "permessage-deflate");
+      valid = true;
+      p = config;
+      server_bits_offered = false;
+      return;
+    }
+    if (not deflate) return;
+    if (name == "server_no_context_takeover" and value.empty())
+      p.server_no_context_takeover = true;
+    else if (name == "client_no_context_takeover" and value.empty())
+      p.client_no_context_takeover = true;
+    else if (name == "server_max_window_bits") {
+      const int bits = window_bits(value);
+      if (bits < 0) { valid = false; return; }
+      p.server_max_window_bits = std::min<int>(config.server_max_window_bits, bits);
+      server_bits_offered = true;
+    }
+    else if (name == "client_max_window_bits") {
+      // without a value, the client only tells it can be limited
+      if (not value.empty() and window_bits(value) < 0) valid = false;
+      else if (not value.empty()) p.client_max_window_bits = window_bits(value);
+    }
+    else
+      valid = false;
+  },
+  [&] ()
+  {
+    if (found or not deflate or not valid) return;
+    found = true;
+    agreed = p;
+  });
+
+  if (not found)
+    return false;
+
+  response = "permessage-deflate";
+  if (agreed.server_no_context_takeover)
+    response += "; server_no_context_takeover";
+  if (agreed.client_no_context_takeover)
+    response += "; client_no_context_takeover";
+  if (server_bits_offered or agreed.server_max_window_bits < 15)
+    response += "; server_max_window_bits=" + std::to_string(agreed.server_max_window_bits);
+  return true;
+}
+
+std::string WS_deflate_params::offer() const
+{
+  std::string field = "permessage-deflate; client_max_window_bits";
+  if (client_no_context_takeover)
+    field += "; client_no_context_takeover";
+  if (server_no_context_takeover)
+    field += "; server_no_context_takeover";
+  if (server_max_window_bits < 15)
+    field += "; server_max_window_bits=" + std::to_string(server_max_window_bits);
+  return field;
+}
+
+bool WS_deflate_params::accept(util::csview response, WS_deflate_params& agreed)
+{
+  int extensions = 0;
+  bool valid = true;
+  WS_deflate_params p = agreed;
+
+  parse_extensions(response,
+  [&] (util::sview name, util::sview value, bool first)
+  {
+    if (first) {
+      if (name != "permessage-deflate") valid = false;
+      return;
+    }
+    if (name == "server_no_context_takeover" and value.empty())
+      p.server_no_context_takeover = true;
+    else if (name == "client_no_context_takeover" and value.empty())
+      p.client_no_context_takeover = true;
+    else if (name == "server_max_window_bits" and window_bits(value) > 0)
+      p.server_max_window_bits = window_bits(value);
+    else if (name == "client_max_window_bits" and window_bits(value) > 0)
+      p.client_max_window_bits = window_bits(value);
+    else
+      valid = false;
+  },
+  [&] () { extensions++; });
+
+  if (not valid or extensions != 1)
+    return false;
+  agreed = p;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Compression
+
+namespace {
+  struct Bit_writer {
+    std::vector<uint8_t>& out;
+    uint64_t bits  = 0;
+    int      count = 0;
+
+    void put(uint32_t value, int n)
+    {
+      bits |= uint64_t(value) << count;
+      count += n;
+      while (count >= 8) {
+        out.push_back(bits & 0xff);
+        bits >>= 8;
+        count -= 8;
+      }
+    }
+    // Huffman codes go most significant bit first
+    void put_code(uint32_t code, int n)
+    {
+      uint32_t rev = 0;
+      for (int i = 0; i < n; i++)
+        rev |= ((code >> i) & 1) << (n - 1 - i);
+      put(rev, n);
+    }
+    void flush()
+    {
+      if (count > 0) out.push_back(bits & 0xff);
+      bits = 0; count = 0;
+    }
+  };
+
+  void put_literal(Bit_writer& w, unsigned sym)
+  {
+    if (sym < 144)      w.put_code(0x30 + sym, 8);
+    else if (sym < 256) w.put_code(0x190 + sym - 144, 9);
+    else if (sym < 280) w.put_code(sym - 256, 7);
+    else                w.put_code(0xc0 + sym - 280, 8);
+  }
+
+  void put_match(Bit_writer& w, size_t len, size_t dist)
+  {
+    const int l = std::upper_bound(LEN_BASE, LEN_BASE + 29, len) - LEN_BASE - 1;
+    put_literal(w, 257 + l);
+    w.put(len - LEN_BASE[l], LEN_EXTRA[l]);
+    const int d = std::upper_bound(DIST_BASE, DIST_BASE + 30, dist) - DIST_BASE - 1;
+    w.put_code(d, 5);
+    w.put(dist - DIST_BASE[d], DIST_EXTRA[d]);
+  }
+}
+
+WS_deflater::WS_deflater(int window_bits, int mem_level)
+  : window_(size_t(1) << std::clamp(window_bits, 8, 15)),
+    hash_bits_(std::clamp(mem_level, 1, 9) + 7),
+    head_(size_t(1) << hash_bits_, 0),
+    prev_(window_, 0)
+{}
+
+uint32_t WS_deflater::hash(const uint8_t* p) const noexcept
+{
+  const uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+  return (v * 2654435761u) >> (32 - hash_bits_);
+}
+
+void WS_deflater::compress(const uint8_t* data, size_t len, std::vector<uint8_t>& out, bool reset)
+{
+  // positions before base_ are never matched, so nothing needs clearing
+  if (reset) {
+    base_ += buf_.size();
+    buf_.clear();
+  }
+  // unless positions would wrap around, then the context is dropped
+  if (uint64_t(base_) + buf_.size() + len >= UINT32_MAX)
+  {
+    std::fill(head_.begin(), head_.end(), 0);
+    std::fill(prev_.begin(), prev_.end(), 0);
+    base_ = 0;
+    buf_.clear();
+  }
+  const size_t start = buf_.size();
+  buf_.insert(buf_.end(), data, data + len);
+
+  Bit_writer w{out};
+  // a block with the fixed codes, not the last
+  w.put(0, 1);
+  w.put(1, 2);
+
+  size_t pos = start;
+  const size_t end = buf_.size();
+  auto insert = [this, end] (size_t at) {
+    if (at + MIN_MATCH > end) return;
+    const auto h = hash(&buf_[at]);
+    const uint32_t abs = base_ + at;
+    prev_[abs & (window_ - 1)] = head_[h];
+    head_[h] = abs + 1;
+  };
+
+  while (pos < end)
+  {
+    size_t best_len = 0, best_dist = 0;
+    if (pos + MIN_MATCH <= end)
+    {
+      const uint32_t abs = base_ + pos;
+      const size_t max_len = std::min(MAX_MATCH, end - pos);
+      uint32_t cand = head_[hash(&buf_[pos])];
+      for (int chain = 0; chain < MAX_CHAIN and cand != 0; chain++)
+      {
+        const uint32_t c = cand - 1;
+        // gone from the window, or stale after a reset
+        if (c >= abs or abs - c > window_ or c < base_)
+          break;
+        const uint8_t* a = &buf_[c - base_];
+        const uint8_t* b = &buf_[pos];
+        if (a[best_len] == b[best_len] or best_len == 0)
+        {
+          size_t n = 0;
+          while (n < max_len and a[n] == b[n]) n++;
+          if (n > best_len) {
+            best_len = n;
+            best_dist = abs - c;
+            if (n == max_len) break;
+          }
+        }
+        const uint32_t next = prev_[c & (window_ - 1)];
+        if (next == 0 or next - 1 >= c) break;
+        cand = next;
+      }
+    }
+
+    if (best_len >= MIN_MATCH)
+    {
+      put_match(w, best_len, best_dist);
+      for (size_t i = 0; i < best_len; i++)
+        insert(pos + i);
+      pos += best_len;
+    }
+    else
+    {
+      put_literal(w, buf_[pos]);
+      insert(pos);
+      pos++;
+    }
+  }
+  put_literal(w, 256);
+
+  // sync flush: an empty stored block, of which 00 00 ff ff is left out
+  w.put(0, 1);
+  w.put(0, 2);
+  w.flush();
+
+  // keep only the window
+  if (buf_.size() > 2 * window_)
+  {
+    const size_t drop = buf_.size() - window_;
+    buf_.erase(buf_.begin(), buf_.begin() + drop);
+    base_ += drop;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decompression
+
+namespace {
+  struct Huffman {
+    uint16_t count[16];
+    uint16_t symbol[288];
+
+    bool build(const uint8_t* lengths, int n)
+    {
+      memset(count, 0, sizeof(count));
+      for (int i = 0; i < n; i++) count[lengths[i]]++;
+      count[0] = 0;
+      int left = 1;
+      for (int len = 1; len < 16; len++) {
+        left <<= 1;
+        left -= count[len];
+        if (left < 0) return false;
+      }
+      uint16_t offs[16];
+      offs[1] = 0;
+      for (int len = 1; len < 15; len++)
+        offs[len + 1] = offs[len] + count[len];
+      for (int i = 0; i < n; i++)
+        if (lengths[i]) symbol[offs[lengths[i]]++] = i;
+      return true;
+    }
+  };
+
+  struct Bit_reader {
+    const uint8_t* data;
+    size_t len;
+    size_t pos = 0;
+    uint32_t bits = 0;
+    int count = 0;
+    bool error = false;
+
+    uint32_t get(int n)
+    {
+      while (count < n) {
+        if (pos == len) { error = true; return 0; }
+        bits |= uint32_t(data[pos++]) << count;
+        count += 8;
+      }
+      const uint32_t v = bits & ((1u << n) - 1);
+      bits >>= n;
+      count -= n;
+      return v;
+    }
+
+    int decode(const Huffman& h)
+    {
+      int code = 0, first = 0, index = 0;
+      for (int len = 1; len < 16; len++) {
+        code |= get(1);
+        if (error) return -1;
+        const int count = h.count[len];
+        if (code - count < first)
+          return h.symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+      }
+      return -1;
+    }
+  };
+
+  const Huffman& fixed_literals()
+  {
+    static Huffman h = [] {
+      Huffman t;
+      uint8_t lengths[288];
+      for (int i = 0; i < 144; i++) lengths[i] = 8;
+      for (int i = 144; i < 256; i++) lengths[i] = 9;
+      for (int i = 256; i < 280; i++) lengths[i] = 7;
+      for (int i = 280; i < 288; i++) lengths[i] = 8;
+      t.build(lengths, 288);
+      return t;
+    }();
+    return h;
+  }
+
+  const Huffman& fixed_distances()
+  {
+    static Huffman h = [] {
+      Huffman t;
+      uint8_t lengths[30];
+      std::fill(lengths, lengths + 30, 5);
+      t.build(lengths, 30);
+      return t;
+    }();
+    return h;
+  }
+
+  bool dynamic_tables(Bit_reader& in, Huffman& lit, Huffman& dist)
+  {
+    static const uint8_t order[19] = {
+      16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    const int nlen  = in.get(5) + 257;
+    const int ndist = in.get(5) + 1;
+    const int ncode = in.get(4) + 4;
+    if (in.error or nlen > 286 or ndist > 30) return false;
+
+    uint8_t lengths[320] = {};
+    for (int i = 0; i < ncode; i++)
+      lengths[order[i]] = in.get(3);
+    Huffman codes;
+    if (in.error or not codes.build(lengths, 19)) return false;
+
+    int i = 0;
+    while (i < nlen + ndist)
+    {
+      const int sym = in.decode(codes);
+      if (sym < 0) return false;
+      if (sym < 16) { lengths[i++] = sym; continue; }
+      uint8_t len = 0;
+      int repeat;
+      if (sym == 16) {
+        if (i == 0) return false;
+        len = lengths[i - 1];
+        repeat = 3 + in.get(2);
+      }
+      else if (sym == 17) repeat = 3 + in.get(3);
+      else                repeat = 11 + in.get(7);
+      if (in.error or i + repeat > nlen + ndist) return false;
+      while (repeat--) lengths[i++] = len;
+    }
+    if (lengths[256] == 0) return false;
+    return lit.build(lengths, nlen) and dist.build(lengths + nlen, ndist);
+  }
+}
+
+bool WS_inflater::decompress(const uint8_t* data, size_t len, std::vector<uint8_t>& out,
+                             bool reset, size_t max_size)
+{
+  if (reset)
+    buf_.clear();
+  const size_t start = buf_.size();
+
+  // put back the end of the sync flush
+  std::vector<uint8_t> input;
+  input.reserve(len + 4);
+  input.insert(input.end(), data, data + len);
+  input.insert(input.end(), {0x00, 0x00, 0xff, 0xff});
+  Bit_reader in{input.data(), input.size()};
+
+  auto too_large = [&] () {
+    return max_size != 0 and buf_.size() - start > max_size;
+  };
+
+  bool last = false;
+  while (not last and in.pos < in.len)
+  {
+    last = in.get(1);
+    const int type = in.get(2);
+    if (in.error) return false;
+
+    if (type == 0)
+    {
+      // stored, from the next byte
+      in.bits = 0; in.count = 0;
+      if (in.len - in.pos < 4) return false;
+      const size_t n = input[in.pos] | (input[in.pos + 1] << 8);
+      const size_t nn = input[in.pos + 2] | (input[in.pos + 3] << 8);
+      in.pos += 4;
+      if (n != (~nn & 0xffff) or in.len - in.pos < n) return false;
+      buf_.insert(buf_.end(), &input[in.pos], &input[in.pos] + n);
+      in.pos += n;
+      if (too_large()) return false;
+      continue;
+    }
+
+    Huffman dyn_lit, dyn_dist;
+    const Huffman* lit  = &fixed_literals();
+    const Huffman* dist = &fixed_distances();
+    if (type == 2) {
+      if (not dynamic_tables(in, dyn_lit, dyn_dist)) return false;
+      lit = &dyn_lit; dist = &dyn_dist;
+    }
+    else if (type != 1)
+      return false;
+
+    while (true)
+    {
+      const int sym = in.decode(*lit);
+      if (sym < 0) return false;
+      if (sym < 256) {
+        buf_.push_back(sym);
+        continue;
+      }
+      if (sym == 256) break;
+
+      const int l = sym - 257;
+      if (l >= 29) return false;
+      const size_t length = LEN_BASE[l] + in.get(LEN_EXTRA[l]);
+      const int d = in.decode(*dist);
+      if (d < 0 or d >= 30) return false;
+      const size_t distance = DIST_BASE[d] + in.get(DIST_EXTRA[d]);
+      if (in.error or distance > buf_.size() or distance > window_) return false;
+
+      // may overlap what it copies
+      size_t from = buf_.size() - distance;
+      for (size_t i = 0; i < length; i++)
+        buf_.push_back(buf_[from + i]);
+      if (too_large()) return false;
+    }
+    if (too_large()) return false;
+  }
+
+  out.insert(out.end(), buf_.begin() + start, buf_.end());
+
+  // keep only the window
+  if (buf_.size() > 2 * window_)
+    buf_.erase(buf_.begin(), buf_.end() - window_);
+  return true;
+}
+
+} // < namespace net
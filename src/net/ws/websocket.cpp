@@ -3,6 +3,8 @@
 #include <os.hpp>
 #include <util/base64.hpp>
 #include <util/sha1.hpp>
+#include <kernel/rng.hpp>
+#include <algorithm>
 #include <cstdint>
 #include <net/ws/connector.hpp>
 
@@ -38,7 +40,8 @@ const char* WebSocket::to_string(op_code code)
   }
 }
 
-WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writer)
+WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writer,
+                                 std::optional<WS_deflate_params> deflate)
 {
   // validate handshake
   auto view = req.header().value("Sec-WebSocket-Version");
@@ -59,6 +62,21 @@ WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writ
   header.set_field(http::header::Connection, "Upgrade");
   header.set_field(http::header::Upgrade,    "WebSocket");
   header.set_field("Sec-WebSocket-Accept", encode_hash(std::string(key)));
+
+  // agree to the first acceptable permessage-deflate offer
+  WS_deflate_params agreed;
+  bool compress = false;
+  if (deflate.has_value())
+  {
+    auto offers = req.header().value("Sec-WebSocket-Extensions");
+    std::string response;
+    if (not offers.empty()
+        and WS_deflate_params::negotiate(offers, *deflate, agreed, response))
+    {
+      header.set_field("Sec-WebSocket-Extensions", response);
+      compress = true;
+    }
+  }
   writer.write_header(http::Switching_Protocols);
 
   auto stream = writer.connection().release();
@@ -66,12 +84,16 @@ WebSocket_ptr WebSocket::upgrade(http::Request& req, http::Response_writer& writ
   // discard streams which can be FIN-WAIT-1
   if (stream->is_connected()) {
     // for now, only accept fully connected streams
-    return std::make_unique<WebSocket>(std::move(stream), false);
+    auto ws = std::make_unique<WebSocket>(std::move(stream), false);
+    if (compress)
+      ws->deflate_ = std::make_unique<Deflate>(agreed, false);
+    return ws;
   }
   return nullptr;
 }
 
-WebSocket_ptr WebSocket::upgrade(http::Error err, http::Response& res, http::Connection& conn, const std::string& key)
+WebSocket_ptr WebSocket::upgrade(http::Error err, http::Response& res, http::Connection& conn,
+                                 const std::string& key, std::optional<WS_deflate_params> offered)
 {
   if (err or res.status_code() != http::Switching_Protocols)
   {
@@ -85,33 +107,44 @@ WebSocket_ptr WebSocket::upgrade(http::Error err, http::Response& res, http::Con
     {
       return nullptr;
     }
+    /// the server may only agree to what was offered
+    auto extensions = res.header().value("Sec-WebSocket-Extensions");
+    WS_deflate_params agreed;
+    if (not extensions.empty())
+    {
+      if (not offered.has_value())
+        return nullptr;
+      agreed = *offered;
+      if (not WS_deflate_params::accept(extensions, agreed))
+        return nullptr;
+    }
     /// create open websocket
     auto stream = conn.release();
     assert(stream->is_connected());
     // create client websocket and call callback
-    return std::make_unique<WebSocket>(std::move(stream), true);
+    auto ws = std::make_unique<WebSocket>(std::move(stream), true);
+    if (not extensions.empty())
+      ws->deflate_ = std::make_unique<Deflate>(agreed, true);
+    return ws;
   }
 }
 
 std::vector<char> WebSocket::generate_key()
 {
   std::vector<char> key(16);
-  uint16_t v;
-  for (size_t i = 0; i < key.size(); i += sizeof(v))
-  {
-    v = rand() & 0xffff;
-    memcpy(&key[i], &v, sizeof(v));
-  }
+  rng_fast_fill(key.data(), key.size());
   return key;
 }
 
 http::Server::Request_handler WebSocket::create_request_handler(
-  Connect_handler on_connect, Accept_handler on_accept)
+  Connect_handler on_connect, Accept_handler on_accept,
+  std::optional<WS_deflate_params> deflate)
 {
   return http::Server::Request_handler::make_packed(
     [
       on_connect{std::move(on_connect)},
-      on_accept{std::move(on_accept)}
+      on_accept{std::move(on_accept)},
+      deflate
     ]
     (http::Request_ptr req, http::Response_writer_ptr writer)
     {
@@ -126,23 +159,25 @@ http::Server::Request_handler WebSocket::create_request_handler(
           return;
         }
       }
-      auto ws = WebSocket::upgrade(*req, *writer);
+      auto ws = WebSocket::upgrade(*req, *writer, deflate);
 
       on_connect(std::move(ws));
     });
 }
 
 http::Basic_client::Response_handler WebSocket::create_response_handler(
-  Connect_handler on_connect, std::string key)
+  Connect_handler on_connect, std::string key,
+  std::optional<WS_deflate_params> offered)
 {
   return http::Basic_client::Response_handler::make_packed(
     [
       on_connect{std::move(on_connect)},
-      key{std::move(key)}
+      key{std::move(key)},
+      offered
     ]
     (http::Error err, http::Response_ptr res, http::Connection& conn)
     {
-      auto ws = WebSocket::upgrade(err, *res, conn, key);
+      auto ws = WebSocket::upgrade(err, *res, conn, key, offered);
 
       on_connect(std::move(ws));
     });
@@ -151,7 +186,8 @@ http::Basic_client::Response_handler WebSocket::create_response_handler(
 void WebSocket::connect(
       http::Basic_client&   client,
       uri::URI              remote,
-      Connect_handler       callback)
+      Connect_handler       callback,
+      std::optional<WS_deflate_params> deflate)
 {
   // doesn't have to be extremely random, just random
   std::string key  = base64::encode(generate_key());
@@ -162,9 +198,12 @@ void WebSocket::connect(
       {"Sec-WebSocket-Version", "13"},
       {"Sec-WebSocket-Key",     key }
   };
+  if (deflate.has_value())
+    ws_headers.emplace_back("Sec-WebSocket-Extensions", deflate->offer());
   // send HTTP request
   client.get(remote, ws_headers,
-    WS_client_connector::create_response_handler(std::move(callback), std::move(key)));
+    WS_client_connector::create_response_handler(std::move(callback), std::move(key),
+                                                 std::move(deflate)));
 }
 
 void WebSocket::read_data(Stream::buffer_t buf)
@@ -172,26 +211,20 @@ void WebSocket::read_data(Stream::buffer_t buf)
   // silently ignore data for reset connection
   if (this->stream == nullptr) return;
 
-  size_t len = buf->size();
-  const uint8_t* data = buf->data();
-  while (len)
+  size_t offset = 0;
+  while (offset < buf->size() and this->stream != nullptr)
   {
     if (message != nullptr)
     {
-      const size_t written = message->append(data, len);
-      len -= written;
-      data += len;
+      offset += message->append(buf->data() + offset, buf->size() - offset);
     }
     // create new message
     else
     {
-      const size_t written = create_message(data, len);
+      offset += create_message(buf, offset);
 
       if(UNLIKELY(message == nullptr))
         return; // Something was invalid, error has been called and stream closed.
-
-      len -= written;
-      data += len;
     }
 
     if (message->is_complete()) {
@@ -216,18 +249,20 @@ size_t WebSocket::Message::append(const uint8_t* data, size_t len)
       data_.reserve(header().data_length());
     }
   }
-  // fill data with remainder
+  // fill data with remainder, but not into the next frame
   if (this->header_complete())
   {
-    const size_t insert_size = std::min(data_.capacity() - data_.size(), len);
+    const size_t insert_size = std::min(header().data_length() - data_.size(), len);
     data_.insert(data_.end(), data, data + insert_size);
     total += insert_size;
   }
   return total;
 }
 
-size_t WebSocket::create_message(const uint8_t* buf, size_t len)
+size_t WebSocket::create_message(const Stream::buffer_t& buffer, size_t offset)
 {
+  const uint8_t* buf = buffer->data() + offset;
+  const size_t   len = buffer->size() - offset;
   // parse header
   if (len < sizeof(ws_header)) {
     failure("read_data: Header was too short");
@@ -266,6 +301,14 @@ size_t WebSocket::create_message(const uint8_t* buf, size_t len)
     return std::min(hdr.data_length(), len);
   }
 
+  // the whole frame is here, so no need to copy it
+  if (len >= hdr.header_length()
+      and len - hdr.header_length() >= hdr.data_length())
+  {
+    this->message = std::make_unique<Message>(buffer, offset);
+    return hdr.header_length() + hdr.data_length();
+  }
+
   this->message = std::make_unique<Message>(buf, len);
   return len;
 }
@@ -275,6 +318,24 @@ void WebSocket::finalize_message()
   Expects(message != nullptr and message->is_complete());
   message->unmask();
   const auto& hdr = message->header();
+  if (hdr.is_compressed())
+  {
+    // only data frames, and only when agreed on
+    if (deflate_ == nullptr or (static_cast<uint8_t>(hdr.opcode()) & 0x8)) {
+      message.reset();
+      failure("read: Compressed frame without permessage-deflate");
+      return;
+    }
+    Message::Data plain;
+    if (not deflate_->inflater.decompress(message->cbegin(), message->size(),
+                                          plain, deflate_->reset_in, max_msg_size))
+    {
+      message.reset();
+      failure("read: Invalid or too large compressed message");
+      return;
+    }
+    message->set_data(std::move(plain));
+  }
   switch (hdr.opcode()) {
   case op_code::TEXT:
   case op_code::BINARY:
@@ -299,13 +360,13 @@ void WebSocket::finalize_message()
     // the websocket is DEAD after close()
     return;
   case op_code::PING:
-    if (on_ping(hdr.data(), hdr.data_length())) // if return true, pong back
-      write_opcode(op_code::PONG, hdr.data(), hdr.data_length());
+    if (on_ping(message->data(), message->size())) // if return true, pong back
+      write_opcode(op_code::PONG, message->data(), message->size());
     break;
   case op_code::PONG:
     ping_timer.stop();
     if (on_pong != nullptr)
-      on_pong(hdr.data(), hdr.data_length());
+      on_pong(message->data(), message->size());
     break;
   default:
     //printf("Unknown opcode: %d\n", (int) hdr.opcode());
@@ -329,7 +390,7 @@ static Stream::buffer_t create_wsmsg(size_t len, op_code code, bool client)
   hdr.set_payload(len);
   hdr.set_opcode(code);
   if (client) {
-    hdr.set_masked((os::cycles_since_boot() ^ (uintptr_t) buffer.get()) & 0xffffffff);
+    hdr.set_masked(rng_fast_uint32());
   }
   assert(header_len == sizeof(ws_header) + hdr.data_offset());
   return buffer;
@@ -349,8 +410,21 @@ void WebSocket::write(const char* data, size_t len, op_code code)
   Expects((code == op_code::TEXT or code == op_code::BINARY)
       && "Write currently only supports TEXT or BINARY");
 
+  // compress, unless too small to be worth it
+  const bool compress = deflate_ != nullptr and len >= deflate_->params.min_size;
+  if (compress)
+  {
+    deflate_->out.clear();
+    deflate_->deflater.compress((const uint8_t*) data, len,
+                                deflate_->out, deflate_->reset_out);
+    data = (const char*) deflate_->out.data();
+    len  = deflate_->out.size();
+  }
+
   // fill header
   auto buf = create_wsmsg(len, code, clientside);
+  if (compress)
+    ((ws_header*) buf->data())->set_compressed();
   // get data offset & fill in data into buffer
   buf->insert(buf->end(), data, data + len);
   // for client-side we have to mask the data
@@ -374,6 +448,11 @@ void WebSocket::write(Stream::buffer_t buffer, op_code code)
     failure("write: Connection not writable");
     return;
   }
+  // the buffer is not ours to compress in place
+  if (deflate_ != nullptr) {
+    write((const char*) buffer->data(), buffer->size(), code);
+    return;
+  }
   if (UNLIKELY(clientside == true)) {
     failure("write: Client-side does not support sending shared buffers");
     return;
@@ -382,26 +461,90 @@ void WebSocket::write(Stream::buffer_t buffer, op_code code)
   Expects((code == op_code::TEXT or code == op_code::BINARY)
         && "Write currently only supports TEXT or BINARY");
 
-  /// write header
+  /// write header and shared buffer together
   auto header = create_wsmsg(buffer->size(), code, false);
-  this->stream->write(header);
-  /// write shared buffer
-  this->stream->write(buffer);
+  this->stream->writev({std::move(header), std::move(buffer)});
 }
+void WebSocket::write(Broadcast& msg)
+{
+  // masked with a key of our own, or compressed with our own context
+  if (clientside or (deflate_ != nullptr and not deflate_->reset_out)) {
+    write(msg.data(), msg.size(), msg.code());
+    return;
+  }
+  if (UNLIKELY(this->stream == nullptr)) {
+    failure("write: Already closed");
+    return;
+  }
+  if (UNLIKELY(this->stream->is_writable() == false)) {
+    failure("write: Connection not writable");
+    return;
+  }
+
+  if (deflate_ != nullptr and msg.size() >= deflate_->params.min_size)
+    this->stream->write(msg.compressed(deflate_->params.server_max_window_bits,
+                                       deflate_->params.mem_level));
+  else
+    this->stream->write(msg.plain_);
+}
+
+WebSocket::Broadcast::Broadcast(const char* data, size_t len, op_code code)
+  : code_(code),
+    plain_(create_wsmsg(len, code, false)),
+    offset_(plain_->size())
+{
+  Expects((code == op_code::TEXT or code == op_code::BINARY)
+        && "Broadcast only supports TEXT or BINARY");
+  plain_->insert(plain_->end(), data, data + len);
+}
+
+const Stream::buffer_t&
+WebSocket::Broadcast::compressed(int window_bits, int mem_level)
+{
+  auto& frame = compressed_.at(std::clamp(window_bits, 8, 15) - 8);
+  if (frame == nullptr)
+  {
+    // without context, the same for every WebSocket with this window
+    std::vector<uint8_t> out;
+    WS_deflater deflater(window_bits, mem_level);
+    deflater.compress((const uint8_t*) data(), size(), out, true);
+    frame = create_wsmsg(out.size(), code_, false);
+    ((ws_header*) frame->data())->set_compressed();
+    frame->insert(frame->end(), out.begin(), out.end());
+  }
+  return frame;
+}
+
 bool WebSocket::write_opcode(op_code code, const char* buffer, size_t datalen)
 {
   if (UNLIKELY(stream == nullptr || stream->is_writable() == false)) {
     return false;
   }
-  /// write header
+  /// write header, and the buffer (if present) in the same frame buffer
   auto header = create_wsmsg(datalen, code, clientside);
-  this->stream->write(header);
-  /// write buffer (if present)
   if (buffer != nullptr && datalen > 0)
-      this->stream->write(buffer, datalen);
+  {
+    header->insert(header->end(), buffer, buffer + datalen);
+    // for client-side we have to mask the data
+    if (clientside) {
+      auto& hdr = *(ws_header*) header->data();
+      hdr.masking_algorithm(hdr.data());
+    }
+  }
+  this->stream->write(std::move(header));
   return true;
 }
 
+WebSocket::Deflate::Deflate(const WS_deflate_params& agreed, bool client)
+  : params(agreed),
+    // each side compresses with its own window, and inflates with the peer's
+    deflater(client ? agreed.client_max_window_bits : agreed.server_max_window_bits,
+             agreed.mem_level),
+    inflater(client ? agreed.server_max_window_bits : agreed.client_max_window_bits),
+    reset_out(client ? agreed.client_no_context_takeover : agreed.server_no_context_takeover),
+    reset_in(client ? agreed.server_no_context_takeover : agreed.client_no_context_takeover)
+{}
+
 WebSocket::WebSocket(net::Stream_ptr stream_ptr, bool client)
   : stream(std::move(stream_ptr)), max_msg_size(0), clientside(client)
 {
@@ -1,7 +1,9 @@
 #include <array>
 
 #include <kprint>
+#include <kernel/events.hpp>
 #include "gic.h"
+#include "gic_regs.h"
 
 #include "exception_handling.hpp"
 static std::array<irq_handler_t, 0x3ff> handlers;
@@ -25,16 +27,19 @@ extern "C" {
 
 void exception_handler_irq_el(struct stack_frame *ctx,uint64_t esr)
 {
-  int irq=gicd_decode_irq();
-
-  gicd_irq_disable(irq);
-  //is this the role of the handler or the kernel ?
-  gicd_irq_clear(irq);
-
-  if (handlers[irq] != 0)
+  uint32_t ack;
+  const uint32_t irq = gic_ack_irq(&ack);
+  //1020-1023 are special, spurious among them, and need no EOI
+  if (irq >= 1020 && irq < GIC_LPI_BASE)
+    return;
+
+  //MSIs through the ITS, as events of this CPU
+  if (irq >= GIC_LPI_BASE)
+    Events::get().trigger_event(irq - GIC_LPI_BASE - IRQ_BASE);
+  else if (handlers[irq] != 0)
     handlers[irq]();
 
-  gicd_irq_enable(irq);
+  gic_eoi(ack);
 }
 
 struct stack_frame {
@@ -1,4 +1,9 @@
 #include <kprint>
+#include <smp>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
 
 #include "gic.h"
 
@@ -75,6 +80,9 @@ uint64_t fdt_load_size(const struct fdt_property *prop,int *offset,int size_cell
 
 
 
+static void gic_v3_init(uint64_t gicd, uint64_t gicr, uint64_t gicr_len);
+static void gic_its_init(uint64_t base);
+
 //qemu gives us a cortex-a15-gic (why ?)
 void gic_init_fdt(const char * fdt,uint32_t fdt_offset)
 {
@@ -115,6 +123,21 @@ void gic_init_fdt(const char * fdt,uint32_t fdt_offset)
   //gic_init(uint64_t gic_gicd_base,uint64_t gic_gicc_base);
   GIC_INFO("interrupt_cells %d\n",interrupt_cells);
 
+  // a GICv3 has its redistributors where a GICv2 has its CPU interface
+  if (fdt_node_check_compatible(fdt, fdt_offset, "arm,gic-v3") == 0)
+  {
+    gic_v3_init(gicd, gicc, len);
+    const int its = fdt_node_offset_by_compatible(fdt, -1, "arm,gic-v3-its");
+    if (its >= 0)
+    {
+      // the ITS is a child of the GIC, with the same address cells
+      offset = 0;
+      prop = fdt_get_property(fdt, its, "reg", &proplen);
+      if (prop != nullptr)
+        gic_its_init(fdt_load_addr(prop, &offset, addr_cells));
+    }
+    return;
+  }
   gic_init(gicd,gicc);
 }
 
@@ -320,3 +343,358 @@ void __arch_unsubscribe_irq(uint8_t irq)
 //  assert(irq < IRQ_LINES);
 //  PER_CPU(x86::idt).set_handler(IRQ_BASE + irq, unused_interrupt_handler);
 }
+
+
+/// GICv3 ///
+
+// the system register interface of the GICv3 CPU interface
+#define ICC_SYSREG_WRITE(reg, val) asm volatile("msr " reg ", %0; isb" :: "r"((uint64_t) (val)))
+#define ICC_SYSREG_READ(reg, val)  asm volatile("mrs %0, " reg : "=r"(val))
+#define ICC_IAR1_EL1    "S3_0_C12_C12_0"
+#define ICC_EOIR1_EL1   "S3_0_C12_C12_1"
+#define ICC_BPR1_EL1    "S3_0_C12_C12_3"
+#define ICC_SRE_EL1     "S3_0_C12_C12_5"
+#define ICC_IGRPEN1_EL1 "S3_0_C12_C12_7"
+#define ICC_SGI1R_EL1   "S3_0_C12_C11_5"
+#define ICC_PMR_EL1     "S3_0_C4_C6_0"
+
+static constexpr int GIC_MAX_CPUS = 16;
+static constexpr uint8_t GIC_PRIO_DEFAULT = 0xA0;
+// event IDs of a device, so up to 256 MSI-X vectors each
+static constexpr int ITS_EVENT_BITS = 8;
+
+static inline uint32_t mmio_read32(uintptr_t addr)
+{ return *(volatile uint32_t*) addr; }
+static inline void mmio_write32(uintptr_t addr, uint32_t val)
+{ *(volatile uint32_t*) addr = val; }
+static inline uint64_t mmio_read64(uintptr_t addr)
+{ return *(volatile uint64_t*) addr; }
+static inline void mmio_write64(uintptr_t addr, uint64_t val)
+{ *(volatile uint64_t*) addr = val; }
+
+static uint64_t affinity_of(uint64_t mpidr)
+{
+  // Aff3.Aff2.Aff1.Aff0, as in GICR_TYPER and GICD_IROUTER
+  return ((mpidr >> 8) & 0xff000000) | (mpidr & 0xffffff);
+}
+
+struct gic_v3_params {
+  int       version = 2;
+  uintptr_t gicd = 0;
+  uintptr_t gicr = 0;
+  uint64_t  gicr_len = 0;
+  // per CPU, set up by each CPU in gic_init_cpu()
+  uint64_t  mpidr[GIC_MAX_CPUS] {};
+  uintptr_t rdist[GIC_MAX_CPUS] {};
+  uint64_t  rdbase[GIC_MAX_CPUS] {};
+};
+static gic_v3_params v3;
+
+struct its_params {
+  uintptr_t base = 0;
+  bool      pta  = false;
+  uint32_t  itt_entry_size = 0;
+  uint8_t*  cmd_queue = nullptr;
+  uint32_t  cmd_size  = 0;
+  uint32_t  cmd_write = 0;
+  // LPI configuration, shared by every redistributor
+  uint8_t*  prop_table = nullptr;
+  // interrupt translation table of each device, and its events mapped
+  struct device {
+    uint8_t* itt;
+    uint64_t mapped[(1 << ITS_EVENT_BITS) / 64];
+  };
+  std::unordered_map<uint32_t, device> devices;
+  smp_spinlock lock;
+};
+static its_params its;
+
+int gic_version()
+{
+  return v3.version;
+}
+
+static void gicd_v3_wait_rwp()
+{
+  while (mmio_read32(v3.gicd) & GICD_CTLR_V3_RWP);
+}
+
+static void gic_v3_init(uint64_t gicd, uint64_t gicr, uint64_t gicr_len)
+{
+  GIC_INFO("Initializing GICv3\r\n");
+  v3.version  = 3;
+  v3.gicd     = gicd;
+  v3.gicr     = gicr;
+  v3.gicr_len = gicr_len;
+  gic.set_gicd(gicd);
+
+  gic.gicd->ctlr = 0;
+  gicd_v3_wait_rwp();
+
+  const int irq_lines = 32 * ((gic.gicd->type & 0x1F) + 1);
+  // SPIs only, SGIs and PPIs are in the redistributors with affinity routing
+  for (int reg = 1; reg < irq_lines / 32; reg++)
+  {
+    gic.gicd->enable_clr[reg]  = 0xffffffff;
+    gic.gicd->pending_clr[reg] = 0xffffffff;
+    gic.gicd->group[reg]       = 0xffffffff; // non-secure group 1
+  }
+  for (int reg = 32 / GIC_V3_GICD_PRIORITY_PER_REG;
+       reg < irq_lines / GIC_V3_GICD_PRIORITY_PER_REG; reg++)
+    gic.gicd->priority[reg] = GIC_PRIO_DEFAULT * 0x01010101u;
+  for (int reg = 32 / GIC_V3_GICD_CFGR_PER_REG;
+       reg < irq_lines / GIC_V3_GICD_CFGR_PER_REG; reg++)
+    gic.gicd->config[reg] = GICD_ICFGR_LEVEL;
+  gicd_v3_wait_rwp();
+
+  // affinity routing, then the groups
+  gic.gicd->ctlr = GICD_CTLR_V3_ARE;
+  gicd_v3_wait_rwp();
+  gic.gicd->ctlr = GICD_CTLR_V3_ARE | GICD_CTLR_V3_GRP1 | GICD_CTLR_V3_GRP0;
+  gicd_v3_wait_rwp();
+
+  // SPIs go to the boot CPU, until a driver moves them
+  uint64_t mpidr;
+  asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+  for (int irq = 32; irq < irq_lines; irq++)
+    mmio_write64(v3.gicd + GICD_IROUTER + irq * 8, affinity_of(mpidr));
+}
+
+static uintptr_t find_redistributor(uint64_t mpidr)
+{
+  const uint64_t aff = affinity_of(mpidr);
+  for (uintptr_t rd = v3.gicr; rd < v3.gicr + v3.gicr_len; )
+  {
+    const uint64_t typer = mmio_read64(rd + GICR_TYPER);
+    if ((typer >> 32) == aff) return rd;
+    if (typer & GICR_TYPER_LAST) break;
+    // GICv4 redistributors have two more frames, for virtual LPIs
+    rd += GICR_FRAME_SIZE * ((typer & GICR_TYPER_VLPIS) ? 4 : 2);
+  }
+  return 0;
+}
+
+static void its_command(uint64_t d0, uint64_t d1, uint64_t d2)
+{
+  auto* cmd = (uint64_t*) (its.cmd_queue + its.cmd_write);
+  cmd[0] = d0;
+  cmd[1] = d1;
+  cmd[2] = d2;
+  cmd[3] = 0;
+  its.cmd_write = (its.cmd_write + 32) % its.cmd_size;
+  asm volatile("dsb ish" ::: "memory");
+  mmio_write64(its.base + GITS_CWRITER, its.cmd_write);
+  // the queue is short, and commands are only issued at setup
+  while (mmio_read64(its.base + GITS_CREADR) != its.cmd_write);
+}
+
+static void its_sync(int cpu)
+{
+  its_command(GITS_CMD_SYNC, 0, v3.rdbase[cpu] << 16);
+}
+
+static void gic_its_init(uint64_t base)
+{
+  GIC_INFO("Initializing ITS at %lx\r\n", base);
+  its.base = base;
+  mmio_write32(base + GITS_CTLR, 0);
+
+  const uint64_t typer = mmio_read64(base + GITS_TYPER);
+  its.pta = typer & GITS_TYPER_PTA;
+  its.itt_entry_size = ((typer >> 4) & 0xf) + 1;
+  const int dev_bits = std::min<int>(((typer >> 13) & 0x1f) + 1, 16);
+
+  // the LPI configuration table, every LPI disabled
+  const size_t lpis = (1 << GIC_LPI_ID_BITS) - GIC_LPI_BASE;
+  its.prop_table = (uint8_t*) aligned_alloc(4096, lpis);
+  memset(its.prop_table, GIC_LPI_PRIO_DEFAULT, lpis);
+
+  // one page of commands
+  its.cmd_size  = 4096;
+  its.cmd_queue = (uint8_t*) aligned_alloc(65536, its.cmd_size);
+  memset(its.cmd_queue, 0, its.cmd_size);
+  mmio_write64(base + GITS_CBASER, (uintptr_t) its.cmd_queue | GITS_CBASER_VALID
+               | GITS_CACHE_WB | GITS_SHARE_INNER | (its.cmd_size / 4096 - 1));
+  mmio_write64(base + GITS_CWRITER, 0);
+
+  // flat device and collection tables, in 4k pages
+  for (int n = 0; n < 8; n++)
+  {
+    const uintptr_t reg = base + GITS_BASER + n * 8;
+    const uint64_t baser = mmio_read64(reg);
+    const int type = (baser >> 56) & 0x7;
+    const size_t entry_size = ((baser >> 48) & 0x1f) + 1;
+    size_t size;
+    if (type == GITS_BASER_TYPE_DEVICE)
+      size = entry_size << dev_bits;
+    else if (type == GITS_BASER_TYPE_COLL)
+      size = entry_size * GIC_MAX_CPUS;
+    else
+      continue;
+    const size_t pages = std::min<size_t>((size + 4095) / 4096, 256);
+    auto* table = aligned_alloc(65536, pages * 4096);
+    memset(table, 0, pages * 4096);
+    const uint64_t keep = baser & (0x7ull << 56 | 0x1full << 48);
+    mmio_write64(reg, (uintptr_t) table | keep | GITS_BASER_VALID
+                 | GITS_CACHE_WB | GITS_SHARE_INNER | (pages - 1));
+  }
+  mmio_write32(base + GITS_CTLR, GITS_CTLR_ENABLED);
+}
+
+static void gic_v3_init_cpu(int cpu, uint64_t mpidr)
+{
+  const uintptr_t rd = find_redistributor(mpidr);
+  if (rd == 0) {
+    GIC_ERROR("No redistributor for cpu %d\r\n", cpu);
+    return;
+  }
+  v3.rdist[cpu] = rd;
+  // the ITS names redistributors by address or by processor number
+  const uint64_t typer = mmio_read64(rd + GICR_TYPER);
+  v3.rdbase[cpu] = its.pta ? (rd >> 16) : ((typer >> 8) & 0xffff);
+
+  // wake the redistributor up
+  mmio_write32(rd + GICR_WAKER, mmio_read32(rd + GICR_WAKER) & ~GICR_WAKER_SLEEP);
+  while (mmio_read32(rd + GICR_WAKER) & GICR_WAKER_ASLEEP);
+
+  // SGIs and PPIs in group 1, disabled, at the default priority
+  mmio_write32(rd + GICR_IGROUPR0, 0xffffffff);
+  mmio_write32(rd + GICR_ICENABLER0, 0xffffffff);
+  mmio_write32(rd + GICR_ICPENDR0, 0xffffffff);
+  for (int reg = 0; reg < 32 / GIC_V3_GICD_PRIORITY_PER_REG; reg++)
+    mmio_write32(rd + GICR_IPRIORITYR + reg * 4, GIC_PRIO_DEFAULT * 0x01010101u);
+
+  // the CPU interface through system registers
+  uint64_t sre;
+  ICC_SYSREG_READ(ICC_SRE_EL1, sre);
+  ICC_SYSREG_WRITE(ICC_SRE_EL1, sre | 1);
+  ICC_SYSREG_WRITE(ICC_PMR_EL1, GICC_PMR_PRIO_LOW);
+  ICC_SYSREG_WRITE(ICC_BPR1_EL1, 0);
+  ICC_SYSREG_WRITE(ICC_IGRPEN1_EL1, 1);
+
+  if (its.base == 0) return;
+  // LPIs, with a pending table of its own, and a collection for this CPU
+  const size_t pend_size = 65536; // (1 << GIC_LPI_ID_BITS) / 8 bits, padded
+  auto* pending = aligned_alloc(65536, pend_size);
+  memset(pending, 0, pend_size);
+  mmio_write64(rd + GICR_PROPBASER, (uintptr_t) its.prop_table
+               | GICR_BASER_CACHE_WB | GITS_SHARE_INNER | (GIC_LPI_ID_BITS - 1));
+  mmio_write64(rd + GICR_PENDBASER, (uintptr_t) pending
+               | GICR_BASER_CACHE_WB | GITS_SHARE_INNER);
+  mmio_write32(rd + GICR_CTLR, mmio_read32(rd + GICR_CTLR) | GICR_CTLR_ENABLE_LPIS);
+
+  its.lock.lock();
+  its_command(GITS_CMD_MAPC, 0, (1ull << 63) | (v3.rdbase[cpu] << 16) | cpu);
+  its_sync(cpu);
+  its.lock.unlock();
+}
+
+void gic_init_cpu(int cpu, uint64_t mpidr)
+{
+  if (cpu < 0 or cpu >= GIC_MAX_CPUS) return;
+  v3.mpidr[cpu] = mpidr;
+  if (v3.version == 3)
+    gic_v3_init_cpu(cpu, mpidr);
+  else if (cpu != 0)
+    init_gicc(); // the boot CPU did its own in gic_init()
+}
+
+uint32_t gic_ack_irq(uint32_t* ack)
+{
+  if (v3.version == 3) {
+    uint64_t iar;
+    ICC_SYSREG_READ(ICC_IAR1_EL1, iar);
+    *ack = iar & 0xffffff;
+    return *ack;
+  }
+  *ack = gic.gicc->iar;
+  return *ack & gicc_iar_irq_mask;
+}
+
+void gic_eoi(uint32_t ack)
+{
+  if (v3.version == 3)
+    ICC_SYSREG_WRITE(ICC_EOIR1_EL1, ack);
+  else
+    gic_gicc_clear_irq(ack);
+}
+
+void gic_ppi_enable(uint32_t irq, uint8_t priority, uint8_t config)
+{
+  if (v3.version != 3)
+  {
+    // banked per CPU in the GICv2 distributor
+    gicd_set_config(irq, config);
+    gicd_set_priority(irq, priority);
+    gicd_irq_clear(irq);
+    gicd_irq_enable(irq);
+    return;
+  }
+  const uintptr_t rd = v3.rdist[SMP::cpu_id()];
+  const int shift = (irq % 4) * 8;
+  const uintptr_t prio = rd + GICR_IPRIORITYR + (irq / 4) * 4;
+  mmio_write32(prio, (mmio_read32(prio) & ~(0xff << shift)) | (priority << shift));
+  if (irq >= 16)
+  {
+    const int cfg_shift = (irq - 16) * 2;
+    const uint32_t cfg = mmio_read32(rd + GICR_ICFGR1);
+    mmio_write32(rd + GICR_ICFGR1, (cfg & ~(0x3 << cfg_shift)) | ((config & 0x3) << cfg_shift));
+  }
+  mmio_write32(rd + GICR_ICPENDR0, 1 << irq);
+  mmio_write32(rd + GICR_ISENABLER0, 1 << irq);
+}
+
+void gic_send_sgi(int cpu, uint8_t sgi)
+{
+  if (v3.version != 3)
+  {
+    // target list filter 0, the CPU interface of @cpu
+    gic.gicd->soft_int = ((1 << cpu) << 16) | (sgi & 0xf);
+    return;
+  }
+  const uint64_t mpidr = v3.mpidr[cpu];
+  const uint64_t val = (((mpidr >> 32) & 0xff) << 48)  // Aff3
+                     | (((mpidr >> 16) & 0xff) << 32)  // Aff2
+                     | (((mpidr >> 8) & 0xff) << 16)   // Aff1
+                     | ((uint64_t) (sgi & 0xf) << 24)
+                     | (1 << (mpidr & 0xf));           // target list of Aff0
+  asm volatile("dsb ishst" ::: "memory");
+  ICC_SYSREG_WRITE(ICC_SGI1R_EL1, val);
+}
+
+uint64_t gic_its_map_msi(uint32_t device, uint32_t event, int cpu, uint32_t intr)
+{
+  const uint32_t lpi = GIC_LPI_BASE + intr;
+  if (its.base == 0 or cpu < 0 or cpu >= GIC_MAX_CPUS or v3.rdist[cpu] == 0)
+    return 0;
+  if (event >= (1u << ITS_EVENT_BITS) or lpi < GIC_LPI_BASE
+      or lpi >= (1u << GIC_LPI_ID_BITS)) return 0;
+
+  its.lock.lock();
+  auto it = its.devices.find(device);
+  if (it == its.devices.end())
+  {
+    // a translation table for the device, 256 byte aligned
+    const size_t size = (its.itt_entry_size << ITS_EVENT_BITS) | 0xff;
+    auto* itt = (uint8_t*) aligned_alloc(256, size + 1);
+    memset(itt, 0, size + 1);
+    it = its.devices.emplace(device, its_params::device{itt, {}}).first;
+    its_command(GITS_CMD_MAPD | ((uint64_t) device << 32), ITS_EVENT_BITS - 1,
+                (1ull << 63) | (uintptr_t) itt);
+  }
+  auto& dev = it->second;
+  // moving an event to another CPU maps it anew
+  auto& word = dev.mapped[event / 64];
+  if (word & (1ull << (event % 64)))
+    its_command(GITS_CMD_DISCARD | ((uint64_t) device << 32), event, 0);
+  word |= 1ull << (event % 64);
+
+  its.prop_table[lpi - GIC_LPI_BASE] = GIC_LPI_PRIO_DEFAULT | GIC_LPI_ENABLE;
+  asm volatile("dsb ishst" ::: "memory");
+  its_command(GITS_CMD_MAPTI | ((uint64_t) device << 32),
+              event | ((uint64_t) lpi << 32), cpu);
+  its_command(GITS_CMD_INV | ((uint64_t) device << 32), event, 0);
+  its_sync(cpu);
+  its.lock.unlock();
+  return its.base + GITS_TRANSLATER;
+}
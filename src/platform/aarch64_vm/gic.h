@@ -25,6 +25,36 @@ void gicd_set_config(uint32_t irq,uint8_t config);
 
 int gicd_decode_irq();
 
+/** The version of the GIC found in the device tree, 2 or 3 */
+int gic_version();
+
+/**
+ * Set up the interface of the calling CPU to the GIC: its CPU interface,
+ * and for GICv3 its redistributor and LPIs. Called on every CPU.
+ */
+void gic_init_cpu(int cpu, uint64_t mpidr);
+
+/**
+ * Acknowledge the highest priority pending interrupt, and get its INTID.
+ * @ack is what gic_eoi() takes, as GICv2 SGIs carry their source CPU.
+ */
+uint32_t gic_ack_irq(uint32_t* ack);
+/** End the handling of an interrupt, with @ack from gic_ack_irq() */
+void gic_eoi(uint32_t ack);
+
+/** Configure and enable a private interrupt (SGI or PPI) of this CPU */
+void gic_ppi_enable(uint32_t irq, uint8_t priority, uint8_t config);
+
+/** Send software generated interrupt @sgi to @cpu */
+void gic_send_sgi(int cpu, uint8_t sgi);
+
+/**
+ * Have MSI @event of PCI device @device raise interrupt @intr on @cpu,
+ * as LPI GIC_LPI_BASE + @intr, through the interrupt translation service.
+ * Returns the address the device writes @event to, or 0 if there is no ITS.
+ */
+uint64_t gic_its_map_msi(uint32_t device, uint32_t event, int cpu, uint32_t intr);
+
 #if defined(__cplusplus)
 }
 #endif
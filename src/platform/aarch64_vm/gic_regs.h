@@ -102,4 +102,73 @@ struct gic_v3_distributor_map {
 
 
 
+/** GICv3 distributor, beyond the GICv2 compatible map */
+#define GICD_CTLR_V3_GRP0       (1 << 0)
+#define GICD_CTLR_V3_GRP1       (1 << 1)
+#define GICD_CTLR_V3_ARE        (1 << 4)
+#define GICD_CTLR_V3_RWP        (1u << 31)
+/** Interrupt routing, one 64-bit affinity per SPI */
+#define GICD_IROUTER            0x6000
+
+/**
+ * GICv3 redistributor, one per CPU: a frame of control registers then a
+ * frame for its SGIs and PPIs, 64k each (GICv4 adds two more frames)
+ */
+#define GICR_FRAME_SIZE         0x10000
+#define GICR_CTLR               0x0000
+#define GICR_TYPER              0x0008
+#define GICR_WAKER              0x0014
+#define GICR_PROPBASER          0x0070
+#define GICR_PENDBASER          0x0078
+#define GICR_SGI_BASE           0x10000
+#define GICR_IGROUPR0           (GICR_SGI_BASE + 0x0080)
+#define GICR_ISENABLER0         (GICR_SGI_BASE + 0x0100)
+#define GICR_ICENABLER0         (GICR_SGI_BASE + 0x0180)
+#define GICR_ICPENDR0           (GICR_SGI_BASE + 0x0280)
+#define GICR_IPRIORITYR         (GICR_SGI_BASE + 0x0400)
+#define GICR_ICFGR1             (GICR_SGI_BASE + 0x0C04)
+
+#define GICR_CTLR_ENABLE_LPIS   (1 << 0)
+#define GICR_TYPER_VLPIS        (1 << 1)
+#define GICR_TYPER_LAST         (1 << 4)
+#define GICR_WAKER_SLEEP        (1 << 1)
+#define GICR_WAKER_ASLEEP       (1 << 2)
+
+/** GICv3 interrupt translation service, turning MSI writes into LPIs */
+#define GITS_CTLR               0x0000
+#define GITS_TYPER              0x0008
+#define GITS_CBASER             0x0080
+#define GITS_CWRITER            0x0088
+#define GITS_CREADR             0x0090
+#define GITS_BASER              0x0100
+#define GITS_TRANSLATER         0x10040
+
+#define GITS_CTLR_ENABLED       (1 << 0)
+#define GITS_TYPER_PTA          (1 << 19)
+#define GITS_BASER_VALID        (1ull << 63)
+#define GITS_BASER_TYPE_DEVICE  1
+#define GITS_BASER_TYPE_COLL    4
+#define GITS_CBASER_VALID       (1ull << 63)
+/** Normal memory, inner shareable, write-back: the tables stay coherent */
+#define GITS_CACHE_WB           (7ull << 59)
+#define GITS_SHARE_INNER        (1ull << 10)
+// inner cacheability of GICR_PROPBASER and GICR_PENDBASER
+#define GICR_BASER_CACHE_WB     (7ull << 7)
+
+/** Commands of the ITS command queue, 32 bytes each */
+#define GITS_CMD_SYNC           0x05
+#define GITS_CMD_MAPD           0x08
+#define GITS_CMD_MAPC           0x09
+#define GITS_CMD_MAPTI          0x0A
+#define GITS_CMD_INV            0x0C
+#define GITS_CMD_DISCARD        0x0F
+
+/** The first LPI, every INTID below is an SGI, PPI or SPI */
+#define GIC_LPI_BASE            8192
+/** LPI INTIDs are 14 bits, GIC_LPI_BASE to 16383 */
+#define GIC_LPI_ID_BITS         14
+/** LPI priority and enable, one byte per LPI in the configuration table */
+#define GIC_LPI_PRIO_DEFAULT    0xA0
+#define GIC_LPI_ENABLE          0x1
+
 #endif
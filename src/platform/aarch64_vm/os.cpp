@@ -22,6 +22,9 @@ uint64_t os::cycles_asleep() noexcept {
 uint64_t os::nanos_asleep() noexcept {
   return (PER_CPU(os_per_cpu).cycles_hlt * 1e6) / os::cpu_freq().count();
 }
+uint64_t os::nanos_stolen() noexcept {
+  return 0;
+}
 
 extern kernel::ctor_t __stdout_ctors_start;
 extern kernel::ctor_t __stdout_ctors_end;
@@ -18,6 +18,7 @@ extern "C" {
 
 #include "exception_handling.hpp"
 #include "gic.h"
+#include "smp.hpp"
 
 extern "C" void noop_eoi() {}
 extern "C" void cpu_sampling_irq_handler() {}
@@ -30,44 +31,11 @@ void (*current_eoi_mechanism)() = noop_eoi;
 void (*current_intr_handler)() = nullptr;
 */
 
+#define TIMER_IRQ 27
 
-void __platform_init(uint64_t fdt_addr)
+// the virtual timer of the calling CPU, a PPI of its own
+void aarch64::init_cpu_timer()
 {
-  //printf("printf os start\r\n");
-  //belongs in platform ?
-  const char *fdt=(const char *)fdt_addr;
-  printf("fdt addr %zx\r\n",fdt_addr);
-  //checks both magic and version
-  if ( fdt_check_header(fdt) != 0 )
-  {
-    printf("FDT Header check failed\r\n");
-    return;
-  }
-  const int intc = fdt_path_offset(fdt, "/intc");
-
-  if (intc < 0) //interrupt controller not found in fdt.. should never happen..
-  {
-    printf("interrupt controller not found in dtb\r\n");
-    return;
-  }
-  if (fdt_node_check_compatible(fdt,intc,"arm,cortex-a15-gic") == 0)
-  {
-    printf("init gic\r\n");
-    gic_init_fdt(fdt,intc);
-  }
-
-  Events::get(0).init_local();
-
-  struct alignas(SMP_ALIGN) timer_data
-  {
-    int  intr;
-    bool intr_enabled = false;
-  };
-  static std::vector<timer_data> timerdata;
-  SMP_RESIZE_GCTOR(timerdata);
-
-  #define TIMER_IRQ 27
-
   //frequency is in ticks per second
   static uint32_t ticks_per_micro = timer_get_frequency()/1000000;
 
@@ -92,21 +60,45 @@ void __platform_init(uint64_t fdt_addr)
     }
   );
 
-  /* TODO figure out what these are for
-  PER_CPU(timerdata).intr=TIMER_IRQ;
-  Events::get().subscribe(TIMER_IRQ,Timers::timers_handler);
-*/
   //regiser the event handler for the irq.. ?
   register_handler(TIMER_IRQ,&Timers::timers_handler);
-
-  gicd_set_config(TIMER_IRQ,GICD_ICFGR_EDGE);
   //highest possible priority
-  gicd_set_priority(TIMER_IRQ,0);
-  //TODO get what core we are on
-  gicd_set_target(TIMER_IRQ,0x01); //target is processor 1
-  gicd_irq_clear(TIMER_IRQ);
+  gic_ppi_enable(TIMER_IRQ,0,GICD_ICFGR_EDGE);
+}
+
+
+void __platform_init(uint64_t fdt_addr)
+{
+  //printf("printf os start\r\n");
+  //belongs in platform ?
+  const char *fdt=(const char *)fdt_addr;
+  printf("fdt addr %zx\r\n",fdt_addr);
+  //checks both magic and version
+  if ( fdt_check_header(fdt) != 0 )
+  {
+    printf("FDT Header check failed\r\n");
+    return;
+  }
+  const int intc = fdt_path_offset(fdt, "/intc");
+
+  if (intc < 0) //interrupt controller not found in fdt.. should never happen..
+  {
+    printf("interrupt controller not found in dtb\r\n");
+    return;
+  }
+  if (fdt_node_check_compatible(fdt,intc,"arm,cortex-a15-gic") == 0
+   || fdt_node_check_compatible(fdt,intc,"arm,gic-v3") == 0)
+  {
+    printf("init gic\r\n");
+    gic_init_fdt(fdt,intc);
+  }
+
+  Events::get(0).init_local();
+
+  // the interfaces of this CPU, events from the others, and the APs
+  aarch64::init_SMP(fdt);
 
-  gicd_irq_enable(TIMER_IRQ);
+  aarch64::init_cpu_timer();
 
   //cpu_fiq_enable();
   cpu_irq_enable();
@@ -162,9 +154,6 @@ void __arch_enable_legacy_irq(unsigned char){}
 void __arch_disable_legacy_irq(unsigned char){}
 */
 
-void SMP::global_lock() noexcept {}
-void SMP::global_unlock() noexcept {}
-int SMP::cpu_count() noexcept { return 1; }
 
 
 
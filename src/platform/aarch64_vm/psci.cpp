@@ -0,0 +1,44 @@
+#include "psci.hpp"
+#include <cstring>
+
+extern "C" {
+  #include <libfdt.h>
+}
+
+namespace psci {
+
+static bool use_hvc = true;
+static bool present = false;
+
+bool init(const char* fdt)
+{
+  const int node = fdt_path_offset(fdt, "/psci");
+  if (node < 0) return false;
+  int len;
+  const char* method = (const char*) fdt_getprop(fdt, node, "method", &len);
+  if (method == nullptr) return false;
+  use_hvc = strcmp(method, "hvc") == 0;
+  present = use_hvc or strcmp(method, "smc") == 0;
+  return present;
+}
+
+static int64_t call(uint64_t func, uint64_t a1, uint64_t a2, uint64_t a3)
+{
+  register uint64_t x0 asm("x0") = func;
+  register uint64_t x1 asm("x1") = a1;
+  register uint64_t x2 asm("x2") = a2;
+  register uint64_t x3 asm("x3") = a3;
+  if (use_hvc)
+    asm volatile("hvc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3) : "memory");
+  else
+    asm volatile("smc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3) : "memory");
+  return x0;
+}
+
+int cpu_on(uint64_t mpidr, uintptr_t entry, uint64_t context)
+{
+  if (not present) return NOT_SUPPORTED;
+  return call(CPU_ON, mpidr, entry, context);
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef AARCH64_PSCI_HPP
+#define AARCH64_PSCI_HPP
+
+#include <cstdint>
+
+// the Power State Coordination Interface, of the firmware or hypervisor
+namespace psci {
+
+  static const uint32_t CPU_ON = 0xC4000003; // SMC64
+
+  static const int SUCCESS         = 0;
+  static const int NOT_SUPPORTED   = -1;
+  static const int ALREADY_ON      = -4;
+
+  // find the conduit (hvc or smc) in the fdt, false when there is no PSCI
+  bool init(const char* fdt);
+
+  // start the CPU @mpidr at @entry, with @context in x0
+  int cpu_on(uint64_t mpidr, uintptr_t entry, uint64_t context);
+
+}
+
+#endif
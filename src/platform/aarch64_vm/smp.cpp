@@ -0,0 +1,299 @@
+#include "smp.hpp"
+#include "psci.hpp"
+#include "gic.h"
+#include "exception_handling.hpp"
+#include <kernel/events.hpp>
+#include <kernel/smp_common.hpp>
+#include <kernel/timers.hpp>
+#include <info>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cpu.h>
+
+extern "C" {
+  #include <libfdt.h>
+  extern void __smp_secondary_start();
+}
+extern uint64_t fdt_load_addr(const struct fdt_property*, int* offset, int addr_cells);
+
+// SMP::cpu_id() is Aff0 of the MPIDR, so the CPUs of one cluster
+static const int       MAX_CPUS   = 8;
+static const uint32_t  STACK_SIZE = 1 << 16; // 64kb
+// the software generated interrupt delivering events to a CPU
+static const uint8_t   SGI_EVENTS = 1;
+// where QEMU places the fdt, as in kernel_start
+static const uintptr_t FDT_LOCATION = 0x40000000;
+
+static struct {
+  int      count = 0;
+  uint64_t mpidr[MAX_CPUS];
+} cpus;
+
+// events raised on a CPU by the others, delivered by SGI_EVENTS
+struct alignas(SMP_ALIGN) remote_events {
+  std::atomic<uint64_t> bits[(Events::NUM_EVENTS + 63) / 64];
+};
+static std::array<remote_events, MAX_CPUS> remote;
+static uint8_t  bsp_done_evt = 0;
+static uint64_t bsp_tpidr    = 0;
+
+static int fdt_cpus(const char* fdt)
+{
+  if (cpus.count > 0) return cpus.count;
+  const int node = (fdt_check_header(fdt) == 0) ? fdt_path_offset(fdt, "/cpus") : -1;
+  if (node >= 0)
+  {
+    const int addr_cells = fdt_address_cells(fdt, node);
+    for (int sub = fdt_first_subnode(fdt, node); sub >= 0;
+         sub = fdt_next_subnode(fdt, sub))
+    {
+      const char* type = (const char*) fdt_getprop(fdt, sub, "device_type", nullptr);
+      if (type == nullptr or strcmp(type, "cpu") != 0) continue;
+      int len, offset = 0;
+      const auto* prop = fdt_get_property(fdt, sub, "reg", &len);
+      if (prop == nullptr) continue;
+      const uint64_t mpidr = fdt_load_addr(prop, &offset, addr_cells);
+      // numbered from 0 by Aff0, in the first cluster
+      if (mpidr != (uint64_t) cpus.count or cpus.count == MAX_CPUS) break;
+      cpus.mpidr[cpus.count++] = mpidr;
+    }
+  }
+  if (cpus.count == 0) {
+    cpus.mpidr[0] = 0;
+    cpus.count = 1;
+  }
+  return cpus.count;
+}
+
+static void events_sgi_handler()
+{
+  auto& pending = remote.at(SMP::cpu_id());
+  auto& events  = Events::get();
+  for (size_t word = 0; word < std::size(pending.bits); word++)
+  {
+    uint64_t bits = pending.bits[word].exchange(0);
+    while (bits) {
+      events.trigger_event(word * 64 + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+}
+
+static void init_cpu_interrupts(int cpu)
+{
+  uint64_t mpidr;
+  asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+  gic_init_cpu(cpu, mpidr);
+  gic_ppi_enable(SGI_EVENTS, 0, GICD_ICFGR_EDGE);
+}
+
+extern "C" __attribute__((noreturn))
+void __smp_secondary_main()
+{
+  // the thread of the boot CPU, as there are no threads of our own
+  asm volatile("msr tpidr_el0, %0" :: "r"(bsp_tpidr));
+  const int cpu = SMP::cpu_id();
+  init_cpu_interrupts(cpu);
+
+  auto& ev = Events::get(cpu);
+  ev.init_local();
+  // subscribe to tasks
+  ev.subscribe(0, smp::smp_task_handler);
+  aarch64::init_cpu_timer();
+  cpu_irq_enable();
+  Timers::ready();
+
+  // allow programmers to do stuff on each core at init
+  SMP::init_task();
+
+  // signal that the CPU has started
+  smp::main_system.boot_barrier.increment();
+
+  SMP::global_lock();
+  smp::main_system.initialized_cpus.push_back(cpu);
+  SMP::global_unlock();
+  while (true)
+  {
+    Events::get().process_events();
+    Events::get().halt();
+  }
+  __builtin_unreachable();
+}
+
+namespace aarch64
+{
+
+void init_SMP(const char* fdt)
+{
+  const int count = fdt_cpus(fdt);
+  // avoid heap usage during AP init
+  smp::main_system.initialized_cpus.reserve(count);
+  smp::systems.resize(count);
+
+  register_handler(SGI_EVENTS, events_sgi_handler);
+  init_cpu_interrupts(0);
+  bsp_done_evt = Events::get(0).subscribe(smp::task_done_handler);
+  if (count <= 1) return;
+
+  if (not psci::init(fdt)) {
+    INFO("SMP", "No PSCI, staying on one of %d CPUs", count);
+    return;
+  }
+  void* stack = aligned_alloc(4096, count * STACK_SIZE);
+  smp::main_system.stack_base = (uintptr_t) stack;
+  smp::main_system.stack_size = STACK_SIZE;
+  asm volatile("mrs %0, tpidr_el0" : "=r"(bsp_tpidr));
+
+  // reset barrier
+  smp::main_system.boot_barrier.reset(1);
+
+  INFO("SMP", "Starting APs");
+  int started = 1;
+  for (int cpu = 1; cpu < count; cpu++)
+  {
+    // the stack grows down, from the end of its slot
+    const uintptr_t top = smp::main_system.stack_base + (cpu + 1) * STACK_SIZE - 16;
+    const int res = psci::cpu_on(cpus.mpidr[cpu], (uintptr_t) &__smp_secondary_start, top);
+    if (res != psci::SUCCESS) {
+      INFO("SMP", "CPU %d did not start (%d)", cpu, res);
+      continue;
+    }
+    started++;
+  }
+
+  // wait for all APs to start
+  smp::main_system.boot_barrier.spin_wait(started);
+  INFO("SMP", "%d of %d CPUs are online now", started, count);
+}
+
+} // aarch64
+
+/// implementation of the SMP interface ///
+int SMP::cpu_count() noexcept {
+  return smp::main_system.initialized_cpus.size();
+}
+const std::vector<int>& SMP::active_cpus() {
+  return smp::main_system.initialized_cpus;
+}
+size_t SMP::early_cpu_total() noexcept {
+  return fdt_cpus((const char*) FDT_LOCATION);
+}
+
+__attribute__((weak))
+void SMP::init_task()
+{
+  /* do nothing */
+}
+
+void SMP::add_task(SMP::task_func task, SMP::done_func done, int cpu)
+{
+  // tasks for any CPU go to our own deque, for idle CPUs to steal
+  if (cpu == 0)
+  {
+    auto* t = new smp::task(std::move(task), std::move(done));
+    if (LIKELY(PER_CPU(smp::systems).work.push(t))) return;
+    // when full, the task list of CPU 0 is shared by all CPUs
+    task = std::move(t->func);
+    done = std::move(t->done);
+    delete t;
+  }
+  auto& system = smp::systems.at(cpu);
+  system.tlock.lock();
+  system.tasks.emplace_back(std::move(task), std::move(done));
+  system.tlock.unlock();
+}
+void SMP::add_task(SMP::task_func task, int cpu)
+{
+  SMP::add_task(std::move(task), nullptr, cpu);
+}
+int SMP::add_balanced_task(SMP::task_func task, SMP::done_func done)
+{
+  const int cpu = SMP::least_loaded_cpu();
+  if (cpu == 0) {
+    // no other CPUs to run it
+    task();
+    if (done != nullptr) done();
+    return 0;
+  }
+  SMP::add_task(std::move(task), std::move(done), 0);
+  // the least loaded CPU steals it, or anyone earlier
+  SMP::signal(cpu);
+  return cpu;
+}
+static int least_loaded(const std::vector<int>& cpus, bool skip_bsp)
+{
+  int best = 0;
+  int64_t best_load = INT64_MAX;
+  for (const int cpu : cpus)
+  {
+    if (cpu == 0 and skip_bsp) continue;
+    auto& system = smp::systems.at(cpu);
+    // racy, but a hint is all that is needed
+    const int64_t load = system.work.size() + system.tasks.size();
+    if (load < best_load) {
+      best = cpu;
+      best_load = load;
+    }
+  }
+  return best;
+}
+int SMP::least_loaded_cpu()
+{
+  const auto& cpus = SMP::active_cpus();
+  return least_loaded(cpus, cpus.size() > 1);
+}
+int SMP::least_loaded_cpu(const std::vector<int>& cpus)
+{
+  return least_loaded(cpus, false);
+}
+void SMP::add_bsp_task(SMP::done_func task)
+{
+  // queue job
+  auto& system = PER_CPU(smp::systems);
+  system.flock.lock();
+  system.completed.push_back(std::move(task));
+  system.flock.unlock();
+  // set this CPU bit
+  smp::main_system.bitmap.atomic_set(SMP::cpu_id());
+  // call home
+  SMP::signal_bsp();
+}
+
+void SMP::signal(int cpu)
+{
+  // event 0 runs tasks on the APs
+  if (cpu == 0)
+      SMP::broadcast(0);
+  else
+      SMP::unicast(cpu, 0);
+}
+void SMP::signal_bsp()
+{
+  SMP::unicast(0, bsp_done_evt);
+}
+
+void SMP::broadcast(uint8_t evt)
+{
+  // everyone but ourselves, as with the APIC
+  const int self = SMP::cpu_id();
+  for (const int cpu : SMP::active_cpus())
+    if (cpu != self) SMP::unicast(cpu, evt);
+}
+void SMP::unicast(int cpu, uint8_t evt)
+{
+  if (UNLIKELY(evt >= Events::NUM_EVENTS)) return;
+  remote.at(cpu).bits[evt / 64].fetch_or(1ull << (evt % 64));
+  gic_send_sgi(cpu, SGI_EVENTS);
+}
+
+static smp_spinlock g_global_lock;
+
+void SMP::global_lock() noexcept
+{
+  g_global_lock.lock();
+}
+void SMP::global_unlock() noexcept
+{
+  g_global_lock.unlock();
+}
@@ -0,0 +1,18 @@
+#pragma once
+#ifndef AARCH64_SMP_HPP
+#define AARCH64_SMP_HPP
+
+#include <cstdint>
+#include <smp>
+
+namespace aarch64 {
+
+  // start the CPUs in the fdt, each running its own event loop
+  extern void init_SMP(const char* fdt);
+
+  // timers of the calling CPU, from platform.cpp
+  extern void init_cpu_timer();
+
+}
+
+#endif
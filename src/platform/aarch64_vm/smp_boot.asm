@@ -0,0 +1,25 @@
+/*
+  Entry of the secondary CPUs, started by PSCI CPU_ON at EL1 with the MMU
+  off, as the boot CPU runs. x0 holds the top of the stack of the CPU.
+*/
+.text
+.global __smp_secondary_start
+.extern exception_vector
+.extern __smp_secondary_main
+
+.align 8
+__smp_secondary_start:
+    msr     daifset, #0xF           /* disable all exceptions */
+    adr     x1, exception_vector
+    msr     vbar_el1, x1
+    mov     x1, #3 << 20
+    msr     cpacr_el1, x1           /* Enable FP/SIMD */
+    isb
+
+    mov     sp, x0
+    mov     x29, xzr                /* end of the frame chain */
+    mov     x30, xzr
+    bl      __smp_secondary_main
+1:
+    wfi
+    b       1b
@@ -0,0 +1,66 @@
+#include <arch/x86/cpu.hpp>
+#include <kernel/cpuid.hpp>
+#include <info>
+#include <smp>
+#include <algorithm>
+#include <array>
+
+// *** manual ***
+// https://www.kernel.org/doc/Documentation/virtual/kvm/hypercalls.txt
+// https://www.kernel.org/doc/Documentation/virtual/kvm/cpuid.txt
+
+#define KVM_HC_KICK_CPU        5
+
+// the lock each vCPU is halted waiting for, if any
+struct alignas(SMP_ALIGN) pv_waiter
+{
+  volatile spinlock_t* volatile lock = nullptr;
+};
+static std::array<pv_waiter, 256> waiters;
+static bool use_vmmcall = false;
+
+static void kvm_kick_cpu(int apic_id)
+{
+  // wakes the vCPU, or makes its next halt return right away
+  long ret;
+  if (use_vmmcall)
+    asm volatile("vmmcall" : "=a"(ret) : "a"(KVM_HC_KICK_CPU), "b"(0), "c"(apic_id) : "memory");
+  else
+    asm volatile("vmcall"  : "=a"(ret) : "a"(KVM_HC_KICK_CPU), "b"(0), "c"(apic_id) : "memory");
+}
+
+static void kvm_lock_wait(volatile spinlock_t* lock)
+{
+  auto& me = PER_CPU(waiters);
+  me.lock = lock;
+  // the holder kicks us once released, when seeing the flag
+  __atomic_fetch_or(lock, smp_spinlock::WAITERS, __ATOMIC_SEQ_CST);
+  if (*lock & smp_spinlock::LOCKED) {
+    // KVM wakes a halted vCPU on a kick even with interrupts off
+    asm volatile("hlt" ::: "memory");
+  }
+  me.lock = nullptr;
+}
+
+static void kvm_lock_kick(volatile spinlock_t* lock)
+{
+  // every waiter retries, the ones losing the race halt again
+  const int cpus = std::min<int>(SMP::early_cpu_total(), waiters.size());
+  for (int cpu = 0; cpu < cpus; cpu++)
+  {
+    if (waiters[cpu].lock == lock)
+      kvm_kick_cpu(cpu);
+  }
+}
+
+void kvm_pv_spinlock_init()
+{
+  // with one vCPU there is no one to wait for
+  if (SMP::early_cpu_total() <= 1) return;
+  use_vmmcall = CPUID::is_amd_cpu();
+  // kick first, so that every waiter is seen by an unlock
+  smp::pv_lock_kick = kvm_lock_kick;
+  __sync_synchronize();
+  smp::pv_lock_wait = kvm_lock_wait;
+  INFO("KVM", "Paravirtual spinlocks enabled");
+}
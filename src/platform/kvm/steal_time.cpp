@@ -0,0 +1,76 @@
+#include "steal_time.hpp"
+#include <arch/x86/cpu.hpp>
+#include <statman>
+#include <info>
+#include <smp>
+#include <array>
+
+using namespace x86;
+
+// *** manual ***
+// https://www.kernel.org/doc/Documentation/virtual/kvm/msr.txt
+
+#define KVM_MSR_ENABLED        1
+#define MSR_KVM_STEAL_TIME     0x4b564d03
+
+struct alignas(64) kvm_steal_time {
+  uint64_t steal;
+  uint32_t version;
+  uint32_t flags;
+  uint8_t  preempted;
+  uint8_t  pad0[3];
+  uint32_t pad1[11];
+};
+static_assert(sizeof(kvm_steal_time) == 64, "The area is 64 bytes");
+
+struct alignas(SMP_ALIGN) steal_cpu
+{
+  kvm_steal_time area {};
+  uint64_t last = 0;
+};
+static std::array<steal_cpu, 256> steal_time;
+static Stat_percpu* steal_stat = nullptr;
+
+void KVM_steal_time::init()
+{
+  auto& cpu = PER_CPU(steal_time);
+  CPU::write_msr(MSR_KVM_STEAL_TIME, (uintptr_t) &cpu.area | KVM_MSR_ENABLED);
+  cpu.last = nanos();
+  if (SMP::cpu_id() == 0) {
+    steal_stat = &Statman::get().create_percpu("kvm.steal_ns");
+    INFO("KVM", "Steal time accounting enabled");
+  }
+}
+
+bool KVM_steal_time::enabled() noexcept
+{
+  return steal_stat != nullptr;
+}
+
+uint64_t KVM_steal_time::nanos() noexcept
+{
+  // the version is odd while the hypervisor updates the area
+  const auto& area = PER_CPU(steal_time).area;
+  uint32_t version;
+  uint64_t steal;
+  do {
+    version = __atomic_load_n(&area.version, __ATOMIC_ACQUIRE);
+    steal   = __atomic_load_n(&area.steal, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((version & 1) or version != __atomic_load_n(&area.version, __ATOMIC_RELAXED));
+  return steal;
+}
+
+void KVM_steal_time::update() noexcept
+{
+  if (steal_stat == nullptr) return;
+  auto& cpu = PER_CPU(steal_time);
+  const uint64_t now = nanos();
+  *steal_stat += now - cpu.last;
+  cpu.last = now;
+}
+
+void KVM_steal_time::deactivate()
+{
+  CPU::write_msr(MSR_KVM_STEAL_TIME, 0);
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+
+// time the hypervisor ran something else while this vCPU was ready to run
+struct KVM_steal_time
+{
+  // on each CPU
+  static void init();
+  static bool enabled() noexcept;
+  // nanoseconds stolen from this vCPU so far
+  static uint64_t nanos() noexcept;
+  // add what was stolen since the last update to the stats
+  static void update() noexcept;
+  static void deactivate();
+};
@@ -37,6 +37,7 @@ void kernel_start(uintptr_t magic, uintptr_t addr)
   // Initialize .bss
   extern char _BSS_START_, _BSS_END_;
   __builtin_memset(&_BSS_START_, 0, &_BSS_END_ - &_BSS_START_);
+  kernel::boot_phase("Heap and syscalls");
 
   // Initialize heap
   kernel::init_heap(free_mem_begin, mem_end);
@@ -48,10 +49,13 @@ void kernel_start(uintptr_t magic, uintptr_t addr)
   if (os_default_stdout)
     os::add_stdout(&kernel::default_stdout);
 
+  kernel::boot_phase("Multiboot and IDT");
   kernel::start(magic, addr);
 
   // Start the service
+  kernel::boot_phase("Service::start");
   Service::start();
+  kernel::boot_finish();
 
   __arch_poweroff();
 }
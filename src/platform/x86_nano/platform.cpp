@@ -62,6 +62,10 @@ void SMP::global_lock() noexcept {}
 void SMP::global_unlock() noexcept {}
 int SMP::cpu_id() noexcept { return 0; }
 int SMP::cpu_count() noexcept { return 1; }
+size_t SMP::early_cpu_total() noexcept { return 1; }
+void SMP::unicast(int, uint8_t) {}
+
+uint64_t os::nanos_stolen() noexcept { return 0; }
 
 void os::halt() noexcept {
   asm("hlt");
@@ -1,9 +1,12 @@
 
 #include "acpi.hpp"
 #include <os.hpp>
+#include <kernel.hpp>
+#include <kernel/memory.hpp>
 #include <hw/ioport.hpp>
 #include <debug>
 #include <info>
+#include <smp>
 
 extern "C" void reboot_os();
 extern "C" void apm_shutdown();
@@ -57,6 +60,58 @@ namespace x86 {
     MADTRecord record[0];
   };
 
+  struct SRATHeader
+  {
+    SDTHeader  hdr;
+    uint32_t   revision; // 1
+    uint64_t   reserved;
+    MADTRecord record[0];
+  } __attribute__((packed));
+
+  struct SRAT_cpu
+  {
+    uint8_t  type;
+    uint8_t  length;
+    uint8_t  domain_lo;
+    uint8_t  apic_id;
+    uint32_t flags; // 1 = enabled
+    uint8_t  sapic_eid;
+    uint8_t  domain_hi[3];
+    uint32_t clock_domain;
+  } __attribute__((packed));
+
+  struct SRAT_memory
+  {
+    uint8_t  type;
+    uint8_t  length;
+    uint32_t domain;
+    uint16_t reserved1;
+    uint64_t base;
+    uint64_t size;
+    uint32_t reserved2;
+    uint32_t flags; // 1 = enabled
+    uint64_t reserved3;
+  } __attribute__((packed));
+
+  struct SRAT_x2apic
+  {
+    uint8_t  type;
+    uint8_t  length;
+    uint16_t reserved1;
+    uint32_t domain;
+    uint32_t x2apic_id;
+    uint32_t flags; // 1 = enabled
+    uint32_t clock_domain;
+    uint32_t reserved2;
+  } __attribute__((packed));
+
+  struct SLITHeader
+  {
+    SDTHeader hdr;
+    uint64_t  localities;
+    uint8_t   entry[0];
+  } __attribute__((packed));
+
   struct FACPHeader
   {
     SDTHeader sdt;
@@ -154,6 +209,10 @@ namespace x86 {
     constexpr uint32_t APIC_t = bake('A', 'P', 'I', 'C');
     constexpr uint32_t HPET_t = bake('H', 'P', 'E', 'T');
     constexpr uint32_t FACP_t = bake('F', 'A', 'C', 'P');
+    constexpr uint32_t SRAT_t = bake('S', 'R', 'A', 'T');
+    constexpr uint32_t SLIT_t = bake('S', 'L', 'I', 'T');
+    // distances refer to domains, so the SLIT is read after the SRAT
+    const char* slit = nullptr;
 
     while (total > 0)
     {
@@ -181,10 +240,19 @@ namespace x86 {
         debug("FACP found: P=%p L=%u\n", sdt, sdt->Length);
         walk_facp((char*) sdt);
         break;
+      case SRAT_t:
+        debug("SRAT found: P=%p L=%u\n", sdt, sdt->Length);
+        walk_srat((char*) sdt);
+        break;
+      case SLIT_t:
+        debug("SLIT found: P=%p L=%u\n", sdt, sdt->Length);
+        slit = (const char*) sdt;
+        break;
       default:
         debug("Signature: %.*s (u=%u)\n", 4, sdt->Signature, sdt->sigint());
       }
     }
+    if (slit) walk_slit(slit);
     debug("Finished walking SDTs\n");
   }
 
@@ -248,6 +316,63 @@ namespace x86 {
     INFO("SMP", "Found %u APs", (uint32_t) lapics.size());
   }
 
+  void ACPI::walk_srat(const char* addr)
+  {
+    auto* hdr = (SRATHeader*) addr;
+    int len = hdr->hdr.Length - sizeof(SRATHeader);
+    const char* ptr = (char*) hdr->record;
+    int cpus = 0, ranges = 0;
+
+    while (len > 0) {
+      auto* rec = (MADTRecord*) ptr;
+      if (rec->length == 0) break;
+      switch (rec->type) {
+      case 0: // processor local APIC affinity
+        {
+          auto& cpu = *(SRAT_cpu*) rec;
+          if ((cpu.flags & 1) == 0) break;
+          const uint32_t domain = cpu.domain_lo | (cpu.domain_hi[0] << 8)
+                  | (cpu.domain_hi[1] << 16) | (cpu.domain_hi[2] << 24);
+          kernel::numa_add_cpu(cpu.apic_id, domain);
+          cpus++;
+        }
+        break;
+      case 1: // memory affinity
+        {
+          auto& mem = *(SRAT_memory*) rec;
+          if ((mem.flags & 1) == 0 or mem.size == 0) break;
+          kernel::numa_add_range(mem.base, mem.base + mem.size, mem.domain);
+          ranges++;
+        }
+        break;
+      case 2: // processor local x2APIC affinity
+        {
+          auto& cpu = *(SRAT_x2apic*) rec;
+          if ((cpu.flags & 1) == 0 or cpu.x2apic_id >= SMP_MAX_CORES) break;
+          kernel::numa_add_cpu(cpu.x2apic_id, cpu.domain);
+          cpus++;
+        }
+        break;
+      default:
+        break;
+      }
+      len -= rec->length;
+      ptr += rec->length;
+    }
+    INFO("NUMA", "%d nodes, %d CPUs and %d memory ranges",
+         os::mem::numa_nodes(), cpus, ranges);
+  }
+
+  void ACPI::walk_slit(const char* addr)
+  {
+    auto* hdr = (SLITHeader*) addr;
+    const uint64_t n = hdr->localities;
+    if (sizeof(SLITHeader) + n * n > hdr->hdr.Length) return;
+    for (uint64_t from = 0; from < n; from++)
+    for (uint64_t to = 0; to < n; to++)
+        kernel::numa_set_distance(from, to, hdr->entry[from * n + to]);
+  }
+
   void ACPI::walk_facp(const char* addr)
   {
     auto* facp = (FACPHeader*) addr;
@@ -88,6 +88,8 @@ namespace x86 {
     void walk_sdts(SDTHeader* addr);
     void walk_madt(const char* addr);
     void walk_facp(const char* addr);
+    void walk_srat(const char* addr);
+    void walk_slit(const char* addr);
 
     uintptr_t hpet_base;
     uintptr_t apic_base;
@@ -32,6 +32,8 @@ namespace x86 {
     virtual void bcast_ipi(uint8_t vector) noexcept = 0;
 
     virtual void     timer_init(const uint8_t) = 0;
+    // arm with IA32_TSC_DEADLINE instead of the initial count
+    virtual void     timer_deadline_init(const uint8_t) = 0;
     virtual void     timer_begin(uint32_t) noexcept = 0;
     virtual uint32_t timer_diff() noexcept = 0;
     virtual void     timer_interrupt(bool) noexcept = 0;
@@ -55,7 +55,7 @@ void revenant_thread_main(int cpu)
     while (true)
     {
       Events::get().process_events();
-      os::halt();
+      Events::get().halt();
     }
     __builtin_unreachable();
 }
@@ -2,8 +2,11 @@
 #include "apic_timer.hpp"
 #include "apic.hpp"
 #include "pit.hpp"
+#include <arch/x86/cpu.hpp>
+#include <kernel/cpuid.hpp>
 #include <kernel/events.hpp>
 #include <kernel/timers.hpp>
+#include <os.hpp>
 #include <smp>
 #include <cstdio>
 #include <info>
@@ -17,12 +20,17 @@
 
 #define CALIBRATION_MS   125
 
+#define IA32_TSC_DEADLINE  0x6E0
+
 using namespace std::chrono;
 
 namespace x86
 {
   // calculated once on BSP
   static uint32_t ticks_per_micro = 0;
+  // TSC cycles per nanosecond, 32.32 fixed point, in TSC-deadline mode
+  static uint64_t tsc_per_nano = 0;
+  static bool     tsc_deadline = false;
 
   struct alignas(SMP_ALIGN) timer_data
   {
@@ -45,13 +53,25 @@ namespace x86
     GET_TIMER().intr =
         Events::get().subscribe(Timers::timers_handler);
     // initialize local APIC timer
-    APIC::get().timer_init(GET_TIMER().intr);
+    if (tsc_deadline)
+      APIC::get().timer_deadline_init(GET_TIMER().intr);
+    else
+      APIC::get().timer_init(GET_TIMER().intr);
   }
   void APIC_Timer::calibrate()
   {
+    // with TSC-deadline the timer counts CPU cycles, so there is
+    // nothing to measure, and arming it is a single WRMSR
+    const auto khz = os::cpu_freq().count();
+    if (CPUID::has_feature(CPUID::Feature::TSC_DEADLINE) and khz > 0)
+    {
+      tsc_deadline = true;
+      tsc_per_nano = (uint64_t) (khz / 1e6 * 4294967296.0);
+      INFO("APIC", "Timer in TSC-deadline mode");
+    }
     init();
 
-    if (ticks_per_micro != 0) {
+    if (ready()) {
       start_timers();
       // with SMP, signal everyone else too (IRQ 1)
       if (SMP::cpu_count() > 1) {
@@ -106,11 +126,23 @@ namespace x86
 
   bool APIC_Timer::ready() noexcept
   {
-    return ticks_per_micro != 0;
+    return tsc_deadline ? tsc_per_nano != 0 : ticks_per_micro != 0;
   }
 
   void APIC_Timer::oneshot(std::chrono::nanoseconds nanos) noexcept
   {
+    if (tsc_deadline)
+    {
+      // prevent oneshots less than a microsecond
+      const uint64_t ns = std::max<int64_t>(nanos.count(), 1000);
+      const uint64_t cycles = ((unsigned __int128) ns * tsc_per_nano) >> 32;
+      CPU::write_msr(IA32_TSC_DEADLINE, os::Arch::cpu_cycles() + cycles);
+      if (GET_TIMER().intr_enabled == false) {
+        GET_TIMER().intr_enabled = true;
+        APIC::get().timer_interrupt(true);
+      }
+      return;
+    }
     // prevent overflow
     uint64_t ticks = nanos.count() / 1000 * ticks_per_micro;
     if (ticks > 0xFFFFFFFF)
@@ -133,6 +165,9 @@ namespace x86
   {
     GET_TIMER().intr_enabled = false;
     APIC::get().timer_interrupt(false);
+    // disarm, so a pending deadline cannot fire once unmasked again
+    if (tsc_deadline)
+      CPU::write_msr(IA32_TSC_DEADLINE, 0);
   }
 
   // used by soft-reset
@@ -1,6 +1,7 @@
 
 #include "clocks.hpp"
 #include "../kvm/kvmclock.hpp"
+#include "../kvm/steal_time.hpp"
 #include "cmos_clock.hpp"
 #include "platform.hpp"
 #include <util/units.hpp>
@@ -50,6 +51,14 @@ namespace x86
         INFO("x86", "CMOS clock initialized");
       }
     }
+
+    // steal time, for the stats and the halt polling of each CPU
+    if (CPUID::kvm_feature(KVM_FEATURE_STEAL_TIME))
+    {
+      KVM_steal_time::init();
+      if (SMP::cpu_id() == 0)
+        x86::register_deactivation_function(KVM_steal_time::deactivate);
+    }
   }
 
   KHz Clocks::get_khz()
@@ -13,40 +13,49 @@ extern "C" uint16_t _cpu_sampling_freq_divider_;
 
 namespace x86
 {
+  // unix time in ns, and cycles since boot, at the last sync with the CMOS
   static uint64_t current_time;
   static uint64_t current_ticks;
+  // the same at init, for a system time that never goes backwards
+  static uint64_t boot_time;
+  static uint64_t boot_ticks;
+
+  static void sync()
+  {
+    current_time  = CMOS::now().to_epoch() * 1'000'000'000ull;
+    current_ticks = os::cycles_since_boot();
+  }
+
+  // the cycles are scaled once the CPU frequency is known
+  static uint64_t since(uint64_t time, uint64_t ticks)
+  {
+    return time + os::detail::cycles_to_nanos(os::cycles_since_boot() - ticks);
+  }
 
   void CMOS_clock::init()
   {
     using namespace std::chrono;
-    current_time  = CMOS::now().to_epoch();
-    current_ticks = os::cycles_since_boot();
+    sync();
+    boot_time  = current_time;
+    boot_ticks = current_ticks;
 
     INFO("CMOS", "Enabling regular clock sync for CMOS clock");
     // every minute recalibrate
     Timers::periodic(seconds(60), seconds(60),
-      [] (Timers::id_t) {
-        current_time  = CMOS::now().to_epoch();
-        current_ticks = os::cycles_since_boot();
-      });
+      [] (Timers::id_t) { sync(); });
   }
 
   uint64_t CMOS_clock::system_time()
   {
-    auto ticks = os::cycles_since_boot() - current_ticks;
-    auto diff  = (double) ticks / Hz(os::cpu_freq()).count();
-
-    return (current_time + diff) * 1000000000ull;
+    return since(boot_time, boot_ticks);
   }
   timespec CMOS_clock::wall_clock()
   {
-    using namespace util;
-    auto ticks = os::cycles_since_boot() - current_ticks;
-    auto diff  = (double) ticks / Hz(os::cpu_freq()).count();
+    const uint64_t now = since(current_time, current_ticks);
 
     timespec tval;
-    tval.tv_sec  = current_time + time_t(diff);
-    tval.tv_nsec = diff * 1000000000ull;
+    tval.tv_sec  = now / 1'000'000'000ull;
+    tval.tv_nsec = now % 1'000'000'000ull;
     return tval;
   }
 
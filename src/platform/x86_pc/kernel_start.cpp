@@ -76,6 +76,7 @@ void kernel_start(uint32_t magic, uint32_t addr)
 
   PRATTLE("* Init .bss\n");
   _init_bss();
+  kernel::boot_phase("Machine init");
 
   // Instantiate machine
   size_t memsize = memory_end - free_mem_begin;
@@ -88,18 +89,21 @@ void kernel_start(uint32_t magic, uint32_t addr)
   __machine->init();
 
   PRATTLE("* Early RNG init\n");
+  kernel::boot_phase("RNG init");
   {
     PROFILE("RNG init")
     // TODO: Move more stuff into Machine::init
     RNG::init();
   }
 
+  kernel::boot_phase("Syscalls and IDT");
   PRATTLE("* Init syscalls\n");
   _init_syscalls();
 
   PRATTLE("* Init CPU exceptions\n");
   x86::idt_initialize_for_cpu(0);
 
+  kernel::boot_phase("libc init");
   PRATTLE("* Init libc\n");
   x86::init_libc(magic, addr);
 }
@@ -12,6 +12,7 @@
 #include <service>
 #include <cstdio>
 #include "cmos.hpp"
+#include "../kvm/steal_time.hpp"
 //#define ENABLE_PROFILERS
 #include <profile>
 
@@ -30,6 +31,9 @@ uint64_t os::cycles_asleep() noexcept {
 uint64_t os::nanos_asleep() noexcept {
   return (PER_CPU(os_per_cpu).cycles_hlt * 1e6) / os::cpu_freq().count();
 }
+uint64_t os::nanos_stolen() noexcept {
+  return KVM_steal_time::enabled() ? KVM_steal_time::nanos() : 0;
+}
 
 __attribute__((noinline))
 void os::halt() noexcept
@@ -45,6 +49,8 @@ void os::halt() noexcept
 
   // Count sleep cycles
   PER_CPU(os_per_cpu).cycles_hlt += os::Arch::cpu_cycles() - cycles_before;
+  // and what the hypervisor took meanwhile
+  KVM_steal_time::update();
 }
 
 void kernel::default_stdout(const char* str, const size_t len)
@@ -57,10 +63,12 @@ extern kernel::ctor_t __stdout_ctors_end;
 extern void __arch_init_paging();
 extern void __platform_init();
 extern void elf_protect_symbol_areas();
+extern void mmap_init_stats();
 
 void kernel::start(uint32_t boot_magic, uint32_t boot_addr)
 {
   PROFILE("OS::start");
+  kernel::boot_phase("Stdout init");
   kernel::state().cmdline = Service::binary_name();
 
   // Initialize stdout handlers
@@ -78,12 +86,14 @@ void kernel::start(uint32_t boot_magic, uint32_t boot_addr)
   MYINFO("Boot magic: 0x%x, addr: 0x%x", boot_magic, boot_addr);
 
   // PAGING //
+  kernel::boot_phase("Enable paging");
   {
     PROFILE("Enable paging");
     __arch_init_paging();
   }
 
   // BOOT METHOD //
+  kernel::boot_phase("Multiboot / legacy");
   {
   PROFILE("Multiboot / legacy");
   // Detect memory limits etc. depending on boot type
@@ -106,6 +116,7 @@ void kernel::start(uint32_t boot_magic, uint32_t boot_addr)
   assert(kernel::heap_begin() != 0x0 and kernel::heap_max() != 0x0);
 
   // Assign memory ranges used by the kernel
+  kernel::boot_phase("Memory map");
   auto& memmap = os::mem::vmmap();
   INFO2("Assigning fixed memory ranges (Memory map)");
 
@@ -131,12 +142,21 @@ void kernel::start(uint32_t boot_magic, uint32_t boot_addr)
   INFO2("* Assigning heap 0x%zx -> 0x%zx", kernel::heap_begin(), heap_range_max_);
   memmap.assign_range({kernel::heap_begin(), heap_range_max_,
         "Dynamic memory", kernel::heap_usage });
+  mmap_init_stats();
 
   MYINFO("Virtual memory map");
   {
     PROFILE("Print memory map");
     for (const auto& entry : memmap)
-        INFO2("%s", entry.second.to_string().c_str());
+    {
+#if defined(ARCH_x86_64)
+      const auto& range = entry.second;
+      INFO2("%s [%s]", range.to_string().c_str(), os::mem::page_sizes_str(
+            os::mem::page_sizes_in(range.addr_start(), range.addr_end())).c_str());
+#else
+      INFO2("%s", entry.second.to_string().c_str());
+#endif
+    }
   }
 
   {
@@ -145,6 +165,7 @@ void kernel::start(uint32_t boot_magic, uint32_t boot_addr)
   }
 
   // Realtime/monotonic clock
+  kernel::boot_phase("RTC init");
   {
     PROFILE("RTC init");
     RTC::init();
@@ -157,7 +178,7 @@ void os::event_loop()
 {
   Events::get(0).process_events();
   do {
-    os::halt();
+    Events::get(0).halt();
     Events::get(0).process_events();
   } while (kernel::is_running());
 
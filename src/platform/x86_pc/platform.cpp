@@ -10,6 +10,7 @@
 #include <kernel/events.hpp>
 #include <kernel/threads.hpp>
 #include <hw/pci_manager.hpp>
+#include <kernel/cpuid.hpp>
 #include <kernel.hpp>
 #include <os.hpp>
 #include <info>
@@ -32,6 +33,7 @@ namespace x86 {
   void initialize_cpu_tables_for_cpu(int cpu);
   void register_deactivation_function(delegate<void()>);
 }
+extern void kvm_pv_spinlock_init();
 namespace kernel {
 	Fixed_vector<delegate<void()>, 64> smp_global_init(Fixedvector_Init::UNINIT);
 }
@@ -39,6 +41,7 @@ namespace kernel {
 void __platform_init()
 {
   // read ACPI tables
+  kernel::boot_phase("ACPI init");
   {
     PROFILE("ACPI init");
     x86::ACPI::init();
@@ -51,6 +54,7 @@ void __platform_init()
   kernel::setup_main_thread(0);
 
   // read SMBIOS tables
+  kernel::boot_phase("SMBIOS init");
   {
     PROFILE("SMBIOS init");
     x86::SMBIOS::init();
@@ -61,6 +65,7 @@ void __platform_init()
   //initialize_gdt_for_cpu(0);
 #ifdef ARCH_x86_64
   // setup Interrupt Stack Table
+  kernel::boot_phase("IST amd64");
   {
     PROFILE("IST amd64");
     x86::ist_initialize_for_cpu(0, 0x9D3F0);
@@ -68,17 +73,20 @@ void __platform_init()
 #endif
 
   INFO("x86", "Initializing CPU 0");
+  kernel::boot_phase("CPU tables x86");
   {
     PROFILE("CPU tables x86");
     x86::initialize_cpu_tables_for_cpu(0);
   }
 
+  kernel::boot_phase("Events init");
   {
     PROFILE("Events init");
     Events::get(0).init_local();
   }
 
   // setup APIC, APIC timer, SMP etc.
+  kernel::boot_phase("APIC init");
   {
     PROFILE("APIC init");
     x86::APIC::init();
@@ -91,7 +99,12 @@ void __platform_init()
     asm volatile("sti");
   }
 
+  // halt vCPUs waiting for a lock held by a preempted one
+  if (CPUID::kvm_feature(KVM_FEATURE_PV_UNHALT))
+      kvm_pv_spinlock_init();
+
   // initialize and start registered APs found in ACPI-tables
+  kernel::boot_phase("SMP init");
   {
     PROFILE("SMP init");
     x86::init_SMP();
@@ -99,25 +112,29 @@ void __platform_init()
 
   // Setup kernel clocks
   MYINFO("Setting up kernel clock sources");
+  kernel::boot_phase("Clocks init (x86)");
   {
     PROFILE("Clocks init (x86)");
     x86::Clocks::init();
   }
 
+  // known already after a soft reset
   if (os::cpu_freq().count() <= 0.0) {
-    kernel::state().cpu_khz = x86::Clocks::get_khz();
+    kernel::set_cpu_freq(x86::Clocks::get_khz());
   }
   INFO2("+--> %f MHz", os::cpu_freq().count() / 1000.0);
 
   // Note: CPU freq must be known before we can start timer system
   // Initialize APIC timers and timer systems
   // Deferred call to Service::ready() when calibration is complete
+  kernel::boot_phase("APIC timer calibrate");
   {
     PROFILE("APIC timer calibrate");
     x86::APIC_Timer::calibrate();
   }
 
   INFO2("Initializing drivers");
+  kernel::boot_phase("Initialize drivers");
   {
     PROFILE("Initialize drivers");
     extern kernel::ctor_t __driver_ctors_start;
@@ -126,6 +143,7 @@ void __platform_init()
   }
 
   // Scan PCI buses
+  kernel::boot_phase("PCI bus scan");
   {
     PROFILE("PCI bus scan");
     hw::PCI_manager::init();
@@ -133,9 +151,11 @@ void __platform_init()
   {
 	PROFILE("PCI device init")
     // Initialize storage devices
+    kernel::boot_phase("PCI storage init");
     hw::PCI_manager::init_devices(PCI::STORAGE);
     kernel::state().block_drivers_ready = true;
     // Initialize network devices
+    kernel::boot_phase("PCI NIC init");
     hw::PCI_manager::init_devices(PCI::NIC);
   }
 
@@ -145,17 +145,64 @@ void SMP::init_task()
 
 void SMP::add_task(SMP::task_func task, SMP::done_func done, int cpu)
 {
-  auto& system = PER_CPU(smp::systems);
+  // tasks for any CPU go to our own deque, for idle CPUs to steal
+  if (cpu == 0)
+  {
+    auto* t = new smp::task(std::move(task), std::move(done));
+    if (LIKELY(PER_CPU(smp::systems).work.push(t))) return;
+    // when full, the task list of CPU 0 is shared by all CPUs
+    task = std::move(t->func);
+    done = std::move(t->done);
+    delete t;
+  }
+  auto& system = smp::systems.at(cpu);
   system.tlock.lock();
   system.tasks.emplace_back(std::move(task), std::move(done));
   system.tlock.unlock();
 }
 void SMP::add_task(SMP::task_func task, int cpu)
 {
-  auto& system = PER_CPU(smp::systems);
-  system.tlock.lock();
-  system.tasks.emplace_back(std::move(task), nullptr);
-  system.tlock.unlock();
+  SMP::add_task(std::move(task), nullptr, cpu);
+}
+int SMP::add_balanced_task(SMP::task_func task, SMP::done_func done)
+{
+  const int cpu = SMP::least_loaded_cpu();
+  if (cpu == 0) {
+    // no other CPUs to run it
+    task();
+    if (done != nullptr) done();
+    return 0;
+  }
+  SMP::add_task(std::move(task), std::move(done), 0);
+  // the least loaded CPU steals it, or anyone earlier
+  SMP::signal(cpu);
+  return cpu;
+}
+static int least_loaded(const std::vector<int>& cpus, bool skip_bsp)
+{
+  int best = 0;
+  int64_t best_load = INT64_MAX;
+  for (const int cpu : cpus)
+  {
+    if (cpu == 0 and skip_bsp) continue;
+    auto& system = smp::systems.at(cpu);
+    // racy, but a hint is all that is needed
+    const int64_t load = system.work.size() + system.tasks.size();
+    if (load < best_load) {
+      best = cpu;
+      best_load = load;
+    }
+  }
+  return best;
+}
+int SMP::least_loaded_cpu()
+{
+  const auto& cpus = SMP::active_cpus();
+  return least_loaded(cpus, cpus.size() > 1);
+}
+int SMP::least_loaded_cpu(const std::vector<int>& cpus)
+{
+  return least_loaded(cpus, false);
 }
 void SMP::add_bsp_task(SMP::done_func task)
 {
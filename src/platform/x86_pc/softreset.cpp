@@ -65,7 +65,7 @@ void kernel::resume_softreset(intptr_t addr)
   kernel::state().liveupdate_phys = data->liveupdate_loc;
   kernel::state().liveupdate_size = data->liveupdate_size;
   kernel::state().is_live_updated = true;
-  kernel::state().cpu_khz = data->cpu_freq;
+  kernel::set_cpu_freq(data->cpu_freq);
   x86::apic_timer_set_ticks(data->apic_ticks);
 
   kernel::state().mmap_size = data->mmap_size;
@@ -145,6 +145,16 @@ x86_enable_avx:
   xor ecx, ecx
   xgetbv
   or eax, 0x7
+  mov ebx, eax
+  ;; also enable the AVX-512 state (opmask, ZMM) the CPU supports
+  mov eax, 0xd
+  xor ecx, ecx
+  cpuid
+  and eax, 0xe0
+  or ebx, eax
+  xor ecx, ecx
+  xgetbv
+  mov eax, ebx
   xsetbv
 avx_not_supported:
   pop ebx
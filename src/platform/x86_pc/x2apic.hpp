@@ -198,6 +198,15 @@ namespace x86 {
       // but also disable interrupts
       write(x2APIC_LVT_TMR, TIMER_ONESHOT | (32+timer_intr) | INTR_MASK);
     }
+    void timer_deadline_init(const uint8_t timer_intr) noexcept override
+    {
+      static const uint32_t TIMER_DEADLINE = 0x40000;
+      // disarmed and masked until the first deadline is written
+      write(x2APIC_LVT_TMR, TIMER_DEADLINE | (32+timer_intr) | INTR_MASK);
+      // WRMSR to the x2APIC does not serialize, and the mode must be
+      // set before the first write to IA32_TSC_DEADLINE (vol 3a 10.5.4.1)
+      asm volatile("mfence" ::: "memory");
+    }
     void timer_begin(uint32_t value) noexcept override
     {
       write(x2APIC_TMRINITCNT, value);
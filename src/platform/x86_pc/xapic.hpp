@@ -190,6 +190,12 @@ namespace x86 {
       // but also disable interrupts
       write(xAPIC_LVT_TMR, TIMER_ONESHOT | (32+timer_intr) | INTR_MASK);
     }
+    void timer_deadline_init(const uint8_t timer_intr) noexcept override
+    {
+      static const uint32_t TIMER_DEADLINE = 0x40000;
+      // disarmed and masked until the first deadline is written
+      write(xAPIC_LVT_TMR, TIMER_DEADLINE | (32+timer_intr) | INTR_MASK);
+    }
     void timer_begin(uint32_t value) noexcept override
     {
       write(xAPIC_TMRINITCNT, value);
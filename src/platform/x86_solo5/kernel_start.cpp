@@ -42,6 +42,8 @@ int solo5_app_main(const struct solo5_start_info *si)
 extern "C"
 void kernel_start()
 {
+  // .bss was cleared when solo5 loaded the binary
+  kernel::boot_phase("Sanity checks");
   // generate checksums of read-only areas etc.
   __init_sanity_checks();
 
@@ -51,6 +53,7 @@ void kernel_start()
   mem_size -= len;
 
   // Ze machine
+  kernel::boot_phase("Machine init");
   __machine = os::Machine::create((void*)free_mem_begin, mem_size);
 
   _init_elf_parser();
@@ -61,5 +64,6 @@ void kernel_start()
   // Initialize system calls
   _init_syscalls();
 
+  kernel::boot_phase("libc init");
   x86::init_libc((uint32_t) (uintptr_t) temp_cmdline, 0);
 }
@@ -46,6 +46,9 @@ uint64_t os::cycles_asleep() noexcept {
 uint64_t os::nanos_asleep() noexcept {
   return os_cycles_hlt;
 }
+uint64_t os::nanos_stolen() noexcept {
+  return 0;
+}
 
 void kernel::default_stdout(const char* str, const size_t len)
 {
@@ -54,6 +57,7 @@ void kernel::default_stdout(const char* str, const size_t len)
 
 void kernel::start(const char* cmdline)
 {
+  kernel::boot_phase("Stdout init");
   kernel::state().cmdline = cmdline;
 
   // Initialize stdout handlers
@@ -65,6 +69,7 @@ void kernel::start(const char* cmdline)
   kernel::run_ctors(&__stdout_ctors_start, &__stdout_ctors_end);
 
   // Call global ctors
+  kernel::boot_phase("Global kernel constructors");
   PROFILE("Global kernel constructors");
   kernel::run_ctors(&__init_array_start, &__init_array_end);
 
@@ -75,6 +80,7 @@ void kernel::start(const char* cmdline)
   void* esp = get_cpu_esp();
   MYINFO("Stack: %p", esp);
 
+  kernel::boot_phase("Memory map");
   PROFILE("Memory map");
   // Assign memory ranges used by the kernel
   auto& memmap = os::mem::vmmap();
@@ -107,8 +113,10 @@ void kernel::start(const char* cmdline)
   MYINFO("Booted at monotonic_ns=%ld walltime_ns=%ld",
          solo5_clock_monotonic(), solo5_clock_wall());
 
+  kernel::boot_phase("Initialize drivers");
   kernel::run_ctors(&__driver_ctors_start, &__driver_ctors_end);
 
+  kernel::boot_phase("Solo5 devices init");
   Solo5_manager::init();
 
   // We don't need a start or stop function in solo5.
@@ -154,6 +162,8 @@ static inline void event_loop_inner()
     for (auto& nic : os::machine().get<hw::Nic>()) {
       nic.get().poll();
     }
+    // receive until the NICs are drained
+    Events::get().process_events();
   }
 }
 
@@ -44,5 +44,7 @@ void SMP::global_lock() noexcept {}
 void SMP::global_unlock() noexcept {}
 int SMP::cpu_id() noexcept { return 0; }
 int SMP::cpu_count() noexcept { return 1; }
+size_t SMP::early_cpu_total() noexcept { return 1; }
 void SMP::signal(int) { }
+void SMP::unicast(int, uint8_t) { }
 void SMP::add_task(SMP::task_func, int) { };
@@ -0,0 +1,128 @@
+#include <posix/epoll_fd.hpp>
+#include <posix/fd_map.hpp>
+#include <os.hpp>
+#include <timers>
+
+// ready FDs are reported level-triggered, unless asked for otherwise
+static const uint32_t EPOLL_FLAGS = EPOLLET | EPOLLONESHOT;
+
+void Epoll_FD::queue(const int id, Entry& ent)
+{
+  if (ent.queued) return;
+  ent.queued = true;
+  ready_.push_back(id);
+  // for when this one is watched by another
+  notify_ready();
+}
+
+void Epoll_FD::on_ready(FD& fd)
+{
+  auto it = interest_.find(fd.get_id());
+  if (it != interest_.end()) queue(it->first, it->second);
+}
+
+int Epoll_FD::ctl(const int op, const int id, struct epoll_event* event)
+{
+  auto* fd = FD_map::_get(id);
+  if (fd == nullptr) return -EBADF;
+  if (fd == this) return -EINVAL;
+  if (op != EPOLL_CTL_DEL and event == nullptr) return -EFAULT;
+  auto it = interest_.find(id);
+
+  switch (op) {
+  case EPOLL_CTL_ADD:
+    if (it != interest_.end()) return -EEXIST;
+    it = interest_.emplace(id, Entry{event->events, event->data}).first;
+    fd->watch(this, {this, &Epoll_FD::on_ready});
+    // it may be ready already
+    queue(id, it->second);
+    return 0;
+  case EPOLL_CTL_MOD:
+    if (it == interest_.end()) return -ENOENT;
+    it->second.events = event->events;
+    it->second.data   = event->data;
+    queue(id, it->second);
+    return 0;
+  case EPOLL_CTL_DEL:
+    if (it == interest_.end()) return -ENOENT;
+    // left in the ready queue, where it's skipped
+    interest_.erase(it);
+    fd->unwatch(this);
+    return 0;
+  default:
+    return -EINVAL;
+  }
+}
+
+int Epoll_FD::wait(struct epoll_event* events, const int maxevents, const int timeout)
+{
+  if (maxevents <= 0) return -EINVAL;
+  bool timed_out = (timeout == 0);
+  Timers::id_t timer = Timers::UNUSED_ID;
+
+  while (true)
+  {
+    int count = 0;
+    // each FD that may be ready is looked at once
+    for (size_t n = ready_.size(); n > 0 and count < maxevents; n--)
+    {
+      const int id = ready_.front();
+      ready_.pop_front();
+      auto it = interest_.find(id);
+      if (it == interest_.end()) continue;
+      auto& ent = it->second;
+      ent.queued = false;
+      // closed FDs are dropped, like they are on Linux
+      auto* fd = FD_map::_get(id);
+      if (fd == nullptr) {
+        interest_.erase(it);
+        continue;
+      }
+      // disabled, after firing once
+      if ((ent.events & ~EPOLL_FLAGS) == 0) continue;
+      // the POLL* and EPOLL* values are the same
+      const uint32_t revents = fd->poll_events() & (ent.events | EPOLLERR | EPOLLHUP);
+      if (revents == 0) continue;
+
+      events[count].events = revents;
+      events[count].data   = ent.data;
+      count++;
+      if (ent.events & EPOLLONESHOT)
+        ent.events = 0;
+      // still ready until read or written, as far as anyone knows
+      else if (not (ent.events & EPOLLET))
+        queue(id, ent);
+    }
+
+    if (count > 0 or timed_out)
+    {
+      if (timer != Timers::UNUSED_ID and not timed_out)
+        Timers::stop(timer);
+      return count;
+    }
+    if (timeout > 0 and timer == Timers::UNUSED_ID)
+    {
+      timer = Timers::oneshot(std::chrono::milliseconds(timeout),
+        [&timed_out] (Timers::id_t) { timed_out = true; });
+    }
+    // until something is ready, or the timer wakes us up
+    while (ready_.empty() and not timed_out)
+      os::block();
+  }
+}
+
+int Epoll_FD::close()
+{
+  for (auto& it : interest_)
+  {
+    if (auto* fd = FD_map::_get(it.first)) fd->unwatch(this);
+  }
+  interest_.clear();
+  ready_.clear();
+  return 0;
+}
+
+Epoll_FD::~Epoll_FD()
+{
+  close();
+}
@@ -1,6 +1,7 @@
 
 #include <posix/fd.hpp>
 #include <fcntl.h>
+#include <sys/uio.h>
 #include <cstdarg>
 #include <errno.h>
 
@@ -30,6 +31,39 @@ int FD::fcntl(int cmd, va_list list)
   }
 }
 
+ssize_t FD::writev(const struct iovec* iov, int iovcnt)
+{
+  // one write per buffer, for the FDs that can't gather
+  ssize_t total = 0;
+  for (int i = 0; i < iovcnt; i++)
+  {
+    if (iov[i].iov_len == 0) continue;
+    const int res = this->write(iov[i].iov_base, iov[i].iov_len);
+    if (res < 0) return (total > 0) ? total : res;
+    total += res;
+    if ((size_t) res < iov[i].iov_len) break;
+  }
+  return total;
+}
+
+void FD::watch(void* owner, watcher_t func)
+{
+  for (auto& w : watchers_)
+    if (w.first == owner) {
+      w.second = std::move(func);
+      return;
+    }
+  watchers_.emplace_back(owner, std::move(func));
+}
+void FD::unwatch(void* owner)
+{
+  for (auto it = watchers_.begin(); it != watchers_.end(); ++it)
+    if (it->first == owner) {
+      watchers_.erase(it);
+      return;
+    }
+}
+
 int FD::ioctl(int /*req*/, void* /*arg*/)
 {
   //PRINT("ioctl(%d, %p) = -1\n", req, arg);
@@ -40,12 +74,10 @@ int FD::ioctl(int /*req*/, void* /*arg*/)
 int FD::getsockopt(int /*fd*/, int, void *__restrict__, socklen_t *__restrict__)
 {
   //PRINT("getsockopt(%d) = -1\n", fd);
-  errno = ENOTSOCK;
-  return -1;
+  return -ENOTSOCK;
 }
 int FD::setsockopt(int /*fd*/, int, const void *, socklen_t)
 {
   //PRINT("setsockopt(%d) = -1\n", fd);
-  errno = ENOTSOCK;
-  return -1;
+  return -ENOTSOCK;
 }
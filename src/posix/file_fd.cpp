@@ -3,6 +3,13 @@
 #include <errno.h>
 #include <dirent.h>
 #include <sys/uio.h>
+#include <kernel/memory.hpp>
+#include <util/bitops.hpp>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <tuple>
 
 ssize_t File_FD::read(void* p, size_t n)
 {
@@ -24,19 +31,35 @@ ssize_t File_FD::read(void* p, size_t n)
 
 ssize_t File_FD::readv(const struct iovec* iov, int iovcnt)
 {
-  if(UNLIKELY(iovcnt <= 0 and iovcnt > IOV_MAX))
+  if(UNLIKELY(iovcnt < 0 or iovcnt > IOV_MAX))
     return -EINVAL;
 
-  ssize_t total = 0;
-  // TODO: return EINVAL if total overflow ssize_t
+  if(UNLIKELY(ent_.is_dir()))
+    return -EISDIR;
+
+  size_t total = 0;
   for(int i = 0; i < iovcnt; i++)
   {
-    auto& vec = iov[i];
-    if(vec.iov_len > 0)
-      total += this->read(vec.iov_base, vec.iov_len);
+    if(UNLIKELY(iov[i].iov_len > (size_t) SSIZE_MAX - total))
+      return -EINVAL;
+    total += iov[i].iov_len;
   }
+  if(UNLIKELY(total == 0))
+    return 0;
+
+  // one read from the file system, scattered over the buffers
+  auto buf = ent_.read(offset_, total);
+  if (not buf.is_valid()) return -EIO;
 
-  return total;
+  size_t count = 0;
+  for(int i = 0; i < iovcnt and count < buf.size(); i++)
+  {
+    const size_t n = std::min(iov[i].iov_len, buf.size() - count);
+    memcpy(iov[i].iov_base, buf.data() + count, n);
+    count += n;
+  }
+  offset_ += count;
+  return count;
 }
 
 int File_FD::write(const void*, size_t) {
@@ -70,6 +93,106 @@ off_t File_FD::lseek(off_t offset, int whence)
   return offset_;
 }
 
+namespace {
+  // device, first block, offset and length of a mapped part of a file
+  using Page_key = std::tuple<int, uint64_t, off_t, size_t>;
+
+  struct File_mapping {
+    int      refs   = 0;
+    bool     cached = false;
+    Page_key key;
+  };
+
+  // mapped address -> mapping
+  std::map<uintptr_t, File_mapping> file_mappings;
+  // file contents read in for mappings of files not kept in memory,
+  // shared by all the mappings of the same part of a file
+  std::map<Page_key, uintptr_t> page_cache;
+}
+
+void* File_FD::mmap(size_t len, off_t offset)
+{
+  if (UNLIKELY(ent_.is_dir()))
+    return (void*) -ENODEV;
+
+  const size_t psize = os::mem::min_psize();
+  if (UNLIKELY(len == 0 or offset < 0 or offset % psize != 0))
+    return (void*) -EINVAL;
+
+  if (UNLIKELY((uint64_t) offset >= ent_.size()))
+    return (void*) -ENXIO;
+  const uint64_t n = std::min<uint64_t>(len, ent_.size() - offset);
+
+  // files on a device in memory (memdisk) are mapped where they are
+  if (const char* data = ent_.fs().map(ent_, offset, n); data != nullptr)
+  {
+    file_mappings[(uintptr_t) data].refs++;
+    return (void*) data;
+  }
+
+  const Page_key key {ent_.device_id(), ent_.block(), offset, len};
+  auto it = page_cache.find(key);
+  if (it == page_cache.end())
+  {
+    auto buf = ent_.read(offset, n);
+    if (not buf.is_valid())
+      return (void*) -EIO;
+
+    const size_t size = util::bits::roundto(psize, len);
+    auto* pages = (char*) aligned_alloc(psize, size);
+    if (UNLIKELY(pages == nullptr))
+      return (void*) -ENOMEM;
+    // the rest of the last page reads as zeros
+    memcpy(pages, buf.data(), buf.size());
+    memset(pages + buf.size(), 0, size - buf.size());
+
+    it = page_cache.emplace(key, (uintptr_t) pages).first;
+    file_mappings[it->second] = {0, true, key};
+  }
+  file_mappings[it->second].refs++;
+  return (void*) it->second;
+}
+
+bool File_FD::munmap(void* addr)
+{
+  auto it = file_mappings.find((uintptr_t) addr);
+  if (it == file_mappings.end())
+    return false;
+
+  if (--it->second.refs == 0)
+  {
+    if (it->second.cached) {
+      page_cache.erase(it->second.key);
+      free(addr);
+    }
+    file_mappings.erase(it);
+  }
+  return true;
+}
+
+ssize_t File_FD::peek(uint64_t offset, size_t len,
+                      const uint8_t*& data, std::shared_ptr<const void>& owner)
+{
+  if (UNLIKELY(ent_.is_dir()))
+    return -EISDIR;
+  if (offset >= ent_.size() or len == 0)
+    return 0;
+  const uint64_t n = std::min<uint64_t>(len, ent_.size() - offset);
+
+  // memdisk contents stay where they are for as long as the OS runs
+  if (const char* mem = ent_.fs().map(ent_, offset, n); mem != nullptr)
+  {
+    data = (const uint8_t*) mem;
+    owner = nullptr;
+    return n;
+  }
+  auto buf = ent_.read(offset, n);
+  if (not buf.is_valid()) return -EIO;
+  data  = buf.data();
+  owner = buf.get();
+  return buf.size();
+}
+
 long File_FD::getdents(struct dirent *dirp, unsigned int count)
 {
   static_assert(sizeof(dirent::d_name) > 0);
@@ -0,0 +1,65 @@
+#include <posix/poll.hpp>
+#include <posix/fd_map.hpp>
+#include <os.hpp>
+#include <timers>
+
+static int ready_events(const struct pollfd& pfd)
+{
+  if (pfd.fd < 0) return 0;
+  // always ready for errors, asked for or not
+  const int wanted = pfd.events | POLLERR | POLLHUP;
+  if (auto* fd = FD_map::_get(pfd.fd); fd)
+    return fd->poll_events() & wanted;
+  // stdout and stderr go to os::print, which never blocks
+  if (pfd.fd == 1 or pfd.fd == 2) return POLLOUT & wanted;
+  if (pfd.fd == 0) return 0;
+  return POLLNVAL;
+}
+
+static int check_all(struct pollfd* fds, nfds_t nfds)
+{
+  int count = 0;
+  for (nfds_t i = 0; i < nfds; i++)
+  {
+    fds[i].revents = ready_events(fds[i]);
+    if (fds[i].revents) count++;
+  }
+  return count;
+}
+
+int fd_poll(struct pollfd* fds, nfds_t nfds, std::chrono::nanoseconds timeout)
+{
+  int count = check_all(fds, nfds);
+  if (count > 0 or timeout.count() == 0) return count;
+
+  // nothing changes between checking and watching, as notifications
+  // only come from the events handled in os::block()
+  bool woken = false;
+  bool timed_out = false;
+  for (nfds_t i = 0; i < nfds; i++)
+  {
+    if (auto* fd = FD_map::_get(fds[i].fd); fd)
+      fd->watch(&woken, [&woken] (FD&) { woken = true; });
+  }
+  Timers::id_t timer = Timers::UNUSED_ID;
+  if (timeout.count() > 0)
+    timer = Timers::oneshot(timeout, [&timed_out] (Timers::id_t) { timed_out = true; });
+
+  while (count == 0 and not timed_out)
+  {
+    while (not woken and not timed_out)
+      os::block();
+    woken = false;
+    count = check_all(fds, nfds);
+  }
+
+  if (timer != Timers::UNUSED_ID and not timed_out)
+    Timers::stop(timer);
+  // the FDs that were closed in the meantime took their watchers with them
+  for (nfds_t i = 0; i < nfds; i++)
+  {
+    if (auto* fd = FD_map::_get(fds[i].fd); fd)
+      fd->unwatch(&woken);
+  }
+  return count;
+}
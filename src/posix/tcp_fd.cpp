@@ -1,10 +1,16 @@
 
 #include <posix/tcp_fd.hpp>
 #include <posix/fd_map.hpp>
+#include <posix/file_fd.hpp>
 #include <os.hpp>
 #include <errno.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 #include <net/interfaces.hpp>
+#include <smp>
+#include <array>
+#include <unordered_set>
 
 //#define POSIX_STRACE
 #ifdef POSIX_STRACE
@@ -20,14 +26,63 @@ static auto& net_stack() {
   return Interfaces::get(0);
 }
 
+// the listeners bound by sockets, on each CPU
+static std::array<std::unordered_set<const net::tcp::Listener*>, SMP_MAX_CORES> listeners_in_use;
+
+// The listener of this CPU on a port sharded over the CPUs, SO_REUSEPORT style.
+// The first socket bound to the port shards it, and each worker then binds
+// a socket of its own on its own CPU, accepting the connections hashed there.
+static net::tcp::Listener& sharded_listener(const uint16_t port)
+{
+  auto& tcp = net_stack().tcp();
+  if (auto* shard = tcp.shard(SMP::cpu_id()); shard)
+  {
+    if (auto* L = shard->listeners().find({ip6::Addr::addr_any, port}); L)
+      return **L;
+  }
+  // throws when the port is bound but not sharded
+  return tcp.listen_sharded(port, nullptr);
+}
+
 ssize_t TCP_FD::read(void* data, size_t len)
 {
   return recv(data, len, 0);
 }
+ssize_t TCP_FD::readv(const struct iovec* iov, int iovcnt)
+{
+  if (!cd) {
+    return -EINVAL;
+  }
+  if (cd->slices.empty())
+    cd->retrieve_data();
+  if (not is_blocking() and cd->recv_would_block())
+    return -EAGAIN;
+  return cd->recv(iov, iovcnt, 0);
+}
 int TCP_FD::write(const void* data, size_t len)
 {
   return send(data, len, 0);
 }
+ssize_t TCP_FD::writev(const struct iovec* iov, int iovcnt)
+{
+  if (!cd) {
+    return -EINVAL;
+  }
+  const int fl = (is_blocking()) ? 0 : MSG_DONTWAIT;
+  if (iovcnt == 1)
+    return cd->send(iov[0].iov_base, iov[0].iov_len, fl);
+  // gathered into a single write queue entry
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++)
+    total += iov[i].iov_len;
+  auto buf = net::tcp::construct_buffer();
+  buf->reserve(total);
+  for (int i = 0; i < iovcnt; i++) {
+    const auto* base = (const uint8_t*) iov[i].iov_base;
+    buf->insert(buf->end(), base, base + iov[i].iov_len);
+  }
+  return cd->send(std::move(buf), fl);
+}
 
 int TCP_FD::close()
 {
@@ -79,16 +134,20 @@ long TCP_FD::connect(const struct sockaddr* address, socklen_t address_len)
 
   auto outgoing = net_stack().tcp().connect({addr, port});
 
-  bool refused = false;
-  outgoing->on_connect([&refused](auto conn) {
-    refused = (conn == nullptr);
-  });
   // O_NONBLOCK is set for the file descriptor for the socket and the connection
   // cannot be immediately established; the connection shall be established asynchronously.
   if (this->is_blocking() == false) {
+    // writable once connected, see poll_events()
+    set_connection(std::make_unique<TCP_FD_Conn>(outgoing));
+    outgoing->on_connect([this] (auto) { this->notify_ready(); });
     return -EINPROGRESS;
   }
 
+  bool refused = false;
+  outgoing->on_connect([&refused](auto conn) {
+    refused = (conn == nullptr);
+  });
+
   // wait for connection state to change
   while (not (outgoing->is_connected() or
               outgoing->is_closing() or
@@ -100,8 +159,7 @@ long TCP_FD::connect(const struct sockaddr* address, socklen_t address_len)
   // set connection whether good or bad
   if (outgoing->is_connected()) {
     // out with the old, in with the new
-    this->cd = std::make_unique<TCP_FD_Conn>(outgoing);
-    cd->set_default_read();
+    set_connection(std::make_unique<TCP_FD_Conn>(outgoing));
     return 0;
   }
   // failed to connect
@@ -115,8 +173,39 @@ ssize_t TCP_FD::send(const void* data, size_t len, int fmt)
   if (!cd) {
     return -EINVAL;
   }
+  if (not is_blocking()) fmt |= MSG_DONTWAIT;
   return cd->send(data, len, fmt);
 }
+ssize_t TCP_FD::sendfile(File_FD& file, off_t* offset, size_t count)
+{
+  if (!cd) {
+    return -EINVAL;
+  }
+  uint64_t pos = (offset) ? *offset : file.offset();
+  ssize_t total = 0;
+  while (count > 0)
+  {
+    // the file contents are queued where they are, when they can be
+    const uint8_t* data;
+    std::shared_ptr<const void> owner;
+    const ssize_t n = file.peek(pos, std::min<size_t>(count, SENDFILE_CHUNK), data, owner);
+    if (n <= 0) {
+      if (total == 0) return n;
+      break;
+    }
+    const ssize_t res = cd->send(data, n, std::move(owner), (is_blocking()) ? 0 : MSG_DONTWAIT);
+    if (res < 0) {
+      if (total == 0) return res;
+      break;
+    }
+    pos   += res;
+    total += res;
+    count -= res;
+  }
+  if (offset) *offset = pos;
+  else file.lseek(total, SEEK_CUR);
+  return total;
+}
 ssize_t TCP_FD::sendto(const void* data, size_t len, int fmt,
                        const struct sockaddr* dest_addr, socklen_t dest_len)
 {
@@ -129,6 +218,10 @@ ssize_t TCP_FD::recv(void* dest, size_t len, int flags)
   if (!cd) {
     return -EINVAL;
   }
+  if (cd->slices.empty())
+    cd->retrieve_data();
+  if ((flags & MSG_DONTWAIT or not is_blocking()) and cd->recv_would_block())
+    return -EAGAIN;
   return cd->recv(dest, len, flags);
 }
 
@@ -136,12 +229,44 @@ ssize_t TCP_FD::recvfrom(void* dest, size_t len, int flags, struct sockaddr*, so
 {
   return recv(dest, len, flags);
 }
+ssize_t TCP_FD::recvmsg(struct msghdr* msg, int flags)
+{
+  if (!cd) {
+    return -EINVAL;
+  }
+  if (msg->msg_iovlen <= 0)
+    return 0;
+  if (cd->slices.empty())
+    cd->retrieve_data();
+  if ((flags & MSG_DONTWAIT or not is_blocking()) and cd->recv_would_block())
+    return -EAGAIN;
+  // a stream has no source address nor control data
+  msg->msg_namelen    = 0;
+  msg->msg_controllen = 0;
+  msg->msg_flags      = 0;
+  if (flags & MSG_HANDOFF)
+    return cd->lend(msg->msg_iov, (int) msg->msg_iovlen, flags);
+  return cd->recv(msg->msg_iov, (int) msg->msg_iovlen, flags);
+}
+ssize_t TCP_FD::recv_slices(net::tcp::Slice_chain& out, size_t len, int flags)
+{
+  if (!cd) {
+    return -EINVAL;
+  }
+  if (cd->slices.empty())
+    cd->retrieve_data();
+  if ((flags & MSG_DONTWAIT or not is_blocking()) and cd->recv_would_block())
+    return -EAGAIN;
+  return cd->recv(out, len, flags);
+}
 
 long TCP_FD::accept(struct sockaddr *__restrict__ addr, socklen_t *__restrict__ addr_len)
 {
   if (!ld) {
     return -EINVAL;
   }
+  if (not is_blocking() and ld->connq.empty())
+    return -EAGAIN;
   return ld->accept(addr, addr_len);
 }
 long TCP_FD::listen(int backlog)
@@ -172,7 +297,10 @@ long TCP_FD::bind(const struct sockaddr *addr, socklen_t addrlen)
   // ignore IP address (FIXME?)
   /// TODO: verify that the IP is "local"
   try {
-    auto& L = net_stack().tcp().listen(port);
+    auto& L = (reuse_port) ? sharded_listener(port) : net_stack().tcp().listen(port);
+    // one socket per listener, as each listener has one queue of connections
+    if (not PER_CPU(listeners_in_use).insert(&L).second)
+      return -EADDRINUSE;
     // remove existing listener
     if (ld) {
       int ret = ld->close();
@@ -181,12 +309,126 @@ long TCP_FD::bind(const struct sockaddr *addr, socklen_t addrlen)
     }
     // create new one
     ld = new TCP_FD_Listen(L);
+    ld->on_ready = [this] () { this->notify_ready(); };
     return 0;
 
   } catch (...) {
     return -EADDRINUSE;
   }
 }
+int TCP_FD::getsockopt(int level, int option_name,
+  void *__restrict__ option_value, socklen_t *__restrict__ option_len)
+{
+  if (level != SOL_SOCKET and level != IPPROTO_TCP)
+    return -ENOPROTOOPT;
+  if (*option_len < sizeof(int))
+    return -EINVAL;
+
+  int value;
+  if (level == IPPROTO_TCP) {
+    switch (option_name) {
+    // there is no Nagle, what isn't corked is sent right away
+    case TCP_NODELAY:
+      value = 1;
+      break;
+    case TCP_CORK:
+      value = (cd) ? cd->conn->is_corked() : cork;
+      break;
+    default:
+      return -ENOPROTOOPT;
+    }
+    *((int*) option_value) = value;
+    *option_len = sizeof(int);
+    return 0;
+  }
+  switch (option_name) {
+  // addresses can always be reused in IncludeOS
+  case SO_REUSEADDR:
+    value = 1;
+    break;
+  case SO_REUSEPORT:
+    value = reuse_port;
+    break;
+  case SO_ACCEPTCONN:
+    value = is_listener();
+    break;
+  case SO_TYPE:
+    value = SOCK_STREAM;
+    break;
+  default:
+    return -ENOPROTOOPT;
+  }
+  *((int*) option_value) = value;
+  *option_len = sizeof(int);
+  return 0;
+}
+int TCP_FD::setsockopt(int level, int option_name,
+  const void* option_value, socklen_t option_len)
+{
+  if (level != SOL_SOCKET and level != IPPROTO_TCP)
+    return -ENOPROTOOPT;
+  if (option_len < sizeof(int))
+    return -EINVAL;
+
+  const bool on = *((const int*) option_value) != 0;
+  if (level == IPPROTO_TCP) {
+    switch (option_name) {
+    case TCP_NODELAY:
+      // as on Linux, what a cork holds back goes out now
+      if (on and cd) cd->conn->push();
+      return 0;
+    case TCP_CORK:
+      cork = on;
+      if (cd) {
+        if (on) cd->conn->cork();
+        else cd->conn->uncork();
+      }
+      return 0;
+    default:
+      return -ENOPROTOOPT;
+    }
+  }
+  switch (option_name) {
+  case SO_REUSEADDR:
+    return 0;
+  case SO_REUSEPORT:
+    // only before binding
+    if (ld) return -EINVAL;
+    reuse_port = on;
+    return 0;
+  default:
+    return -ENOPROTOOPT;
+  }
+}
+
+void TCP_FD::set_connection(std::unique_ptr<TCP_FD_Conn> conn)
+{
+  this->cd = std::move(conn);
+  cd->on_ready = [this] () { this->notify_ready(); };
+  if (cork) cd->conn->cork();
+}
+
+int TCP_FD::poll_events()
+{
+  if (ld) {
+    return ld->connq.empty() ? 0 : POLLIN;
+  }
+  if (not cd) {
+    return POLLOUT | POLLHUP;
+  }
+  if (cd->slices.empty())
+    cd->retrieve_data();
+  int events = 0;
+  // recv returns 0 at the end, without blocking
+  if (not cd->recv_would_block())
+    events |= POLLIN;
+  if (cd->conn->is_connected() and not cd->send_would_block())
+    events |= POLLOUT;
+  if (cd->conn->is_closed() or cd->recv_disc)
+    events |= POLLHUP;
+  return events;
+}
+
 int TCP_FD::shutdown(int mode)
 {
   if (!cd) {
@@ -197,14 +439,15 @@ int TCP_FD::shutdown(int mode)
 
 /// socket as connection
 TCP_FD_Conn::TCP_FD_Conn(net::tcp::Connection_ptr c)
-  : conn{std::move(c)},
-    buffer{nullptr}, buf_offset{0}
+  : conn{std::move(c)}
 {
   assert(conn != nullptr);
   set_default_read();
+  set_default_write();
 
   conn->on_disconnect([this](auto self, auto reason) {
     this->recv_disc = true;
+    if (this->on_ready) this->on_ready();
     (void) reason;
     //printf("dc: %s - %s\n", reason.to_string().c_str(), self->to_string().c_str());
     // do nothing, avoid close
@@ -215,18 +458,54 @@ TCP_FD_Conn::TCP_FD_Conn(net::tcp::Connection_ptr c)
 }
 void TCP_FD_Conn::set_default_read()
 {
-  conn->on_data({this, &TCP_FD_Conn::retrieve_buffer});
+  // recv copies straight out of the packets
+  conn->on_data({this, &TCP_FD_Conn::data_ready}, true);
+}
+void TCP_FD_Conn::set_default_write()
+{
+  // there may be room in the send buffer again
+  conn->on_write([this] (size_t) { if (this->on_ready) this->on_ready(); });
+}
+ssize_t TCP_FD_Conn::send(const void* data, size_t len, int fl)
+{
+  if (not conn->is_connected()) {
+    return -ENOTCONN;
+  }
+  return send(net::tcp::construct_buffer((const uint8_t*) data,
+                                         (const uint8_t*) data + len), fl);
 }
-ssize_t TCP_FD_Conn::send(const void* data, size_t len, int)
+ssize_t TCP_FD_Conn::send(net::tcp::buffer_t buf, int fl)
+{
+  const auto* data = buf->data();
+  const size_t len = buf->size();
+  return send(data, len, std::move(buf), fl);
+}
+ssize_t TCP_FD_Conn::send(const void* data, size_t len,
+                          std::shared_ptr<const void> owner, int fl)
 {
   if (not conn->is_connected()) {
     return -ENOTCONN;
   }
+  if (len == 0) return 0;
+
+  // held back for what follows, until a segment is full
+  const bool more = fl & MSG_MORE;
+  // the write queue holds on to it until it is acknowledged
+  if (fl & MSG_DONTWAIT) {
+    if (send_would_block()) return -EAGAIN;
+    conn->write(data, len, std::move(owner), more);
+    return len;
+  }
+  // it may not be sent before the next send, so don't wait for it
+  if (more) {
+    conn->write(data, len, std::move(owner), more);
+    return len;
+  }
 
   bool written = false;
   conn->on_write([&written] (bool) { written = true; }); // temp
 
-  conn->write(data, len);
+  conn->write(data, len, std::move(owner));
 
   // sometimes we can just write and forget
   if (written) return len;
@@ -234,45 +513,112 @@ ssize_t TCP_FD_Conn::send(const void* data, size_t len, int)
     os::block();
   }
 
-  conn->on_write(nullptr); // temp
+  set_default_write();
   return len;
 }
 
-void TCP_FD_Conn::retrieve_buffer()
+void TCP_FD_Conn::retrieve_data()
 {
-  if(buffer == nullptr and conn->next_size() > 0)
-  {
-    buffer = conn->read_next();
-    buf_offset = 0;
-  }
+  // leave the rest with the connection, where it counts against the window
+  if(slices.empty())
+    slices = conn->read_slices();
+}
+void TCP_FD_Conn::data_ready()
+{
+  retrieve_data();
+  if (on_ready) on_ready();
+}
+ssize_t TCP_FD_Conn::recv(void* dest, size_t len, int fl)
+{
+  const struct iovec iov {dest, len};
+  return recv(&iov, 1, fl);
 }
-ssize_t TCP_FD_Conn::recv(void* dest, size_t len, int)
+bool TCP_FD_Conn::await_data()
 {
-  if(buffer == nullptr)
-    retrieve_buffer();
+  // whatever was lent out goes back with the next receive
+  lent.clear();
+  if(slices.empty())
+    retrieve_data();
 
   // BLOCK HERE:
   // If we havent read the data we asked for or if we're not yet closed/want to close
-  while (buffer == nullptr and !conn->is_closed() and !recv_disc) {
+  while (slices.empty() and !conn->is_closed() and !recv_disc) {
     os::block();
   }
 
   // means block exited by conn closing
-  if(buffer == nullptr)
+  return not slices.empty();
+}
+ssize_t TCP_FD_Conn::recv(const struct iovec* iov, int iovcnt, int)
+{
+  if (not await_data())
     return 0;
 
-  // make sure to not read past current buffer
-  auto count = std::min(buffer->size() - buf_offset, len);
-  Expects(count > 0);
-  std::memcpy(dest, buffer->data() + buf_offset, count);
-  // increase the offset with how much we read
-  buf_offset += count;
-  Ensures(buf_offset <= buffer->size());
+  // fill as much as we can, dropping the slices read
+  size_t count = 0;
+  for (int i = 0; i < iovcnt and not slices.empty(); i++)
+  {
+    auto* dest = (uint8_t*) iov[i].iov_base;
+    const size_t len = iov[i].iov_len;
+    size_t done = 0;
+    while (done < len and not slices.empty())
+    {
+      auto& slice = slices.front();
+      const auto n = std::min(slice.size(), len - done);
+      std::memcpy(dest + done, slice.data(), n);
+      done += n;
+      slice.consume(n);
+      if(slice.size() == 0)
+        slices.pop_front();
+    }
+    count += done;
+  }
+
+  return count;
+}
+ssize_t TCP_FD_Conn::recv(net::tcp::Slice_chain& out, size_t len, int)
+{
+  if (not await_data())
+    return 0;
 
-  // null out the buffer if everything is read from it
-  if(buf_offset == buffer->size())
-    buffer = nullptr;
+  size_t count = 0;
+  while (count < len and not slices.empty())
+  {
+    auto& slice = slices.front();
+    if (slice.size() <= len - count) {
+      count += slice.size();
+      out.push_back(std::move(slice));
+      slices.pop_front();
+    }
+    else {
+      out.push_back(slice.take(len - count));
+      count = len;
+    }
+  }
+  return count;
+}
+ssize_t TCP_FD_Conn::lend(struct iovec* iov, int iovcnt, int)
+{
+  if (not await_data())
+    return 0;
 
+  // a slice for each buffer, at most as long as the buffer was
+  size_t count = 0;
+  for (int i = 0; i < iovcnt; i++)
+  {
+    if (slices.empty()) {
+      iov[i].iov_len = 0;
+      continue;
+    }
+    auto& slice = slices.front();
+    const auto n = std::min(slice.size(), iov[i].iov_len);
+    lent.push_back(slice.take(n));
+    if (slice.size() == 0)
+      slices.pop_front();
+    iov[i].iov_base = (void*) lent.back().data();
+    iov[i].iov_len  = n;
+    count += n;
+  }
   return count;
 }
 int TCP_FD_Conn::close()
@@ -316,6 +662,7 @@ long TCP_FD_Listen::listen(int backlog)
     // new connection
     this->connq.push_front(std::make_unique<TCP_FD_Conn>(conn));
     /// if someone is blocking they should be leaving right about now
+    if (this->on_ready) this->on_ready();
   });
   return 0;
 }
@@ -332,7 +679,7 @@ long TCP_FD_Listen::accept(struct sockaddr *__restrict__ addr, socklen_t *__rest
   assert(sock != nullptr);
   // create connected TCP socket
   auto& fd = FD_map::_open<TCP_FD>();
-  fd.cd = std::move(sock);
+  fd.set_connection(std::move(sock));
   // set address and length
   if(addr != nullptr and addr_len != nullptr)
   {
@@ -348,6 +695,7 @@ long TCP_FD_Listen::accept(struct sockaddr *__restrict__ addr, socklen_t *__rest
 }
 int TCP_FD_Listen::close()
 {
+  PER_CPU(listeners_in_use).erase(&listener);
   listener.close();
   return 0;
 }
@@ -3,6 +3,7 @@
 #include <os.hpp> // os::block()
 #include <errno.h>
 #include <net/interfaces.hpp>
+#include <vector>
 
 //#define POSIX_STRACE 1
 #ifdef POSIX_STRACE
@@ -30,9 +31,17 @@ void UDP_FD::recv_to_buffer(net::udp::addr_t addr,
     auto buff = net::tcp::construct_buffer(buf, buf + len);
     // emplace the message in buffer
     buffer_.emplace_back(htonl(addr.v4().whole), htons(port), std::move(buff));
+    notify_ready();
   }
 }
 
+void UDP_FD::recv_batch_to_buffer(const net::udp::Datagram* msgs, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    recv_to_buffer(msgs[i].peer.address(), msgs[i].peer.port(),
+                   (const char*) msgs[i].data, msgs[i].length);
+}
+
 int UDP_FD::read_from_buffer(void* buffer, size_t len, int flags,
   struct sockaddr* address, socklen_t* address_len)
 {
@@ -58,6 +67,7 @@ void UDP_FD::set_default_recv()
 {
   assert(this->sock != nullptr && "Default recv called on nullptr");
   this->sock->on_read({this, &UDP_FD::recv_to_buffer});
+  this->sock->on_read_batch({this, &UDP_FD::recv_batch_to_buffer});
 }
 UDP_FD::~UDP_FD()
 {
@@ -69,9 +79,44 @@ ssize_t UDP_FD::read(void* buffer, size_t len)
 {
   return recv(buffer, len, 0);
 }
+ssize_t UDP_FD::readv(const struct iovec* iov, int iovcnt)
+{
+  if(UNLIKELY(this->sock == nullptr))
+    return -EINVAL;
+  if(buffer_.empty() and not is_blocking())
+    return -EAGAIN;
+  // the default handler buffers what arrives
+  while(buffer_.empty())
+    os::block();
+
+  // one datagram, scattered over the buffers
+  auto& mbuf = buffer_.front().buffer;
+  size_t count = 0;
+  for(int i = 0; i < iovcnt and count < mbuf->size(); i++)
+  {
+    const size_t n = std::min(iov[i].iov_len, mbuf->size() - count);
+    memcpy(iov[i].iov_base, mbuf->data() + count, n);
+    count += n;
+  }
+  buffer_.pop_front();
+  return count;
+}
 int UDP_FD::write(const void* buffer, size_t len)
 {
-  return send(buffer, len, 0);
+  // only to the connected peer
+  return sendto(buffer, len, 0, nullptr, 0);
+}
+ssize_t UDP_FD::writev(const struct iovec* iov, int iovcnt)
+{
+  if(iovcnt == 1)
+    return write(iov[0].iov_base, iov[0].iov_len);
+  // gathered into a single datagram
+  std::vector<uint8_t> buf;
+  for(int i = 0; i < iovcnt; i++) {
+    const auto* base = (const uint8_t*) iov[i].iov_base;
+    buf.insert(buf.end(), base, base + iov[i].iov_len);
+  }
+  return sendto(buf.data(), buf.size(), 0, nullptr, 0);
 }
 int UDP_FD::close()
 {
@@ -134,7 +179,7 @@ long UDP_FD::connect(const struct sockaddr* address, socklen_t address_len)
   return 0;
 }
 
-ssize_t UDP_FD::sendto(const void* message, size_t len, int,
+ssize_t UDP_FD::sendto(const void* message, size_t len, int flags,
   const struct sockaddr* dest_addr, socklen_t dest_len)
 {
   if(not is_connected())
@@ -161,6 +206,13 @@ ssize_t UDP_FD::sendto(const void* message, size_t len, int,
     return -EOPNOTSUPP;
   }
 
+  // the datagram is copied, so there's no need to wait for it to leave
+  if(flags & MSG_DONTWAIT or not is_blocking())
+  {
+    this->sock->sendto(net::ip4::Addr{ntohl(dest.sin_addr.s_addr)}, ntohs(dest.sin_port), message, len);
+    return len;
+  }
+
   // Sending
   bool written = false;
   this->sock->sendto(net::ip4::Addr{ntohl(dest.sin_addr.s_addr)}, ntohs(dest.sin_port), message, len,
@@ -171,6 +223,68 @@ ssize_t UDP_FD::sendto(const void* message, size_t len, int,
 
   return len;
 }
+int UDP_FD::sendmmsg(struct mmsghdr* msgvec, unsigned int vlen, int flags)
+{
+  // Bind a socket if we dont already have one
+  if(this->sock == nullptr) {
+    this->sock = &net_stack().udp().bind();
+    set_default_recv();
+  }
+
+  std::vector<net::udp::Datagram> msgs;
+  msgs.reserve(vlen);
+  // messages spread over more than one iovec are gathered here
+  std::deque<std::vector<uint8_t>> gathered;
+
+  for(unsigned int i = 0; i < vlen; i++)
+  {
+    auto& hdr = msgvec[i].msg_hdr;
+    const auto* dest = (not is_connected()) ? (const sockaddr_in*) hdr.msg_name : &peer_;
+    long err = 0;
+    if(UNLIKELY(dest == nullptr))
+      err = -EDESTADDRREQ;
+    else if(UNLIKELY(not is_connected() and hdr.msg_namelen != sizeof(struct sockaddr_in)))
+      err = -EAFNOSUPPORT;
+    else if(!broadcast_ && dest->sin_addr.s_addr == INADDR_BROADCAST)
+      err = -EOPNOTSUPP;
+    // the error is only returned when nothing could be sent
+    if(UNLIKELY(err)) {
+      if(msgs.empty()) return err;
+      break;
+    }
+
+    const void* data = (hdr.msg_iovlen > 0) ? hdr.msg_iov[0].iov_base : nullptr;
+    size_t len = (hdr.msg_iovlen > 0) ? hdr.msg_iov[0].iov_len : 0;
+    if(hdr.msg_iovlen > 1)
+    {
+      auto& buf = gathered.emplace_back();
+      for(size_t v = 0; v < hdr.msg_iovlen; v++) {
+        const auto* base = (const uint8_t*) hdr.msg_iov[v].iov_base;
+        buf.insert(buf.end(), base, base + hdr.msg_iov[v].iov_len);
+      }
+      data = buf.data();
+      len  = buf.size();
+    }
+
+    msgs.push_back({{net::ip4::Addr{ntohl(dest->sin_addr.s_addr)}, ntohs(dest->sin_port)},
+                    data, len});
+    msgvec[i].msg_len = len;
+  }
+
+  // Sending, all in one go
+  if(flags & MSG_DONTWAIT or not is_blocking())
+  {
+    this->sock->send_batch(msgs.data(), msgs.size());
+    return msgs.size();
+  }
+  bool written = false;
+  this->sock->send_batch(msgs.data(), msgs.size(), [&written]() { written = true; });
+
+  while(!written)
+    os::block();
+
+  return msgs.size();
+}
 ssize_t UDP_FD::recv(void* buffer, size_t len, int flags)
 {
   PRINT("UDP: recv(%lu, %x)\n", len, flags);
@@ -189,12 +303,17 @@ ssize_t UDP_FD::recvfrom(void *__restrict__ buffer, size_t len, int flags,
   {
     return read_from_buffer(buffer, len, flags, address, address_len);
   }
+  else if(flags & MSG_DONTWAIT or not is_blocking())
+  {
+    return -EAGAIN;
+  }
   // Else make a blocking receive
   else
   {
     int bytes = 0;
     bool done = false;
 
+    this->sock->on_read_batch(nullptr);
     this->sock->on_read(net::udp::Socket::recvfrom_handler::make_packed(
     [&bytes, &done, this,
       buffer, len, flags, address, address_len]
@@ -235,26 +354,71 @@ ssize_t UDP_FD::recvfrom(void *__restrict__ buffer, size_t len, int flags,
     return bytes;
   }
 }
+int UDP_FD::recvmmsg(struct mmsghdr* msgvec, unsigned int vlen, int flags,
+  struct timespec*)
+{
+  if(UNLIKELY(this->sock == nullptr)) {
+    return -EINVAL;
+  }
+  if(vlen == 0)
+    return 0;
+
+  // Block until (any) data is buffered, then take what there is
+  if(buffer_.empty())
+  {
+    if(flags & MSG_DONTWAIT or not is_blocking())
+      return -EAGAIN;
+    while(buffer_.empty())
+      os::block();
+  }
+
+  unsigned int count = 0;
+  for(; count < vlen and not buffer_.empty(); count++)
+  {
+    auto& hdr  = msgvec[count].msg_hdr;
+    auto& msg  = buffer_.front();
+    auto& mbuf = msg.buffer;
+
+    // scatter over the iovecs, truncating what doesn't fit
+    size_t copied = 0;
+    for(size_t v = 0; v < hdr.msg_iovlen and copied < mbuf->size(); v++) {
+      const size_t n = std::min(hdr.msg_iov[v].iov_len, mbuf->size() - copied);
+      memcpy(hdr.msg_iov[v].iov_base, mbuf->data() + copied, n);
+      copied += n;
+    }
+    hdr.msg_flags = (copied < mbuf->size()) ? MSG_TRUNC : 0;
+
+    if(hdr.msg_name != nullptr) {
+      memcpy(hdr.msg_name, &msg.src, std::min(hdr.msg_namelen, (uint32_t) sizeof(struct sockaddr_in)));
+      hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    msgvec[count].msg_len = copied;
+
+    if(flags & MSG_PEEK)
+      return count + 1;
+    buffer_.pop_front();
+  }
+  return count;
+}
+
 int UDP_FD::getsockopt(int level, int option_name,
   void *option_value, socklen_t *option_len)
 {
   PRINT("UDP: getsockopt(%d, %d)\n", level, option_name);
   if(level != SOL_SOCKET)
-    return -1;
+    return -ENOPROTOOPT;
 
   switch(option_name)
   {
     case SO_ACCEPTCONN:
     {
-      errno = ENOPROTOOPT;
-      return -1;
+      return -ENOPROTOOPT;
     }
     case SO_BROADCAST:
     {
       if(*option_len < (int)sizeof(int))
       {
-        errno = EINVAL;
-        return -1;
+        return -EINVAL;
       }
 
       *((int*)option_value) = broadcast_;
@@ -263,15 +427,13 @@ int UDP_FD::getsockopt(int level, int option_name,
     }
     case SO_KEEPALIVE:
     {
-      errno = ENOPROTOOPT;
-      return -1;
+      return -ENOPROTOOPT;
     }
     case SO_RCVBUF:
     {
       if(*option_len < (int)sizeof(int))
       {
-        errno = EINVAL;
-        return -1;
+        return -EINVAL;
       }
 
       *((int*)option_value) = rcvbuf_;
@@ -280,11 +442,11 @@ int UDP_FD::getsockopt(int level, int option_name,
     }
     // Address can always be reused in IncludeOS
     case SO_REUSEADDR:
+    case SO_REUSEPORT:
     {
       if(*option_len < (int)sizeof(int))
       {
-        errno = EINVAL;
-        return -1;
+        return -EINVAL;
       }
 
       *((int*)option_value) = 1;
@@ -295,8 +457,7 @@ int UDP_FD::getsockopt(int level, int option_name,
     {
       if(*option_len < (int)sizeof(int))
       {
-        errno = EINVAL;
-        return -1;
+        return -EINVAL;
       }
 
       *((int*)option_value) = SOCK_DGRAM;
@@ -305,7 +466,7 @@ int UDP_FD::getsockopt(int level, int option_name,
     }
 
     default:
-      return -1;
+      return -ENOPROTOOPT;
   } // < switch(option_name)
 }
 
@@ -314,38 +475,38 @@ int UDP_FD::setsockopt(int level, int option_name,
 {
   PRINT("UDP: setsockopt(%d, %d, ... %d)\n", level, option_name, option_len);
   if(level != SOL_SOCKET)
-    return -1;
+    return -ENOPROTOOPT;
 
   switch(option_name)
   {
     case SO_BROADCAST:
     {
       if(option_len < (int)sizeof(int))
-        return -1;
+        return -EINVAL;
 
       broadcast_ = *((int*)option_value);
       return 0;
     }
     case SO_KEEPALIVE:
     {
-      errno = ENOPROTOOPT;
-      return -1;
+      return -ENOPROTOOPT;
     }
     case SO_RCVBUF:
     {
       if(option_len < (int)sizeof(int))
-        return -1;
+        return -EINVAL;
 
       rcvbuf_ = *((int*)option_value);
       return 0;
     }
     // Address can always be reused in IncludeOS
     case SO_REUSEADDR:
+    case SO_REUSEPORT:
     {
       return 0;
     }
 
     default:
-      return -1;
+      return -ENOPROTOOPT;
   } // < switch(option_name)
 }
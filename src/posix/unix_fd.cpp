@@ -33,7 +33,10 @@ long Unix_FD::set_impl_if_needed(const struct sockaddr* addr, socklen_t addrlen)
 long Unix_FD::connect(const struct sockaddr* addr, socklen_t addrlen)
 {
   auto res = set_impl_if_needed(addr, addrlen);
-  return (res < 0) ? res : impl->connect(addr, addrlen);
+  if (res < 0) return res;
+  res = impl->connect(addr, addrlen);
+  notify_ready();
+  return res;
 }
 
 ssize_t Unix_FD::sendto(const void* buf, size_t len, int fl,
@@ -8,6 +8,17 @@ void autoconf::run()
 {
   INFO("Autoconf", "Running auto configure");
 
+  // the compiled config is read in place, without a JSON document
+  if(const auto root = Config::compiled(); root.IsObject())
+  {
+    if(root.HasMember("net"))
+    {
+      net::configure(root["net"]);
+    }
+    INFO("Autoconf", "Finished");
+    return;
+  }
+
   const auto& cfg = Config::get();
 
   if(cfg.empty())
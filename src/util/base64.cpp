@@ -0,0 +1,437 @@
+#include <util/base64.hpp>
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  #include <immintrin.h>
+  #include <kernel/cpuid.hpp>
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
+#include <common>
+
+namespace base64 {
+
+/**
+ *  The kernels take as many whole blocks as they can from the front of
+ *  the input, advancing @src, @len and @out, and leave the rest to the
+ *  scalar code. A decode kernel stops at a block with chars that aren't
+ *  in the alphabet (when validating), so that the scalar code finds them.
+ */
+struct Alphabet {
+  const char* chars;
+  uint8_t c62, c63; // the chars that differ between the alphabets
+};
+
+using encode_kernel_t = void (*)(const uint8_t*& src, size_t& len, char*& out,
+                                 const Alphabet&);
+using decode_kernel_t = void (*)(const uint8_t*& src, size_t& len, uint8_t*& out,
+                                 const uint8_t* out_end, const Alphabet&, bool validate);
+
+struct Codec_kernel {
+  const char*     name;
+  bool            (*available)();
+  encode_kernel_t encode;
+  decode_kernel_t decode;
+};
+
+static const Alphabet standard {base64_alphabet(),    '+', '/'};
+static const Alphabet url      {base64url_alphabet(), '-', '_'};
+
+static constexpr uint8_t INVALID = 0xff;
+
+using decode_table_t = std::array<uint8_t, 256>;
+
+static constexpr decode_table_t make_decode_table(const char c62, const char c63)
+{
+  decode_table_t table {};
+  for (auto& val : table) val = INVALID;
+  for (int i = 0; i < 26; i++) {
+    table['A' + i] = i;
+    table['a' + i] = 26 + i;
+  }
+  for (int i = 0; i < 10; i++)
+    table['0' + i] = 52 + i;
+  table[(uint8_t) c62] = 62;
+  table[(uint8_t) c63] = 63;
+  return table;
+}
+
+static constexpr decode_table_t standard_table = make_decode_table('+', '/');
+static constexpr decode_table_t url_table      = make_decode_table('-', '_');
+
+static void encode_scalar(const uint8_t*& src, size_t& len, char*& out,
+                          const Alphabet& abc)
+{
+  while (len >= 3)
+  {
+    const uint32_t v = src[0] << 16 | src[1] << 8 | src[2];
+    out[0] = abc.chars[v >> 18];
+    out[1] = abc.chars[(v >> 12) & 0x3f];
+    out[2] = abc.chars[(v >> 6) & 0x3f];
+    out[3] = abc.chars[v & 0x3f];
+    src += 3; len -= 3; out += 4;
+  }
+}
+
+static void decode_scalar(const uint8_t*&, size_t&, uint8_t*&, const uint8_t*,
+                          const Alphabet&, bool)
+{
+  // all of it is left to the scalar tail
+}
+
+static bool always() { return true; }
+
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+// CPU support is not enough, the OS must save the register state (XCR0)
+static bool os_saves(uint64_t mask)
+{
+  if (not CPUID::has_feature(CPUID::Feature::OSXSAVE)) return false;
+  uint32_t lo, hi;
+  asm volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((((uint64_t) hi << 32) | lo) & mask) == mask;
+}
+
+static bool has_ssse3()
+{ return CPUID::has_feature(CPUID::Feature::SSSE3); }
+
+/**
+ *  Encoding spreads 3 bytes over the 4 bytes of each 32-bit lane, moves
+ *  the 6-bit units into place with multiplications, and turns them into
+ *  chars by adding an offset looked up from the range each is in.
+ */
+__attribute__((target("ssse3")))
+static __m128i encode_units_ssse3(__m128i in, const __m128i shift_lut)
+{
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  const __m128i units = _mm_or_si128(t1, t3);
+  // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+  __m128i range = _mm_subs_epu8(units, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), units);
+  range = _mm_or_si128(range, _mm_and_si128(less, _mm_set1_epi8(13)));
+  return _mm_add_epi8(units, _mm_shuffle_epi8(shift_lut, range));
+}
+
+__attribute__((target("ssse3")))
+static __m128i shift_lut_ssse3(const Alphabet& abc)
+{
+  return _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       abc.c62 - 62, abc.c63 - 63, 'A', 0, 0);
+}
+
+__attribute__((target("ssse3")))
+static void encode_ssse3(const uint8_t*& src, size_t& len, char*& out,
+                         const Alphabet& abc)
+{
+  const __m128i shift_lut = shift_lut_ssse3(abc);
+  // 12 bytes are used from each 16 loaded
+  while (len >= 16)
+  {
+    const __m128i in = _mm_loadu_si128((const __m128i*) src);
+    _mm_storeu_si128((__m128i*) out, encode_units_ssse3(in, shift_lut));
+    src += 12; len -= 12; out += 16;
+  }
+}
+
+static inline __m128i in_range_sse(const __m128i v, const char lo, const char hi)
+{
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+}
+
+/**
+ *  Decoding finds the range each char is in, which gives both whether it
+ *  is valid and the offset to its 6-bit unit. The units are then merged
+ *  pairwise with multiply-adds, and the 3 bytes of each lane shuffled out.
+ */
+__attribute__((target("ssse3")))
+static bool decode_units_ssse3(__m128i& v, const Alphabet& abc, const bool validate)
+{
+  const __m128i upper = in_range_sse(v, 'A', 'Z');
+  const __m128i lower = in_range_sse(v, 'a', 'z');
+  const __m128i digit = in_range_sse(v, '0', '9');
+  const __m128i c62   = _mm_cmpeq_epi8(v, _mm_set1_epi8(abc.c62));
+  const __m128i c63   = _mm_cmpeq_epi8(v, _mm_set1_epi8(abc.c63));
+  if (validate)
+  {
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                          _mm_or_si128(_mm_or_si128(digit, c62), c63));
+    if (_mm_movemask_epi8(valid) != 0xffff) return false;
+  }
+  __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-65));
+  shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+  shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+  shift = _mm_or_si128(shift, _mm_and_si128(c62, _mm_set1_epi8(62 - abc.c62)));
+  shift = _mm_or_si128(shift, _mm_and_si128(c63, _mm_set1_epi8(63 - abc.c63)));
+  v = _mm_add_epi8(v, shift);
+  return true;
+}
+
+__attribute__((target("ssse3")))
+static __m128i pack_units_ssse3(__m128i v)
+{
+  const __m128i ab_bc = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+  const __m128i abcd  = _mm_madd_epi16(ab_bc, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                              -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static void decode_ssse3(const uint8_t*& src, size_t& len, uint8_t*& out,
+                         const uint8_t* out_end, const Alphabet& abc, bool validate)
+{
+  // 12 bytes are used from each 16 stored, and the padding is left alone
+  while (len >= 16 + 4 and out_end - out >= 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) src);
+    if (not decode_units_ssse3(v, abc, validate)) return;
+    _mm_storeu_si128((__m128i*) out, pack_units_ssse3(v));
+    src += 16; len -= 16; out += 12;
+  }
+}
+
+static bool has_avx2()
+{
+  return CPUID::has_feature(CPUID::Feature::AVX2) and os_saves(0x6);
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2(const uint8_t*& src, size_t& len, char*& out,
+                        const Alphabet& abc)
+{
+  const __m128i lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, abc.c62 - 62, abc.c63 - 63, 'A', 0, 0);
+  const __m256i shift_lut = _mm256_broadcastsi128_si256(lut);
+  const __m256i spread = _mm256_broadcastsi128_si256(
+      _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  // 12 bytes for each lane, from two loads
+  while (len >= 12 + 16)
+  {
+    __m256i in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) src)),
+        _mm_loadu_si128((const __m128i*) (src + 12)), 1);
+    in = _mm256_shuffle_epi8(in, spread);
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i units = _mm256_or_si256(t1, t3);
+    __m256i range = _mm256_subs_epu8(units, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), units);
+    range = _mm256_or_si256(range, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    const __m256i chars = _mm256_add_epi8(units, _mm256_shuffle_epi8(shift_lut, range));
+    _mm256_storeu_si256((__m256i*) out, chars);
+    src += 24; len -= 24; out += 32;
+  }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i in_range_avx2(const __m256i v, const char lo, const char hi)
+{
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+__attribute__((target("avx2")))
+static void decode_avx2(const uint8_t*& src, size_t& len, uint8_t*& out,
+                        const uint8_t* out_end, const Alphabet& abc, bool validate)
+{
+  const __m256i pack = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  // 24 bytes are used from each 32 stored
+  while (len >= 32 + 4 and out_end - out >= 32)
+  {
+    const __m256i v = _mm256_loadu_si256((const __m256i*) src);
+    const __m256i upper = in_range_avx2(v, 'A', 'Z');
+    const __m256i lower = in_range_avx2(v, 'a', 'z');
+    const __m256i digit = in_range_avx2(v, '0', '9');
+    const __m256i c62   = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(abc.c62));
+    const __m256i c63   = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(abc.c63));
+    if (validate)
+    {
+      const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                            _mm256_or_si256(_mm256_or_si256(digit, c62), c63));
+      if (_mm256_movemask_epi8(valid) != -1) return;
+    }
+    __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(c62, _mm256_set1_epi8(62 - abc.c62)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(c63, _mm256_set1_epi8(63 - abc.c63)));
+    const __m256i units = _mm256_add_epi8(v, shift);
+
+    const __m256i ab_bc = _mm256_maddubs_epi16(units, _mm256_set1_epi32(0x01400140));
+    const __m256i abcd  = _mm256_madd_epi16(ab_bc, _mm256_set1_epi32(0x00011000));
+    // 12 bytes at the start of each lane, then next to each other
+    __m256i bytes = _mm256_shuffle_epi8(abcd, pack);
+    bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256((__m256i*) out, bytes);
+    src += 32; len -= 32; out += 24;
+  }
+}
+
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+/**
+ *  The structure loads and stores split 3 bytes into 3 vectors, and 4
+ *  chars into 4, so that the units are only shifts apart.
+ */
+static void encode_neon(const uint8_t*& src, size_t& len, char*& out,
+                        const Alphabet& abc)
+{
+  uint8x16x4_t table;
+  table.val[0] = vld1q_u8((const uint8_t*) abc.chars +  0);
+  table.val[1] = vld1q_u8((const uint8_t*) abc.chars + 16);
+  table.val[2] = vld1q_u8((const uint8_t*) abc.chars + 32);
+  table.val[3] = vld1q_u8((const uint8_t*) abc.chars + 48);
+  const uint8x16_t mask = vdupq_n_u8(0x3f);
+  while (len >= 48)
+  {
+    const uint8x16x3_t in = vld3q_u8(src);
+    uint8x16x4_t units;
+    units.val[0] = vshrq_n_u8(in.val[0], 2);
+    units.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+    units.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+    units.val[3] = vandq_u8(in.val[2], mask);
+    for (auto& u : units.val) u = vqtbl4q_u8(table, u);
+    vst4q_u8((uint8_t*) out, units);
+    src += 48; len -= 48; out += 64;
+  }
+}
+
+static inline uint8x16_t in_range_neon(const uint8x16_t v, const uint8_t lo, const uint8_t hi)
+{
+  return vandq_u8(vcgeq_u8(v, vdupq_n_u8(lo)), vcleq_u8(v, vdupq_n_u8(hi)));
+}
+
+static uint8x16_t decode_units_neon(uint8x16_t v, uint8x16_t& valid, const Alphabet& abc)
+{
+  const uint8x16_t upper = in_range_neon(v, 'A', 'Z');
+  const uint8x16_t lower = in_range_neon(v, 'a', 'z');
+  const uint8x16_t digit = in_range_neon(v, '0', '9');
+  const uint8x16_t c62   = vceqq_u8(v, vdupq_n_u8(abc.c62));
+  const uint8x16_t c63   = vceqq_u8(v, vdupq_n_u8(abc.c63));
+  valid = vandq_u8(valid, vorrq_u8(vorrq_u8(upper, lower),
+                                   vorrq_u8(vorrq_u8(digit, c62), c63)));
+  uint8x16_t shift = vandq_u8(upper, vdupq_n_u8((uint8_t) -65));
+  shift = vorrq_u8(shift, vandq_u8(lower, vdupq_n_u8((uint8_t) -71)));
+  shift = vorrq_u8(shift, vandq_u8(digit, vdupq_n_u8(4)));
+  shift = vorrq_u8(shift, vandq_u8(c62, vdupq_n_u8((uint8_t) (62 - abc.c62))));
+  shift = vorrq_u8(shift, vandq_u8(c63, vdupq_n_u8((uint8_t) (63 - abc.c63))));
+  return vaddq_u8(v, shift);
+}
+
+static void decode_neon(const uint8_t*& src, size_t& len, uint8_t*& out,
+                        const uint8_t*, const Alphabet& abc, bool validate)
+{
+  // the padding is left alone
+  while (len >= 64 + 4)
+  {
+    uint8x16x4_t in = vld4q_u8(src);
+    uint8x16_t valid = vdupq_n_u8(0xff);
+    for (auto& v : in.val) v = decode_units_neon(v, valid, abc);
+    if (validate and vminvq_u8(valid) != 0xff) return;
+    uint8x16x3_t bytes;
+    bytes.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+    bytes.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+    vst3q_u8(out, bytes);
+    src += 64; len -= 64; out += 48;
+  }
+}
+#endif
+
+// best first
+static const Codec_kernel kernels[] {
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  { "avx2",   has_avx2,   encode_avx2,   decode_avx2   },
+  { "ssse3",  has_ssse3,  encode_ssse3,  decode_ssse3  },
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+  { "neon",   always,     encode_neon,   decode_neon   },
+#endif
+  { "scalar", always,     encode_scalar, decode_scalar },
+};
+
+static const Codec_kernel* active_kernel = nullptr;
+
+static const Codec_kernel& kernel() noexcept
+{
+  if (UNLIKELY(active_kernel == nullptr)) {
+    for (const auto& k : kernels)
+      if (k.available()) { active_kernel = &k; break; }
+  }
+  return *active_kernel;
+}
+
+size_t encode_into(const void* data, size_t length, char* out,
+                   const url_alphabet url_alphabet_switch) noexcept
+{
+  const Alphabet& abc = url_alphabet_switch ? url : standard;
+  auto* src = (const uint8_t*) data;
+  char* const begin = out;
+
+  kernel().encode(src, length, out, abc);
+  encode_scalar(src, length, out, abc);
+
+  if (length == 1) {
+    *out++ = abc.chars[src[0] >> 2];
+    *out++ = abc.chars[(src[0] & 0x03) << 4];
+    *out++ = '=';
+    *out++ = '=';
+  }
+  else if (length == 2) {
+    *out++ = abc.chars[src[0] >> 2];
+    *out++ = abc.chars[((src[0] & 0x03) << 4) | (src[1] >> 4)];
+    *out++ = abc.chars[(src[1] & 0x0f) << 2];
+    *out++ = '=';
+  }
+  return out - begin;
+}
+
+long decode_into(const char* data, size_t length, void* out_v,
+                 const url_alphabet url_alphabet_switch, const bool validate) noexcept
+{
+  const Alphabet& abc = url_alphabet_switch ? url : standard;
+  const decode_table_t& table = url_alphabet_switch ? url_table : standard_table;
+  auto* src = (const uint8_t*) data;
+  auto* out = (uint8_t*) out_v;
+  uint8_t* const begin = out;
+
+  // the padding is optional
+  if (length > 0 and src[length - 1] == '=') length--;
+  if (length > 0 and src[length - 1] == '=') length--;
+
+  kernel().decode(src, length, out, begin + decoded_size(length), abc, validate);
+
+  uint32_t bits = 0;
+  uint32_t valid = 0; // INVALID where any unit was
+  size_t   units = 0;
+  for (; length > 0; src++, length--)
+  {
+    const uint8_t unit = table[*src];
+    valid |= unit;
+    bits = (bits << 6) | (unit & 0x3f);
+    if (++units == 4)
+    {
+      out[0] = bits >> 16;
+      out[1] = bits >> 8;
+      out[2] = bits;
+      out += 3; units = 0; bits = 0;
+    }
+  }
+  if (validate and (valid == INVALID or units == 1))
+    return -1;
+
+  if (units == 2) {
+    *out++ = bits >> 4;
+  }
+  else if (units == 3) {
+    *out++ = bits >> 10;
+    *out++ = bits >> 2;
+  }
+  return out - begin;
+}
+
+} //< namespace base64
@@ -0,0 +1,116 @@
+
+#include <util/compressed_image.hpp>
+#include <util/crc32.hpp>
+#include <util/lz4.hpp>
+#include <smp_utils>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace compressed_image
+{
+  static const Header* header_of(const void* data, size_t len) noexcept
+  {
+    if (data == nullptr or len < sizeof(Header)) return nullptr;
+    const auto* hdr = (const Header*) data;
+    if (hdr->magic != MAGIC or hdr->version != VERSION) return nullptr;
+    return hdr;
+  }
+
+  static inline uint32_t checksum(const uint8_t* data, size_t len) noexcept
+  {
+    return CRC32_VALUE(crc32_update(CRC32_BEGIN(), data, len));
+  }
+
+  bool is_compressed(const void* data, size_t len) noexcept
+  {
+    return header_of(data, len) != nullptr;
+  }
+
+  uint64_t decompressed_size(const void* data, size_t len) noexcept
+  {
+    const auto* hdr = header_of(data, len);
+    return (hdr) ? hdr->size : 0;
+  }
+
+  std::vector<uint8_t> compress(const void* data, size_t len, size_t chunk_size)
+  {
+    if (chunk_size == 0 or chunk_size > UINT32_MAX)
+      throw Error("Invalid chunk size for compressed image");
+    const auto* src = (const uint8_t*) data;
+    const size_t chunks = (len + chunk_size - 1) / chunk_size;
+    const size_t table  = sizeof(Header) + chunks * sizeof(Chunk);
+
+    std::vector<uint8_t> image(table);
+    Header hdr {MAGIC, VERSION, 0, (uint32_t) chunk_size, (uint32_t) chunks, len};
+    std::memcpy(image.data(), &hdr, sizeof(hdr));
+
+    for (size_t i = 0; i < chunks; i++)
+    {
+      const size_t first = i * chunk_size;
+      const size_t part  = std::min(chunk_size, len - first);
+      Chunk chunk {image.size(), 0, checksum(&src[first], part)};
+
+      image.resize(chunk.offset + lz4::compress_bound(part));
+      size_t length = lz4::compress(&src[first], part, &image[chunk.offset], image.size() - chunk.offset);
+      // a chunk that doesn't shrink is stored as is
+      if (length == 0 or length >= part) {
+        std::memcpy(&image[chunk.offset], &src[first], part);
+        length = part;
+      }
+      chunk.length = length;
+      image.resize(chunk.offset + length);
+      std::memcpy(&image[sizeof(Header) + i * sizeof(Chunk)], &chunk, sizeof(chunk));
+    }
+    return image;
+  }
+
+  size_t decompress(const void* data, size_t len, void* dest, size_t cap)
+  {
+    const auto* hdr = header_of(data, len);
+    if (hdr == nullptr)
+      throw Error("Not a compressed image");
+    const size_t size       = hdr->size;
+    const size_t chunk_size = hdr->chunk_size;
+    const size_t chunks     = hdr->chunks;
+    if (size > cap)
+      throw Error("Compressed image doesn't fit in the destination");
+    if (chunk_size == 0 or chunks != (size + chunk_size - 1) / chunk_size
+        or chunks > (len - sizeof(Header)) / sizeof(Chunk))
+      throw Error("Compressed image has a malformed header");
+
+    const auto* image = (const uint8_t*) data;
+    const auto* table = (const Chunk*) &image[sizeof(Header)];
+    for (size_t i = 0; i < chunks; i++)
+    {
+      const auto& chunk = table[i];
+      if (chunk.offset > len or chunk.length > len - chunk.offset)
+        throw Error("Compressed image is truncated");
+    }
+
+    // the chunks don't depend on each other, so each goes on its own
+    std::atomic<size_t> corrupt {0};
+    auto* out = (uint8_t*) dest;
+    smp::parallel_for(0, chunks,
+      [&] (const size_t i) {
+        const auto& chunk = table[i];
+        const size_t first = i * chunk_size;
+        const size_t part  = std::min(chunk_size, size - first);
+        const uint8_t* in  = &image[chunk.offset];
+        bool ok;
+        if (chunk.length == part) {
+          std::memcpy(&out[first], in, part);
+          ok = true;
+        }
+        else {
+          ok = lz4::decompress(in, chunk.length, &out[first], part) == (long) part;
+        }
+        if (not ok or checksum(&out[first], part) != chunk.crc)
+          corrupt.fetch_add(1, std::memory_order_relaxed);
+      }, 1);
+
+    if (corrupt.load() > 0)
+      throw Error("Compressed image is corrupt");
+    return size;
+  }
+}
@@ -1,11 +1,14 @@
 
 #include <util/config.hpp>
 #include <rapidjson/error/en.h>
+#include <cstring>
 #include <memory>
 #include <info>
 
 extern char _CONFIG_JSON_START_;
 extern char _CONFIG_JSON_END_;
+extern char _CONFIG_BIN_START_;
+extern char _CONFIG_BIN_END_;
 
 const Config& Config::get() noexcept
 {
@@ -39,3 +42,22 @@ const rapidjson::Document& Config::doc()
 
   return *ptr;
 }
+
+Config_value Config::compiled() noexcept
+{
+  // magic, size of the root value
+  static constexpr size_t HEADER = 8;
+  const auto* start = (const uint8_t*) &_CONFIG_BIN_START_;
+  const size_t size = &_CONFIG_BIN_END_ - &_CONFIG_BIN_START_;
+  if (size < HEADER or std::memcmp(start, "ICF1", 4) != 0)
+    return {};
+
+  uint32_t root_size;
+  std::memcpy(&root_size, start + 4, sizeof(root_size));
+  if (root_size > size - HEADER)
+  {
+    INFO("Config", "Compiled config is truncated");
+    return {};
+  }
+  return Config_value{start + HEADER};
+}
@@ -0,0 +1,43 @@
+#include <util/config_value.hpp>
+
+// tag, count, bytes of the elements or members
+static constexpr size_t CONTAINER_HEAD = 1 + 4 + 4;
+
+size_t Config_value::encoded_size() const noexcept
+{
+  switch (type()) {
+  case INT_T:
+  case DOUBLE_T:
+    return 1 + 8;
+  case STRING_T:
+    return 1 + 4 + read<uint32_t>(1) + 1;
+  case ARRAY_T:
+  case OBJECT_T:
+    return CONTAINER_HEAD + read<uint32_t>(5);
+  default:
+    return 1;
+  }
+}
+
+Config_value::Array Config_value::GetArray() const noexcept
+{
+  if (not IsArray()) return {Iterator{nullptr}, Iterator{nullptr}};
+  return {Iterator{p_ + CONTAINER_HEAD}, Iterator{p_ + encoded_size()}};
+}
+
+Config_value Config_value::operator[](const char* name) const noexcept
+{
+  if (not IsObject()) return {};
+  const size_t len = std::strlen(name);
+  const uint8_t* p = p_ + CONTAINER_HEAD;
+  for (uint32_t i = Size(); i > 0; i--)
+  {
+    uint32_t key_len;
+    std::memcpy(&key_len, p, sizeof(key_len));
+    const uint8_t* value = p + 4 + key_len + 1;
+    if (key_len == len and std::memcmp(p + 4, name, len) == 0)
+      return Config_value{value};
+    p = value + Config_value{value}.encoded_size();
+  }
+  return {};
+}
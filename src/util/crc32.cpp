@@ -1,51 +1,177 @@
 
 #include <util/crc32.hpp>
+#include <util/detail/crc_fold.hpp>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include <common>
 
 /** Intel (iSCSI) or vanilla-polynomial, DONT mix with other code **/
 #if defined(ARCH_x86_64) || defined(ARCH_i686)
   #include <immintrin.h>
+  #include <kernel/cpuid.hpp>
+#elif defined(ARCH_aarch64)
+  #include <arm_acle.h>
 #endif
 
-inline bool ____is__aligned(const uint8_t* buffer, const int align) noexcept {
-  return (((uintptr_t) buffer) & (align-1)) == 0;
+using util::detail::Crc_fold_keys;
+
+// the normal polynomials, for the folding keys
+static constexpr Crc_fold_keys crc32_keys  = util::detail::crc_fold_keys(0x04C11DB7, 32);
+static constexpr Crc_fold_keys crc32c_keys = util::detail::crc_fold_keys(0x1EDC6F41, 32);
+
+template <typename T>
+static inline T load(const uint8_t* buffer) noexcept {
+  T val;
+  std::memcpy(&val, buffer, sizeof(T));
+  return val;
+}
+
+// what the CPU can do, checked on first use
+static struct {
+  bool checked = false;
+  bool crc32c  = false; // SSE 4.2 or ARMv8 CRC instructions
+  bool fold    = false; // PCLMULQDQ
+} cpu;
+
+static void check_cpu()
+{
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  cpu.crc32c = CPUID::has_feature(CPUID::Feature::SSE4_2);
+  cpu.fold   = CPUID::has_feature(CPUID::Feature::PCLMULQDQ);
+#elif defined(ARCH_aarch64)
+  uint64_t isar0;
+  asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r"(isar0));
+  cpu.crc32c = ((isar0 >> 16) & 0xf) != 0;
+#endif
+  cpu.checked = true;
 }
 
 #if defined(ARCH_x86_64) || defined(ARCH_i686)
 __attribute__ ((target ("sse4.2")))
-uint32_t crc32c_hw(const uint8_t* buffer, size_t len)
+static uint32_t crc32c_hw(uint32_t hash, const uint8_t* buffer, size_t len)
 {
-  uint32_t hash = 0xFFFFFFFF;
-  // 8-bits until 4-byte aligned
-  while (____is__aligned(buffer, 4) == false && len > 0) {
+  // 8-bits until aligned
+  while (((uintptr_t) buffer & 7) != 0 && len > 0) {
     hash = _mm_crc32_u8(hash, *buffer); buffer++; len--;
   }
-  // 16 bytes at a time
-  while (len >= 16) {
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer +  0));
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer +  4));
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer +  8));
-    hash = _mm_crc32_u32(hash, *(uint32_t*) (buffer + 12));
-    buffer += 16; len -= 16;
+#ifdef ARCH_x86_64
+  // 8 bytes at a time, 32 per round
+  uint64_t hash64 = hash;
+  while (len >= 32) {
+    hash64 = _mm_crc32_u64(hash64, load<uint64_t>(buffer +  0));
+    hash64 = _mm_crc32_u64(hash64, load<uint64_t>(buffer +  8));
+    hash64 = _mm_crc32_u64(hash64, load<uint64_t>(buffer + 16));
+    hash64 = _mm_crc32_u64(hash64, load<uint64_t>(buffer + 24));
+    buffer += 32; len -= 32;
+  }
+  while (len >= 8) {
+    hash64 = _mm_crc32_u64(hash64, load<uint64_t>(buffer));
+    buffer += 8; len -= 8;
   }
+  hash = hash64;
+#endif
   // 4 bytes at a time
   while (len >= 4) {
-    hash = _mm_crc32_u32(hash, *(uint32_t*) buffer);
+    hash = _mm_crc32_u32(hash, load<uint32_t>(buffer));
     buffer += 4; len -= 4;
   }
   // remaining bytes
   if (len & 2) {
-    hash = _mm_crc32_u16(hash, *(uint16_t*) buffer);
+    hash = _mm_crc32_u16(hash, load<uint16_t>(buffer));
     buffer += 2;
   }
   if (len & 1) {
     hash = _mm_crc32_u8(hash, *buffer);
   }
-  return hash ^ 0xFFFFFFFF;
+  return hash;
+}
+
+__attribute__ ((target ("pclmul,sse2")))
+static inline __m128i fold_block(__m128i x, __m128i next, __m128i keys)
+{
+  const __m128i lo = _mm_clmulepi64_si128(x, keys, 0x00);
+  const __m128i hi = _mm_clmulepi64_si128(x, keys, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(lo, hi), next);
+}
+
+__attribute__ ((target ("pclmul,sse2")))
+static size_t crc_fold_pclmul(uint64_t crc, const uint8_t* data, size_t len,
+                              const Crc_fold_keys& k, uint8_t out[16])
+{
+  len &= ~size_t(15);
+  const uint8_t* end = data + len;
+  const __m128i k512 = _mm_set_epi64x(k.k512_hi, k.k512_lo);
+  const __m128i k128 = _mm_set_epi64x(k.k128_hi, k.k128_lo);
+
+  // the register goes onto the first bytes
+  __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*) data),
+                             _mm_set_epi64x(0, crc));
+  __m128i x1 = _mm_loadu_si128((const __m128i*) data + 1);
+  __m128i x2 = _mm_loadu_si128((const __m128i*) data + 2);
+  __m128i x3 = _mm_loadu_si128((const __m128i*) data + 3);
+  data += 64;
+  // four blocks in parallel, as far as it goes
+  while (end - data >= 64) {
+    x0 = fold_block(x0, _mm_loadu_si128((const __m128i*) data + 0), k512);
+    x1 = fold_block(x1, _mm_loadu_si128((const __m128i*) data + 1), k512);
+    x2 = fold_block(x2, _mm_loadu_si128((const __m128i*) data + 2), k512);
+    x3 = fold_block(x3, _mm_loadu_si128((const __m128i*) data + 3), k512);
+    data += 64;
+  }
+  x1 = fold_block(x0, x1, k128);
+  x2 = fold_block(x1, x2, k128);
+  x3 = fold_block(x2, x3, k128);
+  while (end - data >= 16) {
+    x3 = fold_block(x3, _mm_loadu_si128((const __m128i*) data), k128);
+    data += 16;
+  }
+  _mm_storeu_si128((__m128i*) out, x3);
+  return len;
+}
+
+#elif defined(ARCH_aarch64)
+__attribute__ ((target ("+crc")))
+static uint32_t crc32c_hw(uint32_t hash, const uint8_t* buffer, size_t len)
+{
+  while (len >= 8) {
+    hash = __crc32cd(hash, load<uint64_t>(buffer));
+    buffer += 8; len -= 8;
+  }
+  while (len > 0) {
+    hash = __crc32cb(hash, *buffer); buffer++; len--;
+  }
+  return hash;
 }
+
+// ARMv8 has the Ethernet polynomial too
+__attribute__ ((target ("+crc")))
+static uint32_t crc32_hw(uint32_t hash, const uint8_t* buffer, size_t len)
+{
+  while (len >= 8) {
+    hash = __crc32d(hash, load<uint64_t>(buffer));
+    buffer += 8; len -= 8;
+  }
+  while (len > 0) {
+    hash = __crc32b(hash, *buffer); buffer++; len--;
+  }
+  return hash;
+}
+#endif
+
+size_t util::detail::crc_fold(uint64_t crc, const uint8_t* data, size_t len,
+                              const Crc_fold_keys& keys, uint8_t out[16]) noexcept
+{
+  if (len < CRC_FOLD_MIN) return 0;
+  if (UNLIKELY(cpu.checked == false)) check_cpu();
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  if (cpu.fold)
+    return crc_fold_pclmul(crc, data, len, keys, out);
+#else
+  (void) crc; (void) data; (void) keys; (void) out;
 #endif
+  return 0;
+}
 
 uint32_t crc32c_sw(uint32_t partial, const char* buf, size_t len)
 {
@@ -121,27 +247,39 @@ uint32_t crc32c_sw(uint32_t partial, const char* buf, size_t len)
   return partial;
 }
 
-#include <kernel/cpuid.hpp>
-uint32_t crc32_fast(const void* buf, size_t len)
+uint32_t crc32c_update(uint32_t partial, const void* buf, size_t len)
 {
-#ifdef __SSE4_2__
-  return crc32c_hw((const uint8_t*) buf, len);
-#else
-#if defined(ARCH_x86_64) || defined(ARCH_i686)
-  static bool has_sse42 = false;
-  static bool has_checked = false;
-  if (UNLIKELY(has_checked == false)) {
-    has_sse42 = CPUID::has_feature(CPUID::Feature::SSE4_2);
-    has_checked = true;
-  }
-  if (has_sse42 == false) {
-      return ~crc32c_sw(0xFFFFFFFF, (const char*) buf, len);
-  } else {
-      return crc32c_hw((const uint8_t*) buf, len);
+  if (UNLIKELY(cpu.checked == false)) check_cpu();
+  auto* data = (const uint8_t*) buf;
+  uint8_t block[16];
+  if (const size_t n = util::detail::crc_fold(partial, data, len, crc32c_keys, block); n) {
+    partial = crc32c_update(0, block, sizeof(block));
+    data += n; len -= n;
   }
-#else
-  // for all other arches (and linux) ...
-  return ~crc32c_sw(0xFFFFFFFF, (const char*) buf, len);
+#if defined(ARCH_x86_64) || defined(ARCH_i686) || defined(ARCH_aarch64)
+  if (cpu.crc32c)
+    return crc32c_hw(partial, data, len);
 #endif
+  return crc32c_sw(partial, (const char*) data, len);
+}
+
+uint32_t crc32_update(uint32_t partial, const void* buf, size_t len)
+{
+  if (UNLIKELY(cpu.checked == false)) check_cpu();
+  auto* data = (const uint8_t*) buf;
+#if defined(ARCH_aarch64)
+  if (cpu.crc32c)
+    return crc32_hw(partial, data, len);
 #endif
+  uint8_t block[16];
+  if (const size_t n = util::detail::crc_fold(partial, data, len, crc32_keys, block); n) {
+    partial = crc32(0, (const char*) block, sizeof(block));
+    data += n; len -= n;
+  }
+  return crc32(partial, (const char*) data, len);
+}
+
+uint32_t crc32_fast(const void* buf, size_t len)
+{
+  return ~crc32c_update(0xFFFFFFFF, buf, len);
 }
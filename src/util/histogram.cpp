@@ -0,0 +1,71 @@
+
+#include <util/histogram.hpp>
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+namespace util
+{
+
+uint64_t Histogram::percentile(const double percentile) const noexcept
+{
+  if (count_ == 0) return 0;
+  const double  wanted = std::ceil(percentile / 100.0 * count_);
+  const uint64_t rank  = std::clamp<double>(wanted, 1.0, (double) count_);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; i++)
+  {
+    seen += counts_[i];
+    if (seen >= rank) {
+      // the last bucket has no top, and no bucket goes past the max
+      if (i == BUCKETS - 1) return max_;
+      return std::min(highest_in(i), max_);
+    }
+  }
+  return max_;
+}
+
+void Histogram::merge(const Histogram& other) noexcept
+{
+  for (size_t i = 0; i < BUCKETS; i++)
+    counts_[i] += other.counts_[i];
+  count_ += other.count_;
+  sum_   += other.sum_;
+  max_ = std::max(max_, other.max_);
+  min_ = std::min(min_, other.min_);
+}
+
+void Histogram::reset() noexcept
+{
+  counts_.fill(0);
+  count_ = 0;
+  sum_   = 0;
+  max_   = 0;
+  min_   = UINT64_MAX;
+}
+
+std::string Histogram::to_string() const
+{
+  char buf[160];
+  const int len = snprintf(buf, sizeof(buf),
+      "count=%" PRIu64 " p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64
+      " p99.9=%" PRIu64 " max=%" PRIu64,
+      count_, percentile(50), percentile(90), percentile(99),
+      percentile(99.9), max_);
+  return std::string(buf, len);
+}
+
+Histogram Histogram_percpu::merged() const noexcept
+{
+  Histogram total;
+  for (const auto& slot : slots_) total.merge(slot.hist);
+  return total;
+}
+
+void Histogram_percpu::reset() noexcept
+{
+  for (auto& slot : slots_) slot.hist.reset();
+}
+
+} // util
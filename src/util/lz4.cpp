@@ -0,0 +1,172 @@
+
+#include <util/lz4.hpp>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace lz4
+{
+  static constexpr size_t MIN_MATCH     = 4;
+  // the format ends every block with literals, and no match starts after
+  static constexpr size_t LAST_LITERALS = 5;
+  static constexpr size_t MF_LIMIT      = 12;
+  static constexpr size_t MAX_OFFSET    = 65535;
+  static constexpr int    HASH_BITS     = 12;
+
+  static inline uint32_t read32(const uint8_t* p) noexcept
+  {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  static inline uint32_t hash(const uint32_t seq) noexcept
+  {
+    return (seq * 2654435761u) >> (32 - HASH_BITS);
+  }
+
+  // the part of a length that doesn't fit in the 4 bits of the token
+  static inline uint8_t* put_length(uint8_t* op, size_t len) noexcept
+  {
+    for (len -= 15; len >= 255; len -= 255)
+      *op++ = 255;
+    *op++ = len;
+    return op;
+  }
+
+  static inline bool get_length(const uint8_t*& ip, const uint8_t* iend, size_t& len) noexcept
+  {
+    uint8_t b;
+    do {
+      if (ip >= iend) return false;
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return true;
+  }
+
+  static inline size_t sequence_bound(const size_t literals, const size_t match) noexcept
+  {
+    return 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+  }
+
+  size_t compress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap) noexcept
+  {
+    const uint8_t* ip     = src;
+    const uint8_t* anchor = src;
+    const uint8_t* const end = src + len;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + cap;
+
+    if (len > MF_LIMIT)
+    {
+      // positions of the last 4-byte sequences seen, by hash
+      std::unique_ptr<uint32_t[]> table {new (std::nothrow) uint32_t[1u << HASH_BITS]()};
+      if (table == nullptr) return 0;
+      const uint8_t* const mflimit    = end - MF_LIMIT;
+      const uint8_t* const matchlimit = end - LAST_LITERALS;
+
+      while (ip < mflimit)
+      {
+        const uint32_t seq = read32(ip);
+        const uint32_t h = hash(seq);
+        const uint8_t* ref = src + table[h];
+        table[h] = ip - src;
+        if (ref >= ip or size_t(ip - ref) > MAX_OFFSET or read32(ref) != seq) {
+          ip++;
+          continue;
+        }
+        while (ip > anchor and ref > src and ip[-1] == ref[-1]) {
+          ip--; ref--;
+        }
+        const uint8_t* m = ip + MIN_MATCH;
+        const uint8_t* r = ref + MIN_MATCH;
+        while (m < matchlimit and *m == *r) {
+          m++; r++;
+        }
+
+        const size_t literals = ip - anchor;
+        const size_t match    = m - ip - MIN_MATCH;
+        if (sequence_bound(literals, match) > size_t(oend - op))
+          return 0;
+        uint8_t* token = op++;
+        *token = std::min<size_t>(literals, 15) << 4;
+        if (literals >= 15) op = put_length(op, literals);
+        std::memcpy(op, anchor, literals);
+        op += literals;
+        const size_t offset = ip - ref;
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        *token |= std::min<size_t>(match, 15);
+        if (match >= 15) op = put_length(op, match);
+
+        ip = anchor = m;
+        if (ip < mflimit)
+          table[hash(read32(ip - 2))] = ip - 2 - src;
+      }
+    }
+
+    const size_t literals = end - anchor;
+    if (1 + literals / 255 + 1 + literals > size_t(oend - op))
+      return 0;
+    *op++ = std::min<size_t>(literals, 15) << 4;
+    if (literals >= 15) op = put_length(op, literals);
+    std::memcpy(op, anchor, literals);
+    op += literals;
+    return op - dst;
+  }
+
+  long decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t cap) noexcept
+  {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + len;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + cap;
+
+    while (ip < iend)
+    {
+      const unsigned token = *ip++;
+      size_t literals = token >> 4;
+      if (literals == 15 and not get_length(ip, iend, literals))
+        return -1;
+      if (literals > size_t(iend - ip) or literals > size_t(oend - op))
+        return -1;
+      std::memcpy(op, ip, literals);
+      op += literals;
+      ip += literals;
+      // the last sequence has no match
+      if (ip == iend) break;
+
+      if (iend - ip < 2) return -1;
+      const size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 or offset > size_t(op - dst))
+        return -1;
+      size_t match = token & 15;
+      if (match == 15 and not get_length(ip, iend, match))
+        return -1;
+      match += MIN_MATCH;
+      if (match > size_t(oend - op))
+        return -1;
+
+      const uint8_t* ref = op - offset;
+      if (offset >= match) {
+        std::memcpy(op, ref, match);
+      }
+      else if (offset >= 8) {
+        // overlapping, but each word is complete before it is read
+        size_t n = 0;
+        for (; n + 8 <= match; n += 8)
+          std::memcpy(op + n, ref + n, 8);
+        for (; n < match; n++)
+          op[n] = ref[n];
+      }
+      else {
+        for (size_t n = 0; n < match; n++)
+          op[n] = ref[n];
+      }
+      op += match;
+    }
+    return op - dst;
+  }
+}
@@ -1,8 +1,15 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
 
 #include <util/percent_encoding.hpp>
+#include <common>
 
 ///////////////////////////////////////////////////////////////////////////////
 static inline std::string decode_error(std::string res) {
@@ -58,28 +65,183 @@ static inline bool is_unreserved (const char chr) noexcept {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-std::string uri::encode(util::csview input) {
+// Which chars are left as they are, unreserved ones when encoding, and
+// unreserved or reserved ones (except '%') when decoding
+using char_table_t = std::array<bool, 256>;
+
+static constexpr char_table_t make_unreserved_table() {
+  char_table_t table {};
+  for (int c = '0'; c <= '9'; c++) table[c] = true;
+  for (int c = 'A'; c <= 'Z'; c++) table[c] = true;
+  for (int c = 'a'; c <= 'z'; c++) table[c] = true;
+  for (const char c : {'-', '.', '_', '~'}) table[(uint8_t) c] = true;
+  return table;
+}
+
+static constexpr char_table_t make_plain_table() {
+  char_table_t table = make_unreserved_table();
+  for (const char c : {':', '/', '?', '#', '[', ']', '@', '!', '$',
+                       '&', '\'', '(', ')', '*', '+', ',', ';', '='})
+    table[(uint8_t) c] = true;
+  return table;
+}
+
+static constexpr char_table_t unreserved_table = make_unreserved_table();
+static constexpr char_table_t plain_table      = make_plain_table();
+
+///////////////////////////////////////////////////////////////////////////////
+// 16 chars at a time, a bit set for each one in the set
+#if defined(__SSE2__)
+static inline __m128i in_range(const __m128i v, const char lo, const char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+}
+
+static inline uint32_t unreserved_mask(const char* p) {
+  const __m128i v = _mm_loadu_si128((const __m128i*) p);
+  const __m128i alpha = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+  __m128i ok = _mm_or_si128(alpha, in_range(v, '0', '9'));
+  ok = _mm_or_si128(ok, in_range(v, '-', '.'));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+  return _mm_movemask_epi8(ok);
+}
+
+static inline uint32_t plain_mask(const char* p) {
+  const __m128i v = _mm_loadu_si128((const __m128i*) p);
+  __m128i ok = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')),
+                                in_range(v, '#', ';'));
+  ok = _mm_or_si128(ok, in_range(v, '?', 'Z'));
+  ok = _mm_or_si128(ok, in_range(v, 'a', 'z'));
+  for (const char c : {'!', '=', '[', ']', '_', '~'})
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+  return _mm_movemask_epi8(ok);
+}
+#elif defined(ARCH_aarch64) && defined(__ARM_NEON)
+static inline uint8x16_t in_range(const uint8x16_t v, const uint8_t lo, const uint8_t hi) {
+  return vandq_u8(vcgeq_u8(v, vdupq_n_u8(lo)), vcleq_u8(v, vdupq_n_u8(hi)));
+}
+
+// one bit per char, from the top bit of each byte
+static inline uint32_t to_mask(const uint8x16_t ok) {
+  static const uint8_t bits[16] {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t set = vandq_u8(ok, vld1q_u8(bits));
+  return vaddv_u8(vget_low_u8(set)) | (vaddv_u8(vget_high_u8(set)) << 8);
+}
+
+static inline uint32_t unreserved_mask(const char* p) {
+  const uint8x16_t v = vld1q_u8((const uint8_t*) p);
+  uint8x16_t ok = in_range(vorrq_u8(v, vdupq_n_u8(0x20)), 'a', 'z');
+  ok = vorrq_u8(ok, in_range(v, '0', '9'));
+  ok = vorrq_u8(ok, in_range(v, '-', '.'));
+  ok = vorrq_u8(ok, vceqq_u8(v, vdupq_n_u8('_')));
+  ok = vorrq_u8(ok, vceqq_u8(v, vdupq_n_u8('~')));
+  return to_mask(ok);
+}
+
+static inline uint32_t plain_mask(const char* p) {
+  const uint8x16_t v = vld1q_u8((const uint8_t*) p);
+  uint8x16_t ok = vbicq_u8(in_range(v, '#', ';'), vceqq_u8(v, vdupq_n_u8('%')));
+  ok = vorrq_u8(ok, in_range(v, '?', 'Z'));
+  ok = vorrq_u8(ok, in_range(v, 'a', 'z'));
+  for (const char c : {'!', '=', '[', ']', '_', '~'})
+    ok = vorrq_u8(ok, vceqq_u8(v, vdupq_n_u8(c)));
+  return to_mask(ok);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// The length of the run of chars from @p that are left as they are
+template <bool Plain>
+static inline size_t run_length(const char* p, const char* const end) noexcept {
+  const char* const begin = p;
+#if defined(__SSE2__) || (defined(ARCH_aarch64) && defined(__ARM_NEON))
+  while (end - p >= 16) {
+    const uint32_t mask = Plain ? plain_mask(p) : unreserved_mask(p);
+    if (mask != 0xffff) return (p - begin) + __builtin_ctz(~mask);
+    p += 16;
+  }
+#endif
+  const char_table_t& table = Plain ? plain_table : unreserved_table;
+  while (p < end and table[(uint8_t) *p]) p++;
+  return p - begin;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+size_t uri::encode_into(util::csview input, char* out) noexcept {
   static const std::array<char,16> hex
   {{ '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' }};
 
-  std::string res;
-  res.reserve(input.size() * 3);
+  const char* p = input.data();
+  const char* const end = p + input.size();
+  char* const begin = out;
+
+  while (p < end) {
+    const size_t run = run_length<false>(p, end);
+    std::memcpy(out, p, run);
+    out += run;
+    p   += run;
+    if (p == end) break;
+
+    const uint8_t chr = *p++;
+    out[0] = '%';
+    out[1] = hex[ chr >> 4  ];
+    out[2] = hex[ chr & 0xf ];
+    out += 3;
+  }
+  return out - begin;
+}
 
-  for (const auto chr : input)
-    if (is_unreserved(chr)) {
-      res += chr;
+///////////////////////////////////////////////////////////////////////////////
+static inline int hex_value(const char digit) noexcept {
+  if (digit >= '0' and digit <= '9') return digit - '0';
+  const char lower = digit | 0x20;
+  if (lower >= 'a' and lower <= 'f') return lower - 'a' + 10;
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+long uri::decode_into(util::csview input, char* out, const bool validate) noexcept {
+  const char* p = input.data();
+  const char* const end = p + input.size();
+  char* const begin = out;
+
+  while (p < end) {
+    size_t run;
+    if (validate) {
+      run = run_length<true>(p, end);
     } else {
-      res += '%';
-      res += hex[ chr >> 4  ];
-      res += hex[ chr & 0xf ];
+      const void* pct = std::memchr(p, '%', end - p);
+      run = (pct ? static_cast<const char*>(pct) : end) - p;
     }
+    std::memcpy(out, p, run);
+    out += run;
+    p   += run;
+    if (p == end) break;
+
+    if (*p not_eq '%') return -1;
+    if (end - p < 3) return -1;
+    const int hi = hex_value(p[1]);
+    const int lo = hex_value(p[2]);
+    if (validate and (hi < 0 or lo < 0)) return -1;
+    *out++ = static_cast<char>((hi << 4) | (lo & 0xf));
+    p += 3;
+  }
+  return out - begin;
+}
 
+///////////////////////////////////////////////////////////////////////////////
+std::string uri::encode(util::csview input) {
+  std::string res;
+  res.resize(input.size() * 3);
+  res.resize(encode_into(input, res.data()));
   res.shrink_to_fit();
   return res;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-std::string uri::decode(util::csview input) {
+// Partially decodes, or throws, on invalid input
+static std::string decode_slow(util::csview input) {
   std::string res;
   res.reserve(input.size());
 
@@ -105,3 +267,14 @@ std::string uri::decode(util::csview input) {
   res.shrink_to_fit();
   return res;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+std::string uri::decode(util::csview input) {
+  std::string res;
+  res.resize(input.size());
+  const long len = decode_into(input, res.data());
+  if (UNLIKELY(len < 0)) return decode_slow(input);
+  res.resize(len);
+  res.shrink_to_fit();
+  return res;
+}
@@ -0,0 +1,46 @@
+#include <util/pmr_pools.hpp>
+#include <util/units.hpp>
+#include <common>
+#include <smp>
+#include <array>
+
+namespace os::mem {
+
+  using namespace util::literals;
+  static constexpr size_t NUM_POOLS = size_t(Pool_id::NUM_POOLS);
+
+  static std::array<Pool_quota, NUM_POOLS> quotas {{
+    { 16_MiB, 64_KiB },  // http
+    {  1_MiB,  1_MiB },  // dns
+  }};
+
+  struct alignas(SMP_ALIGN) Cpu_pools {
+    std::array<Pmr_pool, NUM_POOLS> pools;
+    std::array<bool, NUM_POOLS>     created {};
+  };
+  static std::array<Cpu_pools, SMP_MAX_CORES> cpu_pools;
+
+  void set_pool_quota(Pool_id id, Pool_quota quota) noexcept
+  {
+    quotas.at(size_t(id)) = quota;
+  }
+
+  Pool_quota pool_quota(Pool_id id) noexcept
+  {
+    return quotas.at(size_t(id));
+  }
+
+  Pmr_pool& cpu_pool(Pool_id id)
+  {
+    auto& cpu = PER_CPU(cpu_pools);
+    const size_t i = size_t(id);
+    // created on first use, with the quota at that time
+    if (UNLIKELY(not cpu.created.at(i)))
+    {
+      cpu.pools[i]   = Pmr_pool{quotas[i].total, quotas[i].per_resource};
+      cpu.created[i] = true;
+    }
+    return cpu.pools[i];
+  }
+
+} // os::mem
@@ -0,0 +1,267 @@
+
+#include <util/route_tree.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+namespace path2regex {
+
+static constexpr size_t NO_ROUTE = std::numeric_limits<size_t>::max();
+
+struct Route_tree::Node {
+  struct Param {
+    char  stop;       // a parameter ends before this, or
+    bool  wildcard;   // takes the rest of the path
+    std::unique_ptr<Node> next;
+  };
+
+  std::string label;  // the text leading here from the parent
+  std::vector<std::unique_ptr<Node>> children;  // with different first chars
+  std::vector<Param> params;
+  std::vector<std::pair<size_t, bool>> routes;  // ending here, and if strict
+  size_t first_route = NO_ROUTE;                // the first in this subtree
+};
+
+struct Route_tree::Candidate {
+  size_t route = NO_ROUTE;
+  std::vector<std::string_view> values;
+};
+
+namespace {
+  // A pattern as a sequence of text and parameters
+  struct Segment {
+    std::string text;
+    bool        param    = false;
+    bool        wildcard = false;
+    char        stop     = '/';
+  };
+}
+
+static bool has_option(const Options& options, const char* name, bool def) {
+  auto it = options.find(name);
+  return (it != options.end()) ? it->second : def;
+}
+
+// Plain text goes into the regex as it is, so these would not be plain
+static bool is_plain(const std::string& text) {
+  return text.find_first_of("\\^$|?*+()[]{}") == std::string::npos;
+}
+
+static bool compile(const Tokens& tokens, bool strict, bool sensitive,
+                    std::vector<Segment>& out, std::vector<std::string>& names) {
+  std::string text;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    const auto& token = tokens[i];
+    if (token.is_string) {
+      if (not is_plain(token.name))
+        return false;
+      text += token.name;
+      continue;
+    }
+
+    if (token.optional or token.repeat)
+      return false;
+
+    Segment param;
+    param.param = true;
+    if (token.asterisk) {
+      // only where it takes the rest
+      if (i != tokens.size() - 1)
+        return false;
+      param.wildcard = true;
+    }
+    else if (token.delimiter.size() != 1
+             or token.pattern != "[^" + token.delimiter + "]+?") {
+      return false;
+    }
+    else {
+      param.stop = token.delimiter[0];
+    }
+
+    text += token.prefix;
+    if (not text.empty())
+      out.push_back({std::move(text)});
+    text.clear();
+    out.push_back(std::move(param));
+    names.push_back(token.name);
+  }
+
+  // a trailing slash is optional unless strict, like for the regex
+  if (not strict and not tokens.empty() and tokens.back().is_string
+      and not text.empty() and text.back() == '/')
+    text.pop_back();
+
+  if (not text.empty())
+    out.push_back({std::move(text)});
+
+  if (not sensitive)
+    for (auto& seg : out)
+      std::transform(seg.text.begin(), seg.text.end(), seg.text.begin(), ::tolower);
+  return true;
+}
+
+Route_tree::Route_tree()
+  : sensitive_{std::make_unique<Node>()},
+    insensitive_{std::make_unique<Node>()}
+{}
+
+Route_tree::~Route_tree() = default;
+
+size_t Route_tree::add(const std::string& pattern, const Options& options) {
+  const size_t route = routes_++;
+  const bool strict    = has_option(options, "strict", false);
+  const bool sensitive = has_option(options, "sensitive", false);
+  const bool end       = has_option(options, "end", true);
+
+  const auto tokens = parse(pattern);
+  std::vector<Segment> segments;
+  std::vector<std::string> names;
+  if (tokens.empty() or not end
+      or not compile(tokens, strict, sensitive, segments, names)) {
+    Keys keys;
+    auto regex = path_to_regex(pattern, keys, options);
+    regexes_.push_back({route, std::move(regex), std::move(keys)});
+    names_.emplace_back();
+    return route;
+  }
+
+  Node* node = sensitive ? sensitive_.get() : insensitive_.get();
+  node->first_route = std::min(node->first_route, route);
+  for (const auto& seg : segments) {
+    if (not seg.param) {
+      node = insert_text(node, seg.text, route);
+      continue;
+    }
+    auto it = std::find_if(node->params.begin(), node->params.end(),
+      [&seg] (const Node::Param& p) {
+        return p.wildcard == seg.wildcard and p.stop == seg.stop;
+      });
+    if (it == node->params.end()) {
+      node->params.push_back({seg.stop, seg.wildcard, std::make_unique<Node>()});
+      it = node->params.end() - 1;
+    }
+    node = it->next.get();
+    node->first_route = std::min(node->first_route, route);
+  }
+  node->routes.emplace_back(route, strict);
+  names_.push_back(std::move(names));
+  return route;
+}
+
+Route_tree::Node* Route_tree::insert_text(Node* node, std::string_view text, size_t route) {
+  while (not text.empty()) {
+    auto it = std::find_if(node->children.begin(), node->children.end(),
+      [c = text.front()] (const auto& child) { return child->label.front() == c; });
+
+    if (it == node->children.end()) {
+      auto child = std::make_unique<Node>();
+      child->label = std::string(text);
+      child->first_route = route;
+      node->children.push_back(std::move(child));
+      return node->children.back().get();
+    }
+
+    auto& child = *it;
+    const auto common = std::mismatch(child->label.begin(), child->label.end(),
+                                      text.begin(), text.end()).first - child->label.begin();
+    // split the edge where the texts part
+    if ((size_t) common < child->label.size()) {
+      auto mid = std::make_unique<Node>();
+      mid->label = child->label.substr(0, common);
+      mid->first_route = child->first_route;
+      child->label.erase(0, common);
+      mid->children.push_back(std::move(child));
+      child = std::move(mid);
+    }
+    child->first_route = std::min(child->first_route, route);
+    node = child.get();
+    text.remove_prefix(common);
+  }
+  return node;
+}
+
+void Route_tree::walk(const Node& node, std::string_view path, bool sensitive,
+                      std::vector<std::string_view>& values, Candidate& best) {
+  // only an earlier route can do better
+  if (node.first_route >= best.route)
+    return;
+
+  if (path.empty() or path == "/") {
+    for (const auto& r : node.routes) {
+      if (r.first < best.route and (path.empty() or not r.second)) {
+        best.route  = r.first;
+        best.values = values;
+      }
+    }
+  }
+
+  if (not path.empty()) {
+    const char c = sensitive ? path.front() : std::tolower(path.front());
+    for (const auto& child : node.children) {
+      const auto& label = child->label;
+      if (label.front() != c)
+        continue;
+      const bool equal = path.size() >= label.size() and (sensitive
+        ? path.compare(0, label.size(), label) == 0
+        : std::equal(label.begin(), label.end(), path.begin(),
+                     [] (char a, char b) { return a == std::tolower(b); }));
+      if (equal)
+        walk(*child, path.substr(label.size()), sensitive, values, best);
+      break;
+    }
+  }
+
+  for (const auto& param : node.params) {
+    if (param.wildcard) {
+      // as much as possible
+      for (size_t len = path.size() + 1; len-- > 0; ) {
+        values.push_back(path.substr(0, len));
+        walk(*param.next, path.substr(len), sensitive, values, best);
+        values.pop_back();
+      }
+      continue;
+    }
+    // as little as possible
+    for (size_t len = 1; len <= path.size() and path[len - 1] != param.stop; len++) {
+      values.push_back(path.substr(0, len));
+      walk(*param.next, path.substr(len), sensitive, values, best);
+      values.pop_back();
+    }
+  }
+}
+
+bool Route_tree::match(std::string_view path, Match& out) const {
+  Candidate best;
+  std::vector<std::string_view> values;
+  walk(*sensitive_, path, true, values, best);
+  walk(*insensitive_, path, false, values, best);
+
+  // kept in the order added
+  for (const auto& r : regexes_) {
+    if (r.route >= best.route)
+      break;
+    std::match_results<std::string_view::const_iterator> m;
+    if (not std::regex_search(path.begin(), path.end(), m, r.regex))
+      continue;
+
+    out.route = r.route;
+    out.params.clear();
+    for (size_t i = 0; i < r.keys.size() and i + 1 < m.size(); i++)
+      if (m[i + 1].matched)
+        out.params.emplace_back(r.keys[i].name, m[i + 1].str());
+    return true;
+  }
+
+  if (best.route == NO_ROUTE)
+    return false;
+
+  out.route = best.route;
+  out.params.clear();
+  const auto& names = names_[best.route];
+  for (size_t i = 0; i < names.size(); i++)
+    out.params.emplace_back(names[i], std::string(best.values[i]));
+  return true;
+}
+
+} //< namespace path2regex
@@ -20,8 +20,16 @@
 */
 
 #include <util/sha1.hpp>
+#include <common>
 #include <cstring>
 
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  #include <immintrin.h>
+  #include <kernel/cpuid.hpp>
+#elif defined(ARCH_aarch64)
+  #include <arm_neon.h>
+#endif
+
 #define BLOCK_INTS   SHA1::BLOCK_INTS
 #define BLOCK_BYTES  SHA1::BLOCK_BYTES
 
@@ -98,7 +106,7 @@ static void R4(uint32_t block[BLOCK_INTS], const uint32_t v, uint32_t &w, const
  * Hash a single 512-bit block. This is the core of the algorithm.
  */
 
-static void transform(uint32_t digest[], uint32_t block[BLOCK_INTS], uint64_t &transforms)
+static void transform(uint32_t digest[], uint32_t block[BLOCK_INTS])
 {
     /* Copy digest[] to working vars */
     uint32_t a = digest[0];
@@ -195,13 +203,10 @@ static void transform(uint32_t digest[], uint32_t block[BLOCK_INTS], uint64_t &t
     digest[2] += c;
     digest[3] += d;
     digest[4] += e;
-
-    /* Count the number of transformations */
-    transforms++;
 }
 
 
-static void buffer_to_block(const char* buffer, uint32_t block[BLOCK_INTS])
+static void buffer_to_block(const uint8_t* buffer, uint32_t block[BLOCK_INTS])
 {
     /* Convert the std::string (byte buffer) to a uint32_t array (MSB) */
     for (size_t i = 0; i < BLOCK_INTS; i++)
@@ -214,6 +219,363 @@ static void buffer_to_block(const char* buffer, uint32_t block[BLOCK_INTS])
 }
 
 
+static void hash_blocks_sw(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    uint32_t block[BLOCK_INTS];
+    for (; blocks; blocks--, data += BLOCK_BYTES)
+    {
+        buffer_to_block(data, block);
+        transform(digest, block);
+    }
+}
+
+
+/*
+ * The SHA extensions (SHA-NI) do 4 rounds per instruction.
+ */
+
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+__attribute__ ((target ("sha,sse4.1")))
+static void hash_blocks_hw(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+    __m128i MSG0, MSG1, MSG2, MSG3;
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) digest), 0x1B);
+    E0   = _mm_set_epi32(digest[4], 0, 0, 0);
+
+    for (; blocks; blocks--, data += BLOCK_BYTES)
+    {
+        ABCD_SAVE = ABCD;
+        E0_SAVE   = E0;
+
+        // rounds 0-3
+        MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 0)), MASK);
+        E0 = _mm_add_epi32(E0, MSG0);
+        E1 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+        // rounds 4-7
+        MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16)), MASK);
+        E1 = _mm_sha1nexte_epu32(E1, MSG1);
+        E0 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+        MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+        // rounds 8-11
+        MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 32)), MASK);
+        E0 = _mm_sha1nexte_epu32(E0, MSG2);
+        E1 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+        MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+        MSG0 = _mm_xor_si128(MSG0, MSG2);
+        // rounds 12-15
+        MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 48)), MASK);
+        E1 = _mm_sha1nexte_epu32(E1, MSG3);
+        E0 = ABCD;
+        MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+        MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+        MSG1 = _mm_xor_si128(MSG1, MSG3);
+        // rounds 16-19
+        E0 = _mm_sha1nexte_epu32(E0, MSG0);
+        E1 = ABCD;
+        MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+        MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+        MSG2 = _mm_xor_si128(MSG2, MSG0);
+        // rounds 20-23
+        E1 = _mm_sha1nexte_epu32(E1, MSG1);
+        E0 = ABCD;
+        MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+        MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+        MSG3 = _mm_xor_si128(MSG3, MSG1);
+        // rounds 24-27
+        E0 = _mm_sha1nexte_epu32(E0, MSG2);
+        E1 = ABCD;
+        MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+        MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+        MSG0 = _mm_xor_si128(MSG0, MSG2);
+        // rounds 28-31
+        E1 = _mm_sha1nexte_epu32(E1, MSG3);
+        E0 = ABCD;
+        MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+        MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+        MSG1 = _mm_xor_si128(MSG1, MSG3);
+        // rounds 32-35
+        E0 = _mm_sha1nexte_epu32(E0, MSG0);
+        E1 = ABCD;
+        MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+        MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+        MSG2 = _mm_xor_si128(MSG2, MSG0);
+        // rounds 36-39
+        E1 = _mm_sha1nexte_epu32(E1, MSG1);
+        E0 = ABCD;
+        MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+        MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+        MSG3 = _mm_xor_si128(MSG3, MSG1);
+        // rounds 40-43
+        E0 = _mm_sha1nexte_epu32(E0, MSG2);
+        E1 = ABCD;
+        MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+        MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+        MSG0 = _mm_xor_si128(MSG0, MSG2);
+        // rounds 44-47
+        E1 = _mm_sha1nexte_epu32(E1, MSG3);
+        E0 = ABCD;
+        MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+        MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+        MSG1 = _mm_xor_si128(MSG1, MSG3);
+        // rounds 48-51
+        E0 = _mm_sha1nexte_epu32(E0, MSG0);
+        E1 = ABCD;
+        MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+        MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+        MSG2 = _mm_xor_si128(MSG2, MSG0);
+        // rounds 52-55
+        E1 = _mm_sha1nexte_epu32(E1, MSG1);
+        E0 = ABCD;
+        MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+        MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+        MSG3 = _mm_xor_si128(MSG3, MSG1);
+        // rounds 56-59
+        E0 = _mm_sha1nexte_epu32(E0, MSG2);
+        E1 = ABCD;
+        MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+        MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+        MSG0 = _mm_xor_si128(MSG0, MSG2);
+        // rounds 60-63
+        E1 = _mm_sha1nexte_epu32(E1, MSG3);
+        E0 = ABCD;
+        MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+        MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+        MSG1 = _mm_xor_si128(MSG1, MSG3);
+        // rounds 64-67
+        E0 = _mm_sha1nexte_epu32(E0, MSG0);
+        E1 = ABCD;
+        MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+        MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+        MSG2 = _mm_xor_si128(MSG2, MSG0);
+        // rounds 68-71
+        E1 = _mm_sha1nexte_epu32(E1, MSG1);
+        E0 = ABCD;
+        MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+        MSG3 = _mm_xor_si128(MSG3, MSG1);
+        // rounds 72-75
+        E0 = _mm_sha1nexte_epu32(E0, MSG2);
+        E1 = ABCD;
+        MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+        // rounds 76-79
+        E1 = _mm_sha1nexte_epu32(E1, MSG3);
+        E0 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+
+        E0   = _mm_sha1nexte_epu32(E0, E0_SAVE);
+        ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    }
+
+    _mm_storeu_si128((__m128i*) digest, _mm_shuffle_epi32(ABCD, 0x1B));
+    digest[4] = _mm_extract_epi32(E0, 3);
+}
+
+static bool has_sha_hw()
+{
+    return CPUID::has_feature(CPUID::Feature::SHA)
+       and CPUID::has_feature(CPUID::Feature::SSE4_1);
+}
+
+/*
+ * The ARMv8 cryptographic extension, 4 rounds per instruction as well.
+ */
+
+#elif defined(ARCH_aarch64)
+__attribute__ ((target ("+sha2")))
+static void hash_blocks_hw(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    uint32x4_t ABCD, ABCD_SAVE;
+    uint32x4_t TMP0, TMP1;
+    uint32x4_t MSG0, MSG1, MSG2, MSG3;
+    uint32_t   E0, E0_SAVE, E1;
+    const uint32x4_t K0 = vdupq_n_u32(0x5A827999);
+    const uint32x4_t K1 = vdupq_n_u32(0x6ED9EBA1);
+    const uint32x4_t K2 = vdupq_n_u32(0x8F1BBCDC);
+    const uint32x4_t K3 = vdupq_n_u32(0xCA62C1D6);
+
+    ABCD = vld1q_u32(&digest[0]);
+    E0   = digest[4];
+
+    for (; blocks; blocks--, data += BLOCK_BYTES)
+    {
+        ABCD_SAVE = ABCD;
+        E0_SAVE   = E0;
+
+        MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data +  0)));
+        MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+        MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+        MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+        TMP0 = vaddq_u32(MSG0, K0);
+        TMP1 = vaddq_u32(MSG1, K0);
+
+        // rounds 0-3
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG2, K0);
+        MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+        // rounds 4-7
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG3, K0);
+        MSG0 = vsha1su1q_u32(MSG0, MSG3);
+        MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+        // rounds 8-11
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG0, K0);
+        MSG1 = vsha1su1q_u32(MSG1, MSG0);
+        MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+        // rounds 12-15
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG1, K1);
+        MSG2 = vsha1su1q_u32(MSG2, MSG1);
+        MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+        // rounds 16-19
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG2, K1);
+        MSG3 = vsha1su1q_u32(MSG3, MSG2);
+        MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+        // rounds 20-23
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG3, K1);
+        MSG0 = vsha1su1q_u32(MSG0, MSG3);
+        MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+        // rounds 24-27
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG0, K1);
+        MSG1 = vsha1su1q_u32(MSG1, MSG0);
+        MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+        // rounds 28-31
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG1, K1);
+        MSG2 = vsha1su1q_u32(MSG2, MSG1);
+        MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+        // rounds 32-35
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG2, K2);
+        MSG3 = vsha1su1q_u32(MSG3, MSG2);
+        MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+        // rounds 36-39
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG3, K2);
+        MSG0 = vsha1su1q_u32(MSG0, MSG3);
+        MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+        // rounds 40-43
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG0, K2);
+        MSG1 = vsha1su1q_u32(MSG1, MSG0);
+        MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+        // rounds 44-47
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG1, K2);
+        MSG2 = vsha1su1q_u32(MSG2, MSG1);
+        MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+        // rounds 48-51
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG2, K2);
+        MSG3 = vsha1su1q_u32(MSG3, MSG2);
+        MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+        // rounds 52-55
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG3, K3);
+        MSG0 = vsha1su1q_u32(MSG0, MSG3);
+        MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+        // rounds 56-59
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG0, K3);
+        MSG1 = vsha1su1q_u32(MSG1, MSG0);
+        MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+        // rounds 60-63
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG1, K3);
+        MSG2 = vsha1su1q_u32(MSG2, MSG1);
+        MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+        // rounds 64-67
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+        TMP0 = vaddq_u32(MSG2, K3);
+        MSG3 = vsha1su1q_u32(MSG3, MSG2);
+        // rounds 68-71
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+        TMP1 = vaddq_u32(MSG3, K3);
+        // rounds 72-75
+        E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+        // rounds 76-79
+        E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+        ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+
+        E0  += E0_SAVE;
+        ABCD = vaddq_u32(ABCD_SAVE, ABCD);
+    }
+
+    vst1q_u32(&digest[0], ABCD);
+    digest[4] = E0;
+}
+
+static bool has_sha_hw()
+{
+    uint64_t isar0;
+    asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r"(isar0));
+    return ((isar0 >> 8) & 0xf) != 0; // SHA1
+}
+#endif
+
+
+/*
+ * Hash whole blocks, the fastest way this CPU can
+ */
+
+static void hash_blocks(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    using hash_func = void(*)(uint32_t[], const uint8_t*, size_t);
+    static hash_func func = nullptr;
+    if (UNLIKELY(func == nullptr))
+    {
+        func = hash_blocks_sw;
+#if defined(ARCH_x86_64) || defined(ARCH_i686) || defined(ARCH_aarch64)
+        if (has_sha_hw()) func = hash_blocks_hw;
+#endif
+    }
+    func(digest, data, blocks);
+}
+
+
 SHA1::SHA1()
 {
     reset(digest, transforms);
@@ -232,9 +594,19 @@ void SHA1::update(const std::vector<char>& vec)
 
 void SHA1::update(const void* inbuffer_v, size_t inlen)
 {
-    auto* inbuffer = (const char*) inbuffer_v;
+    auto* inbuffer = (const uint8_t*) inbuffer_v;
     while (inlen)
     {
+        // whole blocks straight from the input
+        if (buffer_len == 0 && inlen >= BLOCK_BYTES)
+        {
+            const size_t blocks = inlen / BLOCK_BYTES;
+            hash_blocks(digest, inbuffer, blocks);
+            transforms += blocks;
+            inbuffer   += blocks * BLOCK_BYTES;
+            inlen      -= blocks * BLOCK_BYTES;
+            continue;
+        }
         // find out how much we can copy
         uint32_t max = BLOCK_BYTES - buffer_len;
         max = (inlen < max) ? inlen : max;
@@ -247,9 +619,8 @@ void SHA1::update(const void* inbuffer_v, size_t inlen)
         if (buffer_len == BLOCK_BYTES)
         {
             buffer_len = 0;
-            uint32_t block[BLOCK_INTS];
-            buffer_to_block(buffer, block);
-            transform(digest, block, transforms);
+            hash_blocks(digest, buffer, 1);
+            transforms++;
         }
     }
 }
@@ -264,30 +635,22 @@ void SHA1::finalize()
     /* Total number of hashed bits */
     uint64_t total_bits = (transforms*BLOCK_BYTES + buffer_len) * 8;
 
-    /* Padding */
+    /* Padding, in a block of its own when the length doesn't fit */
     buffer[buffer_len++] = 0x80;
-    uint32_t orig_size = buffer_len;
-    while (buffer_len < BLOCK_BYTES)
+    if (buffer_len > BLOCK_BYTES - 8)
     {
-        buffer[buffer_len++] = (char)0x00;
+        memset(&buffer[buffer_len], 0, BLOCK_BYTES - buffer_len);
+        hash_blocks(digest, buffer, 1);
+        buffer_len = 0;
     }
+    memset(&buffer[buffer_len], 0, BLOCK_BYTES - 8 - buffer_len);
 
-    uint32_t block[BLOCK_INTS];
-    buffer_to_block(buffer, block);
-
-    if (orig_size > BLOCK_BYTES - 8)
+    /* Append total_bits, big-endian */
+    for (size_t i = 0; i < 8; i++)
     {
-        transform(digest, block, transforms);
-        for (size_t i = 0; i < BLOCK_INTS - 2; i++)
-        {
-            block[i] = 0;
-        }
+        buffer[BLOCK_BYTES - 1 - i] = total_bits >> (8 * i);
     }
-
-    /* Append total_bits, split this uint64_t into two uint32_t */
-    block[BLOCK_INTS - 1] = total_bits;
-    block[BLOCK_INTS - 2] = (total_bits >> 32);
-    transform(digest, block, transforms);
+    hash_blocks(digest, buffer, 1);
 }
 
 std::vector<char> SHA1::as_raw()
@@ -0,0 +1,542 @@
+
+#include <util/sha256.hpp>
+#include <common>
+#include <cstring>
+
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+  #include <immintrin.h>
+  #include <kernel/cpuid.hpp>
+#elif defined(ARCH_aarch64)
+  #include <arm_neon.h>
+#endif
+
+#define BLOCK_BYTES  SHA256::BLOCK_BYTES
+
+alignas(16) static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+static inline uint32_t ror(const uint32_t value, const size_t bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+
+static void hash_blocks_sw(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    uint32_t w[64];
+    for (; blocks; blocks--, data += BLOCK_BYTES)
+    {
+        for (size_t i = 0; i < 16; i++)
+        {
+            w[i] = (uint32_t) data[4*i+0] << 24 | (uint32_t) data[4*i+1] << 16
+                 | (uint32_t) data[4*i+2] << 8  | (uint32_t) data[4*i+3];
+        }
+        for (size_t i = 16; i < 64; i++)
+        {
+            const uint32_t s0 = ror(w[i-15], 7) ^ ror(w[i-15], 18) ^ (w[i-15] >> 3);
+            const uint32_t s1 = ror(w[i-2], 17) ^ ror(w[i-2], 19)  ^ (w[i-2] >> 10);
+            w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+
+        uint32_t a = digest[0], b = digest[1], c = digest[2], d = digest[3];
+        uint32_t e = digest[4], f = digest[5], g = digest[6], h = digest[7];
+        for (size_t i = 0; i < 64; i++)
+        {
+            const uint32_t S1 = ror(e, 6) ^ ror(e, 11) ^ ror(e, 25);
+            const uint32_t ch = (e & f) ^ (~e & g);
+            const uint32_t t1 = h + S1 + ch + K[i] + w[i];
+            const uint32_t S0 = ror(a, 2) ^ ror(a, 13) ^ ror(a, 22);
+            const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            const uint32_t t2 = S0 + maj;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        digest[0] += a; digest[1] += b; digest[2] += c; digest[3] += d;
+        digest[4] += e; digest[5] += f; digest[6] += g; digest[7] += h;
+    }
+}
+
+
+/*
+ * The SHA extensions (SHA-NI) do 2 rounds per instruction, with the
+ * state kept as ABEF and CDGH.
+ */
+
+#if defined(ARCH_x86_64) || defined(ARCH_i686)
+__attribute__ ((target ("sha,sse4.1")))
+static void hash_blocks_hw(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    __m128i STATE0, STATE1, ABEF_SAVE, CDGH_SAVE;
+    __m128i MSG, TMP;
+    __m128i MSG0, MSG1, MSG2, MSG3;
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    TMP    = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &digest[0]), 0xB1); // CDAB
+    STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &digest[4]), 0x1B); // EFGH
+    STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);    // ABEF
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0); // CDGH
+
+    for (; blocks; blocks--, data += BLOCK_BYTES)
+    {
+        ABEF_SAVE = STATE0;
+        CDGH_SAVE = STATE1;
+
+        // rounds 0-3
+        MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 0)), MASK);
+        MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i*) &K[0]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        // rounds 4-7
+        MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16)), MASK);
+        MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i*) &K[4]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+        // rounds 8-11
+        MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 32)), MASK);
+        MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i*) &K[8]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+        // rounds 12-15
+        MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 48)), MASK);
+        MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i*) &K[12]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG3, MSG2, 4);
+        MSG0 = _mm_add_epi32(MSG0, TMP);
+        MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+        // rounds 16-19
+        MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i*) &K[16]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG0, MSG3, 4);
+        MSG1 = _mm_add_epi32(MSG1, TMP);
+        MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+        // rounds 20-23
+        MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i*) &K[20]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG1, MSG0, 4);
+        MSG2 = _mm_add_epi32(MSG2, TMP);
+        MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+        // rounds 24-27
+        MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i*) &K[24]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG2, MSG1, 4);
+        MSG3 = _mm_add_epi32(MSG3, TMP);
+        MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+        // rounds 28-31
+        MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i*) &K[28]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG3, MSG2, 4);
+        MSG0 = _mm_add_epi32(MSG0, TMP);
+        MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+        // rounds 32-35
+        MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i*) &K[32]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG0, MSG3, 4);
+        MSG1 = _mm_add_epi32(MSG1, TMP);
+        MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+        // rounds 36-39
+        MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i*) &K[36]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG1, MSG0, 4);
+        MSG2 = _mm_add_epi32(MSG2, TMP);
+        MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+        // rounds 40-43
+        MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i*) &K[40]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG2, MSG1, 4);
+        MSG3 = _mm_add_epi32(MSG3, TMP);
+        MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+        // rounds 44-47
+        MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i*) &K[44]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG3, MSG2, 4);
+        MSG0 = _mm_add_epi32(MSG0, TMP);
+        MSG0 = _mm_sha256msg2_epu32(MSG0, MSG3);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+        // rounds 48-51
+        MSG = _mm_add_epi32(MSG0, _mm_loadu_si128((const __m128i*) &K[48]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG0, MSG3, 4);
+        MSG1 = _mm_add_epi32(MSG1, TMP);
+        MSG1 = _mm_sha256msg2_epu32(MSG1, MSG0);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        MSG3 = _mm_sha256msg1_epu32(MSG3, MSG0);
+        // rounds 52-55
+        MSG = _mm_add_epi32(MSG1, _mm_loadu_si128((const __m128i*) &K[52]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG1, MSG0, 4);
+        MSG2 = _mm_add_epi32(MSG2, TMP);
+        MSG2 = _mm_sha256msg2_epu32(MSG2, MSG1);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        // rounds 56-59
+        MSG = _mm_add_epi32(MSG2, _mm_loadu_si128((const __m128i*) &K[56]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        TMP = _mm_alignr_epi8(MSG2, MSG1, 4);
+        MSG3 = _mm_add_epi32(MSG3, TMP);
+        MSG3 = _mm_sha256msg2_epu32(MSG3, MSG2);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+        // rounds 60-63
+        MSG = _mm_add_epi32(MSG3, _mm_loadu_si128((const __m128i*) &K[60]));
+        STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+        MSG = _mm_shuffle_epi32(MSG, 0x0E);
+        STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+        STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+    }
+
+    TMP    = _mm_shuffle_epi32(STATE0, 0x1B);    // FEBA
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);    // DCHG
+    STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0); // DCBA
+    STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);    // HGFE
+    _mm_storeu_si128((__m128i*) &digest[0], STATE0);
+    _mm_storeu_si128((__m128i*) &digest[4], STATE1);
+}
+
+static bool has_sha_hw()
+{
+    return CPUID::has_feature(CPUID::Feature::SHA)
+       and CPUID::has_feature(CPUID::Feature::SSE4_1);
+}
+
+/*
+ * The ARMv8 cryptographic extension, 4 rounds per instruction pair.
+ */
+
+#elif defined(ARCH_aarch64)
+__attribute__ ((target ("+sha2")))
+static void hash_blocks_hw(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    uint32x4_t STATE0, STATE1, ABEF_SAVE, CDGH_SAVE;
+    uint32x4_t MSG0, MSG1, MSG2, MSG3;
+    uint32x4_t TMP0, TMP1, TMP2;
+
+    STATE0 = vld1q_u32(&digest[0]);
+    STATE1 = vld1q_u32(&digest[4]);
+
+    for (; blocks; blocks--, data += BLOCK_BYTES)
+    {
+        ABEF_SAVE = STATE0;
+        CDGH_SAVE = STATE1;
+
+        MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data +  0)));
+        MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+        MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+        MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+        TMP0 = vaddq_u32(MSG0, vld1q_u32(&K[0]));
+
+        // rounds 0-3
+        MSG0 = vsha256su0q_u32(MSG0, MSG1);
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG1, vld1q_u32(&K[4]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        MSG0 = vsha256su1q_u32(MSG0, MSG2, MSG3);
+        // rounds 4-7
+        MSG1 = vsha256su0q_u32(MSG1, MSG2);
+        TMP2 = STATE0;
+        TMP0 = vaddq_u32(MSG2, vld1q_u32(&K[8]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+        MSG1 = vsha256su1q_u32(MSG1, MSG3, MSG0);
+        // rounds 8-11
+        MSG2 = vsha256su0q_u32(MSG2, MSG3);
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG3, vld1q_u32(&K[12]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        MSG2 = vsha256su1q_u32(MSG2, MSG0, MSG1);
+        // rounds 12-15
+        MSG3 = vsha256su0q_u32(MSG3, MSG0);
+        TMP2 = STATE0;
+        TMP0 = vaddq_u32(MSG0, vld1q_u32(&K[16]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+        MSG3 = vsha256su1q_u32(MSG3, MSG1, MSG2);
+        // rounds 16-19
+        MSG0 = vsha256su0q_u32(MSG0, MSG1);
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG1, vld1q_u32(&K[20]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        MSG0 = vsha256su1q_u32(MSG0, MSG2, MSG3);
+        // rounds 20-23
+        MSG1 = vsha256su0q_u32(MSG1, MSG2);
+        TMP2 = STATE0;
+        TMP0 = vaddq_u32(MSG2, vld1q_u32(&K[24]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+        MSG1 = vsha256su1q_u32(MSG1, MSG3, MSG0);
+        // rounds 24-27
+        MSG2 = vsha256su0q_u32(MSG2, MSG3);
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG3, vld1q_u32(&K[28]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        MSG2 = vsha256su1q_u32(MSG2, MSG0, MSG1);
+        // rounds 28-31
+        MSG3 = vsha256su0q_u32(MSG3, MSG0);
+        TMP2 = STATE0;
+        TMP0 = vaddq_u32(MSG0, vld1q_u32(&K[32]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+        MSG3 = vsha256su1q_u32(MSG3, MSG1, MSG2);
+        // rounds 32-35
+        MSG0 = vsha256su0q_u32(MSG0, MSG1);
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG1, vld1q_u32(&K[36]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        MSG0 = vsha256su1q_u32(MSG0, MSG2, MSG3);
+        // rounds 36-39
+        MSG1 = vsha256su0q_u32(MSG1, MSG2);
+        TMP2 = STATE0;
+        TMP0 = vaddq_u32(MSG2, vld1q_u32(&K[40]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+        MSG1 = vsha256su1q_u32(MSG1, MSG3, MSG0);
+        // rounds 40-43
+        MSG2 = vsha256su0q_u32(MSG2, MSG3);
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG3, vld1q_u32(&K[44]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        MSG2 = vsha256su1q_u32(MSG2, MSG0, MSG1);
+        // rounds 44-47
+        MSG3 = vsha256su0q_u32(MSG3, MSG0);
+        TMP2 = STATE0;
+        TMP0 = vaddq_u32(MSG0, vld1q_u32(&K[48]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+        MSG3 = vsha256su1q_u32(MSG3, MSG1, MSG2);
+        // rounds 48-51
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG1, vld1q_u32(&K[52]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        // rounds 52-55
+        TMP2 = STATE0;
+        TMP0 = vaddq_u32(MSG2, vld1q_u32(&K[56]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+        // rounds 56-59
+        TMP2 = STATE0;
+        TMP1 = vaddq_u32(MSG3, vld1q_u32(&K[60]));
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP0);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP0);
+        // rounds 60-63
+        TMP2 = STATE0;
+        STATE0 = vsha256hq_u32(STATE0, STATE1, TMP1);
+        STATE1 = vsha256h2q_u32(STATE1, TMP2, TMP1);
+
+        STATE0 = vaddq_u32(STATE0, ABEF_SAVE);
+        STATE1 = vaddq_u32(STATE1, CDGH_SAVE);
+    }
+
+    vst1q_u32(&digest[0], STATE0);
+    vst1q_u32(&digest[4], STATE1);
+}
+
+static bool has_sha_hw()
+{
+    uint64_t isar0;
+    asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r"(isar0));
+    return ((isar0 >> 12) & 0xf) != 0; // SHA2
+}
+#endif
+
+
+/*
+ * Hash whole blocks, the fastest way this CPU can
+ */
+
+static void hash_blocks(uint32_t digest[], const uint8_t* data, size_t blocks)
+{
+    using hash_func = void(*)(uint32_t[], const uint8_t*, size_t);
+    static hash_func func = nullptr;
+    if (UNLIKELY(func == nullptr))
+    {
+        func = hash_blocks_sw;
+#if defined(ARCH_x86_64) || defined(ARCH_i686) || defined(ARCH_aarch64)
+        if (has_sha_hw()) func = hash_blocks_hw;
+#endif
+    }
+    func(digest, data, blocks);
+}
+
+
+SHA256::SHA256()
+{
+    reset();
+}
+
+void SHA256::reset()
+{
+    /* SHA256 initialization constants */
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(digest, init, sizeof(digest));
+    transforms = 0;
+    buffer_len = 0;
+}
+
+
+void SHA256::update(const std::string &s)
+{
+    update(s.c_str(), s.size());
+}
+
+void SHA256::update(const std::vector<char>& vec)
+{
+    update(vec.data(), vec.size());
+}
+
+void SHA256::update(const void* inbuffer_v, size_t inlen)
+{
+    auto* inbuffer = (const uint8_t*) inbuffer_v;
+    while (inlen)
+    {
+        // whole blocks straight from the input
+        if (buffer_len == 0 && inlen >= BLOCK_BYTES)
+        {
+            const size_t blocks = inlen / BLOCK_BYTES;
+            hash_blocks(digest, inbuffer, blocks);
+            transforms += blocks;
+            inbuffer   += blocks * BLOCK_BYTES;
+            inlen      -= blocks * BLOCK_BYTES;
+            continue;
+        }
+        // find out how much we can copy
+        uint32_t max = BLOCK_BYTES - buffer_len;
+        max = (inlen < max) ? inlen : max;
+        // copy to working buffer
+        memcpy(&buffer[buffer_len], inbuffer, max);
+        buffer_len += max;
+        inbuffer   += max;
+        inlen      -= max;
+        // process full buffer
+        if (buffer_len == BLOCK_BYTES)
+        {
+            buffer_len = 0;
+            hash_blocks(digest, buffer, 1);
+            transforms++;
+        }
+    }
+}
+
+
+/*
+ * Add padding.
+ */
+
+void SHA256::finalize()
+{
+    /* Total number of hashed bits */
+    uint64_t total_bits = (transforms*BLOCK_BYTES + buffer_len) * 8;
+
+    /* Padding, in a block of its own when the length doesn't fit */
+    buffer[buffer_len++] = 0x80;
+    if (buffer_len > BLOCK_BYTES - 8)
+    {
+        memset(&buffer[buffer_len], 0, BLOCK_BYTES - buffer_len);
+        hash_blocks(digest, buffer, 1);
+        buffer_len = 0;
+    }
+    memset(&buffer[buffer_len], 0, BLOCK_BYTES - 8 - buffer_len);
+
+    /* Append total_bits, big-endian */
+    for (size_t i = 0; i < 8; i++)
+    {
+        buffer[BLOCK_BYTES - 1 - i] = total_bits >> (8 * i);
+    }
+    hash_blocks(digest, buffer, 1);
+}
+
+std::vector<char> SHA256::as_raw()
+{
+    finalize();
+
+    /* Result as raw character array */
+    std::vector<char> result(32);
+    for (int i = 0; i < 8; i++) {
+      result[i * 4 + 0] = digest[i] >> 24;
+      result[i * 4 + 1] = digest[i] >> 16;
+      result[i * 4 + 2] = digest[i] >> 8;
+      result[i * 4 + 3] = digest[i];
+    }
+
+    /* Reset for next run */
+    reset();
+    return result;
+}
+std::string SHA256::as_hex()
+{
+    finalize();
+
+    /* Result as hex string */
+    std::string result;  result.resize(64);
+    for (int i = 0; i < 8; i++) {
+      snprintf(&result[i * 8], 9, "%08x", digest[i]);
+    }
+
+    /* Reset for next run */
+    reset();
+    return result;
+}
+
+std::vector<char> SHA256::oneshot_raw(const std::vector<char>& vec)
+{
+  SHA256 object;
+  object.update(vec.data(), vec.size());
+  return object.as_raw();
+}
+std::string SHA256::oneshot_hex(const std::string& buffer)
+{
+  SHA256 object;
+  object.update(buffer.c_str(), buffer.size());
+  return object.as_hex();
+}
@@ -2,10 +2,12 @@
 #include <statman>
 #include <info>
 #include <smp_utils>
+#include <cstring>
 
-// this is done to make sure construction only happens here
-static Statman statman_instance;
+// this is done to make sure construction only happens here,
+// and before first use (e.g. from other global constructors)
 Statman& Statman::get() {
+  static Statman statman_instance;
   return statman_instance;
 }
 
@@ -20,19 +22,64 @@ Stat::Stat(const Stat_type type, const std::string& name)
 
   snprintf(name_, sizeof(name_), "%s", name.c_str());
 }
+uint64_t Stat_percpu::total() const noexcept {
+  uint64_t sum = 0;
+  for (const auto& slot : slots_) sum += slot.value;
+  return sum;
+}
+void Stat_percpu::reset() noexcept {
+  for (auto& slot : slots_) slot.value = 0;
+}
+
 Stat::Stat(const Stat& other) {
   this->ui64   = other.ui64;
+  this->m_percpu = other.m_percpu;
   this->m_bits = other.m_bits;
   __builtin_memcpy(this->name_, other.name_, sizeof(name_));
 }
 Stat& Stat::operator=(const Stat& other) {
   this->ui64   = other.ui64;
+  this->m_percpu = other.m_percpu;
   this->m_bits = other.m_bits;
   __builtin_memcpy(this->name_, other.name_, sizeof(name_));
   return *this;
 }
 
+uint64_t& Stat::percpu_total() const noexcept {
+  // stats live in Statman, which is never const
+  auto& total = const_cast<Stat*>(this)->ui64;
+  total = m_percpu->total();
+  return total;
+}
+
+uint64_t& Stat::histogram_value() const noexcept {
+  auto& value = const_cast<Stat*>(this)->ui64;
+  const auto hist = m_histo->hist->merged();
+  value = (m_histo->percentile > 100.0) ? hist.max() : hist.percentile(m_histo->percentile);
+  return value;
+}
+
+Stat Stat::flattened() const {
+  Stat plain {*this};
+  if (is_percpu() or is_histogram()) {
+    plain.ui64 = get_uint64();
+    plain.m_percpu = nullptr;
+    plain.m_bits &= ~(PERCPU_BIT | HISTO_BIT);
+  }
+  return plain;
+}
+
+void Stat::release() noexcept {
+  if (is_percpu()) delete m_percpu;
+  else if (is_histogram()) delete m_histo;
+  m_percpu = nullptr;
+}
+
 void Stat::operator++() {
+  if (UNLIKELY(is_percpu())) {
+    ++(*m_percpu);
+    return;
+  }
   switch (this->type()) {
     case UINT32: ui32++;    break;
     case UINT64: ui64++;    break;
@@ -44,7 +91,7 @@ void Stat::operator++() {
 std::string Stat::to_string() const {
   switch (this->type()) {
     case UINT32: return std::to_string(ui32);
-    case UINT64: return std::to_string(ui64);
+    case UINT64: return std::to_string(get_uint64());
     case FLOAT:  return std::to_string(f);
     default:     return "Unknown stat type";
   }
@@ -55,6 +102,9 @@ std::string Stat::to_string() const {
 Statman::Statman() {
   this->create(Stat::UINT32, "statman.unused_stats");
 }
+Statman::~Statman() {
+  for (auto& stat : m_stats) stat.release();
+}
 
 Stat& Statman::create(const Stat::Stat_type type, const std::string& name)
 {
@@ -69,6 +119,7 @@ Stat& Statman::create(const Stat::Stat_type type, const std::string& name)
     // FIXME: this can throw, and leave the spinlock unlocked
     m_stats.emplace_back(type, name);
     auto& retval = m_stats.back();
+    this->index(retval);
     stlock.unlock();
     return retval;
   }
@@ -76,10 +127,46 @@ Stat& Statman::create(const Stat::Stat_type type, const std::string& name)
   // note: we have to create this early in case it throws
   auto& stat = *new (&m_stats[idx]) Stat(type, name);
   unused_stats()--; // decrease unused stats
+  this->index(stat);
   stlock.unlock();
   return stat;
 }
 
+Stat_percpu& Statman::create_percpu(const std::string& name)
+{
+  auto* counter = new Stat_percpu(SMP::early_cpu_total());
+  try {
+    auto& stat = this->create(Stat::UINT64, name);
+    stat.m_percpu = counter;
+    stat.m_bits |= Stat::PERCPU_BIT;
+    return *counter;
+  }
+  catch (...) {
+    delete counter;
+    throw;
+  }
+}
+
+util::Histogram_percpu& Statman::create_histogram(const std::string& name)
+{
+  static const std::pair<const char*, double> gauges[] {
+    {".p50", 50.0}, {".p90", 90.0}, {".p99", 99.0}, {".p999", 99.9}, {".max", 101.0}
+  };
+  auto hist = std::make_unique<util::Histogram_percpu>(SMP::early_cpu_total());
+  for (const auto& [suffix, percentile] : gauges)
+  {
+    auto& stat = this->create(Stat::UINT64, name + suffix);
+    stat.m_histo = new Stat_histogram{hist.get(), percentile};
+    stat.m_bits |= Stat::HISTO_BIT;
+    stat.make_gauge();
+  }
+  stlock.lock();
+  m_histograms.emplace_back(name, std::move(hist));
+  auto& result = *m_histograms.back().second;
+  stlock.unlock();
+  return result;
+}
+
 Stat& Statman::get(const Stat* st)
 {
   stlock.lock();
@@ -99,23 +186,15 @@ Stat& Statman::get(const Stat* st)
 
 Stat& Statman::get_by_name(const char* name)
 {
-  /// FIXME FIXME FIXME ///
-  ///  Regression here  ///
-  /// FIXME FIXME FIXME ///
-  
-  //printf("get_by_name Locking: this=%p, lock=%p, %d\n", this, &stlock, *(spinlock_t*) &stlock);
-  //stlock.lock();
-  for (auto& stat : this->m_stats)
-  {
-    if (stat.unused() == false) {
-      if (strncmp(stat.name(), name, Stat::MAX_NAME_LEN) == 0)
-        //stlock.unlock();
-        printf("Unlocked (found): this=%p, lock=%p, %d\n", this, &stlock, *(spinlock_t*) &stlock);
-        return stat;
-    }
+  const std::string_view key {name, strnlen(name, Stat::MAX_NAME_LEN)};
+  stlock.lock();
+  auto it = m_index.find(key);
+  if (it != m_index.end()) {
+    auto& stat = *it->second;
+    stlock.unlock();
+    return stat;
   }
-  //stlock.unlock();
-  //printf("Unlocked (not found): %d\n", *(spinlock_t*) &stlock);
+  stlock.unlock();
   throw std::out_of_range("No stat found with exact given name");
 }
 
@@ -137,12 +216,34 @@ void Statman::free(void* addr)
 {
   auto& stat = this->get((Stat*) addr);
   stlock.lock();
+  this->unindex(stat);
+  stat.release();
   // delete entry
   new (&stat) Stat(Stat::FLOAT, "");
   unused_stats()++; // increase unused stats
   stlock.unlock();
 }
 
+// the first stat by a name is the one found
+void Statman::index(Stat& stat)
+{
+  m_index.emplace(std::string_view{stat.name()}, &stat);
+}
+
+void Statman::unindex(Stat& stat)
+{
+  auto it = m_index.find(stat.name());
+  if (it == m_index.end() or it->second != &stat) return;
+  m_index.erase(it);
+  // another stat by the same name takes its place
+  for (auto& other : m_stats) {
+    if (&other != &stat and strncmp(other.name(), stat.name(), Stat::MAX_NAME_LEN) == 0) {
+      this->index(other);
+      return;
+    }
+  }
+}
+
 ssize_t Statman::find_free_stat() const noexcept
 {
   for (size_t i = 0; i < this->m_stats.size(); i++)
@@ -155,6 +256,9 @@ ssize_t Statman::find_free_stat() const noexcept
 void Statman::clear()
 {
   if (size() <= 1) return;
+  for (auto& stat : m_stats) stat.release();
   m_stats.clear();
+  m_index.clear();
+  m_histograms.clear();
   this->create(Stat::UINT32, "statman.unused_stats");
 }
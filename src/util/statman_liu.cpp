@@ -5,7 +5,11 @@
 
 void Statman::store(uint32_t id, liu::Storage& store)
 {
-  store.add_vector<Stat>(id, {m_stats.begin(), m_stats.end()});
+  // per-CPU stats are stored as their sums
+  std::vector<Stat> stats;
+  stats.reserve(m_stats.size());
+  for (const auto& stat : m_stats) stats.push_back(stat.flattened());
+  store.add_vector<Stat>(id, stats);
 }
 void Statman::restore(liu::Restore& store)
 {
@@ -20,7 +24,15 @@ void Statman::restore(liu::Restore& store)
   {
     try {
       // TODO: merge here
-      this->get_by_name(merge_stat.name()) = merge_stat;
+      auto& stat = this->get_by_name(merge_stat.name());
+      // percentiles are of what was recorded since the update
+      if (stat.is_histogram()) continue;
+      if (stat.is_percpu()) {
+        if (merge_stat.type() == Stat::UINT64)
+            stat.percpu()->local() += merge_stat.get_uint64();
+        continue;
+      }
+      stat = merge_stat;
     }
     catch (const std::exception& e)
     {
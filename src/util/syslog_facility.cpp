@@ -1,6 +1,9 @@
 #include <util/syslog_facility.hpp>
 #include <net/interfaces>
+#include <os.hpp>
+#include <timers>
 #include <unistd.h> // getpid
+#include <algorithm>
 #include <ctime>
 
 const int TIMELEN = 32;
@@ -14,7 +17,74 @@ void Syslog_udp::syslog(const std::string& log_message) {
   if (logopt() & LOG_PERROR)
     fprintf(stderr, "%s\n", log_message.c_str());
 
-  send_udp_data(log_message);
+  if (not admit()) return;
+  // once there is room again, say how much was left out
+  if (suppressed_ > 0)
+  {
+    const int prio = priority();
+    set_priority(LOG_WARNING);
+    send(build_message_prefix("syslogd") + std::to_string(suppressed_)
+         + " messages suppressed by rate limit");
+    set_priority(prio);
+    suppressed_ = 0;
+  }
+  send(log_message);
+}
+
+void Syslog_udp::set_rate_limit(uint32_t per_sec, uint32_t burst)
+{
+  rate_   = per_sec;
+  burst_  = std::max<uint32_t>(burst, 1);
+  tokens_ = burst_;
+}
+
+bool Syslog_udp::admit()
+{
+  if (rate_ == 0) return true;
+  const uint64_t now = os::nanos_since_boot();
+  tokens_ = std::min<double>(burst_, tokens_ + (now - refilled_) * 1e-9 * rate_);
+  refilled_ = now;
+  if (tokens_ < 1.0) {
+    suppressed_++;
+    suppressed_total_++;
+    return false;
+  }
+  tokens_ -= 1.0;
+  return true;
+}
+
+void Syslog_udp::send(const std::string& message)
+{
+  if (framing_ == Framing::DATAGRAM) {
+    send_udp_data(message.data(), message.size());
+    return;
+  }
+  const std::string len = std::to_string(message.size()) + " ";
+  // the datagram is sent when the next message doesn't fit
+  if (not batch_.empty()
+      and batch_.size() + len.size() + message.size() > max_datagram_)
+    flush();
+  batch_ += len;
+  batch_ += message;
+  if (batch_.size() >= max_datagram_) {
+    flush();
+    return;
+  }
+  // or when no more show up for a while
+  if (not flush_scheduled_) {
+    flush_scheduled_ = true;
+    flush_timer_ = Timers::oneshot(flush_interval_, [this] (int) {
+      flush_scheduled_ = false;
+      this->flush();
+    });
+  }
+}
+
+void Syslog_udp::flush()
+{
+  if (batch_.empty()) return;
+  send_udp_data(batch_.data(), batch_.size());
+  batch_.clear();
 }
 
 void Syslog_udp::open_socket() {
@@ -23,6 +93,7 @@ void Syslog_udp::open_socket() {
 }
 
 void Syslog_udp::close_socket() {
+  flush();
   if (sock_) {
     sock_->close();
     sock_ = nullptr;
@@ -30,8 +101,12 @@ void Syslog_udp::close_socket() {
 }
 
 void Syslog_udp::send_udp_data(const std::string& data) {
+  send_udp_data(data.c_str(), data.size());
+}
+
+void Syslog_udp::send_udp_data(const char* data, size_t len) {
   open_socket();
-  sock_->sendto( ip_, port_, data.c_str(), data.size() );
+  sock_->sendto( ip_, port_, data, len );
 }
 
 std::string Syslog_udp::build_message_prefix(const std::string& binary_name) {
@@ -67,6 +142,9 @@ std::string Syslog_udp::build_message_prefix(const std::string& binary_name) {
 }
 
 Syslog_udp::~Syslog_udp() {
+  if (flush_scheduled_)
+    Timers::stop(flush_timer_);
+  flush();
   if (sock_)
     sock_->close();
 }
@@ -1,5 +1,7 @@
 #include <syslogd>
 #include <service>
+#include <smp>
+#include <array>
 #include <errno.h>		// errno
 #include <unistd.h>		// getpid
 
@@ -13,18 +15,40 @@ void Syslog::syslog(const int priority, const char* fmt, ...)
   va_end(list);
 }
 
+// formatting is done in these, reused by each message on a CPU
+struct alignas(SMP_ALIGN) Format_buffer
+{
+  std::string fmt;
+  std::string message;
+  char body[2048];
+};
+static std::array<Format_buffer, SMP_MAX_CORES> format_buffers;
+
+// @dst += @src, with each %m replaced by @with
+static void replace_m(std::string& dst, const char* src, const char* with)
+{
+  for (const char* p = src; *p; p++)
+  {
+    if (p[0] == '%' and p[1] == 'm') {
+      dst += with;
+      p++;
+    }
+    else dst += *p;
+  }
+}
+
 // va_list arguments (POSIX)
 void Syslog::syslog(const int priority, const char* fmt, va_list args)
 {
   // due to musl "bug" (strftime setting errno..)
   const int save_errno = errno;
+  auto& fb = PER_CPU(format_buffers);
   // snprintf removes % if calling syslog with %m in addition to arguments
   // Find %m here first and escape % if found
-  std::regex m_regex{"\\%m"};
-  std::string msg = std::regex_replace(fmt, m_regex, "%%m");
+  fb.fmt.clear();
+  replace_m(fb.fmt, fmt, "%%m");
 
-  char buf[2048];
-  vsnprintf(buf, sizeof(buf), msg.c_str(), args);
+  vsnprintf(fb.body, sizeof(fb.body), fb.fmt.c_str(), args);
 
 	/*
   	All syslog-calls comes through here in the end, so
@@ -38,13 +62,15 @@ void Syslog::syslog(const int priority, const char* fmt, va_list args)
 		 Could also document by setting logopt to LOG_PID | LOG_CONS | LOG_PERROR, but
 		 then only for this specific message */
   if (not valid_priority(priority)) {
-  	syslog(LOG_ERR, "Syslog: Unknown priority %d. Message: %s", priority, buf);
+    // the buffers are reused by the call
+    const std::string body {fb.body};
+  	syslog(LOG_ERR, "Syslog: Unknown priority %d. Message: %s", priority, body.c_str());
     return;
   }
  	fac_->set_priority(priority);
 
   /* Building the log message based on the facility used */
-  std::string message = fac_->build_message_prefix(Service::binary_name());
+  fb.message = fac_->build_message_prefix(Service::binary_name());
 
  	/*
  		%m:
@@ -59,10 +85,10 @@ void Syslog::syslog(const int priority, const char* fmt, va_list args)
 	*/
   errno = save_errno;
   // Handle %m (replace it with strerror(errno)) and add the message (buf)
-  message += std::regex_replace(buf, m_regex, strerror(errno));
+  replace_m(fb.message, fb.body, strerror(errno));
 
  	/* Last: Send the log string */
- 	fac_->syslog(message);
+ 	fac_->syslog(fb.message);
 }
 
 void Syslog::openlog(const char* ident, int logopt, int facility) {
@@ -23,12 +23,58 @@ bool Element::is_tar_gz() const noexcept {
 
 // ----------------------- Tar -----------------------
 
-const Element& Tar::element(const std::string& path) const {
-  for (auto& element : elements_) {
-    if (element.name() == path) {
-      return element;
+void Tar::add_element(const Element& element) {
+  append(element);
+}
+
+const Element& Tar::append(const Element& element) const {
+  index_.emplace(element.name(), elements_.size());
+  elements_.push_back(element);
+  return elements_.back();
+}
+
+const Element* Tar::parse(const std::string* path) const {
+  // Go through the tar file block by block, from where we stopped
+  while (parsed_ < size_) {
+    Tar_header* header = (Tar_header*) ((const char*) data_ + parsed_);
+    Element element{*header};
+    parsed_ += SECTOR_SIZE;
+
+    if (element.name().empty()) {
+      // Empty header name - continue
+      continue;
     }
+
+    // Check if this is a directory or not (typeflag) (directories have no content)
+    // If typeflag not set -> is not a directory and has content
+    if (not element.typeflag_is_set() or not element.is_dir()) {
+      const size_t len = SECTOR_SIZE * (size_t) element.num_content_blocks();
+      if (len > size_ - parsed_) {
+        // truncated, so there's nothing more to find
+        parsed_ = size_;
+        break;
+      }
+      element.set_content_start(data_ + parsed_);
+      parsed_ += len;  // move to the end of the element
+    }
+
+    const auto& added = append(element);
+    if (path != nullptr and added.name() == *path)
+      return &added;
   }
+  return nullptr;
+}
+
+const Element* Tar::find(const std::string& path) const {
+  auto it = index_.find(path);
+  if (it != index_.end())
+    return &elements_[it->second];
+  return parse(&path);
+}
+
+const Element& Tar::element(const std::string& path) const {
+  if (auto* element = find(path))
+    return *element;
 
   throw Tar_exception(std::string{"Path " + path + " doesn't exist. Folder names should have a trailing /"});
 }
@@ -58,30 +104,8 @@ Tar Reader::read(const uint8_t* data, const size_t size) {
   if (size % SECTOR_SIZE not_eq 0)
     throw Tar_exception("Invalid size of tar file");
 
-  Tar tar;
-
-  // Go through the whole tar file block by block
-  for (size_t i = 0; i < size; i += SECTOR_SIZE) {
-    Tar_header* header = (Tar_header*) ((const char*) data + i);
-    Element element{*header};
-
-    if (element.name().empty()) {
-      // Empty header name - continue
-      continue;
-    }
-
-    // Check if this is a directory or not (typeflag) (directories have no content)
-    // If typeflag not set -> is not a directory and has content
-    if (not element.typeflag_is_set() or not element.is_dir()) {
-      i += SECTOR_SIZE; // move past header
-      element.set_content_start(data + i);
-      i += (SECTOR_SIZE * (element.num_content_blocks() - 1));  // move to the end of the element
-    }
-
-    tar.add_element(element);
-  }
-
-  return tar;
+  // the headers are parsed on first use
+  return Tar{data, size};
 }
 
 Tar_data Reader::decompress(const uint8_t* data, const size_t size, unsigned int dlen)
@@ -337,6 +337,49 @@ void URI::load_queries() {
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+static_assert(UF_MAX == 7, "URI_view keeps one span for each http_parser field");
+
+URI_view::URI_view(util::csview uri, const bool is_connect) noexcept
+  : data_{uri.data()}, size_(uri.size())
+{
+  http_parser_url u;
+  http_parser_url_init(&u);
+
+  // the offsets are 16-bit
+  if (uri.size() > UINT16_MAX) return;
+  if (http_parser_parse_url(data_, size_, is_connect, &u) not_eq 0) return;
+
+  for (int f = 0; f < UF_MAX; f++) {
+    if (u.field_set & (1 << f))
+      parts_[f] = {u.field_data[f].off, u.field_data[f].len};
+  }
+  // http_parser has checked that the port fits
+  port_  = (u.field_set & (1 << UF_PORT)) ? u.port : bind_port(scheme(), 0);
+  valid_ = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool URI_view::host_is_ip6() const noexcept {
+  const uint32_t end = parts_[HOST].off + parts_[HOST].len;
+  return parts_[HOST].len > 0 and end < size_ and data_[end] == ']';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+util::sview URI_view::query(util::csview key) const noexcept {
+  for (const auto& param : query_params()) {
+    if (param.key == key) return param.value;
+  }
+  return {};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+URI_view::Range<URI_view::Segment_iterator> URI_view::path_segments() const noexcept {
+  auto path = this->path();
+  if (not path.empty() and path.front() == '/') path.remove_prefix(1);
+  return {Segment_iterator{path}, Segment_iterator{}};
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 bool operator < (const URI& lhs, const URI& rhs) noexcept {
   return lhs.to_string() < rhs.to_string();
@@ -136,6 +136,17 @@ void Virtio::get_config(void* buf, int len)
   }
 }
 
+void Virtio::set_config(int offset, const void* buf, int len)
+{
+  uint32_t ioaddr = _iobase + offset;
+  ioaddr += (has_msix()) ? VIRTIO_PCI_CONFIG_MSIX : VIRTIO_PCI_CONFIG;
+
+  auto* ptr = (const uint8_t*) buf;
+  for (int i = 0; i < len; i++) {
+    hw::outp(ioaddr + i, ptr[i]);
+  }
+}
+
 
 void Virtio::reset() {
   hw::outp(_iobase + VIRTIO_PCI_STATUS, 0);
@@ -157,6 +168,11 @@ uint32_t Virtio::queue_size(uint16_t index) {
 }
 
 bool Virtio::assign_queue(uint16_t index, const void* queue_desc)
+{
+  return assign_queue(index, queue_desc, index);
+}
+
+bool Virtio::assign_queue(uint16_t index, const void* queue_desc, uint16_t vector)
 {
   hw::outpw(iobase() + VIRTIO_PCI_QUEUE_SEL, index);
   hw::outpd(iobase() + VIRTIO_PCI_QUEUE_PFN, kernel::addr_to_page((uintptr_t) queue_desc));
@@ -164,10 +180,10 @@ bool Virtio::assign_queue(uint16_t index, const void* queue_desc)
   if (_pcidev.has_msix())
   {
     // also update virtio MSI-X queue vector
-    hw::outpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR, index);
+    hw::outpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR, vector);
     // the programming could fail, and the reason is allocation failed on vmm
     // in which case we probably don't wanna continue anyways
-    assert(hw::inpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR) == index);
+    assert(hw::inpw(iobase() + VIRTIO_MSI_QUEUE_VECTOR) == vector);
   }
 
   return hw::inpd(iobase() + VIRTIO_PCI_QUEUE_PFN) == kernel::addr_to_page((uintptr_t) queue_desc);
@@ -184,6 +200,15 @@ void Virtio::negotiate_features(uint32_t features) {
   hw::outpd(_iobase + VIRTIO_PCI_GUEST_FEATURES, _features);
   _features = probe_features();
   debug("<Virtio> Got features: 0x%lx \n",_features);
+  this->_negotiated = features & _features;
+}
+
+void Virtio::enable_ring_features(Queue& q, int max_tokens)
+{
+  if (max_tokens > 1 && (_negotiated & (1 << VIRTIO_F_RING_INDIRECT_DESC)))
+    q.enable_indirect(max_tokens);
+  if (_negotiated & (1 << VIRTIO_F_RING_EVENT_IDX))
+    q.enable_event_idx();
 }
 
 void Virtio::move_to_this_cpu()
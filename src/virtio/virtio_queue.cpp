@@ -65,6 +65,34 @@ Virtio::Queue::Queue(const std::string& name,
   debug(" >> Virtio Queue %s setup complete. \n", qname.c_str());
 }
 
+void Virtio::Queue::enable_indirect(int max_tokens)
+{
+  Expects(max_tokens > 1 && _indirect == nullptr);
+  const size_t total_bytes = sizeof(virtq_desc) * max_tokens * _size;
+  // The device reads the tables by guest-physical address, like the rings
+  _indirect = (virtq_desc*) memalign(PAGE_SIZE, total_bytes);
+  if (! _indirect)
+    os::panic("Virtio queue could not allocate indirect descriptors");
+
+  memset(_indirect, 0, total_bytes);
+  _indirect_max = max_tokens;
+  debug("<%s> Indirect descriptors, %i per chain\n", qname.c_str(), max_tokens);
+}
+
+void Virtio::Queue::add_avail(uint16_t head)
+{
+  // Place the head of this current chain in the avail ring
+  uint16_t avail_index = (_queue.avail->idx + _num_added) % _size;
+
+  // we added a token
+  _num_added++;
+
+  _queue.avail->ring[avail_index] = head;
+
+  debug("<%s> avail_index: %u size: %u, free_head %u num free: %u\n",
+        qname.c_str(), avail_index, size(), _free_head, num_free());
+}
+
 /** Ported more or less directly from SanOS. */
 int Virtio::Queue::enqueue(gsl::span<Token> buffers)
 {
@@ -72,6 +100,34 @@ int Virtio::Queue::enqueue(gsl::span<Token> buffers)
 
   uint16_t last = _free_head;
   uint16_t first = _free_head;
+
+  // A chain takes one ring descriptor, pointing to its own table
+  if (indirect() && buffers.size() > 1 && buffers.size() <= _indirect_max)
+  {
+    auto* table = &_indirect[first * _indirect_max];
+    int i = 0;
+    for (auto buf : buffers) {
+      table[i].flags =
+        buf.direction() ? VIRTQ_DESC_F_NEXT : VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE;
+      table[i].addr = (uint64_t) buf.data();
+      table[i].len  = buf.size();
+      table[i].next = i + 1;
+      i++;
+    }
+    table[i - 1].flags &= ~VIRTQ_DESC_F_NEXT;
+
+    auto& desc = _queue.desc[first];
+    desc.flags = VIRTQ_DESC_F_INDIRECT;
+    desc.addr  = (uint64_t) table;
+    desc.len   = i * sizeof(virtq_desc);
+    _free_head = desc.next;
+
+    _desc_in_flight++;
+    Ensures(_desc_in_flight <= size());
+    add_avail(first);
+    return buffers.size();
+  }
+
   // Place each buffer in a token
   for( auto buf : buffers )  {
     debug ("%s:  buf @ %p \n", qname.c_str(), buf.data());
@@ -94,18 +150,7 @@ int Virtio::Queue::enqueue(gsl::span<Token> buffers)
   // No continue on last buffer
   _queue.desc[last].flags &= ~VIRTQ_DESC_F_NEXT;
 
-
-  // Place the head of this current chain in the avail ring
-  uint16_t avail_index = (_queue.avail->idx + _num_added) % _size;
-
-  // we added a token
-  _num_added++;
-
-  _queue.avail->ring[avail_index] = first;
-
-  debug("<%s> avail_index: %u size: %u, free_head %u num free: %u\n",
-        qname.c_str(), avail_index, size(), _free_head, num_free());
-
+  add_avail(first);
   return buffers.size();
 }
 
@@ -136,35 +181,56 @@ Virtio::Token Virtio::Queue::dequeue()
   auto& e = _queue.used->ring[_last_used_idx % _size];
   debug("<%s> Releasing token @%p, nr. %i Len: %i\n", qname.c_str(), &e, e.id, e.len);
 
+  // An indirect chain returns the first buffer of its table
+  const auto& desc = _queue.desc[e.id];
+  auto* data = (desc.flags & VIRTQ_DESC_F_INDIRECT)
+             ? (uint8_t*) ((virtq_desc*) desc.addr)[0].addr
+             : (uint8_t*) desc.addr;
+
   // Release buffer
   release(e.id);
   _last_used_idx++;
   // return token:
-  return {{(uint8_t*) _queue.desc[e.id].addr, e.len }, Token::IN};
+  return {{data, e.len }, Token::IN};
 }
 
 void Virtio::Queue::disable_interrupts() {
-  _queue.avail->flags |= (1 << VIRTQ_AVAIL_F_NO_INTERRUPT);
+  _queue.avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+  // the device ignores the flag, ask for an interrupt only after a full wrap
+  if (_event_idx) used_event() = _last_used_idx - 1;
 }
 void Virtio::Queue::enable_interrupts() {
-  _queue.avail->flags &= ~(1 << VIRTQ_AVAIL_F_NO_INTERRUPT);
+  _queue.avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+  // interrupt as soon as the device uses the next buffer
+  if (_event_idx) used_event() = _last_used_idx;
 }
 bool Virtio::Queue::interrupts_enabled() const noexcept {
-  return (_queue.avail->flags & (1 << VIRTQ_AVAIL_F_NO_INTERRUPT)) == 0;
+  return (_queue.avail->flags & VIRTQ_AVAIL_F_NO_INTERRUPT) == 0;
 }
 
 // this will force most of the implementation to not use PCI
 // and thus be more easily testable
 #include <hw/pci.hpp>
+bool Virtio::Queue::needs_notify(u16 old_idx) noexcept
+{
+  // Std. §2.4.8.2: notify if avail_event lies in [old_idx, new_idx)
+  const u16 new_idx = _queue.avail->idx;
+  if (_event_idx)
+    return (u16) (new_idx - avail_event() - 1) < (u16) (new_idx - old_idx);
+  return !(_queue.used->flags & VIRTQ_USED_F_NO_NOTIFY);
+}
+
 void Virtio::Queue::kick()
 {
+  const u16 old_idx = _queue.avail->idx;
   update_avail_idx();
 #if defined (PLATFORM_UNITTEST)
   // do nothing here
+  (void) old_idx;
 #elif defined(ARCH_x86)
   // Std. §3.2.1 pt. 4
   __arch_hw_barrier();
-  if (!(_queue.used->flags & VIRTQ_USED_F_NO_NOTIFY)){
+  if (needs_notify(old_idx)){
     debug("<%s> Kicking virtio. Iobase 0x%x \n", qname.c_str(), _iobase);
     hw::outpw(_iobase + VIRTIO_PCI_QUEUE_NOTIFY , _pci_index);
   }else{
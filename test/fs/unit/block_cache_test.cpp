@@ -0,0 +1,95 @@
+#include <common.cxx>
+#include <memdisk>
+#include <fs/block_cache.hpp>
+
+static std::vector<char> make_image(size_t blocks)
+{
+  std::vector<char> image(blocks * fs::MemDisk::SECTOR_SIZE);
+  for (size_t i = 0; i < blocks; i++)
+    image[i * fs::MemDisk::SECTOR_SIZE] = (char) i;
+  return image;
+}
+
+CASE("Block_cache serves repeated reads from the cache")
+{
+  auto image = make_image(64);
+  fs::MemDisk memdisk {image.data(), image.data() + image.size()};
+  fs::Block_cache cache {memdisk, 8 * memdisk.block_size(), 0};
+  EXPECT(cache.size() == memdisk.size());
+  EXPECT(cache.block_size() == memdisk.block_size());
+  EXPECT(cache.capacity() == 8u);
+
+  auto buf = cache.read_sync(3, 2);
+  EXPECT(buf != nullptr);
+  EXPECT(buf->size() == 2 * cache.block_size());
+  EXPECT(buf->at(0) == 3);
+  EXPECT(cache.misses() == 1u);
+  EXPECT(cache.cached() == 2u);
+
+  bool called = false;
+  cache.read(4, 1, hw::Block_device::on_read_func::make_packed(
+  [&] (fs::buffer_t buf) {
+    EXPECT(buf != nullptr);
+    EXPECT(buf->at(0) == 4);
+    called = true;
+  }));
+  EXPECT(called);
+  EXPECT(cache.hits() == 1u);
+  EXPECT(cache.misses() == 1u);
+}
+
+CASE("Block_cache evicts the least recently used blocks")
+{
+  auto image = make_image(64);
+  fs::MemDisk memdisk {image.data(), image.data() + image.size()};
+  fs::Block_cache cache {memdisk, 4 * memdisk.block_size(), 0};
+
+  for (int i = 0; i < 4; i++) cache.read_sync(i * 10, 1);
+  EXPECT(cache.cached() == 4u);
+  // touch block 0, so that block 10 is the oldest
+  cache.read_sync(0, 1);
+  EXPECT(cache.hits() == 1u);
+  cache.read_sync(50, 1);
+  EXPECT(cache.cached() == 4u);
+
+  cache.read_sync(0, 1);
+  EXPECT(cache.hits() == 2u);
+  auto buf = cache.read_sync(10, 1);
+  EXPECT(cache.hits() == 2u);
+  EXPECT(buf->at(0) == 10);
+
+  cache.invalidate(0, 64);
+  EXPECT(cache.cached() == 0u);
+  cache.read_sync(50, 1);
+  EXPECT(cache.hits() == 2u);
+}
+
+CASE("Block_cache reads ahead on sequential reads")
+{
+  auto image = make_image(64);
+  fs::MemDisk memdisk {image.data(), image.data() + image.size()};
+  fs::Block_cache cache {memdisk, 32 * memdisk.block_size(), 8};
+
+  auto reader = hw::Block_device::on_read_func::make_packed(
+  [&] (fs::buffer_t buf) {
+    EXPECT(buf != nullptr);
+    EXPECT(buf->size() == 2 * cache.block_size());
+  });
+  cache.read(0, 2, reader);
+  EXPECT(cache.cached() == 2u);
+  // continuing the last read reads ahead
+  cache.read(2, 2, reader);
+  EXPECT(cache.cached() == 12u);
+  cache.read(4, 2, reader);
+  cache.read(10, 2, reader);
+  EXPECT(cache.hits() == 2u);
+  EXPECT(cache.misses() == 2u);
+
+  cache.clear();
+  EXPECT(cache.cached() == 0u);
+  // readahead stops at the end of the device
+  auto ignore = hw::Block_device::on_read_func::make_packed([] (fs::buffer_t) {});
+  cache.read(62, 1, ignore);
+  cache.read(63, 1, ignore);
+  EXPECT(cache.cached() == 2u);
+}
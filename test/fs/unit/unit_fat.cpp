@@ -2,11 +2,13 @@
 #include <fs/disk.hpp>
 #include <fs/memdisk.hpp>
 #include <util/sha1.hpp>
+#include <statman>
 #include <unistd.h>
 using namespace fs;
 
 static MemDisk* mdisk = nullptr;
 static Disk_ptr disk = nullptr;
+static std::vector<char> image;
 
 CASE("Prepare custom memdisk")
 {
@@ -31,6 +33,7 @@ CASE("Prepare custom memdisk")
   // create memdisk
   mdisk = new MemDisk(buffer, buffer + size);
   EXPECT(mdisk);
+  image.assign(buffer, buffer + size);
 }
 
 CASE("Initialize FAT fs")
@@ -152,3 +155,131 @@ CASE("Stat /folder/file.txt")
   const std::string text((const char*) buffer.data(), buffer.size());
   EXPECT(text == "This file contains text\n");
 }
+
+CASE("Map /folder/file.txt in place")
+{
+  auto& fs = disk->fs();
+  auto ent = fs.stat("/folder/file.txt");
+  EXPECT(ent.is_valid());
+
+  // the file is in the memdisk image, and mapped from there
+  const char* data = fs.map(ent, 0, ent.size());
+  EXPECT(data != nullptr);
+  EXPECT(std::string(data, ent.size()) == "This file contains text\n");
+
+  const char* part = fs.map(ent, 5, 4);
+  EXPECT(part == data + 5);
+  EXPECT(std::string(part, 4) == "file");
+
+  // nothing past the end of the file
+  EXPECT(fs.map(ent, 0, ent.size() + 1) == nullptr);
+  EXPECT(fs.map(ent, ent.size(), 1) == nullptr);
+  EXPECT(fs.map(ent, 0, 0) == nullptr);
+}
+
+CASE("View /folder/file.txt without copying")
+{
+  auto& fs = disk->fs();
+  auto view = fs.view_file("/folder/file.txt");
+  EXPECT(view.size() == 24);
+  EXPECT(std::string((const char*) view.data(), view.size()) == "This file contains text\n");
+  EXPECT((const char*) view.data() == fs.map(fs.stat("/folder/file.txt"), 0, 24));
+
+  auto ent = fs.stat("/folder/file.txt");
+  // cut at the end of the file, like read()
+  auto tail = ent.view(19, 100);
+  EXPECT(tail.size() == 5);
+  EXPECT(std::string((const char*) tail.data(), tail.size()) == "text\n");
+  EXPECT(ent.view(24, 1).empty());
+  EXPECT(fs.view_file("/folder").empty());
+  EXPECT(fs.view_file("/missing").empty());
+}
+
+CASE("Read a fragmented file by following its cluster chain")
+{
+  // /folder/file.txt is in cluster 4 (sector 5), continue it in cluster 20
+  std::vector<char> copy = image;
+  char* fat = &copy[512];
+  auto set_fat12 = [fat] (int cl, uint16_t val) {
+    auto* entry = (uint16_t*) &fat[cl + cl / 2];
+    if (cl & 1) *entry = (*entry & 0x000F) | (val << 4);
+    else        *entry = (*entry & 0xF000) | val;
+  };
+  set_fat12(4, 20);
+  set_fat12(20, 0xFFF);
+  const uint32_t size = 1024;
+  memcpy(&copy[4 * 512 + 2 * 32 + 28], &size, sizeof(size));
+  memset(&copy[21 * 512], 'B', 512);
+
+  MemDisk memdisk {copy.data(), copy.data() + copy.size()};
+  auto frag = std::make_shared<Disk> (memdisk);
+  frag->init_fs(
+    [&lest_env] (auto err, File_system&)
+    {
+      EXPECT(!err);
+    });
+  auto& fs = frag->fs();
+  auto ent = fs.stat("/folder/file.txt");
+  EXPECT(ent.size() == 1024u);
+
+  auto buffer = fs.read(ent, 500, 24);
+  EXPECT(buffer.size() == 24);
+  EXPECT(std::string((const char*) buffer.data() + 12, 12) == std::string(12, 'B'));
+
+  fs.read(ent, 0, ent.size(),
+  [&lest_env] (auto err, auto buf)
+  {
+    EXPECT(!err);
+    EXPECT(buf->size() == 1024u);
+    EXPECT(std::string((const char*) buf->data(), 24) == "This file contains text\n");
+    EXPECT(buf->at(512) == 'B');
+    EXPECT(buf->at(1023) == 'B');
+  });
+  // parts of both fragments in one go, into our own memory
+  char first[10], second[8], none[4];
+  bool done = false;
+  fs.readv({ {&ent, 1000, 8, second}, {&ent, 5, 10, first}, {&ent, 2000, 4, none} },
+  [&] (auto err, size_t total)
+  {
+    EXPECT(!err);
+    EXPECT(total == 18u);
+    done = true;
+  });
+  EXPECT(done);
+  EXPECT(std::string(first, 10) == "file conta");
+  EXPECT(std::string(second, 8) == std::string(8, 'B'));
+  // the file can't be mapped as one range any more
+  EXPECT(fs.map(ent, 0, ent.size()) == nullptr);
+  EXPECT(fs.map(ent, 512, 512) == copy.data() + 21 * 512);
+}
+
+CASE("Stat looks up cached paths without reading directories")
+{
+  auto& fs = disk->fs();
+  auto& reads = Statman::get().get_by_name((mdisk->device_name() + ".reads").c_str());
+  fs.stat("/folder/file.txt");
+  EXPECT(fs.stat("/folder/missing.txt").is_valid() == false);
+
+  const auto before = reads.get_uint64();
+  auto ent = fs.stat("/folder/file.txt");
+  EXPECT(ent.is_valid());
+  EXPECT(ent.size() == 24);
+  // missing names are cached as well
+  EXPECT(fs.stat("/folder/missing.txt").is_valid() == false);
+  fs.stat("/folder/file.txt",
+  [&lest_env] (auto err, const Dirent& ent)
+  {
+    EXPECT(!err);
+    EXPECT(ent.name() == "file.txt");
+  });
+  fs.stat("/folder/missing.txt",
+  [&lest_env] (auto err, const Dirent& ent)
+  {
+    EXPECT(err);
+    EXPECT(ent.is_valid() == false);
+  });
+  EXPECT(reads.get_uint64() == before);
+
+  // a file isn't a directory, cached or not
+  EXPECT(fs.stat("/folder/file.txt/x").is_valid() == false);
+}
@@ -0,0 +1,57 @@
+
+#include <common.cxx>
+#include <hw/nic.hpp>
+#include <kernel/events.hpp>
+
+CASE("Rx_poller polls in budgeted rounds until the queue drains")
+{
+  static int queued, rounds, rearmed;
+  queued = 100; rounds = 0; rearmed = 0;
+
+  hw::Nic::Rx_poller poller(
+    [] (int budget) {
+      rounds++;
+      const int n = std::min(budget, queued);
+      queued -= n;
+      return n;
+    },
+    [] () { rearmed++; return false; },
+    32);
+
+  EXPECT(not poller.scheduled());
+  poller.schedule();
+  EXPECT(poller.scheduled());
+  // scheduling twice is harmless
+  poller.schedule();
+
+  Events::get().process_events();
+  // 32 + 32 + 32 + 4
+  EXPECT(queued == 0);
+  EXPECT(rounds == 4);
+  EXPECT(rearmed == 1);
+  EXPECT(not poller.scheduled());
+}
+
+CASE("Rx_poller keeps polling when packets arrive while re-arming")
+{
+  static int queued, rearmed;
+  queued = 10; rearmed = 0;
+
+  hw::Nic::Rx_poller poller(
+    [] (int budget) {
+      const int n = std::min(budget, queued);
+      queued -= n;
+      return n;
+    },
+    [] () {
+      // a packet slips in on the first re-arm
+      if (rearmed++ == 0) queued++;
+      return queued > 0;
+    });
+
+  poller.schedule();
+  Events::get().process_events();
+  EXPECT(queued == 0);
+  EXPECT(rearmed == 2);
+  EXPECT(not poller.scheduled());
+}
@@ -39,3 +39,51 @@ CASE("Virtio Queue dequeue")
   EXPECT(res.size() == 0);
   EXPECT(res.data() == nullptr);
 }
+
+CASE("Virtio Queue indirect descriptors")
+{
+  Virtio::Queue q("Test queue", 256, 0, 0x1000);
+  q.enable_indirect(2);
+  EXPECT(q.indirect());
+
+  uint8_t  value = 4;
+  uint8_t  buffer[16];
+
+  Virtio::Token token1 {{&value, sizeof(value)}, Virtio::Token::OUT };
+  Virtio::Token token2 {{buffer, sizeof(buffer)}, Virtio::Token::IN };
+
+  std::array<Virtio::Token, 2> tokens {{ token1, token2 }};
+  q.enqueue(tokens);
+  // the chain only occupies one ring descriptor
+  EXPECT(q.num_free() == 255);
+  EXPECT(q.num_free_chains(2) == 255);
+
+  auto& desc = q.queue_desc()[0];
+  EXPECT(desc.flags == VIRTQ_DESC_F_INDIRECT);
+  EXPECT(desc.len == 2 * sizeof(Virtio::Queue::virtq_desc));
+
+  auto* table = (Virtio::Queue::virtq_desc*) desc.addr;
+  EXPECT(table[0].addr == (uint64_t) &value);
+  EXPECT(table[0].flags == VIRTQ_DESC_F_NEXT);
+  EXPECT(table[1].addr == (uint64_t) buffer);
+  EXPECT(table[1].flags == VIRTQ_DESC_F_WRITE);
+}
+
+CASE("Virtio Queue event index notification suppression")
+{
+  Virtio::Queue q("Test queue", 256, 0, 0x1000);
+  q.enable_event_idx();
+
+  uint8_t  buffer[16];
+  Virtio::Token token {{buffer, sizeof(buffer)}, Virtio::Token::OUT };
+  std::array<Virtio::Token, 1> tokens {{ token }};
+
+  // the device wants to hear about avail index 0
+  q.enqueue(tokens);
+  q.kick();
+  EXPECT(q.needs_notify(0));
+  // ...but not again until it moves avail_event
+  q.enqueue(tokens);
+  q.kick();
+  EXPECT(not q.needs_notify(1));
+}
@@ -2,6 +2,7 @@
 #include <os>
 #include <vector>
 #include <kernel/fiber.hpp>
+#include <kernel/memory.hpp>
 
 void scheduler1();
 void scheduler2();
@@ -231,6 +232,30 @@ long compute_int() {
   return i;
 }
 
+void no_work() {}
+
+void stack_pool_test()
+{
+  INFO("Stack pool", "Recycling fiber stacks");
+  char* stack = nullptr;
+  {
+    auto first = Fiber::alloc_stack(Fiber::default_stack_size);
+    stack = first.get();
+  }
+  Expects(Fiber::pooled_stacks() > 0);
+
+  auto again = Fiber::alloc_stack(Fiber::default_stack_size);
+  Expects(again.get() == stack);
+  Expects(os::mem::flags((uintptr_t) stack - 1) == os::mem::Access::none
+          && "Guard page below the stack");
+
+  // fiber per call doesn't grow the pool
+  const auto pooled = Fiber::pooled_stacks();
+  for (int i = 0; i < 100; i++)
+    Fiber{no_work}.start();
+  Expects(Fiber::pooled_stacks() == std::max<size_t>(pooled, 1));
+}
+
 void Service::start()
 {
   Expects(Fiber::main() == nullptr);
@@ -292,6 +317,8 @@ void Service::start()
 
   INFO("Service", "Computed long: %li", ret);
 
+  stack_pool_test();
+
   if (SMP::cpu_count() > 1) {
     extern void fiber_smp_test();
     fiber_smp_test();
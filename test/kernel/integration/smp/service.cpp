@@ -79,6 +79,20 @@ void smp_advanced_test()
 }
 
 #include <smp_utils>
+static void smp_parallel_test()
+{
+  static const size_t N = 100000;
+  std::vector<uint32_t> data(N);
+  smp::parallel_for(0, N, [&data] (size_t i) { data[i] = i; });
+  const uint64_t sum = smp::parallel_reduce(0, N, uint64_t(0),
+      [&data] (size_t i) -> uint64_t { return data[i]; },
+      [] (uint64_t a, uint64_t b) { return a + b; });
+  SMP::global_lock();
+  printf("Parallel sum of %zu values: %lu\n", N, sum);
+  SMP::global_unlock();
+  assert(sum == (uint64_t) N * (N - 1) / 2);
+}
+
 static struct {
 	smp_barrier barry;
 } messages;
@@ -198,6 +212,8 @@ void Service::start()
   printf("DONE: Barrier condition met\n");
   SMP::global_unlock();
 
+  smp_parallel_test();
+
   // trigger interrupt
   SMP::broadcast(IRQ);
   // the rest
@@ -0,0 +1,95 @@
+#include <common.cxx>
+#include <kernel/mem_pressure.hpp>
+#include <kernel/events.hpp>
+#include <climits>
+#include <string>
+
+using namespace os::mem;
+
+static std::string calls;
+
+static size_t cheap(Pressure level)
+{
+  calls += (level == Pressure::critical) ? "C" : "c";
+  return 100;
+}
+
+static size_t expensive(Pressure level)
+{
+  calls += (level == Pressure::critical) ? "E" : "e";
+  return 1000;
+}
+
+static size_t relieving(Pressure)
+{
+  calls += "r";
+  // as if it gave back all that was needed
+  set_watermarks(0, 0);
+  return 10;
+}
+
+CASE("Shrinkers run cheapest first, only under pressure")
+{
+  set_watermarks(0, 0);
+  EXPECT(low_watermark() > critical_watermark());
+  EXPECT(pressure() == Pressure::none);
+
+  const int e = add_shrinker("expensive", Shrink_cost::expensive, expensive);
+  const int c = add_shrinker("cheap", Shrink_cost::cheap, cheap);
+  calls.clear();
+  EXPECT(shrink(pressure()) == 0u);
+  EXPECT(calls == "");
+
+  // nothing is ever left over these
+  set_watermarks(SIZE_MAX, SIZE_MAX);
+  EXPECT(pressure() == Pressure::critical);
+  EXPECT(shrink(pressure()) == 1100u);
+  EXPECT(calls == "CE");
+
+  set_watermarks(SIZE_MAX, 0);
+  calls.clear();
+  EXPECT(shrink(pressure()) == 1100u);
+  EXPECT(calls == "ce");
+
+  remove_shrinker(e);
+  remove_shrinker(c);
+  calls.clear();
+  EXPECT(shrink(Pressure::critical) == 0u);
+  EXPECT(calls == "");
+}
+
+CASE("Shrinking stops once the pressure is gone")
+{
+  const int e = add_shrinker("expensive", Shrink_cost::expensive, expensive);
+  const int r = add_shrinker("relieving", Shrink_cost::moderate, relieving);
+  const int c = add_shrinker("cheap", Shrink_cost::cheap, cheap);
+
+  set_watermarks(SIZE_MAX, SIZE_MAX);
+  calls.clear();
+  EXPECT(shrink(pressure()) == 110u);
+  EXPECT(calls == "Cr");
+  EXPECT(pressure() == Pressure::none);
+
+  remove_shrinker(e);
+  remove_shrinker(r);
+  remove_shrinker(c);
+}
+
+CASE("The allocator posts shrinking to the event loop, once")
+{
+  const int c = add_shrinker("cheap", Shrink_cost::cheap, cheap);
+  calls.clear();
+  set_watermarks(0, 0);
+  pressure_notify();
+  Events::get(0).process_events();
+  EXPECT(calls == "");
+
+  set_watermarks(SIZE_MAX, 0);
+  pressure_notify();
+  pressure_notify();
+  EXPECT(Events::get(0).has_posted());
+  Events::get(0).process_events();
+  EXPECT(calls == "c");
+  remove_shrinker(c);
+  set_watermarks(0, 0);
+}
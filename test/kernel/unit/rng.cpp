@@ -1,6 +1,9 @@
 
 #include <common.cxx>
 #include <kernel/rng.hpp>
+#include <algorithm>
+#include <set>
+#include <vector>
 
 CASE("RNG init")
 {
@@ -18,3 +21,21 @@ CASE("RNG rng_extract")
   uint32_t value2 = rng_extract_uint32();
   EXPECT(value2 != value);
 }
+CASE("RNG rng_fast_fill")
+{
+  // small and bulk requests, across refills of the buffer
+  std::vector<uint8_t> a(3000), b(3000);
+  rng_fast_fill(a.data(), a.size());
+  rng_fast_fill(b.data(), b.size());
+  EXPECT(a != b);
+  int zeros = std::count(a.begin(), a.end(), 0);
+  EXPECT(zeros < 50);
+
+  std::set<uint64_t> seen;
+  for (int i = 0; i < 1000; i++)
+    seen.insert(rng_fast_uint64());
+  EXPECT(seen.size() == 1000u);
+
+  rng_fast_reseed();
+  EXPECT(rng_fast_uint32() != rng_fast_uint32() or rng_fast_uint32() != rng_fast_uint32());
+}
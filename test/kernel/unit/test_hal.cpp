@@ -133,3 +133,42 @@ CASE("os::Machine basics") {
     machine->remove<Pool>(i);
   }
 }
+
+CASE("os::Machine lazy parts are constructed on first use")
+{
+  Pool pool(4_MiB);
+  auto* machine = os::Machine::create(pool.data, pool.size);
+
+  static int constructed = 0;
+  static ssize_t index_seen = -1;
+  constructed = 0;
+  auto factory = [machine] () -> void* {
+    constructed++;
+    index_seen = machine->next_index<Pool>();
+    return new Pool(500u);
+  };
+
+  EXPECT(machine->add_new<Pool>(100u) == 0);
+  EXPECT(machine->add_lazy<Pool>(factory) == 1);
+  EXPECT(machine->add_lazy<Pool>(factory) == 2);
+  EXPECT(machine->count<Pool>() == 3);
+  EXPECT(machine->next_index<Pool>() == 3);
+  EXPECT(constructed == 0);
+
+  EXPECT(machine->is_active<Pool>(0));
+  EXPECT(not machine->is_active<Pool>(1));
+  EXPECT(machine->get_active<Pool>().size() == 1);
+
+  auto& lazy = machine->get<Pool>(2);
+  EXPECT(lazy.size == 500u);
+  EXPECT(constructed == 1);
+  EXPECT(index_seen == 2);
+  EXPECT(machine->is_active<Pool>(2));
+  EXPECT(std::addressof(machine->get<Pool>(2)) == std::addressof(lazy));
+  EXPECT(constructed == 1);
+
+  // getting them all activates the rest
+  EXPECT(machine->get<Pool>().size() == 3);
+  EXPECT(constructed == 2);
+  EXPECT(machine->get_active<Pool>().size() == 3);
+}
@@ -1,6 +1,7 @@
 
 #include <common.cxx>
 #include <kernel/events.hpp>
+#include <profile>
 const int Events::NUM_EVENTS;
 
 static inline auto& manager() {
@@ -109,3 +110,80 @@ CASE("Too many events throws exception")
   // event not subscribed on should throw
   EXPECT_THROWS(manager().unsubscribe(35));
 }
+
+CASE("Posted calls are made in order, and the queue is bounded")
+{
+  static std::vector<int> calls;
+  calls.clear();
+  EXPECT(manager().has_posted() == false);
+
+  for (int i = 0; i < Events::POST_QUEUE; i++)
+  {
+    EXPECT(manager().post([i] { calls.push_back(i); }));
+  }
+  // the queue is full
+  EXPECT(manager().post([] { calls.push_back(-1); }) == false);
+  EXPECT(manager().has_posted());
+  EXPECT(calls.empty());
+
+  manager().process_events();
+  EXPECT(manager().has_posted() == false);
+  EXPECT(calls.size() == (size_t) Events::POST_QUEUE);
+  for (int i = 0; i < Events::POST_QUEUE; i++)
+  {
+    EXPECT(calls[i] == i);
+  }
+  // a posted call can post another, going around the ring several times
+  static int remaining;
+  remaining = 3 * Events::POST_QUEUE;
+  static Events::event_callback again;
+  again = [] { if (--remaining > 0) manager().post(again); };
+  EXPECT(manager().post(again));
+  manager().process_events();
+  EXPECT(remaining == 0);
+}
+
+CASE("Stall watchdog keeps slow handlers, named by their code")
+{
+  using namespace std::chrono_literals;
+  StallWatchdog::reset();
+  // every handler is over the limit
+  StallWatchdog::enable(0us);
+
+  static int called = 0;
+  Events::event_callback handler = [] { called++; };
+  const auto evt = manager().subscribe(handler);
+  manager().trigger_event(evt);
+  manager().process_events();
+  EXPECT(called == 1);
+  EXPECT(StallWatchdog::count() == 1u);
+  auto stalls = StallWatchdog::results(1);
+  EXPECT(stalls.size() == 1u);
+  EXPECT(stalls[0].kind == Stall_sample::EVENT);
+  EXPECT(stalls[0].key == evt);
+  EXPECT(stalls[0].func == handler.invoker());
+  EXPECT(stalls[0].name.empty() == false);
+  manager().unsubscribe(evt);
+
+  // deferred and posted calls are named after what they call
+  Events::event_callback deferred = [] { called++; };
+  Events::event_callback posted = [] { called += 10; };
+  manager().defer(deferred);
+  manager().process_events();
+  EXPECT(manager().post(posted));
+  manager().process_events();
+  EXPECT(called == 12);
+  stalls = StallWatchdog::results();
+  EXPECT(stalls.size() == 3u);
+  EXPECT(stalls[1].func == deferred.invoker());
+  EXPECT(stalls[0].kind == Stall_sample::POSTED);
+  EXPECT(stalls[0].func == posted.invoker());
+
+  // nothing is timed when disabled
+  StallWatchdog::disable();
+  manager().post(posted);
+  manager().process_events();
+  EXPECT(StallWatchdog::count() == 3u);
+  StallWatchdog::reset();
+  EXPECT(StallWatchdog::results().empty());
+}
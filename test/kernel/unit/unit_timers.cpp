@@ -1,6 +1,7 @@
 
 #include <common.cxx>
 #include <kernel/timers.hpp>
+#include <vector>
 using namespace std::chrono;
 
 extern delegate<uint64_t()> systime_override;
@@ -140,6 +141,110 @@ CASE("Test a periodic timer")
   current_time = 0;
 }
 
+CASE("Timers far apart run at their exact time")
+{
+  current_time = 0;
+  magic_performed = 0;
+  // timers on every level of the wheel, and beyond it
+  const std::vector<Timers::duration_t> whens {
+    1500us, 70ms, 3s, 10min, 30h, 60 * 24h
+  };
+  for (auto when : whens)
+    Timers::oneshot(when, perform_magic);
+  EXPECT(Timers::active() == whens.size());
+
+  int expected = 0;
+  for (auto when : whens)
+  {
+    // the hardware timer may be due earlier, to move timers down a level
+    EXPECT(Timers::next() <= when - nanoseconds(current_time));
+    EXPECT(Timers::next() > 0ns);
+    // just before
+    current_time = when.count() - 1;
+    Timers::timers_handler();
+    EXPECT(magic_performed == expected);
+    // just in time
+    current_time = when.count();
+    Timers::timers_handler();
+    EXPECT(magic_performed == ++expected);
+  }
+  EXPECT(Timers::active() == 0);
+  current_time = 0;
+}
+
+CASE("Stop many timers in any order")
+{
+  current_time = 0;
+  magic_performed = 0;
+  std::vector<Timers::id_t> ids;
+  for (int i = 0; i < 1000; i++)
+    ids.push_back(Timers::oneshot(microseconds(100 + (i * 7919) % 500000), perform_magic));
+  EXPECT(Timers::active() == 1000);
+  // stop every other timer, from both ends
+  for (size_t i = 0; i < ids.size() / 2; i += 2) {
+    Timers::stop(ids[i]);
+    Timers::stop(ids[ids.size() - 1 - i]);
+  }
+  EXPECT(Timers::active() == 500);
+  current_time = 1000000000;
+  Timers::timers_handler();
+  EXPECT(magic_performed == 500);
+  EXPECT(Timers::active() == 0);
+  current_time = 0;
+}
+
+CASE("Timers started and stopped by callbacks")
+{
+  current_time = 0;
+  magic_performed = 0;
+  static Timers::id_t other;
+  other = Timers::oneshot(2ms, perform_magic);
+  // stops the other timer, and starts one due right away
+  Timers::oneshot(1ms,
+    [] (Timers::id_t) {
+      Timers::stop(other);
+      Timers::oneshot(0ms, perform_magic);
+    });
+  current_time = 5000000;
+  Timers::timers_handler();
+  EXPECT(magic_performed == 1);
+  EXPECT(Timers::active() == 0);
+  current_time = 0;
+}
+
+CASE("Timers with slack run together")
+{
+  current_time = 0;
+  magic_performed = 0;
+  auto early = Timers::oneshot(1ms, perform_magic);
+  Timers::set_slack(early, 500us);
+  Timers::oneshot(1200us, perform_magic);
+  // one wakeup for both, within the slack of the first
+  EXPECT(Timers::next() == 1200us);
+  current_time = 1200000;
+  Timers::timers_handler();
+  EXPECT(magic_performed == 2);
+  current_time = 0;
+}
+
+CASE("Deferrable timers don't wake the CPU")
+{
+  current_time = 0;
+  magic_performed = 0;
+  auto lazy = Timers::oneshot(1ms, perform_magic);
+  Timers::set_deferrable(lazy, true);
+  EXPECT(Timers::active() == 1);
+  EXPECT(Timers::next() == 0ns);
+  // they run along with the next timer that does
+  Timers::oneshot(3ms, perform_magic);
+  EXPECT(Timers::next() == 3ms);
+  current_time = 3000000;
+  Timers::timers_handler();
+  EXPECT(magic_performed == 2);
+  EXPECT(Timers::active() == 0);
+  current_time = 0;
+}
+
 #include <util/timer.hpp>
 CASE("Test util timer")
 {
@@ -108,8 +108,12 @@ public:
 
   std::vector<net::Packet_ptr> tx_queue_;
 
-  void transmit_link(net::Packet_ptr pkt, MAC::Addr, net::Ethertype)
+  // sees each packet sent, from its network layer header
+  delegate<void(const net::Packet&, net::Ethertype)> on_transmit_ = nullptr;
+
+  void transmit_link(net::Packet_ptr pkt, MAC::Addr, net::Ethertype type)
   {
+    if (on_transmit_) on_transmit_(*pkt, type);
     transmit_to_physical_(std::move(pkt));
   }
 
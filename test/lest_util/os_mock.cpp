@@ -72,8 +72,17 @@ printf("%s", str);
 //void os::default_stdout(const char*, size_t) {}
 void os::event_loop() {}
 void os::halt() noexcept {}
+uint64_t os::nanos_stolen() noexcept { return 0; }
 void os::reboot() noexcept {}
 
+#include <kernel/memory.hpp>
+void* os::mem::numa_alloc(size_t size, int) {
+  return aligned_alloc(4096, size);
+}
+void os::mem::numa_free(void* ptr, size_t) {
+  free(ptr);
+}
+
 void __x86_init_paging(void*){};
 namespace x86 {
 namespace paging {
@@ -182,10 +191,14 @@ uint32_t __arch_rand32()
 int SMP::cpu_id() noexcept {
   return 0;
 }
+size_t SMP::early_cpu_total() noexcept {
+  return 1;
+}
 void SMP::global_lock() noexcept {}
 void SMP::global_unlock() noexcept {}
 void SMP::add_task(SMP::task_func func, int) { func(); }
 void SMP::signal(int) {}
+void SMP::unicast(int, uint8_t) {}
 
 extern "C"
 void (*current_eoi_mechanism) () = nullptr;
@@ -248,6 +261,10 @@ namespace kernel {
     return 0xff00ff00;
   }
 
+  size_t heap_avail() noexcept {
+    return heap_max() - heap_begin() - heap_usage();
+  }
+
   size_t total_memuse() noexcept {
     return heap_end();
   }
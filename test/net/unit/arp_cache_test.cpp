@@ -0,0 +1,76 @@
+
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/ip4/arp_cache.hpp>
+
+using namespace net;
+
+CASE("Arp_cache finds what was inserted")
+{
+  Arp_cache cache{8, 4};
+  EXPECT(cache.size() == 0u);
+  EXPECT(cache.capacity() == 8u);
+  EXPECT(cache.find({10,0,0,1}) == nullptr);
+
+  auto& ent = cache.insert({10,0,0,1});
+  EXPECT(not ent.resolved);
+  ent.mac      = MAC::Addr{1,2,3,4,5,6};
+  ent.resolved = true;
+
+  auto* found = cache.find({10,0,0,1});
+  EXPECT(found == &ent);
+  EXPECT(found->mac == MAC::Addr(1,2,3,4,5,6));
+  EXPECT(&cache.insert({10,0,0,1}) == &ent);
+  EXPECT(cache.size() == 1u);
+
+  const auto gen = cache.generation();
+  cache.erase(ent);
+  EXPECT(cache.find({10,0,0,1}) == nullptr);
+  EXPECT(cache.size() == 0u);
+  EXPECT(cache.generation() != gen);
+}
+
+CASE("A full Arp_cache evicts entries that were not looked up")
+{
+  Arp_cache cache{4, 4};
+  for (uint8_t i = 1; i <= 4; i++)
+    cache.insert({10,0,0,i}).resolved = true;
+
+  // 10.0.0.2 is in use, everyone else is idle
+  EXPECT(cache.find({10,0,0,2}) != nullptr);
+  const auto gen = cache.generation();
+
+  // a scan of a whole subnet stays within capacity
+  for (int i = 0; i < 256; i++)
+  {
+    cache.insert({192,168,0,uint8_t(i)});
+    EXPECT(cache.find({10,0,0,2}) != nullptr);
+  }
+  EXPECT(cache.size() == 4u);
+  EXPECT(cache.find({10,0,0,1}) == nullptr);
+  EXPECT(cache.find({10,0,0,3}) == nullptr);
+  EXPECT(cache.find({10,0,0,2}) != nullptr);
+  EXPECT(cache.evictions() == 256u);
+  EXPECT(cache.generation() != gen);
+}
+
+CASE("Evicting an Arp_cache entry drops its waiting packets")
+{
+  Arp_cache cache{1, 4};
+  auto& ent = cache.insert({10,0,0,1});
+  ent.pending.push_back(create_packet());
+  ent.pending.push_back(create_packet());
+  EXPECT(ent.pending.size() == 2);
+
+  auto& other = cache.insert({10,0,0,2});
+  EXPECT(other.pending.empty());
+  EXPECT(cache.find({10,0,0,1}) == nullptr);
+  EXPECT(cache.size() == 1u);
+
+  int count = 0;
+  cache.for_each([&count] (Arp_cache::Entry& e) {
+      count++;
+      EXPECT(e.ip == ip4::Addr(10,0,0,2));
+    });
+  EXPECT(count == 1);
+}
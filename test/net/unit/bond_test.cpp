@@ -0,0 +1,65 @@
+#include <common.cxx>
+#include <nic_mock.hpp>
+#include <net/bond.hpp>
+
+using namespace net;
+
+static void tcp_frame(uint8_t* frame, uint8_t src, uint16_t sport)
+{
+  std::memset(frame, 0, 54);
+  frame[12] = 0x08;            // IPv4
+  auto* ip = frame + 14;
+  ip[0] = 0x45;
+  ip[9] = 6;                   // TCP
+  const uint8_t addrs[] {10,0,0,src, 10,0,0,1};
+  std::memcpy(ip + 12, addrs, sizeof(addrs));
+  ip[20] = sport >> 8;
+  ip[21] = sport & 0xff;
+  ip[23] = 80;
+}
+
+CASE("A bond spreads flows over its links by their hash")
+{
+  uint8_t frame[54];
+  tcp_frame(frame, 2, 1000);
+  const auto hash = Bond::xmit_hash(frame, sizeof(frame));
+  EXPECT(hash == Bond::xmit_hash(frame, sizeof(frame)));
+
+  // with only the source port changing, the flows use both of two links
+  bool used[2] {};
+  for (uint16_t port = 1000; port < 1016; port++) {
+    tcp_frame(frame, 2, port);
+    used[Bond::xmit_hash(frame, sizeof(frame)) % 2] = true;
+  }
+  EXPECT(used[0]);
+  EXPECT(used[1]);
+
+  // fragments go by the addresses only
+  tcp_frame(frame, 2, 1000);
+  frame[14 + 7] = 1;
+  const auto frag = Bond::xmit_hash(frame, sizeof(frame));
+  tcp_frame(frame, 2, 1001);
+  frame[14 + 7] = 1;
+  EXPECT(frag == Bond::xmit_hash(frame, sizeof(frame)));
+
+  // not IP
+  frame[12] = 0x08;
+  frame[13] = 0x06;
+  EXPECT(Bond::xmit_hash(frame, sizeof(frame)) == 0u);
+}
+
+CASE("A bond looks like one NIC, with what arrives on any link")
+{
+  Nic_mock link0, link1;
+  link1.mac_ = {0xc0,0x00,0x01,0x70,0x00,0x02};
+  Bond bond({&link0, &link1});
+  EXPECT(bond.mac() == link0.mac());
+  EXPECT(bond.MTU() == link0.MTU());
+  EXPECT(bond.transmit_queue_available() == 1024u);
+
+  int received = 0;
+  bond.set_ip4_upstream({[&received] (Packet_ptr, bool) { received++; }});
+  link0.receive(link0.create_packet(0));
+  link1.receive(link1.create_packet(0));
+  EXPECT(received == 2);
+}
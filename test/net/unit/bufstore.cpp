@@ -36,3 +36,56 @@ CASE("Randomly release bufferstore buffers")
     EXPECT(bufstore.available() == BUFFER_CNT * BS_CHAINS);
   }
 }
+
+CASE("BufferStore per-CPU cache recycles buffers locally")
+{
+  BufferStore bufstore(BUFFER_CNT * 4, BUFFER_SZ);
+  EXPECT(bufstore.available() == BUFFER_CNT * 4);
+
+  // first allocation refills the CPU cache in bulk
+  auto* first = bufstore.get_buffer();
+  EXPECT(bufstore.available() == BUFFER_CNT * 4 - 1);
+  EXPECT(bufstore.buffers_in_use() == 1);
+
+  // released buffers are handed out again from the cache, LIFO
+  bufstore.release(first);
+  EXPECT(bufstore.get_buffer() == first);
+  bufstore.release(first);
+
+  // overflowing the cache spills back to the shared free list
+  std::vector<uint8_t*> buffers;
+  for (int i = 0; i < BUFFER_CNT * 4; i++)
+    buffers.push_back(bufstore.get_buffer());
+  EXPECT(bufstore.available() == 0);
+  for (auto* buf : buffers)
+    bufstore.release(buf);
+  EXPECT(bufstore.available() == BUFFER_CNT * 4);
+  EXPECT(bufstore.total_buffers() == BUFFER_CNT * 4);
+
+  EXPECT_THROWS(bufstore.release(first + 1));
+}
+
+CASE("BufferStore ownership checks across grown pools")
+{
+  BufferStore bufstore(BUFFER_CNT, BUFFER_SZ);
+  std::vector<uint8_t*> buffers;
+  // force out several pools
+  for (int num = 0; num < BUFFER_CNT * 4; num++)
+    buffers.push_back(bufstore.get_buffer());
+
+  for (auto* buf : buffers) {
+    EXPECT(bufstore.is_valid(buf));
+    EXPECT_NOT(bufstore.is_valid(buf + 1));
+    EXPECT_NOT(bufstore.is_valid(buf + BUFFER_SZ / 2));
+  }
+  uint8_t outside[BUFFER_SZ];
+  EXPECT_NOT(bufstore.is_valid(outside));
+
+  // bulk release validates everything before releasing anything
+  uint8_t* bad[2] = { buffers[0], outside };
+  EXPECT_THROWS(bufstore.release(bad, 2));
+  EXPECT(bufstore.available() == 0);
+
+  bufstore.release(buffers.data(), buffers.size());
+  EXPECT(bufstore.available() == BUFFER_CNT * 4);
+}
@@ -0,0 +1,106 @@
+#include <common.cxx>
+#include <net/capture.hpp>
+#include <cstring>
+
+using namespace net;
+
+// a frame in a buffer of its own, with @len bytes numbered from @first
+static Packet_ptr frame(int len, uint8_t first = 0)
+{
+  auto* buf = new uint8_t[sizeof(Packet) + 2048];
+  auto* pkt = new (buf) Packet(0, len, 2048, nullptr);
+  for (int i = 0; i < len; i++)
+    pkt->layer_begin()[i] = first + i;
+  return Packet_ptr(pkt);
+}
+
+// the records of a pcap file: original length and first byte
+static std::vector<std::pair<uint32_t, uint8_t>> records(const std::vector<uint8_t>& pcap)
+{
+  std::vector<std::pair<uint32_t, uint8_t>> out;
+  size_t pos = 24;
+  while (pos + 16 <= pcap.size())
+  {
+    uint32_t incl, orig;
+    std::memcpy(&incl, &pcap[pos + 8], 4);
+    std::memcpy(&orig, &pcap[pos + 12], 4);
+    out.push_back({orig, pcap[pos + 16]});
+    pos += 16 + incl;
+  }
+  return out;
+}
+
+CASE("Captured frames are exported as pcap, truncated to the snaplen")
+{
+  Capture capture{8, 64};
+  auto pcap = capture.to_pcap();
+  EXPECT(pcap.size() == 24u);
+  uint32_t magic, snaplen, network;
+  std::memcpy(&magic, &pcap[0], 4);
+  std::memcpy(&snaplen, &pcap[16], 4);
+  std::memcpy(&network, &pcap[20], 4);
+  EXPECT(magic == 0xa1b23c4du);
+  EXPECT(snaplen == 64u);
+  EXPECT(network == 1u);
+
+  auto small = frame(60, 1);
+  small->chain(frame(1000, 2));
+  capture.record(small.get(), Capture::RX);
+  EXPECT(capture.recorded() == 2u);
+
+  pcap = capture.to_pcap();
+  EXPECT(pcap.size() == 24u + 16 + 60 + 16 + 64);
+  const auto recs = records(pcap);
+  EXPECT(recs.size() == 2u);
+  EXPECT(recs[0].first == 60u);
+  EXPECT(recs[0].second == 1);
+  EXPECT(recs[1].first == 1000u);
+  EXPECT(recs[1].second == 2);
+}
+
+CASE("The capture ring keeps the last frames, and frames that pass the filter")
+{
+  Capture capture{4, 32};
+  for (uint8_t i = 0; i < 10; i++) {
+    auto pkt = frame(40, i);
+    capture.record(pkt.get(), Capture::TX);
+  }
+  auto recs = records(capture.to_pcap());
+  EXPECT(recs.size() == 4u);
+  EXPECT(recs.front().second == 6);
+  EXPECT(recs.back().second == 9);
+
+  capture.clear();
+  EXPECT(records(capture.to_pcap()).empty());
+
+  capture.set_filter({[] (const uint8_t* data, size_t, Capture::Direction dir) {
+    return dir == Capture::RX and data[0] % 2 == 0;
+  }});
+  for (uint8_t i = 0; i < 4; i++) {
+    auto pkt = frame(40, i);
+    capture.record(pkt.get(), Capture::RX);
+    capture.record(pkt.get(), Capture::TX);
+  }
+  capture.pause();
+  auto pkt = frame(40, 100);
+  capture.record(pkt.get(), Capture::RX);
+  recs = records(capture.to_pcap());
+  EXPECT(recs.size() == 2u);
+  EXPECT(recs[0].second == 0);
+  EXPECT(recs[1].second == 2);
+}
+
+CASE("The capture port filter matches TCP and UDP in either direction")
+{
+  uint8_t buf[14 + 20 + 8] {};
+  buf[12] = 0x08;
+  buf[14] = 0x45;
+  buf[14 + 9] = 17;
+  buf[34] = 0x1f; buf[35] = 0x90;    // 8080
+  buf[36] = 0x00; buf[37] = 0x35;    // 53
+  EXPECT(Capture::is_port(buf, sizeof(buf), 8080));
+  EXPECT(Capture::is_port(buf, sizeof(buf), 53));
+  EXPECT_NOT(Capture::is_port(buf, sizeof(buf), 80));
+  buf[14 + 9] = 1;
+  EXPECT_NOT(Capture::is_port(buf, sizeof(buf), 53));
+}
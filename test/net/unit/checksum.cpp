@@ -89,3 +89,60 @@ CASE("Verify adjusting checksum")
     EXPECT(csum == *(uint16_t*)buffer);
   }
 }
+
+CASE("Every checksum kernel the CPU supports gives the same checksum")
+{
+  const std::string best = net::checksum_kernel();
+  const auto kernels = net::checksum_kernels();
+  EXPECT(not kernels.empty());
+  EXPECT(best == kernels.front());
+  EXPECT(std::string(kernels.back()) == "scalar");
+  EXPECT_NOT(net::use_checksum_kernel("none"));
+
+  char buffer[2048 + 64];
+  for (size_t i = 0; i < sizeof(buffer); i++)
+    buffer[i] = rand() & 0xff;
+
+  for (const char* name : kernels)
+  {
+    EXPECT(net::use_checksum_kernel(name));
+    EXPECT(std::string(net::checksum_kernel()) == name);
+    // lengths on both sides of every kernel block size, at any alignment
+    bool same = true;
+    for (size_t align = 0; align < 64; align += 7)
+      for (size_t len = 0; len < 300; len++)
+        same = same and safe_checksum(buffer + align, len) == net::checksum(buffer + align, len);
+    same = same and verify(buffer, 2048);
+    EXPECT(same);
+  }
+  EXPECT(net::use_checksum_kernel(best.c_str()));
+}
+
+CASE("Data summed while it is copied checksums like the copy")
+{
+  char src[2048], dst[2048 + 1];
+  for (size_t i = 0; i < sizeof(src); i++)
+    src[i] = rand() & 0xff;
+
+  for (const char* name : net::checksum_kernels())
+  {
+    net::use_checksum_kernel(name);
+    bool same = true;
+    for (size_t len = 1; len < sizeof(src); len += 33)
+    {
+      memset(dst, 0, sizeof(dst));
+      const uint16_t sum = net::copy_and_checksum(dst, src, len);
+      same = same and memcmp(dst, src, len) == 0 and dst[len] == 0;
+      same = same and (uint16_t) ~sum == net::checksum(dst, len);
+    }
+    EXPECT(same);
+
+    // a partial sum, and data copied in after an odd number of bytes
+    const uint16_t head = net::copy_and_checksum(dst, src, 101);
+    const uint16_t rest = net::copy_and_checksum(dst + 101, src + 101, 899);
+    const uint16_t sum  = net::checksum_combine(head, rest, 101);
+    EXPECT((uint16_t) ~sum == net::checksum(src, 1000));
+    EXPECT(net::checksum(sum, src + 1000, 47) == net::checksum(src, 1047));
+  }
+  net::use_checksum_kernel(net::checksum_kernels().front());
+}
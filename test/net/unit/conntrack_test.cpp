@@ -70,6 +70,54 @@ CASE("Testing Conntrack flow")
 
 }
 
+CASE("Testing Conntrack expiry from the timing wheel")
+{
+  using namespace net;
+  const Protocol proto{Protocol::UDP};
+  Socket src{ip4::Addr{10,0,0,42}, 80};
+  Socket dst{ip4::Addr{10,0,0,1}, 1337};
+  Quadruple quad{src, dst};
+  Quadruple rquad = quad; rquad.swap();
+  Quadruple other{{ip4::Addr{10,0,0,43}, 80}, dst};
+
+  Conntrack ct;
+  // more than a lap of the wheel
+  ct.timeout.established.udp = Conntrack::Timeout_duration{3000};
+  const auto NOW = RTC::now();
+
+  int closed = 0;
+  auto* entry = ct.simple_track_in(quad, proto);
+  entry->on_close = [&closed](auto*){ closed++; };
+  ct.simple_track_in(other, proto)->on_close = [&closed](auto*){ closed++; };
+  EXPECT(ct.number_of_entries() == 4);
+
+  // nothing is due yet
+  ct.expire_due(NOW + 5);
+  EXPECT(ct.number_of_entries() == 4);
+
+  // traffic both ways moves the first entry to a slot well ahead
+  ct.confirm(quad, proto);
+  ct.simple_track_in(rquad, proto);
+  EXPECT(entry->state == Conntrack::State::ESTABLISHED);
+
+  // only the unconfirmed entry expires
+  ct.expire_due(NOW + ct.timeout.unconfirmed.udp.count());
+  EXPECT(closed == 1);
+  EXPECT(ct.get(other, proto) == nullptr);
+  EXPECT(ct.get(quad, proto) == entry);
+  EXPECT(ct.number_of_entries() == 2);
+
+  // passing its slot a lap early does not expire it
+  ct.expire_due(NOW + 2000);
+  EXPECT(ct.get(quad, proto) == entry);
+
+  ct.expire_due(NOW + 3000);
+  EXPECT(closed == 2);
+  EXPECT(ct.get(quad, proto) == nullptr);
+  EXPECT(ct.get(rquad, proto) == nullptr);
+  EXPECT(ct.number_of_entries() == 0);
+}
+
 CASE("Testing Conntrack update entry")
 {
   using namespace net;
@@ -192,3 +240,63 @@ CASE("Testing Conntrack serialization")
 
   EXPECT(ct->number_of_entries() == 4);
 }
+
+CASE("Testing Conntrack serialization of many entries")
+{
+  using namespace net;
+  auto ct = std::make_unique<Conntrack>();
+  for(uint16_t port = 1; port <= 1000; port++)
+  {
+    Quadruple quad{{ip4::Addr{10,0,0,42}, port}, {ip4::Addr{10,0,0,1}, 80}};
+    ct->simple_track_in(quad, Protocol::TCP);
+    ct->confirm(quad, Protocol::TCP)->state = Conntrack::State::ESTABLISHED;
+  }
+  EXPECT(ct->number_of_entries() == 2000);
+
+  // appended to what is in the buffer already
+  std::vector<char> buffer(3, 'x');
+  ct->serialize_to(buffer);
+  const auto written = buffer.size() - 3;
+  // much less than the entries take in memory
+  EXPECT(written < 1000 * sizeof(Conntrack::Entry) / 2);
+
+  ct.reset(new Conntrack());
+  EXPECT(written == ct->deserialize_from(buffer.data() + 3));
+  EXPECT(ct->number_of_entries() == 2000);
+
+  Quadruple quad{{ip4::Addr{10,0,0,42}, 500}, {ip4::Addr{10,0,0,1}, 80}};
+  auto* entry = ct->get(quad, Protocol::TCP);
+  EXPECT(entry != nullptr);
+  EXPECT(entry->state == Conntrack::State::ESTABLISHED);
+  EXPECT(ct->get(quad, Protocol::UDP) == nullptr);
+}
+
+CASE("Testing sharded Conntrack")
+{
+  using namespace net;
+  Socket src{ip4::Addr{10,0,0,42}, 80};
+  Socket dst{ip4::Addr{10,0,0,1}, 1337};
+  Quadruple quad{src, dst};
+  Quadruple rquad = quad; rquad.swap();
+
+  // a limit of 8 entries split over 4 shards
+  Conntrack ct(8, 4);
+  EXPECT(ct.shards() == 4);
+
+  // flows seen on this CPU are tracked in its shard
+  auto* entry = ct.simple_track_in(quad, Protocol::UDP);
+  EXPECT(entry != nullptr);
+  EXPECT(ct.confirm(quad, Protocol::UDP) == entry);
+  EXPECT(ct.simple_track_in(rquad, Protocol::UDP) == entry);
+  EXPECT(entry->state == Conntrack::State::ESTABLISHED);
+  EXPECT(ct.number_of_entries() == 2);
+  EXPECT(ct.handoffs() == 0);
+
+  // the shard of this CPU is full
+  EXPECT(ct.simple_track_in(quad, Protocol::TCP) == nullptr);
+
+  entry->timeout = RTC::now();
+  ct.remove_expired();
+  EXPECT(ct.get(quad, Protocol::UDP) == nullptr);
+  EXPECT(ct.number_of_entries() == 0);
+}
@@ -57,3 +57,22 @@ CASE("Create DHCP request")
     //printf("AFT Done = %d\n", done);
   }
 }
+
+CASE("DHCP server keeps the lease indexed")
+{
+  using namespace net::dhcp;
+  auto& client = net::Interfaces::get(1);
+  const auto& pool = dhcp_server->pool();
+  EXPECT(pool.size() == 24u);
+  EXPECT(dhcp_server->available() == 23u);
+  EXPECT(dhcp_server->status(client.ip_addr()) == Status::IN_USE);
+  EXPECT(dhcp_server->status({10,0,0,25}) == Status::IN_USE);
+
+  EXPECT(dhcp_server->records().size() == 1u);
+  const int ridx = dhcp_server->get_record_idx_from_mac(client.link_addr());
+  EXPECT(ridx == 0);
+  EXPECT(dhcp_server->get_record_idx_from_ip(client.ip_addr()) == ridx);
+  const auto& rec = dhcp_server->records().at(ridx);
+  EXPECT(dhcp_server->get_record_idx(rec.client_id()) == ridx);
+  EXPECT(rec.status() == Status::IN_USE);
+}
@@ -0,0 +1,101 @@
+#include <common.cxx>
+#include <net/dns/cache.hpp>
+
+using namespace net;
+using namespace net::dns;
+
+CASE("DNS cache entries live for their TTL")
+{
+  Cache cache;
+  EXPECT(cache.empty());
+  EXPECT(cache.lookup("example.com", 0) == nullptr);
+
+  cache.insert("example.com", ip4::Addr{10,0,0,1}, 60, 100);
+  EXPECT(cache.size() == 1u);
+
+  auto* e = cache.lookup("example.com", 120);
+  EXPECT(e != nullptr);
+  EXPECT(e->address == Addr(ip4::Addr(10,0,0,1)));
+  EXPECT(not e->negative);
+  EXPECT(e->ttl_left(120) == 40u);
+
+  // expired on lookup
+  EXPECT(cache.lookup("example.com", 160) == nullptr);
+  EXPECT(cache.empty());
+
+  // a TTL of zero is not cached
+  cache.insert("example.com", ip4::Addr{10,0,0,1}, 0, 100);
+  EXPECT(cache.empty());
+}
+
+CASE("DNS cache evicts the least recently used")
+{
+  Cache cache{3};
+  cache.insert("a", ip4::Addr{10,0,0,1}, 60, 0);
+  cache.insert("b", ip4::Addr{10,0,0,2}, 60, 0);
+  cache.insert("c", ip4::Addr{10,0,0,3}, 60, 0);
+
+  // a is used, so b is the oldest
+  EXPECT(cache.lookup("a", 1) != nullptr);
+  cache.insert("d", ip4::Addr{10,0,0,4}, 60, 1);
+  EXPECT(cache.size() == 3u);
+  EXPECT(cache.lookup("b", 1) == nullptr);
+  EXPECT(cache.lookup("a", 1) != nullptr);
+  EXPECT(cache.lookup("c", 1) != nullptr);
+  EXPECT(cache.lookup("d", 1) != nullptr);
+
+  // replacing an entry does not evict
+  cache.insert("a", ip4::Addr{10,0,0,5}, 60, 2);
+  EXPECT(cache.size() == 3u);
+  EXPECT(cache.lookup("a", 2)->address == Addr(ip4::Addr(10,0,0,5)));
+
+  // shrinking keeps the capacity
+  EXPECT(cache.shrink(2) == 1u);
+  EXPECT(cache.capacity() == 3u);
+  EXPECT(cache.lookup("c", 2) == nullptr);
+  EXPECT(cache.shrink(2) == 0u);
+
+  cache.set_capacity(1);
+  EXPECT(cache.size() == 1u);
+  EXPECT(cache.lookup("a", 2) != nullptr);
+}
+
+CASE("DNS cache keeps negative entries")
+{
+  Cache cache;
+  cache.insert_negative("nowhere.example", 30, 0);
+  auto* e = cache.lookup("nowhere.example", 10);
+  EXPECT(e != nullptr);
+  EXPECT(e->negative);
+  EXPECT(cache.lookup("nowhere.example", 30) == nullptr);
+
+  // an answer replaces it
+  cache.insert_negative("nowhere.example", 30, 0);
+  cache.insert("nowhere.example", ip4::Addr{10,0,0,1}, 30, 0);
+  EXPECT(not cache.lookup("nowhere.example", 1)->negative);
+}
+
+CASE("DNS cache prefetches popular entries before they expire")
+{
+  Cache cache;
+  cache.insert("popular", ip4::Addr{10,0,0,1}, 100, 0);
+  cache.insert("rare", ip4::Addr{10,0,0,2}, 100, 0);
+
+  for (int i = 0; i < 3; i++)
+  {
+    auto* e = cache.lookup("popular", 10);
+    EXPECT(not cache.prefetch_due(*e, 10));
+  }
+  // in the last tenth of its life
+  auto* e = cache.lookup("popular", 95);
+  EXPECT(cache.prefetch_due(*e, 95));
+  // only once
+  EXPECT(not cache.prefetch_due(*e, 96));
+
+  auto* r = cache.lookup("rare", 95);
+  EXPECT(not cache.prefetch_due(*r, 95));
+
+  EXPECT(cache.expire(99) == 0u);
+  EXPECT(cache.expire(100) == 2u);
+  EXPECT(cache.empty());
+}
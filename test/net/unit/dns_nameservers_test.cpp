@@ -0,0 +1,77 @@
+#include <common.cxx>
+#include <net/dns/nameservers.hpp>
+
+using namespace net;
+using namespace net::dns;
+
+static const Addr ns1{ip4::Addr{10,0,0,1}};
+static const Addr ns2{ip4::Addr{10,0,0,2}};
+static const Addr ns3{ip4::Addr{10,0,0,3}};
+
+CASE("Nameservers are asked in the order set until measured")
+{
+  Nameservers ns;
+  EXPECT(ns.empty());
+  EXPECT(ns.ordered().empty());
+
+  ns.set({ns1, ns2, ns3, ns2});
+  EXPECT(ns.servers().size() == 3u);
+  auto order = ns.ordered();
+  EXPECT(order.size() == 3u);
+  EXPECT(order[0] == ns1);
+  EXPECT(order[1] == ns2);
+  EXPECT(order[2] == ns3);
+}
+
+CASE("Nameservers prefer the fastest to answer")
+{
+  Nameservers ns;
+  ns.set({ns1, ns2, ns3});
+
+  for (int i = 0; i < 20; i++)
+  {
+    ns.answered(ns1, 80);
+    ns.answered(ns2, 10);
+    ns.answered(ns3, 40);
+  }
+  auto order = ns.ordered();
+  EXPECT(order[0] == ns2);
+  EXPECT(order[1] == ns3);
+  EXPECT(order[2] == ns1);
+
+  // hedging after about twice the round trip time
+  EXPECT(ns.hedge_delay(ns2) < 40u);
+  EXPECT(ns.hedge_delay(ns2) >= Nameservers::MIN_HEDGE);
+
+  // not answering pushes it back
+  ns.timed_out(ns2);
+  ns.timed_out(ns2);
+  ns.timed_out(ns2);
+  EXPECT(ns.ordered().back() == ns2);
+}
+
+CASE("Nameservers hedge within bounds")
+{
+  Nameservers ns;
+  ns.set({ns1});
+  EXPECT(ns.hedge_delay(ns1) == 2 * Nameservers::INITIAL_RTT);
+
+  for (int i = 0; i < 10; i++)
+    ns.timed_out(ns1);
+  EXPECT(ns.servers()[0].srtt == Nameservers::MAX_RTT);
+  EXPECT(ns.hedge_delay(ns1) == Nameservers::DEFAULT_HEDGE);
+
+  ns.set_max_hedge_delay(1000);
+  EXPECT(ns.hedge_delay(ns1) == 1000u);
+}
+
+CASE("Nameservers only use the family of the first")
+{
+  Nameservers ns;
+  const Addr ns6{ip6::Addr{0xfe80, 0, 0, 0, 0, 0, 0, 1}};
+  ns.set({ns1, ns6, ns2});
+  auto order = ns.ordered();
+  EXPECT(order.size() == 2u);
+  EXPECT(order[0] == ns1);
+  EXPECT(order[1] == ns2);
+}
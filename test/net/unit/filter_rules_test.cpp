@@ -0,0 +1,201 @@
+
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/ip4/ip4.hpp>
+#include <net/filter_rules.hpp>
+#include <random>
+
+using namespace net;
+
+using Rule4 = Filter_rule<IP4>;
+
+CASE("Filter rules match on address, protocol and port")
+{
+  Filter_rules<IP4> rules{"test.rules", {
+    Rule4{}.from({10,0,0,0}, 8).protocol(Protocol::TCP).dport(22).accept(),
+    Rule4{}.protocol(Protocol::TCP).dport(20, 25).drop(),
+    Rule4{}.to({192,168,1,0}, 24).protocol(Protocol::UDP).accept(),
+    Rule4{}.protocol(Protocol::UDP).drop()
+  }};
+  EXPECT(rules.rules().size() == 4u);
+
+  auto ssh = create_tcp_packet_init({{10,1,2,3}, 5000}, {{10,0,0,1}, 22});
+  EXPECT(rules.classify(*ssh, nullptr) == 0);
+
+  auto ssh_out = create_tcp_packet_init({{11,1,2,3}, 5000}, {{10,0,0,1}, 22});
+  EXPECT(rules.classify(*ssh_out, nullptr) == 1);
+
+  auto http = create_tcp_packet_init({{10,1,2,3}, 5000}, {{10,0,0,1}, 80});
+  EXPECT(rules.classify(*http, nullptr) == -1);
+
+  auto dns = create_udp_packet_init({{10,1,2,3}, 5000}, {{192,168,1,1}, 53});
+  EXPECT(rules.classify(*dns, nullptr) == 2);
+
+  auto other = create_udp_packet_init({{10,1,2,3}, 5000}, {{192,168,2,1}, 53});
+  EXPECT(rules.classify(*other, nullptr) == 3);
+
+  // ICMP has no ports, so only rules without port ranges match
+  auto icmp = create_ip4_packet_init({10,1,2,3}, {10,0,0,1});
+  icmp->set_protocol(Protocol::ICMPv4);
+  Filter_rules<IP4> any_port{"test.anyport", {
+    Rule4{}.dport(0, 0xfffe).drop(),
+    Rule4{}.from({10,1,2,3}, 32).accept()
+  }};
+  EXPECT(any_port.classify(*icmp, nullptr) == 1);
+}
+
+CASE("Filter rules return verdicts and count hits")
+{
+  Filter_rules<IP4> rules{"test.verdicts", {
+    Rule4{}.protocol(Protocol::TCP).dport(22).accept(),
+    Rule4{}.protocol(Protocol::TCP).drop()
+  }, Filter_verdict_type::ACCEPT};
+
+  Filter_chain<IP4> chain{"test", {rules.filter()}};
+  Inet& stack = *(Inet*) 1;
+
+  auto verdict = chain(create_tcp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 22}), stack, nullptr);
+  EXPECT(verdict == Filter_verdict_type::ACCEPT);
+  verdict = chain(create_tcp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 80}), stack, nullptr);
+  EXPECT(verdict == Filter_verdict_type::DROP);
+  verdict = chain(create_tcp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 81}), stack, nullptr);
+  EXPECT(verdict == Filter_verdict_type::DROP);
+  verdict = chain(create_udp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 81}), stack, nullptr);
+  EXPECT(verdict == Filter_verdict_type::ACCEPT);
+
+  EXPECT(rules.hits(0) == 1u);
+  EXPECT(rules.hits(1) == 2u);
+
+  // recompiling keeps the counters of existing rules
+  rules.add(Rule4{}.protocol(Protocol::UDP).drop());
+  rules.compile();
+  verdict = chain(create_udp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 81}), stack, nullptr);
+  EXPECT(verdict == Filter_verdict_type::DROP);
+  EXPECT(rules.hits(1) == 2u);
+  EXPECT(rules.hits(2) == 1u);
+}
+
+CASE("Filter rules match on conntrack state")
+{
+  Conntrack ct;
+  auto pkt = create_tcp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 80});
+  auto* entry = ct.in(*pkt);
+  EXPECT(entry != nullptr);
+  EXPECT(entry->state == Conntrack::State::UNCONFIRMED);
+
+  Filter_rules<IP4> rules{"test.states", {
+    Rule4{}.states(Rule4::ESTABLISHED | Rule4::RELATED).accept(),
+    Rule4{}.states(Rule4::UNTRACKED).drop(),
+    Rule4{}.states(Rule4::NEW | Rule4::UNCONFIRMED).accept()
+  }};
+  EXPECT(rules.classify(*pkt, entry) == 2);
+  EXPECT(rules.classify(*pkt, nullptr) == 1);
+
+  entry->state = Conntrack::State::ESTABLISHED;
+  EXPECT(rules.classify(*pkt, entry) == 0);
+}
+
+CASE("Filter rules agree with matching every rule in order")
+{
+  std::mt19937 rng(42);
+  std::vector<Rule4> list;
+  for (int i = 0; i < 300; i++)
+  {
+    Rule4 rule;
+    if (rng() % 2) rule.from(ip4::Addr{10, uint8_t(rng() % 4), uint8_t(rng() % 4), 0}, 8 + rng() % 17);
+    if (rng() % 2) rule.to(ip4::Addr{10, uint8_t(rng() % 4), 0, 0}, 8 + rng() % 9);
+    if (rng() % 2) rule.protocol(rng() % 2 ? Protocol::TCP : Protocol::UDP);
+    if (rng() % 2) {
+      const uint16_t lo = rng() % 1024;
+      rule.dport(lo, lo + rng() % 64);
+    }
+    rule.verdict = (rng() % 2) ? Filter_verdict_type::ACCEPT : Filter_verdict_type::DROP;
+    list.push_back(rule);
+  }
+  Filter_rules<IP4> rules{"test.random"};
+  for (auto& rule : list) rules.add(rule);
+  rules.compile();
+
+  auto in_prefix = [] (ip4::Addr addr, ip4::Addr net, int len) {
+    const uint32_t mask = len ? ~0u << (32 - len) : 0;
+    return ((ntohl(addr.whole) ^ ntohl(net.whole)) & mask) == 0;
+  };
+
+  for (int i = 0; i < 2000; i++)
+  {
+    const ip4::Addr src{10, uint8_t(rng() % 4), uint8_t(rng() % 4), uint8_t(rng())};
+    const ip4::Addr dst{10, uint8_t(rng() % 4), uint8_t(rng() % 4), uint8_t(rng())};
+    const uint16_t dport = rng() % 1100;
+    const bool tcp = rng() % 2;
+    std::unique_ptr<PacketIP4> pkt;
+    if (tcp) pkt = create_tcp_packet_init({src, 1000}, {dst, dport});
+    else     pkt = create_udp_packet_init({src, 1000}, {dst, dport});
+
+    int expected = -1;
+    for (size_t r = 0; r < list.size() and expected < 0; r++)
+    {
+      const auto& rule = list[r];
+      if (rule.src_prefix and not in_prefix(src, rule.src, rule.src_prefix)) continue;
+      if (rule.dst_prefix and not in_prefix(dst, rule.dst, rule.dst_prefix)) continue;
+      if (not rule.any_proto and rule.proto != pkt->ip_protocol()) continue;
+      if (dport < rule.dst_port.min or dport > rule.dst_port.max) continue;
+      expected = r;
+    }
+    EXPECT(rules.classify(*pkt, nullptr) == expected);
+  }
+}
+
+CASE("Established connections skip chains with a fast path")
+{
+  Conntrack ct;
+  auto pkt = create_tcp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 80});
+  auto* entry = ct.in(*pkt);
+  Inet& stack = *(Inet*) 1;
+
+  static int calls = 0;
+  static Filter_verdict_type decision = Filter_verdict_type::ACCEPT;
+  Filter_chain<IP4> chain{"fast", {
+    [] (IP4::IP_packet_ptr p, Inet&, Conntrack::Entry_ptr) -> Filter_verdict<IP4> {
+      calls++;
+      return {std::move(p), decision};
+    }
+  }};
+  auto run = [&] {
+    auto res = chain(create_tcp_packet_init({{10,0,0,1}, 5000}, {{10,0,0,2}, 80}), stack, entry);
+    return res.verdict;
+  };
+
+  // disabled by default
+  entry->state = Conntrack::State::ESTABLISHED;
+  run(); run();
+  EXPECT(calls == 2);
+
+  EXPECT(chain.enable_fast_path());
+  EXPECT(chain.fast_path());
+  run(); run();
+  EXPECT(calls == 3);
+
+  // unestablished connections always run the filters
+  entry->state = Conntrack::State::NEW;
+  run();
+  EXPECT(calls == 4);
+  entry->state = Conntrack::State::ESTABLISHED;
+
+  // a new ruleset generation runs the filters again
+  decision = Filter_verdict_type::DROP;
+  filter_ruleset_changed();
+  EXPECT(run() == Filter_verdict_type::DROP);
+  EXPECT(run() == Filter_verdict_type::DROP);
+  EXPECT(calls == 6);
+
+  // adding a filter is noticed without a new generation
+  decision = Filter_verdict_type::ACCEPT;
+  filter_ruleset_changed();
+  run(); run();
+  EXPECT(calls == 7);
+  chain.chain.push_back([] (IP4::IP_packet_ptr p, Inet&, Conntrack::Entry_ptr) -> Filter_verdict<IP4> {
+      return {std::move(p), Filter_verdict_type::DROP};
+    });
+  EXPECT(run() == Filter_verdict_type::DROP);
+  EXPECT(calls == 8);
+}
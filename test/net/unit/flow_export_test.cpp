@@ -0,0 +1,172 @@
+
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/flow_export.hpp>
+#include <cstring>
+
+using namespace net;
+
+static uint16_t read16(const uint8_t* p)
+{ uint16_t v; std::memcpy(&v, p, 2); return ntohs(v); }
+static uint32_t read32(const uint8_t* p)
+{ uint32_t v; std::memcpy(&v, p, 4); return ntohl(v); }
+static uint64_t read64(const uint8_t* p)
+{ uint64_t v; std::memcpy(&v, p, 8); return ntohll(v); }
+
+using Messages = std::vector<std::vector<uint8_t>>;
+
+// the data records of a message, as (template, record) pairs
+static std::vector<std::pair<uint16_t, const uint8_t*>> records_of(const std::vector<uint8_t>& msg)
+{
+  std::vector<std::pair<uint16_t, const uint8_t*>> records;
+  size_t pos = 16;
+  while (pos < msg.size())
+  {
+    const auto id  = read16(&msg[pos]);
+    const auto len = read16(&msg[pos + 2]);
+    if (id >= 256) {
+      const size_t size = (id == Flow_exporter::TEMPLATE_IP4) ? 38 : 62;
+      for (size_t rec = pos + 4; rec + size <= pos + len; rec += size)
+        records.emplace_back(id, &msg[rec]);
+    }
+    pos += len;
+  }
+  return records;
+}
+
+CASE("Conntrack counts the packets of each direction of a flow")
+{
+  Conntrack ct;
+  const Socket client{ip4::Addr{10,0,0,1}, 32222};
+  const Socket server{ip4::Addr{10,0,0,42}, 53};
+
+  auto request = create_udp_packet_init(client, server);
+  request->set_data_length(20);
+  auto* entry = ct.in(*request);
+  EXPECT(entry != nullptr);
+  ct.in(*request);
+  auto reply = create_udp_packet_init(server, client);
+  reply->set_data_length(100);
+  EXPECT(ct.in(*reply) == entry);
+
+  EXPECT(entry->packets[0] == 2u);
+  EXPECT(entry->bytes[0] == 2 * request->size());
+  EXPECT(entry->packets[1] == 1u);
+  EXPECT(entry->bytes[1] == reply->size());
+  EXPECT(entry->first_seen != 0u);
+  EXPECT(entry->last_seen >= entry->first_seen);
+}
+
+CASE("Flow_exporter exports active and expired flows as IPFIX")
+{
+  Conntrack ct;
+  Messages sent;
+  Flow_exporter flows{ct, [&sent] (const uint8_t* data, size_t len) {
+    sent.emplace_back(data, data + len);
+  }, 1, 7};
+
+  const Protocol proto{Protocol::UDP};
+  const Quadruple quad{{ip4::Addr{10,0,0,1}, 32222}, {ip4::Addr{10,0,0,42}, 53}};
+  auto* entry = ct.simple_track_in(quad, proto);
+  entry->packets[0] = 3; entry->bytes[0] = 300;
+  entry->packets[1] = 1; entry->bytes[1] = 60;
+  // a flow without replies gets one record
+  auto* other = ct.simple_track_in({{ip4::Addr{10,0,0,2}, 1000}, {ip4::Addr{10,0,0,42}, 53}}, proto);
+  other->packets[0] = 1; other->bytes[0] = 40;
+
+  flows.export_active();
+  EXPECT(sent.empty());
+  flows.flush();
+  EXPECT(sent.size() == 1u);
+  EXPECT(flows.records() == 3u);
+
+  const auto& msg = sent[0];
+  EXPECT(read16(&msg[0]) == 10);
+  EXPECT(read16(&msg[2]) == msg.size());
+  EXPECT(read32(&msg[8]) == 0u);
+  EXPECT(read32(&msg[12]) == 7u);
+  // the templates come first
+  EXPECT(read16(&msg[16]) == 2);
+  EXPECT(read16(&msg[20]) == Flow_exporter::TEMPLATE_IP4);
+  EXPECT(read16(&msg[22]) == 10);
+
+  auto records = records_of(msg);
+  EXPECT(records.size() == 3u);
+  int found = 0;
+  for (auto& [tmpl, rec] : records)
+  {
+    EXPECT(tmpl == Flow_exporter::TEMPLATE_IP4);
+    EXPECT(rec[12] == (uint8_t) Protocol::UDP);
+    EXPECT(rec[13] == Flow_exporter::ACTIVE);
+    if (read16(&rec[8]) == 32222) {
+      EXPECT(read16(&rec[10]) == 53);
+      EXPECT(read64(&rec[14]) == 3u);
+      EXPECT(read64(&rec[22]) == 300u);
+      found++;
+    }
+    else if (read16(&rec[8]) == 53) {
+      EXPECT(read16(&rec[10]) == 32222);
+      const auto addr = quad.dst.address().v4().whole;
+      EXPECT(std::memcmp(&rec[0], &addr, 4) == 0);
+      EXPECT(read64(&rec[14]) == 1u);
+      EXPECT(read64(&rec[22]) == 60u);
+      found++;
+    }
+  }
+  EXPECT(found == 2);
+
+  // the flows expire, and are exported once more
+  sent.clear();
+  entry->timeout = RTC::now();
+  other->timeout = RTC::now();
+  ct.remove_expired();
+  EXPECT(ct.number_of_entries() == 0u);
+  flows.flush();
+  EXPECT(sent.size() == 1u);
+  EXPECT(read32(&sent[0][8]) == 3u);
+  records = records_of(sent[0]);
+  EXPECT(records.size() == 3u);
+  for (auto& [tmpl, rec] : records)
+    EXPECT(rec[13] == Flow_exporter::IDLE);
+}
+
+CASE("Flow_exporter samples flows, and drops records it can't keep")
+{
+  Conntrack ct;
+  Messages sent;
+  Flow_exporter flows{ct, [&sent] (const uint8_t* data, size_t len) {
+    sent.emplace_back(data, data + len);
+  }, 4};
+
+  const int FLOWS = 400;
+  int sampled = 0;
+  for (int i = 0; i < FLOWS; i++)
+  {
+    auto* ent = ct.simple_track_in({{ip4::Addr{10,0,1,(uint8_t) i}, (uint16_t) (1000 + i)},
+                                    {ip4::Addr{10,0,0,42}, 80}}, Protocol::TCP);
+    ent->packets[0] = 1;
+    if (flows.sampled(*ent)) sampled++;
+  }
+  // about one in four
+  EXPECT(sampled > FLOWS / 8);
+  EXPECT(sampled < FLOWS / 2);
+
+  flows.export_active();
+  flows.flush();
+  size_t records = 0;
+  for (auto& msg : sent) {
+    EXPECT(msg.size() <= Flow_exporter::MAX_MESSAGE);
+    records += records_of(msg).size();
+  }
+  EXPECT(records == (size_t) sampled);
+  EXPECT(flows.records() == (uint64_t) sampled);
+
+  // with room for one message, the rest is dropped
+  sent.clear();
+  flows.max_messages = 1;
+  flows.export_active();
+  flows.flush();
+  EXPECT(sent.size() == 1u);
+  EXPECT(flows.dropped() > 0u);
+  EXPECT(records_of(sent[0]).size() + flows.dropped() == (size_t) sampled);
+}
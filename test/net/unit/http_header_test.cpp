@@ -1,6 +1,9 @@
 
 #include <common.cxx>
 #include <net/http/header.hpp>
+#include <util/units.hpp>
+
+using namespace util::literals;
 
 CASE("Header::Header() constructs an empty header with capacity 25")
 {
@@ -97,3 +100,54 @@ CASE("Headers can be streamed")
   ss << header;
   EXPECT(ss.str().size() > 15);
 }
+
+CASE("Header::set_field_view() sets fields as views into a buffer")
+{
+  std::string buf = "Host" "example.org" "X-Custom" "foo" "content-length" "42";
+  http::Header header;
+  header.set_base(buf.data());
+  const util::sview data{buf};
+  EXPECT(header.set_field_view(data.substr(0, 4), data.substr(4, 11)));
+  EXPECT(header.set_field_view(data.substr(15, 8), data.substr(23, 3)));
+  EXPECT(header.set_field_view(data.substr(26, 14), data.substr(40, 2)));
+  EXPECT(header.size() == 3u);
+  EXPECT(header.value("host") == "example.org");
+  EXPECT(header.value("x-custom") == "foo");
+  EXPECT(header.content_length() == 42u);
+  EXPECT(header.has_field("Accept") == false);
+
+  // moving the buffer only needs a rebase
+  std::string copy = buf;
+  header.set_base(copy.data());
+  buf.assign(buf.size(), '-');
+  EXPECT(header.value("Host") == "example.org");
+
+  // an owned value replaces the view
+  EXPECT(header.set_field("Host", "example.com"));
+  EXPECT(header.size() == 3u);
+  EXPECT(header.value("Host") == "example.com");
+
+  header.erase("X-Custom");
+  EXPECT(header.size() == 2u);
+  EXPECT(header.has_field("X-Custom") == false);
+  EXPECT(header.content_length() == 42u);
+
+  header.clear();
+  EXPECT(header.is_empty());
+}
+
+CASE("Header views are allocated from the given resource, and copies keep the limit")
+{
+  os::mem::Pmr_pool pool{64_KiB, 4_KiB};
+  auto res = pool.get_resource();
+  const std::string buf {"Host: a\r\nAccept: b\r\n"};
+  http::Header header{2, res.get()};
+  header.set_base(buf.data());
+  EXPECT(header.set_field_view({buf.data(), 4}, {buf.data() + 6, 1}));
+  EXPECT(res->allocated() > 0u);
+  EXPECT(header.set_field_view({buf.data() + 9, 6}, {buf.data() + 17, 1}));
+
+  http::Header copy{header};
+  EXPECT(copy.value("accept") == "b");
+  EXPECT(not copy.add_field("X-Too-Many", "c"));
+}
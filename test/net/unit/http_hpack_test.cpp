@@ -0,0 +1,101 @@
+#include <common.cxx>
+#include <net/http/hpack.hpp>
+
+using namespace http::hpack;
+
+static std::string from_hex(const char* hex)
+{
+  std::string out;
+  for (const char* p = hex; p[0] and p[1]; p += 2) {
+    if (*p == ' ') { --p; continue; }
+    out += (char) std::stoul(std::string(p, 2), nullptr, 16);
+  }
+  return out;
+}
+
+static bool decode(Decoder& dec, const std::string& block, Header_list& out)
+{
+  return dec.decode((const uint8_t*) block.data(), block.size(), out);
+}
+
+CASE("HPACK integers are encoded with a prefix (RFC 7541 C.1)")
+{
+  std::string out;
+  encode_integer(out, 0, 5, 10);
+  EXPECT(out == from_hex("0a"));
+  out.clear();
+  encode_integer(out, 0, 5, 1337);
+  EXPECT(out == from_hex("1f9a0a"));
+
+  uint32_t value = 0;
+  const uint8_t* p = (const uint8_t*) out.data();
+  EXPECT(decode_integer(p, p + out.size(), 5, value));
+  EXPECT(value == 1337u);
+
+  // overflowing is an error
+  const auto big = from_hex("1fffffffff7f");
+  p = (const uint8_t*) big.data();
+  EXPECT(not decode_integer(p, p + big.size(), 5, value));
+}
+
+CASE("HPACK decodes Huffman coded requests (RFC 7541 C.4)")
+{
+  Decoder dec;
+  Header_list fields;
+  EXPECT(decode(dec, from_hex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), fields));
+  EXPECT(fields.size() == 4u);
+  EXPECT(fields[0] == Field(":method", "GET"));
+  EXPECT(fields[1] == Field(":scheme", "http"));
+  EXPECT(fields[2] == Field(":path", "/"));
+  EXPECT(fields[3] == Field(":authority", "www.example.com"));
+
+  // from the dynamic table
+  fields.clear();
+  EXPECT(decode(dec, from_hex("828684be5886a8eb10649cbf"), fields));
+  EXPECT(fields.size() == 5u);
+  EXPECT(fields[3] == Field(":authority", "www.example.com"));
+  EXPECT(fields[4] == Field("cache-control", "no-cache"));
+
+  fields.clear();
+  EXPECT(decode(dec, from_hex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), fields));
+  EXPECT(fields.size() == 5u);
+  EXPECT(fields[1] == Field(":scheme", "https"));
+  EXPECT(fields[2] == Field(":path", "/index.html"));
+  EXPECT(fields[3] == Field(":authority", "www.example.com"));
+  EXPECT(fields[4] == Field("custom-key", "custom-value"));
+}
+
+CASE("HPACK refuses malformed blocks")
+{
+  Decoder dec;
+  Header_list fields;
+  // index out of range
+  EXPECT(not decode(dec, from_hex("ff00"), fields));
+  // truncated string
+  EXPECT(not decode(dec, from_hex("400a637573"), fields));
+  // table size above the limit
+  EXPECT(not decode(dec, from_hex("3fe21f"), fields));
+}
+
+CASE("HPACK encodes what it decodes")
+{
+  std::string block;
+  Encoder::encode(":status", "200", block);
+  EXPECT(block == from_hex("88"));
+  Encoder::encode(":status", "201", block);
+  Encoder::encode("content-type", "text/html", block);
+  Encoder::encode("x-powered-by", "IncludeOS", block);
+
+  Decoder dec;
+  Header_list fields;
+  EXPECT(decode(dec, block, fields));
+  EXPECT(fields.size() == 4u);
+  EXPECT(fields[0] == Field(":status", "200"));
+  EXPECT(fields[1] == Field(":status", "201"));
+  EXPECT(fields[2] == Field("content-type", "text/html"));
+  EXPECT(fields[3] == Field("x-powered-by", "IncludeOS"));
+
+  std::string huff;
+  huffman_encode("www.example.com", huff);
+  EXPECT(huff == from_hex("f1e3c2e5f23a6ba0ab90f4ff"));
+}
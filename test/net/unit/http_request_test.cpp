@@ -118,3 +118,34 @@ CASE("operator std::string converts request to string")
   std::string s = r;
   EXPECT(s.size() > 30);
 }
+
+CASE("Requests of the usual kind and the unusual are parsed alike")
+{
+  const std::string long_value(100, 'v');
+  http::Request usual("GET /some/path/past/a/block?q=1 HTTP/1.1\r\n"
+                      "Host:  www.includeos.org \r\nX-Long: " + long_value + "\r\n\r\n");
+  // bare LF line endings are left to http_parser
+  http::Request unusual("GET /some/path/past/a/block?q=1 HTTP/1.1\n"
+                        "Host: www.includeos.org\nX-Long: " + long_value + "\n\n");
+  for (auto* r : {&usual, &unusual})
+  {
+    EXPECT(r->method() == http::GET);
+    EXPECT(r->uri() == uri::URI("/some/path/past/a/block?q=1"));
+    EXPECT(r->version().to_string() == "HTTP/1.1");
+    EXPECT(r->header().value("Host") == "www.includeos.org");
+    EXPECT(r->header().value("X-Long") == long_value);
+    EXPECT(r->headers_complete());
+  }
+
+  // a body of the length given, or the start of it
+  http::Request post("POST /form HTTP/1.1\r\nContent-Length: 10\r\n\r\nname=value");
+  EXPECT(post.body() == "name=value");
+  http::Request partial("POST /form HTTP/1.1\r\nContent-Length: 1000\r\n\r\nname=");
+  EXPECT(partial.body() == "name=");
+  // in chunks
+  http::Request chunked("POST /form HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                        "a\r\nname=value\r\n0\r\n\r\n");
+  EXPECT(chunked.body() == "name=value");
+
+  EXPECT_THROWS(http::Request("GET / HTTP/1.1\r\nHost: a\x01" "b\r\n\r\n"));
+}
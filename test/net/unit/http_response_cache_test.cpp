@@ -0,0 +1,92 @@
+#include <common.cxx>
+#include <net/http/response_cache.hpp>
+
+using namespace http;
+
+static Request get(std::string path, std::string extra = "")
+{
+  return Request{"GET " + path + " HTTP/1.1\r\nHost: example.org\r\n" + extra + "\r\n"};
+}
+
+static Response response(std::string fields, std::string body = "hello")
+{
+  return Response{"HTTP/1.1 200 OK\r\n" + fields
+                  + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body};
+}
+
+CASE("Response_cache::lifetime() reads Cache-Control and Expires")
+{
+  const std::time_t now = 1552576166; // Thu, 14 Mar 2019 15:09:26 GMT
+  EXPECT(Response_cache::lifetime(response(""), now) == -1);
+  EXPECT(Response_cache::lifetime(response("Cache-Control: max-age=60\r\n"), now) == 60);
+  EXPECT(Response_cache::lifetime(response("Cache-Control: public, max-age=60, s-maxage=10\r\n"), now) == 10);
+  EXPECT(Response_cache::lifetime(response("Cache-Control: no-cache\r\n"), now) == 0);
+  EXPECT(Response_cache::lifetime(response("Cache-Control: private, max-age=60\r\n"), now) == -1);
+  EXPECT(Response_cache::lifetime(response("Cache-Control: no-store\r\n"), now) == -1);
+  EXPECT(Response_cache::lifetime(response("Cache-Control: max-age=x\r\n"), now) == -1);
+  EXPECT(Response_cache::lifetime(
+    response("Date: Thu, 14 Mar 2019 15:09:26 GMT\r\nExpires: Thu, 14 Mar 2019 15:10:26 GMT\r\n"), now) == 60);
+  EXPECT(Response_cache::lifetime(response("Expires: 0\r\n"), now) == 0);
+}
+
+CASE("Response_cache::cacheable() only takes GET and HEAD for everyone")
+{
+  EXPECT(Response_cache::cacheable(get("/")));
+  EXPECT(not Response_cache::cacheable(get("/", "Authorization: Basic Zm9vOmJhcg==\r\n")));
+  EXPECT(not Response_cache::cacheable(get("/", "Cache-Control: no-store\r\n")));
+  EXPECT(not Response_cache::cacheable(Request{"POST / HTTP/1.1\r\nHost: example.org\r\n\r\n"}));
+}
+
+CASE("Response_cache stores what it may, by Vary")
+{
+  Response_cache cache;
+  EXPECT(not cache.store(get("/none"), response("")));
+  EXPECT(not cache.store(get("/cookie"), response("Cache-Control: max-age=60\r\nSet-Cookie: a=b\r\n")));
+  EXPECT(not cache.store(get("/any"), response("Cache-Control: max-age=60\r\nVary: *\r\n")));
+  EXPECT(cache.entries() == 0u);
+
+  EXPECT(cache.store(get("/a"), response("Cache-Control: max-age=60\r\nETag: \"1\"\r\n")));
+  const auto* entry = cache.find(get("/a"));
+  EXPECT(entry != nullptr);
+  EXPECT(entry->status == OK);
+  EXPECT(entry->etag == "\"1\"");
+  EXPECT(entry->expires - entry->stored == 60);
+  EXPECT(std::string(entry->body->begin(), entry->body->end()) == "hello");
+  EXPECT(cache.find(get("/b")) == nullptr);
+
+  // one entry per language
+  EXPECT(cache.store(get("/v", "Accept-Language: en\r\n"),
+                     response("Cache-Control: max-age=60\r\nVary: Accept-Language\r\n", "hello")));
+  EXPECT(cache.store(get("/v", "Accept-Language: nb\r\n"),
+                     response("Cache-Control: max-age=60\r\nVary: Accept-Language\r\n", "hei")));
+  EXPECT(cache.entries() == 3u);
+  entry = cache.find(get("/v", "Accept-Language: nb\r\n"));
+  EXPECT(entry != nullptr);
+  EXPECT(std::string(entry->body->begin(), entry->body->end()) == "hei");
+  EXPECT(cache.find(get("/v", "Accept-Language: de\r\n")) == nullptr);
+
+  cache.erase(get("/v"));
+  EXPECT(cache.entries() == 1u);
+  cache.clear();
+  EXPECT(cache.entries() == 0u);
+  EXPECT(cache.bytes() == 0u);
+}
+
+CASE("Response_cache evicts the least recently used")
+{
+  const std::string body(1000, 'x');
+  const auto one = Response_cache::Entry{OK, {}, net::tcp::construct_buffer(body.begin(), body.end()),
+                                         {}, 0, 0}.bytes();
+  Response_cache cache{one * 4 + 500};
+  const auto res = response("Cache-Control: max-age=60\r\n", body);
+  for (int i = 0; i < 4; i++)
+    EXPECT(cache.store(get("/" + std::to_string(i)), res));
+  EXPECT(cache.entries() == 4u);
+
+  // the first one stored goes first
+  EXPECT(cache.store(get("/4"), res));
+  EXPECT(cache.entries() == 4u);
+  EXPECT(cache.find(get("/0")) == nullptr);
+  EXPECT(cache.find(get("/1")) != nullptr);
+  EXPECT(cache.bytes() <= cache.capacity());
+}
@@ -0,0 +1,62 @@
+#include <common.cxx>
+#include <net/http/response_compressor.hpp>
+#include <net/ws/deflate.hpp>
+#include <util/crc32.hpp>
+
+using namespace http;
+using Coding = Response_compressor::Coding;
+
+CASE("Response_compressor::negotiate() picks the coding the client prefers")
+{
+  EXPECT(Response_compressor::negotiate("gzip, deflate, br") == Coding::GZIP);
+  EXPECT(Response_compressor::negotiate("deflate") == Coding::DEFLATE);
+  EXPECT(Response_compressor::negotiate("deflate;q=1, gzip;q=0.5") == Coding::DEFLATE);
+  EXPECT(Response_compressor::negotiate("gzip;q=0, *") == Coding::DEFLATE);
+  EXPECT(Response_compressor::negotiate("*;q=0.1") == Coding::GZIP);
+  EXPECT(Response_compressor::negotiate("x-gzip") == Coding::GZIP);
+  EXPECT(Response_compressor::negotiate("") == Coding::IDENTITY);
+  EXPECT(Response_compressor::negotiate("identity, br") == Coding::IDENTITY);
+  EXPECT(Response_compressor::negotiate("gzip;q=0.000, deflate;q=0") == Coding::IDENTITY);
+}
+
+CASE("Response_compressor::compressible() takes text, JSON and the like")
+{
+  EXPECT(Response_compressor::compressible("application/json"));
+  EXPECT(Response_compressor::compressible("application/ld+json; charset=utf-8"));
+  EXPECT(Response_compressor::compressible("text/html"));
+  EXPECT(Response_compressor::compressible("image/svg+xml"));
+  EXPECT(Response_compressor::compressible("application/javascript"));
+  EXPECT(not Response_compressor::compressible("image/png"));
+  EXPECT(not Response_compressor::compressible("application/octet-stream"));
+  EXPECT(not Response_compressor::compressible(""));
+}
+
+CASE("Response_compressor::compress() makes gzip and zlib streams")
+{
+  std::string json;
+  for (int i = 0; i < 2000; i++)
+    json += "{\"id\": " + std::to_string(i) + ", \"name\": \"item\"},";
+  const auto* data = (const uint8_t*) json.data();
+
+  auto gz = Response_compressor::compress(Coding::GZIP, data, json.size());
+  EXPECT(gz->size() < json.size() / 4);
+  EXPECT(gz->at(0) == 0x1f);
+  EXPECT(gz->at(1) == 0x8b);
+  // the DEFLATE data between the header and the trailer
+  std::vector<uint8_t> out;
+  net::WS_inflater inflater;
+  EXPECT(inflater.decompress(gz->data() + 10, gz->size() - 18, out, true));
+  EXPECT(std::string(out.begin(), out.end()) == json);
+  const auto* trailer = gz->data() + gz->size() - 8;
+  const uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | (uint32_t(trailer[3]) << 24);
+  const uint32_t len = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | (uint32_t(trailer[7]) << 24);
+  EXPECT(crc == crc32(json.data(), json.size()));
+  EXPECT(len == json.size());
+
+  auto zl = Response_compressor::compress(Coding::DEFLATE, data, json.size());
+  EXPECT(zl->at(0) == 0x78);
+  EXPECT((zl->at(0) * 256 + zl->at(1)) % 31 == 0);
+  out.clear();
+  EXPECT(inflater.decompress(zl->data() + 2, zl->size() - 6, out, true));
+  EXPECT(std::string(out.begin(), out.end()) == json);
+}
@@ -0,0 +1,28 @@
+#include <common.cxx>
+#include <net/http/static_files.hpp>
+
+using namespace http;
+
+CASE("Static_files::accepts_gzip() reads Accept-Encoding")
+{
+  EXPECT(Static_files::accepts_gzip("gzip"));
+  EXPECT(Static_files::accepts_gzip("deflate, gzip;q=0.5, br"));
+  EXPECT(Static_files::accepts_gzip("br, *"));
+  EXPECT(Static_files::accepts_gzip(" x-gzip "));
+  EXPECT(not Static_files::accepts_gzip(""));
+  EXPECT(not Static_files::accepts_gzip("identity"));
+  EXPECT(not Static_files::accepts_gzip("deflate, br"));
+  EXPECT(not Static_files::accepts_gzip("gzip;q=0"));
+  EXPECT(not Static_files::accepts_gzip("gzip; q=0.000"));
+}
+
+CASE("Static_files::fat_time_to_http() formats FAT timestamps")
+{
+  // 2019-03-14 15:09:26
+  const uint16_t date = ((2019 - 1980) << 9) | (3 << 5) | 14;
+  const uint16_t time = (15 << 11) | (9 << 5) | (26 / 2);
+  EXPECT(Static_files::fat_time_to_http((date << 16) | time)
+         == "Thu, 14 Mar 2019 15:09:26 GMT");
+  // not set
+  EXPECT(Static_files::fat_time_to_http(0) == "");
+}
@@ -0,0 +1,34 @@
+#include <common.cxx>
+#include <net/http/stats_exporter.hpp>
+
+using namespace http;
+
+CASE("Stats_exporter::metric_name() makes valid metric names")
+{
+  EXPECT(Stats_exporter::metric_name("", "eth0.ip4.packets_rx") == "eth0_ip4_packets_rx");
+  EXPECT(Stats_exporter::metric_name("includeos_", "eth0.tcp.rx") == "includeos_eth0_tcp_rx");
+  EXPECT(Stats_exporter::metric_name("", "cpu0.timers.oneshot_started") == "cpu0_timers_oneshot_started");
+  EXPECT(Stats_exporter::metric_name("", "0.timers-x") == "_0_timers_x");
+  EXPECT(Stats_exporter::metric_name("ios_", "0.timers") == "ios_0_timers");
+}
+
+CASE("Stats_exporter::render() writes all stats in the text format")
+{
+  Statman statman;
+  auto& rx = statman.create(Stat::UINT64, "eth0.packets_rx");
+  ++rx; ++rx;
+  auto& queue = statman.create(Stat::UINT32, "eth0.sendq_now");
+  queue.make_gauge();
+  auto& tx = statman.create_percpu("eth0.packets_tx");
+  tx += 5;
+  auto& gone = statman.create(Stat::UINT32, "eth0.gone");
+  statman.free(&gone);
+
+  Stats_exporter exporter {"/metrics", "ios_", statman};
+  const auto text = exporter.render();
+  EXPECT(text.find("# TYPE ios_statman_unused_stats counter\nios_statman_unused_stats 1\n") != std::string::npos);
+  EXPECT(text.find("# TYPE ios_eth0_packets_rx counter\nios_eth0_packets_rx 2\n") != std::string::npos);
+  EXPECT(text.find("# TYPE ios_eth0_sendq_now gauge\nios_eth0_sendq_now 0\n") != std::string::npos);
+  EXPECT(text.find("ios_eth0_packets_tx 5\n") != std::string::npos);
+  EXPECT(text.find("gone") == std::string::npos);
+}
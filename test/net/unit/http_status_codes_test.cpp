@@ -8,3 +8,10 @@ CASE("code_description() returns textual description of status code")
   auto desc = http::code_description(http::Not_Found);
   EXPECT(desc == "Not Found");
 }
+
+CASE("status_line_1_1() returns the preformatted status line")
+{
+  EXPECT(http::status_line_1_1(http::OK) == "HTTP/1.1 200 OK\r\n");
+  EXPECT(http::status_line_1_1(http::Not_Found) == "HTTP/1.1 404 Not Found\r\n");
+  EXPECT(http::status_line_1_1(static_cast<http::status_t>(299)).empty());
+}
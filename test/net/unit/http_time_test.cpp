@@ -37,3 +37,14 @@ CASE("now() returns current time")
   auto str = http::time::now();
   EXPECT(str.size() > 0ul);
 }
+
+CASE("cached_now() returns the current time, formatted once per second")
+{
+  auto first = http::time::cached_now();
+  EXPECT(first.size() == 29u);
+  EXPECT(first.substr(first.size() - 4) == " GMT");
+  EXPECT(http::time::to_time_t(std::string(first)) != std::time_t{});
+  // the same slot, unless the second just ended
+  auto second = http::time::cached_now();
+  EXPECT(second.data() == first.data());
+}
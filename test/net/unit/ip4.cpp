@@ -27,16 +27,20 @@ std::map<net::Protocol, int> pass_count {
 
 #define MYINFO(X,...) INFO("Unit IP4", X, ##__VA_ARGS__)
 
-void ip_rcv_udp(net::Packet_ptr) {
+// calls to the TCP handler, which may get a chain of packets
+int tcp_handler_calls = 0;
+
+void ip_rcv_udp(net::Packet_ptr pkt) {
   MYINFO("UDP got packet from IP");
 
-  pass_count[net::Protocol::UDP]++;
+  pass_count[net::Protocol::UDP] += pkt->chain_length();
 }
 
-void ip_rcv_tcp(net::Packet_ptr) {
+void ip_rcv_tcp(net::Packet_ptr pkt) {
   MYINFO("TCP got packet from IP");
 
-  pass_count[net::Protocol::TCP]++;
+  pass_count[net::Protocol::TCP] += pkt->chain_length();
+  tcp_handler_calls++;
 }
 
 void ip_rcv_icmp(net::Packet_ptr) {
@@ -248,5 +252,29 @@ CASE("IP4 is still a thing")
       EXPECT_PASS(std::move(ip_pckt), Protocol::TCP);
       MYINFO("Section %i done", ++sections);
     }
+
+    SECTION("A chain of packets is passed on in bursts per protocol"){
+      auto tcp_passed = pass_count[Protocol::TCP];
+      auto udp_passed = pass_count[Protocol::UDP];
+      auto dropcount  = ip_packets_dropped;
+      auto calls      = tcp_handler_calls;
+
+      auto head = inet.create_ip_packet(Protocol::TCP);
+      head->make_flight_ready();
+      for (auto proto : {Protocol::UDP, Protocol::TCP, Protocol::TCP})  {
+        auto ip_pckt = inet.create_ip_packet(proto);
+        ip_pckt->make_flight_ready();
+        head->chain(std::move(ip_pckt));
+      }
+      // a bad packet in the middle is dropped on its own
+      head->chain(inet.create_ip_packet(Protocol::TCP));
+
+      nic.receive(std::move(head));
+      EXPECT(pass_count[Protocol::TCP] == tcp_passed + 3);
+      EXPECT(pass_count[Protocol::UDP] == udp_passed + 1);
+      EXPECT(ip_packets_dropped == dropcount + 1);
+      EXPECT(tcp_handler_calls == calls + 1);
+      MYINFO("Section %i done", ++sections);
+    }
   }
 }
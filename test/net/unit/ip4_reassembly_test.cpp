@@ -0,0 +1,131 @@
+
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/ip4/reassembly.hpp>
+#include <net/udp/packet4_view.hpp>
+
+using namespace net;
+
+static uint8_t pattern(int i)
+{ return (i * 7) & 0xff; }
+
+// UDP datagram of @total bytes, with @len bytes from @offset
+static std::unique_ptr<PacketIP4> fragment(uint16_t id, int offset, int len, int total)
+{
+  auto pkt = create_ip4_packet_init({10,0,0,1}, {10,0,0,2});
+  pkt->set_protocol(Protocol::UDP);
+  pkt->set_ip_id(id);
+  pkt->set_ip_data_length(len);
+  auto* data = pkt->ip_data().data();
+  for (int i = 0; i < len; i++)
+    data[i] = pattern(offset + i);
+  if (offset == 0) {
+    // UDP header, with the length of the whole datagram
+    auto& udp = *(udp::Header*) data;
+    udp.sport  = htons(1000);
+    udp.dport  = htons(53);
+    udp.length = htons(total);
+    udp.checksum = 0;
+  }
+  const uint16_t more = (offset + len < total) ? 0x2000 : 0;
+  auto& hdr = *(ip4::Header*) pkt->layer_begin();
+  hdr.frag_off_flags = htons(more | (offset / 8));
+  return pkt;
+}
+
+static bool payload_matches(const Packet& pkt, int hdr_len)
+{
+  int pos = 0;
+  const Packet* seg = &pkt;
+  for (int skip = hdr_len; seg; seg = seg->next_segment(), skip = 0)
+  {
+    for (int i = skip; i < seg->size(); i++, pos++)
+      if (pos >= 8 and seg->layer_begin()[i] != pattern(pos)) return false;
+  }
+  return true;
+}
+
+CASE("Fragments are reassembled as segments of the first fragment")
+{
+  Reassembly reassembly;
+  EXPECT(reassembly.process(fragment(1, 0, 1000, 2500)) == nullptr);
+  EXPECT(reassembly.datagrams() == 1);
+  EXPECT(reassembly.bytes() > 0u);
+  EXPECT(reassembly.process(fragment(1, 1000, 1000, 2500)) == nullptr);
+  auto dgram = reassembly.process(fragment(1, 2000, 500, 2500));
+  EXPECT(dgram != nullptr);
+  EXPECT(reassembly.datagrams() == 0);
+  EXPECT(reassembly.bytes() == 0u);
+
+  EXPECT(dgram->ip_total_length() == 2520);
+  EXPECT(dgram->ip_frag_offs() == 0);
+  EXPECT(dgram->ip_flags() == ip4::Flags::NONE);
+  EXPECT(dgram->compute_ip_checksum() == 0);
+  EXPECT(dgram->total_size() == 2520);
+  EXPECT(dgram->next_segment() != nullptr);
+  EXPECT(dgram->next_segment()->size() == 1000);
+  EXPECT(dgram->next_segment()->next_segment()->size() == 500);
+  EXPECT(payload_matches(*dgram, 20));
+
+  // UDP reads the payload across the segments
+  udp::Packet4_view view(std::move(dgram));
+  EXPECT(view.udp_payload_length() == 2492);
+  EXPECT(view.udp_data_length() == 992);
+  std::vector<uint8_t> buffer(3000);
+  EXPECT(view.copy_payload(buffer.data(), buffer.size()) == 2492u);
+  bool same = true;
+  for (int i = 0; i < 2492; i++)
+    same = same and buffer[i] == pattern(i + 8);
+  EXPECT(same);
+}
+
+CASE("Fragments can arrive in any order, and duplicates are ignored")
+{
+  Reassembly reassembly;
+  EXPECT(reassembly.process(fragment(2, 2000, 500, 2500)) == nullptr);
+  EXPECT(reassembly.process(fragment(2, 1000, 1000, 2500)) == nullptr);
+  EXPECT(reassembly.process(fragment(2, 1000, 1000, 2500)) == nullptr);
+  // an unrelated datagram in between
+  EXPECT(reassembly.process(fragment(3, 0, 1000, 2000)) == nullptr);
+  EXPECT(reassembly.datagrams() == 2);
+
+  auto dgram = reassembly.process(fragment(2, 0, 1000, 2500));
+  EXPECT(dgram != nullptr);
+  EXPECT(dgram->ip_id() == 2);
+  EXPECT(dgram->total_size() == 2520);
+  EXPECT(payload_matches(*dgram, 20));
+  EXPECT(reassembly.datagrams() == 1);
+  EXPECT(reassembly.dropped() == 0u);
+}
+
+CASE("Overlapping fragments drop the datagram")
+{
+  Reassembly reassembly;
+  EXPECT(reassembly.process(fragment(4, 0, 1000, 2500)) == nullptr);
+  EXPECT(reassembly.process(fragment(4, 504, 1000, 2500)) == nullptr);
+  EXPECT(reassembly.datagrams() == 0);
+  EXPECT(reassembly.dropped() == 1u);
+
+  // a fragment past the end of the datagram
+  EXPECT(reassembly.process(fragment(5, 1000, 1000, 2000)) == nullptr);
+  EXPECT(reassembly.process(fragment(5, 0, 504, 504)) == nullptr);
+  EXPECT(reassembly.datagrams() == 0);
+  EXPECT(reassembly.dropped() == 2u);
+}
+
+CASE("Incomplete datagrams time out")
+{
+  Reassembly reassembly;
+  EXPECT(reassembly.process(fragment(6, 0, 1000, 2500)) == nullptr);
+  reassembly.expire(RTC::now());
+  EXPECT(reassembly.datagrams() == 1);
+  reassembly.expire(RTC::now() + Reassembly::TIMEOUT);
+  EXPECT(reassembly.datagrams() == 0);
+  EXPECT(reassembly.bytes() == 0u);
+  EXPECT(reassembly.dropped() == 1u);
+
+  // the rest of it starts over
+  EXPECT(reassembly.process(fragment(6, 1000, 1000, 2500)) == nullptr);
+  EXPECT(reassembly.process(fragment(6, 2000, 500, 2500)) == nullptr);
+  EXPECT(reassembly.datagrams() == 1);
+}
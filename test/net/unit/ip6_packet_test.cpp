@@ -48,3 +48,56 @@ CASE("IP6 Packet HOPLIMIT - multiple packets")
     EXPECT(ip6->hop_limit() == 0);
   }
 }
+
+CASE("IP6 Packet finds the upper layer after the extension headers")
+{
+  const ip6::Addr src{0xfe80, 0, 0, 0, 0xe823, 0xfcff, 0xfef4, 0x85bd};
+  const ip6::Addr dst{0xfe80, 0, 0, 0, 0xe823, 0xfcff, 0xfef4, 0x83e7};
+
+  // no extension headers
+  auto plain = create_ip6_packet_init(src, dst);
+  plain->set_ip_next_header(static_cast<uint8_t>(Protocol::UDP));
+  plain->increment_data_end(8);
+  EXPECT(plain->ip_protocol() == Protocol::UDP);
+  plain->calculate_payload_offset();
+  EXPECT(plain->upper_protocol() == static_cast<uint8_t>(Protocol::UDP));
+  EXPECT(plain->ip_header_len() == sizeof(ip6::Header));
+
+  // hop-by-hop options of 8 bytes, then destination options of 16
+  auto ip6 = create_ip6_packet_init(src, dst);
+  ip6->set_ip_next_header(static_cast<uint8_t>(Protocol::HOPOPT));
+  auto* ext = ip6->layer_begin() + sizeof(ip6::Header);
+  std::memset(ext, 0, 32);
+  ext[0]  = static_cast<uint8_t>(Protocol::OPTSV6);
+  ext[8]  = static_cast<uint8_t>(Protocol::TCP);
+  ext[9]  = 1;
+  ip6->increment_data_end(24 + 20);
+  EXPECT(ip6->ip_protocol() == Protocol::TCP);
+
+  ip6->calculate_payload_offset();
+  EXPECT(ip6->upper_protocol() == static_cast<uint8_t>(Protocol::TCP));
+  EXPECT(ip6->ip_protocol() == Protocol::TCP);
+  EXPECT(ip6->ip_header_len() == sizeof(ip6::Header) + 24);
+
+  // changing the next header forgets what was found
+  ip6->set_ip_next_header(static_cast<uint8_t>(Protocol::UDP));
+  EXPECT(ip6->upper_protocol() == 0);
+  EXPECT(ip6->ip_protocol() == Protocol::UDP);
+}
+
+CASE("IP6 Packet with extension headers running past its end")
+{
+  const ip6::Addr src{0xfe80, 0, 0, 0, 0xe823, 0xfcff, 0xfef4, 0x85bd};
+  const ip6::Addr dst{0xfe80, 0, 0, 0, 0xe823, 0xfcff, 0xfef4, 0x83e7};
+  auto ip6 = create_ip6_packet_init(src, dst);
+  ip6->set_ip_next_header(static_cast<uint8_t>(Protocol::HOPOPT));
+  auto* ext = ip6->layer_begin() + sizeof(ip6::Header);
+  std::memset(ext, 0, 16);
+  ext[0] = static_cast<uint8_t>(Protocol::UDP);
+  ext[1] = 4; // 40 bytes, in a packet of 16
+  ip6->increment_data_end(16);
+
+  ip6->calculate_payload_offset();
+  EXPECT(ip6->ip_protocol() == Protocol::IPv6_NONXT);
+  EXPECT(ip6->ip_header_len() == sizeof(ip6::Header));
+}
@@ -0,0 +1,120 @@
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/nat/load_balancer.hpp>
+#include <nic_mock.hpp>
+#include <net/inet>
+
+using namespace net;
+using namespace net::nat;
+
+static std::vector<Maglev::Backend> backends(int count)
+{
+  std::vector<Maglev::Backend> list;
+  for (int i = 0; i < count; i++)
+    list.push_back({Socket{ip4::Addr{10,0,1,(uint8_t) (i + 1)}, 8080}});
+  return list;
+}
+
+static std::unique_ptr<tcp::Packet> tcp_packet(Socket src, Socket dst)
+{
+  auto tcp = create_tcp_packet_init(src, dst);
+  tcp->set_tcp_checksum();
+  tcp->set_ip_checksum();
+  return tcp;
+}
+
+CASE("Maglev spreads the table evenly, and by weight")
+{
+  Maglev empty{{}, 251};
+  EXPECT(empty.lookup(1234) == nullptr);
+
+  Maglev even{backends(4)};
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT(even.slots(i) > Maglev::DEFAULT_SIZE / 4 * 0.95);
+    EXPECT(even.slots(i) < Maglev::DEFAULT_SIZE / 4 * 1.05);
+  }
+
+  auto list = backends(3);
+  list[0].weight = 2;
+  list[2].healthy = false;
+  Maglev weighted{list};
+  EXPECT(weighted.slots(0) > weighted.slots(1) * 1.9);
+  EXPECT(weighted.slots(0) < weighted.slots(1) * 2.1);
+  EXPECT(weighted.slots(2) == 0u);
+}
+
+CASE("Maglev moves few flows when a backend goes")
+{
+  auto list = backends(10);
+  Maglev before{list};
+  list[3].healthy = false;
+  Maglev after{list};
+
+  int moved = 0;
+  for (uint64_t hash = 0; hash < before.size(); hash++)
+  {
+    const auto* a = before.lookup(hash);
+    const auto* b = after.lookup(hash);
+    EXPECT(b->addr != list[3].addr);
+    if (a->addr != list[3].addr and a->addr != b->addr) moved++;
+  }
+  // only the flows of the one that went should move, give or take
+  EXPECT(moved < (int) before.size() / 50);
+}
+
+CASE("Load balancer keeps flows on their backend")
+{
+  auto conntrack = std::make_shared<Conntrack>();
+  Nic_mock nic;
+  Inet inet{nic};
+  inet.network_config({10,0,0,40},{255,255,255,0}, 0);
+
+  const Socket vip{ip4::Addr{10,0,0,40}, 80};
+  const Socket client{ip4::Addr{10,0,0,1}, 32222};
+  Load_balancer lb{conntrack, vip};
+
+  // no backends
+  auto tcp = tcp_packet(client, vip);
+  auto* entry = conntrack->in(*tcp);
+  auto res = lb.prerouting(std::move(tcp), inet, entry);
+  EXPECT(res == Filter_verdict_type::DROP);
+  EXPECT(lb.dropped() == 1u);
+
+  lb.set_backends(backends(3));
+  const auto* expected = lb.pick({client, vip});
+  EXPECT(expected != nullptr);
+  const Socket backend = expected->addr;
+
+  // the first packet picks
+  tcp = tcp_packet(client, vip);
+  entry = conntrack->in(*tcp);
+  res = lb.prerouting(std::move(tcp), inet, entry);
+  EXPECT(res == Filter_verdict_type::ACCEPT);
+  EXPECT(res.packet->ip_dst() == backend.address().v4());
+  conntrack->confirm(*res.packet);
+  EXPECT(lb.new_flows() == 1u);
+
+  // the rest stay, whatever the table says now
+  auto list = lb.backends();
+  for (auto& b : list) b.healthy = (b.addr != backend);
+  lb.set_backends(list);
+  EXPECT(lb.pick({client, vip})->addr != backend);
+
+  tcp = tcp_packet(client, vip);
+  entry = conntrack->in(*tcp);
+  res = lb.prerouting(std::move(tcp), inet, entry);
+  EXPECT(res.packet->ip_dst() == backend.address().v4());
+  EXPECT(lb.new_flows() == 1u);
+
+  // replies come from the VIP
+  tcp = tcp_packet(backend, client);
+  entry = conntrack->in(*tcp);
+  res = lb.postrouting(std::move(tcp), inet, entry);
+  auto* reply = static_cast<tcp::Packet*>(res.packet.get());
+  EXPECT(reply->source() == vip);
+  EXPECT(reply->compute_tcp_checksum() == 0);
+  EXPECT(reply->compute_ip_checksum() == 0);
+
+  // the old tables go once the event loop has been around
+  Events::get(0).process_events();
+}
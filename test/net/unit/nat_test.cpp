@@ -222,3 +222,109 @@ CASE("ICMP NAT verifying rewrite")
 
 }
 
+
+#include <net/udp/packet4_view.hpp>
+#include <net/tcp/packet4_view.hpp>
+
+CASE("UDP NAT keeps a set checksum valid")
+{
+  const Socket src{ip4::Addr{10,0,0,42},80};
+  const Socket dst{ip4::Addr{10,0,0,43},32222};
+  auto udp = create_udp_packet_init(src, dst);
+  udp->set_data_length(13);
+  std::memcpy(udp->data(), "Hello, world!", 13);
+  udp->set_ip_checksum();
+
+  auto valid = [&udp] {
+    udp::Packet4_view_raw view{udp.get()};
+    return udp::calculate_checksum4(view) == 0 and udp->compute_ip_checksum() == 0;
+  };
+
+  // without a checksum there is nothing to update
+  snat(*udp, Socket{ip4::Addr{10,0,0,1}, 4000});
+  EXPECT(udp->checksum() == 0);
+
+  udp::Packet4_view_raw view{udp.get()};
+  udp->set_checksum(udp::calculate_checksum4(view));
+  EXPECT(valid());
+
+  snat(*udp, Socket{ip4::Addr{192,168,1,1}, 5000});
+  EXPECT(valid());
+  dnat(*udp, ip4::Addr{8,8,8,8});
+  EXPECT(valid());
+  dnat(*udp, uint16_t{53});
+  EXPECT(valid());
+  EXPECT(udp->source() == Socket(ip4::Addr{192,168,1,1}, 5000));
+  EXPECT(udp->destination() == Socket(ip4::Addr{8,8,8,8}, 53));
+}
+
+CASE("A precomputed rewrite translates a burst of packets of one flow")
+{
+  const Socket src{ip4::Addr{10,0,0,42},1234};
+  const Socket dst{ip4::Addr{10,0,0,43},80};
+  const Socket masq{ip4::Addr{192,168,0,1},40000};
+
+  auto create = [&] (uint32_t seq) {
+    auto tcp = create_tcp_packet_init(src, dst);
+    tcp->set_seq(seq);
+    tcp->set_tcp_checksum();
+    tcp->set_ip_checksum();
+    return net::Packet_ptr(std::move(tcp));
+  };
+  auto head = create(1);
+  head->chain(create(1000));
+  head->chain(create(2000));
+  auto& first = static_cast<PacketIP4&>(*head);
+
+  const Rewrite rewrite{first, Rewrite::Dir::SRC, masq};
+  rewrite.apply_chain(first);
+
+  int count = 0;
+  for (auto* pkt = head.get(); pkt != nullptr; pkt = pkt->tail(), count++)
+  {
+    auto& tcp = static_cast<tcp::Packet&>(*pkt);
+    EXPECT(tcp.source() == masq);
+    EXPECT(tcp.destination() == dst);
+    EXPECT(tcp.compute_tcp_checksum() == 0);
+    EXPECT(tcp.compute_ip_checksum() == 0);
+  }
+  EXPECT(count == 3);
+}
+
+CASE("TCP NAT keeps the pseudo-header sum of checksum offloaded packets")
+{
+  const Socket src{ip4::Addr{10,0,0,42},1234};
+  const Socket dst{ip4::Addr{10,0,0,43},80};
+  auto tcp = create_tcp_packet_init(src, dst);
+  tcp->set_ip_checksum();
+
+  tcp::Packet4_view_raw view{tcp.get()};
+  view.set_tcp_checksum_offload();
+  EXPECT(tcp->checksum_offloaded());
+
+  snat(*tcp, Socket{ip4::Addr{192,168,0,1},40000});
+  EXPECT(view.tcp_checksum() == view.compute_pseudo_checksum());
+  dnat(*tcp, ip4::Addr{8,8,4,4});
+  EXPECT(view.tcp_checksum() == view.compute_pseudo_checksum());
+  EXPECT(tcp->compute_ip_checksum() == 0);
+}
+
+CASE("UDP NAT keeps the pseudo-header sum of checksum offloaded packets")
+{
+  const Socket src{ip4::Addr{10,0,0,42},1234};
+  const Socket dst{ip4::Addr{10,0,0,43},53};
+  auto udp = create_udp_packet_init(src, dst);
+  udp->set_data_length(13);
+  std::memcpy(udp->data(), "Hello, world!", 13);
+  udp->set_ip_checksum();
+
+  udp::Packet4_view_raw view{udp.get()};
+  view.set_udp_checksum_offload();
+  EXPECT(udp->checksum_offloaded());
+
+  snat(*udp, Socket{ip4::Addr{192,168,0,1},40000});
+  EXPECT(view.udp_checksum() == view.compute_pseudo_checksum());
+  dnat(*udp, ip4::Addr{8,8,4,4});
+  EXPECT(view.udp_checksum() == view.compute_pseudo_checksum());
+  EXPECT(udp->compute_ip_checksum() == 0);
+}
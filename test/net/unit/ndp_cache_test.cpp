@@ -0,0 +1,93 @@
+
+#include <common.cxx>
+#include <packet_factory.hpp>
+#include <net/ip6/ndp_cache.hpp>
+
+using namespace net;
+
+CASE("Ndp_cache finds what was inserted")
+{
+  Ndp_cache cache{8, 4};
+  const ip6::Addr ip{0xfe80, 0, 0, 0, 0, 0, 0, 1};
+  EXPECT(cache.size() == 0u);
+  EXPECT(cache.capacity() == 8u);
+  EXPECT(cache.find(ip) == nullptr);
+
+  auto& ent = cache.insert(ip);
+  EXPECT(not ent.resolved);
+  EXPECT(ent.state == Ndp_cache::State::INCOMPLETE);
+  ent.mac      = MAC::Addr{1,2,3,4,5,6};
+  ent.resolved = true;
+
+  auto* found = cache.find(ip);
+  EXPECT(found == &ent);
+  EXPECT(found->mac == MAC::Addr(1,2,3,4,5,6));
+  EXPECT(&cache.insert(ip) == &ent);
+  EXPECT(cache.size() == 1u);
+
+  const auto gen = cache.generation();
+  cache.erase(ent);
+  EXPECT(cache.find(ip) == nullptr);
+  EXPECT(cache.size() == 0u);
+  EXPECT(cache.generation() != gen);
+}
+
+CASE("Ndp_cache routes a destination through its next hop")
+{
+  Ndp_cache cache{8, 4};
+  const ip6::Addr router{0xfe80, 0, 0, 0, 0, 0, 0, 1};
+  const ip6::Addr dst{0x2001, 0xdb8, 0, 0, 0, 0, 0, 42};
+
+  // the next hop is not known yet
+  auto& ent = cache.insert(dst);
+  cache.set_route(ent, router, 1);
+  EXPECT(ent.next_hop == router);
+  EXPECT(ent.route_gen == 1u);
+  EXPECT(cache.hop_of(ent) == nullptr);
+
+  auto& hop = cache.insert(router);
+  hop.mac      = MAC::Addr{1,2,3,4,5,6};
+  hop.resolved = true;
+  EXPECT(cache.hop_of(ent) == &hop);
+
+  // the slot of the next hop is reused, and the link to it found broken
+  cache.erase(hop);
+  auto& other = cache.insert({0x2001, 0xdb8, 0, 0, 0, 0, 0, 7});
+  EXPECT(&other == &hop);
+  EXPECT(cache.hop_of(ent) == nullptr);
+  auto& again = cache.insert(router);
+  EXPECT(cache.hop_of(ent) == &again);
+
+  // an on-link destination is its own next hop
+  auto& onlink = cache.insert({0x2001, 0xdb8, 0, 0, 0, 0, 0, 9});
+  cache.set_route(onlink, onlink.ip, 1);
+  EXPECT(cache.hop_of(onlink) == &onlink);
+}
+
+CASE("A full Ndp_cache evicts entries that were not looked up")
+{
+  Ndp_cache cache{4, 4};
+  for (uint16_t i = 1; i <= 4; i++)
+    cache.insert({0xfe80, 0, 0, 0, 0, 0, 0, i}).resolved = true;
+
+  // fe80::2 is in use, everyone else is idle
+  const ip6::Addr busy{0xfe80, 0, 0, 0, 0, 0, 0, 2};
+  EXPECT(cache.find(busy) != nullptr);
+  auto& waiting = cache.insert({0xfe80, 0, 0, 0, 0, 0, 0, 3});
+  waiting.pending.push_back(create_packet());
+
+  // a scan of many destinations stays within capacity
+  for (uint16_t i = 0; i < 256; i++)
+  {
+    cache.insert({0x2001, 0xdb8, 0, 0, 0, 0, 0, i});
+    EXPECT(cache.find(busy) != nullptr);
+  }
+  EXPECT(cache.size() == 4u);
+  EXPECT(cache.find({0xfe80, 0, 0, 0, 0, 0, 0, 1}) == nullptr);
+  EXPECT(cache.find({0xfe80, 0, 0, 0, 0, 0, 0, 3}) == nullptr);
+  EXPECT(cache.evictions() == 256u);
+
+  int count = 0;
+  cache.for_each([&count] (Ndp_cache::Entry&) { count++; });
+  EXPECT(count == 4);
+}
@@ -2,6 +2,7 @@
 #include <common.cxx>
 #include <net/buffer_store.hpp>
 #include <net/packet.hpp>
+#include <vector>
 
 using namespace net;
 #define BUFFER_CNT 128
@@ -141,3 +142,114 @@ CASE("Verify packet chaining works")
   packet = nullptr;
   EXPECT(bufstore.available() == BUFFER_CNT);
 }
+
+CASE("Release a packet chain in bulk")
+{
+  const auto avail = bufstore.available();
+  auto head = create_packet();
+  for (int i = 0; i < 40; i++)
+    head->chain(create_packet());
+  EXPECT(head->chain_length() == 41);
+  EXPECT(bufstore.available() == avail - 41);
+
+  Packet::release_chain(std::move(head));
+  EXPECT(bufstore.available() == avail);
+}
+
+CASE("Build a packet chain in order with Packet_chain")
+{
+  const auto avail = bufstore.available();
+  std::vector<Packet*> order;
+
+  Packet_chain burst;
+  EXPECT(burst.empty());
+  for (int i = 0; i < 4; i++) {
+    auto pkt = create_packet();
+    order.push_back(pkt.get());
+    burst.push_back(std::move(pkt));
+  }
+  // appending a chain appends all of its packets
+  auto sub = create_packet();
+  order.push_back(sub.get());
+  for (int i = 0; i < 3; i++) {
+    auto pkt = create_packet();
+    order.push_back(pkt.get());
+    sub->chain(std::move(pkt));
+  }
+  burst.push_back(std::move(sub));
+  auto last = create_packet();
+  order.push_back(last.get());
+  burst.push_back(std::move(last));
+
+  EXPECT(burst.size() == 9);
+  auto head = burst.release();
+  EXPECT(burst.empty());
+  EXPECT(burst.size() == 0);
+  EXPECT(head->chain_length() == 9);
+
+  size_t i = 0;
+  for (auto* p = head.get(); p != nullptr; p = p->tail())
+    EXPECT(p == order.at(i++));
+  EXPECT(i == order.size());
+
+  Packet::release_chain(std::move(head));
+  EXPECT(bufstore.available() == avail);
+}
+
+CASE("Headroom and tailroom follow the layer and the data")
+{
+  auto packet = create_packet();
+  EXPECT(packet->headroom() == DRIVER_OFFSET);
+  EXPECT(packet->tailroom() == PACKET_CAPA);
+
+  packet->increment_layer_begin(14);
+  packet->increment_data_end(100);
+  EXPECT(packet->headroom() == DRIVER_OFFSET + 14);
+  EXPECT(packet->tailroom() == PACKET_CAPA - 14 - 100);
+  EXPECT(packet->headroom() + packet->size() + packet->tailroom() == packet->bufsize());
+}
+
+CASE("Linearize a packet in segments into one buffer")
+{
+  const auto avail = bufstore.available();
+  auto packet = create_packet();
+  packet->increment_layer_begin(14);
+  packet->increment_data_end(PACKET_CAPA - 14);
+  // a jumbo frame, as a NIC receives it into several buffers
+  for (int i = 0; i < 2; i++) {
+    auto seg = create_packet();
+    seg->increment_data_end(PACKET_CAPA);
+    packet->append_segment(std::move(seg));
+  }
+  int value = 0;
+  for (auto* p = packet.get(); p != nullptr; p = p->next_segment())
+    for (auto* b = p->layer_begin(); b < p->data_end(); b++)
+      *b = value++;
+  packet->set_vlan_id(42);
+  EXPECT(packet->segment_count() == 3);
+  EXPECT(packet->total_size() == value);
+
+  // a packet without segments is left as it is
+  auto single = create_packet();
+  auto* single_ptr = single.get();
+  EXPECT(Packet::linearize(std::move(single)).get() == single_ptr);
+
+  auto* head = packet->buf();
+  head[DRIVER_OFFSET] = 0xab;
+  auto flat = Packet::linearize(std::move(packet));
+  EXPECT(flat->segment_count() == 1);
+  EXPECT(flat->size() == value);
+  EXPECT(flat->tailroom() == 0);
+  // the headroom and the lower layer headers are kept
+  EXPECT(flat->headroom() == DRIVER_OFFSET + 14);
+  EXPECT(flat->buf()[DRIVER_OFFSET] == 0xab);
+  EXPECT(flat->vlan_id() == 42);
+  bool same = true;
+  for (int i = 0; i < value; i++)
+    same &= flat->layer_begin()[i] == (uint8_t) i;
+  EXPECT(same);
+
+  // the buffers went back to the store
+  flat.reset();
+  EXPECT(bufstore.available() == avail);
+}
@@ -71,3 +71,55 @@ CASE("Simulating random connections")
     EXPECT(util.has_free_ephemeral() == false);
   }
 }
+
+CASE("Ports are shared by flows to different remotes")
+{
+  using namespace net;
+  Port_util util;
+
+  const Socket remote1{ip4::Addr{10,0,0,1}, 80};
+  const Socket remote2{ip4::Addr{10,0,0,2}, 80};
+
+  auto port = util.get_next_ephemeral(remote1);
+  util.bind(port, remote1);
+  EXPECT(util.is_bound(port));
+  EXPECT(util.is_shared(port));
+  EXPECT(util.is_bound(port, remote1));
+  EXPECT(not util.is_bound(port, remote2));
+
+  // the same port is fine for another remote
+  util.bind(port, remote2);
+  EXPECT(util.is_bound(port, remote2));
+
+  // but never twice to the same remote
+  for (int i = 0; i < 100; i++)
+    EXPECT(util.get_next_ephemeral(remote1) != port);
+
+  EXPECT(util.unbind(port, remote1));
+  EXPECT(not util.unbind(port, remote1));
+  EXPECT(util.is_bound(port));
+
+  EXPECT(util.unbind(port, remote2));
+  EXPECT(not util.is_bound(port));
+  EXPECT(not util.is_shared(port));
+}
+
+CASE("Ports for a remote skip those bound exclusively")
+{
+  using namespace net;
+  Port_util util;
+  const Socket remote{ip4::Addr{10,0,0,1}, 443};
+
+  // bind all but one exclusively
+  for (auto i = 0; i < util.size() - 1; ++i)
+    util.bind(util.get_next_ephemeral());
+
+  auto port = util.get_next_ephemeral(remote);
+  EXPECT(not util.is_bound(port));
+  util.bind(port, remote);
+  EXPECT(util.has_free_ephemeral() == false);
+
+  // the one shared port is taken for this remote, free for another
+  EXPECT_THROWS_AS(util.get_next_ephemeral(remote), net::Port_error);
+  EXPECT(util.get_next_ephemeral(Socket{ip4::Addr{10,0,0,2}, 443}) == port);
+}
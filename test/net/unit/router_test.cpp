@@ -248,6 +248,88 @@ CASE("net::router: Actual routing verifying TTL")
   EXPECT(tcp_packet_recv == 2);
 }
 
+CASE("net::router: Established connections forward along their cached route")
+{
+  Nic_mock nic1;
+  Inet inet1{nic1};
+  inet1.network_config({10,0,1,1},{255,255,255,0}, 0);
+
+  Nic_mock nic2;
+  Inet inet2{nic2};
+  inet2.network_config({10,0,2,1},{255,255,255,0}, 0);
+
+  Router<IP4> router({
+    {{10, 0, 1, 0}, {255, 255, 255, 0}, {0}, inet1 , 1 },
+    {{10, 0, 2, 0}, {255, 255, 255, 0}, {0}, inet2 , 1 }
+  });
+
+  const Socket src{ip4::Addr{10,0,1,10}, 32222};
+  const Socket dst{ip4::Addr{10,0,2,10}, 80};
+  const MAC::Addr mac1{0xc0,0x01,0x4a,0x00,0x00,0x01};
+  const MAC::Addr mac2{0xc0,0x01,0x4a,0x00,0x00,0x02};
+
+  int via_arp1 = 0, via_arp2 = 0, via_link = 0;
+  MAC::Addr last_mac;
+  inet1.ip_obj().set_linklayer_out([&](auto, auto) { via_arp1++; });
+  inet2.ip_obj().set_linklayer_out([&](auto, auto ip) {
+    EXPECT(ip == dst.address().v4());
+    via_arp2++;
+  });
+  inet2.ip_obj().set_link_out([&](auto, auto mac, auto) {
+    last_mac = mac;
+    via_link++;
+  });
+
+  auto forward = [&] (const Conntrack::Entry& ct) {
+    auto tcp = create_tcp_packet_init(src, dst);
+    tcp->set_ip_checksum();
+    tcp->set_tcp_checksum();
+    net::Packet_ptr pkt = std::move(tcp);
+    router.forward(static_unique_ptr_cast<PacketIP4>(std::move(pkt)), inet1, &ct);
+  };
+
+  // Only established connections are cached
+  Conntrack::Entry entry{{src, dst}, Protocol::TCP};
+  entry.state = Conntrack::State::NEW;
+  forward(entry);
+  EXPECT(via_arp2 == 1);
+  EXPECT(entry.route_cache[0].route == nullptr);
+
+  // Not resolved yet, the route is cached but goes through ARP
+  entry.state = Conntrack::State::ESTABLISHED;
+  forward(entry);
+  EXPECT(via_arp2 == 2);
+  EXPECT(entry.route_cache[0].route != nullptr);
+  EXPECT(entry.route_cache[0].link_gen == 0u);
+
+  // Once resolved, packets go straight to the link
+  inet2.arp().cache(dst.address().v4(), mac1);
+  forward(entry);
+  EXPECT(via_arp2 == 3);
+  forward(entry);
+  forward(entry);
+  EXPECT(via_arp2 == 3);
+  EXPECT(via_link == 2);
+  EXPECT(last_mac == mac1);
+
+  // A changed link address is picked up again through ARP
+  inet2.arp().cache(dst.address().v4(), mac2);
+  forward(entry);
+  EXPECT(via_arp2 == 4);
+  forward(entry);
+  EXPECT(via_link == 3);
+  EXPECT(last_mac == mac2);
+
+  // A new routing table invalidates the cached route
+  const auto gen = router.generation();
+  router.set_routing_table({{{10, 0, 2, 0}, {255, 255, 255, 0}, {10, 0, 1, 254}, inet1 , 1 }});
+  EXPECT(router.generation() != gen);
+  forward(entry);
+  EXPECT(via_arp1 == 1);
+  EXPECT(via_link == 3);
+  EXPECT(via_arp2 == 4);
+}
+
 CASE("net::router: Calculate Route nexthop")
 {
   Nic_mock nic1;
@@ -282,3 +364,98 @@ CASE("net::router: Calculate Route nexthop")
   // Matches routes net (duh), and can be sent directly
   EXPECT(r3.nexthop({10,0,1,10})  == ip4::Addr(10,0,1,10)); // == ip
 }
+
+// Reference implementation of the route lookups, scanning the whole table
+template <class IPV, class Addr>
+static int linear_most_specific(const typename Router<IPV>::Routing_table& tbl, Addr dest)
+{
+  int match = -1;
+  for (size_t i = 0; i < tbl.size(); i++)
+    if (tbl[i].match(dest) and (match < 0 or tbl[i].netmask() > tbl[match].netmask()))
+      match = i;
+  return match;
+}
+
+template <class IPV, class Addr>
+static int linear_cheapest_cost(const typename Router<IPV>::Routing_table& tbl, Addr dest)
+{
+  int cost = -1;
+  for (auto& route : tbl)
+    if (route.match(dest) and (cost < 0 or route.cost() < cost))
+      cost = route.cost();
+  return cost;
+}
+
+CASE("net::router: Compiled IPv4 route lookup matches a linear scan")
+{
+  std::mt19937 rng(1234);
+  Inet* ifaces[] {eth1, eth2, eth3, eth4};
+  Router<IP4>::Routing_table tbl;
+  // nets drawn from a small space to get plenty of overlap
+  for (int i = 0; i < 400; i++)
+  {
+    const int len = (i == 0) ? 0 : rng() % 33;
+    const uint32_t mask = len ? ~0u << (32 - len) : 0;
+    const uint32_t net  = ((rng() & 0x0f0f0f0f) | 0x0a000000) & mask;
+    tbl.emplace_back(ip4::Addr{htonl(net)}, ip4::Addr{htonl(mask)},
+                     ip4::Addr{10,0,0,1}, *ifaces[i % 4], rng() % 8);
+  }
+  // duplicate prefixes go to the first one in the table
+  tbl.emplace_back(tbl[100].net(), tbl[100].netmask(), ip4::Addr{10,0,0,2}, *eth1, 0);
+
+  Router<IP4> router(tbl);
+  for (int i = 0; i < 20000; i++)
+  {
+    const ip4::Addr dest{htonl((rng() & 0x0f0f0f0f) | 0x0a000000)};
+    const int idx = linear_most_specific<IP4>(tbl, dest);
+    auto* route = router.get_most_specific_route(dest);
+    EXPECT(route != nullptr);
+    EXPECT(*route == tbl[idx]);
+    auto* cheapest = router.get_cheapest_route(dest);
+    EXPECT(cheapest != nullptr);
+    EXPECT(cheapest->cost() == linear_cheapest_cost<IP4>(tbl, dest));
+    EXPECT(cheapest->match(dest));
+  }
+
+  // a table without a default route
+  router.set_routing_table({{{10, 42, 0, 0}, {255, 255, 0, 0}, {10, 42, 42, 3}, *eth2, 1},
+                            {{10, 42, 42, 128}, {255, 255, 255, 128}, {10, 42, 42, 2}, *eth1, 2}});
+  EXPECT(router.get_most_specific_route({10, 42, 42, 200})->interface() == eth1);
+  EXPECT(router.get_most_specific_route({10, 42, 42, 100})->interface() == eth2);
+  EXPECT(router.get_cheapest_route({10, 42, 42, 200})->interface() == eth2);
+  EXPECT(router.get_most_specific_route({10, 43, 0, 1}) == nullptr);
+  EXPECT(router.get_cheapest_route({10, 43, 0, 1}) == nullptr);
+}
+
+CASE("net::router: Compiled IPv6 route lookup matches a linear scan")
+{
+  std::mt19937 rng(4321);
+  auto random_addr = [&rng] () {
+    // fix most bits, so that prefixes overlap
+    return ip6::Addr{0x2001, 0xdb8, 0, 0, 0, 0,
+                     (uint16_t) (rng() & 0x0f0f), (uint16_t) (rng() & 0xf00f)};
+  };
+  Router<IP6>::Routing_table tbl;
+  for (int i = 0; i < 300; i++)
+  {
+    const uint8_t len = (i == 0) ? 0 : 96 + rng() % 33;
+    tbl.emplace_back(random_addr() & len, len, ip6::Addr{0xfe80, 0, 0, 0, 0, 0, 0, 1},
+                     *eth1, rng() % 8);
+  }
+  Router<IP6> router(tbl);
+  for (int i = 0; i < 20000; i++)
+  {
+    const auto dest = random_addr();
+    const int idx = linear_most_specific<IP6>(tbl, dest);
+    auto* route = router.get_most_specific_route(dest);
+    EXPECT(route != nullptr);
+    EXPECT(*route == tbl[idx]);
+    auto* cheapest = router.get_cheapest_route(dest);
+    EXPECT(cheapest != nullptr);
+    EXPECT(cheapest->cost() == linear_cheapest_cost<IP6>(tbl, dest));
+    EXPECT(cheapest->match(dest));
+  }
+
+  router.set_routing_table({});
+  EXPECT(router.get_most_specific_route(random_addr()) == nullptr);
+}
@@ -0,0 +1,61 @@
+#include <common.cxx>
+#include <net/rps.hpp>
+#include <net/rss.hpp>
+
+using namespace net;
+
+// the verification suite of the RSS specification
+CASE("Toeplitz hash of IPv4 flows matches the RSS verification suite")
+{
+  const auto& key = rss::default_key;
+  const Socket src1{ip4::Addr{66,9,149,187}, 2794};
+  const Socket dst1{ip4::Addr{161,142,100,80}, 1766};
+  EXPECT(rss::hash(src1, dst1, key.data(), key.size(), false) == 0x323e8fc2u);
+  EXPECT(rss::hash(src1, dst1, key.data(), key.size()) == 0x51ccc178u);
+
+  const Socket src2{ip4::Addr{199,92,111,2}, 14230};
+  const Socket dst2{ip4::Addr{65,69,140,83}, 4739};
+  EXPECT(rss::hash(src2, dst2, key.data(), key.size(), false) == 0xd718262au);
+  EXPECT(rss::hash(src2, dst2, key.data(), key.size()) == 0xc626b0eau);
+}
+
+CASE("Toeplitz hash of IPv6 flows matches the RSS verification suite")
+{
+  const auto& key = rss::default_key;
+  const Socket src{ip6::Addr{0x3ffe, 0x2501, 0x200, 0x1fff, 0, 0, 0, 7}, 2794};
+  const Socket dst{ip6::Addr{0x3ffe, 0x2501, 0x200, 3, 0, 0, 0, 1}, 1766};
+  EXPECT(rss::hash(src, dst, key.data(), key.size(), false) == 0x2cc18cd5u);
+  EXPECT(rss::hash(src, dst, key.data(), key.size()) == 0x40207d3du);
+}
+
+CASE("Receive packet steering hashes TCP frames like TCP hashes their flow")
+{
+  const auto& key = rss::default_key;
+  const Socket src{ip4::Addr{66,9,149,187}, 2794};
+  const Socket dst{ip4::Addr{161,142,100,80}, 1766};
+
+  uint8_t frame[14 + 20 + 20] {};
+  frame[12] = 0x08;            // IPv4
+  auto* ip = frame + 14;
+  ip[0] = 0x45;
+  ip[9] = 6;                   // TCP
+  const uint8_t addrs[] {66,9,149,187, 161,142,100,80};
+  std::memcpy(ip + 12, addrs, sizeof(addrs));
+  auto* tcp = ip + 20;
+  tcp[0] = 2794 >> 8; tcp[1] = 2794 & 0xff;
+  tcp[2] = 1766 >> 8; tcp[3] = 1766 & 0xff;
+
+  const auto hash = RPS::flow_hash(frame, sizeof(frame));
+  EXPECT(hash.has_value());
+  EXPECT(*hash == rss::hash(src, dst, key.data(), key.size()));
+
+  // too short for the ports
+  EXPECT_NOT(RPS::flow_hash(frame, 14 + 20 + 2).has_value());
+  // a fragment
+  ip[7] = 1;
+  EXPECT_NOT(RPS::flow_hash(frame, sizeof(frame)).has_value());
+  // UDP
+  ip[7] = 0;
+  ip[9] = 17;
+  EXPECT_NOT(RPS::flow_hash(frame, sizeof(frame)).has_value());
+}
@@ -0,0 +1,134 @@
+#include <common.cxx>
+#include <net/tcp/congestion.hpp>
+
+using namespace net::tcp;
+
+static const uint16_t SMSS = 1460;
+
+struct Window_state {
+  uint32_t cwnd     = 0;
+  uint32_t ssthresh = 0;
+
+  Congestion_window window(uint32_t flight, uint64_t now_us, uint64_t srtt_us = 100'000)
+  { return {cwnd, ssthresh, flight, 0xffff * 64, SMSS, srtt_us, now_us}; }
+};
+
+CASE("Congestion control is created from its algorithm")
+{
+  using Algo = Congestion_control::Algorithm;
+  for (auto algo : {Algo::NEW_RENO, Algo::CUBIC, Algo::BBR})
+  {
+    auto cc = Congestion_control::create(algo);
+    EXPECT(cc->algorithm() == algo);
+    EXPECT(std::string(cc->name()) == to_string(algo));
+  }
+}
+
+CASE("NewReno grows by one segment per ACK in slow start and halves on loss")
+{
+  New_reno cc;
+  Window_state s;
+  auto w = s.window(0, 0);
+  cc.init(w);
+  EXPECT(s.cwnd == 3u * SMSS);
+  EXPECT(w.slow_start());
+
+  cc.on_ack(w, 0, 2 * SMSS);
+  EXPECT(s.cwnd == 4u * SMSS);
+
+  auto lw = s.window(20 * SMSS, 0);
+  cc.on_enter_recovery(lw);
+  EXPECT(s.ssthresh == 10u * SMSS);
+  EXPECT(s.cwnd == 13u * SMSS);
+
+  cc.on_recovery_dup_ack(lw);
+  EXPECT(s.cwnd == 14u * SMSS);
+
+  cc.on_exit_recovery(lw);
+  EXPECT(s.cwnd == s.ssthresh);
+
+  // ssthresh is only reduced on the first timeout
+  auto tw = s.window(2 * SMSS, 0);
+  cc.on_timeout(tw, false);
+  EXPECT(s.ssthresh == 10u * SMSS);
+  EXPECT(s.cwnd == 3u * SMSS);
+  cc.on_timeout(tw, true);
+  EXPECT(s.ssthresh == 2u * SMSS);
+}
+
+CASE("The window is paced over the RTT, faster in slow start")
+{
+  New_reno cc;
+  Window_state s;
+  s.cwnd = 10 * SMSS;
+  s.ssthresh = 100 * SMSS;
+  // no RTT yet, not paced
+  EXPECT(cc.pacing_rate(s.window(0, 0, 0)) == 0u);
+  // 10 segments per 100 ms, twice that in slow start
+  EXPECT(cc.pacing_rate(s.window(0, 0)) == 2u * 10 * SMSS * 10);
+  s.ssthresh = 5 * SMSS;
+  EXPECT(cc.pacing_rate(s.window(0, 0)) == 12u * SMSS * 10);
+}
+
+CASE("CUBIC reduces by beta and grows back to the old window")
+{
+  Cubic cc;
+  Window_state s;
+  auto w = s.window(0, 0);
+  cc.init(w);
+
+  s.cwnd = 100 * SMSS;
+  auto lw = s.window(100 * SMSS, 1'000'000);
+  cc.on_enter_recovery(lw);
+  EXPECT(s.ssthresh == 70u * SMSS);
+  cc.on_exit_recovery(lw);
+  EXPECT(s.cwnd == 70u * SMSS);
+
+  // K = cbrt(30 / 0.4) is about 4.2 s, after which cwnd should be back
+  // at w_max and growing past it
+  uint64_t now = 1'000'000;
+  while (now < 8'000'000)
+  {
+    now += 1'000;
+    auto aw = s.window(s.cwnd, now);
+    cc.on_ack(aw, 0, SMSS);
+  }
+  EXPECT(s.cwnd > 100u * SMSS);
+  EXPECT(s.cwnd < 200u * SMSS);
+}
+
+CASE("BBR sizes its window from the measured bandwidth-delay product")
+{
+  Bbr cc;
+  Window_state s;
+  auto w = s.window(0, 0);
+  cc.init(w);
+  EXPECT(s.cwnd == Bbr::min_segments * SMSS);
+  EXPECT(cc.mode() == Bbr::Mode::STARTUP);
+
+  // a path delivering 100 segments per 10 ms round trip
+  const uint64_t rtt = 10'000;
+  uint64_t now = 0;
+  seq_t seq = 0;
+  for (int round = 0; round < 50; round++)
+  {
+    // time the last segment of the round
+    auto sw = s.window(100 * SMSS, now);
+    cc.on_send(sw, seq + 100 * SMSS);
+    now += rtt;
+    for (int i = 1; i <= 100; i++)
+    {
+      seq += SMSS;
+      auto aw = s.window((100 - i) * SMSS, now);
+      cc.on_ack(aw, seq, SMSS);
+    }
+  }
+
+  const uint64_t bw = 100ull * SMSS * 1'000'000 / rtt;
+  EXPECT(cc.min_rtt() == rtt);
+  EXPECT(cc.bottleneck_bw() == bw);
+  EXPECT(cc.mode() != Bbr::Mode::STARTUP);
+  // at most cwnd_gain times the BDP
+  EXPECT(s.cwnd <= 2u * 100 * SMSS);
+  EXPECT(cc.pacing_rate(s.window(s.cwnd, now)) >= bw * 3 / 4);
+}
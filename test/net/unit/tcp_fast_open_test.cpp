@@ -0,0 +1,68 @@
+#include <common.cxx>
+#include <net/tcp/fast_open.hpp>
+
+using namespace net;
+using namespace net::tcp;
+
+static const Addr client{ip4::Addr{10,0,0,1}};
+static const Addr server{ip4::Addr{10,0,0,42}};
+
+CASE("A Fast Open cookie is only valid for its client")
+{
+  Fast_open fo{{0x0123456789abcdef, 0xfedcba9876543210}};
+  const auto cookie = fo.make(client);
+  EXPECT(cookie.len == Fast_open::COOKIE_LEN);
+  EXPECT(fo.check(client, cookie.data.data(), cookie.len));
+
+  // another client
+  EXPECT(not fo.check(Addr{ip4::Addr{10,0,0,2}}, cookie.data.data(), cookie.len));
+  EXPECT(not fo.check(Addr{ip6::Addr{0xfe80, 0, 0, 0, 0, 0, 0, 1}}, cookie.data.data(), cookie.len));
+  // tampered or cut short
+  auto bad = cookie;
+  bad.data[3] ^= 0x1;
+  EXPECT(not fo.check(client, bad.data.data(), bad.len));
+  EXPECT(not fo.check(client, cookie.data.data(), Fast_open::MIN_COOKIE));
+  // another key
+  Fast_open other{{1, 2}};
+  EXPECT(not other.check(client, cookie.data.data(), cookie.len));
+}
+
+CASE("A Fast Open client remembers the cookie and MSS of servers")
+{
+  Fast_open fo{{42, 43}};
+  EXPECT(fo.cached(server) == nullptr);
+
+  Fast_open::Cookie cookie;
+  cookie.len = 6;
+  cookie.data = {1, 2, 3, 4, 5, 6};
+  fo.cache(server, cookie, 1460);
+
+  const auto* cached = fo.cached(server);
+  EXPECT(cached != nullptr);
+  EXPECT(cached->mss == 1460);
+  EXPECT(cached->cookie.len == 6);
+  EXPECT(cached->cookie.data == cookie.data);
+
+  // too short to be a cookie
+  Fast_open::Cookie tiny;
+  tiny.len = 2;
+  fo.cache(client, tiny, 1460);
+  EXPECT(fo.cached(client) == nullptr);
+
+  fo.forget(server);
+  EXPECT(fo.cached(server) == nullptr);
+}
+
+CASE("The Fast Open cookie cache is bounded")
+{
+  Fast_open fo{{42, 43}};
+  Fast_open::Cookie cookie;
+  cookie.len = Fast_open::COOKIE_LEN;
+  for (uint32_t i = 0; i < Fast_open::CACHE_SIZE + 10; i++)
+    fo.cache(Addr{ip4::Addr{i + 1}}, cookie, 536);
+
+  size_t cached = 0;
+  for (uint32_t i = 0; i < Fast_open::CACHE_SIZE + 10; i++)
+    cached += fo.cached(Addr{ip4::Addr{i + 1}}) != nullptr;
+  EXPECT(cached == Fast_open::CACHE_SIZE);
+}
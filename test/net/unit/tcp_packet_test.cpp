@@ -185,3 +185,54 @@ CASE("TCP checksum")
   tcp->set_tcp_checksum();
   EXPECT(tcp->compute_tcp_checksum() == 0);
 }
+
+#include <net/tcp/packet4_view.hpp>
+CASE("TCP checksum offload leaves a partial sum for the NIC")
+{
+  auto ip4 = create_ip4_packet();
+  ip4->init(Protocol::TCP);
+  tcp::Packet4_view tcp{std::move(ip4)};
+  tcp.init();
+  tcp.set_source({ip4::Addr{10,0,0,1}, 666});
+  tcp.set_destination({ip4::Addr{10,0,0,2}, 667});
+  const std::string data = "Offloaded checksums";
+  tcp.fill((const uint8_t*) data.data(), data.size());
+
+  tcp.set_tcp_checksum_offload();
+  const auto& pkt = *tcp.packet_ptr();
+  EXPECT(pkt.checksum_offloaded());
+  EXPECT(pkt.csum_start() == 20);
+  EXPECT(pkt.csum_offset() == 16);
+  EXPECT(tcp.compute_tcp_checksum() != 0);
+
+  // finish the checksum, as the NIC would
+  auto* start = pkt.layer_begin() + pkt.csum_start();
+  const uint16_t csum = net::checksum(start, pkt.data_end() - start);
+  memcpy(start + pkt.csum_offset(), &csum, sizeof(csum));
+  EXPECT(tcp.compute_tcp_checksum() == 0);
+}
+
+CASE("TCP checksum with the data summed while it was filled in")
+{
+  auto ip4 = create_ip4_packet();
+  ip4->init(Protocol::TCP);
+  tcp::Packet4_view tcp{std::move(ip4)};
+  tcp.init();
+  tcp.set_source({ip4::Addr{10,0,0,1}, 666});
+  tcp.set_destination({ip4::Addr{10,0,0,2}, 667});
+  EXPECT_NOT(tcp.has_data_sum());
+
+  // pieces of odd length, so later ones start at odd offsets
+  const std::string data = "Summed while copying, in pieces of odd length";
+  tcp.fill((const uint8_t*) data.data(), 7);
+  tcp.fill((const uint8_t*) data.data() + 7, 20);
+  tcp.fill((const uint8_t*) data.data() + 27, data.size() - 27);
+  EXPECT(tcp.has_data_sum());
+  EXPECT(tcp.tcp_data_length() == data.size());
+
+  tcp.set_tcp_checksum();
+  // a fresh view sums the data itself
+  tcp::Packet4_view_raw raw{tcp.packet_ptr().get()};
+  EXPECT_NOT(raw.has_data_sum());
+  EXPECT(raw.compute_tcp_checksum() == 0);
+}
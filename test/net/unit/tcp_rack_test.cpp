@@ -0,0 +1,143 @@
+#include <common.cxx>
+#include <net/tcp/rack.hpp>
+
+using namespace net::tcp;
+
+static const uint32_t MSS = 1000;
+
+// send n segments of MSS starting at seq, one every 10 us
+static void send(Rack& rack, seq_t seq, int n, uint64_t now)
+{
+  for (int i = 0; i < n; i++)
+    rack.on_transmit(seq + i * MSS, seq + (i+1) * MSS, now + i * 10);
+}
+
+CASE("RACK tracks the pipe as segments are sent, SACKed and acknowledged")
+{
+  Rack rack;
+  send(rack, 0, 10, 0);
+  EXPECT(rack.size() == 10u);
+  EXPECT(rack.pipe(0, 10 * MSS) == 10 * MSS);
+  // data not yet recorded counts in full
+  EXPECT(rack.pipe(0, 11 * MSS) == 11 * MSS);
+
+  sack::Block blk{4 * MSS, 6 * MSS};
+  rack.on_ack(2 * MSS, &blk, 1, 1000);
+  EXPECT(rack.size() == 8u);
+  EXPECT(rack.pipe(2 * MSS, 10 * MSS) == 6 * MSS);
+  EXPECT(rack.rtt() > 0u);
+
+  // partial ACK into a segment
+  rack.on_ack(2 * MSS + 500, &blk, 1, 1100);
+  EXPECT(rack.pipe(2 * MSS + 500, 10 * MSS) == 5 * MSS + 500);
+
+  rack.on_ack(10 * MSS, nullptr, 0, 1200);
+  EXPECT(rack.empty());
+  EXPECT(rack.pipe(10 * MSS, 10 * MSS) == 0u);
+}
+
+CASE("RACK deems a segment lost once a later one is delivered and the reordering window passed")
+{
+  Rack rack;
+  send(rack, 0, 5, 0);
+  // first one delivered to get an RTT of 1 ms
+  rack.on_ack(MSS, nullptr, 0, 1000);
+  EXPECT(rack.min_rtt() == 1000u);
+
+  // segments 3 and 4 are SACKed, 1 and 2 are not
+  sack::Block blk{3 * MSS, 5 * MSS};
+  rack.on_ack(MSS, &blk, 1, 1040);
+
+  // two SACKed segments and no recovery, so wait min_rtt / 4
+  auto timeout = rack.detect_loss(1040, 100'000, false);
+  EXPECT(not rack.has_lost());
+  EXPECT(timeout > 0u);
+
+  rack.detect_loss(1040 + timeout, 100'000, false);
+  EXPECT(rack.has_lost());
+  auto* lost = rack.next_lost();
+  EXPECT(lost != nullptr);
+  EXPECT(lost->start == MSS);
+  EXPECT(rack.pipe(MSS, 5 * MSS) == 0u);
+
+  // a retransmission of the lost segment puts it back in the pipe
+  rack.on_transmit(MSS, 2 * MSS, 2000);
+  EXPECT(rack.next_lost()->start == 2 * MSS);
+  EXPECT(rack.pipe(MSS, 5 * MSS) == MSS);
+  rack.on_transmit(2 * MSS, 3 * MSS, 2000);
+  EXPECT(not rack.has_lost());
+}
+
+CASE("RACK does not wait for reordering once three segments are SACKed")
+{
+  Rack rack;
+  send(rack, 0, 5, 0);
+  sack::Block blk{MSS, 4 * MSS};
+  rack.on_ack(0, &blk, 1, 1000);
+  EXPECT(rack.detect_loss(1000, 100'000, false) == 0u);
+  EXPECT(rack.has_lost());
+  EXPECT(rack.next_lost()->start == 0u);
+  EXPECT(not rack.reordering_seen());
+}
+
+CASE("RACK notices reordering when a segment is delivered below a SACKed one")
+{
+  Rack rack;
+  send(rack, 0, 4, 0);
+  sack::Block blk{2 * MSS, 3 * MSS};
+  rack.on_ack(0, &blk, 1, 1000);
+  EXPECT(not rack.reordering_seen());
+  // the earlier segments turn up, never retransmitted
+  rack.on_ack(2 * MSS, &blk, 1, 1010);
+  EXPECT(rack.reordering_seen());
+}
+
+CASE("RACK retransmissions split segments to what was resent")
+{
+  Rack rack;
+  rack.on_transmit(0, 4 * MSS, 0);
+  rack.on_timeout();
+  EXPECT(rack.rto_recovery());
+  EXPECT(rack.pipe(0, 4 * MSS) == 0u);
+
+  rack.on_transmit(0, MSS, 100);
+  EXPECT(rack.size() == 2u);
+  EXPECT(rack.pipe(0, 4 * MSS) == MSS);
+  EXPECT(rack.next_lost()->start == MSS);
+
+  rack.on_ack(4 * MSS, nullptr, 0, 200);
+  EXPECT(not rack.rto_recovery());
+  EXPECT(rack.empty());
+}
+
+CASE("A retransmitted tail loss probe that is acknowledged repaired a loss")
+{
+  Rack rack;
+  send(rack, 0, 3, 0);
+  auto* last = rack.last_unsacked();
+  EXPECT(last->start == 2 * MSS);
+
+  rack.on_transmit(2 * MSS, 3 * MSS, 500);
+  rack.on_probe(3 * MSS, true);
+  EXPECT(rack.probing());
+
+  rack.on_ack(3 * MSS, nullptr, 0, 600);
+  EXPECT(not rack.probing());
+  EXPECT(rack.probe_repaired_loss());
+  EXPECT(not rack.probe_repaired_loss());
+
+  // with a DSACK for the probe, the original made it
+  send(rack, 3 * MSS, 1, 700);
+  rack.on_transmit(3 * MSS, 4 * MSS, 800);
+  rack.on_probe(4 * MSS, true);
+  sack::Block dsack{3 * MSS, 4 * MSS};
+  rack.on_ack(4 * MSS, &dsack, 1, 900);
+  EXPECT(not rack.probe_repaired_loss());
+}
+
+CASE("Probe timeout is two RTTs, more for a lone segment, at most the RTO")
+{
+  EXPECT(Rack::pto(10'000, 1'000'000, 10 * MSS, MSS) == 20'000u);
+  EXPECT(Rack::pto(10'000, 1'000'000, MSS, MSS) == 20'000u + Rack::max_ack_delay_us);
+  EXPECT(Rack::pto(10'000, 15'000, 10 * MSS, MSS) == 15'000u);
+}
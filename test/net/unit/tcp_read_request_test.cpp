@@ -1,6 +1,8 @@
 
 #include <common.cxx>
 #include <net/tcp/read_request.hpp>
+#include <net/buffer_store.hpp>
+#include <cstring>
 
 CASE("Operating with out of order data")
 {
@@ -69,3 +71,143 @@ CASE("Operating with out of order data")
 
   EXPECT(seq == (uint32_t)(SEQ_START + SEGSZ*5));
 }
+
+static net::BufferStore bufstore(16, 2048);
+
+// a packet holding a segment of n bytes, all of them set to value
+static net::Packet_ptr create_segment(size_t n, uint8_t value)
+{
+  auto* ptr = (net::Packet*) bufstore.get_buffer();
+  new (ptr) net::Packet(0, n, 2048 - sizeof(net::Packet), &bufstore);
+  std::memset(ptr->layer_begin(), value, n);
+  return net::Packet_ptr(ptr);
+}
+
+CASE("Zero-copy reads hand over the data in the packets it arrived in")
+{
+  using namespace net::tcp;
+  const size_t BUFSZ = 4096;
+  const size_t SEGSZ = 1000;
+  const auto in_use = bufstore.buffers_in_use();
+
+  int no_signals = 0;
+  Read_request req{0, BUFSZ, BUFSZ, Read_request::Alloc(), true};
+  req.on_data_callback = [&no_signals] { no_signals++; };
+  EXPECT(req.zero_copy());
+
+  // the packets as they are handed over after the segments are handled
+  auto insert = [&req] (seq_t seq, uint8_t value, bool psh) {
+    auto ref = std::make_shared<net::Packet_ptr>();
+    auto pkt = create_segment(SEGSZ, value);
+    const auto n = req.insert(seq, ref, pkt->layer_begin(), SEGSZ, psh);
+    *ref = std::move(pkt);
+    return n;
+  };
+
+  // second segment out of order, held back
+  EXPECT(insert(SEGSZ, 2, true) == SEGSZ);
+  EXPECT(req.next_size() == 0u);
+  EXPECT(req.size() == SEGSZ);
+  EXPECT(req.fits(2 * SEGSZ) == 2 * BUFSZ - 3 * SEGSZ);
+  EXPECT(no_signals == 0);
+
+  // filling the gap makes both ready
+  EXPECT(insert(0, 1, false) == SEGSZ);
+  EXPECT(req.next_size() == 2 * SEGSZ);
+  EXPECT(no_signals == 1);
+  EXPECT(bufstore.buffers_in_use() == in_use + 2);
+
+  auto slices = req.read_slices();
+  EXPECT(slices.size() == 2u);
+  EXPECT(slices[0].size() == SEGSZ);
+  EXPECT(slices[0].data()[0] == 1);
+  EXPECT(slices[1].data()[SEGSZ - 1] == 2);
+  EXPECT(req.next_size() == 0u);
+  EXPECT(req.size() == 0u);
+
+  // the buffers go back once the slices are dropped
+  slices.clear();
+  EXPECT(bufstore.buffers_in_use() == in_use);
+
+  // read_next gathers the slices into one buffer
+  insert(2 * SEGSZ, 3, false);
+  insert(3 * SEGSZ, 4, true);
+  auto buf = req.read_next();
+  EXPECT(buf != nullptr);
+  EXPECT(buf->size() == 2 * SEGSZ);
+  EXPECT(buf->at(SEGSZ) == 4);
+  EXPECT(bufstore.buffers_in_use() == in_use);
+}
+
+CASE("The buffer size of a read request can grow and shrink")
+{
+  using namespace net::tcp;
+  const size_t BUFSZ = 4096;
+  const size_t SEGSZ = 1000;
+  uint8_t data[SEGSZ] {};
+  int no_reads = 0;
+
+  Read_request req{0, BUFSZ, BUFSZ};
+  req.on_read_callback = [&no_reads] (auto) { no_reads++; };
+  EXPECT(req.buffer_size() == BUFSZ);
+  EXPECT(req.room(0) == 2 * BUFSZ);
+
+  // a buffer not made yet is sized right away
+  req.set_buffer_size(4 * BUFSZ);
+  EXPECT(req.room(0) == BUFSZ + 4 * BUFSZ);
+  EXPECT(req.fits(BUFSZ) == 4 * BUFSZ);
+  EXPECT(req.insert(BUFSZ, data, SEGSZ) == SEGSZ);
+  EXPECT(req.queue().back()->capacity() == 4 * BUFSZ);
+
+  // the one in use keeps its size until it's done
+  EXPECT(req.front().capacity() == BUFSZ);
+  seq_t seq = 0;
+  while (seq < BUFSZ)
+    seq += req.insert(seq, data, std::min(SEGSZ, BUFSZ - seq));
+  EXPECT(no_reads == 1);
+  EXPECT(req.front().capacity() == 4 * BUFSZ);
+  EXPECT(req.queue().size() == 1u);
+
+  // reused at the new size when it's the only one
+  req.set_buffer_size(BUFSZ);
+  seq = BUFSZ + SEGSZ;
+  while (seq < 5 * BUFSZ)
+    seq += req.insert(seq, data, std::min(SEGSZ, 5 * BUFSZ - seq));
+  EXPECT(no_reads == 2);
+  EXPECT(req.front().capacity() == BUFSZ);
+  EXPECT(req.room(seq) == 2 * BUFSZ);
+}
+
+CASE("An idle read request gives back its buffer, and gets one when data comes")
+{
+  using namespace net::tcp;
+  const size_t BUFSZ = 4096;
+  const size_t SEGSZ = 1460;
+  uint8_t data[SEGSZ];
+  std::memset(data, 'x', sizeof(data));
+  std::vector<buffer_t> reads;
+
+  Read_request req{0, BUFSZ, BUFSZ};
+  req.on_read_callback = [&reads] (auto buf) { reads.push_back(buf); };
+  EXPECT(req.front().buffer()->capacity() >= BUFSZ);
+
+  // not while there is data in it
+  EXPECT(req.insert(0, data, SEGSZ) == SEGSZ);
+  EXPECT(req.release() == 0u);
+
+  // pushed out to the user, who keeps it
+  EXPECT(req.insert(SEGSZ, data, SEGSZ, true) == SEGSZ);
+  EXPECT(reads.size() == 1u);
+  EXPECT(req.release() > 0u);
+  EXPECT(req.front().buffer()->capacity() == 0u);
+  EXPECT(req.front().capacity() == BUFSZ);
+  EXPECT(req.fits(2 * SEGSZ) == BUFSZ);
+  EXPECT(reads[0]->size() == 2 * SEGSZ);
+  EXPECT(req.release() == 0u);
+
+  // allocated again for what arrives
+  EXPECT(req.insert(2 * SEGSZ, data, 100, true) == 100u);
+  EXPECT(reads.size() == 2u);
+  EXPECT(reads[1]->size() == 100u);
+  EXPECT(std::memcmp(reads[1]->data(), data, 100) == 0);
+}
@@ -0,0 +1,87 @@
+#include <common.cxx>
+#include <net/tcp/slab_pool.hpp>
+
+using namespace net::tcp;
+
+CASE("A slab pool reuses freed blocks")
+{
+  Slab_pool pool{24, 4};
+  EXPECT(pool.block_size() % Slab_pool::alignment == 0);
+  EXPECT(pool.capacity() == 0u);
+
+  void* a = pool.allocate();
+  EXPECT(pool.capacity() == 4u);
+  EXPECT(pool.available() == 3u);
+  void* b = pool.allocate();
+  EXPECT(a != b);
+
+  pool.deallocate(a);
+  EXPECT(pool.allocate() == a);
+  pool.deallocate(a);
+  pool.deallocate(b);
+  EXPECT(pool.available() == 4u);
+
+  // runs dry, takes another slab
+  for (int i = 0; i < 5; i++)
+    pool.allocate();
+  EXPECT(pool.capacity() == 8u);
+}
+
+CASE("A slab pool can be filled ahead of use")
+{
+  Slab_pool pool{64};
+  pool.reserve(100);
+  EXPECT(pool.available() == 100u);
+  EXPECT(pool.capacity() == 100u);
+  // already there
+  pool.reserve(50);
+  EXPECT(pool.capacity() == 100u);
+}
+
+struct Thing {
+  static inline int alive = 0;
+  int value;
+  Thing(int v) : value{v} { alive++; }
+  ~Thing() { alive--; }
+};
+
+CASE("Objects are made in and returned to a slab pool")
+{
+  Slab_pool pool{sizeof(Thing), 2};
+  {
+    auto thing = make_slab<Thing>(&pool, 42);
+    EXPECT(thing->value == 42);
+    EXPECT(Thing::alive == 1);
+    EXPECT(pool.available() == 1u);
+  }
+  EXPECT(Thing::alive == 0);
+  EXPECT(pool.available() == 2u);
+
+  // no pool, from the heap
+  auto heap = make_slab<Thing>(nullptr, 1);
+  EXPECT(heap->value == 1);
+  heap = std::make_unique<Thing>(2);
+  EXPECT(heap->value == 2);
+  heap.reset();
+  EXPECT(Thing::alive == 0);
+  EXPECT(pool.available() == 2u);
+}
+
+CASE("Shared objects with their control block in a slab pool")
+{
+  Slab_pool pool{sizeof(Thing) + 64, 1};
+  {
+    auto thing = std::allocate_shared<Thing>(Slab_allocator<Thing>{&pool}, 7);
+    EXPECT(thing->value == 7);
+    EXPECT(pool.capacity() == 1u);
+    EXPECT(pool.available() == 0u);
+  }
+  EXPECT(Thing::alive == 0);
+  EXPECT(pool.available() == 1u);
+
+  // too small for a block, from the heap
+  Slab_pool tiny{1, 1};
+  auto thing = std::allocate_shared<Thing>(Slab_allocator<Thing>{&tiny}, 8);
+  EXPECT(thing->value == 8);
+  EXPECT(tiny.capacity() == 0u);
+}
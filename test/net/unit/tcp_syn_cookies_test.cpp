@@ -0,0 +1,53 @@
+#include <common.cxx>
+#include <net/tcp/syn_cookies.hpp>
+
+using namespace net;
+using namespace net::tcp;
+
+static const Socket local{ip4::Addr{10,0,0,42}, 80};
+static const Socket remote{ip4::Addr{10,0,0,1}, 54321};
+
+CASE("A SYN cookie holds the MSS and is only valid for its connection")
+{
+  Syn_cookies cookies{{0x0123456789abcdef, 0xfedcba9876543210}};
+  const seq_t isn = 1000;
+  const uint64_t now = 12345;
+
+  const seq_t cookie = cookies.make(local, remote, isn, 1460, now);
+  EXPECT(cookies.check(local, remote, isn, cookie, now) == 1460);
+
+  // rounded down to what fits the cookie
+  const seq_t small = cookies.make(local, remote, isn, 1250, now);
+  EXPECT(cookies.check(local, remote, isn, small, now) == 1220);
+  const seq_t tiny = cookies.make(local, remote, isn, 100, now);
+  EXPECT(cookies.check(local, remote, isn, tiny, now) == 536);
+
+  // another peer, port or ISN
+  EXPECT(cookies.check(local, Socket{ip4::Addr{10,0,0,2}, 54321}, isn, cookie, now) == 0);
+  EXPECT(cookies.check(local, Socket{ip4::Addr{10,0,0,1}, 54322}, isn, cookie, now) == 0);
+  EXPECT(cookies.check(local, remote, isn + 1, cookie, now) == 0);
+  // a tampered cookie
+  EXPECT(cookies.check(local, remote, isn, cookie ^ 0x10, now) == 0);
+  EXPECT(cookies.check(local, remote, isn, cookie ^ (1u << 24), now) == 0);
+
+  // another key
+  Syn_cookies other{{1, 2}};
+  EXPECT(other.check(local, remote, isn, cookie, now) == 0);
+}
+
+CASE("A SYN cookie expires after a period")
+{
+  Syn_cookies cookies{{42, 43}};
+  const seq_t isn = 0xfffffff0;
+  const uint64_t period = 1 << Syn_cookies::PERIOD_BITS;
+  const uint64_t made = 100 * period + 10;
+
+  const seq_t cookie = cookies.make(local, remote, isn, 1440, made);
+  EXPECT(cookies.check(local, remote, isn, cookie, made + period - 1) == 1440);
+  EXPECT(cookies.check(local, remote, isn, cookie, made + period + 53) == 1440);
+  EXPECT(cookies.check(local, remote, isn, cookie, made + 2 * period) == 0);
+  // the counter wraps, an old cookie is still rejected
+  EXPECT(cookies.check(local, remote, isn, cookie, made + 32 * period) == 0);
+  // never from the future
+  EXPECT(cookies.check(local, remote, isn, cookie, made - period) == 0);
+}
@@ -0,0 +1,73 @@
+#include <common.cxx>
+#include <net/tcp/time_wait.hpp>
+#include <vector>
+
+using namespace net;
+using namespace net::tcp;
+
+static Time_wait::Tuple tuple(uint16_t port)
+{
+  return {Socket{ip4::Addr{10,0,0,42}, 80}, Socket{ip4::Addr{10,0,0,1}, port}};
+}
+
+static Time_wait::Entry entry(uint64_t expires)
+{ return {1000, 2000, 0, 0xffff, false, expires}; }
+
+CASE("TIME-WAIT tombstones expire in order")
+{
+  Time_wait tw;
+  EXPECT(tw.empty());
+  EXPECT(tw.next_expiry() == 0u);
+
+  tw.insert(tuple(1), entry(100));
+  tw.insert(tuple(2), entry(150));
+  tw.insert(tuple(3), entry(200));
+  EXPECT(tw.size() == 3u);
+  EXPECT(tw.next_expiry() == 100u);
+
+  auto* e = tw.find(tuple(2));
+  EXPECT(e != nullptr);
+  EXPECT(e->snd_nxt == 1000u);
+  EXPECT(e->rcv_nxt == 2000u);
+  EXPECT(tw.find(tuple(4)) == nullptr);
+
+  std::vector<uint16_t> expired;
+  auto on_expired = [&expired] (const Time_wait::Tuple& t) {
+    expired.push_back(t.second.port());
+  };
+  EXPECT(tw.expire(99, on_expired) == 0u);
+  EXPECT(tw.expire(150, on_expired) == 2u);
+  EXPECT(expired == std::vector<uint16_t>({1, 2}));
+  EXPECT(tw.size() == 1u);
+  EXPECT(tw.next_expiry() == 200u);
+}
+
+CASE("A restarted or removed TIME-WAIT tombstone is not expired early")
+{
+  Time_wait tw;
+  tw.insert(tuple(1), entry(100));
+  tw.insert(tuple(2), entry(110));
+  tw.insert(tuple(3), entry(120));
+
+  // a retransmitted FIN
+  tw.restart(tuple(1), 200);
+  EXPECT(tw.find(tuple(1))->expires == 200u);
+  // a new connection took over
+  EXPECT(tw.erase(tuple(2)));
+  EXPECT(not tw.erase(tuple(2)));
+  // and went into TIME-WAIT again
+  tw.insert(tuple(2), entry(250));
+
+  std::vector<uint16_t> expired;
+  auto on_expired = [&expired] (const Time_wait::Tuple& t) {
+    expired.push_back(t.second.port());
+  };
+  EXPECT(tw.expire(150, on_expired) == 1u);
+  EXPECT(expired == std::vector<uint16_t>({3}));
+  EXPECT(tw.next_expiry() == 200u);
+
+  EXPECT(tw.expire(300, on_expired) == 2u);
+  EXPECT(expired == std::vector<uint16_t>({3, 1, 2}));
+  EXPECT(tw.empty());
+  EXPECT(tw.next_expiry() == 0u);
+}
@@ -0,0 +1,125 @@
+#include <common.cxx>
+#include <net/tcp/timer_wheel.hpp>
+#include <memory>
+#include <vector>
+
+using namespace net::tcp;
+using namespace std::chrono;
+
+static uint64_t fake_ns = 0;
+static uint64_t fake_clock() { return fake_ns; }
+
+// run the wheel up to a point in time, as the kernel timer would
+static void run_to(Timer_wheel& wheel, milliseconds t)
+{
+  fake_ns = duration_cast<nanoseconds>(t).count();
+  wheel.advance(fake_ns / Timer_wheel::TICK_NS);
+}
+
+// records the tick each timer ran at
+struct Recorder {
+  Timer_wheel& wheel;
+  std::vector<uint64_t> fired {};
+  void on_timeout() { fired.push_back(wheel.now()); }
+};
+
+CASE("Timer wheel runs timers on time, never early")
+{
+  fake_ns = 0;
+  Timer_wheel wheel{fake_clock};
+  Recorder rec{wheel};
+  Wheel_timer a{wheel, {&rec, &Recorder::on_timeout}};
+  Wheel_timer b{wheel, {&rec, &Recorder::on_timeout}};
+
+  a.start(10ms);
+  // part of a tick is rounded up
+  b.start(microseconds(20'500));
+  EXPECT(a.is_running());
+  EXPECT(wheel.size() == 2u);
+  EXPECT(wheel.next_event() == 10u);
+
+  run_to(wheel, 9ms);
+  EXPECT(rec.fired.empty());
+  run_to(wheel, 10ms);
+  EXPECT(rec.fired.size() == 1u);
+  EXPECT(not a.is_running());
+  run_to(wheel, 20ms);
+  EXPECT(rec.fired.size() == 1u);
+  run_to(wheel, 21ms);
+  EXPECT(rec.fired.size() == 2u);
+  EXPECT(wheel.empty());
+  EXPECT(wheel.next_event() == 0u);
+}
+
+CASE("Timer wheel restarts and stops timers")
+{
+  fake_ns = 0;
+  Timer_wheel wheel{fake_clock};
+  Recorder rec{wheel};
+  Wheel_timer t{wheel, {&rec, &Recorder::on_timeout}};
+
+  t.start(100ms);
+  // start does nothing on a running timer, restart moves it
+  t.start(10ms);
+  EXPECT(wheel.next_event() > 10u);
+  t.restart(50ms);
+  run_to(wheel, 60ms);
+  EXPECT(rec.fired == std::vector<uint64_t>{50});
+
+  t.start(10ms);
+  t.stop();
+  EXPECT(not t.is_running());
+  EXPECT(wheel.empty());
+  run_to(wheel, 200ms);
+  EXPECT(rec.fired.size() == 1u);
+
+  // a destroyed timer is unlinked
+  {
+    Wheel_timer tmp{wheel, {&rec, &Recorder::on_timeout}};
+    tmp.start(10ms);
+    EXPECT(wheel.size() == 1u);
+  }
+  EXPECT(wheel.empty());
+}
+
+CASE("Timer wheel moves timers down the levels and runs them at their tick")
+{
+  fake_ns = 0;
+  Timer_wheel wheel{fake_clock};
+  Recorder rec{wheel};
+  std::vector<std::unique_ptr<Wheel_timer>> timers;
+  // one per level, and one past the top level
+  const std::vector<uint64_t> at {
+    63, 64, 1000, 4095, 4096, 70'000, 300'000, 20'000'000
+  };
+  for (auto ms : at)
+  {
+    timers.push_back(std::make_unique<Wheel_timer>(wheel, Timer_wheel::handler_t{&rec, &Recorder::on_timeout}));
+    timers.back()->start(milliseconds(ms));
+  }
+
+  for (auto ms : at)
+    run_to(wheel, milliseconds(ms));
+
+  EXPECT(rec.fired == at);
+  EXPECT(wheel.empty());
+}
+
+CASE("Timer wheel lets handlers re-arm their own timer")
+{
+  fake_ns = 0;
+  Timer_wheel wheel{fake_clock};
+  int count = 0;
+  Wheel_timer* self = nullptr;
+  Wheel_timer t{wheel, [&count, &self] {
+    if (++count < 3) self->start(5ms);
+  }};
+  self = &t;
+
+  t.start(5ms);
+  run_to(wheel, 100ms);
+  EXPECT(count == 1);
+  // the handler re-arms relative to the clock, which the run jumped past
+  run_to(wheel, 200ms);
+  EXPECT(count == 2);
+}
@@ -0,0 +1,99 @@
+#include <common.cxx>
+#include <net/tcp/tx_scheduler.hpp>
+#include <vector>
+
+using namespace net::tcp;
+
+// a flow with packets to send, recording what it was given
+struct Flow {
+  int    id;
+  size_t backlog;
+  std::vector<int>* log;
+};
+
+static bool send(Flow*& flow, size_t& budget)
+{
+  while (budget > 0 and flow->backlog > 0) {
+    budget--;
+    flow->backlog--;
+    flow->log->push_back(flow->id);
+  }
+  return flow->backlog > 0;
+}
+
+static size_t count(const std::vector<int>& log, int id)
+{ return std::count(log.begin(), log.end(), id); }
+
+CASE("Flows of a class share the packets in rounds")
+{
+  std::vector<int> log;
+  Flow bulk{1, 1000, &log}, small{2, 3, &log}, other{3, 1000, &log};
+  Tx_scheduler<Flow*> sched;
+  sched.set_quantum(Tx_priority::NORMAL, 4);
+  EXPECT(sched.quantum(Tx_priority::NORMAL) == 4u);
+
+  sched.push(&bulk);
+  sched.push(&small);
+  sched.push(&other);
+  EXPECT(sched.size() == 3u);
+
+  size_t packets = 20;
+  sched.serve(packets, send);
+  EXPECT(packets == 0u);
+  // the bulk flow doesn't get it all, the small one is done
+  EXPECT(small.backlog == 0u);
+  EXPECT(count(log, 1) == 9u);
+  EXPECT(count(log, 2) == 3u);
+  EXPECT(count(log, 3) == 8u);
+  EXPECT(sched.size() == 2u);
+}
+
+CASE("A flow cut short by the NIC goes first next time")
+{
+  std::vector<int> log;
+  Flow a{1, 1000, &log}, b{2, 1000, &log};
+  Tx_scheduler<Flow*> sched;
+  sched.set_quantum(Tx_priority::NORMAL, 4);
+  sched.push(&a);
+  sched.push(&b);
+
+  size_t packets = 2;
+  sched.serve(packets, send);
+  EXPECT(log == std::vector<int>({1, 1}));
+
+  // what is left of its quantum, then the other
+  log.clear();
+  packets = 4;
+  sched.serve(packets, send);
+  EXPECT(log == std::vector<int>({1, 1, 2, 2}));
+}
+
+CASE("Interactive flows go first, bulk ones last")
+{
+  std::vector<int> log;
+  Flow bulk{1, 1000, &log}, normal{2, 1000, &log}, chat{3, 2, &log};
+  Tx_scheduler<Flow*> sched;
+  sched.push(&bulk, Tx_priority::BULK);
+  sched.push(&normal, Tx_priority::NORMAL);
+  EXPECT(sched.waiting());
+  EXPECT(sched.waiting(Tx_priority::NORMAL));
+  EXPECT(not sched.waiting(Tx_priority::INTERACTIVE));
+  sched.push(&chat, Tx_priority::INTERACTIVE);
+  EXPECT(sched.waiting(Tx_priority::INTERACTIVE));
+
+  size_t packets = 10;
+  sched.serve(packets, send);
+  EXPECT(log.front() == 3);
+  EXPECT(count(log, 3) == 2u);
+  EXPECT(count(log, 2) == 8u);
+  EXPECT(count(log, 1) == 0u);
+  EXPECT(not sched.waiting(Tx_priority::INTERACTIVE));
+
+  // nothing above it left to send
+  normal.backlog = 0;
+  log.clear();
+  packets = 5;
+  sched.serve(packets, send);
+  EXPECT(count(log, 1) == 5u);
+  EXPECT(sched.size() == 1u);
+}
@@ -214,3 +214,112 @@ CASE("Creating a WriteQueue and operate it")
     }
   }
 };
+
+CASE("A segment can be gathered from several small writes")
+{
+  Write_queue wq;
+  std::vector<size_t> written;
+  wq.on_write([&written](size_t n) { written.push_back(n); });
+
+  for (int i = 0; i < 4; i++)
+  {
+    auto buf = create_write_request(100);
+    std::fill(buf->begin(), buf->end(), i);
+    wq.push_back(buf);
+  }
+
+  std::vector<uint8_t> seg;
+  auto copy = [&seg](const uint8_t* data, uint32_t len) {
+    seg.insert(seg.end(), data, data + len);
+    return len;
+  };
+
+  // gather the unsent data into one segment of at most 250 bytes
+  EXPECT( wq.gather(wq.bytes_in_flight(), 250, copy) == 250u );
+  EXPECT( seg.size() == 250u );
+  EXPECT( seg[99] == 0 );
+  EXPECT( seg[100] == 1 );
+  EXPECT( seg[249] == 2 );
+
+  wq.advance(250);
+  EXPECT( wq.current() == 2u );
+  EXPECT( wq.offset() == 50u );
+  EXPECT( written.size() == 2u );
+  EXPECT( wq.bytes_in_flight() == 250u );
+  EXPECT( wq.bytes_remaining() == 150u );
+
+  // the rest, starting in the middle of a buffer
+  seg.clear();
+  EXPECT( wq.gather(wq.bytes_in_flight(), 1000, copy) == 150u );
+  EXPECT( seg.front() == 2 );
+  EXPECT( seg.back() == 3 );
+
+  // retransmission from within the acknowledged part of the first buffer
+  wq.acknowledge(120);
+  seg.clear();
+  EXPECT( wq.gather(30, 100, copy) == 100u );
+  EXPECT( seg.front() == 1 );
+  EXPECT( seg.back() == 2 );
+  EXPECT( wq.bytes_unacknowledged() == 280u );
+
+  // a sink that stops taking ends the walk
+  EXPECT( wq.gather(0, 1000, [](const uint8_t*, uint32_t len) { return len / 2; }) == 40u );
+}
+
+CASE("Memory that isn't copied is written where it is, and its owner kept until acknowledged")
+{
+  Write_queue wq;
+  static const uint8_t file[300] = {7};
+  auto owner = std::make_shared<int>(0);
+
+  wq.push_back({file, sizeof(file), owner});
+  wq.push_back(create_write_request(100));
+  EXPECT( wq.bytes_total() == 400u );
+  EXPECT( wq.nxt_data() == file );
+  EXPECT( owner.use_count() == 2 );
+
+  const uint8_t* first = nullptr;
+  EXPECT( wq.gather(0, 400, [&first](const uint8_t* data, uint32_t len) {
+    if (first == nullptr) first = data;
+    return len;
+  }) == 400u );
+  EXPECT( first == file );
+
+  wq.advance(400);
+  wq.acknowledge(299);
+  EXPECT( owner.use_count() == 2 );
+  wq.acknowledge(1);
+  EXPECT( owner.use_count() == 1 );
+  EXPECT( wq.bytes_unacknowledged() == 100u );
+}
+
+CASE("A queue at its high watermark is full until acknowledged down to its low")
+{
+  Write_queue wq;
+  int drained = 0;
+  wq.on_drain([&drained] { drained++; });
+
+  // unbounded by default
+  wq.push_back(create_write_request(5000));
+  EXPECT( not wq.full() );
+
+  wq.set_watermarks(3000, 1000);
+  EXPECT( wq.full() );
+  wq.advance(5000);
+  wq.acknowledge(3000);
+  EXPECT( wq.full() );
+  EXPECT( drained == 0 );
+
+  wq.push_back(create_write_request(1000));
+  wq.acknowledge(2000);
+  EXPECT( not wq.full() );
+  EXPECT( drained == 1 );
+
+  // writes are never refused
+  wq.push_back(create_write_request(4000));
+  EXPECT( wq.full() );
+  EXPECT( wq.bytes_total() == 5000u );
+  wq.reset();
+  EXPECT( not wq.full() );
+  EXPECT( drained == 1 );
+}
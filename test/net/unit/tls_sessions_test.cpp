@@ -0,0 +1,54 @@
+#include <common.cxx>
+#include <net/https/tls_sessions.hpp>
+
+using namespace http;
+
+CASE("The TLS session cache drops the least recently used session when full")
+{
+  TLS_session_cache cache{2, std::chrono::seconds{300}};
+  cache.store("a", "session a");
+  cache.store("b", "session b");
+  EXPECT(cache.size() == 2u);
+
+  // a is now more recent than b
+  auto* found = cache.find("a");
+  EXPECT(found != nullptr);
+  EXPECT(*found == "session a");
+
+  cache.store("c", "session c");
+  EXPECT(cache.size() == 2u);
+  EXPECT(cache.find("b") == nullptr);
+  EXPECT(cache.find("a") != nullptr);
+  EXPECT(cache.find("c") != nullptr);
+
+  // replacing keeps the size
+  cache.store("c", "session c2");
+  EXPECT(*cache.find("c") == "session c2");
+  EXPECT(cache.size() == 2u);
+
+  cache.erase("a");
+  EXPECT(cache.find("a") == nullptr);
+  EXPECT(cache.size() == 1u);
+}
+
+CASE("A TLS session cache of size 0 keeps nothing")
+{
+  TLS_session_cache cache{0, std::chrono::seconds{300}};
+  cache.store("a", "session a");
+  EXPECT(cache.size() == 0u);
+  EXPECT(cache.find("a") == nullptr);
+}
+
+CASE("Session ticket keys are found by name until rotated out")
+{
+  TLS_ticket_keys keys{std::chrono::seconds{3600}};
+  const auto& key = keys.current();
+  // the same key within the period
+  EXPECT(&keys.current() == &key);
+  EXPECT(keys.find(key.name.data()) == &key);
+  EXPECT_NOT(keys.is_retired(key));
+
+  auto name = key.name;
+  name[0] ^= 0xff;
+  EXPECT(keys.find(name.data()) == nullptr);
+}
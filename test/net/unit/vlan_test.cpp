@@ -0,0 +1,82 @@
+#include <common.cxx>
+#include <net/buffer_store.hpp>
+#include <net/ethernet/ethernet_8021q.hpp>
+
+using namespace net;
+
+static BufferStore bufstore(16, 2048);
+static const MAC::Addr our_mac {0xc0, 0x01, 0x0a, 0x00, 0x00, 0x2a};
+
+static Packet_ptr create_frame(int header_len)
+{
+  auto* ptr = (net::Packet*) bufstore.get_buffer();
+  new (ptr) net::Packet(0, 0, 1500, &bufstore);
+  Packet_ptr pkt(ptr);
+  pkt->increment_data_end(header_len + 20);
+  return pkt;
+}
+
+// a frame as it arrives, with the 802.1Q tag in it
+static Packet_ptr tagged_frame(int vid, Ethertype type)
+{
+  auto pkt = create_frame(sizeof(ethernet::VLAN_header));
+  auto& hdr = *(ethernet::VLAN_header*) pkt->layer_begin();
+  hdr.dest = our_mac;
+  hdr.src  = MAC::BROADCAST;
+  hdr.tpid = static_cast<uint16_t>(Ethertype::VLAN);
+  hdr.set_vid(vid);
+  hdr.type = type;
+  return pkt;
+}
+
+// a frame the NIC took the tag off
+static Packet_ptr stripped_frame(int vid, Ethertype type)
+{
+  auto pkt = create_frame(sizeof(ethernet::Header));
+  auto& hdr = *(ethernet::Header*) pkt->layer_begin();
+  hdr.set_dest(our_mac);
+  hdr.set_src(MAC::BROADCAST);
+  hdr.set_type(type);
+  pkt->set_vlan_id(vid);
+  return pkt;
+}
+
+static void drop(Packet_ptr) {}
+
+CASE("Frames are VLAN tagged in software unless the NIC stripped the tag")
+{
+  Ethernet_8021Q vlan({drop}, our_mac, 42);
+  Packet::Byte_ptr ip_begin = nullptr;
+  vlan.set_ip4_upstream({[&ip_begin] (Packet_ptr pkt, bool) {
+    ip_begin = pkt->layer_begin();
+  }});
+
+  auto tagged = tagged_frame(42, Ethertype::IP4);
+  EXPECT(tagged->vlan_id() == 0);
+  auto* begin = tagged->layer_begin();
+  vlan.receive(std::move(tagged));
+  EXPECT(ip_begin == begin + sizeof(ethernet::VLAN_header));
+
+  auto stripped = stripped_frame(42, Ethertype::IP4);
+  begin = stripped->layer_begin();
+  vlan.receive(std::move(stripped));
+  EXPECT(ip_begin == begin + sizeof(ethernet::Header));
+}
+
+CASE("Ethernet hands frames with a stripped tag to the VLAN upstream")
+{
+  Ethernet eth({drop}, our_mac);
+  int vlan_frames = 0, ip_frames = 0;
+  eth.set_vlan_upstream({[&vlan_frames] (Packet_ptr) { vlan_frames++; }});
+  eth.set_ip4_upstream({[&ip_frames] (Packet_ptr, bool) { ip_frames++; }});
+
+  eth.receive(tagged_frame(7, Ethertype::IP4));
+  eth.receive(stripped_frame(7, Ethertype::IP4));
+  EXPECT(vlan_frames == 2);
+  EXPECT(ip_frames == 0);
+
+  auto plain = stripped_frame(0, Ethertype::IP4);
+  eth.receive(std::move(plain));
+  EXPECT(vlan_frames == 2);
+  EXPECT(ip_frames == 1);
+}
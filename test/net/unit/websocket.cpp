@@ -150,3 +150,72 @@ CASE("Send some short websocket data")
       ws->write(data_string);
     });
 }
+
+CASE("Masking matches the byte-wise XOR for every length and alignment")
+{
+  const char key[4] = { 0x12, 0x34, 0x56, 0x78 };
+  std::vector<char> data(203), expected;
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = (char) (i * 7);
+
+  for (size_t start = 0; start < 4; start++)
+  for (size_t len = 0; len + start <= data.size(); len += 13)
+  {
+    auto copy = data;
+    expected = data;
+    for (size_t i = 0; i < len; i++)
+      expected[start + i] ^= key[i & 3];
+    net::ws_header::mask(&copy[start], len, key);
+    EXPECT(copy == expected);
+  }
+}
+
+CASE("permessage-deflate is negotiated within what the server agrees to")
+{
+  net::WS_deflate_params config;
+  config.server_max_window_bits = 12;
+  net::WS_deflate_params agreed;
+  std::string response;
+
+  EXPECT(net::WS_deflate_params::negotiate(
+      "x-webkit-deflate-frame, permessage-deflate; client_max_window_bits; server_max_window_bits=14",
+      config, agreed, response));
+  EXPECT(agreed.server_max_window_bits == 12);
+  EXPECT(response == "permessage-deflate; server_max_window_bits=12");
+
+  EXPECT_NOT(net::WS_deflate_params::negotiate(
+      "permessage-deflate; server_max_window_bits=16", config, agreed, response));
+
+  net::WS_deflate_params offered;
+  offered.server_no_context_takeover = true;
+  EXPECT(offered.offer() == "permessage-deflate; client_max_window_bits; server_no_context_takeover");
+  EXPECT(net::WS_deflate_params::accept(
+      "permessage-deflate; server_no_context_takeover; client_max_window_bits=10", offered));
+  EXPECT(offered.client_max_window_bits == 10);
+  EXPECT_NOT(net::WS_deflate_params::accept("permessage-deflate; foo", offered));
+}
+
+CASE("Messages deflate and inflate, with and without context takeover")
+{
+  std::string json;
+  for (int i = 0; i < 200; i++)
+    json += "{\"id\":" + std::to_string(i) + ",\"price\":" + std::to_string(i * 37 % 1000) + "},";
+
+  for (const bool reset : {false, true})
+  {
+    net::WS_deflater deflater(15, 8);
+    net::WS_inflater inflater(15);
+    for (int n = 0; n < 3; n++)
+    {
+      std::vector<uint8_t> packed, plain;
+      deflater.compress((const uint8_t*) json.data(), json.size(), packed, reset);
+      EXPECT(packed.size() < json.size() / 2);
+      EXPECT(inflater.decompress(packed.data(), packed.size(), plain, reset));
+      EXPECT(std::string(plain.begin(), plain.end()) == json);
+      // more than the limit is not decompressed
+      plain.clear();
+      if (reset)
+        EXPECT_NOT(inflater.decompress(packed.data(), packed.size(), plain, true, 100));
+    }
+  }
+}
@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+# Load generation and results for the performance services.
+#
+# Each benchmark appends one JSON object per line to the file named by
+# BENCH_RESULTS (bench_results.json in the working directory by default),
+# tagged with the commit, so runs on different commits can be compared.
+
+from __future__ import print_function
+import base64
+import http.client
+import json
+import os
+import socket
+import ssl
+import struct
+import subprocess
+import threading
+import time
+
+def percentile(samples, p):
+    if not samples:
+        return 0.0
+    samples = sorted(samples)
+    index = min(len(samples) - 1, int(round(p / 100.0 * (len(samples) - 1))))
+    return samples[index]
+
+def git_commit():
+    src = os.environ.get('INCLUDEOS_SRC', os.path.dirname(os.path.realpath(__file__)))
+    try:
+        return subprocess.check_output(["git", "-C", src, "rev-parse", "HEAD"],
+                                       stderr=subprocess.DEVNULL).decode().strip()
+    except Exception:
+        return "unknown"
+
+def run_clients(clients, duration, client):
+    """ Run client(deadline, latencies, errors) in a number of threads for
+        a duration, and summarize the latencies (seconds) they record """
+    results = [([], [0]) for _ in range(clients)]
+    deadline = time.time() + duration
+    threads = [threading.Thread(target=client, args=(deadline,) + r) for r in results]
+    start = time.time()
+    for t in threads: t.start()
+    for t in threads: t.join()
+    elapsed = time.time() - start
+
+    latencies = [l for r in results for l in r[0]]
+    return {
+        "clients":  clients,
+        "seconds":  round(elapsed, 3),
+        "count":    len(latencies),
+        "errors":   sum(r[1][0] for r in results),
+        "per_sec":  round(len(latencies) / elapsed, 1),
+        "p50_us":   round(percentile(latencies, 50) * 1e6, 1),
+        "p99_us":   round(percentile(latencies, 99) * 1e6, 1),
+    }
+
+def http_client(host, port, path):
+    """ Requests over one keep-alive connection, reconnecting on errors """
+    def client(deadline, latencies, errors):
+        conn = None
+        while time.time() < deadline:
+            try:
+                if conn is None:
+                    conn = http.client.HTTPConnection(host, port, timeout=5)
+                start = time.perf_counter()
+                conn.request("GET", path)
+                conn.getresponse().read()
+                latencies.append(time.perf_counter() - start)
+            except (OSError, http.client.HTTPException):
+                errors[0] += 1
+                conn = None
+    return client
+
+def https_handshake_client(host, port):
+    """ A full handshake (no resumption) and one request per connection """
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    context.check_hostname = False
+    context.verify_mode = ssl.CERT_NONE
+    request = ("GET / HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n" % host).encode()
+    def client(deadline, latencies, errors):
+        while time.time() < deadline:
+            try:
+                start = time.perf_counter()
+                with socket.create_connection((host, port), timeout=5) as sock:
+                    with context.wrap_socket(sock) as tls:
+                        latencies.append(time.perf_counter() - start)
+                        tls.sendall(request)
+                        while tls.recv(4096): pass
+            except (OSError, ssl.SSLError):
+                errors[0] += 1
+    return client
+
+class WebSocket(object):
+    """ Just enough of a WebSocket client to measure message round trips """
+    def __init__(self, host, port, path="/"):
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall(("GET %s HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\n"
+                           "Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n" % (path, host, port, key)).encode())
+        self.reader = self.sock.makefile('rb')
+        status = self.reader.readline()
+        if b" 101 " not in status:
+            raise OSError("WebSocket upgrade failed: %r" % status)
+        while self.reader.readline() not in (b"\r\n", b""): pass
+
+    def send(self, payload, opcode=2):
+        mask = os.urandom(4)
+        header = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        elif len(payload) < 65536:
+            header += bytes([0x80 | 126]) + struct.pack("!H", len(payload))
+        else:
+            header += bytes([0x80 | 127]) + struct.pack("!Q", len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def recv(self):
+        head = self.reader.read(2)
+        if len(head) < 2:
+            raise OSError("WebSocket closed")
+        length = head[1] & 0x7f
+        if length == 126:
+            length = struct.unpack("!H", self.reader.read(2))[0]
+        elif length == 127:
+            length = struct.unpack("!Q", self.reader.read(8))[0]
+        return self.reader.read(length)
+
+    def close(self):
+        self.sock.close()
+
+def websocket_client(host, port, size):
+    """ Message round trips, one at a time, over one WebSocket """
+    payload = os.urandom(size)
+    def client(deadline, latencies, errors):
+        ws = None
+        while time.time() < deadline:
+            try:
+                if ws is None:
+                    ws = WebSocket(host, port)
+                start = time.perf_counter()
+                ws.send(payload)
+                if len(ws.recv()) != size:
+                    raise OSError("short echo")
+                latencies.append(time.perf_counter() - start)
+            except OSError:
+                errors[0] += 1
+                if ws: ws.close()
+                ws = None
+        if ws: ws.close()
+    return client
+
+def run_streams(clients, duration, stream):
+    """ Run stream(deadline, totals, errors) in a number of threads for a
+        duration, where totals is [bytes, packets], and sum up the rates """
+    results = [([0, 0], [0]) for _ in range(clients)]
+    deadline = time.time() + duration
+    threads = [threading.Thread(target=stream, args=(deadline,) + r) for r in results]
+    start = time.time()
+    for t in threads: t.start()
+    for t in threads: t.join()
+    elapsed = time.time() - start
+
+    total_bytes = sum(r[0][0] for r in results)
+    packets = sum(r[0][1] for r in results)
+    return {
+        "clients":  clients,
+        "seconds":  round(elapsed, 3),
+        "count":    packets,
+        "errors":   sum(r[1][0] for r in results),
+        "gbit_per_sec": round(total_bytes * 8 / elapsed / 1e9, 3),
+        "pps":      round(packets / elapsed, 1),
+    }
+
+def tcp_send_stream(host, port, size=65536):
+    """ Bulk data to the service, over one connection """
+    chunk = os.urandom(size)
+    def stream(deadline, totals, errors):
+        try:
+            with socket.create_connection((host, port), timeout=5) as sock:
+                while time.time() < deadline:
+                    sock.sendall(chunk)
+                    totals[0] += size
+                    totals[1] += 1
+        except OSError:
+            errors[0] += 1
+    return stream
+
+def tcp_recv_stream(host, port, size=65536):
+    """ Bulk data from the service, over one connection """
+    def stream(deadline, totals, errors):
+        try:
+            with socket.create_connection((host, port), timeout=5) as sock:
+                while time.time() < deadline:
+                    data = sock.recv(size)
+                    if not data:
+                        raise OSError("closed by the service")
+                    totals[0] += len(data)
+                    totals[1] += 1
+        except OSError:
+            errors[0] += 1
+    return stream
+
+def tcp_rr_client(host, port, size=1):
+    """ Transactions of one request and one response, like netperf TCP_RR """
+    payload = os.urandom(size)
+    def client(deadline, latencies, errors):
+        sock = None
+        while time.time() < deadline:
+            try:
+                if sock is None:
+                    sock = socket.create_connection((host, port), timeout=5)
+                    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                start = time.perf_counter()
+                sock.sendall(payload)
+                got = 0
+                while got < size:
+                    data = sock.recv(size - got)
+                    if not data:
+                        raise OSError("closed by the service")
+                    got += len(data)
+                latencies.append(time.perf_counter() - start)
+            except OSError:
+                errors[0] += 1
+                if sock: sock.close()
+                sock = None
+        if sock: sock.close()
+    return client
+
+def udp_flood_stream(host, port, size):
+    """ Datagrams as fast as they can be sent; count what arrives in the
+        service, since UDP may drop them anywhere on the way """
+    payload = os.urandom(size)
+    def stream(deadline, totals, errors):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.connect((host, port))
+        while time.time() < deadline:
+            # check the time only now and then, it's slower than sending
+            for _ in range(100):
+                try:
+                    sock.send(payload)
+                    totals[0] += size
+                    totals[1] += 1
+                except OSError:
+                    errors[0] += 1
+        sock.close()
+    return stream
+
+def udp_rr_client(host, port, size):
+    """ Round trips of datagrams, one in flight; a lost one is an error """
+    payload = os.urandom(size)
+    def client(deadline, latencies, errors):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.settimeout(0.5)
+        sock.connect((host, port))
+        while time.time() < deadline:
+            try:
+                start = time.perf_counter()
+                sock.send(payload)
+                sock.recv(size)
+                latencies.append(time.perf_counter() - start)
+            except OSError:
+                errors[0] += 1
+        sock.close()
+    return client
+
+def iperf3(server, seconds, extra=[], netns=None):
+    """ Run an iperf3 client, and summarize its JSON output """
+    cmd = ["iperf3", "-c", server, "-t", str(seconds), "-J"] + extra
+    if netns:
+        cmd = ["sudo", "ip", "netns", "exec", netns] + cmd
+    out = json.loads(subprocess.check_output(cmd, timeout=seconds + 30).decode())
+    end = out.get("end", {})
+    if "sum_received" in end:
+        # TCP
+        received = end["sum_received"]
+        return {
+            "seconds":  round(received["seconds"], 3),
+            "errors":   end.get("sum_sent", {}).get("retransmits", 0),
+            "gbit_per_sec": round(received["bits_per_second"] / 1e9, 3),
+        }
+    # UDP, as seen by the server
+    total = end.get("sum", {})
+    seconds = total.get("seconds", seconds) or seconds
+    packets = total.get("packets", 0)
+    lost = total.get("lost_packets", 0)
+    return {
+        "seconds":  round(seconds, 3),
+        "count":    packets,
+        "errors":   lost,
+        "gbit_per_sec": round(total.get("bits_per_second", 0) / 1e9, 3),
+        "pps":      round((packets - lost) / seconds, 1),
+        "jitter_us": round(total.get("jitter_ms", 0) * 1000, 1),
+    }
+
+def service_stats(host, port, path, tls=False):
+    if tls:
+        context = ssl._create_unverified_context()
+        conn = http.client.HTTPSConnection(host, port, timeout=5, context=context)
+    else:
+        conn = http.client.HTTPConnection(host, port, timeout=5)
+    conn.request("GET", path)
+    body = conn.getresponse().read()
+    conn.close()
+    return json.loads(body.decode() or "{}")
+
+def reset_stats(host, port, tls=False):
+    service_stats(host, port, "/bench/reset", tls)
+
+def read_stats(host, port, tls=False):
+    return service_stats(host, port, "/bench/stats", tls)
+
+def report(name, results):
+    """ Print a result and append it to the results file """
+    record = { "benchmark": name, "commit": git_commit(), "time": int(time.time()) }
+    record.update(results)
+    line = json.dumps(record, sort_keys=True)
+    print("BENCH " + line)
+    with open(os.environ.get('BENCH_RESULTS', 'bench_results.json'), 'a') as f:
+        f.write(line + "\n")
+    return record
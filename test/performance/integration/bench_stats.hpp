@@ -0,0 +1,70 @@
+#pragma once
+#ifndef PERFORMANCE_BENCH_STATS_HPP
+#define PERFORMANCE_BENCH_STATS_HPP
+
+#include <os>
+#include <net/http/request.hpp>
+#include <net/http/response_writer.hpp>
+#include <cinttypes>
+#include <cstdio>
+
+/**
+ * What a benchmark service has done, and the CPU cycles it spent awake
+ * doing it, since the load generator last reset it.
+ *
+ * GET /bench/reset starts a run, GET /bench/stats ends it with a JSON
+ * object the load generator adds to its results.
+ */
+struct Bench_stats
+{
+  uint64_t requests = 0;
+  uint64_t messages = 0;
+  uint64_t bytes    = 0;
+  uint64_t cycles_start = 0;
+
+  static uint64_t busy_cycles() noexcept
+  { return os::cycles_since_boot() - os::cycles_asleep(); }
+
+  void reset() noexcept
+  {
+    requests = 0;
+    messages = 0;
+    bytes    = 0;
+    cycles_start = busy_cycles();
+  }
+
+  std::string to_json() const
+  {
+    const uint64_t cycles = busy_cycles() - cycles_start;
+    const uint64_t work   = requests + messages;
+    char buf[256];
+    const int len = snprintf(buf, sizeof(buf),
+        "{\"requests\":%" PRIu64 ",\"messages\":%" PRIu64 ",\"bytes\":%" PRIu64 ","
+        "\"cycles\":%" PRIu64 ",\"cycles_per_op\":%" PRIu64 "}",
+        requests, messages, bytes, cycles, work ? cycles / work : 0);
+    return std::string(buf, len);
+  }
+
+  /**
+   * Answer the /bench/ requests
+   *
+   * Returns true if the request was one of them
+   */
+  bool serve(const http::Request& req, http::Response_writer& writer)
+  {
+    const auto path = req.uri().path();
+    if (path == "/bench/reset") {
+      reset();
+      writer.write("{}");
+      return true;
+    }
+    if (path == "/bench/stats") {
+      writer.header().set_field(http::header::Content_Type, "application/json");
+      writer.write(to_json());
+      return true;
+    }
+    return false;
+  }
+};
+
+#endif
@@ -0,0 +1,50 @@
+
+#include <service>
+#include <os>
+#ifndef PLATFORM_x86_nano
+#include <net/interfaces>
+#endif
+
+// printed last, when test.py has all it needs
+static void done()
+{
+  os::print_boot_timeline();
+  printf("Boot benchmark done\n");
+}
+
+#ifdef PLATFORM_x86_nano
+// no network and no event loop, so the boot ends here
+void Service::start()
+{
+  printf("Boot benchmark ready\n");
+  done();
+}
+#else
+using namespace net;
+
+void Service::start()
+{
+  auto& inet = Interfaces::get(0);
+  inet.network_config(
+    {  10,  0,  0, 76 },  // IP
+    {  255,255,255, 0 },  // Netmask
+    {  10,  0,  0,  1 },  // Gateway
+    {  10,  0,  0,  1 }   // DNS
+  );
+
+  // the host sends to the echo port from before launch, until answered
+  auto& echo = inet.udp().bind(7);
+  echo.on_read(
+  [&echo] (UDP::addr_t addr, UDP::port_t port, const char* data, size_t len)
+  {
+    static bool first = true;
+    echo.sendto(addr, port, data, len);
+    if (first) {
+      first = false;
+      done();
+    }
+  });
+
+  printf("Boot benchmark ready\n");
+}
+#endif
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+
+from __future__ import print_function
+from future import standard_library
+standard_library.install_aliases()
+from builtins import str
+import sys
+import os
+import re
+import socket
+import subprocess
+import threading
+import time
+
+from vmrunner import vmrunner
+import bench
+
+HOST = "10.0.0.76"
+MAC = "c0:01:0a:00:00:4c"
+IMAGE = "performance_boot"
+PLATFORM = os.environ.get('PLATFORM', 'x86_pc')
+TIMEOUT = 60
+
+# solo5-hvt is run without vmrunner, on a tap device of its own
+SOLO5_NET = os.environ.get('BENCH_SOLO5_NET', 'tap100')
+SOLO5_TENDER = os.environ.get('BENCH_SOLO5_TENDER', 'solo5-hvt')
+
+results = { "platform": PLATFORM }
+phases = {}
+launched = [0.0]
+replied = [None]
+vm = None
+status = [1]
+
+def sizes():
+    """ What the hypervisor has to load """
+    results["binary_bytes"] = os.path.getsize(IMAGE)
+    results["memdisk_bytes"] = os.path.getsize("memdisk.fat") if os.path.exists("memdisk.fat") else 0
+    try:
+        # text, data and bss, as size(1) counts them
+        fields = subprocess.check_output(["size", IMAGE]).decode().splitlines()[1].split()
+        results["text_bytes"], results["data_bytes"], results["bss_bytes"] = [int(f) for f in fields[:3]]
+    except Exception:
+        pass
+
+def static_neighbour(dev):
+    """ Without an ARP entry, Linux only asks again once a second, which
+        would hide how fast the service came up """
+    if subprocess.call(["sudo", "ip", "neigh", "replace", HOST, "lladdr", MAC,
+                        "dev", dev, "nud", "permanent"]) != 0:
+        print("Boot: no static ARP entry, the first packet may be a second late")
+
+def ping_until_reply():
+    """ Send to the echo port every millisecond until the service answers """
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(0.001)
+    deadline = time.time() + TIMEOUT
+    while time.time() < deadline:
+        try:
+            sock.sendto(b"boot", (HOST, 7))
+            sock.recvfrom(64)
+            replied[0] = time.time()
+            break
+        except socket.timeout:
+            pass
+        except OSError:
+            # the tap device is not up yet
+            time.sleep(0.001)
+    sock.close()
+
+pinger = threading.Thread(target=ping_until_reply)
+
+def ms_since_launch(t):
+    return round((t - launched[0]) * 1000, 3)
+
+def ready(line):
+    results["launch_to_ready_ms"] = ms_since_launch(time.time())
+    return True
+
+def timeline(line):
+    results["timeline_unit"] = "cycles" if "cycles" in line else "us"
+    return True
+
+# "     Start   Duration  Phase", with an empty start for the total
+PHASE = re.compile(r"^\s*(\d*)\s+(\d+)  (.+?)\s*$")
+
+def phase(line):
+    match = PHASE.match(line)
+    if match:
+        phases[match.group(3)] = int(match.group(2))
+    return True
+
+def done(line):
+    if PLATFORM != "x86_nano":
+        pinger.join()
+        if replied[0] is None:
+            return finish(False)
+        results["launch_to_first_packet_ms"] = ms_since_launch(replied[0])
+    return finish(True)
+
+def finish(ok):
+    sizes()
+    results["phases"] = phases
+    total = phases.get("Total", 0)
+    results["boot_total"] = total
+    # what happened before the first phase: the hypervisor and the loader
+    if results.get("timeline_unit") == "us" and "launch_to_ready_ms" in results:
+        results["before_kernel_ms"] = round(results["launch_to_ready_ms"] - total / 1000.0, 3)
+    bench.report("boot_" + PLATFORM, results)
+    if ok:
+        return stop(0, "Benchmark done")
+    return stop(1, "Benchmark failed: no reply from the service")
+
+def stop(code, msg):
+    if vm is not None:
+        return vm.exit(code, msg)
+    print(msg)
+    status[0] = code
+    return False
+
+OUTPUT = [
+    ("Boot benchmark ready", ready),
+    ("Boot timeline - ", timeline),
+    (PHASE.pattern, phase),
+    ("Boot benchmark done", done),
+]
+
+def launch():
+    launched[0] = time.time()
+    if PLATFORM != "x86_nano":
+        pinger.start()
+
+def boot_solo5():
+    static_neighbour(SOLO5_NET)
+    # the default solo5-hvt needs a disk, even an empty one
+    open("dummy.img", "a").close()
+    launch()
+    tender = subprocess.Popen([SOLO5_TENDER, "--disk=dummy.img", "--net=" + SOLO5_NET,
+                               "--net-mac=" + MAC, "--", IMAGE],
+                              stdout=subprocess.PIPE, universal_newlines=True)
+    timer = threading.Timer(TIMEOUT, tender.kill)
+    timer.start()
+    for line in tender.stdout:
+        print(line, end="")
+        if not all(func(line) for pattern, func in OUTPUT if re.search(pattern, line)):
+            break
+    tender.kill()
+    timer.cancel()
+    sys.exit(status[0])
+
+if len(sys.argv) > 1:
+    IMAGE = str(sys.argv[1])
+
+# solo5 binaries are built like the others, and run here
+if PLATFORM == "x86_solo5":
+    boot_solo5()
+
+# Get an auto-created VM from the vmrunner
+vm = vmrunner.vms[0]
+
+for pattern, func in OUTPUT:
+    vm.on_output(pattern, func)
+
+if len(sys.argv) > 1:
+    static_neighbour("bridge43")
+    launch()
+    vm.boot(image_name=IMAGE)
+else:
+    vm.cmake()
+    static_neighbour("bridge43")
+    # from here, it is the hypervisor's time
+    launch()
+    vm.boot(TIMEOUT, image_name=IMAGE).clean()
@@ -0,0 +1,35 @@
+
+#include <service>
+#include <net/interfaces>
+#include <net/http/server.hpp>
+#include "../bench_stats.hpp"
+
+static std::unique_ptr<http::Server> server_;
+static Bench_stats stats_;
+
+// a small response, so the benchmark measures the HTTP path itself
+static const std::string body(64, 'x');
+
+void Service::start()
+{
+  auto& inet = net::Interfaces::get(0);
+  inet.network_config(
+    {  10,  0,  0, 70 },  // IP
+    {  255,255,255, 0 },  // Netmask
+    {  10,  0,  0,  1 },  // Gateway
+    {  10,  0,  0,  1 }   // DNS
+  );
+
+  server_ = std::make_unique<http::Server>(inet.tcp());
+  server_->on_request(
+  [] (http::Request_ptr req, http::Response_writer_ptr writer)
+  {
+    if (stats_.serve(*req, *writer)) return;
+    stats_.requests++;
+    writer->header().set_field(http::header::Content_Type, "text/plain");
+    writer->write(body);
+  });
+  server_->listen(8080);
+
+  printf("Benchmark ready\n");
+}
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+
+from __future__ import print_function
+from future import standard_library
+standard_library.install_aliases()
+from builtins import str
+import sys
+import os
+import _thread
+
+from vmrunner import vmrunner
+import bench
+
+HOST = "10.0.0.70"
+PORT = 8080
+SECONDS = int(os.environ.get('BENCH_SECONDS', 10))
+CLIENTS = int(os.environ.get('BENCH_CLIENTS', 8))
+
+def benchmark():
+    # one keep-alive connection per client, small responses
+    bench.reset_stats(HOST, PORT)
+    results = bench.run_clients(CLIENTS, SECONDS, bench.http_client(HOST, PORT, "/"))
+    results.update(bench.read_stats(HOST, PORT))
+    bench.report("http_keepalive", results)
+
+    if results["errors"] == 0 and results["count"] > 0:
+        vm.exit(0, "Benchmark done")
+    else:
+        vm.exit(1, "Benchmark failed")
+
+def start(line):
+    _thread.start_new_thread(benchmark, ())
+    return True
+
+# Get an auto-created VM from the vmrunner
+vm = vmrunner.vms[0]
+
+vm.on_output("Benchmark ready", start)
+
+if len(sys.argv) > 1:
+    vm.boot(image_name=str(sys.argv[1]))
+else:
+    # Boot the VM, taking a timeout as parameter
+    vm.cmake().boot(SECONDS + 60, image_name='performance_http').clean()
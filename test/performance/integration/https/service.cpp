@@ -0,0 +1,70 @@
+
+#include <service>
+#include <memdisk>
+#include <array>
+#include <net/interfaces>
+#include <net/https/openssl_server.hpp>
+#include <net/https/botan_server.hpp>
+#include <net/https/s2n_server.hpp>
+#include "../bench_stats.hpp"
+
+// one server for each TLS backend, each with its own stats
+struct Backend {
+  const char*                   name;
+  uint16_t                      port;
+  std::unique_ptr<http::Server> server;
+  Bench_stats                   stats;
+};
+static std::array<Backend, 3> backends {{
+  { "openssl", 443,  nullptr, {} },
+  { "botan",   8443, nullptr, {} },
+  { "s2n",     9443, nullptr, {} },
+}};
+
+static void serve(Backend& backend)
+{
+  backend.server->on_request(
+  [&backend] (http::Request_ptr req, http::Response_writer_ptr writer)
+  {
+    if (backend.stats.serve(*req, *writer)) return;
+    backend.stats.requests++;
+    writer->header().set_field(http::header::Content_Type, "text/plain");
+    writer->write("ok");
+  });
+  backend.server->listen(backend.port);
+}
+
+void Service::start()
+{
+  auto& inet = net::Interfaces::get(0);
+  inet.network_config(
+    {  10,  0,  0, 71 },  // IP
+    {  255,255,255, 0 },  // Netmask
+    {  10,  0,  0,  1 },  // Gateway
+    {  10,  0,  0,  1 }   // DNS
+  );
+
+  // every backend uses the same certificate, so they do the same work
+  fs::memdisk().init_fs(
+  [] (fs::error_t err, fs::File_system&) {
+    assert(!err);
+  });
+  auto& filesys = fs::memdisk().fs();
+
+  backends[0].server = std::make_unique<http::OpenSSL_server>(
+        "/test.pem", "/test.key", inet.tcp());
+
+  auto ca_key  = filesys.stat("/test.key");
+  auto ca_cert = filesys.stat("/test.der");
+  auto srv_key = filesys.stat("/test.key");
+  backends[1].server = std::make_unique<http::Botan_server>(
+        "10.0.0.71", ca_key, ca_cert, srv_key, inet.tcp());
+
+  backends[2].server = std::make_unique<http::S2N_server>(
+        filesys.stat("/test.pem").read(), filesys.stat("/test.key").read(), inet.tcp());
+
+  for (auto& backend : backends)
+    serve(backend);
+
+  printf("Benchmark ready\n");
+}
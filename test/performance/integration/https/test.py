@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+
+from __future__ import print_function
+from future import standard_library
+standard_library.install_aliases()
+from builtins import str
+import sys
+import os
+import _thread
+
+from vmrunner import vmrunner
+import bench
+
+HOST = "10.0.0.71"
+BACKENDS = [("openssl", 443), ("botan", 8443), ("s2n", 9443)]
+SECONDS = int(os.environ.get('BENCH_SECONDS', 10))
+CLIENTS = int(os.environ.get('BENCH_CLIENTS', 8))
+
+def benchmark():
+    failed = False
+    # full handshakes, each followed by one request, one backend at a time
+    for name, port in BACKENDS:
+        bench.reset_stats(HOST, port, tls=True)
+        results = bench.run_clients(CLIENTS, SECONDS, bench.https_handshake_client(HOST, port))
+        results.update(bench.read_stats(HOST, port, tls=True))
+        bench.report("https_handshake_" + name, results)
+        failed = failed or results["errors"] > 0 or results["count"] == 0
+
+    if not failed:
+        vm.exit(0, "Benchmark done")
+    else:
+        vm.exit(1, "Benchmark failed")
+
+def start(line):
+    _thread.start_new_thread(benchmark, ())
+    return True
+
+# Get an auto-created VM from the vmrunner
+vm = vmrunner.vms[0]
+
+vm.on_output("Benchmark ready", start)
+
+if len(sys.argv) > 1:
+    vm.boot(image_name=str(sys.argv[1]))
+else:
+    # Boot the VM, taking a timeout as parameter
+    vm.cmake().boot(len(BACKENDS) * SECONDS + 60, image_name='performance_https').clean()
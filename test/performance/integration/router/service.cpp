@@ -0,0 +1,75 @@
+
+#include <service>
+#include <net/interfaces>
+#include <net/nat/napt.hpp>
+#include <net/router.hpp>
+#include <net/http/server.hpp>
+#include "../bench_stats.hpp"
+
+using namespace net;
+
+static std::unique_ptr<Router<IP4>> router_;
+static std::shared_ptr<Conntrack> ct_;
+static std::unique_ptr<nat::NAPT> napt_;
+static std::unique_ptr<http::Server> server_;
+static Bench_stats stats_;
+
+// every forwarded packet is counted
+static void ip_forward(IP4::IP_packet_ptr pckt, Inet& stack, Conntrack::Entry_ptr)
+{
+  if (not pckt) return;
+  Inet* route = router_->get_first_interface(pckt->ip_dst());
+  if (route == nullptr or route == &stack) return;
+
+  stats_.messages++;
+  stats_.bytes += pckt->size();
+  route->ip_obj().ship(std::move(pckt));
+}
+
+void Service::start()
+{
+  // the host on eth0, the iperf3 server in a namespace behind eth1
+  auto& eth0 = Interfaces::get(0);
+  eth0.network_config({ 10,  0,  0, 75 }, { 255, 255, 255, 0 }, { 10, 0, 0, 1 });
+  auto& eth1 = Interfaces::get(1);
+  eth1.network_config({ 10, 42, 43,  1 }, { 255, 255, 255, 0 }, { 10, 42, 43, 2 });
+
+  Router<IP4>::Routing_table routing_table{
+    {{ 10, 42, 43, 0 }, { 255, 255, 255, 0 }, 0, eth1, 1 },
+    {{ 10,  0,  0, 0 }, { 255, 255, 255, 0 }, 0, eth0, 1 }
+  };
+  router_ = std::make_unique<Router<IP4>>(routing_table);
+  eth0.ip_obj().set_packet_forwarding(ip_forward);
+  eth1.ip_obj().set_packet_forwarding(ip_forward);
+
+  // masquerade out of eth1, like a home router
+  ct_ = std::make_shared<Conntrack>();
+  eth0.enable_conntrack(ct_);
+  eth1.enable_conntrack(ct_);
+  napt_ = std::make_unique<nat::NAPT>(ct_);
+
+  auto masq = [] (IP4::IP_packet_ptr pkt, Inet& stack, Conntrack::Entry_ptr entry)
+    -> Filter_verdict<IP4>
+  {
+    napt_->masquerade(*pkt, stack, entry);
+    return {std::move(pkt), Filter_verdict_type::ACCEPT};
+  };
+  auto demasq = [] (IP4::IP_packet_ptr pkt, Inet& stack, Conntrack::Entry_ptr entry)
+    -> Filter_verdict<IP4>
+  {
+    napt_->demasquerade(*pkt, stack, entry);
+    return {std::move(pkt), Filter_verdict_type::ACCEPT};
+  };
+  eth1.ip_obj().prerouting_chain().chain.push_back(demasq);
+  eth1.ip_obj().postrouting_chain().chain.push_back(masq);
+
+  server_ = std::make_unique<http::Server>(eth0.tcp());
+  server_->on_request(
+  [] (http::Request_ptr req, http::Response_writer_ptr writer)
+  {
+    stats_.serve(*req, *writer);
+  });
+  server_->listen(8080);
+
+  printf("Benchmark ready\n");
+}
@@ -0,0 +1,59 @@
+#! /bin/bash
+# The iperf3 server runs in a namespace behind the VM's second interface,
+# so traffic from the host to it is forwarded (and masqueraded) by the VM.
+set -e #abort on first command returning a failure
+dest_net=10.42.43.0/24
+dest_bridge=bridge45
+dest_addr=10.42.43.2
+router=10.0.0.75
+
+if2=tap1
+
+export NSNAME="bench1"
+shopt -s expand_aliases
+alias bench1="sudo ip netns exec $NSNAME"
+
+setup() {
+  sudo ip link add veth_bench type veth peer name veth_bench_ns
+  sudo ip link set veth_bench up
+
+  sudo ip netns add $NSNAME
+  sudo ip link set veth_bench_ns netns $NSNAME
+  bench1 ip addr add $dest_addr/24 dev veth_bench_ns
+  bench1 ip link set veth_bench_ns up
+  bench1 ip link set lo up
+
+  sudo ip link add name $dest_bridge type bridge
+  sudo ip link set dev $dest_bridge up
+  sudo ip link set dev veth_bench master $dest_bridge
+
+  # the VM masquerades, so the namespace needs no route back
+  sudo ip route add $dest_net via $router
+  echo ">>> Setup complete"
+}
+
+undo(){
+  set +e
+  sudo ip link delete veth_bench
+  sudo ip link set $dest_bridge down
+  sudo ip link del $dest_bridge
+  sudo ip netns del $NSNAME
+  sudo ip route del $dest_net via $router
+}
+
+vmsetup(){
+  echo ">>> Moving VM iface $if2 to $dest_bridge"
+  sudo ip link set dev $if2 nomaster
+  sudo ip link set dev $if2 master $dest_bridge
+  sudo ip link set $if2 up
+}
+
+if [ "$1" == "--clean" ]
+then
+  undo
+elif [ "$1" == "--vmsetup" ]
+then
+  vmsetup
+else
+  setup
+fi
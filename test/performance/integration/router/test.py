@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+
+from __future__ import print_function
+from future import standard_library
+standard_library.install_aliases()
+from builtins import str
+import sys
+import os
+import subprocess
+import _thread
+import time
+
+from vmrunner import vmrunner
+import bench
+
+HOST = "10.0.0.75"
+STATS = 8080
+SERVER = "10.42.43.2"
+NSNAME = "bench1"
+SECONDS = int(os.environ.get('BENCH_SECONDS', 10))
+CLIENTS = int(os.environ.get('BENCH_CLIENTS', 8))
+
+# name, iperf3 client options
+RUNS = [
+    ("nat_tcp_bulk",   ["-P", str(CLIENTS)]),
+    ("nat_tcp_bulk_r", ["-P", str(CLIENTS), "-R"]),
+    ("nat_udp_64",     ["-u", "-b", "0", "-l", "64"]),
+]
+
+def move_tap1(line):
+    subprocess.call(["./setup.sh", "--vmsetup"])
+    return True
+
+def clean():
+    subprocess.call(["sudo", "pkill", "iperf3"])
+    subprocess.call(["./setup.sh", "--clean"])
+
+def benchmark():
+    iperf = subprocess.Popen(["sudo", "ip", "netns", "exec", NSNAME, "iperf3", "-s"],
+                             stdout = subprocess.DEVNULL, stderr = subprocess.DEVNULL)
+    time.sleep(1)
+    failed = False
+    try:
+        # through the VM from the host to the namespace, masqueraded
+        for name, options in RUNS:
+            bench.reset_stats(HOST, STATS)
+            results = bench.iperf3(SERVER, SECONDS, options)
+            results.update(bench.read_stats(HOST, STATS))
+            results["forwarded_pps"] = round(results["messages"] / results["seconds"], 1)
+            bench.report(name, results)
+            failed = failed or results["messages"] == 0
+    except Exception as e:
+        print("Benchmark error:", e)
+        failed = True
+    iperf.terminate()
+
+    if not failed:
+        vm.exit(0, "Benchmark done")
+    else:
+        vm.exit(1, "Benchmark failed")
+
+def start(line):
+    _thread.start_new_thread(benchmark, ())
+    return True
+
+# clean anything hanging after a crash, from a previous run
+subprocess.call(["./setup.sh", "--clean"])
+subprocess.call("./setup.sh")
+
+# Get an auto-created VM from the vmrunner
+vm = vmrunner.vms[0]
+
+# Move the second interface to the namespace's bridge, right after boot
+vm.on_output("NAT router benchmark", move_tap1)
+vm.on_output("Benchmark ready", start)
+vm.on_exit(clean)
+
+if len(sys.argv) > 1:
+    vm.boot(image_name=str(sys.argv[1]))
+else:
+    # Boot the VM, taking a timeout as parameter
+    vm.cmake().boot(len(RUNS) * (SECONDS + 5) + 60, image_name='performance_router').clean()
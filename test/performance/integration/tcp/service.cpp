@@ -0,0 +1,80 @@
+
+#include <service>
+#include <net/interfaces>
+#include <net/http/server.hpp>
+#include "../bench_stats.hpp"
+
+using namespace net;
+
+static std::unique_ptr<http::Server> server_;
+static Bench_stats stats_;
+
+// what the source port sends, over and over, without copying it
+static const size_t CHUNK = 64 * 1024;
+static uint8_t chunk_[CHUNK];
+
+static void close_on_disconnect(tcp::Connection_ptr conn)
+{
+  conn->on_disconnect([] (tcp::Connection_ptr conn, tcp::Connection::Disconnect) {
+    conn->close();
+  });
+}
+
+// keep two chunks in the write queue until the client hangs up
+static void send_chunk(tcp::Connection* conn)
+{
+  if (not conn->is_writable()) return;
+  conn->write(chunk_, CHUNK, nullptr);
+}
+
+void Service::start()
+{
+  auto& inet = Interfaces::get(0);
+  inet.network_config(
+    {  10,  0,  0, 73 },  // IP
+    {  255,255,255, 0 },  // Netmask
+    {  10,  0,  0,  1 },  // Gateway
+    {  10,  0,  0,  1 }   // DNS
+  );
+  auto& tcp = inet.tcp();
+
+  // discard, like an iperf (2) server: iperf -c 10.0.0.73 -t 10
+  tcp.listen(5001).on_connect([] (tcp::Connection_ptr conn) {
+    conn->on_read(CHUNK, [] (tcp::buffer_t buf) {
+      stats_.bytes += buf->size();
+    });
+    close_on_disconnect(conn);
+  });
+
+  // source, for bulk transfers from the service
+  tcp.listen(5002).on_connect([] (tcp::Connection_ptr conn) {
+    auto* raw = conn.get();
+    conn->on_write([raw] (size_t written) {
+      stats_.bytes += written;
+      send_chunk(raw);
+    });
+    close_on_disconnect(conn);
+    send_chunk(raw);
+    send_chunk(raw);
+  });
+
+  // echo, for request/response transactions (like netperf TCP_RR)
+  tcp.listen(7).on_connect([] (tcp::Connection_ptr conn) {
+    auto* raw = conn.get();
+    conn->on_read(1024, [raw] (tcp::buffer_t buf) {
+      stats_.messages++;
+      raw->write(std::move(buf));
+    });
+    close_on_disconnect(conn);
+  });
+
+  server_ = std::make_unique<http::Server>(tcp);
+  server_->on_request(
+  [] (http::Request_ptr req, http::Response_writer_ptr writer)
+  {
+    stats_.serve(*req, *writer);
+  });
+  server_->listen(8080);
+
+  printf("Benchmark ready\n");
+}
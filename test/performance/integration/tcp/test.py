@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+
+from __future__ import print_function
+from future import standard_library
+standard_library.install_aliases()
+from builtins import str
+import sys
+import os
+import _thread
+
+from vmrunner import vmrunner
+import bench
+
+HOST = "10.0.0.73"
+STATS = 8080
+SECONDS = int(os.environ.get('BENCH_SECONDS', 10))
+CLIENTS = int(os.environ.get('BENCH_CLIENTS', 8))
+
+def benchmark():
+    failed = False
+    # bulk data to and from the service, one connection per client
+    for name, port, stream in (("tcp_bulk_rx", 5001, bench.tcp_send_stream),
+                               ("tcp_bulk_tx", 5002, bench.tcp_recv_stream)):
+        bench.reset_stats(HOST, STATS)
+        results = bench.run_streams(CLIENTS, SECONDS, stream(HOST, port))
+        results.update(bench.read_stats(HOST, STATS))
+        bench.report(name, results)
+        failed = failed or results["errors"] > 0 or results["bytes"] == 0
+
+    # one byte each way, one transaction in flight per client
+    bench.reset_stats(HOST, STATS)
+    results = bench.run_clients(CLIENTS, SECONDS, bench.tcp_rr_client(HOST, 7))
+    results.update(bench.read_stats(HOST, STATS))
+    bench.report("tcp_rr", results)
+    failed = failed or results["errors"] > 0 or results["count"] == 0
+
+    if not failed:
+        vm.exit(0, "Benchmark done")
+    else:
+        vm.exit(1, "Benchmark failed")
+
+def start(line):
+    _thread.start_new_thread(benchmark, ())
+    return True
+
+# Get an auto-created VM from the vmrunner
+vm = vmrunner.vms[0]
+
+vm.on_output("Benchmark ready", start)
+
+if len(sys.argv) > 1:
+    vm.boot(image_name=str(sys.argv[1]))
+else:
+    # Boot the VM, taking a timeout as parameter
+    vm.cmake().boot(3 * SECONDS + 60, image_name='performance_tcp').clean()
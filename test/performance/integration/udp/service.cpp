@@ -0,0 +1,50 @@
+
+#include <service>
+#include <net/interfaces>
+#include <net/http/server.hpp>
+#include "../bench_stats.hpp"
+
+using namespace net;
+
+static std::unique_ptr<http::Server> server_;
+static Bench_stats stats_;
+
+void Service::start()
+{
+  auto& inet = Interfaces::get(0);
+  inet.network_config(
+    {  10,  0,  0, 74 },  // IP
+    {  255,255,255, 0 },  // Netmask
+    {  10,  0,  0,  1 },  // Gateway
+    {  10,  0,  0,  1 }   // DNS
+  );
+
+  // discard, counting what arrives of a flood
+  auto& discard = inet.udp().bind(9);
+  discard.on_read(
+  [] (UDP::addr_t, UDP::port_t, const char*, size_t len)
+  {
+    stats_.messages++;
+    stats_.bytes += len;
+  });
+
+  // echo, for request/response round trips
+  auto& echo = inet.udp().bind(7);
+  echo.on_read(
+  [&echo] (UDP::addr_t addr, UDP::port_t port, const char* data, size_t len)
+  {
+    stats_.messages++;
+    stats_.bytes += len;
+    echo.sendto(addr, port, data, len);
+  });
+
+  server_ = std::make_unique<http::Server>(inet.tcp());
+  server_->on_request(
+  [] (http::Request_ptr req, http::Response_writer_ptr writer)
+  {
+    stats_.serve(*req, *writer);
+  });
+  server_->listen(8080);
+
+  printf("Benchmark ready\n");
+}
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+
+from __future__ import print_function
+from future import standard_library
+standard_library.install_aliases()
+from builtins import str
+import sys
+import os
+import _thread
+
+from vmrunner import vmrunner
+import bench
+
+HOST = "10.0.0.74"
+STATS = 8080
+SECONDS = int(os.environ.get('BENCH_SECONDS', 10))
+CLIENTS = int(os.environ.get('BENCH_CLIENTS', 8))
+SIZES = [64, 1472]
+
+def benchmark():
+    failed = False
+    # a flood of datagrams; pps is what was sent, rx_pps what arrived
+    for size in SIZES:
+        bench.reset_stats(HOST, STATS)
+        results = bench.run_streams(CLIENTS, SECONDS, bench.udp_flood_stream(HOST, 9, size))
+        results.update(bench.read_stats(HOST, STATS))
+        results["size"] = size
+        results["rx_pps"] = round(results["messages"] / results["seconds"], 1)
+        bench.report("udp_flood_%d" % size, results)
+        failed = failed or results["messages"] == 0
+
+    # echoed datagrams, one in flight per client
+    bench.reset_stats(HOST, STATS)
+    results = bench.run_clients(CLIENTS, SECONDS, bench.udp_rr_client(HOST, 7, 64))
+    results.update(bench.read_stats(HOST, STATS))
+    bench.report("udp_rr", results)
+    failed = failed or results["count"] == 0
+
+    if not failed:
+        vm.exit(0, "Benchmark done")
+    else:
+        vm.exit(1, "Benchmark failed")
+
+def start(line):
+    _thread.start_new_thread(benchmark, ())
+    return True
+
+# Get an auto-created VM from the vmrunner
+vm = vmrunner.vms[0]
+
+vm.on_output("Benchmark ready", start)
+
+if len(sys.argv) > 1:
+    vm.boot(image_name=str(sys.argv[1]))
+else:
+    # Boot the VM, taking a timeout as parameter
+    vm.cmake().boot((len(SIZES) + 1) * SECONDS + 60, image_name='performance_udp').clean()
@@ -0,0 +1,49 @@
+
+#include <service>
+#include <net/interfaces>
+#include <net/ws/connector.hpp>
+#include <net/http/server.hpp>
+#include "../bench_stats.hpp"
+
+static std::unique_ptr<http::Server> server_;
+static std::unique_ptr<net::WS_server_connector> ws_serve_;
+static Bench_stats stats_;
+
+// every message is echoed back, and counted
+static void on_connect(net::WebSocket_ptr ws)
+{
+  if (ws == nullptr) return;
+  auto* socket = ws.release();
+  socket->on_read =
+  [socket] (net::WebSocket::Message_ptr message) {
+    stats_.messages++;
+    socket->write(message->data(), message->size(), message->opcode());
+  };
+  socket->on_close =
+  [socket] (uint16_t) {
+    delete socket;
+  };
+}
+
+void Service::start()
+{
+  auto& inet = net::Interfaces::get(0);
+  inet.network_config(
+    {  10,  0,  0, 72 },  // IP
+    {  255,255,255, 0 },  // Netmask
+    {  10,  0,  0,  1 },  // Gateway
+    {  10,  0,  0,  1 }   // DNS
+  );
+
+  ws_serve_ = std::make_unique<net::WS_server_connector>(on_connect);
+  server_   = std::make_unique<http::Server>(inet.tcp());
+  server_->on_request(
+  [] (http::Request_ptr req, http::Response_writer_ptr writer)
+  {
+    if (stats_.serve(*req, *writer)) return;
+    ws_serve_->on_request(std::move(req), std::move(writer));
+  });
+  server_->listen(8000);
+
+  printf("Benchmark ready\n");
+}
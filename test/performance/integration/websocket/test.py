@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+
+from __future__ import print_function
+from future import standard_library
+standard_library.install_aliases()
+from builtins import str
+import sys
+import os
+import _thread
+
+from vmrunner import vmrunner
+import bench
+
+HOST = "10.0.0.72"
+PORT = 8000
+SECONDS = int(os.environ.get('BENCH_SECONDS', 10))
+CLIENTS = int(os.environ.get('BENCH_CLIENTS', 8))
+SIZES = [64, 4096]
+
+def benchmark():
+    failed = False
+    # echoed messages, one in flight per client
+    for size in SIZES:
+        bench.reset_stats(HOST, PORT)
+        results = bench.run_clients(CLIENTS, SECONDS, bench.websocket_client(HOST, PORT, size))
+        results.update(bench.read_stats(HOST, PORT))
+        results["size"] = size
+        bench.report("websocket_echo_%d" % size, results)
+        failed = failed or results["errors"] > 0 or results["count"] == 0
+
+    if not failed:
+        vm.exit(0, "Benchmark done")
+    else:
+        vm.exit(1, "Benchmark failed")
+
+def start(line):
+    _thread.start_new_thread(benchmark, ())
+    return True
+
+# Get an auto-created VM from the vmrunner
+vm = vmrunner.vms[0]
+
+vm.on_output("Benchmark ready", start)
+
+if len(sys.argv) > 1:
+    vm.boot(image_name=str(sys.argv[1]))
+else:
+    # Boot the VM, taking a timeout as parameter
+    vm.cmake().boot(len(SIZES) * SECONDS + 60, image_name='performance_websocket').clean()
@@ -0,0 +1,72 @@
+#include <common.cxx>
+#include "microbench.hpp"
+
+#include <kernel/timers.hpp>
+#include <util/alloc_buddy.hpp>
+#include <util/units.hpp>
+
+using namespace std::chrono;
+using namespace util::literals;
+
+CASE("Benchmark alloc_buddy allocate and deallocate")
+{
+  using Alloc = os::mem::buddy::Alloc<false>;
+  const size_t size = Alloc::max_bufsize(64_MiB);
+  void* addr = nullptr;
+  EXPECT(posix_memalign(&addr, Alloc::min_size, size) == 0);
+  auto* alloc = Alloc::create(addr, size);
+
+  std::vector<void*> ptrs(1024);
+  microbench::run("buddy_alloc_free_4k", 1000000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i += ptrs.size()) {
+      for (auto& ptr : ptrs) ptr = alloc->allocate(4_KiB);
+      for (auto* ptr : ptrs) alloc->deallocate(ptr, 4_KiB);
+    }
+  });
+
+  // sizes from 4 KiB to 64 KiB, freed in a different order
+  static const size_t sizes[] {4_KiB, 8_KiB, 16_KiB, 4_KiB, 32_KiB, 64_KiB, 8_KiB, 4_KiB};
+  microbench::run("buddy_alloc_free_mixed", 500000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i += ptrs.size()) {
+      for (size_t j = 0; j < ptrs.size(); j++)
+        ptrs[j] = alloc->allocate(sizes[j % 8]);
+      for (size_t j = 0; j < ptrs.size(); j += 2)
+        alloc->deallocate(ptrs[j], sizes[j % 8]);
+      for (size_t j = 1; j < ptrs.size(); j += 2)
+        alloc->deallocate(ptrs[j], sizes[j % 8]);
+    }
+  });
+  EXPECT(alloc->bytes_used() == 0u);
+  free(addr);
+}
+
+extern delegate<uint64_t()> systime_override;
+static uint64_t current_time = 0;
+
+CASE("Benchmark Timers arm and cancel")
+{
+  systime_override = [] () -> uint64_t { return current_time; };
+  Timers::init([] (Timers::duration_t) {}, [] () {});
+  Timers::ready();
+
+  static const size_t BATCH = 1000;
+  std::vector<Timers::id_t> ids(BATCH);
+  // timeouts like those of connections, each one later than the last
+  microbench::run("timers_oneshot_stop", 1000000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i += BATCH) {
+      for (size_t j = 0; j < BATCH; j++)
+        ids[j] = Timers::oneshot(milliseconds(100 + j), [] (Timers::id_t) {});
+      for (auto id : ids) Timers::stop(id);
+    }
+  });
+  // timeouts in no order, stopped in no order
+  microbench::run("timers_oneshot_stop_random", 1000000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i += BATCH) {
+      for (size_t j = 0; j < BATCH; j++)
+        ids[j] = Timers::oneshot(milliseconds(100 + (j * 7919) % BATCH), [] (Timers::id_t) {});
+      for (size_t j = 0; j < BATCH; j++) Timers::stop(ids[(j * 104729) % BATCH]);
+    }
+  });
+  Timers::timers_handler();
+  EXPECT(Timers::active() == 0u);
+}
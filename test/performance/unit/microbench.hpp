@@ -0,0 +1,113 @@
+#pragma once
+#ifndef PERFORMANCE_MICROBENCH_HPP
+#define PERFORMANCE_MICROBENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/**
+ * Microbenchmarks of the hot paths, run with the unit tests.
+ *
+ * A benchmark runs a warm-up round and then a number of timed rounds of
+ * the same number of operations. It reports the median time of an
+ * operation, which is much steadier between runs than the mean.
+ * Results are printed as one JSON object per line, with a "BENCH "
+ * prefix, and appended to the file named in BENCH_RESULTS when it is
+ * set. This is the same format as the services in
+ * test/performance/integration, so CI can gate both the same way.
+ *
+ * BENCH_ROUNDS overrides the number of timed rounds (default 7).
+ */
+namespace microbench
+{
+  struct Result {
+    std::string name;
+    uint64_t ops;
+    int      rounds;
+    double   ns_per_op;     // median of the rounds
+    double   min_ns_per_op;
+  };
+
+  // the keys are always in this order, the numbers always in this form
+  inline std::string to_json(const Result& res)
+  {
+    char buf[256];
+    const int len = snprintf(buf, sizeof(buf),
+        "{\"benchmark\":\"%s\",\"ops\":%" PRIu64 ",\"rounds\":%d,"
+        "\"ns_per_op\":%.2f,\"min_ns_per_op\":%.2f}",
+        res.name.c_str(), res.ops, res.rounds, res.ns_per_op, res.min_ns_per_op);
+    return std::string(buf, len);
+  }
+
+  /** Print a result, as a JSON object, and append it to the results */
+  inline void report(const std::string& json)
+  {
+    printf("BENCH %s\n", json.c_str());
+    if (const char* path = getenv("BENCH_RESULTS"))
+    {
+      if (FILE* file = fopen(path, "a")) {
+        fprintf(file, "%s\n", json.c_str());
+        fclose(file);
+      }
+    }
+  }
+
+  inline void report(const Result& res)
+  {
+    report(to_json(res));
+  }
+
+  inline int rounds()
+  {
+    const char* env = getenv("BENCH_ROUNDS");
+    const int num = env ? atoi(env) : 0;
+    return num > 0 ? num : 7;
+  }
+
+  /** Keep the compiler from optimizing away how @val was computed */
+  template <typename T>
+  inline void keep(const T& val)
+  { asm volatile("" : : "r"(&val) : "memory"); }
+
+  /**
+   * Time @body(ops) in rounds, calling @setup(ops) untimed before each.
+   * Returns the result after reporting it.
+   */
+  template <typename Setup, typename Body>
+  Result run(const char* name, uint64_t ops, Setup setup, Body body)
+  {
+    using namespace std::chrono;
+    setup(ops);
+    body(ops);
+
+    std::vector<double> times;
+    const int count = rounds();
+    for (int i = 0; i < count; i++)
+    {
+      setup(ops);
+      const auto start = steady_clock::now();
+      body(ops);
+      const auto time = duration<double, std::nano>(steady_clock::now() - start);
+      times.push_back(time.count() / ops);
+    }
+    std::sort(times.begin(), times.end());
+
+    const Result res {name, ops, count, times[count / 2], times.front()};
+    report(res);
+    return res;
+  }
+
+  template <typename Body>
+  Result run(const char* name, uint64_t ops, Body body)
+  {
+    return run(name, ops, [] (uint64_t) {}, body);
+  }
+
+} // microbench
+
+#endif
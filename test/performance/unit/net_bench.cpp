@@ -0,0 +1,182 @@
+#include <common.cxx>
+#include <nic_mock.hpp>
+#include <packet_factory.hpp>
+#include "microbench.hpp"
+
+#include <net/checksum.hpp>
+#include <net/conntrack.hpp>
+#include <net/inet>
+#include <net/router.hpp>
+#include <net/http/request.hpp>
+
+using namespace net;
+
+CASE("Benchmark net::checksum")
+{
+  static const size_t sizes[] {20, 64, 576, 1500, 9000, 65536};
+  std::vector<uint8_t> data(65536);
+  for (size_t i = 0; i < data.size(); i++) data[i] = i * 7;
+
+  for (const size_t size : sizes)
+  {
+    const std::string name = "checksum_" + std::to_string(size);
+    const uint64_t ops = std::max<size_t>(1000, (64 << 20) / size);
+    auto res = microbench::run(name.c_str(), ops, [&] (uint64_t n) {
+      uint16_t sum = 0;
+      for (uint64_t i = 0; i < n; i++) sum += checksum(data.data(), size);
+      microbench::keep(sum);
+    });
+    EXPECT(res.ns_per_op > 0.0);
+  }
+}
+
+CASE("Benchmark BufferStore get and release")
+{
+  BufferStore store{1024, 2048};
+  std::vector<uint8_t*> bufs(BufferStore::CPU_CACHE_SIZE * 4);
+
+  // one at a time, from and to the CPU cache
+  microbench::run("bufstore_get_release", 1000000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) store.release(store.get_buffer());
+  });
+  // many at a time, overflowing the CPU cache onto the locked free list,
+  // the path that is contended when several CPUs share a store
+  microbench::run("bufstore_get_release_shared", 100000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i += bufs.size()) {
+      for (auto& buf : bufs) buf = store.get_buffer();
+      for (auto* buf : bufs) store.release(buf);
+    }
+  });
+  microbench::run("bufstore_release_batch", 100000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i += bufs.size()) {
+      for (auto& buf : bufs) buf = store.get_buffer();
+      store.release(bufs.data(), bufs.size());
+    }
+  });
+  EXPECT(store.available() == store.total_buffers());
+}
+
+static std::vector<Quadruple> make_flows(size_t count)
+{
+  std::vector<Quadruple> flows;
+  const Socket server{ip4::Addr{10,0,0,42}, 53};
+  for (size_t i = 0; i < count; i++)
+  {
+    const ip4::Addr client{10, 1, uint8_t(i >> 8), uint8_t(i)};
+    flows.push_back({Socket{client, uint16_t(1024 + i % 60000)}, server});
+  }
+  return flows;
+}
+
+CASE("Benchmark Conntrack insert, lookup and expire")
+{
+  static const size_t NUM_FLOWS = 10000;
+  const auto flows = make_flows(NUM_FLOWS);
+  const Protocol proto{Protocol::UDP};
+
+  std::unique_ptr<Conntrack> ct;
+  auto fresh = [&] (uint64_t) { ct = std::make_unique<Conntrack>(NUM_FLOWS * 2); };
+  microbench::run("conntrack_insert", NUM_FLOWS, fresh, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) ct->simple_track_in(flows[i], proto);
+  });
+
+  size_t found = 0;
+  microbench::run("conntrack_lookup", 1000000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      found += ct->get(flows[(i * 7919) % NUM_FLOWS], proto) != nullptr;
+  });
+  EXPECT(found > 0u);
+
+  // entries that are due at once, all taken out in one sweep
+  auto due = [&] (uint64_t n) {
+    fresh(n);
+    ct->timeout.unconfirmed.udp = Conntrack::Timeout_duration{0};
+    for (uint64_t i = 0; i < n; i++) ct->simple_track_in(flows[i], proto);
+  };
+  microbench::run("conntrack_expire", NUM_FLOWS, due, [&] (uint64_t) {
+    ct->remove_expired();
+  });
+  EXPECT(ct->get(flows[0], proto) == nullptr);
+}
+
+CASE("Benchmark router lookup")
+{
+  // a table of /16, /24 and /28 routes, and a default route
+  Inet* eth1 = (Inet*) 1;
+  Inet* eth2 = (Inet*) 2;
+  Router<IP4>::Routing_table table;
+  for (int i = 0; i < 256; i++)
+  {
+    table.emplace_back(ip4::Addr(10, i, 0, 0), ip4::Addr(255, 255, 0, 0),
+                       ip4::Addr(10, i, 0, 1), *eth1, 1);
+    table.emplace_back(ip4::Addr(10, i, i, 0), ip4::Addr(255, 255, 255, 0),
+                       ip4::Addr(10, i, i, 1), *eth2, 1);
+    table.emplace_back(ip4::Addr(10, i, i, 16), ip4::Addr(255, 255, 255, 240),
+                       ip4::Addr(10, i, i, 17), *eth2, 1);
+  }
+  table.emplace_back(ip4::Addr(0), ip4::Addr(0), ip4::Addr(10, 0, 0, 1), *eth1, 1);
+  Router<IP4> router{table};
+
+  size_t found = 0;
+  microbench::run("router_lookup", 1000000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      const uint32_t h = i * 2654435761u;
+      const ip4::Addr dest(10, h >> 24, h >> 16, h >> 8);
+      found += router.get_most_specific_route(dest) != nullptr;
+    }
+  });
+  EXPECT(found > 0u);
+}
+
+CASE("Benchmark TCP segment processing")
+{
+  Nic_mock nic;
+  Inet inet{nic};
+  inet.network_config({10,0,0,42}, {255,255,255,0}, {10,0,0,1});
+  inet.tcp().listen(80);
+
+  // resets for connections that aren't there go through IP4 and TCP
+  // input, the checksums and the demux, and are dropped without a reply
+  static const size_t BATCH = 1000;
+  std::vector<net::Packet_ptr> segments;
+  auto make = [&] (uint64_t n) {
+    segments.clear();
+    for (uint64_t i = 0; i < n; i++)
+    {
+      auto tcp = create_tcp_packet_init({{10,0,0,43}, uint16_t(1024 + i)}, {{10,0,0,42}, 80});
+      tcp->set_flag(tcp::RST);
+      tcp->set_seq(i);
+      tcp->set_ip_checksum();
+      tcp->set_tcp_checksum();
+      segments.push_back(std::move(tcp));
+    }
+  };
+  microbench::run("tcp_segment_rx", BATCH, make, [&] (uint64_t) {
+    for (auto& seg : segments) nic.receive(std::move(seg));
+  });
+  EXPECT(inet.ip_obj().get_packets_rx() > 0u);
+}
+
+CASE("Benchmark HTTP request parse")
+{
+  static const std::string raw =
+    "GET /api/v1/users/42/profile?fields=name,email&lang=en HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:60.0) Gecko/20100101\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Cookie: session=8b1a9953c4611296a827abf8c47804d7; theme=dark\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+  auto* mr = std::pmr::get_default_resource();
+  size_t fields = 0;
+  microbench::run("http_request_parse", 100000, [&] (uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      http::Request req{mr, util::csview{raw}};
+      fields += req.header().size();
+    }
+  });
+  EXPECT(fields > 0u);
+}
@@ -0,0 +1,308 @@
+#include <common.cxx>
+#include "microbench.hpp"
+#include "pcap_replay.hpp"
+
+#include <net/http/server.hpp>
+#include <cinttypes>
+#include <new>
+
+/**
+ * Replays a capture through the stack, as a benchmark:
+ *
+ *   REPLAY_PCAP=traffic.pcap ./pcap_replay
+ *
+ * Without REPLAY_PCAP, a capture of HTTP requests and UDP datagrams from
+ * a number of clients is made up, and the stack is checked to answer
+ * them all. The stack serves HTTP on the TCP ports whose requests look
+ * like it, discards on the other TCP ports and echoes on the UDP ports.
+ *
+ * REPLAY_SERVER plays another address than the one found.
+ * REPLAY_TIMING=original keeps the frames as far apart as they were,
+ * REPLAY_SPEED times closer. REPLAY_MAX_CYCLES and REPLAY_MAX_ALLOCS
+ * fail the test when a packet takes more, for use as a regression gate.
+ */
+
+// every heap allocation the stack makes, by way of operator new
+void* operator new(std::size_t size)
+{
+  replay::allocations++;
+  if (void* ptr = malloc(size)) return ptr;
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size)
+{
+  return ::operator new(size);
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { free(ptr); }
+
+using namespace net;
+using replay::Pcap;
+using replay::Replayer;
+
+// a pcap file written frame by frame, at microsecond resolution
+class Capture_writer {
+public:
+  Capture_writer()
+  {
+    put32(0xa1b2c3d4);
+    put16(2); put16(4);
+    put32(0); put32(0);
+    put32(65535);
+    put32(Pcap::LINKTYPE_ETHERNET);
+  }
+
+  void tcp(ip4::Addr src, uint16_t sport, ip4::Addr dst, uint16_t dport,
+           uint32_t seq, uint32_t ack, uint8_t flags, const std::string& payload = "")
+  {
+    std::vector<uint8_t> seg(20);
+    set16(&seg[0], sport);
+    set16(&seg[2], dport);
+    set32(&seg[4], seq);
+    set32(&seg[8], ack);
+    seg[12] = 5 << 4;
+    seg[13] = flags;
+    set16(&seg[14], 65535);
+    seg.insert(seg.end(), payload.begin(), payload.end());
+    ip(src, dst, 6, seg);
+  }
+
+  void udp(ip4::Addr src, uint16_t sport, ip4::Addr dst, uint16_t dport,
+           const std::string& payload)
+  {
+    std::vector<uint8_t> dgram(8);
+    set16(&dgram[0], sport);
+    set16(&dgram[2], dport);
+    set16(&dgram[4], 8 + payload.size());
+    dgram.insert(dgram.end(), payload.begin(), payload.end());
+    ip(src, dst, 17, dgram);
+  }
+
+  std::vector<uint8_t> data;
+
+private:
+  uint64_t us_ = 1500000000ull * 1000000;
+
+  void ip(ip4::Addr src, ip4::Addr dst, uint8_t proto, std::vector<uint8_t>& l4)
+  {
+    std::vector<uint8_t> frame(14 + 20);
+    const uint8_t mac[] {0x02, 0, 0, 0, src.part(1), src.part(0)};
+    memcpy(&frame[0], mac, 6);
+    memcpy(&frame[6], mac, 6);
+    set16(&frame[12], 0x0800);
+
+    uint8_t* hdr = &frame[14];
+    hdr[0] = 0x45;
+    set16(hdr + 2, 20 + l4.size());
+    hdr[8] = 64;
+    hdr[9] = proto;
+    memcpy(hdr + 12, &src.whole, 4);
+    memcpy(hdr + 16, &dst.whole, 4);
+    set16(hdr + 10, ~sum(hdr, 20, 0));
+
+    // the pseudo header, then the segment
+    uint32_t pseudo = sum(hdr + 12, 8, 0) + proto + l4.size();
+    const int csum_at = (proto == 6) ? 16 : 6;
+    set16(&l4[csum_at], ~sum(l4.data(), l4.size(), pseudo));
+    frame.insert(frame.end(), l4.begin(), l4.end());
+
+    us_ += 50;
+    put32(us_ / 1000000);
+    put32(us_ % 1000000);
+    put32(frame.size());
+    put32(frame.size());
+    data.insert(data.end(), frame.begin(), frame.end());
+  }
+
+  static uint16_t sum(const uint8_t* p, size_t len, uint32_t acc)
+  {
+    for (size_t i = 0; i + 1 < len; i += 2) acc += p[i] << 8 | p[i + 1];
+    if (len & 1) acc += p[len - 1] << 8;
+    while (acc >> 16) acc = (acc & 0xffff) + (acc >> 16);
+    return acc;
+  }
+  static void set16(uint8_t* p, uint16_t val)
+  { p[0] = val >> 8; p[1] = val; }
+  static void set32(uint8_t* p, uint32_t val)
+  { set16(p, val >> 16); set16(p + 2, val); }
+  void put16(uint16_t val)
+  { data.insert(data.end(), (uint8_t*) &val, (uint8_t*) &val + 2); }
+  void put32(uint32_t val)
+  { data.insert(data.end(), (uint8_t*) &val, (uint8_t*) &val + 4); }
+};
+
+static const ip4::Addr SERVER {10,0,0,42};
+static const int CLIENTS = 200;
+static const std::string REQUEST = "GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n";
+
+// each client connects, makes a request, reads the response and closes,
+// and sends two datagrams. The clients take turns, step by step
+static std::vector<uint8_t> make_capture()
+{
+  Capture_writer cap;
+  const std::string response(64, 'x');
+  const std::string dgram(32, 'd');
+  auto client = [] (int i) { return ip4::Addr(10, 0, 1 + i / 250, 1 + i % 250); };
+  auto cisn = [] (int i) { return uint32_t(1000 * i + 1); };
+  auto sisn = [] (int i) { return uint32_t(5000000 + 77 * i); };
+  const uint8_t FIN = 0x01, SYN = 0x02, PSH = 0x08, ACK = 0x10;
+
+  for (int step = 0; step < 7; step++)
+  {
+    for (int i = 0; i < CLIENTS; i++)
+    {
+      const uint16_t port = 40000 + i;
+      const uint32_t c = cisn(i), s = sisn(i);
+      const uint32_t req_end = c + 1 + REQUEST.size();
+      switch (step) {
+      case 0: cap.tcp(client(i), port, SERVER, 80, c, 0, SYN); break;
+      case 1: cap.tcp(SERVER, 80, client(i), port, s, c + 1, SYN | ACK); break;
+      case 2: cap.tcp(client(i), port, SERVER, 80, c + 1, s + 1, ACK);
+              cap.udp(client(i), port, SERVER, 53, dgram); break;
+      case 3: cap.tcp(client(i), port, SERVER, 80, c + 1, s + 1, PSH | ACK, REQUEST); break;
+      case 4: cap.tcp(SERVER, 80, client(i), port, s + 1, req_end, PSH | ACK, response); break;
+      case 5: cap.tcp(client(i), port, SERVER, 80, req_end, s + 1 + response.size(), ACK);
+              cap.udp(client(i), port, SERVER, 53, dgram); break;
+      case 6: cap.tcp(client(i), port, SERVER, 80, req_end, s + 1 + response.size(), FIN | ACK); break;
+      }
+    }
+  }
+  return std::move(cap.data);
+}
+
+static Pcap open_capture()
+{
+  if (const char* path = getenv("REPLAY_PCAP"))
+    return Pcap::load(path);
+  return Pcap(make_capture());
+}
+
+static double env_number(const char* name, double fallback)
+{
+  const char* env = getenv(name);
+  return env ? atof(env) : fallback;
+}
+
+CASE("Pcap reads both byte orders and timestamp resolutions")
+{
+  auto data = make_capture();
+  Pcap micros(data);
+  EXPECT(micros.ethernet());
+  EXPECT(micros.frames().size() == size_t(CLIENTS * 9));
+  EXPECT(micros.frames()[1].ns - micros.frames()[0].ns == 50000u);
+
+  // the same, written on a big endian host with nanosecond timestamps
+  auto swap_at = [&data] (size_t off) {
+    std::reverse(data.begin() + off, data.begin() + off + 4);
+  };
+  data[0] = 0x4d; data[1] = 0x3c;
+  swap_at(0);
+  std::reverse(data.begin() + 4, data.begin() + 6);
+  std::reverse(data.begin() + 6, data.begin() + 8);
+  for (size_t off : {8, 12, 16, 20}) swap_at(off);
+  for (size_t off = 24; off < data.size(); )
+  {
+    uint32_t incl;
+    memcpy(&incl, &data[off + 8], 4);
+    for (int i = 0; i < 4; i++) swap_at(off + 4 * i);
+    off += 16 + incl;
+  }
+  Pcap nanos(std::move(data));
+  EXPECT(nanos.frames().size() == micros.frames().size());
+  EXPECT(nanos.frames()[1].ns - nanos.frames()[0].ns == 50u);
+  EXPECT(nanos.frames()[1].len == micros.frames()[1].len);
+
+  EXPECT_THROWS(Pcap(std::vector<uint8_t>(64, 0)));
+}
+
+CASE("Replay a capture through the stack")
+{
+  const Pcap pcap = open_capture();
+  Replayer replayer{pcap};
+  if (const char* server = getenv("REPLAY_SERVER"))
+    replayer.set_server(ip4::Addr{server});
+  const bool made_up = getenv("REPLAY_PCAP") == nullptr;
+  if (made_up) {
+    EXPECT(replayer.server() == SERVER);
+    EXPECT(replayer.http_ports().count(80) == 1u);
+    EXPECT(replayer.udp_ports().count(53) == 1u);
+  }
+  const auto timing = getenv("REPLAY_TIMING") and strcmp(getenv("REPLAY_TIMING"), "original") == 0
+                    ? Replayer::Timing::original : Replayer::Timing::fast;
+  const double speed = env_number("REPLAY_SPEED", 1.0);
+
+  std::vector<Replayer::Result> results;
+  for (int round = 0; round < microbench::rounds(); round++)
+  {
+    // a fresh stack each round, with the services of the capture
+    Nic_mock nic;
+    Inet inet{nic};
+    inet.network_config(replayer.server(), {0,0,0,0}, 0);
+
+    static const std::string body(64, 'x');
+    uint64_t requests = 0, datagrams = 0;
+    std::vector<std::unique_ptr<http::Server>> servers;
+    for (const uint16_t port : replayer.tcp_ports())
+    {
+      if (replayer.http_ports().count(port)) {
+        servers.push_back(std::make_unique<http::Server>(inet.tcp()));
+        servers.back()->on_request(
+          [&] (http::Request_ptr, http::Response_writer_ptr writer) {
+            replayer.app([&] {
+              requests++;
+              writer->header().set_field(http::header::Content_Type, "text/plain");
+              writer->write(body);
+            });
+          });
+        servers.back()->listen(port);
+      }
+      else {
+        inet.tcp().listen(port, [&replayer] (auto conn) {
+          conn->on_read(16384, [&replayer] (auto) { replayer.app([] {}); });
+        });
+      }
+    }
+    for (const uint16_t port : replayer.udp_ports())
+    {
+      auto& sock = inet.udp().bind(port);
+      sock.on_read(
+        [&, &sock = sock] (udp::addr_t addr, udp::port_t from, const char* data, size_t len) {
+          replayer.app([&] {
+            datagrams++;
+            sock.sendto(addr, from, data, len);
+          });
+        });
+    }
+
+    results.push_back(replayer.run(nic, inet, timing, speed));
+    if (made_up) {
+      EXPECT(requests == uint64_t(CLIENTS));
+      EXPECT(datagrams == uint64_t(CLIENTS * 2));
+    }
+  }
+
+  std::sort(results.begin(), results.end(), [] (const auto& a, const auto& b) {
+    return a.cycles_per_packet() < b.cycles_per_packet();
+  });
+  const auto& res = results[results.size() / 2];
+  EXPECT(res.delivered > 0u);
+
+  char buf[512];
+  const int len = snprintf(buf, sizeof(buf),
+      "{\"benchmark\":\"pcap_replay\",\"frames\":%" PRIu64 ",\"delivered\":%" PRIu64 ","
+      "\"skipped\":%" PRIu64 ",\"sent\":%" PRIu64 ",\"rounds\":%zu,"
+      "\"cycles_per_packet\":%.1f,\"allocs_per_packet\":%.2f,"
+      "\"ip4_cycles\":%.1f,\"tcp_cycles\":%.1f,\"udp_cycles\":%.1f,"
+      "\"icmp_cycles\":%.1f,\"arp_cycles\":%.1f,\"app_cycles\":%.1f,\"seconds\":%.3f}",
+      res.frames, res.delivered, res.skipped, res.sent, results.size(),
+      res.cycles_per_packet(), res.allocs_per_packet(),
+      res.layer_cycles("ip4"), res.layer_cycles("tcp"), res.layer_cycles("udp"),
+      res.layer_cycles("icmp"), res.layer_cycles("arp"), res.layer_cycles("app"),
+      res.seconds);
+  microbench::report(std::string(buf, len));
+
+  EXPECT(res.cycles_per_packet() <= env_number("REPLAY_MAX_CYCLES", 1e12));
+  EXPECT(res.allocs_per_packet() <= env_number("REPLAY_MAX_ALLOCS", 1e12));
+}
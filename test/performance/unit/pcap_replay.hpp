@@ -0,0 +1,536 @@
+#pragma once
+#ifndef PERFORMANCE_PCAP_REPLAY_HPP
+#define PERFORMANCE_PCAP_REPLAY_HPP
+
+#include <nic_mock.hpp>
+#include <net/inet>
+#include <kernel/events.hpp>
+#include <kernel/timers.hpp>
+#include <os>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Replay of recorded traffic through a real IP stack on a Nic_mock, to
+ * reproduce performance problems offline.
+ *
+ * The stack plays the server of the capture: the destination of the
+ * first TCP SYN, or else of the first UDP datagram. Frames to it are
+ * delivered, the rest are skipped, and what the server sent is only used
+ * to follow its TCP sequence numbers. The stack picks its own initial
+ * sequence numbers, so the acknowledgements of the clients are moved by
+ * the difference. What the stack answers isn't what the server answered,
+ * so acknowledgements of more data than it sent are ignored by it.
+ *
+ * Frames go to the IP layer as they are, at full speed or as far apart
+ * as they were recorded. The cycles of each are counted, and the heap
+ * allocations when the program counts them in replay::allocations. The
+ * cycles are also split by layer, as the stack hands a packet up. The
+ * services time themselves with Replayer::app().
+ */
+namespace replay
+{
+  /** Heap allocations so far, when the program counts them */
+  inline uint64_t allocations = 0;
+
+  struct Frame {
+    uint64_t       ns;   // since the epoch
+    const uint8_t* data;
+    uint32_t       len;
+    bool           truncated;
+  };
+
+  /** The frames of a pcap file (not pcapng), of Ethernet or raw IPv4 */
+  class Pcap {
+  public:
+    static constexpr uint32_t LINKTYPE_ETHERNET = 1;
+    static constexpr uint32_t LINKTYPE_RAW      = 101;
+    static constexpr uint32_t LINKTYPE_IPV4     = 228;
+
+    /** Read a file. Throws std::runtime_error */
+    static Pcap load(const std::string& path)
+    {
+      std::ifstream file(path, std::ios::binary);
+      if (not file)
+        throw std::runtime_error("Can't open " + path);
+      std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+      return Pcap(std::move(data));
+    }
+
+    /** Throws std::runtime_error when it isn't a pcap we can read */
+    explicit Pcap(std::vector<uint8_t> data)
+      : data_(std::move(data))
+    {
+      if (data_.size() < 24)
+        throw std::runtime_error("Too short for a pcap file");
+      const uint32_t magic = get32(0, false);
+      if (magic == 0xa1b2c3d4 or magic == 0xa1b23c4d)
+        swapped_ = false;
+      else if (magic == 0xd4c3b2a1 or magic == 0x4d3cb2a1)
+        swapped_ = true;
+      else
+        throw std::runtime_error("Not a pcap file (pcapng isn't read)");
+      const bool nanos = (get32(0, swapped_) == 0xa1b23c4d);
+
+      linktype_ = get32(20, swapped_) & 0xffff;
+      if (linktype_ != LINKTYPE_ETHERNET and linktype_ != LINKTYPE_RAW
+          and linktype_ != LINKTYPE_IPV4)
+        throw std::runtime_error("Link type " + std::to_string(linktype_) + " isn't read");
+
+      for (size_t off = 24; off + 16 <= data_.size(); )
+      {
+        const uint64_t sec  = get32(off, swapped_);
+        const uint64_t frac = get32(off + 4, swapped_);
+        const uint32_t incl = get32(off + 8, swapped_);
+        const uint32_t orig = get32(off + 12, swapped_);
+        off += 16;
+        // a capture cut off while writing ends early
+        if (off + incl > data_.size()) break;
+        frames_.push_back({sec * 1000000000ull + (nanos ? frac : frac * 1000),
+                           &data_[off], incl, incl < orig});
+        off += incl;
+      }
+    }
+
+    Pcap(Pcap&&) = default;
+    Pcap(const Pcap&) = delete;
+
+    const std::vector<Frame>& frames() const noexcept
+    { return frames_; }
+
+    bool ethernet() const noexcept
+    { return linktype_ == LINKTYPE_ETHERNET; }
+
+  private:
+    std::vector<uint8_t> data_;
+    std::vector<Frame>   frames_;
+    uint32_t linktype_ = 0;
+    bool     swapped_  = false;
+
+    uint32_t get32(size_t off, bool swap) const noexcept
+    {
+      uint32_t val;
+      memcpy(&val, &data_[off], 4);
+      return swap ? __builtin_bswap32(val) : val;
+    }
+  };
+
+  class Replayer {
+  public:
+    enum class Timing { fast, original };
+
+    struct Layer {
+      const char* name;
+      uint64_t cycles = 0; // including the layers above
+      uint64_t inner  = 0; // in the layers above
+      uint64_t count  = 0;
+
+      uint64_t own() const noexcept
+      { return cycles - inner; }
+    };
+
+    struct Result {
+      uint64_t frames    = 0;
+      uint64_t delivered = 0;
+      uint64_t skipped   = 0;
+      uint64_t sent      = 0;
+      uint64_t cycles    = 0;
+      uint64_t allocs    = 0;
+      double   seconds   = 0;
+      std::vector<Layer> layers;
+
+      double cycles_per_packet() const noexcept
+      { return delivered ? double(cycles) / delivered : 0; }
+      double allocs_per_packet() const noexcept
+      { return delivered ? double(allocs) / delivered : 0; }
+
+      /** The cycles of a layer, not counting those above, per packet */
+      double layer_cycles(const char* name) const noexcept
+      {
+        for (const auto& layer : layers)
+          if (strcmp(layer.name, name) == 0 and delivered)
+            return double(layer.own()) / delivered;
+        return 0;
+      }
+    };
+
+    /** Timers and events are run every this many frames at full speed */
+    static constexpr size_t BATCH = 64;
+
+    /** Look for the server in @pcap, which must outlive the replayer */
+    explicit Replayer(const Pcap& pcap)
+      : pcap_{pcap}
+    {
+      for (const auto& frame : pcap_.frames())
+      {
+        Ip ip;
+        if (not parse(frame, ip) or ip.proto != PROTO_TCP or ip.l4_len < 20) continue;
+        const uint8_t flags = ip.l4[13];
+        if ((flags & (SYN | ACK)) == SYN) {
+          server_ = ip.dst;
+          break;
+        }
+      }
+      if (server_ == 0)
+      {
+        for (const auto& frame : pcap_.frames())
+        {
+          Ip ip;
+          if (parse(frame, ip) and ip.proto == PROTO_UDP) {
+            server_ = ip.dst;
+            break;
+          }
+        }
+      }
+      scan();
+    }
+
+    /** Play another host of the capture than the one found */
+    void set_server(net::ip4::Addr addr)
+    {
+      server_ = addr.whole;
+      scan();
+    }
+
+    net::ip4::Addr server() const noexcept
+    { return net::ip4::Addr{server_}; }
+
+    /** The TCP ports connected to on the server */
+    const std::set<uint16_t>& tcp_ports() const noexcept
+    { return tcp_ports_; }
+
+    /** The TCP ports whose first request looks like HTTP */
+    const std::set<uint16_t>& http_ports() const noexcept
+    { return http_ports_; }
+
+    /** The UDP ports sent to on the server */
+    const std::set<uint16_t>& udp_ports() const noexcept
+    { return udp_ports_; }
+
+    /**
+     * Replay the capture into @inet on @nic, configured with server().
+     * With original timing, the frames are @speed times closer together
+     */
+    Result run(Nic_mock& nic, net::Inet& inet, Timing timing, double speed = 1.0)
+    {
+      using namespace std::chrono;
+      attach(nic, inet);
+      deltas_.clear();
+      neighbours_.clear();
+      result_ = Result{};
+      result_.frames = pcap_.frames().size();
+      const uint64_t allocs = allocations;
+
+      const auto start = steady_clock::now();
+      const uint64_t first_ns = pcap_.frames().empty() ? 0 : pcap_.frames().front().ns;
+      size_t count = 0;
+      for (const auto& frame : pcap_.frames())
+      {
+        if (timing == Timing::original)
+        {
+          const auto due = start + nanoseconds(uint64_t((frame.ns - first_ns) / speed));
+          while (steady_clock::now() < due) idle();
+        }
+        else if (++count % BATCH == 0) {
+          idle();
+        }
+        deliver(nic, inet, frame);
+      }
+      idle();
+
+      result_.seconds = duration<double>(steady_clock::now() - start).count();
+      result_.allocs  = allocations - allocs;
+      result_.layers  = {ip4_, tcp_, udp_, icmp_, arp_, app_};
+      detach(nic, inet);
+      return result_;
+    }
+
+    /** Run the work of a service, counting its cycles as the application's */
+    template <typename Fn>
+    void app(Fn&& fn)
+    {
+      enter(app_);
+      fn();
+      leave();
+    }
+
+  private:
+    static constexpr uint8_t PROTO_ICMP = 1;
+    static constexpr uint8_t PROTO_TCP  = 6;
+    static constexpr uint8_t PROTO_UDP  = 17;
+    static constexpr uint8_t SYN = 0x02, ACK = 0x10;
+    static constexpr uint16_t ETH_IP4 = 0x0800, ETH_ARP = 0x0806, ETH_VLAN = 0x8100;
+
+    struct Ip {
+      const uint8_t* mac_src = nullptr;
+      const uint8_t* hdr;
+      uint32_t len;
+      uint32_t src, dst;   // network order, as ip4::Addr keeps them
+      uint8_t  proto;
+      const uint8_t* l4;
+      uint32_t l4_len;
+    };
+    struct Scope {
+      Layer*   layer;
+      uint64_t start;
+    };
+
+    const Pcap& pcap_;
+    uint32_t server_ = 0;
+    std::set<uint16_t> tcp_ports_, http_ports_, udp_ports_;
+    // by the client socket, and the server ISN recorded
+    std::unordered_map<uint64_t, uint32_t> recorded_isn_;
+    // what the stack's ISN differs by, once it has picked it
+    std::unordered_map<uint64_t, uint32_t> deltas_;
+    std::unordered_set<uint32_t> neighbours_;
+
+    Result result_;
+    Layer ip4_{"ip4"}, tcp_{"tcp"}, udp_{"udp"}, icmp_{"icmp"}, arp_{"arp"}, app_{"app"};
+    std::vector<Scope> scopes_;
+    net::upstream_ip next_ip4_;
+    net::upstream next_tcp_, next_udp_, next_icmp_, next_arp_;
+
+    static uint16_t get16(const uint8_t* p) noexcept
+    { return p[0] << 8 | p[1]; }
+    static uint32_t get32(const uint8_t* p) noexcept
+    { return uint32_t(get16(p)) << 16 | get16(p + 2); }
+    static uint64_t flow_key(uint32_t addr, uint16_t port) noexcept
+    { return uint64_t(addr) << 16 | port; }
+
+    // the network layer of a frame, past any VLAN tags
+    const uint8_t* strip_link(const Frame& frame, uint16_t& type, uint32_t& len) const noexcept
+    {
+      const uint8_t* p = frame.data;
+      len  = frame.len;
+      type = ETH_IP4;
+      if (not pcap_.ethernet()) return p;
+      if (len < 14) {
+        type = 0;
+        return p;
+      }
+      type = get16(p + 12);
+      p += 14; len -= 14;
+      while (type == ETH_VLAN and len >= 4) {
+        type = get16(p + 2);
+        p += 4; len -= 4;
+      }
+      return p;
+    }
+
+    // an IPv4 header, and what follows it
+    static bool parse_ip(const uint8_t* p, uint32_t len, Ip& ip) noexcept
+    {
+      if (len < 20 or (p[0] >> 4) != 4) return false;
+      const uint32_t hlen = (p[0] & 0xf) * 4;
+      const uint32_t total = get16(p + 2);
+      if (hlen < 20 or total < hlen or total > len) return false;
+      ip.hdr   = p;
+      ip.len   = total;
+      memcpy(&ip.src, p + 12, 4);
+      memcpy(&ip.dst, p + 16, 4);
+      ip.proto = p[9];
+      // only the first fragment has the ports
+      const bool later_fragment = (get16(p + 6) & 0x1fff) != 0;
+      ip.l4     = p + hlen;
+      ip.l4_len = later_fragment ? 0 : total - hlen;
+      return true;
+    }
+
+    bool parse(const Frame& frame, Ip& ip) const noexcept
+    {
+      uint16_t type;
+      uint32_t len;
+      const uint8_t* p = strip_link(frame, type, len);
+      if (type != ETH_IP4 or not parse_ip(p, len, ip)) return false;
+      if (pcap_.ethernet()) ip.mac_src = frame.data + 6;
+      return true;
+    }
+
+    // the ports, flows and services of the server
+    void scan()
+    {
+      tcp_ports_.clear();
+      http_ports_.clear();
+      udp_ports_.clear();
+      recorded_isn_.clear();
+      std::set<uint16_t> seen_payload;
+      for (const auto& frame : pcap_.frames())
+      {
+        Ip ip;
+        if (not parse(frame, ip) or ip.l4_len < 8) continue;
+        const uint16_t dport = get16(ip.l4 + 2);
+        if (ip.proto == PROTO_UDP and ip.dst == server_) {
+          udp_ports_.insert(dport);
+          continue;
+        }
+        if (ip.proto != PROTO_TCP or ip.l4_len < 20) continue;
+        const uint8_t flags = ip.l4[13];
+        if (ip.dst == server_ and (flags & (SYN | ACK)) == SYN) {
+          tcp_ports_.insert(dport);
+        }
+        else if (ip.src == server_ and (flags & (SYN | ACK)) == (SYN | ACK)) {
+          recorded_isn_[flow_key(ip.dst, dport)] = get32(ip.l4 + 4);
+        }
+        else if (ip.dst == server_ and tcp_ports_.count(dport)
+                 and not seen_payload.count(dport))
+        {
+          const uint32_t off = (ip.l4[12] >> 4) * 4;
+          if (off >= ip.l4_len) continue;
+          seen_payload.insert(dport);
+          static const char* methods[] {"GET ", "POST", "PUT ", "HEAD", "DELE", "OPTI", "PATC"};
+          for (const char* method : methods)
+            if (ip.l4_len - off >= 4 and memcmp(ip.l4 + off, method, 4) == 0)
+              http_ports_.insert(dport);
+        }
+      }
+    }
+
+    void enter(Layer& layer)
+    {
+      scopes_.push_back({&layer, os::cycles_since_boot()});
+    }
+    void leave()
+    {
+      const auto scope = scopes_.back();
+      scopes_.pop_back();
+      const uint64_t cycles = os::cycles_since_boot() - scope.start;
+      scope.layer->cycles += cycles;
+      scope.layer->count++;
+      if (not scopes_.empty()) scopes_.back().layer->inner += cycles;
+    }
+
+    void ip4_in(net::Packet_ptr pkt, const bool bcast)
+    { enter(ip4_); next_ip4_(std::move(pkt), bcast); leave(); }
+    void tcp_in(net::Packet_ptr pkt)
+    { enter(tcp_); next_tcp_(std::move(pkt)); leave(); }
+    void udp_in(net::Packet_ptr pkt)
+    { enter(udp_); next_udp_(std::move(pkt)); leave(); }
+    void icmp_in(net::Packet_ptr pkt)
+    { enter(icmp_); next_icmp_(std::move(pkt)); leave(); }
+    void arp_in(net::Packet_ptr pkt)
+    { enter(arp_); next_arp_(std::move(pkt)); leave(); }
+
+    void attach(Nic_mock& nic, net::Inet& inet)
+    {
+      for (auto* layer : {&ip4_, &tcp_, &udp_, &icmp_, &arp_, &app_})
+        *layer = Layer{layer->name};
+      auto& ip4 = inet.ip_obj();
+      next_ip4_  = nic.ip4_upstream();
+      next_arp_  = nic.arp_upstream();
+      next_tcp_  = ip4.tcp_handler();
+      next_udp_  = ip4.udp_handler();
+      next_icmp_ = ip4.icmp_handler();
+      nic.set_ip4_upstream({this, &Replayer::ip4_in});
+      nic.set_arp_upstream({this, &Replayer::arp_in});
+      ip4.set_tcp_handler({this, &Replayer::tcp_in});
+      ip4.set_udp_handler({this, &Replayer::udp_in});
+      ip4.set_icmp_handler({this, &Replayer::icmp_in});
+      nic.on_transmit_ = {this, &Replayer::transmitted};
+    }
+
+    void detach(Nic_mock& nic, net::Inet& inet)
+    {
+      auto& ip4 = inet.ip_obj();
+      nic.set_ip4_upstream(next_ip4_);
+      nic.set_arp_upstream(next_arp_);
+      ip4.set_tcp_handler(next_tcp_);
+      ip4.set_udp_handler(next_udp_);
+      ip4.set_icmp_handler(next_icmp_);
+      nic.on_transmit_ = nullptr;
+    }
+
+    static void idle()
+    {
+      Events::get().process_events();
+      if (Timers::is_ready()) Timers::timers_handler();
+    }
+
+    // the ISN the stack picked for a connection, from its SYN-ACK
+    void transmitted(const net::Packet& pkt, net::Ethertype type)
+    {
+      result_.sent++;
+      Ip ip;
+      if (type != net::Ethertype::IP4 or not parse_ip(pkt.layer_begin(), pkt.size(), ip)
+          or ip.proto != PROTO_TCP or ip.l4_len < 20)
+        return;
+      if ((ip.l4[13] & (SYN | ACK)) != (SYN | ACK)) return;
+      const uint64_t key = flow_key(ip.dst, get16(ip.l4 + 2));
+      auto it = recorded_isn_.find(key);
+      if (it != recorded_isn_.end())
+        deltas_[key] = get32(ip.l4 + 4) - it->second;
+    }
+
+    // move the acknowledgement by what the stack's ISN differs by, and
+    // the checksum with it (RFC 1624)
+    void rewrite_ack(uint8_t* tcp, uint32_t delta)
+    {
+      const uint32_t old_ack = get32(tcp + 8);
+      const uint32_t new_ack = old_ack + delta;
+      for (int i = 0; i < 4; i++) tcp[8 + i] = new_ack >> (24 - 8 * i);
+      uint32_t sum = uint16_t(~get16(tcp + 16));
+      sum += uint16_t(~(old_ack >> 16)) + uint16_t(~old_ack);
+      sum += (new_ack >> 16) + (new_ack & 0xffff);
+      while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+      const uint16_t csum = ~sum;
+      tcp[16] = csum >> 8;
+      tcp[17] = csum;
+    }
+
+    void deliver(Nic_mock& nic, net::Inet& inet, const Frame& frame)
+    {
+      uint16_t type;
+      uint32_t len;
+      const uint8_t* p = strip_link(frame, type, len);
+      Ip ip;
+      const bool is_ip = parse(frame, ip);
+      if (frame.truncated or (type != ETH_ARP and not is_ip)
+          or (is_ip and (ip.dst != server_ or ip.src == server_))
+          or len > uint32_t(Nic_mock::packet_len() - Nic_mock::frame_offs_link_))
+      {
+        result_.skipped++;
+        return;
+      }
+
+      auto pkt = nic.create_packet(0);
+      if (is_ip) len = ip.len;
+      memcpy(pkt->layer_begin(), p, len);
+      pkt->set_data_end(len);
+
+      if (is_ip)
+      {
+        // the stack won't ask for the clients, it knows them from their frames
+        if (ip.mac_src and neighbours_.insert(ip.src).second)
+        {
+          const auto* m = ip.mac_src;
+          inet.arp().cache(net::ip4::Addr{ip.src}, MAC::Addr{m[0], m[1], m[2], m[3], m[4], m[5]});
+        }
+        if (ip.proto == PROTO_TCP and ip.l4_len >= 20 and (ip.l4[13] & ACK))
+        {
+          auto it = deltas_.find(flow_key(ip.src, get16(ip.l4)));
+          if (it != deltas_.end())
+            rewrite_ack(pkt->layer_begin() + (ip.l4 - ip.hdr), it->second);
+        }
+      }
+
+      result_.delivered++;
+      const uint64_t start = os::cycles_since_boot();
+      if (is_ip)
+        nic.receive(std::move(pkt));
+      else
+        nic.arp_upstream()(std::move(pkt));
+      result_.cycles += os::cycles_since_boot() - start;
+    }
+  };
+
+} // replay
+
+#endif
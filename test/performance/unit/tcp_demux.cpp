@@ -0,0 +1,96 @@
+#include <common.cxx>
+#include <net/socket.hpp>
+#include <util/flat_map.hpp>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+using Tuple = std::pair<net::Socket, net::Socket>;
+
+static const size_t NUM_CONNS   = 10000;
+static const size_t NUM_LOOKUPS = 1000000;
+
+static inline auto now() {
+  using namespace std::chrono;
+  return duration_cast< nanoseconds >(steady_clock::now().time_since_epoch());
+}
+
+// a server on port 80, with connections from many clients
+static std::vector<Tuple> make_tuples()
+{
+  const net::Socket local{net::ip4::Addr{10,0,0,42}, 80};
+  std::vector<Tuple> tuples;
+  for (size_t i = 0; i < NUM_CONNS; i++)
+  {
+    const net::ip4::Addr client{10, 1, uint8_t(i >> 8), uint8_t(i)};
+    tuples.emplace_back(local, net::Socket{client, uint16_t(49152 + i % 16384)});
+  }
+  return tuples;
+}
+
+template <typename Map, typename Find>
+static double lookup_ns(const std::vector<Tuple>& tuples, Map& map, Find find)
+{
+  size_t found = 0;
+  const auto start = now();
+  for (size_t i = 0; i < NUM_LOOKUPS; i++)
+    found += find(map, tuples[(i * 7919) % tuples.size()]);
+  const auto time = now() - start;
+  EXPECT(found == NUM_LOOKUPS);
+  return double(time.count()) / NUM_LOOKUPS;
+}
+
+CASE("TCP connection demux benchmark")
+{
+  const auto tuples = make_tuples();
+  auto conn = std::make_shared<int>(0);
+
+  std::unordered_map<Tuple, std::shared_ptr<int>> node_map;
+  Flat_map<Tuple, std::shared_ptr<int>> flat_map;
+  for (const auto& tuple : tuples) {
+    node_map.emplace(tuple, conn);
+    flat_map.emplace(tuple, conn);
+  }
+
+  const double node_ns = lookup_ns(tuples, node_map, [] (auto& map, const Tuple& t) {
+    return map.find(t) != map.end();
+  });
+  const double flat_ns = lookup_ns(tuples, flat_map, [] (auto& map, const Tuple& t) {
+    return map.find(t) != nullptr;
+  });
+
+  printf("Connections: %zu, unordered_map %.1f ns/lookup, Flat_map %.1f ns/lookup\n",
+         NUM_CONNS, node_ns, flat_ns);
+}
+
+CASE("TCP listener demux benchmark")
+{
+  // segments to a listener miss on the address, then hit on any address
+  std::vector<Tuple> tuples;
+  for (uint16_t port = 1; port <= 64; port++)
+    tuples.emplace_back(net::Socket{net::ip4::Addr{10,0,0,42}, port}, net::Socket{});
+
+  std::map<net::Socket, std::shared_ptr<int>> tree_map;
+  Flat_map<net::Socket, std::shared_ptr<int>> flat_map;
+  for (const auto& tuple : tuples) {
+    const net::Socket any{net::ip4::Addr::addr_any, tuple.first.port()};
+    tree_map.emplace(any, nullptr);
+    flat_map.emplace(any, nullptr);
+  }
+
+  const double tree_ns = lookup_ns(tuples, tree_map, [] (auto& map, const Tuple& t) {
+    const auto& s = t.first;
+    return map.find(s) != map.end()
+        or map.find({s.address().any_addr(), s.port()}) != map.end();
+  });
+  const double flat_ns = lookup_ns(tuples, flat_map, [] (auto& map, const Tuple& t) {
+    const auto& s = t.first;
+    return map.find(s) != nullptr
+        or map.find({s.address().any_addr(), s.port()}) != nullptr;
+  });
+
+  printf("Listeners: %zu, map %.1f ns/lookup, Flat_map %.1f ns/lookup\n",
+         tuples.size(), tree_ns, flat_ns);
+}
@@ -67,3 +67,52 @@ CASE("Decode 'Zm8' (without padding) throws exception") {
   EXPECT_THROWS(base64::decode("Zm8"));
   EXPECT_THROWS_AS(base64::decode("Zm8"),  base64::Decode_error);
 }
+
+CASE("Decode invalid characters throws exception") {
+  EXPECT_THROWS_AS(base64::decode("Zm9v!mFy"), base64::Decode_error);
+  EXPECT_THROWS_AS(base64::decode("Zm9v-mFy"), base64::Decode_error);
+}
+
+CASE("Encode and decode with the URL alphabet") {
+  const std::string data {"\xfb\xff\xbf"};
+  EXPECT("+/+/" == base64::encode(data));
+  EXPECT("-_-_" == base64::encode(data, base64::url_alphabet{true}));
+  EXPECT(data == base64::decode<std::string>("-_-_", base64::url_alphabet{true}));
+  EXPECT_THROWS_AS(base64::decode("-_-_"), base64::Decode_error);
+}
+
+CASE("Encode and decode data of every length up to 300") {
+  std::string data;
+  for (size_t len = 0; len <= 300; len++)
+  {
+    const auto enc = base64::encode(data);
+    EXPECT(enc.size() == base64::encoded_size(len));
+    EXPECT(data == base64::decode<std::string>(enc));
+
+    const auto url = base64::encode(data, base64::url_alphabet{true});
+    EXPECT(data == base64::decode<std::string>(url, base64::url_alphabet{true}));
+    data.push_back(len * 167 + 13);
+  }
+}
+
+CASE("decode_into() takes unpadded data, and rejects bad characters anywhere") {
+  std::string data(1000, 0);
+  for (size_t i = 0; i < data.size(); i++) data[i] = i * 31 + (i >> 3);
+  const auto enc = base64::encode(data);
+  std::vector<char> out(base64::decoded_size(enc.size()));
+
+  const auto unpadded = enc.substr(0, enc.find('='));
+  EXPECT(unpadded.size() == enc.size() - 2);
+  EXPECT(base64::decode_into(unpadded.data(), unpadded.size(), out.data()) == 1000);
+  EXPECT(std::string(out.data(), 1000) == data);
+
+  for (size_t pos : {0, 100, 700, 1330}) {
+    auto bad = enc;
+    bad[pos] = '*';
+    EXPECT(base64::decode_into(bad.data(), bad.size(), out.data()) == -1);
+    EXPECT(base64::decode_into(bad.data(), bad.size(), out.data(),
+                               base64::url_alphabet{false}, false) == 1000);
+  }
+  // a single char can't be decoded
+  EXPECT(base64::decode_into("Zm9vY", 5, out.data()) == -1);
+}
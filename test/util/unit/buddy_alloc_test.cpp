@@ -115,6 +115,67 @@ CASE("mem::buddy basic allocation / deallocation"){
 }
 
 
+CASE("mem::buddy free block lookup and fragmentation"){
+  using namespace util;
+
+  Pool pool(64_KiB);
+  auto& alloc = *pool.alloc;
+  EXPECT(alloc.free_blocks() == 1);
+  EXPECT(alloc.largest_free() == 64_KiB);
+
+  // The rest is split into free blocks of 4, 8, 16 and 32 KiB
+  auto* a = alloc.allocate(4_KiB);
+  EXPECT(alloc.free_blocks(4_KiB) == 1);
+  EXPECT(alloc.free_blocks(8_KiB) == 1);
+  EXPECT(alloc.free_blocks(16_KiB) == 1);
+  EXPECT(alloc.free_blocks(32_KiB) == 1);
+  EXPECT(alloc.largest_free() == 32_KiB);
+
+  // The smallest free block that fits is taken, not split from a larger one
+  auto* b = alloc.allocate(8_KiB);
+  EXPECT((uintptr_t)b == (uintptr_t)a + 8_KiB);
+  EXPECT(alloc.free_blocks(8_KiB) == 0);
+  EXPECT(alloc.free_blocks(4_KiB) == 1);
+
+  // Buddies merge again when freed
+  alloc.deallocate(a, 4_KiB);
+  EXPECT(alloc.free_blocks(4_KiB) == 0);
+  EXPECT(alloc.free_blocks(8_KiB) == 1);
+  alloc.deallocate(b, 8_KiB);
+  EXPECT(alloc.free_blocks() == 1);
+  EXPECT(alloc.largest_free() == 64_KiB);
+  EXPECT(alloc.bytes_used() == 0);
+}
+
+CASE("mem::buddy allocation within an address range"){
+  using namespace util;
+
+  Pool pool(64_KiB);
+  auto& alloc = *pool.alloc;
+  const auto base = alloc.root().addr();
+
+  // Only the upper half, split down from the root
+  auto* a = alloc.allocate_in(4_KiB, base + 32_KiB, base + 64_KiB);
+  EXPECT((uintptr_t)a == base + 32_KiB);
+  EXPECT(alloc.free_blocks(32_KiB) == 1);
+  auto* b = alloc.allocate_in(8_KiB, base + 32_KiB, base + 64_KiB);
+  EXPECT((uintptr_t)b == base + 40_KiB);
+
+  // A range not on a chunk boundary gets the chunk inside it
+  auto* c = alloc.allocate_in(4_KiB, base + 1, base + 12_KiB);
+  EXPECT((uintptr_t)c == base + 4_KiB);
+
+  // Nothing fits
+  EXPECT(alloc.allocate_in(32_KiB, base + 36_KiB, base + 64_KiB) == nullptr);
+  EXPECT(alloc.allocate_in(4_KiB, base + 1, base + 4_KiB) == nullptr);
+
+  alloc.deallocate(a, 4_KiB);
+  alloc.deallocate(b, 8_KiB);
+  alloc.deallocate(c, 4_KiB);
+  EXPECT(alloc.free_blocks() == 1);
+  EXPECT(alloc.bytes_used() == 0);
+}
+
 CASE("mem::buddy random ordered allocation then deallocation"){
   using namespace util;
   #ifdef DEBUG_UNIT
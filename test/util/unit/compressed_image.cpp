@@ -0,0 +1,86 @@
+#include <common.cxx>
+#include <util/compressed_image.hpp>
+#include <util/lz4.hpp>
+#include <cstring>
+#include <random>
+
+// something like a binary: runs of zeroes, repeated code, some noise
+static std::vector<uint8_t> sample_image(size_t size)
+{
+  std::vector<uint8_t> data(size);
+  std::mt19937 rng {42};
+  for (size_t i = 0; i < size; i++)
+  {
+    if (i % 4096 < 1024) data[i] = 0;
+    else if (i % 4096 < 3072) data[i] = "push rbp; mov rbp, rsp; ret"[i % 27];
+    else data[i] = rng();
+  }
+  return data;
+}
+
+CASE("LZ4 blocks round trip, and malformed blocks are refused")
+{
+  for (size_t size : {0, 1, 12, 13, 100, 70000})
+  {
+    auto data = sample_image(size);
+    std::vector<uint8_t> block(lz4::compress_bound(size));
+    const size_t len = lz4::compress(data.data(), size, block.data(), block.size());
+    EXPECT(len > 0u);
+    std::vector<uint8_t> out(size);
+    EXPECT(lz4::decompress(block.data(), len, out.data(), out.size()) == (long) size);
+    EXPECT(out == data);
+    if (size > 0)
+      // no room for the last byte
+      EXPECT(lz4::decompress(block.data(), len, out.data(), size - 1) == -1);
+  }
+  // a match reaching back before the start
+  const uint8_t bad[] {0x10, 'a', 0x05, 0x00, 0x00};
+  uint8_t out[64];
+  EXPECT(lz4::decompress(bad, sizeof(bad), out, sizeof(out)) == -1);
+}
+
+CASE("Compressed images round trip in chunks, and are smaller")
+{
+  const auto data = sample_image(300000);
+  EXPECT(not compressed_image::is_compressed(data.data(), data.size()));
+
+  auto image = compressed_image::compress(data.data(), data.size(), 64 * 1024);
+  EXPECT(compressed_image::is_compressed(image.data(), image.size()));
+  EXPECT(compressed_image::decompressed_size(image.data(), image.size()) == data.size());
+  EXPECT(image.size() < data.size() / 2);
+
+  std::vector<uint8_t> out(data.size());
+  EXPECT(compressed_image::decompress(image.data(), image.size(), out.data(), out.size()) == data.size());
+  EXPECT(out == data);
+  // it doesn't fit
+  EXPECT_THROWS_AS(compressed_image::decompress(image.data(), image.size(), out.data(), out.size() - 1),
+                   compressed_image::Error);
+
+  // noise is stored as is
+  std::vector<uint8_t> noise(10000);
+  std::mt19937 rng {7};
+  for (auto& b : noise) b = rng();
+  image = compressed_image::compress(noise.data(), noise.size());
+  EXPECT(image.size() == sizeof(compressed_image::Header) + sizeof(compressed_image::Chunk) + noise.size());
+  out.resize(noise.size());
+  compressed_image::decompress(image.data(), image.size(), out.data(), out.size());
+  EXPECT(out == noise);
+}
+
+CASE("Corrupt and truncated compressed images are refused")
+{
+  const auto data = sample_image(200000);
+  const auto image = compressed_image::compress(data.data(), data.size(), 32 * 1024);
+  std::vector<uint8_t> out(data.size());
+
+  auto corrupt = image;
+  corrupt[image.size() - 100] ^= 0x40;
+  EXPECT_THROWS_AS(compressed_image::decompress(corrupt.data(), corrupt.size(), out.data(), out.size()),
+                   compressed_image::Error);
+  EXPECT_THROWS_AS(compressed_image::decompress(image.data(), image.size() - 1, out.data(), out.size()),
+                   compressed_image::Error);
+  EXPECT_THROWS_AS(compressed_image::decompress(image.data(), 40, out.data(), out.size()),
+                   compressed_image::Error);
+  EXPECT_THROWS_AS(compressed_image::decompress(data.data(), data.size(), out.data(), out.size()),
+                   compressed_image::Error);
+}
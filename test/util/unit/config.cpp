@@ -3,6 +3,8 @@
 
 char _CONFIG_JSON_START_;
 char _CONFIG_JSON_END_;
+char _CONFIG_BIN_START_;
+char _CONFIG_BIN_END_;
 
 CASE("Test empty config")
 {
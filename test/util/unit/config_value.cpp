@@ -0,0 +1,67 @@
+#include <common.cxx>
+#include <util/config_value.hpp>
+#include <string>
+
+// the compiled form of
+// {"net": [{"iface": 0, "config": ["dhcp", "static"], "timeout": 2.5}], "x": null}
+static std::string compiled()
+{
+  auto u32 = [] (uint32_t v) { return std::string((const char*) &v, 4); };
+  auto str = [&] (const std::string& s) { return u32(s.size()) + s + '\0'; };
+  auto tag = [] (Config_value::Type t) { return std::string(1, (char) t); };
+  auto i64 = [] (int64_t v) { return std::string((const char*) &v, 8); };
+  auto f64 = [] (double v)  { return std::string((const char*) &v, 8); };
+  auto container = [&] (Config_value::Type t, uint32_t n, const std::string& body) {
+    return tag(t) + u32(n) + u32(body.size()) + body;
+  };
+
+  const auto methods = container(Config_value::ARRAY_T, 2,
+      tag(Config_value::STRING_T) + str("dhcp") + tag(Config_value::STRING_T) + str("static"));
+  const auto iface = container(Config_value::OBJECT_T, 3,
+      str("iface") + tag(Config_value::INT_T) + i64(0) +
+      str("config") + methods +
+      str("timeout") + tag(Config_value::DOUBLE_T) + f64(2.5));
+  return container(Config_value::OBJECT_T, 2,
+      str("net") + container(Config_value::ARRAY_T, 1, iface) +
+      str("x") + tag(Config_value::NULL_T));
+}
+
+CASE("Config_value looks up members and iterates arrays in place")
+{
+  const auto blob = compiled();
+  const Config_value root {(const uint8_t*) blob.data()};
+  EXPECT(root.IsObject());
+  EXPECT(root.Size() == 2u);
+  EXPECT(root.encoded_size() == blob.size());
+  EXPECT(root.HasMember("net"));
+  EXPECT(not root.HasMember("ne"));
+  EXPECT(not root.HasMember("x"));
+
+  const auto net = root["net"];
+  EXPECT(net.IsArray());
+  EXPECT(net.Size() == 1u);
+  int count = 0;
+  for (const auto& val : net.GetArray())
+  {
+    count++;
+    EXPECT(val["iface"].IsInt());
+    EXPECT(val["iface"].GetInt() == 0);
+    EXPECT(val["timeout"].GetDouble() == 2.5);
+    std::string methods;
+    for (const auto& m : val["config"].GetArray())
+      methods += std::string(m.GetString()) + ";";
+    EXPECT(methods == "dhcp;static;");
+    EXPECT(val["config"].GetArray().begin()->GetStringLength() == 4u);
+  }
+  EXPECT(count == 1);
+}
+
+CASE("Config_value is null when empty, or looked up in the wrong type")
+{
+  const Config_value none;
+  EXPECT(none.IsNull());
+  EXPECT(none["net"].IsNull());
+  EXPECT(none.GetArray().begin() == none.GetArray().end());
+  EXPECT(std::string(none.GetString()).empty());
+  EXPECT(none.Size() == 0u);
+}
@@ -24,3 +24,42 @@ CASE("Various text strings with known CRC32 matches")
   EXPECT(crc32_fast(q2.c_str(), q2.size()) == crc32c(q2.c_str(), q2.size()));
   
 }
+
+CASE("Checksumming in pieces gives the same CRC32 as all at once")
+{
+  std::string data;
+  for (int i = 0; i < 5000; i++) data += (char) (i * 131 + (i >> 3));
+
+  const uint32_t whole  = crc32(data.c_str(), data.size());
+  const uint32_t whole_c = crc32c(data.c_str(), data.size());
+  EXPECT(CRC32_VALUE(crc32_update(CRC32_BEGIN(), data.c_str(), data.size())) == whole);
+  EXPECT(crc32_fast(data.c_str(), data.size()) == whole_c);
+
+  // odd sizes, both below and above where folding starts
+  for (size_t piece : {1u, 7u, 100u, 333u, 4096u})
+  {
+    uint32_t crc = CRC32_BEGIN(), crc_c = CRC32_BEGIN();
+    for (size_t i = 0; i < data.size(); i += piece) {
+      const size_t len = std::min(piece, data.size() - i);
+      crc   = crc32_update(crc, &data[i], len);
+      crc_c = crc32c_update(crc_c, &data[i], len);
+    }
+    EXPECT(CRC32_VALUE(crc) == whole);
+    EXPECT(CRC32_VALUE(crc_c) == whole_c);
+  }
+}
+
+#include <util/crc64.hpp>
+CASE("CRC64 check values, all at once and in pieces")
+{
+  EXPECT(util::crc64_ecma_checksum("123456789", 9) == 0x995dc9bbdf1939faull);
+  EXPECT(util::crc64_iso_checksum("123456789", 9)  == 0xb90956c775a41001ull);
+
+  std::vector<char> data(3000);
+  for (size_t i = 0; i < data.size(); i++) data[i] = (char) (i * 7 + 0x80);
+  const uint64_t whole = util::crc64_ecma_checksum(data);
+
+  util::crc64_ecma_checksum crc;
+  crc.update(data.data(), 1).update(data.data() + 1, 1000).update(data.data() + 1001, 1999);
+  EXPECT((uint64_t) crc == whole);
+}
@@ -0,0 +1,118 @@
+#include <common.cxx>
+#include <util/flat_map.hpp>
+#include <unordered_map>
+#include <random>
+
+CASE("A new flat map is empty")
+{
+  Flat_map<int, int> map;
+  EXPECT(map.empty());
+  EXPECT(map.size() == 0);
+  EXPECT(map.find(1) == nullptr);
+}
+
+CASE("Reserving a flat map fixes its capacity")
+{
+  Flat_map<int, int> map(1000);
+  const auto cap = map.capacity();
+  EXPECT(cap >= 1000u);
+
+  for (int i = 0; i < 1000; i++)
+    EXPECT(map.emplace(i, i * 2).second);
+  EXPECT(map.size() == 1000u);
+  EXPECT(map.capacity() == cap);
+}
+
+CASE("Emplace does not replace, insert_or_assign does")
+{
+  Flat_map<int, int> map;
+  auto res = map.emplace(7, 1);
+  EXPECT(res.second);
+  EXPECT(*res.first == 1);
+
+  res = map.emplace(7, 2);
+  EXPECT(not res.second);
+  EXPECT(*map.find(7) == 1);
+
+  EXPECT(not map.insert_or_assign(7, 3));
+  EXPECT(*map.find(7) == 3);
+  EXPECT(map.insert_or_assign(8, 4));
+  EXPECT(map.size() == 2u);
+}
+
+// all keys collide, so erasing has to shift probed keys back
+struct Bad_hash {
+  size_t operator()(int) const noexcept { return 0; }
+};
+
+CASE("Erasing from a cluster keeps every other key reachable")
+{
+  Flat_map<int, int, Bad_hash> map;
+  for (int i = 0; i < 10; i++)
+    map.emplace(i, i);
+
+  EXPECT(map.erase(3));
+  EXPECT(not map.erase(3));
+  EXPECT(map.find(3) == nullptr);
+  for (int i = 0; i < 10; i++)
+    if (i != 3)
+      EXPECT(map.find(i) != nullptr);
+  EXPECT(map.size() == 9u);
+}
+
+CASE("A flat map behaves like std::unordered_map")
+{
+  Flat_map<uint32_t, uint32_t> map;
+  std::unordered_map<uint32_t, uint32_t> ref;
+  std::mt19937 rng(1234);
+
+  for (int i = 0; i < 20000; i++)
+  {
+    const uint32_t key = rng() % 2048;
+    switch (rng() % 3)
+    {
+      case 0:
+        EXPECT(map.insert_or_assign(key, i) == ref.insert_or_assign(key, i).second);
+        break;
+      case 1:
+        EXPECT(map.erase(key) == (ref.erase(key) == 1));
+        break;
+      default: {
+        auto* found = map.find(key);
+        auto it = ref.find(key);
+        EXPECT((found != nullptr) == (it != ref.end()));
+        if (found && it != ref.end())
+          EXPECT(*found == it->second);
+      }
+    }
+  }
+  EXPECT(map.size() == ref.size());
+
+  map.clear();
+  EXPECT(map.empty());
+  EXPECT(map.find(ref.begin()->first) == nullptr);
+}
+
+CASE("Iterating a flat map visits every element once")
+{
+  Flat_map<int, int> map;
+  EXPECT(map.begin() == map.end());
+
+  for (int i = 0; i < 100; i++)
+    map.emplace(i, i * 2);
+  map.erase(42);
+
+  int count = 0, sum = 0;
+  for (auto& kv : map) {
+    EXPECT(kv.second == kv.first * 2);
+    kv.second++;
+    sum += kv.first;
+    count++;
+  }
+  EXPECT(count == 99);
+  EXPECT(sum == 99 * 100 / 2 - 42);
+
+  const auto& cmap = map;
+  for (const auto& kv : cmap)
+    EXPECT(kv.second == kv.first * 2 + 1);
+}
@@ -0,0 +1,108 @@
+#include <common.cxx>
+#include <util/histogram.hpp>
+
+using util::Histogram;
+
+CASE("An empty histogram has no percentiles")
+{
+  Histogram hist;
+  EXPECT(hist.count() == 0u);
+  EXPECT(hist.percentile(50) == 0u);
+  EXPECT(hist.max() == 0u);
+  EXPECT(hist.min() == 0u);
+  EXPECT(hist.mean() == 0.0);
+}
+
+CASE("Small values are kept exactly")
+{
+  Histogram hist;
+  for (uint64_t v = 1; v <= 100; v++) hist.record(v);
+  EXPECT(hist.count() == 100u);
+  EXPECT(hist.min() == 1u);
+  EXPECT(hist.max() == 100u);
+  EXPECT(hist.mean() == 50.5);
+  EXPECT(hist.percentile(1) == 1u);
+  EXPECT(hist.percentile(10) == 10u);
+  EXPECT(hist.percentile(100) == 100u);
+}
+
+CASE("Buckets are never off by more than 1/32 of the value")
+{
+  for (uint64_t v = 1; v < (uint64_t(1) << Histogram::MAX_BITS); v = v * 3 + 7)
+  {
+    const size_t index = Histogram::index_of(v);
+    EXPECT(index < Histogram::BUCKETS);
+    const uint64_t high = Histogram::highest_in(index);
+    EXPECT(high >= v);
+    EXPECT(high - v <= v / Histogram::SUB_COUNT);
+    // the next bucket starts right after
+    EXPECT(Histogram::index_of(high + 1) == index + 1);
+  }
+  EXPECT(Histogram::index_of(UINT64_MAX) == Histogram::BUCKETS - 1);
+}
+
+CASE("The tail is not hidden by the median")
+{
+  Histogram hist;
+  // 1 us, with one in a hundred taking 1 ms, and one taking a second
+  for (int i = 0; i < 10000; i++)
+    hist.record((i % 100 == 99) ? 1'000'000 : 1'000);
+  hist.record(1'000'000'000);
+
+  const uint64_t p50 = hist.percentile(50);
+  const uint64_t p90 = hist.percentile(90);
+  const uint64_t p99 = hist.percentile(99);
+  EXPECT(p50 >= 1'000u);
+  EXPECT(p50 < 1'032u);
+  EXPECT(p90 < 1'032u);
+  EXPECT(p99 >= 1'000'000u);
+  EXPECT(p99 < 1'032'000u);
+  EXPECT(hist.percentile(100) == 1'000'000'000u);
+  EXPECT(hist.max() == 1'000'000'000u);
+}
+
+CASE("Values past the last bucket keep the max")
+{
+  Histogram hist;
+  const uint64_t huge = uint64_t(1) << 50;
+  hist.record(5);
+  hist.record(huge);
+  EXPECT(hist.percentile(100) == huge);
+  EXPECT(hist.max() == huge);
+}
+
+CASE("Merged histograms are the same as one")
+{
+  Histogram a, b, both;
+  for (uint64_t v = 0; v < 5000; v++) {
+    const uint64_t val = v * v;
+    ((v & 1) ? a : b).record(val);
+    both.record(val);
+  }
+  a.merge(b);
+  EXPECT(a.count() == both.count());
+  EXPECT(a.sum() == both.sum());
+  EXPECT(a.min() == both.min());
+  EXPECT(a.max() == both.max());
+  for (double p : {1.0, 50.0, 90.0, 99.0, 99.9})
+    EXPECT(a.percentile(p) == both.percentile(p));
+
+  a.reset();
+  EXPECT(a.count() == 0u);
+  EXPECT(a.percentile(99) == 0u);
+  EXPECT(a.to_string() == "count=0 p50=0 p90=0 p99=0 p99.9=0 max=0");
+}
+
+CASE("Per-CPU histograms are merged when read")
+{
+  util::Histogram_percpu hist(4);
+  EXPECT(hist.cpus() == 4u);
+  hist.at(0).record(10);
+  hist.at(3).record(20);
+  EXPECT(hist.at(3).count() == 1u);
+  EXPECT(hist.merged().count() == 2u);
+  EXPECT(hist.merged().max() == 20u);
+  EXPECT_THROWS(hist.at(4));
+  hist.reset();
+  EXPECT(hist.merged().count() == 0u);
+}
@@ -0,0 +1,95 @@
+
+#include <common.cxx>
+#include <util/lockfree_ring.hpp>
+#include <memory>
+
+CASE("A new SPSC ring is empty")
+{
+  util::SPSC_ring<int, 8> ring;
+  EXPECT(ring.capacity() == 8u);
+  EXPECT(ring.empty());
+  int val;
+  EXPECT(not ring.pop(val));
+}
+CASE("SPSC ring keeps the order and stops when full")
+{
+  util::SPSC_ring<int, 4> ring;
+  for (int i = 0; i < 4; i++)
+    EXPECT(ring.push(i));
+  EXPECT(not ring.push(4));
+  EXPECT(ring.size() == 4u);
+
+  int val = -1;
+  EXPECT(ring.pop(val));
+  EXPECT(val == 0);
+  EXPECT(ring.push(4));
+  for (int i = 1; i <= 4; i++) {
+    EXPECT(ring.pop(val));
+    EXPECT(val == i);
+  }
+  EXPECT(ring.empty());
+}
+CASE("SPSC ring moves as many as it can in bulk, across the wrap")
+{
+  util::SPSC_ring<int, 8> ring;
+  int in[12] = {0,1,2,3,4,5,6,7,8,9,10,11};
+  int out[12] = {};
+  EXPECT(ring.push_bulk(in, 6) == 6u);
+  EXPECT(ring.pop_bulk(out, 4) == 4u);
+  // only 6 slots are free
+  EXPECT(ring.push_bulk(in + 6, 6) == 6u);
+  EXPECT(ring.push_bulk(in, 1) == 0u);
+  EXPECT(ring.pop_bulk(out + 4, 12) == 8u);
+  for (int i = 0; i < 12; i++)
+    EXPECT(out[i] == i);
+  EXPECT(ring.pop_bulk(out, 1) == 0u);
+}
+CASE("SPSC ring moves elements that can't be copied")
+{
+  util::SPSC_ring<std::unique_ptr<int>, 2> ring;
+  EXPECT(ring.push(std::make_unique<int>(42)));
+  std::unique_ptr<int> val;
+  EXPECT(ring.pop(val));
+  EXPECT(val != nullptr);
+  EXPECT(*val == 42);
+}
+CASE("A new MPSC ring is empty")
+{
+  util::MPSC_ring<int, 8> ring;
+  EXPECT(ring.capacity() == 8u);
+  EXPECT(ring.empty());
+  int val;
+  EXPECT(not ring.pop(val));
+}
+CASE("MPSC ring keeps the order and stops when full")
+{
+  util::MPSC_ring<int, 4> ring;
+  for (int i = 0; i < 4; i++)
+    EXPECT(ring.push(i));
+  EXPECT(not ring.push(4));
+
+  int val = -1;
+  EXPECT(ring.pop(val));
+  EXPECT(val == 0);
+  EXPECT(ring.push(4));
+  for (int i = 1; i <= 4; i++) {
+    EXPECT(ring.pop(val));
+    EXPECT(val == i);
+  }
+  EXPECT(ring.empty());
+}
+CASE("MPSC ring moves as many as it can in bulk, across the wrap")
+{
+  util::MPSC_ring<int, 8> ring;
+  int in[20];
+  for (int i = 0; i < 20; i++) in[i] = i;
+  int out[20] = {};
+  EXPECT(ring.push_bulk(in, 5) == 5u);
+  EXPECT(ring.pop_bulk(out, 5) == 5u);
+  EXPECT(ring.push_bulk(in + 5, 10) == 8u);
+  EXPECT(ring.pop_bulk(out + 5, 20) == 8u);
+  for (int i = 0; i < 13; i++)
+    EXPECT(out[i] == i);
+  EXPECT(ring.pop_bulk(out, 1) == 0u);
+  EXPECT(ring.empty());
+}
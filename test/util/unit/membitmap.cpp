@@ -1,6 +1,7 @@
 
 #include <common.cxx>
 #include <util/membitmap.hpp>
+#include <vector>
 
 CASE( "Empty chunk data means no set bits" )
 {
@@ -119,3 +120,85 @@ CASE( "Bit-and two bitmaps together" )
   EXPECT( bmp2.get_chunk(0) == 0xFFFFFFFF );
   EXPECT( bmp2.get_chunk(1) == 0x0 );
 }
+CASE( "Find the next set bit from an index" )
+{
+  uint32_t data[3] = {0, 0, 0};
+  MemBitmap bmp(data, 3);
+
+  EXPECT( bmp.next_set(0) == -1 );
+  bmp.set(5);
+  bmp.set(40);
+  bmp.set(95);
+  EXPECT( bmp.next_set(0)  == 5 );
+  EXPECT( bmp.next_set(5)  == 5 );
+  EXPECT( bmp.next_set(6)  == 40 );
+  EXPECT( bmp.next_set(41) == 95 );
+  EXPECT( bmp.next_set(96) == -1 );
+  EXPECT( bmp.next_set(500) == -1 );
+}
+CASE( "Find the first clear bit past full words" )
+{
+  std::vector<MemBitmap::word> data(100, UINT32_MAX);
+  MemBitmap bmp(data.data(), data.size());
+
+  EXPECT( bmp.first_free() == -1 );
+  bmp.reset(77 * 32 + 9);
+  bmp.reset(3 * 32 + 31);
+  EXPECT( bmp.first_free() == 3 * 32 + 31 );
+  EXPECT( bmp.next_free(3 * 32 + 31) == 3 * 32 + 31 );
+  EXPECT( bmp.next_free(4 * 32) == 77 * 32 + 9 );
+  EXPECT( bmp.next_free(77 * 32 + 10) == -1 );
+}
+CASE( "Find runs of clear bits" )
+{
+  std::vector<MemBitmap::word> data(8, UINT32_MAX);
+  MemBitmap bmp(data.data(), data.size());
+
+  EXPECT( bmp.find_free_run(1) == -1 );
+  // a run inside of a word
+  for (int i = 40; i < 45; i++) bmp.reset(i);
+  EXPECT( bmp.find_free_run(1) == 40 );
+  EXPECT( bmp.find_free_run(5) == 40 );
+  EXPECT( bmp.find_free_run(6) == -1 );
+  // a run across words
+  for (int i = 90; i < 140; i++) bmp.reset(i);
+  EXPECT( bmp.find_free_run(6) == 90 );
+  EXPECT( bmp.find_free_run(50) == 90 );
+  EXPECT( bmp.find_free_run(51) == -1 );
+  // up to the end of the bitmap
+  for (int i = 150; i < 256; i++) bmp.reset(i);
+  EXPECT( bmp.find_free_run(51) == 150 );
+  EXPECT( bmp.find_free_run(106) == 150 );
+  EXPECT( bmp.find_free_run(107) == -1 );
+}
+CASE( "A summary of the words gives the same answers" )
+{
+  std::vector<MemBitmap::word> data(2048, 0);
+  std::vector<MemBitmap::word> summary(MemBitmap::summary_chunks(data.size()));
+  MemBitmap bmp(data.data(), data.size());
+  bmp.set_summary(summary.data());
+
+  EXPECT( bmp.first_set() == -1 );
+  bmp.set_all();
+  EXPECT( bmp.first_free() == -1 );
+  EXPECT( bmp.first_set() == 0 );
+
+  bmp.reset(60000);
+  bmp.reset(60001);
+  bmp.reset(1000);
+  EXPECT( bmp.first_free() == 1000 );
+  EXPECT( bmp.next_free(1001) == 60000 );
+  EXPECT( bmp.find_free_run(2) == 60000 );
+  EXPECT( bmp.find_free_run(3) == -1 );
+  bmp.set(1000);
+  EXPECT( bmp.first_free() == 60000 );
+
+  bmp.zero_all();
+  bmp.set(65535);
+  bmp.set(33000);
+  EXPECT( bmp.next_set(0) == 33000 );
+  EXPECT( bmp.next_set(33001) == 65535 );
+  bmp.flip(33000);
+  EXPECT( bmp.first_set() == 65535 );
+  EXPECT( bmp.last_set() == 65535 );
+}
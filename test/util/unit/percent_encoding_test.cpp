@@ -20,3 +20,25 @@ CASE("uri::decode() throws on invalid input when URI_THROW_ON_ERROR is defined")
 {
   EXPECT_THROWS_AS(std::string s = uri::decode("%2x%zz"), std::runtime_error);
 }
+
+CASE("uri::encode() and uri::decode() round-trip all bytes, in long runs")
+{
+  std::string input;
+  for (int i = 0; i < 4096; i++)
+    input += (i % 97 < 60) ? "abcXYZ019-._~"[i % 13] : static_cast<char>(i * 7);
+  const std::string encoded {uri::encode(input)};
+  EXPECT(encoded.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._~%")
+         == std::string::npos);
+  EXPECT(uri::decode(encoded) == input);
+}
+
+CASE("uri::decode_into() rejects disallowed chars and bad escapes")
+{
+  char out[64];
+  EXPECT(uri::decode_into("a/b?c=d&e=%7E", out) == 11);
+  EXPECT(std::string(out, 11) == "a/b?c=d&e=~");
+  EXPECT(uri::decode_into("abcdefghijklmnopqrstuvwxyz<", out) == -1);
+  EXPECT(uri::decode_into("abcdefghijklmnopqrstuvwxyz%4", out) == -1);
+  EXPECT(uri::decode_into("abcdefghijklmnopqrstuvwxyz%4g", out) == -1);
+  EXPECT(uri::decode_into("abcdefghijklmnopqrstuvwxyz<", out, false) == 27);
+}
@@ -3,6 +3,7 @@
 
 #include <common.cxx>
 #include <util/alloc_pmr.hpp>
+#include <util/pmr_pools.hpp>
 #include <util/units.hpp>
 
 #if __has_include(<experimental/memory_resource>)
@@ -382,3 +383,24 @@ CASE("pmr::default resource cap") {
 
 
 }
+
+CASE("pmr::pool quotas can be set before the per-CPU pools are made")
+{
+  using namespace util;
+  using namespace os::mem;
+  EXPECT(pool_quota(Pool_id::http).total > 0u);
+  EXPECT(pool_quota(Pool_id::dns).total > 0u);
+
+  set_pool_quota(Pool_id::dns, {256_KiB, 64_KiB});
+  const auto quota = pool_quota(Pool_id::dns);
+  EXPECT(quota.total == 256_KiB);
+  EXPECT(quota.per_resource == 64_KiB);
+
+  // cpu_pool() makes its pools just like this, on first use on a CPU
+  Pmr_pool pool{quota.total, quota.per_resource};
+  auto res = pool.get_resource();
+  std::pmr::vector<char> data{res.get()};
+  data.resize(quota.per_resource / 2);
+  EXPECT(res->allocated() >= quota.per_resource / 2);
+  EXPECT_THROWS_AS(data.resize(quota.per_resource * 2), std::bad_alloc);
+}
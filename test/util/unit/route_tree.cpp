@@ -0,0 +1,109 @@
+#include <common.cxx>
+#include <util/route_tree.hpp>
+
+using namespace path2regex;
+
+// The first route whose regex matches, as a router trying each in turn would
+static long first_regex_match(const std::vector<std::pair<std::string, Options>>& routes,
+                              const std::string& path)
+{
+  for (size_t i = 0; i < routes.size(); i++)
+    if (std::regex_search(path, path_to_regex(routes[i].first, routes[i].second)))
+      return i;
+  return -1;
+}
+
+CASE("Route_tree matches text and parameters, capturing them")
+{
+  Route_tree tree;
+  EXPECT(tree.add("/users") == 0u);
+  EXPECT(tree.add("/users/:id") == 1u);
+  EXPECT(tree.add("/users/:id/posts/:post") == 2u);
+  EXPECT(tree.add("/files/:name.:ext") == 3u);
+  EXPECT(tree.add("/static/*") == 4u);
+  EXPECT(tree.regex_routes() == 0u);
+
+  Route_tree::Match m;
+  EXPECT(tree.match("/users", m));
+  EXPECT(m.route == 0u);
+  EXPECT(m.params.empty());
+
+  EXPECT(tree.match("/users/42", m));
+  EXPECT(m.route == 1u);
+  EXPECT(m.params.size() == 1u);
+  EXPECT(m.params[0].first == "id");
+  EXPECT(m.params[0].second == "42");
+
+  EXPECT(tree.match("/USERS/Bob/posts/7/", m));
+  EXPECT(m.route == 2u);
+  EXPECT(m.params[0].second == "Bob");
+  EXPECT(m.params[1].first == "post");
+  EXPECT(m.params[1].second == "7");
+
+  EXPECT(tree.match("/files/report.tar.gz", m));
+  EXPECT(m.route == 3u);
+  EXPECT(m.params[0].second == "report.tar");
+  EXPECT(m.params[1].second == "gz");
+
+  EXPECT(tree.match("/static/css/site.css", m));
+  EXPECT(m.route == 4u);
+  EXPECT(m.params[0].second == "css/site.css");
+
+  EXPECT_NOT(tree.match("/users/42/posts", m));
+  EXPECT_NOT(tree.match("/other", m));
+}
+
+CASE("Route_tree falls back to regex for patterns that need it")
+{
+  Route_tree tree;
+  tree.add("/items/:id(\\d+)");
+  tree.add("/items/:name");
+  tree.add("/maybe/:opt?");
+  EXPECT(tree.regex_routes() == 2u);
+
+  Route_tree::Match m;
+  EXPECT(tree.match("/items/12", m));
+  EXPECT(m.route == 0u);
+  EXPECT(m.params[0].second == "12");
+
+  EXPECT(tree.match("/items/twelve", m));
+  EXPECT(m.route == 1u);
+  EXPECT(m.params[0].second == "twelve");
+
+  EXPECT(tree.match("/maybe", m));
+  EXPECT(m.route == 2u);
+  EXPECT(m.params.empty());
+}
+
+CASE("Route_tree picks the same route as trying each regex in turn")
+{
+  const std::vector<std::pair<std::string, Options>> routes {
+    {"/api/:version/users/:id", {}},
+    {"/api/v1/users/me", {}},
+    {"/api/:version/*", {}},
+    {"/Case/:x", {{"sensitive", true}}},
+    {"/strict/", {{"strict", true}}},
+    {"/loose/", {}},
+    {"/num/:n(\\d+)", {}},
+    {"/prefix", {{"end", false}}},
+    {"/", {}},
+  };
+  Route_tree tree;
+  for (const auto& r : routes)
+    tree.add(r.first, r.second);
+
+  const std::vector<std::string> paths {
+    "/api/v1/users/me", "/api/v2/users/7", "/api/v2/users/7/", "/api/v2/x/y",
+    "/case/a", "/Case/a", "/strict", "/strict/", "/loose", "/loose/", "/num/1",
+    "/num/a", "/prefix/more", "/prefixed", "/", "", "/nothing/here"
+  };
+  for (const auto& path : paths)
+  {
+    Route_tree::Match m;
+    const long expected = first_regex_match(routes, path);
+    const bool found = tree.match(path, m);
+    EXPECT(found == (expected >= 0));
+    if (found)
+      EXPECT(m.route == (size_t) expected);
+  }
+}
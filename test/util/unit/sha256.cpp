@@ -0,0 +1,41 @@
+
+#include <common.cxx>
+#include <util/sha256.hpp>
+
+CASE("SHA-256 test vectors") {
+  SHA256 checksum;
+  EXPECT(checksum.as_hex() == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+  checksum.update("abc");
+  EXPECT(checksum.as_hex() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+  checksum.update("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+  EXPECT(checksum.as_hex() == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+  for (int i = 0; i < 1000000/200; ++i)
+  {
+      checksum.update("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+                      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+                      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+                      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+                     );
+  }
+  EXPECT(checksum.as_hex() == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+CASE("SHA-256 over whole blocks at once and in pieces") {
+  std::string data;
+  for (int i = 0; i < 1000; i++) data += (char) (i * 31);
+
+  const auto whole = SHA256::oneshot_hex(data);
+  SHA256 checksum;
+  for (size_t i = 0; i < data.size(); i += 37)
+    checksum.update(data.substr(i, 37));
+  EXPECT(checksum.as_hex() == whole);
+
+  auto raw = SHA256::oneshot_raw(std::vector<char>(data.begin(), data.end()));
+  EXPECT(raw.size() == 32u);
+  char hex[3];
+  snprintf(hex, sizeof(hex), "%02x", (uint8_t) raw[0]);
+  EXPECT(whole.substr(0, 2) == hex);
+}
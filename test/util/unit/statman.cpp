@@ -241,3 +241,95 @@ CASE("Various stat to_string()")
   EXPECT(stat2.to_string() == std::to_string(1ul));
   EXPECT(stat3.to_string() == std::to_string(1.0f));
 }
+
+CASE("Per-CPU stats are summed up when read")
+{
+  Statman statman_;
+  Stat_percpu& counter = statman_.create_percpu("net.eth0.packets_rx");
+  EXPECT(statman_.size() == 2);
+  Stat& stat = statman_[1];
+  EXPECT(stat.is_percpu());
+  EXPECT(stat.type() == Stat::UINT64);
+  EXPECT(stat.percpu() == &counter);
+  EXPECT(stat.get_uint64() == 0u);
+
+  counter++;
+  ++counter;
+  counter += 40;
+  EXPECT(counter.local() == 42u);
+  EXPECT(counter.total() == 42u);
+  EXPECT(stat.get_uint64() == 42u);
+  EXPECT(stat.to_string() == std::to_string(42ul));
+
+  // incrementing through the Stat counts on this CPU too
+  ++stat;
+  EXPECT(counter.total() == 43u);
+  EXPECT_THROWS(stat.get_uint32());
+
+  counter.reset();
+  EXPECT(stat.get_uint64() == 0u);
+
+  statman_.free(&stat);
+  EXPECT(statman_.size() == 1);
+}
+
+CASE("Stats are found by name, also after others are freed")
+{
+  Statman statman_;
+  Stat& a = statman_.create(Stat::UINT32, "net.eth0.arp.requests_rx");
+  Stat& b = statman_.create(Stat::UINT64, "net.eth0.ip4.packets_rx");
+  EXPECT(&statman_.get_by_name("net.eth0.arp.requests_rx") == &a);
+  EXPECT(&statman_.get_by_name("net.eth0.ip4.packets_rx") == &b);
+  EXPECT_THROWS(statman_.get_by_name("net.eth0.ip4"));
+  EXPECT_THROWS(statman_.get_by_name("net.eth0.ip4.packets_rx.more"));
+
+  statman_.free(&a);
+  EXPECT_THROWS(statman_.get_by_name("net.eth0.arp.requests_rx"));
+  // takes the freed place, and is found in it
+  Stat& c = statman_.create(Stat::FLOAT, "net.eth0.tcp.average");
+  EXPECT(&c == &a);
+  EXPECT(&statman_.get_by_name("net.eth0.tcp.average") == &c);
+  EXPECT(&statman_.get_or_create(Stat::UINT64, "net.eth0.ip4.packets_rx") == &b);
+  EXPECT_THROWS(statman_.get_or_create(Stat::UINT32, "net.eth0.ip4.packets_rx"));
+
+  statman_.clear();
+  EXPECT_THROWS(statman_.get_by_name("net.eth0.ip4.packets_rx"));
+  EXPECT_NO_THROW(statman_.get_by_name("statman.unused_stats"));
+}
+
+CASE("Histograms are read through percentile gauges")
+{
+  Statman statman_;
+  auto& hist = statman_.create_histogram("eth0.tcp.rtt_ns");
+  EXPECT(statman_.size() == 6u);
+  Stat& p50 = statman_.get_by_name("eth0.tcp.rtt_ns.p50");
+  Stat& p999 = statman_.get_by_name("eth0.tcp.rtt_ns.p999");
+  Stat& max = statman_.get_by_name("eth0.tcp.rtt_ns.max");
+  EXPECT(p50.is_histogram());
+  EXPECT(p50.is_gauge());
+  EXPECT(p50.percpu() == nullptr);
+  EXPECT(p50.get_uint64() == 0u);
+
+  for (int i = 1; i <= 1000; i++) hist.at(0).record(i);
+  EXPECT(p50.get_uint64() >= 500u);
+  EXPECT(p50.get_uint64() <= 516u);
+  EXPECT(p999.get_uint64() >= 999u);
+  EXPECT(max.get_uint64() == 1000u);
+  EXPECT(max.to_string() == "1000");
+
+  int seen = 0;
+  statman_.for_each_histogram(
+  [&] (const std::string& name, const util::Histogram_percpu& h) {
+    EXPECT(name == "eth0.tcp.rtt_ns");
+    EXPECT(&h == &hist);
+    seen++;
+  });
+  EXPECT(seen == 1);
+
+  // freeing a gauge leaves the others
+  statman_.free(&p50);
+  EXPECT(statman_.size() == 5u);
+  EXPECT(max.get_uint64() == 1000u);
+  statman_.clear();
+  EXPECT(statman_.size() == 1u);
+}
@@ -110,3 +110,41 @@ CASE("Reading tar.gz inside tar file")
   EXPECT(inner_e.name().find(".tar.gz") == std::string::npos);
   close(fd);
 }
+
+CASE("Looking up elements parses only as far as needed")
+{
+  // three files of 600, 0 and 10 bytes
+  const char* names[] = {"a.txt", "empty.txt", "b.txt"};
+  const size_t sizes[] = {600, 0, 10};
+  std::vector<uint8_t> archive;
+  for (int f = 0; f < 3; f++)
+  {
+    Tar_header header{};
+    strcpy(header.name, names[f]);
+    snprintf(header.size, sizeof(header.size), "%011zo", sizes[f]);
+    header.typeflag = REGTYPE;
+    memcpy(header.magic, TMAGIC, TMAGLEN);
+    const auto* bytes = (const uint8_t*) &header;
+    archive.insert(archive.end(), bytes, bytes + sizeof(header));
+    const size_t blocks = (sizes[f] + tar::SECTOR_SIZE - 1) / tar::SECTOR_SIZE;
+    archive.resize(archive.size() + blocks * tar::SECTOR_SIZE, 'a' + f);
+  }
+  archive.resize(archive.size() + 2 * tar::SECTOR_SIZE);
+
+  tar::Tar tar = tar::Reader::read(archive.data(), archive.size());
+  const auto& a = tar.element("a.txt");
+  EXPECT(a.size() == 600);
+  // the contents are a span into the archive
+  EXPECT(a.data().data() == archive.data() + tar::SECTOR_SIZE);
+  EXPECT(a.data().size() == 600u);
+
+  const auto* b = tar.find("b.txt");
+  EXPECT(b != nullptr);
+  EXPECT(b->data().size() == 10u);
+  EXPECT(b->data()[0] == 'c');
+  // earlier elements stay put as more are parsed
+  EXPECT(&tar.element("a.txt") == &a);
+  EXPECT(tar.element("empty.txt").data().empty());
+  EXPECT(tar.find("missing.txt") == nullptr);
+  EXPECT(tar.num_elements() == 3);
+}
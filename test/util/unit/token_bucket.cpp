@@ -0,0 +1,41 @@
+#include <common.cxx>
+#include <util/token_bucket.hpp>
+
+using util::Token_bucket;
+static constexpr uint64_t MS = 1'000'000;
+
+CASE("Token_bucket lets a burst through, then the rate")
+{
+  Token_bucket bucket{100, 10};
+  uint64_t now = 1000 * MS;
+  int admitted = 0;
+  for (int i = 0; i < 50; i++)
+    admitted += bucket.admit(now);
+  EXPECT(admitted == 10);
+  EXPECT(bucket.limited() == 40u);
+
+  // 100 a second is one token every 10 ms
+  EXPECT(not bucket.admit(now + 5 * MS));
+  EXPECT(bucket.admit(now + 10 * MS));
+  EXPECT(not bucket.admit(now + 10 * MS));
+
+  // after a long while the bucket is full, and no fuller
+  now += 3600'000 * MS;
+  admitted = 0;
+  for (int i = 0; i < 50; i++)
+    admitted += bucket.admit(now);
+  EXPECT(admitted == 10);
+}
+
+CASE("Token_bucket with a rate of 0 admits everything")
+{
+  Token_bucket bucket{0, 1};
+  for (int i = 0; i < 1000; i++)
+    EXPECT(bucket.admit(0));
+  EXPECT(bucket.limited() == 0u);
+
+  bucket.set(1, 1);
+  EXPECT(bucket.rate() == 1u);
+  EXPECT(bucket.admit(0));
+  EXPECT(not bucket.admit(0));
+}
@@ -156,3 +156,42 @@ CASE("operator <")
   res = (uri2 < uri3);
   EXPECT(res == false);
 }
+
+CASE("URI_view parses in place, leaving the parts encoded") {
+  const std::string str {"https://user@www.vg.no:8443/a%20b/c/?x=1&y=%41&z&x=2#frag"};
+  uri::URI_view uri {str};
+  EXPECT(uri.is_valid());
+  EXPECT(uri.scheme() == "https");
+  EXPECT(uri.userinfo() == "user");
+  EXPECT(uri.host() == "www.vg.no");
+  EXPECT(uri.port() == 8443);
+  EXPECT(uri.path() == "/a%20b/c/");
+  EXPECT(uri.query() == "x=1&y=%41&z&x=2");
+  EXPECT(uri.fragment() == "frag");
+  EXPECT(uri.path().data() == str.data() + 27);
+
+  EXPECT(uri.query("x") == "1");
+  EXPECT(uri.query("y") == "%41");
+  EXPECT(uri.query("z").empty());
+  EXPECT(uri.query("z").data() != nullptr);
+  EXPECT(uri.query("w").data() == nullptr);
+
+  std::vector<std::string> params;
+  for (const auto& param : uri.query_params())
+    params.push_back(std::string{param.key} + "=" + std::string{param.value});
+  EXPECT(params == (std::vector<std::string>{"x=1", "y=%41", "z=", "x=2"}));
+
+  std::vector<std::string> segments;
+  for (const auto seg : uri.path_segments())
+    segments.emplace_back(seg);
+  EXPECT(segments == (std::vector<std::string>{"a%20b", "c", ""}));
+}
+
+CASE("URI_view defaults the port, and has no parts when invalid") {
+  EXPECT(uri::URI_view{"http://www.vg.no"}.port() == 80);
+  EXPECT(uri::URI_view{"/"}.path_segments().begin() == uri::URI_view{"/"}.path_segments().end());
+  uri::URI_view bad {"?!?!?!"};
+  EXPECT(not bad.is_valid());
+  EXPECT(bad.path().empty());
+  EXPECT(bad.query_params().begin() == bad.query_params().end());
+}
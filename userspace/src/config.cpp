@@ -28,3 +28,9 @@ const Config& Config::get() noexcept
   assert(config != nullptr);
   return *config;
 }
+
+// config.json is read from the source dir, there is no compiled config
+Config_value Config::compiled() noexcept
+{
+  return {};
+}
@@ -113,7 +113,10 @@ TAP_driver::TAP_driver(const char* devname,
       printf("[TAP] ERROR when setting addr for if\n");
       std::abort();
   }
+}
 
+void TAP_driver::epoll_register()
+{
   // create epoll event
   this->m_epoll = std::make_unique<epoll_event> ();
   m_epoll->events = EPOLLIN;
@@ -124,6 +127,7 @@ TAP_driver::TAP_driver(const char* devname,
 
 TAP_driver::~TAP_driver()
 {
-  linux::epoll_del_fd(this->tun_fd);
+  if (m_epoll != nullptr)
+      linux::epoll_del_fd(this->tun_fd);
   close (this->tun_fd);
 }
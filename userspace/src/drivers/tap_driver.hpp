@@ -16,6 +16,8 @@ struct TAP_driver
 
   void on_read(on_read_func func) { this->m_on_read = std::move(func); }
   int get_fd() const { return tun_fd; }
+  // have the epoll event loop read from us
+  void epoll_register();
   int read (char *buf, int len);
   int write(const void* buf, int len);
 
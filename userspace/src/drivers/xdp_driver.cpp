@@ -0,0 +1,281 @@
+#include "xdp_driver.hpp"
+#include <hw/usernet.hpp>
+#include <linux/bpf.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef AF_XDP
+#define AF_XDP  44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+static void xdp_fail(const char* what)
+{
+  perror(what);
+  std::abort();
+}
+
+static int sys_bpf(int cmd, bpf_attr& attr)
+{
+  return syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+}
+
+template <typename T>
+static void map_ring(int fd, XDP_driver::Ring<T>& ring, const xdp_ring_offset& off,
+                     off_t pgoff, uint32_t entries)
+{
+  ring.map_size = off.desc + entries * sizeof(T);
+  ring.map = mmap(nullptr, ring.map_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (ring.map == MAP_FAILED) xdp_fail("[XDP] ERROR when mapping ring");
+  auto* base    = (uint8_t*) ring.map;
+  ring.producer = (uint32_t*) (base + off.producer);
+  ring.consumer = (uint32_t*) (base + off.consumer);
+  ring.flags    = (uint32_t*) (base + off.flags);
+  ring.descs    = (T*) (base + off.desc);
+  ring.mask     = entries - 1;
+}
+
+template <typename T>
+static void unmap_ring(XDP_driver::Ring<T>& ring)
+{
+  if (ring.map != nullptr) munmap(ring.map, ring.map_size);
+}
+
+static inline uint32_t load_acquire(const uint32_t* p)
+{ return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void store_release(uint32_t* p, uint32_t val)
+{ __atomic_store_n(p, val, __ATOMIC_RELEASE); }
+
+XDP_driver::XDP_driver(const char* devname, int q, UserNet& usernet)
+  : nic{usernet}, m_dev{devname}, queue{q}
+{
+  assert(devname != nullptr);
+  this->ifindex = if_nametoindex(devname);
+  if (ifindex == 0) xdp_fail("[XDP] ERROR when looking up interface");
+
+  auto& store = nic.bufstore();
+  // the UMEM is one region of power-of-2 frames, which the store must
+  // still be at its first pool for
+  assert(store.pools().size() == 1);
+  assert((store.bufsize() & (store.bufsize() - 1)) == 0);
+  this->umem       = store.pools().front();
+  this->frame_size = store.bufsize();
+  tx_frames.resize(store.poolsize() / frame_size);
+
+  this->create_socket();
+  this->attach_program();
+  this->fill();
+}
+
+void XDP_driver::create_socket()
+{
+  xsk_fd = socket(AF_XDP, SOCK_RAW, 0);
+  if (xsk_fd < 0) xdp_fail("[XDP] ERROR when creating AF_XDP socket");
+
+  // the kernel writes frames XDP_PACKET_HEADROOM (or more) into a chunk,
+  // so there must be room for the Packet in front of that
+  xdp_umem_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.addr       = (uint64_t) umem;
+  reg.len        = nic.bufstore().poolsize();
+  reg.chunk_size = frame_size;
+  reg.headroom   = (sizeof(net::Packet) > XDP_PACKET_HEADROOM)
+                 ? sizeof(net::Packet) - XDP_PACKET_HEADROOM : 0;
+  if (setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0)
+    xdp_fail("[XDP] ERROR when registering UMEM");
+
+  const int size = RING_SIZE;
+  if (setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) < 0
+   or setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) < 0
+   or setsockopt(xsk_fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0
+   or setsockopt(xsk_fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0)
+    xdp_fail("[XDP] ERROR when sizing rings");
+
+  xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+  if (getsockopt(xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+    xdp_fail("[XDP] ERROR when getting ring offsets");
+  map_ring(xsk_fd, fill_ring, off.fr, XDP_UMEM_PGOFF_FILL_RING, RING_SIZE);
+  map_ring(xsk_fd, comp_ring, off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, RING_SIZE);
+  map_ring(xsk_fd, rx_ring,   off.rx, XDP_PGOFF_RX_RING, RING_SIZE);
+  map_ring(xsk_fd, tx_ring,   off.tx, XDP_PGOFF_TX_RING, RING_SIZE);
+
+  // zero-copy when the NIC driver can, copying otherwise
+  sockaddr_xdp addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sxdp_family   = AF_XDP;
+  addr.sxdp_flags    = XDP_USE_NEED_WAKEUP;
+  addr.sxdp_ifindex  = ifindex;
+  addr.sxdp_queue_id = queue;
+  if (bind(xsk_fd, (sockaddr*) &addr, sizeof(addr)) < 0)
+    xdp_fail("[XDP] ERROR when binding to interface queue");
+}
+
+void XDP_driver::attach_program()
+{
+  bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size    = sizeof(int);
+  attr.value_size  = sizeof(int);
+  attr.max_entries = std::max(queue + 1, 64);
+  map_fd = sys_bpf(BPF_MAP_CREATE, attr);
+  if (map_fd < 0) xdp_fail("[XDP] ERROR when creating XSKMAP");
+
+  // return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+  const bpf_insn prog[] = {
+    { BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(xdp_md, rx_queue_index), 0 },
+    { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd },
+    { 0, 0, 0, 0, 0 },
+    { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+    { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+    { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+  };
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insn_cnt  = sizeof(prog) / sizeof(prog[0]);
+  attr.insns     = (uint64_t) prog;
+  attr.license   = (uint64_t) "Dual BSD/GPL";
+  prog_fd = sys_bpf(BPF_PROG_LOAD, attr);
+  if (prog_fd < 0) xdp_fail("[XDP] ERROR when loading XDP program");
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = map_fd;
+  attr.key    = (uint64_t) &queue;
+  attr.value  = (uint64_t) &xsk_fd;
+  attr.flags  = BPF_ANY;
+  if (sys_bpf(BPF_MAP_UPDATE_ELEM, attr) < 0)
+    xdp_fail("[XDP] ERROR when adding socket to XSKMAP");
+
+  // the program stays attached for as long as the link is open
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd        = prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type    = BPF_XDP;
+  link_fd = sys_bpf(BPF_LINK_CREATE, attr);
+  if (link_fd < 0) xdp_fail("[XDP] ERROR when attaching XDP program");
+}
+
+void XDP_driver::fill()
+{
+  auto& store = nic.bufstore();
+  uint32_t prod = *fill_ring.producer;
+  uint32_t room = RING_SIZE - (prod - load_acquire(fill_ring.consumer));
+  for (; room > 0; room--)
+  {
+    auto* buffer = store.get_buffer();
+    // a pool the store has grown since is not in the UMEM
+    if (UNLIKELY(store.pool_of(buffer) != umem)) {
+      store.release(buffer);
+      break;
+    }
+    fill_ring.descs[prod++ & fill_ring.mask] = buffer - umem;
+  }
+  store_release(fill_ring.producer, prod);
+}
+
+void XDP_driver::poll()
+{
+  this->complete_tx();
+
+  auto& store = nic.bufstore();
+  uint32_t cons = *rx_ring.consumer;
+  const uint32_t prod = load_acquire(rx_ring.producer);
+  for (; cons != prod; cons++)
+  {
+    const auto& desc = rx_ring.descs[cons & rx_ring.mask];
+    auto* buffer = umem + (desc.addr & ~uint64_t(frame_size - 1));
+    auto* ptr    = (net::Packet*) buffer;
+    // the frame is already in place, after the Packet
+    const int layer_begin = (umem + desc.addr) - (buffer + sizeof(net::Packet));
+    new (ptr) net::Packet(layer_begin, desc.len,
+                          frame_size - sizeof(net::Packet), &store);
+    store_release(rx_ring.consumer, cons + 1);
+    nic.receive(net::Packet_ptr(ptr));
+  }
+  this->fill();
+}
+
+void XDP_driver::complete_tx()
+{
+  uint32_t cons = *comp_ring.consumer;
+  const uint32_t prod = load_acquire(comp_ring.producer);
+  for (; cons != prod; cons++)
+  {
+    const uint64_t addr = comp_ring.descs[cons & comp_ring.mask];
+    // the packet goes back to the BufferStore
+    tx_frames.at(addr / frame_size) = nullptr;
+  }
+  store_release(comp_ring.consumer, cons);
+}
+
+bool XDP_driver::queue_tx(net::Packet_ptr& packet)
+{
+  const uint32_t prod = *tx_ring.producer;
+  if (prod - load_acquire(tx_ring.consumer) >= RING_SIZE) return false;
+
+  auto& desc   = tx_ring.descs[prod & tx_ring.mask];
+  desc.addr    = packet->layer_begin() - umem;
+  desc.len     = packet->size();
+  desc.options = 0;
+  tx_frames.at(desc.addr / frame_size) = std::move(packet);
+  store_release(tx_ring.producer, prod + 1);
+  tx_pending = true;
+  return true;
+}
+
+void XDP_driver::transmit(net::Packet_ptr packet)
+{
+  auto& store = nic.bufstore();
+  if (UNLIKELY(store.pool_of((uint8_t*) packet.get()) != umem))
+  {
+    // not in the UMEM, so it has to be copied into it
+    auto copy = nic.create_packet(0);
+    if (store.pool_of((uint8_t*) copy.get()) != umem) return;
+    memcpy(copy->layer_begin(), packet->layer_begin(), packet->size());
+    copy->set_data_end(packet->size());
+    packet = std::move(copy);
+  }
+  if (not queue_tx(packet))
+  {
+    // make room, or drop it like a NIC with a full ring would
+    this->complete_tx();
+    queue_tx(packet);
+  }
+}
+
+void XDP_driver::flush()
+{
+  if (tx_pending)
+  {
+    tx_pending = false;
+    if (load_acquire(tx_ring.flags) & XDP_RING_NEED_WAKEUP)
+      sendto(xsk_fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+  }
+  this->complete_tx();
+}
+
+XDP_driver::~XDP_driver()
+{
+  // closing the link detaches the program
+  if (link_fd >= 0) close(link_fd);
+  if (prog_fd >= 0) close(prog_fd);
+  if (map_fd >= 0)  close(map_fd);
+  unmap_ring(fill_ring);
+  unmap_ring(comp_ring);
+  unmap_ring(rx_ring);
+  unmap_ring(tx_ring);
+  if (xsk_fd >= 0)  close(xsk_fd);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <net/packet.hpp>
+#include <linux/if_xdp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class UserNet;
+
+/**
+ * An AF_XDP socket on one queue of a NIC, feeding a UserNet.
+ *
+ * The UMEM is the buffer pool of the UserNet's BufferStore, so frames are
+ * received straight into packet buffers and sent out of them, without
+ * copying. A small XDP program on the interface redirects the queue to
+ * the socket, and passes on what arrives on queues without one.
+ * Needs Linux 5.9 (BPF links), and CAP_NET_ADMIN and CAP_BPF.
+ */
+struct XDP_driver
+{
+  // frames in the UMEM, and so buffers in the UserNet's BufferStore
+  static constexpr uint32_t NUM_FRAMES = 4096;
+  static constexpr uint32_t RING_SIZE  = 2048;
+
+  XDP_driver(const char* ifname, int queue, UserNet& nic);
+  ~XDP_driver();
+
+  int get_fd() const { return xsk_fd; }
+
+  // take the received frames, and reclaim the sent ones
+  void poll();
+  // queue a packet to be sent on the next flush()
+  void transmit(net::Packet_ptr);
+  // have the kernel send what is queued, once per event loop iteration
+  void flush();
+
+  template <typename T>
+  struct Ring {
+    uint32_t* producer = nullptr;
+    uint32_t* consumer = nullptr;
+    uint32_t* flags    = nullptr;
+    T*        descs    = nullptr;
+    uint32_t  mask     = 0;
+    void*     map      = nullptr;
+    size_t    map_size = 0;
+  };
+private:
+  void create_socket();
+  void attach_program();
+  void fill();
+  void complete_tx();
+  bool queue_tx(net::Packet_ptr&);
+
+  UserNet&    nic;
+  std::string m_dev;
+  int ifindex;
+  int queue;
+  int xsk_fd  = -1;
+  int map_fd  = -1;
+  int prog_fd = -1;
+  int link_fd = -1;
+  uint8_t* umem = nullptr;
+  uint32_t frame_size;
+  bool tx_pending = false;
+  Ring<uint64_t> fill_ring;
+  Ring<uint64_t> comp_ring;
+  Ring<xdp_desc> rx_ring;
+  Ring<xdp_desc> tx_ring;
+  // the packets being sent, by frame
+  std::vector<net::Packet_ptr> tx_frames;
+};
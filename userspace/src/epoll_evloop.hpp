@@ -1,9 +1,14 @@
 #pragma once
+#include <delegate>
 #include <sys/epoll.h>
 
 namespace linux
 {
   void epoll_add_fd(int fd, epoll_event& event);
+  // call @on_ready whenever @fd is readable
+  void epoll_add_handler(int fd, delegate<void()> on_ready);
   void epoll_del_fd(int fd);
-  void epoll_wait_events();
+  // wait for the TAP devices until the next timer is due, on epoll or
+  // io_uring, whichever they use
+  void wait_events();
 }
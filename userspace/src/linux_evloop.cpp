@@ -1,12 +1,22 @@
 #include "epoll_evloop.hpp"
+#ifdef USERSPACE_IO_URING
+#include "uring_evloop.hpp"
+#endif
 
 #include "drivers/tap_driver.hpp"
+#include "drivers/xdp_driver.hpp"
 #include <hal/machine.hpp>
 #include <hw/usernet.hpp>
 #include <net/inet>
+#include <unordered_map>
 #include <vector>
 
 static std::vector<std::shared_ptr<TAP_driver>> tap_devices;
+static std::vector<std::shared_ptr<XDP_driver>> xdp_devices;
+// the devices do their I/O on io_uring, not epoll
+static bool uring_taps = false;
+// what to do when other FDs on epoll are ready
+static std::unordered_map<int, delegate<void()>> epoll_handlers;
 
 // create TAP device and hook up packet receive to UserNet driver
 void create_network_device(int N, const char* ip)
@@ -19,7 +29,14 @@ void create_network_device(int N, const char* ip)
   // register driver for superstack
   auto driver = std::unique_ptr<hw::Nic> (usernet);
   os::machine().add<hw::Nic> (std::move(driver));
+#ifdef USERSPACE_IO_URING
+  if (linux::uring_attach_tap(*tap, *usernet)) {
+    uring_taps = true;
+    return;
+  }
+#endif
   // connect driver to tap device
+  tap->epoll_register();
   usernet->set_transmit_forward(
     [tap] (net::Packet_ptr packet) {
       tap->write(packet->layer_begin(), packet->size());
@@ -27,6 +44,30 @@ void create_network_device(int N, const char* ip)
   tap->on_read({usernet, &UserNet::receive});
 }
 
+// bind an AF_XDP socket to @queue of NIC @ifname, and hook it up to a
+// UserNet with a BufferStore big enough to be its UMEM
+void create_xdp_device(const char* ifname, int queue)
+{
+  auto* usernet = new UserNet(1500, XDP_driver::NUM_FRAMES);
+  auto driver = std::unique_ptr<hw::Nic> (usernet);
+  os::machine().add<hw::Nic> (std::move(driver));
+
+  auto xdp = std::make_shared<XDP_driver> (ifname, queue, *usernet);
+  xdp_devices.push_back(xdp);
+  usernet->set_transmit_forward(
+    [xdp] (net::Packet_ptr packet) {
+      xdp->transmit(std::move(packet));
+    });
+  const delegate<void()> on_ready {xdp.get(), &XDP_driver::poll};
+#ifdef USERSPACE_IO_URING
+  if (linux::uring_watch_fd(xdp->get_fd(), on_ready)) {
+    uring_taps = true;
+    return;
+  }
+#endif
+  linux::epoll_add_handler(xdp->get_fd(), on_ready);
+}
+
 namespace linux
 {
   static int epoll_init_if_needed()
@@ -51,6 +92,14 @@ namespace linux
       std::abort();
     }
   }
+  void epoll_add_handler(int fd, delegate<void()> on_ready)
+  {
+    epoll_event event;
+    event.events  = EPOLLIN;
+    event.data.fd = fd;
+    epoll_handlers[fd] = std::move(on_ready);
+    epoll_add_fd(fd, event);
+  }
   void epoll_del_fd(int fd)
   {
     const int efd = epoll_init_if_needed();
@@ -61,17 +110,26 @@ namespace linux
       std::abort();
     }
   }
-  void epoll_wait_events()
+  void wait_events()
   {
     // get timeout from time to next timer in timer system
     // NOTE: when next is 0, it means there is no next timer
     const unsigned long long next = Timers::next().count();
     int timeout = (next == 0) ? -1 : (1 + next / 1000000ull);
 
-    if (timeout < 0 && tap_devices.empty()) {
-      printf("epoll_wait_events(): Deadlock reached\n");
+    // send what was queued on the XDP sockets in this iteration
+    for (auto& xdp : xdp_devices) xdp->flush();
+
+    if (timeout < 0 && tap_devices.empty() && xdp_devices.empty()) {
+      printf("wait_events(): Deadlock reached\n");
       std::abort();
     }
+#ifdef USERSPACE_IO_URING
+    if (uring_taps) {
+      uring_wait_events(timeout);
+      return;
+    }
+#endif
 
     const int efd = epoll_init_if_needed();
     std::array<epoll_event, 16> events;
@@ -85,9 +143,14 @@ namespace linux
     }
     for (int i = 0; i < ready; i++)
     {
+      const int fd = events.at(i).data.fd;
+      auto it = epoll_handlers.find(fd);
+      if (it != epoll_handlers.end()) {
+        it->second();
+        continue;
+      }
       for (auto& tap : tap_devices)
       {
-        const int fd = events.at(i).data.fd;
         if (tap->get_fd() == fd)
         {
           char buffer[9000];
@@ -98,5 +161,5 @@ namespace linux
         } // tap devices
       }
     }
-  } // epoll_wait_events()
+  } // wait_events()
 }
@@ -20,7 +20,7 @@ void os::event_loop()
     Timers::timers_handler();
     Events::get().process_events();
 #ifndef PORTABLE_USERSPACE
-    if (kernel::is_running()) linux::epoll_wait_events();
+    if (kernel::is_running()) linux::wait_events();
 #endif
     Events::get().process_events();
   }
@@ -37,6 +37,9 @@ RTC::timestamp_t RTC::booted_at = time(0);
 int SMP::cpu_id() noexcept {
   return 0;
 }
+size_t SMP::early_cpu_total() noexcept {
+  return 1;
+}
 void SMP::global_lock() noexcept {}
 void SMP::global_unlock() noexcept {}
 void SMP::add_task(SMP::task_func, int) {}
@@ -59,7 +62,7 @@ void kernel::start(const char* cmdline)
   rng_absorb(entropy, sizeof(entropy));
   // fake CPU frequency
   kernel::state().cmdline = cmdline;
-  kernel::state().cpu_khz = decltype(os::cpu_freq()) {3000000ul};
+  kernel::set_cpu_freq(decltype(os::cpu_freq()) {3000000ul});
 }
 
 // stdout
@@ -96,6 +99,7 @@ void kernel::init_heap(uintptr_t, uintptr_t) noexcept {
 }
 bool kernel::heap_ready() { return true; }
 bool os::mem::heap_ready() { return true; }
+uint64_t os::nanos_stolen() noexcept { return 0; }
 
 size_t kernel::heap_usage() noexcept {
   return 0;
@@ -107,6 +111,7 @@ uintptr_t kernel::heap_end() noexcept {
   return 0x7FFFFFFF;
 }
 
+#include <cstdlib>
 #include <memory>
 namespace os::mem
 {
@@ -116,4 +121,14 @@ namespace os::mem
   size_t min_psize() {
     return 4096;
   }
+  // the process is left to Linux to place on NUMA nodes
+  int numa_node_of_cpu(int) noexcept {
+    return 0;
+  }
+  void* numa_alloc(size_t size, int) {
+    return aligned_alloc(min_psize(), size);
+  }
+  void numa_free(void* ptr, size_t) {
+    free(ptr);
+  }
 }
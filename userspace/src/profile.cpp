@@ -8,6 +8,10 @@ uint64_t StackSampler::samples_asleep() noexcept {
   return 0;
 }
 void StackSampler::print(int) {}
+std::string StackSampler::folded() {
+  return "";
+}
+void StackSampler::print_folded() {}
 void StackSampler::set_mode(mode_t) {}
 
 std::string HeapDiag::to_string()
@@ -0,0 +1,139 @@
+#include "uring.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace linux
+{
+  static int io_uring_setup(unsigned entries, io_uring_params* p)
+  {
+    return syscall(__NR_io_uring_setup, entries, p);
+  }
+  static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                            unsigned flags, const void* arg, size_t argsz)
+  {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+  }
+  static int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+  {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+  }
+
+  bool Uring::init(unsigned entries)
+  {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    const int fd = io_uring_setup(entries, &p);
+    if (fd < 0) return false;
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    // newer kernels map both rings with one mmap
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sq_size = cq_size = std::max(sq_size, cq_size);
+
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    if (single) {
+      cq_ptr = sq_ptr;
+    }
+    else {
+      cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cq_ptr == MAP_FAILED) {
+        munmap(sq_ptr, sq_size);
+        close(fd);
+        return false;
+      }
+    }
+    sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*) mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      if (not single) munmap(cq_ptr, cq_size);
+      munmap(sq_ptr, sq_size);
+      close(fd);
+      return false;
+    }
+
+    auto* sq = (char*) sq_ptr;
+    sq_head  = (unsigned*) (sq + p.sq_off.head);
+    sq_tail  = (unsigned*) (sq + p.sq_off.tail);
+    sq_mask  = (unsigned*) (sq + p.sq_off.ring_mask);
+    sq_array = (unsigned*) (sq + p.sq_off.array);
+    auto* cq = (char*) cq_ptr;
+    cq_head  = (unsigned*) (cq + p.cq_off.head);
+    cq_tail  = (unsigned*) (cq + p.cq_off.tail);
+    cq_mask  = (unsigned*) (cq + p.cq_off.ring_mask);
+    cqes     = (io_uring_cqe*) (cq + p.cq_off.cqes);
+
+    // entry i always sits in slot i, so the array is filled in once
+    for (unsigned i = 0; i < p.sq_entries; i++) sq_array[i] = i;
+    feats      = p.features;
+    sq_entries = p.sq_entries;
+    sqe_tail   = *sq_tail;
+    ring_fd    = fd;
+    return true;
+  }
+
+  Uring::~Uring()
+  {
+    if (ring_fd < 0) return;
+    munmap(sqes, sqes_size);
+    if (cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+    munmap(sq_ptr, sq_size);
+    close(ring_fd);
+  }
+
+  io_uring_sqe* Uring::get_sqe() noexcept
+  {
+    const unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sqe_tail - head >= sq_entries) return nullptr;
+    auto* sqe = &sqes[sqe_tail & *sq_mask];
+    sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  int Uring::submit(unsigned wait_nr, const __kernel_timespec* timeout)
+  {
+    // publish the new entries, and hand the kernel all it hasn't taken yet
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+    const unsigned to_submit = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 and wait_nr == 0) return 0;
+
+    unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    if (timeout != nullptr)
+    {
+      io_uring_getevents_arg arg;
+      memset(&arg, 0, sizeof(arg));
+      arg.ts = (uint64_t) timeout;
+      flags |= IORING_ENTER_EXT_ARG;
+      ret = io_uring_enter(ring_fd, to_submit, wait_nr, flags, &arg, sizeof(arg));
+    }
+    else {
+      ret = io_uring_enter(ring_fd, to_submit, wait_nr, flags, nullptr, 0);
+    }
+    return (ret < 0) ? -errno : ret;
+  }
+
+  int Uring::register_buffers(const iovec* iov, unsigned count)
+  {
+    const int ret = io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, iov, count);
+    return (ret < 0) ? -errno : ret;
+  }
+
+  int Uring::unregister_buffers()
+  {
+    const int ret = io_uring_register(ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    return (ret < 0) ? -errno : ret;
+  }
+}
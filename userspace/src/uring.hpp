@@ -0,0 +1,78 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstdint>
+
+namespace linux
+{
+  /**
+   * A minimal io_uring, set up with the system calls directly so that
+   * we don't depend on liburing. Only used from the event loop thread.
+   */
+  class Uring {
+  public:
+    Uring() = default;
+    ~Uring();
+
+    // false when the kernel has no io_uring, or isn't letting us use it
+    bool init(unsigned entries);
+    bool ready() const noexcept { return ring_fd >= 0; }
+    // IORING_FEAT_* of the kernel
+    unsigned features() const noexcept { return feats; }
+
+    // a zeroed submission entry, or nullptr when the queue is full
+    io_uring_sqe* get_sqe() noexcept;
+
+    // submit everything queued, and wait for @wait_nr completions, for
+    // at most @timeout when given (needs IORING_FEAT_EXT_ARG)
+    // returns the number submitted, or -errno
+    int submit(unsigned wait_nr = 0, const __kernel_timespec* timeout = nullptr);
+
+    // call @func(user_data, res) on every completion there is
+    template <typename Func>
+    unsigned for_each_cqe(Func func);
+
+    // fixed buffers, for IORING_OP_READ_FIXED and WRITE_FIXED
+    int register_buffers(const iovec*, unsigned count);
+    int unregister_buffers();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+  private:
+    int       ring_fd = -1;
+    unsigned  feats = 0;
+    unsigned  sq_entries = 0;
+    // submission entries handed out, but not yet seen by the kernel
+    unsigned  sqe_tail = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    void*  sq_ptr = nullptr;
+    size_t sq_size = 0;
+    void*  cq_ptr = nullptr;
+    size_t cq_size = 0;
+    size_t sqes_size = 0;
+  };
+
+  template <typename Func>
+  inline unsigned Uring::for_each_cqe(Func func)
+  {
+    unsigned head = *cq_head;
+    const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    const unsigned count = tail - head;
+    for (; head != tail; head++)
+    {
+      const auto& cqe = cqes[head & *cq_mask];
+      func(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return count;
+  }
+}
@@ -0,0 +1,279 @@
+#include "uring_evloop.hpp"
+#include "uring.hpp"
+
+#include "drivers/tap_driver.hpp"
+#include <common>
+#include <hw/usernet.hpp>
+#include <net/packet.hpp>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <poll.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * TAP I/O on io_uring. Every device keeps RX_DEPTH reads queued, straight
+ * into packet buffers from the BufferStore of its UserNet, and packets are
+ * written out from their own buffers without copying. The pools of those
+ * BufferStores are registered with the ring, so that the kernel doesn't
+ * have to map the pages on every read and write. All I/O queued while
+ * handling events is submitted with one system call, which also waits for
+ * the next completions.
+ */
+namespace linux
+{
+  static constexpr unsigned RING_SIZE = 256;
+  // reads kept queued on each device
+  static constexpr unsigned RX_DEPTH  = 32;
+  // writes in flight on each device, more wait in line
+  static constexpr unsigned TX_DEPTH  = 128;
+
+  // user_data: the kind of I/O, the device and the slot
+  enum Op : uint64_t { OP_READ = 1, OP_WRITE = 2, OP_POLL = 3 };
+  static uint64_t make_tag(Op op, uint32_t dev, uint32_t slot) noexcept
+  { return (uint64_t(op) << 56) | (uint64_t(dev) << 32) | slot; }
+
+  static Uring ring;
+  static bool  ring_failed = false;
+
+  // registered buffer index by pool
+  static std::unordered_map<const uint8_t*, uint16_t> fixed_index;
+  static std::vector<iovec> fixed_iovs;
+  static bool fixed_done = false;
+
+  static io_uring_sqe* next_sqe()
+  {
+    auto* sqe = ring.get_sqe();
+    if (UNLIKELY(sqe == nullptr)) {
+      // make room by handing what we have to the kernel
+      ring.submit();
+      sqe = ring.get_sqe();
+    }
+    return sqe;
+  }
+
+  // fill in a read or write of @len bytes at @buf, from a registered
+  // buffer when the packet is in one
+  static void prep_rw(io_uring_sqe* sqe, bool write, int fd,
+                      net::Packet& packet, uint8_t* buf, unsigned len,
+                      net::BufferStore& store)
+  {
+    sqe->fd   = fd;
+    sqe->addr = (uint64_t) buf;
+    sqe->len  = len;
+    // TAP devices have no file position
+    sqe->off  = (uint64_t) -1;
+
+    const auto it = fixed_index.find(store.pool_of((uint8_t*) &packet));
+    if (it != fixed_index.end()) {
+      sqe->opcode    = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->buf_index = it->second;
+    }
+    else {
+      sqe->opcode    = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+  }
+
+  struct Uring_tap
+  {
+    TAP_driver& tap;
+    UserNet&    nic;
+    uint32_t    index;
+    bool        started = false;
+    std::array<net::Packet_ptr, RX_DEPTH> rx;
+    std::array<net::Packet_ptr, TX_DEPTH> tx;
+    std::vector<uint32_t> tx_free;
+    // packets waiting for a write slot
+    std::deque<net::Packet_ptr> tx_wait;
+
+    Uring_tap(TAP_driver& t, UserNet& n, uint32_t idx)
+      : tap{t}, nic{n}, index{idx}
+    {
+      tx_free.reserve(TX_DEPTH);
+      for (uint32_t i = TX_DEPTH; i > 0; i--) tx_free.push_back(i - 1);
+    }
+
+    void start()
+    {
+      for (uint32_t slot = 0; slot < RX_DEPTH; slot++) queue_read(slot);
+      started = true;
+    }
+
+    void queue_read(uint32_t slot)
+    {
+      auto* sqe = next_sqe();
+      if (UNLIKELY(sqe == nullptr)) return;
+      auto packet = nic.create_packet(0);
+      prep_rw(sqe, false, tap.get_fd(), *packet,
+              packet->layer_begin(), packet->capacity(), nic.bufstore());
+      sqe->user_data = make_tag(OP_READ, index, slot);
+      rx[slot] = std::move(packet);
+    }
+
+    void transmit(net::Packet_ptr packet)
+    {
+      if (not tx_wait.empty() or not queue_write(packet))
+        tx_wait.push_back(std::move(packet));
+    }
+
+    bool queue_write(net::Packet_ptr& packet)
+    {
+      if (tx_free.empty()) return false;
+      auto* sqe = next_sqe();
+      if (UNLIKELY(sqe == nullptr)) return false;
+      const uint32_t slot = tx_free.back();
+      tx_free.pop_back();
+      prep_rw(sqe, true, tap.get_fd(), *packet,
+              packet->layer_begin(), packet->size(), nic.bufstore());
+      sqe->user_data = make_tag(OP_WRITE, index, slot);
+      // kept alive until the write is done
+      tx[slot] = std::move(packet);
+      return true;
+    }
+
+    void complete(Op op, uint32_t slot, int res)
+    {
+      if (op == OP_READ)
+      {
+        auto packet = std::move(rx[slot]);
+        if (LIKELY(res > 0)) {
+          packet->set_data_end(res);
+          nic.receive(std::move(packet));
+        }
+        else if (res != -EAGAIN and res != -EINTR) {
+          fprintf(stderr, "[TAP] ERROR when reading: %s\n", strerror(-res));
+          // leave this slot empty, rather than spin on the error
+          return;
+        }
+        queue_read(slot);
+      }
+      else
+      {
+        // the packet goes back to its BufferStore
+        tx[slot] = nullptr;
+        tx_free.push_back(slot);
+        while (not tx_wait.empty() and queue_write(tx_wait.front()))
+          tx_wait.pop_front();
+      }
+    }
+  };
+
+  static std::vector<std::unique_ptr<Uring_tap>> taps;
+
+  // FDs polled for readability, such as AF_XDP sockets
+  struct Watch {
+    int fd;
+    delegate<void()> on_ready;
+    bool armed = false;
+  };
+  static std::vector<Watch> watches;
+
+  static void arm_watch(uint32_t index)
+  {
+    auto* sqe = next_sqe();
+    if (UNLIKELY(sqe == nullptr)) return;
+    sqe->opcode      = IORING_OP_POLL_ADD;
+    sqe->fd          = watches[index].fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data   = make_tag(OP_POLL, 0, index);
+    watches[index].armed = true;
+  }
+
+  static bool uring_init_if_needed()
+  {
+    if (ring.ready()) return true;
+    if (ring_failed)  return false;
+    // the timed wait needs EXT_ARG, from Linux 5.11
+    if (not ring.init(RING_SIZE) or not (ring.features() & IORING_FEAT_EXT_ARG))
+    {
+      fprintf(stderr, "[TAP] io_uring not available, using epoll\n");
+      ring_failed = true;
+      return false;
+    }
+    return true;
+  }
+
+  // register the pools of every device's BufferStore, once all the devices
+  // are there. Pools the stores grow later are read and written unregistered.
+  static void register_buffers()
+  {
+    fixed_done = true;
+    for (auto& t : taps)
+    {
+      auto& store = t->nic.bufstore();
+      for (auto* pool : store.pools())
+      {
+        if (fixed_index.count(pool)) continue;
+        fixed_index.emplace(pool, fixed_iovs.size());
+        fixed_iovs.push_back({pool, store.poolsize()});
+      }
+    }
+    if (fixed_iovs.empty()) return;
+    const int ret = ring.register_buffers(fixed_iovs.data(), fixed_iovs.size());
+    if (ret < 0) {
+      // typically RLIMIT_MEMLOCK, the I/O works without
+      fprintf(stderr, "[TAP] Not using registered buffers: %s\n", strerror(-ret));
+      fixed_index.clear();
+      fixed_iovs.clear();
+    }
+  }
+
+  bool uring_attach_tap(TAP_driver& tap, UserNet& nic)
+  {
+    if (not uring_init_if_needed()) return false;
+
+    const uint32_t index = taps.size();
+    taps.push_back(std::make_unique<Uring_tap>(tap, nic, index));
+    auto* utap = taps.back().get();
+    nic.set_transmit_forward(
+      [utap] (net::Packet_ptr packet) {
+        utap->transmit(std::move(packet));
+      });
+    return true;
+  }
+
+  bool uring_watch_fd(int fd, delegate<void()> on_ready)
+  {
+    if (not uring_init_if_needed()) return false;
+    watches.push_back({fd, std::move(on_ready)});
+    return true;
+  }
+
+  void uring_wait_events(int timeout)
+  {
+    if (UNLIKELY(not fixed_done)) register_buffers();
+    for (auto& t : taps)
+      if (UNLIKELY(not t->started)) t->start();
+    for (uint32_t i = 0; i < watches.size(); i++)
+      if (not watches[i].armed) arm_watch(i);
+
+    __kernel_timespec ts;
+    ts.tv_sec  = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000ll;
+    const int ret = ring.submit(1, (timeout >= 0) ? &ts : nullptr);
+    // ETIME: the timeout expired, EINTR: a signal
+    if (ret < 0 and ret != -ETIME and ret != -EINTR and ret != -EAGAIN and ret != -EBUSY)
+    {
+      fprintf(stderr, "[TAP] ERROR when waiting for io_uring: %s\n", strerror(-ret));
+      std::abort();
+    }
+
+    ring.for_each_cqe(
+      [] (uint64_t tag, int res) {
+        const auto op   = Op(tag >> 56);
+        const auto dev  = uint32_t(tag >> 32) & 0xFFFFFF;
+        const auto slot = uint32_t(tag);
+        if (op == OP_POLL) {
+          // polls fire once, and are armed again before the next wait
+          watches.at(slot).armed = false;
+          watches.at(slot).on_ready();
+          return;
+        }
+        taps.at(dev)->complete(op, slot, res);
+      });
+  }
+}
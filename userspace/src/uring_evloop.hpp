@@ -0,0 +1,16 @@
+#pragma once
+#include <delegate>
+struct TAP_driver;
+class UserNet;
+
+namespace linux
+{
+  // move the packet I/O of @tap onto io_uring
+  // false when io_uring can't be used, and epoll should be
+  bool uring_attach_tap(TAP_driver& tap, UserNet& nic);
+  // call @on_ready whenever @fd is readable, false when io_uring can't be used
+  bool uring_watch_fd(int fd, delegate<void()> on_ready);
+  // submit the queued I/O, then wait up to @timeout ms (-1: forever)
+  // for completions, and handle them
+  void uring_wait_events(int timeout);
+}